@@ -16,18 +16,28 @@
 
 #include "actions/actions-suggestions.h"
 
+#include <algorithm>
+#include <iterator>
 #include <memory>
+#include <unordered_map>
 
 #include "actions/lua-actions.h"
 #include "actions/types.h"
 #include "actions/zlib-utils.h"
 #include "utils/base/logging.h"
+#include "utils/base/tracing.h"
 #include "utils/flatbuffers.h"
+#include "utils/hash/farmhash.h"
 #include "utils/lua-utils.h"
+#include "utils/memory/scratch-arena.h"
+#include "utils/phase-timer.h"
 #include "utils/regex-match.h"
+#include "utils/shared-string-cache.h"
 #include "utils/strings/split.h"
 #include "utils/strings/stringpiece.h"
+#include "utils/utf8/codepoint-offsets.h"
 #include "utils/utf8/unicodetext.h"
+#include "utils/verified-buffers.h"
 #include "utils/zlib/zlib_regex.h"
 #include "tensorflow/lite/string_util.h"
 
@@ -52,9 +62,69 @@ const std::string& ActionsSuggestions::kShareLocation =
 
 namespace {
 
+// Input shape of the interpreters of models that don't resize their inputs.
+constexpr int kFixedInputShape = -1;
+
+// Hands the interpreter of a request back to the pool once the request is
+// done with it.
+class InterpreterReleaser {
+ public:
+  InterpreterReleaser(TfLiteInterpreterPool* pool,
+                      std::unique_ptr<tflite::Interpreter>* interpreter,
+                      const std::vector<int>* input_shape)
+      : pool_(pool), interpreter_(interpreter), input_shape_(input_shape) {}
+
+  ~InterpreterReleaser() {
+    if (pool_ != nullptr) {
+      pool_->Release(std::move(*interpreter_), *input_shape_);
+    }
+  }
+
+ private:
+  TfLiteInterpreterPool* const pool_;
+  std::unique_ptr<tflite::Interpreter>* const interpreter_;
+  const std::vector<int>* const input_shape_;
+};
+
+// Waits for the actions of the annotations that are suggested on a thread
+// pool, and puts them in front of the other actions, where suggesting them on
+// the calling thread would have put them. Merges at the latest when going out
+// of scope, as the task refers to the locals of the request.
+class PendingAnnotationActions {
+ public:
+  PendingAnnotationActions(std::unique_ptr<SharedTask> task,
+                           std::vector<ActionSuggestion>* annotation_actions,
+                           std::vector<ActionSuggestion>* actions)
+      : task_(std::move(task)),
+        annotation_actions_(annotation_actions),
+        actions_(actions) {}
+
+  ~PendingAnnotationActions() { Merge(); }
+
+  void Merge() {
+    if (task_ == nullptr) {
+      return;
+    }
+    task_->Wait();
+    task_.reset();
+    actions_->insert(actions_->begin(),
+                     std::make_move_iterator(annotation_actions_->begin()),
+                     std::make_move_iterator(annotation_actions_->end()));
+  }
+
+ private:
+  std::unique_ptr<SharedTask> task_;
+  std::vector<ActionSuggestion>* const annotation_actions_;
+  std::vector<ActionSuggestion>* const actions_;
+};
+
 const ActionsModel* LoadAndVerifyModel(const uint8_t* addr, int size) {
-  flatbuffers::Verifier verifier(addr, size);
-  if (VerifyActionsModelBuffer(verifier)) {
+  const bool verified =
+      VerifiedBufferRegistry::Instance()->Verify(addr, size, [addr, size]() {
+        flatbuffers::Verifier verifier(addr, size);
+        return VerifyActionsModelBuffer(verifier);
+      });
+  if (verified) {
     return GetActionsModel(addr);
   } else {
     return nullptr;
@@ -79,6 +149,82 @@ int NumMessagesToConsider(const Conversation& conversation,
               : max_conversation_history_length);
 }
 
+// Returns pointers to the tokens of each message.
+std::vector<const std::vector<Token>*> MessageTokenPointers(
+    const std::vector<std::vector<Token>>& tokens) {
+  std::vector<const std::vector<Token>*> message_tokens;
+  message_tokens.reserve(tokens.size());
+  for (const std::vector<Token>& tokens_of_message : tokens) {
+    message_tokens.push_back(&tokens_of_message);
+  }
+  return message_tokens;
+}
+
+// Appends a field to a response cache key, prefixed by its length so that the
+// fields can't run into each other.
+void AppendToResponseCacheKey(const std::string& value, std::string* key) {
+  key->append(std::to_string(value.size()));
+  key->push_back(':');
+  key->append(value);
+}
+
+// Returns the key of the cached response for the last `num_messages` messages
+// of the conversation, a fingerprint of their fields the response depends on,
+// or "" if the response can't be cached because the messages come with
+// annotations.
+std::string ResponseCacheKey(const Conversation& conversation,
+                             const int num_messages,
+                             const Annotator* annotator) {
+  // By instance id rather than address, which a new annotator can reuse.
+  const uint64 annotator_id =
+      annotator != nullptr ? annotator->instance_id() : 0;
+  std::string key(reinterpret_cast<const char*>(&annotator_id),
+                  sizeof(annotator_id));
+  int64 last_message_reference_time_ms_utc = 0;
+  for (int i = conversation.messages.size() - num_messages;
+       i < conversation.messages.size(); ++i) {
+    const ConversationMessage& message = conversation.messages[i];
+    if (!message.annotations.empty()) {
+      return "";
+    }
+    // The model reads the time since the previous message, computed as in
+    // SuggestActionsFromModel.
+    int64 time_diff_ms = 0;
+    if (message.reference_time_ms_utc != 0 &&
+        last_message_reference_time_ms_utc != 0) {
+      time_diff_ms =
+          std::max<int64>(0, message.reference_time_ms_utc -
+                                 last_message_reference_time_ms_utc);
+    }
+    if (message.reference_time_ms_utc != 0) {
+      last_message_reference_time_ms_utc = message.reference_time_ms_utc;
+    }
+    AppendToResponseCacheKey(std::to_string(message.user_id), &key);
+    AppendToResponseCacheKey(message.text, &key);
+    AppendToResponseCacheKey(std::to_string(time_diff_ms), &key);
+    AppendToResponseCacheKey(message.reference_timezone, &key);
+    AppendToResponseCacheKey(message.detected_text_language_tags, &key);
+  }
+  const uint64 fingerprint = tc3farmhash::Fingerprint64(key);
+  return std::string(reinterpret_cast<const char*>(&fingerprint),
+                     sizeof(fingerprint));
+}
+
+// Whether the response can be cached: it didn't stop early and none of its
+// actions has annotations, whose spans refer to the exact text of the
+// messages.
+bool IsCacheableResponse(const ActionsSuggestionsResponse& response) {
+  if (response.is_partial || response.annotation_tiers != ANNOTATION_TIER_ALL) {
+    return false;
+  }
+  for (const ActionSuggestion& action : response.actions) {
+    if (!action.annotations.empty()) {
+      return false;
+    }
+  }
+  return true;
+}
+
 }  // namespace
 
 std::unique_ptr<ActionsSuggestions> ActionsSuggestions::FromUnownedBuffer(
@@ -241,11 +387,13 @@ bool ActionsSuggestions::ValidateAndInitialize() {
     return false;
   }
 
+  std::vector<Locale> locales;
   if (model_->locales() &&
-      !ParseLocales(model_->locales()->c_str(), &locales_)) {
+      !ParseLocales(model_->locales()->c_str(), &locales)) {
     TC3_LOG(ERROR) << "Could not parse model supported locales.";
     return false;
   }
+  locales_ = locale_table_.Add(locales);
 
   if (model_->tflite_model_spec() != nullptr) {
     model_executor_ = TfLiteModelExecutor::FromBuffer(
@@ -254,6 +402,7 @@ bool ActionsSuggestions::ValidateAndInitialize() {
       TC3_LOG(ERROR) << "Could not initialize model executor.";
       return false;
     }
+    interpreter_pool_.reset(new TfLiteInterpreterPool(model_executor_.get()));
   }
 
   if (model_->annotation_actions_spec() != nullptr &&
@@ -264,12 +413,8 @@ bool ActionsSuggestions::ValidateAndInitialize() {
     }
   }
 
-  std::unique_ptr<ZlibDecompressor> decompressor = ZlibDecompressor::Instance();
-  if (!InitializeRules(decompressor.get())) {
-    TC3_LOG(ERROR) << "Could not initialize rules.";
-    return false;
-  }
-
+  // The entity data schema is needed to resolve the entity data fields of the
+  // rules.
   if (model_->actions_entity_data_schema() != nullptr) {
     entity_data_schema_ = LoadAndVerifyFlatbuffer<reflection::Schema>(
         model_->actions_entity_data_schema()->Data(),
@@ -285,15 +430,34 @@ bool ActionsSuggestions::ValidateAndInitialize() {
     entity_data_schema_ = nullptr;
   }
 
+  std::unique_ptr<ZlibDecompressor> decompressor =
+      model_->compression_dictionary() != nullptr &&
+              model_->compression_dictionary()->size() > 0
+          ? ZlibDecompressor::Instance(
+                model_->compression_dictionary()->data(),
+                model_->compression_dictionary()->size())
+          : ZlibDecompressor::Instance();
+  if (!InitializeRules(decompressor.get())) {
+    TC3_LOG(ERROR) << "Could not initialize rules.";
+    return false;
+  }
+
   std::string actions_script;
   if (GetUncompressedString(model_->lua_actions_script(),
                             model_->compressed_lua_actions_script(),
                             decompressor.get(), &actions_script) &&
       !actions_script.empty()) {
-    if (!Compile(actions_script, &lua_bytecode_)) {
+    // The bytecode is shared by all instances loading the same script.
+    lua_bytecode_ = SharedStringCache::Instance()->GetOrCreate(
+        SharedStringCache::Key("lua-bytecode", actions_script),
+        [&actions_script](std::string* bytecode) {
+          return Compile(actions_script, bytecode);
+        });
+    if (lua_bytecode_ == nullptr) {
       TC3_LOG(ERROR) << "Could not precompile lua actions snippet.";
       return false;
     }
+    lua_actions_.reset(new LuaEnvironmentPool<LuaActionsSuggestions>());
   }
 
   if (!(ranker_ = ActionsSuggestionsRanker::CreateActionsSuggestionsRanker(
@@ -330,6 +494,9 @@ bool ActionsSuggestions::ValidateAndInitialize() {
       return false;
     }
     token_embedding_size_ = feature_processor_->GetTokenEmbeddingSize();
+    token_embedding_cache_.reset(
+        new SharedEmbeddingCache(kDefaultTokenEmbeddingCacheCapacity,
+                                 SharedEmbeddingCache::kDefaultNumShards));
   }
 
   // Create low confidence model if specified.
@@ -338,7 +505,11 @@ bool ActionsSuggestions::ValidateAndInitialize() {
                                       feature_processor_ == nullptr
                                           ? nullptr
                                           : feature_processor_->tokenizer(),
-                                      unilib_);
+                                      unilib_,
+                                      feature_processor_ == nullptr
+                                          ? nullptr
+                                          : model_->feature_processor_options()
+                                                ->tokenizer_options());
     if (ngram_model_ == nullptr) {
       TC3_LOG(ERROR) << "Could not create ngram linear regression model.";
       return false;
@@ -419,7 +590,8 @@ bool ActionsSuggestions::EmbedTokenId(const int32 token_id,
 
 bool ActionsSuggestions::InitializeRules(ZlibDecompressor* decompressor) {
   if (model_->rules() != nullptr) {
-    if (!InitializeRules(decompressor, model_->rules(), &rules_)) {
+    if (!InitializeRules(decompressor, model_->rules(), &rules_,
+                         &rule_triggers_)) {
       TC3_LOG(ERROR) << "Could not initialize action rules.";
       return false;
     }
@@ -427,7 +599,8 @@ bool ActionsSuggestions::InitializeRules(ZlibDecompressor* decompressor) {
 
   if (model_->low_confidence_rules() != nullptr) {
     if (!InitializeRules(decompressor, model_->low_confidence_rules(),
-                         &low_confidence_rules_)) {
+                         &low_confidence_rules_,
+                         &low_confidence_rule_triggers_)) {
       TC3_LOG(ERROR) << "Could not initialize low confidence rules.";
       return false;
     }
@@ -447,7 +620,7 @@ bool ActionsSuggestions::InitializeRules(ZlibDecompressor* decompressor) {
     if (!InitializeRules(
             overwrite_decompressor.get(),
             triggering_preconditions_overlay_->low_confidence_rules(),
-            &low_confidence_rules_)) {
+            &low_confidence_rules_, &low_confidence_rule_triggers_)) {
       TC3_LOG(ERROR)
           << "Could not initialize low confidence rules from overwrite.";
       return false;
@@ -459,16 +632,20 @@ bool ActionsSuggestions::InitializeRules(ZlibDecompressor* decompressor) {
 
 bool ActionsSuggestions::InitializeRules(
     ZlibDecompressor* decompressor, const RulesModel* rules,
-    std::vector<CompiledRule>* compiled_rules) const {
+    std::vector<CompiledRule>* compiled_rules,
+    RegexTriggerMatcher* rule_triggers) {
   for (const RulesModel_::Rule* rule : *rules->rule()) {
+    std::string pattern_text;
     std::unique_ptr<UniLib::RegexPattern> compiled_pattern =
         UncompressMakeRegexPattern(
             *unilib_, rule->pattern(), rule->compressed_pattern(),
-            rules->lazy_regex_compilation(), decompressor);
+            rules->lazy_regex_compilation(), decompressor, &pattern_text);
     if (compiled_pattern == nullptr) {
       TC3_LOG(ERROR) << "Failed to load rule pattern.";
       return false;
     }
+    regex_pattern_bytes_ += pattern_text.size();
+    rule_triggers->Add(ExtractRegexTriggers(pattern_text));
 
     // Check whether there is a check on the output.
     std::unique_ptr<UniLib::RegexPattern> compiled_output_pattern;
@@ -483,14 +660,210 @@ bool ActionsSuggestions::InitializeRules(
       }
     }
 
+    // Resolve the entity data fields of the capturing groups once, so that a
+    // match only sets them.
+    std::vector<std::vector<ResolvedFieldPath>> entity_field_paths;
+    if (rule->actions() != nullptr) {
+      for (const RulesModel_::Rule_::RuleActionSpec* rule_action :
+           *rule->actions()) {
+        entity_field_paths.emplace_back();
+        if (rule_action->capturing_group() == nullptr) {
+          continue;
+        }
+        std::vector<ResolvedFieldPath>& group_paths =
+            entity_field_paths.back();
+        group_paths.resize(rule_action->capturing_group()->size());
+        for (int i = 0; i < group_paths.size(); i++) {
+          const FlatbufferFieldPath* entity_field =
+              rule_action->capturing_group()->Get(i)->entity_field();
+          if (entity_field != nullptr && entity_data_builder_ != nullptr &&
+              !entity_data_builder_->ResolveFieldPath(entity_field,
+                                                      &group_paths[i])) {
+            TC3_LOG(ERROR) << "Unknown entity data field of rule.";
+          }
+        }
+      }
+    }
+
     compiled_rules->emplace_back(rule, std::move(compiled_pattern),
-                                 std::move(compiled_output_pattern));
+                                 std::move(compiled_output_pattern),
+                                 std::move(entity_field_paths));
+  }
+
+  return true;
+}
+
+bool ActionsSuggestions::CompileRegexPatterns(ThreadPool* thread_pool) const {
+  std::vector<const UniLib::RegexPattern*> patterns;
+  for (const std::vector<CompiledRule>* compiled_rules :
+       {&rules_, &low_confidence_rules_}) {
+    for (const CompiledRule& rule : *compiled_rules) {
+      patterns.push_back(rule.pattern.get());
+      if (rule.output_pattern != nullptr) {
+        patterns.push_back(rule.output_pattern.get());
+      }
+    }
+  }
+  return libtextclassifier3::CompileRegexPatterns(patterns, thread_pool);
+}
+
+WarmupReport ActionsSuggestions::Warmup() const {
+  WarmupReport report;
+  report.RunPhase("compile_regex_patterns",
+                  [this]() { return CompileRegexPatterns(nullptr); });
+  report.RunPhase("suggest_actions", [this]() {
+    Conversation conversation;
+    conversation.messages.push_back(
+        {/*user_id=*/1, "Are you free tomorrow at 5pm? Call me at 555-0123.",
+         /*reference_time_ms_utc=*/0, /*reference_timezone=*/"UTC",
+         /*annotations=*/{}, /*detected_text_language_tags=*/"en"});
+    conversation.messages.push_back(
+        {kLocalUserId, "Sure, see you then!", /*reference_time_ms_utc=*/0,
+         /*reference_timezone=*/"UTC", /*annotations=*/{},
+         /*detected_text_language_tags=*/"en"});
+    SuggestActions(conversation);
+    return true;
+  });
+  return report;
+}
+
+void ActionsSuggestions::SetTokenEmbeddingCacheCapacity(int max_num_tokens) {
+  if (token_embedding_cache_ != nullptr) {
+    token_embedding_cache_->SetCapacity(max_num_tokens);
+  }
+}
+
+bool ActionsSuggestions::SetTfLiteExecutorOptions(
+    const TfLiteExecutorOptions& options) {
+  if (model_executor_ == nullptr) {
+    return true;
+  }
+  std::unique_ptr<const TfLiteModelExecutor> model_executor =
+      TfLiteModelExecutor::FromBuffer(
+          model_->tflite_model_spec()->tflite_model(), options);
+  if (!model_executor) {
+    TC3_LOG(ERROR) << "Could not rebuild model executor.";
+    return false;
+  }
+  interpreter_pool_.reset(new TfLiteInterpreterPool(
+      model_executor.get(), interpreter_pool_->MaxIdleInterpreters()));
+  model_executor_ = std::move(model_executor);
+  return true;
+}
+
+void ActionsSuggestions::SetResponseCacheOptions(
+    const ResponseCacheOptions& options) {
+  response_cache_num_messages_ = std::max(0, options.num_messages);
+  response_cache_.SetTtlMs(options.ttl_ms);
+  response_cache_.SetCapacity(options.capacity);
+  response_cache_.Clear();
+}
+
+ResultCacheStats ActionsSuggestions::GetResponseCacheStats() const {
+  return response_cache_.GetStats();
+}
+
+void ActionsSuggestions::ClearResponseCache() { response_cache_.Clear(); }
+
+SharedEmbeddingCacheStats ActionsSuggestions::GetTokenEmbeddingCacheStats()
+    const {
+  if (token_embedding_cache_ == nullptr) {
+    return SharedEmbeddingCacheStats();
   }
+  return token_embedding_cache_->GetStats();
+}
 
+MemoryStats ActionsSuggestions::GetMemoryStats() const {
+  MemoryStats stats;
+  if (mmap_ != nullptr && mmap_->handle().ok()) {
+    stats.mapped_bytes = mmap_->handle().num_bytes();
+    stats.resident_bytes = std::max<int64>(0, mmap_->ResidentBytes());
+  }
+  stats.regex_bytes = regex_pattern_bytes_;
+  if (lua_bytecode_ != nullptr) {
+    stats.decompressed_bytes += lua_bytecode_->size();
+  }
+  if (lua_actions_ != nullptr) {
+    stats.lua_bytes += lua_actions_->IdleMemoryUsageBytes();
+  }
+  if (ranker_ != nullptr) {
+    stats.decompressed_bytes += ranker_->LuaBytecodeBytes();
+    stats.lua_bytes += ranker_->IdleLuaMemoryUsageBytes();
+  }
+  if (interpreter_pool_ != nullptr) {
+    stats.interpreter_bytes = interpreter_pool_->IdleTensorBytes();
+  }
+  stats.cache_bytes =
+      GetTokenEmbeddingCacheStats().bytes + GetResponseCacheStats().bytes;
+  return stats;
+}
+
+bool ActionsSuggestions::MeetsInputPreconditions(
+    const Conversation& conversation, const int num_messages,
+    ActionsSuggestionsResponse* response) const {
+  // Bail out if we are provided with too few or too much input.
+  int input_text_length = 0;
+  for (int i = conversation.messages.size() - num_messages;
+       i < conversation.messages.size(); i++) {
+    input_text_length += conversation.messages[i].text.length();
+  }
+  if (input_text_length < preconditions_.min_input_length ||
+      (preconditions_.max_input_length >= 0 &&
+       input_text_length > preconditions_.max_input_length)) {
+    TC3_LOG(INFO) << "Too much or not enough input for inference.";
+    return false;
+  }
+
+  // Bail out if the text does not look like it can be handled by the model.
+  int num_matching_locales = 0;
+  std::vector<Locale> message_languages;
+  for (int i = conversation.messages.size() - num_messages;
+       i < conversation.messages.size(); i++) {
+    message_languages.clear();
+    if (!LocaleListCache::Default()->Parse(
+            conversation.messages[i].detected_text_language_tags,
+            &message_languages)) {
+      continue;
+    }
+    if (locale_table_.IsAnyLocaleSupported(
+            message_languages, locales_,
+            preconditions_.handle_unknown_locale_as_supported)) {
+      ++num_matching_locales;
+    }
+  }
+  const float matching_fraction =
+      static_cast<float>(num_matching_locales) / num_messages;
+  if (matching_fraction < preconditions_.min_locale_match_fraction) {
+    TC3_LOG(INFO) << "Not enough locale matches.";
+    response->output_filtered_locale_mismatch = true;
+    return false;
+  }
   return true;
 }
 
-bool ActionsSuggestions::IsLowConfidenceInput(
+bool ActionsSuggestions::IsLowConfidenceInputByNgrams(
+    const Conversation& conversation, const int num_messages,
+    const std::vector<const std::vector<Token>*>& message_tokens) const {
+  if (ngram_model_ == nullptr) {
+    return false;
+  }
+  for (int i = 1; i <= num_messages; i++) {
+    if (!message_tokens.empty()) {
+      if (ngram_model_->Eval(*message_tokens[num_messages - i])) {
+        return true;
+      }
+      continue;
+    }
+    const std::string& message =
+        conversation.messages[conversation.messages.size() - i].text;
+    if (ngram_model_->Eval(UTF8ToUnicodeText(message, /*do_copy=*/false))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ActionsSuggestions::IsLowConfidenceInputByRules(
     const Conversation& conversation, const int num_messages,
     std::vector<int>* post_check_rules) const {
   for (int i = 1; i <= num_messages; i++) {
@@ -498,18 +871,16 @@ bool ActionsSuggestions::IsLowConfidenceInput(
         conversation.messages[conversation.messages.size() - i].text;
     const UnicodeText message_unicode(
         UTF8ToUnicodeText(message, /*do_copy=*/false));
-
-    // Run ngram linear regression model.
-    if (ngram_model_ != nullptr) {
-      if (ngram_model_->Eval(message_unicode)) {
-        return true;
-      }
-    }
+    std::vector<bool> may_match_rule;
+    low_confidence_rule_triggers_.FindCandidates(message, &may_match_rule);
 
     // Run the regex based rules.
     for (int low_confidence_rule = 0;
          low_confidence_rule < low_confidence_rules_.size();
          low_confidence_rule++) {
+      if (!may_match_rule[low_confidence_rule]) {
+        continue;
+      }
       const CompiledRule& rule = low_confidence_rules_[low_confidence_rule];
       const std::unique_ptr<UniLib::RegexMatcher> matcher =
           rule.pattern->Matcher(message_unicode);
@@ -587,23 +958,108 @@ ActionSuggestion ActionsSuggestions::SuggestionFromSpec(
   return suggestion;
 }
 
-std::vector<std::vector<Token>> ActionsSuggestions::Tokenize(
-    const std::vector<std::string>& context) const {
-  std::vector<std::vector<Token>> tokens;
-  tokens.reserve(context.size());
-  for (const std::string& message : context) {
-    tokens.push_back(feature_processor_->tokenizer()->Tokenize(message));
+std::vector<const std::vector<Token>*> ActionsSuggestions::Tokenize(
+    const std::vector<StringPiece>& context,
+    const std::vector<ConversationSession::MessageState*>& message_states,
+    std::vector<std::vector<Token>>* tokens) const {
+  std::vector<const std::vector<Token>*> message_tokens(context.size());
+  if (message_states.empty()) {
+    tokens->resize(context.size());
+  }
+  for (int i = 0; i < context.size(); i++) {
+    std::vector<Token>* output;
+    if (message_states.empty()) {
+      output = &(*tokens)[i];
+    } else if (message_states[i]->has_tokens) {
+      message_tokens[i] = &message_states[i]->tokens;
+      continue;
+    } else {
+      output = &message_states[i]->tokens;
+      message_states[i]->has_tokens = true;
+    }
+    *output = feature_processor_->tokenizer()->Tokenize(UTF8ToUnicodeText(
+        context[i].data(), context[i].size(), /*do_copy=*/false));
+    message_tokens[i] = output;
   }
-  return tokens;
+  return message_tokens;
+}
+
+bool ActionsSuggestions::AppendTokenEmbedding(
+    const Token& token, std::vector<float>* embeddings) const {
+  const int embedding_offset = embeddings->size();
+  if (token_embedding_cache_ != nullptr && token_embedding_cache_->enabled()) {
+    embeddings->resize(embedding_offset + token_embedding_size_);
+    if (token_embedding_cache_->Lookup(token.value,
+                                       embeddings->data() + embedding_offset,
+                                       token_embedding_size_)) {
+      return true;
+    }
+    embeddings->resize(embedding_offset);
+  }
+
+  if (!feature_processor_->AppendTokenFeatures(
+          token, embedding_executor_.get(), embeddings)) {
+    TC3_LOG(ERROR) << "Could not run token feature extractor.";
+    return false;
+  }
+
+  if (token_embedding_cache_ != nullptr) {
+    token_embedding_cache_->Insert(token.value,
+                                   embeddings->data() + embedding_offset,
+                                   embeddings->size() - embedding_offset);
+  }
+  return true;
+}
+
+bool ActionsSuggestions::AppendTokenEmbeddings(
+    const std::vector<Token>& tokens, const int begin, const int end,
+    ConversationSession::MessageState* state,
+    std::vector<float>* embeddings) const {
+  if (state == nullptr) {
+    for (int pos = begin; pos < end; pos++) {
+      if (!AppendTokenEmbedding(tokens[pos], embeddings)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  if (!state->has_token_embeddings) {
+    state->token_embeddings.clear();
+    state->token_embeddings.reserve(tokens.size() * token_embedding_size_);
+    for (const Token& token : tokens) {
+      if (!AppendTokenEmbedding(token, &state->token_embeddings)) {
+        state->token_embeddings.clear();
+        return false;
+      }
+    }
+    state->has_token_embeddings = true;
+  }
+  embeddings->insert(
+      embeddings->end(),
+      state->token_embeddings.begin() + begin * token_embedding_size_,
+      state->token_embeddings.begin() + end * token_embedding_size_);
+  return true;
 }
 
 bool ActionsSuggestions::EmbedTokensPerMessage(
     const std::vector<std::vector<Token>>& tokens,
-    std::vector<float>* embeddings, int* max_num_tokens_per_message) const {
+    std::vector<float>* embeddings, int* max_num_tokens_per_message,
+    const std::vector<ConversationSession::MessageState*>& message_states)
+    const {
+  return EmbedTokensPerMessage(MessageTokenPointers(tokens), embeddings,
+                               max_num_tokens_per_message, message_states);
+}
+
+bool ActionsSuggestions::EmbedTokensPerMessage(
+    const std::vector<const std::vector<Token>*>& tokens,
+    std::vector<float>* embeddings, int* max_num_tokens_per_message,
+    const std::vector<ConversationSession::MessageState*>& message_states)
+    const {
   const int num_messages = tokens.size();
   *max_num_tokens_per_message = 0;
   for (int i = 0; i < num_messages; i++) {
-    const int num_message_tokens = tokens[i].size();
+    const int num_message_tokens = tokens[i]->size();
     if (num_message_tokens > *max_num_tokens_per_message) {
       *max_num_tokens_per_message = num_message_tokens;
     }
@@ -626,17 +1082,18 @@ bool ActionsSuggestions::EmbedTokensPerMessage(
   // If a number of tokens is specified in the model config, tokens at the
   // beginning of a message are dropped if they don't fit in the limit.
   for (int i = 0; i < num_messages; i++) {
+    const std::vector<Token>& message_tokens = *tokens[i];
     const int start =
-        std::max<int>(tokens[i].size() - *max_num_tokens_per_message, 0);
-    for (int pos = start; pos < tokens[i].size(); pos++) {
-      if (!feature_processor_->AppendTokenFeatures(
-              tokens[i][pos], embedding_executor_.get(), embeddings)) {
-        TC3_LOG(ERROR) << "Could not run token feature extractor.";
-        return false;
-      }
+        std::max<int>(message_tokens.size() - *max_num_tokens_per_message, 0);
+    if (!AppendTokenEmbeddings(
+            message_tokens, start, message_tokens.size(),
+            message_states.empty() ? nullptr : message_states[i],
+            embeddings)) {
+      return false;
     }
     // Add padding.
-    for (int k = tokens[i].size(); k < *max_num_tokens_per_message; k++) {
+    for (int k = message_tokens.size(); k < *max_num_tokens_per_message;
+         k++) {
       embeddings->insert(embeddings->end(), embedded_padding_token_.begin(),
                          embedded_padding_token_.end());
     }
@@ -646,8 +1103,19 @@ bool ActionsSuggestions::EmbedTokensPerMessage(
 }
 
 bool ActionsSuggestions::EmbedAndFlattenTokens(
-    const std::vector<std::vector<Token>> tokens,
-    std::vector<float>* embeddings, int* total_token_count) const {
+    const std::vector<std::vector<Token>>& tokens,
+    std::vector<float>* embeddings, int* total_token_count,
+    const std::vector<ConversationSession::MessageState*>& message_states)
+    const {
+  return EmbedAndFlattenTokens(MessageTokenPointers(tokens), embeddings,
+                               total_token_count, message_states);
+}
+
+bool ActionsSuggestions::EmbedAndFlattenTokens(
+    const std::vector<const std::vector<Token>*>& tokens,
+    std::vector<float>* embeddings, int* total_token_count,
+    const std::vector<ConversationSession::MessageState*>& message_states)
+    const {
   const int num_messages = tokens.size();
   int start_message = 0;
   int message_token_offset = 0;
@@ -661,7 +1129,7 @@ bool ActionsSuggestions::EmbedAndFlattenTokens(
     start_message = num_messages - 1;
     for (; start_message >= 0; start_message--) {
       // Tokens of the message + start and end token.
-      const int num_message_tokens = tokens[start_message].size() + 2;
+      const int num_message_tokens = tokens[start_message]->size() + 2;
       total_tokens += num_message_tokens;
 
       // Check whether we exhausted the budget.
@@ -682,14 +1150,15 @@ bool ActionsSuggestions::EmbedAndFlattenTokens(
                          embedded_start_token_.end());
     }
 
-    for (int pos = std::max(0, message_token_offset - 1);
-         pos < tokens[i].size(); pos++) {
-      ++(*total_token_count);
-      if (!feature_processor_->AppendTokenFeatures(
-              tokens[i][pos], embedding_executor_.get(), embeddings)) {
-        TC3_LOG(ERROR) << "Could not run token feature extractor.";
-        return false;
-      }
+    const std::vector<Token>& message_tokens = *tokens[i];
+    const int start = std::min<int>(std::max(0, message_token_offset - 1),
+                                    message_tokens.size());
+    *total_token_count += message_tokens.size() - start;
+    if (!AppendTokenEmbeddings(
+            message_tokens, start, message_tokens.size(),
+            message_states.empty() ? nullptr : message_states[i],
+            embeddings)) {
+      return false;
     }
 
     // Add `end message` token.
@@ -712,10 +1181,30 @@ bool ActionsSuggestions::EmbedAndFlattenTokens(
   return true;
 }
 
-bool ActionsSuggestions::AllocateInput(const int conversation_length,
-                                       const int max_tokens,
-                                       const int total_token_count,
-                                       tflite::Interpreter* interpreter) const {
+bool ActionsSuggestions::AllocateInput(
+    const int conversation_length, const int max_tokens,
+    const int total_token_count,
+    std::unique_ptr<tflite::Interpreter>* model_interpreter,
+    std::vector<int>* input_shape) const {
+  std::vector<int> shape;
+  if (model_->tflite_model_spec()->resize_inputs()) {
+    shape = {conversation_length, max_tokens, total_token_count};
+  } else {
+    shape = {kFixedInputShape};
+  }
+  bool allocated = false;
+  *model_interpreter = interpreter_pool_->Acquire(shape, &allocated);
+  if (!*model_interpreter) {
+    TC3_LOG(ERROR) << "Could not build TensorFlow Lite interpreter for the "
+                      "actions suggestions model.";
+    return false;
+  }
+  if (allocated) {
+    *input_shape = shape;
+    return true;
+  }
+
+  tflite::Interpreter* interpreter = model_interpreter->get();
   if (model_->tflite_model_spec()->resize_inputs()) {
     if (model_->tflite_model_spec()->input_context() >= 0) {
       interpreter->ResizeInputTensor(
@@ -753,17 +1242,25 @@ bool ActionsSuggestions::AllocateInput(const int conversation_length,
     }
   }
 
-  return interpreter->AllocateTensors() == kTfLiteOk;
+  if (interpreter->AllocateTensors() != kTfLiteOk) {
+    return false;
+  }
+  *input_shape = shape;
+  return true;
 }
 
 bool ActionsSuggestions::SetupModelInput(
-    const std::vector<std::string>& context, const std::vector<int>& user_ids,
+    const std::vector<StringPiece>& context, const std::vector<int>& user_ids,
     const std::vector<float>& time_diffs, const int num_suggestions,
     const float confidence_threshold, const float diversification_distance,
     const float empirical_probability_factor,
-    tflite::Interpreter* interpreter) const {
+    const std::vector<ConversationSession::MessageState*>& message_states,
+    const std::vector<const std::vector<Token>*>& message_tokens,
+    std::unique_ptr<tflite::Interpreter>* model_interpreter,
+    std::vector<int>* input_shape) const {
   // Compute token embeddings.
-  std::vector<std::vector<Token>> tokens;
+  std::vector<std::vector<Token>> owned_tokens;
+  std::vector<const std::vector<Token>*> tokens;
   std::vector<float> token_embeddings;
   std::vector<float> flattened_token_embeddings;
   int max_tokens = 0;
@@ -777,16 +1274,19 @@ bool ActionsSuggestions::SetupModelInput(
     }
 
     // Tokenize the messages in the conversation.
-    tokens = Tokenize(context);
+    tokens = message_tokens.empty()
+                 ? Tokenize(context, message_states, &owned_tokens)
+                 : message_tokens;
     if (model_->tflite_model_spec()->input_token_embeddings() >= 0) {
-      if (!EmbedTokensPerMessage(tokens, &token_embeddings, &max_tokens)) {
+      if (!EmbedTokensPerMessage(tokens, &token_embeddings, &max_tokens,
+                                 message_states)) {
         TC3_LOG(ERROR) << "Could not extract token features.";
         return false;
       }
     }
     if (model_->tflite_model_spec()->input_flattened_token_embeddings() >= 0) {
       if (!EmbedAndFlattenTokens(tokens, &flattened_token_embeddings,
-                                 &total_token_count)) {
+                                 &total_token_count, message_states)) {
         TC3_LOG(ERROR) << "Could not extract token features.";
         return false;
       }
@@ -794,12 +1294,13 @@ bool ActionsSuggestions::SetupModelInput(
   }
 
   if (!AllocateInput(context.size(), max_tokens, total_token_count,
-                     interpreter)) {
+                     model_interpreter, input_shape)) {
     TC3_LOG(ERROR) << "TensorFlow Lite model allocation failed.";
     return false;
   }
+  tflite::Interpreter* interpreter = model_interpreter->get();
   if (model_->tflite_model_spec()->input_context() >= 0) {
-    model_executor_->SetInput<std::string>(
+    model_executor_->SetInput<StringPiece>(
         model_->tflite_model_spec()->input_context(), context, interpreter);
   }
   if (model_->tflite_model_spec()->input_context_length() >= 0) {
@@ -839,7 +1340,7 @@ bool ActionsSuggestions::SetupModelInput(
   if (model_->tflite_model_spec()->input_num_tokens() >= 0) {
     std::vector<int> num_tokens_per_message(tokens.size());
     for (int i = 0; i < tokens.size(); i++) {
-      num_tokens_per_message[i] = tokens[i].size();
+      num_tokens_per_message[i] = tokens[i]->size();
     }
     model_executor_->SetInput<int>(
         model_->tflite_model_spec()->input_num_tokens(), num_tokens_per_message,
@@ -945,25 +1446,22 @@ bool ActionsSuggestions::ReadModelOutput(
 
 bool ActionsSuggestions::SuggestActionsFromModel(
     const Conversation& conversation, const int num_messages,
-    const ActionSuggestionOptions& options,
+    const ActionSuggestionOptions& options, ConversationSession* session,
+    const std::vector<const std::vector<Token>*>& message_tokens,
     ActionsSuggestionsResponse* response,
-    std::unique_ptr<tflite::Interpreter>* interpreter) const {
+    std::unique_ptr<tflite::Interpreter>* interpreter,
+    std::vector<int>* input_shape) const {
+  TC3_TRACE_SCOPE("ActionsSuggestions::SuggestActionsFromModel");
   TC3_CHECK_LE(num_messages, conversation.messages.size());
 
   if (!model_executor_) {
     return true;
   }
-  *interpreter = model_executor_->CreateInterpreter();
 
-  if (!*interpreter) {
-    TC3_LOG(ERROR) << "Could not build TensorFlow Lite interpreter for the "
-                      "actions suggestions model.";
-    return false;
-  }
-
-  std::vector<std::string> context;
+  std::vector<StringPiece> context;
   std::vector<int> user_ids;
   std::vector<float> time_diffs;
+  std::vector<ConversationSession::MessageState*> message_states;
   context.reserve(num_messages);
   user_ids.reserve(num_messages);
   time_diffs.reserve(num_messages);
@@ -976,6 +1474,9 @@ bool ActionsSuggestions::SuggestActionsFromModel(
     const ConversationMessage& message = conversation.messages[i];
     context.push_back(message.text);
     user_ids.push_back(message.user_id);
+    if (session != nullptr) {
+      message_states.push_back(session->GetOrCreateMessageState(message));
+    }
 
     float time_diff_secs = 0;
     if (message.reference_time_ms_utc != 0 &&
@@ -995,14 +1496,18 @@ bool ActionsSuggestions::SuggestActionsFromModel(
                        preconditions_.confidence_threshold,
                        preconditions_.diversification_distance_threshold,
                        preconditions_.empirical_probability_factor,
-                       interpreter->get())) {
+                       message_states, message_tokens, interpreter,
+                       input_shape)) {
     TC3_LOG(ERROR) << "Failed to setup input for TensorFlow Lite model.";
     return false;
   }
 
-  if ((*interpreter)->Invoke() != kTfLiteOk) {
-    TC3_LOG(ERROR) << "Failed to invoke TensorFlow Lite interpreter.";
-    return false;
+  {
+    TC3_TRACE_SCOPE("Interpreter::Invoke");
+    if ((*interpreter)->Invoke() != kTfLiteOk) {
+      TC3_LOG(ERROR) << "Failed to invoke TensorFlow Lite interpreter.";
+      return false;
+    }
   }
 
   return ReadModelOutput(interpreter->get(), options, response);
@@ -1024,7 +1529,10 @@ AnnotationOptions ActionsSuggestions::AnnotationOptionsForMessage(
 
 void ActionsSuggestions::SuggestActionsFromAnnotations(
     const Conversation& conversation, const ActionSuggestionOptions& options,
-    const Annotator* annotator, std::vector<ActionSuggestion>* actions) const {
+    const Annotator* annotator, ConversationSession* session,
+    const StopCondition* stop, std::vector<ActionSuggestion>* actions,
+    int* annotation_tiers) const {
+  *annotation_tiers = ANNOTATION_TIER_ALL;
   if (model_->annotation_actions_spec() == nullptr ||
       model_->annotation_actions_spec()->annotation_mapping() == nullptr ||
       model_->annotation_actions_spec()->annotation_mapping()->size() == 0) {
@@ -1038,13 +1546,17 @@ void ActionsSuggestions::SuggestActionsFromAnnotations(
       model_->annotation_actions_spec()->max_history_from_last_person();
   const int last_person = conversation.messages.back().user_id;
 
+  // The messages to create actions for, from the last one.
+  std::vector<int> message_indices;
   int num_messages_last_person = 0;
   int num_messages_any_person = 0;
   bool all_from_last_person = true;
   for (int message_index = conversation.messages.size() - 1; message_index >= 0;
        message_index--) {
+    if (ShouldStop(stop)) {
+      break;
+    }
     const ConversationMessage& message = conversation.messages[message_index];
-    std::vector<AnnotatedSpan> annotations = message.annotations;
 
     // Update how many messages we have processed from the last person in the
     // conversation and from any person in the conversation.
@@ -1069,13 +1581,75 @@ void ActionsSuggestions::SuggestActionsFromAnnotations(
         continue;
       }
     }
-
-    if (annotations.empty() && annotator != nullptr) {
-      annotations = annotator->Annotate(message.text,
-                                        AnnotationOptionsForMessage(message));
+    message_indices.push_back(message_index);
+  }
+
+  // The messages without annotations of their own or in the session are
+  // annotated in one batch, which sets up the annotator only once.
+  std::vector<std::vector<AnnotatedSpan>> message_annotations(
+      message_indices.size());
+  std::vector<ConversationSession::MessageState*> batch_states;
+  std::vector<int> batch_indices;
+  std::vector<std::string> batch_texts;
+  std::vector<AnnotationOptions> batch_options;
+  std::vector<int> batch_tiers(message_indices.size(), ANNOTATION_TIER_ALL);
+  for (int i = 0; i < message_indices.size(); ++i) {
+    const ConversationMessage& message =
+        conversation.messages[message_indices[i]];
+    if (!message.annotations.empty() || annotator == nullptr) {
+      message_annotations[i] = message.annotations;
+      continue;
+    }
+    ConversationSession::MessageState* state =
+        session != nullptr ? session->GetOrCreateMessageState(message)
+                           : nullptr;
+    if (state != nullptr && state->has_annotations) {
+      message_annotations[i] = state->annotations;
+      continue;
+    }
+    // The annotation has to stop by the deadline of this call too.
+    AnnotationOptions annotation_options = AnnotationOptionsForMessage(message);
+    annotation_options.cancellation_token = options.cancellation_token;
+    annotation_options.timeout_ms =
+        stop != nullptr ? stop->RemainingTimeoutMs() : 0;
+    annotation_options.degradation_policy = options.degradation_policy;
+    annotation_options.annotation_tiers = &batch_tiers[batch_indices.size()];
+    batch_states.push_back(state);
+    batch_indices.push_back(i);
+    batch_texts.push_back(message.text);
+    batch_options.push_back(std::move(annotation_options));
+  }
+  int num_messages = message_indices.size();
+  if (!batch_texts.empty()) {
+    int num_complete = 0;
+    std::vector<std::vector<AnnotatedSpan>> batch_annotations =
+        annotator->AnnotateBatch(batch_texts, batch_options, &num_complete);
+    for (int j = 0; j < batch_indices.size(); ++j) {
+      message_annotations[batch_indices[j]] = std::move(batch_annotations[j]);
+      *annotation_tiers &= batch_tiers[j];
+      // Partial and degraded annotations are not kept in the session.
+      if (batch_states[j] != nullptr && j < num_complete &&
+          batch_tiers[j] == ANNOTATION_TIER_ALL) {
+        batch_states[j]->annotations = message_annotations[batch_indices[j]];
+        batch_states[j]->has_annotations = true;
+      }
     }
+    // No actions are created past the message at which the annotation
+    // stopped.
+    if (num_complete < batch_indices.size()) {
+      num_messages = batch_indices[num_complete] + 1;
+    }
+  }
+
+  for (int i = 0; i < num_messages; ++i) {
+    const int message_index = message_indices[i];
+    const ConversationMessage& message = conversation.messages[message_index];
+    const std::vector<AnnotatedSpan>& annotations = message_annotations[i];
     std::vector<ActionSuggestionAnnotation> action_annotations;
     action_annotations.reserve(annotations.size());
+    const UnicodeText message_unicode =
+        UTF8ToUnicodeText(message.text, /*do_copy=*/false);
+    const CodepointOffsetIndex message_offsets(message_unicode);
     for (const AnnotatedSpan& annotation : annotations) {
       if (annotation.classification.empty()) {
         continue;
@@ -1087,8 +1661,8 @@ void ActionsSuggestions::SuggestActionsFromAnnotations(
       ActionSuggestionAnnotation action_annotation;
       action_annotation.span = {
           message_index, annotation.span,
-          UTF8ToUnicodeText(message.text, /*do_copy=*/false)
-              .UTF8Substring(annotation.span.first, annotation.span.second)};
+          message_offsets.UTF8Substring(annotation.span.first,
+                                        annotation.span.second)};
       action_annotation.entity = classification_result;
       action_annotation.name = classification_result.collection;
       action_annotations.push_back(action_annotation);
@@ -1150,27 +1724,35 @@ void ActionsSuggestions::SuggestActionsFromAnnotation(
 
 std::vector<int> ActionsSuggestions::DeduplicateAnnotations(
     const std::vector<ActionSuggestionAnnotation>& annotations) const {
-  std::map<std::pair<std::string, std::string>, int> deduplicated_annotations;
-
+  // The kept annotations, in the order in which they first occur, are found by
+  // the hash of their name and text.
+  std::vector<int> result;
+  std::unordered_multimap<uint64, int> kept_by_hash;
   for (int i = 0; i < annotations.size(); i++) {
-    const std::pair<std::string, std::string> key = {annotations[i].name,
-                                                     annotations[i].span.text};
-    auto entry = deduplicated_annotations.find(key);
-    if (entry != deduplicated_annotations.end()) {
-      // Kepp the annotation with the higher score.
-      if (annotations[entry->second].entity.score <
-          annotations[i].entity.score) {
-        entry->second = i;
+    const ActionSuggestionAnnotation& annotation = annotations[i];
+    const uint64 hash = tc3farmhash::Hash64WithSeed(
+        annotation.span.text.data(), annotation.span.text.size(),
+        tc3farmhash::Fingerprint64(annotation.name.data(),
+                                   annotation.name.size()));
+    int* kept = nullptr;
+    const auto range = kept_by_hash.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      const ActionSuggestionAnnotation& other = annotations[result[it->second]];
+      if (other.name == annotation.name &&
+          other.span.text == annotation.span.text) {
+        kept = &result[it->second];
+        break;
+      }
+    }
+    if (kept != nullptr) {
+      // Keep the annotation with the higher score.
+      if (annotations[*kept].entity.score < annotation.entity.score) {
+        *kept = i;
       }
       continue;
     }
-    deduplicated_annotations.insert(entry, {key, i});
-  }
-
-  std::vector<int> result;
-  result.reserve(deduplicated_annotations.size());
-  for (const auto& key_and_annotation : deduplicated_annotations) {
-    result.push_back(key_and_annotation.second);
+    kept_by_hash.emplace(hash, result.size());
+    result.push_back(i);
   }
   return result;
 }
@@ -1216,13 +1798,21 @@ bool ActionsSuggestions::SuggestActionsFromRules(
   const std::string& message = conversation.messages.back().text;
   const UnicodeText message_unicode(
       UTF8ToUnicodeText(message, /*do_copy=*/false));
-  for (const CompiledRule& rule : rules_) {
+  std::vector<bool> may_match_rule;
+  rule_triggers_.FindCandidates(message, &may_match_rule);
+  for (int rule_id = 0; rule_id < rules_.size(); rule_id++) {
+    if (!may_match_rule[rule_id]) {
+      continue;
+    }
+    const CompiledRule& rule = rules_[rule_id];
     const std::unique_ptr<UniLib::RegexMatcher> matcher =
         rule.pattern->Matcher(message_unicode);
     int status = UniLib::RegexMatcher::kNoError;
     while (matcher->Find(&status) && status == UniLib::RegexMatcher::kNoError) {
-      for (const RulesModel_::Rule_::RuleActionSpec* rule_action :
-           *rule.rule->actions()) {
+      for (int action_index = 0; action_index < rule.rule->actions()->size();
+           action_index++) {
+        const RulesModel_::Rule_::RuleActionSpec* rule_action =
+            rule.rule->actions()->Get(action_index);
         const ActionSuggestionSpec* action = rule_action->action();
         std::vector<ActionSuggestionAnnotation> annotations;
 
@@ -1242,14 +1832,18 @@ bool ActionsSuggestions::SuggestActionsFromRules(
 
         // Add entity data from rule capturing groups.
         if (rule_action->capturing_group() != nullptr) {
-          for (const RulesModel_::Rule_::RuleActionSpec_::RuleCapturingGroup*
-                   group : *rule_action->capturing_group()) {
+          for (int group_index = 0;
+               group_index < rule_action->capturing_group()->size();
+               group_index++) {
+            const RulesModel_::Rule_::RuleActionSpec_::RuleCapturingGroup*
+                group = rule_action->capturing_group()->Get(group_index);
             if (group->entity_field() != nullptr) {
               TC3_CHECK(entity_data != nullptr);
               sets_entity_data = true;
               if (!SetFieldFromCapturingGroup(
-                      group->group_id(), group->entity_field(), matcher.get(),
-                      entity_data.get())) {
+                      group->group_id(),
+                      rule.entity_field_paths[action_index][group_index],
+                      matcher.get(), entity_data.get())) {
                 TC3_LOG(ERROR)
                     << "Could not set entity data from rule capturing group.";
                 return false;
@@ -1303,24 +1897,36 @@ bool ActionsSuggestions::SuggestActionsFromLua(
     const tflite::Interpreter* interpreter,
     const reflection::Schema* annotation_entity_data_schema,
     std::vector<ActionSuggestion>* actions) const {
-  if (lua_bytecode_.empty()) {
+  if (lua_bytecode_ == nullptr) {
     return true;
   }
+  TC3_TRACE_SCOPE("ActionsSuggestions::SuggestActionsFromLua");
 
-  auto lua_actions = LuaActionsSuggestions::CreateLuaActionsSuggestions(
-      lua_bytecode_, conversation, model_executor, model_->tflite_model_spec(),
-      interpreter, entity_data_schema_, annotation_entity_data_schema);
-  if (lua_actions == nullptr) {
+  LuaEnvironmentPool<LuaActionsSuggestions>::Lease lua_actions =
+      lua_actions_->Acquire();
+  if (lua_actions == nullptr ||
+      !lua_actions->HasSchemas(entity_data_schema_,
+                               annotation_entity_data_schema)) {
+    lua_actions = LuaActionsSuggestions::CreateLuaActionsSuggestions(
+        *lua_bytecode_, entity_data_schema_, annotation_entity_data_schema);
+  }
+  if (lua_actions == nullptr ||
+      !lua_actions->BindRequest(conversation, model_executor,
+                                model_->tflite_model_spec(), interpreter)) {
     TC3_LOG(ERROR) << "Could not create lua actions.";
     return false;
   }
-  return lua_actions->SuggestActions(actions);
+  if (!lua_actions->SuggestActions(actions)) {
+    return false;
+  }
+  lua_actions_->Release(std::move(lua_actions));
+  return true;
 }
 
 bool ActionsSuggestions::GatherActionsSuggestions(
     const Conversation& conversation, const Annotator* annotator,
-    const ActionSuggestionOptions& options,
-    ActionsSuggestionsResponse* response) const {
+    const ActionSuggestionOptions& options, ConversationSession* session,
+    const StopCondition* stop, ActionsSuggestionsResponse* response) const {
   if (conversation.messages.empty()) {
     return true;
   }
@@ -1333,56 +1939,108 @@ bool ActionsSuggestions::GatherActionsSuggestions(
     return false;
   }
 
-  SuggestActionsFromAnnotations(conversation, options, annotator,
-                                &response->actions);
-
-  int input_text_length = 0;
-  int num_matching_locales = 0;
-  for (int i = conversation.messages.size() - num_messages;
-       i < conversation.messages.size(); i++) {
-    input_text_length += conversation.messages[i].text.length();
-    std::vector<Locale> message_languages;
-    if (!ParseLocales(conversation.messages[i].detected_text_language_tags,
-                      &message_languages)) {
-      continue;
-    }
-    if (Locale::IsAnyLocaleSupported(
-            message_languages, locales_,
-            preconditions_.handle_unknown_locale_as_supported)) {
-      ++num_matching_locales;
+  // With a thread pool, the messages are annotated on it while the model runs.
+  // The states of the messages are created beforehand, so that the two don't
+  // modify the session at the same time.
+  std::vector<ActionSuggestion> annotation_actions;
+  std::unique_ptr<SharedTask> annotation_task;
+  if (options.thread_pool != nullptr) {
+    if (session != nullptr) {
+      for (const ConversationMessage& message : conversation.messages) {
+        session->GetOrCreateMessageState(message);
+      }
     }
+    annotation_task.reset(new SharedTask([this, &conversation, &options,
+                                          annotator, session, stop,
+                                          &annotation_actions, response]() {
+      ScopedPhaseTimer timer(options.phase_times,
+                             &ActionsPhaseTimes::annotations_us);
+      SuggestActionsFromAnnotations(conversation, options, annotator, session,
+                                    stop, &annotation_actions,
+                                    &response->annotation_tiers);
+      return true;
+    }));
+    annotation_task->ScheduleOn(options.thread_pool);
+  } else {
+    ScopedPhaseTimer timer(options.phase_times,
+                           &ActionsPhaseTimes::annotations_us);
+    SuggestActionsFromAnnotations(conversation, options, annotator, session,
+                                  stop, &response->actions,
+                                  &response->annotation_tiers);
+  }
+  PendingAnnotationActions pending_annotation_actions(
+      std::move(annotation_task), &annotation_actions, &response->actions);
+
+  // The preconditions are checked from the cheapest to the most expensive,
+  // so that a rejected conversation is neither tokenized nor run through the
+  // model: first the length and the locales of the input, then the low
+  // confidence rules, and only then the n-gram model on the tokens.
+  if (!MeetsInputPreconditions(conversation, num_messages, response)) {
+    return true;
   }
 
-  // Bail out if we are provided with too few or too much input.
-  if (input_text_length < preconditions_.min_input_length ||
-      (preconditions_.max_input_length >= 0 &&
-       input_text_length > preconditions_.max_input_length)) {
-    TC3_LOG(INFO) << "Too much or not enough input for inference.";
-    return response;
-  }
+  // If the n-gram model uses the tokenizer of the feature processor, the
+  // messages are tokenized once for both.
+  std::vector<std::vector<Token>> owned_tokens;
+  std::vector<const std::vector<Token>*> message_tokens;
+  std::vector<int> post_check_rules;
+  if (preconditions_.suppress_on_low_confidence_input) {
+    ScopedPhaseTimer timer(options.phase_times,
+                           &ActionsPhaseTimes::low_confidence_us);
+    if (IsLowConfidenceInputByRules(conversation, num_messages,
+                                    &post_check_rules)) {
+      response->output_filtered_low_confidence = true;
+      return true;
+    }
 
-  // Bail out if the text does not look like it can be handled by the model.
-  const float matching_fraction =
-      static_cast<float>(num_matching_locales) / num_messages;
-  if (matching_fraction < preconditions_.min_locale_match_fraction) {
-    TC3_LOG(INFO) << "Not enough locale matches.";
-    response->output_filtered_locale_mismatch = true;
-    return true;
+    if (ngram_model_ != nullptr && feature_processor_ != nullptr &&
+        ngram_model_->tokenizer() == feature_processor_->tokenizer()) {
+      std::vector<StringPiece> context;
+      std::vector<ConversationSession::MessageState*> message_states;
+      context.reserve(num_messages);
+      for (int i = conversation.messages.size() - num_messages;
+           i < conversation.messages.size(); i++) {
+        context.push_back(conversation.messages[i].text);
+        if (session != nullptr) {
+          message_states.push_back(
+              session->GetOrCreateMessageState(conversation.messages[i]));
+        }
+      }
+      message_tokens = Tokenize(context, message_states, &owned_tokens);
+    }
+
+    if (IsLowConfidenceInputByNgrams(conversation, num_messages,
+                                     message_tokens)) {
+      response->output_filtered_low_confidence = true;
+      return true;
+    }
   }
 
-  std::vector<int> post_check_rules;
-  if (preconditions_.suppress_on_low_confidence_input &&
-      IsLowConfidenceInput(conversation, num_messages, &post_check_rules)) {
-    response->output_filtered_low_confidence = true;
+  // Once the call has to stop, the actions found so far are returned. Before
+  // the model has run, the sensitivity of the conversation is unknown, so
+  // none are returned if a sensitive topic would suppress them.
+  if (ShouldStop(stop)) {
+    if (preconditions_.suppress_on_sensitive_topic) {
+      pending_annotation_actions.Merge();
+      response->actions.clear();
+    }
     return true;
   }
 
   std::unique_ptr<tflite::Interpreter> interpreter;
-  if (!SuggestActionsFromModel(conversation, num_messages, options, response,
-                               &interpreter)) {
-    TC3_LOG(ERROR) << "Could not run model.";
-    return false;
+  std::vector<int> input_shape;
+  const InterpreterReleaser interpreter_releaser(interpreter_pool_.get(),
+                                                 &interpreter, &input_shape);
+  {
+    ScopedPhaseTimer timer(options.phase_times, &ActionsPhaseTimes::model_us);
+    if (!SuggestActionsFromModel(conversation, num_messages, options, session,
+                                 message_tokens, response, &interpreter,
+                                 &input_shape)) {
+      TC3_LOG(ERROR) << "Could not run model.";
+      return false;
+    }
   }
+  pending_annotation_actions.Merge();
 
   // Suppress all predictions if the conversation was deemed sensitive.
   if (preconditions_.suppress_on_sensitive_topic &&
@@ -1390,19 +2048,29 @@ bool ActionsSuggestions::GatherActionsSuggestions(
     return true;
   }
 
-  if (!SuggestActionsFromLua(
-          conversation, model_executor_.get(), interpreter.get(),
-          annotator != nullptr ? annotator->entity_data_schema() : nullptr,
-          &response->actions)) {
-    TC3_LOG(ERROR) << "Could not suggest actions from script.";
-    return false;
+  {
+    ScopedPhaseTimer timer(options.phase_times, &ActionsPhaseTimes::lua_us);
+    if (!ShouldStop(stop) &&
+        !SuggestActionsFromLua(
+            conversation, model_executor_.get(), interpreter.get(),
+            annotator != nullptr ? annotator->entity_data_schema() : nullptr,
+            &response->actions)) {
+      TC3_LOG(ERROR) << "Could not suggest actions from script.";
+      return false;
+    }
   }
 
-  if (!SuggestActionsFromRules(conversation, &response->actions)) {
-    TC3_LOG(ERROR) << "Could not suggest actions from rules.";
-    return false;
+  {
+    ScopedPhaseTimer timer(options.phase_times, &ActionsPhaseTimes::rules_us);
+    if (!ShouldStop(stop) &&
+        !SuggestActionsFromRules(conversation, &response->actions)) {
+      TC3_LOG(ERROR) << "Could not suggest actions from rules.";
+      return false;
+    }
   }
 
+  ScopedPhaseTimer timer(options.phase_times,
+                         &ActionsPhaseTimes::low_confidence_us);
   if (preconditions_.suppress_on_low_confidence_input &&
       !FilterConfidenceOutput(post_check_rules, &response->actions)) {
     TC3_LOG(ERROR) << "Could not post-check actions.";
@@ -1415,16 +2083,56 @@ bool ActionsSuggestions::GatherActionsSuggestions(
 ActionsSuggestionsResponse ActionsSuggestions::SuggestActions(
     const Conversation& conversation, const Annotator* annotator,
     const ActionSuggestionOptions& options) const {
+  return SuggestActions(conversation, annotator, options, /*session=*/nullptr);
+}
+
+ActionsSuggestionsResponse ActionsSuggestions::SuggestActions(
+    const Conversation& conversation, const Annotator* annotator,
+    const ActionSuggestionOptions& options,
+    ConversationSession* session) const {
+  TC3_TRACE_SCOPE("ActionsSuggestions::SuggestActions");
   ActionsSuggestionsResponse response;
-  if (!GatherActionsSuggestions(conversation, annotator, options, &response)) {
+  std::string cache_key;
+  if (response_cache_.enabled()) {
+    cache_key = ResponseCacheKey(
+        conversation,
+        response_cache_num_messages_ > 0
+            ? NumMessagesToConsider(conversation, response_cache_num_messages_)
+            : static_cast<int>(conversation.messages.size()),
+        annotator);
+    if (!cache_key.empty() && response_cache_.Lookup(cache_key, &response)) {
+      if (session != nullptr) {
+        session->RetainMessagesOf(conversation);
+      }
+      return response;
+    }
+  }
+  ScopedScratchArena scratch_arena;
+  const StopCondition stop(options.cancellation_token, options.timeout_ms);
+  bool failed = false;
+  if (!GatherActionsSuggestions(conversation, annotator, options, session,
+                                &stop, &response)) {
     TC3_LOG(ERROR) << "Could not gather actions suggestions.";
     response.actions.clear();
-  } else if (!ranker_->RankActions(conversation, &response, entity_data_schema_,
-                                   annotator != nullptr
-                                       ? annotator->entity_data_schema()
-                                       : nullptr)) {
-    TC3_LOG(ERROR) << "Could not rank actions.";
-    response.actions.clear();
+    failed = true;
+  } else {
+    ScopedPhaseTimer timer(options.phase_times,
+                           &ActionsPhaseTimes::ranking_us);
+    if (!ranker_->RankActions(conversation, &response, entity_data_schema_,
+                              annotator != nullptr
+                                  ? annotator->entity_data_schema()
+                                  : nullptr)) {
+      TC3_LOG(ERROR) << "Could not rank actions.";
+      response.actions.clear();
+      failed = true;
+    }
+  }
+  if (session != nullptr) {
+    session->RetainMessagesOf(conversation);
+  }
+  response.is_partial = stop.stopped();
+  if (!cache_key.empty() && !failed && IsCacheableResponse(response)) {
+    response_cache_.Insert(cache_key, response);
   }
   return response;
 }
@@ -1435,6 +2143,24 @@ ActionsSuggestionsResponse ActionsSuggestions::SuggestActions(
   return SuggestActions(conversation, /*annotator=*/nullptr, options);
 }
 
+std::vector<ActionsSuggestionsResponse> ActionsSuggestions::SuggestActionsBatch(
+    const std::vector<Conversation>& conversations, const Annotator* annotator,
+    const ActionSuggestionOptions& options, ThreadPool* thread_pool) const {
+  std::vector<ActionsSuggestionsResponse> responses(conversations.size());
+  RunInBatches(conversations.size(), thread_pool,
+               [this, &conversations, annotator, &options, &responses](
+                   int begin, int end) {
+                 ActionSuggestionOptions conversation_options = options;
+                 conversation_options.phase_times = nullptr;
+                 for (int i = begin; i < end; ++i) {
+                   responses[i] = SuggestActions(conversations[i], annotator,
+                                                 conversation_options);
+                 }
+                 return true;
+               });
+  return responses;
+}
+
 const ActionsModel* ActionsSuggestions::model() const { return model_; }
 const reflection::Schema* ActionsSuggestions::entity_data_schema() const {
   return entity_data_schema_;
@@ -24,28 +24,109 @@
 #include <vector>
 
 #include "actions/actions_model_generated.h"
+#include "actions/conversation-session.h"
 #include "actions/feature-processor.h"
+#include "actions/lua-actions.h"
 #include "actions/ngram-model.h"
 #include "actions/ranker.h"
 #include "actions/types.h"
 #include "annotator/annotator.h"
 #include "annotator/model-executor.h"
+#include "annotator/result-cache.h"
+#include "annotator/shared-embedding-cache.h"
 #include "annotator/types.h"
+#include "utils/cancellation.h"
 #include "utils/flatbuffers.h"
+#include "utils/i18n/locale-table.h"
 #include "utils/i18n/locale.h"
+#include "utils/lua-utils.h"
+#include "utils/memory/memory-stats.h"
 #include "utils/memory/mmap.h"
+#include "utils/strings/stringpiece.h"
+#include "utils/regex-compilation.h"
+#include "utils/regex-prefilter.h"
+#include "utils/tflite-interpreter-pool.h"
 #include "utils/tflite-model-executor.h"
+#include "utils/thread-pool.h"
 #include "utils/utf8/unilib.h"
 #include "utils/variant.h"
+#include "utils/warmup.h"
 #include "utils/zlib/zlib.h"
 
 namespace libtextclassifier3 {
 
+// Wall time spent by SuggestActions in each of its phases, in microseconds.
+struct ActionsPhaseTimes {
+  // Annotating the messages and suggesting actions from the annotations.
+  int64 annotations_us = 0;
+
+  // Tokenizing the messages and checking them with the low confidence model
+  // and rules.
+  int64 low_confidence_us = 0;
+
+  // Running the TensorFlow Lite model, including the preparation of its input.
+  int64 model_us = 0;
+
+  int64 lua_us = 0;
+  int64 rules_us = 0;
+  int64 ranking_us = 0;
+};
+
 // Options for suggesting actions.
 struct ActionSuggestionOptions {
   static ActionSuggestionOptions Default() { return ActionSuggestionOptions(); }
+
+  // If set, SuggestActions checks it between the messages it annotates and
+  // between its suggestion sources, and returns the actions found so far once
+  // it is cancelled. Not owned, must outlive the call.
+  const CancellationToken* cancellation_token = nullptr;
+
+  // If positive, SuggestActions also returns the actions found so far once it
+  // has run for this many milliseconds. In a batch, the timeout applies to
+  // each conversation.
+  int64 timeout_ms = 0;
+
+  // If set, SuggestActions adds the time it spends in each of its phases to
+  // it. Not owned, must outlive the call. SuggestActionsBatch ignores it, as it
+  // suggests actions for several conversations at the same time.
+  ActionsPhaseTimes* phase_times = nullptr;
+
+  // If set, SuggestActions annotates the messages and suggests the actions of
+  // the annotations on the pool, while it runs the model on the calling
+  // thread. The actions are the same as without a pool. Not owned, must
+  // outlive the call.
+  ThreadPool* thread_pool = nullptr;
+
+  // The degradation policy of the annotation of each message, which skips
+  // the costly annotation tiers under pressure, see DegradationPolicy. The
+  // responses with degraded annotations are not cached.
+  DegradationPolicy degradation_policy;
+};
+
+// Options of the cache of the responses of SuggestActions, for conversations
+// whose last messages repeat a lot (e.g. "Are you coming?").
+struct ResponseCacheOptions {
+  // Maximum number of cached responses. A value of 0 (the default) disables
+  // the cache.
+  int capacity = 0;
+
+  // Number of last messages the responses are keyed by. A value of 0 (the
+  // default) keys them by all the messages, so that the cached actions are the
+  // ones the sources would suggest. Fewer messages get more hits, at the cost
+  // of ignoring the earlier messages of the hits, which e.g. the Lua snippet
+  // and the model may consider.
+  int num_messages = 0;
+
+  // How long a response stays cached, in milliseconds. A value of 0 (the
+  // default) keeps it until it is evicted.
+  int64 ttl_ms = 0;
 };
 
+// Estimated memory of a cached response, see ResultCache.
+inline int64 ApproximateResultBytes(const ActionsSuggestionsResponse& result) {
+  return sizeof(result) + result.actions.capacity() * sizeof(ActionSuggestion);
+}
+
 // Class for predicting actions following a conversation.
 class ActionsSuggestions {
  public:
@@ -105,10 +186,78 @@ class ActionsSuggestions {
       const Conversation& conversation, const Annotator* annotator,
       const ActionSuggestionOptions& options = ActionSuggestionOptions()) const;
 
+  // Same as above, but reuses the tokens, token embeddings and annotations of
+  // the messages that were processed in earlier calls with the session.
+  ActionsSuggestionsResponse SuggestActions(
+      const Conversation& conversation, const Annotator* annotator,
+      const ActionSuggestionOptions& options,
+      ConversationSession* session) const;
+
+  // Suggests actions for many independent conversations, returning one
+  // response per conversation. The conversations are spread over the thread
+  // pool if one is given, otherwise they run on the calling thread.
+  std::vector<ActionsSuggestionsResponse> SuggestActionsBatch(
+      const std::vector<Conversation>& conversations,
+      const Annotator* annotator = nullptr,
+      const ActionSuggestionOptions& options = ActionSuggestionOptions(),
+      ThreadPool* thread_pool = nullptr) const;
+
   const ActionsModel* model() const;
   const reflection::Schema* entity_data_schema() const;
 
+  // Compiles the rule patterns that were created lazily because of
+  // lazy_regex_compilation, concurrently on the thread pool, and waits for
+  // them. Can run concurrently with requests, e.g. from a background thread
+  // after loading. Passing nullptr compiles on the calling thread. Returns
+  // false if a pattern failed to compile.
+  bool CompileRegexPatterns(ThreadPool* thread_pool) const;
+
+  // Gets the model ready to serve: compiles the rule patterns and suggests
+  // actions for a synthetic conversation, which builds the interpreter and the
+  // Lua environments. Returns how long every phase took.
+  WarmupReport Warmup() const;
+
+  // Sets how many token embeddings are kept between calls, so that frequent
+  // tokens don't need to be re-embedded in every request. A value of 0
+  // disables the cache.
+  void SetTokenEmbeddingCacheCapacity(int max_num_tokens);
+
+  // Returns the statistics of the token embedding cache.
+  SharedEmbeddingCacheStats GetTokenEmbeddingCacheStats() const;
+
+  // Sets up the cache of the responses, which returns them without tokenizing
+  // the messages, running the model or ranking the actions again. The
+  // responses are keyed by the user ids, the exact text, the time since the
+  // previous message, the timezone and the detected languages of the last
+  // messages, and by the instance id of the annotator. The absolute times of
+  // the messages aren't part of the key, the time-to-live bounds how long they
+  // are ignored. Responses that stopped early, and those with actions on
+  // annotations, whose spans depend on the exact text, aren't cached. Not
+  // thread-safe, meant to be called after loading, before serving requests.
+  void SetResponseCacheOptions(const ResponseCacheOptions& options);
+
+  // Returns the statistics of the response cache.
+  ResultCacheStats GetResponseCacheStats() const;
+
+  // Drops the cached responses, e.g. after the annotator passed to
+  // SuggestActions was replaced.
+  void ClearResponseCache();
+
+  // Returns the memory held by the model and by the state kept between calls:
+  // the idle interpreters, the token embedding and response caches and the lua
+  // environments. The lua bytecode is shared by the models loading the same
+  // script, and counted in each of them.
+  MemoryStats GetMemoryStats() const;
+
+  // Rebuilds the model executor with the given options, e.g. to pin the model
+  // to one thread or run it on a delegate. Idle interpreters built with the
+  // previous options are dropped. Not thread-safe, meant to be called after
+  // loading, before serving requests. Returns false if the executor couldn't
+  // be rebuilt, in which case the previous one is kept.
+  bool SetTfLiteExecutorOptions(const TfLiteExecutorOptions& options);
+
   static const int kLocalUserId = 0;
+  static const int kDefaultTokenEmbeddingCacheCapacity = 4096;
 
   // Should be in sync with those defined in Android.
   // android/frameworks/base/core/java/android/view/textclassifier/ConversationActions.java
@@ -127,9 +276,20 @@ class ActionsSuggestions {
 
   // Embeds the tokens per message separately. Each message is padded to the
   // maximum length with the padding token.
-  bool EmbedTokensPerMessage(const std::vector<std::vector<Token>>& tokens,
-                             std::vector<float>* embeddings,
-                             int* max_num_tokens_per_message) const;
+  // If given, `message_states` hold the cached state of each message, and
+  // the token embeddings are taken from there or stored there.
+  // The tokens of each message are passed by pointer, so that they can be
+  // taken from the message states without copying them.
+  bool EmbedTokensPerMessage(
+      const std::vector<const std::vector<Token>*>& tokens,
+      std::vector<float>* embeddings, int* max_num_tokens_per_message,
+      const std::vector<ConversationSession::MessageState*>& message_states =
+          {}) const;
+  bool EmbedTokensPerMessage(
+      const std::vector<std::vector<Token>>& tokens,
+      std::vector<float>* embeddings, int* max_num_tokens_per_message,
+      const std::vector<ConversationSession::MessageState*>& message_states =
+          {}) const;
 
   // Concatenates the embedded message tokens - separated by start and end
   // token between messages.
@@ -138,9 +298,16 @@ class ActionsSuggestions {
   // If the total token count is smaller than the minimum length, padding tokens
   // are added to the end.
   // Messages are assumed to be ordered by recency - most recent is last.
-  bool EmbedAndFlattenTokens(const std::vector<std::vector<Token>> tokens,
-                             std::vector<float>* embeddings,
-                             int* total_token_count) const;
+  bool EmbedAndFlattenTokens(
+      const std::vector<const std::vector<Token>*>& tokens,
+      std::vector<float>* embeddings, int* total_token_count,
+      const std::vector<ConversationSession::MessageState*>& message_states =
+          {}) const;
+  bool EmbedAndFlattenTokens(
+      const std::vector<std::vector<Token>>& tokens,
+      std::vector<float>* embeddings, int* total_token_count,
+      const std::vector<ConversationSession::MessageState*>& message_states =
+          {}) const;
 
   const ActionsModel* model_;
 
@@ -152,17 +319,28 @@ class ActionsSuggestions {
   std::vector<float> embedded_end_token_;
   int token_embedding_size_;
 
+  // Finished embeddings of the tokens, including their dense features, which
+  // only depend on the token value.
+  std::unique_ptr<SharedEmbeddingCache> token_embedding_cache_;
+
  private:
   struct CompiledRule {
     const RulesModel_::Rule* rule;
     std::unique_ptr<UniLib::RegexPattern> pattern;
     std::unique_ptr<UniLib::RegexPattern> output_pattern;
+
+    // The entity data fields of the capturing groups of the rule actions,
+    // resolved against the entity data schema, by action and group.
+    std::vector<std::vector<ResolvedFieldPath>> entity_field_paths;
+
     CompiledRule(const RulesModel_::Rule* rule,
                  std::unique_ptr<UniLib::RegexPattern> pattern,
-                 std::unique_ptr<UniLib::RegexPattern> output_pattern)
+                 std::unique_ptr<UniLib::RegexPattern> output_pattern,
+                 std::vector<std::vector<ResolvedFieldPath>> entity_field_paths)
         : rule(rule),
           pattern(std::move(pattern)),
-          output_pattern(std::move(output_pattern)) {}
+          output_pattern(std::move(output_pattern)),
+          entity_field_paths(std::move(entity_field_paths)) {}
   };
 
   // Checks that model contains all required fields, and initializes internal
@@ -171,49 +349,85 @@ class ActionsSuggestions {
 
   void SetOrCreateUnilib(const UniLib* unilib);
 
-  // Initializes regular expression rules.
+  // Initializes regular expression rules. The triggers of the rules are added
+  // to `rule_triggers`, so their ids are the indices of the rules in
+  // `compiled_rules`.
   bool InitializeRules(ZlibDecompressor* decompressor);
   bool InitializeRules(ZlibDecompressor* decompressor, const RulesModel* rules,
-                       std::vector<CompiledRule>* compiled_rules) const;
+                       std::vector<CompiledRule>* compiled_rules,
+                       RegexTriggerMatcher* rule_triggers);
 
   // Prepare preconditions.
   // Takes values from flag provided data, but falls back to model provided
   // values for parameters that are not explicitly provided.
   bool InitializeTriggeringPreconditions();
 
-  // Tokenizes a conversation and produces the tokens per message.
-  std::vector<std::vector<Token>> Tokenize(
-      const std::vector<std::string>& context) const;
-
+  // Tokenizes a conversation and returns the tokens per message. The tokens
+  // are stored in `tokens`, unless the messages have `message_states`, in
+  // which case they are taken from there, or stored there.
+  std::vector<const std::vector<Token>*> Tokenize(
+      const std::vector<StringPiece>& context,
+      const std::vector<ConversationSession::MessageState*>& message_states,
+      std::vector<std::vector<Token>>* tokens) const;
+
+  // Appends the embedding of a token, taking it from the token embedding cache
+  // if possible.
+  bool AppendTokenEmbedding(const Token& token,
+                            std::vector<float>* embeddings) const;
+
+  // Appends the embeddings of the tokens [begin, end) of a message. If the
+  // message has a state, the embeddings of all its tokens are computed once
+  // and kept there.
+  bool AppendTokenEmbeddings(const std::vector<Token>& tokens, int begin,
+                             int end, ConversationSession::MessageState* state,
+                             std::vector<float>* embeddings) const;
+
+  // Checks out an interpreter from the pool and allocates its tensors for the
+  // input, unless the interpreter was already allocated for the same input
+  // shape, which is returned in `input_shape`.
   bool AllocateInput(const int conversation_length, const int max_tokens,
                      const int total_token_count,
-                     tflite::Interpreter* interpreter) const;
+                     std::unique_ptr<tflite::Interpreter>* interpreter,
+                     std::vector<int>* input_shape) const;
 
-  bool SetupModelInput(const std::vector<std::string>& context,
+  // If given, `message_tokens` are the tokens of the messages in the context,
+  // otherwise the messages are tokenized.
+  bool SetupModelInput(const std::vector<StringPiece>& context,
                        const std::vector<int>& user_ids,
                        const std::vector<float>& time_diffs,
                        const int num_suggestions,
                        const float confidence_threshold,
                        const float diversification_distance,
                        const float empirical_probability_factor,
-                       tflite::Interpreter* interpreter) const;
+                       const std::vector<ConversationSession::MessageState*>&
+                           message_states,
+                       const std::vector<const std::vector<Token>*>&
+                           message_tokens,
+                       std::unique_ptr<tflite::Interpreter>* interpreter,
+                       std::vector<int>* input_shape) const;
   bool ReadModelOutput(tflite::Interpreter* interpreter,
                        const ActionSuggestionOptions& options,
                        ActionsSuggestionsResponse* response) const;
 
   bool SuggestActionsFromModel(
       const Conversation& conversation, const int num_messages,
-      const ActionSuggestionOptions& options,
+      const ActionSuggestionOptions& options, ConversationSession* session,
+      const std::vector<const std::vector<Token>*>& message_tokens,
       ActionsSuggestionsResponse* response,
-      std::unique_ptr<tflite::Interpreter>* interpreter) const;
+      std::unique_ptr<tflite::Interpreter>* interpreter,
+      std::vector<int>* input_shape) const;
 
   // Creates options for annotation of a message.
   AnnotationOptions AnnotationOptionsForMessage(
       const ConversationMessage& message) const;
 
+  // Sets 'annotation_tiers' to the tiers that ran for all the messages it
+  // annotates.
   void SuggestActionsFromAnnotations(
       const Conversation& conversation, const ActionSuggestionOptions& options,
-      const Annotator* annotator, std::vector<ActionSuggestion>* actions) const;
+      const Annotator* annotator, ConversationSession* session,
+      const StopCondition* stop, std::vector<ActionSuggestion>* actions,
+      int* annotation_tiers) const;
 
   void SuggestActionsFromAnnotation(
       const int message_index, const ActionSuggestionAnnotation& annotation,
@@ -221,7 +435,8 @@ class ActionsSuggestions {
 
   // Deduplicates equivalent annotations - annotations that have the same type
   // and same span text.
-  // Returns the indices of the deduplicated annotations.
+  // Returns the indices of the deduplicated annotations, in the order in which
+  // the annotations first occur.
   std::vector<int> DeduplicateAnnotations(
       const std::vector<ActionSuggestionAnnotation>& annotations) const;
 
@@ -238,12 +453,29 @@ class ActionsSuggestions {
   bool GatherActionsSuggestions(const Conversation& conversation,
                                 const Annotator* annotator,
                                 const ActionSuggestionOptions& options,
+                                ConversationSession* session,
+                                const StopCondition* stop,
                                 ActionsSuggestionsResponse* response) const;
 
-  // Checks whether the input triggers the low confidence checks.
-  bool IsLowConfidenceInput(const Conversation& conversation,
-                            const int num_messages,
-                            std::vector<int>* post_check_rules) const;
+  // Checks the preconditions on the length and the locales of the last
+  // `num_messages` messages, which only take a pass over them. Marks the
+  // response if the locales don't match.
+  bool MeetsInputPreconditions(const Conversation& conversation,
+                               const int num_messages,
+                               ActionsSuggestionsResponse* response) const;
+
+  // Checks whether the input triggers the low confidence rules. The rules that
+  // only apply to input-output pairs are added to `post_check_rules` instead.
+  bool IsLowConfidenceInputByRules(const Conversation& conversation,
+                                   const int num_messages,
+                                   std::vector<int>* post_check_rules) const;
+
+  // Checks whether the n-gram model finds the input low confidence. If given,
+  // `message_tokens` are the tokens of the last `num_messages` messages,
+  // which the n-gram model then doesn't need to tokenize again.
+  bool IsLowConfidenceInputByNgrams(
+      const Conversation& conversation, const int num_messages,
+      const std::vector<const std::vector<Token>*>& message_tokens) const;
   // Checks and filters suggestions triggering the low confidence post checks.
   bool FilterConfidenceOutput(const std::vector<int>& post_check_rules,
                               std::vector<ActionSuggestion>* actions) const;
@@ -265,14 +497,26 @@ class ActionsSuggestions {
   // Tensorflow Lite models.
   std::unique_ptr<const TfLiteModelExecutor> model_executor_;
 
+  // Interpreters of the model, keyed by the input shape they were allocated
+  // for, so that requests don't rebuild and re-allocate them.
+  std::unique_ptr<TfLiteInterpreterPool> interpreter_pool_;
+
   // Rules.
   std::vector<CompiledRule> rules_, low_confidence_rules_;
 
+  // Literals the rules need to match, looked for in a message in one pass to
+  // only run the rules that can match.
+  RegexTriggerMatcher rule_triggers_, low_confidence_rule_triggers_;
+
+  // Size of the source of the rule patterns.
+  int64 regex_pattern_bytes_ = 0;
+
   std::unique_ptr<UniLib> owned_unilib_;
   const UniLib* unilib_;
 
-  // Locales supported by the model.
-  std::vector<Locale> locales_;
+  // Locales supported by the model, as the only list of locale_table_.
+  LocaleTable locale_table_;
+  int locales_ = -1;
 
   // Annotation entities used by the model.
   std::unordered_set<std::string> annotation_entity_types_;
@@ -282,7 +526,12 @@ class ActionsSuggestions {
   std::unique_ptr<ReflectiveFlatbufferBuilder> entity_data_builder_;
   std::unique_ptr<ActionsSuggestionsRanker> ranker_;
 
-  std::string lua_bytecode_;
+  // Compiled actions snippet, nullptr if the model doesn't have one.
+  std::shared_ptr<const std::string> lua_bytecode_;
+
+  // Idle lua environments with the actions snippet loaded, reused across
+  // requests.
+  std::unique_ptr<LuaEnvironmentPool<LuaActionsSuggestions>> lua_actions_;
 
   // Triggering preconditions. These parameters can be backed by the model and
   // (partially) be provided by flags.
@@ -292,6 +541,10 @@ class ActionsSuggestions {
 
   // Low confidence input ngram classifier.
   std::unique_ptr<const NGramModel> ngram_model_;
+
+  // Responses of earlier calls, see SetResponseCacheOptions.
+  mutable ResultCache<ActionsSuggestionsResponse> response_cache_;
+  int response_cache_num_messages_ = 0;
 };
 
 // Interprets the buffer as a Model flatbuffer and returns it for reading.
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "actions/actions-suggestions.h"
+#include "annotator/annotator.h"
+#include "utils/testing/benchmark-utils.h"
+#include "benchmark/benchmark.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+// Returns the conversations of the corpus: the chat messages form one
+// conversation between two users, longer texts are a message each.
+std::vector<Conversation> CorpusConversations(BenchmarkCorpus corpus) {
+  const std::vector<std::string>& texts = BenchmarkCorpusTexts(corpus);
+  std::vector<Conversation> conversations;
+  if (corpus == BenchmarkCorpus::kChat) {
+    conversations.emplace_back();
+    for (int i = 0; i < texts.size(); ++i) {
+      conversations.back().messages.push_back(
+          {/*user_id=*/i % 2, texts[i],
+           /*reference_time_ms_utc=*/1560000000000 + i * 60000,
+           /*reference_timezone=*/"Europe/Zurich", /*annotations=*/{},
+           /*detected_text_language_tags=*/"en"});
+    }
+  } else {
+    for (const std::string& text : texts) {
+      conversations.push_back(
+          {{{/*user_id=*/1, text, /*reference_time_ms_utc=*/1560000000000,
+             /*reference_timezone=*/"Europe/Zurich", /*annotations=*/{},
+             /*detected_text_language_tags=*/"en"}}});
+    }
+  }
+  return conversations;
+}
+
+const ActionsSuggestions* GetActionsSuggestions() {
+  static const ActionsSuggestions* const actions_suggestions =
+      ActionsSuggestions::FromPath(
+          BenchmarkModelPath("actions_suggestions.universal.model"))
+          .release();
+  return actions_suggestions;
+}
+
+const Annotator* GetAnnotator() {
+  static const Annotator* const annotator =
+      Annotator::FromPath(BenchmarkModelPath("textclassifier.en.model"))
+          .release();
+  return annotator;
+}
+
+void BM_SuggestActions(benchmark::State& state) {
+  const ActionsSuggestions* actions_suggestions = GetActionsSuggestions();
+  const Annotator* annotator = GetAnnotator();
+  if (actions_suggestions == nullptr || annotator == nullptr) {
+    state.SkipWithError("Couldn't load the models.");
+    return;
+  }
+
+  const BenchmarkCorpus corpus = static_cast<BenchmarkCorpus>(state.range(0));
+  state.SetLabel(BenchmarkCorpusName(corpus));
+  const std::vector<Conversation> conversations = CorpusConversations(corpus);
+  int64 num_bytes = 0;
+  for (const Conversation& conversation : conversations) {
+    for (const ConversationMessage& message : conversation.messages) {
+      num_bytes += message.text.size();
+    }
+  }
+
+  int i = 0;
+  RunMeasuredBenchmark(state, num_bytes / conversations.size(), [&]() {
+    benchmark::DoNotOptimize(
+        actions_suggestions->SuggestActions(conversations[i], annotator));
+    i = (i + 1) % conversations.size();
+  });
+}
+BENCHMARK(BM_SuggestActions)->DenseRange(0, kNumBenchmarkCorpora - 1);
+
+// Suggests actions for the chat conversation from 1 to 64 threads sharing the
+// models.
+void BM_SuggestActionsThreads(benchmark::State& state) {
+  const ActionsSuggestions* actions_suggestions = GetActionsSuggestions();
+  const Annotator* annotator = GetAnnotator();
+  if (actions_suggestions == nullptr || annotator == nullptr) {
+    state.SkipWithError("Couldn't load the models.");
+    return;
+  }
+  const std::vector<Conversation> conversations =
+      CorpusConversations(BenchmarkCorpus::kChat);
+
+  RunThreadScalingBenchmark(state, [&]() {
+    benchmark::DoNotOptimize(
+        actions_suggestions->SuggestActions(conversations[0], annotator));
+  });
+}
+BENCHMARK(BM_SuggestActionsThreads)->Apply(SharedInstanceThreads);
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -28,6 +28,7 @@
 #include "utils/flatbuffers.h"
 #include "utils/flatbuffers_generated.h"
 #include "utils/hash/farmhash.h"
+#include "utils/testing/allocation-counter.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "flatbuffers/flatbuffers.h"
@@ -78,6 +79,155 @@ TEST_F(ActionsSuggestionsTest, SuggestActions) {
   EXPECT_EQ(response.actions.size(), 3 /* share_location + 2 smart replies*/);
 }
 
+// Heap allocations a warm SuggestActions call on the test conversation may
+// make. A failure means that a change added allocations to the path: remove
+// them, or raise the budget knowingly. Lower it when allocations are removed.
+constexpr int64 kMaxSuggestActionsAllocations = 1500;
+
+TEST_F(ActionsSuggestionsTest, SuggestActionsStaysWithinAllocationBudget) {
+  std::unique_ptr<ActionsSuggestions> actions_suggestions = LoadTestModel();
+  const Conversation conversation = {
+      {{/*user_id=*/1, "Where are you?", /*reference_time_ms_utc=*/0,
+        /*reference_timezone=*/"Europe/Zurich",
+        /*annotations=*/{}, /*locales=*/"en"}}};
+
+  // The first call builds the interpreter and the lua environments.
+  actions_suggestions->SuggestActions(conversation);
+  const int64 num_allocations = CountAllocations(
+      [&]() { actions_suggestions->SuggestActions(conversation); });
+  EXPECT_LE(num_allocations, kMaxSuggestActionsAllocations);
+}
+
+TEST_F(ActionsSuggestionsTest, SuggestActionsBatch) {
+  std::unique_ptr<ActionsSuggestions> actions_suggestions = LoadTestModel();
+  const Conversation where = {
+      {{/*user_id=*/1, "Where are you?", /*reference_time_ms_utc=*/0,
+        /*reference_timezone=*/"Europe/Zurich",
+        /*annotations=*/{}, /*locales=*/"en"}}};
+  const Conversation unknown_locale = {
+      {{/*user_id=*/1, "Where are you?", /*reference_time_ms_utc=*/0,
+        /*reference_timezone=*/"Europe/Zurich",
+        /*annotations=*/{}, /*locales=*/"zz"}}};
+  const std::vector<Conversation> conversations = {where, unknown_locale,
+                                                   where, where};
+  ThreadPool thread_pool(/*num_threads=*/2);
+
+  const std::vector<ActionsSuggestionsResponse> responses =
+      actions_suggestions->SuggestActionsBatch(conversations,
+                                               /*annotator=*/nullptr,
+                                               ActionSuggestionOptions(),
+                                               &thread_pool);
+  ASSERT_EQ(responses.size(), conversations.size());
+  for (int i = 0; i < conversations.size(); ++i) {
+    EXPECT_EQ(responses[i].actions.size(),
+              actions_suggestions->SuggestActions(conversations[i])
+                  .actions.size());
+  }
+  EXPECT_THAT(responses[1].actions, testing::IsEmpty());
+}
+
+TEST_F(ActionsSuggestionsTest, SuggestActionsStopsWhenCancelled) {
+  std::unique_ptr<ActionsSuggestions> actions_suggestions = LoadTestModel();
+  const Conversation conversation = {
+      {{/*user_id=*/1, "Where are you?", /*reference_time_ms_utc=*/0,
+        /*reference_timezone=*/"Europe/Zurich",
+        /*annotations=*/{}, /*locales=*/"en"}}};
+  CancellationToken token;
+  token.Cancel();
+  ActionSuggestionOptions options;
+  options.cancellation_token = &token;
+
+  const ActionsSuggestionsResponse response =
+      actions_suggestions->SuggestActions(conversation, /*annotator=*/nullptr,
+                                          options);
+  EXPECT_TRUE(response.is_partial);
+  EXPECT_THAT(response.actions, testing::IsEmpty());
+  EXPECT_FALSE(actions_suggestions->SuggestActions(conversation).is_partial);
+}
+
+TEST_F(ActionsSuggestionsTest, SuggestActionsWithSession) {
+  std::unique_ptr<ActionsSuggestions> actions_suggestions = LoadTestModel();
+  ConversationSession session;
+  Conversation conversation = {
+      {{/*user_id=*/1, "Hi!", /*reference_time_ms_utc=*/0,
+        /*reference_timezone=*/"Europe/Zurich",
+        /*annotations=*/{}, /*locales=*/"en"}}};
+  actions_suggestions->SuggestActions(conversation, /*annotator=*/nullptr,
+                                      ActionSuggestionOptions(), &session);
+
+  conversation.messages.push_back(
+      {/*user_id=*/1, "Where are you?", /*reference_time_ms_utc=*/0,
+       /*reference_timezone=*/"Europe/Zurich",
+       /*annotations=*/{}, /*locales=*/"en"});
+  const ActionsSuggestionsResponse& response =
+      actions_suggestions->SuggestActions(conversation, /*annotator=*/nullptr,
+                                          ActionSuggestionOptions(), &session);
+  EXPECT_LE(session.size(), conversation.messages.size());
+  EXPECT_EQ(response.actions.size(),
+            actions_suggestions->SuggestActions(conversation).actions.size());
+}
+
+TEST_F(ActionsSuggestionsTest, SuggestActionsFromResponseCache) {
+  std::unique_ptr<ActionsSuggestions> actions_suggestions = LoadTestModel();
+  ResponseCacheOptions cache_options;
+  cache_options.capacity = 10;
+  actions_suggestions->SetResponseCacheOptions(cache_options);
+  const ActionsSuggestionsResponse response =
+      actions_suggestions->SuggestActions(
+          {{{/*user_id=*/1, "Where are you?", /*reference_time_ms_utc=*/0,
+             /*reference_timezone=*/"Europe/Zurich",
+             /*annotations=*/{}, /*locales=*/"en"}}});
+
+  // Same message at another time, with the same time since the previous one.
+  const ActionsSuggestionsResponse cached_response =
+      actions_suggestions->SuggestActions(
+          {{{/*user_id=*/1, "Where are you?",
+             /*reference_time_ms_utc=*/1000,
+             /*reference_timezone=*/"Europe/Zurich",
+             /*annotations=*/{}, /*locales=*/"en"}}});
+  ASSERT_EQ(cached_response.actions.size(), response.actions.size());
+  for (int i = 0; i < response.actions.size(); ++i) {
+    EXPECT_EQ(cached_response.actions[i].type, response.actions[i].type);
+    EXPECT_EQ(cached_response.actions[i].response_text,
+              response.actions[i].response_text);
+  }
+
+  // Another user, other whitespace, another timezone, and another time since
+  // the previous message.
+  actions_suggestions->SuggestActions(
+      {{{/*user_id=*/2, "Where are you?", /*reference_time_ms_utc=*/0,
+         /*reference_timezone=*/"Europe/Zurich",
+         /*annotations=*/{}, /*locales=*/"en"}}});
+  actions_suggestions->SuggestActions(
+      {{{/*user_id=*/1, " Where  are\tyou? ", /*reference_time_ms_utc=*/0,
+         /*reference_timezone=*/"Europe/Zurich",
+         /*annotations=*/{}, /*locales=*/"en"}}});
+  actions_suggestions->SuggestActions(
+      {{{/*user_id=*/1, "Where are you?", /*reference_time_ms_utc=*/0,
+         /*reference_timezone=*/"America/New_York",
+         /*annotations=*/{}, /*locales=*/"en"}}});
+  actions_suggestions->SuggestActions(
+      {{{/*user_id=*/2, "Hi", /*reference_time_ms_utc=*/1000,
+         /*reference_timezone=*/"Europe/Zurich",
+         /*annotations=*/{}, /*locales=*/"en"},
+        {/*user_id=*/1, "Where are you?", /*reference_time_ms_utc=*/61000,
+         /*reference_timezone=*/"Europe/Zurich",
+         /*annotations=*/{}, /*locales=*/"en"}}});
+  actions_suggestions->SuggestActions(
+      {{{/*user_id=*/2, "Hi", /*reference_time_ms_utc=*/1000,
+         /*reference_timezone=*/"Europe/Zurich",
+         /*annotations=*/{}, /*locales=*/"en"},
+        {/*user_id=*/1, "Where are you?", /*reference_time_ms_utc=*/3601000,
+         /*reference_timezone=*/"Europe/Zurich",
+         /*annotations=*/{}, /*locales=*/"en"}}});
+
+  const ResultCacheStats stats = actions_suggestions->GetResponseCacheStats();
+  EXPECT_EQ(stats.num_hits, 1);
+  EXPECT_EQ(stats.num_misses, 6);
+  EXPECT_EQ(stats.size, 6);
+  EXPECT_GE(actions_suggestions->GetMemoryStats().cache_bytes, stats.bytes);
+}
+
 TEST_F(ActionsSuggestionsTest, SuggestNoActionsForUnknownLocale) {
   std::unique_ptr<ActionsSuggestions> actions_suggestions = LoadTestModel();
   const ActionsSuggestionsResponse& response =
@@ -105,6 +255,36 @@ TEST_F(ActionsSuggestionsTest, SuggestActionsFromAnnotations) {
   EXPECT_EQ(response.actions.front().score, 1.0);
 }
 
+TEST_F(ActionsSuggestionsTest, SuggestActionsFromAnnotationsOnThreadPool) {
+  std::unique_ptr<ActionsSuggestions> actions_suggestions = LoadTestModel();
+  AnnotatedSpan annotation;
+  annotation.span = {11, 15};
+  annotation.classification = {ClassificationResult("address", 1.0)};
+  const Conversation conversation = {
+      {{/*user_id=*/1, "are you at home?",
+        /*reference_time_ms_utc=*/0,
+        /*reference_timezone=*/"Europe/Zurich",
+        /*annotations=*/{annotation},
+        /*locales=*/"en"}}};
+  ThreadPool thread_pool(/*num_threads=*/1);
+  ActionSuggestionOptions options;
+  options.thread_pool = &thread_pool;
+  ConversationSession session;
+
+  const ActionsSuggestionsResponse response =
+      actions_suggestions->SuggestActions(conversation, /*annotator=*/nullptr,
+                                          options, &session);
+  const ActionsSuggestionsResponse expected_response =
+      actions_suggestions->SuggestActions(conversation);
+  ASSERT_EQ(response.actions.size(), expected_response.actions.size());
+  for (int i = 0; i < response.actions.size(); ++i) {
+    EXPECT_EQ(response.actions[i].type, expected_response.actions[i].type);
+    EXPECT_EQ(response.actions[i].score, expected_response.actions[i].score);
+  }
+  ASSERT_GE(response.actions.size(), 1);
+  EXPECT_EQ(response.actions.front().type, "view_map");
+}
+
 TEST_F(ActionsSuggestionsTest, SuggestActionsFromAnnotationsWithEntityData) {
   const std::string actions_model_string =
       ReadFile(GetModelPath() + kModelFileName);
@@ -1028,6 +1208,7 @@ class TestingMessageEmbedder : private ActionsSuggestions {
 
   using ActionsSuggestions::EmbedAndFlattenTokens;
   using ActionsSuggestions::EmbedTokensPerMessage;
+  using ActionsSuggestions::GetTokenEmbeddingCacheStats;
 
  protected:
   // EmbeddingExecutor that always returns features based on
@@ -1057,6 +1238,8 @@ TestingMessageEmbedder::TestingMessageEmbedder(const ActionsModel* model) {
   EXPECT_TRUE(EmbedTokenId(options->end_token_id(), &embedded_end_token_));
   token_embedding_size_ = feature_processor_->GetTokenEmbeddingSize();
   EXPECT_EQ(token_embedding_size_, 1);
+  token_embedding_cache_.reset(
+      new SharedEmbeddingCache(kDefaultTokenEmbeddingCacheCapacity));
 }
 
 class EmbeddingTest : public testing::Test {
@@ -1110,6 +1293,46 @@ TEST_F(EmbeddingTest, EmbedsTokensPerMessageWithNoBounds) {
                                options_->num_buckets));
 }
 
+TEST_F(EmbeddingTest, EmbedsTokensPerMessageFromSession) {
+  const TestingMessageEmbedder embedder = CreateTestingMessageEmbedder();
+  std::vector<std::vector<Token>> tokens = {
+      {Token("a", 0, 1), Token("b", 2, 3), Token("c", 4, 5)}};
+  ConversationSession::MessageState state;
+  std::vector<float> embeddings;
+  int max_num_tokens_per_message = 0;
+
+  EXPECT_TRUE(embedder.EmbedTokensPerMessage(
+      tokens, &embeddings, &max_num_tokens_per_message, {&state}));
+  EXPECT_TRUE(state.has_token_embeddings);
+  EXPECT_EQ(state.token_embeddings, embeddings);
+
+  // The second time, the embeddings come from the message state.
+  state.token_embeddings[0] = 42;
+  embeddings.clear();
+  EXPECT_TRUE(embedder.EmbedTokensPerMessage(
+      tokens, &embeddings, &max_num_tokens_per_message, {&state}));
+  EXPECT_EQ(embeddings.size(), 3);
+  EXPECT_THAT(embeddings[0], testing::FloatEq(42));
+}
+
+TEST_F(EmbeddingTest, EmbedsRepeatedTokensFromCache) {
+  const TestingMessageEmbedder embedder = CreateTestingMessageEmbedder();
+  std::vector<std::vector<Token>> tokens = {
+      {Token("a", 0, 1), Token("b", 2, 3), Token("a", 4, 5)}};
+  std::vector<float> embeddings;
+  int max_num_tokens_per_message = 0;
+
+  EXPECT_TRUE(embedder.EmbedTokensPerMessage(tokens, &embeddings,
+                                             &max_num_tokens_per_message));
+
+  EXPECT_EQ(embeddings.size(), 3);
+  EXPECT_THAT(embeddings[2], testing::FloatEq(embeddings[0]));
+  const SharedEmbeddingCacheStats stats =
+      embedder.GetTokenEmbeddingCacheStats();
+  EXPECT_EQ(stats.num_hits, 1);
+  EXPECT_EQ(stats.size, 2);
+}
+
 TEST_F(EmbeddingTest, EmbedsTokensPerMessageWithPadding) {
   options_->min_num_tokens_per_message = 5;
   const TestingMessageEmbedder embedder = CreateTestingMessageEmbedder();
@@ -29,7 +29,10 @@
 #include "utils/base/integral_types.h"
 #include "utils/intents/intent-generator.h"
 #include "utils/intents/jni.h"
+#include "utils/java/jni-async.h"
 #include "utils/java/jni-cache.h"
+#include "utils/java/jni-warmup.h"
+#include "utils/java/scoped_global_ref.h"
 #include "utils/java/scoped_local_ref.h"
 #include "utils/java/string_utils.h"
 #include "utils/memory/mmap.h"
@@ -39,10 +42,12 @@ using libtextclassifier3::ActionsSuggestionsResponse;
 using libtextclassifier3::ActionSuggestion;
 using libtextclassifier3::ActionSuggestionOptions;
 using libtextclassifier3::Annotator;
+using libtextclassifier3::CancellationToken;
 using libtextclassifier3::Conversation;
 using libtextclassifier3::IntentGenerator;
 using libtextclassifier3::ScopedLocalRef;
 using libtextclassifier3::ToStlString;
+using libtextclassifier3::WarmupReportToJObjectArray;
 
 // When using the Java's ICU, UniLib needs to be instantiated with a JavaVM
 // pointer from JNI. When using a standard ICU the pointer is not needed and the
@@ -55,9 +60,57 @@ namespace libtextclassifier3 {
 
 namespace {
 
+// The Java result classes and their constructors. They are resolved once,
+// when the model is created, instead of on every call.
+struct ActionsJniResultClasses {
+  static std::unique_ptr<ActionsJniResultClasses> Create(
+      const std::shared_ptr<JniCache>& jni_cache) {
+    JNIEnv* env = jni_cache->GetEnv();
+    if (env == nullptr) {
+      return nullptr;
+    }
+    std::unique_ptr<ActionsJniResultClasses> classes(
+        new ActionsJniResultClasses(jni_cache->jvm));
+
+    classes->action_suggestion_class = MakeGlobalRef(
+        env->FindClass(TC3_PACKAGE_PATH TC3_ACTIONS_CLASS_NAME_STR
+                       "$ActionSuggestion"),
+        env, jni_cache->jvm);
+    TC3_CHECK(classes->action_suggestion_class != nullptr)
+        << "Error finding class: ActionSuggestion";
+    classes->action_suggestion_init = env->GetMethodID(
+        classes->action_suggestion_class.get(), "<init>",
+        "(Ljava/lang/String;Ljava/lang/String;F[L" TC3_PACKAGE_PATH
+            TC3_NAMED_VARIANT_CLASS_NAME_STR
+        ";[B[L" TC3_PACKAGE_PATH TC3_REMOTE_ACTION_TEMPLATE_CLASS_NAME_STR
+        ";)V");
+    TC3_CHECK(classes->action_suggestion_init)
+        << "Error finding method: ActionSuggestion.<init>";
+
+    classes->action_suggestion_array_class = MakeGlobalRef(
+        env->FindClass("[L" TC3_PACKAGE_PATH TC3_ACTIONS_CLASS_NAME_STR
+                       "$ActionSuggestion;"),
+        env, jni_cache->jvm);
+    TC3_CHECK(classes->action_suggestion_array_class != nullptr)
+        << "Error finding class: ActionSuggestion[]";
+
+    return classes;
+  }
+
+  ScopedGlobalRef<jclass> action_suggestion_class;
+  jmethodID action_suggestion_init = nullptr;
+
+  ScopedGlobalRef<jclass> action_suggestion_array_class;
+
+ private:
+  explicit ActionsJniResultClasses(JavaVM* jvm)
+      : action_suggestion_class(nullptr, jvm),
+        action_suggestion_array_class(nullptr, jvm) {}
+};
+
 // Cached state for model inference.
-// Keeps a jni cache, intent generator and model instance so that they don't
-// have to be recreated for each call.
+// Keeps a jni cache, intent generator, result classes and model instance so
+// that they don't have to be recreated for each call.
 class ActionsSuggestionsJniContext {
  public:
   static ActionsSuggestionsJniContext* Create(
@@ -72,13 +125,17 @@ class ActionsSuggestionsJniContext {
     std::unique_ptr<RemoteActionTemplatesHandler> template_handler =
         libtextclassifier3::RemoteActionTemplatesHandler::Create(jni_cache);
 
-    if (intent_generator == nullptr || template_handler == nullptr) {
+    std::unique_ptr<ActionsJniResultClasses> result_classes =
+        ActionsJniResultClasses::Create(jni_cache);
+
+    if (intent_generator == nullptr || template_handler == nullptr ||
+        result_classes == nullptr) {
       return nullptr;
     }
 
-    return new ActionsSuggestionsJniContext(jni_cache, std::move(model),
-                                            std::move(intent_generator),
-                                            std::move(template_handler));
+    return new ActionsSuggestionsJniContext(
+        jni_cache, std::move(model), std::move(intent_generator),
+        std::move(template_handler), std::move(result_classes));
   }
 
   std::shared_ptr<libtextclassifier3::JniCache> jni_cache() const {
@@ -93,21 +150,28 @@ class ActionsSuggestionsJniContext {
     return template_handler_.get();
   }
 
+  const ActionsJniResultClasses* result_classes() const {
+    return result_classes_.get();
+  }
+
  private:
   ActionsSuggestionsJniContext(
       const std::shared_ptr<libtextclassifier3::JniCache>& jni_cache,
       std::unique_ptr<ActionsSuggestions> model,
       std::unique_ptr<IntentGenerator> intent_generator,
-      std::unique_ptr<RemoteActionTemplatesHandler> template_handler)
+      std::unique_ptr<RemoteActionTemplatesHandler> template_handler,
+      std::unique_ptr<ActionsJniResultClasses> result_classes)
       : jni_cache_(jni_cache),
         model_(std::move(model)),
         intent_generator_(std::move(intent_generator)),
-        template_handler_(std::move(template_handler)) {}
+        template_handler_(std::move(template_handler)),
+        result_classes_(std::move(result_classes)) {}
 
   std::shared_ptr<libtextclassifier3::JniCache> jni_cache_;
   std::unique_ptr<ActionsSuggestions> model_;
   std::unique_ptr<IntentGenerator> intent_generator_;
   std::unique_ptr<RemoteActionTemplatesHandler> template_handler_;
+  std::unique_ptr<ActionsJniResultClasses> result_classes_;
 };
 
 ActionSuggestionOptions FromJavaActionSuggestionOptions(JNIEnv* env,
@@ -123,27 +187,24 @@ jobjectArray ActionSuggestionsToJObjectArray(
     const std::vector<ActionSuggestion>& action_result,
     const Conversation& conversation, const jstring device_locales,
     const bool generate_intents) {
-  const ScopedLocalRef<jclass> result_class(
-      env->FindClass(TC3_PACKAGE_PATH TC3_ACTIONS_CLASS_NAME_STR
-                     "$ActionSuggestion"),
-      env);
-  if (!result_class) {
-    TC3_LOG(ERROR) << "Couldn't find ActionSuggestion class.";
-    return nullptr;
+  const ActionsJniResultClasses* classes = context->result_classes();
+  const reflection::Schema* actions_entity_data_schema =
+      context->model()->entity_data_schema();
+
+  // The intents of all the actions are generated in one pass.
+  std::vector<std::vector<RemoteActionTemplate>> remote_action_templates;
+  if (generate_intents) {
+    context->intent_generator()->GenerateIntents(
+        device_locales, action_result, conversation, app_context,
+        actions_entity_data_schema, annotations_entity_data_schema,
+        &remote_action_templates);
   }
 
-  const jmethodID result_class_constructor = env->GetMethodID(
-      result_class.get(), "<init>",
-      "(Ljava/lang/String;Ljava/lang/String;F[L" TC3_PACKAGE_PATH
-          TC3_NAMED_VARIANT_CLASS_NAME_STR
-      ";[B[L" TC3_PACKAGE_PATH TC3_REMOTE_ACTION_TEMPLATE_CLASS_NAME_STR ";)V");
-  const jobjectArray results =
-      env->NewObjectArray(action_result.size(), result_class.get(), nullptr);
+  const jobjectArray results = env->NewObjectArray(
+      action_result.size(), classes->action_suggestion_class.get(), nullptr);
   for (int i = 0; i < action_result.size(); i++) {
     jobject extras = nullptr;
 
-    const reflection::Schema* actions_entity_data_schema =
-        context->model()->entity_data_schema();
     if (actions_entity_data_schema != nullptr &&
         !action_result[i].serialized_entity_data.empty()) {
       extras = context->template_handler()->EntityDataAsNamedVariantArray(
@@ -163,22 +224,17 @@ jobjectArray ActionSuggestionsToJObjectArray(
 
     jobject remote_action_templates_result = nullptr;
     if (generate_intents) {
-      std::vector<RemoteActionTemplate> remote_action_templates;
-      if (context->intent_generator()->GenerateIntents(
-              device_locales, action_result[i], conversation, app_context,
-              actions_entity_data_schema, annotations_entity_data_schema,
-              &remote_action_templates)) {
-        remote_action_templates_result =
-            context->template_handler()->RemoteActionTemplatesToJObjectArray(
-                remote_action_templates);
-      }
+      remote_action_templates_result =
+          context->template_handler()->RemoteActionTemplatesToJObjectArray(
+              remote_action_templates[i]);
     }
 
     ScopedLocalRef<jstring> reply = context->jni_cache()->ConvertToJavaString(
         action_result[i].response_text);
 
     ScopedLocalRef<jobject> result(env->NewObject(
-        result_class.get(), result_class_constructor, reply.get(),
+        classes->action_suggestion_class.get(),
+        classes->action_suggestion_init, reply.get(),
         env->NewStringUTF(action_result[i].type.c_str()),
         static_cast<jfloat>(action_result[i].score), extras,
         serialized_entity_data, remote_action_templates_result));
@@ -307,6 +363,9 @@ using libtextclassifier3::ActionsSuggestionsJniContext;
 using libtextclassifier3::ActionSuggestionsToJObjectArray;
 using libtextclassifier3::FromJavaActionSuggestionOptions;
 using libtextclassifier3::FromJavaConversation;
+using libtextclassifier3::GetAsyncRequestToken;
+using libtextclassifier3::ScheduleJniTask;
+using libtextclassifier3::ScopedGlobalRef;
 
 TC3_JNI_METHOD(jlong, TC3_ACTIONS_CLASS_NAME, nativeNewActionsModel)
 (JNIEnv* env, jobject thiz, jint fd, jbyteArray serialized_preconditions) {
@@ -379,6 +438,126 @@ TC3_JNI_METHOD(jobjectArray, TC3_ACTIONS_CLASS_NAME, nativeSuggestActions)
       response.actions, conversation, device_locales, generate_intents);
 }
 
+TC3_JNI_METHOD(jobjectArray, TC3_ACTIONS_CLASS_NAME, nativeSuggestActionsBatch)
+(JNIEnv* env, jobject clazz, jlong ptr, jobjectArray jconversations,
+ jobject joptions, jlong annotatorPtr, jobject app_context,
+ jstring device_locales, jboolean generate_intents) {
+  if (!ptr) {
+    return nullptr;
+  }
+  const int num_conversations = env->GetArrayLength(jconversations);
+  std::vector<Conversation> conversations;
+  conversations.reserve(num_conversations);
+  for (int i = 0; i < num_conversations; ++i) {
+    const ScopedLocalRef<jobject> jconversation(
+        env->GetObjectArrayElement(jconversations, i), env);
+    conversations.push_back(FromJavaConversation(env, jconversation.get()));
+  }
+  const ActionSuggestionOptions options =
+      FromJavaActionSuggestionOptions(env, joptions);
+  const ActionsSuggestionsJniContext* context =
+      reinterpret_cast<ActionsSuggestionsJniContext*>(ptr);
+  const Annotator* annotator = reinterpret_cast<Annotator*>(annotatorPtr);
+
+  const std::vector<ActionsSuggestionsResponse> responses =
+      context->model()->SuggestActionsBatch(conversations, annotator, options);
+
+  const reflection::Schema* anntotations_entity_data_schema =
+      annotator ? annotator->entity_data_schema() : nullptr;
+  jobjectArray results = env->NewObjectArray(
+      num_conversations,
+      context->result_classes()->action_suggestion_array_class.get(), nullptr);
+  for (int i = 0; i < num_conversations; ++i) {
+    const ScopedLocalRef<jobjectArray> result(
+        ActionSuggestionsToJObjectArray(
+            env, context, app_context, anntotations_entity_data_schema,
+            responses[i].actions, conversations[i], device_locales,
+            generate_intents),
+        env);
+    env->SetObjectArrayElement(results, i, result.get());
+  }
+  return results;
+}
+
+TC3_JNI_METHOD(jboolean, TC3_ACTIONS_CLASS_NAME, nativeSuggestActionsAsync)
+(JNIEnv* env, jobject clazz, jlong ptr, jobject jconversation, jobject joptions,
+ jlong annotatorPtr, jobject callback, jlong request_ptr) {
+  if (!ptr || !request_ptr) {
+    return false;
+  }
+  const ScopedLocalRef<jclass> callback_class(env->GetObjectClass(callback),
+                                              env);
+  const jmethodID on_suggested_actions = env->GetMethodID(
+      callback_class.get(), "onSuggestedActions",
+      "([L" TC3_PACKAGE_PATH TC3_ACTIONS_CLASS_NAME_STR "$ActionSuggestion;)V");
+  if (!on_suggested_actions) {
+    TC3_LOG(ERROR) << "Couldn't find onSuggestedActions method.";
+    return false;
+  }
+  const ActionsSuggestionsJniContext* context =
+      reinterpret_cast<ActionsSuggestionsJniContext*>(ptr);
+  JavaVM* jvm = context->jni_cache()->jvm;
+  const std::shared_ptr<ScopedGlobalRef<jobject>> callback_ref =
+      std::make_shared<ScopedGlobalRef<jobject>>(env->NewGlobalRef(callback),
+                                                 jvm);
+  const std::shared_ptr<CancellationToken> token =
+      GetAsyncRequestToken(request_ptr);
+  ActionSuggestionOptions options =
+      FromJavaActionSuggestionOptions(env, joptions);
+  options.cancellation_token = token.get();
+
+  ScheduleJniTask(
+      jvm, [context, callback_ref, on_suggested_actions, token, options,
+            conversation = FromJavaConversation(env, jconversation),
+            annotator = reinterpret_cast<const Annotator*>(annotatorPtr)](
+               JNIEnv* worker_env) {
+        if (token->IsCancelled()) {
+          return;
+        }
+        const ActionsSuggestionsResponse response =
+            context->model()->SuggestActions(conversation, annotator, options);
+        if (token->IsCancelled()) {
+          return;
+        }
+        const ScopedLocalRef<jobjectArray> result(
+            ActionSuggestionsToJObjectArray(
+                worker_env, context, /*app_context=*/nullptr,
+                annotator ? annotator->entity_data_schema() : nullptr,
+                response.actions, conversation, /*device_locales=*/nullptr,
+                /*generate_intents=*/false),
+            worker_env);
+        worker_env->CallVoidMethod(callback_ref->get(), on_suggested_actions,
+                                   result.get());
+      });
+  return true;
+}
+
+TC3_JNI_METHOD(jobjectArray, TC3_ACTIONS_CLASS_NAME, nativeWarmup)
+(JNIEnv* env, jobject thiz, jlong ptr) {
+  if (!ptr) {
+    return nullptr;
+  }
+  const ActionsSuggestionsJniContext* context =
+      reinterpret_cast<ActionsSuggestionsJniContext*>(ptr);
+  return WarmupReportToJObjectArray(env, context->model()->Warmup());
+}
+
+TC3_JNI_METHOD(jboolean, TC3_ACTIONS_CLASS_NAME, nativeSetExecutorOptions)
+(JNIEnv* env, jobject thiz, jlong ptr, jint num_threads, jboolean allow_fp16) {
+  if (!ptr) {
+    return false;
+  }
+  const ActionsSuggestionsJniContext* context =
+      reinterpret_cast<ActionsSuggestionsJniContext*>(ptr);
+
+  // The op resolver and the delegate can't be passed from Java, keep the
+  // process-wide ones.
+  TfLiteExecutorOptions options = DefaultTfLiteExecutorOptions();
+  options.num_threads = num_threads;
+  options.allow_fp16 = allow_fp16;
+  return context->model()->SetTfLiteExecutorOptions(options);
+}
+
 TC3_JNI_METHOD(void, TC3_ACTIONS_CLASS_NAME, nativeCloseActionsModel)
 (JNIEnv* env, jobject clazz, jlong model_ptr) {
   const ActionsSuggestionsJniContext* context =
@@ -42,6 +42,21 @@ TC3_JNI_METHOD(jobjectArray, TC3_ACTIONS_CLASS_NAME, nativeSuggestActions)
  jlong annotatorPtr, jobject app_context, jstring device_locales,
  jboolean generate_intents);
 
+TC3_JNI_METHOD(jobjectArray, TC3_ACTIONS_CLASS_NAME, nativeSuggestActionsBatch)
+(JNIEnv* env, jobject thiz, jlong ptr, jobjectArray jconversations,
+ jobject joptions, jlong annotatorPtr, jobject app_context,
+ jstring device_locales, jboolean generate_intents);
+
+TC3_JNI_METHOD(jboolean, TC3_ACTIONS_CLASS_NAME, nativeSuggestActionsAsync)
+(JNIEnv* env, jobject thiz, jlong ptr, jobject jconversation, jobject joptions,
+ jlong annotatorPtr, jobject callback, jlong request_ptr);
+
+TC3_JNI_METHOD(jobjectArray, TC3_ACTIONS_CLASS_NAME, nativeWarmup)
+(JNIEnv* env, jobject thiz, jlong ptr);
+
+TC3_JNI_METHOD(jboolean, TC3_ACTIONS_CLASS_NAME, nativeSetExecutorOptions)
+(JNIEnv* env, jobject thiz, jlong ptr, jint num_threads, jboolean allow_fp16);
+
 TC3_JNI_METHOD(void, TC3_ACTIONS_CLASS_NAME, nativeCloseActionsModel)
 (JNIEnv* env, jobject thiz, jlong ptr);
 
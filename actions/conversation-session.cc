@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "actions/conversation-session.h"
+
+#include <string>
+#include <unordered_set>
+
+#include "utils/hash/farmhash.h"
+
+namespace libtextclassifier3 {
+
+uint64 ConversationSession::Fingerprint(const ConversationMessage& message) {
+  // Everything the tokens and the annotations depend on. The fields are
+  // length-prefixed, so that different fields can't run into each other.
+  std::string key;
+  for (const std::string* field :
+       {&message.text, &message.reference_timezone,
+        &message.detected_text_language_tags}) {
+    key.append(std::to_string(field->size()));
+    key.push_back(':');
+    key.append(*field);
+  }
+  key.append(std::to_string(message.user_id));
+  key.push_back(':');
+  key.append(std::to_string(message.reference_time_ms_utc));
+  return tc3farmhash::Fingerprint64(key);
+}
+
+ConversationSession::MessageState* ConversationSession::GetOrCreateMessageState(
+    const ConversationMessage& message) {
+  const uint64 fingerprint = Fingerprint(message);
+  const auto it = messages_.find(fingerprint);
+  if (it != messages_.end()) {
+    return &it->second;
+  }
+  return &messages_[fingerprint];
+}
+
+void ConversationSession::RetainMessagesOf(const Conversation& conversation) {
+  std::unordered_set<uint64> fingerprints;
+  for (const ConversationMessage& message : conversation.messages) {
+    fingerprints.insert(Fingerprint(message));
+  }
+  for (auto it = messages_.begin(); it != messages_.end();) {
+    if (fingerprints.find(it->first) == fingerprints.end()) {
+      it = messages_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Per-conversation cache of the message work done by ActionsSuggestions.
+
+#ifndef LIBTEXTCLASSIFIER_ACTIONS_CONVERSATION_SESSION_H_
+#define LIBTEXTCLASSIFIER_ACTIONS_CONVERSATION_SESSION_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include "actions/types.h"
+#include "annotator/types.h"
+#include "utils/base/integral_types.h"
+
+namespace libtextclassifier3 {
+
+// Keeps the tokens, token embeddings and annotations of the messages of one
+// conversation across ActionsSuggestions calls, so that a call for a growing
+// conversation only processes the new messages.
+//
+// Messages are identified by a fingerprint of their contents, so an edited
+// message is processed anew. After each call, the state of the messages that
+// are no longer part of the conversation is dropped.
+//
+// The cached values depend on the actions model and the annotator, so use a
+// session with only one of each. The class is not thread-safe, except that
+// GetOrCreateMessageState can be called concurrently for messages that
+// already have a state, and different threads can update different fields of
+// a state.
+class ConversationSession {
+ public:
+  struct MessageState {
+    bool has_tokens = false;
+    std::vector<Token> tokens;
+
+    // The embeddings of all the tokens of the message, without padding.
+    bool has_token_embeddings = false;
+    std::vector<float> token_embeddings;
+
+    bool has_annotations = false;
+    std::vector<AnnotatedSpan> annotations;
+  };
+
+  // Returns the state of the message, which is empty the first time the
+  // message is seen. The pointer stays valid until the state is dropped.
+  // Doesn't modify the session if the message already has a state.
+  MessageState* GetOrCreateMessageState(const ConversationMessage& message);
+
+  // Drops the state of the messages that are not in the conversation.
+  void RetainMessagesOf(const Conversation& conversation);
+
+  // Number of messages with state.
+  int size() const { return messages_.size(); }
+
+  void Clear() { messages_.clear(); }
+
+ private:
+  static uint64 Fingerprint(const ConversationMessage& message);
+
+  std::unordered_map<uint64, MessageState> messages_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_ACTIONS_CONVERSATION_SESSION_H_
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "actions/conversation-session.h"
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+ConversationMessage Message(int user_id, const std::string& text) {
+  return {user_id, text, /*reference_time_ms_utc=*/0,
+          /*reference_timezone=*/"Europe/Zurich", /*annotations=*/{},
+          /*detected_text_language_tags=*/"en"};
+}
+
+TEST(ConversationSessionTest, ReturnsSameStateForSameMessage) {
+  ConversationSession session;
+  ConversationSession::MessageState* state =
+      session.GetOrCreateMessageState(Message(1, "Where are you?"));
+  EXPECT_FALSE(state->has_tokens);
+  state->has_tokens = true;
+
+  EXPECT_EQ(session.GetOrCreateMessageState(Message(1, "Where are you?")),
+            state);
+  EXPECT_TRUE(state->has_tokens);
+  EXPECT_EQ(session.size(), 1);
+}
+
+TEST(ConversationSessionTest, DistinguishesMessages) {
+  ConversationSession session;
+  ConversationSession::MessageState* state =
+      session.GetOrCreateMessageState(Message(1, "Where are you?"));
+  EXPECT_NE(session.GetOrCreateMessageState(Message(2, "Where are you?")),
+            state);
+  EXPECT_NE(session.GetOrCreateMessageState(Message(1, "Where are you")),
+            state);
+
+  ConversationMessage later = Message(1, "Where are you?");
+  later.reference_time_ms_utc = 1000;
+  EXPECT_NE(session.GetOrCreateMessageState(later), state);
+  EXPECT_EQ(session.size(), 4);
+}
+
+TEST(ConversationSessionTest, DropsMessagesNotInConversation) {
+  ConversationSession session;
+  session.GetOrCreateMessageState(Message(1, "Hi"));
+  session.GetOrCreateMessageState(Message(2, "Hello"));
+  session.GetOrCreateMessageState(Message(1, "Where are you?"));
+
+  session.RetainMessagesOf(
+      {{Message(2, "Hello"), Message(1, "Where are you?")}});
+  EXPECT_EQ(session.size(), 2);
+
+  session.Clear();
+  EXPECT_EQ(session.size(), 0);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
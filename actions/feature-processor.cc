@@ -16,6 +16,11 @@
 
 #include "actions/feature-processor.h"
 
+#include <cstring>
+#include <memory>
+
+#include "flatbuffers/flatbuffers.h"
+
 namespace libtextclassifier3 {
 namespace {
 TokenFeatureExtractorOptions BuildTokenFeatureExtractorOptions(
@@ -38,6 +43,8 @@ TokenFeatureExtractorOptions BuildTokenFeatureExtractorOptions(
   }
   extractor_options.remap_digits = options->remap_digits();
   extractor_options.lowercase_tokens = options->lowercase_tokens();
+  extractor_options.incremental_chargram_hashing =
+      options->incremental_chargram_hashing();
   return extractor_options;
 }
 }  // namespace
@@ -65,6 +72,27 @@ std::unique_ptr<Tokenizer> CreateTokenizer(
       tokenize_on_script_change, options->icu_preserve_whitespace_tokens()));
 }
 
+bool TokenizerOptionsEqual(const ActionsTokenizerOptions* a,
+                           const ActionsTokenizerOptions* b) {
+  if (a == nullptr || b == nullptr) {
+    return a == b;
+  }
+  if (a == b) {
+    return true;
+  }
+
+  // Compare the canonical serializations of the options, the tables can be
+  // laid out differently in the model buffers.
+  const std::unique_ptr<ActionsTokenizerOptionsT> unpacked_a(a->UnPack());
+  const std::unique_ptr<ActionsTokenizerOptionsT> unpacked_b(b->UnPack());
+  flatbuffers::FlatBufferBuilder builder_a, builder_b;
+  builder_a.Finish(ActionsTokenizerOptions::Pack(builder_a, unpacked_a.get()));
+  builder_b.Finish(ActionsTokenizerOptions::Pack(builder_b, unpacked_b.get()));
+  return builder_a.GetSize() == builder_b.GetSize() &&
+         std::memcmp(builder_a.GetBufferPointer(), builder_b.GetBufferPointer(),
+                     builder_a.GetSize()) == 0;
+}
+
 ActionsFeatureProcessor::ActionsFeatureProcessor(
     const ActionsTokenFeatureProcessorOptions* options, const UniLib* unilib)
     : options_(options),
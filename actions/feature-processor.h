@@ -33,6 +33,11 @@ namespace libtextclassifier3 {
 std::unique_ptr<Tokenizer> CreateTokenizer(
     const ActionsTokenizerOptions* options, const UniLib* unilib);
 
+// Returns whether two tokenizer options are equal, and thus the tokenizers
+// created from them produce the same tokens.
+bool TokenizerOptionsEqual(const ActionsTokenizerOptions* a,
+                           const ActionsTokenizerOptions* b);
+
 // Feature processor for the actions suggestions model.
 class ActionsFeatureProcessor {
  public:
@@ -54,11 +54,25 @@ LuaActionsSuggestions::CreateLuaActionsSuggestions(
     const tflite::Interpreter* interpreter,
     const reflection::Schema* actions_entity_data_schema,
     const reflection::Schema* annotations_entity_data_schema) {
+  auto lua_actions = CreateLuaActionsSuggestions(
+      snippet, actions_entity_data_schema, annotations_entity_data_schema);
+  if (lua_actions == nullptr ||
+      !lua_actions->BindRequest(conversation, model_executor, model_spec,
+                                interpreter)) {
+    return nullptr;
+  }
+  return lua_actions;
+}
+
+std::unique_ptr<LuaActionsSuggestions>
+LuaActionsSuggestions::CreateLuaActionsSuggestions(
+    const std::string& snippet,
+    const reflection::Schema* actions_entity_data_schema,
+    const reflection::Schema* annotations_entity_data_schema) {
   auto lua_actions =
       std::unique_ptr<LuaActionsSuggestions>(new LuaActionsSuggestions(
-          snippet, conversation, model_executor, model_spec, interpreter,
           actions_entity_data_schema, annotations_entity_data_schema));
-  if (!lua_actions->Initialize()) {
+  if (!lua_actions->Initialize(snippet)) {
     TC3_LOG(ERROR)
         << "Could not initialize lua environment for actions suggestions.";
     return nullptr;
@@ -67,67 +81,69 @@ LuaActionsSuggestions::CreateLuaActionsSuggestions(
 }
 
 LuaActionsSuggestions::LuaActionsSuggestions(
-    const std::string& snippet, const Conversation& conversation,
-    const TfLiteModelExecutor* model_executor,
-    const TensorflowLiteModelSpec* model_spec,
-    const tflite::Interpreter* interpreter,
     const reflection::Schema* actions_entity_data_schema,
     const reflection::Schema* annotations_entity_data_schema)
-    : snippet_(snippet),
-      conversation_(conversation),
-      conversation_iterator_(annotations_entity_data_schema, this),
-      actions_scores_(
-          model_spec == nullptr
-              ? TensorView<float>::Invalid()
-              : GetTensorViewForOutput(model_executor, interpreter,
-                                       model_spec->output_actions_scores())),
-      smart_reply_scores_(
-          model_spec == nullptr
-              ? TensorView<float>::Invalid()
-              : GetTensorViewForOutput(model_executor, interpreter,
-                                       model_spec->output_replies_scores())),
-      sensitivity_score_(model_spec == nullptr
-                             ? TensorView<float>::Invalid()
-                             : GetTensorViewForOutput(
-                                   model_executor, interpreter,
-                                   model_spec->output_sensitive_topic_score())),
-      triggering_score_(
-          model_spec == nullptr
-              ? TensorView<float>::Invalid()
-              : GetTensorViewForOutput(model_executor, interpreter,
-                                       model_spec->output_triggering_score())),
+    : conversation_iterator_(annotations_entity_data_schema, this),
       actions_entity_data_schema_(actions_entity_data_schema),
       annotations_entity_data_schema_(annotations_entity_data_schema) {}
 
-bool LuaActionsSuggestions::Initialize() {
-  return RunProtected([this] {
-           LoadDefaultLibraries();
+bool LuaActionsSuggestions::Initialize(const std::string& snippet) {
+  if (RunProtected([this] {
+        LoadDefaultLibraries();
+        return LUA_OK;
+      }) != LUA_OK) {
+    return false;
+  }
+  snippet_ref_ = LoadSnippet(snippet);
+  return snippet_ref_ != LUA_NOREF;
+}
 
+bool LuaActionsSuggestions::BindRequest(
+    const Conversation& conversation, const TfLiteModelExecutor* model_executor,
+    const TensorflowLiteModelSpec* model_spec,
+    const tflite::Interpreter* interpreter) {
+  if (model_spec == nullptr) {
+    model_outputs_.reset(new ModelOutputs{
+        TensorView<float>::Invalid(), TensorView<float>::Invalid(),
+        TensorView<float>::Invalid(), TensorView<float>::Invalid()});
+  } else {
+    model_outputs_.reset(new ModelOutputs{
+        GetTensorViewForOutput(model_executor, interpreter,
+                               model_spec->output_actions_scores()),
+        GetTensorViewForOutput(model_executor, interpreter,
+                               model_spec->output_replies_scores()),
+        GetTensorViewForOutput(model_executor, interpreter,
+                               model_spec->output_sensitive_topic_score()),
+        GetTensorViewForOutput(model_executor, interpreter,
+                               model_spec->output_triggering_score())});
+  }
+
+  return RunProtected([this, &conversation] {
            // Expose conversation message stream.
            conversation_iterator_.NewIterator("messages",
-                                              &conversation_.messages, state_);
+                                              &conversation.messages, state_);
            lua_setglobal(state_, "messages");
 
            // Expose ML model output.
            lua_newtable(state_);
            {
-             tensor_iterator_.NewIterator("actions_scores", &actions_scores_,
-                                          state_);
+             tensor_iterator_.NewIterator(
+                 "actions_scores", &model_outputs_->actions_scores, state_);
              lua_setfield(state_, /*idx=*/-2, "actions_scores");
            }
            {
-             tensor_iterator_.NewIterator("reply_scores", &smart_reply_scores_,
-                                          state_);
+             tensor_iterator_.NewIterator(
+                 "reply_scores", &model_outputs_->smart_reply_scores, state_);
              lua_setfield(state_, /*idx=*/-2, "reply_scores");
            }
            {
-             tensor_iterator_.NewIterator("sensitivity", &sensitivity_score_,
-                                          state_);
+             tensor_iterator_.NewIterator(
+                 "sensitivity", &model_outputs_->sensitivity_score, state_);
              lua_setfield(state_, /*idx=*/-2, "sensitivity");
            }
            {
-             tensor_iterator_.NewIterator("triggering_score",
-                                          &triggering_score_, state_);
+             tensor_iterator_.NewIterator(
+                 "triggering_score", &model_outputs_->triggering_score, state_);
              lua_setfield(state_, /*idx=*/-2, "triggering_score");
            }
            lua_setglobal(state_, "model");
@@ -138,27 +154,26 @@ bool LuaActionsSuggestions::Initialize() {
 
 bool LuaActionsSuggestions::SuggestActions(
     std::vector<ActionSuggestion>* actions) {
-  if (luaL_loadbuffer(state_, snippet_.data(), snippet_.size(),
-                      /*name=*/nullptr) != LUA_OK) {
-    TC3_LOG(ERROR) << "Could not load actions suggestions snippet.";
-    return false;
-  }
-
-  if (lua_pcall(state_, /*nargs=*/0, /*nargs=*/1, /*errfunc=*/0) != LUA_OK) {
+  // Leave the stack as it was, whatever happens, as the state is reused.
+  const int stack_top = lua_gettop(state_);
+  if (RunSnippet(snippet_ref_, /*num_results=*/1) != LUA_OK) {
     TC3_LOG(ERROR) << "Could not run actions suggestions snippet.";
+    lua_settop(state_, stack_top);
     return false;
   }
 
-  if (RunProtected(
+  const bool success =
+      RunProtected(
           [this, actions] {
             return ReadActions(actions_entity_data_schema_,
                                annotations_entity_data_schema_, this, actions);
           },
-          /*num_args=*/1) != LUA_OK) {
+          /*num_args=*/1) == LUA_OK;
+  lua_settop(state_, stack_top);
+  if (!success) {
     TC3_LOG(ERROR) << "Could not read lua result.";
-    return false;
   }
-  return true;
+  return success;
 }
 
 }  // namespace libtextclassifier3
@@ -17,6 +17,10 @@
 #ifndef LIBTEXTCLASSIFIER_ACTIONS_LUA_ACTIONS_H_
 #define LIBTEXTCLASSIFIER_ACTIONS_LUA_ACTIONS_H_
 
+#include <memory>
+#include <string>
+#include <vector>
+
 #include "actions/actions_model_generated.h"
 #include "actions/lua-utils.h"
 #include "actions/types.h"
@@ -27,6 +31,9 @@
 namespace libtextclassifier3 {
 
 // Lua backed actions suggestions.
+// An instance can be reused for several requests: the libraries and the
+// snippet are only loaded once, and BindRequest() exposes the data of the next
+// request to the snippet.
 class LuaActionsSuggestions : public LuaEnvironment {
  public:
   static std::unique_ptr<LuaActionsSuggestions> CreateLuaActionsSuggestions(
@@ -37,8 +44,29 @@ class LuaActionsSuggestions : public LuaEnvironment {
       const reflection::Schema* actions_entity_data_schema,
       const reflection::Schema* annotations_entity_data_schema);
 
+  // Creates an instance without binding a request.
+  static std::unique_ptr<LuaActionsSuggestions> CreateLuaActionsSuggestions(
+      const std::string& snippet,
+      const reflection::Schema* actions_entity_data_schema,
+      const reflection::Schema* annotations_entity_data_schema);
+
+  // Exposes the conversation and model outputs of a request to the snippet.
+  // They need to outlive the following SuggestActions() calls.
+  bool BindRequest(const Conversation& conversation,
+                   const TfLiteModelExecutor* model_executor,
+                   const TensorflowLiteModelSpec* model_spec,
+                   const tflite::Interpreter* interpreter);
+
   bool SuggestActions(std::vector<ActionSuggestion>* actions);
 
+  // Whether the instance was created for the given entity data schemas.
+  bool HasSchemas(
+      const reflection::Schema* actions_entity_data_schema,
+      const reflection::Schema* annotations_entity_data_schema) const {
+    return actions_entity_data_schema_ == actions_entity_data_schema &&
+           annotations_entity_data_schema_ == annotations_entity_data_schema;
+  }
+
  private:
   // Model tensor lua iterator.
   class TensorViewIterator
@@ -50,23 +78,24 @@ class LuaActionsSuggestions : public LuaEnvironment {
   };
 
   LuaActionsSuggestions(
-      const std::string& snippet, const Conversation& conversation,
-      const TfLiteModelExecutor* model_executor,
-      const TensorflowLiteModelSpec* model_spec,
-      const tflite::Interpreter* interpreter,
       const reflection::Schema* actions_entity_data_schema,
       const reflection::Schema* annotations_entity_data_schema);
 
-  bool Initialize();
+  bool Initialize(const std::string& snippet);
 
-  const std::string& snippet_;
-  const Conversation& conversation_;
+  // Reference to the loaded snippet.
+  int snippet_ref_ = LUA_NOREF;
   ConversationIterator conversation_iterator_;
   TensorViewIterator tensor_iterator_;
-  TensorView<float> actions_scores_;
-  TensorView<float> smart_reply_scores_;
-  TensorView<float> sensitivity_score_;
-  TensorView<float> triggering_score_;
+
+  // Model outputs of the bound request.
+  struct ModelOutputs {
+    TensorView<float> actions_scores;
+    TensorView<float> smart_reply_scores;
+    TensorView<float> sensitivity_score;
+    TensorView<float> triggering_score;
+  };
+  std::unique_ptr<ModelOutputs> model_outputs_;
   const reflection::Schema* actions_entity_data_schema_;
   const reflection::Schema* annotations_entity_data_schema_;
 };
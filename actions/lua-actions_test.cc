@@ -17,7 +17,9 @@
 #include "actions/lua-actions.h"
 
 #include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "actions/test_utils.h"
 #include "actions/types.h"
@@ -92,6 +94,36 @@ TEST(LuaActions, ConversationActions) {
                            {IsAction("text_reply", "you are a bold one!")}));
 }
 
+TEST(LuaActions, ReusesEnvironmentAcrossRequests) {
+  const std::string test_snippet = R"(
+    if seen ~= nil then
+      return {}
+    end
+    seen = true
+    return {{ type = "text_reply", response_text = messages[1].text }}
+  )";
+  std::unique_ptr<LuaActionsSuggestions> lua_actions =
+      LuaActionsSuggestions::CreateLuaActionsSuggestions(
+          test_snippet,
+          /*actions_entity_data_schema=*/nullptr,
+          /*annotations_entity_data_schema=*/nullptr);
+  ASSERT_TRUE(lua_actions != nullptr);
+
+  // Globals set by a run must not leak into the next request.
+  for (const std::string& text : {"hello", "there"}) {
+    Conversation conversation;
+    conversation.messages.push_back({/*user_id=*/0, text});
+    std::vector<ActionSuggestion> actions;
+    EXPECT_TRUE(lua_actions->BindRequest(conversation,
+                                         /*model_executor=*/nullptr,
+                                         /*model_spec=*/nullptr,
+                                         /*interpreter=*/nullptr));
+    EXPECT_TRUE(lua_actions->SuggestActions(&actions));
+    EXPECT_THAT(actions,
+                testing::ElementsAreArray({IsAction("text_reply", text)}));
+  }
+}
+
 TEST(LuaActions, SimpleModelAction) {
   Conversation conversation;
   const std::string test_snippet = R"(
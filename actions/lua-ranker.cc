@@ -16,6 +16,7 @@
 
 #include "actions/lua-ranker.h"
 #include "utils/base/logging.h"
+#include "utils/base/tracing.h"
 #include "utils/lua-utils.h"
 
 #ifdef __cplusplus
@@ -35,21 +36,45 @@ ActionsSuggestionsLuaRanker::Create(
     const reflection::Schema* entity_data_schema,
     const reflection::Schema* annotations_entity_data_schema,
     ActionsSuggestionsResponse* response) {
-  auto ranker = std::unique_ptr<ActionsSuggestionsLuaRanker>(
-      new ActionsSuggestionsLuaRanker(
-          conversation, ranker_code, entity_data_schema,
-          annotations_entity_data_schema, response));
-  if (!ranker->Initialize()) {
+  auto ranker =
+      Create(ranker_code, entity_data_schema, annotations_entity_data_schema);
+  if (ranker == nullptr || !ranker->BindRequest(conversation, response)) {
+    return nullptr;
+  }
+  return ranker;
+}
+
+std::unique_ptr<ActionsSuggestionsLuaRanker>
+ActionsSuggestionsLuaRanker::Create(
+    const std::string& ranker_code,
+    const reflection::Schema* entity_data_schema,
+    const reflection::Schema* annotations_entity_data_schema) {
+  auto ranker =
+      std::unique_ptr<ActionsSuggestionsLuaRanker>(
+          new ActionsSuggestionsLuaRanker(entity_data_schema,
+                                          annotations_entity_data_schema));
+  if (!ranker->Initialize(ranker_code)) {
     TC3_LOG(ERROR) << "Could not initialize lua environment for ranker.";
     return nullptr;
   }
   return ranker;
 }
 
-bool ActionsSuggestionsLuaRanker::Initialize() {
-  return RunProtected([this] {
-           LoadDefaultLibraries();
+bool ActionsSuggestionsLuaRanker::Initialize(const std::string& ranker_code) {
+  if (RunProtected([this] {
+        LoadDefaultLibraries();
+        return LUA_OK;
+      }) != LUA_OK) {
+    return false;
+  }
+  ranker_ref_ = LoadSnippet(ranker_code);
+  return ranker_ref_ != LUA_NOREF;
+}
 
+bool ActionsSuggestionsLuaRanker::BindRequest(
+    const Conversation& conversation, ActionsSuggestionsResponse* response) {
+  response_ = response;
+  return RunProtected([this, &conversation] {
            // Expose generated actions.
            actions_iterator_.NewIterator("actions", &response_->actions,
                                          state_);
@@ -57,7 +82,7 @@ bool ActionsSuggestionsLuaRanker::Initialize() {
 
            // Expose conversation message stream.
            conversation_iterator_.NewIterator("messages",
-                                              &conversation_.messages, state_);
+                                              &conversation.messages, state_);
            lua_setglobal(state_, "messages");
            return LUA_OK;
          }) == LUA_OK;
@@ -94,24 +119,24 @@ bool ActionsSuggestionsLuaRanker::RankActions() {
     // Nothing to do.
     return true;
   }
+  TC3_TRACE_SCOPE("ActionsSuggestionsLuaRanker::RankActions");
 
-  if (luaL_loadbuffer(state_, ranker_code_.data(), ranker_code_.size(),
-                      /*name=*/nullptr) != LUA_OK) {
-    TC3_LOG(ERROR) << "Could not load compiled ranking snippet.";
-    return false;
-  }
-
-  if (lua_pcall(state_, /*nargs=*/0, /*nresults=*/1, /*errfunc=*/0) != LUA_OK) {
+  // Leave the stack as it was, whatever happens, as the state is reused.
+  const int stack_top = lua_gettop(state_);
+  if (RunSnippet(ranker_ref_, /*num_results=*/1) != LUA_OK) {
     TC3_LOG(ERROR) << "Could not run ranking snippet.";
+    lua_settop(state_, stack_top);
     return false;
   }
 
-  if (RunProtected([this] { return ReadActionsRanking(); }, /*num_args=*/1) !=
-      LUA_OK) {
+  const bool success =
+      RunProtected([this] { return ReadActionsRanking(); },
+                   /*num_args=*/1) == LUA_OK;
+  lua_settop(state_, stack_top);
+  if (!success) {
     TC3_LOG(ERROR) << "Could not read lua result.";
-    return false;
   }
-  return true;
+  return success;
 }
 
 }  // namespace libtextclassifier3
@@ -27,6 +27,9 @@
 namespace libtextclassifier3 {
 
 // Lua backed action suggestion ranking.
+// A ranker can be reused for several requests: the libraries and the ranking
+// snippet are only loaded once, and BindRequest() exposes the data of the next
+// request to the snippet.
 class ActionsSuggestionsLuaRanker : public LuaEnvironment {
  public:
   static std::unique_ptr<ActionsSuggestionsLuaRanker> Create(
@@ -35,29 +38,48 @@ class ActionsSuggestionsLuaRanker : public LuaEnvironment {
       const reflection::Schema* annotations_entity_data_schema,
       ActionsSuggestionsResponse* response);
 
+  // Creates a ranker without binding a request.
+  static std::unique_ptr<ActionsSuggestionsLuaRanker> Create(
+      const std::string& ranker_code,
+      const reflection::Schema* entity_data_schema,
+      const reflection::Schema* annotations_entity_data_schema);
+
+  // Exposes the conversation and the actions to rank of a request to the
+  // snippet. They need to outlive the following RankActions() calls.
+  bool BindRequest(const Conversation& conversation,
+                   ActionsSuggestionsResponse* response);
+
   bool RankActions();
 
+  // Whether the ranker was created for the given entity data schemas.
+  bool HasSchemas(
+      const reflection::Schema* entity_data_schema,
+      const reflection::Schema* annotations_entity_data_schema) const {
+    return entity_data_schema_ == entity_data_schema &&
+           annotations_entity_data_schema_ == annotations_entity_data_schema;
+  }
+
  private:
   explicit ActionsSuggestionsLuaRanker(
-      const Conversation& conversation, const std::string& ranker_code,
       const reflection::Schema* entity_data_schema,
-      const reflection::Schema* annotations_entity_data_schema,
-      ActionsSuggestionsResponse* response)
-      : conversation_(conversation),
-        ranker_code_(ranker_code),
-        response_(response),
+      const reflection::Schema* annotations_entity_data_schema)
+      : entity_data_schema_(entity_data_schema),
+        annotations_entity_data_schema_(annotations_entity_data_schema),
         actions_iterator_(entity_data_schema, annotations_entity_data_schema,
                           this),
         conversation_iterator_(annotations_entity_data_schema, this) {}
 
-  bool Initialize();
+  bool Initialize(const std::string& ranker_code);
 
   // Reads ranking results from the lua stack.
   int ReadActionsRanking();
 
-  const Conversation& conversation_;
-  const std::string& ranker_code_;
-  ActionsSuggestionsResponse* response_;
+  const reflection::Schema* const entity_data_schema_;
+  const reflection::Schema* const annotations_entity_data_schema_;
+
+  // Reference to the loaded ranking snippet.
+  int ranker_ref_ = LUA_NOREF;
+  ActionsSuggestionsResponse* response_ = nullptr;
   const ActionsIterator actions_iterator_;
   const ConversationIterator conversation_iterator_;
 };
@@ -16,6 +16,9 @@
 
 #include "actions/lua-utils.h"
 
+#include <initializer_list>
+#include <string>
+
 namespace libtextclassifier3 {
 namespace {
 static constexpr const char* kTextKey = "text";
@@ -35,6 +38,178 @@ static constexpr const char* kEndKey = "end";
 static constexpr const char* kClassificationKey = "classification";
 static constexpr const char* kSerializedEntity = "serialized_entity";
 static constexpr const char* kEntityKey = "entity";
+static constexpr const char* kUserIdKey = "user_id";
+static constexpr const char* kTimeMsUtcKey = "time_ms_utc";
+static constexpr const char* kTimezoneKey = "timezone";
+
+// Upvalues of the view callbacks.
+static constexpr int kObjectArgId = 1;
+static constexpr int kEntityDataSchemaArgId = 2;
+
+// Pushes a view of a C++ object: an empty table whose fields are looked up by
+// `callback` when they are accessed, with `upvalues` as the upvalues of the
+// callback. Nothing is copied to lua until a script reads it, so the object
+// needs to outlive the view. Values assigned by the script are stored in the
+// table and take precedence.
+void PushView(lua_CFunction callback,
+              std::initializer_list<const void*> upvalues, lua_State* state) {
+  lua_newtable(state);
+  // Not a named metatable, as the closure is bound to this object.
+  lua_createtable(state, /*narr=*/0, /*nrec=*/1);
+  for (const void* upvalue : upvalues) {
+    lua_pushlightuserdata(state, const_cast<void*>(upvalue));
+  }
+  lua_pushcclosure(state, callback, upvalues.size());
+  lua_setfield(state, /*idx=*/-2, kIndexKey);
+  lua_setmetatable(state, /*idx=*/-2);
+}
+
+// Pushes a field of serialized entity data, or nil if there is none.
+int PushEntityDataField(const reflection::Schema* entity_data_schema,
+                        const std::string& serialized_entity_data,
+                        lua_State* state) {
+  if (entity_data_schema == nullptr || serialized_entity_data.empty()) {
+    lua_pushnil(state);
+    return 1;
+  }
+  return LuaEnvironment::PushFlatbufferField(
+      entity_data_schema,
+      flatbuffers::GetRoot<flatbuffers::Table>(serialized_entity_data.data()),
+      state);
+}
+
+int PushClassificationField(const ClassificationResult& classification,
+                            const StringPiece key,
+                            const reflection::Schema* entity_data_schema,
+                            LuaEnvironment* env) {
+  lua_State* state = env->state();
+  if (key.Equals(kTimeUsecKey)) {
+    lua_pushinteger(state, classification.datetime_parse_result.time_ms_utc);
+  } else if (key.Equals(kGranularityKey)) {
+    lua_pushinteger(state, classification.datetime_parse_result.granularity);
+  } else if (key.Equals(kCollectionKey)) {
+    env->PushString(classification.collection);
+  } else if (key.Equals(kScoreKey)) {
+    lua_pushnumber(state, classification.score);
+  } else if (key.Equals(kSerializedEntity)) {
+    env->PushString(classification.serialized_entity_data);
+  } else {
+    return PushEntityDataField(entity_data_schema,
+                               classification.serialized_entity_data, state);
+  }
+  return 1;
+}
+
+// Only string keys name fields, anything else is nil as for a plain table.
+bool ReadFieldKey(const LuaEnvironment* env, StringPiece* key) {
+  if (lua_type(env->state(), /*idx=*/-1) != LUA_TSTRING) {
+    lua_pushnil(env->state());
+    return false;
+  }
+  *key = env->ReadString(/*index=*/-1);
+  return true;
+}
+
+int ClassificationFieldCallback(lua_State* state) {
+  const ClassificationResult* classification =
+      FromUpValue<const ClassificationResult*>(kObjectArgId, state);
+  const reflection::Schema* entity_data_schema =
+      FromUpValue<const reflection::Schema*>(kEntityDataSchemaArgId, state);
+  LuaEnvironment* env = FromUpValue<LuaEnvironment*>(3, state);
+  StringPiece key;
+  if (!ReadFieldKey(env, &key)) {
+    return 1;
+  }
+  return PushClassificationField(*classification, key, entity_data_schema,
+                                 env);
+}
+
+int ActionAnnotationFieldCallback(lua_State* state) {
+  const ActionSuggestionAnnotation* annotation =
+      FromUpValue<const ActionSuggestionAnnotation*>(kObjectArgId, state);
+  const reflection::Schema* entity_data_schema =
+      FromUpValue<const reflection::Schema*>(kEntityDataSchemaArgId, state);
+  LuaEnvironment* env = FromUpValue<LuaEnvironment*>(3, state);
+  StringPiece key;
+  if (!ReadFieldKey(env, &key)) {
+    return 1;
+  }
+  if (key.Equals(kNameKey)) {
+    env->PushString(annotation->name);
+  } else if (key.Equals(kTextKey)) {
+    env->PushString(annotation->span.text);
+  } else if (key.Equals(kSpanKey)) {
+    lua_newtable(state);
+    lua_pushinteger(state, annotation->span.message_index);
+    lua_setfield(state, /*idx=*/-2, kMessageKey);
+    lua_pushinteger(state, annotation->span.span.first);
+    lua_setfield(state, /*idx=*/-2, kBeginKey);
+    lua_pushinteger(state, annotation->span.span.second);
+    lua_setfield(state, /*idx=*/-2, kEndKey);
+  } else {
+    return PushClassificationField(annotation->entity, key,
+                                   entity_data_schema, env);
+  }
+  return 1;
+}
+
+int ActionFieldCallback(lua_State* state) {
+  const ActionSuggestion* action =
+      FromUpValue<const ActionSuggestion*>(kObjectArgId, state);
+  const reflection::Schema* entity_data_schema =
+      FromUpValue<const reflection::Schema*>(kEntityDataSchemaArgId, state);
+  const AnnotationIterator<ActionSuggestionAnnotation>* annotation_iterator =
+      FromUpValue<const AnnotationIterator<ActionSuggestionAnnotation>*>(
+          3, state);
+  LuaEnvironment* env = FromUpValue<LuaEnvironment*>(4, state);
+  StringPiece key;
+  if (!ReadFieldKey(env, &key)) {
+    return 1;
+  }
+  if (key.Equals(kTypeKey)) {
+    env->PushString(action->type);
+  } else if (key.Equals(kResponseTextKey)) {
+    env->PushString(action->response_text);
+  } else if (key.Equals(kScoreKey)) {
+    lua_pushnumber(state, action->score);
+  } else if (key.Equals(kPriorityScoreKey)) {
+    lua_pushnumber(state, action->priority_score);
+  } else if (key.Equals(kAnnotationKey)) {
+    annotation_iterator->NewIterator(kAnnotationKey, &action->annotations,
+                                     state);
+  } else {
+    return PushEntityDataField(entity_data_schema,
+                               action->serialized_entity_data, state);
+  }
+  return 1;
+}
+
+int MessageFieldCallback(lua_State* state) {
+  const ConversationMessage* message =
+      FromUpValue<const ConversationMessage*>(kObjectArgId, state);
+  const AnnotatedSpanIterator* annotated_span_iterator =
+      FromUpValue<const AnnotatedSpanIterator*>(2, state);
+  LuaEnvironment* env = FromUpValue<LuaEnvironment*>(3, state);
+  StringPiece key;
+  if (!ReadFieldKey(env, &key)) {
+    return 1;
+  }
+  if (key.Equals(kUserIdKey)) {
+    lua_pushinteger(state, message->user_id);
+  } else if (key.Equals(kTextKey)) {
+    env->PushString(message->text);
+  } else if (key.Equals(kTimeMsUtcKey)) {
+    lua_pushinteger(state, message->reference_time_ms_utc);
+  } else if (key.Equals(kTimezoneKey)) {
+    env->PushString(message->reference_timezone);
+  } else if (key.Equals(kAnnotationKey)) {
+    annotated_span_iterator->NewIterator(kAnnotationKey,
+                                         &message->annotations, state);
+  } else {
+    lua_pushnil(state);
+  }
+  return 1;
+}
 }  // namespace
 
 template <>
@@ -73,27 +248,8 @@ int AnnotationIterator<ActionSuggestionAnnotation>::Item(
 void PushAnnotation(const ClassificationResult& classification,
                     const reflection::Schema* entity_data_schema,
                     LuaEnvironment* env) {
-  if (entity_data_schema == nullptr ||
-      classification.serialized_entity_data.empty()) {
-    // Empty table.
-    lua_newtable(env->state());
-  } else {
-    env->PushFlatbuffer(entity_data_schema,
-                        flatbuffers::GetRoot<flatbuffers::Table>(
-                            classification.serialized_entity_data.data()));
-  }
-  lua_pushinteger(env->state(),
-                  classification.datetime_parse_result.time_ms_utc);
-  lua_setfield(env->state(), /*idx=*/-2, kTimeUsecKey);
-  lua_pushinteger(env->state(),
-                  classification.datetime_parse_result.granularity);
-  lua_setfield(env->state(), /*idx=*/-2, kGranularityKey);
-  env->PushString(classification.collection);
-  lua_setfield(env->state(), /*idx=*/-2, kCollectionKey);
-  lua_pushnumber(env->state(), classification.score);
-  lua_setfield(env->state(), /*idx=*/-2, kScoreKey);
-  env->PushString(classification.serialized_entity_data);
-  lua_setfield(env->state(), /*idx=*/-2, kSerializedEntity);
+  PushView(&ClassificationFieldCallback,
+           {&classification, entity_data_schema, env}, env->state());
 }
 
 void PushAnnotation(const ClassificationResult& classification,
@@ -230,20 +386,8 @@ ClassificationResult ReadClassificationResult(
 void PushAnnotation(const ActionSuggestionAnnotation& annotation,
                     const reflection::Schema* entity_data_schema,
                     LuaEnvironment* env) {
-  PushAnnotation(annotation.entity, annotation.span.text, entity_data_schema,
-                 env);
-  env->PushString(annotation.name);
-  lua_setfield(env->state(), /*idx=*/-2, kNameKey);
-  {
-    lua_newtable(env->state());
-    lua_pushinteger(env->state(), annotation.span.message_index);
-    lua_setfield(env->state(), /*idx=*/-2, kMessageKey);
-    lua_pushinteger(env->state(), annotation.span.span.first);
-    lua_setfield(env->state(), /*idx=*/-2, kBeginKey);
-    lua_pushinteger(env->state(), annotation.span.span.second);
-    lua_setfield(env->state(), /*idx=*/-2, kEndKey);
-  }
-  lua_setfield(env->state(), /*idx=*/-2, kSpanKey);
+  PushView(&ActionAnnotationFieldCallback,
+           {&annotation, entity_data_schema, env}, env->state());
 }
 
 void PushAction(
@@ -251,25 +395,9 @@ void PushAction(
     const reflection::Schema* entity_data_schema,
     const AnnotationIterator<ActionSuggestionAnnotation>& annotation_iterator,
     LuaEnvironment* env) {
-  if (entity_data_schema == nullptr || action.serialized_entity_data.empty()) {
-    // Empty table.
-    lua_newtable(env->state());
-  } else {
-    env->PushFlatbuffer(entity_data_schema,
-                        flatbuffers::GetRoot<flatbuffers::Table>(
-                            action.serialized_entity_data.data()));
-  }
-  env->PushString(action.type);
-  lua_setfield(env->state(), /*idx=*/-2, kTypeKey);
-  env->PushString(action.response_text);
-  lua_setfield(env->state(), /*idx=*/-2, kResponseTextKey);
-  lua_pushnumber(env->state(), action.score);
-  lua_setfield(env->state(), /*idx=*/-2, kScoreKey);
-  lua_pushnumber(env->state(), action.priority_score);
-  lua_setfield(env->state(), /*idx=*/-2, kPriorityScoreKey);
-  annotation_iterator.NewIterator(kAnnotationKey, &action.annotations,
-                                  env->state());
-  lua_setfield(env->state(), /*idx=*/-2, kAnnotationKey);
+  PushView(&ActionFieldCallback,
+           {&action, entity_data_schema, &annotation_iterator, env},
+           env->state());
 }
 
 ActionSuggestion ReadAction(
@@ -335,19 +463,8 @@ int ReadActions(const reflection::Schema* actions_entity_data_schema,
 
 int ConversationIterator::Item(const std::vector<ConversationMessage>* messages,
                                const int64 pos, lua_State* state) const {
-  const ConversationMessage& message = (*messages)[pos];
-  lua_newtable(state);
-  lua_pushinteger(state, message.user_id);
-  lua_setfield(state, /*idx=*/-2, "user_id");
-  env_->PushString(message.text);
-  lua_setfield(state, /*idx=*/-2, "text");
-  lua_pushinteger(state, message.reference_time_ms_utc);
-  lua_setfield(state, /*idx=*/-2, "time_ms_utc");
-  env_->PushString(message.reference_timezone);
-  lua_setfield(state, /*idx=*/-2, "timezone");
-  annotated_span_iterator_.NewIterator("annotation", &message.annotations,
-                                       state);
-  lua_setfield(state, /*idx=*/-2, "annotation");
+  PushView(&MessageFieldCallback,
+           {&(*messages)[pos], &annotated_span_iterator_, env_}, state);
   return 1;
 }
 
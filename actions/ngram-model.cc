@@ -16,8 +16,6 @@
 
 #include "actions/ngram-model.h"
 
-#include <algorithm>
-
 #include "actions/feature-processor.h"
 #include "utils/hash/farmhash.h"
 #include "utils/strings/stringpiece.h"
@@ -25,44 +23,17 @@
 namespace libtextclassifier3 {
 namespace {
 
-// An iterator to iterate over the initial tokens of the n-grams of a model.
-class FirstTokenIterator
-    : public std::iterator<std::random_access_iterator_tag,
-                           /*value_type=*/uint32, /*difference_type=*/ptrdiff_t,
-                           /*pointer=*/const uint32*,
-                           /*reference=*/uint32&> {
- public:
-  explicit FirstTokenIterator(const NGramLinearRegressionModel* model,
-                              int index)
-      : model_(model), index_(index) {}
-
-  FirstTokenIterator& operator++() {
-    index_++;
-    return *this;
-  }
-  FirstTokenIterator& operator+=(ptrdiff_t dist) {
-    index_ += dist;
-    return *this;
-  }
-  ptrdiff_t operator-(const FirstTokenIterator& other_it) const {
-    return index_ - other_it.index_;
-  }
-  uint32 operator*() const {
-    const uint32 token_offset = (*model_->ngram_start_offsets())[index_];
-    return (*model_->hashed_ngram_tokens())[token_offset];
-  }
-  int index() const { return index_; }
-
- private:
-  const NGramLinearRegressionModel* model_;
-  int index_;
-};
+// Returns the hash table bucket of a token hash. Fingerprints are uniformly
+// distributed, so the low bits can be used directly.
+int BucketIndex(uint32 token_hash, int num_buckets) {
+  return token_hash & (num_buckets - 1);
+}
 
 }  // anonymous namespace
 
 std::unique_ptr<NGramModel> NGramModel::Create(
     const NGramLinearRegressionModel* model, const Tokenizer* tokenizer,
-    const UniLib* unilib) {
+    const UniLib* unilib, const ActionsTokenizerOptions* tokenizer_options) {
   if (model == nullptr) {
     return nullptr;
   }
@@ -70,20 +41,65 @@ std::unique_ptr<NGramModel> NGramModel::Create(
     TC3_LOG(ERROR) << "No tokenizer options specified.";
     return nullptr;
   }
-  return std::unique_ptr<NGramModel>(new NGramModel(model, tokenizer, unilib));
+  return std::unique_ptr<NGramModel>(
+      new NGramModel(model, tokenizer, unilib, tokenizer_options));
 }
 
 NGramModel::NGramModel(const NGramLinearRegressionModel* model,
-                       const Tokenizer* tokenizer, const UniLib* unilib)
+                       const Tokenizer* tokenizer, const UniLib* unilib,
+                       const ActionsTokenizerOptions* tokenizer_options)
     : model_(model) {
-  // Create new tokenizer if options are specified, reuse feature processor
-  // tokenizer otherwise.
-  if (model->tokenizer_options() != nullptr) {
+  // Create new tokenizer if options are specified and differ from the ones of
+  // the feature processor, reuse feature processor tokenizer otherwise.
+  if (model->tokenizer_options() != nullptr &&
+      (tokenizer == nullptr ||
+       !TokenizerOptionsEqual(model->tokenizer_options(), tokenizer_options))) {
     owned_tokenizer_ = CreateTokenizer(model->tokenizer_options(), unilib);
     tokenizer_ = owned_tokenizer_.get();
   } else {
     tokenizer_ = tokenizer;
   }
+  BuildIndex();
+}
+
+void NGramModel::BuildIndex() {
+  const int num_ngrams =
+      model_->ngram_weights() == nullptr ? 0 : model_->ngram_weights()->size();
+  if (num_ngrams == 0) {
+    return;
+  }
+  const uint32* hashed_ngram_tokens = model_->hashed_ngram_tokens()->data();
+  ngrams_.reserve(num_ngrams);
+  int num_first_tokens = 0;
+  for (int i = 0; i < num_ngrams; i++) {
+    const uint16 begin = (*model_->ngram_start_offsets())[i];
+    const uint16 end = (*model_->ngram_start_offsets())[i + 1];
+    ngrams_.push_back(NGram{hashed_ngram_tokens + begin, end - begin,
+                            (*model_->ngram_weights())[i]});
+    if (i == 0 || ngrams_[i].tokens[0] != ngrams_[i - 1].tokens[0]) {
+      ++num_first_tokens;
+    }
+  }
+
+  // Keep the load factor at most 1/2.
+  int num_buckets = 1;
+  while (num_buckets < 2 * num_first_tokens) {
+    num_buckets *= 2;
+  }
+  first_token_buckets_.resize(num_buckets);
+  for (int begin = 0; begin < num_ngrams;) {
+    const uint32 token_hash = ngrams_[begin].tokens[0];
+    int end = begin + 1;
+    while (end < num_ngrams && ngrams_[end].tokens[0] == token_hash) {
+      ++end;
+    }
+    int index = BucketIndex(token_hash, num_buckets);
+    while (first_token_buckets_[index].end != 0) {
+      index = (index + 1) & (num_buckets - 1);
+    }
+    first_token_buckets_[index] = FirstTokenBucket{token_hash, begin, end};
+    begin = end;
+  }
 }
 
 // Returns whether a given n-gram matches the token stream.
@@ -138,17 +154,27 @@ uint64 NGramModel::GetNumSkipGrams(int num_tokens, int max_ngram_length,
 }
 
 std::pair<int, int> NGramModel::GetFirstTokenMatches(uint32 token_hash) const {
-  const int num_ngrams = model_->ngram_weights()->size();
-  const auto start_it = FirstTokenIterator(model_, 0);
-  const auto end_it = FirstTokenIterator(model_, num_ngrams);
-  const int start = std::lower_bound(start_it, end_it, token_hash).index();
-  const int end = std::upper_bound(start_it, end_it, token_hash).index();
-  return std::make_pair(start, end);
+  const int num_buckets = first_token_buckets_.size();
+  if (num_buckets == 0) {
+    return std::make_pair(0, 0);
+  }
+  for (int index = BucketIndex(token_hash, num_buckets);
+       first_token_buckets_[index].end != 0;
+       index = (index + 1) & (num_buckets - 1)) {
+    const FirstTokenBucket& bucket = first_token_buckets_[index];
+    if (bucket.token_hash == token_hash) {
+      return std::make_pair(bucket.begin, bucket.end);
+    }
+  }
+  return std::make_pair(0, 0);
 }
 
 bool NGramModel::Eval(const UnicodeText& text, float* score) const {
-  const std::vector<Token> raw_tokens = tokenizer_->Tokenize(text);
+  return Eval(tokenizer_->Tokenize(text), score);
+}
 
+bool NGramModel::Eval(const std::vector<Token>& raw_tokens,
+                      float* score) const {
   // If we have no tokens, then just bail early.
   if (raw_tokens.empty()) {
     if (score != nullptr) {
@@ -171,6 +197,7 @@ bool NGramModel::Eval(const UnicodeText& text, float* score) const {
       tokens.size(), model_->max_denom_ngram_length(), model_->max_skips());
 
   // For each token, see whether it denotes the start of an n-gram in the model.
+  const int max_skips = model_->max_skips();
   int num_matches = 0;
   float weight_matches = 0.f;
   for (size_t start_i = 0; start_i < tokens.size(); ++start_i) {
@@ -178,19 +205,15 @@ bool NGramModel::Eval(const UnicodeText& text, float* score) const {
         GetFirstTokenMatches(tokens[start_i]);
     for (int ngram_idx = ngram_range.first; ngram_idx < ngram_range.second;
          ++ngram_idx) {
-      const uint16 ngram_tokens_begin =
-          (*model_->ngram_start_offsets())[ngram_idx];
-      const uint16 ngram_tokens_end =
-          (*model_->ngram_start_offsets())[ngram_idx + 1];
+      const NGram& ngram = ngrams_[ngram_idx];
       if (IsNGramMatch(
               /*tokens=*/tokens.data() + start_i,
               /*num_tokens=*/tokens.size() - start_i,
-              /*ngram_tokens=*/model_->hashed_ngram_tokens()->data() +
-                  ngram_tokens_begin,
-              /*num_ngram_tokens=*/ngram_tokens_end - ngram_tokens_begin,
-              /*max_skips=*/model_->max_skips())) {
+              /*ngram_tokens=*/ngram.tokens,
+              /*num_ngram_tokens=*/ngram.num_tokens,
+              /*max_skips=*/max_skips)) {
         ++num_matches;
-        weight_matches += (*model_->ngram_weights())[ngram_idx];
+        weight_matches += ngram.weight;
       }
     }
   }
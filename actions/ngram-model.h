@@ -18,6 +18,8 @@
 #define LIBTEXTCLASSIFIER_ACTIONS_NGRAM_MODEL_H_
 
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "actions/actions_model_generated.h"
 #include "utils/tokenizer.h"
@@ -28,22 +30,53 @@ namespace libtextclassifier3 {
 
 class NGramModel {
  public:
+  // The model uses its own tokenizer if it has tokenizer options, otherwise
+  // `tokenizer`. If `tokenizer_options` are given, they are the options
+  // `tokenizer` was created from, and it is also used if the model's tokenizer
+  // options are the same.
   static std::unique_ptr<NGramModel> Create(
       const NGramLinearRegressionModel* model, const Tokenizer* tokenizer,
-      const UniLib* unilib);
+      const UniLib* unilib,
+      const ActionsTokenizerOptions* tokenizer_options = nullptr);
 
   // Evaluates an n-gram linear regression model, and tests against the
   // threshold. Returns true in case of a positive classification. The caller
   // may also optionally query the score.
   bool Eval(const UnicodeText& text, float* score = nullptr) const;
 
+  // Same as above, but takes the text already tokenized with tokenizer().
+  bool Eval(const std::vector<Token>& raw_tokens,
+            float* score = nullptr) const;
+
+  // The tokenizer used by the model.
+  const Tokenizer* tokenizer() const { return tokenizer_; }
+
   // Exposed for testing only.
   static uint64 GetNumSkipGrams(int num_tokens, int max_ngram_length,
                                 int max_skips);
 
  private:
   NGramModel(const NGramLinearRegressionModel* model,
-             const Tokenizer* tokenizer, const UniLib* unilib);
+             const Tokenizer* tokenizer, const UniLib* unilib,
+             const ActionsTokenizerOptions* tokenizer_options);
+
+  // An n-gram of the model, with its tokens.
+  struct NGram {
+    const uint32* tokens;
+    int num_tokens;
+    float weight;
+  };
+
+  // The n-grams starting with a given token, ngrams_[begin, end). An empty
+  // bucket has end == 0.
+  struct FirstTokenBucket {
+    uint32 token_hash = 0;
+    int begin = 0;
+    int end = 0;
+  };
+
+  // Builds ngrams_ and the first token hash table from the model.
+  void BuildIndex();
 
   // Returns the (begin,end] range of n-grams where the first hashed token
   // matches the given value.
@@ -57,6 +90,13 @@ class NGramModel {
   const NGramLinearRegressionModel* model_;
   const Tokenizer* tokenizer_;
   std::unique_ptr<Tokenizer> owned_tokenizer_;
+
+  // The n-grams of the model, ordered by their first token as in the model.
+  std::vector<NGram> ngrams_;
+
+  // Open addressing hash table with linear probing from the first token of
+  // the n-grams to their range in ngrams_. The size is a power of two.
+  std::vector<FirstTokenBucket> first_token_buckets_;
 };
 
 }  // namespace libtextclassifier3
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <string>
+
+#include "actions/actions-suggestions.h"
+#include "actions/feature-processor.h"
+#include "actions/ngram-model.h"
+#include "utils/memory/mmap.h"
+#include "utils/testing/benchmark-utils.h"
+#include "utils/utf8/unicodetext.h"
+#include "utils/utf8/unilib.h"
+#include "benchmark/benchmark.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+// The low confidence n-gram model of the English actions model, set up as in
+// ActionsSuggestions.
+struct LowConfidenceModel {
+  explicit LowConfidenceModel(const std::string& path) : mmap(path) {}
+
+  ScopedMmap mmap;
+  UniLib unilib;
+  std::unique_ptr<ActionsFeatureProcessor> feature_processor;
+  std::unique_ptr<NGramModel> ngram_model;
+};
+
+// Returns the model, or nullptr if it isn't available.
+const LowConfidenceModel* GetLowConfidenceModel() {
+  static const LowConfidenceModel* const low_confidence_model = []() {
+    std::unique_ptr<LowConfidenceModel> low_confidence_model(
+        new LowConfidenceModel(
+            BenchmarkModelPath("actions_suggestions.en.model")));
+    if (!low_confidence_model->mmap.handle().ok()) {
+      return static_cast<LowConfidenceModel*>(nullptr);
+    }
+    const ActionsModel* model =
+        ViewActionsModel(low_confidence_model->mmap.handle().start(),
+                         low_confidence_model->mmap.handle().num_bytes());
+    if (model == nullptr) {
+      return static_cast<LowConfidenceModel*>(nullptr);
+    }
+    const ActionsTokenFeatureProcessorOptions* options =
+        model->feature_processor_options();
+    if (options != nullptr && options->tokenizer_options() != nullptr) {
+      low_confidence_model->feature_processor.reset(
+          new ActionsFeatureProcessor(options, &low_confidence_model->unilib));
+    }
+    const ActionsFeatureProcessor* feature_processor =
+        low_confidence_model->feature_processor.get();
+    low_confidence_model->ngram_model = NGramModel::Create(
+        model->low_confidence_ngram_model(),
+        feature_processor == nullptr ? nullptr : feature_processor->tokenizer(),
+        &low_confidence_model->unilib,
+        feature_processor == nullptr ? nullptr : options->tokenizer_options());
+    if (low_confidence_model->ngram_model == nullptr) {
+      return static_cast<LowConfidenceModel*>(nullptr);
+    }
+    return low_confidence_model.release();
+  }();
+  return low_confidence_model;
+}
+
+void BM_NGramModelEval(benchmark::State& state) {
+  const LowConfidenceModel* low_confidence_model = GetLowConfidenceModel();
+  if (low_confidence_model == nullptr) {
+    state.SkipWithError("Couldn't load the n-gram model.");
+    return;
+  }
+  const BenchmarkScript script = static_cast<BenchmarkScript>(state.range(0));
+  state.SetLabel(BenchmarkScriptName(script));
+  const std::string text = BenchmarkScriptText(script, state.range(1));
+  const UnicodeText text_unicode = UTF8ToUnicodeText(text, /*do_copy=*/false);
+
+  float score;
+  RunMeasuredBenchmark(state, text.size(), [&]() {
+    benchmark::DoNotOptimize(
+        low_confidence_model->ngram_model->Eval(text_unicode, &score));
+  });
+}
+BENCHMARK(BM_NGramModelEval)->Apply(ScriptsAndLengths);
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "actions/ngram-model.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "actions/actions_model_generated.h"
+#include "actions/feature-processor.h"
+#include "utils/hash/farmhash.h"
+#include "gtest/gtest.h"
+#include "flatbuffers/flatbuffers.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+// Options of a tokenizer that splits on spaces.
+std::unique_ptr<ActionsTokenizerOptionsT> WhitespaceTokenizerOptions() {
+  std::unique_ptr<ActionsTokenizerOptionsT> options(
+      new ActionsTokenizerOptionsT);
+  options->tokenization_codepoint_config.emplace_back(
+      new TokenizationCodepointRangeT);
+  TokenizationCodepointRangeT* config =
+      options->tokenization_codepoint_config.back().get();
+  config->start = 32;
+  config->end = 33;
+  config->role = TokenizationCodepointRange_::Role_WHITESPACE_SEPARATOR;
+  return options;
+}
+
+class NGramModelTest : public testing::Test {
+ protected:
+  NGramModelTest() {
+    model_.low_confidence_ngram_model.reset(new NGramLinearRegressionModelT);
+    ngram_model_ = model_.low_confidence_ngram_model.get();
+    ngram_model_->default_token_weight = 0.0;
+    ngram_model_->max_denom_ngram_length = 2;
+    ngram_model_->max_skips = 1;
+    ngram_model_->threshold = 0.1;
+    ngram_model_->tokenizer_options = WhitespaceTokenizerOptions();
+  }
+
+  // Sets the n-grams of the model, all with weight 1, sorted by the hash of
+  // their first token as the model requires.
+  void SetNGrams(const std::vector<std::vector<std::string>>& ngrams) {
+    std::vector<std::vector<uint32>> hashed_ngrams;
+    for (const std::vector<std::string>& ngram : ngrams) {
+      hashed_ngrams.emplace_back();
+      for (const std::string& token : ngram) {
+        hashed_ngrams.back().push_back(
+            tc3farmhash::Fingerprint32(token.data(), token.size()));
+      }
+    }
+    std::sort(hashed_ngrams.begin(), hashed_ngrams.end());
+
+    ngram_model_->hashed_ngram_tokens.clear();
+    ngram_model_->ngram_start_offsets.clear();
+    ngram_model_->ngram_weights.clear();
+    for (const std::vector<uint32>& hashed_ngram : hashed_ngrams) {
+      ngram_model_->ngram_start_offsets.push_back(
+          ngram_model_->hashed_ngram_tokens.size());
+      ngram_model_->hashed_ngram_tokens.insert(
+          ngram_model_->hashed_ngram_tokens.end(), hashed_ngram.begin(),
+          hashed_ngram.end());
+      ngram_model_->ngram_weights.push_back(1.0);
+    }
+    ngram_model_->ngram_start_offsets.push_back(
+        ngram_model_->hashed_ngram_tokens.size());
+  }
+
+  const ActionsModel* PackModel() {
+    flatbuffers::FlatBufferBuilder builder;
+    FinishActionsModelBuffer(builder, ActionsModel::Pack(builder, &model_));
+    buffer_ = builder.ReleaseBufferPointer();
+    return flatbuffers::GetRoot<ActionsModel>(buffer_.data());
+  }
+
+  std::unique_ptr<NGramModel> CreateNGramModel() {
+    return NGramModel::Create(PackModel()->low_confidence_ngram_model(),
+                              /*tokenizer=*/nullptr, /*unilib=*/nullptr);
+  }
+
+  flatbuffers::DetachedBuffer buffer_;
+  ActionsModelT model_;
+  NGramLinearRegressionModelT* ngram_model_;
+};
+
+TEST_F(NGramModelTest, MatchesSkipGrams) {
+  SetNGrams({{"good", "morning"}, {"hello"}});
+  const std::unique_ptr<NGramModel> model = CreateNGramModel();
+  ASSERT_NE(model, nullptr);
+
+  // 3 unigrams, 2 bigrams and 1 bigram with a skip, of which one matches.
+  float score;
+  EXPECT_TRUE(model->Eval(UTF8ToUnicodeText("good very morning"), &score));
+  EXPECT_FLOAT_EQ(score, 1.0 / 6.0);
+
+  EXPECT_FALSE(model->Eval(UTF8ToUnicodeText("good very very morning")));
+  EXPECT_FALSE(model->Eval(UTF8ToUnicodeText("nothing here"), &score));
+  EXPECT_FLOAT_EQ(score, 0.0);
+}
+
+TEST_F(NGramModelTest, FindsAllFirstTokens) {
+  std::vector<std::vector<std::string>> ngrams;
+  for (int i = 0; i < 100; i++) {
+    ngrams.push_back({"token" + std::to_string(i)});
+  }
+  ngrams.push_back({"token42", "token43"});
+  SetNGrams(ngrams);
+  const std::unique_ptr<NGramModel> model = CreateNGramModel();
+  ASSERT_NE(model, nullptr);
+
+  for (int i = 0; i < 100; i++) {
+    float score;
+    EXPECT_TRUE(model->Eval(
+        UTF8ToUnicodeText("token" + std::to_string(i), /*do_copy=*/false),
+        &score));
+    EXPECT_FLOAT_EQ(score, 1.0);
+  }
+  EXPECT_FALSE(model->Eval(UTF8ToUnicodeText("token100")));
+
+  // Both unigrams and the bigram match.
+  float score;
+  EXPECT_TRUE(model->Eval(UTF8ToUnicodeText("token42 token43"), &score));
+  EXPECT_FLOAT_EQ(score, 1.0);
+}
+
+TEST_F(NGramModelTest, EvaluatesTokenizedText) {
+  SetNGrams({{"good", "morning"}, {"hello"}});
+  const std::unique_ptr<NGramModel> model = CreateNGramModel();
+  ASSERT_NE(model, nullptr);
+
+  float score;
+  EXPECT_TRUE(model->Eval(
+      model->tokenizer()->Tokenize(std::string("good very morning")), &score));
+  EXPECT_FLOAT_EQ(score, 1.0 / 6.0);
+}
+
+TEST_F(NGramModelTest, ReusesTokenizerWithSameOptions) {
+  SetNGrams({{"hello"}});
+  model_.feature_processor_options.reset(
+      new ActionsTokenFeatureProcessorOptionsT);
+  model_.feature_processor_options->tokenizer_options =
+      WhitespaceTokenizerOptions();
+  const ActionsModel* model = PackModel();
+  const ActionsTokenizerOptions* tokenizer_options =
+      model->feature_processor_options()->tokenizer_options();
+  const std::unique_ptr<Tokenizer> tokenizer =
+      CreateTokenizer(tokenizer_options, /*unilib=*/nullptr);
+
+  const std::unique_ptr<NGramModel> ngram_model =
+      NGramModel::Create(model->low_confidence_ngram_model(), tokenizer.get(),
+                         /*unilib=*/nullptr, tokenizer_options);
+  ASSERT_NE(ngram_model, nullptr);
+  EXPECT_EQ(ngram_model->tokenizer(), tokenizer.get());
+}
+
+TEST_F(NGramModelTest, CreatesTokenizerWithDifferentOptions) {
+  SetNGrams({{"hello"}});
+  model_.feature_processor_options.reset(
+      new ActionsTokenFeatureProcessorOptionsT);
+  model_.feature_processor_options->tokenizer_options =
+      WhitespaceTokenizerOptions();
+  model_.feature_processor_options->tokenizer_options
+      ->tokenize_on_script_change = true;
+  const ActionsModel* model = PackModel();
+  const ActionsTokenizerOptions* tokenizer_options =
+      model->feature_processor_options()->tokenizer_options();
+  const std::unique_ptr<Tokenizer> tokenizer =
+      CreateTokenizer(tokenizer_options, /*unilib=*/nullptr);
+
+  const std::unique_ptr<NGramModel> ngram_model =
+      NGramModel::Create(model->low_confidence_ngram_model(), tokenizer.get(),
+                         /*unilib=*/nullptr, tokenizer_options);
+  ASSERT_NE(ngram_model, nullptr);
+  EXPECT_NE(ngram_model->tokenizer(), tokenizer.get());
+}
+
+TEST_F(NGramModelTest, HandlesModelWithoutNGrams) {
+  SetNGrams({});
+  const std::unique_ptr<NGramModel> model = CreateNGramModel();
+  ASSERT_NE(model, nullptr);
+  EXPECT_FALSE(model->Eval(UTF8ToUnicodeText("hello")));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
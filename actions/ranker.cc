@@ -16,15 +16,19 @@
 
 #include "actions/ranker.h"
 
-#include <functional>
-#include <set>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "actions/lua-ranker.h"
 #include "actions/zlib-utils.h"
 #include "annotator/types.h"
 #include "utils/base/logging.h"
+#include "utils/hash/farmhash.h"
 #include "utils/lua-utils.h"
+#include "utils/shared-string-cache.h"
 
 namespace libtextclassifier3 {
 namespace {
@@ -142,53 +146,235 @@ bool IsEquivalentActionSuggestion(const ActionSuggestion& action,
   return Compare(action, other) == 0;
 }
 
-// Checks whether any action is equivalent to the given one.
-bool IsAnyActionEquivalent(const ActionSuggestion& action,
-                           const std::vector<ActionSuggestion>& actions) {
-  for (const ActionSuggestion& other : actions) {
-    if (IsEquivalentActionSuggestion(action, other)) {
-      return true;
-    }
+// Hashes of the fields that the comparisons above look at, so that equivalent
+// annotations and actions have the same hash.
+uint64 HashInt(uint64 hash, int64 value) {
+  return tc3farmhash::Hash64WithSeed(reinterpret_cast<const char*>(&value),
+                                     sizeof(value), hash);
+}
+
+uint64 HashString(uint64 hash, const std::string& value) {
+  return tc3farmhash::Hash64WithSeed(value.data(), value.size(), hash);
+}
+
+uint64 HashAnnotations(const ActionSuggestion& action) {
+  uint64 hash = HashInt(0, action.annotations.size());
+  for (const ActionSuggestionAnnotation& annotation : action.annotations) {
+    hash = HashInt(hash, annotation.span.message_index);
+    hash = HashInt(hash, annotation.span.span.first);
+    hash = HashInt(hash, annotation.span.span.second);
+    hash = HashString(hash, annotation.name);
+    hash = HashString(hash, annotation.entity.collection);
   }
-  return false;
+  return hash;
 }
 
-bool IsConflicting(const ActionSuggestionAnnotation& annotation,
-                   const ActionSuggestionAnnotation& other) {
-  // Two annotations are conflicting if they are different but refer to
-  // overlapping spans in the conversation.
-  return (!IsEquivalentActionAnnotation(annotation, other) &&
-          TextSpansIntersect(annotation.span, other.span));
+uint64 HashAction(const ActionSuggestion& action) {
+  uint64 hash = HashAnnotations(action);
+  hash = HashString(hash, action.type);
+  hash = HashString(hash, action.response_text);
+  return HashString(hash, action.serialized_entity_data);
 }
 
-// Checks whether two action suggestions can be considered conflicting.
-bool IsConflictingActionSuggestion(const ActionSuggestion& action,
-                                   const ActionSuggestion& other) {
-  // Actions are considered conflicting, iff they refer to the same text span,
-  // but were not generated from the same annotation.
-  if (action.annotations.empty() || other.annotations.empty()) {
+// The kept actions, by their hash, to find the equivalent ones.
+class KeptActions {
+ public:
+  explicit KeptActions(const std::vector<ActionSuggestion>* actions)
+      : actions_(actions) {}
+
+  bool IsRedundant(const ActionSuggestion& action) const {
+    const auto range = actions_by_hash_.equal_range(HashAction(action));
+    for (auto it = range.first; it != range.second; ++it) {
+      if (IsEquivalentActionSuggestion(action, (*actions_)[it->second])) {
+        return true;
+      }
+    }
     return false;
   }
-  for (const ActionSuggestionAnnotation& annotation : action.annotations) {
-    for (const ActionSuggestionAnnotation& other_annotation :
-         other.annotations) {
-      if (IsConflicting(annotation, other_annotation)) {
+
+  void Add(int index) {
+    actions_by_hash_.emplace(HashAction((*actions_)[index]), index);
+  }
+
+ private:
+  const std::vector<ActionSuggestion>* const actions_;
+  std::unordered_multimap<uint64, int> actions_by_hash_;
+};
+
+// The annotations of the kept actions, to find the actions that conflict with
+// them. Actions are conflicting, iff they refer to overlapping text spans, but
+// were not generated from the same annotation. Equivalent annotations are kept
+// once, ordered by message and start, so only the ones that start within the
+// longest kept span before an annotation can overlap it.
+class KeptAnnotations {
+ public:
+  explicit KeptAnnotations(const std::vector<ActionSuggestion>* actions)
+      : actions_(actions) {}
+
+  bool IsRedundant(const ActionSuggestion& action) const {
+    for (const ActionSuggestionAnnotation& annotation : action.annotations) {
+      bool has_equivalent;
+      if (HasConflict(annotation, &has_equivalent)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void Add(int index) {
+    for (const ActionSuggestionAnnotation& annotation :
+         (*actions_)[index].annotations) {
+      bool has_equivalent;
+      HasConflict(annotation, &has_equivalent);
+      if (has_equivalent) {
+        continue;
+      }
+      // The kept actions stay in place, so the annotations can be referred to.
+      annotations_.emplace(
+          std::make_pair(annotation.span.message_index,
+                         annotation.span.span.first),
+          &annotation);
+      max_length_ =
+          std::max(max_length_,
+                   annotation.span.span.second - annotation.span.span.first);
+    }
+  }
+
+ private:
+  // Returns whether a kept annotation conflicts with the annotation, and sets
+  // 'has_equivalent' to whether one is equivalent to it.
+  bool HasConflict(const ActionSuggestionAnnotation& annotation,
+                   bool* has_equivalent) const {
+    *has_equivalent = false;
+    const int message_index = annotation.span.message_index;
+    const CodepointSpan& span = annotation.span.span;
+    for (auto it = annotations_.lower_bound(
+             std::make_pair(message_index, span.first - max_length_));
+         it != annotations_.end() &&
+         it->first < std::make_pair(message_index, span.second);
+         ++it) {
+      if (IsEquivalentActionAnnotation(annotation, *it->second)) {
+        *has_equivalent = true;
+      } else if (TextSpansIntersect(annotation.span, it->second->span)) {
         return true;
       }
     }
+    return false;
   }
-  return false;
+
+  const std::vector<ActionSuggestion>* const actions_;
+  std::multimap<std::pair<int, int>, const ActionSuggestionAnnotation*>
+      annotations_;
+  int max_length_ = 0;
+};
+
+// Removes, in place, the actions that are redundant with an action kept before
+// them, as found by `Kept`.
+template <typename Kept>
+void RemoveRedundantActions(std::vector<ActionSuggestion>* actions) {
+  Kept kept(actions);
+  int num_kept = 0;
+  for (int i = 0; i < actions->size(); i++) {
+    if (kept.IsRedundant((*actions)[i])) {
+      continue;
+    }
+    if (i != num_kept) {
+      (*actions)[num_kept] = std::move((*actions)[i]);
+    }
+    kept.Add(num_kept);
+    ++num_kept;
+  }
+  actions->erase(actions->begin() + num_kept, actions->end());
 }
 
-// Checks whether any action is considered conflicting with the given one.
-bool IsAnyActionConflicting(const ActionSuggestion& action,
-                            const std::vector<ActionSuggestion>& actions) {
-  for (const ActionSuggestion& other : actions) {
-    if (IsConflictingActionSuggestion(action, other)) {
-      return true;
+// Orders actions from the same entities together: groups of actions with
+// the same annotations are ordered by their best action, and the actions of a
+// group by score. Actions without annotations form groups of their own.
+void GroupByAnnotations(std::vector<ActionSuggestion>* actions) {
+  const int num_actions = actions->size();
+
+  // Assign the actions to groups, by the first action of each group. The
+  // groups with annotations are found by the hash of the annotations.
+  std::vector<int> group_of_action(num_actions);
+  std::vector<int> first_action_of_group;
+  std::unordered_multimap<uint64, int> groups_by_hash;
+  for (int i = 0; i < num_actions; i++) {
+    const ActionSuggestion& action = (*actions)[i];
+    int group = -1;
+    if (!action.annotations.empty()) {
+      const uint64 hash = HashAnnotations(action);
+      const auto range = groups_by_hash.equal_range(hash);
+      for (auto it = range.first; it != range.second; ++it) {
+        if (HaveEquivalentAnnotations(action,
+                                      (*actions)[first_action_of_group[
+                                          it->second]])) {
+          group = it->second;
+          break;
+        }
+      }
+      if (group < 0) {
+        groups_by_hash.emplace(hash, first_action_of_group.size());
+      }
+    }
+    if (group < 0) {
+      group = first_action_of_group.size();
+      first_action_of_group.push_back(i);
     }
+    group_of_action[i] = group;
   }
-  return false;
+
+  // Find the best action of each group, by score and type.
+  std::vector<int> best_action_of_group = first_action_of_group;
+  for (int i = 0; i < num_actions; i++) {
+    int& best = best_action_of_group[group_of_action[i]];
+    const ActionSuggestion& action = (*actions)[i];
+    if (action.score > (*actions)[best].score ||
+        (action.score >= (*actions)[best].score &&
+         action.type < (*actions)[best].type)) {
+      best = i;
+    }
+  }
+
+  // Order the actions by the best action of their group, then by the group,
+  // and then by their own score and type.
+  std::vector<int> order(num_actions);
+  for (int i = 0; i < num_actions; i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](int a, int b) {
+    const int group_a = group_of_action[a];
+    const int group_b = group_of_action[b];
+    if (group_a != group_b) {
+      const ActionSuggestion& best_a =
+          (*actions)[best_action_of_group[group_a]];
+      const ActionSuggestion& best_b =
+          (*actions)[best_action_of_group[group_b]];
+      if (best_a.score != best_b.score) {
+        return best_a.score > best_b.score;
+      }
+      if (const int value = best_a.type.compare(best_b.type)) {
+        return value < 0;
+      }
+      return group_a < group_b;
+    }
+    const ActionSuggestion& action_a = (*actions)[a];
+    const ActionSuggestion& action_b = (*actions)[b];
+    if (action_a.score != action_b.score) {
+      return action_a.score > action_b.score;
+    }
+    if (const int value = action_a.type.compare(action_b.type)) {
+      return value < 0;
+    }
+    return a < b;
+  });
+
+  // The actions are moved, not copied, into their new order.
+  std::vector<ActionSuggestion> ordered_actions;
+  ordered_actions.reserve(num_actions);
+  for (const int i : order) {
+    ordered_actions.push_back(std::move((*actions)[i]));
+  }
+  actions->swap(ordered_actions);
 }
 
 }  // namespace
@@ -220,15 +406,30 @@ bool ActionsSuggestionsRanker::InitializeAndValidate(
                             options_->compressed_lua_ranking_script(),
                             decompressor, &lua_ranking_script) &&
       !lua_ranking_script.empty()) {
-    if (!Compile(lua_ranking_script, &lua_bytecode_)) {
+    // The bytecode is shared by all instances loading the same script.
+    lua_bytecode_ = SharedStringCache::Instance()->GetOrCreate(
+        SharedStringCache::Key("lua-bytecode", lua_ranking_script),
+        [&lua_ranking_script](std::string* bytecode) {
+          return Compile(lua_ranking_script, bytecode);
+        });
+    if (lua_bytecode_ == nullptr) {
       TC3_LOG(ERROR) << "Could not precompile lua ranking snippet.";
       return false;
     }
+    lua_rankers_.reset(new LuaEnvironmentPool<ActionsSuggestionsLuaRanker>());
   }
 
   return true;
 }
 
+size_t ActionsSuggestionsRanker::LuaBytecodeBytes() const {
+  return lua_bytecode_ != nullptr ? lua_bytecode_->size() : 0;
+}
+
+size_t ActionsSuggestionsRanker::IdleLuaMemoryUsageBytes() const {
+  return lua_rankers_ != nullptr ? lua_rankers_->IdleMemoryUsageBytes() : 0;
+}
+
 bool ActionsSuggestionsRanker::RankActions(
     const Conversation& conversation, ActionsSuggestionsResponse* response,
     const reflection::Schema* entity_data_schema,
@@ -245,106 +446,51 @@ bool ActionsSuggestionsRanker::RankActions(
 
     // Deduplicate, keeping the higher score actions.
     if (options_->deduplicate_suggestions()) {
-      std::vector<ActionSuggestion> deduplicated_actions;
-      for (const ActionSuggestion& candidate : response->actions) {
-        // Check whether we already have an equivalent action.
-        if (!IsAnyActionEquivalent(candidate, deduplicated_actions)) {
-          deduplicated_actions.push_back(std::move(candidate));
-        }
-      }
-      response->actions = std::move(deduplicated_actions);
+      RemoveRedundantActions<KeptActions>(&response->actions);
     }
 
     // Resolve conflicts between conflicting actions referring to the same
     // text span.
     if (options_->deduplicate_suggestions_by_span()) {
-      std::vector<ActionSuggestion> deduplicated_actions;
-      for (const ActionSuggestion& candidate : response->actions) {
-        // Check whether we already have a conflicting action.
-        if (!IsAnyActionConflicting(candidate, deduplicated_actions)) {
-          deduplicated_actions.push_back(std::move(candidate));
-        }
-      }
-      response->actions = std::move(deduplicated_actions);
+      RemoveRedundantActions<KeptAnnotations>(&response->actions);
     }
   }
 
   // Suppress smart replies if actions are present.
   if (options_->suppress_smart_replies_with_actions()) {
-    std::vector<ActionSuggestion> non_smart_reply_actions;
-    for (const ActionSuggestion& action : response->actions) {
-      if (action.type != smart_reply_action_type_) {
-        non_smart_reply_actions.push_back(std::move(action));
-      }
-    }
-    response->actions = std::move(non_smart_reply_actions);
+    response->actions.erase(
+        std::remove_if(response->actions.begin(), response->actions.end(),
+                       [this](const ActionSuggestion& action) {
+                         return action.type == smart_reply_action_type_;
+                       }),
+        response->actions.end());
   }
 
   // Group by annotation if specified.
   if (options_->group_by_annotations()) {
-    auto group_id = std::map<
-        ActionSuggestion, int,
-        std::function<bool(const ActionSuggestion&, const ActionSuggestion&)>>{
-        [](const ActionSuggestion& action, const ActionSuggestion& other) {
-          return (CompareAnnotationsOnly(action, other) < 0);
-        }};
-    typedef std::vector<ActionSuggestion> ActionSuggestionGroup;
-    std::vector<ActionSuggestionGroup> groups;
-
-    // Group actions by the annotation set they are based of.
-    for (const ActionSuggestion& action : response->actions) {
-      // Treat actions with no annotations idependently.
-      if (action.annotations.empty()) {
-        groups.emplace_back(1, action);
-        continue;
-      }
-
-      auto it = group_id.find(action);
-      if (it != group_id.end()) {
-        groups[it->second].push_back(action);
-      } else {
-        group_id[action] = groups.size();
-        groups.emplace_back(1, action);
-      }
-    }
-
-    // Sort within each group by score.
-    for (std::vector<ActionSuggestion>& group : groups) {
-      SortByScoreAndType(&group);
-    }
-
-    // Sort groups by maximum score.
-    std::sort(groups.begin(), groups.end(),
-              [](const std::vector<ActionSuggestion>& a,
-                 const std::vector<ActionSuggestion>& b) {
-                return a.begin()->score > b.begin()->score ||
-                       (a.begin()->score >= b.begin()->score &&
-                        a.begin()->type < b.begin()->type);
-              });
-
-    // Flatten result.
-    const size_t num_actions = response->actions.size();
-    response->actions.clear();
-    response->actions.reserve(num_actions);
-    for (const std::vector<ActionSuggestion>& actions : groups) {
-      response->actions.insert(response->actions.end(), actions.begin(),
-                               actions.end());
-    }
-
+    GroupByAnnotations(&response->actions);
   } else {
     // Order suggestions independently by score.
     SortByScoreAndType(&response->actions);
   }
 
   // Run lua ranking snippet, if provided.
-  if (!lua_bytecode_.empty()) {
-    auto lua_ranker = ActionsSuggestionsLuaRanker::Create(
-        conversation, lua_bytecode_, entity_data_schema,
-        annotations_entity_data_schema, response);
-    if (lua_ranker == nullptr || !lua_ranker->RankActions()) {
+  if (lua_bytecode_ != nullptr) {
+    LuaEnvironmentPool<ActionsSuggestionsLuaRanker>::Lease lua_ranker =
+        lua_rankers_->Acquire();
+    if (lua_ranker == nullptr ||
+        !lua_ranker->HasSchemas(entity_data_schema,
+                                annotations_entity_data_schema)) {
+      lua_ranker = ActionsSuggestionsLuaRanker::Create(
+          *lua_bytecode_, entity_data_schema, annotations_entity_data_schema);
+    }
+    if (lua_ranker == nullptr ||
+        !lua_ranker->BindRequest(conversation, response) ||
+        !lua_ranker->RankActions()) {
       TC3_LOG(ERROR) << "Could not run lua ranking snippet.";
       return false;
     }
+    lua_rankers_->Release(std::move(lua_ranker));
   }
 
   return true;
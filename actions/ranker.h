@@ -18,9 +18,12 @@
 #define LIBTEXTCLASSIFIER_ACTIONS_RANKER_H_
 
 #include <memory>
+#include <string>
 
 #include "actions/actions_model_generated.h"
+#include "actions/lua-ranker.h"
 #include "actions/types.h"
+#include "utils/lua-utils.h"
 #include "utils/zlib/zlib.h"
 
 namespace libtextclassifier3 {
@@ -39,6 +42,12 @@ class ActionsSuggestionsRanker {
       const reflection::Schema* entity_data_schema = nullptr,
       const reflection::Schema* annotations_entity_data_schema = nullptr) const;
 
+  // Size of the compiled ranking snippet, 0 if there is none.
+  size_t LuaBytecodeBytes() const;
+
+  // Memory allocated by the lua states of the idle lua rankers.
+  size_t IdleLuaMemoryUsageBytes() const;
+
  private:
   explicit ActionsSuggestionsRanker(const RankingOptions* options,
                                     const std::string& smart_reply_action_type)
@@ -47,8 +56,13 @@ class ActionsSuggestionsRanker {
   bool InitializeAndValidate(ZlibDecompressor* decompressor);
 
   const RankingOptions* const options_;
-  std::string lua_bytecode_;
+  // Compiled ranking snippet, nullptr if there is none.
+  std::shared_ptr<const std::string> lua_bytecode_;
   std::string smart_reply_action_type_;
+
+  // Idle lua rankers with the ranking snippet loaded, reused across requests.
+  std::unique_ptr<LuaEnvironmentPool<ActionsSuggestionsLuaRanker>>
+      lua_rankers_;
 };
 
 }  // namespace libtextclassifier3
@@ -230,6 +230,45 @@ TEST(RankingTest, DeduplicatesConflictingActions) {
               testing::ElementsAreArray({IsAction("copy_code", "", 1.0)}));
 }
 
+TEST(RankingTest, DeduplicatesConflictingActionsOfRepeatedEntities) {
+  const Conversation conversation = {
+      {{/*user_id=*/1, "call 911 or 911"}, {/*user_id=*/2, "911"}}};
+  ActionsSuggestionsResponse response;
+  const auto add_action = [&response](const std::string& type,
+                                      int message_index, CodepointSpan span,
+                                      const std::string& collection,
+                                      float priority_score) {
+    ActionSuggestionAnnotation annotation;
+    annotation.span = {message_index, span, /*text=*/"911"};
+    annotation.entity = ClassificationResult(collection, 1.0);
+    annotation.name = collection;
+    response.actions.push_back({/*response_text=*/"", type, /*score=*/1.0,
+                                priority_score,
+                                /*annotations=*/{annotation}});
+  };
+  for (const CodepointSpan span :
+       {CodepointSpan{5, 8}, CodepointSpan{12, 15}}) {
+    add_action("call_phone", /*message_index=*/0, span, "phone", 2.0);
+    add_action("send_sms", /*message_index=*/0, span, "phone", 2.0);
+    add_action("copy_code", /*message_index=*/0, span, "code", 1.0);
+  }
+  add_action("copy_code", /*message_index=*/1, {0, 3}, "code", 1.0);
+  RankingOptionsT options;
+  options.deduplicate_suggestions_by_span = true;
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(RankingOptions::Pack(builder, &options));
+  auto ranker = ActionsSuggestionsRanker::CreateActionsSuggestionsRanker(
+      flatbuffers::GetRoot<RankingOptions>(builder.GetBufferPointer()),
+      /*decompressor=*/nullptr, /*smart_reply_action_type=*/"text_reply");
+
+  ranker->RankActions(conversation, &response);
+  EXPECT_THAT(response.actions,
+              testing::UnorderedElementsAre(
+                  IsActionType("call_phone"), IsActionType("call_phone"),
+                  IsActionType("send_sms"), IsActionType("send_sms"),
+                  IsActionType("copy_code")));
+}
+
 TEST(RankingTest, HandlesCompressedLuaScript) {
   const Conversation conversation = {{{/*user_id=*/1, "hello hello"}}};
   ActionsSuggestionsResponse response;
@@ -338,6 +377,54 @@ TEST(RankingTest, GroupsActionsByAnnotations) {
                                  IsAction("text_reply", "How are you?", 0.5)}));
 }
 
+TEST(RankingTest, GroupsInterleavedActionsByAnnotations) {
+  const Conversation conversation = {
+      {{/*user_id=*/1, "call 911 or mail me@example.com"}}};
+  ActionsSuggestionsResponse response;
+  ActionSuggestionAnnotation phone;
+  phone.span = {/*message_index=*/0, /*span=*/{5, 8}, /*text=*/"911"};
+  phone.entity = ClassificationResult("phone", 1.0);
+  ActionSuggestionAnnotation email;
+  email.span = {/*message_index=*/0, /*span=*/{17, 31},
+                /*text=*/"me@example.com"};
+  email.entity = ClassificationResult("email", 1.0);
+  response.actions.push_back({/*response_text=*/"",
+                              /*type=*/"add_contact",
+                              /*score=*/0.25,
+                              /*priority_score=*/0.0,
+                              /*annotations=*/{phone}});
+  response.actions.push_back({/*response_text=*/"",
+                              /*type=*/"send_email",
+                              /*score=*/0.5,
+                              /*priority_score=*/0.0,
+                              /*annotations=*/{email}});
+  response.actions.push_back({/*response_text=*/"",
+                              /*type=*/"call_phone",
+                              /*score=*/0.75,
+                              /*priority_score=*/0.0,
+                              /*annotations=*/{phone}});
+  response.actions.push_back({/*response_text=*/"",
+                              /*type=*/"add_contact",
+                              /*score=*/0.125,
+                              /*priority_score=*/0.0,
+                              /*annotations=*/{email}});
+  RankingOptionsT options;
+  options.group_by_annotations = true;
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(RankingOptions::Pack(builder, &options));
+  auto ranker = ActionsSuggestionsRanker::CreateActionsSuggestionsRanker(
+      flatbuffers::GetRoot<RankingOptions>(builder.GetBufferPointer()),
+      /*decompressor=*/nullptr, /*smart_reply_action_type=*/"text_reply");
+
+  ranker->RankActions(conversation, &response);
+
+  EXPECT_THAT(response.actions,
+              testing::ElementsAreArray({IsAction("call_phone", "", 0.75),
+                                         IsAction("add_contact", "", 0.25),
+                                         IsAction("send_email", "", 0.5),
+                                         IsAction("add_contact", "", 0.125)}));
+}
+
 TEST(RankingTest, SortsActionsByScore) {
   const Conversation conversation = {{{/*user_id=*/1, "should i call 911"}}};
   ActionsSuggestionsResponse response;
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks of the sentencepiece kernels of the TextEncoder op, with the
+// encoder config of the English actions model.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "actions/actions-suggestions.h"
+#include "utils/memory/mmap.h"
+#include "utils/sentencepiece/double_array_trie.h"
+#include "utils/sentencepiece/encoder.h"
+#include "utils/sentencepiece/normalizer.h"
+#include "utils/sentencepiece/sorted_strings_table.h"
+#include "utils/testing/benchmark-utils.h"
+#include "utils/tflite/text_encoder_config_generated.h"
+#include "benchmark/benchmark.h"
+#include "flatbuffers/flexbuffers.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+// The kernels set up as in the TextEncoder op.
+struct TextEncoder {
+  explicit TextEncoder(const std::string& path) : mmap(path) {}
+
+  ScopedMmap mmap;
+  std::unique_ptr<DoubleArrayTrie> charsmap_trie;
+  std::unique_ptr<SentencePieceNormalizer> normalizer;
+  std::unique_ptr<SentencePieceMatcher> matcher;
+  std::unique_ptr<Encoder> encoder;
+};
+
+// Returns the config of the first TextEncoder op of the TensorFlow Lite model.
+const TextEncoderConfig* FindTextEncoderConfig(const tflite::Model* model) {
+  if (model->subgraphs() == nullptr || model->operator_codes() == nullptr) {
+    return nullptr;
+  }
+  for (const tflite::SubGraph* subgraph : *model->subgraphs()) {
+    if (subgraph->operators() == nullptr) {
+      continue;
+    }
+    for (const tflite::Operator* op : *subgraph->operators()) {
+      const tflite::OperatorCode* code =
+          model->operator_codes()->Get(op->opcode_index());
+      if (code->custom_code() == nullptr ||
+          code->custom_code()->str() != "TextEncoder" ||
+          op->custom_options() == nullptr) {
+        continue;
+      }
+      const flexbuffers::Blob serialized_config =
+          flexbuffers::GetRoot(op->custom_options()->data(),
+                               op->custom_options()->size())
+              .AsMap()["text_encoder_config"]
+              .AsBlob();
+      return flatbuffers::GetRoot<TextEncoderConfig>(serialized_config.data());
+    }
+  }
+  return nullptr;
+}
+
+// Returns the text encoder, or nullptr if it isn't available.
+const TextEncoder* GetTextEncoder() {
+  static const TextEncoder* const text_encoder = []() {
+    std::unique_ptr<TextEncoder> text_encoder(
+        new TextEncoder(BenchmarkModelPath("actions_suggestions.en.model")));
+    if (!text_encoder->mmap.handle().ok()) {
+      return static_cast<TextEncoder*>(nullptr);
+    }
+    const ActionsModel* model =
+        ViewActionsModel(text_encoder->mmap.handle().start(),
+                         text_encoder->mmap.handle().num_bytes());
+    if (model == nullptr || model->tflite_model_spec() == nullptr ||
+        model->tflite_model_spec()->tflite_model() == nullptr) {
+      return static_cast<TextEncoder*>(nullptr);
+    }
+    const TextEncoderConfig* config = FindTextEncoderConfig(
+        tflite::GetModel(model->tflite_model_spec()->tflite_model()->data()));
+    if (config == nullptr) {
+      return static_cast<TextEncoder*>(nullptr);
+    }
+
+    text_encoder->charsmap_trie.reset(new DoubleArrayTrie(
+        reinterpret_cast<const TrieNode*>(
+            config->normalization_charsmap()->Data()),
+        config->normalization_charsmap()->Length() / sizeof(TrieNode)));
+    text_encoder->normalizer.reset(new SentencePieceNormalizer(
+        *text_encoder->charsmap_trie,
+        StringPiece(config->normalization_charsmap_values()->data(),
+                    config->normalization_charsmap_values()->size()),
+        config->add_dummy_prefix(), config->remove_extra_whitespaces(),
+        config->escape_whitespaces()));
+    const int num_pieces = config->pieces_scores()->Length();
+    if (config->matcher_type() == SentencePieceMatcherType_MAPPED_TRIE) {
+      text_encoder->matcher.reset(new DoubleArrayTrie(
+          reinterpret_cast<const TrieNode*>(config->pieces()->Data()),
+          config->pieces()->Length() / sizeof(TrieNode)));
+    } else {
+      text_encoder->matcher.reset(new SortedStringsTable(
+          num_pieces, config->pieces_offsets()->data(),
+          StringPiece(config->pieces()->data(), config->pieces()->Length())));
+    }
+    text_encoder->encoder.reset(new Encoder(
+        text_encoder->matcher.get(), num_pieces,
+        config->pieces_scores()->data(), config->start_code(),
+        config->end_code(), config->encoding_offset(), config->unknown_code(),
+        config->unknown_score()));
+    return text_encoder.release();
+  }();
+  return text_encoder;
+}
+
+// Sets up a benchmark on the text of the script and length of the arguments,
+// or skips it if the model isn't available.
+const TextEncoder* SetUp(benchmark::State& state, std::string* text) {
+  const TextEncoder* text_encoder = GetTextEncoder();
+  if (text_encoder == nullptr) {
+    state.SkipWithError("Couldn't load the text encoder of the model.");
+    return nullptr;
+  }
+  const BenchmarkScript script = static_cast<BenchmarkScript>(state.range(0));
+  *text = BenchmarkScriptText(script, state.range(1));
+  state.SetLabel(BenchmarkScriptName(script));
+  return text_encoder;
+}
+
+void BM_Normalize(benchmark::State& state) {
+  std::string text;
+  const TextEncoder* text_encoder = SetUp(state, &text);
+  if (text_encoder == nullptr) {
+    return;
+  }
+  std::string normalized;
+  RunMeasuredBenchmark(state, text.size(), [&]() {
+    normalized.clear();
+    text_encoder->normalizer->Normalize(text, &normalized);
+    benchmark::DoNotOptimize(normalized.data());
+  });
+}
+BENCHMARK(BM_Normalize)->Apply(ScriptsAndLengths);
+
+void BM_Encode(benchmark::State& state) {
+  std::string text;
+  const TextEncoder* text_encoder = SetUp(state, &text);
+  if (text_encoder == nullptr) {
+    return;
+  }
+  std::string normalized;
+  text_encoder->normalizer->Normalize(text, &normalized);
+  Encoder::Scratch scratch;
+  std::vector<int> encoded;
+  RunMeasuredBenchmark(state, normalized.size(), [&]() {
+    encoded.clear();
+    text_encoder->encoder->Encode(normalized, &scratch, &encoded);
+    benchmark::DoNotOptimize(encoded.data());
+  });
+}
+BENCHMARK(BM_Encode)->Apply(ScriptsAndLengths);
+
+// Looks up the normalization rules at every byte of the text, as the
+// normalizer does for the bytes that aren't left unchanged.
+void BM_FindAllPrefixMatches(benchmark::State& state) {
+  std::string text;
+  const TextEncoder* text_encoder = SetUp(state, &text);
+  if (text_encoder == nullptr) {
+    return;
+  }
+  const DoubleArrayTrie& trie = *text_encoder->charsmap_trie;
+  std::vector<TrieMatch> matches;
+  RunMeasuredBenchmark(state, text.size(), [&]() {
+    for (int i = 0; i < text.size(); ++i) {
+      matches.clear();
+      trie.FindAllPrefixMatches(
+          StringPiece(text.data() + i, text.size() - i), &matches);
+    }
+    benchmark::DoNotOptimize(matches.data());
+  });
+}
+BENCHMARK(BM_FindAllPrefixMatches)->Apply(ScriptsAndLengths);
+
+}  // namespace
+}  // namespace libtextclassifier3
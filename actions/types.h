@@ -22,6 +22,7 @@
 #include <vector>
 
 #include "actions/actions-entity-data_generated.h"
+#include "annotator/degradation.h"
 #include "annotator/types.h"
 #include "utils/flatbuffers.h"
 
@@ -91,7 +92,9 @@ struct ActionsSuggestionsResponse {
         output_filtered_sensitivity(false),
         output_filtered_min_triggering_score(false),
         output_filtered_low_confidence(false),
-        output_filtered_locale_mismatch(false) {}
+        output_filtered_locale_mismatch(false),
+        is_partial(false),
+        annotation_tiers(ANNOTATION_TIER_ALL) {}
 
   // The sensitivity assessment.
   float sensitivity_score;
@@ -109,6 +112,15 @@ struct ActionsSuggestionsResponse {
   // Whether the output was suppressed due to locale mismatch.
   bool output_filtered_locale_mismatch;
 
+  // Whether the call stopped early because of the cancellation token or
+  // timeout of the options, so that the actions only come from the sources
+  // that ran.
+  bool is_partial;
+
+  // The AnnotationTier flags of the tiers that ran for all the messages the
+  // call annotated, see ActionSuggestionOptions::degradation_policy.
+  int annotation_tiers;
+
   // The suggested actions.
   std::vector<ActionSuggestion> actions;
 };
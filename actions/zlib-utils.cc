@@ -17,6 +17,8 @@
 #include "actions/zlib-utils.h"
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "utils/base/logging.h"
 #include "utils/intents/zlib-utils.h"
@@ -24,9 +26,50 @@
 
 namespace libtextclassifier3 {
 
+namespace {
+
+// Returns the texts of the model that are compressed, in the order they are
+// compressed.
+std::vector<std::string> TextsToCompress(const ActionsModelT& model) {
+  std::vector<std::string> texts;
+  if (model.rules != nullptr) {
+    for (const auto& rule : model.rules->rule) {
+      texts.push_back(rule->pattern);
+    }
+  }
+  if (model.low_confidence_rules != nullptr) {
+    for (const auto& rule : model.low_confidence_rules->rule) {
+      texts.push_back(rule->pattern);
+      texts.push_back(rule->output_pattern);
+    }
+  }
+  texts.push_back(model.lua_actions_script);
+  if (model.ranking_options != nullptr) {
+    texts.push_back(model.ranking_options->lua_ranking_script);
+  }
+  return texts;
+}
+
+}  // namespace
+
 // Compress rule fields in the model.
-bool CompressActionsModel(ActionsModelT* model) {
-  std::unique_ptr<ZlibCompressor> zlib_compressor = ZlibCompressor::Instance();
+bool CompressActionsModel(ActionsModelT* model,
+                          const bool build_compression_dictionary) {
+  model->compression_dictionary.clear();
+  if (build_compression_dictionary) {
+    std::vector<unsigned char> dictionary;
+    if (!BuildZlibDictionary(TextsToCompress(*model), &dictionary)) {
+      TC3_LOG(ERROR) << "Cannot build compression dictionary.";
+      return false;
+    }
+    model->compression_dictionary.assign(dictionary.begin(), dictionary.end());
+  }
+
+  std::unique_ptr<ZlibCompressor> zlib_compressor =
+      model->compression_dictionary.empty()
+          ? ZlibCompressor::Instance()
+          : ZlibCompressor::Instance(model->compression_dictionary.data(),
+                                     model->compression_dictionary.size());
   if (!zlib_compressor) {
     TC3_LOG(ERROR) << "Cannot compress model.";
     return false;
@@ -53,7 +96,7 @@ bool CompressActionsModel(ActionsModelT* model) {
       }
       if (!rule->output_pattern.empty()) {
         rule->compressed_output_pattern.reset(new CompressedBufferT);
-        zlib_compressor->Compress(rule->pattern,
+        zlib_compressor->Compress(rule->output_pattern,
                                   rule->compressed_output_pattern.get());
         rule->output_pattern.clear();
       }
@@ -90,7 +133,10 @@ bool CompressActionsModel(ActionsModelT* model) {
 
 bool DecompressActionsModel(ActionsModelT* model) {
   std::unique_ptr<ZlibDecompressor> zlib_decompressor =
-      ZlibDecompressor::Instance();
+      model->compression_dictionary.empty()
+          ? ZlibDecompressor::Instance()
+          : ZlibDecompressor::Instance(model->compression_dictionary.data(),
+                                       model->compression_dictionary.size());
   if (!zlib_decompressor) {
     TC3_LOG(ERROR) << "Cannot initialize decompressor.";
     return false;
@@ -134,23 +180,56 @@ bool DecompressActionsModel(ActionsModelT* model) {
     TC3_LOG(ERROR) << "Cannot decompress actions script.";
     return false;
   }
+  model->compressed_lua_actions_script.reset(nullptr);
+
+  if (model->ranking_options != nullptr) {
+    if (!zlib_decompressor->MaybeDecompress(
+            model->ranking_options->compressed_lua_ranking_script.get(),
+            &model->ranking_options->lua_ranking_script)) {
+      TC3_LOG(ERROR) << "Cannot decompress actions script.";
+      return false;
+    }
+    model->ranking_options->compressed_lua_ranking_script.reset(nullptr);
+  }
+  zlib_decompressor.reset();
+  model->compression_dictionary.clear();
+
+  // Decompress resources.
+  if (model->resources != nullptr &&
+      !DecompressResources(model->resources.get())) {
+    TC3_LOG(ERROR) << "Cannot decompress resources.";
+    return false;
+  }
 
-  if (model->ranking_options != nullptr &&
-      !zlib_decompressor->MaybeDecompress(
-          model->ranking_options->compressed_lua_ranking_script.get(),
-          &model->ranking_options->lua_ranking_script)) {
-    TC3_LOG(ERROR) << "Cannot decompress actions script.";
+  // Decompress intent generator.
+  if (model->android_intent_options != nullptr &&
+      !DecompressIntentModel(model->android_intent_options.get())) {
+    TC3_LOG(ERROR) << "Cannot decompress intent generator.";
     return false;
   }
 
   return true;
 }
 
-std::string CompressSerializedActionsModel(const std::string& model) {
+std::string CompressSerializedActionsModel(
+    const std::string& model, const bool build_compression_dictionary) {
+  std::unique_ptr<ActionsModelT> unpacked_model =
+      UnPackActionsModel(model.c_str());
+  TC3_CHECK(unpacked_model != nullptr);
+  TC3_CHECK(CompressActionsModel(unpacked_model.get(),
+                                 build_compression_dictionary));
+  flatbuffers::FlatBufferBuilder builder;
+  FinishActionsModelBuffer(builder,
+                           ActionsModel::Pack(builder, unpacked_model.get()));
+  return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                     builder.GetSize());
+}
+
+std::string DecompressSerializedActionsModel(const std::string& model) {
   std::unique_ptr<ActionsModelT> unpacked_model =
       UnPackActionsModel(model.c_str());
   TC3_CHECK(unpacked_model != nullptr);
-  TC3_CHECK(CompressActionsModel(unpacked_model.get()));
+  TC3_CHECK(DecompressActionsModel(unpacked_model.get()));
   flatbuffers::FlatBufferBuilder builder;
   FinishActionsModelBuffer(builder,
                            ActionsModel::Pack(builder, unpacked_model.get()));
@@ -25,14 +25,22 @@
 
 namespace libtextclassifier3 {
 
-// Compresses regex rules in the model in place.
-bool CompressActionsModel(ActionsModelT* model);
+// Compresses regex rules and scripts in the model in place. If
+// `build_compression_dictionary` is set, they are compressed with a preset
+// dictionary built from all of them, which is stored in the model.
+bool CompressActionsModel(ActionsModelT* model,
+                          bool build_compression_dictionary = false);
 
-// Decompresses regex rules in the model in place.
+// Decompresses all compressed fields of the model in place.
 bool DecompressActionsModel(ActionsModelT* model);
 
 // Compresses regex rules in the model.
-std::string CompressSerializedActionsModel(const std::string& model);
+std::string CompressSerializedActionsModel(
+    const std::string& model, bool build_compression_dictionary = false);
+
+// Decompresses all compressed fields of the model. The result is larger, but
+// can be memory-mapped and used without decompressing anything at load time.
+std::string DecompressSerializedActionsModel(const std::string& model);
 
 bool GetUncompressedString(const flatbuffers::String* uncompressed_buffer,
                            const CompressedBuffer* compressed_buffer,
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/annotation-session.h"
+
+#include <utility>
+
+#include "utils/utf8/unicodetext.h"
+
+namespace libtextclassifier3 {
+
+std::vector<AnnotatedSpan> AnnotationSession::Annotate(
+    const std::string& context) {
+  std::unordered_map<std::string, std::vector<AnnotatedSpan>> line_annotations;
+  std::vector<AnnotatedSpan> result;
+  num_lines_annotated_in_last_call_ = 0;
+
+  const UnicodeText context_unicode =
+      UTF8ToUnicodeText(context, /*do_copy=*/false);
+  if (!context_unicode.is_valid()) {
+    return result;
+  }
+
+  int line_offset = 0;
+  auto line_begin = context_unicode.begin();
+  while (true) {
+    auto line_end = line_begin;
+    int line_length = 0;
+    while (line_end != context_unicode.end() && *line_end != '\n') {
+      ++line_end;
+      ++line_length;
+    }
+
+    if (line_length > 0) {
+      std::string line = UnicodeText::UTF8Substring(line_begin, line_end);
+      auto it = line_annotations.find(line);
+      if (it == line_annotations.end()) {
+        auto previous_it = line_annotations_.find(line);
+        if (previous_it != line_annotations_.end()) {
+          it = line_annotations
+                   .emplace(std::move(line), std::move(previous_it->second))
+                   .first;
+          line_annotations_.erase(previous_it);
+        } else {
+          ++num_lines_annotated_in_last_call_;
+          std::vector<AnnotatedSpan> spans =
+              annotator_->Annotate(line, options_);
+          it = line_annotations.emplace(std::move(line), std::move(spans))
+                   .first;
+        }
+      }
+
+      for (const AnnotatedSpan& span : it->second) {
+        result.push_back(span);
+        result.back().span = {span.span.first + line_offset,
+                              span.span.second + line_offset};
+      }
+    }
+
+    if (line_end == context_unicode.end()) {
+      break;
+    }
+    line_offset += line_length + 1;
+    line_begin = line_end;
+    ++line_begin;
+  }
+
+  // Only keep the annotations of the current lines.
+  line_annotations_ = std::move(line_annotations);
+  return result;
+}
+
+void AnnotationSession::Reset(const AnnotationOptions& options) {
+  options_ = options;
+  line_annotations_.clear();
+  num_lines_annotated_in_last_call_ = 0;
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Incremental annotation of a text that is edited over time.
+
+#ifndef LIBTEXTCLASSIFIER_ANNOTATOR_ANNOTATION_SESSION_H_
+#define LIBTEXTCLASSIFIER_ANNOTATOR_ANNOTATION_SESSION_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "annotator/annotator.h"
+#include "annotator/types.h"
+
+namespace libtextclassifier3 {
+
+// Annotates successive versions of a growing or edited text (e.g. the content
+// of a chat composer or a log) without re-running the annotator on all of it
+// every time. The text is split into lines, each line is annotated on its own
+// and the annotations of the lines that are unchanged since the previous call
+// are reused, wherever the lines moved to.
+//
+// The results differ from Annotator::Annotate() on the whole text: each line
+// is annotated as if it were the whole context, so
+//   - entities that span a line break are not found,
+//   - all the annotators, including the datetime and regex ones, only see one
+//     line at a time, e.g. a date and a time on consecutive lines are not
+//     merged,
+//   - the lines are only split on '\n', so a "\r\n" line break leaves the
+//     '\r' at the end of the line, and other line separators don't split.
+// The result is always the annotations of Annotator::Annotate() on each line,
+// shifted by the offset of the line.
+//
+// The session is not thread-safe; the annotator can be shared between
+// sessions.
+class AnnotationSession {
+ public:
+  // Does not take ownership of the annotator, which needs to outlive the
+  // session.
+  AnnotationSession(const Annotator* annotator,
+                    const AnnotationOptions& options)
+      : annotator_(annotator), options_(options) {}
+
+  // Annotates the current version of the text. The returned spans are
+  // codepoint offsets into the whole context.
+  std::vector<AnnotatedSpan> Annotate(const std::string& context);
+
+  // Drops all the cached annotations and sets the options used from now on.
+  void Reset(const AnnotationOptions& options);
+
+  // Number of lines that needed to be annotated in the last Annotate call.
+  int NumLinesAnnotatedInLastCall() const {
+    return num_lines_annotated_in_last_call_;
+  }
+
+ private:
+  const Annotator* const annotator_;
+  AnnotationOptions options_;
+
+  // Annotations of the lines of the previous version of the text, keyed by
+  // the line content. The spans are relative to the start of the line.
+  std::unordered_map<std::string, std::vector<AnnotatedSpan>> line_annotations_;
+
+  int num_lines_annotated_in_last_call_ = 0;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_ANNOTATOR_ANNOTATION_SESSION_H_
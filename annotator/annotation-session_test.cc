@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/annotation-session.h"
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "annotator/annotator.h"
+#include "annotator/types-test-util.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+std::string GetModelPath() { return TC3_TEST_DATA_DIR; }
+
+std::string ReadFile(const std::string& file_name) {
+  std::ifstream file_stream(file_name);
+  return std::string(std::istreambuf_iterator<char>(file_stream), {});
+}
+
+class AnnotationSessionTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    model_buffer_ = ReadFile(GetModelPath() + "test_model.fb");
+    annotator_ = Annotator::FromUnownedBuffer(model_buffer_.data(),
+                                              model_buffer_.size(), &unilib_);
+    ASSERT_NE(annotator_, nullptr);
+  }
+
+  UniLib unilib_;
+  std::string model_buffer_;
+  std::unique_ptr<Annotator> annotator_;
+};
+
+void ExpectSameSpans(const std::vector<AnnotatedSpan>& actual,
+                     const std::vector<AnnotatedSpan>& expected,
+                     int offset) {
+  ASSERT_EQ(actual.size(), expected.size());
+  for (int i = 0; i < actual.size(); ++i) {
+    EXPECT_EQ(actual[i].span, CodepointSpan(expected[i].span.first + offset,
+                                            expected[i].span.second + offset));
+    ASSERT_FALSE(actual[i].classification.empty());
+    EXPECT_EQ(actual[i].classification[0].collection,
+              expected[i].classification[0].collection);
+  }
+}
+
+TEST_F(AnnotationSessionTest, ReusesUnchangedLines) {
+  const std::string first_line = "call me at (800) 123-456 please";
+  const std::string second_line = "or at (800) 123-456";
+  AnnotationSession session(annotator_.get(), AnnotationOptions());
+
+  std::vector<AnnotatedSpan> result = session.Annotate(first_line);
+  EXPECT_EQ(session.NumLinesAnnotatedInLastCall(), 1);
+  const std::vector<AnnotatedSpan> first_line_spans =
+      annotator_->Annotate(first_line);
+  ExpectSameSpans(result, first_line_spans, /*offset=*/0);
+
+  result = session.Annotate(first_line + "\n" + second_line);
+  EXPECT_EQ(session.NumLinesAnnotatedInLastCall(), 1);
+  std::vector<AnnotatedSpan> expected = first_line_spans;
+  for (AnnotatedSpan span : annotator_->Annotate(second_line)) {
+    span.span = {span.span.first + first_line.size() + 1,
+                 span.span.second + first_line.size() + 1};
+    expected.push_back(span);
+  }
+  ExpectSameSpans(result, expected, /*offset=*/0);
+}
+
+TEST_F(AnnotationSessionTest, AnnotatesEachLineAsAWholeContext) {
+  // Entities split across the lines, a "\r\n" line break and an empty line,
+  // which is not annotated.
+  const std::vector<std::string> lines = {
+      "call me at (800)", "123-456 tomorrow", "at 5pm\r",
+      "or write to hello@example.com", "", "call me at (800) 123-456 please"};
+  std::string text;
+  std::vector<AnnotatedSpan> expected;
+  for (int i = 0; i < lines.size(); ++i) {
+    if (i > 0) {
+      text += "\n";
+    }
+    const int offset = text.size();
+    text += lines[i];
+    for (AnnotatedSpan span : annotator_->Annotate(lines[i])) {
+      span.span = {span.span.first + offset, span.span.second + offset};
+      expected.push_back(span);
+    }
+  }
+
+  AnnotationSession session(annotator_.get(), AnnotationOptions());
+  ExpectSameSpans(session.Annotate(text), expected, /*offset=*/0);
+  EXPECT_EQ(session.NumLinesAnnotatedInLastCall(), lines.size() - 1);
+}
+
+TEST_F(AnnotationSessionTest, ShiftsMovedLines) {
+  const std::string line = "call me at (800) 123-456 please";
+  AnnotationSession session(annotator_.get(), AnnotationOptions());
+  session.Annotate(line);
+
+  const std::vector<AnnotatedSpan> result =
+      session.Annotate("hello\n" + line);
+  EXPECT_EQ(session.NumLinesAnnotatedInLastCall(), 1);
+  ExpectSameSpans(result, annotator_->Annotate(line), /*offset=*/6);
+}
+
+TEST_F(AnnotationSessionTest, ResetDropsCachedLines) {
+  AnnotationSession session(annotator_.get(), AnnotationOptions());
+  session.Annotate("call me at (800) 123-456 please");
+  session.Reset(AnnotationOptions());
+  session.Annotate("call me at (800) 123-456 please");
+  EXPECT_EQ(session.NumLinesAnnotatedInLastCall(), 1);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/annotations-flatbuffer.h"
+
+#include <string>
+#include <unordered_map>
+
+#include "utils/base/logging.h"
+
+namespace libtextclassifier3 {
+
+namespace {
+
+// Writes the spans, storing each collection name once.
+class AnnotationsPacker {
+ public:
+  explicit AnnotationsPacker(flatbuffers::FlatBufferBuilder* builder)
+      : builder_(builder) {}
+
+  void AddSpan(CodepointSpan span,
+               const std::vector<ClassificationResult>& classification) {
+    std::vector<flatbuffers::Offset<AnnotationClassification>> results;
+    results.reserve(classification.size());
+    for (const ClassificationResult& result : classification) {
+      results.push_back(PackClassification(result));
+    }
+    spans_.push_back(CreateAnnotationSpan(*builder_, span.first, span.second,
+                                          builder_->CreateVector(results)));
+  }
+
+  flatbuffers::Offset<Annotations> Finish() {
+    return CreateAnnotations(*builder_,
+                             builder_->CreateVectorOfStrings(collections_),
+                             builder_->CreateVector(spans_));
+  }
+
+ private:
+  int CollectionIndex(const std::string& collection) {
+    const auto it = collection_index_.find(collection);
+    if (it != collection_index_.end()) {
+      return it->second;
+    }
+    collections_.push_back(collection);
+    collection_index_[collection] = collections_.size() - 1;
+    return collections_.size() - 1;
+  }
+
+  flatbuffers::Offset<AnnotationClassification> PackClassification(
+      const ClassificationResult& result) {
+    flatbuffers::Offset<EntityData_::Datetime> datetime;
+    if (result.datetime_parse_result.IsSet()) {
+      datetime = EntityData_::CreateDatetime(
+          *builder_, result.datetime_parse_result.time_ms_utc,
+          static_cast<EntityData_::Datetime_::Granularity>(
+              result.datetime_parse_result.granularity));
+    }
+
+    // The results are const, so deferred entity data is built on the side.
+    std::string built_entity_data;
+    const std::string* entity_data = &result.serialized_entity_data;
+    if (result.lazy_entity_data != nullptr) {
+      if (!result.lazy_entity_data->Build(&built_entity_data)) {
+        TC3_LOG(ERROR) << "Could not build the entity data of a result.";
+      }
+      entity_data = &built_entity_data;
+    }
+    flatbuffers::Offset<flatbuffers::Vector<uint8_t>> entity_data_offset;
+    if (!entity_data->empty()) {
+      entity_data_offset = builder_->CreateVector(
+          reinterpret_cast<const uint8_t*>(entity_data->data()),
+          entity_data->size());
+    }
+    flatbuffers::Offset<flatbuffers::Vector<uint8_t>> knowledge_offset;
+    if (result.extras() != nullptr &&
+        !result.extras()->serialized_knowledge_result.empty()) {
+      const std::string& knowledge =
+          result.extras()->serialized_knowledge_result;
+      knowledge_offset = builder_->CreateVector(
+          reinterpret_cast<const uint8_t*>(knowledge.data()),
+          knowledge.size());
+    }
+
+    return CreateAnnotationClassification(
+        *builder_, CollectionIndex(result.collection), result.score,
+        result.priority_score, datetime, result.numeric_value,
+        result.duration_ms, entity_data_offset, knowledge_offset);
+  }
+
+  flatbuffers::FlatBufferBuilder* const builder_;
+  std::vector<std::string> collections_;
+  std::unordered_map<std::string, int> collection_index_;
+  std::vector<flatbuffers::Offset<AnnotationSpan>> spans_;
+};
+
+}  // namespace
+
+flatbuffers::Offset<Annotations> PackAnnotations(
+    const std::vector<AnnotatedSpan>& annotated_spans,
+    flatbuffers::FlatBufferBuilder* builder) {
+  AnnotationsPacker packer(builder);
+  for (const AnnotatedSpan& annotated_span : annotated_spans) {
+    packer.AddSpan(annotated_span.span, annotated_span.classification);
+  }
+  return packer.Finish();
+}
+
+flatbuffers::Offset<Annotations> PackAnnotations(
+    CodepointSpan span, const std::vector<ClassificationResult>& classification,
+    flatbuffers::FlatBufferBuilder* builder) {
+  AnnotationsPacker packer(builder);
+  packer.AddSpan(span, classification);
+  return packer.Finish();
+}
+
+}  // namespace libtextclassifier3
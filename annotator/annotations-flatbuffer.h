@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Functions to write the results of Annotate and ClassifyText into an
+// Annotations flatbuffer, see annotations.fbs, which the receiving process
+// reads in place instead of parsing it.
+
+#ifndef LIBTEXTCLASSIFIER_ANNOTATOR_ANNOTATIONS_FLATBUFFER_H_
+#define LIBTEXTCLASSIFIER_ANNOTATOR_ANNOTATIONS_FLATBUFFER_H_
+
+#include <vector>
+
+#include "annotator/annotations_generated.h"
+#include "annotator/types.h"
+#include "flatbuffers/flatbuffers.h"
+
+namespace libtextclassifier3 {
+
+// Adds the annotated spans to the builder as an Annotations table. Each
+// collection name is stored once, and the entity data of the results is
+// embedded as is, building it first for the results whose entity data was
+// deferred.
+flatbuffers::Offset<Annotations> PackAnnotations(
+    const std::vector<AnnotatedSpan>& annotated_spans,
+    flatbuffers::FlatBufferBuilder* builder);
+
+// Same as above, but for the classification of a single span, e.g. the result
+// of ClassifyText for the selection.
+flatbuffers::Offset<Annotations> PackAnnotations(
+    CodepointSpan span, const std::vector<ClassificationResult>& classification,
+    flatbuffers::FlatBufferBuilder* builder);
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_ANNOTATOR_ANNOTATIONS_FLATBUFFER_H_
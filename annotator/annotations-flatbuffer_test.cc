@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/annotations-flatbuffer.h"
+
+#include <string>
+#include <vector>
+
+#include "utils/flatbuffers.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+std::string SerializeEntityData(const std::string& type) {
+  EntityDataT entity_data;
+  entity_data.type = type;
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(EntityData::Pack(builder, &entity_data));
+  return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                     builder.GetSize());
+}
+
+const Annotations* Finish(flatbuffers::Offset<Annotations> annotations,
+                          flatbuffers::FlatBufferBuilder* builder) {
+  FinishAnnotationsBuffer(*builder, annotations);
+  return LoadAndVerifyFlatbuffer<Annotations>(builder->GetBufferPointer(),
+                                              builder->GetSize());
+}
+
+TEST(AnnotationsFlatbufferTest, StoresCollectionsOnce) {
+  std::vector<AnnotatedSpan> spans(3);
+  spans[0].span = {0, 5};
+  spans[0].classification = {ClassificationResult("phone", 0.9f),
+                             ClassificationResult("date", 0.1f)};
+  spans[1].span = {7, 10};
+  spans[1].classification = {ClassificationResult("date", 0.8f)};
+  spans[2].span = {12, 14};
+  spans[2].classification = {ClassificationResult("phone", 0.7f)};
+
+  flatbuffers::FlatBufferBuilder builder;
+  const Annotations* annotations =
+      Finish(PackAnnotations(spans, &builder), &builder);
+  ASSERT_NE(annotations, nullptr);
+  ASSERT_EQ(annotations->collections()->size(), 2);
+  ASSERT_EQ(annotations->spans()->size(), spans.size());
+  for (int i = 0; i < spans.size(); ++i) {
+    const AnnotationSpan* span = annotations->spans()->Get(i);
+    EXPECT_EQ(span->start(), spans[i].span.first);
+    EXPECT_EQ(span->end(), spans[i].span.second);
+    ASSERT_EQ(span->classification()->size(),
+              spans[i].classification.size());
+    for (int j = 0; j < spans[i].classification.size(); ++j) {
+      const AnnotationClassification* result = span->classification()->Get(j);
+      EXPECT_EQ(annotations->collections()->Get(result->collection())->str(),
+                spans[i].classification[j].collection);
+      EXPECT_FLOAT_EQ(result->score(), spans[i].classification[j].score);
+    }
+  }
+}
+
+TEST(AnnotationsFlatbufferTest, EmbedsEntityDataAndDatetime) {
+  ClassificationResult result("datetime", 1.0f);
+  result.datetime_parse_result = {1000, GRANULARITY_HOUR};
+  result.serialized_entity_data = SerializeEntityData("datetime");
+
+  flatbuffers::FlatBufferBuilder builder;
+  const Annotations* annotations =
+      Finish(PackAnnotations({3, 8}, {result}, &builder), &builder);
+  ASSERT_NE(annotations, nullptr);
+  ASSERT_EQ(annotations->spans()->size(), 1);
+  const AnnotationClassification* classification =
+      annotations->spans()->Get(0)->classification()->Get(0);
+  ASSERT_NE(classification->datetime(), nullptr);
+  EXPECT_EQ(classification->datetime()->time_ms_utc(), 1000);
+  EXPECT_EQ(classification->datetime()->granularity(),
+            EntityData_::Datetime_::Granularity_GRANULARITY_HOUR);
+  ASSERT_NE(classification->entity_data_nested_root(), nullptr);
+  EXPECT_EQ(classification->entity_data_nested_root()->type()->str(),
+            "datetime");
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
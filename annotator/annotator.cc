@@ -18,26 +18,34 @@
 
 #include <algorithm>
 #include <cctype>
+#include <chrono>  // NOLINT
 #include <cmath>
 #include <iterator>
 #include <numeric>
 #include <unordered_map>
 
+#include "annotator/annotations-flatbuffer.h"
 #include "annotator/collections.h"
+#include "annotator/conflict-resolution.h"
 #include "annotator/model_generated.h"
 #include "annotator/types.h"
+#include "lang_id/lang-id.h"
 #include "utils/base/logging.h"
+#include "utils/base/tracing.h"
 #include "utils/checksum.h"
+#include "utils/hash/farmhash.h"
 #include "utils/math/softmax.h"
+#include "utils/memory/scratch-arena.h"
+#include "utils/phase-timer.h"
 #include "utils/regex-match.h"
+#include "utils/utf8/codepoint-offsets.h"
 #include "utils/utf8/unicodetext.h"
+#include "utils/verified-buffers.h"
 #include "utils/zlib/zlib_regex.h"
 
 
 namespace libtextclassifier3 {
 
-using SortedIntSet = std::set<int, std::function<bool(int, int)>>;
-
 const std::string& Annotator::kPhoneCollection =
     *[]() { return new std::string("phone"); }();
 const std::string& Annotator::kAddressCollection =
@@ -51,18 +59,118 @@ const std::string& Annotator::kEmailCollection =
 
 namespace {
 const Model* LoadAndVerifyModel(const void* addr, int size) {
-  flatbuffers::Verifier verifier(reinterpret_cast<const uint8_t*>(addr), size);
-  if (VerifyModelBuffer(verifier)) {
+  const bool verified =
+      VerifiedBufferRegistry::Instance()->Verify(addr, size, [addr, size]() {
+        flatbuffers::Verifier verifier(reinterpret_cast<const uint8_t*>(addr),
+                                       size);
+        return VerifyModelBuffer(verifier);
+      });
+  if (verified) {
     return GetModel(addr);
   } else {
     return nullptr;
   }
 }
 
+bool HasCompressionDictionary(const Model* model) {
+  return model->compression_dictionary() != nullptr &&
+         model->compression_dictionary()->size() > 0;
+}
+
+// Returns the decompressor of the compressed patterns of the model.
+std::unique_ptr<ZlibDecompressor> ModelDecompressor(const Model* model) {
+  if (HasCompressionDictionary(model)) {
+    return ZlibDecompressor::Instance(model->compression_dictionary()->data(),
+                                      model->compression_dictionary()->size());
+  }
+  return ZlibDecompressor::Instance();
+}
+
+// Returns whether the datetime model has patterns which are compressed.
+bool HasCompressedPatterns(const DatetimeModel* model) {
+  if (model->patterns() != nullptr) {
+    for (const DatetimeModelPattern* pattern : *model->patterns()) {
+      if (pattern->regexes() == nullptr) {
+        continue;
+      }
+      for (const DatetimeModelPattern_::Regex* regex : *pattern->regexes()) {
+        if (regex->compressed_pattern() != nullptr) {
+          return true;
+        }
+      }
+    }
+  }
+  if (model->extractors() != nullptr) {
+    for (const DatetimeModelExtractor* extractor : *model->extractors()) {
+      if (extractor->compressed_pattern() != nullptr) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Starts a result cache key with the fingerprint of the context. Collisions of
+// the 64 bit fingerprints are negligible for the size of the caches.
+std::string StartResultCacheKey(const std::string& context) {
+  const uint64 fingerprint = tc3farmhash::Fingerprint64(context);
+  return std::string(reinterpret_cast<const char*>(&fingerprint),
+                     sizeof(fingerprint));
+}
+
+// Appends a field to a result cache key, prefixed by its length so that the
+// fields can't run into each other.
+void AppendToResultCacheKey(const std::string& value, std::string* key) {
+  key->append(std::to_string(value.size()));
+  key->push_back(':');
+  key->append(value);
+}
+
+// Key of the cached Annotate results. The reference time and timezone are not
+// part of it, as the datetimes are cached unresolved.
+std::string AnnotationResultCacheKey(const std::string& context,
+                                     const AnnotationOptions& options) {
+  std::string key = StartResultCacheKey(context);
+  AppendToResultCacheKey(options.locales, &key);
+  AppendToResultCacheKey(options.detected_text_language_tags, &key);
+  AppendToResultCacheKey(std::to_string(options.annotation_usecase), &key);
+  key.push_back(options.is_serialized_entity_data_enabled ? '1' : '0');
+  key.push_back(options.defer_serialized_entity_data ? '1' : '0');
+  std::vector<std::string> entity_types(options.entity_types.begin(),
+                                        options.entity_types.end());
+  std::sort(entity_types.begin(), entity_types.end());
+  for (const std::string& entity_type : entity_types) {
+    AppendToResultCacheKey(entity_type, &key);
+  }
+  return key;
+}
+
+// Key of the cached ClassifyText results, see above.
+std::string ClassificationResultCacheKey(const std::string& context,
+                                         CodepointSpan selection_indices,
+                                         const ClassificationOptions& options) {
+  std::string key = StartResultCacheKey(context);
+  AppendToResultCacheKey(std::to_string(selection_indices.first), &key);
+  AppendToResultCacheKey(std::to_string(selection_indices.second), &key);
+  AppendToResultCacheKey(options.locales, &key);
+  AppendToResultCacheKey(options.detected_text_language_tags, &key);
+  AppendToResultCacheKey(std::to_string(options.annotation_usecase), &key);
+  return key;
+}
+
+// Text with some of the common entity types, run through the enabled code
+// paths by Warmup().
+constexpr char kWarmupText[] =
+    "Call me at (650) 555-0123 or write to jane@example.com, I land on AA 1234 "
+    "tomorrow at 5pm.";
+
+// The phone number of kWarmupText, as codepoint span.
+constexpr CodepointSpan kWarmupSpan = {17, 25};
+
 // If lib is not nullptr, just returns lib. Otherwise, if lib is nullptr, will
 // create a new instance, assign ownership to owned_lib, and return it.
 const UniLib* MaybeCreateUnilib(const UniLib* lib,
-                                std::unique_ptr<UniLib>* owned_lib) {
+                                std::shared_ptr<UniLib>* owned_lib) {
   if (lib) {
     return lib;
   } else {
@@ -73,7 +181,7 @@ const UniLib* MaybeCreateUnilib(const UniLib* lib,
 
 // As above, but for CalendarLib.
 const CalendarLib* MaybeCreateCalendarlib(
-    const CalendarLib* lib, std::unique_ptr<CalendarLib>* owned_lib) {
+    const CalendarLib* lib, std::shared_ptr<CalendarLib>* owned_lib) {
   if (lib) {
     return lib;
   } else {
@@ -84,12 +192,25 @@ const CalendarLib* MaybeCreateCalendarlib(
 
 }  // namespace
 
+InterpreterManager::~InterpreterManager() {
+  if (selection_pool_ != nullptr) {
+    selection_pool_->Release(std::move(selection_interpreter_));
+  }
+  if (classification_pool_ != nullptr) {
+    classification_pool_->Release(std::move(classification_interpreter_));
+  }
+}
+
 tflite::Interpreter* InterpreterManager::SelectionInterpreter() {
   if (!selection_interpreter_) {
-    TC3_CHECK(selection_executor_);
-    selection_interpreter_ = selection_executor_->CreateInterpreter();
-    if (!selection_interpreter_) {
-      TC3_LOG(ERROR) << "Could not build TFLite interpreter.";
+    if (selection_pool_ != nullptr) {
+      selection_interpreter_ = selection_pool_->Acquire();
+    } else {
+      TC3_CHECK(selection_executor_);
+      selection_interpreter_ = selection_executor_->CreateInterpreter();
+      if (!selection_interpreter_) {
+        TC3_LOG(ERROR) << "Could not build TFLite interpreter.";
+      }
     }
   }
   return selection_interpreter_.get();
@@ -97,10 +218,15 @@ tflite::Interpreter* InterpreterManager::SelectionInterpreter() {
 
 tflite::Interpreter* InterpreterManager::ClassificationInterpreter() {
   if (!classification_interpreter_) {
-    TC3_CHECK(classification_executor_);
-    classification_interpreter_ = classification_executor_->CreateInterpreter();
-    if (!classification_interpreter_) {
-      TC3_LOG(ERROR) << "Could not build TFLite interpreter.";
+    if (classification_pool_ != nullptr) {
+      classification_interpreter_ = classification_pool_->Acquire();
+    } else {
+      TC3_CHECK(classification_executor_);
+      classification_interpreter_ =
+          classification_executor_->CreateInterpreter();
+      if (!classification_interpreter_) {
+        TC3_LOG(ERROR) << "Could not build TFLite interpreter.";
+      }
     }
   }
   return classification_interpreter_.get();
@@ -108,14 +234,14 @@ tflite::Interpreter* InterpreterManager::ClassificationInterpreter() {
 
 std::unique_ptr<Annotator> Annotator::FromUnownedBuffer(
     const char* buffer, int size, const UniLib* unilib,
-    const CalendarLib* calendarlib) {
+    const CalendarLib* calendarlib, const std::string& load_locales) {
   const Model* model = LoadAndVerifyModel(buffer, size);
   if (model == nullptr) {
     return nullptr;
   }
 
-  auto classifier =
-      std::unique_ptr<Annotator>(new Annotator(model, unilib, calendarlib));
+  auto classifier = std::unique_ptr<Annotator>(
+      new Annotator(model, unilib, calendarlib, load_locales));
   if (!classifier->IsInitialized()) {
     return nullptr;
   }
@@ -126,7 +252,7 @@ std::unique_ptr<Annotator> Annotator::FromUnownedBuffer(
 
 std::unique_ptr<Annotator> Annotator::FromScopedMmap(
     std::unique_ptr<ScopedMmap>* mmap, const UniLib* unilib,
-    const CalendarLib* calendarlib) {
+    const CalendarLib* calendarlib, const std::string& load_locales) {
   if (!(*mmap)->handle().ok()) {
     TC3_VLOG(1) << "Mmap failed.";
     return nullptr;
@@ -140,7 +266,7 @@ std::unique_ptr<Annotator> Annotator::FromScopedMmap(
   }
 
   auto classifier = std::unique_ptr<Annotator>(
-      new Annotator(mmap, model, unilib, calendarlib));
+      new Annotator(mmap, model, unilib, calendarlib, load_locales));
   if (!classifier->IsInitialized()) {
     return nullptr;
   }
@@ -150,7 +276,7 @@ std::unique_ptr<Annotator> Annotator::FromScopedMmap(
 
 std::unique_ptr<Annotator> Annotator::FromScopedMmap(
     std::unique_ptr<ScopedMmap>* mmap, std::unique_ptr<UniLib> unilib,
-    std::unique_ptr<CalendarLib> calendarlib) {
+    std::unique_ptr<CalendarLib> calendarlib, const std::string& load_locales) {
   if (!(*mmap)->handle().ok()) {
     TC3_VLOG(1) << "Mmap failed.";
     return nullptr;
@@ -164,7 +290,8 @@ std::unique_ptr<Annotator> Annotator::FromScopedMmap(
   }
 
   auto classifier = std::unique_ptr<Annotator>(
-      new Annotator(mmap, model, std::move(unilib), std::move(calendarlib)));
+      new Annotator(mmap, model, std::move(unilib), std::move(calendarlib),
+                    load_locales));
   if (!classifier->IsInitialized()) {
     return nullptr;
   }
@@ -174,75 +301,85 @@ std::unique_ptr<Annotator> Annotator::FromScopedMmap(
 
 std::unique_ptr<Annotator> Annotator::FromFileDescriptor(
     int fd, int offset, int size, const UniLib* unilib,
-    const CalendarLib* calendarlib) {
+    const CalendarLib* calendarlib, const std::string& load_locales) {
   std::unique_ptr<ScopedMmap> mmap(new ScopedMmap(fd, offset, size));
-  return FromScopedMmap(&mmap, unilib, calendarlib);
+  return FromScopedMmap(&mmap, unilib, calendarlib, load_locales);
 }
 
 std::unique_ptr<Annotator> Annotator::FromFileDescriptor(
     int fd, int offset, int size, std::unique_ptr<UniLib> unilib,
-    std::unique_ptr<CalendarLib> calendarlib) {
+    std::unique_ptr<CalendarLib> calendarlib, const std::string& load_locales) {
   std::unique_ptr<ScopedMmap> mmap(new ScopedMmap(fd, offset, size));
-  return FromScopedMmap(&mmap, std::move(unilib), std::move(calendarlib));
+  return FromScopedMmap(&mmap, std::move(unilib), std::move(calendarlib),
+                        load_locales);
 }
 
 std::unique_ptr<Annotator> Annotator::FromFileDescriptor(
-    int fd, const UniLib* unilib, const CalendarLib* calendarlib) {
+    int fd, const UniLib* unilib, const CalendarLib* calendarlib,
+    const std::string& load_locales) {
   std::unique_ptr<ScopedMmap> mmap(new ScopedMmap(fd));
-  return FromScopedMmap(&mmap, unilib, calendarlib);
+  return FromScopedMmap(&mmap, unilib, calendarlib, load_locales);
 }
 
 std::unique_ptr<Annotator> Annotator::FromFileDescriptor(
     int fd, std::unique_ptr<UniLib> unilib,
-    std::unique_ptr<CalendarLib> calendarlib) {
+    std::unique_ptr<CalendarLib> calendarlib, const std::string& load_locales) {
   std::unique_ptr<ScopedMmap> mmap(new ScopedMmap(fd));
-  return FromScopedMmap(&mmap, std::move(unilib), std::move(calendarlib));
+  return FromScopedMmap(&mmap, std::move(unilib), std::move(calendarlib),
+                        load_locales);
 }
 
-std::unique_ptr<Annotator> Annotator::FromPath(const std::string& path,
-                                               const UniLib* unilib,
-                                               const CalendarLib* calendarlib) {
+std::unique_ptr<Annotator> Annotator::FromPath(
+    const std::string& path, const UniLib* unilib,
+    const CalendarLib* calendarlib, const std::string& load_locales) {
   std::unique_ptr<ScopedMmap> mmap(new ScopedMmap(path));
-  return FromScopedMmap(&mmap, unilib, calendarlib);
+  return FromScopedMmap(&mmap, unilib, calendarlib, load_locales);
 }
 
 std::unique_ptr<Annotator> Annotator::FromPath(
     const std::string& path, std::unique_ptr<UniLib> unilib,
-    std::unique_ptr<CalendarLib> calendarlib) {
+    std::unique_ptr<CalendarLib> calendarlib, const std::string& load_locales) {
   std::unique_ptr<ScopedMmap> mmap(new ScopedMmap(path));
-  return FromScopedMmap(&mmap, std::move(unilib), std::move(calendarlib));
+  return FromScopedMmap(&mmap, std::move(unilib), std::move(calendarlib),
+                        load_locales);
 }
 
 Annotator::Annotator(std::unique_ptr<ScopedMmap>* mmap, const Model* model,
-                     const UniLib* unilib, const CalendarLib* calendarlib)
+                     const UniLib* unilib, const CalendarLib* calendarlib,
+                     const std::string& load_locales)
     : model_(model),
       mmap_(std::move(*mmap)),
       owned_unilib_(nullptr),
       unilib_(MaybeCreateUnilib(unilib, &owned_unilib_)),
       owned_calendarlib_(nullptr),
-      calendarlib_(MaybeCreateCalendarlib(calendarlib, &owned_calendarlib_)) {
+      calendarlib_(MaybeCreateCalendarlib(calendarlib, &owned_calendarlib_)),
+      load_locales_(load_locales) {
   ValidateAndInitialize();
 }
 
 Annotator::Annotator(std::unique_ptr<ScopedMmap>* mmap, const Model* model,
                      std::unique_ptr<UniLib> unilib,
-                     std::unique_ptr<CalendarLib> calendarlib)
+                     std::unique_ptr<CalendarLib> calendarlib,
+                     const std::string& load_locales)
     : model_(model),
       mmap_(std::move(*mmap)),
       owned_unilib_(std::move(unilib)),
       unilib_(owned_unilib_.get()),
       owned_calendarlib_(std::move(calendarlib)),
-      calendarlib_(owned_calendarlib_.get()) {
+      calendarlib_(owned_calendarlib_.get()),
+      load_locales_(load_locales) {
   ValidateAndInitialize();
 }
 
 Annotator::Annotator(const Model* model, const UniLib* unilib,
-                     const CalendarLib* calendarlib)
+                     const CalendarLib* calendarlib,
+                     const std::string& load_locales)
     : model_(model),
       owned_unilib_(nullptr),
       unilib_(MaybeCreateUnilib(unilib, &owned_unilib_)),
       owned_calendarlib_(nullptr),
-      calendarlib_(MaybeCreateCalendarlib(calendarlib, &owned_calendarlib_)) {
+      calendarlib_(MaybeCreateCalendarlib(calendarlib, &owned_calendarlib_)),
+      load_locales_(load_locales) {
   ValidateAndInitialize();
 }
 
@@ -289,7 +426,10 @@ void Annotator::ValidateAndInitialize() {
       return;
     }
     selection_feature_processor_.reset(
-        new FeatureProcessor(model_->selection_feature_options(), unilib_));
+        new FeatureProcessor(model_->selection_feature_options(), unilib_,
+                             selection_embedding_cache_.get()));
+    selection_interpreter_pool_.reset(
+        new TfLiteInterpreterPool(selection_executor_.get()));
   }
 
   // Annotation requires the classification model for conflict resolution and
@@ -325,9 +465,27 @@ void Annotator::ValidateAndInitialize() {
     }
 
     classification_feature_processor_.reset(new FeatureProcessor(
-        model_->classification_feature_options(), unilib_));
+        model_->classification_feature_options(), unilib_,
+        classification_embedding_cache_.get()));
+    if (model_->classification_feature_options()->collections() != nullptr) {
+      for (const auto collection :
+           *model_->classification_feature_options()->collections()) {
+        model_collection_ids_.push_back(
+            collection_ids_.Intern(collection->str()));
+      }
+    }
+    classification_interpreter_pool_.reset(
+        new TfLiteInterpreterPool(classification_executor_.get()));
   }
 
+  // Most models tokenize the same way for selection and classification, then
+  // the classification reuses the tokens of the selection.
+  classification_reuses_selection_tokens_ =
+      selection_feature_processor_ != nullptr &&
+      classification_feature_processor_ != nullptr &&
+      classification_feature_processor_->HasSameTokenizer(
+          *selection_feature_processor_);
+
   // The embeddings need to be specified if the model is to be used for
   // classification or selection.
   if (model_enabled_for_annotation || model_enabled_for_classification ||
@@ -349,18 +507,38 @@ void Annotator::ValidateAndInitialize() {
       return;
     }
 
-    embedding_executor_ = TFLiteEmbeddingExecutor::FromBuffer(
-        model_->embedding_model(),
-        model_->classification_feature_options()->embedding_size(),
-        model_->classification_feature_options()->embedding_quantization_bits(),
-        model_->embedding_pruning_mask());
-    if (!embedding_executor_) {
-      TC3_LOG(ERROR) << "Could not initialize embedding executor.";
+    // The embedding executor itself is built on first use, only its structure
+    // is checked here.
+    if (!TFLiteEmbeddingExecutor::IsValidModelSpec(
+            model_->embedding_model(),
+            model_->classification_feature_options()->embedding_size(),
+            model_->classification_feature_options()
+                ->embedding_quantization_bits(),
+            model_->embedding_pruning_mask())) {
+      TC3_LOG(ERROR) << "Invalid embedding model.";
+      return;
+    }
+  }
+
+  // The entity data schema is needed to resolve the entity data fields of the
+  // regex patterns.
+  if (model_->entity_data_schema()) {
+    entity_data_schema_ = LoadAndVerifyFlatbuffer<reflection::Schema>(
+        model_->entity_data_schema()->Data(),
+        model_->entity_data_schema()->size());
+    if (entity_data_schema_ == nullptr) {
+      TC3_LOG(ERROR) << "Could not load entity data schema data.";
       return;
     }
+
+    entity_data_builder_.reset(
+        new ReflectiveFlatbufferBuilder(entity_data_schema_));
+  } else {
+    entity_data_schema_ = nullptr;
+    entity_data_builder_ = nullptr;
   }
 
-  std::unique_ptr<ZlibDecompressor> decompressor = ZlibDecompressor::Instance();
+  std::unique_ptr<ZlibDecompressor> decompressor = ModelDecompressor(model_);
   if (model_->regex_model()) {
     if (!InitializeRegexModel(decompressor.get())) {
       TC3_LOG(ERROR) << "Could not initialize regex model.";
@@ -369,31 +547,49 @@ void Annotator::ValidateAndInitialize() {
   }
 
   if (model_->datetime_model()) {
-    datetime_parser_ = DatetimeParser::Instance(
-        model_->datetime_model(), *unilib_, *calendarlib_, decompressor.get());
-    if (!datetime_parser_) {
-      TC3_LOG(ERROR) << "Could not initialize datetime parser.";
+    // The datetime parser itself is built on first use, only the structure of
+    // its model is checked here.
+    if (!DatetimeParser::IsValidModel(model_->datetime_model())) {
+      TC3_LOG(ERROR) << "Invalid datetime model.";
       return;
     }
+
+    // Without a preset dictionary, the compressed datetime patterns continue
+    // the zlib stream of the regex patterns, so they can't be decompressed
+    // later on their own and the datetime parser has to be built now.
+    if (!HasCompressionDictionary(model_) &&
+        HasCompressedPatterns(model_->datetime_model())) {
+      LazyModelParts* parts = lazy_model_parts_.get();
+      std::call_once(parts->datetime_parser_once,
+                     [this, parts, &decompressor]() {
+                       InitializeDatetimeParser(decompressor.get(), parts);
+                     });
+      if (parts->datetime_parser == nullptr) {
+        return;
+      }
+    }
   }
 
   if (model_->output_options()) {
     if (model_->output_options()->filtered_collections_annotation()) {
       for (const auto collection :
            *model_->output_options()->filtered_collections_annotation()) {
-        filtered_collections_annotation_.insert(collection->str());
+        filtered_collections_annotation_.Insert(
+            collection_ids_.Intern(collection->str()));
       }
     }
     if (model_->output_options()->filtered_collections_classification()) {
       for (const auto collection :
            *model_->output_options()->filtered_collections_classification()) {
-        filtered_collections_classification_.insert(collection->str());
+        filtered_collections_classification_.Insert(
+            collection_ids_.Intern(collection->str()));
       }
     }
     if (model_->output_options()->filtered_collections_selection()) {
       for (const auto collection :
            *model_->output_options()->filtered_collections_selection()) {
-        filtered_collections_selection_.insert(collection->str());
+        filtered_collections_selection_.Insert(
+            collection_ids_.Intern(collection->str()));
       }
     }
   }
@@ -418,48 +614,159 @@ void Annotator::ValidateAndInitialize() {
                               selection_feature_processor_.get()));
   }
 
-  if (model_->entity_data_schema()) {
-    entity_data_schema_ = LoadAndVerifyFlatbuffer<reflection::Schema>(
-        model_->entity_data_schema()->Data(),
-        model_->entity_data_schema()->size());
-    if (entity_data_schema_ == nullptr) {
-      TC3_LOG(ERROR) << "Could not load entity data schema data.";
-      return;
-    }
-
-    entity_data_builder_.reset(
-        new ReflectiveFlatbufferBuilder(entity_data_schema_));
-  } else {
-    entity_data_schema_ = nullptr;
-    entity_data_builder_ = nullptr;
-  }
-
+  locale_table_ = std::make_shared<LocaleTable>();
+  std::vector<Locale> model_triggering_locales;
   if (model_->triggering_locales() &&
       !ParseLocales(model_->triggering_locales()->c_str(),
-                    &model_triggering_locales_)) {
+                    &model_triggering_locales)) {
     TC3_LOG(ERROR) << "Could not parse model supported locales.";
     return;
   }
+  model_triggering_locales_ = locale_table_->Add(model_triggering_locales);
 
+  std::vector<Locale> ml_model_triggering_locales;
   if (model_->triggering_options() != nullptr &&
       model_->triggering_options()->locales() != nullptr &&
       !ParseLocales(model_->triggering_options()->locales()->c_str(),
-                    &ml_model_triggering_locales_)) {
+                    &ml_model_triggering_locales)) {
     TC3_LOG(ERROR) << "Could not parse supported ML model locales.";
     return;
   }
+  ml_model_triggering_locales_ =
+      locale_table_->Add(ml_model_triggering_locales);
 
+  std::vector<Locale> dictionary_locales;
   if (model_->triggering_options() != nullptr &&
       model_->triggering_options()->dictionary_locales() != nullptr &&
       !ParseLocales(model_->triggering_options()->dictionary_locales()->c_str(),
-                    &dictionary_locales_)) {
+                    &dictionary_locales)) {
     TC3_LOG(ERROR) << "Could not parse dictionary supported locales.";
     return;
   }
+  dictionary_locales_ = locale_table_->Add(dictionary_locales);
 
   initialized_ = true;
 }
 
+const EmbeddingExecutor* Annotator::GetEmbeddingExecutor() const {
+  LazyModelParts* parts = lazy_model_parts_.get();
+  std::call_once(parts->embedding_executor_once, [this, parts]() {
+    if (!model_->embedding_model()) {
+      return;
+    }
+    parts->embedding_executor = TFLiteEmbeddingExecutor::FromBuffer(
+        model_->embedding_model(),
+        model_->classification_feature_options()->embedding_size(),
+        model_->classification_feature_options()->embedding_quantization_bits(),
+        model_->embedding_pruning_mask());
+    if (!parts->embedding_executor) {
+      TC3_LOG(ERROR) << "Could not initialize embedding executor.";
+    }
+  });
+  return parts->embedding_executor.get();
+}
+
+const DatetimeParser* Annotator::GetDatetimeParser() const {
+  LazyModelParts* parts = lazy_model_parts_.get();
+  std::call_once(parts->datetime_parser_once, [this, parts]() {
+    if (!model_->datetime_model()) {
+      return;
+    }
+    std::unique_ptr<ZlibDecompressor> decompressor = ModelDecompressor(model_);
+    InitializeDatetimeParser(decompressor.get(), parts);
+  });
+  return parts->datetime_parser.get();
+}
+
+void Annotator::InitializeDatetimeParser(ZlibDecompressor* decompressor,
+                                         LazyModelParts* parts) const {
+  parts->datetime_parser =
+      DatetimeParser::Instance(model_->datetime_model(), *unilib_,
+                               *calendarlib_, decompressor, load_locales_);
+  if (!parts->datetime_parser) {
+    TC3_LOG(ERROR) << "Could not initialize datetime parser.";
+  }
+
+  // Under the lock, so that a capacity set concurrently isn't missed.
+  std::lock_guard<std::mutex> lock(parts->datetime_settings_mutex);
+  if (parts->datetime_parser) {
+    parts->datetime_parser->resolution_cache()->SetCapacity(
+        parts->resolution_cache_capacity);
+    if (parts->regex_stats_enabled) {
+      parts->datetime_parser->regex_stats()->Enable(
+          parts->regex_stats_slow_run_threshold_us);
+    }
+  }
+  parts->datetime_parser_initialized.store(true, std::memory_order_release);
+}
+
+std::unique_ptr<Annotator> Annotator::CloneSharingModel() const {
+  if (!initialized_) {
+    TC3_LOG(ERROR) << "Cannot share the model of an uninitialized annotator.";
+    return nullptr;
+  }
+
+  std::unique_ptr<Annotator> annotator(new Annotator());
+  annotator->model_ = model_;
+  annotator->mmap_ = mmap_;
+  annotator->owned_unilib_ = owned_unilib_;
+  annotator->unilib_ = unilib_;
+  annotator->owned_calendarlib_ = owned_calendarlib_;
+  annotator->calendarlib_ = calendarlib_;
+  annotator->load_locales_ = load_locales_;
+
+  annotator->selection_executor_ = selection_executor_;
+  annotator->classification_executor_ = classification_executor_;
+  annotator->lazy_model_parts_ = lazy_model_parts_;
+  annotator->selection_embedding_cache_ = selection_embedding_cache_;
+  annotator->classification_embedding_cache_ = classification_embedding_cache_;
+  annotator->selection_feature_processor_ = selection_feature_processor_;
+  annotator->classification_feature_processor_ =
+      classification_feature_processor_;
+  annotator->classification_reuses_selection_tokens_ =
+      classification_reuses_selection_tokens_;
+  annotator->selection_interpreter_pool_ = selection_interpreter_pool_;
+  annotator->classification_interpreter_pool_ =
+      classification_interpreter_pool_;
+  annotator->annotation_thread_pool_ = annotation_thread_pool_;
+  annotator->chunk_pruning_options_ = chunk_pruning_options_;
+  annotator->lang_id_ = lang_id_;
+
+  annotator->collection_ids_ = collection_ids_;
+  annotator->model_collection_ids_ = model_collection_ids_;
+  annotator->filtered_collections_annotation_ =
+      filtered_collections_annotation_;
+  annotator->filtered_collections_classification_ =
+      filtered_collections_classification_;
+  annotator->filtered_collections_selection_ = filtered_collections_selection_;
+
+  // The compiled patterns themselves are shared, only the bookkeeping around
+  // them is copied.
+  annotator->regex_patterns_ = regex_patterns_;
+  annotator->regex_stats_ = regex_stats_;
+  annotator->regex_pattern_bytes_ = regex_pattern_bytes_;
+  annotator->regex_literals_ = regex_literals_;
+  annotator->lua_verifiers_ = lua_verifiers_;
+  annotator->verification_cache_ = verification_cache_;
+  annotator->annotation_cost_model_ = annotation_cost_model_;
+  annotator->annotation_regex_patterns_ = annotation_regex_patterns_;
+  annotator->classification_regex_patterns_ = classification_regex_patterns_;
+  annotator->selection_regex_patterns_ = selection_regex_patterns_;
+
+  annotator->number_annotator_ = number_annotator_;
+  annotator->duration_annotator_ = duration_annotator_;
+  annotator->entity_data_schema_ = entity_data_schema_;
+  annotator->entity_data_builder_ = entity_data_builder_;
+
+  annotator->locale_table_ = locale_table_;
+  annotator->model_triggering_locales_ = model_triggering_locales_;
+  annotator->ml_model_triggering_locales_ = ml_model_triggering_locales_;
+  annotator->dictionary_locales_ = dictionary_locales_;
+
+  annotator->initialized_ = true;
+  return annotator;
+}
+
 bool Annotator::InitializeRegexModel(ZlibDecompressor* decompressor) {
   if (!model_->regex_model()->patterns()) {
     return true;
@@ -468,16 +775,26 @@ bool Annotator::InitializeRegexModel(ZlibDecompressor* decompressor) {
   // Initialize pattern recognizers.
   int regex_pattern_id = 0;
   for (const auto& regex_pattern : *model_->regex_model()->patterns()) {
+    std::string pattern_text;
     std::unique_ptr<UniLib::RegexPattern> compiled_pattern =
         UncompressMakeRegexPattern(
             *unilib_, regex_pattern->pattern(),
             regex_pattern->compressed_pattern(),
-            model_->regex_model()->lazy_regex_compilation(), decompressor);
+            model_->regex_model()->lazy_regex_compilation(), decompressor,
+            &pattern_text);
     if (!compiled_pattern) {
       TC3_LOG(INFO) << "Failed to load regex pattern";
       return false;
     }
 
+    regex_pattern_bytes_ += pattern_text.size();
+    const RegexRequirements requirements =
+        ExtractRegexRequirements(pattern_text);
+    const int required_literal_id =
+        requirements.literal.empty()
+            ? -1
+            : regex_literals_.Add(requirements.literal);
+
     if (regex_pattern->enabled_modes() & ModeFlag_ANNOTATION) {
       annotation_regex_patterns_.push_back(regex_pattern_id);
     }
@@ -487,16 +804,64 @@ bool Annotator::InitializeRegexModel(ZlibDecompressor* decompressor) {
     if (regex_pattern->enabled_modes() & ModeFlag_SELECTION) {
       selection_regex_patterns_.push_back(regex_pattern_id);
     }
+    // Resolve the entity data fields of the capturing groups once, so that a
+    // match only sets them.
+    std::vector<ResolvedFieldPath> capturing_group_paths;
+    if (regex_pattern->capturing_group() != nullptr) {
+      capturing_group_paths.resize(regex_pattern->capturing_group()->size());
+      for (int i = 0; i < capturing_group_paths.size(); i++) {
+        const FlatbufferFieldPath* field_path =
+            regex_pattern->capturing_group()->Get(i)->entity_field_path();
+        if (field_path != nullptr && entity_data_builder_ != nullptr &&
+            !entity_data_builder_->ResolveFieldPath(
+                field_path, &capturing_group_paths[i])) {
+          TC3_LOG(ERROR) << "Unknown entity data field of regex pattern "
+                         << regex_pattern_id;
+        }
+      }
+    }
+
     regex_patterns_.push_back({
         regex_pattern,
         std::move(compiled_pattern),
+        required_literal_id,
+        requirements.prefix,
+        requirements.digit_run,
+        collection_ids_.Intern(regex_pattern->collection_name()->str()),
+        std::move(capturing_group_paths),
     });
     ++regex_pattern_id;
   }
 
+  std::vector<std::string> collection_names;
+  collection_names.reserve(regex_patterns_.size());
+  for (const CompiledRegexPattern& regex_pattern : regex_patterns_) {
+    collection_names.push_back(regex_pattern.config->collection_name()->str());
+  }
+  regex_stats_ = std::make_shared<RegexStats>("regex_model", collection_names);
+
+  if (model_->regex_model()->lua_verifier() != nullptr) {
+    for (const auto lua_verifier : *model_->regex_model()->lua_verifier()) {
+      lua_verifiers_.emplace_back(new LuaMatchVerifier(lua_verifier->str()));
+    }
+  }
+
   return true;
 }
 
+bool Annotator::CompiledRegexPattern::MayMatch(
+    StringPiece text, const std::vector<bool>& found_literals,
+    const DigitRunMap& digit_runs) const {
+  if (required_literal_id >= 0 && !found_literals[required_literal_id]) {
+    return false;
+  }
+  if (required_digit_run > 0 &&
+      !digit_runs.MayContainDigitRun(required_digit_run)) {
+    return false;
+  }
+  return text.StartsWith(required_prefix);
+}
+
 bool Annotator::InitializeKnowledgeEngine(
     const std::string& serialized_config) {
   std::unique_ptr<KnowledgeEngine> knowledge_engine(
@@ -506,6 +871,7 @@ bool Annotator::InitializeKnowledgeEngine(
     return false;
   }
   knowledge_engine_ = std::move(knowledge_engine);
+  ClearResultCaches();
   return true;
 }
 
@@ -517,11 +883,39 @@ bool Annotator::InitializeContactEngine(const std::string& serialized_config) {
     return false;
   }
   contact_engine_ = std::move(contact_engine);
+  ClearResultCaches();
+  return true;
+}
+
+bool Annotator::AddContact(const ContactEngine::Contact& contact) {
+  if (contact_engine_ == nullptr || !contact_engine_->AddContact(contact)) {
+    return false;
+  }
+  ClearResultCaches();
+  return true;
+}
+
+bool Annotator::RemoveContact(const std::string& id) {
+  if (contact_engine_ == nullptr || !contact_engine_->RemoveContact(id)) {
+    return false;
+  }
+  ClearResultCaches();
   return true;
 }
 
 bool Annotator::InitializeInstalledAppEngine(
     const std::string& serialized_config) {
+  // Rebuild the index of an existing engine in place, so that concurrent
+  // annotations keep using the old one until the new one is ready.
+  if (installed_app_engine_ != nullptr) {
+    if (!installed_app_engine_->Initialize(serialized_config)) {
+      TC3_LOG(ERROR) << "Failed to update the installed app engine.";
+      return false;
+    }
+    ClearResultCaches();
+    return true;
+  }
+
   std::unique_ptr<InstalledAppEngine> installed_app_engine(
       new InstalledAppEngine(selection_feature_processor_.get(), unilib_));
   if (!installed_app_engine->Initialize(serialized_config)) {
@@ -529,165 +923,635 @@ bool Annotator::InitializeInstalledAppEngine(
     return false;
   }
   installed_app_engine_ = std::move(installed_app_engine);
+  ClearResultCaches();
   return true;
 }
 
-namespace {
-
-int CountDigits(const std::string& str, CodepointSpan selection_indices) {
-  int count = 0;
-  int i = 0;
-  const UnicodeText unicode_str = UTF8ToUnicodeText(str, /*do_copy=*/false);
-  for (auto it = unicode_str.begin(); it != unicode_str.end(); ++it, ++i) {
-    if (i >= selection_indices.first && i < selection_indices.second &&
-        isdigit(*it)) {
-      ++count;
-    }
+void Annotator::SetInterpreterPoolSize(int max_idle_interpreters) {
+  if (selection_interpreter_pool_ != nullptr) {
+    selection_interpreter_pool_->SetMaxIdleInterpreters(max_idle_interpreters);
+  }
+  if (classification_interpreter_pool_ != nullptr) {
+    classification_interpreter_pool_->SetMaxIdleInterpreters(
+        max_idle_interpreters);
   }
-  return count;
 }
 
-}  // namespace
-
-namespace internal {
-// Helper function, which if the initial 'span' contains only white-spaces,
-// moves the selection to a single-codepoint selection on a left or right side
-// of this space.
-CodepointSpan SnapLeftIfWhitespaceSelection(CodepointSpan span,
-                                            const UnicodeText& context_unicode,
-                                            const UniLib& unilib) {
-  TC3_CHECK(ValidNonEmptySpan(span));
-
-  UnicodeText::const_iterator it;
-
-  // Check that the current selection is all whitespaces.
-  it = context_unicode.begin();
-  std::advance(it, span.first);
-  for (int i = 0; i < (span.second - span.first); ++i, ++it) {
-    if (!unilib.IsWhitespace(*it)) {
-      return span;
+bool Annotator::SetTfLiteExecutorOptions(
+    const TfLiteExecutorOptions& options) {
+  std::shared_ptr<const ModelExecutor> selection_executor;
+  if (selection_executor_ != nullptr) {
+    selection_executor =
+        ModelExecutor::FromBuffer(model_->selection_model(), options);
+    if (!selection_executor) {
+      TC3_LOG(ERROR) << "Could not rebuild selection executor.";
+      return false;
+    }
+  }
+  std::shared_ptr<const ModelExecutor> classification_executor;
+  if (classification_executor_ != nullptr) {
+    classification_executor =
+        ModelExecutor::FromBuffer(model_->classification_model(), options);
+    if (!classification_executor) {
+      TC3_LOG(ERROR) << "Could not rebuild classification executor.";
+      return false;
     }
   }
 
-  CodepointSpan result;
-
-  // Try moving left.
-  result = span;
-  it = context_unicode.begin();
-  std::advance(it, span.first);
-  while (it != context_unicode.begin() && unilib.IsWhitespace(*it)) {
-    --result.first;
-    --it;
+  if (selection_executor != nullptr) {
+    selection_interpreter_pool_.reset(new TfLiteInterpreterPool(
+        selection_executor.get(),
+        selection_interpreter_pool_->MaxIdleInterpreters()));
+    selection_executor_ = std::move(selection_executor);
   }
-  result.second = result.first + 1;
-  if (!unilib.IsWhitespace(*it)) {
-    return result;
+  if (classification_executor != nullptr) {
+    classification_interpreter_pool_.reset(new TfLiteInterpreterPool(
+        classification_executor.get(),
+        classification_interpreter_pool_->MaxIdleInterpreters()));
+    classification_executor_ = std::move(classification_executor);
   }
-
-  // If moving left didn't find a non-whitespace character, just return the
-  // original span.
-  return span;
-}
-}  // namespace internal
-
-bool Annotator::FilteredForAnnotation(const AnnotatedSpan& span) const {
-  return !span.classification.empty() &&
-         filtered_collections_annotation_.find(
-             span.classification[0].collection) !=
-             filtered_collections_annotation_.end();
+  ClearResultCaches();
+  return true;
 }
 
-bool Annotator::FilteredForClassification(
-    const ClassificationResult& classification) const {
-  return filtered_collections_classification_.find(classification.collection) !=
-         filtered_collections_classification_.end();
+void Annotator::SetEmbeddingCacheCapacity(int max_num_tokens) {
+  selection_embedding_cache_->SetCapacity(max_num_tokens);
+  classification_embedding_cache_->SetCapacity(max_num_tokens);
 }
 
-bool Annotator::FilteredForSelection(const AnnotatedSpan& span) const {
-  return !span.classification.empty() &&
-         filtered_collections_selection_.find(
-             span.classification[0].collection) !=
-             filtered_collections_selection_.end();
+SharedEmbeddingCacheStats Annotator::GetEmbeddingCacheStats() const {
+  SharedEmbeddingCacheStats stats;
+  for (const SharedEmbeddingCache* cache :
+       {selection_embedding_cache_.get(),
+        classification_embedding_cache_.get()}) {
+    const SharedEmbeddingCacheStats cache_stats = cache->GetStats();
+    stats.num_hits += cache_stats.num_hits;
+    stats.num_misses += cache_stats.num_misses;
+    stats.size += cache_stats.size;
+    stats.bytes += cache_stats.bytes;
+  }
+  return stats;
 }
 
-namespace {
-inline bool ClassifiedAsOther(
-    const std::vector<ClassificationResult>& classification) {
-  return !classification.empty() &&
-         classification[0].collection == Collections::Other();
+const flatbuffers::Vector<uint8_t>* Annotator::GetModelSection(
+    ModelSection section) const {
+  switch (section) {
+    case ModelSection::kSelectionModel:
+      return model_->selection_model();
+    case ModelSection::kClassificationModel:
+      return model_->classification_model();
+    case ModelSection::kEmbeddingModel:
+      return model_->embedding_model();
+  }
+  return nullptr;
 }
 
-float GetPriorityScore(
-    const std::vector<ClassificationResult>& classification) {
-  if (!classification.empty() && !ClassifiedAsOther(classification)) {
-    return classification[0].priority_score;
-  } else {
-    return -1.0;
+bool Annotator::AdviseModelSection(ModelSection section,
+                                   MmapAdvice advice) const {
+  const flatbuffers::Vector<uint8_t>* buffer = GetModelSection(section);
+  if (buffer == nullptr) {
+    return false;
   }
+  return AdviseMemory(buffer->data(), buffer->size(), advice);
 }
-}  // namespace
 
-bool Annotator::VerifyRegexMatchCandidate(
-    const std::string& context, const VerificationOptions* verification_options,
-    const std::string& match, const UniLib::RegexMatcher* matcher) const {
-  if (verification_options == nullptr) {
-    return true;
-  }
-  if (verification_options->verify_luhn_checksum() &&
-      !VerifyLuhnChecksum(match)) {
+bool Annotator::PrefaultModelSection(ModelSection section) const {
+  const flatbuffers::Vector<uint8_t>* buffer = GetModelSection(section);
+  if (buffer == nullptr) {
     return false;
   }
-  const int lua_verifier = verification_options->lua_verifier();
-  if (lua_verifier >= 0) {
-    if (model_->regex_model()->lua_verifier() == nullptr ||
-        lua_verifier >= model_->regex_model()->lua_verifier()->size()) {
-      TC3_LOG(ERROR) << "Invalid lua verifier specified: " << lua_verifier;
-      return false;
-    }
-    return VerifyMatch(
-        context, matcher,
-        model_->regex_model()->lua_verifier()->Get(lua_verifier)->str());
-  }
+  PrefaultMemory(buffer->data(), buffer->size());
   return true;
 }
 
-CodepointSpan Annotator::SuggestSelection(
-    const std::string& context, CodepointSpan click_indices,
-    const SelectionOptions& options) const {
-  CodepointSpan original_click_indices = click_indices;
-  if (!initialized_) {
-    TC3_LOG(ERROR) << "Not initialized";
-    return original_click_indices;
-  }
-  if (!(model_->enabled_modes() & ModeFlag_SELECTION)) {
-    return original_click_indices;
+int64 Annotator::GetModelSectionResidentBytes(ModelSection section) const {
+  const flatbuffers::Vector<uint8_t>* buffer = GetModelSection(section);
+  if (buffer == nullptr) {
+    return -1;
   }
+  return GetResidentBytes(buffer->data(), buffer->size());
+}
 
-  std::vector<Locale> detected_text_language_tags;
-  if (!ParseLocales(options.detected_text_language_tags,
-                    &detected_text_language_tags)) {
-    TC3_LOG(WARNING)
-        << "Failed to parse the detected_text_language_tags in options: "
-        << options.detected_text_language_tags;
+MemoryStats Annotator::GetMemoryStats() const {
+  MemoryStats stats;
+  if (mmap_ != nullptr && mmap_->handle().ok()) {
+    stats.mapped_bytes = mmap_->handle().num_bytes();
+    stats.resident_bytes = std::max<int64>(0, mmap_->ResidentBytes());
   }
-  if (!Locale::IsAnyLocaleSupported(detected_text_language_tags,
-                                    model_triggering_locales_,
-                                    /*default_value=*/true)) {
-    return original_click_indices;
+
+  stats.regex_bytes = regex_pattern_bytes_;
+  const LazyModelParts* parts = lazy_model_parts_.get();
+  if (parts->datetime_parser_initialized.load(std::memory_order_acquire) &&
+      parts->datetime_parser != nullptr) {
+    stats.regex_bytes += parts->datetime_parser->regex_pattern_bytes();
   }
 
-  const UnicodeText context_unicode = UTF8ToUnicodeText(context,
-                                                        /*do_copy=*/false);
+  for (const std::shared_ptr<const LuaMatchVerifier>& lua_verifier :
+       lua_verifiers_) {
+    stats.decompressed_bytes += lua_verifier->lua_verifier_code().size();
+    stats.lua_bytes += lua_verifier->IdleMemoryUsageBytes();
+  }
 
-  if (!context_unicode.is_valid()) {
-    return original_click_indices;
+  for (const TfLiteInterpreterPool* pool :
+       {selection_interpreter_pool_.get(),
+        classification_interpreter_pool_.get()}) {
+    if (pool != nullptr) {
+      stats.interpreter_bytes += pool->IdleTensorBytes();
+    }
   }
 
-  const int context_codepoint_size = context_unicode.size_codepoints();
+  stats.cache_bytes = GetEmbeddingCacheStats().bytes +
+                      annotation_result_cache_.GetStats().bytes +
+                      classification_result_cache_.GetStats().bytes +
+                      verification_cache_->GetStats().bytes;
+  return stats;
+}
 
-  if (click_indices.first < 0 || click_indices.second < 0 ||
-      click_indices.first >= context_codepoint_size ||
-      click_indices.second > context_codepoint_size ||
+void Annotator::SetResultCacheCapacity(int max_num_results) {
+  annotation_result_cache_.SetCapacity(max_num_results);
+  classification_result_cache_.SetCapacity(max_num_results);
+}
+
+ResultCacheStats Annotator::GetResultCacheStats() const {
+  ResultCacheStats stats;
+  for (const ResultCacheStats& cache_stats :
+       {annotation_result_cache_.GetStats(),
+        classification_result_cache_.GetStats()}) {
+    stats.num_hits += cache_stats.num_hits;
+    stats.num_misses += cache_stats.num_misses;
+    stats.num_evictions += cache_stats.num_evictions;
+    stats.size += cache_stats.size;
+    stats.bytes += cache_stats.bytes;
+  }
+  return stats;
+}
+
+void Annotator::SetDatetimeResolutionCacheCapacity(int max_num_results) {
+  // A parser that isn't built yet gets the capacity when it is.
+  LazyModelParts* parts = lazy_model_parts_.get();
+  std::lock_guard<std::mutex> lock(parts->datetime_settings_mutex);
+  parts->resolution_cache_capacity = max_num_results;
+  if (parts->datetime_parser_initialized.load(std::memory_order_acquire) &&
+      parts->datetime_parser != nullptr) {
+    parts->datetime_parser->resolution_cache()->SetCapacity(max_num_results);
+  }
+}
+
+void Annotator::SetVerificationCacheCapacity(int max_num_results) {
+  verification_cache_->SetCapacity(max_num_results);
+}
+
+ResultCacheStats Annotator::GetVerificationCacheStats() const {
+  return verification_cache_->GetStats();
+}
+
+ResultCacheStats Annotator::GetDatetimeResolutionCacheStats() const {
+  const LazyModelParts* parts = lazy_model_parts_.get();
+  if (!parts->datetime_parser_initialized.load(std::memory_order_acquire) ||
+      parts->datetime_parser == nullptr) {
+    return ResultCacheStats();
+  }
+  return parts->datetime_parser->resolution_cache()->GetStats();
+}
+
+void Annotator::ClearResultCaches() {
+  annotation_result_cache_.Clear();
+  classification_result_cache_.Clear();
+}
+
+void Annotator::EnableRegexStats(int64 slow_run_threshold_us) {
+  if (regex_stats_ != nullptr) {
+    regex_stats_->Enable(slow_run_threshold_us);
+  }
+  // A parser that isn't built yet starts counting when it is.
+  LazyModelParts* parts = lazy_model_parts_.get();
+  std::lock_guard<std::mutex> lock(parts->datetime_settings_mutex);
+  parts->regex_stats_enabled = true;
+  parts->regex_stats_slow_run_threshold_us = slow_run_threshold_us;
+  if (parts->datetime_parser_initialized.load(std::memory_order_acquire) &&
+      parts->datetime_parser != nullptr) {
+    parts->datetime_parser->regex_stats()->Enable(slow_run_threshold_us);
+  }
+}
+
+std::vector<RegexPatternStats> Annotator::GetRegexStats() const {
+  std::vector<RegexPatternStats> stats;
+  if (regex_stats_ != nullptr) {
+    stats = regex_stats_->GetStats();
+  }
+  const LazyModelParts* parts = lazy_model_parts_.get();
+  if (parts->datetime_parser_initialized.load(std::memory_order_acquire) &&
+      parts->datetime_parser != nullptr) {
+    for (RegexPatternStats& rule_stats :
+         parts->datetime_parser->regex_stats()->GetStats()) {
+      stats.push_back(std::move(rule_stats));
+    }
+  }
+  return stats;
+}
+
+void Annotator::SetAnnotationThreadPool(ThreadPool* thread_pool) {
+  annotation_thread_pool_ = thread_pool;
+}
+
+void Annotator::SetChunkPruningOptions(const ChunkPruningOptions& options) {
+  chunk_pruning_options_ = options;
+}
+
+void Annotator::SetLangId(const mobile::lang_id::LangId* lang_id) {
+  lang_id_ = lang_id;
+  // The cached results may have been computed with other detected languages.
+  ClearResultCaches();
+}
+
+WarmupReport Annotator::Warmup() const {
+  WarmupReport report;
+  if (!initialized_) {
+    TC3_LOG(ERROR) << "Cannot warm up an uninitialized annotator.";
+    report.RunPhase("initialization", []() { return false; });
+    return report;
+  }
+
+  report.RunPhase("prefault_models", [this]() {
+    for (const ModelSection section :
+         {ModelSection::kSelectionModel, ModelSection::kClassificationModel,
+          ModelSection::kEmbeddingModel}) {
+      PrefaultModelSection(section);
+    }
+    return true;
+  });
+  report.RunPhase("compile_regex_patterns", [this]() {
+    return CompileRegexPatterns(annotation_thread_pool_);
+  });
+
+  const int enabled_modes = model_->triggering_options() != nullptr
+                                ? model_->triggering_options()->enabled_modes()
+                                : 0;
+  if (enabled_modes & ModeFlag_SELECTION) {
+    report.RunPhase("suggest_selection", [this]() {
+      SuggestSelection(kWarmupText, {kWarmupSpan.first, kWarmupSpan.first + 1});
+      return true;
+    });
+  }
+  if (enabled_modes & ModeFlag_CLASSIFICATION) {
+    report.RunPhase("classify_text", [this]() {
+      ClassifyText(kWarmupText, kWarmupSpan);
+      return true;
+    });
+  }
+  if (enabled_modes & ModeFlag_ANNOTATION) {
+    report.RunPhase("annotate", [this]() {
+      Annotate(kWarmupText);
+      return true;
+    });
+  }
+  return report;
+}
+
+bool Annotator::CompileRegexPatterns(ThreadPool* thread_pool) const {
+  std::vector<const UniLib::RegexPattern*> patterns;
+  patterns.reserve(regex_patterns_.size());
+  for (const CompiledRegexPattern& regex_pattern : regex_patterns_) {
+    patterns.push_back(regex_pattern.pattern.get());
+  }
+  const DatetimeParser* datetime_parser = GetDatetimeParser();
+  if (datetime_parser != nullptr) {
+    datetime_parser->GetRegexPatterns(&patterns);
+  }
+  return libtextclassifier3::CompileRegexPatterns(patterns, thread_pool);
+}
+
+namespace {
+
+// Returns whether a sentence ends with the token at `index`, i.e. it ends with
+// sentence-final punctuation and is followed by whitespace.
+bool EndsSentence(const std::vector<Token>& tokens, int index) {
+  const Token& token = tokens[index];
+  if (index + 1 < tokens.size() && tokens[index + 1].start == token.end) {
+    return false;
+  }
+  const UnicodeText value = UTF8ToUnicodeText(token.value, /*do_copy=*/false);
+  if (value.empty()) {
+    return false;
+  }
+  UnicodeText::const_iterator last = value.end();
+  --last;
+  switch (*last) {
+    case '.':
+    case '!':
+    case '?':
+    case 0x2026:  // …
+    case 0x3002:  // 。
+    case 0xFF01:  // ！
+    case 0xFF1F:  // ？
+      return true;
+    default:
+      return false;
+  }
+}
+
+int CountDigits(const std::string& str, CodepointSpan selection_indices) {
+  int count = 0;
+  int i = 0;
+  const UnicodeText unicode_str = UTF8ToUnicodeText(str, /*do_copy=*/false);
+  for (auto it = unicode_str.begin(); it != unicode_str.end(); ++it, ++i) {
+    if (i >= selection_indices.first && i < selection_indices.second &&
+        isdigit(*it)) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+// Helper function that returns the index of the first candidate that
+// transitively does not overlap with the candidate on 'start_index'. If the end
+// of 'candidates' is reached, it returns the index that points right behind the
+// array.
+int FirstNonOverlappingSpanIndex(const std::vector<AnnotatedSpan>& candidates,
+                                 int start_index) {
+  int first_non_overlapping = start_index + 1;
+  CodepointSpan conflicting_span = candidates[start_index].span;
+  while (
+      first_non_overlapping < candidates.size() &&
+      SpansOverlap(conflicting_span, candidates[first_non_overlapping].span)) {
+    // Grow the span to include the current one.
+    conflicting_span.second = std::max(
+        conflicting_span.second, candidates[first_non_overlapping].span.second);
+
+    ++first_non_overlapping;
+  }
+  return first_non_overlapping;
+}
+
+// Removes the groups of transitively overlapping candidates that don't overlap
+// the click from the candidates, sorted by their start. The conflicts of each
+// group are resolved on their own, so the candidates that overlap the click
+// are chosen the same way, and the other groups are not classified.
+void KeepConflictGroupsAroundClick(CodepointSpan click_indices,
+                                   std::vector<AnnotatedSpan>* candidates) {
+  int num_kept = 0;
+  for (int i = 0; i < candidates->size();) {
+    const int first_non_overlapping =
+        FirstNonOverlappingSpanIndex(*candidates, /*start_index=*/i);
+    CodepointSpan group_span = (*candidates)[i].span;
+    for (int j = i + 1; j < first_non_overlapping; ++j) {
+      group_span.second =
+          std::max(group_span.second, (*candidates)[j].span.second);
+    }
+    if (SpansOverlap(group_span, click_indices)) {
+      for (int j = i; j < first_non_overlapping; ++j, ++num_kept) {
+        if (num_kept != j) {
+          (*candidates)[num_kept] = std::move((*candidates)[j]);
+        }
+      }
+    }
+    i = first_non_overlapping;
+  }
+  candidates->resize(num_kept);
+}
+
+}  // namespace
+
+namespace internal {
+// Helper function, which if the initial 'span' contains only white-spaces,
+// moves the selection to a single-codepoint selection on a left or right side
+// of this space.
+CodepointSpan SnapLeftIfWhitespaceSelection(CodepointSpan span,
+                                            const UnicodeText& context_unicode,
+                                            const UniLib& unilib) {
+  TC3_CHECK(ValidNonEmptySpan(span));
+
+  UnicodeText::const_iterator it;
+
+  // Check that the current selection is all whitespaces.
+  it = context_unicode.begin();
+  std::advance(it, span.first);
+  for (int i = 0; i < (span.second - span.first); ++i, ++it) {
+    if (!unilib.IsWhitespace(*it)) {
+      return span;
+    }
+  }
+
+  CodepointSpan result;
+
+  // Try moving left.
+  result = span;
+  it = context_unicode.begin();
+  std::advance(it, span.first);
+  while (it != context_unicode.begin() && unilib.IsWhitespace(*it)) {
+    --result.first;
+    --it;
+  }
+  result.second = result.first + 1;
+  if (!unilib.IsWhitespace(*it)) {
+    return result;
+  }
+
+  // If moving left didn't find a non-whitespace character, just return the
+  // original span.
+  return span;
+}
+}  // namespace internal
+
+bool Annotator::FilteredForAnnotation(const AnnotatedSpan& span) const {
+  return !span.classification.empty() &&
+         !filtered_collections_annotation_.empty() &&
+         filtered_collections_annotation_.Contains(
+             collection_ids_.IdOf(span.classification[0]));
+}
+
+bool Annotator::FilteredForClassification(
+    const ClassificationResult& classification) const {
+  return !filtered_collections_classification_.empty() &&
+         filtered_collections_classification_.Contains(
+             collection_ids_.IdOf(classification));
+}
+
+bool Annotator::FilteredForSelection(const AnnotatedSpan& span) const {
+  return !span.classification.empty() &&
+         !filtered_collections_selection_.empty() &&
+         filtered_collections_selection_.Contains(
+             collection_ids_.IdOf(span.classification[0]));
+}
+
+namespace {
+inline bool ClassifiedAsOther(
+    const std::vector<ClassificationResult>& classification) {
+  return !classification.empty() &&
+         classification[0].collection == Collections::Other();
+}
+
+float GetPriorityScore(
+    const std::vector<ClassificationResult>& classification) {
+  if (!classification.empty() && !ClassifiedAsOther(classification)) {
+    return classification[0].priority_score;
+  } else {
+    return -1.0;
+  }
+}
+}  // namespace
+
+bool Annotator::VerifyRegexMatchCandidate(
+    StringPiece context, const VerificationOptions* verification_options,
+    const std::string& match, const UniLib::RegexMatcher* matcher) const {
+  if (verification_options == nullptr) {
+    return true;
+  }
+  if (verification_options->verify_luhn_checksum() &&
+      !VerifyLuhnChecksum(match)) {
+    return false;
+  }
+  const int lua_verifier = verification_options->lua_verifier();
+  if (lua_verifier >= 0) {
+    if (lua_verifier >= lua_verifiers_.size()) {
+      TC3_LOG(ERROR) << "Invalid lua verifier specified: " << lua_verifier;
+      return false;
+    }
+    return lua_verifiers_[lua_verifier]->Verify(context, matcher);
+  }
+  return true;
+}
+
+bool Annotator::VerifyRegexMatchCandidate(
+    int pattern_id, StringPiece context,
+    const VerificationOptions* verification_options,
+    const std::string& match, const UniLib::RegexMatcher* matcher,
+    std::unordered_map<std::string, bool>* verified_matches) const {
+  // Only the lua verifiers are worth memoizing, a checksum is cheaper than the
+  // lookup.
+  if (verification_options == nullptr ||
+      verification_options->lua_verifier() < 0 ||
+      !verification_options->lua_verifier_reads_only_match_text()) {
+    return VerifyRegexMatchCandidate(context, verification_options, match,
+                                     matcher);
+  }
+  int status = UniLib::RegexMatcher::kNoError;
+  const std::string match_text = matcher->Group(0, &status).ToUTF8String();
+  if (status != UniLib::RegexMatcher::kNoError) {
+    return false;
+  }
+  if (verified_matches != nullptr) {
+    const auto it = verified_matches->find(match_text);
+    if (it != verified_matches->end()) {
+      return it->second;
+    }
+  }
+
+  std::string cache_key;
+  bool verified;
+  if (verification_cache_->enabled()) {
+    cache_key = std::to_string(pattern_id) + ":" + match_text;
+  }
+  if (!verification_cache_->Lookup(cache_key, &verified)) {
+    verified = VerifyRegexMatchCandidate(context, verification_options, match,
+                                         matcher);
+    verification_cache_->Insert(cache_key, verified);
+  }
+  if (verified_matches != nullptr) {
+    (*verified_matches)[match_text] = verified;
+  }
+  return verified;
+}
+
+void SuggestSelectionCache::ResetIfOtherContext(
+    const std::string& new_context, const SelectionOptions& new_options) {
+  if (context == new_context && options == new_options) {
+    return;
+  }
+  context = new_context;
+  options = new_options;
+  has_tokens = false;
+  tokens.clear();
+  has_context_candidates = false;
+  regex_datetime_knowledge_candidates.clear();
+  number_candidates.clear();
+  feature_tokens.clear();
+  feature_span = {kInvalidIndex, kInvalidIndex};
+  features.reset();
+}
+
+CodepointSpan Annotator::SuggestSelection(
+    const std::string& context, CodepointSpan click_indices,
+    const SelectionOptions& options) const {
+  return SuggestSelection(context, click_indices, options, /*cache=*/nullptr);
+}
+
+CodepointSpan Annotator::SuggestSelection(const std::string& context,
+                                          CodepointSpan click_indices,
+                                          const SelectionOptions& options,
+                                          SuggestSelectionCache* cache) const {
+  InterpreterManager interpreter_manager(
+      selection_executor_.get(), classification_executor_.get(),
+      selection_interpreter_pool_.get(),
+      classification_interpreter_pool_.get());
+  std::vector<Token> tokens;
+  return SuggestSelection(context, click_indices, options, cache,
+                          &interpreter_manager, &tokens);
+}
+
+AnnotatedSpan Annotator::SuggestSelectionAndClassify(
+    const std::string& context, CodepointSpan click_indices,
+    const SelectionOptions& selection_options,
+    const ClassificationOptions& classification_options) const {
+  TC3_TRACE_SCOPE("Annotator::SuggestSelectionAndClassify");
+  ScopedScratchArena scratch_arena;
+  InterpreterManager interpreter_manager(
+      selection_executor_.get(), classification_executor_.get(),
+      selection_interpreter_pool_.get(),
+      classification_interpreter_pool_.get());
+  std::vector<Token> tokens;
+  AnnotatedSpan result;
+  result.span =
+      SuggestSelection(context, click_indices, selection_options,
+                       /*cache=*/nullptr, &interpreter_manager, &tokens);
+  result.classification =
+      ClassifyText(context, result.span, classification_options, tokens,
+                   &interpreter_manager, /*is_partial=*/nullptr);
+  return result;
+}
+
+CodepointSpan Annotator::SuggestSelection(
+    const std::string& context, CodepointSpan click_indices,
+    const SelectionOptions& options, SuggestSelectionCache* cache,
+    InterpreterManager* interpreter_manager,
+    std::vector<Token>* tokens) const {
+  TC3_TRACE_SCOPE("Annotator::SuggestSelection");
+  ScopedScratchArena scratch_arena;
+  tokens->clear();
+  CodepointSpan original_click_indices = click_indices;
+  if (!initialized_) {
+    TC3_LOG(ERROR) << "Not initialized";
+    return original_click_indices;
+  }
+  if (!(model_->enabled_modes() & ModeFlag_SELECTION)) {
+    return original_click_indices;
+  }
+
+  std::vector<Locale> detected_text_language_tags;
+  if (!LocaleListCache::Default()->Parse(options.detected_text_language_tags,
+                                         &detected_text_language_tags)) {
+    TC3_LOG(WARNING)
+        << "Failed to parse the detected_text_language_tags in options: "
+        << options.detected_text_language_tags;
+  }
+  if (!locale_table_->IsAnyLocaleSupported(detected_text_language_tags,
+                                           model_triggering_locales_,
+                                           /*default_value=*/true)) {
+    return original_click_indices;
+  }
+
+  const UnicodeText context_unicode = UTF8ToUnicodeText(context,
+                                                        /*do_copy=*/false);
+
+  if (!context_unicode.is_valid()) {
+    return original_click_indices;
+  }
+
+  const int context_codepoint_size = context_unicode.size_codepoints();
+
+  if (click_indices.first < 0 || click_indices.second < 0 ||
+      click_indices.first >= context_codepoint_size ||
+      click_indices.second > context_codepoint_size ||
       click_indices.first >= click_indices.second) {
     TC3_VLOG(1) << "Trying to run SuggestSelection with invalid indices: "
                 << click_indices.first << " " << click_indices.second;
@@ -712,51 +1576,93 @@ CodepointSpan Annotator::SuggestSelection(
   }
 
   std::vector<AnnotatedSpan> candidates;
-  InterpreterManager interpreter_manager(selection_executor_.get(),
-                                         classification_executor_.get());
-  std::vector<Token> tokens;
-  if (!ModelSuggestSelection(context_unicode, click_indices,
-                             detected_text_language_tags, &interpreter_manager,
-                             &tokens, &candidates)) {
-    TC3_LOG(ERROR) << "Model suggest selection failed.";
-    return original_click_indices;
-  }
-  if (!RegexChunk(context_unicode, selection_regex_patterns_, &candidates,
-                  /*is_serialized_entity_data_enabled=*/false)) {
-    TC3_LOG(ERROR) << "Regex suggest selection failed.";
-    return original_click_indices;
-  }
-  if (!DatetimeChunk(
-          UTF8ToUnicodeText(context, /*do_copy=*/false),
-          /*reference_time_ms_utc=*/0, /*reference_timezone=*/"",
-          options.locales, ModeFlag_SELECTION, options.annotation_usecase,
-          /*is_serialized_entity_data_enabled=*/false, &candidates)) {
-    TC3_LOG(ERROR) << "Datetime suggest selection failed.";
-    return original_click_indices;
+  if (cache != nullptr) {
+    cache->ResetIfOtherContext(context, options);
+  }
+
+  // The candidates of the sources that don't depend on the click are only
+  // produced once per context when there is a cache.
+  SuggestSelectionCache local_cache;
+  SuggestSelectionCache* context_cache =
+      cache != nullptr ? cache : &local_cache;
+  if (!context_cache->has_context_candidates) {
+    std::vector<AnnotatedSpan>* const context_candidates =
+        &context_cache->regex_datetime_knowledge_candidates;
+    if (!RegexChunk(context_unicode, selection_regex_patterns_,
+                    context_candidates, EntityDataMode::kNone)) {
+      TC3_LOG(ERROR) << "Regex suggest selection failed.";
+      return original_click_indices;
+    }
+    if (!DatetimeChunk(UTF8ToUnicodeText(context, /*do_copy=*/false),
+                       options.locales, ModeFlag_SELECTION,
+                       options.annotation_usecase, context_candidates)) {
+      TC3_LOG(ERROR) << "Datetime suggest selection failed.";
+      return original_click_indices;
+    }
+    if (knowledge_engine_ != nullptr &&
+        !knowledge_engine_->Chunk(context, context_candidates)) {
+      TC3_LOG(ERROR) << "Knowledge suggest selection failed.";
+      return original_click_indices;
+    }
+    if (number_annotator_ != nullptr) {
+      // The tokens of the context are kept for the selection model to start
+      // from.
+      if (!context_cache->has_tokens) {
+        context_cache->tokens =
+            selection_feature_processor_->Tokenize(context_unicode);
+        context_cache->has_tokens = true;
+      }
+      if (!number_annotator_->FindAll(context_unicode, context_cache->tokens,
+                                      options.annotation_usecase,
+                                      &context_cache->number_candidates)) {
+        TC3_LOG(ERROR) << "Number annotator failed in suggest selection.";
+        return original_click_indices;
+      }
+    }
+    context_cache->has_context_candidates = true;
   }
-  if (knowledge_engine_ != nullptr &&
-      !knowledge_engine_->Chunk(context, &candidates)) {
-    TC3_LOG(ERROR) << "Knowledge suggest selection failed.";
+
+  // The selection model only runs if its candidates could still win against
+  // the candidates of the rules around the click.
+  if (IsSelectionDecidedByRules(*context_cache, click_indices)) {
+    if (context_cache->has_tokens) {
+      *tokens = context_cache->tokens;
+    } else {
+      tokens->clear();
+      selection_feature_processor_->Tokenize(context_unicode,
+                                             /*codepoint_offset=*/0, tokens);
+    }
+    int click_pos;
+    selection_feature_processor_->RetokenizeAndFindClick(
+        context_unicode, click_indices,
+        selection_feature_processor_->GetOptions()->only_use_line_with_click(),
+        tokens, &click_pos);
+  } else if (!ModelSuggestSelection(context_unicode, click_indices,
+                                    detected_text_language_tags,
+                                    interpreter_manager, tokens, &candidates,
+                                    context_cache)) {
+    TC3_LOG(ERROR) << "Model suggest selection failed.";
     return original_click_indices;
   }
+  candidates.insert(
+      candidates.end(),
+      context_cache->regex_datetime_knowledge_candidates.begin(),
+      context_cache->regex_datetime_knowledge_candidates.end());
   if (contact_engine_ != nullptr &&
-      !contact_engine_->Chunk(context_unicode, tokens, &candidates)) {
+      !contact_engine_->Chunk(context_unicode, *tokens, &candidates)) {
     TC3_LOG(ERROR) << "Contact suggest selection failed.";
     return original_click_indices;
   }
   if (installed_app_engine_ != nullptr &&
-      !installed_app_engine_->Chunk(context_unicode, tokens, &candidates)) {
+      !installed_app_engine_->Chunk(context_unicode, *tokens, &candidates)) {
     TC3_LOG(ERROR) << "Installed app suggest selection failed.";
     return original_click_indices;
   }
-  if (number_annotator_ != nullptr &&
-      !number_annotator_->FindAll(context_unicode, options.annotation_usecase,
-                                  &candidates)) {
-    TC3_LOG(ERROR) << "Number annotator failed in suggest selection.";
-    return original_click_indices;
-  }
+  candidates.insert(candidates.end(),
+                    context_cache->number_candidates.begin(),
+                    context_cache->number_candidates.end());
   if (duration_annotator_ != nullptr &&
-      !duration_annotator_->FindAll(context_unicode, tokens,
+      !duration_annotator_->FindAll(context_unicode, *tokens,
                                     options.annotation_usecase, &candidates)) {
     TC3_LOG(ERROR) << "Duration annotator failed in suggest selection.";
     return original_click_indices;
@@ -769,11 +1675,12 @@ CodepointSpan Annotator::SuggestSelection(
             [](const AnnotatedSpan& a, const AnnotatedSpan& b) {
               return a.span.first < b.span.first;
             });
+  KeepConflictGroupsAroundClick(click_indices, &candidates);
 
   std::vector<int> candidate_indices;
-  if (!ResolveConflicts(candidates, context, tokens,
+  if (!ResolveConflicts(candidates, context, *tokens,
                         detected_text_language_tags, options.annotation_usecase,
-                        &interpreter_manager, &candidate_indices)) {
+                        interpreter_manager, &candidate_indices)) {
     TC3_LOG(ERROR) << "Couldn't resolve conflicts.";
     return original_click_indices;
   }
@@ -792,8 +1699,8 @@ CodepointSpan Annotator::SuggestSelection(
       if (candidates[i].classification.empty() &&
           model_->selection_options()->always_classify_suggested_selection() &&
           !filtered_collections_selection_.empty()) {
-        if (!ModelClassifyText(context, detected_text_language_tags,
-                               candidates[i].span, &interpreter_manager,
+        if (!ModelClassifyText(context, *tokens, detected_text_language_tags,
+                               candidates[i].span, interpreter_manager,
                                /*embedding_cache=*/nullptr,
                                &candidates[i].classification)) {
           return original_click_indices;
@@ -812,212 +1719,201 @@ CodepointSpan Annotator::SuggestSelection(
   return original_click_indices;
 }
 
-namespace {
-// Helper function that returns the index of the first candidate that
-// transitively does not overlap with the candidate on 'start_index'. If the end
-// of 'candidates' is reached, it returns the index that points right behind the
-// array.
-int FirstNonOverlappingSpanIndex(const std::vector<AnnotatedSpan>& candidates,
-                                 int start_index) {
-  int first_non_overlapping = start_index + 1;
-  CodepointSpan conflicting_span = candidates[start_index].span;
-  while (
-      first_non_overlapping < candidates.size() &&
-      SpansOverlap(conflicting_span, candidates[first_non_overlapping].span)) {
-    // Grow the span to include the current one.
-    conflicting_span.second = std::max(
-        conflicting_span.second, candidates[first_non_overlapping].span.second);
+bool Annotator::IsSelectionDecidedByRules(
+    const SuggestSelectionCache& context_cache,
+    CodepointSpan click_indices) const {
+  if (model_->selection_options() == nullptr) {
+    return false;
+  }
+  const float min_priority_score =
+      model_->selection_options()->skip_model_min_priority_score();
+  if (min_priority_score <= 0.0f) {
+    return false;
+  }
+  // Every candidate of the model overlaps the click, and so also a candidate
+  // that contains the click. Such a candidate with a higher priority score
+  // than the model ever assigns is chosen over all of them.
+  const auto decides_selection = [click_indices,
+                                  min_priority_score](const AnnotatedSpan& a) {
+    return a.span.first <= click_indices.first &&
+           a.span.second >= click_indices.second &&
+           GetPriorityScore(a.classification) >= min_priority_score;
+  };
+  return std::any_of(context_cache.regex_datetime_knowledge_candidates.begin(),
+                     context_cache.regex_datetime_knowledge_candidates.end(),
+                     decides_selection) ||
+         std::any_of(context_cache.number_candidates.begin(),
+                     context_cache.number_candidates.end(), decides_selection);
+}
 
-    ++first_non_overlapping;
+bool Annotator::IsClassificationDecidedByRules(
+    const std::vector<ClassificationResult>& regex_results) const {
+  if (model_->classification_options() == nullptr) {
+    return false;
   }
-  return first_non_overlapping;
+  const float min_priority_score =
+      model_->classification_options()->skip_later_sources_min_priority_score();
+  if (min_priority_score <= 0.0f) {
+    return false;
+  }
+  // All the candidates of a classification have the same span, so the regex
+  // result with the highest priority score conflicts with, and ranks above,
+  // every result of the later sources.
+  return std::any_of(regex_results.begin(), regex_results.end(),
+                     [min_priority_score](const ClassificationResult& result) {
+                       return result.collection != Collections::Other() &&
+                              result.priority_score >= min_priority_score;
+                     });
 }
-}  // namespace
 
 bool Annotator::ResolveConflicts(
     const std::vector<AnnotatedSpan>& candidates, const std::string& context,
     const std::vector<Token>& cached_tokens,
     const std::vector<Locale>& detected_text_language_tags,
     AnnotationUsecase annotation_usecase,
-    InterpreterManager* interpreter_manager, std::vector<int>* result) const {
+    InterpreterManager* interpreter_manager, std::vector<int>* result,
+    const StopCondition* stop) const {
   result->clear();
   result->reserve(candidates.size());
+
+  // Find the conflicting groups, and the candidates in them that still need a
+  // classification to determine their priority.
+  ScratchVector<std::pair<int, int>> conflict_groups;
+  ScratchVector<int> unclassified_indices;
   for (int i = 0; i < candidates.size();) {
-    int first_non_overlapping =
+    const int first_non_overlapping =
         FirstNonOverlappingSpanIndex(candidates, /*start_index=*/i);
-
-    const bool conflict_found = first_non_overlapping != (i + 1);
-    if (conflict_found) {
-      std::vector<int> candidate_indices;
-      if (!ResolveConflict(context, cached_tokens, candidates,
-                           detected_text_language_tags, i,
-                           first_non_overlapping, annotation_usecase,
-                           interpreter_manager, &candidate_indices)) {
-        return false;
+    if (first_non_overlapping != (i + 1)) {
+      conflict_groups.push_back({i, first_non_overlapping});
+      for (int j = i; j < first_non_overlapping; ++j) {
+        if (candidates[j].classification.empty()) {
+          unclassified_indices.push_back(j);
+        }
       }
-      result->insert(result->end(), candidate_indices.begin(),
-                     candidate_indices.end());
-    } else {
-      result->push_back(i);
     }
 
     // Skip over the whole conflicting group/go to next candidate.
     i = first_non_overlapping;
   }
-  return true;
-}
 
-namespace {
-// Returns true, if the given two sources do conflict in given annotation
-// usecase.
-//  - In SMART usecase, all sources do conflict, because there's only 1 possible
-//  annotation for a given span.
-//  - In RAW usecase, certain annotations are allowed to overlap (e.g. datetime
-//  and duration), while others not (e.g. duration and number).
-bool DoSourcesConflict(AnnotationUsecase annotation_usecase,
-                       const AnnotatedSpan::Source source1,
-                       const AnnotatedSpan::Source source2) {
-  uint32 source_mask =
-      (1 << static_cast<int>(source1)) | (1 << static_cast<int>(source2));
-
-  switch (annotation_usecase) {
-    case AnnotationUsecase_ANNOTATION_USECASE_SMART:
-      // In the SMART mode, all annotations conflict.
-      return true;
-
-    case AnnotationUsecase_ANNOTATION_USECASE_RAW:
-      // DURATION and DATETIME do not conflict. E.g. "let's meet in 3 hours",
-      // can have two non-conflicting annotations: "in 3 hours" (datetime), "3
-      // hours" (duration).
-      if ((source_mask &
-           (1 << static_cast<int>(AnnotatedSpan::Source::DURATION))) &&
-          (source_mask &
-           (1 << static_cast<int>(AnnotatedSpan::Source::DATETIME)))) {
-        return false;
+  // OPTIMIZATION: So that we don't have to classify all the ML model spans
+  // apriori, only the ones that conflict with something are classified here,
+  // as we need their actual classification scores to determine the priority.
+  // They are all classified together, sharing one embedding cache. Once the
+  // call has to stop, the remaining ones keep the lowest priority.
+  std::vector<float> scores(candidates.size(), 0.0);
+  for (const std::pair<int, int>& group : conflict_groups) {
+    for (int i = group.first; i < group.second; ++i) {
+      if (!candidates[i].classification.empty()) {
+        scores[i] = GetPriorityScore(candidates[i].classification);
       }
-
-      // A KNOWLEDGE entity does not conflict with anything.
-      if ((source_mask &
-           (1 << static_cast<int>(AnnotatedSpan::Source::KNOWLEDGE)))) {
+    }
+  }
+  if (!unclassified_indices.empty() && !ShouldStop(stop)) {
+    FeatureProcessor::EmbeddingCache embedding_cache;
+    std::vector<std::vector<ClassificationResult>> classifications;
+    if (model_->classification_options()->batch_chunks_in_annotation()) {
+      std::vector<CodepointSpan> spans;
+      spans.reserve(unclassified_indices.size());
+      for (const int i : unclassified_indices) {
+        spans.push_back(candidates[i].span);
+      }
+      if (!ModelClassifyTexts(context, cached_tokens,
+                              detected_text_language_tags, spans,
+                              interpreter_manager, &embedding_cache,
+                              &classifications)) {
         return false;
       }
+    } else {
+      classifications.resize(unclassified_indices.size());
+      for (int k = 0; k < unclassified_indices.size(); ++k) {
+        if (ShouldStop(stop)) {
+          break;
+        }
+        if (!ModelClassifyText(context, cached_tokens,
+                               detected_text_language_tags,
+                               candidates[unclassified_indices[k]].span,
+                               interpreter_manager, &embedding_cache,
+                               &classifications[k])) {
+          return false;
+        }
+      }
+    }
+    for (int k = 0; k < unclassified_indices.size(); ++k) {
+      if (!classifications[k].empty()) {
+        scores[unclassified_indices[k]] = GetPriorityScore(classifications[k]);
+      }
+    }
+  }
 
-      // Entities from other sources can conflict.
-      return true;
+  int next_index = 0;
+  for (const std::pair<int, int>& group : conflict_groups) {
+    for (; next_index < group.first; ++next_index) {
+      result->push_back(next_index);
+    }
+    std::vector<int> candidate_indices;
+    ResolveConflict(candidates, scores, group.first, group.second,
+                    annotation_usecase, &candidate_indices);
+    result->insert(result->end(), candidate_indices.begin(),
+                   candidate_indices.end());
+    next_index = group.second;
   }
+  for (; next_index < candidates.size(); ++next_index) {
+    result->push_back(next_index);
+  }
+  return true;
 }
-}  // namespace
 
-bool Annotator::ResolveConflict(
-    const std::string& context, const std::vector<Token>& cached_tokens,
-    const std::vector<AnnotatedSpan>& candidates,
-    const std::vector<Locale>& detected_text_language_tags, int start_index,
-    int end_index, AnnotationUsecase annotation_usecase,
-    InterpreterManager* interpreter_manager,
-    std::vector<int>* chosen_indices) const {
+void Annotator::ResolveConflict(const std::vector<AnnotatedSpan>& candidates,
+                                const std::vector<float>& scores,
+                                int start_index, int end_index,
+                                AnnotationUsecase annotation_usecase,
+                                std::vector<int>* chosen_indices) const {
   std::vector<int> conflicting_indices;
-  std::unordered_map<int, float> scores;
+  conflicting_indices.reserve(end_index - start_index);
   for (int i = start_index; i < end_index; ++i) {
     conflicting_indices.push_back(i);
-    if (!candidates[i].classification.empty()) {
-      scores[i] = GetPriorityScore(candidates[i].classification);
-      continue;
-    }
-
-    // OPTIMIZATION: So that we don't have to classify all the ML model
-    // spans apriori, we wait until we get here, when they conflict with
-    // something and we need the actual classification scores. So if the
-    // candidate conflicts and comes from the model, we need to run a
-    // classification to determine its priority:
-    std::vector<ClassificationResult> classification;
-    if (!ModelClassifyText(context, cached_tokens, detected_text_language_tags,
-                           candidates[i].span, interpreter_manager,
-                           /*embedding_cache=*/nullptr, &classification)) {
-      return false;
-    }
-
-    if (!classification.empty()) {
-      scores[i] = GetPriorityScore(classification);
-    }
   }
 
   std::sort(conflicting_indices.begin(), conflicting_indices.end(),
             [&scores](int i, int j) { return scores[i] > scores[j]; });
 
-  // Here we keep a set of indices that were chosen, per-source, to enable
-  // effective computation.
-  std::unordered_map<AnnotatedSpan::Source, SortedIntSet>
-      chosen_indices_for_source_map;
-
   // Greedily place the candidates if they don't conflict with the already
   // placed ones.
-  for (int i = 0; i < conflicting_indices.size(); ++i) {
-    const int considered_candidate = conflicting_indices[i];
-
-    // See if there is a conflict between the candidate and all already placed
-    // candidates.
-    bool conflict = false;
-    SortedIntSet* chosen_indices_for_source_ptr = nullptr;
-    for (auto& source_set_pair : chosen_indices_for_source_map) {
-      if (source_set_pair.first == candidates[considered_candidate].source) {
-        chosen_indices_for_source_ptr = &source_set_pair.second;
-      }
-
-      if (DoSourcesConflict(annotation_usecase, source_set_pair.first,
-                            candidates[considered_candidate].source) &&
-          DoesCandidateConflict(considered_candidate, candidates,
-                                source_set_pair.second)) {
-        conflict = true;
-        break;
-      }
-    }
-
-    // Skip the candidate if a conflict was found.
-    if (conflict) {
-      continue;
-    }
-
-    // If the set of indices for the current source doesn't exist yet,
-    // initialize it.
-    if (chosen_indices_for_source_ptr == nullptr) {
-      SortedIntSet new_set([&candidates](int a, int b) {
-        return candidates[a].span.first < candidates[b].span.first;
-      });
-      chosen_indices_for_source_map[candidates[considered_candidate].source] =
-          std::move(new_set);
-      chosen_indices_for_source_ptr =
-          &chosen_indices_for_source_map[candidates[considered_candidate]
-                                             .source];
-    }
-
-    // Place the candidate to the output and to the per-source conflict set.
-    chosen_indices->push_back(considered_candidate);
-    chosen_indices_for_source_ptr->insert(considered_candidate);
-  }
+  ChooseNonConflictingCandidates(candidates, conflicting_indices,
+                                 annotation_usecase, chosen_indices);
 
   std::sort(chosen_indices->begin(), chosen_indices->end());
-
-  return true;
 }
 
 bool Annotator::ModelSuggestSelection(
     const UnicodeText& context_unicode, CodepointSpan click_indices,
     const std::vector<Locale>& detected_text_language_tags,
     InterpreterManager* interpreter_manager, std::vector<Token>* tokens,
-    std::vector<AnnotatedSpan>* result) const {
+    std::vector<AnnotatedSpan>* result, SuggestSelectionCache* cache) const {
   if (model_->triggering_options() == nullptr ||
       !(model_->triggering_options()->enabled_modes() & ModeFlag_SELECTION)) {
     return true;
   }
 
-  if (!Locale::IsAnyLocaleSupported(detected_text_language_tags,
-                                    ml_model_triggering_locales_,
-                                    /*default_value=*/true)) {
+  if (!locale_table_->IsAnyLocaleSupported(detected_text_language_tags,
+                                           ml_model_triggering_locales_,
+                                           /*default_value=*/true)) {
     return true;
   }
 
   int click_pos;
-  *tokens = selection_feature_processor_->Tokenize(context_unicode);
+  if (cache != nullptr && cache->has_tokens) {
+    *tokens = cache->tokens;
+  } else {
+    tokens->clear();
+    selection_feature_processor_->Tokenize(context_unicode,
+                                           /*codepoint_offset=*/0, tokens);
+    if (cache != nullptr) {
+      cache->tokens = *tokens;
+      cache->has_tokens = true;
+    }
+  }
   selection_feature_processor_->RetokenizeAndFindClick(
       context_unicode, click_indices,
       selection_feature_processor_->GetOptions()->only_use_line_with_click(),
@@ -1072,19 +1968,54 @@ bool Annotator::ModelSuggestSelection(
     return true;
   }
 
-  std::unique_ptr<CachedFeatures> cached_features;
-  if (!selection_feature_processor_->ExtractFeatures(
-          *tokens, extraction_span,
-          /*selection_span_for_feature=*/{kInvalidIndex, kInvalidIndex},
-          embedding_executor_.get(),
-          /*embedding_cache=*/nullptr,
-          selection_feature_processor_->EmbeddingSize() +
-              selection_feature_processor_->DenseFeaturesCount(),
-          &cached_features)) {
-    TC3_LOG(ERROR) << "Could not extract features.";
+  const EmbeddingExecutor* embedding_executor = GetEmbeddingExecutor();
+  if (embedding_executor == nullptr) {
+    TC3_LOG(ERROR) << "No embedding executor.";
     return false;
   }
 
+  // Features of a larger span of the same tokens give the same model inputs:
+  // the features the model reads for the new click all lie within the
+  // extraction span, and padding is only used beyond the tokens.
+  std::unique_ptr<CachedFeatures> owned_features;
+  const CachedFeatures* cached_features = nullptr;
+  if (cache != nullptr && cache->features != nullptr &&
+      cache->feature_span.first <= extraction_span.first &&
+      cache->feature_span.second >= extraction_span.second &&
+      cache->feature_tokens == *tokens) {
+    cached_features = cache->features.get();
+  } else {
+    // When the click is close to the previous one, the cached span is extended
+    // so that more clicks around both are covered.
+    TokenSpan feature_span = extraction_span;
+    if (cache != nullptr && cache->features != nullptr &&
+        cache->feature_tokens == *tokens &&
+        TokenSpanSize(IntersectTokenSpans(cache->feature_span,
+                                          extraction_span)) > 0) {
+      feature_span = {std::min(feature_span.first, cache->feature_span.first),
+                      std::max(feature_span.second,
+                               cache->feature_span.second)};
+    }
+    if (!selection_feature_processor_->ExtractFeatures(
+            *tokens, feature_span,
+            /*selection_span_for_feature=*/{kInvalidIndex, kInvalidIndex},
+            embedding_executor,
+            /*embedding_cache=*/nullptr,
+            selection_feature_processor_->EmbeddingSize() +
+                selection_feature_processor_->DenseFeaturesCount(),
+            &owned_features)) {
+      TC3_LOG(ERROR) << "Could not extract features.";
+      return false;
+    }
+    cached_features = owned_features.get();
+    if (cache != nullptr) {
+      ++cache->num_feature_extractions;
+      cache->feature_tokens = *tokens;
+      cache->feature_span = feature_span;
+      cache->features = std::move(owned_features);
+    }
+  }
+
   // Produce selection model candidates.
   std::vector<TokenSpan> chunks;
   if (!ModelChunk(tokens->size(), /*span_of_interest=*/symmetry_context_span,
@@ -1094,13 +2025,17 @@ bool Annotator::ModelSuggestSelection(
     return false;
   }
 
+  // The chunks are found with the index of the context rather than by walking
+  // from the beginning of the text, which would be quadratic in the length of
+  // the text.
+  const CodepointOffsetIndex context_index(context_unicode);
   for (const TokenSpan& chunk : chunks) {
     AnnotatedSpan candidate;
     candidate.span = selection_feature_processor_->StripBoundaryCodepoints(
-        context_unicode, TokenSpanToCodepointSpan(*tokens, chunk));
+        context_index, TokenSpanToCodepointSpan(*tokens, chunk));
     if (model_->selection_options()->strip_unpaired_brackets()) {
       candidate.span =
-          StripUnpairedBrackets(context_unicode, candidate.span, *unilib_);
+          StripUnpairedBrackets(context_index, candidate.span, *unilib_);
     }
 
     // Only output non-empty spans.
@@ -1210,31 +2145,199 @@ bool Annotator::ModelClassifyText(
     return true;
   }
 
-  if (!Locale::IsAnyLocaleSupported(detected_text_language_tags,
-                                    ml_model_triggering_locales_,
-                                    /*default_value=*/true)) {
+  if (!locale_table_->IsAnyLocaleSupported(detected_text_language_tags,
+                                           ml_model_triggering_locales_,
+                                           /*default_value=*/true)) {
+    return true;
+  }
+
+  std::vector<float> features;
+  int selection_num_tokens;
+  if (!ExtractClassificationFeatures(context, cached_tokens, selection_indices,
+                                     embedding_cache, tokens, &features,
+                                     &selection_num_tokens,
+                                     classification_results)) {
+    return false;
+  }
+  if (features.empty()) {
+    // The result was already determined without running the model.
     return true;
   }
 
-  if (cached_tokens.empty()) {
-    *tokens = classification_feature_processor_->Tokenize(context);
+  TensorView<float> logits = classification_executor_->ComputeLogits(
+      TensorView<float>(features.data(),
+                        {1, static_cast<int>(features.size())}),
+      interpreter_manager->ClassificationInterpreter());
+  if (!logits.is_valid()) {
+    TC3_LOG(ERROR) << "Couldn't compute logits.";
+    return false;
+  }
+
+  if (logits.dims() != 2 || logits.dim(0) != 1 ||
+      logits.dim(1) != classification_feature_processor_->NumCollections()) {
+    TC3_LOG(ERROR) << "Mismatching output";
+    return false;
+  }
+
+  ClassificationResultsFromLogits(context, detected_text_language_tags,
+                                  selection_indices, selection_num_tokens,
+                                  logits.data(), logits.dim(1),
+                                  classification_results);
+  return true;
+}
+
+bool Annotator::ModelClassifyTexts(
+    const std::string& context, const std::vector<Token>& cached_tokens,
+    const std::vector<Locale>& detected_text_language_tags,
+    const std::vector<CodepointSpan>& selection_indices,
+    InterpreterManager* interpreter_manager,
+    FeatureProcessor::EmbeddingCache* embedding_cache,
+    std::vector<std::vector<ClassificationResult>>* classification_results)
+    const {
+  classification_results->clear();
+  classification_results->resize(selection_indices.size());
+  if (model_->triggering_options() == nullptr ||
+      !(model_->triggering_options()->enabled_modes() &
+        ModeFlag_CLASSIFICATION)) {
+    return true;
+  }
+
+  if (!locale_table_->IsAnyLocaleSupported(detected_text_language_tags,
+                                           ml_model_triggering_locales_,
+                                           /*default_value=*/true)) {
+    return true;
+  }
+
+  // Gather the features of all the spans that need the model into one batch.
+  // All spans share the same feature size; the tokens needed around a span
+  // are bounded by ClassifyTextUpperBoundNeededTokens().
+  std::vector<float> batch_features;
+  std::vector<int> batch_span_indices;
+  std::vector<int> batch_num_tokens;
+  int feature_size = 0;
+  for (int i = 0; i < selection_indices.size(); ++i) {
+    std::vector<Token> tokens;
+    std::vector<float> features;
+    int selection_num_tokens;
+    if (!ExtractClassificationFeatures(
+            context, cached_tokens, selection_indices[i], embedding_cache,
+            &tokens, &features, &selection_num_tokens,
+            &(*classification_results)[i])) {
+      return false;
+    }
+    if (features.empty()) {
+      continue;
+    }
+    if (feature_size == 0) {
+      feature_size = features.size();
+      batch_features.reserve(feature_size * selection_indices.size());
+    } else if (features.size() != feature_size) {
+      TC3_LOG(ERROR) << "Mismatching feature size.";
+      return false;
+    }
+    batch_features.insert(batch_features.end(), features.begin(),
+                          features.end());
+    batch_span_indices.push_back(i);
+    batch_num_tokens.push_back(selection_num_tokens);
+  }
+
+  if (batch_span_indices.empty()) {
+    return true;
+  }
+
+  const int batch_size = batch_span_indices.size();
+  TensorView<float> logits = classification_executor_->ComputeLogits(
+      TensorView<float>(batch_features.data(), {batch_size, feature_size}),
+      interpreter_manager->ClassificationInterpreter());
+  if (!logits.is_valid()) {
+    TC3_LOG(ERROR) << "Couldn't compute logits.";
+    return false;
+  }
+
+  if (logits.dims() != 2 || logits.dim(0) != batch_size ||
+      logits.dim(1) != classification_feature_processor_->NumCollections()) {
+    TC3_LOG(ERROR) << "Mismatching output";
+    return false;
+  }
+
+  for (int i = 0; i < batch_size; ++i) {
+    const int span_index = batch_span_indices[i];
+    ClassificationResultsFromLogits(
+        context, detected_text_language_tags, selection_indices[span_index],
+        batch_num_tokens[i], logits.data() + i * logits.dim(1), logits.dim(1),
+        &(*classification_results)[span_index]);
+  }
+  return true;
+}
+
+bool Annotator::ExtractClassificationFeatures(
+    const std::string& context, const std::vector<Token>& cached_tokens,
+    CodepointSpan selection_indices,
+    FeatureProcessor::EmbeddingCache* embedding_cache,
+    std::vector<Token>* tokens, std::vector<float>* features,
+    int* selection_num_tokens,
+    std::vector<ClassificationResult>* classification_results) const {
+  features->clear();
+  const bool only_use_line_with_click =
+      classification_feature_processor_->GetOptions()
+          ->only_use_line_with_click();
+  const int tokenization_window_size =
+      model_->classification_options()->tokenization_window_size();
+  int click_pos;
+  if ((cached_tokens.empty() || !classification_reuses_selection_tokens_) &&
+      tokenization_window_size > 0) {
+    // Only the window around the selection is tokenized and retokenized, then
+    // the tokens are moved to the codepoints of the whole context.
+    const UnicodeText context_unicode =
+        UTF8ToUnicodeText(context, /*do_copy=*/false);
+    // The window is clamped to the context, which the selection may be past.
+    auto window_begin = context_unicode.begin();
+    int window_start = 0;
+    for (const int window_start_index =
+             selection_indices.first - tokenization_window_size;
+         window_start < window_start_index &&
+         window_begin != context_unicode.end();
+         ++window_start) {
+      ++window_begin;
+    }
+    auto window_end = window_begin;
+    const int window_end_index =
+        selection_indices.second + tokenization_window_size;
+    for (int i = window_start;
+         i < window_end_index && window_end != context_unicode.end(); ++i) {
+      ++window_end;
+    }
+    const UnicodeText window_unicode = UTF8ToUnicodeText(
+        window_begin.utf8_data(),
+        window_end.utf8_data() - window_begin.utf8_data(), /*do_copy=*/false);
+    *tokens = classification_feature_processor_->Tokenize(window_unicode);
+    classification_feature_processor_->RetokenizeAndFindClick(
+        window_unicode,
+        {selection_indices.first - window_start,
+         selection_indices.second - window_start},
+        only_use_line_with_click, tokens, &click_pos);
+    for (Token& token : *tokens) {
+      token.start += window_start;
+      token.end += window_start;
+    }
   } else {
-    *tokens = internal::CopyCachedTokens(cached_tokens, selection_indices,
-                                         ClassifyTextUpperBoundNeededTokens());
+    if (cached_tokens.empty() || !classification_reuses_selection_tokens_) {
+      *tokens = classification_feature_processor_->Tokenize(context);
+    } else {
+      *tokens = internal::CopyCachedTokens(
+          cached_tokens, selection_indices,
+          ClassifyTextUpperBoundNeededTokens());
+    }
+    classification_feature_processor_->RetokenizeAndFindClick(
+        context, selection_indices, only_use_line_with_click, tokens,
+        &click_pos);
   }
-
-  int click_pos;
-  classification_feature_processor_->RetokenizeAndFindClick(
-      context, selection_indices,
-      classification_feature_processor_->GetOptions()
-          ->only_use_line_with_click(),
-      tokens, &click_pos);
   const TokenSpan selection_token_span =
       CodepointSpanToTokenSpan(*tokens, selection_indices);
-  const int selection_num_tokens = TokenSpanSize(selection_token_span);
+  *selection_num_tokens = TokenSpanSize(selection_token_span);
   if (model_->classification_options()->max_num_tokens() > 0 &&
       model_->classification_options()->max_num_tokens() <
-          selection_num_tokens) {
+          *selection_num_tokens) {
     *classification_results = {{Collections::Other(), 1.0}};
     return true;
   }
@@ -1279,10 +2382,16 @@ bool Annotator::ModelClassifyText(
     return true;
   }
 
+  const EmbeddingExecutor* embedding_executor = GetEmbeddingExecutor();
+  if (embedding_executor == nullptr) {
+    TC3_LOG(ERROR) << "No embedding executor.";
+    return false;
+  }
+
   std::unique_ptr<CachedFeatures> cached_features;
   if (!classification_feature_processor_->ExtractFeatures(
           *tokens, extraction_span, selection_indices,
-          embedding_executor_.get(), embedding_cache,
+          embedding_executor, embedding_cache,
           classification_feature_processor_->EmbeddingSize() +
               classification_feature_processor_->DenseFeaturesCount(),
           &cached_features)) {
@@ -1290,42 +2399,37 @@ bool Annotator::ModelClassifyText(
     return false;
   }
 
-  std::vector<float> features;
-  features.reserve(cached_features->OutputFeaturesSize());
+  features->reserve(cached_features->OutputFeaturesSize());
   if (bounds_sensitive_features && bounds_sensitive_features->enabled()) {
     cached_features->AppendBoundsSensitiveFeaturesForSpan(selection_token_span,
-                                                          &features);
+                                                          features);
   } else {
-    cached_features->AppendClickContextFeaturesForClick(click_pos, &features);
-  }
-
-  TensorView<float> logits = classification_executor_->ComputeLogits(
-      TensorView<float>(features.data(),
-                        {1, static_cast<int>(features.size())}),
-      interpreter_manager->ClassificationInterpreter());
-  if (!logits.is_valid()) {
-    TC3_LOG(ERROR) << "Couldn't compute logits.";
-    return false;
+    cached_features->AppendClickContextFeaturesForClick(click_pos, features);
   }
+  return true;
+}
 
-  if (logits.dims() != 2 || logits.dim(0) != 1 ||
-      logits.dim(1) != classification_feature_processor_->NumCollections()) {
-    TC3_LOG(ERROR) << "Mismatching output";
-    return false;
-  }
-
-  const std::vector<float> scores =
-      ComputeSoftmax(logits.data(), logits.dim(1));
-
-  if (scores.empty()) {
+void Annotator::ClassificationResultsFromLogits(
+    const std::string& context,
+    const std::vector<Locale>& detected_text_language_tags,
+    CodepointSpan selection_indices, int selection_num_tokens,
+    const float* logits, int num_logits,
+    std::vector<ClassificationResult>* classification_results) const {
+  if (num_logits <= 0) {
     *classification_results = {{Collections::Other(), 1.0}};
-    return true;
+    return;
   }
 
+  // Only the probability of the best label is needed, and the softmax doesn't
+  // change the order of the labels.
   const int best_score_index =
-      std::max_element(scores.begin(), scores.end()) - scores.begin();
-  const std::string top_collection =
+      std::max_element(logits, logits + num_logits) - logits;
+  const std::string& top_collection =
       classification_feature_processor_->LabelToCollection(best_score_index);
+  const int top_collection_id =
+      best_score_index < classification_feature_processor_->NumCollections()
+          ? model_collection_ids_[best_score_index]
+          : kUnknownCollectionId;
 
   // Sanity checks.
   if (top_collection == Collections::Phone()) {
@@ -1335,25 +2439,26 @@ bool Annotator::ModelClassifyText(
         digit_count >
             model_->classification_options()->phone_max_num_digits()) {
       *classification_results = {{Collections::Other(), 1.0}};
-      return true;
+      return;
     }
   } else if (top_collection == Collections::Address()) {
     if (selection_num_tokens <
         model_->classification_options()->address_min_num_tokens()) {
       *classification_results = {{Collections::Other(), 1.0}};
-      return true;
+      return;
     }
   } else if (top_collection == Collections::Dictionary()) {
-    if (!Locale::IsAnyLocaleSupported(detected_text_language_tags,
-                                      dictionary_locales_,
-                                      /*default_value=*/false)) {
+    if (!locale_table_->IsAnyLocaleSupported(detected_text_language_tags,
+                                             dictionary_locales_,
+                                             /*default_value=*/false)) {
       *classification_results = {{Collections::Other(), 1.0}};
-      return true;
+      return;
     }
   }
 
-  *classification_results = {{top_collection, 1.0, scores[best_score_index]}};
-  return true;
+  *classification_results = {
+      {top_collection, top_collection_id, 1.0,
+       ComputeSoftmaxProbability(logits, num_logits, best_score_index)}};
 }
 
 bool Annotator::RegexClassifyText(
@@ -1365,30 +2470,42 @@ bool Annotator::RegexClassifyText(
   const UnicodeText selection_text_unicode(
       UTF8ToUnicodeText(selection_text, /*do_copy=*/false));
 
+  // Skip the patterns that can't match without creating a matcher for them.
+  std::vector<bool> found_literals;
+  regex_literals_.FindAll(selection_text, &found_literals);
+  const DigitRunMap digit_runs(selection_text);
+
   // Check whether any of the regular expressions match.
   for (const int pattern_id : classification_regex_patterns_) {
     const CompiledRegexPattern& regex_pattern = regex_patterns_[pattern_id];
+    if (!regex_pattern.MayMatch(selection_text, found_literals, digit_runs)) {
+      continue;
+    }
+    RegexStats::Run stats_run(regex_stats_.get(), pattern_id,
+                              selection_text.size());
     const std::unique_ptr<UniLib::RegexMatcher> matcher =
         regex_pattern.pattern->Matcher(selection_text_unicode);
     int status = UniLib::RegexMatcher::kNoError;
     bool matches;
     if (regex_pattern.config->use_approximate_matching()) {
-      matches = matcher->ApproximatelyMatches(&status);
+      matches = stats_run.CountFind(matcher->ApproximatelyMatches(&status));
     } else {
-      matches = matcher->Matches(&status);
+      matches = stats_run.CountFind(matcher->Matches(&status));
     }
     if (status != UniLib::RegexMatcher::kNoError) {
       return false;
     }
-    if (matches && VerifyRegexMatchCandidate(
-                       context, regex_pattern.config->verification_options(),
-                       selection_text, matcher.get())) {
+    if (matches &&
+        VerifyRegexMatchCandidate(
+            pattern_id, context, regex_pattern.config->verification_options(),
+            selection_text, matcher.get(), /*verified_matches=*/nullptr)) {
       classification_result->push_back(
-          {regex_pattern.config->collection_name()->str(),
+          {collection_ids_.Name(regex_pattern.collection_id),
+           regex_pattern.collection_id,
            regex_pattern.config->target_classification_score(),
            regex_pattern.config->priority_score()});
       if (!SerializedEntityDataFromRegexMatch(
-              regex_pattern.config, matcher.get(),
+              regex_pattern, matcher.get(),
               &classification_result->back().serialized_entity_data)) {
         TC3_LOG(ERROR) << "Could not get entity data.";
         return false;
@@ -1432,7 +2549,8 @@ bool Annotator::DatetimeClassifyText(
     const std::string& context, CodepointSpan selection_indices,
     const ClassificationOptions& options,
     std::vector<ClassificationResult>* classification_results) const {
-  if (!datetime_parser_) {
+  const DatetimeParser* datetime_parser = GetDatetimeParser();
+  if (!datetime_parser) {
     return false;
   }
 
@@ -1441,11 +2559,11 @@ bool Annotator::DatetimeClassifyText(
           .UTF8Substring(selection_indices.first, selection_indices.second);
 
   std::vector<DatetimeParseResultSpan> datetime_spans;
-  if (!datetime_parser_->Parse(selection_text, options.reference_time_ms_utc,
-                               options.reference_timezone, options.locales,
-                               ModeFlag_CLASSIFICATION,
-                               options.annotation_usecase,
-                               /*anchor_start_end=*/true, &datetime_spans)) {
+  if (!datetime_parser->ParseUnresolved(
+          UTF8ToUnicodeText(selection_text, /*do_copy=*/false),
+          options.locales, ModeFlag_CLASSIFICATION,
+          options.annotation_usecase,
+          /*anchor_start_end=*/true, &datetime_spans)) {
     TC3_LOG(ERROR) << "Error during parsing datetime.";
     return false;
   }
@@ -1460,8 +2578,6 @@ bool Annotator::DatetimeClassifyText(
             PickCollectionForDatetime(parse_result),
             datetime_span.target_classification_score);
         classification_results->back().datetime_parse_result = parse_result;
-        classification_results->back().serialized_entity_data =
-            CreateDatetimeSerializedEntityData(parse_result);
         classification_results->back().priority_score =
             datetime_span.priority_score;
       }
@@ -1474,6 +2590,31 @@ bool Annotator::DatetimeClassifyText(
 std::vector<ClassificationResult> Annotator::ClassifyText(
     const std::string& context, CodepointSpan selection_indices,
     const ClassificationOptions& options) const {
+  return ClassifyText(context, selection_indices, options,
+                      /*is_partial=*/nullptr);
+}
+
+std::vector<ClassificationResult> Annotator::ClassifyText(
+    const std::string& context, CodepointSpan selection_indices,
+    const ClassificationOptions& options, bool* is_partial) const {
+  InterpreterManager interpreter_manager(
+      selection_executor_.get(), classification_executor_.get(),
+      selection_interpreter_pool_.get(),
+      classification_interpreter_pool_.get());
+  return ClassifyText(context, selection_indices, options,
+                      /*cached_tokens=*/{}, &interpreter_manager, is_partial);
+}
+
+std::vector<ClassificationResult> Annotator::ClassifyText(
+    const std::string& context, CodepointSpan selection_indices,
+    const ClassificationOptions& options,
+    const std::vector<Token>& cached_tokens,
+    InterpreterManager* interpreter_manager, bool* is_partial) const {
+  TC3_TRACE_SCOPE("Annotator::ClassifyText");
+  ScopedScratchArena scratch_arena;
+  if (is_partial != nullptr) {
+    *is_partial = false;
+  }
   if (!initialized_) {
     TC3_LOG(ERROR) << "Not initialized";
     return {};
@@ -1484,15 +2625,15 @@ std::vector<ClassificationResult> Annotator::ClassifyText(
   }
 
   std::vector<Locale> detected_text_language_tags;
-  if (!ParseLocales(options.detected_text_language_tags,
-                    &detected_text_language_tags)) {
+  if (!LocaleListCache::Default()->Parse(options.detected_text_language_tags,
+                                         &detected_text_language_tags)) {
     TC3_LOG(WARNING)
         << "Failed to parse the detected_text_language_tags in options: "
         << options.detected_text_language_tags;
   }
-  if (!Locale::IsAnyLocaleSupported(detected_text_language_tags,
-                                    model_triggering_locales_,
-                                    /*default_value=*/true)) {
+  if (!locale_table_->IsAnyLocaleSupported(detected_text_language_tags,
+                                           model_triggering_locales_,
+                                           /*default_value=*/true)) {
     return {};
   }
 
@@ -1507,8 +2648,26 @@ std::vector<ClassificationResult> Annotator::ClassifyText(
     return {};
   }
 
+  std::string cache_key;
+  std::vector<ClassificationResult> results;
+  if (classification_result_cache_.enabled()) {
+    cache_key =
+        ClassificationResultCacheKey(context, selection_indices, options);
+    if (classification_result_cache_.Lookup(cache_key, &results)) {
+      if (!ResolveDatetimeClassifications(
+              options.reference_time_ms_utc, options.reference_timezone,
+              options.locales, /*is_serialized_entity_data_enabled=*/true,
+              &results)) {
+        TC3_LOG(ERROR) << "Couldn't resolve datetimes.";
+        return {};
+      }
+      return results;
+    }
+  }
+
   // We'll accumulate a list of candidates, and pick the best candidate in the
-  // end.
+  // end. Once the call has to stop, the remaining classifiers are skipped.
+  const StopCondition stop(options.cancellation_token, options.timeout_ms);
   std::vector<AnnotatedSpan> candidates;
 
   // Try the knowledge engine.
@@ -1539,13 +2698,18 @@ std::vector<ClassificationResult> Annotator::ClassifyText(
 
   // Try the regular expression models.
   std::vector<ClassificationResult> regex_results;
-  if (!RegexClassifyText(context, selection_indices, &regex_results)) {
+  if (!stop.ShouldStop() &&
+      !RegexClassifyText(context, selection_indices, &regex_results)) {
     return {};
   }
   for (const ClassificationResult& result : regex_results) {
     candidates.push_back({selection_indices, {result}});
   }
 
+  // A regex result that outranks anything the remaining sources can return is
+  // chosen over them, so they are skipped.
+  const bool decided_by_rules = IsClassificationDecidedByRules(regex_results);
+
   // Try the date model.
   //
   // DatetimeClassifyText only returns the first result, which can however have
@@ -1553,7 +2717,8 @@ std::vector<ClassificationResult> Annotator::ClassifyText(
   // AnnotatedSpan, so that they get treated together by the conflict resolution
   // algorithm.
   std::vector<ClassificationResult> datetime_results;
-  if (!DatetimeClassifyText(context, selection_indices, options,
+  if (!decided_by_rules && !stop.ShouldStop() &&
+      !DatetimeClassifyText(context, selection_indices, options,
                             &datetime_results)) {
     return {};
   }
@@ -1565,7 +2730,7 @@ std::vector<ClassificationResult> Annotator::ClassifyText(
   // Try the number annotator.
   // TODO(b/126579108): Propagate error status.
   ClassificationResult number_annotator_result;
-  if (number_annotator_ &&
+  if (number_annotator_ && !decided_by_rules && !stop.ShouldStop() &&
       number_annotator_->ClassifyText(
           UTF8ToUnicodeText(context, /*do_copy=*/false), selection_indices,
           options.annotation_usecase, &number_annotator_result)) {
@@ -1574,7 +2739,7 @@ std::vector<ClassificationResult> Annotator::ClassifyText(
 
   // Try the duration annotator.
   ClassificationResult duration_annotator_result;
-  if (duration_annotator_ &&
+  if (duration_annotator_ && !decided_by_rules && !stop.ShouldStop() &&
       duration_annotator_->ClassifyText(
           UTF8ToUnicodeText(context, /*do_copy=*/false), selection_indices,
           options.annotation_usecase, &duration_annotator_result)) {
@@ -1587,14 +2752,13 @@ std::vector<ClassificationResult> Annotator::ClassifyText(
   // The output of the model is considered as an exclusive 1-of-N choice. That's
   // why it's inserted as only 1 AnnotatedSpan into candidates, as opposed to 1
   // span for each candidate, like e.g. the regex model.
-  InterpreterManager interpreter_manager(selection_executor_.get(),
-                                         classification_executor_.get());
   std::vector<ClassificationResult> model_results;
   std::vector<Token> tokens;
-  if (!ModelClassifyText(
-          context, /*cached_tokens=*/{}, detected_text_language_tags,
-          selection_indices, &interpreter_manager,
-          /*embedding_cache=*/nullptr, &model_results, &tokens)) {
+  if (!decided_by_rules && !stop.ShouldStop() &&
+      !ModelClassifyText(context, cached_tokens, detected_text_language_tags,
+                         selection_indices, interpreter_manager,
+                         /*embedding_cache=*/nullptr, &model_results,
+                         &tokens)) {
     return {};
   }
   if (!model_results.empty()) {
@@ -1602,14 +2766,14 @@ std::vector<ClassificationResult> Annotator::ClassifyText(
   }
 
   std::vector<int> candidate_indices;
-  if (!ResolveConflicts(candidates, context, tokens,
+  if (!ResolveConflicts(candidates, context,
+                        tokens.empty() ? cached_tokens : tokens,
                         detected_text_language_tags, options.annotation_usecase,
-                        &interpreter_manager, &candidate_indices)) {
+                        interpreter_manager, &candidate_indices, &stop)) {
     TC3_LOG(ERROR) << "Couldn't resolve conflicts.";
     return {};
   }
 
-  std::vector<ClassificationResult> results;
   for (const int i : candidate_indices) {
     for (const ClassificationResult& result : candidates[i].classification) {
       if (!FilteredForClassification(result)) {
@@ -1627,32 +2791,53 @@ std::vector<ClassificationResult> Annotator::ClassifyText(
   if (results.empty()) {
     results = {{Collections::Other(), 1.0}};
   }
+
+  if (classification_result_cache_.enabled() && !stop.stopped()) {
+    classification_result_cache_.Insert(cache_key, results);
+  }
+
+  // Only the datetimes that were picked are resolved to an absolute time.
+  if (!ResolveDatetimeClassifications(
+          options.reference_time_ms_utc, options.reference_timezone,
+          options.locales, /*is_serialized_entity_data_enabled=*/true,
+          &results)) {
+    TC3_LOG(ERROR) << "Couldn't resolve datetimes.";
+    return {};
+  }
+  if (is_partial != nullptr) {
+    *is_partial = stop.stopped();
+  }
   return results;
 }
 
 bool Annotator::ModelAnnotate(
     const std::string& context,
     const std::vector<Locale>& detected_text_language_tags,
+    const std::vector<LanguageRegion>& language_regions,
     InterpreterManager* interpreter_manager, std::vector<Token>* tokens,
-    std::vector<AnnotatedSpan>* result) const {
+    std::vector<AnnotatedSpan>* result, const StopCondition* stop,
+    AnnotatorPhaseTimes* phase_times) const {
+  TC3_TRACE_SCOPE("Annotator::ModelAnnotate");
   if (model_->triggering_options() == nullptr ||
       !(model_->triggering_options()->enabled_modes() & ModeFlag_ANNOTATION)) {
     return true;
   }
 
-  if (!Locale::IsAnyLocaleSupported(detected_text_language_tags,
-                                    ml_model_triggering_locales_,
-                                    /*default_value=*/true)) {
+  if (!locale_table_->IsAnyLocaleSupported(detected_text_language_tags,
+                                           ml_model_triggering_locales_,
+                                           /*default_value=*/true)) {
     return true;
   }
 
   const UnicodeText context_unicode = UTF8ToUnicodeText(context,
                                                         /*do_copy=*/false);
-  std::vector<UnicodeTextRange> lines;
+  std::vector<ContextLine> lines;
   if (!selection_feature_processor_->GetOptions()->only_use_line_with_click()) {
-    lines.push_back({context_unicode.begin(), context_unicode.end()});
+    lines.push_back({StringPiece(context), /*offset=*/0,
+                     context_unicode.size_codepoints()});
   } else {
-    lines = selection_feature_processor_->SplitContext(context_unicode);
+    lines =
+        selection_feature_processor_->SplitContextIntoLines(context_unicode);
   }
 
   const float min_annotate_confidence =
@@ -1660,210 +2845,826 @@ bool Annotator::ModelAnnotate(
            ? model_->triggering_options()->min_annotate_confidence()
            : 0.f);
 
-  for (const UnicodeTextRange& line : lines) {
-    FeatureProcessor::EmbeddingCache embedding_cache;
-    const std::string line_str =
-        UnicodeText::UTF8Substring(line.first, line.second);
+  // Either all the lines are processed together, so that the selection model
+  // inference can be batched across them, or one line at a time.
+  const int lines_per_group =
+      model_->selection_options()->batch_lines_in_annotation()
+          ? std::max(1, static_cast<int>(lines.size()))
+          : 1;
+  const bool batch_classification =
+      model_->classification_options()->batch_chunks_in_annotation();
+
+  const EmbeddingExecutor* embedding_executor = GetEmbeddingExecutor();
+  if (embedding_executor == nullptr) {
+    TC3_LOG(ERROR) << "No embedding executor.";
+    return false;
+  }
 
-    *tokens = selection_feature_processor_->Tokenize(line_str);
-    selection_feature_processor_->RetokenizeAndFindClick(
-        line_str, {0, std::distance(line.first, line.second)},
-        selection_feature_processor_->GetOptions()->only_use_line_with_click(),
-        tokens,
-        /*click_pos=*/nullptr);
-    const TokenSpan full_line_span = {0, tokens->size()};
+  // Returns the locales of the language region that contains the whole line,
+  // or all the detected languages if there is none.
+  auto line_language_tags =
+      [&language_regions, &detected_text_language_tags](
+          const ContextLine& line) -> const std::vector<Locale>& {
+    auto region = std::upper_bound(
+        language_regions.begin(), language_regions.end(), line.offset,
+        [](int offset, const LanguageRegion& region) {
+          return offset < region.span.first;
+        });
+    if (region != language_regions.begin() &&
+        line.offset + line.size_codepoints <= (region - 1)->span.second) {
+      return (region - 1)->locales;
+    }
+    return detected_text_language_tags;
+  };
+
+  for (int group_start = 0; group_start < lines.size() && !ShouldStop(stop);
+       group_start += lines_per_group) {
+    const int group_end = std::min(group_start + lines_per_group,
+                                   static_cast<int>(lines.size()));
+
+    // Tokenize the lines and extract their selection features.
+    bool last_line_skipped = false;
+    std::vector<AnnotatedLine> group_lines;
+    group_lines.reserve(group_end - group_start);
+    for (int i = group_start; i < group_end && !ShouldStop(stop); ++i) {
+      const ContextLine& line = lines[i];
+      const UnicodeText line_unicode = UTF8ToUnicodeText(
+          line.utf8.data(), line.utf8.size(), /*do_copy=*/false);
+      AnnotatedLine annotated_line;
+      annotated_line.line_str = line.utf8;
+      annotated_line.offset = line.offset;
+      annotated_line.detected_text_language_tags = &line_language_tags(line);
+
+      {
+        ScopedPhaseTimer timer(phase_times,
+                               &AnnotatorPhaseTimes::tokenization_us);
+        selection_feature_processor_->Tokenize(
+            line_unicode, /*codepoint_offset=*/0, &annotated_line.tokens);
+        selection_feature_processor_->RetokenizeAndFindClick(
+            line_unicode, {0, line.size_codepoints},
+            selection_feature_processor_->GetOptions()
+                ->only_use_line_with_click(),
+            &annotated_line.tokens,
+            /*click_pos=*/nullptr);
+      }
+      const TokenSpan full_line_span = {0, annotated_line.tokens.size()};
+
+      // TODO(zilka): Add support for greater granularity of this check.
+      if (!selection_feature_processor_->HasEnoughSupportedCodepoints(
+              annotated_line.tokens, full_line_span) ||
+          !locale_table_->IsAnyLocaleSupported(
+              *annotated_line.detected_text_language_tags,
+              ml_model_triggering_locales_,
+              /*default_value=*/true)) {
+        *tokens = std::move(annotated_line.tokens);
+        last_line_skipped = true;
+        continue;
+      }
 
-    // TODO(zilka): Add support for greater granularity of this check.
-    if (!selection_feature_processor_->HasEnoughSupportedCodepoints(
-            *tokens, full_line_span)) {
+      ScopedPhaseTimer timer(phase_times,
+                             &AnnotatorPhaseTimes::feature_extraction_us);
+      if (!selection_feature_processor_->ExtractFeatures(
+              annotated_line.tokens, full_line_span,
+              /*selection_span_for_feature=*/{kInvalidIndex, kInvalidIndex},
+              embedding_executor,
+              /*embedding_cache=*/nullptr,
+              selection_feature_processor_->EmbeddingSize() +
+                  selection_feature_processor_->DenseFeaturesCount(),
+              &annotated_line.cached_features)) {
+        TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Could not extract features.";
+        return false;
+      }
+      group_lines.push_back(std::move(annotated_line));
+      last_line_skipped = false;
+    }
+    if (group_lines.empty()) {
       continue;
     }
 
-    std::unique_ptr<CachedFeatures> cached_features;
-    if (!selection_feature_processor_->ExtractFeatures(
-            *tokens, full_line_span,
-            /*selection_span_for_feature=*/{kInvalidIndex, kInvalidIndex},
-            embedding_executor_.get(),
-            /*embedding_cache=*/nullptr,
-            selection_feature_processor_->EmbeddingSize() +
-                selection_feature_processor_->DenseFeaturesCount(),
-            &cached_features)) {
-      TC3_LOG(ERROR) << "Could not extract features.";
+    // Chunk all the lines of the group together.
+    std::vector<ChunkInput> chunk_inputs;
+    chunk_inputs.reserve(group_lines.size());
+    for (const AnnotatedLine& line : group_lines) {
+      chunk_inputs.push_back(
+          ChunkInput{static_cast<int>(line.tokens.size()),
+                     /*span_of_interest=*/{0, line.tokens.size()},
+                     line.cached_features.get(), &line.tokens});
+    }
+    std::vector<std::vector<TokenSpan>> chunks_per_line;
+    {
+      ScopedPhaseTimer timer(phase_times,
+                             &AnnotatorPhaseTimes::selection_inference_us);
+      if (!ModelChunk(chunk_inputs, interpreter_manager->SelectionInterpreter(),
+                      &chunks_per_line)) {
+        TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Could not chunk.";
+        return false;
+      }
+    }
+
+    for (int line_index = 0;
+         line_index < group_lines.size() && !ShouldStop(stop); ++line_index) {
+      const AnnotatedLine& line = group_lines[line_index];
+      const UnicodeText line_unicode = UTF8ToUnicodeText(
+          line.line_str.data(), line.line_str.size(), /*do_copy=*/false);
+      const CodepointOffsetIndex line_offsets(line_unicode);
+      std::vector<CodepointSpan> codepoint_spans;
+      for (const TokenSpan& chunk : chunks_per_line[line_index]) {
+        const CodepointSpan codepoint_span =
+            selection_feature_processor_->StripBoundaryCodepoints(
+                line_offsets, TokenSpanToCodepointSpan(line.tokens, chunk));
+
+        // Skip empty spans.
+        if (codepoint_span.first != codepoint_span.second) {
+          codepoint_spans.push_back(codepoint_span);
+        }
+      }
+      if (codepoint_spans.empty()) {
+        continue;
+      }
+
+      // The classification needs the line as a string of its own, unless the
+      // line is the whole context.
+      std::string line_copy;
+      if (line.line_str.size() != context.size()) {
+        line_copy = line.line_str.ToString();
+      }
+      const std::string& line_str =
+          line.line_str.size() != context.size() ? line_copy : context;
+
+      FeatureProcessor::EmbeddingCache embedding_cache;
+
+      std::vector<std::vector<ClassificationResult>> classifications;
+      ScopedPhaseTimer classification_timer(
+          phase_times, &AnnotatorPhaseTimes::classification_inference_us);
+      if (batch_classification) {
+        if (!ModelClassifyTexts(line_str, line.tokens,
+                                *line.detected_text_language_tags,
+                                codepoint_spans, interpreter_manager,
+                                &embedding_cache, &classifications)) {
+          TC3_LOG_EVERY_N_SEC(ERROR, 10)
+              << "Could not classify text in line at offset: " << line.offset;
+          return false;
+        }
+      } else {
+        classifications.resize(codepoint_spans.size());
+        for (int i = 0; i < codepoint_spans.size(); ++i) {
+          if (!ModelClassifyText(line_str, line.tokens,
+                                 *line.detected_text_language_tags,
+                                 codepoint_spans[i], interpreter_manager,
+                                 &embedding_cache, &classifications[i])) {
+            TC3_LOG_EVERY_N_SEC(ERROR, 10)
+                << "Could not classify text: "
+                << (codepoint_spans[i].first + line.offset) << " "
+                << (codepoint_spans[i].second + line.offset);
+            return false;
+          }
+        }
+      }
+
+      for (int i = 0; i < codepoint_spans.size(); ++i) {
+        std::vector<ClassificationResult>& classification = classifications[i];
+
+        // Do not include the span if it's classified as "other".
+        if (!classification.empty() && !ClassifiedAsOther(classification) &&
+            classification[0].score >= min_annotate_confidence) {
+          AnnotatedSpan result_span;
+          result_span.span = {codepoint_spans[i].first + line.offset,
+                              codepoint_spans[i].second + line.offset};
+          result_span.classification = std::move(classification);
+          result->push_back(std::move(result_span));
+        }
+      }
+    }
+
+    // Provide the tokens of the last line to the caller.
+    if (!last_line_skipped && !group_lines.empty()) {
+      *tokens = std::move(group_lines.back().tokens);
+    }
+  }
+  return true;
+}
+
+const FeatureProcessor* Annotator::SelectionFeatureProcessorForTests() const {
+  return selection_feature_processor_.get();
+}
+
+const FeatureProcessor* Annotator::ClassificationFeatureProcessorForTests()
+    const {
+  return classification_feature_processor_.get();
+}
+
+const DatetimeParser* Annotator::DatetimeParserForTests() const {
+  return GetDatetimeParser();
+}
+
+void Annotator::RemoveNotEnabledEntityTypes(
+    const EnabledEntityTypes& is_entity_type_enabled,
+    std::vector<AnnotatedSpan>* annotated_spans) const {
+  for (AnnotatedSpan& annotated_span : *annotated_spans) {
+    std::vector<ClassificationResult>& classifications =
+        annotated_span.classification;
+    classifications.erase(
+        std::remove_if(classifications.begin(), classifications.end(),
+                       [&is_entity_type_enabled](
+                           const ClassificationResult& classification_result) {
+                         return !is_entity_type_enabled(
+                             classification_result);
+                       }),
+        classifications.end());
+  }
+  annotated_spans->erase(
+      std::remove_if(annotated_spans->begin(), annotated_spans->end(),
+                     [](const AnnotatedSpan& annotated_span) {
+                       return annotated_span.classification.empty();
+                     }),
+      annotated_spans->end());
+}
+
+std::vector<AnnotatedSpan> Annotator::Annotate(
+    const std::string& context, const AnnotationOptions& options) const {
+  return Annotate(context, options, /*is_partial=*/nullptr);
+}
+
+std::vector<AnnotatedSpan> Annotator::Annotate(
+    const std::string& context, const AnnotationOptions& options,
+    bool* is_partial) const {
+  TC3_TRACE_SCOPE("Annotator::Annotate");
+  ScopedScratchArena scratch_arena;
+  if (is_partial != nullptr) {
+    *is_partial = false;
+  }
+  if (options.annotation_tiers != nullptr) {
+    *options.annotation_tiers = ANNOTATION_TIER_ALL;
+  }
+  if (!(model_->enabled_modes() & ModeFlag_ANNOTATION)) {
+    return {};
+  }
+
+  std::vector<Locale> detected_text_language_tags;
+  if (!LocaleListCache::Default()->Parse(options.detected_text_language_tags,
+                                         &detected_text_language_tags)) {
+    TC3_LOG(WARNING)
+        << "Failed to parse the detected_text_language_tags in options: "
+        << options.detected_text_language_tags;
+  }
+  if (!locale_table_->IsAnyLocaleSupported(detected_text_language_tags,
+                                           model_triggering_locales_,
+                                           /*default_value=*/true)) {
+    return {};
+  }
+
+  InterpreterManager interpreter_manager(
+      selection_executor_.get(), classification_executor_.get(),
+      selection_interpreter_pool_.get(),
+      classification_interpreter_pool_.get());
+
+  const StopCondition stop(options.cancellation_token, options.timeout_ms);
+  std::vector<AnnotatedSpan> result;
+  if (!AnnotateSingleInput(context, options, detected_text_language_tags,
+                           &interpreter_manager, &stop, &result)) {
+    return {};
+  }
+  if (is_partial != nullptr) {
+    *is_partial = stop.stopped();
+  }
+  return result;
+}
+
+std::vector<std::vector<AnnotatedSpan>> Annotator::AnnotateBatch(
+    const std::vector<std::string>& contexts,
+    const AnnotationOptions& options) const {
+  std::vector<std::vector<AnnotatedSpan>> results(contexts.size());
+  if (options.annotation_tiers != nullptr) {
+    *options.annotation_tiers = ANNOTATION_TIER_ALL;
+  }
+  if (!(model_->enabled_modes() & ModeFlag_ANNOTATION)) {
+    return results;
+  }
+
+  // The options are shared by all the inputs, so the locales only need to be
+  // parsed and checked once.
+  std::vector<Locale> detected_text_language_tags;
+  if (!LocaleListCache::Default()->Parse(options.detected_text_language_tags,
+                                         &detected_text_language_tags)) {
+    TC3_LOG(WARNING)
+        << "Failed to parse the detected_text_language_tags in options: "
+        << options.detected_text_language_tags;
+  }
+  if (!locale_table_->IsAnyLocaleSupported(detected_text_language_tags,
+                                           model_triggering_locales_,
+                                           /*default_value=*/true)) {
+    return results;
+  }
+
+  // One set of interpreters serves the whole batch.
+  InterpreterManager interpreter_manager(
+      selection_executor_.get(), classification_executor_.get(),
+      selection_interpreter_pool_.get(),
+      classification_interpreter_pool_.get());
+
+  const StopCondition stop(options.cancellation_token, options.timeout_ms);
+  for (int i = 0; i < contexts.size() && !stop.ShouldStop(); ++i) {
+    if (!AnnotateSingleInput(contexts[i], options, detected_text_language_tags,
+                             &interpreter_manager, &stop, &results[i])) {
+      results[i].clear();
+    }
+  }
+  return results;
+}
+
+std::vector<std::vector<AnnotatedSpan>> Annotator::AnnotateBatch(
+    const std::vector<std::string>& contexts,
+    const std::vector<AnnotationOptions>& options, int* num_complete) const {
+  TC3_TRACE_SCOPE("Annotator::AnnotateBatch");
+  ScopedScratchArena scratch_arena;
+  std::vector<std::vector<AnnotatedSpan>> results(contexts.size());
+  *num_complete = contexts.size();
+  for (const AnnotationOptions& input_options : options) {
+    if (input_options.annotation_tiers != nullptr) {
+      *input_options.annotation_tiers = ANNOTATION_TIER_ALL;
+    }
+  }
+  if (contexts.empty() || !(model_->enabled_modes() & ModeFlag_ANNOTATION)) {
+    return results;
+  }
+
+  InterpreterManager interpreter_manager(
+      selection_executor_.get(), classification_executor_.get(),
+      selection_interpreter_pool_.get(),
+      classification_interpreter_pool_.get());
+
+  // The locales are only parsed again when they change from one input to the
+  // next, which they rarely do in a conversation.
+  const std::string* parsed_language_tags = nullptr;
+  std::vector<Locale> detected_text_language_tags;
+  bool is_locale_supported = false;
+
+  const StopCondition stop(options[0].cancellation_token,
+                           options[0].timeout_ms);
+  *num_complete = 0;
+  for (int i = 0; i < contexts.size() && !stop.ShouldStop(); ++i) {
+    if (parsed_language_tags == nullptr ||
+        *parsed_language_tags != options[i].detected_text_language_tags) {
+      parsed_language_tags = &options[i].detected_text_language_tags;
+      detected_text_language_tags.clear();
+      if (!LocaleListCache::Default()->Parse(*parsed_language_tags,
+                                             &detected_text_language_tags)) {
+        TC3_LOG(WARNING)
+            << "Failed to parse the detected_text_language_tags in options: "
+            << *parsed_language_tags;
+      }
+      is_locale_supported = locale_table_->IsAnyLocaleSupported(
+          detected_text_language_tags, model_triggering_locales_,
+          /*default_value=*/true);
+    }
+    if (is_locale_supported &&
+        !AnnotateSingleInput(contexts[i], options[i],
+                             detected_text_language_tags, &interpreter_manager,
+                             &stop, &results[i])) {
+      results[i].clear();
+    }
+    if (!stop.stopped()) {
+      *num_complete = i + 1;
+    }
+  }
+  return results;
+}
+
+bool Annotator::AnnotationSources::IsEmpty() const {
+  return regex_rules.empty() && !model && !datetime && !knowledge && !number;
+}
+
+bool Annotator::AnnotationCandidates::HasEnabled(
+    const EnabledEntityTypes& is_entity_type_enabled) const {
+  for (const std::vector<AnnotatedSpan>* source :
+       {&model, &regex, &datetime, &knowledge, &contact, &installed_app,
+        &number, &duration}) {
+    for (const AnnotatedSpan& candidate : *source) {
+      for (const ClassificationResult& classification :
+           candidate.classification) {
+        if (is_entity_type_enabled(classification)) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+void Annotator::PlanAnnotationSources(
+    const EnabledEntityTypes& is_entity_type_enabled,
+    AnnotationSources* producing, AnnotationSources* remaining) const {
+  *producing = AnnotationSources();
+  *remaining = AnnotationSources();
+  if (is_entity_type_enabled.AllEnabled()) {
+    producing->regex_rules = annotation_regex_patterns_;
+    producing->model = true;
+    producing->datetime = true;
+    producing->knowledge = true;
+    producing->number = true;
+    return;
+  }
+
+  bool all_rules_producing = true;
+  for (const int pattern_id : annotation_regex_patterns_) {
+    if (is_entity_type_enabled(regex_patterns_[pattern_id].collection_id)) {
+      producing->regex_rules.push_back(pattern_id);
+    } else {
+      all_rules_producing = false;
+    }
+  }
+  if (!all_rules_producing) {
+    // The regex rules are then re-run all together, which keeps their
+    // candidates in the same order as when running them in one go.
+    remaining->regex_rules = annotation_regex_patterns_;
+  }
+
+  bool model_producing =
+      (contact_engine_ != nullptr &&
+       is_entity_type_enabled(Collections::Contact())) ||
+      (installed_app_engine_ != nullptr &&
+       is_entity_type_enabled(Collections::App())) ||
+      (duration_annotator_ != nullptr &&
+       is_entity_type_enabled(Collections::Duration()));
+  for (const int collection_id : model_collection_ids_) {
+    if (is_entity_type_enabled(collection_id)) {
+      model_producing = true;
+      break;
+    }
+  }
+  (model_producing ? producing : remaining)->model = true;
+
+  // Datetimes are only ever produced when enabled.
+  producing->datetime = true;
+
+  // The knowledge engine can produce any entity type.
+  producing->knowledge = true;
+
+  (is_entity_type_enabled(Collections::Number()) ? producing : remaining)
+      ->number = true;
+}
+
+void Annotator::DetectLanguageRegions(
+    const UnicodeText& context_unicode, std::vector<LanguageRegion>* regions,
+    std::vector<Locale>* detected_text_language_tags) const {
+  regions->clear();
+  if (lang_id_ == nullptr || selection_feature_processor_ == nullptr) {
+    return;
+  }
+
+  // Start a region at every line in a new language; the first region starts
+  // at the beginning of the context.
+  for (const ContextLine& line :
+       selection_feature_processor_->SplitContextIntoLines(context_unicode)) {
+    const std::string language =
+        lang_id_->FindLanguage(line.utf8.data(), line.utf8.size());
+    if (language == mobile::lang_id::LangId::kUnknownLanguageCode ||
+        (!regions->empty() && regions->back().language_tag == language)) {
+      continue;
+    }
+    LanguageRegion region;
+    if (regions->empty()) {
+      region.utf8 = StringPiece(context_unicode.data(), 0);
+      region.span.first = 0;
+    } else {
+      region.utf8 = StringPiece(line.utf8.data(), 0);
+      region.span.first = line.offset;
+    }
+    region.language_tag = language;
+    region.locales.push_back(Locale::FromBCP47(language));
+    regions->push_back(std::move(region));
+  }
+
+  // Every region ends where the next one starts, the last one at the end of
+  // the context.
+  const char* context_end =
+      context_unicode.data() + context_unicode.size_bytes();
+  for (int i = regions->size() - 1; i >= 0; --i) {
+    LanguageRegion& region = (*regions)[i];
+    const bool is_last = (i == regions->size() - 1);
+    const char* end = is_last ? context_end : (*regions)[i + 1].utf8.data();
+    region.utf8 = StringPiece(region.utf8.data(), end - region.utf8.data());
+    region.span.second = is_last ? context_unicode.size_codepoints()
+                                 : (*regions)[i + 1].span.first;
+  }
+
+  for (int i = 0; i < regions->size(); ++i) {
+    bool is_new_language = true;
+    for (int j = 0; j < i; ++j) {
+      if ((*regions)[j].language_tag == (*regions)[i].language_tag) {
+        is_new_language = false;
+        break;
+      }
+    }
+    if (is_new_language) {
+      detected_text_language_tags->push_back((*regions)[i].locales[0]);
+    }
+  }
+}
+
+bool Annotator::DatetimeChunkLanguageRegions(
+    const UnicodeText& context_unicode, const std::string& locales,
+    const std::vector<LanguageRegion>& language_regions,
+    AnnotationUsecase annotation_usecase, const StopCondition* stop,
+    std::vector<AnnotatedSpan>* result) const {
+  if (language_regions.empty()) {
+    return DatetimeChunk(context_unicode, locales, ModeFlag_ANNOTATION,
+                         annotation_usecase, result, stop);
+  }
+  for (const LanguageRegion& region : language_regions) {
+    const std::string region_locales =
+        locales.empty() ? region.language_tag
+                        : locales + "," + region.language_tag;
+    if (language_regions.size() == 1) {
+      // The region is the whole context.
+      return DatetimeChunk(context_unicode, region_locales,
+                           ModeFlag_ANNOTATION, annotation_usecase, result,
+                           stop);
+    }
+    const int region_start = result->size();
+    if (!DatetimeChunk(UTF8ToUnicodeText(region.utf8.data(),
+                                         region.utf8.size(),
+                                         /*do_copy=*/false),
+                       region_locales, ModeFlag_ANNOTATION,
+                       annotation_usecase, result, stop)) {
       return false;
     }
+    for (int i = region_start; i < result->size(); ++i) {
+      (*result)[i].span.first += region.span.first;
+      (*result)[i].span.second += region.span.first;
+    }
+  }
+  return true;
+}
 
-    std::vector<TokenSpan> local_chunks;
-    if (!ModelChunk(tokens->size(), /*span_of_interest=*/full_line_span,
-                    interpreter_manager->SelectionInterpreter(),
-                    *cached_features, &local_chunks)) {
-      TC3_LOG(ERROR) << "Could not chunk.";
+bool Annotator::RunAnnotationSources(
+    const std::string& context, const UnicodeText& context_unicode,
+    const AnnotationOptions& options,
+    const EnabledEntityTypes& is_entity_type_enabled,
+    const std::vector<Locale>& detected_text_language_tags,
+    const std::vector<LanguageRegion>& language_regions,
+    const AnnotationSources& sources, InterpreterManager* interpreter_manager,
+    const StopCondition* stop, AnnotationCandidates* candidates) const {
+  // The regex, datetime, knowledge and number sources don't depend on the
+  // rest, so they are run on the thread pool (if any) while the ML model and
+  // the sources that need its tokens run on this thread. Each source is
+  // skipped once the call has to stop.
+  SharedTask regex_task([this, &context, &options, &sources, stop,
+                         candidates]() {
+    ScopedPhaseTimer timer(options.phase_times, &AnnotatorPhaseTimes::regex_us);
+    // Annotate with the regular expression models.
+    const EntityDataMode entity_data_mode =
+        !options.is_serialized_entity_data_enabled
+            ? EntityDataMode::kNone
+            : (options.defer_serialized_entity_data
+                   ? EntityDataMode::kDeferred
+                   : EntityDataMode::kSerialized);
+    if (!sources.regex_rules.empty() && !ShouldStop(stop) &&
+        !RegexChunk(UTF8ToUnicodeText(context, /*do_copy=*/false),
+                    sources.regex_rules, &candidates->regex,
+                    entity_data_mode, stop)) {
+      TC3_LOG(ERROR) << "Couldn't run RegexChunk.";
       return false;
     }
-
-    const int offset = std::distance(context_unicode.begin(), line.first);
-    for (const TokenSpan& chunk : local_chunks) {
-      const CodepointSpan codepoint_span =
-          selection_feature_processor_->StripBoundaryCodepoints(
-              line_str, TokenSpanToCodepointSpan(*tokens, chunk));
-
-      // Skip empty spans.
-      if (codepoint_span.first != codepoint_span.second) {
-        std::vector<ClassificationResult> classification;
-        if (!ModelClassifyText(line_str, *tokens, detected_text_language_tags,
-                               codepoint_span, interpreter_manager,
-                               &embedding_cache, &classification)) {
-          TC3_LOG(ERROR) << "Could not classify text: "
-                         << (codepoint_span.first + offset) << " "
-                         << (codepoint_span.second + offset);
+    return true;
+  });
+
+  SharedTask datetime_task([this, &context, &options, &is_entity_type_enabled,
+                            &language_regions, &sources, stop, candidates]() {
+    ScopedPhaseTimer timer(options.phase_times,
+                           &AnnotatorPhaseTimes::datetime_us);
+    const std::vector<LanguageRegion> no_language_regions;
+    // Annotate with the datetime model.
+    if (sources.datetime &&
+        (is_entity_type_enabled(Collections::Date()) ||
+         is_entity_type_enabled(Collections::DateTime())) &&
+        !ShouldStop(stop) &&
+        !DatetimeChunkLanguageRegions(
+            UTF8ToUnicodeText(context, /*do_copy=*/false), options.locales,
+            sources.datetime_language_regions ? language_regions
+                                              : no_language_regions,
+            options.annotation_usecase, stop, &candidates->datetime)) {
+      TC3_LOG(ERROR) << "Couldn't run RegexChunk.";
+      return false;
+    }
+    return true;
+  });
+
+  SharedTask knowledge_task([this, &context, &options, &sources, stop,
+                             candidates]() {
+    ScopedPhaseTimer timer(options.phase_times,
+                           &AnnotatorPhaseTimes::knowledge_us);
+    // Annotate with the knowledge engine.
+    if (sources.knowledge && knowledge_engine_ && !ShouldStop(stop) &&
+        !knowledge_engine_->Chunk(context, &candidates->knowledge)) {
+      TC3_LOG(ERROR) << "Couldn't run knowledge engine Chunk.";
+      return false;
+    }
+    return true;
+  });
+
+  SharedTask number_task(
+      [this, &context_unicode, &options, &sources, stop, candidates]() {
+        ScopedPhaseTimer timer(options.phase_times,
+                               &AnnotatorPhaseTimes::number_us);
+        // Annotate with the number annotator. It only finds numbers with ASCII
+        // digits, so texts without any are neither tokenized nor scanned.
+        if (sources.number && number_annotator_ != nullptr &&
+            !ShouldStop(stop) &&
+            DigitRunMap(StringPiece(context_unicode.data(),
+                                    context_unicode.size_bytes()))
+                .has_ascii_digit() &&
+            !number_annotator_->FindAll(
+                context_unicode,
+                selection_feature_processor_->Tokenize(context_unicode),
+                options.annotation_usecase, &candidates->number)) {
+          TC3_LOG(ERROR) << "Couldn't run number annotator FindAll.";
           return false;
         }
+        return true;
+      });
 
-        // Do not include the span if it's classified as "other".
-        if (!classification.empty() && !ClassifiedAsOther(classification) &&
-            classification[0].score >= min_annotate_confidence) {
-          AnnotatedSpan result_span;
-          result_span.span = {codepoint_span.first + offset,
-                              codepoint_span.second + offset};
-          result_span.classification = std::move(classification);
-          result->push_back(std::move(result_span));
-        }
-      }
+  const std::vector<const SharedTask*> independent_tasks = {
+      &regex_task, &datetime_task, &knowledge_task, &number_task};
+  if (annotation_thread_pool_ != nullptr) {
+    for (const SharedTask* task : independent_tasks) {
+      task->ScheduleOn(annotation_thread_pool_);
     }
   }
-  return true;
-}
-
-const FeatureProcessor* Annotator::SelectionFeatureProcessorForTests() const {
-  return selection_feature_processor_.get();
-}
-
-const FeatureProcessor* Annotator::ClassificationFeatureProcessorForTests()
-    const {
-  return classification_feature_processor_.get();
-}
 
-const DatetimeParser* Annotator::DatetimeParserForTests() const {
-  return datetime_parser_.get();
-}
+  bool success = true;
+  if (sources.model && !ShouldStop(stop)) {
+    // Annotate with the selection model.
+    if (!ModelAnnotate(context, detected_text_language_tags, language_regions,
+                       interpreter_manager, &candidates->tokens,
+                       &candidates->model, stop, options.phase_times)) {
+      TC3_LOG(ERROR) << "Couldn't run ModelAnnotate.";
+      success = false;
+    }
 
-void Annotator::RemoveNotEnabledEntityTypes(
-    const EnabledEntityTypes& is_entity_type_enabled,
-    std::vector<AnnotatedSpan>* annotated_spans) const {
-  for (AnnotatedSpan& annotated_span : *annotated_spans) {
-    std::vector<ClassificationResult>& classifications =
-        annotated_span.classification;
-    classifications.erase(
-        std::remove_if(classifications.begin(), classifications.end(),
-                       [&is_entity_type_enabled](
-                           const ClassificationResult& classification_result) {
-                         return !is_entity_type_enabled(
-                             classification_result.collection);
-                       }),
-        classifications.end());
-  }
-  annotated_spans->erase(
-      std::remove_if(annotated_spans->begin(), annotated_spans->end(),
-                     [](const AnnotatedSpan& annotated_span) {
-                       return annotated_span.classification.empty();
-                     }),
-      annotated_spans->end());
-}
+    {
+      ScopedPhaseTimer timer(options.phase_times,
+                             &AnnotatorPhaseTimes::other_engines_us);
 
-std::vector<AnnotatedSpan> Annotator::Annotate(
-    const std::string& context, const AnnotationOptions& options) const {
-  std::vector<AnnotatedSpan> candidates;
+      // Annotate with the contact engine.
+      if (success && !ShouldStop(stop) && contact_engine_ &&
+          !contact_engine_->Chunk(context_unicode, candidates->tokens,
+                                  &candidates->contact)) {
+        TC3_LOG(ERROR) << "Couldn't run contact engine Chunk.";
+        success = false;
+      }
 
-  if (!(model_->enabled_modes() & ModeFlag_ANNOTATION)) {
-    return {};
-  }
+      // Annotate with the installed app engine.
+      if (success && !ShouldStop(stop) && installed_app_engine_ &&
+          !installed_app_engine_->Chunk(context_unicode, candidates->tokens,
+                                        &candidates->installed_app)) {
+        TC3_LOG(ERROR) << "Couldn't run installed app engine Chunk.";
+        success = false;
+      }
+    }
 
-  const UnicodeText context_unicode =
-      UTF8ToUnicodeText(context, /*do_copy=*/false);
-  if (!context_unicode.is_valid()) {
-    return {};
+    // Annotate with the duration annotator.
+    ScopedPhaseTimer timer(options.phase_times,
+                           &AnnotatorPhaseTimes::duration_us);
+    if (success && !ShouldStop(stop) &&
+        is_entity_type_enabled(Collections::Duration()) &&
+        duration_annotator_ != nullptr &&
+        !duration_annotator_->FindAll(context_unicode, candidates->tokens,
+                                      options.annotation_usecase,
+                                      &candidates->duration)) {
+      TC3_LOG(ERROR) << "Couldn't run duration annotator FindAll.";
+      success = false;
+    }
   }
 
-  std::vector<Locale> detected_text_language_tags;
-  if (!ParseLocales(options.detected_text_language_tags,
-                    &detected_text_language_tags)) {
-    TC3_LOG(WARNING)
-        << "Failed to parse the detected_text_language_tags in options: "
-        << options.detected_text_language_tags;
-  }
-  if (!Locale::IsAnyLocaleSupported(detected_text_language_tags,
-                                    model_triggering_locales_,
-                                    /*default_value=*/true)) {
-    return {};
+  // Always wait for the independent sources, as they reference local state.
+  for (const SharedTask* task : independent_tasks) {
+    if (!task->Wait()) {
+      success = false;
+    }
   }
+  return success;
+}
 
-  InterpreterManager interpreter_manager(selection_executor_.get(),
-                                         classification_executor_.get());
-
-  // Annotate with the selection model.
-  std::vector<Token> tokens;
-  if (!ModelAnnotate(context, detected_text_language_tags, &interpreter_manager,
-                     &tokens, &candidates)) {
-    TC3_LOG(ERROR) << "Couldn't run ModelAnnotate.";
-    return {};
+bool Annotator::AnnotateSingleInput(
+    const std::string& full_context, const AnnotationOptions& options,
+    const std::vector<Locale>& requested_text_language_tags,
+    InterpreterManager* interpreter_manager, const StopCondition* stop,
+    std::vector<AnnotatedSpan>* result) const {
+  result->clear();
+  const UnicodeText full_context_unicode =
+      UTF8ToUnicodeText(full_context, /*do_copy=*/false);
+  if (!full_context_unicode.is_valid()) {
+    return false;
   }
 
-  // Annotate with the regular expression models.
-  if (!RegexChunk(UTF8ToUnicodeText(context, /*do_copy=*/false),
-                  annotation_regex_patterns_, &candidates,
-                  options.is_serialized_entity_data_enabled)) {
-    TC3_LOG(ERROR) << "Couldn't run RegexChunk.";
-    return {};
+  std::string cache_key;
+  if (annotation_result_cache_.enabled()) {
+    cache_key = AnnotationResultCacheKey(full_context, options);
+    if (annotation_result_cache_.Lookup(cache_key, result)) {
+      return FinishAnnotation(options, result);
+    }
   }
 
-  // Annotate with the datetime model.
-  const EnabledEntityTypes is_entity_type_enabled(options.entity_types);
-  if ((is_entity_type_enabled(Collections::Date()) ||
-       is_entity_type_enabled(Collections::DateTime())) &&
-      !DatetimeChunk(UTF8ToUnicodeText(context, /*do_copy=*/false),
-                     options.reference_time_ms_utc, options.reference_timezone,
-                     options.locales, ModeFlag_ANNOTATION,
-                     options.annotation_usecase,
-                     options.is_serialized_entity_data_enabled, &candidates)) {
-    TC3_LOG(ERROR) << "Couldn't run RegexChunk.";
-    return {};
+  // Under the degradation policy, the tiers that don't fit its budget are
+  // skipped, which can leave only the start of the text to annotate.
+  const std::chrono::steady_clock::time_point start_time =
+      std::chrono::steady_clock::now();
+  const AnnotationPlan plan = annotation_cost_model_->Plan(
+      options.degradation_policy, full_context_unicode.size_codepoints());
+  if (options.annotation_tiers != nullptr) {
+    *options.annotation_tiers &= plan.tiers;
   }
-
-  // Annotate with the knowledge engine.
-  if (knowledge_engine_ && !knowledge_engine_->Chunk(context, &candidates)) {
-    TC3_LOG(ERROR) << "Couldn't run knowledge engine Chunk.";
-    return {};
+  std::string capped_context;
+  if (!(plan.tiers & ANNOTATION_TIER_FULL_TEXT)) {
+    capped_context =
+        full_context_unicode.UTF8Substring(0, plan.max_codepoints);
   }
+  const std::string& context = (plan.tiers & ANNOTATION_TIER_FULL_TEXT)
+                                   ? full_context
+                                   : capped_context;
+  const UnicodeText context_unicode =
+      UTF8ToUnicodeText(context, /*do_copy=*/false);
 
-  // Annotate with the contact engine.
-  if (contact_engine_ &&
-      !contact_engine_->Chunk(context_unicode, tokens, &candidates)) {
-    TC3_LOG(ERROR) << "Couldn't run contact engine Chunk.";
-    return {};
+  // Without languages from the caller, they are detected for every line.
+  std::vector<LanguageRegion> language_regions;
+  std::vector<Locale> region_language_tags;
+  if (lang_id_ != nullptr && requested_text_language_tags.empty()) {
+    {
+      ScopedPhaseTimer timer(options.phase_times,
+                             &AnnotatorPhaseTimes::language_detection_us);
+      DetectLanguageRegions(context_unicode, &language_regions,
+                            &region_language_tags);
+    }
+    if (!locale_table_->IsAnyLocaleSupported(region_language_tags,
+                                             model_triggering_locales_,
+                                             /*default_value=*/true)) {
+      if (annotation_result_cache_.enabled() &&
+          plan.tiers == ANNOTATION_TIER_ALL) {
+        annotation_result_cache_.Insert(cache_key, *result);
+      }
+      return true;
+    }
   }
-
-  // Annotate with the installed app engine.
-  if (installed_app_engine_ &&
-      !installed_app_engine_->Chunk(context_unicode, tokens, &candidates)) {
-    TC3_LOG(ERROR) << "Couldn't run installed app engine Chunk.";
-    return {};
+  const std::vector<Locale>& detected_text_language_tags =
+      language_regions.empty() ? requested_text_language_tags
+                               : region_language_tags;
+
+  const EnabledEntityTypes is_entity_type_enabled(options.entity_types,
+                                                  collection_ids_);
+
+  // First run only the sources that can produce one of the enabled entity
+  // types. If they find none, the result is empty whatever the other sources
+  // find, so these are skipped. Otherwise the other sources are needed too, as
+  // their candidates can win conflicts against the enabled ones.
+  AnnotationSources producing_sources, remaining_sources;
+  PlanAnnotationSources(is_entity_type_enabled, &producing_sources,
+                        &remaining_sources);
+  for (AnnotationSources* sources : {&producing_sources, &remaining_sources}) {
+    if (!(plan.tiers & ANNOTATION_TIER_MODEL)) {
+      sources->model = false;
+    }
+    sources->datetime_language_regions =
+        (plan.tiers & ANNOTATION_TIER_FULL_DATETIME) != 0;
+  }
+  AnnotationCandidates source_candidates;
+  if (!RunAnnotationSources(context, context_unicode, options,
+                            is_entity_type_enabled, detected_text_language_tags,
+                            language_regions, producing_sources,
+                            interpreter_manager, stop, &source_candidates)) {
+    return false;
   }
-
-  // Annotate with the number annotator.
-  if (number_annotator_ != nullptr &&
-      !number_annotator_->FindAll(context_unicode, options.annotation_usecase,
-                                  &candidates)) {
-    TC3_LOG(ERROR) << "Couldn't run number annotator FindAll.";
-    return {};
+  if (!remaining_sources.IsEmpty()) {
+    if (!source_candidates.HasEnabled(is_entity_type_enabled)) {
+      if (annotation_result_cache_.enabled() && !stop->stopped() &&
+          plan.tiers == ANNOTATION_TIER_ALL) {
+        annotation_result_cache_.Insert(cache_key, *result);
+      }
+      return true;
+    }
+    if (!remaining_sources.regex_rules.empty()) {
+      // All the regex rules are run again.
+      source_candidates.regex.clear();
+    }
+    if (!RunAnnotationSources(context, context_unicode, options,
+                              is_entity_type_enabled,
+                              detected_text_language_tags, language_regions,
+                              remaining_sources, interpreter_manager, stop,
+                              &source_candidates)) {
+      return false;
+    }
   }
 
-  // Annotate with the duration annotator.
-  if (is_entity_type_enabled(Collections::Duration()) &&
-      duration_annotator_ != nullptr &&
-      !duration_annotator_->FindAll(context_unicode, tokens,
-                                    options.annotation_usecase, &candidates)) {
-    TC3_LOG(ERROR) << "Couldn't run duration annotator FindAll.";
-    return {};
+  // Merge the candidates in the order in which the sources used to run.
+  std::vector<AnnotatedSpan> candidates;
+  for (std::vector<AnnotatedSpan>* source :
+       {&source_candidates.model, &source_candidates.regex,
+        &source_candidates.datetime, &source_candidates.knowledge,
+        &source_candidates.contact, &source_candidates.installed_app,
+        &source_candidates.number, &source_candidates.duration}) {
+    std::move(source->begin(), source->end(), std::back_inserter(candidates));
   }
+  const std::vector<Token>& tokens = source_candidates.tokens;
 
   // Sort candidates according to their position in the input, so that the next
   // code can assume that any connected component of overlapping spans forms a
@@ -1874,20 +3675,25 @@ std::vector<AnnotatedSpan> Annotator::Annotate(
             });
 
   std::vector<int> candidate_indices;
-  if (!ResolveConflicts(candidates, context, tokens,
-                        detected_text_language_tags, options.annotation_usecase,
-                        &interpreter_manager, &candidate_indices)) {
-    TC3_LOG(ERROR) << "Couldn't resolve conflicts.";
-    return {};
+  {
+    ScopedPhaseTimer timer(options.phase_times,
+                           &AnnotatorPhaseTimes::conflict_resolution_us);
+    if (!ResolveConflicts(candidates, context, tokens,
+                          detected_text_language_tags,
+                          options.annotation_usecase, interpreter_manager,
+                          &candidate_indices, stop)) {
+      TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't resolve conflicts.";
+      return false;
+    }
   }
 
-  std::vector<AnnotatedSpan> result;
-  result.reserve(candidate_indices.size());
+  result->clear();
+  result->reserve(candidate_indices.size());
   AnnotatedSpan aggregated_span;
   for (const int i : candidate_indices) {
     if (candidates[i].span != aggregated_span.span) {
       if (!aggregated_span.classification.empty()) {
-        result.push_back(std::move(aggregated_span));
+        result->push_back(std::move(aggregated_span));
       }
       aggregated_span =
           AnnotatedSpan(candidates[i].span, /*arg_classification=*/{});
@@ -1902,21 +3708,47 @@ std::vector<AnnotatedSpan> Annotator::Annotate(
     }
   }
   if (!aggregated_span.classification.empty()) {
-    result.push_back(std::move(aggregated_span));
+    result->push_back(std::move(aggregated_span));
+  }
+
+  // Unless nothing enabled was found, we generate all candidates and remove
+  // them later (with the exception of date/time/duration entities) because
+  // there are complex interdependencies between the entity types. E.g., the
+  // TLD of an email can be interpreted as a URL, but most likely a user of the
+  // API does not want such annotations if "url" is enabled and "email" is not.
+  RemoveNotEnabledEntityTypes(is_entity_type_enabled, result);
+
+  if (!stop->stopped()) {
+    if (options.degradation_policy.enabled()) {
+      annotation_cost_model_->Record(
+          plan.tiers, context_unicode.size_codepoints(),
+          std::chrono::duration_cast<std::chrono::microseconds>(
+              std::chrono::steady_clock::now() - start_time)
+              .count());
+    }
+    if (annotation_result_cache_.enabled() &&
+        plan.tiers == ANNOTATION_TIER_ALL) {
+      annotation_result_cache_.Insert(cache_key, *result);
+    }
   }
+  return FinishAnnotation(options, result);
+}
 
-  // We generate all candidates and remove them later (with the exception of
-  // date/time/duration entities) because there are complex interdependencies
-  // between the entity types. E.g., the TLD of an email can be interpreted as a
-  // URL, but most likely a user of the API does not want such annotations if
-  // "url" is enabled and "email" is not.
-  RemoveNotEnabledEntityTypes(is_entity_type_enabled, &result);
+bool Annotator::FinishAnnotation(const AnnotationOptions& options,
+                                 std::vector<AnnotatedSpan>* result) const {
+  // Only the datetimes that made it this far are resolved to an absolute time.
+  if (!ResolveDatetimes(options.reference_time_ms_utc,
+                        options.reference_timezone, options.locales,
+                        options.is_serialized_entity_data_enabled, result)) {
+    TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't resolve datetimes.";
+    return false;
+  }
 
-  for (AnnotatedSpan& annotated_span : result) {
+  for (AnnotatedSpan& annotated_span : *result) {
     SortClassificationResults(&annotated_span.classification);
   }
 
-  return result;
+  return true;
 }
 
 CodepointSpan Annotator::ComputeSelectionBoundaries(
@@ -1976,12 +3808,51 @@ bool Annotator::HasEntityData(const RegexModel_::Pattern* pattern) const {
 }
 
 bool Annotator::SerializedEntityDataFromRegexMatch(
-    const RegexModel_::Pattern* pattern, UniLib::RegexMatcher* matcher,
+    const CompiledRegexPattern& regex_pattern, UniLib::RegexMatcher* matcher,
     std::string* serialized_entity_data) const {
-  if (!HasEntityData(pattern)) {
+  if (!HasEntityData(regex_pattern.config)) {
     serialized_entity_data->clear();
     return true;
   }
+  std::vector<std::string> group_texts;
+  if (!EntityDataGroupTexts(regex_pattern, matcher, &group_texts)) {
+    return false;
+  }
+  return SerializedEntityDataFromGroupTexts(regex_pattern, group_texts,
+                                            serialized_entity_data);
+}
+
+bool Annotator::EntityDataGroupTexts(
+    const CompiledRegexPattern& regex_pattern,
+    const UniLib::RegexMatcher* matcher,
+    std::vector<std::string>* group_texts) const {
+  const RegexModel_::Pattern* pattern = regex_pattern.config;
+  group_texts->clear();
+  if (pattern->capturing_group() == nullptr) {
+    return true;
+  }
+  const int num_groups = pattern->capturing_group()->size();
+  group_texts->resize(num_groups);
+  for (int i = 0; i < num_groups; i++) {
+    if (pattern->capturing_group()->Get(i)->entity_field_path() == nullptr) {
+      continue;
+    }
+    int status = UniLib::RegexMatcher::kNoError;
+    (*group_texts)[i] = matcher->Group(i, &status).ToUTF8String();
+    if (status != UniLib::RegexMatcher::kNoError || (*group_texts)[i].empty()) {
+      TC3_LOG_EVERY_N_SEC(ERROR, 10)
+          << "Could not set entity data from rule capturing group.";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Annotator::SerializedEntityDataFromGroupTexts(
+    const CompiledRegexPattern& regex_pattern,
+    const std::vector<std::string>& group_texts,
+    std::string* serialized_entity_data) const {
+  const RegexModel_::Pattern* pattern = regex_pattern.config;
   TC3_CHECK(entity_data_builder_ != nullptr);
 
   std::unique_ptr<ReflectiveFlatbuffer> entity_data =
@@ -1991,28 +3862,21 @@ bool Annotator::SerializedEntityDataFromRegexMatch(
 
   // Set static entity data.
   if (pattern->serialized_entity_data() != nullptr) {
-    TC3_CHECK(entity_data != nullptr);
     entity_data->MergeFromSerializedFlatbuffer(
         StringPiece(pattern->serialized_entity_data()->c_str(),
                     pattern->serialized_entity_data()->size()));
   }
 
   // Add entity data from rule capturing groups.
-  if (pattern->capturing_group() != nullptr) {
-    const int num_groups = pattern->capturing_group()->size();
-    for (int i = 0; i < num_groups; i++) {
-      const FlatbufferFieldPath* field_path =
-          pattern->capturing_group()->Get(i)->entity_field_path();
-      if (field_path == nullptr) {
-        continue;
-      }
-      TC3_CHECK(entity_data != nullptr);
-      if (!SetFieldFromCapturingGroup(/*group_id=*/i, field_path, matcher,
-                                      entity_data.get())) {
-        TC3_LOG(ERROR)
-            << "Could not set entity data from rule capturing group.";
-        return false;
-      }
+  for (int i = 0; i < group_texts.size(); i++) {
+    if (pattern->capturing_group()->Get(i)->entity_field_path() == nullptr) {
+      continue;
+    }
+    if (!entity_data->ParseAndSet(regex_pattern.capturing_group_paths[i],
+                                  group_texts[i])) {
+      TC3_LOG_EVERY_N_SEC(ERROR, 10)
+          << "Could not set entity data from rule capturing group.";
+      return false;
     }
   }
 
@@ -2020,37 +3884,96 @@ bool Annotator::SerializedEntityDataFromRegexMatch(
   return true;
 }
 
+class Annotator::RegexEntityData : public LazyEntityData {
+ public:
+  RegexEntityData(const Annotator* annotator, int pattern_id,
+                  std::vector<std::string> group_texts)
+      : annotator_(annotator),
+        pattern_id_(pattern_id),
+        group_texts_(std::move(group_texts)) {}
+
+  bool Build(std::string* serialized_entity_data) const override {
+    return annotator_->SerializedEntityDataFromGroupTexts(
+        annotator_->regex_patterns_[pattern_id_], group_texts_,
+        serialized_entity_data);
+  }
+
+ private:
+  const Annotator* const annotator_;
+  const int pattern_id_;
+  const std::vector<std::string> group_texts_;
+};
+
 bool Annotator::RegexChunk(const UnicodeText& context_unicode,
                            const std::vector<int>& rules,
                            std::vector<AnnotatedSpan>* result,
-                           bool is_serialized_entity_data_enabled) const {
+                           EntityDataMode entity_data_mode,
+                           const StopCondition* stop) const {
+  TC3_TRACE_SCOPE("Annotator::RegexChunk");
+  // Find the literals the patterns require in a single pass over the text, and
+  // only run the patterns that can match.
+  const StringPiece context(context_unicode.data(),
+                            context_unicode.size_bytes());
+  std::vector<bool> found_literals;
+  regex_literals_.FindAll(context, &found_literals);
+  const DigitRunMap digit_runs(context);
+
   for (int pattern_id : rules) {
+    if (ShouldStop(stop)) {
+      break;
+    }
     const CompiledRegexPattern& regex_pattern = regex_patterns_[pattern_id];
+    if (!regex_pattern.MayMatch(context, found_literals, digit_runs)) {
+      continue;
+    }
+    RegexStats::Run stats_run(regex_stats_.get(), pattern_id, context.size());
     const auto matcher = regex_pattern.pattern->Matcher(context_unicode);
     if (!matcher) {
-      TC3_LOG(ERROR) << "Could not get regex matcher for pattern: "
-                     << pattern_id;
+      TC3_LOG_EVERY_N_SEC(ERROR, 10)
+          << "Could not get regex matcher for pattern: " << pattern_id;
       return false;
     }
 
+    // The texts that repeat in the context are only verified once.
+    std::unordered_map<std::string, bool> verified_matches;
     int status = UniLib::RegexMatcher::kNoError;
-    while (matcher->Find(&status) && status == UniLib::RegexMatcher::kNoError) {
-      if (regex_pattern.config->verification_options()) {
-        if (!VerifyRegexMatchCandidate(
-                context_unicode.ToUTF8String(),
-                regex_pattern.config->verification_options(),
-                matcher->Group(1, &status).ToUTF8String(), matcher.get())) {
+    while (stats_run.CountFind(matcher->Find(&status)) &&
+           status == UniLib::RegexMatcher::kNoError) {
+      const VerificationOptions* verification_options =
+          regex_pattern.config->verification_options();
+      if (verification_options != nullptr) {
+        // The context is passed as a view of the text being matched, and the
+        // match text is only needed by the checksum verification.
+        std::string match;
+        if (verification_options->verify_luhn_checksum()) {
+          match = matcher->Group(1, &status).ToUTF8String();
+        }
+        if (!VerifyRegexMatchCandidate(pattern_id, context,
+                                       verification_options, match,
+                                       matcher.get(), &verified_matches)) {
           continue;
         }
       }
 
       std::string serialized_entity_data;
-      if (is_serialized_entity_data_enabled) {
-        if (!SerializedEntityDataFromRegexMatch(
-                regex_pattern.config, matcher.get(), &serialized_entity_data)) {
-          TC3_LOG(ERROR) << "Could not get entity data.";
+      std::shared_ptr<const LazyEntityData> lazy_entity_data;
+      if (entity_data_mode == EntityDataMode::kSerialized) {
+        if (!SerializedEntityDataFromRegexMatch(regex_pattern, matcher.get(),
+                                                &serialized_entity_data)) {
+          TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Could not get entity data.";
+          return false;
+        }
+      } else if (entity_data_mode == EntityDataMode::kDeferred &&
+                 HasEntityData(regex_pattern.config)) {
+        // Only the group texts are kept, the flatbuffer is built on demand.
+        std::vector<std::string> group_texts;
+        if (!EntityDataGroupTexts(regex_pattern, matcher.get(),
+                                  &group_texts)) {
+          TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Could not get entity data.";
           return false;
         }
+        lazy_entity_data.reset(
+            new RegexEntityData(this, pattern_id, std::move(group_texts)));
       }
 
       result->emplace_back();
@@ -2061,12 +3984,15 @@ bool Annotator::RegexChunk(const UnicodeText& context_unicode,
           ComputeSelectionBoundaries(matcher.get(), regex_pattern.config);
 
       result->back().classification = {
-          {regex_pattern.config->collection_name()->str(),
+          {collection_ids_.Name(regex_pattern.collection_id),
+           regex_pattern.collection_id,
            regex_pattern.config->target_classification_score(),
            regex_pattern.config->priority_score()}};
 
       result->back().classification[0].serialized_entity_data =
           serialized_entity_data;
+      result->back().classification[0].lazy_entity_data =
+          std::move(lazy_entity_data);
     }
   }
   return true;
@@ -2076,35 +4002,65 @@ bool Annotator::ModelChunk(int num_tokens, const TokenSpan& span_of_interest,
                            tflite::Interpreter* selection_interpreter,
                            const CachedFeatures& cached_features,
                            std::vector<TokenSpan>* chunks) const {
-  const int max_selection_span =
-      selection_feature_processor_->GetOptions()->max_selection_span();
-  // The inference span is the span of interest expanded to include
-  // max_selection_span tokens on either side, which is how far a selection can
-  // stretch from the click.
-  const TokenSpan inference_span = IntersectTokenSpans(
-      ExpandTokenSpan(span_of_interest,
-                      /*num_tokens_left=*/max_selection_span,
-                      /*num_tokens_right=*/max_selection_span),
-      {0, num_tokens});
+  std::vector<std::vector<TokenSpan>> chunks_per_input;
+  if (!ModelChunk({ChunkInput{num_tokens, span_of_interest, &cached_features}},
+                  selection_interpreter, &chunks_per_input)) {
+    return false;
+  }
+  *chunks = std::move(chunks_per_input[0]);
+  return true;
+}
 
-  std::vector<ScoredChunk> scored_chunks;
+bool Annotator::ModelChunk(
+    const std::vector<ChunkInput>& inputs,
+    tflite::Interpreter* selection_interpreter,
+    std::vector<std::vector<TokenSpan>>* chunks) const {
+  chunks->clear();
+  chunks->resize(inputs.size());
+  if (inputs.empty()) {
+    return true;
+  }
+
+  std::vector<std::vector<ScoredChunk>> scored_chunks;
   if (selection_feature_processor_->GetOptions()->bounds_sensitive_features() &&
       selection_feature_processor_->GetOptions()
           ->bounds_sensitive_features()
           ->enabled()) {
-    if (!ModelBoundsSensitiveScoreChunks(
-            num_tokens, span_of_interest, inference_span, cached_features,
-            selection_interpreter, &scored_chunks)) {
+    if (!ModelBoundsSensitiveScoreChunks(inputs, selection_interpreter,
+                                         &scored_chunks)) {
       return false;
     }
   } else {
-    if (!ModelClickContextScoreChunks(num_tokens, span_of_interest,
-                                      cached_features, selection_interpreter,
+    if (!ModelClickContextScoreChunks(inputs, selection_interpreter,
                                       &scored_chunks)) {
       return false;
     }
   }
-  std::sort(scored_chunks.rbegin(), scored_chunks.rend(),
+
+  for (int i = 0; i < inputs.size(); ++i) {
+    SelectNonOverlappingChunks(InferenceSpan(inputs[i]), &scored_chunks[i],
+                               &(*chunks)[i]);
+  }
+  return true;
+}
+
+TokenSpan Annotator::InferenceSpan(const ChunkInput& input) const {
+  const int max_selection_span =
+      selection_feature_processor_->GetOptions()->max_selection_span();
+  // The inference span is the span of interest expanded to include
+  // max_selection_span tokens on either side, which is how far a selection can
+  // stretch from the click.
+  return IntersectTokenSpans(
+      ExpandTokenSpan(input.span_of_interest,
+                      /*num_tokens_left=*/max_selection_span,
+                      /*num_tokens_right=*/max_selection_span),
+      {0, input.num_tokens});
+}
+
+void Annotator::SelectNonOverlappingChunks(
+    const TokenSpan& inference_span, std::vector<ScoredChunk>* scored_chunks,
+    std::vector<TokenSpan>* chunks) const {
+  std::sort(scored_chunks->rbegin(), scored_chunks->rend(),
             [](const ScoredChunk& lhs, const ScoredChunk& rhs) {
               return lhs.score < rhs.score;
             });
@@ -2112,9 +4068,9 @@ bool Annotator::ModelChunk(int num_tokens, const TokenSpan& span_of_interest,
   // Traverse the candidate chunks from highest-scoring to lowest-scoring. Pick
   // them greedily as long as they do not overlap with any previously picked
   // chunks.
-  std::vector<bool> token_used(TokenSpanSize(inference_span));
+  ScratchVector<bool> token_used(TokenSpanSize(inference_span));
   chunks->clear();
-  for (const ScoredChunk& scored_chunk : scored_chunks) {
+  for (const ScoredChunk& scored_chunk : *scored_chunks) {
     bool feasible = true;
     for (int i = scored_chunk.token_span.first;
          i < scored_chunk.token_span.second; ++i) {
@@ -2137,8 +4093,6 @@ bool Annotator::ModelChunk(int num_tokens, const TokenSpan& span_of_interest,
   }
 
   std::sort(chunks->begin(), chunks->end());
-
-  return true;
 }
 
 namespace {
@@ -2157,81 +4111,128 @@ void UpdateMax(Map* map, typename Map::key_type key,
 }  // namespace
 
 bool Annotator::ModelClickContextScoreChunks(
-    int num_tokens, const TokenSpan& span_of_interest,
-    const CachedFeatures& cached_features,
+    const std::vector<ChunkInput>& inputs,
     tflite::Interpreter* selection_interpreter,
-    std::vector<ScoredChunk>* scored_chunks) const {
+    std::vector<std::vector<ScoredChunk>>* scored_chunks) const {
   const int max_batch_size = model_->selection_options()->batch_size();
+  const int features_size = inputs[0].cached_features->OutputFeaturesSize();
+
+  // Click positions of all the inputs, as pairs of (input index, click
+  // position). Batches are filled from consecutive entries, so one batch can
+  // contain clicks from several inputs.
+  std::vector<std::pair<int, int>> clicks;
+  for (int input_index = 0; input_index < inputs.size(); ++input_index) {
+    const TokenSpan& span_of_interest = inputs[input_index].span_of_interest;
+    for (int click_pos = span_of_interest.first;
+         click_pos < span_of_interest.second; ++click_pos) {
+      clicks.push_back({input_index, click_pos});
+    }
+  }
 
-  std::vector<float> all_features;
-  std::map<TokenSpan, float> chunk_scores;
-  for (int batch_start = span_of_interest.first;
-       batch_start < span_of_interest.second; batch_start += max_batch_size) {
-    const int batch_end =
-        std::min(batch_start + max_batch_size, span_of_interest.second);
+  // The buffer is allocated once and reused by all the batches.
+  std::vector<float> scores(
+      selection_feature_processor_->GetSelectionLabelCount());
+  // An end-to-end quantized model takes int8 features, which are first written
+  // to this buffer and then quantized into the input.
+  const bool quantized_input =
+      selection_executor_->HasQuantizedFeaturesInput(selection_interpreter);
+  std::vector<float> quantized_input_features;
+  std::vector<std::map<TokenSpan, float>> chunk_scores(inputs.size());
+  for (int batch_start = 0; batch_start < clicks.size();
+       batch_start += max_batch_size) {
+    const int batch_end = std::min(batch_start + max_batch_size,
+                                   static_cast<int>(clicks.size()));
 
-    // Prepare features for the whole batch.
-    all_features.clear();
-    all_features.reserve(max_batch_size * cached_features.OutputFeaturesSize());
-    for (int click_pos = batch_start; click_pos < batch_end; ++click_pos) {
-      cached_features.AppendClickContextFeaturesForClick(click_pos,
-                                                         &all_features);
+    // Write the features of the whole batch straight to the model input. The
+    // rows padding the batch are zeroed and their logits ignored.
+    const int batch_size = batch_end - batch_start;
+    const int padded_batch_size =
+        ModelExecutor::PaddedBatchSize(batch_size, max_batch_size);
+    float* batch_features;
+    if (quantized_input) {
+      quantized_input_features.resize(padded_batch_size * features_size);
+      batch_features = quantized_input_features.data();
+    } else {
+      batch_features = selection_executor_->AllocateFeaturesInput(
+          padded_batch_size, features_size, selection_interpreter);
+    }
+    if (batch_features == nullptr) {
+      TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't allocate the model input.";
+      return false;
+    }
+    std::fill(batch_features + batch_size * features_size,
+              batch_features + padded_batch_size * features_size, 0.0f);
+    for (int i = batch_start; i < batch_end; ++i) {
+      inputs[clicks[i].first]
+          .cached_features->WriteClickContextFeaturesForClick(
+              clicks[i].second,
+              batch_features + (i - batch_start) * features_size);
     }
 
     // Run batched inference.
-    const int batch_size = batch_end - batch_start;
-    const int features_size = cached_features.OutputFeaturesSize();
-    TensorView<float> logits = selection_executor_->ComputeLogits(
-        TensorView<float>(all_features.data(), {batch_size, features_size}),
-        selection_interpreter);
+    if (quantized_input && !selection_executor_->QuantizeFeaturesInput(
+                               batch_features, padded_batch_size,
+                               features_size, selection_interpreter)) {
+      TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't quantize the model input.";
+      return false;
+    }
+    TensorView<float> logits =
+        selection_executor_->ComputeLogits(selection_interpreter);
     if (!logits.is_valid()) {
-      TC3_LOG(ERROR) << "Couldn't compute logits.";
+      TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't compute logits.";
       return false;
     }
-    if (logits.dims() != 2 || logits.dim(0) != batch_size ||
+    if (logits.dims() != 2 || logits.dim(0) != padded_batch_size ||
         logits.dim(1) !=
             selection_feature_processor_->GetSelectionLabelCount()) {
-      TC3_LOG(ERROR) << "Mismatching output.";
+      TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Mismatching output.";
       return false;
     }
 
     // Save results.
-    for (int click_pos = batch_start; click_pos < batch_end; ++click_pos) {
-      const std::vector<float> scores = ComputeSoftmax(
-          logits.data() + logits.dim(1) * (click_pos - batch_start),
-          logits.dim(1));
+    for (int i = batch_start; i < batch_end; ++i) {
+      const int input_index = clicks[i].first;
+      const int click_pos = clicks[i].second;
+      ComputeSoftmax(logits.data() + logits.dim(1) * (i - batch_start),
+                     logits.dim(1), scores.data());
       for (int j = 0;
            j < selection_feature_processor_->GetSelectionLabelCount(); ++j) {
         TokenSpan relative_token_span;
         if (!selection_feature_processor_->LabelToTokenSpan(
                 j, &relative_token_span)) {
-          TC3_LOG(ERROR) << "Couldn't map the label to a token span.";
+          TC3_LOG_EVERY_N_SEC(ERROR, 10)
+              << "Couldn't map the label to a token span.";
           return false;
         }
         const TokenSpan candidate_span = ExpandTokenSpan(
             SingleTokenSpan(click_pos), relative_token_span.first,
             relative_token_span.second);
-        if (candidate_span.first >= 0 && candidate_span.second <= num_tokens) {
-          UpdateMax(&chunk_scores, candidate_span, scores[j]);
+        if (candidate_span.first >= 0 &&
+            candidate_span.second <= inputs[input_index].num_tokens) {
+          UpdateMax(&chunk_scores[input_index], candidate_span, scores[j]);
         }
       }
     }
   }
 
   scored_chunks->clear();
-  scored_chunks->reserve(chunk_scores.size());
-  for (const auto& entry : chunk_scores) {
-    scored_chunks->push_back(ScoredChunk{entry.first, entry.second});
+  scored_chunks->resize(inputs.size());
+  for (int input_index = 0; input_index < inputs.size(); ++input_index) {
+    std::vector<ScoredChunk>& input_scored_chunks =
+        (*scored_chunks)[input_index];
+    input_scored_chunks.reserve(chunk_scores[input_index].size());
+    for (const auto& entry : chunk_scores[input_index]) {
+      input_scored_chunks.push_back(ScoredChunk{entry.first, entry.second});
+    }
   }
 
   return true;
 }
 
 bool Annotator::ModelBoundsSensitiveScoreChunks(
-    int num_tokens, const TokenSpan& span_of_interest,
-    const TokenSpan& inference_span, const CachedFeatures& cached_features,
+    const std::vector<ChunkInput>& inputs,
     tflite::Interpreter* selection_interpreter,
-    std::vector<ScoredChunk>* scored_chunks) const {
+    std::vector<std::vector<ScoredChunk>>* scored_chunks) const {
   const int max_selection_span =
       selection_feature_processor_->GetOptions()->max_selection_span();
   const int max_chunk_length = selection_feature_processor_->GetOptions()
@@ -2242,73 +4243,136 @@ bool Annotator::ModelBoundsSensitiveScoreChunks(
       selection_feature_processor_->GetOptions()
           ->bounds_sensitive_features()
           ->score_single_token_spans_as_zero();
+  const ChunkPruningOptions& pruning = chunk_pruning_options_;
 
   scored_chunks->clear();
-  if (score_single_token_spans_as_zero) {
-    scored_chunks->reserve(TokenSpanSize(span_of_interest));
-  }
+  scored_chunks->resize(inputs.size());
 
-  // Prepare all chunk candidates into one batch:
+  // Prepare all chunk candidates of all the inputs, as pairs of (input index,
+  // candidate span). The candidates:
   //   - Are contained in the inference span
   //   - Have a non-empty intersection with the span of interest
   //   - Are at least one token long
   //   - Are not longer than the maximum chunk length
-  std::vector<TokenSpan> candidate_spans;
-  for (int start = inference_span.first; start < span_of_interest.second;
-       ++start) {
-    const int leftmost_end_index = std::max(start, span_of_interest.first) + 1;
-    for (int end = leftmost_end_index;
-         end <= inference_span.second && end - start <= max_chunk_length;
-         ++end) {
-      const TokenSpan candidate_span = {start, end};
-      if (score_single_token_spans_as_zero &&
-          TokenSpanSize(candidate_span) == 1) {
-        // Do not include the single token span in the batch, add a zero score
-        // for it directly to the output.
-        scored_chunks->push_back(ScoredChunk{candidate_span, 0.0f});
-      } else {
-        candidate_spans.push_back(candidate_span);
+  //   - Don't cross the end of a sentence, if pruned so
+  std::vector<std::pair<int, TokenSpan>> candidate_spans;
+  for (int input_index = 0; input_index < inputs.size(); ++input_index) {
+    const ChunkInput& input = inputs[input_index];
+    const TokenSpan& span_of_interest = input.span_of_interest;
+    const TokenSpan inference_span = InferenceSpan(input);
+    std::vector<ScoredChunk>& input_scored_chunks =
+        (*scored_chunks)[input_index];
+    if (score_single_token_spans_as_zero) {
+      input_scored_chunks.reserve(TokenSpanSize(span_of_interest));
+    }
+
+    // The end of the sentence of each token of the inference span, which the
+    // candidates starting at the token can't extend past.
+    ScratchVector<int> sentence_ends;
+    if (pruning.drop_spans_across_sentences && input.tokens != nullptr) {
+      sentence_ends.resize(TokenSpanSize(inference_span));
+      int sentence_end = inference_span.second;
+      for (int i = inference_span.second - 1; i >= inference_span.first; --i) {
+        if (EndsSentence(*input.tokens, i)) {
+          sentence_end = i + 1;
+        }
+        sentence_ends[i - inference_span.first] = sentence_end;
+      }
+    }
+
+    for (int start = inference_span.first; start < span_of_interest.second;
+         ++start) {
+      const int leftmost_end_index =
+          std::max(start, span_of_interest.first) + 1;
+      const int rightmost_end_index =
+          sentence_ends.empty() ? inference_span.second
+                                : sentence_ends[start - inference_span.first];
+      for (int end = leftmost_end_index;
+           end <= rightmost_end_index && end - start <= max_chunk_length;
+           ++end) {
+        const TokenSpan candidate_span = {start, end};
+        if (score_single_token_spans_as_zero &&
+            TokenSpanSize(candidate_span) == 1) {
+          // Do not include the single token span in the batch, add a zero
+          // score for it directly to the output.
+          if (input.tokens == nullptr || 0.0f >= pruning.min_chunk_score) {
+            input_scored_chunks.push_back(ScoredChunk{candidate_span, 0.0f});
+          }
+        } else {
+          candidate_spans.push_back({input_index, candidate_span});
+        }
       }
     }
   }
 
   const int max_batch_size = model_->selection_options()->batch_size();
+  const int features_size = inputs[0].cached_features->OutputFeaturesSize();
+  // An end-to-end quantized model takes int8 features, which are first written
+  // to this buffer and then quantized into the input.
+  const bool quantized_input =
+      selection_executor_->HasQuantizedFeaturesInput(selection_interpreter);
+  std::vector<float> quantized_input_features;
 
-  std::vector<float> all_features;
-  scored_chunks->reserve(scored_chunks->size() + candidate_spans.size());
   for (int batch_start = 0; batch_start < candidate_spans.size();
        batch_start += max_batch_size) {
     const int batch_end = std::min(batch_start + max_batch_size,
                                    static_cast<int>(candidate_spans.size()));
 
-    // Prepare features for the whole batch.
-    all_features.clear();
-    all_features.reserve(max_batch_size * cached_features.OutputFeaturesSize());
+    // Write the features of the whole batch straight to the model input. The
+    // rows padding the batch are zeroed and their logits ignored.
+    const int batch_size = batch_end - batch_start;
+    const int padded_batch_size =
+        ModelExecutor::PaddedBatchSize(batch_size, max_batch_size);
+    float* batch_features;
+    if (quantized_input) {
+      quantized_input_features.resize(padded_batch_size * features_size);
+      batch_features = quantized_input_features.data();
+    } else {
+      batch_features = selection_executor_->AllocateFeaturesInput(
+          padded_batch_size, features_size, selection_interpreter);
+    }
+    if (batch_features == nullptr) {
+      TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't allocate the model input.";
+      return false;
+    }
+    std::fill(batch_features + batch_size * features_size,
+              batch_features + padded_batch_size * features_size, 0.0f);
     for (int i = batch_start; i < batch_end; ++i) {
-      cached_features.AppendBoundsSensitiveFeaturesForSpan(candidate_spans[i],
-                                                           &all_features);
+      inputs[candidate_spans[i].first]
+          .cached_features->WriteBoundsSensitiveFeaturesForSpan(
+              candidate_spans[i].second,
+              batch_features + (i - batch_start) * features_size);
     }
 
     // Run batched inference.
-    const int batch_size = batch_end - batch_start;
-    const int features_size = cached_features.OutputFeaturesSize();
-    TensorView<float> logits = selection_executor_->ComputeLogits(
-        TensorView<float>(all_features.data(), {batch_size, features_size}),
-        selection_interpreter);
+    if (quantized_input && !selection_executor_->QuantizeFeaturesInput(
+                               batch_features, padded_batch_size,
+                               features_size, selection_interpreter)) {
+      TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't quantize the model input.";
+      return false;
+    }
+    TensorView<float> logits =
+        selection_executor_->ComputeLogits(selection_interpreter);
     if (!logits.is_valid()) {
-      TC3_LOG(ERROR) << "Couldn't compute logits.";
+      TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't compute logits.";
       return false;
     }
-    if (logits.dims() != 2 || logits.dim(0) != batch_size ||
+    if (logits.dims() != 2 || logits.dim(0) != padded_batch_size ||
         logits.dim(1) != 1) {
-      TC3_LOG(ERROR) << "Mismatching output.";
+      TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Mismatching output.";
       return false;
     }
 
-    // Save results.
+    // Save results, without the chunks below the score threshold of the
+    // pruned inputs.
     for (int i = batch_start; i < batch_end; ++i) {
-      scored_chunks->push_back(
-          ScoredChunk{candidate_spans[i], logits.data()[i - batch_start]});
+      const float score = logits.data()[i - batch_start];
+      if (inputs[candidate_spans[i].first].tokens != nullptr &&
+          score < pruning.min_chunk_score) {
+        continue;
+      }
+      (*scored_chunks)[candidate_spans[i].first].push_back(
+          ScoredChunk{candidate_spans[i].second, score});
     }
   }
 
@@ -2316,21 +4380,20 @@ bool Annotator::ModelBoundsSensitiveScoreChunks(
 }
 
 bool Annotator::DatetimeChunk(const UnicodeText& context_unicode,
-                              int64 reference_time_ms_utc,
-                              const std::string& reference_timezone,
                               const std::string& locales, ModeFlag mode,
                               AnnotationUsecase annotation_usecase,
-                              bool is_serialized_entity_data_enabled,
-                              std::vector<AnnotatedSpan>* result) const {
-  if (!datetime_parser_) {
+                              std::vector<AnnotatedSpan>* result,
+                              const StopCondition* stop) const {
+  const DatetimeParser* datetime_parser = GetDatetimeParser();
+  if (!datetime_parser) {
     return true;
   }
 
   std::vector<DatetimeParseResultSpan> datetime_spans;
-  if (!datetime_parser_->Parse(context_unicode, reference_time_ms_utc,
-                               reference_timezone, locales, mode,
-                               annotation_usecase,
-                               /*anchor_start_end=*/false, &datetime_spans)) {
+  if (!datetime_parser->ParseUnresolved(context_unicode, locales, mode,
+                                        annotation_usecase,
+                                        /*anchor_start_end=*/false,
+                                        &datetime_spans, stop)) {
     return false;
   }
   for (const DatetimeParseResultSpan& datetime_span : datetime_spans) {
@@ -2342,10 +4405,6 @@ bool Annotator::DatetimeChunk(const UnicodeText& context_unicode,
           datetime_span.target_classification_score,
           datetime_span.priority_score);
       annotated_span.classification.back().datetime_parse_result = parse_result;
-      if (is_serialized_entity_data_enabled) {
-        annotated_span.classification.back().serialized_entity_data =
-            CreateDatetimeSerializedEntityData(parse_result);
-      }
     }
     annotated_span.source = AnnotatedSpan::Source::DATETIME;
     result->push_back(std::move(annotated_span));
@@ -2353,11 +4412,54 @@ bool Annotator::DatetimeChunk(const UnicodeText& context_unicode,
   return true;
 }
 
+bool Annotator::ResolveDatetimes(int64 reference_time_ms_utc,
+                                 const std::string& reference_timezone,
+                                 const std::string& locales,
+                                 bool is_serialized_entity_data_enabled,
+                                 std::vector<AnnotatedSpan>* spans) const {
+  for (AnnotatedSpan& span : *spans) {
+    if (!ResolveDatetimeClassifications(
+            reference_time_ms_utc, reference_timezone, locales,
+            is_serialized_entity_data_enabled, &span.classification)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Annotator::ResolveDatetimeClassifications(
+    int64 reference_time_ms_utc, const std::string& reference_timezone,
+    const std::string& locales, bool is_serialized_entity_data_enabled,
+    std::vector<ClassificationResult>* classifications) const {
+  for (ClassificationResult& classification : *classifications) {
+    DatetimeParseResult& parse_result = classification.datetime_parse_result;
+    if (parse_result.unresolved_parse_data == nullptr) {
+      continue;
+    }
+    // Only results of the datetime parser have unresolved data, so it exists.
+    if (!GetDatetimeParser()->Resolve(reference_time_ms_utc,
+                                      reference_timezone, locales,
+                                      &parse_result)) {
+      return false;
+    }
+    if (is_serialized_entity_data_enabled) {
+      classification.serialized_entity_data =
+          CreateDatetimeSerializedEntityData(parse_result);
+    }
+  }
+  return true;
+}
+
 const Model* Annotator::model() const { return model_; }
 const reflection::Schema* Annotator::entity_data_schema() const {
   return entity_data_schema_;
 }
 
+uint64 Annotator::NextInstanceId() {
+  static std::atomic<uint64> next_instance_id(1);
+  return next_instance_id.fetch_add(1, std::memory_order_relaxed);
+}
+
 const Model* ViewModel(const void* buffer, int size) {
   if (!buffer) {
     return nullptr;
@@ -2372,4 +4474,22 @@ bool Annotator::LookUpKnowledgeEntity(
          knowledge_engine_->LookUpEntity(id, serialized_knowledge_result);
 }
 
+void Annotator::AnnotateToFlatbuffer(
+    const std::string& context, const AnnotationOptions& options,
+    flatbuffers::FlatBufferBuilder* builder) const {
+  FinishAnnotationsBuffer(
+      *builder, PackAnnotations(Annotate(context, options), builder));
+}
+
+void Annotator::ClassifyTextToFlatbuffer(
+    const std::string& context, CodepointSpan selection_indices,
+    const ClassificationOptions& options,
+    flatbuffers::FlatBufferBuilder* builder) const {
+  FinishAnnotationsBuffer(
+      *builder,
+      PackAnnotations(selection_indices,
+                      ClassifyText(context, selection_indices, options),
+                      builder));
+}
+
 }  // namespace libtextclassifier3
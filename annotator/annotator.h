@@ -19,14 +19,20 @@
 #ifndef LIBTEXTCLASSIFIER_ANNOTATOR_ANNOTATOR_H_
 #define LIBTEXTCLASSIFIER_ANNOTATOR_ANNOTATOR_H_
 
+#include <atomic>
+#include <limits>
 #include <memory>
+#include <mutex>  // NOLINT
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include "annotator/collection-ids.h"
 #include "annotator/contact/contact-engine.h"
 #include "annotator/datetime/parser.h"
+#include "annotator/degradation.h"
 #include "annotator/duration/duration.h"
 #include "annotator/feature-processor.h"
 #include "annotator/installed_app/installed-app-engine.h"
@@ -34,17 +40,35 @@
 #include "annotator/model-executor.h"
 #include "annotator/model_generated.h"
 #include "annotator/number/number.h"
+#include "annotator/result-cache.h"
+#include "annotator/shared-embedding-cache.h"
 #include "annotator/strip-unpaired-brackets.h"
 #include "annotator/types.h"
 #include "annotator/zlib-utils.h"
+#include "utils/cancellation.h"
 #include "utils/flatbuffers.h"
+#include "utils/i18n/locale-table.h"
 #include "utils/i18n/locale.h"
+#include "utils/memory/memory-stats.h"
 #include "utils/memory/mmap.h"
+#include "utils/regex-compilation.h"
+#include "utils/regex-match.h"
+#include "utils/regex-prefilter.h"
+#include "utils/regex-stats.h"
+#include "utils/tflite-interpreter-pool.h"
+#include "utils/thread-pool.h"
 #include "utils/utf8/unilib.h"
+#include "utils/warmup.h"
 #include "utils/zlib/zlib.h"
 
 namespace libtextclassifier3 {
 
+namespace mobile {
+namespace lang_id {
+class LangId;
+}  // namespace lang_id
+}  // namespace mobile
+
 // Aliases for long enum values.
 const AnnotationUsecase ANNOTATION_USECASE_SMART =
     AnnotationUsecase_ANNOTATION_USECASE_SMART;
@@ -89,6 +113,14 @@ struct ClassificationOptions {
   // Tailors the output annotations according to the specified use-case.
   AnnotationUsecase annotation_usecase = ANNOTATION_USECASE_SMART;
 
+  // If set, ClassifyText checks it between the classifiers and skips the
+  // remaining ones once it is cancelled. Not owned, must outlive the call.
+  const CancellationToken* cancellation_token = nullptr;
+
+  // If positive, ClassifyText also skips the remaining classifiers once it has
+  // run for this many milliseconds.
+  int64 timeout_ms = 0;
+
   bool operator==(const ClassificationOptions& other) const {
     return this->reference_time_ms_utc == other.reference_time_ms_utc &&
            this->reference_timezone == other.reference_timezone &&
@@ -99,6 +131,31 @@ struct ClassificationOptions {
   }
 };
 
+// Wall time spent by Annotate in each of its phases, in microseconds. The
+// regex, datetime, knowledge and number phases can run on the annotation
+// thread pool, in parallel with the others, so the phases can add up to more
+// than the time of the call.
+struct AnnotatorPhaseTimes {
+  int64 language_detection_us = 0;
+
+  // The phases of the selection and classification models.
+  int64 tokenization_us = 0;
+  int64 feature_extraction_us = 0;
+  int64 selection_inference_us = 0;
+  // Including the extraction of the classification features.
+  int64 classification_inference_us = 0;
+
+  int64 regex_us = 0;
+  int64 datetime_us = 0;
+  int64 knowledge_us = 0;
+  int64 number_us = 0;
+  int64 duration_us = 0;
+  // The contact and installed app engines.
+  int64 other_engines_us = 0;
+
+  int64 conflict_resolution_us = 0;
+};
+
 struct AnnotationOptions {
   // For parsing relative datetimes, the reference now time against which the
   // relative datetimes get resolved.
@@ -121,9 +178,38 @@ struct AnnotationOptions {
   // If true, serialized_entity_data in the results is populated."
   bool is_serialized_entity_data_enabled = false;
 
+  // If true together with is_serialized_entity_data_enabled, the entity data
+  // of the regex annotations is only built when it is needed, by
+  // ClassificationResult::ResolveEntityData (or entity_data()), instead of
+  // for every match.
+  bool defer_serialized_entity_data = false;
+
   // Tailors the output annotations according to the specified use-case.
   AnnotationUsecase annotation_usecase = ANNOTATION_USECASE_SMART;
 
+  // If set, Annotate checks it between lines, rules and conflicting candidates
+  // and returns the annotations found so far once it is cancelled. Not owned,
+  // must outlive the call.
+  const CancellationToken* cancellation_token = nullptr;
+
+  // If positive, Annotate also returns the annotations found so far once it
+  // has run for this many milliseconds.
+  int64 timeout_ms = 0;
+
+  // If set, Annotate adds the time it spends in each of its phases to it. Not
+  // owned, must outlive the call.
+  AnnotatorPhaseTimes* phase_times = nullptr;
+
+  // Which work Annotate skips to stay within a latency budget, see
+  // DegradationPolicy. Degraded results are not cached.
+  DegradationPolicy degradation_policy;
+
+  // If set, Annotate sets it to the AnnotationTier flags of the tiers that ran,
+  // ANNOTATION_TIER_ALL unless the degradation policy skipped some. In a batch
+  // with shared options, the tiers that ran for all the inputs. Not owned,
+  // must outlive the call.
+  int* annotation_tiers = nullptr;
+
   bool operator==(const AnnotationOptions& other) const {
     return this->reference_time_ms_utc == other.reference_time_ms_utc &&
            this->reference_timezone == other.reference_timezone &&
@@ -132,10 +218,27 @@ struct AnnotationOptions {
                other.detected_text_language_tags &&
            this->annotation_usecase == other.annotation_usecase &&
            this->is_serialized_entity_data_enabled ==
-               other.is_serialized_entity_data_enabled;
+               other.is_serialized_entity_data_enabled &&
+           this->defer_serialized_entity_data ==
+               other.defer_serialized_entity_data;
   }
 };
 
+// Pruning of the candidate chunks of the bounds-sensitive selection model in
+// Annotate. The model scores every span of up to max_selection_span tokens
+// around every token of a line, so the candidates grow quadratically with
+// that length. The lines of the text are already chunked separately. Both
+// prunings can drop annotations, so they are off by default.
+struct ChunkPruningOptions {
+  // Drops the candidate spans that cross the end of a sentence, i.e. a token
+  // ending with sentence-final punctuation and followed by whitespace.
+  bool drop_spans_across_sentences = false;
+
+  // Drops the chunks scoring below it before picking the non-overlapping
+  // ones, so that they aren't classified.
+  float min_chunk_score = -std::numeric_limits<float>::infinity();
+};
+
 // Holds TFLite interpreters for selection and classification models.
 // NOTE: his class is not thread-safe, thus should NOT be re-used across
 // threads.
@@ -147,7 +250,23 @@ class InterpreterManager {
   InterpreterManager(const ModelExecutor* selection_executor,
                      const ModelExecutor* classification_executor)
       : selection_executor_(selection_executor),
-        classification_executor_(classification_executor) {}
+        classification_executor_(classification_executor),
+        selection_pool_(nullptr),
+        classification_pool_(nullptr) {}
+
+  // Same as above, but borrows the interpreters from the given pools instead of
+  // building them, and gives them back on destruction. A null pool falls back
+  // to building the interpreter from the corresponding executor.
+  InterpreterManager(const ModelExecutor* selection_executor,
+                     const ModelExecutor* classification_executor,
+                     TfLiteInterpreterPool* selection_pool,
+                     TfLiteInterpreterPool* classification_pool)
+      : selection_executor_(selection_executor),
+        classification_executor_(classification_executor),
+        selection_pool_(selection_pool),
+        classification_pool_(classification_pool) {}
+
+  ~InterpreterManager();
 
   // Gets or creates and caches an interpreter for the selection model.
   tflite::Interpreter* SelectionInterpreter();
@@ -158,6 +277,8 @@ class InterpreterManager {
  private:
   const ModelExecutor* selection_executor_;
   const ModelExecutor* classification_executor_;
+  TfLiteInterpreterPool* selection_pool_;
+  TfLiteInterpreterPool* classification_pool_;
 
   std::unique_ptr<tflite::Interpreter> selection_interpreter_;
   std::unique_ptr<tflite::Interpreter> classification_interpreter_;
@@ -167,17 +288,70 @@ class InterpreterManager {
 // checking whether a given entity type is enabled.
 class EnabledEntityTypes {
  public:
-  explicit EnabledEntityTypes(
-      const std::unordered_set<std::string>& entity_types)
-      : entity_types_(entity_types) {}
+  // The entity types are also looked up in the collections of the model once,
+  // so that the collections with an id are checked without hashing.
+  EnabledEntityTypes(const std::unordered_set<std::string>& entity_types,
+                     const CollectionIdTable& collection_ids)
+      : entity_types_(entity_types) {
+    for (const std::string& entity_type : entity_types_) {
+      enabled_ids_.Insert(collection_ids.Find(entity_type));
+    }
+  }
 
   bool operator()(const std::string& entity_type) const {
     return entity_types_.empty() ||
            entity_types_.find(entity_type) != entity_types_.cend();
   }
 
+  // Same as above, for a collection of the table of the model.
+  bool operator()(int collection_id) const {
+    return entity_types_.empty() || enabled_ids_.Contains(collection_id);
+  }
+
+  // Same as above, for the collection of a result.
+  bool operator()(const ClassificationResult& classification) const {
+    return classification.collection_id != kUnknownCollectionId
+               ? (*this)(classification.collection_id)
+               : (*this)(classification.collection);
+  }
+
+  // Whether all entity types are enabled.
+  bool AllEnabled() const { return entity_types_.empty(); }
+
  private:
   const std::unordered_set<std::string>& entity_types_;
+  CollectionIdSet enabled_ids_;
+};
+
+// Work of SuggestSelection() that can be reused by later calls on the same
+// context with other clicks, see SelectionSession.
+struct SuggestSelectionCache {
+  // The context and options that the rest is valid for.
+  std::string context;
+  SelectionOptions options;
+
+  // Tokens of the context, before they are retokenized for the click.
+  bool has_tokens = false;
+  std::vector<Token> tokens;
+
+  // Candidates of the sources that don't depend on the click: the regex,
+  // datetime and knowledge sources, and the number annotator.
+  bool has_context_candidates = false;
+  std::vector<AnnotatedSpan> regex_datetime_knowledge_candidates;
+  std::vector<AnnotatedSpan> number_candidates;
+
+  // Selection model features of feature_span of the retokenized
+  // feature_tokens.
+  std::vector<Token> feature_tokens;
+  TokenSpan feature_span = {kInvalidIndex, kInvalidIndex};
+  std::unique_ptr<CachedFeatures> features;
+
+  // Number of times the features needed to be extracted.
+  int num_feature_extractions = 0;
+
+  // Drops the cached work if it is not for the given context and options.
+  void ResetIfOtherContext(const std::string& new_context,
+                           const SelectionOptions& new_options);
 };
 
 // A text processing model that provides text classification, annotation,
@@ -185,47 +359,218 @@ class EnabledEntityTypes {
 // NOTE: This class is not thread-safe.
 class Annotator {
  public:
+  // If load_locales (comma-separated BCP 47 locales) is not empty, only the
+  // datetime rules and extractors that can run for these locales are
+  // decompressed and compiled, which makes loading the models of many locales
+  // faster and smaller when only a few of them are served. Requests for other
+  // locales then don't find their datetimes.
   static std::unique_ptr<Annotator> FromUnownedBuffer(
       const char* buffer, int size, const UniLib* unilib = nullptr,
-      const CalendarLib* calendarlib = nullptr);
+      const CalendarLib* calendarlib = nullptr,
+      const std::string& load_locales = "");
   // Takes ownership of the mmap.
   static std::unique_ptr<Annotator> FromScopedMmap(
       std::unique_ptr<ScopedMmap>* mmap, const UniLib* unilib = nullptr,
-      const CalendarLib* calendarlib = nullptr);
+      const CalendarLib* calendarlib = nullptr,
+      const std::string& load_locales = "");
   static std::unique_ptr<Annotator> FromScopedMmap(
       std::unique_ptr<ScopedMmap>* mmap, std::unique_ptr<UniLib> unilib,
-      std::unique_ptr<CalendarLib> calendarlib);
+      std::unique_ptr<CalendarLib> calendarlib,
+      const std::string& load_locales = "");
   static std::unique_ptr<Annotator> FromFileDescriptor(
       int fd, int offset, int size, const UniLib* unilib = nullptr,
-      const CalendarLib* calendarlib = nullptr);
+      const CalendarLib* calendarlib = nullptr,
+      const std::string& load_locales = "");
   static std::unique_ptr<Annotator> FromFileDescriptor(
       int fd, int offset, int size, std::unique_ptr<UniLib> unilib,
-      std::unique_ptr<CalendarLib> calendarlib);
+      std::unique_ptr<CalendarLib> calendarlib,
+      const std::string& load_locales = "");
   static std::unique_ptr<Annotator> FromFileDescriptor(
       int fd, const UniLib* unilib = nullptr,
-      const CalendarLib* calendarlib = nullptr);
+      const CalendarLib* calendarlib = nullptr,
+      const std::string& load_locales = "");
   static std::unique_ptr<Annotator> FromFileDescriptor(
       int fd, std::unique_ptr<UniLib> unilib,
-      std::unique_ptr<CalendarLib> calendarlib);
+      std::unique_ptr<CalendarLib> calendarlib,
+      const std::string& load_locales = "");
   static std::unique_ptr<Annotator> FromPath(
       const std::string& path, const UniLib* unilib = nullptr,
-      const CalendarLib* calendarlib = nullptr);
+      const CalendarLib* calendarlib = nullptr,
+      const std::string& load_locales = "");
   static std::unique_ptr<Annotator> FromPath(
       const std::string& path, std::unique_ptr<UniLib> unilib,
-      std::unique_ptr<CalendarLib> calendarlib);
-
-  // Returns true if the model is ready for use.
+      std::unique_ptr<CalendarLib> calendarlib,
+      const std::string& load_locales = "");
+
+  // Returns true if the model is ready for use. The embedding executor and the
+  // datetime parser are only built on first use, so for them only the
+  // structure of their models is checked up front. If building them fails
+  // later on, e.g. because a datetime pattern doesn't compile, it is logged,
+  // the datetime source finds nothing and the model calls return errors.
   bool IsInitialized() { return initialized_; }
 
+  // Creates a new annotator on top of the same model, sharing everything that
+  // was built from it: the mmap, the executors and their interpreter pools,
+  // the feature processors and embedding caches, the compiled regex patterns
+  // and the datetime parser. This is much cheaper than loading the model
+  // again. The new annotator starts without knowledge, contact and installed
+  // app engines and with its own (disabled) result caches, so it can be
+  // configured independently, e.g. per tenant. It keeps the shared parts
+  // alive on its own, but a UniLib or CalendarLib that is not owned by this
+  // annotator needs to outlive it as well.
+  // Returns nullptr if this annotator is not initialized.
+  std::unique_ptr<Annotator> CloneSharingModel() const;
+
   // Initializes the knowledge engine with the given config.
   bool InitializeKnowledgeEngine(const std::string& serialized_config);
 
   // Initializes the contact engine with the given config.
   bool InitializeContactEngine(const std::string& serialized_config);
 
-  // Initializes the installed app engine with the given config.
+  // Adds a contact to, or replaces a contact with the same id in, the index of
+  // the contact engine, without rebuilding it. Returns false if the contact
+  // engine isn't initialized or the contact can't be indexed.
+  bool AddContact(const ContactEngine::Contact& contact);
+
+  // Removes the contact with the given id from the index of the contact
+  // engine. Returns false if there is no such contact.
+  bool RemoveContact(const std::string& id);
+
+  // Initializes the installed app engine with the given config. Calling it
+  // again, e.g. when apps are installed or removed, rebuilds the app index.
   bool InitializeInstalledAppEngine(const std::string& serialized_config);
 
+  // Sets how many idle TFLite interpreters per model are kept around between
+  // calls, so that they don't have to be rebuilt for every request. A value of
+  // 0 disables the pooling.
+  void SetInterpreterPoolSize(int max_idle_interpreters);
+
+  // Rebuilds the selection and classification executors with the given
+  // options, e.g. to pin the models to one thread or run them on a delegate.
+  // Idle interpreters built with the previous options are dropped. Not
+  // thread-safe, meant to be called after loading, before serving requests.
+  // Returns false if an executor couldn't be rebuilt, in which case the
+  // previous ones are kept.
+  bool SetTfLiteExecutorOptions(const TfLiteExecutorOptions& options);
+
+  // Sets how many token embeddings per feature processor are kept between
+  // calls, so that frequent tokens don't need to be re-embedded in every
+  // request. A value of 0 (the default) disables the cache.
+  void SetEmbeddingCacheCapacity(int max_num_tokens);
+
+  // Returns the combined statistics of the token embedding caches.
+  SharedEmbeddingCacheStats GetEmbeddingCacheStats() const;
+
+  // Sets how many Annotate and ClassifyText results are kept between calls, for
+  // texts that repeat a lot. The results are keyed by a fingerprint of the
+  // text and the options that affect them; their datetimes are resolved
+  // against the reference time of every call. A value of 0 (the default)
+  // disables the caches.
+  void SetResultCacheCapacity(int max_num_results);
+
+  // Returns the combined statistics of the result caches.
+  ResultCacheStats GetResultCacheStats() const;
+
+  // Sets how many resolutions of datetime expressions to absolute times are
+  // kept between calls, so that expressions like "tomorrow" are resolved once
+  // for all the texts with a close reference time and the same timezone. The
+  // cache is shared with the annotators of CloneSharingModel(). A value of 0
+  // (the default) disables it. Doesn't build the datetime parser, which takes
+  // the capacity when it is built.
+  void SetDatetimeResolutionCacheCapacity(int max_num_results);
+
+  // Returns the statistics of the datetime resolution cache, empty until the
+  // datetime parser is built.
+  ResultCacheStats GetDatetimeResolutionCacheStats() const;
+
+  // Sets how many outcomes of the regex match verifications that only depend
+  // on the text of the match are kept between calls, see
+  // VerificationOptions.lua_verifier_reads_only_match_text, so that e.g. the
+  // same order id in every message of a thread is verified once. The cache is
+  // shared with the annotators of CloneSharingModel(). Within a call, these
+  // outcomes are memoized regardless. A value of 0 (the default) disables it.
+  void SetVerificationCacheCapacity(int max_num_results);
+
+  // Returns the statistics of the verification cache.
+  ResultCacheStats GetVerificationCacheStats() const;
+
+  // Starts counting, for every pattern of the regex model and rule of the
+  // datetime model, the matchers created, the Find calls and matches and the
+  // time spent, to find the patterns that are costly on real traffic. A run of
+  // a pattern over a text that takes longer than `slow_run_threshold_us` is
+  // logged, unless it's 0. The counters are shared with the annotators
+  // sharing the model. Doesn't build the lazily built datetime parser, whose
+  // counting starts when it is.
+  void EnableRegexStats(int64 slow_run_threshold_us);
+
+  // Returns the counters of the patterns that ran since EnableRegexStats. The
+  // datetime rules are only included once the datetime parser is built.
+  std::vector<RegexPatternStats> GetRegexStats() const;
+
+  // Sets a thread pool on which the independent annotation sources (regular
+  // expressions, datetime, knowledge and number annotators) are run
+  // concurrently with the ML model during Annotate. The pool is not owned and
+  // needs to outlive the annotator. Passing nullptr runs everything on the
+  // calling thread.
+  void SetAnnotationThreadPool(ThreadPool* thread_pool);
+
+  // Sets how Annotate prunes the candidate chunks of the selection model.
+  // Needs to be called before the annotator is used.
+  void SetChunkPruningOptions(const ChunkPruningOptions& options);
+
+  // Sets a language identifier that Annotate runs on every line of the text
+  // when the caller provides no detected_text_language_tags. Consecutive lines
+  // in the same language form a region: the ML model is then only run on the
+  // regions in a language of ml_model_triggering_locales, and the datetime
+  // patterns of each region are picked for its language in addition to the
+  // requested locales. The LangId is not owned and needs to outlive the
+  // annotator. Passing nullptr disables the detection.
+  void SetLangId(const mobile::lang_id::LangId* lang_id);
+
+  // Compiles the regex patterns of the model (including the datetime ones)
+  // that were created lazily because of lazy_regex_compilation, concurrently
+  // on the thread pool, and waits for them. Right after loading, this moves
+  // the compilation out of the first requests; called from a background
+  // thread, it warms the patterns up off the request path, as it can run
+  // concurrently with requests. Passing nullptr compiles on the calling
+  // thread. Returns false if a pattern failed to compile.
+  bool CompileRegexPatterns(ThreadPool* thread_pool) const;
+
+  // Gets the annotator ready to serve: faults in the TFLite models, compiles
+  // the regex patterns and runs a synthetic text through every enabled mode,
+  // which builds the interpreters, the embedding executor and the datetime
+  // parser. The result cache (if enabled) gets the synthetic entries too.
+  // Returns how long every phase took.
+  WarmupReport Warmup() const;
+
+  // Sections of the model buffer that memory advice can be applied to.
+  enum class ModelSection {
+    kSelectionModel,
+    kClassificationModel,
+    kEmbeddingModel,
+  };
+
+  // Applies the memory access advice to a section of the (typically mmapped)
+  // model, e.g. MmapAdvice::kRandom for the embedding tables, or
+  // MmapAdvice::kWillNeed to page in the TFLite weights in the background.
+  // Returns false if the model has no such section or the advice failed.
+  bool AdviseModelSection(ModelSection section, MmapAdvice advice) const;
+
+  // Faults in all pages of a model section, blocking until they are resident.
+  // Can be called concurrently with the other methods, e.g. from a background
+  // thread right after loading. Returns false if there's no such section.
+  bool PrefaultModelSection(ModelSection section) const;
+
+  // Returns how many bytes of a model section are resident in memory, or -1 if
+  // the model has no such section or the residency couldn't be determined.
+  int64 GetModelSectionResidentBytes(ModelSection section) const;
+
+  // Returns the memory held by the model and by the state kept between calls:
+  // the idle interpreters, the caches and the lua environments. The parts
+  // shared with the clones of the annotator are counted in each of them. The
+  // datetime parser is only counted once it was built.
+  MemoryStats GetMemoryStats() const;
+
   // Runs inference for given a context and current selection (i.e. index
   // of the first and one past last selected characters (utf8 codepoint
   // offsets)). Returns the indices (utf8 codepoint offsets) of the selection
@@ -238,18 +583,89 @@ class Annotator {
       const std::string& context, CodepointSpan click_indices,
       const SelectionOptions& options = SelectionOptions()) const;
 
+  // Same as above, but reuses the work of previous calls on the same context
+  // kept in the cache, and adds its own. The cache can be nullptr.
+  CodepointSpan SuggestSelection(const std::string& context,
+                                 CodepointSpan click_indices,
+                                 const SelectionOptions& options,
+                                 SuggestSelectionCache* cache) const;
+
+  // Suggests the selection of a click as SuggestSelection() does and
+  // classifies the suggested span as ClassifyText() does, with the options of
+  // each. The classification reuses the work of the selection: the TFLite
+  // interpreters, and the tokens of the selection model, from which the
+  // classification model takes the ones around the span when both models
+  // tokenize the same way. Returns the suggested span, or the click if an
+  // error occurs, with its classification, which is empty if an error occurs.
+  AnnotatedSpan SuggestSelectionAndClassify(
+      const std::string& context, CodepointSpan click_indices,
+      const SelectionOptions& selection_options,
+      const ClassificationOptions& classification_options) const;
+
   // Classifies the selected text given the context string.
   // Returns an empty result if an error occurs.
   std::vector<ClassificationResult> ClassifyText(
       const std::string& context, CodepointSpan selection_indices,
       const ClassificationOptions& options = ClassificationOptions()) const;
 
+  // Same as above, but sets 'is_partial' to whether the call stopped early
+  // because of the cancellation token or timeout of the options, in which case
+  // the result only comes from the classifiers that ran. Partial results are
+  // not cached.
+  std::vector<ClassificationResult> ClassifyText(
+      const std::string& context, CodepointSpan selection_indices,
+      const ClassificationOptions& options, bool* is_partial) const;
+
   // Annotates given input text. The annotations are sorted by their position
   // in the context string and exclude spans classified as 'other'.
   std::vector<AnnotatedSpan> Annotate(
       const std::string& context,
       const AnnotationOptions& options = AnnotationOptions()) const;
 
+  // Same as above, but sets 'is_partial' to whether the call stopped early
+  // because of the cancellation token or timeout of the options, in which case
+  // the result holds the annotations found before stopping, with their
+  // conflicts resolved. Partial results are not cached.
+  std::vector<AnnotatedSpan> Annotate(const std::string& context,
+                                      const AnnotationOptions& options,
+                                      bool* is_partial) const;
+
+  // Annotates a batch of input texts that share the same options. The result
+  // for each input is the same as Annotate() would return for it. This is a
+  // convenience over calling Annotate() in a loop: the inputs are annotated
+  // one after the other, and only the per-call setup (locale parsing, TFLite
+  // interpreters) is shared by the batch, the model inference is not batched
+  // across the inputs. The cancellation token and timeout of the options apply
+  // to the whole batch; the inputs after the one that stops get no
+  // annotations.
+  std::vector<std::vector<AnnotatedSpan>> AnnotateBatch(
+      const std::vector<std::string>& contexts,
+      const AnnotationOptions& options = AnnotationOptions()) const;
+
+  // Same as above, but with the options of each input, e.g. for the messages
+  // of a conversation, which have their own reference times and locales. The
+  // cancellation token and timeout of the first options apply to the whole
+  // batch. Sets 'num_complete' to the number of inputs, from the first one,
+  // whose annotations are complete, i.e. not partial.
+  std::vector<std::vector<AnnotatedSpan>> AnnotateBatch(
+      const std::vector<std::string>& contexts,
+      const std::vector<AnnotationOptions>& options, int* num_complete) const;
+
+  // Same as Annotate(), but writes the annotations to the builder as a
+  // finished Annotations flatbuffer, see annotations.fbs, with each collection
+  // name stored once and the entity data embedded. With a builder that
+  // allocates in shared memory, another process reads the annotations in place.
+  void AnnotateToFlatbuffer(const std::string& context,
+                            const AnnotationOptions& options,
+                            flatbuffers::FlatBufferBuilder* builder) const;
+
+  // Same as ClassifyText(), but writes the classification to the builder as a
+  // finished Annotations flatbuffer with the selection as its only span.
+  void ClassifyTextToFlatbuffer(const std::string& context,
+                                CodepointSpan selection_indices,
+                                const ClassificationOptions& options,
+                                flatbuffers::FlatBufferBuilder* builder) const;
+
   // Looks up a knowledge entity by its id. If successful, populates the
   // serialized knowledge result and returns true.
   bool LookUpKnowledgeEntity(const std::string& id,
@@ -258,6 +674,11 @@ class Annotator {
   const Model* model() const;
   const reflection::Schema* entity_data_schema() const;
 
+  // Returns an id of this annotator that is unique in the process. Unlike its
+  // address, it isn't reused by an annotator created after this one is gone,
+  // so that results cached for this one aren't returned for another one.
+  uint64 instance_id() const { return instance_id_; }
+
   // Exposes the feature processor for tests and evaluations.
   const FeatureProcessor* SelectionFeatureProcessorForTests() const;
   const FeatureProcessor* ClassificationFeatureProcessorForTests() const;
@@ -277,18 +698,69 @@ class Annotator {
     float score;
   };
 
+  // Describes one piece of text (e.g. a line of the context) that should be
+  // chunked by the selection model.
+  struct ChunkInput {
+    // The total number of tokens of the text.
+    int num_tokens;
+
+    // Span of all the tokens that could be clicked.
+    TokenSpan span_of_interest;
+
+    // Features extracted for the tokens of the text. Not owned.
+    const CachedFeatures* cached_features;
+
+    // The tokens of the text, if the candidate chunks are pruned by
+    // chunk_pruning_options_. Not owned.
+    const std::vector<Token>* tokens = nullptr;
+  };
+
+  // A run of lines of the context in the same language, as detected by
+  // lang_id_. The regions of a context are contiguous and cover all of it.
+  struct LanguageRegion {
+    // Points into the buffer of the context.
+    StringPiece utf8;
+
+    // Codepoint span of the region in the context.
+    CodepointSpan span;
+
+    // The detected language, as a BCP 47 tag, and parsed.
+    std::string language_tag;
+    std::vector<Locale> locales;
+  };
+
+  // A line of the context being annotated by the ML model.
+  struct AnnotatedLine {
+    // Points into the buffer of the context.
+    StringPiece line_str;
+
+    // Codepoint offset of the line in the context.
+    int offset;
+
+    // The locales the line is classified with.
+    const std::vector<Locale>* detected_text_language_tags;
+
+    std::vector<Token> tokens;
+    std::unique_ptr<CachedFeatures> cached_features;
+  };
+
   // Constructs and initializes text classifier from given model.
   // Takes ownership of 'mmap', and thus owns the buffer that backs 'model'.
   Annotator(std::unique_ptr<ScopedMmap>* mmap, const Model* model,
-            const UniLib* unilib, const CalendarLib* calendarlib);
+            const UniLib* unilib, const CalendarLib* calendarlib,
+            const std::string& load_locales);
   Annotator(std::unique_ptr<ScopedMmap>* mmap, const Model* model,
             std::unique_ptr<UniLib> unilib,
-            std::unique_ptr<CalendarLib> calendarlib);
+            std::unique_ptr<CalendarLib> calendarlib,
+            const std::string& load_locales);
 
   // Constructs, validates and initializes text classifier from given model.
   // Does not own the buffer that backs 'model'.
   Annotator(const Model* model, const UniLib* unilib,
-            const CalendarLib* calendarlib);
+            const CalendarLib* calendarlib, const std::string& load_locales);
+
+  // Constructs an uninitialized annotator, filled in by CloneSharingModel().
+  Annotator() = default;
 
   // Checks that model contains all required fields, and initializes internal
   // datastructures.
@@ -301,34 +773,68 @@ class Annotator {
   // ones. Returns indices of the surviving ones.
   // NOTE: Assumes that the candidates are sorted according to their position in
   // the span.
+  // Once 'stop' says to stop, the candidates that still need a classification
+  // are no longer classified and lose their conflicts.
   bool ResolveConflicts(const std::vector<AnnotatedSpan>& candidates,
                         const std::string& context,
                         const std::vector<Token>& cached_tokens,
                         const std::vector<Locale>& detected_text_language_tags,
                         AnnotationUsecase annotation_usecase,
                         InterpreterManager* interpreter_manager,
-                        std::vector<int>* result) const;
+                        std::vector<int>* result,
+                        const StopCondition* stop = nullptr) const;
 
   // Resolves one conflict between candidates on indices 'start_index'
-  // (inclusive) and 'end_index' (exclusive). Assigns the winning candidate
-  // indices to 'chosen_indices'. Returns false if a problem arises.
-  bool ResolveConflict(const std::string& context,
-                       const std::vector<Token>& cached_tokens,
-                       const std::vector<AnnotatedSpan>& candidates,
-                       const std::vector<Locale>& detected_text_language_tags,
-                       int start_index, int end_index,
-                       AnnotationUsecase annotation_usecase,
-                       InterpreterManager* interpreter_manager,
+  // (inclusive) and 'end_index' (exclusive), using the given priority scores
+  // of the candidates (indexed like 'candidates'). Assigns the winning
+  // candidate indices to 'chosen_indices'.
+  void ResolveConflict(const std::vector<AnnotatedSpan>& candidates,
+                       const std::vector<float>& scores, int start_index,
+                       int end_index, AnnotationUsecase annotation_usecase,
                        std::vector<int>* chosen_indices) const;
 
+  // Returns whether a candidate of the sources that don't depend on the click
+  // contains the click with a priority score that the selection model can't
+  // reach, see SelectionModelOptions.skip_model_min_priority_score. The model
+  // doesn't need to run then.
+  bool IsSelectionDecidedByRules(const SuggestSelectionCache& context_cache,
+                                 CodepointSpan click_indices) const;
+
+  // Same as the public SuggestSelection(), but with the interpreters of the
+  // caller, and sets 'tokens' to the tokens the selection ended with.
+  CodepointSpan SuggestSelection(const std::string& context,
+                                 CodepointSpan click_indices,
+                                 const SelectionOptions& options,
+                                 SuggestSelectionCache* cache,
+                                 InterpreterManager* interpreter_manager,
+                                 std::vector<Token>* tokens) const;
+
+  // Same as the public ClassifyText(), but with the interpreters of the
+  // caller, and with the tokens of a previous call on the context for the
+  // classification model to reuse. 'cached_tokens' can be empty.
+  std::vector<ClassificationResult> ClassifyText(
+      const std::string& context, CodepointSpan selection_indices,
+      const ClassificationOptions& options,
+      const std::vector<Token>& cached_tokens,
+      InterpreterManager* interpreter_manager, bool* is_partial) const;
+
+  // Returns whether one of the regex results of a classification has a
+  // priority score that the later sources can't reach, see
+  // ClassificationModelOptions.skip_later_sources_min_priority_score. They
+  // don't need to run then.
+  bool IsClassificationDecidedByRules(
+      const std::vector<ClassificationResult>& regex_results) const;
+
   // Gets selection candidates from the ML model.
   // Provides the tokens produced during tokenization of the context string for
   // reuse.
+  // Reuses the tokens and features in the cache if it's not nullptr.
   bool ModelSuggestSelection(
       const UnicodeText& context_unicode, CodepointSpan click_indices,
       const std::vector<Locale>& detected_text_language_tags,
       InterpreterManager* interpreter_manager, std::vector<Token>* tokens,
-      std::vector<AnnotatedSpan>* result) const;
+      std::vector<AnnotatedSpan>* result,
+      SuggestSelectionCache* cache = nullptr) const;
 
   // Classifies the selected text given the context string with the
   // classification model.
@@ -357,6 +863,41 @@ class Annotator {
       FeatureProcessor::EmbeddingCache* embedding_cache,
       std::vector<ClassificationResult>* classification_results) const;
 
+  // Classifies several spans of the same context with a single inference of
+  // the classification model. Outputs one list of results per span, in the
+  // order of the selection_indices.
+  // Returns true if no error occurred.
+  bool ModelClassifyTexts(
+      const std::string& context, const std::vector<Token>& cached_tokens,
+      const std::vector<Locale>& detected_text_language_tags,
+      const std::vector<CodepointSpan>& selection_indices,
+      InterpreterManager* interpreter_manager,
+      FeatureProcessor::EmbeddingCache* embedding_cache,
+      std::vector<std::vector<ClassificationResult>>* classification_results)
+      const;
+
+  // Tokenizes the context and extracts the classification model input
+  // features for the selection. If the result can be determined without
+  // running the model, it is written to classification_results and the
+  // features are left empty.
+  // Returns true if no error occurred.
+  bool ExtractClassificationFeatures(
+      const std::string& context, const std::vector<Token>& cached_tokens,
+      CodepointSpan selection_indices,
+      FeatureProcessor::EmbeddingCache* embedding_cache,
+      std::vector<Token>* tokens, std::vector<float>* features,
+      int* selection_num_tokens,
+      std::vector<ClassificationResult>* classification_results) const;
+
+  // Turns the classification model logits for a selection into the
+  // classification result, applying the collection sanity checks.
+  void ClassificationResultsFromLogits(
+      const std::string& context,
+      const std::vector<Locale>& detected_text_language_tags,
+      CodepointSpan selection_indices, int selection_num_tokens,
+      const float* logits, int num_logits,
+      std::vector<ClassificationResult>* classification_results) const;
+
   // Returns a relative token span that represents how many tokens on the left
   // from the selection and right from the selection are needed for the
   // classifier input.
@@ -368,7 +909,8 @@ class Annotator {
       const std::string& context, CodepointSpan selection_indices,
       std::vector<ClassificationResult>* classification_result) const;
 
-  // Classifies the selected text with the date time model.
+  // Classifies the selected text with the date time model. The datetimes are
+  // not resolved to an absolute time yet, see ResolveDatetimeClassifications().
   // Returns true if no error happened, false otherwise.
   bool DatetimeClassifyText(
       const std::string& context, CodepointSpan selection_indices,
@@ -381,11 +923,18 @@ class Annotator {
   // exclude spans classified as 'other'.
   // Provides the tokens produced during tokenization of the context string for
   // reuse.
+  // If "language_regions" are given, the lines are gated and classified with
+  // the locales of their region instead of "detected_text_language_tags".
+  // Stops between lines once 'stop' says to, keeping the spans found so far.
+  // Adds the time of its phases to "phase_times", if set.
   bool ModelAnnotate(const std::string& context,
                      const std::vector<Locale>& detected_text_language_tags,
+                     const std::vector<LanguageRegion>& language_regions,
                      InterpreterManager* interpreter_manager,
                      std::vector<Token>* tokens,
-                     std::vector<AnnotatedSpan>* result) const;
+                     std::vector<AnnotatedSpan>* result,
+                     const StopCondition* stop = nullptr,
+                     AnnotatorPhaseTimes* phase_times = nullptr) const;
 
   // Groups the tokens into chunks. A chunk is a token span that should be the
   // suggested selection when any of its contained tokens is clicked. The chunks
@@ -401,38 +950,92 @@ class Annotator {
                   const CachedFeatures& cached_features,
                   std::vector<TokenSpan>* chunks) const;
 
+  // Same as above, but chunks several inputs at once. The inference batches of
+  // the selection model are shared between the inputs, so that many small
+  // inputs (e.g. lines) don't each need their own model invocations.
+  // Returns the chunks of each input in 'chunks', in the order of 'inputs'.
+  bool ModelChunk(const std::vector<ChunkInput>& inputs,
+                  tflite::Interpreter* selection_interpreter,
+                  std::vector<std::vector<TokenSpan>>* chunks) const;
+
+  // Returns the span of tokens that the chunks of the input can cover.
+  TokenSpan InferenceSpan(const ChunkInput& input) const;
+
+  // Greedily picks the highest scoring chunks that don't overlap. The scored
+  // chunks get sorted by score. The chunks are output sorted by position.
+  void SelectNonOverlappingChunks(const TokenSpan& inference_span,
+                                  std::vector<ScoredChunk>* scored_chunks,
+                                  std::vector<TokenSpan>* chunks) const;
+
   // A helper method for ModelChunk(). It generates scored chunk candidates for
-  // a click context model.
+  // a click context model, for each of the inputs.
   // NOTE: The returned chunks can (and most likely do) overlap.
   bool ModelClickContextScoreChunks(
-      int num_tokens, const TokenSpan& span_of_interest,
-      const CachedFeatures& cached_features,
+      const std::vector<ChunkInput>& inputs,
       tflite::Interpreter* selection_interpreter,
-      std::vector<ScoredChunk>* scored_chunks) const;
+      std::vector<std::vector<ScoredChunk>>* scored_chunks) const;
 
   // A helper method for ModelChunk(). It generates scored chunk candidates for
-  // a bounds-sensitive model.
+  // a bounds-sensitive model, for each of the inputs.
   // NOTE: The returned chunks can (and most likely do) overlap.
   bool ModelBoundsSensitiveScoreChunks(
-      int num_tokens, const TokenSpan& span_of_interest,
-      const TokenSpan& inference_span, const CachedFeatures& cached_features,
+      const std::vector<ChunkInput>& inputs,
       tflite::Interpreter* selection_interpreter,
-      std::vector<ScoredChunk>* scored_chunks) const;
+      std::vector<std::vector<ScoredChunk>>* scored_chunks) const;
+
+  // How RegexChunk provides the entity data of the matches.
+  enum class EntityDataMode {
+    kNone,
+    kSerialized,
+    // As ClassificationResult::lazy_entity_data.
+    kDeferred,
+  };
 
-  // Produces chunks isolated by a set of regular expressions.
+  // Produces chunks isolated by a set of regular expressions. Stops between
+  // rules once 'stop' says to.
   bool RegexChunk(const UnicodeText& context_unicode,
                   const std::vector<int>& rules,
                   std::vector<AnnotatedSpan>* result,
-                  bool is_serialized_entity_data_enabled) const;
+                  EntityDataMode entity_data_mode,
+                  const StopCondition* stop = nullptr) const;
 
-  // Produces chunks from the datetime parser.
+  // Produces chunks from the datetime parser. The datetimes are not resolved
+  // to an absolute time yet, see ResolveDatetimes(). Stops between datetime
+  // rules once 'stop' says to.
   bool DatetimeChunk(const UnicodeText& context_unicode,
-                     int64 reference_time_ms_utc,
-                     const std::string& reference_timezone,
                      const std::string& locales, ModeFlag mode,
                      AnnotationUsecase annotation_usecase,
-                     bool is_serialized_entity_data_enabled,
-                     std::vector<AnnotatedSpan>* result) const;
+                     std::vector<AnnotatedSpan>* result,
+                     const StopCondition* stop = nullptr) const;
+
+  // Resolves the datetime classifications produced by DatetimeChunk() to an
+  // absolute time, and adds their entity data if enabled.
+  bool ResolveDatetimes(int64 reference_time_ms_utc,
+                        const std::string& reference_timezone,
+                        const std::string& locales,
+                        bool is_serialized_entity_data_enabled,
+                        std::vector<AnnotatedSpan>* spans) const;
+
+  // Same as above, for the classifications of one span.
+  bool ResolveDatetimeClassifications(
+      int64 reference_time_ms_utc, const std::string& reference_timezone,
+      const std::string& locales, bool is_serialized_entity_data_enabled,
+      std::vector<ClassificationResult>* classifications) const;
+
+  // Annotates one input text with all the annotation sources and resolves
+  // conflicts between them. Expects that the model triggering locales were
+  // already checked by the caller. Once 'stop' says to stop, the remaining
+  // work is skipped and the result is not cached.
+  bool AnnotateSingleInput(
+      const std::string& context, const AnnotationOptions& options,
+      const std::vector<Locale>& detected_text_language_tags,
+      InterpreterManager* interpreter_manager, const StopCondition* stop,
+      std::vector<AnnotatedSpan>* result) const;
+
+  // Resolves the datetimes of the annotations of one input text and sorts
+  // their classifications.
+  bool FinishAnnotation(const AnnotationOptions& options,
+                        std::vector<AnnotatedSpan>* result) const;
 
   // Returns whether a classification should be filtered.
   bool FilteredForAnnotation(const AnnotatedSpan& span) const;
@@ -448,78 +1051,304 @@ class Annotator {
   // Returns whether a regex pattern provides entity data from a match.
   bool HasEntityData(const RegexModel_::Pattern* pattern) const;
 
-  // Constructs and serializes entity data from regex matches.
-  bool SerializedEntityDataFromRegexMatch(
-      const RegexModel_::Pattern* pattern, UniLib::RegexMatcher* matcher,
-      std::string* serialized_entity_data) const;
+  // The embedding executor and the datetime parser are only built on first
+  // use, so that processes which never need them don't pay for them. Return
+  // nullptr if the model doesn't have them or they couldn't be built.
+  const EmbeddingExecutor* GetEmbeddingExecutor() const;
+  const DatetimeParser* GetDatetimeParser() const;
 
   // Verifies a regex match and returns true if verification was successful.
+  // `match` is only read for the checksum verification.
   bool VerifyRegexMatchCandidate(
-      const std::string& context,
-      const VerificationOptions* verification_options, const std::string& match,
-      const UniLib::RegexMatcher* matcher) const;
+      StringPiece context, const VerificationOptions* verification_options,
+      const std::string& match, const UniLib::RegexMatcher* matcher) const;
+
+  // Same as above for a match of the pattern, but if the outcome only depends
+  // on the text of the match, it's looked up in and added to
+  // 'verified_matches', the outcomes of the call for the pattern by match
+  // text, which can be nullptr, and the verification cache.
+  bool VerifyRegexMatchCandidate(
+      int pattern_id, StringPiece context,
+      const VerificationOptions* verification_options,
+      const std::string& match, const UniLib::RegexMatcher* matcher,
+      std::unordered_map<std::string, bool>* verified_matches) const;
+
+  // Parts of the model that are only built on first use.
+  struct LazyModelParts {
+    std::once_flag embedding_executor_once;
+    std::unique_ptr<const EmbeddingExecutor> embedding_executor;
+    std::once_flag datetime_parser_once;
+    std::unique_ptr<const DatetimeParser> datetime_parser;
+
+    // Set once datetime_parser was built, to look at it without building it.
+    std::atomic<bool> datetime_parser_initialized{false};
+
+    // The capacity of the resolution cache of datetime_parser and whether
+    // its regex stats are enabled, with their threshold, applied when it is
+    // built. The mutex guards setting them against the parser being built.
+    std::mutex datetime_settings_mutex;
+    int resolution_cache_capacity = 0;
+    bool regex_stats_enabled = false;
+    int64 regex_stats_slow_run_threshold_us = 0;
+  };
+
+  // Builds the datetime parser of the lazy parts, decompressing its patterns
+  // with the given decompressor.
+  void InitializeDatetimeParser(ZlibDecompressor* decompressor,
+                                LazyModelParts* parts) const;
+
+  // NOTE: Everything built from the model alone is held by shared pointers,
+  // so that CloneSharingModel() can share it between annotators.
+  const Model* model_ = nullptr;
+
+  std::shared_ptr<const ModelExecutor> selection_executor_;
+  std::shared_ptr<const ModelExecutor> classification_executor_;
+  std::shared_ptr<LazyModelParts> lazy_model_parts_ =
+      std::make_shared<LazyModelParts>();
+
+  // Token embeddings kept between calls, used by the feature processors.
+  std::shared_ptr<SharedEmbeddingCache> selection_embedding_cache_ =
+      std::make_shared<SharedEmbeddingCache>(
+          /*capacity=*/0, SharedEmbeddingCache::kDefaultNumShards);
+  std::shared_ptr<SharedEmbeddingCache> classification_embedding_cache_ =
+      std::make_shared<SharedEmbeddingCache>(
+          /*capacity=*/0, SharedEmbeddingCache::kDefaultNumShards);
+
+  // Results of Annotate and ClassifyText kept between calls, with their
+  // datetimes unresolved.
+  mutable ResultCache<std::vector<AnnotatedSpan>> annotation_result_cache_;
+  mutable ResultCache<std::vector<ClassificationResult>>
+      classification_result_cache_;
+
+  // Outcomes of the verifications that only depend on the text of the match,
+  // by pattern and match text.
+  std::shared_ptr<ResultCache<bool>> verification_cache_ =
+      std::make_shared<ResultCache<bool>>();
+
+  // The cost of Annotate, for the degradation policies of the calls.
+  std::shared_ptr<AnnotationCostModel> annotation_cost_model_ =
+      std::make_shared<AnnotationCostModel>();
+
+  std::shared_ptr<const FeatureProcessor> selection_feature_processor_;
+  std::shared_ptr<const FeatureProcessor> classification_feature_processor_;
+
+  // Whether the classification feature processor can reuse the tokens of the
+  // selection feature processor, as they tokenize the same way.
+  bool classification_reuses_selection_tokens_ = false;
 
-  const Model* model_;
+  // Interpreters kept between calls for the selection and classification
+  // models.
+  std::shared_ptr<TfLiteInterpreterPool> selection_interpreter_pool_;
+  std::shared_ptr<TfLiteInterpreterPool> classification_interpreter_pool_;
 
-  std::unique_ptr<const ModelExecutor> selection_executor_;
-  std::unique_ptr<const ModelExecutor> classification_executor_;
-  std::unique_ptr<const EmbeddingExecutor> embedding_executor_;
+  // Not owned, can be nullptr.
+  ThreadPool* annotation_thread_pool_ = nullptr;
 
-  std::unique_ptr<const FeatureProcessor> selection_feature_processor_;
-  std::unique_ptr<const FeatureProcessor> classification_feature_processor_;
+  ChunkPruningOptions chunk_pruning_options_;
 
-  std::unique_ptr<const DatetimeParser> datetime_parser_;
+  // Not owned, see SetLangId().
+  const mobile::lang_id::LangId* lang_id_ = nullptr;
 
  private:
+  // Returns the buffer of the model section, or nullptr if it is missing.
+  const flatbuffers::Vector<uint8_t>* GetModelSection(
+      ModelSection section) const;
+
   struct CompiledRegexPattern {
     const RegexModel_::Pattern* config;
-    std::unique_ptr<UniLib::RegexPattern> pattern;
+    std::shared_ptr<const UniLib::RegexPattern> pattern;
+
+    // Id in regex_literals_ of a literal that every match of the pattern
+    // contains, or -1 if there is none.
+    int required_literal_id;
+
+    // Literal the text needs to start with, and the length of a run of digits
+    // it needs to contain (0 if none) for the pattern to match.
+    std::string required_prefix;
+    int required_digit_run;
+
+    // Id of the collection of the pattern in collection_ids_.
+    int collection_id;
+
+    // The entity data fields of the capturing groups, resolved against the
+    // entity data schema. Empty for the groups without an entity data field.
+    std::vector<ResolvedFieldPath> capturing_group_paths;
+
+    // Returns whether the pattern can match in the text, given which of the
+    // regex_literals_ the text contains and its runs of digits.
+    bool MayMatch(StringPiece text, const std::vector<bool>& found_literals,
+                  const DigitRunMap& digit_runs) const;
+  };
+
+  // Constructs and serializes entity data from regex matches.
+  bool SerializedEntityDataFromRegexMatch(
+      const CompiledRegexPattern& regex_pattern, UniLib::RegexMatcher* matcher,
+      std::string* serialized_entity_data) const;
+
+  // Gets the texts of the capturing groups of a match that set entity data
+  // fields, by group. Returns false if one of them is not part of the match.
+  bool EntityDataGroupTexts(const CompiledRegexPattern& regex_pattern,
+                            const UniLib::RegexMatcher* matcher,
+                            std::vector<std::string>* group_texts) const;
+
+  // Constructs and serializes the entity data of a regex match from the texts
+  // of its capturing groups, see EntityDataGroupTexts.
+  bool SerializedEntityDataFromGroupTexts(
+      const CompiledRegexPattern& regex_pattern,
+      const std::vector<std::string>& group_texts,
+      std::string* serialized_entity_data) const;
+
+  // The deferred entity data of a regex match.
+  class RegexEntityData;
+
+  // The annotation sources to run for an annotation request. The ML model
+  // includes the contact, installed app and duration sources, as they use its
+  // tokens.
+  struct AnnotationSources {
+    // Indices into regex_patterns_ of the regex rules to run.
+    std::vector<int> regex_rules;
+    bool model = false;
+    bool datetime = false;
+    bool knowledge = false;
+    bool number = false;
+
+    // Whether the datetimes are parsed with the languages detected in each
+    // region too, or only with the locales of the options.
+    bool datetime_language_regions = true;
+
+    bool IsEmpty() const;
+  };
+
+  // The candidates found by the annotation sources, by source.
+  struct AnnotationCandidates {
+    // Tokens of the context produced by the ML model.
+    std::vector<Token> tokens;
+
+    std::vector<AnnotatedSpan> model, regex, datetime, knowledge, contact,
+        installed_app, number, duration;
+
+    // Returns whether any candidate has an enabled entity type.
+    bool HasEnabled(const EnabledEntityTypes& is_entity_type_enabled) const;
   };
 
+  // Splits the annotation sources into the ones that can produce one of the
+  // enabled entity types, and the remaining ones. Sources that are disabled
+  // together with their entity types (datetime, duration) are never run.
+  void PlanAnnotationSources(const EnabledEntityTypes& is_entity_type_enabled,
+                             AnnotationSources* producing,
+                             AnnotationSources* remaining) const;
+
+  // Detects the language of every line of the context with lang_id_ and groups
+  // them into regions. Lines in an unknown language (e.g. too short to tell)
+  // join the region before them, or the first region. Leaves "regions" empty
+  // if no line has a known language. Adds the distinct languages to
+  // "detected_text_language_tags".
+  void DetectLanguageRegions(const UnicodeText& context_unicode,
+                             std::vector<LanguageRegion>* regions,
+                             std::vector<Locale>* detected_text_language_tags)
+      const;
+
+  // Runs the datetime parser on the context, or on every region separately
+  // with its language added to "locales" if there are "language_regions".
+  bool DatetimeChunkLanguageRegions(
+      const UnicodeText& context_unicode, const std::string& locales,
+      const std::vector<LanguageRegion>& language_regions,
+      AnnotationUsecase annotation_usecase, const StopCondition* stop,
+      std::vector<AnnotatedSpan>* result) const;
+
+  // Runs the given annotation sources on the context, adding their candidates.
+  // Once 'stop' says to stop, the sources keep what they found so far and the
+  // remaining ones don't run.
+  bool RunAnnotationSources(
+      const std::string& context, const UnicodeText& context_unicode,
+      const AnnotationOptions& options,
+      const EnabledEntityTypes& is_entity_type_enabled,
+      const std::vector<Locale>& detected_text_language_tags,
+      const std::vector<LanguageRegion>& language_regions,
+      const AnnotationSources& sources,
+      InterpreterManager* interpreter_manager, const StopCondition* stop,
+      AnnotationCandidates* candidates) const;
+
+  // Drops the cached results, when a change of the annotator makes them stale.
+  void ClearResultCaches();
+
   // Removes annotations the entity type of which is not in the set of enabled
   // entity types.
   void RemoveNotEnabledEntityTypes(
       const EnabledEntityTypes& is_entity_type_enabled,
       std::vector<AnnotatedSpan>* annotated_spans) const;
 
-  std::unique_ptr<ScopedMmap> mmap_;
+  std::shared_ptr<ScopedMmap> mmap_;
   bool initialized_ = false;
   bool enabled_for_annotation_ = false;
   bool enabled_for_classification_ = false;
   bool enabled_for_selection_ = false;
-  std::unordered_set<std::string> filtered_collections_annotation_;
-  std::unordered_set<std::string> filtered_collections_classification_;
-  std::unordered_set<std::string> filtered_collections_selection_;
+  // The collections of the model: those of the classification model, of the
+  // regex patterns and of the output options. The results of the
+  // classification model and of the regex patterns carry their ids.
+  CollectionIdTable collection_ids_;
+
+  // Ids of the collections of the classification model, by label.
+  std::vector<int> model_collection_ids_;
+
+  CollectionIdSet filtered_collections_annotation_;
+  CollectionIdSet filtered_collections_classification_;
+  CollectionIdSet filtered_collections_selection_;
 
   std::vector<CompiledRegexPattern> regex_patterns_;
 
+  // The cost counters of regex_patterns_, by index.
+  std::shared_ptr<RegexStats> regex_stats_;
+
+  // Size of the source of regex_patterns_.
+  int64 regex_pattern_bytes_ = 0;
+
+  // The literals required by the regex patterns, looked for in the text in one
+  // pass before running the patterns.
+  LiteralSetMatcher regex_literals_;
+
+  // Verifiers for the lua verifier snippets of the regex model, by index.
+  std::vector<std::shared_ptr<const LuaMatchVerifier>> lua_verifiers_;
+
   // Indices into regex_patterns_ for the different modes.
   std::vector<int> annotation_regex_patterns_, classification_regex_patterns_,
       selection_regex_patterns_;
 
-  std::unique_ptr<UniLib> owned_unilib_;
-  const UniLib* unilib_;
-  std::unique_ptr<CalendarLib> owned_calendarlib_;
-  const CalendarLib* calendarlib_;
+  std::shared_ptr<UniLib> owned_unilib_;
+  const UniLib* unilib_ = nullptr;
+  std::shared_ptr<CalendarLib> owned_calendarlib_;
+  const CalendarLib* calendarlib_ = nullptr;
+
+  // The locales the datetime parser is loaded for, all if empty.
+  std::string load_locales_;
 
   std::unique_ptr<const KnowledgeEngine> knowledge_engine_;
-  std::unique_ptr<const ContactEngine> contact_engine_;
-  std::unique_ptr<const InstalledAppEngine> installed_app_engine_;
-  std::unique_ptr<const NumberAnnotator> number_annotator_;
-  std::unique_ptr<const DurationAnnotator> duration_annotator_;
+  std::unique_ptr<ContactEngine> contact_engine_;
+  std::unique_ptr<InstalledAppEngine> installed_app_engine_;
+  std::shared_ptr<const NumberAnnotator> number_annotator_;
+  std::shared_ptr<const DurationAnnotator> duration_annotator_;
 
   // Builder for creating extra data.
-  const reflection::Schema* entity_data_schema_;
-  std::unique_ptr<ReflectiveFlatbufferBuilder> entity_data_builder_;
+  const reflection::Schema* entity_data_schema_ = nullptr;
+  std::shared_ptr<const ReflectiveFlatbufferBuilder> entity_data_builder_;
+
+  // The lists of supported locales of the model, shared with the clones.
+  std::shared_ptr<LocaleTable> locale_table_;
+
+  // Ids in locale_table_ of the locales for which the entire model triggers.
+  int model_triggering_locales_ = -1;
+
+  // Ids in locale_table_ of the locales for which the ML model triggers.
+  int ml_model_triggering_locales_ = -1;
 
-  // Locales for which the entire model triggers.
-  std::vector<Locale> model_triggering_locales_;
+  // Ids in locale_table_ of the locales that the dictionary classification
+  // support.
+  int dictionary_locales_ = -1;
 
-  // Locales for which the ML model triggers.
-  std::vector<Locale> ml_model_triggering_locales_;
+  // Returns the next id of instance_id().
+  static uint64 NextInstanceId();
 
-  // Locales that the dictionary classification support.
-  std::vector<Locale> dictionary_locales_;
+  uint64 instance_id_ = NextInstanceId();
 };
 
 namespace internal {
@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "annotator/annotator.h"
+#include "annotator/datetime/parser.h"
+#include "utils/flatbuffers.h"
+#include "utils/testing/benchmark-utils.h"
+#include "utils/testing/worst-case-search.h"
+#include "utils/utf8/unicodetext.h"
+#include "benchmark/benchmark.h"
+#include "flatbuffers/reflection_generated.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+// The shipped models the benchmarks run with, selected by the second argument.
+const char* const kModelFilenames[] = {"textclassifier.en.model",
+                                       "textclassifier.universal.model"};
+constexpr int kNumModels = 2;
+
+const Annotator* GetAnnotator(int model_index) {
+  static std::unique_ptr<Annotator>* const annotators =
+      new std::unique_ptr<Annotator>[kNumModels];
+  std::unique_ptr<Annotator>& annotator = annotators[model_index];
+  if (annotator == nullptr) {
+    annotator =
+        Annotator::FromPath(BenchmarkModelPath(kModelFilenames[model_index]));
+  }
+  return annotator.get();
+}
+
+// Returns the span of the whitespace-separated token in the middle of the
+// text, standing in for what the user taps on.
+CodepointSpan MiddleTokenSpan(const std::string& text) {
+  const UnicodeText unicode = UTF8ToUnicodeText(text, /*do_copy=*/false);
+  std::vector<CodepointSpan> tokens;
+  int index = 0;
+  int token_start = -1;
+  for (const char32 codepoint : unicode) {
+    const bool is_space =
+        codepoint == ' ' || codepoint == '\n' || codepoint == '\t';
+    if (is_space && token_start >= 0) {
+      tokens.push_back({token_start, index});
+      token_start = -1;
+    } else if (!is_space && token_start < 0) {
+      token_start = index;
+    }
+    ++index;
+  }
+  if (token_start >= 0) {
+    tokens.push_back({token_start, index});
+  }
+  return tokens.empty() ? CodepointSpan{0, 1} : tokens[tokens.size() / 2];
+}
+
+// Sets up a benchmark on the corpus and model of the arguments, or skips it
+// if the model isn't available. Returns the annotator.
+const Annotator* SetUp(benchmark::State& state,
+                       const std::vector<std::string>** texts,
+                       int64* bytes_per_call) {
+  const BenchmarkCorpus corpus = static_cast<BenchmarkCorpus>(state.range(0));
+  const Annotator* annotator = GetAnnotator(state.range(1));
+  if (annotator == nullptr) {
+    state.SkipWithError("Couldn't load the model.");
+    return nullptr;
+  }
+  state.SetLabel(BenchmarkCorpusName(corpus) + "/" +
+                 kModelFilenames[state.range(1)]);
+  *texts = &BenchmarkCorpusTexts(corpus);
+  int64 num_bytes = 0;
+  for (const std::string& text : **texts) {
+    num_bytes += text.size();
+  }
+  *bytes_per_call = num_bytes / (*texts)->size();
+  return annotator;
+}
+
+void CorporaAndModels(benchmark::internal::Benchmark* benchmark) {
+  for (int corpus = 0; corpus < kNumBenchmarkCorpora; ++corpus) {
+    for (int model = 0; model < kNumModels; ++model) {
+      benchmark->Args({corpus, model});
+    }
+  }
+}
+
+void BM_SuggestSelection(benchmark::State& state) {
+  const std::vector<std::string>* texts;
+  int64 bytes_per_call;
+  const Annotator* annotator = SetUp(state, &texts, &bytes_per_call);
+  if (annotator == nullptr) {
+    return;
+  }
+  std::vector<CodepointSpan> clicks;
+  for (const std::string& text : *texts) {
+    const CodepointSpan token = MiddleTokenSpan(text);
+    clicks.push_back({token.first, token.first + 1});
+  }
+
+  int i = 0;
+  RunMeasuredBenchmark(state, bytes_per_call, [&]() {
+    benchmark::DoNotOptimize(
+        annotator->SuggestSelection((*texts)[i], clicks[i]));
+    i = (i + 1) % texts->size();
+  });
+}
+BENCHMARK(BM_SuggestSelection)->Apply(CorporaAndModels);
+
+void BM_ClassifyText(benchmark::State& state) {
+  const std::vector<std::string>* texts;
+  int64 bytes_per_call;
+  const Annotator* annotator = SetUp(state, &texts, &bytes_per_call);
+  if (annotator == nullptr) {
+    return;
+  }
+  std::vector<CodepointSpan> selections;
+  for (const std::string& text : *texts) {
+    selections.push_back(MiddleTokenSpan(text));
+  }
+
+  int i = 0;
+  RunMeasuredBenchmark(state, bytes_per_call, [&]() {
+    benchmark::DoNotOptimize(
+        annotator->ClassifyText((*texts)[i], selections[i]));
+    i = (i + 1) % texts->size();
+  });
+}
+BENCHMARK(BM_ClassifyText)->Apply(CorporaAndModels);
+
+void BM_Annotate(benchmark::State& state) {
+  const std::vector<std::string>* texts;
+  int64 bytes_per_call;
+  const Annotator* annotator = SetUp(state, &texts, &bytes_per_call);
+  if (annotator == nullptr) {
+    return;
+  }
+
+  int i = 0;
+  RunMeasuredBenchmark(state, bytes_per_call, [&]() {
+    benchmark::DoNotOptimize(annotator->Annotate((*texts)[i]));
+    i = (i + 1) % texts->size();
+  });
+}
+BENCHMARK(BM_Annotate)->Apply(CorporaAndModels);
+
+// The pathological inputs, on the English model.
+void BM_AnnotateWorstCase(benchmark::State& state) {
+  const Annotator* annotator = GetAnnotator(/*model_index=*/0);
+  if (annotator == nullptr) {
+    state.SkipWithError("Couldn't load the model.");
+    return;
+  }
+  const WorstCaseInput input = static_cast<WorstCaseInput>(state.range(0));
+  state.SetLabel(WorstCaseInputName(input));
+  const std::string text = WorstCaseInputText(input, state.range(1));
+
+  RunMeasuredBenchmark(state, text.size(), [&]() {
+    benchmark::DoNotOptimize(annotator->Annotate(text));
+  });
+}
+BENCHMARK(BM_AnnotateWorstCase)->Apply(WorstCaseInputsAndLengths);
+
+void BM_DatetimeParseWorstCase(benchmark::State& state) {
+  const Annotator* annotator = GetAnnotator(/*model_index=*/0);
+  const DatetimeParser* parser =
+      annotator != nullptr ? annotator->DatetimeParserForTests() : nullptr;
+  if (parser == nullptr) {
+    state.SkipWithError("Couldn't load the model.");
+    return;
+  }
+  const WorstCaseInput input = static_cast<WorstCaseInput>(state.range(0));
+  state.SetLabel(WorstCaseInputName(input));
+  const std::string text = WorstCaseInputText(input, state.range(1));
+
+  std::vector<DatetimeParseResultSpan> results;
+  RunMeasuredBenchmark(state, text.size(), [&]() {
+    results.clear();
+    parser->Parse(text, /*reference_time_ms_utc=*/0,
+                  /*reference_timezone=*/"UTC", /*locales=*/"en",
+                  ModeFlag_ANNOTATION,
+                  AnnotationUsecase_ANNOTATION_USECASE_SMART,
+                  /*anchor_start_end=*/false, &results);
+    benchmark::DoNotOptimize(results.data());
+  });
+}
+BENCHMARK(BM_DatetimeParseWorstCase)->Apply(WorstCaseInputsAndLengths);
+
+// The work of Annotator::SerializedEntityDataFromRegexMatch for a rule with
+// static entity data and a capturing group for each scalar and string field
+// of the root of the entity data schema of the English model.
+void BM_SerializedEntityDataFromRegexMatch(benchmark::State& state) {
+  const Annotator* annotator = GetAnnotator(/*model_index=*/0);
+  const reflection::Schema* schema =
+      annotator != nullptr ? annotator->entity_data_schema() : nullptr;
+  if (schema == nullptr || schema->root_table() == nullptr) {
+    state.SkipWithError("Couldn't load the entity data schema of the model.");
+    return;
+  }
+  std::vector<const reflection::Field*> fields;
+  for (const reflection::Field* field : *schema->root_table()->fields()) {
+    switch (field->type()->base_type()) {
+      case reflection::String:
+      case reflection::Int:
+      case reflection::Long:
+      case reflection::Float:
+      case reflection::Double:
+        fields.push_back(field);
+        break;
+      default:
+        break;
+    }
+  }
+  if (fields.empty()) {
+    state.SkipWithError("The entity data schema has no scalar fields.");
+    return;
+  }
+  state.SetLabel(std::to_string(fields.size()) + " fields");
+  const ReflectiveFlatbufferBuilder entity_data_builder(schema);
+  std::unique_ptr<ReflectiveFlatbuffer> static_entity_data =
+      entity_data_builder.NewRoot();
+  static_entity_data->ParseAndSet(fields[0], "1");
+  const std::string serialized_static_entity_data =
+      static_entity_data->Serialize();
+
+  RunMeasuredBenchmark(state, /*bytes_per_call=*/0, [&]() {
+    std::unique_ptr<ReflectiveFlatbuffer> entity_data =
+        entity_data_builder.NewRoot();
+    entity_data->MergeFromSerializedFlatbuffer(serialized_static_entity_data);
+    for (const reflection::Field* field : fields) {
+      entity_data->ParseAndSet(field, "42");
+    }
+    benchmark::DoNotOptimize(entity_data->Serialize());
+  });
+}
+BENCHMARK(BM_SerializedEntityDataFromRegexMatch);
+
+// Annotates the chat corpus with the English model from 1 to 64 threads
+// sharing the annotator.
+void BM_AnnotateThreads(benchmark::State& state) {
+  static const Annotator* const annotator =
+      Annotator::FromPath(BenchmarkModelPath(kModelFilenames[0])).release();
+  if (annotator == nullptr) {
+    state.SkipWithError("Couldn't load the model.");
+    return;
+  }
+  const std::vector<std::string>& texts =
+      BenchmarkCorpusTexts(BenchmarkCorpus::kChat);
+
+  int i = 0;
+  RunThreadScalingBenchmark(state, [&]() {
+    benchmark::DoNotOptimize(annotator->Annotate(texts[i]));
+    i = (i + 1) % texts.size();
+  });
+}
+BENCHMARK(BM_AnnotateThreads)->Apply(SharedInstanceThreads);
+
+}  // namespace
+}  // namespace libtextclassifier3
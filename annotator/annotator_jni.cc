@@ -19,7 +19,9 @@
 #include "annotator/annotator_jni.h"
 
 #include <jni.h>
+#include <algorithm>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 #include "annotator/annotator.h"
@@ -29,11 +31,16 @@
 #include "utils/calendar/calendar.h"
 #include "utils/intents/intent-generator.h"
 #include "utils/intents/jni.h"
+#include "utils/java/jni-async.h"
 #include "utils/java/jni-cache.h"
+#include "utils/java/jni-warmup.h"
+#include "utils/java/scoped_global_ref.h"
 #include "utils/java/scoped_local_ref.h"
 #include "utils/java/string_utils.h"
 #include "utils/memory/mmap.h"
+#include "utils/model-handle.h"
 #include "utils/strings/stringpiece.h"
+#include "utils/utf8/unicodetext.h"
 #include "utils/utf8/unilib.h"
 
 #ifdef TC3_UNILIB_JAVAICU
@@ -50,6 +57,7 @@ using libtextclassifier3::ClassificationResult;
 using libtextclassifier3::CodepointSpan;
 using libtextclassifier3::Model;
 using libtextclassifier3::ScopedLocalRef;
+using libtextclassifier3::WarmupReportToJObjectArray;
 // When using the Java's ICU, CalendarLib and UniLib need to be instantiated
 // with a JavaVM pointer from JNI. When using a standard ICU the pointer is
 // not needed and the objects are instantiated implicitly.
@@ -63,6 +71,95 @@ namespace libtextclassifier3 {
 using libtextclassifier3::CodepointSpan;
 
 namespace {
+
+// The macros below are intended to reduce the boilerplate and avoid
+// easily introduced copy/paste errors.
+#define TC3_GET_CLASS(FIELD, NAME)                                             \
+  classes->FIELD = MakeGlobalRef(env->FindClass(NAME), env, jni_cache->jvm);   \
+  TC3_CHECK(classes->FIELD != nullptr) << "Error finding class: " << NAME;
+#define TC3_GET_METHOD(CLASS, FIELD, NAME, SIGNATURE)                          \
+  classes->FIELD = env->GetMethodID(classes->CLASS.get(), NAME, SIGNATURE);    \
+  TC3_CHECK(classes->FIELD) << "Error finding method: " << NAME;
+
+// The Java result classes and their constructors. They are resolved once,
+// when the model is created, instead of on every call.
+struct AnnotatorJniResultClasses {
+  static std::unique_ptr<AnnotatorJniResultClasses> Create(
+      const std::shared_ptr<JniCache>& jni_cache) {
+    JNIEnv* env = jni_cache->GetEnv();
+    if (env == nullptr) {
+      return nullptr;
+    }
+    std::unique_ptr<AnnotatorJniResultClasses> classes(
+        new AnnotatorJniResultClasses(jni_cache->jvm));
+
+    TC3_GET_CLASS(classification_result_class,
+                  TC3_PACKAGE_PATH TC3_ANNOTATOR_CLASS_NAME_STR
+                  "$ClassificationResult");
+    TC3_GET_METHOD(
+        classification_result_class, classification_result_init, "<init>",
+        "(Ljava/lang/String;FL" TC3_PACKAGE_PATH TC3_ANNOTATOR_CLASS_NAME_STR
+        "$DatetimeResult;[BLjava/lang/String;Ljava/lang/String;Ljava/lang/"
+        "String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/"
+        "lang/String;Ljava/lang/String;[L" TC3_PACKAGE_PATH
+            TC3_NAMED_VARIANT_CLASS_NAME_STR
+        ";[B[L" TC3_PACKAGE_PATH TC3_REMOTE_ACTION_TEMPLATE_CLASS_NAME_STR
+        ";JJ)V");
+
+    TC3_GET_CLASS(classification_result_array_class,
+                  "[L" TC3_PACKAGE_PATH TC3_ANNOTATOR_CLASS_NAME_STR
+                  "$ClassificationResult;");
+
+    TC3_GET_CLASS(datetime_result_class, TC3_PACKAGE_PATH
+                  TC3_ANNOTATOR_CLASS_NAME_STR "$DatetimeResult");
+    TC3_GET_METHOD(datetime_result_class, datetime_result_init, "<init>",
+                   "(JI)V");
+
+    TC3_GET_CLASS(annotated_span_class, TC3_PACKAGE_PATH
+                  TC3_ANNOTATOR_CLASS_NAME_STR "$AnnotatedSpan");
+    TC3_GET_METHOD(annotated_span_class, annotated_span_init, "<init>",
+                   "(II[L" TC3_PACKAGE_PATH TC3_ANNOTATOR_CLASS_NAME_STR
+                   "$ClassificationResult;)V");
+
+    TC3_GET_CLASS(annotated_spans_class, TC3_PACKAGE_PATH
+                  TC3_ANNOTATOR_CLASS_NAME_STR "$AnnotatedSpans");
+    TC3_GET_METHOD(annotated_spans_class, annotated_spans_init, "<init>",
+                   "([I[I[I[Ljava/lang/String;[I[F[J[I[J[J[Ljava/lang/"
+                   "String;[I[[B[[B)V");
+
+    TC3_GET_CLASS(byte_array_class, "[B");
+
+    return classes;
+  }
+
+  ScopedGlobalRef<jclass> classification_result_class;
+  jmethodID classification_result_init = nullptr;
+  ScopedGlobalRef<jclass> classification_result_array_class;
+
+  ScopedGlobalRef<jclass> datetime_result_class;
+  jmethodID datetime_result_init = nullptr;
+
+  ScopedGlobalRef<jclass> annotated_span_class;
+  jmethodID annotated_span_init = nullptr;
+
+  ScopedGlobalRef<jclass> annotated_spans_class;
+  jmethodID annotated_spans_init = nullptr;
+
+  ScopedGlobalRef<jclass> byte_array_class;
+
+ private:
+  explicit AnnotatorJniResultClasses(JavaVM* jvm)
+      : classification_result_class(nullptr, jvm),
+        classification_result_array_class(nullptr, jvm),
+        datetime_result_class(nullptr, jvm),
+        annotated_span_class(nullptr, jvm),
+        annotated_spans_class(nullptr, jvm),
+        byte_array_class(nullptr, jvm) {}
+};
+
+#undef TC3_GET_CLASS
+#undef TC3_GET_METHOD
+
 class AnnotatorJniContext {
  public:
   static AnnotatorJniContext* Create(
@@ -76,12 +173,14 @@ class AnnotatorJniContext {
                                 model->model()->resources(), jni_cache);
     std::unique_ptr<RemoteActionTemplatesHandler> template_handler =
         libtextclassifier3::RemoteActionTemplatesHandler::Create(jni_cache);
-    if (template_handler == nullptr) {
+    std::unique_ptr<AnnotatorJniResultClasses> result_classes =
+        AnnotatorJniResultClasses::Create(jni_cache);
+    if (template_handler == nullptr || result_classes == nullptr) {
       return nullptr;
     }
-    return new AnnotatorJniContext(jni_cache, std::move(model),
-                                   std::move(intent_generator),
-                                   std::move(template_handler));
+    return new AnnotatorJniContext(
+        jni_cache, std::move(model), std::move(intent_generator),
+        std::move(template_handler), std::move(result_classes));
   }
 
   std::shared_ptr<libtextclassifier3::JniCache> jni_cache() const {
@@ -96,97 +195,96 @@ class AnnotatorJniContext {
     return template_handler_.get();
   }
 
+  const AnnotatorJniResultClasses* result_classes() const {
+    return result_classes_.get();
+  }
+
  private:
   AnnotatorJniContext(
       const std::shared_ptr<libtextclassifier3::JniCache>& jni_cache,
       std::unique_ptr<Annotator> model,
       std::unique_ptr<IntentGenerator> intent_generator,
-      std::unique_ptr<RemoteActionTemplatesHandler> template_handler)
+      std::unique_ptr<RemoteActionTemplatesHandler> template_handler,
+      std::unique_ptr<AnnotatorJniResultClasses> result_classes)
       : jni_cache_(jni_cache),
         model_(std::move(model)),
         intent_generator_(std::move(intent_generator)),
-        template_handler_(std::move(template_handler)) {}
+        template_handler_(std::move(template_handler)),
+        result_classes_(std::move(result_classes)) {}
 
   std::shared_ptr<libtextclassifier3::JniCache> jni_cache_;
   std::unique_ptr<Annotator> model_;
   std::unique_ptr<IntentGenerator> intent_generator_;
   std::unique_ptr<RemoteActionTemplatesHandler> template_handler_;
+  std::unique_ptr<AnnotatorJniResultClasses> result_classes_;
 };
 
+// Returns a new Java string for the value, or nullptr if it is empty.
+jstring NewStringUTFIfNotEmpty(JNIEnv* env, const std::string& value) {
+  if (value.empty()) {
+    return nullptr;
+  }
+  return env->NewStringUTF(value.c_str());
+}
+
+// The classification results that intents are generated for.
+enum class IntentsFor { kNone, kTopResult, kAllResults };
+
+// Converts a classification result, with the given intents if they are not
+// nullptr.
 jobject ClassificationResultWithIntentsToJObject(
-    JNIEnv* env, const AnnotatorJniContext* model_context, jobject app_context,
-    jclass result_class, jmethodID result_class_constructor,
-    jclass datetime_parse_class, jmethodID datetime_parse_class_constructor,
-    const jstring device_locales, const ClassificationOptions* options,
-    const std::string& context, const CodepointSpan& selection_indices,
-    const ClassificationResult& classification_result, bool generate_intents) {
+    JNIEnv* env, const AnnotatorJniContext* model_context,
+    const ClassificationResult& classification_result,
+    const std::vector<RemoteActionTemplate>* remote_action_templates) {
+  const AnnotatorJniResultClasses* classes = model_context->result_classes();
   jstring row_string =
       env->NewStringUTF(classification_result.collection.c_str());
 
   jobject row_datetime_parse = nullptr;
   if (classification_result.datetime_parse_result.IsSet()) {
     row_datetime_parse =
-        env->NewObject(datetime_parse_class, datetime_parse_class_constructor,
+        env->NewObject(classes->datetime_result_class.get(),
+                       classes->datetime_result_init,
                        classification_result.datetime_parse_result.time_ms_utc,
                        classification_result.datetime_parse_result.granularity);
   }
 
+  // Most results don't have any of the rare fields, so they are only looked at
+  // if present.
   jbyteArray serialized_knowledge_result = nullptr;
-  const std::string& serialized_knowledge_result_string =
-      classification_result.serialized_knowledge_result;
-  if (!serialized_knowledge_result_string.empty()) {
-    serialized_knowledge_result =
-        env->NewByteArray(serialized_knowledge_result_string.size());
-    env->SetByteArrayRegion(serialized_knowledge_result, 0,
-                            serialized_knowledge_result_string.size(),
-                            reinterpret_cast<const jbyte*>(
-                                serialized_knowledge_result_string.data()));
-  }
-
   jstring contact_name = nullptr;
-  if (!classification_result.contact_name.empty()) {
-    contact_name =
-        env->NewStringUTF(classification_result.contact_name.c_str());
-  }
-
   jstring contact_given_name = nullptr;
-  if (!classification_result.contact_given_name.empty()) {
-    contact_given_name =
-        env->NewStringUTF(classification_result.contact_given_name.c_str());
-  }
-
   jstring contact_nickname = nullptr;
-  if (!classification_result.contact_nickname.empty()) {
-    contact_nickname =
-        env->NewStringUTF(classification_result.contact_nickname.c_str());
-  }
-
   jstring contact_email_address = nullptr;
-  if (!classification_result.contact_email_address.empty()) {
-    contact_email_address =
-        env->NewStringUTF(classification_result.contact_email_address.c_str());
-  }
-
   jstring contact_phone_number = nullptr;
-  if (!classification_result.contact_phone_number.empty()) {
-    contact_phone_number =
-        env->NewStringUTF(classification_result.contact_phone_number.c_str());
-  }
-
   jstring contact_id = nullptr;
-  if (!classification_result.contact_id.empty()) {
-    contact_id = env->NewStringUTF(classification_result.contact_id.c_str());
-  }
-
   jstring app_name = nullptr;
-  if (!classification_result.app_name.empty()) {
-    app_name = env->NewStringUTF(classification_result.app_name.c_str());
-  }
-
   jstring app_package_name = nullptr;
-  if (!classification_result.app_package_name.empty()) {
+  if (const ClassificationResultExtras* result_extras =
+          classification_result.extras()) {
+    const std::string& serialized_knowledge_result_string =
+        result_extras->serialized_knowledge_result;
+    if (!serialized_knowledge_result_string.empty()) {
+      serialized_knowledge_result =
+          env->NewByteArray(serialized_knowledge_result_string.size());
+      env->SetByteArrayRegion(serialized_knowledge_result, 0,
+                              serialized_knowledge_result_string.size(),
+                              reinterpret_cast<const jbyte*>(
+                                  serialized_knowledge_result_string.data()));
+    }
+    contact_name = NewStringUTFIfNotEmpty(env, result_extras->contact_name);
+    contact_given_name =
+        NewStringUTFIfNotEmpty(env, result_extras->contact_given_name);
+    contact_nickname =
+        NewStringUTFIfNotEmpty(env, result_extras->contact_nickname);
+    contact_email_address =
+        NewStringUTFIfNotEmpty(env, result_extras->contact_email_address);
+    contact_phone_number =
+        NewStringUTFIfNotEmpty(env, result_extras->contact_phone_number);
+    contact_id = NewStringUTFIfNotEmpty(env, result_extras->contact_id);
+    app_name = NewStringUTFIfNotEmpty(env, result_extras->app_name);
     app_package_name =
-        env->NewStringUTF(classification_result.app_package_name.c_str());
+        NewStringUTFIfNotEmpty(env, result_extras->app_package_name);
   }
 
   jobject extras = nullptr;
@@ -209,23 +307,15 @@ jobject ClassificationResultWithIntentsToJObject(
   }
 
   jobject remote_action_templates_result = nullptr;
-  // Only generate RemoteActionTemplate for the top classification result
-  // as classifyText does not need RemoteAction from other results anyway.
-  if (generate_intents && model_context->intent_generator() != nullptr) {
-    std::vector<RemoteActionTemplate> remote_action_templates;
-    if (model_context->intent_generator()->GenerateIntents(
-            device_locales, classification_result,
-            options->reference_time_ms_utc, context, selection_indices,
-            app_context, model_context->model()->entity_data_schema(),
-            &remote_action_templates)) {
-      remote_action_templates_result =
-          model_context->template_handler()
-              ->RemoteActionTemplatesToJObjectArray(remote_action_templates);
-    }
+  if (remote_action_templates != nullptr) {
+    remote_action_templates_result =
+        model_context->template_handler()->RemoteActionTemplatesToJObjectArray(
+            *remote_action_templates);
   }
 
   return env->NewObject(
-      result_class, result_class_constructor, row_string,
+      classes->classification_result_class.get(),
+      classes->classification_result_init, row_string,
       static_cast<jfloat>(classification_result.score), row_datetime_parse,
       serialized_knowledge_result, contact_name, contact_given_name,
       contact_nickname, contact_email_address, contact_phone_number, contact_id,
@@ -239,44 +329,43 @@ jobjectArray ClassificationResultsWithIntentsToJObjectArray(
     const jstring device_locales, const ClassificationOptions* options,
     const std::string& context, const CodepointSpan& selection_indices,
     const std::vector<ClassificationResult>& classification_result,
-    bool generate_intents) {
-  const ScopedLocalRef<jclass> result_class(
-      env->FindClass(TC3_PACKAGE_PATH TC3_ANNOTATOR_CLASS_NAME_STR
-                     "$ClassificationResult"),
-      env);
-  if (!result_class) {
-    TC3_LOG(ERROR) << "Couldn't find ClassificationResult class.";
-    return nullptr;
-  }
-  const ScopedLocalRef<jclass> datetime_parse_class(
-      env->FindClass(TC3_PACKAGE_PATH TC3_ANNOTATOR_CLASS_NAME_STR
-                     "$DatetimeResult"),
-      env);
-  if (!datetime_parse_class) {
-    TC3_LOG(ERROR) << "Couldn't find DatetimeResult class.";
-    return nullptr;
+    IntentsFor intents_for) {
+  // The intents of each result, nullptr for the results without.
+  std::vector<const std::vector<RemoteActionTemplate>*> result_intents(
+      classification_result.size(), nullptr);
+  std::vector<std::vector<RemoteActionTemplate>> remote_action_templates;
+  const IntentGenerator* intent_generator = model_context->intent_generator();
+  if (intent_generator != nullptr && !classification_result.empty()) {
+    if (intents_for == IntentsFor::kTopResult) {
+      remote_action_templates.resize(1);
+      if (intent_generator->GenerateIntents(
+              device_locales, classification_result[0],
+              options->reference_time_ms_utc, context, selection_indices,
+              app_context, model_context->model()->entity_data_schema(),
+              &remote_action_templates[0])) {
+        result_intents[0] = &remote_action_templates[0];
+      }
+    } else if (intents_for == IntentsFor::kAllResults) {
+      // The failures of single generators are logged, the results still get
+      // the intents of the generators that succeeded.
+      intent_generator->GenerateIntents(
+          device_locales, classification_result,
+          options->reference_time_ms_utc, context, selection_indices,
+          app_context, model_context->model()->entity_data_schema(),
+          &remote_action_templates);
+      for (int i = 0; i < classification_result.size(); i++) {
+        result_intents[i] = &remote_action_templates[i];
+      }
+    }
   }
 
-  const jmethodID result_class_constructor = env->GetMethodID(
-      result_class.get(), "<init>",
-      "(Ljava/lang/String;FL" TC3_PACKAGE_PATH TC3_ANNOTATOR_CLASS_NAME_STR
-      "$DatetimeResult;[BLjava/lang/String;Ljava/lang/String;Ljava/lang/String;"
-      "Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;"
-      "Ljava/lang/String;[L" TC3_PACKAGE_PATH TC3_NAMED_VARIANT_CLASS_NAME_STR
-      ";[B[L" TC3_PACKAGE_PATH TC3_REMOTE_ACTION_TEMPLATE_CLASS_NAME_STR
-      ";JJ)V");
-  const jmethodID datetime_parse_class_constructor =
-      env->GetMethodID(datetime_parse_class.get(), "<init>", "(JI)V");
-
-  const jobjectArray results = env->NewObjectArray(classification_result.size(),
-                                                   result_class.get(), nullptr);
+  const jobjectArray results = env->NewObjectArray(
+      classification_result.size(),
+      model_context->result_classes()->classification_result_class.get(),
+      nullptr);
   for (int i = 0; i < classification_result.size(); i++) {
     jobject result = ClassificationResultWithIntentsToJObject(
-        env, model_context, app_context, result_class.get(),
-        result_class_constructor, datetime_parse_class.get(),
-        datetime_parse_class_constructor, device_locales, options, context,
-        selection_indices, classification_result[i],
-        generate_intents && (i == 0));
+        env, model_context, classification_result[i], result_intents[i]);
     env->SetObjectArrayElement(results, i, result);
     env->DeleteLocalRef(result);
   }
@@ -293,67 +382,286 @@ jobjectArray ClassificationResultsToJObjectArray(
       /*(unusued) options=*/nullptr,
       /*(unused) selection_text=*/"",
       /*(unused) selection_indices=*/{kInvalidIndex, kInvalidIndex},
-      classification_result,
-      /*generate_intents=*/false);
+      classification_result, IntentsFor::kNone);
 }
 
-CodepointSpan ConvertIndicesBMPUTF8(const std::string& utf8_str,
-                                    CodepointSpan orig_indices,
-                                    bool from_utf8) {
-  const libtextclassifier3::UnicodeText unicode_str =
-      libtextclassifier3::UTF8ToUnicodeText(utf8_str, /*do_copy=*/false);
+}  // namespace
 
-  int unicode_index = 0;
+BMPIndexTable::BMPIndexTable(const std::string& utf8_str) {
+  const UnicodeText unicode_str =
+      UTF8ToUnicodeText(utf8_str, /*do_copy=*/false);
   int bmp_index = 0;
+  for (auto it = unicode_str.begin(); it != unicode_str.end(); ++it) {
+    // There is 1 extra character in the input for each UTF8 character > 0xFFFF.
+    if (*it > 0xFFFF && bmp_indices_.empty()) {
+      // Until now the indices were the same, fill them in.
+      bmp_indices_.reserve(utf8_str.size() + 1);
+      for (int i = 0; i <= num_codepoints_; i++) {
+        bmp_indices_.push_back(i);
+      }
+    } else if (!bmp_indices_.empty()) {
+      bmp_indices_.push_back(bmp_index);
+    }
+    bmp_index += (*it > 0xFFFF) ? 2 : 1;
+    ++num_codepoints_;
+  }
+  if (!bmp_indices_.empty()) {
+    bmp_indices_.push_back(bmp_index);
+  }
+}
 
-  const int* source_index;
-  const int* target_index;
-  if (from_utf8) {
-    source_index = &unicode_index;
-    target_index = &bmp_index;
-  } else {
-    source_index = &bmp_index;
-    target_index = &unicode_index;
+int BMPIndexTable::ToBMP(int utf8_index) const {
+  if (utf8_index < 0 || utf8_index > num_codepoints_) {
+    return -1;
   }
+  return bmp_indices_.empty() ? utf8_index : bmp_indices_[utf8_index];
+}
 
-  CodepointSpan result{-1, -1};
-  std::function<void()> assign_indices_fn = [&result, &orig_indices,
-                                             &source_index, &target_index]() {
-    if (orig_indices.first == *source_index) {
-      result.first = *target_index;
-    }
+int BMPIndexTable::ToUTF8(int bmp_index) const {
+  if (bmp_indices_.empty()) {
+    return (bmp_index < 0 || bmp_index > num_codepoints_) ? -1 : bmp_index;
+  }
+  const auto it =
+      std::lower_bound(bmp_indices_.begin(), bmp_indices_.end(), bmp_index);
+  if (it == bmp_indices_.end() || *it != bmp_index) {
+    return -1;
+  }
+  return it - bmp_indices_.begin();
+}
 
-    if (orig_indices.second == *source_index) {
-      result.second = *target_index;
-    }
-  };
+CodepointSpan BMPIndexTable::ToBMP(CodepointSpan utf8_indices) const {
+  return {ToBMP(utf8_indices.first), ToBMP(utf8_indices.second)};
+}
 
-  for (auto it = unicode_str.begin(); it != unicode_str.end();
-       ++it, ++unicode_index, ++bmp_index) {
-    assign_indices_fn();
+CodepointSpan BMPIndexTable::ToUTF8(CodepointSpan bmp_indices) const {
+  return {ToUTF8(bmp_indices.first), ToUTF8(bmp_indices.second)};
+}
 
-    // There is 1 extra character in the input for each UTF8 character > 0xFFFF.
-    if (*it > 0xFFFF) {
-      ++bmp_index;
+CodepointSpan ConvertIndicesBMPToUTF8(const std::string& utf8_str,
+                                      CodepointSpan bmp_indices) {
+  return BMPIndexTable(utf8_str).ToUTF8(bmp_indices);
+}
+
+CodepointSpan ConvertIndicesUTF8ToBMP(const std::string& utf8_str,
+                                      CodepointSpan utf8_indices) {
+  return BMPIndexTable(utf8_str).ToBMP(utf8_indices);
+}
+
+namespace {
+
+// Number of rare string fields stored per result by the compact annotate
+// output, in the order of the ClassificationResult constructor.
+constexpr int kNumCompactStringFields = 8;
+
+// Deduplicating table of strings, shared by all results of one call.
+class JniStringTable {
+ public:
+  // Returns the index of the value in the table, or -1 if it is empty.
+  int Add(const std::string& value) {
+    if (value.empty()) {
+      return -1;
     }
+    auto it = indices_.find(value);
+    if (it != indices_.end()) {
+      return it->second;
+    }
+    const int index = values_.size();
+    indices_.emplace(value, index);
+    values_.push_back(&value);
+    return index;
   }
-  assign_indices_fn();
 
+  jobjectArray ToJObjectArray(JNIEnv* env, jclass string_class) const {
+    jobjectArray result =
+        env->NewObjectArray(values_.size(), string_class, nullptr);
+    for (int i = 0; i < values_.size(); i++) {
+      jstring value = env->NewStringUTF(values_[i]->c_str());
+      env->SetObjectArrayElement(result, i, value);
+      env->DeleteLocalRef(value);
+    }
+    return result;
+  }
+
+ private:
+  // The values point into the results, which outlive the table.
+  std::unordered_map<std::string, int> indices_;
+  std::vector<const std::string*> values_;
+};
+
+jintArray ToJIntArray(JNIEnv* env, const std::vector<jint>& values) {
+  jintArray result = env->NewIntArray(values.size());
+  env->SetIntArrayRegion(result, 0, values.size(), values.data());
   return result;
 }
 
-}  // namespace
+jlongArray ToJLongArray(JNIEnv* env, const std::vector<jlong>& values) {
+  jlongArray result = env->NewLongArray(values.size());
+  env->SetLongArrayRegion(result, 0, values.size(), values.data());
+  return result;
+}
 
-CodepointSpan ConvertIndicesBMPToUTF8(const std::string& utf8_str,
-                                      CodepointSpan bmp_indices) {
-  return ConvertIndicesBMPUTF8(utf8_str, bmp_indices, /*from_utf8=*/false);
+// Sets the element of a byte[][] array, leaving it null if value is empty.
+void SetByteArrayElementIfNotEmpty(JNIEnv* env, jobjectArray array, int index,
+                                   const std::string& value) {
+  if (value.empty()) {
+    return;
+  }
+  jbyteArray bytes = env->NewByteArray(value.size());
+  env->SetByteArrayRegion(bytes, 0, value.size(),
+                          reinterpret_cast<const jbyte*>(value.data()));
+  env->SetObjectArrayElement(array, index, bytes);
+  env->DeleteLocalRef(bytes);
 }
 
-CodepointSpan ConvertIndicesUTF8ToBMP(const std::string& utf8_str,
-                                      CodepointSpan utf8_indices) {
-  return ConvertIndicesBMPUTF8(utf8_str, utf8_indices, /*from_utf8=*/true);
+// Converts the annotations to an array of Java AnnotatedSpan objects.
+jobjectArray AnnotationsToJObjectArray(
+    JNIEnv* env, const AnnotatorJniContext* model_context,
+    const std::string& context_utf8,
+    const std::vector<AnnotatedSpan>& annotations) {
+  const AnnotatorJniResultClasses* classes = model_context->result_classes();
+  jobjectArray results = env->NewObjectArray(
+      annotations.size(), classes->annotated_span_class.get(), nullptr);
+
+  const BMPIndexTable bmp_index_table(context_utf8);
+  for (int i = 0; i < annotations.size(); ++i) {
+    const CodepointSpan span_bmp = bmp_index_table.ToBMP(annotations[i].span);
+    jobject result = env->NewObject(
+        classes->annotated_span_class.get(), classes->annotated_span_init,
+        static_cast<jint>(span_bmp.first), static_cast<jint>(span_bmp.second),
+        ClassificationResultsToJObjectArray(env, model_context,
+                                            annotations[i].classification));
+    env->SetObjectArrayElement(results, i, result);
+    env->DeleteLocalRef(result);
+  }
+  return results;
 }
 
+// Converts the annotations to a Java AnnotatedSpans object, which holds them
+// column-wise in primitive arrays. Only the strings and byte arrays are Java
+// objects, and each distinct string is created once per call.
+jobject AnnotationsToCompactJObject(
+    JNIEnv* env, const AnnotatorJniContext* model_context,
+    const std::string& context_utf8,
+    const std::vector<AnnotatedSpan>& annotations) {
+  const AnnotatorJniResultClasses* classes = model_context->result_classes();
+  const jclass string_class = model_context->jni_cache()->string_class.get();
+
+  int num_results = 0;
+  for (const AnnotatedSpan& annotation : annotations) {
+    num_results += annotation.classification.size();
+  }
+
+  std::vector<jint> starts, ends, result_offsets;
+  starts.reserve(annotations.size());
+  ends.reserve(annotations.size());
+  result_offsets.reserve(annotations.size() + 1);
+  std::vector<jint> collection_ids, datetime_granularities, string_indices;
+  std::vector<jfloat> scores;
+  std::vector<jlong> datetime_times_ms_utc, durations_ms, numeric_values;
+  collection_ids.reserve(num_results);
+  scores.reserve(num_results);
+  datetime_times_ms_utc.reserve(num_results);
+  datetime_granularities.reserve(num_results);
+  durations_ms.reserve(num_results);
+  numeric_values.reserve(num_results);
+  string_indices.reserve(num_results * kNumCompactStringFields);
+
+  JniStringTable collections;
+  JniStringTable strings;
+  const ScopedLocalRef<jobjectArray> serialized_knowledge_results(
+      env->NewObjectArray(num_results, classes->byte_array_class.get(),
+                          nullptr),
+      env);
+  const ScopedLocalRef<jobjectArray> serialized_entity_data(
+      env->NewObjectArray(num_results, classes->byte_array_class.get(),
+                          nullptr),
+      env);
+
+  const BMPIndexTable bmp_index_table(context_utf8);
+  int result_index = 0;
+  for (const AnnotatedSpan& annotation : annotations) {
+    const CodepointSpan span_bmp = bmp_index_table.ToBMP(annotation.span);
+    starts.push_back(span_bmp.first);
+    ends.push_back(span_bmp.second);
+    result_offsets.push_back(result_index);
+
+    for (const ClassificationResult& result : annotation.classification) {
+      collection_ids.push_back(collections.Add(result.collection));
+      scores.push_back(result.score);
+      if (result.datetime_parse_result.IsSet()) {
+        datetime_times_ms_utc.push_back(
+            result.datetime_parse_result.time_ms_utc);
+        datetime_granularities.push_back(
+            result.datetime_parse_result.granularity);
+      } else {
+        datetime_times_ms_utc.push_back(0);
+        datetime_granularities.push_back(-1);
+      }
+      durations_ms.push_back(result.duration_ms);
+      numeric_values.push_back(result.numeric_value);
+
+      if (const ClassificationResultExtras* extras = result.extras()) {
+        string_indices.push_back(strings.Add(extras->contact_name));
+        string_indices.push_back(strings.Add(extras->contact_given_name));
+        string_indices.push_back(strings.Add(extras->contact_nickname));
+        string_indices.push_back(strings.Add(extras->contact_email_address));
+        string_indices.push_back(strings.Add(extras->contact_phone_number));
+        string_indices.push_back(strings.Add(extras->contact_id));
+        string_indices.push_back(strings.Add(extras->app_name));
+        string_indices.push_back(strings.Add(extras->app_package_name));
+        SetByteArrayElementIfNotEmpty(env, serialized_knowledge_results.get(),
+                                      result_index,
+                                      extras->serialized_knowledge_result);
+      } else {
+        string_indices.insert(string_indices.end(), kNumCompactStringFields,
+                              -1);
+      }
+      SetByteArrayElementIfNotEmpty(env, serialized_entity_data.get(),
+                                    result_index,
+                                    result.serialized_entity_data);
+      ++result_index;
+    }
+  }
+  result_offsets.push_back(result_index);
+
+  const ScopedLocalRef<jintArray> starts_array(ToJIntArray(env, starts), env);
+  const ScopedLocalRef<jintArray> ends_array(ToJIntArray(env, ends), env);
+  const ScopedLocalRef<jintArray> result_offsets_array(
+      ToJIntArray(env, result_offsets), env);
+  const ScopedLocalRef<jobjectArray> collections_array(
+      collections.ToJObjectArray(env, string_class), env);
+  const ScopedLocalRef<jintArray> collection_ids_array(
+      ToJIntArray(env, collection_ids), env);
+  const ScopedLocalRef<jfloatArray> scores_array(
+      env->NewFloatArray(scores.size()), env);
+  env->SetFloatArrayRegion(scores_array.get(), 0, scores.size(),
+                           scores.data());
+  const ScopedLocalRef<jlongArray> datetime_times_ms_utc_array(
+      ToJLongArray(env, datetime_times_ms_utc), env);
+  const ScopedLocalRef<jintArray> datetime_granularities_array(
+      ToJIntArray(env, datetime_granularities), env);
+  const ScopedLocalRef<jlongArray> durations_ms_array(
+      ToJLongArray(env, durations_ms), env);
+  const ScopedLocalRef<jlongArray> numeric_values_array(
+      ToJLongArray(env, numeric_values), env);
+  const ScopedLocalRef<jobjectArray> strings_array(
+      strings.ToJObjectArray(env, string_class), env);
+  const ScopedLocalRef<jintArray> string_indices_array(
+      ToJIntArray(env, string_indices), env);
+
+  return env->NewObject(
+      classes->annotated_spans_class.get(), classes->annotated_spans_init,
+      starts_array.get(),
+      ends_array.get(), result_offsets_array.get(), collections_array.get(),
+      collection_ids_array.get(), scores_array.get(),
+      datetime_times_ms_utc_array.get(), datetime_granularities_array.get(),
+      durations_ms_array.get(), numeric_values_array.get(),
+      strings_array.get(), string_indices_array.get(),
+      serialized_knowledge_results.get(), serialized_entity_data.get());
+}
+
+}  // namespace
+
 jstring GetLocalesFromMmap(JNIEnv* env, libtextclassifier3::ScopedMmap* mmap) {
   if (!mmap->handle().ok()) {
     return env->NewStringUTF("");
@@ -390,30 +698,58 @@ jstring GetNameFromMmap(JNIEnv* env, libtextclassifier3::ScopedMmap* mmap) {
   return env->NewStringUTF(model->name()->c_str());
 }
 
+// The native object behind the Java AnnotatorModel. Swapping the model
+// swaps the whole context, because the intent generator refers to the model.
+using AnnotatorJniHandle = ModelHandle<AnnotatorJniContext>;
+
+jlong NewAnnotatorJniHandle(AnnotatorJniContext* context) {
+  if (context == nullptr) {
+    return 0L;
+  }
+  return reinterpret_cast<jlong>(new AnnotatorJniHandle(
+      std::unique_ptr<AnnotatorJniContext>(context)));
+}
+
+// Returns a snapshot of the current context, which stays valid while the
+// pointer is held, even if the model is swapped meanwhile.
+std::shared_ptr<const AnnotatorJniContext> GetAnnotatorJniContext(jlong ptr) {
+  return reinterpret_cast<const AnnotatorJniHandle*>(ptr)->Get();
+}
+
 }  // namespace libtextclassifier3
 
 using libtextclassifier3::AnnotatorJniContext;
+using libtextclassifier3::AnnotatorJniHandle;
+using libtextclassifier3::AnnotationsToCompactJObject;
+using libtextclassifier3::AnnotationsToJObjectArray;
+using libtextclassifier3::BMPIndexTable;
 using libtextclassifier3::ClassificationResultsToJObjectArray;
 using libtextclassifier3::ClassificationResultsWithIntentsToJObjectArray;
-using libtextclassifier3::ConvertIndicesBMPToUTF8;
-using libtextclassifier3::ConvertIndicesUTF8ToBMP;
+using libtextclassifier3::IntentsFor;
+using libtextclassifier3::CancellationToken;
 using libtextclassifier3::FromJavaAnnotationOptions;
 using libtextclassifier3::FromJavaClassificationOptions;
 using libtextclassifier3::FromJavaSelectionOptions;
+using libtextclassifier3::GetAnnotatorJniContext;
+using libtextclassifier3::GetAsyncRequestToken;
+using libtextclassifier3::NewAnnotatorJniHandle;
+using libtextclassifier3::ScheduleJniTask;
+using libtextclassifier3::ScopedGlobalRef;
 using libtextclassifier3::ToStlString;
+using libtextclassifier3::WarmupReport;
 
 TC3_JNI_METHOD(jlong, TC3_ANNOTATOR_CLASS_NAME, nativeNewAnnotator)
 (JNIEnv* env, jobject thiz, jint fd) {
   std::shared_ptr<libtextclassifier3::JniCache> jni_cache(
       libtextclassifier3::JniCache::Create(env));
 #ifdef TC3_USE_JAVAICU
-  return reinterpret_cast<jlong>(AnnotatorJniContext::Create(
+  return NewAnnotatorJniHandle(AnnotatorJniContext::Create(
       jni_cache,
       Annotator::FromFileDescriptor(
           fd, std::unique_ptr<UniLib>(new UniLib(jni_cache)),
           std::unique_ptr<CalendarLib>(new CalendarLib(jni_cache)))));
 #else
-  return reinterpret_cast<jlong>(AnnotatorJniContext::Create(
+  return NewAnnotatorJniHandle(AnnotatorJniContext::Create(
       jni_cache, Annotator::FromFileDescriptor(fd)));
 #endif
 }
@@ -424,13 +760,13 @@ TC3_JNI_METHOD(jlong, TC3_ANNOTATOR_CLASS_NAME, nativeNewAnnotatorFromPath)
   std::shared_ptr<libtextclassifier3::JniCache> jni_cache(
       libtextclassifier3::JniCache::Create(env));
 #ifdef TC3_USE_JAVAICU
-  return reinterpret_cast<jlong>(AnnotatorJniContext::Create(
+  return NewAnnotatorJniHandle(AnnotatorJniContext::Create(
       jni_cache,
       Annotator::FromPath(
           path_str, std::unique_ptr<UniLib>(new UniLib(jni_cache)),
           std::unique_ptr<CalendarLib>(new CalendarLib(jni_cache)))));
 #else
-  return reinterpret_cast<jlong>(
+  return NewAnnotatorJniHandle(
       AnnotatorJniContext::Create(jni_cache, Annotator::FromPath(path_str)));
 #endif
 }
@@ -442,13 +778,13 @@ TC3_JNI_METHOD(jlong, TC3_ANNOTATOR_CLASS_NAME,
       libtextclassifier3::JniCache::Create(env));
   const jint fd = libtextclassifier3::GetFdFromAssetFileDescriptor(env, afd);
 #ifdef TC3_USE_JAVAICU
-  return reinterpret_cast<jlong>(AnnotatorJniContext::Create(
+  return NewAnnotatorJniHandle(AnnotatorJniContext::Create(
       jni_cache,
       Annotator::FromFileDescriptor(
           fd, offset, size, std::unique_ptr<UniLib>(new UniLib(jni_cache)),
           std::unique_ptr<CalendarLib>(new CalendarLib(jni_cache)))));
 #else
-  return reinterpret_cast<jlong>(AnnotatorJniContext::Create(
+  return NewAnnotatorJniHandle(AnnotatorJniContext::Create(
       jni_cache, Annotator::FromFileDescriptor(fd, offset, size)));
 #endif
 }
@@ -460,7 +796,9 @@ TC3_JNI_METHOD(jboolean, TC3_ANNOTATOR_CLASS_NAME,
     return false;
   }
 
-  Annotator* model = reinterpret_cast<AnnotatorJniContext*>(ptr)->model();
+  const std::shared_ptr<const AnnotatorJniContext> model_context =
+      GetAnnotatorJniContext(ptr);
+  Annotator* model = model_context->model();
 
   std::string serialized_config_string;
   const int length = env->GetArrayLength(serialized_config);
@@ -479,7 +817,9 @@ TC3_JNI_METHOD(jboolean, TC3_ANNOTATOR_CLASS_NAME,
     return false;
   }
 
-  Annotator* model = reinterpret_cast<AnnotatorJniContext*>(ptr)->model();
+  const std::shared_ptr<const AnnotatorJniContext> model_context =
+      GetAnnotatorJniContext(ptr);
+  Annotator* model = model_context->model();
 
   std::string serialized_config_string;
   const int length = env->GetArrayLength(serialized_config);
@@ -498,7 +838,9 @@ TC3_JNI_METHOD(jboolean, TC3_ANNOTATOR_CLASS_NAME,
     return false;
   }
 
-  Annotator* model = reinterpret_cast<AnnotatorJniContext*>(ptr)->model();
+  const std::shared_ptr<const AnnotatorJniContext> model_context =
+      GetAnnotatorJniContext(ptr);
+  Annotator* model = model_context->model();
 
   std::string serialized_config_string;
   const int length = env->GetArrayLength(serialized_config);
@@ -510,13 +852,27 @@ TC3_JNI_METHOD(jboolean, TC3_ANNOTATOR_CLASS_NAME,
   return model->InitializeInstalledAppEngine(serialized_config_string);
 }
 
+TC3_JNI_METHOD(jboolean, TC3_ANNOTATOR_CLASS_NAME, nativeSetExecutorOptions)
+(JNIEnv* env, jobject thiz, jlong ptr, jint num_threads, jboolean allow_fp16) {
+  if (!ptr) {
+    return false;
+  }
+
+  // The op resolver and the delegate can't be passed from Java, keep the
+  // process-wide ones.
+  TfLiteExecutorOptions options = DefaultTfLiteExecutorOptions();
+  options.num_threads = num_threads;
+  options.allow_fp16 = allow_fp16;
+  return GetAnnotatorJniContext(ptr)->model()->SetTfLiteExecutorOptions(
+      options);
+}
+
 TC3_JNI_METHOD(jlong, TC3_ANNOTATOR_CLASS_NAME, nativeGetNativeModelPtr)
 (JNIEnv* env, jobject thiz, jlong ptr) {
   if (!ptr) {
     return 0L;
   }
-  return reinterpret_cast<jlong>(
-      reinterpret_cast<AnnotatorJniContext*>(ptr)->model());
+  return reinterpret_cast<jlong>(GetAnnotatorJniContext(ptr)->model());
 }
 
 TC3_JNI_METHOD(jintArray, TC3_ANNOTATOR_CLASS_NAME, nativeSuggestSelection)
@@ -525,13 +881,16 @@ TC3_JNI_METHOD(jintArray, TC3_ANNOTATOR_CLASS_NAME, nativeSuggestSelection)
   if (!ptr) {
     return nullptr;
   }
-  const Annotator* model = reinterpret_cast<AnnotatorJniContext*>(ptr)->model();
+  const std::shared_ptr<const AnnotatorJniContext> model_context =
+      GetAnnotatorJniContext(ptr);
+  const Annotator* model = model_context->model();
   const std::string context_utf8 = ToStlString(env, context);
+  const BMPIndexTable bmp_index_table(context_utf8);
   CodepointSpan input_indices =
-      ConvertIndicesBMPToUTF8(context_utf8, {selection_begin, selection_end});
+      bmp_index_table.ToUTF8({selection_begin, selection_end});
   CodepointSpan selection = model->SuggestSelection(
       context_utf8, input_indices, FromJavaSelectionOptions(env, options));
-  selection = ConvertIndicesUTF8ToBMP(context_utf8, selection);
+  selection = bmp_index_table.ToBMP(selection);
 
   jintArray result = env->NewIntArray(2);
   env->SetIntArrayRegion(result, 0, 1, &(std::get<0>(selection)));
@@ -546,79 +905,304 @@ TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME, nativeClassifyText)
   if (!ptr) {
     return nullptr;
   }
-  const AnnotatorJniContext* model_context =
-      reinterpret_cast<AnnotatorJniContext*>(ptr);
+  const std::shared_ptr<const AnnotatorJniContext> model_context =
+      GetAnnotatorJniContext(ptr);
 
   const std::string context_utf8 = ToStlString(env, context);
-  const CodepointSpan input_indices =
-      ConvertIndicesBMPToUTF8(context_utf8, {selection_begin, selection_end});
+  const CodepointSpan input_indices = BMPIndexTable(context_utf8).ToUTF8(
+      {selection_begin, selection_end});
   const libtextclassifier3::ClassificationOptions classification_options =
       FromJavaClassificationOptions(env, options);
   const std::vector<ClassificationResult> classification_result =
       model_context->model()->ClassifyText(context_utf8, input_indices,
                                            classification_options);
   if (app_context != nullptr) {
+    // Only generate RemoteActionTemplate for the top classification result
+    // as classifyText does not need RemoteAction from other results anyway.
     return ClassificationResultsWithIntentsToJObjectArray(
-        env, model_context, app_context, device_locales,
+        env, model_context.get(), app_context, device_locales,
         &classification_options, context_utf8, input_indices,
-        classification_result,
-        /*generate_intents=*/true);
+        classification_result, IntentsFor::kTopResult);
   }
-  return ClassificationResultsToJObjectArray(env, model_context,
+  return ClassificationResultsToJObjectArray(env, model_context.get(),
                                              classification_result);
 }
 
+TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME,
+               nativeClassifyTextWithAllIntents)
+(JNIEnv* env, jobject thiz, jlong ptr, jstring context, jint selection_begin,
+ jint selection_end, jobject options, jobject app_context,
+ jstring device_locales) {
+  if (!ptr || app_context == nullptr) {
+    return nullptr;
+  }
+  const std::shared_ptr<const AnnotatorJniContext> model_context =
+      GetAnnotatorJniContext(ptr);
+
+  const std::string context_utf8 = ToStlString(env, context);
+  const CodepointSpan input_indices = BMPIndexTable(context_utf8).ToUTF8(
+      {selection_begin, selection_end});
+  const libtextclassifier3::ClassificationOptions classification_options =
+      FromJavaClassificationOptions(env, options);
+  const std::vector<ClassificationResult> classification_result =
+      model_context->model()->ClassifyText(context_utf8, input_indices,
+                                           classification_options);
+  return ClassificationResultsWithIntentsToJObjectArray(
+      env, model_context.get(), app_context, device_locales,
+      &classification_options, context_utf8, input_indices,
+      classification_result, IntentsFor::kAllResults);
+}
+
+TC3_JNI_METHOD(jobject, TC3_ANNOTATOR_CLASS_NAME,
+               nativeSuggestSelectionAndClassify)
+(JNIEnv* env, jobject thiz, jlong ptr, jstring context, jint selection_begin,
+ jint selection_end, jobject selection_options, jobject classification_options,
+ jobject app_context, jstring device_locales) {
+  if (!ptr) {
+    return nullptr;
+  }
+  const std::shared_ptr<const AnnotatorJniContext> model_context =
+      GetAnnotatorJniContext(ptr);
+
+  const std::string context_utf8 = ToStlString(env, context);
+  const BMPIndexTable bmp_index_table(context_utf8);
+  const CodepointSpan input_indices =
+      bmp_index_table.ToUTF8({selection_begin, selection_end});
+  const libtextclassifier3::ClassificationOptions options =
+      FromJavaClassificationOptions(env, classification_options);
+  const libtextclassifier3::AnnotatedSpan result =
+      model_context->model()->SuggestSelectionAndClassify(
+          context_utf8, input_indices,
+          FromJavaSelectionOptions(env, selection_options), options);
+
+  jobjectArray classification;
+  if (app_context != nullptr) {
+    // As in classifyText, only the top result gets its RemoteActionTemplates.
+    classification = ClassificationResultsWithIntentsToJObjectArray(
+        env, model_context.get(), app_context, device_locales, &options,
+        context_utf8, result.span, result.classification,
+        IntentsFor::kTopResult);
+  } else {
+    classification = ClassificationResultsToJObjectArray(
+        env, model_context.get(), result.classification);
+  }
+  const CodepointSpan span_bmp = bmp_index_table.ToBMP(result.span);
+  const libtextclassifier3::AnnotatorJniResultClasses* classes =
+      model_context->result_classes();
+  return env->NewObject(classes->annotated_span_class.get(),
+                        classes->annotated_span_init,
+                        static_cast<jint>(span_bmp.first),
+                        static_cast<jint>(span_bmp.second), classification);
+}
+
 TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME, nativeAnnotate)
 (JNIEnv* env, jobject thiz, jlong ptr, jstring context, jobject options) {
   if (!ptr) {
     return nullptr;
   }
-  const AnnotatorJniContext* model_context =
-      reinterpret_cast<AnnotatorJniContext*>(ptr);
+  const std::shared_ptr<const AnnotatorJniContext> model_context =
+      GetAnnotatorJniContext(ptr);
   const std::string context_utf8 = ToStlString(env, context);
   const std::vector<AnnotatedSpan> annotations =
       model_context->model()->Annotate(context_utf8,
                                        FromJavaAnnotationOptions(env, options));
 
-  jclass result_class = env->FindClass(
-      TC3_PACKAGE_PATH TC3_ANNOTATOR_CLASS_NAME_STR "$AnnotatedSpan");
-  if (!result_class) {
-    TC3_LOG(ERROR) << "Couldn't find result class: "
-                   << TC3_PACKAGE_PATH TC3_ANNOTATOR_CLASS_NAME_STR
-        "$AnnotatedSpan";
+  return AnnotationsToJObjectArray(env, model_context.get(), context_utf8,
+                                   annotations);
+}
+
+TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME, nativeAnnotateUtf8)
+(JNIEnv* env, jobject thiz, jlong ptr, jbyteArray context, jobject options) {
+  if (!ptr) {
     return nullptr;
   }
+  const std::shared_ptr<const AnnotatorJniContext> model_context =
+      GetAnnotatorJniContext(ptr);
+  std::string context_utf8;
+  if (!libtextclassifier3::JByteArrayToString(env, context, &context_utf8)) {
+    return nullptr;
+  }
+  const std::vector<AnnotatedSpan> annotations =
+      model_context->model()->Annotate(context_utf8,
+                                       FromJavaAnnotationOptions(env, options));
+  return AnnotationsToJObjectArray(env, model_context.get(), context_utf8,
+                                   annotations);
+}
 
-  jmethodID result_class_constructor =
-      env->GetMethodID(result_class, "<init>",
-                       "(II[L" TC3_PACKAGE_PATH TC3_ANNOTATOR_CLASS_NAME_STR
-                       "$ClassificationResult;)V");
+TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME,
+               nativeAnnotateDirectUtf8)
+(JNIEnv* env, jobject thiz, jlong ptr, jobject context, jint offset,
+ jint length, jobject options) {
+  if (!ptr) {
+    return nullptr;
+  }
+  const char* context_bytes =
+      static_cast<const char*>(env->GetDirectBufferAddress(context));
+  if (context_bytes == nullptr || offset < 0 || length < 0 ||
+      offset + length > env->GetDirectBufferCapacity(context)) {
+    TC3_LOG(ERROR) << "Invalid direct buffer.";
+    return nullptr;
+  }
+  const std::shared_ptr<const AnnotatorJniContext> model_context =
+      GetAnnotatorJniContext(ptr);
+  const std::string context_utf8(context_bytes + offset, length);
+  const std::vector<AnnotatedSpan> annotations =
+      model_context->model()->Annotate(context_utf8,
+                                       FromJavaAnnotationOptions(env, options));
+  return AnnotationsToJObjectArray(env, model_context.get(), context_utf8,
+                                   annotations);
+}
 
-  jobjectArray results =
-      env->NewObjectArray(annotations.size(), result_class, nullptr);
+TC3_JNI_METHOD(jobject, TC3_ANNOTATOR_CLASS_NAME, nativeAnnotateCompact)
+(JNIEnv* env, jobject thiz, jlong ptr, jstring context, jobject options) {
+  if (!ptr) {
+    return nullptr;
+  }
+  const std::shared_ptr<const AnnotatorJniContext> model_context =
+      GetAnnotatorJniContext(ptr);
+  const std::string context_utf8 = ToStlString(env, context);
+  const std::vector<AnnotatedSpan> annotations =
+      model_context->model()->Annotate(context_utf8,
+                                       FromJavaAnnotationOptions(env, options));
+  return AnnotationsToCompactJObject(env, model_context.get(), context_utf8,
+                                     annotations);
+}
 
-  for (int i = 0; i < annotations.size(); ++i) {
-    CodepointSpan span_bmp =
-        ConvertIndicesUTF8ToBMP(context_utf8, annotations[i].span);
-    jobject result = env->NewObject(
-        result_class, result_class_constructor,
-        static_cast<jint>(span_bmp.first), static_cast<jint>(span_bmp.second),
-        ClassificationResultsToJObjectArray(env, model_context,
-                                            annotations[i].classification));
-    env->SetObjectArrayElement(results, i, result);
-    env->DeleteLocalRef(result);
+TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME, nativeAnnotateBatch)
+(JNIEnv* env, jobject thiz, jlong ptr, jobjectArray contexts, jobject options) {
+  if (!ptr) {
+    return nullptr;
+  }
+  const std::shared_ptr<const AnnotatorJniContext> model_context =
+      GetAnnotatorJniContext(ptr);
+  const int num_contexts = env->GetArrayLength(contexts);
+  std::vector<std::string> contexts_utf8;
+  contexts_utf8.reserve(num_contexts);
+  for (int i = 0; i < num_contexts; ++i) {
+    const ScopedLocalRef<jstring> context(
+        static_cast<jstring>(env->GetObjectArrayElement(contexts, i)), env);
+    contexts_utf8.push_back(ToStlString(env, context.get()));
+  }
+  const std::vector<std::vector<AnnotatedSpan>> annotations =
+      model_context->model()->AnnotateBatch(
+          contexts_utf8, FromJavaAnnotationOptions(env, options));
+
+  jobjectArray results = env->NewObjectArray(
+      num_contexts,
+      model_context->result_classes()->annotated_spans_class.get(), nullptr);
+  for (int i = 0; i < num_contexts; ++i) {
+    const ScopedLocalRef<jobject> result(
+        AnnotationsToCompactJObject(env, model_context.get(),
+                                    contexts_utf8[i], annotations[i]),
+        env);
+    env->SetObjectArrayElement(results, i, result.get());
+  }
+  return results;
+}
+
+TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME,
+               nativeClassifyTextBatch)
+(JNIEnv* env, jobject thiz, jlong ptr, jobjectArray contexts,
+ jintArray selection_begins, jintArray selection_ends, jobject options) {
+  if (!ptr) {
+    return nullptr;
+  }
+  const int num_contexts = env->GetArrayLength(contexts);
+  if (env->GetArrayLength(selection_begins) != num_contexts ||
+      env->GetArrayLength(selection_ends) != num_contexts) {
+    TC3_LOG(ERROR) << "Mismatching number of contexts and selections.";
+    return nullptr;
+  }
+  const std::shared_ptr<const AnnotatorJniContext> model_context =
+      GetAnnotatorJniContext(ptr);
+  const libtextclassifier3::ClassificationOptions classification_options =
+      FromJavaClassificationOptions(env, options);
+  std::vector<jint> begins(num_contexts);
+  std::vector<jint> ends(num_contexts);
+  env->GetIntArrayRegion(selection_begins, 0, num_contexts, begins.data());
+  env->GetIntArrayRegion(selection_ends, 0, num_contexts, ends.data());
+
+  jobjectArray results = env->NewObjectArray(
+      num_contexts,
+      model_context->result_classes()->classification_result_array_class.get(),
+      nullptr);
+  for (int i = 0; i < num_contexts; ++i) {
+    const ScopedLocalRef<jstring> context(
+        static_cast<jstring>(env->GetObjectArrayElement(contexts, i)), env);
+    const std::string context_utf8 = ToStlString(env, context.get());
+    const CodepointSpan input_indices =
+        BMPIndexTable(context_utf8).ToUTF8({begins[i], ends[i]});
+    const ScopedLocalRef<jobjectArray> result(
+        ClassificationResultsToJObjectArray(
+            env, model_context.get(),
+            model_context->model()->ClassifyText(context_utf8, input_indices,
+                                                 classification_options)),
+        env);
+    env->SetObjectArrayElement(results, i, result.get());
   }
-  env->DeleteLocalRef(result_class);
   return results;
 }
 
+TC3_JNI_METHOD(jboolean, TC3_ANNOTATOR_CLASS_NAME, nativeAnnotateAsync)
+(JNIEnv* env, jobject thiz, jlong ptr, jstring context, jobject options,
+ jobject callback, jlong request_ptr) {
+  if (!ptr || !request_ptr) {
+    return false;
+  }
+  // Everything that reads the Java arguments happens here, on the calling
+  // thread; the worker only sees native copies and global references.
+  const ScopedLocalRef<jclass> callback_class(env->GetObjectClass(callback),
+                                              env);
+  const jmethodID on_annotated = env->GetMethodID(
+      callback_class.get(), "onAnnotated",
+      "([L" TC3_PACKAGE_PATH TC3_ANNOTATOR_CLASS_NAME_STR "$AnnotatedSpan;)V");
+  if (!on_annotated) {
+    TC3_LOG(ERROR) << "Couldn't find onAnnotated method.";
+    return false;
+  }
+  const std::shared_ptr<const AnnotatorJniContext> model_context =
+      GetAnnotatorJniContext(ptr);
+  JavaVM* jvm = model_context->jni_cache()->jvm;
+  const std::shared_ptr<ScopedGlobalRef<jobject>> callback_ref =
+      std::make_shared<ScopedGlobalRef<jobject>>(env->NewGlobalRef(callback),
+                                                 jvm);
+  const std::shared_ptr<CancellationToken> token =
+      GetAsyncRequestToken(request_ptr);
+  libtextclassifier3::AnnotationOptions annotation_options =
+      FromJavaAnnotationOptions(env, options);
+  annotation_options.cancellation_token = token.get();
+
+  ScheduleJniTask(jvm, [model_context, callback_ref, on_annotated, token,
+                        annotation_options,
+                        context_utf8 = ToStlString(env, context)](
+                           JNIEnv* worker_env) {
+    if (token->IsCancelled()) {
+      return;
+    }
+    const std::vector<AnnotatedSpan> annotations =
+        model_context->model()->Annotate(context_utf8, annotation_options);
+    if (token->IsCancelled()) {
+      return;
+    }
+    const ScopedLocalRef<jobjectArray> result(
+        AnnotationsToJObjectArray(worker_env, model_context.get(),
+                                  context_utf8, annotations),
+        worker_env);
+    worker_env->CallVoidMethod(callback_ref->get(), on_annotated,
+                               result.get());
+  });
+  return true;
+}
+
 TC3_JNI_METHOD(jbyteArray, TC3_ANNOTATOR_CLASS_NAME,
                nativeLookUpKnowledgeEntity)
 (JNIEnv* env, jobject thiz, jlong ptr, jstring id) {
   if (!ptr) {
     return nullptr;
   }
-  const Annotator* model = reinterpret_cast<AnnotatorJniContext*>(ptr)->model();
+  const std::shared_ptr<const AnnotatorJniContext> model_context =
+      GetAnnotatorJniContext(ptr);
+  const Annotator* model = model_context->model();
   const std::string id_utf8 = ToStlString(env, id);
   std::string serialized_knowledge_result;
   if (!model->LookUpKnowledgeEntity(id_utf8, &serialized_knowledge_result)) {
@@ -631,11 +1215,41 @@ TC3_JNI_METHOD(jbyteArray, TC3_ANNOTATOR_CLASS_NAME,
   return result;
 }
 
+TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME, nativeWarmup)
+(JNIEnv* env, jobject thiz, jlong ptr) {
+  if (!ptr) {
+    return nullptr;
+  }
+  const std::shared_ptr<const AnnotatorJniContext> model_context =
+      GetAnnotatorJniContext(ptr);
+  return WarmupReportToJObjectArray(env, model_context->model()->Warmup());
+}
+
+TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME, nativeSwapAnnotator)
+(JNIEnv* env, jobject thiz, jlong ptr, jlong new_ptr, jboolean warmup) {
+  if (!ptr || !new_ptr) {
+    return nullptr;
+  }
+  AnnotatorJniHandle* handle = reinterpret_cast<AnnotatorJniHandle*>(ptr);
+  std::unique_ptr<AnnotatorJniHandle> new_handle(
+      reinterpret_cast<AnnotatorJniHandle*>(new_ptr));
+  const std::shared_ptr<const AnnotatorJniContext> new_context =
+      new_handle->Get();
+
+  // Warm up before publishing, so that no request hits the cold model.
+  WarmupReport report;
+  if (warmup) {
+    report = new_context->model()->Warmup();
+  }
+  handle->Swap(new_context);
+  return WarmupReportToJObjectArray(env, report);
+}
+
 TC3_JNI_METHOD(void, TC3_ANNOTATOR_CLASS_NAME, nativeCloseAnnotator)
 (JNIEnv* env, jobject thiz, jlong ptr) {
-  const AnnotatorJniContext* context =
-      reinterpret_cast<AnnotatorJniContext*>(ptr);
-  delete context;
+  const AnnotatorJniHandle* handle =
+      reinterpret_cast<AnnotatorJniHandle*>(ptr);
+  delete handle;
 }
 
 TC3_JNI_METHOD(jstring, TC3_ANNOTATOR_CLASS_NAME, nativeGetLanguage)
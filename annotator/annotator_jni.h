@@ -19,6 +19,7 @@
 
 #include <jni.h>
 #include <string>
+#include <vector>
 #include "annotator/annotator_jni_common.h"
 #include "annotator/types.h"
 #include "utils/java/jni-base.h"
@@ -50,6 +51,9 @@ TC3_JNI_METHOD(jboolean, TC3_ANNOTATOR_CLASS_NAME,
                nativeInitializeInstalledAppEngine)
 (JNIEnv* env, jobject thiz, jlong ptr, jbyteArray serialized_config);
 
+TC3_JNI_METHOD(jboolean, TC3_ANNOTATOR_CLASS_NAME, nativeSetExecutorOptions)
+(JNIEnv* env, jobject thiz, jlong ptr, jint num_threads, jboolean allow_fp16);
+
 TC3_JNI_METHOD(jlong, TC3_ANNOTATOR_CLASS_NAME, nativeGetNativeModelPtr)
 (JNIEnv* env, jobject thiz, jlong ptr);
 
@@ -62,13 +66,54 @@ TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME, nativeClassifyText)
  jint selection_end, jobject options, jobject app_context,
  jstring device_locales);
 
+TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME,
+               nativeClassifyTextWithAllIntents)
+(JNIEnv* env, jobject thiz, jlong ptr, jstring context, jint selection_begin,
+ jint selection_end, jobject options, jobject app_context,
+ jstring device_locales);
+
+TC3_JNI_METHOD(jobject, TC3_ANNOTATOR_CLASS_NAME,
+               nativeSuggestSelectionAndClassify)
+(JNIEnv* env, jobject thiz, jlong ptr, jstring context, jint selection_begin,
+ jint selection_end, jobject selection_options, jobject classification_options,
+ jobject app_context, jstring device_locales);
+
 TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME, nativeAnnotate)
 (JNIEnv* env, jobject thiz, jlong ptr, jstring context, jobject options);
 
+TC3_JNI_METHOD(jobject, TC3_ANNOTATOR_CLASS_NAME, nativeAnnotateCompact)
+(JNIEnv* env, jobject thiz, jlong ptr, jstring context, jobject options);
+
+TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME, nativeAnnotateUtf8)
+(JNIEnv* env, jobject thiz, jlong ptr, jbyteArray context, jobject options);
+
+TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME,
+               nativeAnnotateDirectUtf8)
+(JNIEnv* env, jobject thiz, jlong ptr, jobject context, jint offset,
+ jint length, jobject options);
+
+TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME, nativeAnnotateBatch)
+(JNIEnv* env, jobject thiz, jlong ptr, jobjectArray contexts, jobject options);
+
+TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME,
+               nativeClassifyTextBatch)
+(JNIEnv* env, jobject thiz, jlong ptr, jobjectArray contexts,
+ jintArray selection_begins, jintArray selection_ends, jobject options);
+
+TC3_JNI_METHOD(jboolean, TC3_ANNOTATOR_CLASS_NAME, nativeAnnotateAsync)
+(JNIEnv* env, jobject thiz, jlong ptr, jstring context, jobject options,
+ jobject callback, jlong request_ptr);
+
 TC3_JNI_METHOD(jbyteArray, TC3_ANNOTATOR_CLASS_NAME,
                nativeLookUpKnowledgeEntity)
 (JNIEnv* env, jobject thiz, jlong ptr, jstring id);
 
+TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME, nativeWarmup)
+(JNIEnv* env, jobject thiz, jlong ptr);
+
+TC3_JNI_METHOD(jobjectArray, TC3_ANNOTATOR_CLASS_NAME, nativeSwapAnnotator)
+(JNIEnv* env, jobject thiz, jlong ptr, jlong new_ptr, jboolean warmup);
+
 TC3_JNI_METHOD(void, TC3_ANNOTATOR_CLASS_NAME, nativeCloseAnnotator)
 (JNIEnv* env, jobject thiz, jlong ptr);
 
@@ -103,6 +148,34 @@ TC3_JNI_METHOD(jstring, TC3_ANNOTATOR_CLASS_NAME,
 
 namespace libtextclassifier3 {
 
+// Translates the codepoint indices of a utf8 string to and from Java BMP
+// (basic multilingual plane) indices. The string is scanned once, when the
+// table is built, so that all spans of a request are translated without
+// rescanning it.
+class BMPIndexTable {
+ public:
+  explicit BMPIndexTable(const std::string& utf8_str);
+
+  // Converts a span expressed in utf8 codepoints to Java BMP codepoints.
+  // Indices that are out of range are converted to -1.
+  CodepointSpan ToBMP(CodepointSpan utf8_indices) const;
+
+  // Converts a span expressed in Java BMP codepoints to utf8 codepoints.
+  // Indices that are out of range or inside a surrogate pair are converted to
+  // -1.
+  CodepointSpan ToUTF8(CodepointSpan bmp_indices) const;
+
+ private:
+  int ToBMP(int utf8_index) const;
+  int ToUTF8(int bmp_index) const;
+
+  int num_codepoints_ = 0;
+
+  // The BMP index of each codepoint index, including the end of the string.
+  // Empty if all codepoints are in the BMP, as the indices are then the same.
+  std::vector<int> bmp_indices_;
+};
+
 // Given a utf8 string and a span expressed in Java BMP (basic multilingual
 // plane) codepoints, converts it to a span expressed in utf8 codepoints.
 libtextclassifier3::CodepointSpan ConvertIndicesBMPToUTF8(
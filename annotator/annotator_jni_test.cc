@@ -75,5 +75,25 @@ TEST(Annotator, ConvertIndicesBMPUTF8) {
             std::make_pair(3, 9));
 }
 
+TEST(Annotator, BMPIndexTable) {
+  const BMPIndexTable ascii("hello world");
+  EXPECT_EQ(ascii.ToBMP({6, 11}), std::make_pair(6, 11));
+  EXPECT_EQ(ascii.ToUTF8({6, 11}), std::make_pair(6, 11));
+  EXPECT_EQ(ascii.ToBMP({-1, 12}), std::make_pair(-1, -1));
+  EXPECT_EQ(ascii.ToUTF8({-1, 12}), std::make_pair(-1, -1));
+
+  // The same table converts all spans.
+  const BMPIndexTable emoji("😁 Hell😁😁World.");
+  EXPECT_EQ(emoji.ToBMP({0, 1}), std::make_pair(0, 2));
+  EXPECT_EQ(emoji.ToBMP({2, 7}), std::make_pair(3, 9));
+  EXPECT_EQ(emoji.ToBMP({7, 14}), std::make_pair(9, 17));
+  EXPECT_EQ(emoji.ToUTF8({3, 9}), std::make_pair(2, 7));
+  EXPECT_EQ(emoji.ToUTF8({9, 17}), std::make_pair(7, 14));
+  EXPECT_EQ(emoji.ToUTF8({0, 18}), std::make_pair(0, -1));
+
+  // Indices inside a surrogate pair don't map to a codepoint.
+  EXPECT_EQ(emoji.ToUTF8({1, 8}), std::make_pair(-1, -1));
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
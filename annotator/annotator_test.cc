@@ -0,0 +1,642 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/annotator.h"
+
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "annotator/annotations_generated.h"
+#include "lang_id/fb_model/lang-id-from-fb.h"
+#include "lang_id/lang-id.h"
+#include "utils/testing/allocation-counter.h"
+#include "utils/testing/worst-case-search.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+// Heap allocations a warm call on the test text may make. A failure means
+// that a change added allocations to the path: remove them, or raise the
+// budget knowingly. Lower a budget when allocations are removed.
+constexpr int64 kMaxAnnotateAllocations = 3000;
+constexpr int64 kMaxClassifyTextAllocations = 1500;
+
+constexpr char kText[] = "call me at (800) 123-456 today";
+constexpr CodepointSpan kPhoneSpan = {11, 24};
+
+std::string GetModelPath() { return TC3_TEST_DATA_DIR; }
+
+std::string ReadFile(const std::string& file_name) {
+  std::ifstream file_stream(file_name);
+  return std::string(std::istreambuf_iterator<char>(file_stream), {});
+}
+
+// Returns the model with the changes of 'modify'.
+std::string ModifyModel(const std::string& model_buffer,
+                        const std::function<void(ModelT*)>& modify) {
+  std::unique_ptr<ModelT> model = UnPackModel(model_buffer.data());
+  modify(model.get());
+  flatbuffers::FlatBufferBuilder builder;
+  FinishModelBuffer(builder, Model::Pack(builder, model.get()));
+  return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                     builder.GetSize());
+}
+
+// Adds a regex rule for order numbers like "ORD-1234" to the model.
+void AddOrderPattern(ModelT* model, float priority_score) {
+  if (model->regex_model == nullptr) {
+    model->regex_model.reset(new RegexModelT);
+  }
+  model->regex_model->patterns.emplace_back(new RegexModel_::PatternT);
+  RegexModel_::PatternT* pattern = model->regex_model->patterns.back().get();
+  pattern->collection_name = "order";
+  pattern->pattern = "ORD-\\d{4}";
+  pattern->priority_score = priority_score;
+}
+
+void ExpectSameClassifications(
+    const std::vector<ClassificationResult>& classifications,
+    const std::vector<ClassificationResult>& expected) {
+  ASSERT_EQ(classifications.size(), expected.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(classifications[i].collection, expected[i].collection);
+    EXPECT_FLOAT_EQ(classifications[i].score, expected[i].score);
+  }
+}
+
+void ExpectSameAnnotations(const std::vector<AnnotatedSpan>& annotations,
+                           const std::vector<AnnotatedSpan>& expected) {
+  ASSERT_EQ(annotations.size(), expected.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_EQ(annotations[i].span, expected[i].span);
+    ExpectSameClassifications(annotations[i].classification,
+                              expected[i].classification);
+  }
+}
+
+class AnnotatorTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    model_buffer_ = ReadFile(GetModelPath() + "test_model.fb");
+    annotator_ = Annotator::FromUnownedBuffer(model_buffer_.data(),
+                                              model_buffer_.size(), &unilib_);
+    ASSERT_NE(annotator_, nullptr);
+  }
+
+  // Loads an annotator from a model buffer that outlives it.
+  std::unique_ptr<Annotator> LoadModel(const std::string& model_buffer) {
+    return Annotator::FromUnownedBuffer(model_buffer.data(),
+                                        model_buffer.size(), &unilib_);
+  }
+
+  UniLib unilib_;
+  std::string model_buffer_;
+  std::unique_ptr<Annotator> annotator_;
+};
+
+TEST_F(AnnotatorTest, AnnotateStaysWithinAllocationBudget) {
+  const std::string text = kText;
+  // The first call builds the interpreters and the lazy parts of the model.
+  annotator_->Annotate(text);
+  const int64 num_allocations =
+      CountAllocations([&]() { annotator_->Annotate(text); });
+  EXPECT_LE(num_allocations, kMaxAnnotateAllocations);
+}
+
+TEST_F(AnnotatorTest, ClassifyTextStaysWithinAllocationBudget) {
+  const std::string text = kText;
+  annotator_->ClassifyText(text, kPhoneSpan);
+  const int64 num_allocations = CountAllocations(
+      [&]() { annotator_->ClassifyText(text, kPhoneSpan); });
+  EXPECT_LE(num_allocations, kMaxClassifyTextAllocations);
+}
+
+TEST_F(AnnotatorTest, RejectsWrongEmbeddingsOnLoad) {
+  const std::string model_buffer =
+      ReadFile(GetModelPath() + "wrong_embeddings.fb");
+  EXPECT_EQ(LoadModel(model_buffer), nullptr);
+}
+
+TEST_F(AnnotatorTest, AppliesDatetimeResolutionCacheCapacityOnBuild) {
+  // Set before anything built the datetime parser.
+  annotator_->SetDatetimeResolutionCacheCapacity(100);
+  EXPECT_EQ(annotator_->GetDatetimeResolutionCacheStats().num_misses, 0);
+
+  AnnotationOptions options;
+  options.reference_time_ms_utc = 1000000000000;
+  options.reference_timezone = "Europe/Zurich";
+  const std::string text = "see you tomorrow at 5";
+  annotator_->Annotate(text, options);
+  annotator_->Annotate(text, options);
+  const ResultCacheStats stats =
+      annotator_->GetDatetimeResolutionCacheStats();
+  EXPECT_GT(stats.num_misses, 0);
+  EXPECT_GT(stats.num_hits, 0);
+}
+
+TEST_F(AnnotatorTest, NeverReusesInstanceIds) {
+  // The annotators are destroyed before the next ones are created, so their
+  // addresses can be reused, but not their ids.
+  std::unordered_set<uint64> instance_ids = {annotator_->instance_id()};
+  for (int i = 0; i < 10; ++i) {
+    std::unique_ptr<Annotator> annotator = LoadModel(model_buffer_);
+    ASSERT_NE(annotator, nullptr);
+    EXPECT_TRUE(instance_ids.insert(annotator->instance_id()).second);
+    EXPECT_TRUE(
+        instance_ids.insert(annotator->CloneSharingModel()->instance_id())
+            .second);
+  }
+}
+
+TEST_F(AnnotatorTest, EnablesDatetimeRegexStatsOnBuild) {
+  // Enabled and read before anything built the datetime parser, which they
+  // don't build.
+  const int64 regex_bytes = annotator_->GetMemoryStats().regex_bytes;
+  annotator_->EnableRegexStats(/*slow_run_threshold_us=*/0);
+  annotator_->GetRegexStats();
+  EXPECT_EQ(annotator_->GetMemoryStats().regex_bytes, regex_bytes);
+
+  AnnotationOptions options;
+  options.reference_time_ms_utc = 1000000000000;
+  options.reference_timezone = "Europe/Zurich";
+  annotator_->Annotate("see you tomorrow at 5", options);
+  int num_datetime_matchers = 0;
+  for (const RegexPatternStats& stats : annotator_->GetRegexStats()) {
+    if (stats.model == "datetime_model") {
+      num_datetime_matchers += stats.num_matchers;
+    }
+  }
+  EXPECT_GT(num_datetime_matchers, 0);
+}
+
+TEST_F(AnnotatorTest, AnnotatesWithPrunedChunks) {
+  ChunkPruningOptions pruning;
+  pruning.drop_spans_across_sentences = true;
+  annotator_->SetChunkPruningOptions(pruning);
+
+  const std::string text = std::string("See you soon. ") + kText + ". Bye!";
+  const int offset = 14;
+  bool found_phone = false;
+  for (const AnnotatedSpan& annotation : annotator_->Annotate(text)) {
+    EXPECT_FALSE(annotation.span.first < offset &&
+                 annotation.span.second > offset);
+    found_phone |= annotation.span == CodepointSpan(kPhoneSpan.first + offset,
+                                                    kPhoneSpan.second + offset);
+  }
+  EXPECT_TRUE(found_phone);
+}
+
+TEST_F(AnnotatorTest, AnnotatesBatchAsEachInputAlone) {
+  const std::vector<std::string> contexts = {
+      kText, "", "see you tomorrow at 5",
+      "write to me at hello@example.com or call (800) 123-456"};
+  const std::vector<std::vector<AnnotatedSpan>> results =
+      annotator_->AnnotateBatch(contexts);
+  ASSERT_EQ(results.size(), contexts.size());
+  for (int i = 0; i < contexts.size(); ++i) {
+    const std::vector<AnnotatedSpan> expected =
+        annotator_->Annotate(contexts[i]);
+    ASSERT_EQ(results[i].size(), expected.size()) << i;
+    for (int j = 0; j < expected.size(); ++j) {
+      EXPECT_EQ(results[i][j].span, expected[j].span);
+      ASSERT_EQ(results[i][j].classification.size(),
+                expected[j].classification.size());
+      for (int k = 0; k < expected[j].classification.size(); ++k) {
+        EXPECT_EQ(results[i][j].classification[k].collection,
+                  expected[j].classification[k].collection);
+        EXPECT_FLOAT_EQ(results[i][j].classification[k].score,
+                        expected[j].classification[k].score);
+      }
+    }
+  }
+}
+
+TEST_F(AnnotatorTest, AnnotatesSameWithBatchedLinesAndChunks) {
+  const std::string text = std::string(kText) +
+                           "\nsee you tomorrow at 5\n\n"
+                           "write to me at hello@example.com\n" +
+                           kText;
+  const auto model_with = [this](bool batch_lines, bool batch_chunks) {
+    return ModifyModel(model_buffer_, [=](ModelT* model) {
+      model->selection_feature_options->only_use_line_with_click = true;
+      model->selection_options->batch_lines_in_annotation = batch_lines;
+      model->classification_options->batch_chunks_in_annotation =
+          batch_chunks;
+    });
+  };
+  const std::string unbatched_model = model_with(false, false);
+  std::unique_ptr<Annotator> unbatched = LoadModel(unbatched_model);
+  ASSERT_NE(unbatched, nullptr);
+  const std::vector<AnnotatedSpan> expected = unbatched->Annotate(text);
+  EXPECT_FALSE(expected.empty());
+
+  for (const bool batch_lines : {false, true}) {
+    for (const bool batch_chunks : {false, true}) {
+      SCOPED_TRACE(testing::Message() << batch_lines << " " << batch_chunks);
+      const std::string model = model_with(batch_lines, batch_chunks);
+      std::unique_ptr<Annotator> annotator = LoadModel(model);
+      ASSERT_NE(annotator, nullptr);
+      ExpectSameAnnotations(annotator->Annotate(text), expected);
+    }
+  }
+}
+
+TEST_F(AnnotatorTest, ResolvesConflictsSameWithBatchedClassification) {
+  // Model, regex and datetime candidates that overlap each other.
+  const std::string text =
+      "call (800) 123-456 or hello@example.com at 5 pm tomorrow, 12 main st";
+  const auto model_with = [this](bool batch_chunks) {
+    return ModifyModel(model_buffer_, [=](ModelT* model) {
+      model->classification_options->batch_chunks_in_annotation =
+          batch_chunks;
+    });
+  };
+  const std::string unbatched_model = model_with(false);
+  const std::string batched_model = model_with(true);
+  std::unique_ptr<Annotator> unbatched = LoadModel(unbatched_model);
+  std::unique_ptr<Annotator> batched = LoadModel(batched_model);
+  ASSERT_NE(unbatched, nullptr);
+  ASSERT_NE(batched, nullptr);
+
+  for (int i = 0; i < text.size(); ++i) {
+    SCOPED_TRACE(i);
+    EXPECT_EQ(batched->SuggestSelection(text, {i, i + 1}),
+              unbatched->SuggestSelection(text, {i, i + 1}));
+  }
+  ExpectSameAnnotations(batched->Annotate(text), unbatched->Annotate(text));
+}
+
+TEST_F(AnnotatorTest, AnnotatesEnabledEntityTypesAsFilteredFullResult) {
+  // No dates or durations, whose sources only run when their types are
+  // enabled.
+  const std::string text =
+      "call (800) 123-456 or write to hello@example.com, see www.example.com";
+  const std::vector<AnnotatedSpan> all = annotator_->Annotate(text);
+  EXPECT_FALSE(all.empty());
+
+  for (const std::unordered_set<std::string>& entity_types :
+       std::vector<std::unordered_set<std::string>>{{"phone"},
+                                                    {"email"},
+                                                    {"url"},
+                                                    {"email", "url"},
+                                                    {"number"},
+                                                    {"flight"}}) {
+    std::vector<AnnotatedSpan> expected;
+    for (const AnnotatedSpan& annotation : all) {
+      AnnotatedSpan filtered;
+      filtered.span = annotation.span;
+      for (const ClassificationResult& classification :
+           annotation.classification) {
+        if (entity_types.count(classification.collection) > 0) {
+          filtered.classification.push_back(classification);
+        }
+      }
+      if (!filtered.classification.empty()) {
+        expected.push_back(filtered);
+      }
+    }
+
+    AnnotationOptions options;
+    options.entity_types = entity_types;
+    SCOPED_TRACE(*entity_types.begin());
+    ExpectSameAnnotations(annotator_->Annotate(text, options), expected);
+  }
+}
+
+TEST_F(AnnotatorTest, GatesAnnotationOnLanguagesOfLangId) {
+  std::unique_ptr<mobile::lang_id::LangId> lang_id =
+      mobile::lang_id::GetLangIdFromFlatbufferFile(GetModelPath() +
+                                                   "lang_id.model");
+  ASSERT_TRUE(lang_id->is_valid());
+  const std::string model_buffer =
+      ModifyModel(model_buffer_, [](ModelT* model) {
+        model->triggering_locales = "en";
+      });
+  std::unique_ptr<Annotator> annotator = LoadModel(model_buffer);
+  ASSERT_NE(annotator, nullptr);
+  const std::string english_text =
+      "Hello, please call me at (800) 123-456, I will be at home all day.";
+  const std::string french_text =
+      "Bonjour, appelle-moi au (800) 123-456, je serai chez moi toute la "
+      "journée.";
+
+  // Without a LangId, nothing tells that the text is not in English.
+  EXPECT_FALSE(annotator->Annotate(french_text).empty());
+
+  annotator->SetLangId(lang_id.get());
+  EXPECT_TRUE(annotator->Annotate(french_text).empty());
+  EXPECT_FALSE(annotator->Annotate(french_text + "\n" + english_text).empty());
+
+  // The detected language is used as if the caller had given it.
+  AnnotationOptions options;
+  options.detected_text_language_tags = "en";
+  ExpectSameAnnotations(annotator->Annotate(english_text),
+                        annotator->Annotate(english_text, options));
+  EXPECT_FALSE(annotator->Annotate(english_text).empty());
+}
+
+TEST_F(AnnotatorTest, SuggestsSameSelectionWhenRuleSkipsModel) {
+  const std::string text =
+      "your order ORD-1234 ships today, call me at (800) 123-456";
+  const auto model_with = [this](float skip_model_min_priority_score) {
+    return ModifyModel(model_buffer_, [=](ModelT* model) {
+      AddOrderPattern(model, /*priority_score=*/2.0f);
+      model->selection_options->skip_model_min_priority_score =
+          skip_model_min_priority_score;
+    });
+  };
+  const std::string model_buffer = model_with(0.0f);
+  const std::string skipping_model_buffer = model_with(1.5f);
+  std::unique_ptr<Annotator> annotator = LoadModel(model_buffer);
+  std::unique_ptr<Annotator> skipping_annotator =
+      LoadModel(skipping_model_buffer);
+  ASSERT_NE(annotator, nullptr);
+  ASSERT_NE(skipping_annotator, nullptr);
+
+  for (int i = 0; i < text.size(); ++i) {
+    SCOPED_TRACE(i);
+    EXPECT_EQ(skipping_annotator->SuggestSelection(text, {i, i + 1}),
+              annotator->SuggestSelection(text, {i, i + 1}));
+  }
+  EXPECT_EQ(skipping_annotator->SuggestSelection(text, {13, 14}),
+            CodepointSpan(11, 19));
+}
+
+// Returns the model with only the given selection patterns, with the priority
+// scores, and without the selection model and the datetimes.
+std::string SelectionPatternsModel(
+    const std::string& model_buffer,
+    const std::vector<std::pair<std::string, float>>& patterns) {
+  return ModifyModel(model_buffer, [&patterns](ModelT* model) {
+    model->triggering_options->enabled_modes =
+        ModeFlag_ANNOTATION_AND_CLASSIFICATION;
+    model->datetime_model.reset();
+    model->regex_model->patterns.clear();
+    for (const std::pair<std::string, float>& pattern : patterns) {
+      model->regex_model->patterns.emplace_back(new RegexModel_::PatternT);
+      model->regex_model->patterns.back()->collection_name = "code";
+      model->regex_model->patterns.back()->pattern = pattern.first;
+      model->regex_model->patterns.back()->enabled_modes = ModeFlag_SELECTION;
+      model->regex_model->patterns.back()->priority_score = pattern.second;
+    }
+  });
+}
+
+TEST_F(AnnotatorTest, SuggestsSelectionOfAdjacentMatches) {
+  std::unique_ptr<Annotator> annotator = LoadModel(
+      SelectionPatternsModel(model_buffer_, {{"\\d{3}-\\d{3}", 2.0f}}));
+  ASSERT_NE(annotator, nullptr);
+  const std::string text = "111-222-333-444-555-666-777";
+
+  // The matches are found from the start of the text, whatever the click.
+  EXPECT_EQ(annotator->SuggestSelection(text, {0, 3}), CodepointSpan(0, 7));
+  EXPECT_EQ(annotator->SuggestSelection(text, {12, 15}), CodepointSpan(8, 15));
+  EXPECT_EQ(annotator->SuggestSelection(text, {20, 23}),
+            CodepointSpan(16, 23));
+  EXPECT_EQ(annotator->SuggestSelection(text, {24, 27}),
+            CodepointSpan(24, 27));
+}
+
+TEST_F(AnnotatorTest, SuggestsSelectionResolvingChainedMatches) {
+  // "1-222-3" overlaps both "111-222" and "333-444", and wins against them.
+  std::unique_ptr<Annotator> annotator = LoadModel(SelectionPatternsModel(
+      model_buffer_,
+      {{"\\d{3}-\\d{3}", 2.0f}, {"\\d-\\d{3}-\\d", 3.0f}}));
+  ASSERT_NE(annotator, nullptr);
+  const std::string text = "111-222-333-444 and 555-666";
+
+  EXPECT_EQ(annotator->SuggestSelection(text, {4, 7}), CodepointSpan(2, 9));
+  EXPECT_EQ(annotator->SuggestSelection(text, {12, 15}),
+            CodepointSpan(12, 15));
+  EXPECT_EQ(annotator->SuggestSelection(text, {24, 27}),
+            CodepointSpan(20, 27));
+}
+
+TEST_F(AnnotatorTest, ClassifiesSameWithTokenizationWindow) {
+  std::string filler;
+  for (int i = 0; i < 10; ++i) {
+    filler += "nothing to see in this part of the text. ";
+  }
+  const std::string window_model_buffer =
+      ModifyModel(model_buffer_, [](ModelT* model) {
+        model->classification_options->tokenization_window_size = 100;
+      });
+  std::unique_ptr<Annotator> window_annotator = LoadModel(window_model_buffer);
+  ASSERT_NE(window_annotator, nullptr);
+
+  // The phone number at the start, in the middle and at the end of a text
+  // much longer than the window.
+  for (const std::string& prefix : {std::string(), filler}) {
+    for (const std::string& suffix : {std::string(), filler}) {
+      const std::string text = prefix + kText + suffix;
+      const int offset = prefix.size();
+      const CodepointSpan selection = {kPhoneSpan.first + offset,
+                                       kPhoneSpan.second + offset};
+      SCOPED_TRACE(testing::Message() << offset << " " << suffix.size());
+      ExpectSameClassifications(
+          window_annotator->ClassifyText(text, selection),
+          annotator_->ClassifyText(text, selection));
+    }
+  }
+
+  // A selection past the end of the context.
+  const std::string text = kText + filler;
+  for (const int start : {static_cast<int>(text.size()) + 10,
+                          static_cast<int>(text.size()) + 1000}) {
+    SCOPED_TRACE(start);
+    ExpectSameClassifications(
+        window_annotator->ClassifyText(text, {start, start + 5}),
+        annotator_->ClassifyText(text, {start, start + 5}));
+  }
+}
+
+TEST_F(AnnotatorTest, ClassifiesSameWhenRuleSkipsLaterSources) {
+  const std::string text =
+      "your order ORD-1234 ships on March 3rd, call me at (800) 123-456";
+  const auto model_with = [this](float skip_later_sources_min_priority_score) {
+    return ModifyModel(model_buffer_, [=](ModelT* model) {
+      AddOrderPattern(model, /*priority_score=*/2.0f);
+      model->classification_options->skip_later_sources_min_priority_score =
+          skip_later_sources_min_priority_score;
+    });
+  };
+  const std::string model_buffer = model_with(0.0f);
+  const std::string skipping_model_buffer = model_with(1.5f);
+  std::unique_ptr<Annotator> annotator = LoadModel(model_buffer);
+  std::unique_ptr<Annotator> skipping_annotator =
+      LoadModel(skipping_model_buffer);
+  ASSERT_NE(annotator, nullptr);
+  ASSERT_NE(skipping_annotator, nullptr);
+
+  // The order number, text around it, a date and a phone number.
+  for (const CodepointSpan& selection :
+       std::vector<CodepointSpan>{{11, 19}, {5, 19}, {20, 25}, {29, 38},
+                                  {51, 64}}) {
+    SCOPED_TRACE(testing::Message() << selection.first << " "
+                                    << selection.second);
+    ExpectSameClassifications(
+        skipping_annotator->ClassifyText(text, selection),
+        annotator->ClassifyText(text, selection));
+  }
+  const std::vector<ClassificationResult> order =
+      skipping_annotator->ClassifyText(text, {11, 19});
+  ASSERT_FALSE(order.empty());
+  EXPECT_EQ(order[0].collection, "order");
+}
+
+TEST_F(AnnotatorTest, AnnotatesBatchWithOptionsOfEachInput) {
+  const std::vector<std::string> contexts = {kText, "see you tomorrow at 5",
+                                             kText};
+  std::vector<AnnotationOptions> options(contexts.size());
+  options[1].reference_time_ms_utc = 1000000000000;
+  options[1].reference_timezone = "Europe/Zurich";
+  options[2].detected_text_language_tags = "zz";
+
+  int num_complete = 0;
+  const std::vector<std::vector<AnnotatedSpan>> results =
+      annotator_->AnnotateBatch(contexts, options, &num_complete);
+  EXPECT_EQ(num_complete, contexts.size());
+  ASSERT_EQ(results.size(), contexts.size());
+  for (int i = 0; i < contexts.size(); ++i) {
+    const std::vector<AnnotatedSpan> expected =
+        annotator_->Annotate(contexts[i], options[i]);
+    ASSERT_EQ(results[i].size(), expected.size()) << i;
+    for (int j = 0; j < expected.size(); ++j) {
+      EXPECT_EQ(results[i][j].span, expected[j].span);
+    }
+  }
+}
+
+TEST_F(AnnotatorTest, SuggestsSelectionAndClassifiesAsSeparateCalls) {
+  const std::string text = kText;
+  const CodepointSpan click = {kPhoneSpan.first + 1, kPhoneSpan.first + 2};
+  const CodepointSpan selection = annotator_->SuggestSelection(text, click);
+  const std::vector<ClassificationResult> classification =
+      annotator_->ClassifyText(text, selection);
+
+  const AnnotatedSpan result = annotator_->SuggestSelectionAndClassify(
+      text, click, SelectionOptions(), ClassificationOptions());
+  EXPECT_EQ(result.span, selection);
+  ASSERT_EQ(result.classification.size(), classification.size());
+  for (int i = 0; i < classification.size(); ++i) {
+    EXPECT_EQ(result.classification[i].collection,
+              classification[i].collection);
+    EXPECT_FLOAT_EQ(result.classification[i].score, classification[i].score);
+  }
+}
+
+TEST_F(AnnotatorTest, SkipsModelUnderDegradationPolicy) {
+  const std::string text = kText;
+  std::atomic<float> load(1.0f);
+  AnnotationOptions options;
+  options.degradation_policy.budget_ms = 1000;
+  options.degradation_policy.load = &load;
+  int tiers = 0;
+  options.annotation_tiers = &tiers;
+
+  // The first call measures the cost of all the tiers, which at full load
+  // doesn't fit the budget of the next call.
+  annotator_->Annotate(text, options);
+  EXPECT_EQ(tiers, ANNOTATION_TIER_ALL);
+  annotator_->Annotate(text, options);
+  EXPECT_EQ(tiers & ANNOTATION_TIER_MODEL, 0);
+
+  load = 0.0f;
+  annotator_->Annotate(text, options);
+  EXPECT_EQ(tiers, ANNOTATION_TIER_ALL);
+}
+
+TEST_F(AnnotatorTest, AnnotatesToFlatbuffer) {
+  const std::string text = kText;
+  const std::vector<AnnotatedSpan> expected = annotator_->Annotate(text);
+  flatbuffers::FlatBufferBuilder builder;
+  annotator_->AnnotateToFlatbuffer(text, AnnotationOptions(), &builder);
+  const Annotations* annotations = LoadAndVerifyFlatbuffer<Annotations>(
+      builder.GetBufferPointer(), builder.GetSize());
+  ASSERT_NE(annotations, nullptr);
+  ASSERT_EQ(annotations->spans()->size(), expected.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    const AnnotationSpan* span = annotations->spans()->Get(i);
+    EXPECT_EQ(CodepointSpan(span->start(), span->end()), expected[i].span);
+    ASSERT_EQ(span->classification()->size(),
+              expected[i].classification.size());
+    EXPECT_EQ(annotations->collections()
+                  ->Get(span->classification()->Get(0)->collection())
+                  ->str(),
+              expected[i].classification[0].collection);
+  }
+}
+
+TEST_F(AnnotatorTest, VerifiesRepeatedMatchesOnce) {
+  std::unique_ptr<ModelT> model = UnPackModel(model_buffer_.data());
+  ASSERT_NE(model, nullptr);
+  if (model->regex_model == nullptr) {
+    model->regex_model.reset(new RegexModelT);
+  }
+  model->regex_model->lua_verifier.push_back("return true");
+  model->regex_model->patterns.emplace_back(new RegexModel_::PatternT);
+  RegexModel_::PatternT* pattern = model->regex_model->patterns.back().get();
+  pattern->collection_name = "order";
+  pattern->pattern = "ORD-\\d{4}";
+  pattern->verification_options.reset(new VerificationOptionsT);
+  pattern->verification_options->lua_verifier =
+      model->regex_model->lua_verifier.size() - 1;
+  pattern->verification_options->lua_verifier_reads_only_match_text = true;
+  flatbuffers::FlatBufferBuilder builder;
+  FinishModelBuffer(builder, Model::Pack(builder, model.get()));
+  std::unique_ptr<Annotator> annotator = Annotator::FromUnownedBuffer(
+      reinterpret_cast<const char*>(builder.GetBufferPointer()),
+      builder.GetSize(), &unilib_);
+  ASSERT_NE(annotator, nullptr);
+  annotator->SetVerificationCacheCapacity(10);
+
+  // The second ORD-1234 is memoized within the call.
+  const std::string text = "ORD-1234 and ORD-1234 again, then ORD-5678";
+  annotator->Annotate(text);
+  ResultCacheStats stats = annotator->GetVerificationCacheStats();
+  EXPECT_EQ(stats.num_misses, 2);
+  EXPECT_EQ(stats.num_hits, 0);
+  EXPECT_EQ(stats.size, 2);
+
+  annotator->Annotate(text);
+  stats = annotator->GetVerificationCacheStats();
+  EXPECT_EQ(stats.num_misses, 2);
+  EXPECT_EQ(stats.num_hits, 2);
+}
+
+TEST_F(AnnotatorTest, AnnotatesWorstCaseInputsWithinTimeBudget) {
+  // Generous, to only catch inputs that became superlinear to annotate.
+  constexpr double kMaxUsPerByte = 50.0;
+  annotator_->Annotate(kText);
+  for (int i = 0; i < kNumWorstCaseInputs; ++i) {
+    const WorstCaseInput input = static_cast<WorstCaseInput>(i);
+    const std::string text = WorstCaseInputText(input, 4096);
+    const double time_us = MinTimeUs(
+        /*num_repetitions=*/3, [&]() { annotator_->Annotate(text); });
+    EXPECT_LE(time_us / text.size(), kMaxUsPerByte)
+        << WorstCaseInputName(input);
+  }
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
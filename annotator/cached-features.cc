@@ -16,6 +16,9 @@
 
 #include "annotator/cached-features.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "utils/base/logging.h"
 #include "utils/tensor-view.h"
 
@@ -54,6 +57,22 @@ int CalculateOutputFeaturesSize(const FeatureProcessorOptions* options,
   return output_features_size;
 }
 
+// Rounds the value to the nearest bfloat16, i.e. to the upper half of its
+// bits. The features are finite, so NaNs don't need special handling.
+uint16 FloatToBfloat16(float value) {
+  uint32 bits;
+  memcpy(&bits, &value, sizeof(bits));
+  bits += 0x7FFF + ((bits >> 16) & 1);
+  return static_cast<uint16>(bits >> 16);
+}
+
+float Bfloat16ToFloat(uint16 value) {
+  const uint32 bits = static_cast<uint32>(value) << 16;
+  float result;
+  memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
 }  // namespace
 
 std::unique_ptr<CachedFeatures> CachedFeatures::Create(
@@ -75,99 +94,196 @@ std::unique_ptr<CachedFeatures> CachedFeatures::Create(
   cached_features->extraction_span_ = extraction_span;
   cached_features->features_ = std::move(features);
   cached_features->padding_features_ = std::move(padding_features);
+  if (options->cached_features_bfloat16()) {
+    std::vector<uint16>& bfloat16_features =
+        cached_features->bfloat16_features_;
+    bfloat16_features.reserve(cached_features->features_->size());
+    for (const float value : *cached_features->features_) {
+      bfloat16_features.push_back(FloatToBfloat16(value));
+    }
+    std::vector<float>().swap(*cached_features->features_);
+  }
   cached_features->options_ = options;
 
   cached_features->output_features_size_ =
       CalculateOutputFeaturesSize(options, feature_vector_size);
 
+  cached_features->context_size_ = options->context_size();
+  if (const FeatureProcessorOptions_::BoundsSensitiveFeatures* config =
+          options->bounds_sensitive_features()) {
+    cached_features->num_tokens_before_ = config->num_tokens_before();
+    cached_features->num_tokens_inside_left_ = config->num_tokens_inside_left();
+    cached_features->num_tokens_inside_right_ =
+        config->num_tokens_inside_right();
+    cached_features->num_tokens_after_ = config->num_tokens_after();
+    cached_features->include_inside_bag_ = config->include_inside_bag();
+    cached_features->include_inside_length_ = config->include_inside_length();
+  }
+  cached_features->SelectKernels();
+
   return cached_features;
 }
 
 void CachedFeatures::AppendClickContextFeaturesForClick(
     int click_pos, std::vector<float>* output_features) const {
-  click_pos -= extraction_span_.first;
-
-  AppendFeaturesInternal(
-      /*intended_span=*/ExpandTokenSpan(SingleTokenSpan(click_pos),
-                                        options_->context_size(),
-                                        options_->context_size()),
-      /*read_mask_span=*/{0, TokenSpanSize(extraction_span_)}, output_features);
+  const int offset = output_features->size();
+  output_features->resize(offset + OutputFeaturesSize());
+  WriteClickContextFeaturesForClick(click_pos,
+                                    output_features->data() + offset);
 }
 
 void CachedFeatures::AppendBoundsSensitiveFeaturesForSpan(
     TokenSpan selected_span, std::vector<float>* output_features) const {
-  const FeatureProcessorOptions_::BoundsSensitiveFeatures* config =
-      options_->bounds_sensitive_features();
+  const int offset = output_features->size();
+  output_features->resize(offset + OutputFeaturesSize());
+  WriteBoundsSensitiveFeaturesForSpan(selected_span,
+                                      output_features->data() + offset);
+}
+
+void CachedFeatures::WriteClickContextFeaturesForClick(int click_pos,
+                                                       float* output) const {
+  (this->*write_click_context_features_)(click_pos, output);
+}
+
+void CachedFeatures::WriteBoundsSensitiveFeaturesForSpan(
+    TokenSpan selected_span, float* output) const {
+  (this->*write_bounds_sensitive_features_)(selected_span, output);
+}
 
+void CachedFeatures::SelectKernels() {
+  const bool bfloat16 = options_->cached_features_bfloat16();
+  // The embedding size of the shipped models, plus the case feature, and for
+  // the classification model, the selection mask feature.
+  switch (padding_features_->size()) {
+    case 13:
+      SetKernels<13>(bfloat16);
+      break;
+    case 14:
+      SetKernels<14>(bfloat16);
+      break;
+    default:
+      SetKernels<0>(bfloat16);
+  }
+}
+
+template <int kNumFeaturesPerToken>
+void CachedFeatures::SetKernels(bool bfloat16) {
+  if (bfloat16) {
+    write_click_context_features_ =
+        &CachedFeatures::WriteClickContextFeaturesKernel<kNumFeaturesPerToken,
+                                                         true>;
+    write_bounds_sensitive_features_ = &CachedFeatures::
+        WriteBoundsSensitiveFeaturesKernel<kNumFeaturesPerToken, true>;
+  } else {
+    write_click_context_features_ =
+        &CachedFeatures::WriteClickContextFeaturesKernel<kNumFeaturesPerToken,
+                                                         false>;
+    write_bounds_sensitive_features_ = &CachedFeatures::
+        WriteBoundsSensitiveFeaturesKernel<kNumFeaturesPerToken, false>;
+  }
+}
+
+template <int kNumFeaturesPerToken, bool kBfloat16>
+void CachedFeatures::WriteClickContextFeaturesKernel(int click_pos,
+                                                     float* output) const {
+  click_pos -= extraction_span_.first;
+
+  WriteFeaturesInternal<kNumFeaturesPerToken, kBfloat16>(
+      /*intended_span=*/ExpandTokenSpan(SingleTokenSpan(click_pos),
+                                        context_size_, context_size_),
+      /*read_mask_span=*/{0, TokenSpanSize(extraction_span_)}, output);
+}
+
+template <int kNumFeaturesPerToken, bool kBfloat16>
+void CachedFeatures::WriteBoundsSensitiveFeaturesKernel(
+    TokenSpan selected_span, float* output) const {
   selected_span.first -= extraction_span_.first;
   selected_span.second -= extraction_span_.first;
 
-  // Append the features for tokens around the left bound. Masks out tokens
+  // Write the features for tokens around the left bound. Masks out tokens
   // after the right bound, so that if num_tokens_inside_left goes past it,
   // padding tokens will be used.
-  AppendFeaturesInternal(
-      /*intended_span=*/{selected_span.first - config->num_tokens_before(),
-                         selected_span.first +
-                             config->num_tokens_inside_left()},
-      /*read_mask_span=*/{0, selected_span.second}, output_features);
+  output = WriteFeaturesInternal<kNumFeaturesPerToken, kBfloat16>(
+      /*intended_span=*/{selected_span.first - num_tokens_before_,
+                         selected_span.first + num_tokens_inside_left_},
+      /*read_mask_span=*/{0, selected_span.second}, output);
 
-  // Append the features for tokens around the right bound. Masks out tokens
+  // Write the features for tokens around the right bound. Masks out tokens
   // before the left bound, so that if num_tokens_inside_right goes past it,
   // padding tokens will be used.
-  AppendFeaturesInternal(
-      /*intended_span=*/{selected_span.second -
-                             config->num_tokens_inside_right(),
-                         selected_span.second + config->num_tokens_after()},
+  output = WriteFeaturesInternal<kNumFeaturesPerToken, kBfloat16>(
+      /*intended_span=*/{selected_span.second - num_tokens_inside_right_,
+                         selected_span.second + num_tokens_after_},
       /*read_mask_span=*/{selected_span.first, TokenSpanSize(extraction_span_)},
-      output_features);
+      output);
 
-  if (config->include_inside_bag()) {
-    AppendBagFeatures(selected_span, output_features);
+  if (include_inside_bag_) {
+    output = WriteBagFeatures<kNumFeaturesPerToken, kBfloat16>(selected_span,
+                                                               output);
   }
 
-  if (config->include_inside_length()) {
-    output_features->push_back(
-        static_cast<float>(TokenSpanSize(selected_span)));
+  if (include_inside_length_) {
+    *output = static_cast<float>(TokenSpanSize(selected_span));
   }
 }
 
-void CachedFeatures::AppendFeaturesInternal(
-    const TokenSpan& intended_span, const TokenSpan& read_mask_span,
-    std::vector<float>* output_features) const {
-  const TokenSpan copy_span =
-      IntersectTokenSpans(intended_span, read_mask_span);
-  for (int i = intended_span.first; i < copy_span.first; ++i) {
-    AppendPaddingFeatures(output_features);
+template <int kNumFeaturesPerToken, bool kBfloat16>
+float* CachedFeatures::WriteFeaturesInternal(const TokenSpan& intended_span,
+                                             const TokenSpan& read_mask_span,
+                                             float* output) const {
+  for (int i = intended_span.first; i < intended_span.second; ++i) {
+    if (i >= read_mask_span.first && i < read_mask_span.second) {
+      output = WriteTokenFeatures<kNumFeaturesPerToken, kBfloat16>(i, output);
+    } else {
+      output = WritePaddingFeatures<kNumFeaturesPerToken>(output);
+    }
   }
-  output_features->insert(
-      output_features->end(),
-      features_->begin() + copy_span.first * NumFeaturesPerToken(),
-      features_->begin() + copy_span.second * NumFeaturesPerToken());
-  for (int i = copy_span.second; i < intended_span.second; ++i) {
-    AppendPaddingFeatures(output_features);
+  return output;
+}
+
+template <int kNumFeaturesPerToken, bool kBfloat16>
+float* CachedFeatures::WriteTokenFeatures(int token_index,
+                                          float* output) const {
+  const int num_features_per_token =
+      NumFeaturesPerToken<kNumFeaturesPerToken>();
+  const int offset = token_index * num_features_per_token;
+  if (!kBfloat16) {
+    const float* features = features_->data() + offset;
+    return std::copy(features, features + num_features_per_token, output);
   }
+  // A plain loop, so that the compiler can vectorize the widening.
+  const uint16* features = bfloat16_features_.data() + offset;
+  for (int i = 0; i < num_features_per_token; ++i) {
+    output[i] = Bfloat16ToFloat(features[i]);
+  }
+  return output + num_features_per_token;
 }
 
-void CachedFeatures::AppendPaddingFeatures(
-    std::vector<float>* output_features) const {
-  output_features->insert(output_features->end(), padding_features_->begin(),
-                          padding_features_->end());
+template <int kNumFeaturesPerToken>
+float* CachedFeatures::WritePaddingFeatures(float* output) const {
+  const float* padding = padding_features_->data();
+  return std::copy(padding,
+                   padding + NumFeaturesPerToken<kNumFeaturesPerToken>(),
+                   output);
 }
 
-void CachedFeatures::AppendBagFeatures(
-    const TokenSpan& bag_span, std::vector<float>* output_features) const {
-  const int offset = output_features->size();
-  output_features->resize(output_features->size() + NumFeaturesPerToken());
+template <int kNumFeaturesPerToken, bool kBfloat16>
+float* CachedFeatures::WriteBagFeatures(const TokenSpan& bag_span,
+                                        float* output) const {
+  const int num_features_per_token =
+      NumFeaturesPerToken<kNumFeaturesPerToken>();
+  const int bag_size = TokenSpanSize(bag_span);
+  std::fill(output, output + num_features_per_token, 0.0f);
   for (int i = bag_span.first; i < bag_span.second; ++i) {
-    for (int j = 0; j < NumFeaturesPerToken(); ++j) {
-      (*output_features)[offset + j] +=
-          (*features_)[i * NumFeaturesPerToken() + j] / TokenSpanSize(bag_span);
+    const int offset = i * num_features_per_token;
+    for (int j = 0; j < num_features_per_token; ++j) {
+      const float value =
+          kBfloat16 ? Bfloat16ToFloat(bfloat16_features_[offset + j])
+                    : (*features_)[offset + j];
+      output[j] += value / bag_size;
     }
   }
-}
-
-int CachedFeatures::NumFeaturesPerToken() const {
-  return padding_features_->size();
+  return output + num_features_per_token;
 }
 
 }  // namespace libtextclassifier3
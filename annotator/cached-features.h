@@ -23,6 +23,7 @@
 #include "annotator/model-executor.h"
 #include "annotator/model_generated.h"
 #include "annotator/types.h"
+#include "utils/base/integral_types.h"
 
 namespace libtextclassifier3 {
 
@@ -46,36 +47,92 @@ class CachedFeatures {
   void AppendBoundsSensitiveFeaturesForSpan(
       TokenSpan selected_span, std::vector<float>* output_features) const;
 
+  // Same as the above, but write the features to a preallocated buffer of
+  // OutputFeaturesSize() floats, e.g. directly into a batch of model inputs.
+  void WriteClickContextFeaturesForClick(int click_pos, float* output) const;
+  void WriteBoundsSensitiveFeaturesForSpan(TokenSpan selected_span,
+                                           float* output) const;
+
   // Returns number of features that 'AppendFeaturesForSpan' appends.
   int OutputFeaturesSize() const { return output_features_size_; }
 
  private:
   CachedFeatures() {}
 
-  // Appends token features to the output. The intended_span specifies which
-  // tokens' features should be used in principle. The read_mask_span restricts
-  // which tokens are actually read. For tokens outside of the read_mask_span,
-  // padding tokens are used instead.
-  void AppendFeaturesInternal(const TokenSpan& intended_span,
-                              const TokenSpan& read_mask_span,
-                              std::vector<float>* output_features) const;
-
-  // Appends features of one padding token to the output.
-  void AppendPaddingFeatures(std::vector<float>* output_features) const;
-
-  // Appends the features of tokens from the given span to the output. The
-  // features are averaged so that the appended features have the size
+  // The kernels below are specialized for the numbers of features per token of
+  // the shipped models, kNumFeaturesPerToken, which make their loops fixed
+  // size. Zero stands for any number of features, read from the padding. With
+  // kBfloat16, the features are read from bfloat16_features_.
+
+  // Chooses the kernels for the number of features per token and the storage
+  // of the features.
+  void SelectKernels();
+
+  template <int kNumFeaturesPerToken>
+  void SetKernels(bool bfloat16);
+
+  template <int kNumFeaturesPerToken, bool kBfloat16>
+  void WriteClickContextFeaturesKernel(int click_pos, float* output) const;
+
+  template <int kNumFeaturesPerToken, bool kBfloat16>
+  void WriteBoundsSensitiveFeaturesKernel(TokenSpan selected_span,
+                                          float* output) const;
+
+  // Writes token features to the output and returns the end of the written
+  // features. The intended_span specifies which tokens' features should be
+  // used in principle. The read_mask_span restricts which tokens are actually
+  // read. For tokens outside of the read_mask_span, padding tokens are used
+  // instead.
+  template <int kNumFeaturesPerToken, bool kBfloat16>
+  float* WriteFeaturesInternal(const TokenSpan& intended_span,
+                               const TokenSpan& read_mask_span,
+                               float* output) const;
+
+  // Writes features of one padding token to the output.
+  template <int kNumFeaturesPerToken>
+  float* WritePaddingFeatures(float* output) const;
+
+  // Writes the features of tokens from the given span to the output. The
+  // features are averaged so that the written features have the size
   // corresponding to one token.
-  void AppendBagFeatures(const TokenSpan& bag_span,
-                         std::vector<float>* output_features) const;
+  template <int kNumFeaturesPerToken, bool kBfloat16>
+  float* WriteBagFeatures(const TokenSpan& bag_span, float* output) const;
 
-  int NumFeaturesPerToken() const;
+  // Writes the features of the token at the given index to the output.
+  template <int kNumFeaturesPerToken, bool kBfloat16>
+  float* WriteTokenFeatures(int token_index, float* output) const;
+
+  template <int kNumFeaturesPerToken>
+  int NumFeaturesPerToken() const {
+    return kNumFeaturesPerToken > 0
+               ? kNumFeaturesPerToken
+               : static_cast<int>(padding_features_->size());
+  }
 
   TokenSpan extraction_span_;
   const FeatureProcessorOptions* options_;
   int output_features_size_;
+
+  // The options the kernels read on every call, copied out of the flatbuffer.
+  int context_size_ = 0;
+  int num_tokens_before_ = 0;
+  int num_tokens_inside_left_ = 0;
+  int num_tokens_inside_right_ = 0;
+  int num_tokens_after_ = 0;
+  bool include_inside_bag_ = false;
+  bool include_inside_length_ = false;
+
+  void (CachedFeatures::*write_click_context_features_)(int, float*) const =
+      nullptr;
+  void (CachedFeatures::*write_bounds_sensitive_features_)(TokenSpan,
+                                                           float*) const =
+      nullptr;
   std::unique_ptr<std::vector<float>> features_;
   std::unique_ptr<std::vector<float>> padding_features_;
+
+  // If FeatureProcessorOptions.cached_features_bfloat16 is set, holds the
+  // features as bfloat16 instead of features_, which is then empty.
+  std::vector<uint16> bfloat16_features_;
 };
 
 }  // namespace libtextclassifier3
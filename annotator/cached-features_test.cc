@@ -16,6 +16,8 @@
 
 #include "annotator/cached-features.h"
 
+#include <cmath>
+
 #include "annotator/model-executor.h"
 #include "utils/tensor-view.h"
 
@@ -153,5 +155,123 @@ TEST(CachedFeaturesTest, BoundsSensitive) {
                         44.0,     -44.0,     0.4,   1.0}));
 }
 
+TEST(CachedFeaturesTest, WritesBoundsSensitiveFeaturesToBuffer) {
+  std::unique_ptr<FeatureProcessorOptions_::BoundsSensitiveFeaturesT> config(
+      new FeatureProcessorOptions_::BoundsSensitiveFeaturesT());
+  config->enabled = true;
+  config->num_tokens_before = 2;
+  config->num_tokens_inside_left = 2;
+  config->num_tokens_inside_right = 2;
+  config->num_tokens_after = 2;
+  config->include_inside_bag = true;
+  config->include_inside_length = true;
+  FeatureProcessorOptionsT options;
+  options.bounds_sensitive_features = std::move(config);
+  options.feature_version = 2;
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(CreateFeatureProcessorOptions(builder, &options));
+  flatbuffers::DetachedBuffer options_fb = builder.Release();
+
+  std::unique_ptr<std::vector<float>> padding_features(
+      new std::vector<float>{112233.0, -112233.0, 321.0});
+  const std::unique_ptr<CachedFeatures> cached_features =
+      CachedFeatures::Create(
+          {3, 9}, MakeFeatures(9), std::move(padding_features),
+          flatbuffers::GetRoot<FeatureProcessorOptions>(options_fb.data()),
+          /*feature_vector_size=*/3);
+  ASSERT_TRUE(cached_features);
+
+  // The buffer holds two outputs and is not cleared beforehand.
+  const int output_size = cached_features->OutputFeaturesSize();
+  std::vector<float> buffer(2 * output_size, 7.0);
+  cached_features->WriteBoundsSensitiveFeaturesForSpan({5, 8}, buffer.data());
+  cached_features->WriteBoundsSensitiveFeaturesForSpan(
+      {6, 7}, buffer.data() + output_size);
+
+  EXPECT_THAT(std::vector<float>(buffer.begin(), buffer.begin() + output_size),
+              ElementsAreFloat(
+                  GetCachedBoundsSensitiveFeatures(*cached_features, {5, 8})));
+  EXPECT_THAT(std::vector<float>(buffer.begin() + output_size, buffer.end()),
+              ElementsAreFloat(
+                  GetCachedBoundsSensitiveFeatures(*cached_features, {6, 7})));
+}
+
+TEST(CachedFeaturesTest, WritesFeaturesWithSpecializedKernel) {
+  std::unique_ptr<FeatureProcessorOptions_::BoundsSensitiveFeaturesT> config(
+      new FeatureProcessorOptions_::BoundsSensitiveFeaturesT());
+  config->enabled = true;
+  config->num_tokens_before = 1;
+  config->num_tokens_inside_left = 1;
+  config->num_tokens_inside_right = 1;
+  config->num_tokens_after = 1;
+  config->include_inside_bag = true;
+  config->include_inside_length = true;
+  FeatureProcessorOptionsT options;
+  options.bounds_sensitive_features = std::move(config);
+  options.feature_version = 2;
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(CreateFeatureProcessorOptions(builder, &options));
+  flatbuffers::DetachedBuffer options_fb = builder.Release();
+
+  // As many features per token as the shipped models have.
+  const int num_features = 13;
+  const int num_tokens = 4;
+  std::unique_ptr<std::vector<float>> features(new std::vector<float>());
+  for (int i = 0; i < num_tokens * num_features; ++i) {
+    features->push_back(i);
+  }
+  const std::vector<float> token_features = *features;
+  std::unique_ptr<std::vector<float>> padding_features(
+      new std::vector<float>(num_features, -1.0));
+  const std::unique_ptr<CachedFeatures> cached_features =
+      CachedFeatures::Create(
+          {0, num_tokens}, std::move(features), std::move(padding_features),
+          flatbuffers::GetRoot<FeatureProcessorOptions>(options_fb.data()),
+          /*feature_vector_size=*/num_features);
+  ASSERT_TRUE(cached_features);
+
+  // The tokens around the bounds, the average of the tokens inside and the
+  // number of tokens inside.
+  std::vector<float> expected(token_features.begin(), token_features.end());
+  for (int j = 0; j < num_features; ++j) {
+    expected.push_back((token_features[num_features + j] +
+                        token_features[2 * num_features + j]) /
+                       2);
+  }
+  expected.push_back(2.0);
+  EXPECT_THAT(GetCachedBoundsSensitiveFeatures(*cached_features, {1, 3}),
+              ElementsAreFloat(expected));
+}
+
+TEST(CachedFeaturesTest, StoresFeaturesAsBfloat16) {
+  FeatureProcessorOptionsT options;
+  options.context_size = 2;
+  options.feature_version = 1;
+  options.cached_features_bfloat16 = true;
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(CreateFeatureProcessorOptions(builder, &options));
+  flatbuffers::DetachedBuffer options_fb = builder.Release();
+
+  std::unique_ptr<std::vector<float>> padding_features(
+      new std::vector<float>{112233.0, -112233.0, 321.0});
+  const std::unique_ptr<CachedFeatures> cached_features =
+      CachedFeatures::Create(
+          {3, 10}, MakeFeatures(9), std::move(padding_features),
+          flatbuffers::GetRoot<FeatureProcessorOptions>(options_fb.data()),
+          /*feature_vector_size=*/3);
+  ASSERT_TRUE(cached_features);
+
+  // The features are rounded to 8 bits of mantissa, the padding is exact.
+  const std::vector<float> expected = {
+      112233.0, -112233.0, 321.0, 11.0, -11.0, 0.1,  22.0, -22.0,
+      0.2,      33.0,      -33.0, 0.3,  44.0,  -44.0, 0.4};
+  const std::vector<float> features =
+      GetCachedClickContextFeatures(*cached_features, 4);
+  ASSERT_EQ(features.size(), expected.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(features[i], expected[i], std::abs(expected[i]) / 256);
+  }
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
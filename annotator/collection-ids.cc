@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/collection-ids.h"
+
+namespace libtextclassifier3 {
+
+int CollectionIdTable::Intern(const std::string& collection) {
+  const auto it = ids_.find(collection);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+  const int id = names_.size();
+  names_.push_back(collection);
+  ids_.insert({collection, id});
+  return id;
+}
+
+int CollectionIdTable::Find(const std::string& collection) const {
+  const auto it = ids_.find(collection);
+  return it != ids_.end() ? it->second : kUnknownCollectionId;
+}
+
+void CollectionIdSet::Insert(int id) {
+  if (id < 0) {
+    return;
+  }
+  if (id >= contains_.size()) {
+    contains_.resize(id + 1, false);
+  }
+  if (!contains_[id]) {
+    contains_[id] = true;
+    ++size_;
+  }
+}
+
+}  // namespace libtextclassifier3
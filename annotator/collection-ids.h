@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Interned collection names, so that the results of a model can be filtered
+// by collection without hashing and comparing strings.
+
+#ifndef LIBTEXTCLASSIFIER_ANNOTATOR_COLLECTION_IDS_H_
+#define LIBTEXTCLASSIFIER_ANNOTATOR_COLLECTION_IDS_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "annotator/types.h"
+
+namespace libtextclassifier3 {
+
+// The collections a model knows of, numbered from 0. The table is filled while
+// the model is set up, and only read afterwards.
+class CollectionIdTable {
+ public:
+  // Returns the id of the collection, adding it to the table if needed.
+  int Intern(const std::string& collection);
+
+  // Returns the id of the collection, or kUnknownCollectionId if it isn't in
+  // the table.
+  int Find(const std::string& collection) const;
+
+  // Returns the id of the collection of the result: the one it carries if it
+  // was set, or else the one of its name.
+  int IdOf(const ClassificationResult& result) const {
+    return result.collection_id != kUnknownCollectionId
+               ? result.collection_id
+               : Find(result.collection);
+  }
+
+  // Returns the name of the collection with the id.
+  const std::string& Name(int id) const { return names_[id]; }
+
+  int size() const { return names_.size(); }
+
+ private:
+  std::vector<std::string> names_;
+  std::unordered_map<std::string, int> ids_;
+};
+
+// A set of collections of a CollectionIdTable.
+class CollectionIdSet {
+ public:
+  void Insert(int id);
+
+  bool Contains(int id) const {
+    return id >= 0 && id < contains_.size() && contains_[id];
+  }
+
+  bool empty() const { return size_ == 0; }
+
+ private:
+  std::vector<bool> contains_;
+  int size_ = 0;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_ANNOTATOR_COLLECTION_IDS_H_
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/collection-ids.h"
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(CollectionIdTableTest, InternsCollections) {
+  CollectionIdTable table;
+  EXPECT_EQ(table.Intern("phone"), 0);
+  EXPECT_EQ(table.Intern("email"), 1);
+  EXPECT_EQ(table.Intern("phone"), 0);
+  EXPECT_EQ(table.size(), 2);
+  EXPECT_EQ(table.Name(1), "email");
+  EXPECT_EQ(table.Find("email"), 1);
+  EXPECT_EQ(table.Find("address"), kUnknownCollectionId);
+}
+
+TEST(CollectionIdTableTest, IdOfResult) {
+  CollectionIdTable table;
+  table.Intern("phone");
+  table.Intern("email");
+  EXPECT_EQ(table.IdOf(ClassificationResult("email", 1.0)), 1);
+  EXPECT_EQ(table.IdOf(ClassificationResult("email", /*arg_collection_id=*/1,
+                                            1.0, 1.0)),
+            1);
+  EXPECT_EQ(table.IdOf(ClassificationResult("address", 1.0)),
+            kUnknownCollectionId);
+}
+
+TEST(CollectionIdSetTest, ContainsInsertedIds) {
+  CollectionIdSet set;
+  EXPECT_TRUE(set.empty());
+  set.Insert(3);
+  set.Insert(kUnknownCollectionId);
+  EXPECT_FALSE(set.empty());
+  EXPECT_TRUE(set.Contains(3));
+  EXPECT_FALSE(set.Contains(0));
+  EXPECT_FALSE(set.Contains(10));
+  EXPECT_FALSE(set.Contains(kUnknownCollectionId));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/conflict-resolution.h"
+
+#include "utils/memory/scratch-arena.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+constexpr int kNumSources =
+    static_cast<int>(AnnotatedSpan::Source::DATETIME) + 1;
+
+// Orders candidate indices by the start of their spans.
+class SpanStartLess {
+ public:
+  explicit SpanStartLess(const std::vector<AnnotatedSpan>* candidates)
+      : candidates_(candidates) {}
+
+  bool operator()(int a, int b) const {
+    return (*candidates_)[a].span.first < (*candidates_)[b].span.first;
+  }
+
+ private:
+  const std::vector<AnnotatedSpan>* candidates_;
+};
+
+using PlacedSet = ScratchSet<int, SpanStartLess>;
+
+}  // namespace
+
+bool DoSourcesConflict(AnnotationUsecase annotation_usecase,
+                       const AnnotatedSpan::Source source1,
+                       const AnnotatedSpan::Source source2) {
+  uint32 source_mask =
+      (1 << static_cast<int>(source1)) | (1 << static_cast<int>(source2));
+
+  switch (annotation_usecase) {
+    case AnnotationUsecase_ANNOTATION_USECASE_SMART:
+      // In the SMART mode, all annotations conflict.
+      return true;
+
+    case AnnotationUsecase_ANNOTATION_USECASE_RAW:
+      // DURATION and DATETIME do not conflict. E.g. "let's meet in 3 hours",
+      // can have two non-conflicting annotations: "in 3 hours" (datetime), "3
+      // hours" (duration).
+      if ((source_mask &
+           (1 << static_cast<int>(AnnotatedSpan::Source::DURATION))) &&
+          (source_mask &
+           (1 << static_cast<int>(AnnotatedSpan::Source::DATETIME)))) {
+        return false;
+      }
+
+      // A KNOWLEDGE entity does not conflict with anything.
+      if ((source_mask &
+           (1 << static_cast<int>(AnnotatedSpan::Source::KNOWLEDGE)))) {
+        return false;
+      }
+
+      // Entities from other sources can conflict.
+      return true;
+  }
+}
+
+void ChooseNonConflictingCandidates(
+    const std::vector<AnnotatedSpan>& candidates,
+    const std::vector<int>& ranked_indices,
+    AnnotationUsecase annotation_usecase, std::vector<int>* chosen_indices) {
+  // The placed candidates, by source.
+  std::vector<PlacedSet> placed(kNumSources,
+                                PlacedSet(SpanStartLess(&candidates)));
+
+  for (const int candidate : ranked_indices) {
+    const AnnotatedSpan::Source source = candidates[candidate].source;
+    bool conflict = false;
+    for (int other = 0; other < kNumSources && !conflict; ++other) {
+      conflict =
+          DoSourcesConflict(annotation_usecase, source,
+                            static_cast<AnnotatedSpan::Source>(other)) &&
+          DoesCandidateConflict(candidate, candidates, placed[other]);
+    }
+    if (conflict) {
+      continue;
+    }
+    chosen_indices->push_back(candidate);
+    placed[static_cast<int>(source)].insert(candidate);
+  }
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Choosing between annotation candidates that overlap.
+
+#ifndef LIBTEXTCLASSIFIER_ANNOTATOR_CONFLICT_RESOLUTION_H_
+#define LIBTEXTCLASSIFIER_ANNOTATOR_CONFLICT_RESOLUTION_H_
+
+#include <vector>
+
+#include "annotator/model_generated.h"
+#include "annotator/types.h"
+
+namespace libtextclassifier3 {
+
+// Returns true, if the given two sources do conflict in given annotation
+// usecase.
+//  - In SMART usecase, all sources do conflict, because there's only 1 possible
+//  annotation for a given span.
+//  - In RAW usecase, certain annotations are allowed to overlap (e.g. datetime
+//  and duration), while others not (e.g. duration and number).
+bool DoSourcesConflict(AnnotationUsecase annotation_usecase,
+                       AnnotatedSpan::Source source1,
+                       AnnotatedSpan::Source source2);
+
+// Greedily places the candidates with the given indices, in that order, and
+// appends the index of each candidate that doesn't overlap an already placed
+// candidate of a conflicting source to 'chosen_indices'.
+//
+// The placed candidates of each source are kept ordered by their start, and
+// only their neighbours are checked against a new candidate, so this takes
+// O(n log n) time for n candidates.
+void ChooseNonConflictingCandidates(
+    const std::vector<AnnotatedSpan>& candidates,
+    const std::vector<int>& ranked_indices,
+    AnnotationUsecase annotation_usecase, std::vector<int>* chosen_indices);
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_ANNOTATOR_CONFLICT_RESOLUTION_H_
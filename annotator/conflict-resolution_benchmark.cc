@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "annotator/conflict-resolution.h"
+#include "annotator/model_generated.h"
+#include "annotator/types.h"
+#include "utils/testing/benchmark-utils.h"
+#include "benchmark/benchmark.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+// Arguments: the number of candidates, and the annotation usecase. The
+// candidates are 1 to 20 codepoints long, of mixed sources, and start in a
+// text of 2 codepoints per 5 candidates, so that each overlaps many others as
+// the numbers, dates and durations of logs do.
+void BM_ChooseNonConflictingCandidates(benchmark::State& state) {
+  const int num_candidates = state.range(0);
+  const AnnotationUsecase annotation_usecase =
+      static_cast<AnnotationUsecase>(state.range(1));
+  state.SetLabel(annotation_usecase == AnnotationUsecase_ANNOTATION_USECASE_RAW
+                     ? "raw"
+                     : "smart");
+  std::mt19937 random(1);
+  std::vector<AnnotatedSpan> candidates(num_candidates);
+  for (AnnotatedSpan& candidate : candidates) {
+    const int start = random() % (1 + num_candidates * 2 / 5);
+    candidate.span = {start, start + 1 + static_cast<int>(random() % 20)};
+    candidate.source = static_cast<AnnotatedSpan::Source>(random() % 4);
+  }
+  std::vector<int> ranked_indices(num_candidates);
+  for (int i = 0; i < num_candidates; ++i) {
+    ranked_indices[i] = i;
+  }
+  std::shuffle(ranked_indices.begin(), ranked_indices.end(), random);
+
+  std::vector<int> chosen_indices;
+  RunMeasuredBenchmark(state, /*bytes_per_call=*/0, [&]() {
+    chosen_indices.clear();
+    ChooseNonConflictingCandidates(candidates, ranked_indices,
+                                   annotation_usecase, &chosen_indices);
+    benchmark::DoNotOptimize(chosen_indices.data());
+  });
+}
+
+// Registers the arguments {number of candidates, annotation usecase}.
+void NumbersOfCandidatesAndUsecases(benchmark::internal::Benchmark* benchmark) {
+  for (int num_candidates = 16; num_candidates <= 16384; num_candidates *= 8) {
+    for (const AnnotationUsecase annotation_usecase :
+         {AnnotationUsecase_ANNOTATION_USECASE_SMART,
+          AnnotationUsecase_ANNOTATION_USECASE_RAW}) {
+      benchmark->Args({num_candidates, annotation_usecase});
+    }
+  }
+}
+BENCHMARK(BM_ChooseNonConflictingCandidates)
+    ->Apply(NumbersOfCandidatesAndUsecases);
+
+}  // namespace
+}  // namespace libtextclassifier3
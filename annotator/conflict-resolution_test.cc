@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/conflict-resolution.h"
+
+#include <random>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+using testing::ElementsAre;
+
+AnnotatedSpan MakeCandidate(int start, int end, AnnotatedSpan::Source source) {
+  AnnotatedSpan candidate;
+  candidate.span = {start, end};
+  candidate.source = source;
+  return candidate;
+}
+
+// Quadratic version of ChooseNonConflictingCandidates, for spans that are not
+// empty.
+std::vector<int> ChooseByComparingAllPairs(
+    const std::vector<AnnotatedSpan>& candidates,
+    const std::vector<int>& ranked_indices,
+    AnnotationUsecase annotation_usecase) {
+  std::vector<int> chosen;
+  for (const int candidate : ranked_indices) {
+    bool conflict = false;
+    for (const int other : chosen) {
+      if (DoSourcesConflict(annotation_usecase, candidates[candidate].source,
+                            candidates[other].source) &&
+          SpansOverlap(candidates[candidate].span, candidates[other].span)) {
+        conflict = true;
+        break;
+      }
+    }
+    if (!conflict) {
+      chosen.push_back(candidate);
+    }
+  }
+  return chosen;
+}
+
+TEST(ConflictResolutionTest, ChoosesInRankOrder) {
+  const std::vector<AnnotatedSpan> candidates = {
+      MakeCandidate(0, 5, AnnotatedSpan::Source::OTHER),
+      MakeCandidate(3, 8, AnnotatedSpan::Source::DATETIME),
+      MakeCandidate(4, 9, AnnotatedSpan::Source::DURATION),
+      MakeCandidate(8, 10, AnnotatedSpan::Source::OTHER)};
+
+  std::vector<int> chosen;
+  ChooseNonConflictingCandidates(candidates, {1, 0, 2, 3},
+                                 AnnotationUsecase_ANNOTATION_USECASE_SMART,
+                                 &chosen);
+  EXPECT_THAT(chosen, ElementsAre(1, 3));
+
+  // Datetimes and durations can overlap in the raw usecase.
+  chosen.clear();
+  ChooseNonConflictingCandidates(candidates, {1, 0, 2, 3},
+                                 AnnotationUsecase_ANNOTATION_USECASE_RAW,
+                                 &chosen);
+  EXPECT_THAT(chosen, ElementsAre(1, 2));
+}
+
+TEST(ConflictResolutionTest, MatchesPairwiseChecksOnDenseInput) {
+  // Many short, heavily overlapping candidates, as for logs full of numbers,
+  // dates and durations.
+  std::mt19937 random(1);
+  std::vector<AnnotatedSpan> candidates;
+  for (int i = 0; i < 5000; ++i) {
+    const int start = random() % 2000;
+    candidates.push_back(MakeCandidate(
+        start, start + 1 + random() % 20,
+        static_cast<AnnotatedSpan::Source>(random() % 4)));
+  }
+  std::vector<int> ranked_indices(candidates.size());
+  for (int i = 0; i < ranked_indices.size(); ++i) {
+    ranked_indices[i] = i;
+  }
+  std::shuffle(ranked_indices.begin(), ranked_indices.end(), random);
+
+  for (const AnnotationUsecase annotation_usecase :
+       {AnnotationUsecase_ANNOTATION_USECASE_SMART,
+        AnnotationUsecase_ANNOTATION_USECASE_RAW}) {
+    std::vector<int> chosen;
+    ChooseNonConflictingCandidates(candidates, ranked_indices,
+                                   annotation_usecase, &chosen);
+    EXPECT_EQ(chosen, ChooseByComparingAllPairs(candidates, ranked_indices,
+                                                annotation_usecase));
+  }
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/contact/contact-engine.h"
+
+#include <algorithm>
+#include <mutex>  // NOLINT
+#include <utility>
+
+#include "annotator/collections.h"
+#include "annotator/contact/contact-config_generated.h"
+#include "utils/base/logging.h"
+#include "utils/flatbuffers.h"
+
+namespace libtextclassifier3 {
+
+namespace {
+std::string StringOrEmpty(const flatbuffers::String* value) {
+  return value != nullptr ? value->str() : std::string();
+}
+}  // namespace
+
+bool ContactEngine::Initialize(const std::string& serialized_config) {
+  if (serialized_config.empty()) {
+    return true;
+  }
+
+  const ContactConfig* config =
+      LoadAndVerifyFlatbuffer<ContactConfig>(serialized_config);
+  if (config == nullptr) {
+    TC3_LOG(ERROR) << "Invalid contact config.";
+    return false;
+  }
+
+  {
+    std::unique_lock<std::shared_timed_mutex> lock(mutex_);
+    score_ = config->score();
+    priority_score_ = config->priority_score();
+    match_given_name_ = config->match_given_name();
+    match_nickname_ = config->match_nickname();
+  }
+
+  if (config->contacts() == nullptr) {
+    return true;
+  }
+  for (const ContactConfig_::Contact* entry : *config->contacts()) {
+    Contact contact;
+    contact.id = StringOrEmpty(entry->id());
+    contact.name = StringOrEmpty(entry->name());
+    contact.given_name = StringOrEmpty(entry->given_name());
+    contact.nickname = StringOrEmpty(entry->nickname());
+    contact.email_address = StringOrEmpty(entry->email_address());
+    contact.phone_number = StringOrEmpty(entry->phone_number());
+    if (!AddContact(contact)) {
+      TC3_VLOG(1) << "Skipping contact that can't be indexed: " << contact.id;
+    }
+  }
+  return true;
+}
+
+bool ContactEngine::AddContact(const Contact& contact) {
+  if (contact.id.empty() || feature_processor_ == nullptr) {
+    return false;
+  }
+
+  std::unique_lock<std::shared_timed_mutex> lock(mutex_);
+  IndexedContact indexed;
+  indexed.contact = contact;
+  std::vector<const std::string*> names = {&contact.name};
+  if (match_given_name_) {
+    names.push_back(&contact.given_name);
+  }
+  if (match_nickname_) {
+    names.push_back(&contact.nickname);
+  }
+  for (const std::string* name : names) {
+    std::vector<int32> token_ids;
+    if (trie_.InternName(*name, &token_ids) &&
+        std::find(indexed.names.begin(), indexed.names.end(), token_ids) ==
+            indexed.names.end()) {
+      indexed.names.push_back(std::move(token_ids));
+    }
+  }
+  if (indexed.names.empty()) {
+    return false;
+  }
+
+  auto existing = contact_index_by_id_.find(contact.id);
+  if (existing != contact_index_by_id_.end()) {
+    RemoveContactLocked(existing->second);
+  }
+
+  int contact_index;
+  if (!free_contacts_.empty()) {
+    contact_index = free_contacts_.back();
+    free_contacts_.pop_back();
+  } else {
+    contact_index = contacts_.size();
+    contacts_.emplace_back();
+  }
+  for (const std::vector<int32>& token_ids : indexed.names) {
+    trie_.Insert(token_ids, contact_index);
+  }
+  contacts_[contact_index] = std::move(indexed);
+  contact_index_by_id_[contact.id] = contact_index;
+  return true;
+}
+
+bool ContactEngine::RemoveContact(const std::string& id) {
+  std::unique_lock<std::shared_timed_mutex> lock(mutex_);
+  auto it = contact_index_by_id_.find(id);
+  if (it == contact_index_by_id_.end()) {
+    return false;
+  }
+  RemoveContactLocked(it->second);
+  return true;
+}
+
+int ContactEngine::NumContacts() const {
+  std::shared_lock<std::shared_timed_mutex> lock(mutex_);
+  return contact_index_by_id_.size();
+}
+
+bool ContactEngine::ClassifyText(
+    const std::string& context, CodepointSpan selection_indices,
+    ClassificationResult* classification_result) const {
+  if (feature_processor_ == nullptr) {
+    return false;
+  }
+  const UnicodeText context_unicode =
+      UTF8ToUnicodeText(context, /*do_copy=*/false);
+  if (selection_indices.first < 0 ||
+      selection_indices.first >= selection_indices.second ||
+      selection_indices.second > context_unicode.size_codepoints()) {
+    return false;
+  }
+  const std::vector<Token> tokens =
+      feature_processor_->Tokenize(context_unicode.UTF8Substring(
+          selection_indices.first, selection_indices.second));
+  if (tokens.empty()) {
+    return false;
+  }
+
+  std::shared_lock<std::shared_timed_mutex> lock(mutex_);
+  const std::vector<int>* contact_indices = trie_.Find(tokens);
+  if (contact_indices == nullptr) {
+    return false;
+  }
+  FillClassificationResult(contact_indices->front(), classification_result);
+  return true;
+}
+
+bool ContactEngine::Chunk(const UnicodeText& context_unicode,
+                          const std::vector<Token>& tokens,
+                          std::vector<AnnotatedSpan>* result) const {
+  std::shared_lock<std::shared_timed_mutex> lock(mutex_);
+  for (const TokenTrie::Match& match : trie_.FindLongestMatches(tokens)) {
+    AnnotatedSpan span;
+    span.span = {tokens[match.first_token].start,
+                 tokens[match.last_token].end};
+    for (const int contact_index : *match.values) {
+      ClassificationResult classification;
+      FillClassificationResult(contact_index, &classification);
+      span.classification.push_back(std::move(classification));
+    }
+    result->push_back(std::move(span));
+  }
+  return true;
+}
+
+void ContactEngine::RemoveContactLocked(int contact_index) {
+  IndexedContact& indexed = contacts_[contact_index];
+  for (const std::vector<int32>& token_ids : indexed.names) {
+    trie_.Erase(token_ids, contact_index);
+  }
+  contact_index_by_id_.erase(indexed.contact.id);
+  indexed = IndexedContact();
+  free_contacts_.push_back(contact_index);
+}
+
+void ContactEngine::FillClassificationResult(
+    int contact_index, ClassificationResult* result) const {
+  const Contact& contact = contacts_[contact_index].contact;
+  result->collection = Collections::Contact();
+  result->score = score_;
+  result->priority_score = priority_score_;
+  ClassificationResultExtras* extras = result->mutable_extras();
+  extras->contact_name = contact.name;
+  extras->contact_given_name = contact.given_name;
+  extras->contact_nickname = contact.nickname;
+  extras->contact_email_address = contact.email_address;
+  extras->contact_phone_number = contact.phone_number;
+  extras->contact_id = contact.id;
+}
+
+}  // namespace libtextclassifier3
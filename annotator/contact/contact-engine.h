@@ -17,6 +17,103 @@
 #ifndef LIBTEXTCLASSIFIER_ANNOTATOR_CONTACT_CONTACT_ENGINE_H_
 #define LIBTEXTCLASSIFIER_ANNOTATOR_CONTACT_CONTACT_ENGINE_H_
 
-#include "annotator/contact/contact-engine-dummy.h"
+#include <shared_mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "annotator/feature-processor.h"
+#include "annotator/token-trie.h"
+#include "annotator/types.h"
+#include "utils/base/integral_types.h"
+#include "utils/utf8/unicodetext.h"
+#include "utils/utf8/unilib.h"
+
+namespace libtextclassifier3 {
+
+// Annotates the names of the contacts of an address book.
+//
+// The names are stored in a token trie whose nodes keep the contacts with a
+// name ending there, so Chunk needs a single pass over the tokens of the
+// context. Contacts can be added and removed at any time; a removal just
+// prunes the branches of the trie that no other name uses, and nothing is
+// ever rebuilt.
+//
+// Thread-safe: lookups can run concurrently, updates are exclusive.
+class ContactEngine {
+ public:
+  struct Contact {
+    std::string id;
+    std::string name;
+    std::string given_name;
+    std::string nickname;
+    std::string email_address;
+    std::string phone_number;
+  };
+
+  explicit ContactEngine(const FeatureProcessor* feature_processor,
+                         const UniLib* unilib)
+      : feature_processor_(feature_processor),
+        trie_(feature_processor, unilib) {}
+
+  // Indexes the contacts of the given serialized ContactConfig. An empty
+  // config gives an empty index, to be filled with AddContact.
+  bool Initialize(const std::string& serialized_config);
+
+  // Adds the contact to the index, replacing a contact with the same id.
+  // Returns false if the contact has no id or no name that could be indexed.
+  bool AddContact(const Contact& contact);
+
+  // Removes the contact with the given id. Returns false if there is none.
+  bool RemoveContact(const std::string& id);
+
+  // Returns the number of indexed contacts.
+  int NumContacts() const;
+
+  // Classifies the selection as a contact if it is exactly one of the indexed
+  // names.
+  bool ClassifyText(const std::string& context, CodepointSpan selection_indices,
+                    ClassificationResult* classification_result) const;
+
+  // Finds the longest non-overlapping occurrences of the indexed names among
+  // the given tokens.
+  bool Chunk(const UnicodeText& context_unicode,
+             const std::vector<Token>& tokens,
+             std::vector<AnnotatedSpan>* result) const;
+
+ private:
+  struct IndexedContact {
+    Contact contact;
+
+    // The token ids of the indexed names of the contact.
+    std::vector<std::vector<int32>> names;
+  };
+
+  // Removes the contact at the index, with mutex_ held exclusively.
+  void RemoveContactLocked(int contact_index);
+
+  // Fills the classification result for the contact at the index.
+  void FillClassificationResult(int contact_index,
+                                ClassificationResult* result) const;
+
+  const FeatureProcessor* feature_processor_;
+
+  float score_ = 1.0f;
+  float priority_score_ = 0.0f;
+  bool match_given_name_ = false;
+  bool match_nickname_ = false;
+
+  mutable std::shared_timed_mutex mutex_;
+
+  // The names of the contacts, with the indices into contacts_ as values.
+  TokenTrie trie_;
+
+  // The contacts, with the slots of removed ones reused.
+  std::vector<IndexedContact> contacts_;
+  std::vector<int> free_contacts_;
+  std::unordered_map<std::string, int> contact_index_by_id_;
+};
+
+}  // namespace libtextclassifier3
 
 #endif  // LIBTEXTCLASSIFIER_ANNOTATOR_CONTACT_CONTACT_ENGINE_H_
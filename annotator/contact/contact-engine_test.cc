@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/contact/contact-engine.h"
+
+#include <string>
+#include <vector>
+
+#include "annotator/collections.h"
+#include "annotator/contact/contact-config_generated.h"
+#include "annotator/model_generated.h"
+#include "annotator/types-test-util.h"
+#include "annotator/types.h"
+#include "utils/test-utils.h"
+#include "utils/utf8/unicodetext.h"
+#include "utils/utf8/unilib.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+using testing::ElementsAre;
+using testing::Field;
+using testing::IsEmpty;
+
+FeatureProcessor BuildFeatureProcessor(const UniLib* unilib) {
+  static const flatbuffers::DetachedBuffer* options_data = []() {
+    FeatureProcessorOptionsT options;
+    options.context_size = 1;
+    options.max_selection_span = 1;
+
+    options.tokenization_codepoint_config.emplace_back(
+        new TokenizationCodepointRangeT());
+    auto& config = options.tokenization_codepoint_config.back();
+    config->start = 32;
+    config->end = 33;
+    config->role = TokenizationCodepointRange_::Role_WHITESPACE_SEPARATOR;
+
+    flatbuffers::FlatBufferBuilder builder;
+    builder.Finish(FeatureProcessorOptions::Pack(builder, &options));
+    return new flatbuffers::DetachedBuffer(builder.Release());
+  }();
+
+  return FeatureProcessor(
+      flatbuffers::GetRoot<FeatureProcessorOptions>(options_data->data()),
+      unilib);
+}
+
+std::string TestingContactConfig() {
+  ContactConfigT config;
+  config.score = 0.5;
+  config.match_nickname = true;
+
+  config.contacts.emplace_back(new ContactConfig_::ContactT());
+  config.contacts.back()->id = "1";
+  config.contacts.back()->name = "Jane Doe";
+  config.contacts.back()->nickname = "JD";
+
+  config.contacts.emplace_back(new ContactConfig_::ContactT());
+  config.contacts.back()->id = "2";
+  config.contacts.back()->name = "Jane Doe Smith";
+
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(ContactConfig::Pack(builder, &config));
+  return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                     builder.GetSize());
+}
+
+class ContactEngineTest : public ::testing::Test {
+ protected:
+  ContactEngineTest()
+      : INIT_UNILIB_FOR_TESTING(unilib_),
+        feature_processor_(BuildFeatureProcessor(&unilib_)),
+        contact_engine_(&feature_processor_, &unilib_) {}
+
+  std::vector<AnnotatedSpan> Chunk(const std::string& text) {
+    const UnicodeText text_unicode = UTF8ToUnicodeText(text);
+    std::vector<AnnotatedSpan> result;
+    EXPECT_TRUE(contact_engine_.Chunk(
+        text_unicode, feature_processor_.Tokenize(text_unicode), &result));
+    return result;
+  }
+
+  UniLib unilib_;
+  FeatureProcessor feature_processor_;
+  ContactEngine contact_engine_;
+};
+
+TEST_F(ContactEngineTest, InitializesFromConfig) {
+  EXPECT_TRUE(contact_engine_.Initialize(TestingContactConfig()));
+  EXPECT_EQ(contact_engine_.NumContacts(), 2);
+}
+
+TEST_F(ContactEngineTest, FailsOnInvalidConfig) {
+  EXPECT_FALSE(contact_engine_.Initialize("not a config"));
+}
+
+TEST_F(ContactEngineTest, ChunksLongestMatches) {
+  ASSERT_TRUE(contact_engine_.Initialize(TestingContactConfig()));
+
+  EXPECT_THAT(Chunk("Ask jane doe smith and jd or JANE DOE today"),
+              ElementsAre(Field(&AnnotatedSpan::span, CodepointSpan(4, 18)),
+                          Field(&AnnotatedSpan::span, CodepointSpan(23, 25)),
+                          Field(&AnnotatedSpan::span, CodepointSpan(29, 37))));
+}
+
+TEST_F(ContactEngineTest, ChunkFillsContactExtras) {
+  ASSERT_TRUE(contact_engine_.Initialize(TestingContactConfig()));
+
+  const std::vector<AnnotatedSpan> result = Chunk("Call Jane Doe now");
+  ASSERT_EQ(result.size(), 1);
+  ASSERT_EQ(result[0].classification.size(), 1);
+  const ClassificationResult& classification = result[0].classification[0];
+  EXPECT_EQ(classification.collection, Collections::Contact());
+  EXPECT_FLOAT_EQ(classification.score, 0.5);
+  ASSERT_NE(classification.extras(), nullptr);
+  EXPECT_EQ(classification.extras()->contact_id, "1");
+  EXPECT_EQ(classification.extras()->contact_name, "Jane Doe");
+  EXPECT_EQ(classification.extras()->contact_nickname, "JD");
+}
+
+TEST_F(ContactEngineTest, ClassifiesExactNames) {
+  ASSERT_TRUE(contact_engine_.Initialize(TestingContactConfig()));
+
+  ClassificationResult classification;
+  EXPECT_TRUE(
+      contact_engine_.ClassifyText("Call jd now", {5, 7}, &classification));
+  EXPECT_EQ(classification.collection, Collections::Contact());
+  EXPECT_EQ(classification.extras()->contact_id, "1");
+
+  EXPECT_FALSE(contact_engine_.ClassifyText("Call Jane now", {5, 9},
+                                            &classification));
+}
+
+TEST_F(ContactEngineTest, AddsAndRemovesContactsIncrementally) {
+  ASSERT_TRUE(contact_engine_.Initialize(""));
+  EXPECT_THAT(Chunk("Meet John Roe"), IsEmpty());
+
+  EXPECT_TRUE(contact_engine_.AddContact({"3", "John Roe"}));
+  EXPECT_THAT(Chunk("Meet John Roe"),
+              ElementsAre(Field(&AnnotatedSpan::span, CodepointSpan(5, 13))));
+
+  // Replacing the contact drops the old name.
+  EXPECT_TRUE(contact_engine_.AddContact({"3", "Johnny"}));
+  EXPECT_EQ(contact_engine_.NumContacts(), 1);
+  EXPECT_THAT(Chunk("Meet John Roe"), IsEmpty());
+  EXPECT_THAT(Chunk("Meet Johnny"),
+              ElementsAre(Field(&AnnotatedSpan::span, CodepointSpan(5, 11))));
+
+  EXPECT_TRUE(contact_engine_.RemoveContact("3"));
+  EXPECT_FALSE(contact_engine_.RemoveContact("3"));
+  EXPECT_EQ(contact_engine_.NumContacts(), 0);
+  EXPECT_THAT(Chunk("Meet Johnny"), IsEmpty());
+}
+
+TEST_F(ContactEngineTest, RemovingContactKeepsSharedPrefixes) {
+  ASSERT_TRUE(contact_engine_.Initialize(TestingContactConfig()));
+
+  EXPECT_TRUE(contact_engine_.RemoveContact("2"));
+  EXPECT_THAT(Chunk("Ask Jane Doe Smith"),
+              ElementsAre(Field(&AnnotatedSpan::span, CodepointSpan(4, 12))));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
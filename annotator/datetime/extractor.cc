@@ -16,27 +16,152 @@
 
 #include "annotator/datetime/extractor.h"
 
+#include <algorithm>
+
 #include "utils/base/logging.h"
+#include "utils/regex-prefilter.h"
 
 namespace libtextclassifier3 {
+namespace {
+
+// Maximum number of words expanded from one extractor pattern.
+constexpr int kMaxVocabularyWordsPerPattern = 64;
+
+const std::vector<std::pair<DatetimeExtractorType, int>>& MonthExtractors() {
+  static const auto* const kMonthExtractors =
+      new std::vector<std::pair<DatetimeExtractorType, int>>{
+          {DatetimeExtractorType_JANUARY, 1},
+          {DatetimeExtractorType_FEBRUARY, 2},
+          {DatetimeExtractorType_MARCH, 3},
+          {DatetimeExtractorType_APRIL, 4},
+          {DatetimeExtractorType_MAY, 5},
+          {DatetimeExtractorType_JUNE, 6},
+          {DatetimeExtractorType_JULY, 7},
+          {DatetimeExtractorType_AUGUST, 8},
+          {DatetimeExtractorType_SEPTEMBER, 9},
+          {DatetimeExtractorType_OCTOBER, 10},
+          {DatetimeExtractorType_NOVEMBER, 11},
+          {DatetimeExtractorType_DECEMBER, 12},
+      };
+  return *kMonthExtractors;
+}
+
+const std::vector<std::pair<DatetimeExtractorType, DateParseData::AMPM>>&
+AmpmExtractors() {
+  static const auto* const kAmpmExtractors =
+      new std::vector<std::pair<DatetimeExtractorType, DateParseData::AMPM>>{
+          {DatetimeExtractorType_AM, DateParseData::AMPM::AM},
+          {DatetimeExtractorType_PM, DateParseData::AMPM::PM},
+      };
+  return *kAmpmExtractors;
+}
+
+const std::vector<std::pair<DatetimeExtractorType, DateParseData::Relation>>&
+RelationExtractors() {
+  static const auto* const kRelationExtractors = new std::vector<
+      std::pair<DatetimeExtractorType, DateParseData::Relation>>{
+      {DatetimeExtractorType_NOW, DateParseData::Relation::NOW},
+      {DatetimeExtractorType_YESTERDAY, DateParseData::Relation::YESTERDAY},
+      {DatetimeExtractorType_TOMORROW, DateParseData::Relation::TOMORROW},
+      {DatetimeExtractorType_NEXT, DateParseData::Relation::NEXT},
+      {DatetimeExtractorType_NEXT_OR_SAME,
+       DateParseData::Relation::NEXT_OR_SAME},
+      {DatetimeExtractorType_LAST, DateParseData::Relation::LAST},
+      {DatetimeExtractorType_PAST, DateParseData::Relation::PAST},
+      {DatetimeExtractorType_FUTURE, DateParseData::Relation::FUTURE},
+  };
+  return *kRelationExtractors;
+}
+
+const std::vector<
+    std::pair<DatetimeExtractorType, DateParseData::RelationType>>&
+RelationTypeExtractors() {
+  static const auto* const kRelationTypeExtractors = new std::vector<
+      std::pair<DatetimeExtractorType, DateParseData::RelationType>>{
+      {DatetimeExtractorType_MONDAY, DateParseData::RelationType::MONDAY},
+      {DatetimeExtractorType_TUESDAY, DateParseData::RelationType::TUESDAY},
+      {DatetimeExtractorType_WEDNESDAY,
+       DateParseData::RelationType::WEDNESDAY},
+      {DatetimeExtractorType_THURSDAY, DateParseData::RelationType::THURSDAY},
+      {DatetimeExtractorType_FRIDAY, DateParseData::RelationType::FRIDAY},
+      {DatetimeExtractorType_SATURDAY, DateParseData::RelationType::SATURDAY},
+      {DatetimeExtractorType_SUNDAY, DateParseData::RelationType::SUNDAY},
+      {DatetimeExtractorType_SECONDS, DateParseData::RelationType::SECOND},
+      {DatetimeExtractorType_MINUTES, DateParseData::RelationType::MINUTE},
+      {DatetimeExtractorType_HOURS, DateParseData::RelationType::HOUR},
+      {DatetimeExtractorType_DAY, DateParseData::RelationType::DAY},
+      {DatetimeExtractorType_WEEK, DateParseData::RelationType::WEEK},
+      {DatetimeExtractorType_MONTH, DateParseData::RelationType::MONTH},
+      {DatetimeExtractorType_YEAR, DateParseData::RelationType::YEAR},
+  };
+  return *kRelationTypeExtractors;
+}
+
+template <typename T>
+std::vector<DatetimeExtractorType> ExtractorTypes(
+    const std::vector<std::pair<DatetimeExtractorType, T>>& mapping) {
+  std::vector<DatetimeExtractorType> types;
+  for (const auto& type_value_pair : mapping) {
+    types.push_back(type_value_pair.first);
+  }
+  return types;
+}
+
+// Changes the ASCII letters of the text to upper case, or only the first one
+// if 'first_only' is true.
+std::string AsciiToUpper(std::string text, bool first_only) {
+  for (char& c : text) {
+    if (c >= 'a' && c <= 'z') {
+      c += 'A' - 'a';
+    }
+    if (first_only) {
+      break;
+    }
+  }
+  return text;
+}
 
-bool DatetimeExtractor::Extract(DateParseData* result,
+}  // namespace
+
+void DatetimeGroupVocabulary::Add(DatetimeGroupType group_type,
+                                  const std::string& text, int value) {
+  values_[group_type].emplace(text, value);
+}
+
+bool DatetimeGroupVocabulary::Find(DatetimeGroupType group_type,
+                                   const UnicodeText& text, int* value) const {
+  const auto type_it = values_.find(group_type);
+  if (type_it == values_.end()) {
+    return false;
+  }
+  const auto text_it =
+      type_it->second.find(std::string(text.data(), text.size_bytes()));
+  if (text_it == type_it->second.end()) {
+    return false;
+  }
+  *value = text_it->second;
+  return true;
+}
+
+bool DatetimeExtractor::Extract(const CompiledRule& rule,
+                                const UniLib::RegexMatcher& matcher,
+                                DateParseData* result,
                                 CodepointSpan* result_span) const {
   result->field_set_mask = 0;
   *result_span = {kInvalidIndex, kInvalidIndex};
 
-  if (rule_.regex->groups() == nullptr) {
+  if (rule.regex->groups() == nullptr) {
     return false;
   }
 
-  for (int group_id = 0; group_id < rule_.regex->groups()->size(); group_id++) {
+  for (int group_id = 0; group_id < rule.regex->groups()->size(); group_id++) {
     UnicodeText group_text;
-    const int group_type = rule_.regex->groups()->Get(group_id);
+    const int group_type = rule.regex->groups()->Get(group_id);
     if (group_type == DatetimeGroupType_GROUP_UNUSED) {
       continue;
     }
-    if (!GroupTextFromMatch(group_id, &group_text)) {
-      TC3_LOG(ERROR) << "Couldn't retrieve group.";
+    if (!GroupTextFromMatch(matcher, group_id, &group_text)) {
+      TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't retrieve group.";
       return false;
     }
     // The pattern can have a group defined in a part that was not matched,
@@ -47,7 +172,7 @@ bool DatetimeExtractor::Extract(DateParseData* result,
     switch (group_type) {
       case DatetimeGroupType_GROUP_YEAR: {
         if (!ParseYear(group_text, &(result->year))) {
-          TC3_LOG(ERROR) << "Couldn't extract YEAR.";
+          TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't extract YEAR.";
           return false;
         }
         result->field_set_mask |= DateParseData::YEAR_FIELD;
@@ -55,7 +180,7 @@ bool DatetimeExtractor::Extract(DateParseData* result,
       }
       case DatetimeGroupType_GROUP_MONTH: {
         if (!ParseMonth(group_text, &(result->month))) {
-          TC3_LOG(ERROR) << "Couldn't extract MONTH.";
+          TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't extract MONTH.";
           return false;
         }
         result->field_set_mask |= DateParseData::MONTH_FIELD;
@@ -63,7 +188,7 @@ bool DatetimeExtractor::Extract(DateParseData* result,
       }
       case DatetimeGroupType_GROUP_DAY: {
         if (!ParseDigits(group_text, &(result->day_of_month))) {
-          TC3_LOG(ERROR) << "Couldn't extract DAY.";
+          TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't extract DAY.";
           return false;
         }
         result->field_set_mask |= DateParseData::DAY_FIELD;
@@ -71,7 +196,7 @@ bool DatetimeExtractor::Extract(DateParseData* result,
       }
       case DatetimeGroupType_GROUP_HOUR: {
         if (!ParseDigits(group_text, &(result->hour))) {
-          TC3_LOG(ERROR) << "Couldn't extract HOUR.";
+          TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't extract HOUR.";
           return false;
         }
         result->field_set_mask |= DateParseData::HOUR_FIELD;
@@ -79,7 +204,7 @@ bool DatetimeExtractor::Extract(DateParseData* result,
       }
       case DatetimeGroupType_GROUP_MINUTE: {
         if (!ParseDigits(group_text, &(result->minute))) {
-          TC3_LOG(ERROR) << "Couldn't extract MINUTE.";
+          TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't extract MINUTE.";
           return false;
         }
         result->field_set_mask |= DateParseData::MINUTE_FIELD;
@@ -87,7 +212,7 @@ bool DatetimeExtractor::Extract(DateParseData* result,
       }
       case DatetimeGroupType_GROUP_SECOND: {
         if (!ParseDigits(group_text, &(result->second))) {
-          TC3_LOG(ERROR) << "Couldn't extract SECOND.";
+          TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't extract SECOND.";
           return false;
         }
         result->field_set_mask |= DateParseData::SECOND_FIELD;
@@ -95,7 +220,7 @@ bool DatetimeExtractor::Extract(DateParseData* result,
       }
       case DatetimeGroupType_GROUP_AMPM: {
         if (!ParseAMPM(group_text, &(result->ampm))) {
-          TC3_LOG(ERROR) << "Couldn't extract AMPM.";
+          TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't extract AMPM.";
           return false;
         }
         result->field_set_mask |= DateParseData::AMPM_FIELD;
@@ -103,7 +228,8 @@ bool DatetimeExtractor::Extract(DateParseData* result,
       }
       case DatetimeGroupType_GROUP_RELATIONDISTANCE: {
         if (!ParseRelationDistance(group_text, &(result->relation_distance))) {
-          TC3_LOG(ERROR) << "Couldn't extract RELATION_DISTANCE_FIELD.";
+          TC3_LOG_EVERY_N_SEC(ERROR, 10)
+              << "Couldn't extract RELATION_DISTANCE_FIELD.";
           return false;
         }
         result->field_set_mask |= DateParseData::RELATION_DISTANCE_FIELD;
@@ -111,7 +237,7 @@ bool DatetimeExtractor::Extract(DateParseData* result,
       }
       case DatetimeGroupType_GROUP_RELATION: {
         if (!ParseRelation(group_text, &(result->relation))) {
-          TC3_LOG(ERROR) << "Couldn't extract RELATION_FIELD.";
+          TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't extract RELATION_FIELD.";
           return false;
         }
         result->field_set_mask |= DateParseData::RELATION_FIELD;
@@ -119,7 +245,8 @@ bool DatetimeExtractor::Extract(DateParseData* result,
       }
       case DatetimeGroupType_GROUP_RELATIONTYPE: {
         if (!ParseRelationType(group_text, &(result->relation_type))) {
-          TC3_LOG(ERROR) << "Couldn't extract RELATION_TYPE_FIELD.";
+          TC3_LOG_EVERY_N_SEC(ERROR, 10)
+              << "Couldn't extract RELATION_TYPE_FIELD.";
           return false;
         }
         result->field_set_mask |= DateParseData::RELATION_TYPE_FIELD;
@@ -129,11 +256,11 @@ bool DatetimeExtractor::Extract(DateParseData* result,
       case DatetimeGroupType_GROUP_DUMMY2:
         break;
       default:
-        TC3_LOG(INFO) << "Unknown group type.";
+        TC3_LOG_EVERY_N_SEC(INFO, 10) << "Unknown group type.";
         continue;
     }
-    if (!UpdateMatchSpan(group_id, result_span)) {
-      TC3_LOG(ERROR) << "Couldn't update span.";
+    if (!UpdateMatchSpan(matcher, group_id, result_span)) {
+      TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't update span.";
       return false;
     }
   }
@@ -189,24 +316,26 @@ bool DatetimeExtractor::ExtractType(const UnicodeText& input,
   return true;
 }
 
-bool DatetimeExtractor::GroupTextFromMatch(int group_id,
+bool DatetimeExtractor::GroupTextFromMatch(const UniLib::RegexMatcher& matcher,
+                                           int group_id,
                                            UnicodeText* result) const {
   int status;
-  *result = matcher_.Group(group_id, &status);
+  *result = matcher.Group(group_id, &status);
   if (status != UniLib::RegexMatcher::kNoError) {
     return false;
   }
   return true;
 }
 
-bool DatetimeExtractor::UpdateMatchSpan(int group_id,
+bool DatetimeExtractor::UpdateMatchSpan(const UniLib::RegexMatcher& matcher,
+                                        int group_id,
                                         CodepointSpan* span) const {
   int status;
-  const int match_start = matcher_.Start(group_id, &status);
+  const int match_start = matcher.Start(group_id, &status);
   if (status != UniLib::RegexMatcher::kNoError) {
     return false;
   }
-  const int match_end = matcher_.End(group_id, &status);
+  const int match_end = matcher.End(group_id, &status);
   if (status != UniLib::RegexMatcher::kNoError) {
     return false;
   }
@@ -234,6 +363,107 @@ bool DatetimeExtractor::MapInput(
   return false;
 }
 
+template <typename T>
+bool DatetimeExtractor::FindInVocabulary(DatetimeGroupType group_type,
+                                         const UnicodeText& input,
+                                         T* result) const {
+  int value;
+  if (vocabulary_ == nullptr || !vocabulary_->Find(group_type, input, &value)) {
+    return false;
+  }
+  *result = static_cast<T>(value);
+  return true;
+}
+
+bool DatetimeExtractor::ParseVocabularyGroup(DatetimeGroupType group_type,
+                                             const UnicodeText& input,
+                                             int* value) const {
+  switch (group_type) {
+    case DatetimeGroupType_GROUP_MONTH:
+      return ParseMonth(input, value);
+    case DatetimeGroupType_GROUP_AMPM: {
+      DateParseData::AMPM ampm;
+      if (!ParseAMPM(input, &ampm)) {
+        return false;
+      }
+      *value = static_cast<int>(ampm);
+      return true;
+    }
+    case DatetimeGroupType_GROUP_RELATION: {
+      DateParseData::Relation relation;
+      if (!ParseRelation(input, &relation)) {
+        return false;
+      }
+      *value = static_cast<int>(relation);
+      return true;
+    }
+    case DatetimeGroupType_GROUP_RELATIONTYPE: {
+      DateParseData::RelationType relation_type;
+      if (!ParseRelationType(input, &relation_type)) {
+        return false;
+      }
+      *value = static_cast<int>(relation_type);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+std::unique_ptr<DatetimeGroupVocabulary> DatetimeExtractor::BuildVocabulary(
+    const std::vector<std::string>& extractor_rule_patterns) const {
+  std::unique_ptr<DatetimeGroupVocabulary> vocabulary(
+      new DatetimeGroupVocabulary());
+  for (const auto& group_type_extractors :
+       std::vector<std::pair<DatetimeGroupType,
+                             std::vector<DatetimeExtractorType>>>{
+           {DatetimeGroupType_GROUP_MONTH, ExtractorTypes(MonthExtractors())},
+           {DatetimeGroupType_GROUP_AMPM, ExtractorTypes(AmpmExtractors())},
+           {DatetimeGroupType_GROUP_RELATION,
+            ExtractorTypes(RelationExtractors())},
+           {DatetimeGroupType_GROUP_RELATIONTYPE,
+            ExtractorTypes(RelationTypeExtractors())},
+       }) {
+    for (const DatetimeExtractorType extractor_type :
+         group_type_extractors.second) {
+      int rule_id;
+      std::vector<std::string> words;
+      if (!RuleIdForType(extractor_type, &rule_id) ||
+          rule_id >= extractor_rule_patterns.size() ||
+          !ExpandRegexLiterals(extractor_rule_patterns[rule_id],
+                               kMaxVocabularyWordsPerPattern, &words)) {
+        continue;
+      }
+      for (const std::string& word : words) {
+        if (word.empty()) {
+          continue;
+        }
+        // The extractors are usually case-insensitive, so also add the usual
+        // capitalizations of the word. Each variant gets the value that the
+        // extractor regexes give it, so the vocabulary can't change results.
+        UnicodeText lowercase_word;
+        for (const char32 codepoint :
+             UTF8ToUnicodeText(word, /*do_copy=*/false)) {
+          lowercase_word.push_back(unilib_.ToLower(codepoint));
+        }
+        const std::string lowercase = lowercase_word.ToUTF8String();
+        for (const std::string& variant :
+             {word, lowercase, AsciiToUpper(lowercase, /*first_only=*/true),
+              AsciiToUpper(lowercase, /*first_only=*/false)}) {
+          int value;
+          if (ParseVocabularyGroup(group_type_extractors.first,
+                                   UTF8ToUnicodeText(variant,
+                                                     /*do_copy=*/false),
+                                   &value)) {
+            vocabulary->Add(group_type_extractors.first, variant, value);
+          }
+        }
+      }
+    }
+  }
+  return vocabulary;
+}
+
 bool DatetimeExtractor::ParseWrittenNumber(const UnicodeText& input,
                                            int* parsed_number) const {
   std::vector<std::pair<int, int>> found_numbers;
@@ -349,26 +579,15 @@ bool DatetimeExtractor::ParseYear(const UnicodeText& input,
 
 bool DatetimeExtractor::ParseMonth(const UnicodeText& input,
                                    int* parsed_month) const {
+  if (FindInVocabulary(DatetimeGroupType_GROUP_MONTH, input, parsed_month)) {
+    return true;
+  }
+
   if (ParseDigits(input, parsed_month)) {
     return true;
   }
 
-  if (MapInput(input,
-               {
-                   {DatetimeExtractorType_JANUARY, 1},
-                   {DatetimeExtractorType_FEBRUARY, 2},
-                   {DatetimeExtractorType_MARCH, 3},
-                   {DatetimeExtractorType_APRIL, 4},
-                   {DatetimeExtractorType_MAY, 5},
-                   {DatetimeExtractorType_JUNE, 6},
-                   {DatetimeExtractorType_JULY, 7},
-                   {DatetimeExtractorType_AUGUST, 8},
-                   {DatetimeExtractorType_SEPTEMBER, 9},
-                   {DatetimeExtractorType_OCTOBER, 10},
-                   {DatetimeExtractorType_NOVEMBER, 11},
-                   {DatetimeExtractorType_DECEMBER, 12},
-               },
-               parsed_month)) {
+  if (MapInput(input, MonthExtractors(), parsed_month)) {
     return true;
   }
 
@@ -377,12 +596,10 @@ bool DatetimeExtractor::ParseMonth(const UnicodeText& input,
 
 bool DatetimeExtractor::ParseAMPM(const UnicodeText& input,
                                   DateParseData::AMPM* parsed_ampm) const {
-  return MapInput(input,
-                  {
-                      {DatetimeExtractorType_AM, DateParseData::AMPM::AM},
-                      {DatetimeExtractorType_PM, DateParseData::AMPM::PM},
-                  },
-                  parsed_ampm);
+  if (FindInVocabulary(DatetimeGroupType_GROUP_AMPM, input, parsed_ampm)) {
+    return true;
+  }
+  return MapInput(input, AmpmExtractors(), parsed_ampm);
 }
 
 bool DatetimeExtractor::ParseRelationDistance(const UnicodeText& input,
@@ -398,47 +615,21 @@ bool DatetimeExtractor::ParseRelationDistance(const UnicodeText& input,
 
 bool DatetimeExtractor::ParseRelation(
     const UnicodeText& input, DateParseData::Relation* parsed_relation) const {
-  return MapInput(
-      input,
-      {
-          {DatetimeExtractorType_NOW, DateParseData::Relation::NOW},
-          {DatetimeExtractorType_YESTERDAY, DateParseData::Relation::YESTERDAY},
-          {DatetimeExtractorType_TOMORROW, DateParseData::Relation::TOMORROW},
-          {DatetimeExtractorType_NEXT, DateParseData::Relation::NEXT},
-          {DatetimeExtractorType_NEXT_OR_SAME,
-           DateParseData::Relation::NEXT_OR_SAME},
-          {DatetimeExtractorType_LAST, DateParseData::Relation::LAST},
-          {DatetimeExtractorType_PAST, DateParseData::Relation::PAST},
-          {DatetimeExtractorType_FUTURE, DateParseData::Relation::FUTURE},
-      },
-      parsed_relation);
+  if (FindInVocabulary(DatetimeGroupType_GROUP_RELATION, input,
+                       parsed_relation)) {
+    return true;
+  }
+  return MapInput(input, RelationExtractors(), parsed_relation);
 }
 
 bool DatetimeExtractor::ParseRelationType(
     const UnicodeText& input,
     DateParseData::RelationType* parsed_relation_type) const {
-  return MapInput(
-      input,
-      {
-          {DatetimeExtractorType_MONDAY, DateParseData::RelationType::MONDAY},
-          {DatetimeExtractorType_TUESDAY, DateParseData::RelationType::TUESDAY},
-          {DatetimeExtractorType_WEDNESDAY,
-           DateParseData::RelationType::WEDNESDAY},
-          {DatetimeExtractorType_THURSDAY,
-           DateParseData::RelationType::THURSDAY},
-          {DatetimeExtractorType_FRIDAY, DateParseData::RelationType::FRIDAY},
-          {DatetimeExtractorType_SATURDAY,
-           DateParseData::RelationType::SATURDAY},
-          {DatetimeExtractorType_SUNDAY, DateParseData::RelationType::SUNDAY},
-          {DatetimeExtractorType_SECONDS, DateParseData::RelationType::SECOND},
-          {DatetimeExtractorType_MINUTES, DateParseData::RelationType::MINUTE},
-          {DatetimeExtractorType_HOURS, DateParseData::RelationType::HOUR},
-          {DatetimeExtractorType_DAY, DateParseData::RelationType::DAY},
-          {DatetimeExtractorType_WEEK, DateParseData::RelationType::WEEK},
-          {DatetimeExtractorType_MONTH, DateParseData::RelationType::MONTH},
-          {DatetimeExtractorType_YEAR, DateParseData::RelationType::YEAR},
-      },
-      parsed_relation_type);
+  if (FindInVocabulary(DatetimeGroupType_GROUP_RELATIONTYPE, input,
+                       parsed_relation_type)) {
+    return true;
+  }
+  return MapInput(input, RelationTypeExtractors(), parsed_relation_type);
 }
 
 }  // namespace libtextclassifier3
@@ -17,6 +17,7 @@
 #ifndef LIBTEXTCLASSIFIER_ANNOTATOR_DATETIME_EXTRACTOR_H_
 #define LIBTEXTCLASSIFIER_ANNOTATOR_DATETIME_EXTRACTOR_H_
 
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -40,25 +41,50 @@ struct CompiledRule {
   const DatetimeModelPattern* pattern;
 };
 
+// Values of the groups with a finite vocabulary (months, AM/PM, relations and
+// relation types) for the words their extractors match in one locale. Groups
+// that consist of just such a word are then parsed without running the
+// extractor regexes.
+class DatetimeGroupVocabulary {
+ public:
+  void Add(DatetimeGroupType group_type, const std::string& text, int value);
+
+  // Returns whether the text is in the vocabulary of the group type, and if
+  // so sets the value the extractors give it.
+  bool Find(DatetimeGroupType group_type, const UnicodeText& text,
+            int* value) const;
+
+ private:
+  std::unordered_map<DatetimeGroupType, std::unordered_map<std::string, int>>
+      values_;
+};
+
 // A helper class for DatetimeParser that extracts structured data
-// (DateParseDate) from the current match of the passed RegexMatcher.
+// (DateParseDate) from the current match of a RegexMatcher.
 class DatetimeExtractor {
  public:
+  // Does not take ownership of the vocabulary, which can be null.
   DatetimeExtractor(
-      const CompiledRule& rule, const UniLib::RegexMatcher& matcher,
       int locale_id, const UniLib& unilib,
       const std::vector<std::unique_ptr<const UniLib::RegexPattern>>&
           extractor_rules,
       const std::unordered_map<DatetimeExtractorType,
                                std::unordered_map<int, int>>&
-          type_and_locale_to_extractor_rule)
-      : rule_(rule),
-        matcher_(matcher),
-        locale_id_(locale_id),
+          type_and_locale_to_extractor_rule,
+      const DatetimeGroupVocabulary* vocabulary = nullptr)
+      : locale_id_(locale_id),
         unilib_(unilib),
         rules_(extractor_rules),
-        type_and_locale_to_rule_(type_and_locale_to_extractor_rule) {}
-  bool Extract(DateParseData* result, CodepointSpan* result_span) const;
+        type_and_locale_to_rule_(type_and_locale_to_extractor_rule),
+        vocabulary_(vocabulary) {}
+  bool Extract(const CompiledRule& rule, const UniLib::RegexMatcher& matcher,
+               DateParseData* result, CodepointSpan* result_span) const;
+
+  // Builds the vocabulary of the locale from the pattern texts of the
+  // extractor rules (by rule index), by expanding the patterns that match a
+  // finite set of words and parsing each word like a group.
+  std::unique_ptr<DatetimeGroupVocabulary> BuildVocabulary(
+      const std::vector<std::string>& extractor_rule_patterns) const;
 
  private:
   bool RuleIdForType(DatetimeExtractorType type, int* rule_id) const;
@@ -70,10 +96,12 @@ class DatetimeExtractor {
                    DatetimeExtractorType extractor_type,
                    UnicodeText* match_result = nullptr) const;
 
-  bool GroupTextFromMatch(int group_id, UnicodeText* result) const;
+  bool GroupTextFromMatch(const UniLib::RegexMatcher& matcher, int group_id,
+                          UnicodeText* result) const;
 
   // Updates the span to include the current match for the given group.
-  bool UpdateMatchSpan(int group_id, CodepointSpan* span) const;
+  bool UpdateMatchSpan(const UniLib::RegexMatcher& matcher, int group_id,
+                       CodepointSpan* span) const;
 
   // Returns true if any of the extractors from 'mapping' matched. If it did,
   // will fill 'result' with the associated value from 'mapping'.
@@ -82,6 +110,15 @@ class DatetimeExtractor {
                 const std::vector<std::pair<DatetimeExtractorType, T>>& mapping,
                 T* result) const;
 
+  // Looks the input up in the vocabulary of the group type, if there is one.
+  template <typename T>
+  bool FindInVocabulary(DatetimeGroupType group_type, const UnicodeText& input,
+                        T* result) const;
+
+  // Parses a group of a type with a finite vocabulary.
+  bool ParseVocabularyGroup(DatetimeGroupType group_type,
+                            const UnicodeText& input, int* value) const;
+
   bool ParseDigits(const UnicodeText& input, int* parsed_digits) const;
   bool ParseWrittenNumber(const UnicodeText& input, int* parsed_number) const;
   bool ParseYear(const UnicodeText& input, int* parsed_year) const;
@@ -100,13 +137,12 @@ class DatetimeExtractor {
   bool ParseWeekday(const UnicodeText& input,
                     DateParseData::RelationType* parsed_weekday) const;
 
-  const CompiledRule& rule_;
-  const UniLib::RegexMatcher& matcher_;
   int locale_id_;
   const UniLib& unilib_;
   const std::vector<std::unique_ptr<const UniLib::RegexPattern>>& rules_;
   const std::unordered_map<DatetimeExtractorType, std::unordered_map<int, int>>&
       type_and_locale_to_rule_;
+  const DatetimeGroupVocabulary* const vocabulary_;
 };
 
 }  // namespace libtextclassifier3
@@ -16,30 +16,202 @@
 
 #include "annotator/datetime/parser.h"
 
-#include <set>
+#include <algorithm>
+#include <numeric>
 #include <unordered_set>
 
 #include "annotator/datetime/extractor.h"
+#include "utils/base/tracing.h"
 #include "utils/calendar/calendar.h"
+#include "utils/calendar/civil-time.h"
 #include "utils/i18n/locale.h"
+#include "utils/memory/scratch-arena.h"
 #include "utils/strings/split.h"
 #include "utils/zlib/zlib_regex.h"
 
 namespace libtextclassifier3 {
+namespace {
+
+// Orders the indices of the chosen spans by the start of their spans.
+class SpanStartLess {
+ public:
+  explicit SpanStartLess(const std::vector<DatetimeParseResultSpan>* spans)
+      : spans_(spans) {}
+
+  bool operator()(int a, int b) const {
+    return (*spans_)[a].span.first < (*spans_)[b].span.first;
+  }
+
+ private:
+  const std::vector<DatetimeParseResultSpan>* spans_;
+};
+
+int SpanLength(const DatetimeParseResultSpan& span) {
+  return span.span.second - span.span.first;
+}
+
+// Length of the windows of reference times over which the fields resolve to
+// the same time, except for the milliseconds of the reference that relative
+// expressions keep (see CalendarLibTempl::InterpretParseData()).
+//
+// The results of relative expressions with a distance ("in 2 hours") aren't
+// rounded and change with every millisecond. The others only depend on the
+// local calendar fields of the reference down to their granularity. The
+// windows are aligned in UTC, so the ones of hours and coarser are a quarter
+// of an hour, the granularity of the offsets of the zones in use: the local
+// hour and day never change within one.
+int64 ResolutionWindowMs(const DateParseData& parse_data,
+                         DatetimeGranularity granularity) {
+  if (parse_data.field_set_mask & DateParseData::RELATION_DISTANCE_FIELD) {
+    return 1;
+  }
+  switch (granularity) {
+    case GRANULARITY_UNKNOWN:
+    case GRANULARITY_SECOND:
+      return civil_time::kMillisPerSecond;
+    case GRANULARITY_MINUTE:
+      return civil_time::kMillisPerMinute;
+    default:
+      return 15 * civil_time::kMillisPerMinute;
+  }
+}
+
+// The milliseconds of the reference time that are kept in the resolution.
+// Only the absolute dates reset them.
+int64 KeptReferenceMillis(const DateParseData& parse_data,
+                          int64 reference_time_ms_utc) {
+  if (!(parse_data.field_set_mask & DateParseData::RELATION_FIELD)) {
+    return 0;
+  }
+  return civil_time::FloorMod(reference_time_ms_utc,
+                              civil_time::kMillisPerSecond);
+}
+
+void AppendToKey(int64 value, std::string* key) {
+  key->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Key of the resolutions of the parsed fields from the reference times of
+// the window of `reference_time_ms_utc`.
+std::string ResolutionCacheKey(const DateParseData& parse_data,
+                               DatetimeGranularity granularity,
+                               int64 reference_time_ms_utc,
+                               const std::string& reference_timezone,
+                               const std::string& reference_locale) {
+  std::string key;
+  for (const int64 field :
+       {static_cast<int64>(parse_data.field_set_mask),
+        static_cast<int64>(parse_data.year),
+        static_cast<int64>(parse_data.month),
+        static_cast<int64>(parse_data.day_of_month),
+        static_cast<int64>(parse_data.hour),
+        static_cast<int64>(parse_data.minute),
+        static_cast<int64>(parse_data.second),
+        static_cast<int64>(parse_data.ampm),
+        static_cast<int64>(parse_data.zone_offset),
+        static_cast<int64>(parse_data.dst_offset),
+        static_cast<int64>(parse_data.relation),
+        static_cast<int64>(parse_data.relation_type),
+        static_cast<int64>(parse_data.relation_distance)}) {
+    AppendToKey(field, &key);
+  }
+  AppendToKey(civil_time::FloorDiv(reference_time_ms_utc,
+                                   ResolutionWindowMs(parse_data, granularity)),
+              &key);
+  key.append(reference_timezone);
+  key.push_back('\0');
+  key.append(reference_locale);
+  return key;
+}
+
+// Skips a compressed pattern that isn't loaded. Without a dictionary, the
+// compressed patterns of the model form a single zlib stream, so the pattern
+// is still decompressed to keep the decompressor in sync with it.
+bool SkipPattern(const CompressedBuffer* compressed_pattern,
+                 ZlibDecompressor* decompressor) {
+  if (compressed_pattern == nullptr ||
+      compressed_pattern->buffer() == nullptr || decompressor == nullptr ||
+      decompressor->has_dictionary()) {
+    return true;
+  }
+  std::string pattern_text;
+  return decompressor->MaybeDecompress(compressed_pattern, &pattern_text);
+}
+
+}  // namespace
+
+constexpr int DatetimeParser::kMaxExpandedLocales;
+
+void ChooseNonOverlappingDatetimeSpans(
+    const std::vector<DatetimeParseResultSpan>& spans,
+    std::vector<int>* chosen_indices) {
+  // The stable sort keeps the spans of the same length in the order of the
+  // list, i.e. the earlier entry for a given locale wins the ties.
+  ScratchVector<int> ranked_indices(spans.size());
+  std::iota(ranked_indices.begin(), ranked_indices.end(), 0);
+  std::stable_sort(ranked_indices.begin(), ranked_indices.end(),
+                   [&spans](int a, int b) {
+                     return SpanLength(spans[a]) > SpanLength(spans[b]);
+                   });
+
+  ScratchSet<int, SpanStartLess> chosen_indices_set((SpanStartLess(&spans)));
+  for (const int i : ranked_indices) {
+    if (!DoesCandidateConflict(i, spans, chosen_indices_set)) {
+      chosen_indices_set.insert(i);
+      chosen_indices->push_back(i);
+    }
+  }
+}
+
 std::unique_ptr<DatetimeParser> DatetimeParser::Instance(
     const DatetimeModel* model, const UniLib& unilib,
-    const CalendarLib& calendarlib, ZlibDecompressor* decompressor) {
-  std::unique_ptr<DatetimeParser> result(
-      new DatetimeParser(model, unilib, calendarlib, decompressor));
+    const CalendarLib& calendarlib, ZlibDecompressor* decompressor,
+    const std::string& load_locales) {
+  std::unique_ptr<DatetimeParser> result(new DatetimeParser(
+      model, unilib, calendarlib, decompressor, load_locales));
   if (!result->initialized_) {
     result.reset();
   }
   return result;
 }
 
+bool DatetimeParser::IsValidModel(const DatetimeModel* model) {
+  if (model == nullptr) {
+    return false;
+  }
+  const auto has_pattern = [](const flatbuffers::String* pattern,
+                              const CompressedBuffer* compressed_pattern) {
+    return pattern != nullptr ||
+           (compressed_pattern != nullptr &&
+            compressed_pattern->buffer() != nullptr);
+  };
+  if (model->patterns() != nullptr) {
+    for (const DatetimeModelPattern* pattern : *model->patterns()) {
+      if (pattern->regexes() == nullptr) {
+        continue;
+      }
+      for (const DatetimeModelPattern_::Regex* regex : *pattern->regexes()) {
+        if (!has_pattern(regex->pattern(), regex->compressed_pattern())) {
+          return false;
+        }
+      }
+    }
+  }
+  if (model->extractors() != nullptr) {
+    for (const DatetimeModelExtractor* extractor : *model->extractors()) {
+      if (!has_pattern(extractor->pattern(),
+                       extractor->compressed_pattern())) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
 DatetimeParser::DatetimeParser(const DatetimeModel* model, const UniLib& unilib,
                                const CalendarLib& calendarlib,
-                               ZlibDecompressor* decompressor)
+                               ZlibDecompressor* decompressor,
+                               const std::string& load_locales)
     : unilib_(unilib), calendarlib_(calendarlib) {
   initialized_ = false;
 
@@ -47,19 +219,67 @@ DatetimeParser::DatetimeParser(const DatetimeModel* model, const UniLib& unilib,
     return;
   }
 
+  if (model->locales() != nullptr) {
+    for (int i = 0; i < model->locales()->Length(); ++i) {
+      locale_string_to_id_[model->locales()->Get(i)->str()] = i;
+    }
+  }
+
+  if (model->default_locales() != nullptr) {
+    for (const int locale : *model->default_locales()) {
+      default_locale_ids_.push_back(locale);
+    }
+  }
+
+  // With load_locales, only the rules and extractors of the model locales
+  // that they expand to are loaded, the others could never be run. Neither
+  // could the ones without locales.
+  std::unordered_set<int> loaded_locale_ids;
+  if (!load_locales.empty()) {
+    std::string reference_locale;
+    for (const int locale_id : ExpandLocales(load_locales, &reference_locale)) {
+      loaded_locale_ids.insert(locale_id);
+    }
+  }
+  const auto is_loaded = [&load_locales, &loaded_locale_ids](
+                             const flatbuffers::Vector<int32_t>* locales) {
+    if (load_locales.empty()) {
+      return true;
+    }
+    if (locales != nullptr) {
+      for (const int locale_id : *locales) {
+        if (loaded_locale_ids.find(locale_id) != loaded_locale_ids.end()) {
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+
   if (model->patterns() != nullptr) {
     for (const DatetimeModelPattern* pattern : *model->patterns()) {
-      if (pattern->regexes()) {
+      if (pattern->regexes() && !is_loaded(pattern->locales())) {
         for (const DatetimeModelPattern_::Regex* regex : *pattern->regexes()) {
+          if (!SkipPattern(regex->compressed_pattern(), decompressor)) {
+            TC3_LOG(ERROR) << "Couldn't skip rule pattern.";
+            return;
+          }
+        }
+      } else if (pattern->regexes()) {
+        for (const DatetimeModelPattern_::Regex* regex : *pattern->regexes()) {
+          std::string pattern_text;
           std::unique_ptr<UniLib::RegexPattern> regex_pattern =
               UncompressMakeRegexPattern(
                   unilib, regex->pattern(), regex->compressed_pattern(),
-                  model->lazy_regex_compilation(), decompressor);
+                  model->lazy_regex_compilation(), decompressor,
+                  &pattern_text);
           if (!regex_pattern) {
             TC3_LOG(ERROR) << "Couldn't create rule pattern.";
             return;
           }
+          regex_pattern_bytes_ += pattern_text.size();
           rules_.push_back({std::move(regex_pattern), regex, pattern});
+          rule_triggers_.Add(ExtractRegexTriggers(pattern_text));
           if (pattern->locales()) {
             for (int locale : *pattern->locales()) {
               locale_to_rules_[locale].push_back(rules_.size() - 1);
@@ -70,17 +290,30 @@ DatetimeParser::DatetimeParser(const DatetimeModel* model, const UniLib& unilib,
     }
   }
 
+  regex_stats_.reset(new RegexStats(
+      "datetime_model", std::vector<std::string>(rules_.size(), "datetime")));
+
   if (model->extractors() != nullptr) {
     for (const DatetimeModelExtractor* extractor : *model->extractors()) {
+      if (!is_loaded(extractor->locales())) {
+        if (!SkipPattern(extractor->compressed_pattern(), decompressor)) {
+          TC3_LOG(ERROR) << "Couldn't skip extractor pattern.";
+          return;
+        }
+        continue;
+      }
+      std::string pattern_text;
       std::unique_ptr<UniLib::RegexPattern> regex_pattern =
           UncompressMakeRegexPattern(
               unilib, extractor->pattern(), extractor->compressed_pattern(),
-              model->lazy_regex_compilation(), decompressor);
+              model->lazy_regex_compilation(), decompressor, &pattern_text);
       if (!regex_pattern) {
         TC3_LOG(ERROR) << "Couldn't create extractor pattern";
         return;
       }
+      regex_pattern_bytes_ += pattern_text.size();
       extractor_rules_.push_back(std::move(regex_pattern));
+      extractor_rule_patterns_.push_back(std::move(pattern_text));
 
       if (extractor->locales()) {
         for (int locale : *extractor->locales()) {
@@ -91,18 +324,6 @@ DatetimeParser::DatetimeParser(const DatetimeModel* model, const UniLib& unilib,
     }
   }
 
-  if (model->locales() != nullptr) {
-    for (int i = 0; i < model->locales()->Length(); ++i) {
-      locale_string_to_id_[model->locales()->Get(i)->str()] = i;
-    }
-  }
-
-  if (model->default_locales() != nullptr) {
-    for (const int locale : *model->default_locales()) {
-      default_locale_ids_.push_back(locale);
-    }
-  }
-
   use_extractors_for_locating_ = model->use_extractors_for_locating();
   generate_alternative_interpretations_when_ambiguous_ =
       model->generate_alternative_interpretations_when_ambiguous();
@@ -110,6 +331,16 @@ DatetimeParser::DatetimeParser(const DatetimeModel* model, const UniLib& unilib,
   initialized_ = true;
 }
 
+void DatetimeParser::GetRegexPatterns(
+    std::vector<const UniLib::RegexPattern*>* patterns) const {
+  for (const CompiledRule& rule : rules_) {
+    patterns->push_back(rule.compiled_regex.get());
+  }
+  for (const auto& extractor_rule : extractor_rules_) {
+    patterns->push_back(extractor_rule.get());
+  }
+}
+
 bool DatetimeParser::Parse(
     const std::string& input, const int64 reference_time_ms_utc,
     const std::string& reference_timezone, const std::string& locales,
@@ -122,11 +353,14 @@ bool DatetimeParser::Parse(
 
 bool DatetimeParser::FindSpansUsingLocales(
     const std::vector<int>& locale_ids, const UnicodeText& input,
-    const int64 reference_time_ms_utc, const std::string& reference_timezone,
     ModeFlag mode, AnnotationUsecase annotation_usecase, bool anchor_start_end,
-    const std::string& reference_locale,
     std::unordered_set<int>* executed_rules,
-    std::vector<DatetimeParseResultSpan>* found_spans) const {
+    std::vector<DatetimeParseResultSpan>* found_spans,
+    const StopCondition* stop) const {
+  std::vector<bool> may_match_rule;
+  rule_triggers_.FindCandidates(
+      StringPiece(input.data(), input.size_bytes()), &may_match_rule);
+
   for (const int locale_id : locale_ids) {
     auto rules_it = locale_to_rules_.find(locale_id);
     if (rules_it == locale_to_rules_.end()) {
@@ -150,9 +384,16 @@ bool DatetimeParser::FindSpansUsingLocales(
 
       executed_rules->insert(rule_id);
 
-      if (!ParseWithRule(rules_[rule_id], input, reference_time_ms_utc,
-                         reference_timezone, reference_locale, locale_id,
-                         anchor_start_end, found_spans)) {
+      if (!may_match_rule[rule_id]) {
+        continue;
+      }
+
+      if (ShouldStop(stop)) {
+        return true;
+      }
+
+      if (!ParseWithRule(rule_id, input, locale_id, anchor_start_end,
+                         found_spans)) {
         return false;
       }
     }
@@ -165,62 +406,98 @@ bool DatetimeParser::Parse(
     const std::string& reference_timezone, const std::string& locales,
     ModeFlag mode, AnnotationUsecase annotation_usecase, bool anchor_start_end,
     std::vector<DatetimeParseResultSpan>* results) const {
+  const int num_previous_results = results->size();
+  if (!ParseUnresolved(input, locales, mode, annotation_usecase,
+                       anchor_start_end, results)) {
+    return false;
+  }
+  for (int i = num_previous_results; i < results->size(); ++i) {
+    for (DatetimeParseResult& result : (*results)[i].data) {
+      if (!Resolve(reference_time_ms_utc, reference_timezone, locales,
+                   &result)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool DatetimeParser::ParseUnresolved(
+    const UnicodeText& input, const std::string& locales, ModeFlag mode,
+    AnnotationUsecase annotation_usecase, bool anchor_start_end,
+    std::vector<DatetimeParseResultSpan>* results,
+    const StopCondition* stop) const {
+  TC3_TRACE_SCOPE("DatetimeParser::ParseUnresolved");
   std::vector<DatetimeParseResultSpan> found_spans;
   std::unordered_set<int> executed_rules;
   std::string reference_locale;
   const std::vector<int> requested_locales =
       ParseAndExpandLocales(locales, &reference_locale);
-  if (!FindSpansUsingLocales(requested_locales, input, reference_time_ms_utc,
-                             reference_timezone, mode, annotation_usecase,
-                             anchor_start_end, reference_locale,
-                             &executed_rules, &found_spans)) {
+  if (!FindSpansUsingLocales(requested_locales, input, mode,
+                             annotation_usecase, anchor_start_end,
+                             &executed_rules, &found_spans, stop)) {
     return false;
   }
 
-  std::vector<std::pair<DatetimeParseResultSpan, int>> indexed_found_spans;
-  indexed_found_spans.reserve(found_spans.size());
-  for (int i = 0; i < found_spans.size(); i++) {
-    indexed_found_spans.push_back({found_spans[i], i});
-  }
-
   // Resolve conflicts by always picking the longer span and breaking ties by
   // selecting the earlier entry in the list for a given locale.
-  std::sort(indexed_found_spans.begin(), indexed_found_spans.end(),
-            [](const std::pair<DatetimeParseResultSpan, int>& a,
-               const std::pair<DatetimeParseResultSpan, int>& b) {
-              if ((a.first.span.second - a.first.span.first) !=
-                  (b.first.span.second - b.first.span.first)) {
-                return (a.first.span.second - a.first.span.first) >
-                       (b.first.span.second - b.first.span.first);
-              } else {
-                return a.second < b.second;
-              }
-            });
-
-  found_spans.clear();
-  for (auto& span_index_pair : indexed_found_spans) {
-    found_spans.push_back(span_index_pair.first);
-  }
-
-  std::set<int, std::function<bool(int, int)>> chosen_indices_set(
-      [&found_spans](int a, int b) {
-        return found_spans[a].span.first < found_spans[b].span.first;
-      });
-  for (int i = 0; i < found_spans.size(); ++i) {
-    if (!DoesCandidateConflict(i, found_spans, chosen_indices_set)) {
-      chosen_indices_set.insert(i);
-      results->push_back(found_spans[i]);
+  std::vector<int> chosen_indices;
+  ChooseNonOverlappingDatetimeSpans(found_spans, &chosen_indices);
+  results->reserve(results->size() + chosen_indices.size());
+  for (const int i : chosen_indices) {
+    results->push_back(std::move(found_spans[i]));
+  }
+
+  return true;
+}
+
+bool DatetimeParser::Resolve(int64 reference_time_ms_utc,
+                             const std::string& reference_timezone,
+                             const std::string& locales,
+                             DatetimeParseResult* result) const {
+  if (result->unresolved_parse_data == nullptr) {
+    return true;
+  }
+  // The reference locale is the first one of the spec, see ExpandLocales().
+  const std::string reference_locale = locales.substr(0, locales.find(','));
+  const DateParseData& parse_data = *result->unresolved_parse_data;
+
+  // The cached times are stored without the kept milliseconds of the
+  // reference, which are added back.
+  const bool use_cache = resolution_cache_.enabled();
+  std::string cache_key;
+  const int64 kept_millis =
+      KeptReferenceMillis(parse_data, reference_time_ms_utc);
+  if (use_cache) {
+    cache_key = ResolutionCacheKey(
+        parse_data, calendarlib_.GetGranularity(parse_data),
+        reference_time_ms_utc, reference_timezone, reference_locale);
+    DatetimeParseResult cached;
+    if (resolution_cache_.Lookup(cache_key, &cached)) {
+      result->time_ms_utc = cached.time_ms_utc + kept_millis;
+      result->granularity = cached.granularity;
+      result->unresolved_parse_data.reset();
+      return true;
     }
   }
 
+  if (!calendarlib_.InterpretParseData(
+          parse_data, reference_time_ms_utc, reference_timezone,
+          reference_locale, &result->time_ms_utc, &result->granularity)) {
+    return false;
+  }
+  if (use_cache) {
+    resolution_cache_.Insert(
+        cache_key, DatetimeParseResult(result->time_ms_utc - kept_millis,
+                                       result->granularity));
+  }
+  result->unresolved_parse_data.reset();
   return true;
 }
 
 bool DatetimeParser::HandleParseMatch(
     const CompiledRule& rule, const UniLib::RegexMatcher& matcher,
-    int64 reference_time_ms_utc, const std::string& reference_timezone,
-    const std::string& reference_locale, int locale_id,
-    std::vector<DatetimeParseResultSpan>* result) const {
+    int locale_id, std::vector<DatetimeParseResultSpan>* result) const {
   int status = UniLib::RegexMatcher::kNoError;
   const int start = matcher.Start(&status);
   if (status != UniLib::RegexMatcher::kNoError) {
@@ -234,8 +511,7 @@ bool DatetimeParser::HandleParseMatch(
 
   DatetimeParseResultSpan parse_result;
   std::vector<DatetimeParseResult> alternatives;
-  if (!ExtractDatetime(rule, matcher, reference_time_ms_utc, reference_timezone,
-                       reference_locale, locale_id, &alternatives,
+  if (!ExtractDatetime(rule, matcher, locale_id, &alternatives,
                        &parse_result.span)) {
     return false;
   }
@@ -259,26 +535,24 @@ bool DatetimeParser::HandleParseMatch(
 }
 
 bool DatetimeParser::ParseWithRule(
-    const CompiledRule& rule, const UnicodeText& input,
-    const int64 reference_time_ms_utc, const std::string& reference_timezone,
-    const std::string& reference_locale, const int locale_id,
+    const int rule_id, const UnicodeText& input, const int locale_id,
     bool anchor_start_end, std::vector<DatetimeParseResultSpan>* result) const {
+  const CompiledRule& rule = rules_[rule_id];
+  RegexStats::Run stats_run(regex_stats_.get(), rule_id, input.size_bytes());
   std::unique_ptr<UniLib::RegexMatcher> matcher =
       rule.compiled_regex->Matcher(input);
   int status = UniLib::RegexMatcher::kNoError;
   if (anchor_start_end) {
-    if (matcher->Matches(&status) && status == UniLib::RegexMatcher::kNoError) {
-      if (!HandleParseMatch(rule, *matcher, reference_time_ms_utc,
-                            reference_timezone, reference_locale, locale_id,
-                            result)) {
+    if (stats_run.CountFind(matcher->Matches(&status)) &&
+        status == UniLib::RegexMatcher::kNoError) {
+      if (!HandleParseMatch(rule, *matcher, locale_id, result)) {
         return false;
       }
     }
   } else {
-    while (matcher->Find(&status) && status == UniLib::RegexMatcher::kNoError) {
-      if (!HandleParseMatch(rule, *matcher, reference_time_ms_utc,
-                            reference_timezone, reference_locale, locale_id,
-                            result)) {
+    while (stats_run.CountFind(matcher->Find(&status)) &&
+           status == UniLib::RegexMatcher::kNoError) {
+      if (!HandleParseMatch(rule, *matcher, locale_id, result)) {
         return false;
       }
     }
@@ -288,6 +562,27 @@ bool DatetimeParser::ParseWithRule(
 
 std::vector<int> DatetimeParser::ParseAndExpandLocales(
     const std::string& locales, std::string* reference_locale) const {
+  {
+    std::shared_lock<std::shared_timed_mutex> lock(expanded_locales_mutex_);
+    const auto it = expanded_locales_.find(locales);
+    if (it != expanded_locales_.end()) {
+      *reference_locale = it->second.reference_locale;
+      return it->second.locale_ids;
+    }
+  }
+
+  std::vector<int> result = ExpandLocales(locales, reference_locale);
+
+  std::unique_lock<std::shared_timed_mutex> lock(expanded_locales_mutex_);
+  if (expanded_locales_.size() >= kMaxExpandedLocales) {
+    expanded_locales_.clear();
+  }
+  expanded_locales_[locales] = {result, *reference_locale};
+  return result;
+}
+
+std::vector<int> DatetimeParser::ExpandLocales(
+    const std::string& locales, std::string* reference_locale) const {
   std::vector<StringPiece> split_locales = strings::Split(locales, ',');
   if (!split_locales.empty()) {
     *reference_locale = split_locales[0].ToString();
@@ -386,19 +681,37 @@ void DatetimeParser::FillInterpretations(
   // week, and resulted sometimes results in the same date being proposed.
 }
 
+const DatetimeGroupVocabulary* DatetimeParser::VocabularyForLocale(
+    int locale_id) const {
+  {
+    std::shared_lock<std::shared_timed_mutex> lock(vocabularies_mutex_);
+    const auto it = locale_to_vocabulary_.find(locale_id);
+    if (it != locale_to_vocabulary_.end()) {
+      return it->second.get();
+    }
+  }
+
+  // Build outside of the lock, this runs the extractors of the locale.
+  std::unique_ptr<const DatetimeGroupVocabulary> vocabulary =
+      DatetimeExtractor(locale_id, unilib_, extractor_rules_,
+                        type_and_locale_to_extractor_rule_)
+          .BuildVocabulary(extractor_rule_patterns_);
+
+  std::unique_lock<std::shared_timed_mutex> lock(vocabularies_mutex_);
+  return locale_to_vocabulary_.emplace(locale_id, std::move(vocabulary))
+      .first->second.get();
+}
+
 bool DatetimeParser::ExtractDatetime(const CompiledRule& rule,
                                      const UniLib::RegexMatcher& matcher,
-                                     const int64 reference_time_ms_utc,
-                                     const std::string& reference_timezone,
-                                     const std::string& reference_locale,
                                      int locale_id,
                                      std::vector<DatetimeParseResult>* results,
                                      CodepointSpan* result_span) const {
   DateParseData parse;
-  DatetimeExtractor extractor(rule, matcher, locale_id, unilib_,
-                              extractor_rules_,
-                              type_and_locale_to_extractor_rule_);
-  if (!extractor.Extract(&parse, result_span)) {
+  DatetimeExtractor extractor(locale_id, unilib_, extractor_rules_,
+                              type_and_locale_to_extractor_rule_,
+                              VocabularyForLocale(locale_id));
+  if (!extractor.Extract(rule, matcher, &parse, result_span)) {
     return false;
   }
 
@@ -412,11 +725,8 @@ bool DatetimeParser::ExtractDatetime(const CompiledRule& rule,
   results->reserve(results->size() + interpretations.size());
   for (const DateParseData& interpretation : interpretations) {
     DatetimeParseResult result;
-    if (!calendarlib_.InterpretParseData(
-            interpretation, reference_time_ms_utc, reference_timezone,
-            reference_locale, &(result.time_ms_utc), &(result.granularity))) {
-      return false;
-    }
+    result.granularity = calendarlib_.GetGranularity(interpretation);
+    result.unresolved_parse_data.reset(new DateParseData(interpretation));
     results->push_back(result);
   }
   return true;
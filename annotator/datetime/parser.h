@@ -18,6 +18,7 @@
 #define LIBTEXTCLASSIFIER_ANNOTATOR_DATETIME_PARSER_H_
 
 #include <memory>
+#include <shared_mutex>  // NOLINT
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -25,21 +26,42 @@
 
 #include "annotator/datetime/extractor.h"
 #include "annotator/model_generated.h"
+#include "annotator/result-cache.h"
 #include "annotator/types.h"
 #include "utils/base/integral_types.h"
 #include "utils/calendar/calendar.h"
+#include "utils/cancellation.h"
+#include "utils/regex-prefilter.h"
+#include "utils/regex-stats.h"
 #include "utils/utf8/unilib.h"
 #include "utils/zlib/zlib.h"
 
 namespace libtextclassifier3 {
 
+// Chooses the spans of the parse results that don't overlap each other,
+// preferring the longer ones and, among spans of the same length, the earlier
+// ones in `spans`. Fills `chosen_indices` with the indices of the chosen
+// spans in order of preference. Runs in O(n log n).
+void ChooseNonOverlappingDatetimeSpans(
+    const std::vector<DatetimeParseResultSpan>& spans,
+    std::vector<int>* chosen_indices);
+
 // Parses datetime expressions in the input and resolves them to actual absolute
 // time.
 class DatetimeParser {
  public:
+  // If load_locales (comma-separated BCP 47 locales) is not empty, only the
+  // rules and extractors that can run for these locales are loaded. Parsing
+  // with other locales then only finds the datetimes of the loaded ones.
   static std::unique_ptr<DatetimeParser> Instance(
       const DatetimeModel* model, const UniLib& unilib,
-      const CalendarLib& calendarlib, ZlibDecompressor* decompressor);
+      const CalendarLib& calendarlib, ZlibDecompressor* decompressor,
+      const std::string& load_locales = "");
+
+  // Checks the structure of a datetime model without building a parser from
+  // it: that every rule and extractor has a pattern. Whether the patterns
+  // decompress and compile is only known once Instance() builds them.
+  static bool IsValidModel(const DatetimeModel* model);
 
   // Parses the dates in 'input' and fills result. Makes sure that the results
   // do not overlap.
@@ -58,6 +80,43 @@ class DatetimeParser {
              bool anchor_start_end,
              std::vector<DatetimeParseResultSpan>* results) const;
 
+  // Same as above, but doesn't resolve the interpretations to an absolute time
+  // yet: the results only have their granularity set and keep the parsed
+  // fields in unresolved_parse_data. Callers that drop most of the results can
+  // then resolve just the remaining ones with Resolve().
+  // Once 'stop' says to stop, the remaining rules are skipped and the results
+  // only come from the rules that ran.
+  bool ParseUnresolved(const UnicodeText& input, const std::string& locales,
+                       ModeFlag mode, AnnotationUsecase annotation_usecase,
+                       bool anchor_start_end,
+                       std::vector<DatetimeParseResultSpan>* results,
+                       const StopCondition* stop = nullptr) const;
+
+  // Resolves a result of ParseUnresolved() to an absolute time, with the same
+  // reference as Parse(). Does nothing for results that are already resolved.
+  bool Resolve(int64 reference_time_ms_utc,
+               const std::string& reference_timezone,
+               const std::string& locales, DatetimeParseResult* result) const;
+
+  // Appends all the regex patterns of the parser, e.g. to compile lazily
+  // created ones ahead of time.
+  void GetRegexPatterns(
+      std::vector<const UniLib::RegexPattern*>* patterns) const;
+
+  // The cost counters of the rules, by rule index. Disabled by default.
+  RegexStats* regex_stats() const { return regex_stats_.get(); }
+
+  // Resolutions of parsed fields kept between calls of Resolve(), for the
+  // relative expressions that recur over many texts, e.g. "tomorrow". A
+  // resolution is reused for the reference times of the same window, whose
+  // length depends on the granularity of the result. Disabled by default.
+  ResultCache<DatetimeParseResult>* resolution_cache() const {
+    return &resolution_cache_;
+  }
+
+  // Size of the source of the rule and extractor patterns.
+  int64 regex_pattern_bytes() const { return regex_pattern_bytes_; }
+
 #ifdef TC3_TEST_ONLY
   void TestOnlySetGenerateAlternativeInterpretationsWhenAmbiguous(bool value) {
     generate_alternative_interpretations_when_ambiguous_ = value;
@@ -66,49 +125,49 @@ class DatetimeParser {
 
  protected:
   DatetimeParser(const DatetimeModel* model, const UniLib& unilib,
-                 const CalendarLib& calendarlib,
-                 ZlibDecompressor* decompressor);
+                 const CalendarLib& calendarlib, ZlibDecompressor* decompressor,
+                 const std::string& load_locales);
 
   // Returns a list of locale ids for given locale spec string (comma-separated
   // locale names). Assigns the first parsed locale to reference_locale.
+  // The results are remembered for recently seen locale specs.
   std::vector<int> ParseAndExpandLocales(const std::string& locales,
                                          std::string* reference_locale) const;
 
+  // Uncached version of the above.
+  std::vector<int> ExpandLocales(const std::string& locales,
+                                 std::string* reference_locale) const;
+
   // Helper function that finds datetime spans, only using the rules associated
   // with the given locales.
   bool FindSpansUsingLocales(
       const std::vector<int>& locale_ids, const UnicodeText& input,
-      const int64 reference_time_ms_utc, const std::string& reference_timezone,
       ModeFlag mode, AnnotationUsecase annotation_usecase,
-      bool anchor_start_end, const std::string& reference_locale,
-      std::unordered_set<int>* executed_rules,
-      std::vector<DatetimeParseResultSpan>* found_spans) const;
-
-  bool ParseWithRule(const CompiledRule& rule, const UnicodeText& input,
-                     int64 reference_time_ms_utc,
-                     const std::string& reference_timezone,
-                     const std::string& reference_locale, const int locale_id,
-                     bool anchor_start_end,
+      bool anchor_start_end, std::unordered_set<int>* executed_rules,
+      std::vector<DatetimeParseResultSpan>* found_spans,
+      const StopCondition* stop) const;
+
+  bool ParseWithRule(int rule_id, const UnicodeText& input,
+                     const int locale_id, bool anchor_start_end,
                      std::vector<DatetimeParseResultSpan>* result) const;
 
   void FillInterpretations(const DateParseData& parse,
                            std::vector<DateParseData>* interpretations) const;
 
-  // Converts the current match in 'matcher' into DatetimeParseResult.
+  // Converts the current match in 'matcher' into unresolved
+  // DatetimeParseResults.
   bool ExtractDatetime(const CompiledRule& rule,
-                       const UniLib::RegexMatcher& matcher,
-                       int64 reference_time_ms_utc,
-                       const std::string& reference_timezone,
-                       const std::string& reference_locale, int locale_id,
+                       const UniLib::RegexMatcher& matcher, int locale_id,
                        std::vector<DatetimeParseResult>* results,
                        CodepointSpan* result_span) const;
 
+  // Returns the vocabulary of the extractors of the locale, building it on
+  // first use.
+  const DatetimeGroupVocabulary* VocabularyForLocale(int locale_id) const;
+
   // Parse and extract information from current match in 'matcher'.
   bool HandleParseMatch(const CompiledRule& rule,
-                        const UniLib::RegexMatcher& matcher,
-                        int64 reference_time_ms_utc,
-                        const std::string& reference_timezone,
-                        const std::string& reference_locale, int locale_id,
+                        const UniLib::RegexMatcher& matcher, int locale_id,
                         std::vector<DatetimeParseResultSpan>* result) const;
 
  private:
@@ -116,12 +175,39 @@ class DatetimeParser {
   const UniLib& unilib_;
   const CalendarLib& calendarlib_;
   std::vector<CompiledRule> rules_;
+
+  // Triggers of the rules, by rule index. Rules without any of their triggers
+  // in the input are not run.
+  RegexTriggerMatcher rule_triggers_;
+  std::unique_ptr<RegexStats> regex_stats_;
+  mutable ResultCache<DatetimeParseResult> resolution_cache_;
+  int64 regex_pattern_bytes_ = 0;
   std::unordered_map<int, std::vector<int>> locale_to_rules_;
   std::vector<std::unique_ptr<const UniLib::RegexPattern>> extractor_rules_;
+
+  // Pattern texts of extractor_rules_, to build the vocabularies from.
+  std::vector<std::string> extractor_rule_patterns_;
+
+  // Read on every datetime match and written once per locale, so the lookups
+  // only take the lock shared.
+  mutable std::shared_timed_mutex vocabularies_mutex_;
+  mutable std::unordered_map<int,
+                             std::unique_ptr<const DatetimeGroupVocabulary>>
+      locale_to_vocabulary_;
   std::unordered_map<DatetimeExtractorType, std::unordered_map<int, int>>
       type_and_locale_to_extractor_rule_;
   std::unordered_map<std::string, int> locale_string_to_id_;
   std::vector<int> default_locale_ids_;
+
+  // Maximum number of locale specs whose expansion is remembered.
+  static constexpr int kMaxExpandedLocales = 16;
+
+  struct ExpandedLocales {
+    std::vector<int> locale_ids;
+    std::string reference_locale;
+  };
+  mutable std::shared_timed_mutex expanded_locales_mutex_;
+  mutable std::unordered_map<std::string, ExpandedLocales> expanded_locales_;
   bool use_extractors_for_locating_;
   bool generate_alternative_interpretations_when_ambiguous_;
 };
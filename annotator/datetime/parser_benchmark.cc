@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+
+#include "annotator/datetime/parser.h"
+#include "utils/testing/benchmark-utils.h"
+#include "benchmark/benchmark.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+// Argument: the number of spans, which start every 3 codepoints and are 1 to
+// 16 codepoints long, so that most of them overlap their neighbours as the
+// matches of the rules of several locales do.
+void BM_ChooseNonOverlappingDatetimeSpans(benchmark::State& state) {
+  std::vector<DatetimeParseResultSpan> spans(state.range(0));
+  for (int i = 0; i < spans.size(); ++i) {
+    const int start = 3 * i;
+    const int length = 1 + static_cast<int>((i * 2654435761u) % 16);
+    spans[i].span = {start, start + length};
+  }
+
+  std::vector<int> chosen_indices;
+  RunMeasuredBenchmark(state, /*bytes_per_call=*/0, [&]() {
+    chosen_indices.clear();
+    ChooseNonOverlappingDatetimeSpans(spans, &chosen_indices);
+    benchmark::DoNotOptimize(chosen_indices.data());
+  });
+}
+BENCHMARK(BM_ChooseNonOverlappingDatetimeSpans)->Range(16, 16384);
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -15,9 +15,11 @@
  */
 
 #include <time.h>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <random>
 #include <string>
 
 #include "gmock/gmock.h"
@@ -28,6 +30,7 @@
 #include "annotator/model_generated.h"
 #include "annotator/types-test-util.h"
 #include "utils/testing/annotator.h"
+#include "utils/testing/worst-case-search.h"
 
 using testing::ElementsAreArray;
 
@@ -444,6 +447,84 @@ TEST_F(ParserTest, WhenAlternativesDisabledDoesNotGenerateAlternatives) {
                               GRANULARITY_MINUTE));
 }
 
+TEST_F(ParserTest, ParseUnresolvedDefersResolution) {
+  std::vector<DatetimeParseResultSpan> results;
+  ASSERT_TRUE(parser_->ParseUnresolved(
+      UTF8ToUnicodeText("call me on January 1, 1988", /*do_copy=*/false),
+      /*locales=*/"en-US", ModeFlag_ANNOTATION,
+      AnnotationUsecase_ANNOTATION_USECASE_SMART,
+      /*anchor_start_end=*/false, &results));
+  ASSERT_EQ(results.size(), 1);
+  EXPECT_EQ(results[0].span, CodepointSpan(11, 26));
+  ASSERT_EQ(results[0].data.size(), 1);
+
+  DatetimeParseResult& result = results[0].data[0];
+  EXPECT_EQ(result.granularity, GRANULARITY_DAY);
+  ASSERT_NE(result.unresolved_parse_data, nullptr);
+
+  ASSERT_TRUE(parser_->Resolve(/*reference_time_ms_utc=*/0, "Europe/Zurich",
+                               /*locales=*/"en-US", &result));
+  EXPECT_EQ(result.time_ms_utc, 567990000000);
+  EXPECT_EQ(result.granularity, GRANULARITY_DAY);
+  EXPECT_EQ(result.unresolved_parse_data, nullptr);
+}
+
+TEST_F(ParserTest, ResolutionCacheKeepsResolvedTimes) {
+  const std::vector<std::string> texts = {
+      "see you tomorrow", "let's talk next week", "meet at 5pm",
+      "call me in 2 hours", "call me on January 1, 1988", "I'm free now"};
+  // Every 7 minutes and a bit over the days around the spring DST transition
+  // of Zurich, so that the reference times fall at all the milliseconds of a
+  // second and on both sides of the local midnights and of the transition.
+  std::vector<int64> reference_times_ms_utc;
+  for (int64 time_ms = 1553817600000; time_ms < 1554163200000;
+       time_ms += 433457) {
+    reference_times_ms_utc.push_back(time_ms);
+  }
+  auto resolve_all = [&]() {
+    std::vector<DatetimeParseResultSpan> all_results;
+    for (const std::string& text : texts) {
+      for (const int64 reference_time_ms_utc : reference_times_ms_utc) {
+        std::vector<DatetimeParseResultSpan> results;
+        EXPECT_TRUE(parser_->Parse(text, reference_time_ms_utc,
+                                   "Europe/Zurich", /*locales=*/"en-US",
+                                   ModeFlag_ANNOTATION,
+                                   AnnotationUsecase_ANNOTATION_USECASE_SMART,
+                                   /*anchor_start_end=*/false, &results));
+        all_results.insert(all_results.end(), results.begin(), results.end());
+      }
+    }
+    return all_results;
+  };
+  const std::vector<DatetimeParseResultSpan> uncached_results = resolve_all();
+  ASSERT_FALSE(uncached_results.empty());
+
+  parser_->resolution_cache()->SetCapacity(10000);
+  EXPECT_EQ(resolve_all(), uncached_results);
+  // Again from the cache.
+  EXPECT_EQ(resolve_all(), uncached_results);
+  EXPECT_GT(parser_->resolution_cache()->GetStats().num_hits,
+            uncached_results.size());
+}
+
+TEST_F(ParserTest, ParsesWorstCaseInputsWithinTimeBudget) {
+  // Generous, to only catch inputs that became superlinear to parse.
+  constexpr double kMaxUsPerByte = 20.0;
+  for (int i = 0; i < kNumWorstCaseInputs; ++i) {
+    const WorstCaseInput input = static_cast<WorstCaseInput>(i);
+    const std::string text = WorstCaseInputText(input, 4096);
+    const double time_us = MinTimeUs(/*num_repetitions=*/3, [&]() {
+      std::vector<DatetimeParseResultSpan> results;
+      parser_->Parse(text, /*reference_time_ms_utc=*/0, "Europe/Zurich",
+                     /*locales=*/"en-US", ModeFlag_ANNOTATION,
+                     AnnotationUsecase_ANNOTATION_USECASE_SMART,
+                     /*anchor_start_end=*/false, &results);
+    });
+    EXPECT_LE(time_us / text.size(), kMaxUsPerByte)
+        << WorstCaseInputName(input);
+  }
+}
+
 class ParserLocaleTest : public testing::Test {
  public:
   void SetUp() override;
@@ -453,6 +534,7 @@ class ParserLocaleTest : public testing::Test {
   UniLib unilib_;
   CalendarLib calendarlib_;
   flatbuffers::FlatBufferBuilder builder_;
+  const DatetimeModel* model_ = nullptr;
   std::unique_ptr<DatetimeParser> parser_;
 };
 
@@ -488,11 +570,10 @@ void ParserLocaleTest::SetUp() {
   AddPattern(/*regex=*/"default", /*locale=*/6, &model.patterns);
 
   builder_.Finish(DatetimeModel::Pack(builder_, &model));
-  const DatetimeModel* model_fb =
-      flatbuffers::GetRoot<DatetimeModel>(builder_.GetBufferPointer());
-  ASSERT_TRUE(model_fb);
+  model_ = flatbuffers::GetRoot<DatetimeModel>(builder_.GetBufferPointer());
+  ASSERT_TRUE(model_);
 
-  parser_ = DatetimeParser::Instance(model_fb, unilib_, calendarlib_,
+  parser_ = DatetimeParser::Instance(model_, unilib_, calendarlib_,
                                      /*decompressor=*/nullptr);
   ASSERT_TRUE(parser_);
 }
@@ -507,6 +588,62 @@ bool ParserLocaleTest::HasResult(const std::string& input,
   return results.size() == 1;
 }
 
+// Chooses the spans the way the parser did before, by comparing each span
+// with all the chosen ones.
+std::vector<int> ChooseNonOverlappingSpansQuadratic(
+    const std::vector<DatetimeParseResultSpan>& spans) {
+  std::vector<int> ranked_indices;
+  for (int i = 0; i < spans.size(); ++i) {
+    ranked_indices.push_back(i);
+  }
+  std::sort(ranked_indices.begin(), ranked_indices.end(),
+            [&spans](int a, int b) {
+              const int length_a = spans[a].span.second - spans[a].span.first;
+              const int length_b = spans[b].span.second - spans[b].span.first;
+              return length_a != length_b ? length_a > length_b : a < b;
+            });
+  std::vector<int> chosen_indices;
+  for (const int i : ranked_indices) {
+    bool conflict = false;
+    for (const int chosen : chosen_indices) {
+      conflict = conflict || SpansOverlap(spans[i].span, spans[chosen].span);
+    }
+    if (!conflict) {
+      chosen_indices.push_back(i);
+    }
+  }
+  return chosen_indices;
+}
+
+TEST(ChooseNonOverlappingDatetimeSpansTest, ChoosesLongerThenEarlierSpans) {
+  std::vector<DatetimeParseResultSpan> spans(4);
+  spans[0].span = {0, 5};
+  spans[1].span = {3, 10};
+  spans[2].span = {10, 15};
+  spans[3].span = {12, 17};
+
+  std::vector<int> chosen_indices;
+  ChooseNonOverlappingDatetimeSpans(spans, &chosen_indices);
+
+  EXPECT_THAT(chosen_indices, testing::ElementsAre(1, 2));
+}
+
+TEST(ChooseNonOverlappingDatetimeSpansTest, MatchesQuadraticChoice) {
+  std::mt19937 random(/*seed=*/42);
+  for (int trial = 0; trial < 100; ++trial) {
+    std::vector<DatetimeParseResultSpan> spans(1 + random() % 50);
+    for (DatetimeParseResultSpan& span : spans) {
+      const int start = random() % 100;
+      span.span = {start, start + 1 + static_cast<int>(random() % 10)};
+    }
+
+    std::vector<int> chosen_indices;
+    ChooseNonOverlappingDatetimeSpans(spans, &chosen_indices);
+
+    EXPECT_EQ(chosen_indices, ChooseNonOverlappingSpansQuadratic(spans));
+  }
+}
+
 TEST_F(ParserLocaleTest, English) {
   EXPECT_TRUE(HasResult("en-US", /*locales=*/"en-US"));
   EXPECT_FALSE(HasResult("en-CH", /*locales=*/"en-US"));
@@ -534,5 +671,21 @@ TEST_F(ParserLocaleTest, SwissEnglish) {
   EXPECT_TRUE(HasResult("default", /*locales=*/"en-CH"));
 }
 
+TEST_F(ParserLocaleTest, LoadsOnlyTheRulesOfTheLoadLocales) {
+  const int64 all_pattern_bytes = parser_->regex_pattern_bytes();
+  parser_ = DatetimeParser::Instance(model_, unilib_, calendarlib_,
+                                     /*decompressor=*/nullptr,
+                                     /*load_locales=*/"en-CH");
+  ASSERT_TRUE(parser_);
+  EXPECT_LT(parser_->regex_pattern_bytes(), all_pattern_bytes);
+
+  EXPECT_TRUE(HasResult("en-CH", /*locales=*/"en-CH"));
+  EXPECT_TRUE(HasResult("en-all", /*locales=*/"en-CH"));
+  EXPECT_TRUE(HasResult("all-CH", /*locales=*/"de-CH"));
+  EXPECT_TRUE(HasResult("default", /*locales=*/"en-US"));
+  EXPECT_FALSE(HasResult("en-US", /*locales=*/"en-US"));
+  EXPECT_FALSE(HasResult("zh-Hant", /*locales=*/"zh-Hant"));
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
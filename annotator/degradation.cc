@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/degradation.h"
+
+#include <algorithm>
+
+namespace libtextclassifier3 {
+
+namespace {
+
+// The tiers, from the most complete to the cheapest.
+constexpr int kDegradationSteps[] = {
+    ANNOTATION_TIER_ALL, ANNOTATION_TIER_ALL & ~ANNOTATION_TIER_MODEL,
+    ANNOTATION_TIER_ALL & ~ANNOTATION_TIER_MODEL &
+        ~ANNOTATION_TIER_FULL_DATETIME};
+constexpr int kNumDegradationSteps =
+    sizeof(kDegradationSteps) / sizeof(kDegradationSteps[0]);
+
+// Weight of a new measurement in the moving averages.
+constexpr double kNewCostWeight = 1.0 / 8;
+
+}  // namespace
+
+constexpr int AnnotationCostModel::kProbeInterval;
+
+AnnotationCostModel::AnnotationCostModel() {
+  for (std::atomic<double>& cost : cost_us_per_codepoint_) {
+    cost.store(-1.0, std::memory_order_relaxed);
+  }
+}
+
+AnnotationPlan AnnotationCostModel::Plan(const DegradationPolicy& policy,
+                                         const int num_codepoints) const {
+  AnnotationPlan plan;
+  if (!policy.enabled() || num_codepoints <= 0) {
+    return plan;
+  }
+  float load = 0.0f;
+  if (policy.load != nullptr) {
+    load = std::min(
+        1.0f, std::max(0.0f, policy.load->load(std::memory_order_relaxed)));
+  }
+  const double budget_us = policy.budget_ms * 1000.0 * (1.0 - load);
+
+  int step = 0;
+  while (step < kNumDegradationSteps) {
+    const double cost = CostPerCodepointUs(kDegradationSteps[step]);
+    if (cost < 0 || cost * num_codepoints <= budget_us) {
+      break;
+    }
+    ++step;
+  }
+  if (step > 0) {
+    // Now and then one tier more than planned runs, see kProbeInterval.
+    const uint32 num_degraded_plans =
+        num_degraded_plans_.fetch_add(1, std::memory_order_relaxed);
+    if (num_degraded_plans % kProbeInterval == kProbeInterval - 1) {
+      --step;
+    }
+  }
+  if (step < kNumDegradationSteps) {
+    plan.tiers = kDegradationSteps[step];
+    return plan;
+  }
+
+  // Even the cheapest tiers don't fit: only the start of the text is
+  // annotated.
+  const int cheapest_tiers = kDegradationSteps[kNumDegradationSteps - 1];
+  const int affordable_codepoints =
+      static_cast<int>(budget_us / CostPerCodepointUs(cheapest_tiers));
+  plan.max_codepoints = std::max(policy.min_codepoints, affordable_codepoints);
+  plan.tiers = plan.max_codepoints < num_codepoints
+                   ? cheapest_tiers & ~ANNOTATION_TIER_FULL_TEXT
+                   : cheapest_tiers;
+  return plan;
+}
+
+void AnnotationCostModel::Record(const int tiers, const int num_codepoints,
+                                 const int64 elapsed_us) {
+  if (num_codepoints <= 0) {
+    return;
+  }
+  std::atomic<double>& cost =
+      cost_us_per_codepoint_[tiers | ANNOTATION_TIER_FULL_TEXT];
+  const double measured = static_cast<double>(elapsed_us) / num_codepoints;
+  const double previous = cost.load(std::memory_order_relaxed);
+  cost.store(previous < 0
+                 ? measured
+                 : previous + kNewCostWeight * (measured - previous),
+             std::memory_order_relaxed);
+}
+
+double AnnotationCostModel::CostPerCodepointUs(const int tiers) const {
+  return cost_us_per_codepoint_[tiers | ANNOTATION_TIER_FULL_TEXT].load(
+      std::memory_order_relaxed);
+}
+
+}  // namespace libtextclassifier3
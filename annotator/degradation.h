@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Load shedding for Annotate: under pressure, it skips its most costly work to
+// stay within a latency budget, and returns less complete annotations instead
+// of timing out.
+
+#ifndef LIBTEXTCLASSIFIER_ANNOTATOR_DEGRADATION_H_
+#define LIBTEXTCLASSIFIER_ANNOTATOR_DEGRADATION_H_
+
+#include <atomic>
+
+#include "utils/base/integral_types.h"
+
+namespace libtextclassifier3 {
+
+// The parts of the work of Annotate that a DegradationPolicy can skip, as bit
+// flags.
+enum AnnotationTier {
+  // The selection and classification models, and the sources that use their
+  // tokens: contacts, installed apps and durations.
+  ANNOTATION_TIER_MODEL = 1 << 0,
+
+  // Datetime parsing with the languages detected in each region of the text,
+  // on top of the locales of the options.
+  ANNOTATION_TIER_FULL_DATETIME = 1 << 1,
+
+  // The text past its first AnnotationPlan::max_codepoints codepoints.
+  ANNOTATION_TIER_FULL_TEXT = 1 << 2,
+
+  ANNOTATION_TIER_ALL = (1 << 3) - 1,
+};
+
+// Makes Annotate skip tiers, from the most costly one on, until the time it
+// expects to take on the text fits a latency budget: first the ML models, then
+// the datetime parsing of the detected languages, and then the end of the
+// text. Disabled by default.
+struct DegradationPolicy {
+  // The latency budget of a call, in milliseconds. Zero disables the policy.
+  // It only decides which tiers run: a timeout still bounds the call.
+  int64 budget_ms = 0;
+
+  // If set, a load signal of the process in [0, 1], e.g. the fraction of busy
+  // workers, read at the start of the call. The budget shrinks with the load,
+  // down to nothing at full load. Not owned, must outlive the call.
+  const std::atomic<float>* load = nullptr;
+
+  // The number of codepoints that are annotated at least, when the end of the
+  // text is skipped.
+  int min_codepoints = 256;
+
+  bool enabled() const { return budget_ms > 0; }
+};
+
+// The tiers a call runs, and how much of the text.
+struct AnnotationPlan {
+  // AnnotationTier flags.
+  int tiers = ANNOTATION_TIER_ALL;
+
+  // Without ANNOTATION_TIER_FULL_TEXT, the number of codepoints at the start
+  // of the text that are annotated.
+  int max_codepoints = 0;
+};
+
+// Learns how long Annotate takes per codepoint with each set of tiers, and
+// plans the calls of a DegradationPolicy from it. A set of tiers whose cost is
+// not known yet is expected to fit, so that it gets measured. The estimates
+// are only updated by the calls that run the tiers, so one in kProbeInterval
+// degraded calls runs one tier more than planned, to notice when it fits
+// again. Thread-safe.
+class AnnotationCostModel {
+ public:
+  static constexpr int kProbeInterval = 64;
+
+  AnnotationCostModel();
+
+  AnnotationCostModel(const AnnotationCostModel&) = delete;
+  AnnotationCostModel& operator=(const AnnotationCostModel&) = delete;
+
+  // Plans a call on a text of the given length.
+  AnnotationPlan Plan(const DegradationPolicy& policy,
+                      int num_codepoints) const;
+
+  // Adds a measurement of a call that ran the tiers on that many codepoints.
+  void Record(int tiers, int num_codepoints, int64 elapsed_us);
+
+  // Returns the estimated cost of the tiers in microseconds per codepoint, or
+  // a negative value if it isn't known yet.
+  double CostPerCodepointUs(int tiers) const;
+
+ private:
+  // Exponential moving averages of the cost per codepoint, by the tiers other
+  // than ANNOTATION_TIER_FULL_TEXT, which doesn't change it. Negative while
+  // unknown. Concurrent updates can overwrite each other, which only loses
+  // measurements.
+  std::atomic<double> cost_us_per_codepoint_[ANNOTATION_TIER_ALL + 1];
+
+  mutable std::atomic<uint32> num_degraded_plans_{0};
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_ANNOTATOR_DEGRADATION_H_
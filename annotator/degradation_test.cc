@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/degradation.h"
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+constexpr int kWithoutModel = ANNOTATION_TIER_ALL & ~ANNOTATION_TIER_MODEL;
+constexpr int kCheapest = kWithoutModel & ~ANNOTATION_TIER_FULL_DATETIME;
+
+DegradationPolicy PolicyWithBudget(int64 budget_ms) {
+  DegradationPolicy policy;
+  policy.budget_ms = budget_ms;
+  return policy;
+}
+
+TEST(AnnotationCostModelTest, RunsAllTiersWithoutPolicy) {
+  AnnotationCostModel cost_model;
+  cost_model.Record(ANNOTATION_TIER_ALL, 100, 1000000);
+  EXPECT_EQ(cost_model.Plan(DegradationPolicy(), 100).tiers,
+            ANNOTATION_TIER_ALL);
+}
+
+TEST(AnnotationCostModelTest, RunsTiersWhoseCostIsUnknown) {
+  AnnotationCostModel cost_model;
+  EXPECT_EQ(cost_model.Plan(PolicyWithBudget(1), 1000).tiers,
+            ANNOTATION_TIER_ALL);
+
+  // 10 ms for 100 codepoints doesn't fit 5 ms.
+  cost_model.Record(ANNOTATION_TIER_ALL, 100, 10000);
+  EXPECT_EQ(cost_model.Plan(PolicyWithBudget(5), 100).tiers, kWithoutModel);
+  EXPECT_EQ(cost_model.Plan(PolicyWithBudget(20), 100).tiers,
+            ANNOTATION_TIER_ALL);
+}
+
+TEST(AnnotationCostModelTest, SkipsTiersFromTheMostCostlyOne) {
+  AnnotationCostModel cost_model;
+  cost_model.Record(ANNOTATION_TIER_ALL, 100, 10000);
+  cost_model.Record(kWithoutModel, 100, 4000);
+  cost_model.Record(kCheapest, 100, 1000);
+  EXPECT_EQ(cost_model.Plan(PolicyWithBudget(5), 100).tiers, kWithoutModel);
+  EXPECT_EQ(cost_model.Plan(PolicyWithBudget(2), 100).tiers, kCheapest);
+
+  // The cheapest tiers afford 500 of the 1000 codepoints.
+  const AnnotationPlan plan = cost_model.Plan(PolicyWithBudget(5), 1000);
+  EXPECT_EQ(plan.tiers, kCheapest & ~ANNOTATION_TIER_FULL_TEXT);
+  EXPECT_EQ(plan.max_codepoints, 500);
+}
+
+TEST(AnnotationCostModelTest, ShrinksBudgetWithLoad) {
+  AnnotationCostModel cost_model;
+  cost_model.Record(ANNOTATION_TIER_ALL, 100, 4000);
+  std::atomic<float> load(0.0f);
+  DegradationPolicy policy = PolicyWithBudget(5);
+  policy.load = &load;
+  EXPECT_EQ(cost_model.Plan(policy, 100).tiers, ANNOTATION_TIER_ALL);
+  load = 0.5f;
+  EXPECT_EQ(cost_model.Plan(policy, 100).tiers, kWithoutModel);
+}
+
+TEST(AnnotationCostModelTest, ProbesSkippedTiers) {
+  AnnotationCostModel cost_model;
+  cost_model.Record(ANNOTATION_TIER_ALL, 100, 10000);
+  int num_probes = 0;
+  for (int i = 0; i < AnnotationCostModel::kProbeInterval; ++i) {
+    if (cost_model.Plan(PolicyWithBudget(5), 100).tiers ==
+        ANNOTATION_TIER_ALL) {
+      ++num_probes;
+    }
+  }
+  EXPECT_EQ(num_probes, 1);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -18,6 +18,7 @@
 
 #include <climits>
 #include <cstdlib>
+#include <cstring>
 
 #include "annotator/collections.h"
 #include "annotator/types.h"
@@ -34,21 +35,20 @@ namespace {
 void FillDurationUnitMap(
     const flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>*
         expressions,
-    DurationUnit duration_unit,
-    std::unordered_map<std::string, DurationUnit>* target_map) {
+    DurationUnit duration_unit, StringPieceMap<DurationUnit>* target_map) {
   if (expressions == nullptr) {
     return;
   }
 
   for (const flatbuffers::String* expression_string : *expressions) {
-    (*target_map)[expression_string->c_str()] = duration_unit;
+    target_map->Insert(expression_string->c_str(), duration_unit);
   }
 }
 }  // namespace
 
-std::unordered_map<std::string, DurationUnit> BuildTokenToDurationUnitMapping(
+StringPieceMap<DurationUnit> BuildTokenToDurationUnitMapping(
     const DurationAnnotatorOptions* options) {
-  std::unordered_map<std::string, DurationUnit> mapping;
+  StringPieceMap<DurationUnit> mapping;
   FillDurationUnitMap(options->week_expressions(), DurationUnit::WEEK,
                       &mapping);
   FillDurationUnitMap(options->day_expressions(), DurationUnit::DAY, &mapping);
@@ -61,16 +61,16 @@ std::unordered_map<std::string, DurationUnit> BuildTokenToDurationUnitMapping(
   return mapping;
 }
 
-std::unordered_set<std::string> BuildStringSet(
+StringPieceSet BuildStringSet(
     const flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>*
         strings) {
-  std::unordered_set<std::string> result;
+  StringPieceSet result;
   if (strings == nullptr) {
     return result;
   }
 
   for (const flatbuffers::String* string_value : *strings) {
-    result.insert(string_value->c_str());
+    result.Insert(string_value->c_str());
   }
 
   return result;
@@ -78,6 +78,22 @@ std::unordered_set<std::string> BuildStringSet(
 
 }  // namespace internal
 
+namespace {
+
+// Same as ParseInt32, but for a value that is not null-terminated. Quantities
+// are short, so they are terminated in a buffer on the stack.
+bool ParseInt32Value(StringPiece value, int32* result) {
+  char buffer[16];
+  if (value.size() >= sizeof(buffer)) {
+    return ParseInt32(value.ToString().c_str(), result);
+  }
+  memcpy(buffer, value.data(), value.size());
+  buffer[value.size()] = '\0';
+  return ParseInt32(buffer, result);
+}
+
+}  // namespace
+
 bool DurationAnnotator::ClassifyText(
     const UnicodeText& context, CodepointSpan selection_indices,
     AnnotationUsecase annotation_usecase,
@@ -93,8 +109,8 @@ bool DurationAnnotator::ClassifyText(
   const std::vector<Token> tokens = feature_processor_->Tokenize(selection);
 
   AnnotatedSpan annotated_span;
-  if (FindDurationStartingAt(context, tokens, 0, &annotated_span) !=
-      tokens.size()) {
+  if (FindDurationStartingAt(context, tokens, NormalizeTokens(tokens), 0,
+                             &annotated_span) != tokens.size()) {
     return false;
   }
 
@@ -113,9 +129,12 @@ bool DurationAnnotator::FindAll(const UnicodeText& context,
     return true;
   }
 
+  const std::vector<NormalizedToken> normalized_tokens =
+      NormalizeTokens(tokens);
   for (int i = 0; i < tokens.size();) {
     AnnotatedSpan span;
-    const int next_i = FindDurationStartingAt(context, tokens, i, &span);
+    const int next_i =
+        FindDurationStartingAt(context, tokens, normalized_tokens, i, &span);
     if (next_i != i) {
       results->push_back(span);
       i = next_i;
@@ -126,10 +145,22 @@ bool DurationAnnotator::FindAll(const UnicodeText& context,
   return true;
 }
 
-int DurationAnnotator::FindDurationStartingAt(const UnicodeText& context,
-                                              const std::vector<Token>& tokens,
-                                              int start_token_index,
-                                              AnnotatedSpan* result) const {
+std::vector<DurationAnnotator::NormalizedToken>
+DurationAnnotator::NormalizeTokens(const std::vector<Token>& tokens) const {
+  std::vector<NormalizedToken> normalized_tokens(tokens.size());
+  for (int i = 0; i < tokens.size(); ++i) {
+    normalized_tokens[i].value = feature_processor_->StripBoundaryCodepoints(
+        StringPiece(tokens[i].value));
+    normalized_tokens[i].hash =
+        StringPieceMap<DurationUnit>::Hash(normalized_tokens[i].value);
+  }
+  return normalized_tokens;
+}
+
+int DurationAnnotator::FindDurationStartingAt(
+    const UnicodeText& context, const std::vector<Token>& tokens,
+    const std::vector<NormalizedToken>& normalized_tokens,
+    int start_token_index, AnnotatedSpan* result) const {
   CodepointIndex start_index = kInvalidIndex;
   CodepointIndex end_index = kInvalidIndex;
 
@@ -145,14 +176,16 @@ int DurationAnnotator::FindDurationStartingAt(const UnicodeText& context,
   for (token_index = start_token_index; token_index < tokens.size();
        token_index++) {
     const Token& token = tokens[token_index];
+    const NormalizedToken& normalized_token = normalized_tokens[token_index];
 
-    if (ParseQuantityToken(token, &parsed_duration)) {
+    if (ParseQuantityToken(normalized_token, &parsed_duration)) {
       has_quantity = true;
       if (start_index == kInvalidIndex) {
         start_index = token.start;
       }
       end_index = token.end;
-    } else if (ParseDurationUnitToken(token, &parsed_duration.unit)) {
+    } else if (ParseDurationUnitToken(normalized_token,
+                                      &parsed_duration.unit)) {
       if (start_index == kInvalidIndex) {
         start_index = token.start;
       }
@@ -160,7 +193,7 @@ int DurationAnnotator::FindDurationStartingAt(const UnicodeText& context,
       parsed_duration_atoms.push_back(parsed_duration);
       has_quantity = false;
       parsed_duration = ParsedDurationAtom();
-    } else if (ParseFillerToken(token)) {
+    } else if (ParseFillerToken(normalized_token)) {
     } else {
       break;
     }
@@ -236,23 +269,19 @@ int64 DurationAnnotator::ParsedDurationAtomsToMillis(
   return result;
 }
 
-bool DurationAnnotator::ParseQuantityToken(const Token& token,
+bool DurationAnnotator::ParseQuantityToken(const NormalizedToken& token,
                                            ParsedDurationAtom* value) const {
   if (token.value.empty()) {
     return false;
   }
 
-  std::string token_value_buffer;
-  const std::string& token_value = feature_processor_->StripBoundaryCodepoints(
-      token.value, &token_value_buffer);
-
-  if (half_expressions_.find(token_value) != half_expressions_.end()) {
+  if (half_expressions_.Contains(token.value, token.hash)) {
     value->plus_half = true;
     return true;
   }
 
   int32 parsed_value;
-  if (ParseInt32(token_value.c_str(), &parsed_value)) {
+  if (ParseInt32Value(token.value, &parsed_value)) {
     value->value = parsed_value;
     return true;
   }
@@ -261,30 +290,19 @@ bool DurationAnnotator::ParseQuantityToken(const Token& token,
 }
 
 bool DurationAnnotator::ParseDurationUnitToken(
-    const Token& token, DurationUnit* duration_unit) const {
-  std::string token_value_buffer;
-  const std::string& token_value = feature_processor_->StripBoundaryCodepoints(
-      token.value, &token_value_buffer);
-
-  const auto it = token_value_to_duration_unit_.find(token_value);
-  if (it == token_value_to_duration_unit_.end()) {
+    const NormalizedToken& token, DurationUnit* duration_unit) const {
+  const DurationUnit* unit =
+      token_value_to_duration_unit_.Find(token.value, token.hash);
+  if (unit == nullptr) {
     return false;
   }
 
-  *duration_unit = it->second;
+  *duration_unit = *unit;
   return true;
 }
 
-bool DurationAnnotator::ParseFillerToken(const Token& token) const {
-  std::string token_value_buffer;
-  const std::string& token_value = feature_processor_->StripBoundaryCodepoints(
-      token.value, &token_value_buffer);
-
-  if (filler_expressions_.find(token_value) == filler_expressions_.end()) {
-    return false;
-  }
-
-  return true;
+bool DurationAnnotator::ParseFillerToken(const NormalizedToken& token) const {
+  return filler_expressions_.Contains(token.value, token.hash);
 }
 
 }  // namespace libtextclassifier3
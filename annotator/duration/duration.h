@@ -18,13 +18,14 @@
 #define LIBTEXTCLASSIFIER_ANNOTATOR_DURATION_DURATION_H_
 
 #include <string>
-#include <unordered_map>
-#include <unordered_set>
 #include <vector>
 
 #include "annotator/feature-processor.h"
 #include "annotator/model_generated.h"
 #include "annotator/types.h"
+#include "utils/base/integral_types.h"
+#include "utils/strings/string-piece-map.h"
+#include "utils/strings/stringpiece.h"
 #include "utils/utf8/unicodetext.h"
 
 namespace libtextclassifier3 {
@@ -44,12 +45,14 @@ enum class DurationUnit {
   // savings time and assume the day is always 24 hours.
 };
 
-// Prepares the mapping between token values and duration unit types.
-std::unordered_map<std::string, internal::DurationUnit>
-BuildTokenToDurationUnitMapping(const DurationAnnotatorOptions* options);
+// Prepares the mapping between token values and duration unit types. The keys
+// point into the options.
+StringPieceMap<internal::DurationUnit> BuildTokenToDurationUnitMapping(
+    const DurationAnnotatorOptions* options);
 
-// Creates a set of strings from a flatbuffer string vector.
-std::unordered_set<std::string> BuildStringSet(
+// Creates a set of strings from a flatbuffer string vector. The keys point
+// into the vector.
+StringPieceSet BuildStringSet(
     const flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>*);
 
 }  // namespace internal
@@ -101,26 +104,38 @@ class DurationAnnotator {
     }
   };
 
-  // Starts consuming tokens and returns the index past the last consumed token.
-  int FindDurationStartingAt(const UnicodeText& context,
-                             const std::vector<Token>& tokens,
-                             int start_token_index,
-                             AnnotatedSpan* result) const;
+  // The value of a token stripped of the boundary codepoints, with its hash.
+  // Computed once per token and shared by the lookups in all the expression
+  // tables, as the tokens are scanned again from every candidate start.
+  struct NormalizedToken {
+    StringPiece value;
+    uint64 hash = 0;
+  };
 
-  bool ParseQuantityToken(const Token& token, ParsedDurationAtom* value) const;
-  bool ParseDurationUnitToken(const Token& token,
+  // Normalizes the tokens. The values point into the tokens.
+  std::vector<NormalizedToken> NormalizeTokens(
+      const std::vector<Token>& tokens) const;
+
+  // Starts consuming tokens and returns the index past the last consumed token.
+  int FindDurationStartingAt(
+      const UnicodeText& context, const std::vector<Token>& tokens,
+      const std::vector<NormalizedToken>& normalized_tokens,
+      int start_token_index, AnnotatedSpan* result) const;
+
+  bool ParseQuantityToken(const NormalizedToken& token,
+                          ParsedDurationAtom* value) const;
+  bool ParseDurationUnitToken(const NormalizedToken& token,
                               internal::DurationUnit* duration_unit) const;
-  bool ParseFillerToken(const Token& token) const;
+  bool ParseFillerToken(const NormalizedToken& token) const;
 
   int64 ParsedDurationAtomsToMillis(
       const std::vector<ParsedDurationAtom>& atoms) const;
 
   const DurationAnnotatorOptions* options_;
   const FeatureProcessor* feature_processor_;
-  const std::unordered_map<std::string, internal::DurationUnit>
-      token_value_to_duration_unit_;
-  const std::unordered_set<std::string> filler_expressions_;
-  const std::unordered_set<std::string> half_expressions_;
+  const StringPieceMap<internal::DurationUnit> token_value_to_duration_unit_;
+  const StringPieceSet filler_expressions_;
+  const StringPieceSet half_expressions_;
 };
 
 }  // namespace libtextclassifier3
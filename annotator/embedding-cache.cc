@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/embedding-cache.h"
+
+#include <algorithm>
+
+#include "utils/base/logging.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+uint64 HashSpan(CodepointSpan span) {
+  const uint64 key = (static_cast<uint64>(static_cast<uint32>(span.first))
+                      << 32) |
+                     static_cast<uint32>(span.second);
+  // Fibonacci hashing, taking the high bits spreads nearby spans well.
+  return (key * 0x9E3779B97F4A7C15ull) >> 32;
+}
+
+}  // namespace
+
+const float* TokenEmbeddingCache::Get(CodepointSpan span) const {
+  if (num_entries_ == 0) {
+    ++num_misses_;
+    return nullptr;
+  }
+  const Slot& slot = slots_[FindSlot(span)];
+  if (slot.embedding_offset < 0) {
+    ++num_misses_;
+    return nullptr;
+  }
+  ++num_hits_;
+  return embeddings_.data() + slot.embedding_offset;
+}
+
+bool TokenEmbeddingCache::Put(CodepointSpan span, const float* embedding,
+                              int embedding_size) {
+  if (embedding_size_ == 0) {
+    embedding_size_ = embedding_size;
+  } else if (embedding_size != embedding_size_) {
+    TC3_LOG(ERROR) << "Mismatching embedding size: " << embedding_size
+                   << " vs. " << embedding_size_;
+    return false;
+  }
+
+  // Keep the load factor at most 1/2.
+  if (2 * (num_entries_ + 1) > slots_.size()) {
+    Grow();
+  }
+
+  Slot& slot = slots_[FindSlot(span)];
+  if (slot.embedding_offset < 0) {
+    slot.span = span;
+    slot.embedding_offset = embeddings_.size();
+    embeddings_.insert(embeddings_.end(), embedding,
+                       embedding + embedding_size);
+    ++num_entries_;
+  } else {
+    std::copy(embedding, embedding + embedding_size,
+              embeddings_.begin() + slot.embedding_offset);
+  }
+  return true;
+}
+
+int64 TokenEmbeddingCache::MemoryUsageBytes() const {
+  return slots_.capacity() * sizeof(Slot) +
+         embeddings_.capacity() * sizeof(float);
+}
+
+int TokenEmbeddingCache::FindSlot(CodepointSpan span) const {
+  const int mask = slots_.size() - 1;
+  int index = HashSpan(span) & mask;
+  while (slots_[index].embedding_offset >= 0 && slots_[index].span != span) {
+    index = (index + 1) & mask;
+  }
+  return index;
+}
+
+void TokenEmbeddingCache::Grow() {
+  std::vector<Slot> old_slots;
+  old_slots.swap(slots_);
+  slots_.resize(old_slots.empty() ? kInitialNumSlots : 2 * old_slots.size());
+  for (const Slot& old_slot : old_slots) {
+    if (old_slot.embedding_offset >= 0) {
+      slots_[FindSlot(old_slot.span)] = old_slot;
+    }
+  }
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Cache of embedded token features for one context.
+
+#ifndef LIBTEXTCLASSIFIER_ANNOTATOR_EMBEDDING_CACHE_H_
+#define LIBTEXTCLASSIFIER_ANNOTATOR_EMBEDDING_CACHE_H_
+
+#include <vector>
+
+#include "annotator/types.h"
+#include "utils/base/integral_types.h"
+
+namespace libtextclassifier3 {
+
+// Maps codepoint spans of tokens to their embedded features.
+//
+// The embeddings are stored one after another in a single buffer and are
+// found through an open-addressing hash table with linear probing, so that
+// neither lookups nor insertions need per-entry allocations. All the
+// embeddings in one cache have the same size, set by the first insertion.
+//
+// The class is not thread-safe.
+class TokenEmbeddingCache {
+ public:
+  TokenEmbeddingCache() = default;
+
+  // Returns the cached embedding of the span, or nullptr if there is none.
+  // The pointer is valid until the next call to Put().
+  const float* Get(CodepointSpan span) const;
+
+  // Caches the embedding of the span, replacing a previous value. Returns
+  // false if the size doesn't match the size of the cached embeddings.
+  bool Put(CodepointSpan span, const float* embedding, int embedding_size);
+
+  // Number of cached embeddings.
+  int size() const { return num_entries_; }
+
+  // Size of the cached embeddings, 0 if the cache is empty.
+  int embedding_size() const { return embedding_size_; }
+
+  int64 num_hits() const { return num_hits_; }
+  int64 num_misses() const { return num_misses_; }
+
+  // Approximate number of bytes allocated by the cache.
+  int64 MemoryUsageBytes() const;
+
+ private:
+  struct Slot {
+    CodepointSpan span;
+
+    // Offset of the embedding in embeddings_, or -1 for an empty slot.
+    int embedding_offset = -1;
+  };
+
+  static constexpr int kInitialNumSlots = 64;
+
+  // Returns the index of the slot holding the span, or of the empty slot where
+  // it would be inserted. The table must not be full.
+  int FindSlot(CodepointSpan span) const;
+
+  void Grow();
+
+  std::vector<Slot> slots_;
+  std::vector<float> embeddings_;
+  int num_entries_ = 0;
+  int embedding_size_ = 0;
+
+  mutable int64 num_hits_ = 0;
+  mutable int64 num_misses_ = 0;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_ANNOTATOR_EMBEDDING_CACHE_H_
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/embedding-cache.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+using testing::ElementsAreArray;
+
+std::vector<float> Lookup(const TokenEmbeddingCache& cache,
+                          CodepointSpan span) {
+  const float* embedding = cache.Get(span);
+  if (embedding == nullptr) {
+    return {};
+  }
+  return std::vector<float>(embedding, embedding + cache.embedding_size());
+}
+
+TEST(TokenEmbeddingCacheTest, StoresAndFindsEmbeddings) {
+  TokenEmbeddingCache cache;
+  const std::vector<float> embedding1 = {1.0, 2.0};
+  const std::vector<float> embedding2 = {3.0, 4.0};
+  EXPECT_TRUE(cache.Put({0, 3}, embedding1.data(), embedding1.size()));
+  EXPECT_TRUE(cache.Put({kInvalidIndex, kInvalidIndex}, embedding2.data(),
+                        embedding2.size()));
+
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_EQ(cache.embedding_size(), 2);
+  EXPECT_THAT(Lookup(cache, {0, 3}), ElementsAreArray(embedding1));
+  EXPECT_THAT(Lookup(cache, {kInvalidIndex, kInvalidIndex}),
+              ElementsAreArray(embedding2));
+  EXPECT_EQ(cache.Get({0, 4}), nullptr);
+  EXPECT_EQ(cache.num_hits(), 2);
+  EXPECT_EQ(cache.num_misses(), 1);
+}
+
+TEST(TokenEmbeddingCacheTest, ReplacesExistingEmbedding) {
+  TokenEmbeddingCache cache;
+  const std::vector<float> embedding1 = {1.0, 2.0};
+  const std::vector<float> embedding2 = {3.0, 4.0};
+  cache.Put({0, 3}, embedding1.data(), embedding1.size());
+  cache.Put({0, 3}, embedding2.data(), embedding2.size());
+  EXPECT_EQ(cache.size(), 1);
+  EXPECT_THAT(Lookup(cache, {0, 3}), ElementsAreArray(embedding2));
+}
+
+TEST(TokenEmbeddingCacheTest, RejectsMismatchingEmbeddingSize) {
+  TokenEmbeddingCache cache;
+  const std::vector<float> embedding = {1.0, 2.0, 3.0};
+  EXPECT_TRUE(cache.Put({0, 3}, embedding.data(), 2));
+  EXPECT_FALSE(cache.Put({4, 7}, embedding.data(), 3));
+  EXPECT_EQ(cache.size(), 1);
+}
+
+TEST(TokenEmbeddingCacheTest, GrowsBeyondInitialCapacity) {
+  TokenEmbeddingCache cache;
+  for (int i = 0; i < 1000; ++i) {
+    const float value = i;
+    EXPECT_TRUE(cache.Put({i, i + 1}, &value, 1));
+  }
+  EXPECT_EQ(cache.size(), 1000);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_THAT(Lookup(cache, {i, i + 1}), ElementsAreArray({float(i)}));
+  }
+  EXPECT_GT(cache.MemoryUsageBytes(), 1000 * sizeof(float));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
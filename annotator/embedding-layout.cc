@@ -0,0 +1,250 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/embedding-layout.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <numeric>
+
+#include "annotator/annotator.h"
+#include "annotator/feature-processor.h"
+#include "annotator/model-executor.h"
+#include "utils/base/logging.h"
+#include "utils/token-feature-extractor.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+namespace libtextclassifier3 {
+
+namespace {
+
+// The embedding matrix and the scales of its rows in the TFLite model of the
+// embeddings, as TFLiteEmbeddingExecutor reads them.
+struct EmbeddingTensors {
+  int num_rows = 0;
+  int bytes_per_row = 0;
+
+  // Offsets of the data of the tensors in the TFLite model.
+  int embeddings_offset = 0;
+  int scales_offset = 0;
+};
+
+const flatbuffers::Vector<uint8_t>* TensorData(const tflite::Model* model,
+                                               const tflite::Tensor* tensor) {
+  if (tensor->buffer() >= model->buffers()->size()) {
+    return nullptr;
+  }
+  return model->buffers()->Get(tensor->buffer())->data();
+}
+
+bool FindEmbeddingTensors(const uint8_t* tflite_model, int size,
+                          EmbeddingTensors* tensors) {
+  flatbuffers::Verifier verifier(tflite_model, size);
+  if (!tflite::VerifyModelBuffer(verifier)) {
+    return false;
+  }
+  const tflite::Model* model = tflite::GetModel(tflite_model);
+  if (model->buffers() == nullptr || model->subgraphs() == nullptr ||
+      model->subgraphs()->size() != 1 ||
+      model->subgraphs()->Get(0)->tensors() == nullptr ||
+      model->subgraphs()->Get(0)->tensors()->size() != 2) {
+    return false;
+  }
+  const tflite::Tensor* embeddings =
+      model->subgraphs()->Get(0)->tensors()->Get(0);
+  const tflite::Tensor* scales = model->subgraphs()->Get(0)->tensors()->Get(1);
+  if (embeddings->shape() == nullptr || embeddings->shape()->size() != 2 ||
+      scales->shape() == nullptr || scales->shape()->size() != 2 ||
+      scales->type() != tflite::TensorType_FLOAT32) {
+    return false;
+  }
+  tensors->num_rows = embeddings->shape()->Get(0);
+  tensors->bytes_per_row = embeddings->shape()->Get(1);
+  if (scales->shape()->Get(0) != tensors->num_rows ||
+      scales->shape()->Get(1) != 1) {
+    return false;
+  }
+
+  const flatbuffers::Vector<uint8_t>* embeddings_data =
+      TensorData(model, embeddings);
+  const flatbuffers::Vector<uint8_t>* scales_data = TensorData(model, scales);
+  if (embeddings_data == nullptr ||
+      embeddings_data->size() != tensors->num_rows * tensors->bytes_per_row ||
+      scales_data == nullptr ||
+      scales_data->size() != tensors->num_rows * sizeof(float)) {
+    return false;
+  }
+  tensors->embeddings_offset = embeddings_data->data() - tflite_model;
+  tensors->scales_offset = scales_data->data() - tflite_model;
+  return true;
+}
+
+}  // namespace
+
+bool CountEmbeddingRowAccesses(const Model* model, const UniLib& unilib,
+                               const std::vector<std::string>& corpus,
+                               std::vector<int64>* row_counts) {
+  if (model == nullptr || model->embedding_model() == nullptr ||
+      model->classification_feature_options() == nullptr) {
+    TC3_LOG(ERROR) << "The model has no embeddings.";
+    return false;
+  }
+  EmbeddingTensors tensors;
+  if (!FindEmbeddingTensors(model->embedding_model()->data(),
+                            model->embedding_model()->size(), &tensors)) {
+    TC3_LOG(ERROR) << "Cannot find the embeddings in the model.";
+    return false;
+  }
+  // Only for the pruning of the buckets, as in the model.
+  const std::unique_ptr<TFLiteEmbeddingExecutor> embedding_executor =
+      TFLiteEmbeddingExecutor::FromBuffer(
+          model->embedding_model(),
+          model->classification_feature_options()->embedding_size(),
+          model->classification_feature_options()
+              ->embedding_quantization_bits(),
+          model->embedding_pruning_mask());
+  if (embedding_executor == nullptr) {
+    TC3_LOG(ERROR) << "Cannot load the embeddings of the model.";
+    return false;
+  }
+  const Model_::EmbeddingPruningMask* mask = model->embedding_pruning_mask();
+  const bool is_pruned = mask != nullptr && mask->enabled() &&
+                         mask->pruning_mask() != nullptr &&
+                         mask->pruning_mask()->size() > 0;
+  const int num_buckets =
+      is_pruned ? mask->full_num_buckets() : tensors.num_rows;
+
+  row_counts->assign(tensors.num_rows, 0);
+  std::vector<int> sparse_features;
+  std::vector<float> dense_features;
+  for (const FeatureProcessorOptions* options :
+       {model->selection_feature_options(),
+        model->classification_feature_options()}) {
+    if (options == nullptr) {
+      continue;
+    }
+    const FeatureProcessor feature_processor(options, &unilib);
+    const TokenFeatureExtractor feature_extractor(
+        internal::BuildTokenFeatureExtractorOptions(options), unilib);
+    for (const std::string& text : corpus) {
+      for (const Token& token : feature_processor.Tokenize(text)) {
+        sparse_features.clear();
+        dense_features.clear();
+        if (!feature_extractor.Extract(token, /*is_in_span=*/false,
+                                       &sparse_features, &dense_features)) {
+          continue;
+        }
+        for (const int bucket_id : sparse_features) {
+          if (bucket_id < 0 || bucket_id >= num_buckets) {
+            continue;
+          }
+          const int row = is_pruned
+                              ? embedding_executor->PruneBucketId(bucket_id)
+                              : bucket_id;
+          ++(*row_counts)[row];
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool ReorderEmbeddingRows(const std::vector<int64>& row_counts,
+                          const int max_buckets_for_row_table,
+                          ModelT* model) {
+  EmbeddingTensors tensors;
+  if (!FindEmbeddingTensors(model->embedding_model.data(),
+                            model->embedding_model.size(), &tensors)) {
+    TC3_LOG(ERROR) << "Cannot find the embeddings in the model.";
+    return false;
+  }
+  const int num_rows = tensors.num_rows;
+  if (row_counts.size() != num_rows) {
+    TC3_LOG(ERROR) << "Mismatch in the number of embedding rows: "
+                   << row_counts.size() << " " << num_rows;
+    return false;
+  }
+  if (model->embedding_pruning_mask == nullptr) {
+    model->embedding_pruning_mask.reset(new Model_::EmbeddingPruningMaskT);
+  }
+  Model_::EmbeddingPruningMaskT* mask = model->embedding_pruning_mask.get();
+
+  // Where each row is stored before the reordering, for models that were
+  // already reordered.
+  std::vector<int32_t> old_remap = mask->row_remap;
+  if (old_remap.empty()) {
+    old_remap.resize(num_rows);
+    std::iota(old_remap.begin(), old_remap.end(), 0);
+  } else if (old_remap.size() != num_rows) {
+    TC3_LOG(ERROR) << "Mismatch in the size of the embedding row remap.";
+    return false;
+  }
+
+  // The rows by decreasing count, the rows with the same count in their
+  // order.
+  std::vector<int> rows(num_rows);
+  std::iota(rows.begin(), rows.end(), 0);
+  std::stable_sort(rows.begin(), rows.end(), [&row_counts](int a, int b) {
+    return row_counts[a] > row_counts[b];
+  });
+
+  const int bytes_per_row = tensors.bytes_per_row;
+  uint8_t* embeddings =
+      model->embedding_model.data() + tensors.embeddings_offset;
+  uint8_t* scales = model->embedding_model.data() + tensors.scales_offset;
+  const std::vector<uint8_t> old_embeddings(
+      embeddings, embeddings + num_rows * bytes_per_row);
+  const std::vector<uint8_t> old_scales(scales,
+                                        scales + num_rows * sizeof(float));
+  mask->row_remap.resize(num_rows);
+  for (int i = 0; i < num_rows; ++i) {
+    const int old_position = old_remap[rows[i]];
+    memcpy(embeddings + i * bytes_per_row,
+           old_embeddings.data() + old_position * bytes_per_row,
+           bytes_per_row);
+    memcpy(scales + i * sizeof(float),
+           old_scales.data() + old_position * sizeof(float), sizeof(float));
+    mask->row_remap[rows[i]] = i;
+  }
+  if (max_buckets_for_row_table > 0) {
+    mask->max_buckets_for_row_table = max_buckets_for_row_table;
+  }
+  return true;
+}
+
+std::string ReorderEmbeddingRowsInSerializedModel(
+    const std::string& model, const UniLib& unilib,
+    const std::vector<std::string>& corpus,
+    const int max_buckets_for_row_table) {
+  std::vector<int64> row_counts;
+  if (!CountEmbeddingRowAccesses(ViewModel(model.data(), model.size()), unilib,
+                                 corpus, &row_counts)) {
+    return "";
+  }
+  std::unique_ptr<ModelT> unpacked_model = UnPackModel(model.c_str());
+  if (unpacked_model == nullptr ||
+      !ReorderEmbeddingRows(row_counts, max_buckets_for_row_table,
+                            unpacked_model.get())) {
+    return "";
+  }
+  flatbuffers::FlatBufferBuilder builder;
+  FinishModelBuffer(builder, Model::Pack(builder, unpacked_model.get()));
+  return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                     builder.GetSize());
+}
+
+}  // namespace libtextclassifier3
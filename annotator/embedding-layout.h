@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Functions to lay out the embedding matrix of the model for the cache: the
+// rows are stored in bucket order, so the rows of the frequent charactergrams
+// are scattered over the whole matrix. Reordering them by how often a sample
+// corpus reads them puts the hot rows next to each other.
+
+#ifndef LIBTEXTCLASSIFIER_ANNOTATOR_EMBEDDING_LAYOUT_H_
+#define LIBTEXTCLASSIFIER_ANNOTATOR_EMBEDDING_LAYOUT_H_
+
+#include <string>
+#include <vector>
+
+#include "annotator/model_generated.h"
+#include "utils/base/integral_types.h"
+#include "utils/utf8/unilib.h"
+
+namespace libtextclassifier3 {
+
+// Counts how often the feature extraction of the selection and classification
+// models reads each row of the embedding matrix on the texts of the corpus.
+// The rows are the ones the buckets map to through the pruning mask, before
+// the row remap of the model, if any.
+bool CountEmbeddingRowAccesses(const Model* model, const UniLib& unilib,
+                               const std::vector<std::string>& corpus,
+                               std::vector<int64>* row_counts);
+
+// Reorders the rows of the embedding matrix of the model in place by
+// decreasing count, and sets the row remap of the model so that the loader
+// finds them, see EmbeddingPruningMask.row_remap. 'row_counts' are the counts
+// of CountEmbeddingRowAccesses() for the model. If
+// 'max_buckets_for_row_table' is positive, it is set in the model, so that the
+// loader folds the pruning mask and the remap in a table of the row of every
+// bucket when the model has at most that many buckets.
+bool ReorderEmbeddingRows(const std::vector<int64>& row_counts,
+                          int max_buckets_for_row_table, ModelT* model);
+
+// Reorders the rows of the embedding matrix of the model by how often the
+// texts of the corpus read them. Returns an empty string if an error occurs.
+std::string ReorderEmbeddingRowsInSerializedModel(
+    const std::string& model, const UniLib& unilib,
+    const std::vector<std::string>& corpus,
+    int max_buckets_for_row_table = 0);
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_ANNOTATOR_EMBEDDING_LAYOUT_H_
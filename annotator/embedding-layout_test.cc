@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/embedding-layout.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "annotator/annotator.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+std::string GetModelPath() { return TC3_TEST_DATA_DIR; }
+
+std::string ReadFile(const std::string& file_name) {
+  std::ifstream file_stream(file_name);
+  return std::string(std::istreambuf_iterator<char>(file_stream), {});
+}
+
+const std::vector<std::string>& Corpus() {
+  static const std::vector<std::string>* const corpus =
+      new std::vector<std::string>{"call me at (800) 123-456 today",
+                                   "see you tomorrow at 5 at the station",
+                                   "write to me at hello@example.com"};
+  return *corpus;
+}
+
+// Expects the same classifications and selections from both models.
+void ExpectSameResults(const std::string& model, const std::string& other) {
+  UniLib unilib;
+  std::unique_ptr<Annotator> annotator =
+      Annotator::FromUnownedBuffer(model.data(), model.size(), &unilib);
+  std::unique_ptr<Annotator> other_annotator =
+      Annotator::FromUnownedBuffer(other.data(), other.size(), &unilib);
+  ASSERT_NE(annotator, nullptr);
+  ASSERT_NE(other_annotator, nullptr);
+  for (const std::string& text : Corpus()) {
+    for (int i = 0; i + 1 < text.size(); i += 5) {
+      EXPECT_EQ(annotator->SuggestSelection(text, {i, i + 1}),
+                other_annotator->SuggestSelection(text, {i, i + 1}));
+      const std::vector<ClassificationResult> results =
+          annotator->ClassifyText(text, {i, i + 2});
+      const std::vector<ClassificationResult> other_results =
+          other_annotator->ClassifyText(text, {i, i + 2});
+      ASSERT_EQ(results.size(), other_results.size());
+      for (int j = 0; j < results.size(); ++j) {
+        EXPECT_EQ(results[j].collection, other_results[j].collection);
+        EXPECT_FLOAT_EQ(results[j].score, other_results[j].score);
+      }
+    }
+  }
+}
+
+TEST(EmbeddingLayoutTest, ReorderedModelGivesSameResults) {
+  const std::string model = ReadFile(GetModelPath() + "test_model.fb");
+  UniLib unilib;
+  const std::string reordered =
+      ReorderEmbeddingRowsInSerializedModel(model, unilib, Corpus());
+  ASSERT_FALSE(reordered.empty());
+  ExpectSameResults(model, reordered);
+
+  // Also through the table of the row of every bucket.
+  const std::string with_row_table = ReorderEmbeddingRowsInSerializedModel(
+      model, unilib, Corpus(), /*max_buckets_for_row_table=*/1 << 20);
+  ASSERT_FALSE(with_row_table.empty());
+  ExpectSameResults(model, with_row_table);
+}
+
+TEST(EmbeddingLayoutTest, StoresHottestRowFirst) {
+  const std::string model = ReadFile(GetModelPath() + "test_model.fb");
+  UniLib unilib;
+  std::vector<int64> row_counts;
+  ASSERT_TRUE(CountEmbeddingRowAccesses(ViewModel(model.data(), model.size()),
+                                        unilib, Corpus(), &row_counts));
+  ASSERT_FALSE(row_counts.empty());
+  const int hottest_row =
+      std::max_element(row_counts.begin(), row_counts.end()) -
+      row_counts.begin();
+  EXPECT_GT(row_counts[hottest_row], 0);
+
+  const std::string reordered =
+      ReorderEmbeddingRowsInSerializedModel(model, unilib, Corpus());
+  const Model* reordered_model = ViewModel(reordered.data(), reordered.size());
+  ASSERT_NE(reordered_model, nullptr);
+  ASSERT_NE(reordered_model->embedding_pruning_mask(), nullptr);
+  ASSERT_NE(reordered_model->embedding_pruning_mask()->row_remap(), nullptr);
+  EXPECT_EQ(
+      reordered_model->embedding_pruning_mask()->row_remap()->Get(hottest_row),
+      0);
+
+  // Reordering again is stable: the rows are counted before the remap.
+  const std::string reordered_again =
+      ReorderEmbeddingRowsInSerializedModel(reordered, unilib, Corpus());
+  ASSERT_FALSE(reordered_again.empty());
+  ExpectSameResults(model, reordered_again);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
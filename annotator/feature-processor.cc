@@ -17,7 +17,6 @@
 #include "annotator/feature-processor.h"
 
 #include <iterator>
-#include <set>
 #include <vector>
 
 #include "utils/base/logging.h"
@@ -51,6 +50,60 @@ Tokenizer BuildTokenizer(const FeatureProcessorOptions* options,
                    options->icu_preserve_whitespace_tokens());
 }
 
+bool HaveSameTokenizer(const FeatureProcessorOptions* options1,
+                       const FeatureProcessorOptions* options2) {
+  if (options1->tokenization_type() != options2->tokenization_type() ||
+      options1->icu_preserve_whitespace_tokens() !=
+          options2->icu_preserve_whitespace_tokens()) {
+    return false;
+  }
+
+  const auto* codepoint_config1 = options1->tokenization_codepoint_config();
+  const auto* codepoint_config2 = options2->tokenization_codepoint_config();
+  const int codepoint_config_size1 =
+      codepoint_config1 != nullptr ? codepoint_config1->size() : 0;
+  const int codepoint_config_size2 =
+      codepoint_config2 != nullptr ? codepoint_config2->size() : 0;
+  if (codepoint_config_size1 != codepoint_config_size2) {
+    return false;
+  }
+  for (int i = 0; i < codepoint_config_size1; ++i) {
+    const TokenizationCodepointRange* range1 = codepoint_config1->Get(i);
+    const TokenizationCodepointRange* range2 = codepoint_config2->Get(i);
+    if (range1->start() != range2->start() || range1->end() != range2->end() ||
+        range1->role() != range2->role() ||
+        range1->script_id() != range2->script_id()) {
+      return false;
+    }
+  }
+  // Same as in BuildTokenizer().
+  if (codepoint_config1 != nullptr &&
+      options1->tokenize_on_script_change() !=
+          options2->tokenize_on_script_change()) {
+    return false;
+  }
+
+  const auto* internal_ranges1 =
+      options1->internal_tokenizer_codepoint_ranges();
+  const auto* internal_ranges2 =
+      options2->internal_tokenizer_codepoint_ranges();
+  const int internal_ranges_size1 =
+      internal_ranges1 != nullptr ? internal_ranges1->size() : 0;
+  const int internal_ranges_size2 =
+      internal_ranges2 != nullptr ? internal_ranges2->size() : 0;
+  if (internal_ranges_size1 != internal_ranges_size2) {
+    return false;
+  }
+  for (int i = 0; i < internal_ranges_size1; ++i) {
+    if (internal_ranges1->Get(i)->start() !=
+            internal_ranges2->Get(i)->start() ||
+        internal_ranges1->Get(i)->end() != internal_ranges2->Get(i)->end()) {
+      return false;
+    }
+  }
+  return true;
+}
+
 TokenFeatureExtractorOptions BuildTokenFeatureExtractorOptions(
     const FeatureProcessorOptions* const options) {
   TokenFeatureExtractorOptions extractor_options;
@@ -73,6 +126,8 @@ TokenFeatureExtractorOptions BuildTokenFeatureExtractorOptions(
   }
   extractor_options.remap_digits = options->remap_digits();
   extractor_options.lowercase_tokens = options->lowercase_tokens();
+  extractor_options.incremental_chargram_hashing =
+      options->incremental_chargram_hashing();
 
   if (options->allowed_chargrams() != nullptr) {
     for (const auto& chargram : *options->allowed_chargrams()) {
@@ -123,7 +178,7 @@ void SplitTokensOnSelectionBoundaries(CodepointSpan selection,
         last_start = split_point;
         current_pos = new_token.end;
 
-        replacement_tokens.push_back(new_token);
+        replacement_tokens.push_back(std::move(new_token));
       }
 
       it = tokens->erase(it);
@@ -197,6 +252,12 @@ std::vector<Token> FeatureProcessor::Tokenize(
   return tokenizer_.Tokenize(text_unicode);
 }
 
+void FeatureProcessor::Tokenize(const UnicodeText& text_unicode,
+                                const int codepoint_offset,
+                                std::vector<Token>* tokens) const {
+  tokenizer_.Tokenize(text_unicode, codepoint_offset, tokens);
+}
+
 bool FeatureProcessor::LabelToSpan(
     const int label, const VectorSpan<Token>& tokens,
     std::pair<CodepointIndex, CodepointIndex>* span) const {
@@ -474,11 +535,13 @@ bool FeatureProcessor::SelectionLabelSpans(
 }
 
 void FeatureProcessor::PrepareIgnoredSpanBoundaryCodepoints() {
+  std::vector<CodepointRangeStruct> ranges;
   if (options_->ignored_span_boundary_codepoints() != nullptr) {
     for (const int codepoint : *options_->ignored_span_boundary_codepoints()) {
-      ignored_span_boundary_codepoints_.insert(codepoint);
+      ranges.emplace_back(codepoint, codepoint + 1);
     }
   }
+  ignored_span_boundary_codepoints_ = CodepointSet(std::move(ranges));
 }
 
 int FeatureProcessor::CountIgnoredSpanBoundaryCodepoints(
@@ -507,8 +570,7 @@ int FeatureProcessor::CountIgnoredSpanBoundaryCodepoints(
 
   // Move until we encounter a non-ignored character.
   int num_ignored = 0;
-  while (ignored_span_boundary_codepoints_.find(*it) !=
-         ignored_span_boundary_codepoints_.end()) {
+  while (ignored_span_boundary_codepoints_.Contains(*it)) {
     ++num_ignored;
 
     if (it == it_last) {
@@ -527,13 +589,16 @@ int FeatureProcessor::CountIgnoredSpanBoundaryCodepoints(
 
 namespace {
 
-void FindSubstrings(const UnicodeText& t, const std::set<char32>& codepoints,
-                    std::vector<UnicodeTextRange>* ranges) {
+bool IsLineSeparator(char32 codepoint) {
+  return codepoint == '\n' || codepoint == '|';
+}
+
+void FindLines(const UnicodeText& t, std::vector<UnicodeTextRange>* ranges) {
   UnicodeText::const_iterator start = t.begin();
   UnicodeText::const_iterator curr = start;
   UnicodeText::const_iterator end = t.end();
   for (; curr != end; ++curr) {
-    if (codepoints.find(*curr) != codepoints.end()) {
+    if (IsLineSeparator(*curr)) {
       if (start != curr) {
         ranges->push_back(std::make_pair(start, curr));
       }
@@ -551,8 +616,35 @@ void FindSubstrings(const UnicodeText& t, const std::set<char32>& codepoints,
 std::vector<UnicodeTextRange> FeatureProcessor::SplitContext(
     const UnicodeText& context_unicode) const {
   std::vector<UnicodeTextRange> lines;
-  const std::set<char32> codepoints{{'\n', '|'}};
-  FindSubstrings(context_unicode, codepoints, &lines);
+  FindLines(context_unicode, &lines);
+  return lines;
+}
+
+std::vector<ContextLine> FeatureProcessor::SplitContextIntoLines(
+    const UnicodeText& context_unicode) const {
+  std::vector<ContextLine> lines;
+  UnicodeText::const_iterator line_start = context_unicode.begin();
+  int line_start_offset = 0;
+  int offset = 0;
+  for (UnicodeText::const_iterator it = context_unicode.begin();
+       it != context_unicode.end(); ++it, ++offset) {
+    if (IsLineSeparator(*it)) {
+      if (line_start_offset != offset) {
+        lines.push_back({StringPiece(line_start.utf8_data(),
+                                     it.utf8_data() - line_start.utf8_data()),
+                         line_start_offset, offset - line_start_offset});
+      }
+      line_start = it;
+      ++line_start;
+      line_start_offset = offset + 1;
+    }
+  }
+  if (line_start_offset != offset) {
+    lines.push_back({StringPiece(line_start.utf8_data(),
+                                 context_unicode.end().utf8_data() -
+                                     line_start.utf8_data()),
+                     line_start_offset, offset - line_start_offset});
+  }
   return lines;
 }
 
@@ -577,6 +669,16 @@ CodepointSpan FeatureProcessor::StripBoundaryCodepoints(
   return StripBoundaryCodepoints(span_begin, span_end, span);
 }
 
+CodepointSpan FeatureProcessor::StripBoundaryCodepoints(
+    const CodepointOffsetIndex& context_index, CodepointSpan span) const {
+  if (!ValidNonEmptySpan(span) ||
+      span.second > context_index.num_codepoints()) {
+    return span;
+  }
+  return StripBoundaryCodepoints(context_index.IteratorAt(span.first),
+                                 context_index.IteratorAt(span.second), span);
+}
+
 CodepointSpan FeatureProcessor::StripBoundaryCodepoints(
     const UnicodeText::const_iterator& span_begin,
     const UnicodeText::const_iterator& span_end, CodepointSpan span) const {
@@ -604,7 +706,7 @@ float FeatureProcessor::SupportedCodepointsRatio(
     const UnicodeText value =
         UTF8ToUnicodeText(tokens[i].value, /*do_copy=*/false);
     for (auto codepoint : value) {
-      if (IsCodepointInRanges(codepoint, supported_codepoint_ranges_)) {
+      if (supported_codepoints_.Contains(codepoint)) {
         ++num_supported;
       }
       ++num_total;
@@ -630,6 +732,34 @@ const std::string& FeatureProcessor::StripBoundaryCodepoints(
   return value;
 }
 
+StringPiece FeatureProcessor::StripBoundaryCodepoints(
+    StringPiece value) const {
+  const UnicodeText value_unicode =
+      UTF8ToUnicodeText(value.data(), value.size(), /*do_copy=*/false);
+  if (value_unicode.empty()) {
+    return value;
+  }
+
+  const int num_codepoints = value_unicode.size_codepoints();
+  const int start_offset = CountIgnoredSpanBoundaryCodepoints(
+      value_unicode.begin(), value_unicode.end(),
+      /*count_from_beginning=*/true);
+  const int end_offset = CountIgnoredSpanBoundaryCodepoints(
+      value_unicode.begin(), value_unicode.end(),
+      /*count_from_beginning=*/false);
+  if (start_offset >= num_codepoints - end_offset) {
+    return StringPiece(value.data(), 0);
+  }
+
+  UnicodeText::const_iterator begin = value_unicode.begin();
+  std::advance(begin, start_offset);
+  UnicodeText::const_iterator end = value_unicode.end();
+  for (int i = 0; i < end_offset; ++i) {
+    --end;
+  }
+  return StringPiece(begin.utf8_data(), end.utf8_data() - begin.utf8_data());
+}
+
 int FeatureProcessor::CollectionToLabel(const std::string& collection) const {
   const auto it = collection_to_label_.find(collection);
   if (it == collection_to_label_.end()) {
@@ -639,18 +769,28 @@ int FeatureProcessor::CollectionToLabel(const std::string& collection) const {
   }
 }
 
-std::string FeatureProcessor::LabelToCollection(int label) const {
+const std::string& FeatureProcessor::LabelToCollection(int label) const {
   if (label >= 0 && label < collection_to_label_.size()) {
-    return (*options_->collections())[label]->str();
+    return label_to_collection_[label];
   } else {
-    return GetDefaultCollection();
+    if (default_collection_.empty()) {
+      TC3_LOG(ERROR)
+          << "Invalid or missing default collection. Returning empty string.";
+    }
+    return default_collection_;
   }
 }
 
 void FeatureProcessor::MakeLabelMaps() {
   if (options_->collections() != nullptr) {
     for (int i = 0; i < options_->collections()->size(); ++i) {
-      collection_to_label_[(*options_->collections())[i]->str()] = i;
+      label_to_collection_.push_back((*options_->collections())[i]->str());
+      collection_to_label_[label_to_collection_.back()] = i;
+    }
+    if (options_->default_collection() >= 0 &&
+        options_->default_collection() < label_to_collection_.size()) {
+      default_collection_ =
+          label_to_collection_[options_->default_collection()];
     }
   }
 
@@ -765,10 +905,13 @@ bool FeatureProcessor::ExtractFeatures(
     std::unique_ptr<CachedFeatures>* cached_features) const {
   std::unique_ptr<std::vector<float>> features(new std::vector<float>());
   features->reserve(feature_vector_size * TokenSpanSize(token_span));
+
+  // Reused for the sparse features of all the tokens.
+  std::vector<int> sparse_features;
   for (int i = token_span.first; i < token_span.second; ++i) {
     if (!AppendTokenFeaturesWithCache(tokens[i], selection_span_for_feature,
                                       embedding_executor, embedding_cache,
-                                      features.get())) {
+                                      &sparse_features, features.get())) {
       TC3_LOG(ERROR) << "Could not get token features.";
       return false;
     }
@@ -779,7 +922,7 @@ bool FeatureProcessor::ExtractFeatures(
   padding_features->reserve(feature_vector_size);
   if (!AppendTokenFeaturesWithCache(Token(), selection_span_for_feature,
                                     embedding_executor, embedding_cache,
-                                    padding_features.get())) {
+                                    &sparse_features, padding_features.get())) {
     TC3_LOG(ERROR) << "Count not get padding token features.";
     return false;
   }
@@ -798,65 +941,63 @@ bool FeatureProcessor::ExtractFeatures(
 bool FeatureProcessor::AppendTokenFeaturesWithCache(
     const Token& token, CodepointSpan selection_span_for_feature,
     const EmbeddingExecutor* embedding_executor,
-    EmbeddingCache* embedding_cache,
+    EmbeddingCache* embedding_cache, std::vector<int>* sparse_features,
     std::vector<float>* output_features) const {
+  const bool is_in_span = token.IsContainedInSpan(selection_span_for_feature);
+
   // Look for the embedded features for the token in the cache, if there is one.
   if (embedding_cache) {
-    const auto it = embedding_cache->find({token.start, token.end});
-    if (it != embedding_cache->end()) {
+    const float* cached_embedding =
+        embedding_cache->Get({token.start, token.end});
+    if (cached_embedding != nullptr) {
       // The embedded features were found in the cache, extract only the dense
-      // features.
-      std::vector<float> dense_features;
-      if (!feature_extractor_.Extract(
-              token, token.IsContainedInSpan(selection_span_for_feature),
-              /*sparse_features=*/nullptr, &dense_features)) {
-        TC3_LOG(ERROR) << "Could not extract token's dense features.";
-        return false;
-      }
-
-      // Append both embedded and dense features to the output and return.
-      output_features->insert(output_features->end(), it->second.begin(),
-                              it->second.end());
-      output_features->insert(output_features->end(), dense_features.begin(),
-                              dense_features.end());
+      // features, appending both to the output.
+      output_features->insert(
+          output_features->end(), cached_embedding,
+          cached_embedding + embedding_cache->embedding_size());
+      feature_extractor_.AppendDenseFeatures(token, is_in_span,
+                                             output_features);
       return true;
     }
   }
 
-  // Extract the sparse and dense features.
-  std::vector<int> sparse_features;
-  std::vector<float> dense_features;
-  if (!feature_extractor_.Extract(
-          token, token.IsContainedInSpan(selection_span_for_feature),
-          &sparse_features, &dense_features)) {
-    TC3_LOG(ERROR) << "Could not extract token's features.";
-    return false;
-  }
-
-  // Embed the sparse features, appending them directly to the output.
   const int embedding_size = GetOptions()->embedding_size();
-  output_features->resize(output_features->size() + embedding_size);
-  float* output_features_end =
-      output_features->data() + output_features->size();
-  if (!embedding_executor->AddEmbedding(
-          TensorView<int>(sparse_features.data(),
-                          {static_cast<int>(sparse_features.size())}),
-          /*dest=*/output_features_end - embedding_size,
-          /*dest_size=*/embedding_size)) {
-    TC3_LOG(ERROR) << "Cound not embed token's sparse features.";
-    return false;
+  const int embedding_offset = output_features->size();
+  output_features->resize(embedding_offset + embedding_size);
+  float* embedding = output_features->data() + embedding_offset;
+
+  // The embedding of a token only depends on its value, so it can be found in
+  // the shared cache even if this context wasn't seen before.
+  const std::string shared_cache_key =
+      token.is_padding ? std::string() : token.value;
+  if (shared_embedding_cache_ == nullptr ||
+      !shared_embedding_cache_->Lookup(shared_cache_key, embedding,
+                                       embedding_size)) {
+    // Extract the sparse features and embed them directly into the output.
+    feature_extractor_.ExtractCharactergramFeatures(token, sparse_features);
+    if (!embedding_executor->AddEmbedding(
+            TensorView<int>(sparse_features->data(),
+                            {static_cast<int>(sparse_features->size())}),
+            /*dest=*/embedding, /*dest_size=*/embedding_size)) {
+      TC3_LOG(ERROR) << "Cound not embed token's sparse features.";
+      return false;
+    }
+
+    if (shared_embedding_cache_ != nullptr) {
+      shared_embedding_cache_->Insert(shared_cache_key, embedding,
+                                      embedding_size);
+    }
   }
 
   // If there is a cache, the embedded features for the token were not in it,
   // so insert them.
   if (embedding_cache) {
-    (*embedding_cache)[{token.start, token.end}] = std::vector<float>(
-        output_features_end - embedding_size, output_features_end);
+    embedding_cache->Put({token.start, token.end}, embedding, embedding_size);
   }
 
-  // Append the dense features to the output.
-  output_features->insert(output_features->end(), dense_features.begin(),
-                          dense_features.end());
+  // Append the dense features to the output. This can reallocate the output,
+  // so the embedding pointer is not used afterwards.
+  feature_extractor_.AppendDenseFeatures(token, is_in_span, output_features);
   return true;
 }
 
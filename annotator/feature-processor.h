@@ -21,17 +21,21 @@
 
 #include <map>
 #include <memory>
-#include <set>
 #include <string>
 #include <vector>
 
 #include "annotator/cached-features.h"
+#include "annotator/embedding-cache.h"
 #include "annotator/model_generated.h"
+#include "annotator/shared-embedding-cache.h"
 #include "annotator/types.h"
 #include "utils/base/integral_types.h"
 #include "utils/base/logging.h"
+#include "utils/codepoint-range.h"
+#include "utils/strings/stringpiece.h"
 #include "utils/token-feature-extractor.h"
 #include "utils/tokenizer.h"
+#include "utils/utf8/codepoint-offsets.h"
 #include "utils/utf8/unicodetext.h"
 #include "utils/utf8/unilib.h"
 
@@ -44,6 +48,11 @@ namespace internal {
 Tokenizer BuildTokenizer(const FeatureProcessorOptions* options,
                          const UniLib* unilib);
 
+// Returns whether the tokenizers built from the two options split any text into
+// the same tokens.
+bool HaveSameTokenizer(const FeatureProcessorOptions* options1,
+                       const FeatureProcessorOptions* options2);
+
 TokenFeatureExtractorOptions BuildTokenFeatureExtractorOptions(
     const FeatureProcessorOptions* options);
 
@@ -69,6 +78,16 @@ void StripOrPadTokens(TokenSpan relative_click_span, int context_size,
 
 }  // namespace internal
 
+// A line of a context, see FeatureProcessor::SplitContextIntoLines().
+struct ContextLine {
+  // The UTF8 bytes of the line, pointing into the buffer of the context.
+  StringPiece utf8;
+
+  // Codepoint offset of the line in the context and its size in codepoints.
+  int offset;
+  int size_codepoints;
+};
+
 // Converts a codepoint span to a token span in the given list of tokens.
 // If snap_boundaries_to_containing_tokens is set to true, it is enough for a
 // token to overlap with the codepoint range to be considered part of it.
@@ -89,19 +108,24 @@ class FeatureProcessor {
   // same context (the same codepoint spans corresponding to the same tokens),
   // as an optimization. Note that the tokenizations do not have to be
   // identical.
-  typedef std::map<CodepointSpan, std::vector<float>> EmbeddingCache;
+  typedef TokenEmbeddingCache EmbeddingCache;
 
-  FeatureProcessor(const FeatureProcessorOptions* options, const UniLib* unilib)
+  // If given, the shared_embedding_cache is used to look up token embeddings
+  // across calls. It is not owned and needs to outlive the feature processor.
+  FeatureProcessor(const FeatureProcessorOptions* options, const UniLib* unilib,
+                   SharedEmbeddingCache* shared_embedding_cache = nullptr)
       : feature_extractor_(internal::BuildTokenFeatureExtractorOptions(options),
                            *unilib),
         options_(options),
-        tokenizer_(internal::BuildTokenizer(options, unilib)) {
+        tokenizer_(internal::BuildTokenizer(options, unilib)),
+        shared_embedding_cache_(shared_embedding_cache) {
     MakeLabelMaps();
     if (options->supported_codepoint_ranges() != nullptr) {
       SortCodepointRanges({options->supported_codepoint_ranges()->begin(),
                            options->supported_codepoint_ranges()->end()},
                           &supported_codepoint_ranges_);
     }
+    supported_codepoints_ = CodepointSet(supported_codepoint_ranges_);
     PrepareIgnoredSpanBoundaryCodepoints();
   }
 
@@ -111,6 +135,17 @@ class FeatureProcessor {
   // Same as above but takes UnicodeText.
   std::vector<Token> Tokenize(const UnicodeText& text_unicode) const;
 
+  // Same as above, but appends the tokens to 'tokens', with their bounds
+  // shifted by 'codepoint_offset', see Tokenizer::Tokenize.
+  void Tokenize(const UnicodeText& text_unicode, int codepoint_offset,
+                std::vector<Token>* tokens) const;
+
+  // Returns whether the other feature processor tokenizes any text into the
+  // same tokens, so that its tokens can be reused by this one.
+  bool HasSameTokenizer(const FeatureProcessor& other) const {
+    return internal::HaveSameTokenizer(options_, other.options_);
+  }
+
   // Converts a label into a token span.
   bool LabelToTokenSpan(int label, TokenSpan* token_span) const;
 
@@ -118,7 +153,7 @@ class FeatureProcessor {
   int GetSelectionLabelCount() const { return label_to_selection_.size(); }
 
   // Gets the string value for given collection label.
-  std::string LabelToCollection(int label) const;
+  const std::string& LabelToCollection(int label) const;
 
   // Gets the total number of collections of the model.
   int NumCollections() const { return collection_to_label_.size(); }
@@ -171,6 +206,11 @@ class FeatureProcessor {
   std::vector<UnicodeTextRange> SplitContext(
       const UnicodeText& context_unicode) const;
 
+  // Same as above, but returns the lines as views into the buffer of the
+  // context, together with their codepoint offsets, in a single pass.
+  std::vector<ContextLine> SplitContextIntoLines(
+      const UnicodeText& context_unicode) const;
+
   // Strips boundary codepoints from the span in context and returns the new
   // start and end indices. If the span comprises entirely of boundary
   // codepoints, the first index of span is returned for both indices.
@@ -186,12 +226,21 @@ class FeatureProcessor {
       const UnicodeText::const_iterator& span_begin,
       const UnicodeText::const_iterator& span_end, CodepointSpan span) const;
 
+  // Same as above but finds the span with the index of the context, for
+  // callers going over many spans of a long text.
+  CodepointSpan StripBoundaryCodepoints(
+      const CodepointOffsetIndex& context_index, CodepointSpan span) const;
+
   // Same as above, but takes an optional buffer for saving the modified value.
   // As an optimization, returns pointer to 'value' if nothing was stripped, or
   // pointer to 'buffer' if something was stripped.
   const std::string& StripBoundaryCodepoints(const std::string& value,
                                              std::string* buffer) const;
 
+  // Same as above, but returns the stripped value as a view into 'value',
+  // without copying it.
+  StringPiece StripBoundaryCodepoints(StringPiece value) const;
+
  protected:
   // Returns the class id corresponding to the given string collection
   // identifier. There is a catch-all class id that the function returns for
@@ -254,11 +303,13 @@ class FeatureProcessor {
 
   // Extracts the features of a token and appends them to the output vector.
   // Uses the embedding cache to to avoid re-extracting the re-embedding the
-  // sparse features for the same token.
+  // sparse features for the same token. The sparse_features buffer is used for
+  // the intermediate sparse features, so that it can be reused across tokens.
   bool AppendTokenFeaturesWithCache(const Token& token,
                                     CodepointSpan selection_span_for_feature,
                                     const EmbeddingExecutor* embedding_executor,
                                     EmbeddingCache* embedding_cache,
+                                    std::vector<int>* sparse_features,
                                     std::vector<float>* output_features) const;
 
  protected:
@@ -269,9 +320,12 @@ class FeatureProcessor {
   std::vector<CodepointRangeStruct> supported_codepoint_ranges_;
 
  private:
+  // The supported codepoint ranges as a set, for the per-codepoint lookups.
+  CodepointSet supported_codepoints_;
+
   // Set of codepoints that will be stripped from beginning and end of
   // predicted spans.
-  std::set<int32> ignored_span_boundary_codepoints_;
+  CodepointSet ignored_span_boundary_codepoints_;
 
   const FeatureProcessorOptions* const options_;
 
@@ -282,7 +336,15 @@ class FeatureProcessor {
   // Mapping between collections and labels.
   std::map<std::string, int> collection_to_label_;
 
+  // The collections by label, and the default collection, or an empty string
+  // if the model doesn't have a valid one.
+  std::vector<std::string> label_to_collection_;
+  std::string default_collection_;
+
   Tokenizer tokenizer_;
+
+  // Not owned, can be nullptr.
+  SharedEmbeddingCache* const shared_embedding_cache_;
 };
 
 }  // namespace libtextclassifier3
@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmarks of the stages of the feature extraction of the annotator, with
+// the options of the selection model of the English annotator model.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "annotator/annotator.h"
+#include "annotator/cached-features.h"
+#include "annotator/feature-processor.h"
+#include "annotator/model-executor.h"
+#include "annotator/quantization.h"
+#include "utils/memory/mmap.h"
+#include "utils/testing/benchmark-utils.h"
+#include "utils/testing/worst-case-search.h"
+#include "utils/token-feature-extractor.h"
+#include "utils/tokenizer.h"
+#include "utils/utf8/unilib.h"
+#include "benchmark/benchmark.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+// The model and the parts of it the benchmarks use, loaded once.
+struct SelectionModel {
+  explicit SelectionModel(const std::string& path) : mmap(path) {}
+
+  ScopedMmap mmap;
+  const FeatureProcessorOptions* options = nullptr;
+  UniLib unilib;
+  std::unique_ptr<FeatureProcessor> feature_processor;
+  std::unique_ptr<TFLiteEmbeddingExecutor> embedding_executor;
+};
+
+// Returns the selection model, or nullptr if it isn't available.
+const SelectionModel* GetSelectionModel() {
+  static const SelectionModel* const selection_model = []() {
+    std::unique_ptr<SelectionModel> selection_model(
+        new SelectionModel(BenchmarkModelPath("textclassifier.en.model")));
+    if (!selection_model->mmap.handle().ok()) {
+      return static_cast<SelectionModel*>(nullptr);
+    }
+    const Model* model =
+        ViewModel(selection_model->mmap.handle().start(),
+                  selection_model->mmap.handle().num_bytes());
+    if (model == nullptr || model->selection_feature_options() == nullptr ||
+        model->embedding_model() == nullptr) {
+      return static_cast<SelectionModel*>(nullptr);
+    }
+    selection_model->options = model->selection_feature_options();
+    selection_model->feature_processor.reset(new FeatureProcessor(
+        selection_model->options, &selection_model->unilib));
+    selection_model->embedding_executor = TFLiteEmbeddingExecutor::FromBuffer(
+        model->embedding_model(), selection_model->options->embedding_size(),
+        selection_model->options->embedding_quantization_bits(),
+        model->embedding_pruning_mask());
+    if (selection_model->embedding_executor == nullptr) {
+      return static_cast<SelectionModel*>(nullptr);
+    }
+    return selection_model.release();
+  }();
+  return selection_model;
+}
+
+// Sets up a benchmark on the text of the script and length of the first two
+// arguments, or skips it if the model isn't available.
+const SelectionModel* SetUp(benchmark::State& state, std::string* text) {
+  const SelectionModel* selection_model = GetSelectionModel();
+  if (selection_model == nullptr) {
+    state.SkipWithError("Couldn't load the model.");
+    return nullptr;
+  }
+  const BenchmarkScript script = static_cast<BenchmarkScript>(state.range(0));
+  *text = BenchmarkScriptText(script, state.range(1));
+  state.SetLabel(BenchmarkScriptName(script));
+  return selection_model;
+}
+
+// Same as ScriptsAndLengths, with the tokenization type as third argument.
+void ScriptsLengthsAndTokenizationTypes(
+    benchmark::internal::Benchmark* benchmark) {
+  for (int script = 0; script < kNumBenchmarkScripts; ++script) {
+    for (const int length : {64, 1024, 16384}) {
+      for (const TokenizationType type :
+           {TokenizationType_INTERNAL_TOKENIZER, TokenizationType_ICU}) {
+        benchmark->Args({script, length, type});
+      }
+    }
+  }
+}
+
+void BM_Tokenize(benchmark::State& state) {
+  std::string text;
+  const SelectionModel* selection_model = SetUp(state, &text);
+  if (selection_model == nullptr) {
+    return;
+  }
+  const TokenizationType type = static_cast<TokenizationType>(state.range(2));
+  state.SetLabel(BenchmarkScriptName(static_cast<BenchmarkScript>(
+                     state.range(0))) +
+                 (type == TokenizationType_ICU ? "/icu" : "/internal"));
+
+  // The tokenizer of the model, with the tokenization type of the benchmark.
+  const FeatureProcessorOptions* options = selection_model->options;
+  std::vector<const TokenizationCodepointRange*> codepoint_config;
+  if (options->tokenization_codepoint_config() != nullptr) {
+    codepoint_config.assign(options->tokenization_codepoint_config()->begin(),
+                            options->tokenization_codepoint_config()->end());
+  }
+  const Tokenizer tokenizer(
+      type, &selection_model->unilib, codepoint_config,
+      /*internal_tokenizer_codepoint_ranges=*/{},
+      options->tokenization_codepoint_config() != nullptr &&
+          options->tokenize_on_script_change(),
+      options->icu_preserve_whitespace_tokens());
+
+  RunMeasuredBenchmark(state, text.size(), [&]() {
+    benchmark::DoNotOptimize(tokenizer.Tokenize(text));
+  });
+}
+BENCHMARK(BM_Tokenize)->Apply(ScriptsLengthsAndTokenizationTypes);
+
+// The pathological inputs, with the tokenizer of the model.
+void BM_TokenizeWorstCase(benchmark::State& state) {
+  const SelectionModel* selection_model = GetSelectionModel();
+  if (selection_model == nullptr) {
+    state.SkipWithError("Couldn't load the model.");
+    return;
+  }
+  const WorstCaseInput input = static_cast<WorstCaseInput>(state.range(0));
+  state.SetLabel(WorstCaseInputName(input));
+  const std::string text = WorstCaseInputText(input, state.range(1));
+
+  RunMeasuredBenchmark(state, text.size(), [&]() {
+    benchmark::DoNotOptimize(
+        selection_model->feature_processor->Tokenize(text));
+  });
+}
+BENCHMARK(BM_TokenizeWorstCase)->Apply(WorstCaseInputsAndLengths);
+
+void BM_ExtractTokenFeatures(benchmark::State& state) {
+  std::string text;
+  const SelectionModel* selection_model = SetUp(state, &text);
+  if (selection_model == nullptr) {
+    return;
+  }
+  const TokenFeatureExtractor feature_extractor(
+      internal::BuildTokenFeatureExtractorOptions(selection_model->options),
+      selection_model->unilib);
+  const std::vector<Token> tokens =
+      selection_model->feature_processor->Tokenize(text);
+
+  std::vector<int> sparse_features;
+  std::vector<float> dense_features;
+  RunMeasuredBenchmark(state, text.size(), [&]() {
+    for (const Token& token : tokens) {
+      sparse_features.clear();
+      dense_features.clear();
+      feature_extractor.Extract(token, /*is_in_span=*/false, &sparse_features,
+                                &dense_features);
+    }
+    benchmark::DoNotOptimize(sparse_features.data());
+    benchmark::DoNotOptimize(dense_features.data());
+  });
+}
+BENCHMARK(BM_ExtractTokenFeatures)->Apply(ScriptsAndLengths);
+
+void BM_AppendClickContextFeaturesForClick(benchmark::State& state) {
+  std::string text;
+  const SelectionModel* selection_model = SetUp(state, &text);
+  if (selection_model == nullptr) {
+    return;
+  }
+  const FeatureProcessor& feature_processor =
+      *selection_model->feature_processor;
+  const std::vector<Token> tokens = feature_processor.Tokenize(text);
+  std::unique_ptr<CachedFeatures> cached_features;
+  if (tokens.empty() ||
+      !feature_processor.ExtractFeatures(
+          tokens, /*token_span=*/{0, static_cast<int>(tokens.size())},
+          /*selection_span_for_feature=*/{kInvalidIndex, kInvalidIndex},
+          selection_model->embedding_executor.get(),
+          /*embedding_cache=*/nullptr,
+          feature_processor.EmbeddingSize() +
+              feature_processor.DenseFeaturesCount(),
+          &cached_features)) {
+    state.SkipWithError("Couldn't extract the features.");
+    return;
+  }
+
+  // Clicks on each token in turn, as the selection model does for the
+  // candidates of a text.
+  std::vector<float> features;
+  int click_pos = 0;
+  RunMeasuredBenchmark(state, /*bytes_per_call=*/0, [&]() {
+    features.clear();
+    cached_features->AppendClickContextFeaturesForClick(click_pos, &features);
+    benchmark::DoNotOptimize(features.data());
+    click_pos = (click_pos + 1) % tokens.size();
+  });
+}
+BENCHMARK(BM_AppendClickContextFeaturesForClick)->Apply(ScriptsAndLengths);
+
+// Arguments: the number of sparse features of a token, and the quantization
+// bits of the embeddings.
+void BM_DequantizeAdd(benchmark::State& state) {
+  const int num_sparse_features = state.range(0);
+  const int quantization_bits = state.range(1);
+  constexpr int kEmbeddingSize = 32;
+  constexpr int kNumBuckets = 4096;
+  const int bytes_per_embedding = kEmbeddingSize * quantization_bits / 8;
+
+  std::vector<float> scales(kNumBuckets);
+  std::vector<uint8> embeddings(kNumBuckets * bytes_per_embedding);
+  for (int i = 0; i < kNumBuckets; ++i) {
+    scales[i] = 0.01f * (1 + i % 7);
+  }
+  for (int i = 0; i < embeddings.size(); ++i) {
+    embeddings[i] = static_cast<uint8>(i * 131);
+  }
+  std::vector<int> bucket_ids(num_sparse_features);
+  for (int i = 0; i < num_sparse_features; ++i) {
+    bucket_ids[i] = (i * 2654435761u) % kNumBuckets;
+  }
+
+  std::vector<float> dest(kEmbeddingSize);
+  RunMeasuredBenchmark(state, /*bytes_per_call=*/0, [&]() {
+    for (const int bucket_id : bucket_ids) {
+      DequantizeAdd(scales.data(), embeddings.data(), bytes_per_embedding,
+                    num_sparse_features, quantization_bits, bucket_id,
+                    dest.data(), kEmbeddingSize);
+    }
+    benchmark::DoNotOptimize(dest.data());
+  });
+}
+BENCHMARK(BM_DequantizeAdd)
+    ->Apply([](benchmark::internal::Benchmark* benchmark) {
+      for (const int num_sparse_features : {1, 10, 50}) {
+        for (const int quantization_bits : {1, 4, 8}) {
+          benchmark->Args({num_sparse_features, quantization_bits});
+        }
+      }
+    });
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -49,6 +49,17 @@ Matcher<std::vector<float>> ElementsAreFloat(const std::vector<float>& values) {
   return ElementsAreArray(matchers);
 }
 
+std::vector<float> CachedEmbedding(
+    const FeatureProcessor::EmbeddingCache& embedding_cache,
+    CodepointSpan span) {
+  const float* embedding = embedding_cache.Get(span);
+  if (embedding == nullptr) {
+    return {};
+  }
+  return std::vector<float>(embedding,
+                            embedding + embedding_cache.embedding_size());
+}
+
 class TestingFeatureProcessor : public FeatureProcessor {
  public:
   using FeatureProcessor::CountIgnoredSpanBoundaryCodepoints;
@@ -681,11 +692,14 @@ TEST_F(FeatureProcessorTest, EmbeddingCache) {
   const std::vector<float> cached_padding_features = {10.0, -10.0, 10.0, -10.0};
   const std::vector<float> cached_features1 = {1.0, 2.0, 3.0, 4.0};
   const std::vector<float> cached_features2 = {5.0, 6.0, 7.0, 8.0};
-  FeatureProcessor::EmbeddingCache embedding_cache = {
-      {{kInvalidIndex, kInvalidIndex}, cached_padding_features},
-      {{4, 7}, cached_features1},
-      {{12, 15}, cached_features2},
-  };
+  FeatureProcessor::EmbeddingCache embedding_cache;
+  embedding_cache.Put({kInvalidIndex, kInvalidIndex},
+                      cached_padding_features.data(),
+                      cached_padding_features.size());
+  embedding_cache.Put({4, 7}, cached_features1.data(),
+                      cached_features1.size());
+  embedding_cache.Put({12, 15}, cached_features2.data(),
+                      cached_features2.size());
 
   EXPECT_TRUE(feature_processor.ExtractFeatures(
       tokens, /*token_span=*/{0, 6},
@@ -706,15 +720,15 @@ TEST_F(FeatureProcessorTest, EmbeddingCache) {
   // Check that the real embeddings were cached.
   EXPECT_EQ(embedding_cache.size(), 7);
   EXPECT_THAT(Subvector(features, 4, 8),
-              ElementsAreFloat(embedding_cache.at({0, 3})));
+              ElementsAreFloat(CachedEmbedding(embedding_cache, {0, 3})));
   EXPECT_THAT(Subvector(features, 12, 16),
-              ElementsAreFloat(embedding_cache.at({8, 11})));
+              ElementsAreFloat(CachedEmbedding(embedding_cache, {8, 11})));
   EXPECT_THAT(Subvector(features, 20, 24),
-              ElementsAreFloat(embedding_cache.at({8, 11})));
+              ElementsAreFloat(CachedEmbedding(embedding_cache, {8, 11})));
   EXPECT_THAT(Subvector(features, 28, 32),
-              ElementsAreFloat(embedding_cache.at({16, 19})));
+              ElementsAreFloat(CachedEmbedding(embedding_cache, {16, 19})));
   EXPECT_THAT(Subvector(features, 32, 36),
-              ElementsAreFloat(embedding_cache.at({20, 23})));
+              ElementsAreFloat(CachedEmbedding(embedding_cache, {20, 23})));
 }
 
 TEST_F(FeatureProcessorTest, StripUnusedTokensWithNoRelativeClick) {
@@ -939,6 +953,87 @@ TEST_F(FeatureProcessorTest, IgnoredSpanBoundaryCodepoints) {
   // Test stripping empty string.
   EXPECT_EQ(feature_processor.StripBoundaryCodepoints("", {0, 0}),
             std::make_pair(0, 0));
+
+  // Test stripping of a value into a view.
+  EXPECT_EQ(
+      feature_processor.StripBoundaryCodepoints(StringPiece("[[Wořld]],"))
+          .ToString(),
+      "Wořld");
+  EXPECT_EQ(feature_processor.StripBoundaryCodepoints(StringPiece("Wořld"))
+                .ToString(),
+            "Wořld");
+  EXPECT_TRUE(
+      feature_processor.StripBoundaryCodepoints(StringPiece("[[]]")).empty());
+  EXPECT_TRUE(
+      feature_processor.StripBoundaryCodepoints(StringPiece("")).empty());
+}
+
+TEST_F(FeatureProcessorTest, SplitContextIntoLines) {
+  FeatureProcessorOptionsT options;
+  flatbuffers::DetachedBuffer options_fb = PackFeatureProcessorOptions(options);
+  FeatureProcessor feature_processor(
+      flatbuffers::GetRoot<FeatureProcessorOptions>(options_fb.data()),
+      &unilib_);
+
+  const UnicodeText context =
+      UTF8ToUnicodeText("Fiřst Lině\n\nSěcond|Thiřd", /*do_copy=*/false);
+  const std::vector<ContextLine> lines =
+      feature_processor.SplitContextIntoLines(context);
+  ASSERT_EQ(lines.size(), 3);
+  EXPECT_EQ(lines[0].utf8.ToString(), "Fiřst Lině");
+  EXPECT_EQ(lines[0].offset, 0);
+  EXPECT_EQ(lines[0].size_codepoints, 10);
+  EXPECT_EQ(lines[1].utf8.ToString(), "Sěcond");
+  EXPECT_EQ(lines[1].offset, 12);
+  EXPECT_EQ(lines[1].size_codepoints, 6);
+  EXPECT_EQ(lines[2].utf8.ToString(), "Thiřd");
+  EXPECT_EQ(lines[2].offset, 19);
+  EXPECT_EQ(lines[2].size_codepoints, 5);
+
+  // Same lines as SplitContext().
+  const std::vector<UnicodeTextRange> ranges =
+      feature_processor.SplitContext(context);
+  ASSERT_EQ(ranges.size(), lines.size());
+  for (int i = 0; i < lines.size(); ++i) {
+    EXPECT_EQ(UnicodeText::UTF8Substring(ranges[i].first, ranges[i].second),
+              lines[i].utf8.ToString());
+  }
+}
+
+TEST_F(FeatureProcessorTest, HasSameTokenizer) {
+  FeatureProcessorOptionsT options;
+  options.context_size = 1;
+  options.tokenization_codepoint_config.emplace_back(
+      new TokenizationCodepointRangeT());
+  auto& config = options.tokenization_codepoint_config.back();
+  config->start = 32;
+  config->end = 33;
+  config->role = TokenizationCodepointRange_::Role_WHITESPACE_SEPARATOR;
+  flatbuffers::DetachedBuffer options_fb = PackFeatureProcessorOptions(options);
+  FeatureProcessor feature_processor(
+      flatbuffers::GetRoot<FeatureProcessorOptions>(options_fb.data()),
+      &unilib_);
+
+  // Options that don't affect the tokenizer can differ.
+  options.context_size = 2;
+  flatbuffers::DetachedBuffer same_tokenizer_options_fb =
+      PackFeatureProcessorOptions(options);
+  FeatureProcessor same_tokenizer_feature_processor(
+      flatbuffers::GetRoot<FeatureProcessorOptions>(
+          same_tokenizer_options_fb.data()),
+      &unilib_);
+  EXPECT_TRUE(
+      feature_processor.HasSameTokenizer(same_tokenizer_feature_processor));
+
+  options.tokenization_codepoint_config.back()->end = 34;
+  flatbuffers::DetachedBuffer other_tokenizer_options_fb =
+      PackFeatureProcessorOptions(options);
+  FeatureProcessor other_tokenizer_feature_processor(
+      flatbuffers::GetRoot<FeatureProcessorOptions>(
+          other_tokenizer_options_fb.data()),
+      &unilib_);
+  EXPECT_FALSE(
+      feature_processor.HasSameTokenizer(other_tokenizer_feature_processor));
 }
 
 TEST_F(FeatureProcessorTest, CodepointSpanToTokenSpan) {
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/installed_app/installed-app-engine.h"
+
+#include <mutex>  // NOLINT
+#include <utility>
+
+#include "annotator/collections.h"
+#include "annotator/installed_app/installed-app-config_generated.h"
+#include "utils/base/logging.h"
+#include "utils/flatbuffers.h"
+
+namespace libtextclassifier3 {
+
+bool InstalledAppEngine::Initialize(const std::string& serialized_config) {
+  if (feature_processor_ == nullptr) {
+    TC3_LOG(ERROR) << "No feature processor to tokenize the app names.";
+    return false;
+  }
+  const InstalledAppConfig* config =
+      LoadAndVerifyFlatbuffer<InstalledAppConfig>(serialized_config);
+  if (config == nullptr) {
+    TC3_LOG(ERROR) << "Invalid installed app config.";
+    return false;
+  }
+
+  // Build the new index without holding the lock, so that the lookups can go
+  // on with the old one meanwhile.
+  std::vector<App> apps;
+  TokenTrie trie(feature_processor_, unilib_);
+  if (config->apps() != nullptr) {
+    std::vector<int32> token_ids;
+    for (const InstalledAppConfig_::App* entry : *config->apps()) {
+      if (entry->name() == nullptr ||
+          !trie.InternName(entry->name()->str(), &token_ids)) {
+        continue;
+      }
+      trie.Insert(token_ids, apps.size());
+      apps.push_back({entry->name()->str(),
+                      entry->package_name() != nullptr
+                          ? entry->package_name()->str()
+                          : std::string()});
+    }
+  }
+
+  std::unique_lock<std::shared_timed_mutex> lock(mutex_);
+  score_ = config->score();
+  priority_score_ = config->priority_score();
+  apps_ = std::move(apps);
+  trie_ = std::move(trie);
+  return true;
+}
+
+bool InstalledAppEngine::ClassifyText(
+    const std::string& context, CodepointSpan selection_indices,
+    ClassificationResult* classification_result) const {
+  if (feature_processor_ == nullptr) {
+    return false;
+  }
+  const UnicodeText context_unicode =
+      UTF8ToUnicodeText(context, /*do_copy=*/false);
+  if (selection_indices.first < 0 ||
+      selection_indices.first >= selection_indices.second ||
+      selection_indices.second > context_unicode.size_codepoints()) {
+    return false;
+  }
+  const std::vector<Token> tokens =
+      feature_processor_->Tokenize(context_unicode.UTF8Substring(
+          selection_indices.first, selection_indices.second));
+
+  std::shared_lock<std::shared_timed_mutex> lock(mutex_);
+  const std::vector<int>* app_indices = trie_.Find(tokens);
+  if (app_indices == nullptr) {
+    return false;
+  }
+  FillClassificationResult(app_indices->front(), classification_result);
+  return true;
+}
+
+bool InstalledAppEngine::Chunk(const UnicodeText& context_unicode,
+                               const std::vector<Token>& tokens,
+                               std::vector<AnnotatedSpan>* result) const {
+  std::shared_lock<std::shared_timed_mutex> lock(mutex_);
+  for (const TokenTrie::Match& match : trie_.FindLongestMatches(tokens)) {
+    AnnotatedSpan span;
+    span.span = {tokens[match.first_token].start,
+                 tokens[match.last_token].end};
+    for (const int app_index : *match.values) {
+      ClassificationResult classification;
+      FillClassificationResult(app_index, &classification);
+      span.classification.push_back(std::move(classification));
+    }
+    result->push_back(std::move(span));
+  }
+  return true;
+}
+
+void InstalledAppEngine::FillClassificationResult(
+    int app_index, ClassificationResult* result) const {
+  const App& app = apps_[app_index];
+  result->collection = Collections::App();
+  result->score = score_;
+  result->priority_score = priority_score_;
+  ClassificationResultExtras* extras = result->mutable_extras();
+  extras->app_name = app.name;
+  extras->app_package_name = app.package_name;
+}
+
+}  // namespace libtextclassifier3
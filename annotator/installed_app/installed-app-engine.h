@@ -17,6 +17,70 @@
 #ifndef LIBTEXTCLASSIFIER_ANNOTATOR_INSTALLED_APP_INSTALLED_APP_ENGINE_H_
 #define LIBTEXTCLASSIFIER_ANNOTATOR_INSTALLED_APP_INSTALLED_APP_ENGINE_H_
 
-#include "annotator/installed_app/installed-app-engine-dummy.h"
+#include <shared_mutex>  // NOLINT
+#include <string>
+#include <vector>
+
+#include "annotator/feature-processor.h"
+#include "annotator/token-trie.h"
+#include "annotator/types.h"
+#include "utils/utf8/unicodetext.h"
+#include "utils/utf8/unilib.h"
+
+namespace libtextclassifier3 {
+
+// Annotates the names of the apps installed on the device.
+//
+// The app names are stored in a case-folded token trie, so Chunk needs a
+// single pass over the tokens of the context. The index is built in time
+// linear in the total length of the names, and Initialize can be called again
+// with a new config when the installed apps change; the lookups keep using
+// the old index until the new one is swapped in.
+//
+// Thread-safe.
+class InstalledAppEngine {
+ public:
+  explicit InstalledAppEngine(const FeatureProcessor* feature_processor,
+                              const UniLib* unilib)
+      : feature_processor_(feature_processor),
+        unilib_(unilib),
+        trie_(feature_processor, unilib) {}
+
+  // (Re)builds the index from the given serialized InstalledAppConfig.
+  bool Initialize(const std::string& serialized_config);
+
+  // Classifies the selection as an app if it is exactly one of the app names.
+  bool ClassifyText(const std::string& context, CodepointSpan selection_indices,
+                    ClassificationResult* classification_result) const;
+
+  // Finds the longest non-overlapping occurrences of the app names among the
+  // given tokens.
+  bool Chunk(const UnicodeText& context_unicode,
+             const std::vector<Token>& tokens,
+             std::vector<AnnotatedSpan>* result) const;
+
+ private:
+  struct App {
+    std::string name;
+    std::string package_name;
+  };
+
+  // Fills the classification result for the app at the index.
+  void FillClassificationResult(int app_index,
+                                ClassificationResult* result) const;
+
+  const FeatureProcessor* feature_processor_;
+  const UniLib* unilib_;
+
+  mutable std::shared_timed_mutex mutex_;
+  float score_ = 1.0f;
+  float priority_score_ = 0.0f;
+  std::vector<App> apps_;
+
+  // The app names, with the indices into apps_ as values.
+  TokenTrie trie_;
+};
+
+}  // namespace libtextclassifier3
 
 #endif  // LIBTEXTCLASSIFIER_ANNOTATOR_INSTALLED_APP_INSTALLED_APP_ENGINE_H_
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/installed_app/installed-app-engine.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "annotator/collections.h"
+#include "annotator/installed_app/installed-app-config_generated.h"
+#include "annotator/model_generated.h"
+#include "annotator/types-test-util.h"
+#include "annotator/types.h"
+#include "utils/test-utils.h"
+#include "utils/utf8/unicodetext.h"
+#include "utils/utf8/unilib.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+using testing::ElementsAre;
+using testing::Field;
+using testing::IsEmpty;
+
+FeatureProcessor BuildFeatureProcessor(const UniLib* unilib) {
+  static const flatbuffers::DetachedBuffer* options_data = []() {
+    FeatureProcessorOptionsT options;
+    options.context_size = 1;
+    options.max_selection_span = 1;
+
+    options.tokenization_codepoint_config.emplace_back(
+        new TokenizationCodepointRangeT());
+    auto& config = options.tokenization_codepoint_config.back();
+    config->start = 32;
+    config->end = 33;
+    config->role = TokenizationCodepointRange_::Role_WHITESPACE_SEPARATOR;
+
+    flatbuffers::FlatBufferBuilder builder;
+    builder.Finish(FeatureProcessorOptions::Pack(builder, &options));
+    return new flatbuffers::DetachedBuffer(builder.Release());
+  }();
+
+  return FeatureProcessor(
+      flatbuffers::GetRoot<FeatureProcessorOptions>(options_data->data()),
+      unilib);
+}
+
+std::string InstalledAppConfigWithApps(
+    const std::vector<std::pair<std::string, std::string>>& apps) {
+  InstalledAppConfigT config;
+  config.score = 0.8;
+  for (const auto& app : apps) {
+    config.apps.emplace_back(new InstalledAppConfig_::AppT());
+    config.apps.back()->name = app.first;
+    config.apps.back()->package_name = app.second;
+  }
+
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(InstalledAppConfig::Pack(builder, &config));
+  return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                     builder.GetSize());
+}
+
+class InstalledAppEngineTest : public ::testing::Test {
+ protected:
+  InstalledAppEngineTest()
+      : INIT_UNILIB_FOR_TESTING(unilib_),
+        feature_processor_(BuildFeatureProcessor(&unilib_)),
+        installed_app_engine_(&feature_processor_, &unilib_) {}
+
+  std::vector<AnnotatedSpan> Chunk(const std::string& text) {
+    const UnicodeText text_unicode = UTF8ToUnicodeText(text);
+    std::vector<AnnotatedSpan> result;
+    EXPECT_TRUE(installed_app_engine_.Chunk(
+        text_unicode, feature_processor_.Tokenize(text_unicode), &result));
+    return result;
+  }
+
+  UniLib unilib_;
+  FeatureProcessor feature_processor_;
+  InstalledAppEngine installed_app_engine_;
+};
+
+TEST_F(InstalledAppEngineTest, ChunksAppNamesCaseInsensitively) {
+  ASSERT_TRUE(installed_app_engine_.Initialize(InstalledAppConfigWithApps(
+      {{"Maps", "com.example.maps"}, {"Google Maps", "com.example.gmaps"}})));
+
+  const std::vector<AnnotatedSpan> result =
+      Chunk("open google maps or MAPS please");
+  ASSERT_EQ(result.size(), 2);
+  EXPECT_EQ(result[0].span, CodepointSpan(5, 16));
+  ASSERT_EQ(result[0].classification.size(), 1);
+  EXPECT_EQ(result[0].classification[0].collection, Collections::App());
+  EXPECT_FLOAT_EQ(result[0].classification[0].score, 0.8);
+  EXPECT_EQ(result[0].classification[0].extras()->app_package_name,
+            "com.example.gmaps");
+  EXPECT_EQ(result[1].span, CodepointSpan(20, 24));
+  EXPECT_EQ(result[1].classification[0].extras()->app_name, "Maps");
+}
+
+TEST_F(InstalledAppEngineTest, ClassifiesExactAppNames) {
+  ASSERT_TRUE(installed_app_engine_.Initialize(
+      InstalledAppConfigWithApps({{"Photo Editor", "com.example.photos"}})));
+
+  ClassificationResult classification;
+  EXPECT_TRUE(installed_app_engine_.ClassifyText("Try photo editor", {4, 16},
+                                                 &classification));
+  EXPECT_EQ(classification.extras()->app_package_name, "com.example.photos");
+  EXPECT_FALSE(installed_app_engine_.ClassifyText("Try photo editor", {4, 9},
+                                                  &classification));
+}
+
+TEST_F(InstalledAppEngineTest, RebuildsIndexOnReinitialization) {
+  ASSERT_TRUE(installed_app_engine_.Initialize(
+      InstalledAppConfigWithApps({{"Notes", "com.example.notes"}})));
+  EXPECT_THAT(Chunk("open notes"),
+              ElementsAre(Field(&AnnotatedSpan::span, CodepointSpan(5, 10))));
+
+  ASSERT_TRUE(installed_app_engine_.Initialize(
+      InstalledAppConfigWithApps({{"Calendar", "com.example.calendar"}})));
+  EXPECT_THAT(Chunk("open notes"), IsEmpty());
+  EXPECT_THAT(Chunk("open calendar"),
+              ElementsAre(Field(&AnnotatedSpan::span, CodepointSpan(5, 13))));
+}
+
+TEST_F(InstalledAppEngineTest, FailsOnInvalidConfig) {
+  EXPECT_FALSE(installed_app_engine_.Initialize("not a config"));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
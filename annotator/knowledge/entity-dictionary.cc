@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/knowledge/entity-dictionary.h"
+
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
+
+#include "utils/base/integral_types.h"
+#include "utils/hash/farmhash.h"
+
+namespace libtextclassifier3 {
+
+namespace {
+
+bool IsAsciiPunctuation(char32 codepoint) {
+  return (codepoint >= '!' && codepoint <= '/') ||
+         (codepoint >= ':' && codepoint <= '@') ||
+         (codepoint >= '[' && codepoint <= '`') ||
+         (codepoint >= '{' && codepoint <= '~');
+}
+
+// Appends the token of the codepoints starting at index start, without the
+// punctuation at its ends.
+void AddToken(const UniLib& unilib, int start,
+              std::vector<char32>* codepoints,
+              std::vector<EntityToken>* tokens) {
+  int first = 0;
+  int last = codepoints->size();
+  while (first < last && IsAsciiPunctuation((*codepoints)[first])) {
+    ++first;
+  }
+  while (last > first && IsAsciiPunctuation((*codepoints)[last - 1])) {
+    --last;
+  }
+  if (first < last) {
+    UnicodeText normalized;
+    for (int i = first; i < last; ++i) {
+      normalized.push_back(unilib.ToLower((*codepoints)[i]));
+    }
+    tokens->push_back({normalized.ToUTF8String(),
+                       {start + first, start + last}});
+  }
+  codepoints->clear();
+}
+
+uint32 BucketIndex(const std::string& key, int num_buckets) {
+  return tc3farmhash::Fingerprint64(key) & (num_buckets - 1);
+}
+
+// Builds an open-addressing hash table over the keys, see
+// entity-dictionary.fbs.
+std::vector<uint32> BuildBuckets(const std::vector<std::string>& keys) {
+  int num_buckets = 2;
+  while (num_buckets < 2 * keys.size()) {
+    num_buckets *= 2;
+  }
+  std::vector<uint32> buckets(num_buckets, 0);
+  for (int i = 0; i < keys.size(); ++i) {
+    uint32 bucket = BucketIndex(keys[i], num_buckets);
+    while (buckets[bucket] != 0) {
+      bucket = (bucket + 1) & (num_buckets - 1);
+    }
+    buckets[bucket] = i + 1;
+  }
+  return buckets;
+}
+
+// Looks up the key in a hash table built by BuildBuckets. Returns the index of
+// the candidate with the key, or -1.
+template <typename T, typename GetKey>
+int LookUp(const flatbuffers::Vector<uint32>* buckets,
+           const flatbuffers::Vector<flatbuffers::Offset<T>>* values,
+           const std::string& key, const GetKey& get_key) {
+  if (buckets == nullptr || values == nullptr || buckets->size() == 0) {
+    return -1;
+  }
+  const int num_buckets = buckets->size();
+  uint32 bucket = BucketIndex(key, num_buckets);
+  for (int probe = 0; probe < num_buckets; ++probe) {
+    const uint32 value = buckets->Get(bucket);
+    if (value == 0 || value > values->size()) {
+      return -1;
+    }
+    const flatbuffers::String* candidate = get_key(values->Get(value - 1));
+    if (candidate != nullptr && candidate->size() == key.size() &&
+        key.compare(0, key.size(), candidate->c_str(), candidate->size()) ==
+            0) {
+      return value - 1;
+    }
+    bucket = (bucket + 1) & (num_buckets - 1);
+  }
+  return -1;
+}
+
+}  // namespace
+
+std::vector<EntityToken> TokenizeForEntityDictionary(const UnicodeText& text,
+                                                     const UniLib& unilib) {
+  std::vector<EntityToken> tokens;
+  std::vector<char32> codepoints;
+  int token_start = 0;
+  int index = 0;
+  for (const char32 codepoint : text) {
+    if (unilib.IsWhitespace(codepoint)) {
+      AddToken(unilib, token_start, &codepoints, &tokens);
+      token_start = index + 1;
+    } else {
+      codepoints.push_back(codepoint);
+    }
+    ++index;
+  }
+  AddToken(unilib, token_start, &codepoints, &tokens);
+  return tokens;
+}
+
+std::string JoinNormalizedTokens(const std::vector<EntityToken>& tokens) {
+  std::string text;
+  for (const EntityToken& token : tokens) {
+    if (!text.empty()) {
+      text.push_back(' ');
+    }
+    text += token.normalized;
+  }
+  return text;
+}
+
+std::string BuildEntityDictionary(const std::vector<EntityDefinition>& entities,
+                                  const UniLib& unilib) {
+  EntityDictionaryT dictionary;
+  std::vector<std::string> entity_ids;
+  std::vector<std::string> surface_form_texts;
+  std::unordered_map<std::string, int> surface_form_index;
+  for (int i = 0; i < entities.size(); ++i) {
+    const EntityDefinition& definition = entities[i];
+    dictionary.entities.emplace_back(new EntityDictionary_::EntityT());
+    EntityDictionary_::EntityT* entity = dictionary.entities.back().get();
+    entity->id = definition.id;
+    entity->collection = definition.collection;
+    entity->score = definition.score;
+    entity->priority_score = definition.priority_score;
+    entity->summary.assign(definition.summary.begin(),
+                           definition.summary.end());
+    entity->payload.assign(definition.payload.begin(),
+                           definition.payload.end());
+    entity_ids.push_back(definition.id);
+
+    for (const std::string& surface_form : definition.surface_forms) {
+      const std::vector<EntityToken> tokens =
+          TokenizeForEntityDictionary(UTF8ToUnicodeText(surface_form), unilib);
+      if (tokens.empty()) {
+        continue;
+      }
+      const std::string text = JoinNormalizedTokens(tokens);
+      dictionary.max_surface_form_tokens =
+          std::max<int>(dictionary.max_surface_form_tokens, tokens.size());
+
+      auto it = surface_form_index.find(text);
+      if (it == surface_form_index.end()) {
+        it = surface_form_index.emplace(text, surface_form_texts.size()).first;
+        surface_form_texts.push_back(text);
+        dictionary.surface_forms.emplace_back(
+            new EntityDictionary_::SurfaceFormT());
+        dictionary.surface_forms.back()->text = text;
+      }
+      std::vector<int>& surface_form_entities =
+          dictionary.surface_forms[it->second]->entities;
+      if (std::find(surface_form_entities.begin(), surface_form_entities.end(),
+                    i) == surface_form_entities.end()) {
+        surface_form_entities.push_back(i);
+      }
+    }
+  }
+  dictionary.surface_form_buckets = BuildBuckets(surface_form_texts);
+  dictionary.entity_buckets = BuildBuckets(entity_ids);
+
+  flatbuffers::FlatBufferBuilder builder;
+  FinishEntityDictionaryBuffer(builder,
+                               EntityDictionary::Pack(builder, &dictionary));
+  return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                     builder.GetSize());
+}
+
+const EntityDictionary_::SurfaceForm* FindSurfaceForm(
+    const EntityDictionary* dictionary, const std::string& text) {
+  const int index = LookUp(
+      dictionary->surface_form_buckets(), dictionary->surface_forms(), text,
+      [](const EntityDictionary_::SurfaceForm* surface_form) {
+        return surface_form->text();
+      });
+  return index >= 0 ? dictionary->surface_forms()->Get(index) : nullptr;
+}
+
+const EntityDictionary_::Entity* FindEntity(const EntityDictionary* dictionary,
+                                            const std::string& id) {
+  const int index =
+      LookUp(dictionary->entity_buckets(), dictionary->entities(), id,
+             [](const EntityDictionary_::Entity* entity) {
+               return entity->id();
+             });
+  return index >= 0 ? dictionary->entities()->Get(index) : nullptr;
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Building of, and lookups in, the entity dictionaries of the knowledge
+// engine.
+
+#ifndef LIBTEXTCLASSIFIER_ANNOTATOR_KNOWLEDGE_ENTITY_DICTIONARY_H_
+#define LIBTEXTCLASSIFIER_ANNOTATOR_KNOWLEDGE_ENTITY_DICTIONARY_H_
+
+#include <string>
+#include <vector>
+
+#include "annotator/knowledge/entity-dictionary_generated.h"
+#include "annotator/types.h"
+#include "utils/utf8/unicodetext.h"
+#include "utils/utf8/unilib.h"
+
+namespace libtextclassifier3 {
+
+// A token of a text, as the surface forms of the dictionary are made of.
+struct EntityToken {
+  // The lowercased token.
+  std::string normalized;
+
+  CodepointSpan span;
+};
+
+// Splits the text at whitespace, strips ASCII punctuation from the ends of the
+// tokens and lowercases them. The surface forms of a dictionary are the
+// normalized tokens joined by single spaces.
+std::vector<EntityToken> TokenizeForEntityDictionary(const UnicodeText& text,
+                                                     const UniLib& unilib);
+
+// Joins the normalized tokens into the text of a surface form.
+std::string JoinNormalizedTokens(const std::vector<EntityToken>& tokens);
+
+// An entity to put in a dictionary.
+struct EntityDefinition {
+  std::string id;
+  std::string collection;
+  float score = 1.0f;
+  float priority_score = 0.0f;
+  std::string summary;
+  std::string payload;
+
+  // The texts the entity is mentioned by, e.g. "Eiffel Tower".
+  std::vector<std::string> surface_forms;
+};
+
+// Builds a serialized EntityDictionary. Surface forms shared by several
+// entities list them in the given order.
+std::string BuildEntityDictionary(const std::vector<EntityDefinition>& entities,
+                                  const UniLib& unilib);
+
+// Returns the surface form with the given normalized text, or nullptr.
+const EntityDictionary_::SurfaceForm* FindSurfaceForm(
+    const EntityDictionary* dictionary, const std::string& text);
+
+// Returns the entity with the given id, or nullptr.
+const EntityDictionary_::Entity* FindEntity(const EntityDictionary* dictionary,
+                                            const std::string& id);
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_ANNOTATOR_KNOWLEDGE_ENTITY_DICTIONARY_H_
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/knowledge/knowledge-engine.h"
+
+#include <algorithm>
+
+#include "annotator/collections.h"
+#include "annotator/knowledge/knowledge-config_generated.h"
+#include "utils/base/logging.h"
+#include "utils/flatbuffers.h"
+
+namespace libtextclassifier3 {
+
+bool KnowledgeEngine::Initialize(const std::string& serialized_config) {
+  const KnowledgeConfig* config =
+      LoadAndVerifyFlatbuffer<KnowledgeConfig>(serialized_config);
+  if (config == nullptr) {
+    TC3_LOG(ERROR) << "Invalid knowledge config.";
+    return false;
+  }
+
+  if (config->dictionary_file() != nullptr) {
+    dictionary_mmap_.reset(new ScopedMmap(config->dictionary_file()->str()));
+    if (!dictionary_mmap_->handle().ok()) {
+      TC3_LOG(ERROR) << "Couldn't map the entity dictionary file.";
+      return false;
+    }
+    // The payloads are read on demand, read-ahead would only pull them in.
+    dictionary_mmap_->Advise(MmapAdvice::kRandom);
+    dictionary_ = LoadAndVerifyFlatbuffer<EntityDictionary>(
+        dictionary_mmap_->handle().start(),
+        dictionary_mmap_->handle().num_bytes());
+  } else if (config->dictionary() != nullptr) {
+    dictionary_buffer_.assign(
+        reinterpret_cast<const char*>(config->dictionary()->data()),
+        config->dictionary()->size());
+    dictionary_ = LoadAndVerifyFlatbuffer<EntityDictionary>(dictionary_buffer_);
+  } else {
+    TC3_LOG(ERROR) << "No entity dictionary in the knowledge config.";
+    return false;
+  }
+
+  if (dictionary_ == nullptr) {
+    TC3_LOG(ERROR) << "Invalid entity dictionary.";
+    return false;
+  }
+  return true;
+}
+
+bool KnowledgeEngine::ClassifyText(
+    const std::string& context, CodepointSpan selection_indices,
+    ClassificationResult* classification_result) const {
+  if (dictionary_ == nullptr) {
+    return false;
+  }
+  const UnicodeText context_unicode =
+      UTF8ToUnicodeText(context, /*do_copy=*/false);
+  if (selection_indices.first < 0 ||
+      selection_indices.first >= selection_indices.second ||
+      selection_indices.second > context_unicode.size_codepoints()) {
+    return false;
+  }
+  const std::vector<EntityToken> tokens = TokenizeForEntityDictionary(
+      UnicodeText::Substring(context_unicode, selection_indices.first,
+                             selection_indices.second, /*do_copy=*/false),
+      *unilib_);
+  if (tokens.empty()) {
+    return false;
+  }
+
+  const EntityDictionary_::SurfaceForm* surface_form =
+      FindSurfaceFormWithEntities(JoinNormalizedTokens(tokens));
+  if (surface_form == nullptr) {
+    return false;
+  }
+  FillClassificationResult(surface_form->entities()->Get(0),
+                           classification_result);
+  return true;
+}
+
+bool KnowledgeEngine::Chunk(const std::string& context,
+                            std::vector<AnnotatedSpan>* result) const {
+  if (dictionary_ == nullptr) {
+    return true;
+  }
+  const std::vector<EntityToken> tokens = TokenizeForEntityDictionary(
+      UTF8ToUnicodeText(context, /*do_copy=*/false), *unilib_);
+  const int max_surface_form_tokens =
+      std::max(1, dictionary_->max_surface_form_tokens());
+
+  std::string text;
+  for (int i = 0; i < tokens.size();) {
+    // Find the longest surface form starting at this token.
+    const EntityDictionary_::SurfaceForm* longest_surface_form = nullptr;
+    int last_token = -1;
+    text.clear();
+    for (int j = i; j < tokens.size() && j < i + max_surface_form_tokens; ++j) {
+      if (j > i) {
+        text.push_back(' ');
+      }
+      text += tokens[j].normalized;
+      const EntityDictionary_::SurfaceForm* surface_form =
+          FindSurfaceFormWithEntities(text);
+      if (surface_form != nullptr) {
+        longest_surface_form = surface_form;
+        last_token = j;
+      }
+    }
+    if (longest_surface_form == nullptr) {
+      ++i;
+      continue;
+    }
+
+    AnnotatedSpan span;
+    span.span = {tokens[i].span.first, tokens[last_token].span.second};
+    span.source = AnnotatedSpan::Source::KNOWLEDGE;
+    for (const int entity_index : *longest_surface_form->entities()) {
+      ClassificationResult classification;
+      FillClassificationResult(entity_index, &classification);
+      span.classification.push_back(std::move(classification));
+    }
+    result->push_back(std::move(span));
+    i = last_token + 1;
+  }
+  return true;
+}
+
+bool KnowledgeEngine::LookUpEntity(
+    const std::string& id, std::string* serialized_knowledge_result) const {
+  if (dictionary_ == nullptr) {
+    return false;
+  }
+  const EntityDictionary_::Entity* entity = FindEntity(dictionary_, id);
+  if (entity == nullptr || entity->payload() == nullptr) {
+    return false;
+  }
+  serialized_knowledge_result->assign(
+      reinterpret_cast<const char*>(entity->payload()->data()),
+      entity->payload()->size());
+  return true;
+}
+
+const EntityDictionary_::SurfaceForm*
+KnowledgeEngine::FindSurfaceFormWithEntities(const std::string& text) const {
+  const EntityDictionary_::SurfaceForm* surface_form =
+      FindSurfaceForm(dictionary_, text);
+  if (surface_form == nullptr || surface_form->entities() == nullptr ||
+      surface_form->entities()->size() == 0 ||
+      dictionary_->entities() == nullptr) {
+    return nullptr;
+  }
+  for (const int entity_index : *surface_form->entities()) {
+    if (entity_index < 0 || entity_index >= dictionary_->entities()->size()) {
+      TC3_LOG(ERROR) << "Invalid entity index in the dictionary.";
+      return nullptr;
+    }
+  }
+  return surface_form;
+}
+
+void KnowledgeEngine::FillClassificationResult(
+    int entity_index, ClassificationResult* result) const {
+  const EntityDictionary_::Entity* entity =
+      dictionary_->entities()->Get(entity_index);
+  result->collection = entity->collection() != nullptr &&
+                               entity->collection()->size() > 0
+                           ? entity->collection()->str()
+                           : Collections::Entity();
+  result->score = entity->score();
+  result->priority_score = entity->priority_score();
+  ClassificationResultExtras* extras = result->mutable_extras();
+  if (entity->summary() != nullptr && entity->summary()->size() > 0) {
+    extras->serialized_knowledge_result.assign(
+        reinterpret_cast<const char*>(entity->summary()->data()),
+        entity->summary()->size());
+  } else if (entity->id() != nullptr) {
+    extras->serialized_knowledge_result = entity->id()->str();
+  }
+}
+
+}  // namespace libtextclassifier3
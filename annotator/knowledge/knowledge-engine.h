@@ -17,6 +17,61 @@
 #ifndef LIBTEXTCLASSIFIER_ANNOTATOR_KNOWLEDGE_KNOWLEDGE_ENGINE_H_
 #define LIBTEXTCLASSIFIER_ANNOTATOR_KNOWLEDGE_KNOWLEDGE_ENGINE_H_
 
-#include "annotator/knowledge/knowledge-engine-dummy.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "annotator/knowledge/entity-dictionary.h"
+#include "annotator/types.h"
+#include "utils/memory/mmap.h"
+#include "utils/utf8/unilib.h"
+
+namespace libtextclassifier3 {
+
+// Links mentions of knowledge entities in text, using an entity dictionary
+// that is memory mapped from a file (or embedded in the config).
+//
+// Chunk tokenizes the whole context once and looks up, for every token, the
+// surface forms starting there in the hash table of the dictionary, keeping
+// the leftmost longest matches. The annotations only carry the small summary
+// of the entities; the full payload stays in the mapped file until it is
+// asked for with LookUpEntity, so its pages are only read on demand.
+class KnowledgeEngine {
+ public:
+  explicit KnowledgeEngine(const UniLib* unilib) : unilib_(unilib) {}
+
+  // Loads the dictionary of the given serialized KnowledgeConfig.
+  bool Initialize(const std::string& serialized_config);
+
+  bool ClassifyText(const std::string& context, CodepointSpan selection_indices,
+                    ClassificationResult* classification_result) const;
+
+  bool Chunk(const std::string& context,
+             std::vector<AnnotatedSpan>* result) const;
+
+  // Returns the full serialized knowledge result of the entity.
+  bool LookUpEntity(const std::string& id,
+                    std::string* serialized_knowledge_result) const;
+
+ private:
+  // Returns the surface form with the normalized text, or nullptr if there is
+  // none with entities.
+  const EntityDictionary_::SurfaceForm* FindSurfaceFormWithEntities(
+      const std::string& text) const;
+
+  // Fills the classification result for the entity at the index.
+  void FillClassificationResult(int entity_index,
+                                ClassificationResult* result) const;
+
+  const UniLib* unilib_;
+
+  // The mapped dictionary file, or the dictionary copied out of the config.
+  std::unique_ptr<ScopedMmap> dictionary_mmap_;
+  std::string dictionary_buffer_;
+
+  const EntityDictionary* dictionary_ = nullptr;
+};
+
+}  // namespace libtextclassifier3
 
 #endif  // LIBTEXTCLASSIFIER_ANNOTATOR_KNOWLEDGE_KNOWLEDGE_ENGINE_H_
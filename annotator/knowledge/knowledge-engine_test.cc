@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/knowledge/knowledge-engine.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "annotator/collections.h"
+#include "annotator/knowledge/entity-dictionary.h"
+#include "annotator/knowledge/knowledge-config_generated.h"
+#include "annotator/types-test-util.h"
+#include "utils/test-utils.h"
+#include "utils/utf8/unilib.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+using testing::ElementsAre;
+using testing::Field;
+
+std::vector<EntityDefinition> TestingEntities() {
+  std::vector<EntityDefinition> entities(3);
+  entities[0].id = "/m/paris";
+  entities[0].summary = "paris-summary";
+  entities[0].payload = "paris-payload";
+  entities[0].surface_forms = {"Paris"};
+
+  entities[1].id = "/m/paris_hilton";
+  entities[1].collection = "person";
+  entities[1].score = 0.7;
+  entities[1].payload = "hilton-payload";
+  entities[1].surface_forms = {"Paris Hilton", "Paris Whitney Hilton"};
+
+  entities[2].id = "/m/paris_texas";
+  entities[2].surface_forms = {"Paris"};
+  return entities;
+}
+
+std::string ConfigWithDictionary(const std::string& dictionary) {
+  KnowledgeConfigT config;
+  config.dictionary.assign(dictionary.begin(), dictionary.end());
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(KnowledgeConfig::Pack(builder, &config));
+  return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                     builder.GetSize());
+}
+
+class KnowledgeEngineTest : public ::testing::Test {
+ protected:
+  KnowledgeEngineTest()
+      : INIT_UNILIB_FOR_TESTING(unilib_), knowledge_engine_(&unilib_) {}
+
+  UniLib unilib_;
+  KnowledgeEngine knowledge_engine_;
+};
+
+TEST_F(KnowledgeEngineTest, ChunksLongestSurfaceForms) {
+  ASSERT_TRUE(knowledge_engine_.Initialize(
+      ConfigWithDictionary(BuildEntityDictionary(TestingEntities(), unilib_))));
+
+  std::vector<AnnotatedSpan> result;
+  ASSERT_TRUE(knowledge_engine_.Chunk(
+      "Paris Whitney Hilton was in PARIS, again.", &result));
+  ASSERT_EQ(result.size(), 2);
+
+  EXPECT_EQ(result[0].span, CodepointSpan(0, 20));
+  ASSERT_EQ(result[0].classification.size(), 1);
+  EXPECT_EQ(result[0].classification[0].collection, "person");
+  EXPECT_FLOAT_EQ(result[0].classification[0].score, 0.7);
+  EXPECT_EQ(result[0].classification[0].extras()->serialized_knowledge_result,
+            "/m/paris_hilton");
+
+  // The punctuation is not part of the span, and both entities of the surface
+  // form are returned.
+  EXPECT_EQ(result[1].span, CodepointSpan(28, 33));
+  EXPECT_THAT(
+      result[1].classification,
+      ElementsAre(Field(&ClassificationResult::collection,
+                        Collections::Entity()),
+                  Field(&ClassificationResult::collection,
+                        Collections::Entity())));
+  EXPECT_EQ(result[1].classification[0].extras()->serialized_knowledge_result,
+            "paris-summary");
+}
+
+TEST_F(KnowledgeEngineTest, ClassifiesExactSurfaceForms) {
+  ASSERT_TRUE(knowledge_engine_.Initialize(
+      ConfigWithDictionary(BuildEntityDictionary(TestingEntities(), unilib_))));
+
+  ClassificationResult classification;
+  EXPECT_TRUE(knowledge_engine_.ClassifyText("Meet paris hilton today",
+                                             {5, 17}, &classification));
+  EXPECT_EQ(classification.collection, "person");
+  EXPECT_FALSE(knowledge_engine_.ClassifyText("Meet paris hilton today",
+                                              {11, 17}, &classification));
+}
+
+TEST_F(KnowledgeEngineTest, LooksUpPayloads) {
+  ASSERT_TRUE(knowledge_engine_.Initialize(
+      ConfigWithDictionary(BuildEntityDictionary(TestingEntities(), unilib_))));
+
+  std::string payload;
+  EXPECT_TRUE(knowledge_engine_.LookUpEntity("/m/paris_hilton", &payload));
+  EXPECT_EQ(payload, "hilton-payload");
+  EXPECT_FALSE(knowledge_engine_.LookUpEntity("/m/london", &payload));
+}
+
+TEST_F(KnowledgeEngineTest, MapsDictionaryFile) {
+  char path[] = "/tmp/entity_dictionary_XXXXXX";
+  const int fd = mkstemp(path);
+  ASSERT_GE(fd, 0);
+  close(fd);
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << BuildEntityDictionary(TestingEntities(), unilib_);
+  }
+
+  KnowledgeConfigT config;
+  config.dictionary_file = path;
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(KnowledgeConfig::Pack(builder, &config));
+  ASSERT_TRUE(knowledge_engine_.Initialize(
+      std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                  builder.GetSize())));
+
+  std::string payload;
+  EXPECT_TRUE(knowledge_engine_.LookUpEntity("/m/paris", &payload));
+  EXPECT_EQ(payload, "paris-payload");
+  unlink(path);
+}
+
+TEST_F(KnowledgeEngineTest, FailsWithoutDictionary) {
+  EXPECT_FALSE(knowledge_engine_.Initialize(ConfigWithDictionary("")));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -16,8 +16,12 @@
 
 #include "annotator/model-executor.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include "annotator/quantization.h"
 #include "utils/base/logging.h"
+#include "utils/base/tracing.h"
 
 namespace libtextclassifier3 {
 
@@ -26,28 +30,196 @@ TensorView<float> ModelExecutor::ComputeLogits(
   if (!interpreter) {
     return TensorView<float>::Invalid();
   }
-  interpreter->ResizeInputTensor(kInputIndexFeatures, features.shape());
-  if (interpreter->AllocateTensors() != kTfLiteOk) {
-    TC3_VLOG(1) << "Allocation failed.";
+  if (HasQuantizedFeaturesInput(interpreter)) {
+    if (features.dims() != 2 ||
+        !QuantizeFeaturesInput(features.data(), features.dim(0),
+                               features.dim(1), interpreter)) {
+      return TensorView<float>::Invalid();
+    }
+    return ComputeLogits(interpreter);
+  }
+  if (!AllocateFeaturesInput(features.shape(), interpreter)) {
     return TensorView<float>::Invalid();
   }
 
   SetInput<float>(kInputIndexFeatures, features, interpreter);
 
-  if (interpreter->Invoke() != kTfLiteOk) {
-    TC3_VLOG(1) << "Interpreter failed.";
+  return ComputeLogits(interpreter);
+}
+
+float* ModelExecutor::AllocateFeaturesInput(
+    int batch_size, int features_size, tflite::Interpreter* interpreter) const {
+  if (!interpreter) {
+    return nullptr;
+  }
+  if (!AllocateFeaturesInput({batch_size, features_size}, interpreter)) {
+    return nullptr;
+  }
+  return MutableInputData<float>(kInputIndexFeatures, interpreter);
+}
+
+int ModelExecutor::PaddedBatchSize(int batch_size, int max_batch_size) {
+  int padded_batch_size = 1;
+  while (padded_batch_size < batch_size) {
+    padded_batch_size *= 2;
+  }
+  return std::max(batch_size, std::min(padded_batch_size, max_batch_size));
+}
+
+bool ModelExecutor::AllocateFeaturesInput(
+    const std::vector<int>& shape, tflite::Interpreter* interpreter) const {
+  // A tensor that was never allocated has no data, even if the model gives it
+  // the requested shape.
+  const TfLiteTensor* input = interpreter->input_tensor(kInputIndexFeatures);
+  if (input->data.raw != nullptr &&
+      input->dims->size == static_cast<int>(shape.size()) &&
+      std::equal(shape.begin(), shape.end(), input->dims->data)) {
+    return true;
+  }
+  interpreter->ResizeInputTensor(kInputIndexFeatures, shape);
+  if (interpreter->AllocateTensors() != kTfLiteOk) {
+    TC3_VLOG(1) << "Allocation failed.";
+    // The input keeps the new shape, but not the memory for it. Make sure the
+    // next call doesn't take it for allocated.
+    interpreter->ResizeInputTensor(kInputIndexFeatures, {});
+    return false;
+  }
+  return true;
+}
+
+TensorView<float> ModelExecutor::ComputeLogits(
+    tflite::Interpreter* interpreter) const {
+  if (!interpreter) {
     return TensorView<float>::Invalid();
   }
+  {
+    TC3_TRACE_SCOPE("Interpreter::Invoke");
+    if (interpreter->Invoke() != kTfLiteOk) {
+      TC3_VLOG(1) << "Interpreter failed.";
+      return TensorView<float>::Invalid();
+    }
+  }
 
+  // Quantized models still have to dequantize their logits, the scores are
+  // compared across models and rules.
+  if (interpreter->output_tensor(kOutputIndexLogits)->type != kTfLiteFloat32) {
+    TC3_LOG(ERROR) << "Unsupported logits type.";
+    return TensorView<float>::Invalid();
+  }
   return OutputView<float>(kOutputIndexLogits, interpreter);
 }
 
+bool ModelExecutor::HasQuantizedFeaturesInput(
+    const tflite::Interpreter* interpreter) const {
+  return interpreter != nullptr &&
+         interpreter->input_tensor(kInputIndexFeatures)->type == kTfLiteInt8;
+}
+
+bool ModelExecutor::QuantizeFeaturesInput(
+    const float* features, int batch_size, int features_size,
+    tflite::Interpreter* interpreter) const {
+  if (!interpreter ||
+      !AllocateFeaturesInput({batch_size, features_size}, interpreter)) {
+    return false;
+  }
+  const TfLiteTensor* input = interpreter->input_tensor(kInputIndexFeatures);
+  const float scale = input->params.scale;
+  if (scale <= 0.0f) {
+    TC3_LOG(ERROR) << "Missing quantization parameters of the features.";
+    return false;
+  }
+  const float inverse_scale = 1.0f / scale;
+  const int zero_point = input->params.zero_point;
+  int8_t* data = MutableInputData<int8_t>(kInputIndexFeatures, interpreter);
+  const int size = batch_size * features_size;
+  for (int i = 0; i < size; ++i) {
+    const int value =
+        static_cast<int>(std::round(features[i] * inverse_scale)) + zero_point;
+    data[i] = static_cast<int8_t>(std::min(127, std::max(-128, value)));
+  }
+  return true;
+}
+
+namespace {
+
+// Checks the shapes of the embedding matrix and the scales against the
+// quantization parameters and the pruning mask.
+bool CheckEmbeddingShapes(
+    int num_buckets, int bytes_per_embedding, int scales_rows,
+    int scales_columns, int embedding_size, int quantization_bits,
+    const Model_::EmbeddingPruningMask* embedding_pruning_mask) {
+  if (scales_rows != num_buckets || scales_columns != 1) {
+    return false;
+  }
+  if (!CheckQuantizationParams(bytes_per_embedding, quantization_bits,
+                               embedding_size)) {
+    TC3_LOG(ERROR) << "Mismatch in quantization parameters.";
+    return false;
+  }
+  if (embedding_pruning_mask != nullptr &&
+      embedding_pruning_mask->row_remap() != nullptr &&
+      embedding_pruning_mask->row_remap()->size() > 0) {
+    const flatbuffers::Vector<int32_t>* row_remap =
+        embedding_pruning_mask->row_remap();
+    if (row_remap->size() != num_buckets) {
+      TC3_LOG(ERROR) << "Mismatch in the size of the embedding row remap.";
+      return false;
+    }
+    for (const int32 row : *row_remap) {
+      if (row < 0 || row >= num_buckets) {
+        TC3_LOG(ERROR) << "Invalid row in the embedding row remap: " << row;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+bool TFLiteEmbeddingExecutor::IsValidModelSpec(
+    const flatbuffers::Vector<uint8_t>* model_spec_buffer, int embedding_size,
+    int quantization_bits,
+    const Model_::EmbeddingPruningMask* embedding_pruning_mask) {
+  if (model_spec_buffer == nullptr) {
+    return false;
+  }
+  flatbuffers::Verifier verifier(model_spec_buffer->data(),
+                                 model_spec_buffer->Length());
+  if (!tflite::VerifyModelBuffer(verifier)) {
+    TC3_LOG(ERROR) << "Invalid TFLite model for embeddings.";
+    return false;
+  }
+  const tflite::Model* model = tflite::GetModel(model_spec_buffer->data());
+  if (model->subgraphs() == nullptr || model->subgraphs()->size() != 1) {
+    return false;
+  }
+  const auto* tensors = model->subgraphs()->Get(0)->tensors();
+  if (tensors == nullptr || tensors->size() != 2) {
+    return false;
+  }
+  const flatbuffers::Vector<int32_t>* embeddings_shape =
+      tensors->Get(0)->shape();
+  const flatbuffers::Vector<int32_t>* scales_shape = tensors->Get(1)->shape();
+  if (embeddings_shape == nullptr || embeddings_shape->size() != 2 ||
+      scales_shape == nullptr || scales_shape->size() != 2) {
+    return false;
+  }
+  return CheckEmbeddingShapes(
+      embeddings_shape->Get(0), embeddings_shape->Get(1), scales_shape->Get(0),
+      scales_shape->Get(1), embedding_size, quantization_bits,
+      embedding_pruning_mask);
+}
+
 std::unique_ptr<TFLiteEmbeddingExecutor> TFLiteEmbeddingExecutor::FromBuffer(
     const flatbuffers::Vector<uint8_t>* model_spec_buffer, int embedding_size,
     int quantization_bits,
     const Model_::EmbeddingPruningMask* embedding_pruning_mask) {
+  // The embeddings are read directly from the tensors of the interpreter, so
+  // the model always runs on the default kernels without a delegate.
   std::unique_ptr<TfLiteModelExecutor> executor =
-      TfLiteModelExecutor::FromBuffer(model_spec_buffer);
+      TfLiteModelExecutor::FromBuffer(model_spec_buffer,
+                                      TfLiteExecutorOptions());
   if (!executor) {
     TC3_LOG(ERROR) << "Could not load TFLite model for embeddings.";
     return nullptr;
@@ -69,14 +241,14 @@ std::unique_ptr<TFLiteEmbeddingExecutor> TFLiteEmbeddingExecutor::FromBuffer(
   }
   int num_buckets = embeddings->dims->data[0];
   const TfLiteTensor* scales = interpreter->tensor(1);
-  if (scales->dims->size != 2 || scales->dims->data[0] != num_buckets ||
-      scales->dims->data[1] != 1) {
+  if (scales->dims->size != 2) {
     return nullptr;
   }
   int bytes_per_embedding = embeddings->dims->data[1];
-  if (!CheckQuantizationParams(bytes_per_embedding, quantization_bits,
-                               embedding_size)) {
-    TC3_LOG(ERROR) << "Mismatch in quantization parameters.";
+  if (!CheckEmbeddingShapes(num_buckets, bytes_per_embedding,
+                            scales->dims->data[0], scales->dims->data[1],
+                            embedding_size, quantization_bits,
+                            embedding_pruning_mask)) {
     return nullptr;
   }
 
@@ -102,51 +274,63 @@ TFLiteEmbeddingExecutor::TFLiteEmbeddingExecutor(
       interpreter_(std::move(interpreter)) {
   if ((embedding_pruning_mask != nullptr) &&
       (embedding_pruning_mask->enabled())) {
-    for (int i = 0; i < embedding_pruning_mask->pruning_mask()->size(); i++) {
-      pruning_mask_.push_back((*(embedding_pruning_mask->pruning_mask()))[i]);
+    // Pre-compute the prefix sums: the rank of each word is the number of 1s
+    // in the words before it.
+    uint32 rank = 0;
+    if (embedding_pruning_mask->pruning_mask() != nullptr) {
+      for (const uint64 mask : *embedding_pruning_mask->pruning_mask()) {
+        pruning_mask_.push_back({mask, rank});
+        rank += __builtin_popcountll(mask);
+      }
     }
-    ComputePrefixCounts();
     full_num_buckets_ = embedding_pruning_mask->full_num_buckets();
     pruned_row_bucket_id_ = embedding_pruning_mask->pruned_row_bucket_id();
   } else {
     full_num_buckets_ = num_buckets;
   }
-}
+  if (embedding_pruning_mask == nullptr) {
+    return;
+  }
+  if (embedding_pruning_mask->row_remap() != nullptr &&
+      embedding_pruning_mask->row_remap()->size() > 0) {
+    row_remap_ = embedding_pruning_mask->row_remap();
+  }
 
-void TFLiteEmbeddingExecutor::ComputePrefixCounts() {
-  // Pre-compute the prefix sums.
-  // For each i in {0, 1,...,pruning_mask_.size()-1}, we compute number of 1s
-  // in binary representations of the uint64 values in pruning_mask_ before
-  // index i. We set pruned_row_bucket_id_ to the total number of 1s
-  // in binary representations of all values in pruning_mask_.
-  int count = 0;
-  for (const uint64 mask : pruning_mask_) {
-    prefix_counts_.push_back(count);
-    count += __builtin_popcountll(mask);
+  // The table also folds the remap in, so that it's worth it without pruning.
+  const int num_table_buckets =
+      pruning_mask_.empty() ? num_buckets_ : full_num_buckets_;
+  if ((!pruning_mask_.empty() || row_remap_ != nullptr) &&
+      num_table_buckets <=
+          embedding_pruning_mask->max_buckets_for_row_table() &&
+      (pruning_mask_.empty() ||
+       full_num_buckets_ <= 64 * pruning_mask_.size())) {
+    bucket_rows_.reserve(num_table_buckets);
+    for (int bucket_id = 0; bucket_id < num_table_buckets; ++bucket_id) {
+      bucket_rows_.push_back(RowOfBucket(bucket_id));
+    }
   }
 }
 
 int TFLiteEmbeddingExecutor::PruneBucketId(int bucket_id) const {
   // Implements auxiliary data structure for computing the pruned index of a
   // given bucket_id.
-  // If bucket_id is present in pruning_mask_, we compute floor(bucket_id/64),
-  // look it up in the auxiliary array prefix_counts_, and add to it the number
-  // of 1s before before bucket_id % 64 in the 64-bit sequence
-  // pruning_mask_[floor(bucket_id/64)].
-  // If bucket_id is absent from pruning_mask_, we return pruned_row_bucket_id_.
-  const int bucket_id_major = bucket_id >> 6;
+  // If bucket_id is present in the pruning mask, the row is the rank of the
+  // word floor(bucket_id/64) plus the number of 1s before bucket_id % 64 in
+  // the word. If bucket_id is absent from the mask, we return
+  // pruned_row_bucket_id_.
+  const PruningMaskWord& word = pruning_mask_[bucket_id >> 6];
   const int bucket_id_minor = bucket_id & 63;
-  uint64_t one = 1;
-  if (!(pruning_mask_[bucket_id_major] & (one << bucket_id_minor)))
+  if (!((word.mask >> bucket_id_minor) & 1)) {
     return pruned_row_bucket_id_;
-  const uint64 zero = 0;
-  uint64 minor_mask;
-  if (bucket_id_minor == 0)
-    minor_mask = zero;
-  else
-    minor_mask = ((~zero) >> (64 - bucket_id_minor));
-  return prefix_counts_[bucket_id_major] +
-         __builtin_popcountll(pruning_mask_[bucket_id_major] & minor_mask);
+  }
+  const uint64 minor_mask = (uint64{1} << bucket_id_minor) - 1;
+  return word.rank + __builtin_popcountll(word.mask & minor_mask);
+}
+
+int TFLiteEmbeddingExecutor::RowOfBucket(int bucket_id) const {
+  const int row =
+      pruning_mask_.empty() ? bucket_id : PruneBucketId(bucket_id);
+  return row_remap_ == nullptr ? row : row_remap_->Get(row);
 }
 
 bool TFLiteEmbeddingExecutor::AddEmbedding(
@@ -157,23 +341,16 @@ bool TFLiteEmbeddingExecutor::AddEmbedding(
     return false;
   }
   const int num_sparse_features = sparse_features.size();
+  const int full_num_buckets =
+      pruning_mask_.empty() ? num_buckets_ : full_num_buckets_;
   for (int i = 0; i < num_sparse_features; ++i) {
     const int bucket_id = sparse_features.data()[i];
-    int full_num_buckets;
-    if (!pruning_mask_.empty()) {
-      full_num_buckets = full_num_buckets_;
-    } else {
-      full_num_buckets = num_buckets_;
-    }
     if (bucket_id >= full_num_buckets) {
       return false;
     }
-    int final_bucket_id;
-    if (!pruning_mask_.empty()) {
-      final_bucket_id = PruneBucketId(bucket_id);
-    } else {
-      final_bucket_id = bucket_id;
-    }
+    const int final_bucket_id = bucket_rows_.empty()
+                                    ? RowOfBucket(bucket_id)
+                                    : bucket_rows_[bucket_id];
     if (!DequantizeAdd(scales_->data.f, embeddings_->data.uint8,
                        bytes_per_embedding_, num_sparse_features,
                        quantization_bits_, final_bucket_id, dest, dest_size)) {
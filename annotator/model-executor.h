@@ -20,6 +20,7 @@
 #define LIBTEXTCLASSIFIER_ANNOTATOR_MODEL_EXECUTOR_H_
 
 #include <memory>
+#include <vector>
 
 #include "annotator/types.h"
 #include "utils/base/logging.h"
@@ -32,29 +33,68 @@ namespace libtextclassifier3 {
 class ModelExecutor : public TfLiteModelExecutor {
  public:
   static std::unique_ptr<ModelExecutor> FromModelSpec(
-      const tflite::Model* model_spec) {
+      const tflite::Model* model_spec,
+      const TfLiteExecutorOptions& options = DefaultTfLiteExecutorOptions()) {
     auto model = TfLiteModelFromModelSpec(model_spec);
     if (!model) {
       return nullptr;
     }
-    return std::unique_ptr<ModelExecutor>(new ModelExecutor(std::move(model)));
+    return std::unique_ptr<ModelExecutor>(
+        new ModelExecutor(std::move(model), options));
   }
 
   static std::unique_ptr<ModelExecutor> FromBuffer(
-      const flatbuffers::Vector<uint8_t>* model_spec_buffer) {
+      const flatbuffers::Vector<uint8_t>* model_spec_buffer,
+      const TfLiteExecutorOptions& options = DefaultTfLiteExecutorOptions()) {
     auto model = TfLiteModelFromBuffer(model_spec_buffer);
     if (!model) {
       return nullptr;
     }
-    return std::unique_ptr<ModelExecutor>(new ModelExecutor(std::move(model)));
+    return std::unique_ptr<ModelExecutor>(
+        new ModelExecutor(std::move(model), options));
   }
 
   TensorView<float> ComputeLogits(const TensorView<float>& features,
                                   tflite::Interpreter* interpreter) const;
 
+  // Resizes and allocates the features input for a batch of the given size
+  // and returns the input data, which can then be filled in place and run
+  // with the ComputeLogits overload below. Returns nullptr on failure.
+  // Resizing and re-planning the tensors is skipped if the input is already
+  // allocated with this shape.
+  float* AllocateFeaturesInput(int batch_size, int features_size,
+                               tflite::Interpreter* interpreter) const;
+
+  // Returns the batch size to allocate for running `batch_size` rows: the next
+  // power of two, but at most `max_batch_size`. Padding batches this way makes
+  // the input shapes repeat, so that the allocation of an interpreter can be
+  // reused by the next request.
+  static int PaddedBatchSize(int batch_size, int max_batch_size);
+
+  // Runs the model on the features already written to the input.
+  TensorView<float> ComputeLogits(tflite::Interpreter* interpreter) const;
+
+  // Returns whether the model takes its features as int8, i.e. whether it is
+  // quantized end-to-end. The features input of such a model can't be written
+  // in place: the features are written to a float buffer instead, and then
+  // quantized into the input with QuantizeFeaturesInput.
+  bool HasQuantizedFeaturesInput(const tflite::Interpreter* interpreter) const;
+
+  // Allocates the features input for the batch and quantizes the features to
+  // it, with the scale and zero point of the input tensor.
+  bool QuantizeFeaturesInput(const float* features, int batch_size,
+                             int features_size,
+                             tflite::Interpreter* interpreter) const;
+
  protected:
-  explicit ModelExecutor(std::unique_ptr<const tflite::FlatBufferModel> model)
-      : TfLiteModelExecutor(std::move(model)) {}
+  ModelExecutor(std::unique_ptr<const tflite::FlatBufferModel> model,
+                const TfLiteExecutorOptions& options)
+      : TfLiteModelExecutor(std::move(model), options) {}
+
+  // Resizes the features input to `shape` and allocates the tensors, unless
+  // that's already the case.
+  bool AllocateFeaturesInput(const std::vector<int>& shape,
+                             tflite::Interpreter* interpreter) const;
 
   static const int kInputIndexFeatures = 0;
   static const int kOutputIndexLogits = 0;
@@ -81,19 +121,27 @@ class TFLiteEmbeddingExecutor : public EmbeddingExecutor {
       int quantization_bits,
       const Model_::EmbeddingPruningMask* embedding_pruning_mask = nullptr);
 
+  // Checks the structure of an embedding model without building it: that it
+  // is a TFLite model whose embedding matrix and scales fit the given
+  // embedding size, quantization and pruning mask, as FromBuffer() requires.
+  static bool IsValidModelSpec(
+      const flatbuffers::Vector<uint8_t>* model_spec_buffer, int embedding_size,
+      int quantization_bits,
+      const Model_::EmbeddingPruningMask* embedding_pruning_mask = nullptr);
+
   // Embeds the sparse_features into a dense embedding and adds (+) it
   // element-wise to the dest vector.
   bool AddEmbedding(const TensorView<int>& sparse_features, float* dest,
                     int dest_size) const;
 
-  // Auxiliary function for computing prefixes used in implementation of
-  // efficient mask indexing data structure.
-  void ComputePrefixCounts();
-
   // Function implementing mask indexing based on efficient data structure
   int PruneBucketId(int bucket_id) const;
 
  protected:
+  // Returns the row of the embedding matrix where the embedding of the bucket
+  // is stored, after the pruning mask and the row remap.
+  int RowOfBucket(int bucket_id) const;
+
   explicit TFLiteEmbeddingExecutor(
       std::unique_ptr<TfLiteModelExecutor> executor, int quantization_bits,
       int num_buckets, int bytes_per_embedding, int output_embedding_size,
@@ -114,8 +162,22 @@ class TFLiteEmbeddingExecutor : public EmbeddingExecutor {
   // model params), thus is still thread-safe.
   std::unique_ptr<tflite::Interpreter> interpreter_;
 
-  std::vector<uint64> pruning_mask_;
-  std::vector<uint16> prefix_counts_;
+  // The pruning mask, with each word next to the number of kept buckets
+  // before it, so that ranking a bucket reads a single entry.
+  struct PruningMaskWord {
+    uint64 mask;
+    uint32 rank;
+  };
+  std::vector<PruningMaskWord> pruning_mask_;
+
+  // If not empty, the row of every bucket, see
+  // EmbeddingPruningMask.max_buckets_for_row_table.
+  std::vector<int32> bucket_rows_;
+
+  // If not nullptr, where each row is stored, see
+  // EmbeddingPruningMask.row_remap.
+  const flatbuffers::Vector<int32_t>* row_remap_ = nullptr;
+
   int full_num_buckets_ = -1;
 
   // Index of row of embedding table corresponding to all pruned buckets.
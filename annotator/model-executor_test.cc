@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/model-executor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "annotator/annotator.h"
+#include "gtest/gtest.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+std::string GetModelPath() { return TC3_TEST_DATA_DIR; }
+
+std::string ReadFile(const std::string& file_name) {
+  std::ifstream file_stream(file_name);
+  return std::string(std::istreambuf_iterator<char>(file_stream), {});
+}
+
+class ModelExecutorTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    model_buffer_ = ReadFile(GetModelPath() + "test_model.fb");
+    const Model* model = ViewModel(model_buffer_.data(), model_buffer_.size());
+    ASSERT_NE(model, nullptr);
+    executor_ = ModelExecutor::FromBuffer(model->classification_model());
+    ASSERT_NE(executor_, nullptr);
+    std::unique_ptr<tflite::Interpreter> interpreter =
+        executor_->CreateInterpreter();
+    ASSERT_NE(interpreter, nullptr);
+    const TfLiteTensor* input = interpreter->input_tensor(0);
+    ASSERT_EQ(input->dims->size, 2);
+    features_size_ = input->dims->data[1];
+  }
+
+  // Features of a batch, different for every row.
+  std::vector<float> Features(int batch_size) const {
+    std::vector<float> features(batch_size * features_size_);
+    for (int i = 0; i < features.size(); ++i) {
+      features[i] = ((i * 7919) % 200) / 100.0f - 1.0f;
+    }
+    return features;
+  }
+
+  // The logits of a fresh interpreter for the features.
+  std::vector<float> FreshLogits(const std::vector<float>& features) const {
+    std::unique_ptr<tflite::Interpreter> interpreter =
+        executor_->CreateInterpreter();
+    const int batch_size = features.size() / features_size_;
+    const TensorView<float> logits = executor_->ComputeLogits(
+        TensorView<float>(features.data(), {batch_size, features_size_}),
+        interpreter.get());
+    EXPECT_TRUE(logits.is_valid());
+    return std::vector<float>(logits.data(), logits.data() + logits.size());
+  }
+
+  std::string model_buffer_;
+  std::unique_ptr<ModelExecutor> executor_;
+  int features_size_ = 0;
+};
+
+void ExpectSameLogits(const TensorView<float>& logits,
+                      const std::vector<float>& expected) {
+  ASSERT_TRUE(logits.is_valid());
+  ASSERT_EQ(logits.size(), expected.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_FLOAT_EQ(logits.data()[i], expected[i]) << i;
+  }
+}
+
+TEST_F(ModelExecutorTest, ReusedInterpreterComputesLogitsOfFreshOne) {
+  std::unique_ptr<tflite::Interpreter> interpreter =
+      executor_->CreateInterpreter();
+  ASSERT_NE(interpreter, nullptr);
+
+  // The batch sizes repeat, so that the allocation of the input is reused,
+  // and change, so that it is redone.
+  for (const int batch_size : {1, 3, 3, 8, 1, 3}) {
+    SCOPED_TRACE(batch_size);
+    const std::vector<float> features = Features(batch_size);
+    const std::vector<float> expected = FreshLogits(features);
+
+    // Written in place.
+    float* input = executor_->AllocateFeaturesInput(batch_size, features_size_,
+                                                    interpreter.get());
+    ASSERT_NE(input, nullptr);
+    std::copy(features.begin(), features.end(), input);
+    ExpectSameLogits(executor_->ComputeLogits(interpreter.get()), expected);
+
+    // Copied from a view.
+    ExpectSameLogits(
+        executor_->ComputeLogits(
+            TensorView<float>(features.data(), {batch_size, features_size_}),
+            interpreter.get()),
+        expected);
+  }
+}
+
+// Returns a model that takes int8 features, quantized with the given scale and
+// zero point, and returns them dequantized as its float logits.
+std::string DequantizeModel(int features_size, float scale, int zero_point) {
+  tflite::ModelT model;
+  model.version = 3;
+  model.operator_codes.emplace_back(new tflite::OperatorCodeT);
+  model.operator_codes.back()->builtin_code =
+      tflite::BuiltinOperator_DEQUANTIZE;
+  model.operator_codes.back()->version = 2;
+  // Buffer 0 is the empty buffer of the tensors without data.
+  model.buffers.emplace_back(new tflite::BufferT);
+
+  std::unique_ptr<tflite::SubGraphT> subgraph(new tflite::SubGraphT);
+  std::unique_ptr<tflite::TensorT> features(new tflite::TensorT);
+  features->name = "features";
+  features->shape = {1, features_size};
+  features->type = tflite::TensorType_INT8;
+  features->quantization.reset(new tflite::QuantizationParametersT);
+  features->quantization->scale = {scale};
+  features->quantization->zero_point = {zero_point};
+  subgraph->tensors.push_back(std::move(features));
+  std::unique_ptr<tflite::TensorT> logits(new tflite::TensorT);
+  logits->name = "logits";
+  logits->shape = {1, features_size};
+  logits->type = tflite::TensorType_FLOAT32;
+  subgraph->tensors.push_back(std::move(logits));
+  subgraph->inputs = {0};
+  subgraph->outputs = {1};
+  std::unique_ptr<tflite::OperatorT> dequantize(new tflite::OperatorT);
+  dequantize->opcode_index = 0;
+  dequantize->inputs = {0};
+  dequantize->outputs = {1};
+  subgraph->operators.push_back(std::move(dequantize));
+  model.subgraphs.push_back(std::move(subgraph));
+
+  flatbuffers::FlatBufferBuilder builder;
+  tflite::FinishModelBuffer(builder, tflite::Model::Pack(builder, &model));
+  return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                     builder.GetSize());
+}
+
+TEST(QuantizedModelExecutorTest, QuantizesFeaturesInput) {
+  constexpr int kFeaturesSize = 4;
+  constexpr float kScale = 0.05f;
+  constexpr int kZeroPoint = 3;
+  const std::string model_buffer =
+      DequantizeModel(kFeaturesSize, kScale, kZeroPoint);
+  std::unique_ptr<ModelExecutor> executor =
+      ModelExecutor::FromModelSpec(tflite::GetModel(model_buffer.data()));
+  ASSERT_NE(executor, nullptr);
+  std::unique_ptr<tflite::Interpreter> interpreter =
+      executor->CreateInterpreter();
+  ASSERT_NE(interpreter, nullptr);
+  EXPECT_TRUE(executor->HasQuantizedFeaturesInput(interpreter.get()));
+
+  for (const int batch_size : {1, 3, 3}) {
+    SCOPED_TRACE(batch_size);
+    // Out of range values saturate.
+    std::vector<float> features = {0.0f, 0.12f, -1.0f, 10.0f, -10.0f};
+    features.resize(batch_size * kFeaturesSize, 0.31f);
+    const TensorView<float> logits = executor->ComputeLogits(
+        TensorView<float>(features.data(), {batch_size, kFeaturesSize}),
+        interpreter.get());
+    ASSERT_TRUE(logits.is_valid());
+    ASSERT_EQ(logits.size(), features.size());
+    for (int i = 0; i < features.size(); ++i) {
+      const int quantized =
+          static_cast<int>(std::round(features[i] / kScale)) + kZeroPoint;
+      const float expected =
+          (std::min(127, std::max(-128, quantized)) - kZeroPoint) * kScale;
+      EXPECT_FLOAT_EQ(logits.data()[i], expected) << i;
+    }
+  }
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -46,7 +46,25 @@ bool NumberAnnotator::ClassifyText(
   return false;
 }
 
+namespace {
+// Returns whether the text contains an ASCII digit, which every number needs,
+// and sets "is_ascii" to whether all of it is ASCII.
+bool HasAsciiDigit(const std::string& text, bool* is_ascii) {
+  bool has_digit = false;
+  *is_ascii = true;
+  for (const char c : text) {
+    if (static_cast<unsigned char>(c) >= 0x80) {
+      *is_ascii = false;
+    } else if (c >= '0' && c <= '9') {
+      has_digit = true;
+    }
+  }
+  return has_digit;
+}
+}  // namespace
+
 bool NumberAnnotator::FindAll(const UnicodeText& context,
+                              const std::vector<Token>& tokens,
                               AnnotationUsecase annotation_usecase,
                               std::vector<AnnotatedSpan>* result) const {
   if (!options_->enabled() || ((1 << annotation_usecase) &
@@ -54,15 +72,22 @@ bool NumberAnnotator::FindAll(const UnicodeText& context,
     return true;
   }
 
-  const std::vector<Token> tokens = feature_processor_->Tokenize(context);
   for (const Token& token : tokens) {
-    const UnicodeText token_text =
-        UTF8ToUnicodeText(token.value, /*do_copy=*/false);
+    bool is_ascii;
+    if (!HasAsciiDigit(token.value, &is_ascii)) {
+      continue;
+    }
     int64 parsed_value;
     int num_prefix_codepoints;
     int num_suffix_codepoints;
-    if (ParseNumber(token_text, &parsed_value, &num_prefix_codepoints,
-                    &num_suffix_codepoints)) {
+    const bool parsed =
+        is_ascii
+            ? ParseAsciiNumber(token.value, &parsed_value,
+                               &num_prefix_codepoints, &num_suffix_codepoints)
+            : ParseNumber(UTF8ToUnicodeText(token.value, /*do_copy=*/false),
+                          &parsed_value, &num_prefix_codepoints,
+                          &num_suffix_codepoints);
+    if (parsed) {
       ClassificationResult classification{Collections::Number(),
                                           options_->score()};
       classification.numeric_value = parsed_value;
@@ -93,6 +118,19 @@ std::unordered_set<int> NumberAnnotator::FlatbuffersVectorToSet(
   return result;
 }
 
+std::bitset<128> NumberAnnotator::AsciiCodepointsToBitset(
+    const flatbuffers::Vector<int32_t>* codepoints) {
+  std::bitset<128> result;
+  if (codepoints != nullptr) {
+    for (const int codepoint : *codepoints) {
+      if (codepoint >= 0 && codepoint < 128) {
+        result.set(codepoint);
+      }
+    }
+  }
+  return result;
+}
+
 namespace {
 UnicodeText::const_iterator ConsumeAndParseNumber(
     const UnicodeText::const_iterator& it_begin,
@@ -112,24 +150,24 @@ UnicodeText::const_iterator ConsumeAndParseNumber(
     }
   }
 
-  while (it != it_end) {
-    if (*it >= '0' && *it <= '9') {
-      // When overflow is imminent we'll fail to parse the number.
-      if (*result > INT64_MAX / 10) {
-        return it_begin;
-      }
-      *result *= 10;
-      *result += *it - '0';
-    } else {
-      *result *= sign;
-      return it;
+  const auto it_digits = it;
+  while (it != it_end && *it >= '0' && *it <= '9') {
+    // When overflow is imminent we'll fail to parse the number.
+    if (*result > INT64_MAX / 10) {
+      return it_begin;
     }
-
+    *result *= 10;
+    *result += *it - '0';
     ++it;
   }
 
+  // A sign alone is not a number.
+  if (it == it_digits) {
+    return it_begin;
+  }
+
   *result *= sign;
-  return it_end;
+  return it;
 }
 }  // namespace
 
@@ -184,4 +222,67 @@ bool NumberAnnotator::ParseNumber(const UnicodeText& text, int64* result,
   return valid_suffix;
 }
 
+bool NumberAnnotator::ParseAsciiNumber(const std::string& text, int64* result,
+                                       int* num_prefix_codepoints,
+                                       int* num_suffix_codepoints) const {
+  TC3_CHECK(result != nullptr && num_prefix_codepoints != nullptr &&
+            num_suffix_codepoints != nullptr);
+  const int size = text.size();
+  auto is_in = [&text](const std::bitset<128>& codepoints, int index) {
+    return codepoints.test(static_cast<unsigned char>(text[index]));
+  };
+
+  // Strip boundary codepoints from both ends.
+  int begin = 0;
+  while (begin < size && is_in(ascii_boundary_codepoints_, begin)) {
+    ++begin;
+  }
+  if (begin == size) {
+    return false;
+  }
+  int end = size;
+  while (end > begin && is_in(ascii_boundary_codepoints_, end - 1)) {
+    --end;
+  }
+
+  // Consume prefix codepoints.
+  int i = begin;
+  while (i < size && is_in(ascii_prefix_codepoints_, i)) {
+    ++i;
+  }
+  *num_prefix_codepoints = i;
+
+  // Parse the number.
+  int sign = 1;
+  if (i < size && (text[i] == '-' || text[i] == '+')) {
+    sign = text[i] == '-' ? -1 : 1;
+    ++i;
+  }
+  const int digits_start = i;
+  *result = 0;
+  while (i < size && text[i] >= '0' && text[i] <= '9') {
+    // When overflow is imminent we'll fail to parse the number.
+    if (*result > INT64_MAX / 10) {
+      return false;
+    }
+    *result = *result * 10 + (text[i] - '0');
+    ++i;
+  }
+  if (i == digits_start) {
+    return false;
+  }
+  *result *= sign;
+
+  // Consume suffix codepoints.
+  *num_suffix_codepoints = 0;
+  for (; i < end; ++i) {
+    if (!is_in(ascii_suffix_codepoints_, i)) {
+      return false;
+    }
+    ++(*num_suffix_codepoints);
+  }
+  *num_suffix_codepoints += size - end;
+  return true;
+}
+
 }  // namespace libtextclassifier3
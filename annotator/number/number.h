@@ -17,6 +17,7 @@
 #ifndef LIBTEXTCLASSIFIER_ANNOTATOR_NUMBER_NUMBER_H_
 #define LIBTEXTCLASSIFIER_ANNOTATOR_NUMBER_NUMBER_H_
 
+#include <bitset>
 #include <string>
 #include <unordered_set>
 #include <vector>
@@ -43,7 +44,14 @@ class NumberAnnotator {
         allowed_prefix_codepoints_(
             FlatbuffersVectorToSet(options->allowed_prefix_codepoints())),
         allowed_suffix_codepoints_(
-            FlatbuffersVectorToSet(options->allowed_suffix_codepoints())) {}
+            FlatbuffersVectorToSet(options->allowed_suffix_codepoints())),
+        ascii_prefix_codepoints_(
+            AsciiCodepointsToBitset(options->allowed_prefix_codepoints())),
+        ascii_suffix_codepoints_(
+            AsciiCodepointsToBitset(options->allowed_suffix_codepoints())),
+        ascii_boundary_codepoints_(AsciiCodepointsToBitset(
+            feature_processor->GetOptions()
+                ->ignored_span_boundary_codepoints())) {}
 
   // Classifies given text, and if it is a number, it passes the result in
   // 'classification_result' and returns true, otherwise returns false.
@@ -51,8 +59,10 @@ class NumberAnnotator {
                     AnnotationUsecase annotation_usecase,
                     ClassificationResult* classification_result) const;
 
-  // Finds all number instances in the input text.
+  // Finds all number instances among the tokens of the input text, which need
+  // to come from the feature processor of the annotator.
   bool FindAll(const UnicodeText& context_unicode,
+               const std::vector<Token>& tokens,
                AnnotationUsecase annotation_usecase,
                std::vector<AnnotatedSpan>* result) const;
 
@@ -60,6 +70,10 @@ class NumberAnnotator {
   static std::unordered_set<int> FlatbuffersVectorToSet(
       const flatbuffers::Vector<int32_t>* codepoints);
 
+  // Returns the set of the ASCII codepoints among the given ones.
+  static std::bitset<128> AsciiCodepointsToBitset(
+      const flatbuffers::Vector<int32_t>* codepoints);
+
   // Parses the text to an int64 value and returns true if succeeded, otherwise
   // false. Also returns the number of prefix/suffix codepoints that were
   // stripped from the number.
@@ -67,10 +81,22 @@ class NumberAnnotator {
                    int* num_prefix_codepoints,
                    int* num_suffix_codepoints) const;
 
+  // Same as above, but for text that is known to be ASCII only, working on the
+  // bytes directly.
+  bool ParseAsciiNumber(const std::string& text, int64* result,
+                        int* num_prefix_codepoints,
+                        int* num_suffix_codepoints) const;
+
   const NumberAnnotatorOptions* options_;
   const FeatureProcessor* feature_processor_;
   const std::unordered_set<int> allowed_prefix_codepoints_;
   const std::unordered_set<int> allowed_suffix_codepoints_;
+
+  // The ASCII subsets of the allowed prefix and suffix codepoints and of the
+  // ignored span boundary codepoints of the feature processor.
+  const std::bitset<128> ascii_prefix_codepoints_;
+  const std::bitset<128> ascii_suffix_codepoints_;
+  const std::bitset<128> ascii_boundary_codepoints_;
 };
 
 }  // namespace libtextclassifier3
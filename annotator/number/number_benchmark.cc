@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Benchmark of NumberAnnotator::FindAll on number-dense texts, with the
+// tokenizer of the English annotator model.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "annotator/annotator.h"
+#include "annotator/feature-processor.h"
+#include "annotator/model_generated.h"
+#include "annotator/number/number.h"
+#include "annotator/types.h"
+#include "utils/memory/mmap.h"
+#include "utils/testing/benchmark-utils.h"
+#include "utils/utf8/unicodetext.h"
+#include "utils/utf8/unilib.h"
+#include "benchmark/benchmark.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+// Kinds of number-dense texts.
+enum class NumberText {
+  // Lines of an invoice: quantities, prices, percentages and totals.
+  kInvoice = 0,
+  // Lines of a server log: timestamps, ids, durations and sizes.
+  kLog = 1,
+};
+
+// Returns `num_bytes` bytes (rounded up to a line) of the kind of text, with
+// numbers that differ from line to line.
+std::string NumberTextOfLength(NumberText kind, int num_bytes) {
+  std::string text;
+  for (int i = 0; text.size() < num_bytes; ++i) {
+    const std::string n = std::to_string(i);
+    const std::string m = std::to_string((i * 7919) % 100000);
+    if (kind == NumberText::kInvoice) {
+      text += "Item " + n + ": " + std::to_string(i % 9 + 1) + " x $" + m +
+              ".50, discount " + std::to_string(i % 30) + "%, total $" +
+              std::to_string((i % 9 + 1) * ((i * 7919) % 100000)) + "\n";
+    } else {
+      text += "2019-03-04 12:" + std::to_string(10 + i % 50) + ":" +
+              std::to_string(10 + (i * 7) % 50) + " pid " + m + " request " +
+              n + " took " + std::to_string(i % 500) + " ms, sent " +
+              std::to_string((i * 104729) % 1000000) + " bytes\n";
+    }
+  }
+  return text;
+}
+
+// The model and the parts of it the benchmark uses, loaded once.
+struct NumberModel {
+  explicit NumberModel(const std::string& path) : mmap(path) {}
+
+  ScopedMmap mmap;
+  UniLib unilib;
+  std::unique_ptr<FeatureProcessor> feature_processor;
+  std::unique_ptr<NumberAnnotator> number_annotator;
+};
+
+// Returns the options of the number annotator for models without them: the
+// prefixes and suffixes of amounts and percentages.
+const NumberAnnotatorOptions* DefaultNumberAnnotatorOptions() {
+  static const flatbuffers::DetachedBuffer* options_data = []() {
+    NumberAnnotatorOptionsT options;
+    options.enabled = true;
+    options.allowed_prefix_codepoints.push_back('$');
+    options.allowed_suffix_codepoints.push_back('%');
+
+    flatbuffers::FlatBufferBuilder builder;
+    builder.Finish(NumberAnnotatorOptions::Pack(builder, &options));
+    return new flatbuffers::DetachedBuffer(builder.Release());
+  }();
+  return flatbuffers::GetRoot<NumberAnnotatorOptions>(options_data->data());
+}
+
+// Returns the number annotator with the selection feature processor of the
+// model, as the annotator builds it, or nullptr if the model isn't available.
+const NumberModel* GetNumberModel() {
+  static const NumberModel* const number_model = []() {
+    std::unique_ptr<NumberModel> number_model(
+        new NumberModel(BenchmarkModelPath("textclassifier.en.model")));
+    if (!number_model->mmap.handle().ok()) {
+      return static_cast<NumberModel*>(nullptr);
+    }
+    const Model* model = ViewModel(number_model->mmap.handle().start(),
+                                   number_model->mmap.handle().num_bytes());
+    if (model == nullptr || model->selection_feature_options() == nullptr) {
+      return static_cast<NumberModel*>(nullptr);
+    }
+    number_model->feature_processor.reset(new FeatureProcessor(
+        model->selection_feature_options(), &number_model->unilib));
+    number_model->number_annotator.reset(new NumberAnnotator(
+        model->number_annotator_options() != nullptr
+            ? model->number_annotator_options()
+            : DefaultNumberAnnotatorOptions(),
+        number_model->feature_processor.get()));
+    return number_model.release();
+  }();
+  return number_model;
+}
+
+// Registers the arguments {kind of text, text length in bytes}.
+void NumberTextsAndLengths(benchmark::internal::Benchmark* benchmark) {
+  for (const NumberText kind : {NumberText::kInvoice, NumberText::kLog}) {
+    for (const int length : {256, 4096, 65536}) {
+      benchmark->Args({static_cast<int>(kind), length});
+    }
+  }
+}
+
+void BM_NumberAnnotatorFindAll(benchmark::State& state) {
+  const NumberModel* number_model = GetNumberModel();
+  if (number_model == nullptr) {
+    state.SkipWithError("Couldn't load the model.");
+    return;
+  }
+  const NumberText kind = static_cast<NumberText>(state.range(0));
+  state.SetLabel(kind == NumberText::kInvoice ? "invoice" : "log");
+  const std::string text = NumberTextOfLength(kind, state.range(1));
+  const UnicodeText text_unicode = UTF8ToUnicodeText(text, /*do_copy=*/false);
+  // The annotator tokenizes once for all its annotators, so the tokenization
+  // isn't measured.
+  const std::vector<Token> tokens =
+      number_model->feature_processor->Tokenize(text_unicode);
+
+  std::vector<AnnotatedSpan> result;
+  RunMeasuredBenchmark(state, text.size(), [&]() {
+    result.clear();
+    number_model->number_annotator->FindAll(
+        text_unicode, tokens, AnnotationUsecase_ANNOTATION_USECASE_SMART,
+        &result);
+    benchmark::DoNotOptimize(result.data());
+  });
+}
+BENCHMARK(BM_NumberAnnotatorFindAll)->Apply(NumberTextsAndLengths);
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -85,6 +85,10 @@ class NumberAnnotatorTest : public ::testing::Test {
         number_annotator_(TestingNumberAnnotatorOptions(),
                           &feature_processor_) {}
 
+  std::vector<Token> Tokenize(const UnicodeText& text) {
+    return feature_processor_.Tokenize(text);
+  }
+
   UniLib unilib_;
   FeatureProcessor feature_processor_;
   NumberAnnotator number_annotator_;
@@ -109,10 +113,12 @@ TEST_F(NumberAnnotatorTest, ClassifiesNonNumberCorrectly) {
 
 TEST_F(NumberAnnotatorTest, FindsAllNumbersInText) {
   std::vector<AnnotatedSpan> result;
+  const UnicodeText text = UTF8ToUnicodeText(
+      "... 12345 ... 9 is my number and I paid $99 and sometimes 27% but not "
+      "68# nor #68");
   EXPECT_TRUE(number_annotator_.FindAll(
-      UTF8ToUnicodeText("... 12345 ... 9 is my number and I paid $99 and "
-                        "sometimes 27% but not 68# nor #68"),
-      AnnotationUsecase_ANNOTATION_USECASE_RAW, &result));
+      text, Tokenize(text), AnnotationUsecase_ANNOTATION_USECASE_RAW,
+      &result));
 
   ASSERT_EQ(result.size(), 4);
   ASSERT_EQ(result[0].classification.size(), 1);
@@ -131,9 +137,10 @@ TEST_F(NumberAnnotatorTest, FindsAllNumbersInText) {
 
 TEST_F(NumberAnnotatorTest, FindsNumberWithPunctuation) {
   std::vector<AnnotatedSpan> result;
+  const UnicodeText text = UTF8ToUnicodeText("Come at 9, ok?");
   EXPECT_TRUE(number_annotator_.FindAll(
-      UTF8ToUnicodeText("Come at 9, ok?"),
-      AnnotationUsecase_ANNOTATION_USECASE_RAW, &result));
+      text, Tokenize(text), AnnotationUsecase_ANNOTATION_USECASE_RAW,
+      &result));
 
   EXPECT_THAT(
       result,
@@ -147,8 +154,9 @@ TEST_F(NumberAnnotatorTest, FindsNumberWithPunctuation) {
 
 TEST_F(NumberAnnotatorTest, HandlesNumbersAtBeginning) {
   std::vector<AnnotatedSpan> result;
+  const UnicodeText text = UTF8ToUnicodeText("-5");
   EXPECT_TRUE(number_annotator_.FindAll(
-      UTF8ToUnicodeText("-5"), AnnotationUsecase_ANNOTATION_USECASE_RAW,
+      text, Tokenize(text), AnnotationUsecase_ANNOTATION_USECASE_RAW,
       &result));
 
   EXPECT_THAT(
@@ -229,8 +237,9 @@ TEST_F(NumberAnnotatorTest, WhenMinusInTheMiddleDoesNotParseIt) {
 
 TEST_F(NumberAnnotatorTest, WhenSuffixWithoutNumberDoesNotParseIt) {
   std::vector<AnnotatedSpan> result;
+  const UnicodeText text = UTF8ToUnicodeText("... % ...");
   EXPECT_TRUE(number_annotator_.FindAll(
-      UTF8ToUnicodeText("... % ..."), AnnotationUsecase_ANNOTATION_USECASE_RAW,
+      text, Tokenize(text), AnnotationUsecase_ANNOTATION_USECASE_RAW,
       &result));
 
   ASSERT_EQ(result.size(), 0);
@@ -238,8 +247,9 @@ TEST_F(NumberAnnotatorTest, WhenSuffixWithoutNumberDoesNotParseIt) {
 
 TEST_F(NumberAnnotatorTest, WhenPrefixWithoutNumberDoesNotParseIt) {
   std::vector<AnnotatedSpan> result;
+  const UnicodeText text = UTF8ToUnicodeText("... $ ...");
   EXPECT_TRUE(number_annotator_.FindAll(
-      UTF8ToUnicodeText("... $ ..."), AnnotationUsecase_ANNOTATION_USECASE_RAW,
+      text, Tokenize(text), AnnotationUsecase_ANNOTATION_USECASE_RAW,
       &result));
 
   ASSERT_EQ(result.size(), 0);
@@ -247,12 +257,45 @@ TEST_F(NumberAnnotatorTest, WhenPrefixWithoutNumberDoesNotParseIt) {
 
 TEST_F(NumberAnnotatorTest, WhenPrefixAndSuffixWithoutNumberDoesNotParseIt) {
   std::vector<AnnotatedSpan> result;
+  const UnicodeText text = UTF8ToUnicodeText("... $% ...");
   EXPECT_TRUE(number_annotator_.FindAll(
-      UTF8ToUnicodeText("... $% ..."), AnnotationUsecase_ANNOTATION_USECASE_RAW,
+      text, Tokenize(text), AnnotationUsecase_ANNOTATION_USECASE_RAW,
       &result));
 
   ASSERT_EQ(result.size(), 0);
 }
 
+TEST_F(NumberAnnotatorTest, WhenSignWithoutNumberDoesNotParseIt) {
+  ClassificationResult classification_result;
+  EXPECT_FALSE(number_annotator_.ClassifyText(
+      UTF8ToUnicodeText("... - ..."), {4, 5},
+      AnnotationUsecase_ANNOTATION_USECASE_RAW, &classification_result));
+  EXPECT_FALSE(number_annotator_.ClassifyText(
+      UTF8ToUnicodeText("... +% ..."), {4, 6},
+      AnnotationUsecase_ANNOTATION_USECASE_RAW, &classification_result));
+}
+
+TEST_F(NumberAnnotatorTest, FindsNumbersInNonAsciiTokens) {
+  std::vector<AnnotatedSpan> result;
+  const UnicodeText text = UTF8ToUnicodeText("Zaplatil jsem 25% a 7ž, ne 3,");
+  EXPECT_TRUE(number_annotator_.FindAll(
+      text, Tokenize(text), AnnotationUsecase_ANNOTATION_USECASE_RAW,
+      &result));
+
+  // "7ž" is not a number, the other tokens are parsed the same way whether or
+  // not they are ASCII.
+  EXPECT_THAT(
+      result,
+      ElementsAre(
+          AllOf(Field(&AnnotatedSpan::span, CodepointSpan(14, 16)),
+                Field(&AnnotatedSpan::classification,
+                      ElementsAre(Field(&ClassificationResult::numeric_value,
+                                        25)))),
+          AllOf(Field(&AnnotatedSpan::span, CodepointSpan(27, 28)),
+                Field(&AnnotatedSpan::classification,
+                      ElementsAre(Field(&ClassificationResult::numeric_value,
+                                        3))))));
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
@@ -18,6 +18,18 @@
 
 #include "utils/base/logging.h"
 
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TC3_QUANTIZATION_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define TC3_QUANTIZATION_SSE2
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TC3_QUANTIZATION_AVX2
+#endif
+#endif
+
 namespace libtextclassifier3 {
 namespace {
 float DequantizeValue(int num_sparse_features, int quantization_bias,
@@ -25,25 +37,28 @@ float DequantizeValue(int num_sparse_features, int quantization_bias,
   return 1.0 / num_sparse_features * (value - quantization_bias) * multiplier;
 }
 
-void DequantizeAdd8bit(const float* scales, const uint8* embeddings,
-                       int bytes_per_embedding, const int num_sparse_features,
-                       const int bucket_id, float* dest, int dest_size) {
+// Scalar implementations, dequantizing the values from index begin on.
+void DequantizeAdd8bitScalar(const float* scales, const uint8* embeddings,
+                             int bytes_per_embedding,
+                             const int num_sparse_features,
+                             const int bucket_id, int begin, float* dest,
+                             int dest_size) {
   static const int kQuantizationBias8bit = 128;
   const float multiplier = scales[bucket_id];
-  for (int k = 0; k < dest_size; ++k) {
+  for (int k = begin; k < dest_size; ++k) {
     dest[k] +=
         DequantizeValue(num_sparse_features, kQuantizationBias8bit, multiplier,
                         embeddings[bucket_id * bytes_per_embedding + k]);
   }
 }
 
-void DequantizeAddNBit(const float* scales, const uint8* embeddings,
-                       int bytes_per_embedding, int num_sparse_features,
-                       int quantization_bits, int bucket_id, float* dest,
-                       int dest_size) {
+void DequantizeAddNBitScalar(const float* scales, const uint8* embeddings,
+                             int bytes_per_embedding, int num_sparse_features,
+                             int quantization_bits, int bucket_id, int begin,
+                             float* dest, int dest_size) {
   const int quantization_bias = 1 << (quantization_bits - 1);
   const float multiplier = scales[bucket_id];
-  for (int i = 0; i < dest_size; ++i) {
+  for (int i = begin; i < dest_size; ++i) {
     const int bit_offset = i * quantization_bits;
     const int read16_offset = bit_offset / 8;
 
@@ -59,6 +74,150 @@ void DequantizeAddNBit(const float* scales, const uint8* embeddings,
                                multiplier, value);
   }
 }
+
+// Vectorized implementations for the 8-bit and 4-bit quantization. They
+// process as many values as fit whole vector registers and leave the rest to
+// the scalar code. The values are computed in single precision, so they can
+// differ from the scalar results in the last bits.
+#if defined(TC3_QUANTIZATION_NEON)
+
+// Adds (values - bias) * factor of 8 unsigned bytes to dest.
+inline void AddDequantized8(uint8x8_t bytes, int32x4_t bias,
+                            float32x4_t factor, float* dest) {
+  const uint16x8_t values = vmovl_u8(bytes);
+  const int32x4_t low = vsubq_s32(
+      vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(values))), bias);
+  const int32x4_t high = vsubq_s32(
+      vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(values))), bias);
+  vst1q_f32(dest, vmlaq_f32(vld1q_f32(dest), vcvtq_f32_s32(low), factor));
+  vst1q_f32(dest + 4,
+            vmlaq_f32(vld1q_f32(dest + 4), vcvtq_f32_s32(high), factor));
+}
+
+int DequantizeAdd8bitVectorized(const uint8* row, float factor, float* dest,
+                                int dest_size) {
+  const int32x4_t bias = vdupq_n_s32(128);
+  const float32x4_t factor_vector = vdupq_n_f32(factor);
+  int k = 0;
+  for (; k + 8 <= dest_size; k += 8) {
+    AddDequantized8(vld1_u8(row + k), bias, factor_vector, dest + k);
+  }
+  return k;
+}
+
+int DequantizeAdd4bitVectorized(const uint8* row, float factor, float* dest,
+                                int dest_size) {
+  const int32x4_t bias = vdupq_n_s32(8);
+  const float32x4_t factor_vector = vdupq_n_f32(factor);
+  const uint8x8_t mask = vdup_n_u8(0x0F);
+  int k = 0;
+  for (; k + 16 <= dest_size; k += 16) {
+    const uint8x8_t bytes = vld1_u8(row + k / 2);
+    // Even values are in the low nibbles, odd values in the high ones.
+    const uint8x8x2_t values =
+        vzip_u8(vand_u8(bytes, mask), vshr_n_u8(bytes, 4));
+    AddDequantized8(values.val[0], bias, factor_vector, dest + k);
+    AddDequantized8(values.val[1], bias, factor_vector, dest + k + 8);
+  }
+  return k;
+}
+
+#elif defined(TC3_QUANTIZATION_SSE2)
+
+// Adds (values - bias) * factor of the 8 lowest unsigned bytes to dest.
+inline void AddDequantized8(__m128i bytes, __m128i bias, __m128 factor,
+                            float* dest) {
+#if defined(TC3_QUANTIZATION_AVX2)
+  const __m256i values = _mm256_sub_epi32(_mm256_cvtepu8_epi32(bytes),
+                                          _mm256_broadcastsi128_si256(bias));
+  _mm256_storeu_ps(
+      dest, _mm256_add_ps(_mm256_loadu_ps(dest),
+                          _mm256_mul_ps(_mm256_cvtepi32_ps(values),
+                                        _mm256_broadcastss_ps(factor))));
+#else
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i values = _mm_unpacklo_epi8(bytes, zero);
+  const __m128i low = _mm_sub_epi32(_mm_unpacklo_epi16(values, zero), bias);
+  const __m128i high = _mm_sub_epi32(_mm_unpackhi_epi16(values, zero), bias);
+  _mm_storeu_ps(dest, _mm_add_ps(_mm_loadu_ps(dest),
+                                 _mm_mul_ps(_mm_cvtepi32_ps(low), factor)));
+  _mm_storeu_ps(dest + 4,
+                _mm_add_ps(_mm_loadu_ps(dest + 4),
+                           _mm_mul_ps(_mm_cvtepi32_ps(high), factor)));
+#endif
+}
+
+int DequantizeAdd8bitVectorized(const uint8* row, float factor, float* dest,
+                                int dest_size) {
+  const __m128i bias = _mm_set1_epi32(128);
+  const __m128 factor_vector = _mm_set1_ps(factor);
+  int k = 0;
+  for (; k + 8 <= dest_size; k += 8) {
+    AddDequantized8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + k)),
+                    bias, factor_vector, dest + k);
+  }
+  return k;
+}
+
+int DequantizeAdd4bitVectorized(const uint8* row, float factor, float* dest,
+                                int dest_size) {
+  const __m128i bias = _mm_set1_epi32(8);
+  const __m128 factor_vector = _mm_set1_ps(factor);
+  const __m128i mask = _mm_set1_epi8(0x0F);
+  int k = 0;
+  for (; k + 16 <= dest_size; k += 16) {
+    const __m128i bytes =
+        _mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + k / 2));
+    // Even values are in the low nibbles, odd values in the high ones.
+    const __m128i values =
+        _mm_unpacklo_epi8(_mm_and_si128(bytes, mask),
+                          _mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+    AddDequantized8(values, bias, factor_vector, dest + k);
+    AddDequantized8(_mm_srli_si128(values, 8), bias, factor_vector,
+                    dest + k + 8);
+  }
+  return k;
+}
+
+#else
+
+int DequantizeAdd8bitVectorized(const uint8* row, float factor, float* dest,
+                                int dest_size) {
+  return 0;
+}
+
+int DequantizeAdd4bitVectorized(const uint8* row, float factor, float* dest,
+                                int dest_size) {
+  return 0;
+}
+
+#endif
+
+void DequantizeAdd8bit(const float* scales, const uint8* embeddings,
+                       int bytes_per_embedding, const int num_sparse_features,
+                       const int bucket_id, float* dest, int dest_size) {
+  const int begin = DequantizeAdd8bitVectorized(
+      embeddings + bucket_id * bytes_per_embedding,
+      scales[bucket_id] / num_sparse_features, dest, dest_size);
+  DequantizeAdd8bitScalar(scales, embeddings, bytes_per_embedding,
+                          num_sparse_features, bucket_id, begin, dest,
+                          dest_size);
+}
+
+void DequantizeAddNBit(const float* scales, const uint8* embeddings,
+                       int bytes_per_embedding, int num_sparse_features,
+                       int quantization_bits, int bucket_id, float* dest,
+                       int dest_size) {
+  int begin = 0;
+  if (quantization_bits == 4) {
+    begin = DequantizeAdd4bitVectorized(
+        embeddings + bucket_id * bytes_per_embedding,
+        scales[bucket_id] / num_sparse_features, dest, dest_size);
+  }
+  DequantizeAddNBitScalar(scales, embeddings, bytes_per_embedding,
+                          num_sparse_features, quantization_bits, bucket_id,
+                          begin, dest, dest_size);
+}
 }  // namespace
 
 bool CheckQuantizationParams(int bytes_per_embedding, int quantization_bits,
@@ -159,5 +159,62 @@ TEST(QuantizationTest, DequantizeAdd3bit) {
   EXPECT_THAT(dest, ElementsAreFloat(expected));
 }
 
+// Checks the vectorized code paths (used for whole blocks of values) and the
+// scalar tail against a direct computation of the dequantized values.
+void ExpectDequantizeAddMatchesReference(int quantization_bits,
+                                         int embedding_size) {
+  const int num_buckets = 3;
+  const int bucket_id = 2;
+  const int num_sparse_features = 3;
+  const int bytes_per_embedding =
+      (embedding_size * quantization_bits + 7) / 8;
+  const std::vector<float> scales = {0.5, -2.0, 0.25};
+  std::vector<uint8> embeddings(bytes_per_embedding * num_buckets);
+  for (int i = 0; i < embeddings.size(); ++i) {
+    embeddings[i] = (i * 37 + 11) % 256;
+  }
+
+  std::vector<float> dest(embedding_size);
+  std::vector<float> expected(embedding_size);
+  const int quantization_bias = 1 << (quantization_bits - 1);
+  for (int i = 0; i < embedding_size; ++i) {
+    dest[i] = 0.1 * i;
+    const int bit_offset = i * quantization_bits;
+    int value = embeddings[bucket_id * bytes_per_embedding + bit_offset / 8];
+    if (bit_offset / 8 + 1 < bytes_per_embedding) {
+      value |=
+          embeddings[bucket_id * bytes_per_embedding + bit_offset / 8 + 1]
+          << 8;
+    }
+    value = (value >> (bit_offset % 8)) & ((1 << quantization_bits) - 1);
+    expected[i] = dest[i] + 1.0 / num_sparse_features *
+                                (value - quantization_bias) *
+                                scales[bucket_id];
+  }
+
+  EXPECT_TRUE(DequantizeAdd(scales.data(), embeddings.data(),
+                            bytes_per_embedding, num_sparse_features,
+                            quantization_bits, bucket_id, dest.data(),
+                            dest.size()));
+  for (int i = 0; i < embedding_size; ++i) {
+    EXPECT_NEAR(dest[i], expected[i], 1e-5) << "at index " << i;
+  }
+}
+
+TEST(QuantizationTest, DequantizeAdd8bitLongEmbedding) {
+  ExpectDequantizeAddMatchesReference(/*quantization_bits=*/8,
+                                      /*embedding_size=*/35);
+}
+
+TEST(QuantizationTest, DequantizeAdd4bitLongEmbedding) {
+  ExpectDequantizeAddMatchesReference(/*quantization_bits=*/4,
+                                      /*embedding_size=*/37);
+}
+
+TEST(QuantizationTest, DequantizeAdd3bitLongEmbedding) {
+  ExpectDequantizeAddMatchesReference(/*quantization_bits=*/3,
+                                      /*embedding_size=*/29);
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
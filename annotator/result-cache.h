@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Cache of annotator results shared between requests.
+
+#ifndef LIBTEXTCLASSIFIER_ANNOTATOR_RESULT_CACHE_H_
+#define LIBTEXTCLASSIFIER_ANNOTATOR_RESULT_CACHE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <list>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "utils/base/integral_types.h"
+#include "utils/hash/farmhash.h"
+
+namespace libtextclassifier3 {
+
+struct ResultCacheStats {
+  int64 num_hits = 0;
+  int64 num_misses = 0;
+  int64 num_evictions = 0;
+
+  // Lookups that found a result older than the time-to-live, counted as misses
+  // too.
+  int64 num_expirations = 0;
+
+  // Number of cached results.
+  int size = 0;
+
+  // Estimated memory of the cached keys and results, see
+  // ApproximateResultBytes().
+  int64 bytes = 0;
+};
+
+// Estimated memory of a cached result: its size and the buffer it owns
+// directly, not the buffers owned by its elements.
+template <typename Result>
+int64 ApproximateResultBytes(const Result& result) {
+  return sizeof(result);
+}
+
+inline int64 ApproximateResultBytes(const std::string& result) {
+  return sizeof(result) + result.size();
+}
+
+template <typename T>
+int64 ApproximateResultBytes(const std::vector<T>& result) {
+  return sizeof(result) + result.capacity() * sizeof(T);
+}
+
+// A bounded least-recently-used cache of results, for inputs that repeat a
+// lot (e.g. templated notifications). The keys are built by the caller from
+// the input and the options the result depends on.
+//
+// The cache is split into shards by the hash of the key, each with its own
+// lock, so that concurrent requests rarely wait on each other. Every shard
+// holds up to its share of the capacity.
+//
+// Results can also be given a time-to-live, for the callers whose results
+// depend on state outside of the key that changes over time.
+//
+// The class is thread-safe.
+template <typename Result>
+class ResultCache {
+ public:
+  static constexpr int kDefaultNumShards = 8;
+
+  // A capacity of 0 disables the cache.
+  explicit ResultCache(int capacity = 0, int num_shards = kDefaultNumShards)
+      : capacity_(std::max(0, capacity)),
+        shards_(std::max(1, num_shards)) {}
+
+  // Copies the cached result for the key to result. Returns false if there is
+  // none.
+  bool Lookup(const std::string& key, Result* result) {
+    if (!enabled()) {
+      return false;
+    }
+    Shard& shard = ShardForKey(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+      ++shard.num_misses;
+      return false;
+    }
+    if (IsExpired(*it->second)) {
+      shard.entries.erase(it->second);
+      shard.index.erase(it);
+      ++shard.num_expirations;
+      ++shard.num_misses;
+      return false;
+    }
+    ++shard.num_hits;
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    *result = it->second->result;
+    return true;
+  }
+
+  // Caches the result for the key, evicting the least recently used one of its
+  // shard if the shard is full.
+  void Insert(const std::string& key, const Result& result) {
+    if (!enabled()) {
+      return;
+    }
+    Shard& shard = ShardForKey(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      it->second->result = result;
+      it->second->insertion_time = std::chrono::steady_clock::now();
+      shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+      return;
+    }
+    shard.entries.push_front(
+        Entry{key, result, std::chrono::steady_clock::now()});
+    shard.index[key] = shard.entries.begin();
+    EvictOverCapacity(&shard);
+  }
+
+  // Sets the maximum number of cached results, evicting the least recently
+  // used ones that don't fit.
+  void SetCapacity(int capacity) {
+    capacity_ = std::max(0, capacity);
+    for (Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      EvictOverCapacity(&shard);
+    }
+  }
+
+  // Sets how long a result stays valid after it was inserted. Older results
+  // are dropped when looked up. A time-to-live of 0, the default, keeps them
+  // until they are evicted.
+  void SetTtlMs(int64 ttl_ms) { ttl_ms_ = std::max<int64>(0, ttl_ms); }
+
+  // Drops all the cached results, e.g. when they became stale.
+  void Clear() {
+    for (Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      shard.entries.clear();
+      shard.index.clear();
+    }
+  }
+
+  bool enabled() const { return capacity_ > 0; }
+
+  ResultCacheStats GetStats() const {
+    ResultCacheStats stats;
+    for (const Shard& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      stats.num_hits += shard.num_hits;
+      stats.num_misses += shard.num_misses;
+      stats.num_evictions += shard.num_evictions;
+      stats.num_expirations += shard.num_expirations;
+      stats.size += shard.index.size();
+      for (const Entry& entry : shard.entries) {
+        // The key is held by both the entry and the index.
+        stats.bytes += sizeof(Entry) + 2 * entry.key.size() +
+                       ApproximateResultBytes(entry.result) -
+                       sizeof(entry.result) +
+                       sizeof(typename decltype(shard.index)::value_type);
+      }
+    }
+    return stats;
+  }
+
+ private:
+  struct Entry {
+    std::string key;
+    Result result;
+    std::chrono::steady_clock::time_point insertion_time;
+  };
+
+  struct Shard {
+    mutable std::mutex mutex;
+
+    // Most recently used first.
+    std::list<Entry> entries;
+    std::unordered_map<std::string, typename std::list<Entry>::iterator> index;
+    int64 num_hits = 0;
+    int64 num_misses = 0;
+    int64 num_evictions = 0;
+    int64 num_expirations = 0;
+  };
+
+  Shard& ShardForKey(const std::string& key) {
+    return shards_[tc3farmhash::Fingerprint64(key) % shards_.size()];
+  }
+
+  bool IsExpired(const Entry& entry) const {
+    const int64 ttl_ms = ttl_ms_;
+    return ttl_ms > 0 &&
+           std::chrono::steady_clock::now() - entry.insertion_time >
+               std::chrono::milliseconds(ttl_ms);
+  }
+
+  // Evicts the entries of the shard over its share of the capacity. Needs the
+  // lock of the shard to be held.
+  void EvictOverCapacity(Shard* shard) {
+    const int shard_capacity =
+        (capacity_ + shards_.size() - 1) / shards_.size();
+    while (shard->index.size() > shard_capacity) {
+      shard->index.erase(shard->entries.back().key);
+      shard->entries.pop_back();
+      ++shard->num_evictions;
+    }
+  }
+
+  std::atomic<int> capacity_;
+  std::atomic<int64> ttl_ms_{0};
+  std::vector<Shard> shards_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_ANNOTATOR_RESULT_CACHE_H_
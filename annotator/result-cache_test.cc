@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/result-cache.h"
+
+#include <chrono>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(ResultCacheTest, DisabledByDefault) {
+  ResultCache<std::string> cache;
+  cache.Insert("key", "value");
+
+  std::string result;
+  EXPECT_FALSE(cache.Lookup("key", &result));
+  EXPECT_EQ(cache.GetStats().size, 0);
+}
+
+TEST(ResultCacheTest, FindsInsertedResults) {
+  ResultCache<std::string> cache(/*capacity=*/10);
+  cache.Insert("key", "value");
+
+  std::string result;
+  EXPECT_TRUE(cache.Lookup("key", &result));
+  EXPECT_EQ(result, "value");
+  EXPECT_FALSE(cache.Lookup("other key", &result));
+
+  const ResultCacheStats stats = cache.GetStats();
+  EXPECT_EQ(stats.num_hits, 1);
+  EXPECT_EQ(stats.num_misses, 1);
+  EXPECT_EQ(stats.num_evictions, 0);
+  EXPECT_EQ(stats.size, 1);
+  EXPECT_GT(stats.bytes, 0);
+}
+
+TEST(ResultCacheTest, EstimatesBytesOfResults) {
+  ResultCache<std::vector<int>> cache(/*capacity=*/10);
+  cache.Insert("short", std::vector<int>(1));
+  const int64 short_bytes = cache.GetStats().bytes;
+  cache.Clear();
+  cache.Insert("short", std::vector<int>(1000));
+  EXPECT_GE(cache.GetStats().bytes, short_bytes + 999 * sizeof(int));
+}
+
+TEST(ResultCacheTest, EvictsLeastRecentlyUsed) {
+  ResultCache<std::string> cache(/*capacity=*/2, /*num_shards=*/1);
+  std::string result;
+  cache.Insert("a", "1");
+  cache.Insert("b", "2");
+  EXPECT_TRUE(cache.Lookup("a", &result));
+  cache.Insert("c", "3");
+
+  EXPECT_TRUE(cache.Lookup("a", &result));
+  EXPECT_FALSE(cache.Lookup("b", &result));
+  EXPECT_TRUE(cache.Lookup("c", &result));
+  EXPECT_EQ(cache.GetStats().num_evictions, 1);
+
+  cache.SetCapacity(1);
+  EXPECT_EQ(cache.GetStats().size, 1);
+  EXPECT_TRUE(cache.Lookup("c", &result));
+
+  cache.Clear();
+  EXPECT_EQ(cache.GetStats().size, 0);
+  EXPECT_FALSE(cache.Lookup("c", &result));
+}
+
+TEST(ResultCacheTest, DropsExpiredResults) {
+  ResultCache<std::string> cache(/*capacity=*/10);
+  cache.SetTtlMs(1);
+  cache.Insert("key", "value");
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+  std::string result;
+  EXPECT_FALSE(cache.Lookup("key", &result));
+  const ResultCacheStats stats = cache.GetStats();
+  EXPECT_EQ(stats.num_expirations, 1);
+  EXPECT_EQ(stats.num_misses, 1);
+  EXPECT_EQ(stats.size, 0);
+
+  cache.SetTtlMs(0);
+  cache.Insert("key", "value");
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  EXPECT_TRUE(cache.Lookup("key", &result));
+}
+
+TEST(ResultCacheTest, BoundsSizeAcrossShards) {
+  ResultCache<int> cache(/*capacity=*/16, /*num_shards=*/4);
+  for (int i = 0; i < 1000; ++i) {
+    cache.Insert(std::to_string(i), i);
+  }
+  // Each shard holds up to a quarter of the capacity.
+  EXPECT_LE(cache.GetStats().size, 16);
+
+  int result;
+  for (int i = 990; i < 1000; ++i) {
+    if (cache.Lookup(std::to_string(i), &result)) {
+      EXPECT_EQ(result, i);
+    }
+  }
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
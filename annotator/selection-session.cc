@@ -0,0 +1,32 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/selection-session.h"
+
+namespace libtextclassifier3 {
+
+CodepointSpan SelectionSession::SuggestSelection(const std::string& context,
+                                                 CodepointSpan click_indices) {
+  return annotator_->SuggestSelection(context, click_indices, options_,
+                                      &cache_);
+}
+
+void SelectionSession::Reset(const SelectionOptions& options) {
+  options_ = options;
+  cache_ = SuggestSelectionCache();
+}
+
+}  // namespace libtextclassifier3
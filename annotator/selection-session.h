@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Smart selection of several clicks on the same text.
+
+#ifndef LIBTEXTCLASSIFIER_ANNOTATOR_SELECTION_SESSION_H_
+#define LIBTEXTCLASSIFIER_ANNOTATOR_SELECTION_SESSION_H_
+
+#include <string>
+
+#include "annotator/annotator.h"
+#include "annotator/types.h"
+
+namespace libtextclassifier3 {
+
+// Suggests selections for successive clicks on the same text, as selection UIs
+// do when the user adjusts a selection. The tokens of the text, the candidates
+// of the sources that don't depend on the click and the selection model
+// features around the previous clicks are kept, so that a new click mostly
+// only needs to run the selection model on its own span.
+//
+// The kept work is dropped when the text or the options change.
+//
+// The session is not thread-safe; the annotator can be shared between
+// sessions.
+class SelectionSession {
+ public:
+  // Does not take ownership of the annotator, which needs to outlive the
+  // session.
+  SelectionSession(const Annotator* annotator, const SelectionOptions& options)
+      : annotator_(annotator), options_(options) {}
+
+  // Same as Annotator::SuggestSelection.
+  CodepointSpan SuggestSelection(const std::string& context,
+                                 CodepointSpan click_indices);
+
+  // Drops the kept work and sets the options used from now on.
+  void Reset(const SelectionOptions& options);
+
+  // Number of times the selection model features needed to be extracted since
+  // the session started or was last reset.
+  int NumFeatureExtractions() const { return cache_.num_feature_extractions; }
+
+ private:
+  const Annotator* const annotator_;
+  SelectionOptions options_;
+  SuggestSelectionCache cache_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_ANNOTATOR_SELECTION_SESSION_H_
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/selection-session.h"
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "annotator/annotator.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+std::string GetModelPath() { return TC3_TEST_DATA_DIR; }
+
+std::string ReadFile(const std::string& file_name) {
+  std::ifstream file_stream(file_name);
+  return std::string(std::istreambuf_iterator<char>(file_stream), {});
+}
+
+class SelectionSessionTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    model_buffer_ = ReadFile(GetModelPath() + "test_model.fb");
+    annotator_ = Annotator::FromUnownedBuffer(model_buffer_.data(),
+                                              model_buffer_.size(), &unilib_);
+    ASSERT_NE(annotator_, nullptr);
+  }
+
+  UniLib unilib_;
+  std::string model_buffer_;
+  std::unique_ptr<Annotator> annotator_;
+};
+
+TEST_F(SelectionSessionTest, GivesSameSelectionsAsAnnotator) {
+  const std::string context =
+      "call me at (857) 225-3556 today or at 350 Third Street, Cambridge";
+  SelectionSession session(annotator_.get(), SelectionOptions());
+  for (const CodepointSpan& click :
+       {CodepointSpan(11, 14), CodepointSpan(16, 19), CodepointSpan(20, 24),
+        CodepointSpan(38, 41), CodepointSpan(42, 47), CodepointSpan(0, 4)}) {
+    EXPECT_EQ(session.SuggestSelection(context, click),
+              annotator_->SuggestSelection(context, click));
+  }
+}
+
+TEST_F(SelectionSessionTest, ReusesFeaturesOfNearbyClicks) {
+  const std::string context = "call me at (857) 225-3556 today";
+  SelectionSession session(annotator_.get(), SelectionOptions());
+  session.SuggestSelection(context, {11, 14});
+  const int num_feature_extractions = session.NumFeatureExtractions();
+  session.SuggestSelection(context, {11, 14});
+  EXPECT_EQ(session.NumFeatureExtractions(), num_feature_extractions);
+
+  // A new text needs new features.
+  session.SuggestSelection("call me at (857) 225-3556 tomorrow", {11, 14});
+  EXPECT_GT(session.NumFeatureExtractions(), num_feature_extractions);
+}
+
+TEST_F(SelectionSessionTest, ResetDropsKeptWork) {
+  SelectionSession session(annotator_.get(), SelectionOptions());
+  session.SuggestSelection("call me at (857) 225-3556 today", {11, 14});
+  session.Reset(SelectionOptions());
+  EXPECT_EQ(session.NumFeatureExtractions(), 0);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
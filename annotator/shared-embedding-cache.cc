@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/shared-embedding-cache.h"
+
+#include <algorithm>
+
+#include "utils/hash/farmhash.h"
+
+namespace libtextclassifier3 {
+
+constexpr int SharedEmbeddingCache::kDefaultNumShards;
+
+bool SharedEmbeddingCache::Lookup(const std::string& token_value, float* dest,
+                                  int dest_size) {
+  if (!enabled()) {
+    return false;
+  }
+  Shard& shard = ShardForToken(token_value);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  const auto it = shard.index.find(token_value);
+  if (it == shard.index.end() || dest_size != embedding_size_) {
+    ++shard.num_misses;
+    return false;
+  }
+  ++shard.num_hits;
+  shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+  const float* embedding =
+      shard.embeddings.data() + it->second->embedding_offset;
+  std::copy(embedding, embedding + dest_size, dest);
+  return true;
+}
+
+void SharedEmbeddingCache::Insert(const std::string& token_value,
+                                  const float* embedding, int embedding_size) {
+  if (!enabled()) {
+    return;
+  }
+  int expected_size = 0;
+  if (!embedding_size_.compare_exchange_strong(expected_size,
+                                               embedding_size) &&
+      expected_size != embedding_size) {
+    return;
+  }
+
+  Shard& shard = ShardForToken(token_value);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  const auto it = shard.index.find(token_value);
+  if (it != shard.index.end()) {
+    std::copy(embedding, embedding + embedding_size,
+              shard.embeddings.begin() + it->second->embedding_offset);
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    return;
+  }
+
+  int embedding_offset;
+  if (!shard.free_offsets.empty()) {
+    embedding_offset = shard.free_offsets.back();
+    shard.free_offsets.pop_back();
+    std::copy(embedding, embedding + embedding_size,
+              shard.embeddings.begin() + embedding_offset);
+  } else {
+    embedding_offset = shard.embeddings.size();
+    shard.embeddings.insert(shard.embeddings.end(), embedding,
+                            embedding + embedding_size);
+  }
+  shard.entries.push_front(Entry{token_value, embedding_offset});
+  shard.index[token_value] = shard.entries.begin();
+  EvictOverCapacity(&shard);
+}
+
+void SharedEmbeddingCache::SetCapacity(int capacity) {
+  capacity_ = std::max(0, capacity);
+  for (Shard& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    EvictOverCapacity(&shard);
+  }
+}
+
+SharedEmbeddingCacheStats SharedEmbeddingCache::GetStats() const {
+  SharedEmbeddingCacheStats stats;
+  for (const Shard& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    stats.num_hits += shard.num_hits;
+    stats.num_misses += shard.num_misses;
+    stats.size += shard.index.size();
+    stats.bytes += shard.embeddings.capacity() * sizeof(float) +
+                   shard.free_offsets.capacity() * sizeof(int);
+    for (const Entry& entry : shard.entries) {
+      // The token value is held by both the entry and the index.
+      stats.bytes += sizeof(Entry) + 2 * entry.token_value.size() +
+                     sizeof(decltype(shard.index)::value_type);
+    }
+  }
+  return stats;
+}
+
+SharedEmbeddingCache::Shard& SharedEmbeddingCache::ShardForToken(
+    const std::string& token_value) {
+  if (shards_.size() == 1) {
+    return shards_[0];
+  }
+  return shards_[tc3farmhash::Fingerprint64(token_value) % shards_.size()];
+}
+
+void SharedEmbeddingCache::EvictOverCapacity(Shard* shard) {
+  const int shard_capacity =
+      (capacity_ + shards_.size() - 1) / shards_.size();
+  while (shard->index.size() > shard_capacity) {
+    shard->free_offsets.push_back(shard->entries.back().embedding_offset);
+    shard->index.erase(shard->entries.back().token_value);
+    shard->entries.pop_back();
+  }
+}
+
+}  // namespace libtextclassifier3
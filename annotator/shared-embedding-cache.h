@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Cache of token embeddings shared between requests.
+
+#ifndef LIBTEXTCLASSIFIER_ANNOTATOR_SHARED_EMBEDDING_CACHE_H_
+#define LIBTEXTCLASSIFIER_ANNOTATOR_SHARED_EMBEDDING_CACHE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <list>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "utils/base/integral_types.h"
+
+namespace libtextclassifier3 {
+
+struct SharedEmbeddingCacheStats {
+  int64 num_hits = 0;
+  int64 num_misses = 0;
+
+  // Number of cached embeddings.
+  int size = 0;
+
+  // Estimated memory of the cached tokens and embeddings.
+  int64 bytes = 0;
+};
+
+// A bounded least-recently-used cache mapping token values to their summed
+// sparse feature embeddings. Unlike the per-call EmbeddingCache of the
+// FeatureProcessor, it lives as long as the model and keeps the embeddings of
+// frequent tokens (e.g. "the", "at", "pm") across requests.
+//
+// The key only needs to contain the token value, as the dense features of a
+// token are not embedded and are always computed on the fly.
+//
+// All the embeddings in one cache have the same size, set by the first
+// insertion. They are stored in slots of a buffer per shard, and the slots of
+// evicted embeddings are reused, so a full cache doesn't allocate.
+//
+// As every token of a request is looked up, the cache of a model serving
+// concurrent requests should be split into shards by the hash of the token,
+// each with its own lock, like the ResultCache. Every shard holds up to its
+// share of the capacity, so the eviction order is only exactly LRU with one
+// shard, the default.
+//
+// The class is thread-safe.
+class SharedEmbeddingCache {
+ public:
+  static constexpr int kDefaultNumShards = 8;
+
+  // A capacity of 0 disables the cache.
+  explicit SharedEmbeddingCache(int capacity = 0, int num_shards = 1)
+      : capacity_(std::max(0, capacity)), shards_(std::max(1, num_shards)) {}
+
+  // Copies the cached embedding of the token to dest. Returns false if the
+  // token is not cached or its embedding size is not dest_size.
+  bool Lookup(const std::string& token_value, float* dest, int dest_size);
+
+  // Caches the embedding of the token, evicting the least recently used one
+  // of its shard if the shard is full. Embeddings of a different size than the
+  // cached ones are not inserted.
+  void Insert(const std::string& token_value, const float* embedding,
+              int embedding_size);
+
+  // Sets the maximum number of cached embeddings, evicting the least recently
+  // used ones that don't fit.
+  void SetCapacity(int capacity);
+
+  bool enabled() const { return capacity_ > 0; }
+
+  SharedEmbeddingCacheStats GetStats() const;
+
+ private:
+  struct Entry {
+    std::string token_value;
+
+    // Offset of the embedding in the embeddings of the shard.
+    int embedding_offset;
+  };
+
+  struct Shard {
+    mutable std::mutex mutex;
+
+    // Most recently used first.
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+
+    // Slots of embedding_size_ floats, and the offsets of the unused ones.
+    std::vector<float> embeddings;
+    std::vector<int> free_offsets;
+
+    int64 num_hits = 0;
+    int64 num_misses = 0;
+  };
+
+  Shard& ShardForToken(const std::string& token_value);
+
+  // Evicts the entries of the shard over its share of the capacity. Needs the
+  // lock of the shard to be held.
+  void EvictOverCapacity(Shard* shard);
+
+  std::atomic<int> capacity_;
+
+  // 0 until the first insertion.
+  std::atomic<int> embedding_size_{0};
+
+  std::vector<Shard> shards_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_ANNOTATOR_SHARED_EMBEDDING_CACHE_H_
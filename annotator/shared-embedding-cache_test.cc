@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/shared-embedding-cache.h"
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+using testing::ElementsAre;
+
+TEST(SharedEmbeddingCacheTest, DisabledByDefault) {
+  SharedEmbeddingCache cache;
+  const std::vector<float> embedding = {1.0, 2.0};
+  cache.Insert("the", embedding.data(), embedding.size());
+
+  std::vector<float> result(2);
+  EXPECT_FALSE(cache.Lookup("the", result.data(), result.size()));
+  EXPECT_EQ(cache.GetStats().size, 0);
+}
+
+TEST(SharedEmbeddingCacheTest, FindsInsertedEmbeddings) {
+  SharedEmbeddingCache cache(/*capacity=*/10);
+  const std::vector<float> embedding = {1.0, 2.0};
+  cache.Insert("the", embedding.data(), embedding.size());
+
+  std::vector<float> result(2);
+  EXPECT_TRUE(cache.Lookup("the", result.data(), result.size()));
+  EXPECT_THAT(result, ElementsAre(1.0, 2.0));
+  EXPECT_FALSE(cache.Lookup("at", result.data(), result.size()));
+  EXPECT_FALSE(cache.Lookup("the", result.data(), /*dest_size=*/1));
+
+  const SharedEmbeddingCacheStats stats = cache.GetStats();
+  EXPECT_EQ(stats.num_hits, 1);
+  EXPECT_EQ(stats.num_misses, 2);
+  EXPECT_EQ(stats.size, 1);
+  EXPECT_GE(stats.bytes, 2 * sizeof(float));
+}
+
+TEST(SharedEmbeddingCacheTest, EvictsLeastRecentlyUsed) {
+  SharedEmbeddingCache cache(/*capacity=*/2);
+  const std::vector<float> embedding = {1.0};
+  std::vector<float> result(1);
+  cache.Insert("a", embedding.data(), embedding.size());
+  cache.Insert("b", embedding.data(), embedding.size());
+  EXPECT_TRUE(cache.Lookup("a", result.data(), result.size()));
+  cache.Insert("c", embedding.data(), embedding.size());
+
+  EXPECT_TRUE(cache.Lookup("a", result.data(), result.size()));
+  EXPECT_FALSE(cache.Lookup("b", result.data(), result.size()));
+  EXPECT_TRUE(cache.Lookup("c", result.data(), result.size()));
+
+  cache.SetCapacity(1);
+  EXPECT_EQ(cache.GetStats().size, 1);
+  EXPECT_TRUE(cache.Lookup("c", result.data(), result.size()));
+}
+
+TEST(SharedEmbeddingCacheTest, ReusesSlotsOfEvictedEmbeddings) {
+  SharedEmbeddingCache cache(/*capacity=*/1);
+  const std::vector<float> first = {1.0, 2.0};
+  const std::vector<float> second = {3.0, 4.0};
+  cache.Insert("a", first.data(), first.size());
+  cache.Insert("b", second.data(), second.size());
+
+  std::vector<float> result(2);
+  EXPECT_FALSE(cache.Lookup("a", result.data(), result.size()));
+  EXPECT_TRUE(cache.Lookup("b", result.data(), result.size()));
+  EXPECT_THAT(result, ElementsAre(3.0, 4.0));
+}
+
+TEST(SharedEmbeddingCacheTest, IgnoresEmbeddingsOfDifferentSize) {
+  SharedEmbeddingCache cache(/*capacity=*/10);
+  const std::vector<float> embedding = {1.0, 2.0};
+  const std::vector<float> shorter_embedding = {3.0};
+  cache.Insert("a", embedding.data(), embedding.size());
+  cache.Insert("b", shorter_embedding.data(), shorter_embedding.size());
+
+  std::vector<float> result(1);
+  EXPECT_FALSE(cache.Lookup("b", result.data(), result.size()));
+  EXPECT_EQ(cache.GetStats().size, 1);
+}
+
+TEST(SharedEmbeddingCacheTest, ShardsKeepTheirShareOfTheCapacity) {
+  SharedEmbeddingCache cache(/*capacity=*/8, /*num_shards=*/4);
+  const std::vector<float> embedding = {1.0, 2.0};
+  for (int i = 0; i < 100; ++i) {
+    cache.Insert(std::to_string(i), embedding.data(), embedding.size());
+  }
+  EXPECT_EQ(cache.GetStats().size, 8);
+
+  // The last inserted token is the most recently used one of its shard.
+  std::vector<float> result(2);
+  EXPECT_TRUE(cache.Lookup("99", result.data(), result.size()));
+  EXPECT_THAT(result, ElementsAre(1.0, 2.0));
+
+  // The size of the embeddings is the same in all the shards.
+  const std::vector<float> shorter_embedding = {3.0};
+  for (int i = 100; i < 110; ++i) {
+    cache.Insert(std::to_string(i), shorter_embedding.data(),
+                 shorter_embedding.size());
+  }
+  EXPECT_TRUE(cache.Lookup("99", result.data(), result.size()));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -20,6 +20,8 @@
 #include <string>
 
 #include "annotator/types.h"
+#include "utils/utf8/codepoint-offsets.h"
+#include "utils/utf8/unicodetext.h"
 #include "utils/utf8/unilib.h"
 
 namespace libtextclassifier3 {
@@ -33,6 +35,19 @@ CodepointSpan StripUnpairedBrackets(const std::string& context,
 CodepointSpan StripUnpairedBrackets(const UnicodeText& context_unicode,
                                     CodepointSpan span, const UniLib& unilib);
 
+// Same as above but takes the iterators to the beginning and the end of the
+// span, so that callers going over many spans of a long text don't walk to
+// every span from the beginning of the text.
+CodepointSpan StripUnpairedBrackets(
+    const UnicodeText::const_iterator& span_begin,
+    const UnicodeText::const_iterator& span_end, CodepointSpan span,
+    const UniLib& unilib);
+
+// Same as above but finds the span with the index of the context, for callers
+// going over many spans of a long text in any order.
+CodepointSpan StripUnpairedBrackets(const CodepointOffsetIndex& context_index,
+                                    CodepointSpan span, const UniLib& unilib);
+
 }  // namespace libtextclassifier3
 
 #endif  // LIBTEXTCLASSIFIER_ANNOTATOR_STRIP_UNPAIRED_BRACKETS_H_
@@ -16,6 +16,11 @@
 
 #include "annotator/strip-unpaired-brackets.h"
 
+#include <iterator>
+#include <string>
+
+#include "utils/testing/worst-case-search.h"
+#include "utils/utf8/unicodetext.h"
 #include "gtest/gtest.h"
 
 namespace libtextclassifier3 {
@@ -62,5 +67,42 @@ TEST_F(StripUnpairedBracketsTest, StripUnpairedBrackets) {
             std::make_pair(-1, -1));
 }
 
+TEST_F(StripUnpairedBracketsTest, IteratorsGiveTheSameSpans) {
+  const UnicodeText context =
+      UTF8ToUnicodeText("(a) [b c( d] e)f", /*do_copy=*/false);
+  const CodepointOffsetIndex context_index(context);
+  for (int first = 0; first < context.size_codepoints(); ++first) {
+    for (int second = first + 1; second <= context.size_codepoints();
+         ++second) {
+      UnicodeText::const_iterator span_begin = context.begin();
+      std::advance(span_begin, first);
+      UnicodeText::const_iterator span_end = span_begin;
+      std::advance(span_end, second - first);
+      EXPECT_EQ(StripUnpairedBrackets(span_begin, span_end, {first, second},
+                                      unilib_),
+                StripUnpairedBrackets(context, {first, second}, unilib_));
+      EXPECT_EQ(
+          StripUnpairedBrackets(context_index, {first, second}, unilib_),
+          StripUnpairedBrackets(context, {first, second}, unilib_));
+    }
+  }
+}
+
+TEST_F(StripUnpairedBracketsTest, StripsWorstCaseInputsWithinTimeBudget) {
+  // Generous, to only catch spans that became superlinear to strip.
+  constexpr double kMaxUsPerByte = 1.0;
+  for (const WorstCaseInput input :
+       {WorstCaseInput::kNestedBrackets, WorstCaseInput::kUnpairedBrackets}) {
+    const std::string text = WorstCaseInputText(input, 64 * 1024);
+    const UnicodeText context = UTF8ToUnicodeText(text, /*do_copy=*/false);
+    const CodepointSpan span = {0, context.size_codepoints()};
+    const double time_us = MinTimeUs(/*num_repetitions=*/3, [&]() {
+      StripUnpairedBrackets(context, span, unilib_);
+    });
+    EXPECT_LE(time_us / text.size(), kMaxUsPerByte)
+        << WorstCaseInputName(input);
+  }
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
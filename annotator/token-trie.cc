@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/token-trie.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "utils/base/logging.h"
+#include "utils/utf8/unicodetext.h"
+
+namespace libtextclassifier3 {
+
+bool TokenTrie::InternName(const std::string& name,
+                           std::vector<int32>* token_ids) {
+  token_ids->clear();
+  for (const Token& token : feature_processor_->Tokenize(name)) {
+    const std::string normalized = NormalizeToken(token.value);
+    if (normalized.empty()) {
+      continue;
+    }
+    auto it = token_ids_.emplace(normalized, token_ids_.size()).first;
+    token_ids->push_back(it->second);
+  }
+  return !token_ids->empty();
+}
+
+void TokenTrie::Insert(const std::vector<int32>& token_ids, int value) {
+  int node = kRootNode;
+  for (const int32 token_id : token_ids) {
+    int child = FindChild(node, token_id);
+    if (child < 0) {
+      if (!free_nodes_.empty()) {
+        child = free_nodes_.back();
+        free_nodes_.pop_back();
+      } else {
+        child = nodes_.size();
+        nodes_.emplace_back();
+      }
+      edges_[EdgeKey(node, token_id)] = child;
+    }
+    ++nodes_[child].num_names;
+    node = child;
+  }
+  nodes_[node].values.push_back(value);
+}
+
+void TokenTrie::Erase(const std::vector<int32>& token_ids, int value) {
+  std::vector<int> path;
+  int node = kRootNode;
+  for (const int32 token_id : token_ids) {
+    node = FindChild(node, token_id);
+    if (node < 0) {
+      TC3_LOG(ERROR) << "Name is not in the trie.";
+      return;
+    }
+    path.push_back(node);
+  }
+
+  std::vector<int>& values = nodes_[node].values;
+  auto it = std::find(values.begin(), values.end(), value);
+  if (it != values.end()) {
+    values.erase(it);
+  }
+
+  // The counts only decrease along the path, so once a node is pruned, all
+  // the following ones are too.
+  for (int i = 0; i < path.size(); ++i) {
+    if (--nodes_[path[i]].num_names > 0) {
+      continue;
+    }
+    edges_.erase(EdgeKey(i == 0 ? kRootNode : path[i - 1], token_ids[i]));
+    nodes_[path[i]] = Node();
+    free_nodes_.push_back(path[i]);
+  }
+}
+
+const std::vector<int>* TokenTrie::Find(
+    const std::vector<Token>& tokens) const {
+  if (tokens.empty()) {
+    return nullptr;
+  }
+  int node = kRootNode;
+  for (const Token& token : tokens) {
+    const int32 token_id = FindTokenId(token);
+    if (token_id == kNoToken) {
+      return nullptr;
+    }
+    node = FindChild(node, token_id);
+    if (node < 0) {
+      return nullptr;
+    }
+  }
+  return nodes_[node].values.empty() ? nullptr : &nodes_[node].values;
+}
+
+std::vector<TokenTrie::Match> TokenTrie::FindLongestMatches(
+    const std::vector<Token>& tokens) const {
+  std::vector<Match> matches;
+  if (edges_.empty()) {
+    return matches;
+  }
+
+  // For every start token, the last token and the node of the longest name
+  // starting there.
+  std::vector<std::pair<int, int>> longest_match(tokens.size(), {-1, -1});
+
+  // The trie states that are still alive: (start token, node).
+  std::vector<std::pair<int, int>> states;
+  std::vector<std::pair<int, int>> next_states;
+  for (int i = 0; i < tokens.size(); ++i) {
+    const int32 token_id = FindTokenId(tokens[i]);
+    if (token_id == kNoToken) {
+      states.clear();
+      continue;
+    }
+    states.push_back({i, kRootNode});
+    next_states.clear();
+    for (const std::pair<int, int>& state : states) {
+      const int child = FindChild(state.second, token_id);
+      if (child < 0) {
+        continue;
+      }
+      next_states.push_back({state.first, child});
+      if (!nodes_[child].values.empty()) {
+        longest_match[state.first] = {i, child};
+      }
+    }
+    states.swap(next_states);
+  }
+
+  for (int i = 0; i < tokens.size();) {
+    const int last_token = longest_match[i].first;
+    if (last_token < 0) {
+      ++i;
+      continue;
+    }
+    matches.push_back({i, last_token, &nodes_[longest_match[i].second].values});
+    i = last_token + 1;
+  }
+  return matches;
+}
+
+std::string TokenTrie::NormalizeToken(const std::string& value) const {
+  UnicodeText normalized;
+  for (const char32 codepoint : UTF8ToUnicodeText(value, /*do_copy=*/false)) {
+    normalized.push_back(unilib_->ToLower(codepoint));
+  }
+  return normalized.ToUTF8String();
+}
+
+int32 TokenTrie::FindTokenId(const Token& token) const {
+  if (token.is_padding) {
+    return kNoToken;
+  }
+  auto it = token_ids_.find(NormalizeToken(token.value));
+  return it != token_ids_.end() ? it->second : kNoToken;
+}
+
+int TokenTrie::FindChild(int node, int32 token_id) const {
+  auto it = edges_.find(EdgeKey(node, token_id));
+  return it != edges_.end() ? it->second : -1;
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBTEXTCLASSIFIER_ANNOTATOR_TOKEN_TRIE_H_
+#define LIBTEXTCLASSIFIER_ANNOTATOR_TOKEN_TRIE_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "annotator/feature-processor.h"
+#include "annotator/types.h"
+#include "utils/base/integral_types.h"
+#include "utils/utf8/unilib.h"
+
+namespace libtextclassifier3 {
+
+// Index of multi-token names, e.g. of contacts or apps, for finding them among
+// the tokens of a text.
+//
+// The names are tokenized with the feature processor and lowercased. The
+// tokens are interned to ids and the names stored in a trie, whose nodes keep
+// the values (e.g. indices of contacts) of the names ending there. The nodes
+// are reference counted, so names can be inserted and erased at any time and
+// unused branches are pruned without rebuilding anything.
+//
+// Not thread-safe; the users synchronize lookups with the updates.
+class TokenTrie {
+ public:
+  // A name found among the tokens: the first and last token of the match and
+  // the values of the name.
+  struct Match {
+    int first_token;
+    int last_token;
+    const std::vector<int>* values;
+  };
+
+  TokenTrie(const FeatureProcessor* feature_processor, const UniLib* unilib)
+      : feature_processor_(feature_processor), unilib_(unilib), nodes_(1) {}
+
+  // Tokenizes and normalizes the name into the ids of its tokens, interning
+  // the new ones. Returns false if the name has no tokens.
+  bool InternName(const std::string& name, std::vector<int32>* token_ids);
+
+  // Adds the value to the name.
+  void Insert(const std::vector<int32>& token_ids, int value);
+
+  // Removes one occurrence of the value from the name, pruning the nodes that
+  // no other name uses.
+  void Erase(const std::vector<int32>& token_ids, int value);
+
+  // Returns the values of the name made of exactly the given tokens, or
+  // nullptr if there is no such name.
+  const std::vector<int>* Find(const std::vector<Token>& tokens) const;
+
+  // Finds the leftmost longest non-overlapping names among the tokens, in a
+  // single pass that advances the trie states still alive at every token.
+  std::vector<Match> FindLongestMatches(const std::vector<Token>& tokens) const;
+
+ private:
+  static constexpr int32 kNoToken = -1;
+  static constexpr int kRootNode = 0;
+
+  struct Node {
+    // Number of names that pass through or end in this node.
+    int num_names = 0;
+
+    // Values of the names ending here.
+    std::vector<int> values;
+  };
+
+  // Lowercases the token value.
+  std::string NormalizeToken(const std::string& value) const;
+
+  // Returns the id of the token, or kNoToken if it isn't part of any name.
+  int32 FindTokenId(const Token& token) const;
+
+  // Returns the child of the node for the token, or -1 if there is none.
+  int FindChild(int node, int32 token_id) const;
+
+  static uint64 EdgeKey(int node, int32 token_id) {
+    return (static_cast<uint64>(node) << 32) | static_cast<uint32>(token_id);
+  }
+
+  const FeatureProcessor* feature_processor_;
+  const UniLib* unilib_;
+
+  // Interned normalized tokens. Tokens are kept when their names are erased,
+  // so that the ids stay stable.
+  std::unordered_map<std::string, int32> token_ids_;
+
+  // The nodes, with the root at kRootNode. Pruned nodes are reused.
+  std::vector<Node> nodes_;
+  std::vector<int> free_nodes_;
+  std::unordered_map<uint64, int> edges_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_ANNOTATOR_TOKEN_TRIE_H_
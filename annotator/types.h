@@ -22,6 +22,7 @@
 #include <cmath>
 #include <functional>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <utility>
@@ -31,6 +32,7 @@
 #include "utils/base/integral_types.h"
 #include "utils/base/logging.h"
 #include "utils/flatbuffers.h"
+#include "utils/strings/stringpiece.h"
 #include "utils/variant.h"
 
 namespace libtextclassifier3 {
@@ -57,10 +59,13 @@ inline bool ValidNonEmptySpan(const CodepointSpan& span) {
   return span.first < span.second && span.first >= 0 && span.second >= 0;
 }
 
-template <typename T>
-bool DoesCandidateConflict(
-    const int considered_candidate, const std::vector<T>& candidates,
-    const std::set<int, std::function<bool(int, int)>>& chosen_indices_set) {
+// Returns whether the candidate overlaps one of the chosen ones. The chosen
+// indices need to be ordered by the start of their spans, and not overlap each
+// other.
+template <typename T, typename IndexSet>
+bool DoesCandidateConflict(const int considered_candidate,
+                           const std::vector<T>& candidates,
+                           const IndexSet& chosen_indices_set) {
   if (chosen_indices_set.empty()) {
     return false;
   }
@@ -153,6 +158,66 @@ struct Token {
 logging::LoggingStringStream& operator<<(logging::LoggingStringStream& stream,
                                          const Token& token);
 
+// Token that references its text in the UTF-8 buffer it was tokenized from,
+// instead of owning a copy of it. The buffer needs to outlive the token.
+struct TokenRef {
+  // Buffer the token was tokenized from. nullptr for padding tokens.
+  const char* buffer;
+
+  // Byte range of the token text in the buffer.
+  int byte_offset;
+  int byte_length;
+
+  CodepointIndex start;
+  CodepointIndex end;
+
+  // Whether the token is a padding token.
+  bool is_padding;
+
+  // Default constructor constructs the padding-token.
+  TokenRef()
+      : buffer(nullptr),
+        byte_offset(0),
+        byte_length(0),
+        start(kInvalidIndex),
+        end(kInvalidIndex),
+        is_padding(true) {}
+
+  TokenRef(const char* arg_buffer, int arg_byte_offset, int arg_byte_length,
+           CodepointIndex arg_start, CodepointIndex arg_end)
+      : buffer(arg_buffer),
+        byte_offset(arg_byte_offset),
+        byte_length(arg_byte_length),
+        start(arg_start),
+        end(arg_end),
+        is_padding(false) {}
+
+  // Text of the token.
+  StringPiece value() const {
+    if (buffer == nullptr) {
+      return StringPiece();
+    }
+    return StringPiece(buffer + byte_offset, byte_length);
+  }
+
+  // Returns a token that owns a copy of the text.
+  Token ToToken() const {
+    if (is_padding) {
+      return Token();
+    }
+    return Token(value().ToString(), start, end);
+  }
+
+  bool operator==(const TokenRef& other) const {
+    return value().Equals(other.value()) && start == other.start &&
+           end == other.end && is_padding == other.is_padding;
+  }
+
+  bool IsContainedInSpan(CodepointSpan span) const {
+    return start >= span.first && end <= span.second;
+  }
+};
+
 enum DatetimeGranularity {
   GRANULARITY_UNKNOWN = -1,  // GRANULARITY_UNKNOWN is used as a proxy for this
                              // structure being uninitialized.
@@ -165,6 +230,8 @@ enum DatetimeGranularity {
   GRANULARITY_SECOND = 6
 };
 
+struct DateParseData;
+
 struct DatetimeParseResult {
   // The absolute time in milliseconds since the epoch in UTC.
   int64 time_ms_utc;
@@ -172,6 +239,10 @@ struct DatetimeParseResult {
   // The precision of the estimate then in to calculating the milliseconds
   DatetimeGranularity granularity;
 
+  // The parsed fields that time_ms_utc is still to be computed from, for
+  // results of DatetimeParser::ParseUnresolved(). Null once resolved.
+  std::shared_ptr<const DateParseData> unresolved_parse_data;
+
   DatetimeParseResult() : time_ms_utc(0), granularity(GRANULARITY_UNKNOWN) {}
 
   DatetimeParseResult(int64 arg_time_ms_utc,
@@ -206,14 +277,38 @@ struct DatetimeParseResultSpan {
 logging::LoggingStringStream& operator<<(logging::LoggingStringStream& stream,
                                          const DatetimeParseResultSpan& value);
 
-struct ClassificationResult {
-  std::string collection;
-  float score;
-  DatetimeParseResult datetime_parse_result;
+// Fields of a ClassificationResult that only results of a few collections
+// (knowledge entities, contacts, apps) carry.
+struct ClassificationResultExtras {
   std::string serialized_knowledge_result;
   std::string contact_name, contact_given_name, contact_nickname,
       contact_email_address, contact_phone_number, contact_id;
   std::string app_name, app_package_name;
+};
+
+// Builds the serialized entity data of a classification result on demand, see
+// ClassificationResult::lazy_entity_data.
+class LazyEntityData {
+ public:
+  virtual ~LazyEntityData() {}
+
+  // Returns false if the entity data couldn't be built.
+  virtual bool Build(std::string* serialized_entity_data) const = 0;
+};
+
+// Value of ClassificationResult::collection_id when it isn't set.
+constexpr int kUnknownCollectionId = -1;
+
+struct ClassificationResult {
+  std::string collection;
+
+  // Id of the collection in the CollectionIdTable of the annotator that
+  // produced the result, or kUnknownCollectionId. Only used inside the
+  // annotator, and only valid as long as `collection` isn't changed.
+  int collection_id;
+
+  float score;
+  DatetimeParseResult datetime_parse_result;
   int64 numeric_value;
 
   // Length of the parsed duration in milliseconds.
@@ -226,22 +321,70 @@ struct ClassificationResult {
   // Entity data information.
   std::string serialized_entity_data;
   const EntityData* entity_data() {
+    ResolveEntityData();
     return LoadAndVerifyFlatbuffer<EntityData>(serialized_entity_data.data(),
                                                serialized_entity_data.size());
   }
 
-  explicit ClassificationResult() : score(-1.0f), priority_score(-1.0) {}
+  // If set, serialized_entity_data is not built yet, ResolveEntityData builds
+  // it. Only set when the entity data was deferred, see
+  // AnnotationOptions::defer_serialized_entity_data, and must be resolved
+  // while the annotator that returned the result is alive.
+  std::shared_ptr<const LazyEntityData> lazy_entity_data;
+
+  // Builds serialized_entity_data from lazy_entity_data, if it is set.
+  // Returns false if the entity data couldn't be built.
+  bool ResolveEntityData() {
+    if (lazy_entity_data == nullptr) {
+      return true;
+    }
+    const bool success = lazy_entity_data->Build(&serialized_entity_data);
+    lazy_entity_data.reset();
+    return success;
+  }
+
+  // Returns the rarely used fields, or nullptr if none of them was set.
+  const ClassificationResultExtras* extras() const { return extras_.get(); }
+
+  // Returns the rarely used fields for modification, creating them if needed.
+  // The fields are shared between copies of a result until they are modified,
+  // so that results without (or with unchanged) extras stay cheap to copy.
+  ClassificationResultExtras* mutable_extras() {
+    if (extras_ == nullptr) {
+      extras_ = std::make_shared<ClassificationResultExtras>();
+    } else if (extras_.use_count() > 1) {
+      extras_ = std::make_shared<ClassificationResultExtras>(*extras_);
+    }
+    return extras_.get();
+  }
+
+  explicit ClassificationResult()
+      : collection_id(kUnknownCollectionId),
+        score(-1.0f),
+        priority_score(-1.0) {}
 
   ClassificationResult(const std::string& arg_collection, float arg_score)
       : collection(arg_collection),
+        collection_id(kUnknownCollectionId),
         score(arg_score),
         priority_score(arg_score) {}
 
   ClassificationResult(const std::string& arg_collection, float arg_score,
                        float arg_priority_score)
       : collection(arg_collection),
+        collection_id(kUnknownCollectionId),
         score(arg_score),
         priority_score(arg_priority_score) {}
+
+  ClassificationResult(const std::string& arg_collection, int arg_collection_id,
+                       float arg_score, float arg_priority_score)
+      : collection(arg_collection),
+        collection_id(arg_collection_id),
+        score(arg_score),
+        priority_score(arg_priority_score) {}
+
+ private:
+  std::shared_ptr<ClassificationResultExtras> extras_;
 };
 
 // Pretty-printing function for ClassificationResult.
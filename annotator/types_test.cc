@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "annotator/types.h"
+
+#include <memory>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(ClassificationResultTest, HasNoExtrasByDefault) {
+  const ClassificationResult result("phone", 1.0);
+  EXPECT_EQ(result.extras(), nullptr);
+}
+
+TEST(ClassificationResultTest, CopiesShareExtrasUntilModified) {
+  ClassificationResult result("contact", 1.0);
+  result.mutable_extras()->contact_name = "Ann";
+
+  ClassificationResult copy = result;
+  EXPECT_EQ(copy.extras(), result.extras());
+
+  copy.mutable_extras()->contact_name = "Bob";
+  EXPECT_NE(copy.extras(), result.extras());
+  EXPECT_EQ(result.extras()->contact_name, "Ann");
+  EXPECT_EQ(copy.extras()->contact_name, "Bob");
+}
+
+class FakeEntityData : public LazyEntityData {
+ public:
+  explicit FakeEntityData(int* num_builds) : num_builds_(num_builds) {}
+
+  bool Build(std::string* serialized_entity_data) const override {
+    ++*num_builds_;
+    *serialized_entity_data = "entity data";
+    return true;
+  }
+
+ private:
+  int* const num_builds_;
+};
+
+TEST(ClassificationResultTest, ResolvesLazyEntityDataOnce) {
+  int num_builds = 0;
+  ClassificationResult result("flight", 1.0);
+  result.lazy_entity_data = std::make_shared<FakeEntityData>(&num_builds);
+  EXPECT_TRUE(result.serialized_entity_data.empty());
+  EXPECT_EQ(num_builds, 0);
+
+  EXPECT_TRUE(result.ResolveEntityData());
+  EXPECT_EQ(result.serialized_entity_data, "entity data");
+  EXPECT_EQ(result.lazy_entity_data, nullptr);
+  EXPECT_TRUE(result.ResolveEntityData());
+  EXPECT_EQ(num_builds, 1);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
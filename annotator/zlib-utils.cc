@@ -17,6 +17,8 @@
 #include "annotator/zlib-utils.h"
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "utils/base/logging.h"
 #include "utils/intents/zlib-utils.h"
@@ -25,9 +27,55 @@
 
 namespace libtextclassifier3 {
 
+namespace {
+
+// Returns the regex and datetime patterns of the model, in the order they are
+// compressed.
+std::vector<const std::string*> PatternsToCompress(const ModelT& model) {
+  std::vector<const std::string*> patterns;
+  if (model.regex_model != nullptr) {
+    for (const auto& pattern : model.regex_model->patterns) {
+      patterns.push_back(&pattern->pattern);
+    }
+  }
+  if (model.datetime_model != nullptr) {
+    for (const auto& pattern : model.datetime_model->patterns) {
+      for (const auto& regex : pattern->regexes) {
+        patterns.push_back(&regex->pattern);
+      }
+    }
+    for (const auto& extractor : model.datetime_model->extractors) {
+      patterns.push_back(&extractor->pattern);
+    }
+  }
+  return patterns;
+}
+
+}  // namespace
+
 // Compress rule fields in the model.
-bool CompressModel(ModelT* model) {
-  std::unique_ptr<ZlibCompressor> zlib_compressor = ZlibCompressor::Instance();
+bool CompressModel(ModelT* model, const bool build_compression_dictionary) {
+  model->compression_dictionary.clear();
+  if (build_compression_dictionary) {
+    // All patterns share one dictionary built from them, so that every small
+    // pattern can refer back to the common parts.
+    std::vector<std::string> samples;
+    for (const std::string* pattern : PatternsToCompress(*model)) {
+      samples.push_back(*pattern);
+    }
+    std::vector<unsigned char> dictionary;
+    if (!BuildZlibDictionary(samples, &dictionary)) {
+      TC3_LOG(ERROR) << "Cannot build compression dictionary.";
+      return false;
+    }
+    model->compression_dictionary.assign(dictionary.begin(), dictionary.end());
+  }
+
+  std::unique_ptr<ZlibCompressor> zlib_compressor =
+      model->compression_dictionary.empty()
+          ? ZlibCompressor::Instance()
+          : ZlibCompressor::Instance(model->compression_dictionary.data(),
+                                     model->compression_dictionary.size());
   if (!zlib_compressor) {
     TC3_LOG(ERROR) << "Cannot compress model.";
     return false;
@@ -81,7 +129,10 @@ bool CompressModel(ModelT* model) {
 
 bool DecompressModel(ModelT* model) {
   std::unique_ptr<ZlibDecompressor> zlib_decompressor =
-      ZlibDecompressor::Instance();
+      model->compression_dictionary.empty()
+          ? ZlibDecompressor::Instance()
+          : ZlibDecompressor::Instance(model->compression_dictionary.data(),
+                                       model->compression_dictionary.size());
   if (!zlib_decompressor) {
     TC3_LOG(ERROR) << "Cannot initialize decompressor.";
     return false;
@@ -125,13 +176,41 @@ bool DecompressModel(ModelT* model) {
       extractor->compressed_pattern.reset(nullptr);
     }
   }
+  zlib_decompressor.reset();
+  model->compression_dictionary.clear();
+
+  // Decompress resources.
+  if (model->resources != nullptr &&
+      !DecompressResources(model->resources.get())) {
+    TC3_LOG(ERROR) << "Cannot decompress resources.";
+    return false;
+  }
+
+  // Decompress intent generator.
+  if (model->intent_options != nullptr &&
+      !DecompressIntentModel(model->intent_options.get())) {
+    TC3_LOG(ERROR) << "Cannot decompress intent generator.";
+    return false;
+  }
   return true;
 }
 
-std::string CompressSerializedModel(const std::string& model) {
+std::string CompressSerializedModel(const std::string& model,
+                                    const bool build_compression_dictionary) {
+  std::unique_ptr<ModelT> unpacked_model = UnPackModel(model.c_str());
+  TC3_CHECK(unpacked_model != nullptr);
+  TC3_CHECK(
+      CompressModel(unpacked_model.get(), build_compression_dictionary));
+  flatbuffers::FlatBufferBuilder builder;
+  FinishModelBuffer(builder, Model::Pack(builder, unpacked_model.get()));
+  return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                     builder.GetSize());
+}
+
+std::string DecompressSerializedModel(const std::string& model) {
   std::unique_ptr<ModelT> unpacked_model = UnPackModel(model.c_str());
   TC3_CHECK(unpacked_model != nullptr);
-  TC3_CHECK(CompressModel(unpacked_model.get()));
+  TC3_CHECK(DecompressModel(unpacked_model.get()));
   flatbuffers::FlatBufferBuilder builder;
   FinishModelBuffer(builder, Model::Pack(builder, unpacked_model.get()));
   return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
@@ -19,18 +19,27 @@
 #ifndef LIBTEXTCLASSIFIER_ANNOTATOR_ZLIB_UTILS_H_
 #define LIBTEXTCLASSIFIER_ANNOTATOR_ZLIB_UTILS_H_
 
+#include <string>
+
 #include "annotator/model_generated.h"
 
 namespace libtextclassifier3 {
 
-// Compresses regex and datetime rules in the model in place.
-bool CompressModel(ModelT* model);
+// Compresses regex and datetime rules in the model in place. If
+// `build_compression_dictionary` is set, the rules are compressed with a preset
+// dictionary built from all of them, which is stored in the model.
+bool CompressModel(ModelT* model, bool build_compression_dictionary = false);
 
-// Decompresses regex and datetime rules in the model in place.
+// Decompresses all compressed fields of the model in place.
 bool DecompressModel(ModelT* model);
 
 // Compresses regex and datetime rules in the model.
-std::string CompressSerializedModel(const std::string& model);
+std::string CompressSerializedModel(const std::string& model,
+                                    bool build_compression_dictionary = false);
+
+// Decompresses all compressed fields of the model. The result is larger, but
+// can be memory-mapped and used without decompressing anything at load time.
+std::string DecompressSerializedModel(const std::string& model);
 
 }  // namespace libtextclassifier3
 
@@ -96,4 +96,93 @@ TEST(ZlibUtilsTest, CompressModel) {
             "an example datetime extractor");
 }
 
+TEST(ZlibUtilsTest, CompressModelWithDictionary) {
+  ModelT model;
+  model.regex_model.reset(new RegexModelT);
+  model.regex_model->patterns.emplace_back(new RegexModel_::PatternT);
+  model.regex_model->patterns.back()->pattern = "this is a test pattern";
+  model.regex_model->patterns.emplace_back(new RegexModel_::PatternT);
+  model.regex_model->patterns.back()->pattern = "this is a second test pattern";
+
+  EXPECT_TRUE(CompressModel(&model, /*build_compression_dictionary=*/true));
+  EXPECT_FALSE(model.compression_dictionary.empty());
+
+  flatbuffers::FlatBufferBuilder builder;
+  builder.Finish(Model::Pack(builder, &model));
+  const Model* compressed_model =
+      GetModel(reinterpret_cast<const char*>(builder.GetBufferPointer()));
+  ASSERT_TRUE(compressed_model != nullptr);
+
+  // The patterns can be decompressed in any order.
+  std::unique_ptr<ZlibDecompressor> decompressor = ZlibDecompressor::Instance(
+      compressed_model->compression_dictionary()->data(),
+      compressed_model->compression_dictionary()->size());
+  ASSERT_TRUE(decompressor != nullptr);
+  std::string uncompressed_pattern;
+  EXPECT_TRUE(decompressor->MaybeDecompress(
+      compressed_model->regex_model()->patterns()->Get(1)->compressed_pattern(),
+      &uncompressed_pattern));
+  EXPECT_EQ(uncompressed_pattern, "this is a second test pattern");
+  EXPECT_TRUE(decompressor->MaybeDecompress(
+      compressed_model->regex_model()->patterns()->Get(0)->compressed_pattern(),
+      &uncompressed_pattern));
+  EXPECT_EQ(uncompressed_pattern, "this is a test pattern");
+
+  EXPECT_TRUE(DecompressModel(&model));
+  EXPECT_TRUE(model.compression_dictionary.empty());
+  EXPECT_EQ(model.regex_model->patterns[0]->pattern, "this is a test pattern");
+  EXPECT_EQ(model.regex_model->patterns[1]->pattern,
+            "this is a second test pattern");
+}
+
+TEST(ZlibUtilsTest, DecompressSerializedModel) {
+  ModelT model;
+  model.regex_model.reset(new RegexModelT);
+  model.regex_model->patterns.emplace_back(new RegexModel_::PatternT);
+  model.regex_model->patterns.back()->pattern = "this is a test pattern";
+
+  model.resources.reset(new ResourcePoolT);
+  model.resources->resource_entry.emplace_back(new ResourceEntryT);
+  model.resources->resource_entry.back()->name = "test";
+  model.resources->resource_entry.back()->resource.emplace_back(
+      new ResourceT);
+  model.resources->resource_entry.back()->resource.back()->content =
+      "this is a test resource, this is a test resource";
+
+  model.intent_options.reset(new IntentFactoryModelT);
+  model.intent_options->generator.emplace_back(
+      new IntentFactoryModel_::IntentGeneratorT);
+  const std::string lua_generator = "return {{ action = 'test' }}";
+  model.intent_options->generator.back()->lua_template_generator.assign(
+      lua_generator.begin(), lua_generator.end());
+
+  EXPECT_TRUE(CompressModel(&model));
+  flatbuffers::FlatBufferBuilder builder;
+  FinishModelBuffer(builder, Model::Pack(builder, &model));
+  const std::string decompressed_buffer = DecompressSerializedModel(
+      std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                  builder.GetSize()));
+
+  const Model* decompressed_model = GetModel(decompressed_buffer.data());
+  ASSERT_TRUE(decompressed_model != nullptr);
+  const auto* pattern = decompressed_model->regex_model()->patterns()->Get(0);
+  EXPECT_EQ(pattern->compressed_pattern(), nullptr);
+  EXPECT_EQ(pattern->pattern()->str(), "this is a test pattern");
+  const auto* resource = decompressed_model->resources()
+                             ->resource_entry()
+                             ->Get(0)
+                             ->resource()
+                             ->Get(0);
+  EXPECT_EQ(resource->compressed_content(), nullptr);
+  EXPECT_EQ(resource->content()->str(),
+            "this is a test resource, this is a test resource");
+  const auto* generator =
+      decompressed_model->intent_options()->generator()->Get(0);
+  EXPECT_EQ(generator->compressed_lua_template_generator(), nullptr);
+  EXPECT_EQ(std::string(reinterpret_cast<const char*>(
+                            generator->lua_template_generator()->data()),
+                        generator->lua_template_generator()->size()),
+            lua_generator);
+}
+
 }  // namespace libtextclassifier3
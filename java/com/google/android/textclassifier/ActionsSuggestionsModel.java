@@ -76,6 +76,49 @@ public final class ActionsSuggestionsModel implements AutoCloseable {
         /* generateAndroidIntents= */ false);
   }
 
+  /**
+   * Suggests actions / replies to each of the given conversations, in a single native call. Returns
+   * the suggestions in the order of the conversations.
+   */
+  public ActionSuggestion[][] suggestActionsBatch(
+      Conversation[] conversations, ActionSuggestionOptions options, AnnotatorModel annotator) {
+    return nativeSuggestActionsBatch(
+        actionsModelPtr,
+        conversations,
+        options,
+        (annotator != null ? annotator.getNativeAnnotator() : 0),
+        /* appContext= */ null,
+        /* deviceLocales= */ null,
+        /* generateAndroidIntents= */ false);
+  }
+
+  /**
+   * Same as {@link #suggestActions}, but runs on a native worker thread and returns immediately.
+   * The callback is invoked on that worker thread, unless the returned request is cancelled first;
+   * a cancelled request stops between the messages it annotates and between its sources. Both this
+   * model and the annotator must stay open until the callback has run or the request is cancelled.
+   * Returns null if the request couldn't be scheduled. The caller closes the returned request once
+   * it is done.
+   */
+  public AsyncRequest suggestActionsAsync(
+      Conversation conversation,
+      ActionSuggestionOptions options,
+      AnnotatorModel annotator,
+      SuggestActionsCallback callback) {
+    AsyncRequest request = new AsyncRequest();
+    if (!nativeSuggestActionsAsync(
+        actionsModelPtr,
+        conversation,
+        options,
+        (annotator != null ? annotator.getNativeAnnotator() : 0),
+        callback,
+        request.getNativePtr())) {
+      request.close();
+      return null;
+    }
+    return request;
+  }
+
   public ActionSuggestion[] suggestActionsWithIntents(
       Conversation conversation,
       ActionSuggestionOptions options,
@@ -92,6 +135,26 @@ public final class ActionsSuggestionsModel implements AutoCloseable {
         /* generateAndroidIntents= */ true);
   }
 
+  /**
+   * Rebuilds the TFLite interpreter of the model to run ops on up to {@code numThreads} threads
+   * (the TFLite default if not positive), and to optionally compute fp32 ops in fp16. Should be
+   * called before serving requests.
+   */
+  public void setExecutorOptions(int numThreads, boolean allowFp16) {
+    if (!nativeSetExecutorOptions(actionsModelPtr, numThreads, allowFp16)) {
+      throw new IllegalArgumentException("Couldn't set the executor options");
+    }
+  }
+
+  /**
+   * Runs the model once over synthetic input so that the first real request doesn't pay for the
+   * lazy initialization. Returns one entry per warm-up phase, holding the phase name and its
+   * duration in microseconds. A negative duration means the phase failed.
+   */
+  public NamedVariant[] warmup() {
+    return nativeWarmup(actionsModelPtr);
+  }
+
   /** Frees up the allocated memory. */
   @Override
   public void close() {
@@ -236,6 +299,12 @@ public final class ActionsSuggestionsModel implements AutoCloseable {
     }
   }
 
+  /** Receives the result of a suggestActionsAsync call. */
+  public interface SuggestActionsCallback {
+    /** Called with the suggestions, as {@link #suggestActions} would have returned them. */
+    void onSuggestedActions(ActionSuggestion[] suggestions);
+  }
+
   /** Represents options for the SuggestActions call. */
   public static final class ActionSuggestionOptions {
     public ActionSuggestionOptions() {}
@@ -261,5 +330,26 @@ public final class ActionsSuggestionsModel implements AutoCloseable {
       String deviceLocales,
       boolean generateAndroidIntents);
 
+  private native ActionSuggestion[][] nativeSuggestActionsBatch(
+      long context,
+      Conversation[] conversations,
+      ActionSuggestionOptions options,
+      long annotatorPtr,
+      Object appContext,
+      String deviceLocales,
+      boolean generateAndroidIntents);
+
+  private native boolean nativeSuggestActionsAsync(
+      long context,
+      Conversation conversation,
+      ActionSuggestionOptions options,
+      long annotatorPtr,
+      SuggestActionsCallback callback,
+      long requestPtr);
+
+  private native boolean nativeSetExecutorOptions(long ptr, int numThreads, boolean allowFp16);
+
+  private native NamedVariant[] nativeWarmup(long ptr);
+
   private native void nativeCloseActionsModel(long ptr);
 }
@@ -16,6 +16,7 @@
 
 package com.google.android.textclassifier;
 
+import java.nio.ByteBuffer;
 import java.util.Collection;
 import java.util.concurrent.atomic.AtomicBoolean;
 
@@ -110,6 +111,17 @@ public final class AnnotatorModel implements AutoCloseable {
     }
   }
 
+  /**
+   * Rebuilds the TFLite interpreters of the model to run ops on up to {@code numThreads} threads
+   * (the TFLite default if not positive), and to optionally compute fp32 ops in fp16. Should be
+   * called before serving requests.
+   */
+  public void setExecutorOptions(int numThreads, boolean allowFp16) {
+    if (!nativeSetExecutorOptions(annotatorPtr, numThreads, allowFp16)) {
+      throw new IllegalArgumentException("Couldn't set the executor options");
+    }
+  }
+
   /**
    * Given a string context and current selection, computes the selection suggestion.
    *
@@ -155,6 +167,49 @@ public final class AnnotatorModel implements AutoCloseable {
         annotatorPtr, context, selectionBegin, selectionEnd, options, appContext, deviceLocales);
   }
 
+  /**
+   * Same as {@link #classifyText(String, int, int, ClassificationOptions, Object, String)}, but
+   * generates the intents of all the results, not only of the top one. The intents are generated
+   * in a single pass over the results, which is cheaper than classifying and generating them for
+   * each result separately.
+   */
+  public ClassificationResult[] classifyTextWithAllIntents(
+      String context,
+      int selectionBegin,
+      int selectionEnd,
+      ClassificationOptions options,
+      Object appContext,
+      String deviceLocales) {
+    return nativeClassifyTextWithAllIntents(
+        annotatorPtr, context, selectionBegin, selectionEnd, options, appContext, deviceLocales);
+  }
+
+  /**
+   * Same as {@link #suggestSelection} followed by {@link #classifyText(String, int, int,
+   * ClassificationOptions, Object, String)} of the suggested selection, but in a single call that
+   * reuses the work of the selection for the classification.
+   *
+   * <p>Returns the suggested selection with its classification results.
+   */
+  public AnnotatedSpan suggestSelectionAndClassify(
+      String context,
+      int selectionBegin,
+      int selectionEnd,
+      SelectionOptions selectionOptions,
+      ClassificationOptions classificationOptions,
+      Object appContext,
+      String deviceLocales) {
+    return nativeSuggestSelectionAndClassify(
+        annotatorPtr,
+        context,
+        selectionBegin,
+        selectionEnd,
+        selectionOptions,
+        classificationOptions,
+        appContext,
+        deviceLocales);
+  }
+
   /**
    * Annotates given input text. The annotations should cover the whole input context except for
    * whitespaces, and are sorted by their position in the context string.
@@ -163,6 +218,74 @@ public final class AnnotatorModel implements AutoCloseable {
     return nativeAnnotate(annotatorPtr, text, options);
   }
 
+  /**
+   * Same as {@link #annotate(String, AnnotationOptions)}, for text that is already encoded as
+   * UTF-8. The indices of the returned spans are still UTF-16 indices, as if the text were a
+   * String.
+   */
+  public AnnotatedSpan[] annotate(byte[] utf8Text, AnnotationOptions options) {
+    return nativeAnnotateUtf8(annotatorPtr, utf8Text, options);
+  }
+
+  /**
+   * Same as {@link #annotate(byte[], AnnotationOptions)}, for UTF-8 text between the position and
+   * the limit of a direct buffer. The buffer position is not changed.
+   */
+  public AnnotatedSpan[] annotate(ByteBuffer utf8Text, AnnotationOptions options) {
+    if (!utf8Text.isDirect()) {
+      throw new IllegalArgumentException("The buffer is not direct.");
+    }
+    return nativeAnnotateDirectUtf8(
+        annotatorPtr, utf8Text, utf8Text.position(), utf8Text.remaining(), options);
+  }
+
+  /**
+   * Same as {@link #annotate(String, AnnotationOptions)}, but returns the annotations in a compact
+   * form, which creates far fewer Java objects. The entity data of the results is only available
+   * in its serialized form.
+   */
+  public AnnotatedSpans annotateCompact(String text, AnnotationOptions options) {
+    return nativeAnnotateCompact(annotatorPtr, text, options);
+  }
+
+  /**
+   * Annotates each of the given texts, in a single native call. Returns the annotations of each
+   * text in the compact form of {@link #annotateCompact}, in the order of the texts.
+   */
+  public AnnotatedSpans[] annotateBatch(String[] texts, AnnotationOptions options) {
+    return nativeAnnotateBatch(annotatorPtr, texts, options);
+  }
+
+  /**
+   * Classifies the selection of each of the given contexts, in a single native call. Selection
+   * {@code i} is [selectionBegins[i], selectionEnds[i]) in contexts[i]. Returns the results in the
+   * order of the contexts, without intents.
+   */
+  public ClassificationResult[][] classifyTextBatch(
+      String[] contexts,
+      int[] selectionBegins,
+      int[] selectionEnds,
+      ClassificationOptions options) {
+    return nativeClassifyTextBatch(
+        annotatorPtr, contexts, selectionBegins, selectionEnds, options);
+  }
+
+  /**
+   * Same as {@link #annotate(String, AnnotationOptions)}, but runs on a native worker thread and
+   * returns immediately. The callback is invoked on that worker thread, unless the returned request
+   * is cancelled first; a cancelled request stops between lines, rules and candidates. Returns null
+   * if the request couldn't be scheduled. The caller closes the returned request once it is done.
+   */
+  public AsyncRequest annotateAsync(
+      String text, AnnotationOptions options, AnnotateCallback callback) {
+    AsyncRequest request = new AsyncRequest();
+    if (!nativeAnnotateAsync(annotatorPtr, text, options, callback, request.getNativePtr())) {
+      request.close();
+      return null;
+    }
+    return request;
+  }
+
   /**
    * Looks up a knowledge entity by its identifier. Returns null if the entity is not found or on
    * error.
@@ -171,6 +294,32 @@ public final class AnnotatorModel implements AutoCloseable {
     return nativeLookUpKnowledgeEntity(annotatorPtr, id);
   }
 
+  /**
+   * Runs the model once over synthetic input so that the first real request doesn't pay for the
+   * lazy initialization. Returns one entry per warm-up phase, holding the phase name and its
+   * duration in microseconds. A negative duration means the phase failed.
+   */
+  public NamedVariant[] warmup() {
+    return nativeWarmup(annotatorPtr);
+  }
+
+  /**
+   * Replaces the native model with the one of {@code newModel}, which is consumed by the call and
+   * must not be used afterwards. Calls already in flight finish on the old model, which is freed
+   * once they are done. If {@code warmup} is set, the new model is warmed up before it serves, and
+   * the warm-up phases are returned as in {@link #warmup()}. The knowledge, contact and installed
+   * app engines need to be initialized on {@code newModel} before the swap.
+   */
+  public NamedVariant[] swapModel(AnnotatorModel newModel, boolean warmup) {
+    if (!newModel.isClosed.compareAndSet(false, true)) {
+      throw new IllegalArgumentException("The new model is already closed.");
+    }
+    final NamedVariant[] warmupReport =
+        nativeSwapAnnotator(annotatorPtr, newModel.annotatorPtr, warmup);
+    newModel.annotatorPtr = 0L;
+    return warmupReport;
+  }
+
   /** Frees up the allocated memory. */
   @Override
   public void close() {
@@ -385,6 +534,144 @@ public final class AnnotatorModel implements AutoCloseable {
     }
   }
 
+  /**
+   * Represents the result of an annotateCompact call. The annotations are stored column-wise in
+   * primitive arrays, and the {@link AnnotatedSpan} objects are only created when asked for.
+   */
+  public static final class AnnotatedSpans {
+    private static final int NUM_STRING_FIELDS = 8;
+
+    private final int[] startIndices;
+    private final int[] endIndices;
+    // The classification results of span i are in [resultOffsets[i], resultOffsets[i + 1]).
+    private final int[] resultOffsets;
+    private final String[] collections;
+    private final int[] collectionIds;
+    private final float[] scores;
+    private final long[] datetimeTimesMsUtc;
+    // -1 if the result has no datetime.
+    private final int[] datetimeGranularities;
+    private final long[] durationsMs;
+    private final long[] numericValues;
+    // Contact and app fields, NUM_STRING_FIELDS indices into strings per result, -1 if unset.
+    private final String[] strings;
+    private final int[] stringIndices;
+    private final byte[][] serializedKnowledgeResults;
+    private final byte[][] serializedEntityData;
+    private final AnnotatedSpan[] annotatedSpans;
+
+    AnnotatedSpans(
+        int[] startIndices,
+        int[] endIndices,
+        int[] resultOffsets,
+        String[] collections,
+        int[] collectionIds,
+        float[] scores,
+        long[] datetimeTimesMsUtc,
+        int[] datetimeGranularities,
+        long[] durationsMs,
+        long[] numericValues,
+        String[] strings,
+        int[] stringIndices,
+        byte[][] serializedKnowledgeResults,
+        byte[][] serializedEntityData) {
+      this.startIndices = startIndices;
+      this.endIndices = endIndices;
+      this.resultOffsets = resultOffsets;
+      this.collections = collections;
+      this.collectionIds = collectionIds;
+      this.scores = scores;
+      this.datetimeTimesMsUtc = datetimeTimesMsUtc;
+      this.datetimeGranularities = datetimeGranularities;
+      this.durationsMs = durationsMs;
+      this.numericValues = numericValues;
+      this.strings = strings;
+      this.stringIndices = stringIndices;
+      this.serializedKnowledgeResults = serializedKnowledgeResults;
+      this.serializedEntityData = serializedEntityData;
+      this.annotatedSpans = new AnnotatedSpan[startIndices.length];
+    }
+
+    /** Returns the number of annotated spans. */
+    public int size() {
+      return startIndices.length;
+    }
+
+    public int getStartIndex(int span) {
+      return startIndices[span];
+    }
+
+    public int getEndIndex(int span) {
+      return endIndices[span];
+    }
+
+    /** Returns the number of classification results of the span. */
+    public int getClassificationCount(int span) {
+      return resultOffsets[span + 1] - resultOffsets[span];
+    }
+
+    /** Returns the collection of the {@code index}-th classification result of the span. */
+    public String getCollection(int span, int index) {
+      return collections[collectionIds[resultOffsets[span] + index]];
+    }
+
+    /** Returns the score of the {@code index}-th classification result of the span. */
+    public float getScore(int span, int index) {
+      return scores[resultOffsets[span] + index];
+    }
+
+    /** Returns the span as an {@link AnnotatedSpan}, which is created on the first call. */
+    public synchronized AnnotatedSpan get(int span) {
+      if (annotatedSpans[span] == null) {
+        final ClassificationResult[] classification =
+            new ClassificationResult[getClassificationCount(span)];
+        for (int i = 0; i < classification.length; i++) {
+          classification[i] = createClassificationResult(resultOffsets[span] + i);
+        }
+        annotatedSpans[span] =
+            new AnnotatedSpan(startIndices[span], endIndices[span], classification);
+      }
+      return annotatedSpans[span];
+    }
+
+    private ClassificationResult createClassificationResult(int result) {
+      final DatetimeResult datetimeResult =
+          datetimeGranularities[result] < 0
+              ? null
+              : new DatetimeResult(datetimeTimesMsUtc[result], datetimeGranularities[result]);
+      final int stringOffset = result * NUM_STRING_FIELDS;
+      return new ClassificationResult(
+          collections[collectionIds[result]],
+          scores[result],
+          datetimeResult,
+          serializedKnowledgeResults[result],
+          getString(stringOffset),
+          getString(stringOffset + 1),
+          getString(stringOffset + 2),
+          getString(stringOffset + 3),
+          getString(stringOffset + 4),
+          getString(stringOffset + 5),
+          getString(stringOffset + 6),
+          getString(stringOffset + 7),
+          /* entityData= */ null,
+          serializedEntityData[result],
+          /* remoteActionTemplates= */ null,
+          durationsMs[result],
+          numericValues[result]);
+    }
+
+    private String getString(int stringIndex) {
+      final int index = stringIndices[stringIndex];
+      return index < 0 ? null : strings[index];
+    }
+  }
+
+  /** Receives the result of an annotateAsync call. */
+  public interface AnnotateCallback {
+    /** Called with the annotations, as {@link #annotate} would have returned them. */
+    void onAnnotated(AnnotatedSpan[] annotations);
+  }
+
   /** Represents options for the suggestSelection call. */
   public static final class SelectionOptions {
     private final String locales;
@@ -546,7 +833,7 @@ public final class AnnotatorModel implements AutoCloseable {
 
   /**
    * Retrieves the pointer to the native object. Note: Need to keep the AnnotatorModel alive as long
-   * as the pointer is used.
+   * as the pointer is used, and not to swap its model meanwhile.
    */
   long getNativeAnnotator() {
     return nativeGetNativeModelPtr(annotatorPtr);
@@ -570,6 +857,8 @@ public final class AnnotatorModel implements AutoCloseable {
 
   private native boolean nativeInitializeInstalledAppEngine(long context, byte[] serializedConfig);
 
+  private native boolean nativeSetExecutorOptions(long context, int numThreads, boolean allowFp16);
+
   private native int[] nativeSuggestSelection(
       long context, String text, int selectionBegin, int selectionEnd, SelectionOptions options);
 
@@ -582,10 +871,60 @@ public final class AnnotatorModel implements AutoCloseable {
       Object appContext,
       String deviceLocales);
 
+  private native ClassificationResult[] nativeClassifyTextWithAllIntents(
+      long context,
+      String text,
+      int selectionBegin,
+      int selectionEnd,
+      ClassificationOptions options,
+      Object appContext,
+      String deviceLocales);
+
+  private native AnnotatedSpan nativeSuggestSelectionAndClassify(
+      long context,
+      String text,
+      int selectionBegin,
+      int selectionEnd,
+      SelectionOptions selectionOptions,
+      ClassificationOptions classificationOptions,
+      Object appContext,
+      String deviceLocales);
+
   private native AnnotatedSpan[] nativeAnnotate(
       long context, String text, AnnotationOptions options);
 
+  private native AnnotatedSpan[] nativeAnnotateUtf8(
+      long context, byte[] utf8Text, AnnotationOptions options);
+
+  private native AnnotatedSpan[] nativeAnnotateDirectUtf8(
+      long context, ByteBuffer utf8Text, int offset, int length, AnnotationOptions options);
+
+  private native AnnotatedSpans nativeAnnotateCompact(
+      long context, String text, AnnotationOptions options);
+
+  private native AnnotatedSpans[] nativeAnnotateBatch(
+      long context, String[] texts, AnnotationOptions options);
+
+  private native ClassificationResult[][] nativeClassifyTextBatch(
+      long context,
+      String[] contexts,
+      int[] selectionBegins,
+      int[] selectionEnds,
+      ClassificationOptions options);
+
+  private native boolean nativeAnnotateAsync(
+      long context,
+      String text,
+      AnnotationOptions options,
+      AnnotateCallback callback,
+      long requestPtr);
+
   private native byte[] nativeLookUpKnowledgeEntity(long context, String id);
 
+  private native NamedVariant[] nativeWarmup(long context);
+
+  private native NamedVariant[] nativeSwapAnnotator(
+      long context, long newContext, boolean warmup);
+
   private native void nativeCloseAnnotator(long context);
 }
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.google.android.textclassifier;
+
+/**
+ * Handle of an asynchronous request, used to cancel it once its result is no longer needed. The
+ * native code checks for cancellation between the steps of its work, so a cancelled request stops
+ * at the next check and doesn't invoke its callback.
+ *
+ * @hide
+ */
+public final class AsyncRequest implements AutoCloseable {
+  static {
+    System.loadLibrary("textclassifier");
+  }
+
+  private long requestPtr;
+
+  AsyncRequest() {
+    requestPtr = nativeNewAsyncRequest();
+  }
+
+  /** Cancels the request. Does nothing if the request has already finished or is closed. */
+  public synchronized void cancel() {
+    if (requestPtr != 0L) {
+      nativeCancelAsyncRequest(requestPtr);
+    }
+  }
+
+  /** Frees up the handle. A request that is still running is not cancelled by closing it. */
+  @Override
+  public synchronized void close() {
+    if (requestPtr != 0L) {
+      nativeCloseAsyncRequest(requestPtr);
+      requestPtr = 0L;
+    }
+  }
+
+  @Override
+  protected void finalize() throws Throwable {
+    try {
+      close();
+    } finally {
+      super.finalize();
+    }
+  }
+
+  synchronized long getNativePtr() {
+    return requestPtr;
+  }
+
+  private static native long nativeNewAsyncRequest();
+
+  private static native void nativeCancelAsyncRequest(long requestPtr);
+
+  private static native void nativeCloseAsyncRequest(long requestPtr);
+}
@@ -53,6 +53,23 @@ public final class LangIdModel implements AutoCloseable {
     return nativeDetectLanguages(modelPtr, text);
   }
 
+  /**
+   * Detects the languages of each of the given texts, in a single native call. Returns the results
+   * in the order of the texts.
+   */
+  public LanguageResult[][] detectLanguagesBatch(String[] texts) {
+    return nativeDetectLanguagesBatch(modelPtr, texts);
+  }
+
+  /**
+   * Runs the model once over synthetic input so that the first real request doesn't pay for the
+   * lazy initialization. Returns one entry per warm-up phase, holding the phase name and its
+   * duration in microseconds. A negative duration means the phase failed.
+   */
+  public NamedVariant[] warmup() {
+    return nativeWarmup(modelPtr);
+  }
+
   /** Frees up the allocated memory. */
   @Override
   public void close() {
@@ -109,6 +126,10 @@ public final class LangIdModel implements AutoCloseable {
 
   private native LanguageResult[] nativeDetectLanguages(long nativePtr, String text);
 
+  private native LanguageResult[][] nativeDetectLanguagesBatch(long nativePtr, String[] texts);
+
+  private native NamedVariant[] nativeWarmup(long nativePtr);
+
   private native void nativeClose(long nativePtr);
 
   private native int nativeGetVersion(long nativePtr);
@@ -163,6 +163,11 @@ class EmbeddingFeatureExtractor : public GenericEmbeddingFeatureExtractor {
     }
   }
 
+  // Returns the feature extractor of the i-th embedding space.
+  const EXTRACTOR &feature_extractor(int i) const {
+    return *feature_extractors_[i];
+  }
+
  private:
   // Templated feature extractor class.
   std::vector<std::unique_ptr<EXTRACTOR>> feature_extractors_;
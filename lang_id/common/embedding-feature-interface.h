@@ -84,23 +84,35 @@ class EmbeddingFeatureInterface {
 
   // Simpler version of GetFeatures(), for cases when there is no opportunity to
   // reuse computation between feature extractions for the same |obj|, but with
-  // different |args|.  Returns the extracted features.  For more info, see the
-  // doc for GetFeatures().
-  std::vector<FeatureVector> GetFeaturesNoCaching(OBJ *obj,
-                                                  ARGS... args) const {
+  // different |args|.  Puts the extracted features into |features|.  For more
+  // info, see the doc for GetFeatures().
+  //
+  // |workspace| and |features| are only scratch storage: their contents are
+  // overwritten.  Callers that pass the same ones to every call recycle their
+  // allocated memory, such that the steady state doesn't allocate.
+  void GetFeaturesReusingBuffers(OBJ *obj, ARGS... args,
+                                 WorkspaceSet *workspace,
+                                 std::vector<FeatureVector> *features) const {
     // Technically, we still use a workspace, because
     // feature_extractor_.ExtractFeatures requires one.  But there is no real
     // caching here, as we start from scratch for each call to ExtractFeatures.
-    WorkspaceSet workspace;
-    Preprocess(&workspace, obj);
-    std::vector<FeatureVector> features(NumEmbeddings());
-    GetFeatures(*obj, args..., workspace, &features);
-    return features;
+    Preprocess(workspace, obj);
+    if (features->size() != NumEmbeddings()) {
+      // FeatureVector can't be moved, so we can't just resize.
+      *features = std::vector<FeatureVector>(NumEmbeddings());
+    }
+    GetFeatures(*obj, args..., *workspace, features);
   }
 
   // Returns number of embedding spaces.
   int NumEmbeddings() const { return feature_extractor_.NumEmbeddings(); }
 
+  // Returns the underlying feature extractor.
+  const EmbeddingFeatureExtractor<EXTRACTOR, OBJ, ARGS...> &feature_extractor()
+      const {
+    return feature_extractor_;
+  }
+
  private:
   // Typed feature extractor for embeddings.
   EmbeddingFeatureExtractor<EXTRACTOR, OBJ, ARGS...> feature_extractor_;
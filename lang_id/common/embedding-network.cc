@@ -16,8 +16,12 @@
 
 #include "lang_id/common/embedding-network.h"
 
+#include <algorithm>
+#include <vector>
+
 #include "lang_id/common/lite_base/integral-types.h"
 #include "lang_id/common/lite_base/logging.h"
+#include "lang_id/common/math/add-scaled.h"
 
 namespace libtextclassifier3 {
 namespace mobile {
@@ -100,40 +104,26 @@ void SparseReluProductPlusBias(bool apply_relu,
       // weights.
       const float *weight_ptr =
           reinterpret_cast<const float *>(weights.elements);
-      for (int i = 0; i < x_size; ++i) {
-        // Invariant 1: weight_ptr points to the beginning of the i-th row from
-        // weights (i.e., weights[i][0]).
+      for (int i = 0; i < x_size; ++i, weight_ptr += y_size) {
+        // Invariant: weight_ptr points to the beginning of the i-th row from
+        // weights (i.e., weights[i][0]).  Rows have y_size == weights.cols()
+        // elements (see earlier CHECK_EQ).
         const float scale = x[i];
         if (!apply_relu || (scale > 0)) {
-          for (int j = 0; j < y_size; ++j, ++weight_ptr) {
-            // Invariant 2: weight_ptr points to weights[i][j].
-            y_data[j] += (*weight_ptr) * scale;
-          }
-        } else {
-          // We don't update y_data, but we still have to move weight_ptr to the
-          // next row (to satisfy Invariant 1).  We do this by adding y_size ==
-          // weights.cols() (see earlier CHECK_EQ).
-          weight_ptr += y_size;
+          AddScaled(weight_ptr, scale, y_data, y_size);
         }
       }
       break;
     }
     case QuantizationType::FLOAT16: {
-      // See comments for the QuantizationType::NONE case: the code is almost
-      // identical, except for float16 (instead of float) and the Float16To32
-      // conversion.  We could unify these two cases using a template, but since
-      // this is a critical loop, don't want to risk that e.g., inlining of the
-      // conversion function doesn't happen.
+      // See comments for the QuantizationType::NONE case: the code is
+      // identical, except for float16 (instead of float) weights.
       const float16 *weight_ptr =
           reinterpret_cast<const float16 *>(weights.elements);
-      for (int i = 0; i < x_size; ++i) {
+      for (int i = 0; i < x_size; ++i, weight_ptr += y_size) {
         const float scale = x[i];
         if (!apply_relu || (scale > 0)) {
-          for (int j = 0; j < y_size; ++j, ++weight_ptr) {
-            y_data[j] += Float16To32(*weight_ptr) * scale;
-          }
-        } else {
-          weight_ptr += y_size;
+          AddScaled(weight_ptr, scale, y_data, y_size);
         }
       }
       break;
@@ -143,12 +133,91 @@ void SparseReluProductPlusBias(bool apply_relu,
                        << static_cast<int>(weights.quant_type);
   }
 }
+
+// Batch version of SparseReluProductPlusBias: computes y = weights * Relu(x) +
+// b for batch_size inputs at once.  x contains the inputs one after the other
+// (i.e., x is a batch_size x weights.rows matrix in row-major order), and y is
+// filled with the outputs in the same way.
+//
+// Each row of weights is read once and applied to all inputs before moving to
+// the next row; the rows are still visited in the same order as for a single
+// input, so the results are the same.
+void SparseReluProductPlusBiasBatch(
+    bool apply_relu, const EmbeddingNetworkParams::Matrix &weights,
+    const EmbeddingNetworkParams::Matrix &b, const std::vector<float> &x,
+    int batch_size, std::vector<float> *y) {
+  const float *b_start = reinterpret_cast<const float *>(b.elements);
+  SAFTM_DCHECK_EQ(b.cols, 1);
+  const int y_size = b.rows;
+  SAFTM_CHECK_EQ(weights.cols, y_size);
+  const int x_size = weights.rows;
+  SAFTM_CHECK_EQ(x.size(), x_size * batch_size);
+
+  // Initialize each output to b.
+  y->resize(y_size * batch_size);
+  for (int n = 0; n < batch_size; ++n) {
+    std::copy(b_start, b_start + y_size, y->data() + n * y_size);
+  }
+
+  // Row of weights, converted to float if quantized.
+  std::vector<float> row_buffer;
+  if (weights.quant_type == QuantizationType::FLOAT16) {
+    row_buffer.resize(y_size);
+  } else if (weights.quant_type != QuantizationType::NONE) {
+    SAFTM_LOG(FATAL) << "Unsupported weights quantization type: "
+                     << static_cast<int>(weights.quant_type);
+  }
+
+  for (int i = 0; i < x_size; ++i) {
+    const float *weights_row;
+    if (weights.quant_type == QuantizationType::NONE) {
+      weights_row = reinterpret_cast<const float *>(weights.elements) +
+                    i * y_size;
+    } else {
+      const float16 *quant_row =
+          reinterpret_cast<const float16 *>(weights.elements) + i * y_size;
+      for (int j = 0; j < y_size; ++j) {
+        row_buffer[j] = Float16To32(quant_row[j]);
+      }
+      weights_row = row_buffer.data();
+    }
+    for (int n = 0; n < batch_size; ++n) {
+      const float scale = x[n * x_size + i];
+      if (apply_relu && (scale <= 0)) {
+        continue;
+      }
+      AddScaled(weights_row, scale, y->data() + n * y_size, y_size);
+    }
+  }
+}
+
+// Computes y += weights[row] * scale, where y has weights.cols elements and
+// weights is of quantization type NONE or FLOAT16.
+void AddWeightsRow(const EmbeddingNetworkParams::Matrix &weights, int row,
+                   float scale, float *y) {
+  if (weights.quant_type == QuantizationType::NONE) {
+    AddScaled(reinterpret_cast<const float *>(weights.elements) +
+                  row * weights.cols,
+              scale, y, weights.cols);
+  } else {
+    SAFTM_DCHECK_EQ(static_cast<int>(QuantizationType::FLOAT16),
+                    static_cast<int>(weights.quant_type));
+    AddScaled(reinterpret_cast<const float16 *>(weights.elements) +
+                  row * weights.cols,
+              scale, y, weights.cols);
+  }
+}
 }  // namespace
 
 void EmbeddingNetwork::ConcatEmbeddings(
     const std::vector<FeatureVector> &feature_vectors,
     std::vector<float> *concat) const {
-  concat->resize(concat_layer_size_);
+  concat->assign(concat_layer_size_, 0.0f);
+  ConcatEmbeddings(feature_vectors, concat->data());
+}
+
+void EmbeddingNetwork::ConcatEmbeddings(
+    const std::vector<FeatureVector> &feature_vectors, float *concat) const {
 
   // "es_index" stands for "embedding space index".
   for (int es_index = 0; es_index < feature_vectors.size(); ++es_index) {
@@ -157,18 +226,16 @@ void EmbeddingNetwork::ConcatEmbeddings(
     const EmbeddingNetworkParams::Matrix &embedding_matrix =
         embedding_matrices_[es_index];
     const int embedding_dim = embedding_matrix.cols;
-    const int embedding_row_size_in_bytes =
-        embedding_row_size_in_bytes_[es_index];
 
     const FeatureVector &feature_vector = feature_vectors[es_index];
     const int num_features = feature_vector.size();
     for (int fi = 0; fi < num_features; ++fi) {
       const FeatureType *feature_type = feature_vector.type(fi);
       int feature_offset = concat_offset + feature_type->base() * embedding_dim;
-      SAFTM_CHECK_LE(feature_offset + embedding_dim, concat->size());
+      SAFTM_CHECK_LE(feature_offset + embedding_dim, concat_layer_size_);
 
       // Weighted embeddings will be added starting from this address.
-      float *concat_ptr = concat->data() + feature_offset;
+      float *concat_ptr = concat + feature_offset;
 
       // Multiplier for each embedding weight.  Includes feature weight (for
       // continuous features) and quantization scale (for quantized embeddings).
@@ -188,57 +255,149 @@ void EmbeddingNetwork::ConcatEmbeddings(
 
       SAFTM_CHECK_GE(feature_id, 0);
       SAFTM_CHECK_LT(feature_id, embedding_matrix.rows);
+      AddEmbedding(es_index, feature_id, multiplier, concat_ptr);
+    }
+  }
+}
 
-      // Pointer to float / uint8 weights for relevant embedding.
-      const void *embedding_data =
-          (reinterpret_cast<const char *>(embedding_matrix.elements) +
-           feature_id * embedding_row_size_in_bytes);
-
-      switch (embedding_matrix.quant_type) {
-        case QuantizationType::NONE: {
-          const float *weights =
-              reinterpret_cast<const float *>(embedding_data);
-          for (int i = 0; i < embedding_dim; ++i, ++weights, ++concat_ptr) {
-            *concat_ptr += *weights * multiplier;
-          }
-          break;
-        }
-        case QuantizationType::UINT8: {
-          multiplier *= Float16To32(embedding_matrix.quant_scales[feature_id]);
-          const uint8 *quant_weights =
-              reinterpret_cast<const uint8 *>(embedding_data);
-          for (int i = 0; i < embedding_dim;
-               ++i, ++quant_weights, ++concat_ptr) {
-            // 128 is bias for UINT8 quantization.
-            *concat_ptr +=
-                (static_cast<int>(*quant_weights) - 128) * multiplier;
-          }
-          break;
-        }
-        case QuantizationType::UINT4: {
-          multiplier *= Float16To32(embedding_matrix.quant_scales[feature_id]);
-          const uint8 *quant_weights =
-              reinterpret_cast<const uint8 *>(embedding_data);
-          for (int i = 0; i < embedding_dim / 2; ++i, ++quant_weights) {
-            const uint8 qq = *quant_weights;
-            concat_ptr[0] +=
-                (static_cast<int>((qq & 0xF0) | 0x08) - 128) * multiplier;
-            concat_ptr[1] +=
-                (static_cast<int>(((qq & 0x0F) << 4) | 0x08) - 128) *
-                multiplier;
-            concat_ptr += 2;
-          }
-          break;
+void EmbeddingNetwork::AddEmbedding(int es_index, int feature_id,
+                                    float multiplier, float *dest) const {
+  const EmbeddingNetworkParams::Matrix &embedding_matrix =
+      embedding_matrices_[es_index];
+  const int embedding_dim = embedding_matrix.cols;
+
+  // Pointer to float / uint8 weights for relevant embedding.
+  const void *embedding_data =
+      (reinterpret_cast<const char *>(embedding_matrix.elements) +
+       feature_id * embedding_row_size_in_bytes_[es_index]);
+
+  switch (embedding_matrix.quant_type) {
+    case QuantizationType::NONE: {
+      AddScaled(reinterpret_cast<const float *>(embedding_data), multiplier,
+                dest, embedding_dim);
+      break;
+    }
+    case QuantizationType::UINT8: {
+      multiplier *= Float16To32(embedding_matrix.quant_scales[feature_id]);
+      // 128 is bias for UINT8 quantization.
+      AddScaled(reinterpret_cast<const uint8 *>(embedding_data), multiplier,
+                dest, embedding_dim);
+      break;
+    }
+    case QuantizationType::UINT4: {
+      multiplier *= Float16To32(embedding_matrix.quant_scales[feature_id]);
+      const uint8 *quant_weights =
+          reinterpret_cast<const uint8 *>(embedding_data);
+      for (int i = 0; i < embedding_dim / 2; ++i, ++quant_weights) {
+        const uint8 qq = *quant_weights;
+        dest[0] += (static_cast<int>((qq & 0xF0) | 0x08) - 128) * multiplier;
+        dest[1] +=
+            (static_cast<int>(((qq & 0x0F) << 4) | 0x08) - 128) * multiplier;
+        dest += 2;
+      }
+      break;
+    }
+    default:
+      // We already checked (in GetMatrixRowSizeInBytes) that each embedding
+      // matrix has a known quantization type.  Hence, DLOG is enough here.
+      SAFTM_DLOG(ERROR) << "Unknown embeddings quantization type "
+                        << static_cast<int>(embedding_matrix.quant_type);
+      break;
+  }
+}
+
+void EmbeddingNetwork::AddFoldedEmbeddings(
+    const std::vector<FeatureVector> &feature_vectors,
+    const std::vector<float> &extra_inputs, float *hidden) const {
+  const EmbeddingNetworkParams::Matrix &weights = layer_weights_[0];
+  const int hidden_size = weights.cols;
+  for (int es_index = 0; es_index < feature_vectors.size(); ++es_index) {
+    const std::vector<float> &folded = folded_embeddings_[es_index];
+    const int num_rows = embedding_matrices_[es_index].rows;
+    const FeatureVector &feature_vector = feature_vectors[es_index];
+    for (int fi = 0; fi < feature_vector.size(); ++fi) {
+      // Same feature decoding as in ConcatEmbeddings().  The quantization
+      // scale is already part of the folded rows.
+      const FeatureType *feature_type = feature_vector.type(fi);
+      float multiplier;
+      int feature_id;
+      const FeatureValue feature_value = feature_vector.value(fi);
+      if (feature_type->is_continuous()) {
+        FloatFeatureValue float_feature_value(feature_value);
+        feature_id = float_feature_value.id;
+        multiplier = float_feature_value.weight;
+      } else {
+        feature_id = feature_value;
+        multiplier = 1.0;
+      }
+      SAFTM_CHECK_GE(feature_id, 0);
+      SAFTM_CHECK_LT(feature_id, num_rows);
+      const int folded_row = feature_type->base() * num_rows + feature_id;
+      SAFTM_CHECK_LE((folded_row + 1) * hidden_size, folded.size());
+      AddScaled(folded.data() + folded_row * hidden_size, multiplier, hidden,
+                hidden_size);
+    }
+  }
+
+  // The extra inputs follow the concatenated embeddings in the input layer,
+  // they are multiplied by the remaining rows of the weights.
+  SAFTM_CHECK_LE(concat_layer_size_ + extra_inputs.size(), weights.rows);
+  for (int i = 0; i < extra_inputs.size(); ++i) {
+    AddWeightsRow(weights, concat_layer_size_ + i, extra_inputs[i], hidden);
+  }
+}
+
+bool EmbeddingNetwork::FoldFirstLayer() {
+  const EmbeddingNetworkParams::Matrix &weights = layer_weights_[0];
+  if (weights.quant_type != QuantizationType::NONE &&
+      weights.quant_type != QuantizationType::FLOAT16) {
+    SAFTM_LOG(ERROR) << "Can't fold first layer weights of quantization type "
+                     << static_cast<int>(weights.quant_type);
+    return false;
+  }
+  const int hidden_size = weights.cols;
+  std::vector<std::vector<float>> folded_embeddings(
+      embedding_matrices_.size());
+  std::vector<float> embedding;
+  for (int es_index = 0; es_index < embedding_matrices_.size(); ++es_index) {
+    const EmbeddingNetworkParams::Matrix &embedding_matrix =
+        embedding_matrices_[es_index];
+    const int embedding_dim = embedding_matrix.cols;
+    const int num_slots = model_->embedding_num_features(es_index);
+    std::vector<float> &folded = folded_embeddings[es_index];
+    folded.assign(static_cast<size_t>(num_slots) * embedding_matrix.rows *
+                      hidden_size,
+                  0.0f);
+    for (int feature_id = 0; feature_id < embedding_matrix.rows;
+         ++feature_id) {
+      embedding.assign(embedding_dim, 0.0f);
+      AddEmbedding(es_index, feature_id, /*multiplier=*/1.0f,
+                   embedding.data());
+
+      // Each slot of the embedding space has its own rows of the weights.
+      for (int slot = 0; slot < num_slots; ++slot) {
+        const int weights_row =
+            concat_offset_[es_index] + slot * embedding_dim;
+        float *folded_row =
+            folded.data() +
+            (static_cast<size_t>(slot) * embedding_matrix.rows + feature_id) *
+                hidden_size;
+        for (int k = 0; k < embedding_dim; ++k) {
+          AddWeightsRow(weights, weights_row + k, embedding[k], folded_row);
         }
-        default:
-          // We already checked (in GetMatrixRowSizeInBytes) that each embedding
-          // matrix has a known quantization type.  Hence, DLOG is enough here.
-          SAFTM_DLOG(ERROR) << "Unknown embeddings quantization type "
-                            << static_cast<int>(embedding_matrix.quant_type);
-          break;
       }
     }
   }
+  folded_embeddings_ = std::move(folded_embeddings);
+  return true;
+}
+
+int64 EmbeddingNetwork::FoldedEmbeddingsBytes() const {
+  int64 num_bytes = 0;
+  for (const std::vector<float> &folded : folded_embeddings_) {
+    num_bytes += folded.capacity() * sizeof(float);
+  }
+  return num_bytes;
 }
 
 void EmbeddingNetwork::ComputeFinalScores(
@@ -250,25 +409,39 @@ void EmbeddingNetwork::ComputeFinalScores(
 void EmbeddingNetwork::ComputeFinalScores(
     const std::vector<FeatureVector> &features,
     const std::vector<float> &extra_inputs, std::vector<float> *scores) const {
-  // Construct the input layer for our feed-forward neural network (FFNN).
-  std::vector<float> input;
-  ConcatEmbeddings(features, &input);
-  if (!extra_inputs.empty()) {
-    input.reserve(input.size() + extra_inputs.size());
-    for (int i = 0; i < extra_inputs.size(); i++) {
-      input.push_back(extra_inputs[i]);
+  // Alternating storage for activations of the different layers.  We can't use
+  // a single vector because all activations of the previous layer are required
+  // when computing the activations of the next one.  The vectors used for the
+  // layers are kept around (one set per thread), such that their memory is
+  // recycled by the next call.
+  static thread_local std::vector<float> storage[2];
+  const int num_layers = layer_weights_.size();
+  const std::vector<float> *v_in = nullptr;
+  int first_layer = 0;
+  if (is_first_layer_folded()) {
+    // The folded embeddings add up to the output of the first layer directly.
+    std::vector<float> *v_out = num_layers == 1 ? scores : &(storage[0]);
+    const EmbeddingNetworkParams::Matrix &b = layer_bias_[0];
+    const float *b_start = reinterpret_cast<const float *>(b.elements);
+    v_out->assign(b_start, b_start + b.rows);
+    AddFoldedEmbeddings(features, extra_inputs, v_out->data());
+    v_in = v_out;
+    first_layer = 1;
+  } else {
+    // Construct the input layer for our feed-forward neural network (FFNN).
+    static thread_local std::vector<float> input;
+    ConcatEmbeddings(features, &input);
+    if (!extra_inputs.empty()) {
+      input.reserve(input.size() + extra_inputs.size());
+      for (int i = 0; i < extra_inputs.size(); i++) {
+        input.push_back(extra_inputs[i]);
+      }
     }
+    v_in = &input;
   }
 
   // Propagate input through all layers of our FFNN.
-
-  // Alternating storage for activations of the different layers.  We can't use
-  // a single vector because all activations of the previous layer are required
-  // when computing the activations of the next one.
-  std::vector<float> storage[2];
-  const std::vector<float> *v_in = &input;
-  const int num_layers = layer_weights_.size();
-  for (int i = 0; i < num_layers; ++i) {
+  for (int i = first_layer; i < num_layers; ++i) {
     std::vector<float> *v_out = nullptr;
     if (i == num_layers - 1) {
       // Final layer: write results directly into |scores|.
@@ -285,6 +458,57 @@ void EmbeddingNetwork::ComputeFinalScores(
   }
 }
 
+void EmbeddingNetwork::ComputeFinalScoresBatch(
+    const std::vector<std::vector<FeatureVector>> &features,
+    std::vector<std::vector<float>> *scores) const {
+  const int batch_size = features.size();
+  scores->resize(batch_size);
+  if (batch_size == 0) {
+    return;
+  }
+
+  std::vector<float> input;
+  std::vector<float> storage[2];
+  const int num_layers = layer_weights_.size();
+  int first_layer = 0;
+  if (is_first_layer_folded()) {
+    // Output of the first layer for all inputs, one after the other.
+    const EmbeddingNetworkParams::Matrix &b = layer_bias_[0];
+    const float *b_start = reinterpret_cast<const float *>(b.elements);
+    storage[0].resize(batch_size * b.rows);
+    for (int n = 0; n < batch_size; ++n) {
+      float *hidden = storage[0].data() + n * b.rows;
+      std::copy(b_start, b_start + b.rows, hidden);
+      AddFoldedEmbeddings(features[n], /*extra_inputs=*/{}, hidden);
+    }
+    first_layer = 1;
+  } else {
+    // Input layer for all inputs, one after the other.
+    input.assign(batch_size * concat_layer_size_, 0.0f);
+    for (int n = 0; n < batch_size; ++n) {
+      ConcatEmbeddings(features[n], input.data() + n * concat_layer_size_);
+    }
+  }
+
+  // Propagate the inputs through all layers, see ComputeFinalScores().
+  const std::vector<float> *v_in =
+      is_first_layer_folded() ? &(storage[0]) : &input;
+  for (int i = first_layer; i < num_layers; ++i) {
+    std::vector<float> *v_out = &(storage[i % 2]);
+    const bool apply_relu = i > 0;
+    SparseReluProductPlusBiasBatch(apply_relu, layer_weights_[i],
+                                   layer_bias_[i], *v_in, batch_size, v_out);
+    v_in = v_out;
+  }
+
+  // Split the output of the final (softmax) layer.
+  const int num_scores = v_in->size() / batch_size;
+  for (int n = 0; n < batch_size; ++n) {
+    const float *begin = v_in->data() + n * num_scores;
+    (*scores)[n].assign(begin, begin + num_scores);
+  }
+}
+
 EmbeddingNetwork::EmbeddingNetwork(const EmbeddingNetworkParams *model)
     : model_(model) {
   int offset_sum = 0;
@@ -618,6 +618,10 @@ class FeatureExtractor : public GenericFeatureExtractor {
     }
   }
 
+  // Returns the top-level feature functions, e.g. for callers that know their
+  // concrete types and evaluate them directly.
+  const std::vector<Function *> &functions() const { return functions_; }
+
  private:
   // Creates and initializes all feature functions in the feature extractor.
   //
@@ -36,8 +36,8 @@ bool GetFileContent(const string &filename, string *content) {
     SAFTM_LOG(ERROR) << "Error opening " << filename;
     return false;
   }
-  StringPiece sp = handle.to_stringpiece();
-  content->assign(sp.data(), sp.size());
+  content->assign(reinterpret_cast<const char *>(handle.start()),
+                  handle.num_bytes());
   return true;
 }
 
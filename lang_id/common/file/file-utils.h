@@ -20,8 +20,8 @@
 #include <stddef.h>
 #include <string>
 
-#include "lang_id/common/file/mmap.h"
 #include "lang_id/common/lite_strings/stringpiece.h"
+#include "utils/memory/mmap.h"
 
 namespace libtextclassifier3 {
 namespace mobile {
@@ -64,7 +64,8 @@ bool ReadProtoFromFile(const string &filename, Proto *proto) {
   if (!handle.ok()) {
     return false;
   }
-  return ParseProtoFromMemory(handle.to_stringpiece(), proto);
+  return ParseProtoFromMemory(reinterpret_cast<const char *>(handle.start()),
+                              handle.num_bytes(), proto);
 }
 
 // Returns true if filename is the name of an existing file, and false
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "lang_id/common/math/add-scaled.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define SAFTM_ADD_SCALED_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SAFTM_ADD_SCALED_SSE2
+#if defined(__GNUC__) || defined(__clang__)
+// The AVX2 kernels are compiled for AVX2 whatever the target of the build, and
+// only called on CPUs that have it.
+#include <immintrin.h>
+#define SAFTM_ADD_SCALED_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace libtextclassifier3 {
+namespace mobile {
+namespace {
+
+// Vectorized kernels for y[i] += x[i] * scale, with x stored as float, float16
+// or uint8 (with a quantization bias of 128).  They process as many elements
+// as fit whole vector registers and return how many they processed; the
+// callers finish the rest with scalar code.  The kernels perform the same
+// float multiplications and additions as the scalar code.  On x86, the AVX2
+// kernels are picked at runtime when the CPU has AVX2, else the SSE2 ones.
+#if defined(SAFTM_ADD_SCALED_NEON)
+
+inline int AddScaledVectorized(const float *x, float scale, float *y,
+                               int size) {
+  const float32x4_t scale_vector = vdupq_n_f32(scale);
+  int i = 0;
+  for (; i + 4 <= size; i += 4) {
+    vst1q_f32(y + i, vmlaq_f32(vld1q_f32(y + i), vld1q_f32(x + i),
+                               scale_vector));
+  }
+  return i;
+}
+
+inline int AddScaledVectorized(const float16 *x, float scale, float *y,
+                               int size) {
+  const float32x4_t scale_vector = vdupq_n_f32(scale);
+  int i = 0;
+  for (; i + 8 <= size; i += 8) {
+    // A float16 is the upper half of a float, see Float16To32.
+    const uint16x8_t values = vld1q_u16(x + i);
+    const float32x4_t low =
+        vreinterpretq_f32_u32(vshll_n_u16(vget_low_u16(values), 16));
+    const float32x4_t high =
+        vreinterpretq_f32_u32(vshll_n_u16(vget_high_u16(values), 16));
+    vst1q_f32(y + i, vmlaq_f32(vld1q_f32(y + i), low, scale_vector));
+    vst1q_f32(y + i + 4, vmlaq_f32(vld1q_f32(y + i + 4), high, scale_vector));
+  }
+  return i;
+}
+
+inline int AddScaledVectorized(const uint8 *x, float scale, float *y,
+                               int size) {
+  const int32x4_t bias = vdupq_n_s32(128);
+  const float32x4_t scale_vector = vdupq_n_f32(scale);
+  int i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const uint16x8_t values = vmovl_u8(vld1_u8(x + i));
+    const int32x4_t low = vsubq_s32(
+        vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(values))), bias);
+    const int32x4_t high = vsubq_s32(
+        vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(values))), bias);
+    vst1q_f32(y + i,
+              vmlaq_f32(vld1q_f32(y + i), vcvtq_f32_s32(low), scale_vector));
+    vst1q_f32(y + i + 4, vmlaq_f32(vld1q_f32(y + i + 4), vcvtq_f32_s32(high),
+                                   scale_vector));
+  }
+  return i;
+}
+
+#elif defined(SAFTM_ADD_SCALED_SSE2)
+
+inline void AddScaled4(__m128 values, __m128 scale, float *y) {
+  _mm_storeu_ps(y, _mm_add_ps(_mm_loadu_ps(y), _mm_mul_ps(values, scale)));
+}
+
+inline int AddScaledSse2(const float *x, float scale, float *y, int size) {
+  const __m128 scale_vector = _mm_set1_ps(scale);
+  int i = 0;
+  for (; i + 4 <= size; i += 4) {
+    AddScaled4(_mm_loadu_ps(x + i), scale_vector, y + i);
+  }
+  return i;
+}
+
+inline int AddScaledSse2(const float16 *x, float scale, float *y, int size) {
+  const __m128 scale_vector = _mm_set1_ps(scale);
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 8 <= size; i += 8) {
+    // A float16 is the upper half of a float, see Float16To32.
+    const __m128i values =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i));
+    AddScaled4(_mm_castsi128_ps(_mm_unpacklo_epi16(zero, values)),
+               scale_vector, y + i);
+    AddScaled4(_mm_castsi128_ps(_mm_unpackhi_epi16(zero, values)),
+               scale_vector, y + i + 4);
+  }
+  return i;
+}
+
+inline int AddScaledSse2(const uint8 *x, float scale, float *y, int size) {
+  const __m128i bias = _mm_set1_epi32(128);
+  const __m128 scale_vector = _mm_set1_ps(scale);
+  const __m128i zero = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m128i values = _mm_unpacklo_epi8(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(x + i)), zero);
+    const __m128i low = _mm_sub_epi32(_mm_unpacklo_epi16(values, zero), bias);
+    const __m128i high = _mm_sub_epi32(_mm_unpackhi_epi16(values, zero), bias);
+    AddScaled4(_mm_cvtepi32_ps(low), scale_vector, y + i);
+    AddScaled4(_mm_cvtepi32_ps(high), scale_vector, y + i + 4);
+  }
+  return i;
+}
+
+#if defined(SAFTM_ADD_SCALED_AVX2)
+
+SAFTM_ADD_SCALED_AVX2 inline void AddScaled8(__m256 values, __m256 scale,
+                                              float *y) {
+  _mm256_storeu_ps(
+      y, _mm256_add_ps(_mm256_loadu_ps(y), _mm256_mul_ps(values, scale)));
+}
+
+SAFTM_ADD_SCALED_AVX2 int AddScaledAvx2(const float *x, float scale, float *y,
+                                        int size) {
+  const __m256 scale_vector = _mm256_set1_ps(scale);
+  int i = 0;
+  for (; i + 8 <= size; i += 8) {
+    AddScaled8(_mm256_loadu_ps(x + i), scale_vector, y + i);
+  }
+  return i;
+}
+
+SAFTM_ADD_SCALED_AVX2 int AddScaledAvx2(const float16 *x, float scale,
+                                        float *y, int size) {
+  const __m256 scale_vector = _mm256_set1_ps(scale);
+  int i = 0;
+  for (; i + 8 <= size; i += 8) {
+    // A float16 is the upper half of a float, see Float16To32.
+    const __m256i values = _mm256_slli_epi32(
+        _mm256_cvtepu16_epi32(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i))),
+        16);
+    AddScaled8(_mm256_castsi256_ps(values), scale_vector, y + i);
+  }
+  return i;
+}
+
+SAFTM_ADD_SCALED_AVX2 int AddScaledAvx2(const uint8 *x, float scale,
+                                        float *y, int size) {
+  const __m256i bias = _mm256_set1_epi32(128);
+  const __m256 scale_vector = _mm256_set1_ps(scale);
+  int i = 0;
+  for (; i + 8 <= size; i += 8) {
+    const __m256i values = _mm256_sub_epi32(
+        _mm256_cvtepu8_epi32(
+            _mm_loadl_epi64(reinterpret_cast<const __m128i *>(x + i))),
+        bias);
+    AddScaled8(_mm256_cvtepi32_ps(values), scale_vector, y + i);
+  }
+  return i;
+}
+
+// Whether the CPU that runs the code has AVX2, checked once.
+bool CpuHasAvx2() {
+#if defined(__AVX2__)
+  return true;
+#else
+  static const bool has_avx2 = []() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+  }();
+  return has_avx2;
+#endif
+}
+
+#endif  // SAFTM_ADD_SCALED_AVX2
+
+template <typename T>
+inline int AddScaledVectorized(const T *x, float scale, float *y, int size) {
+#if defined(SAFTM_ADD_SCALED_AVX2)
+  if (CpuHasAvx2()) {
+    return AddScaledAvx2(x, scale, y, size);
+  }
+#endif
+  return AddScaledSse2(x, scale, y, size);
+}
+
+#else
+
+template <typename T>
+inline int AddScaledVectorized(const T *x, float scale, float *y, int size) {
+  return 0;
+}
+
+#endif
+
+}  // namespace
+
+void AddScaled(const float *x, float scale, float *y, int size) {
+  for (int i = AddScaledVectorized(x, scale, y, size); i < size; ++i) {
+    y[i] += x[i] * scale;
+  }
+}
+
+void AddScaled(const float16 *x, float scale, float *y, int size) {
+  for (int i = AddScaledVectorized(x, scale, y, size); i < size; ++i) {
+    y[i] += Float16To32(x[i]) * scale;
+  }
+}
+
+void AddScaled(const uint8 *x, float scale, float *y, int size) {
+  for (int i = AddScaledVectorized(x, scale, y, size); i < size; ++i) {
+    y[i] += (static_cast<int>(x[i]) - 128) * scale;
+  }
+}
+
+}  // namespace mobile
+}  // namespace nlp_saft
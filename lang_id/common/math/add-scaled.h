@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NLP_SAFT_COMPONENTS_COMMON_MOBILE_MATH_ADD_SCALED_H_
+#define NLP_SAFT_COMPONENTS_COMMON_MOBILE_MATH_ADD_SCALED_H_
+
+#include "lang_id/common/lite_base/float16.h"
+#include "lang_id/common/lite_base/integral-types.h"
+
+namespace libtextclassifier3 {
+namespace mobile {
+
+// Computes y[i] += x[i] * scale for the |size| elements of x and y, with
+// vector instructions where available.  The results are the same as the ones
+// of the scalar loop: the same float multiplications and additions are done.
+void AddScaled(const float *x, float scale, float *y, int size);
+
+// Same as above, for float16 x.
+void AddScaled(const float16 *x, float scale, float *y, int size);
+
+// Same as above, for uint8 x quantized with a bias of 128.
+void AddScaled(const uint8 *x, float scale, float *y, int size);
+
+}  // namespace mobile
+}  // namespace nlp_saft
+
+#endif  // NLP_SAFT_COMPONENTS_COMMON_MOBILE_MATH_ADD_SCALED_H_
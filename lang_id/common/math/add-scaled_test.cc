@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "lang_id/common/math/add-scaled.h"
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace mobile {
+namespace {
+
+float FloatValue(float value) { return value; }
+
+float Uint8Value(uint8 value) { return static_cast<int>(value) - 128; }
+
+// Checks that AddScaled gives the results of the scalar loop for the lengths
+// that use the vector and the scalar code, alone and together.
+template <typename T>
+void ExpectSameAsScalarLoop(const std::vector<T> &x, float (*to_float)(T)) {
+  const float scale = -0.37f;
+  for (int size = 0; size < 40; ++size) {
+    SCOPED_TRACE(size);
+    // With one element before and after y, which must be left alone, and x
+    // and y starting at an unaligned address.
+    std::vector<float> y(size + 2);
+    for (int i = 0; i < y.size(); ++i) {
+      y[i] = (i % 7) * 0.75f - 2.25f;
+    }
+    std::vector<float> expected = y;
+    for (int i = 0; i < size; ++i) {
+      expected[i + 1] += to_float(x[i + 1]) * scale;
+    }
+    AddScaled(x.data() + 1, scale, y.data() + 1, size);
+    for (int i = 0; i < y.size(); ++i) {
+      EXPECT_FLOAT_EQ(y[i], expected[i]) << i;
+    }
+  }
+}
+
+TEST(AddScaledTest, FloatSameAsScalarLoop) {
+  std::vector<float> x(41);
+  for (int i = 0; i < x.size(); ++i) {
+    x[i] = ((i * 37) % 19) * 0.25f - 2.3f;
+  }
+  ExpectSameAsScalarLoop(x, FloatValue);
+}
+
+TEST(AddScaledTest, Float16SameAsScalarLoop) {
+  std::vector<float16> x(41);
+  for (int i = 0; i < x.size(); ++i) {
+    x[i] = Float32To16(((i * 37) % 19) * 0.25f - 2.3f);
+  }
+  ExpectSameAsScalarLoop(x, Float16To32);
+}
+
+TEST(AddScaledTest, Uint8SameAsScalarLoop) {
+  std::vector<uint8> x(41);
+  for (int i = 0; i < x.size(); ++i) {
+    x[i] = (i * 97) % 256;
+  }
+  ExpectSameAsScalarLoop(x, Uint8Value);
+}
+
+}  // namespace
+}  // namespace mobile
+}  // namespace libtextclassifier3
@@ -30,29 +30,56 @@ namespace mobile {
 namespace lang_id {
 
 namespace {
-inline bool IsTokenSeparator(int num_bytes, const char *curr) {
-  if (num_bytes != 1) {
-    return false;
+// Tokenization class of the first byte of a UTF8 character.
+enum ByteClass : char {
+  // ASCII letter: part of a token.
+  kAsciiLetter,
+
+  // First byte of a multi-byte UTF8 character: part of a token.
+  kMultiByteStart,
+
+  // Any other 1-byte character (including the stray UTF8 continuation bytes,
+  // for which utils::OneCharLen() returns 1): a token separator.
+  kSeparator,
+};
+
+// Table with the ByteClass of each byte, to avoid the locale-aware isalpha()
+// in the tokenization loop.
+class ByteClassTable {
+ public:
+  ByteClassTable() {
+    for (int c = 0; c < 256; ++c) {
+      if (c >= 0xC0) {
+        classes_[c] = kMultiByteStart;
+      } else if (c < 0x80 && isalpha(c)) {
+        classes_[c] = kAsciiLetter;
+      } else {
+        classes_[c] = kSeparator;
+      }
+    }
   }
-  return !isalpha(*curr);
+
+  ByteClass Get(const char *curr) const {
+    return classes_[*reinterpret_cast<const unsigned char *>(curr)];
+  }
+
+ private:
+  ByteClass classes_[256];
+};
+
+const ByteClassTable &GetByteClassTable() {
+  static const ByteClassTable table;
+  return table;
 }
 
-// Appends to *word the UTF8 encoding for the lowercase version of the UTF8
-// character that starts at |curr| and has |num_bytes| bytes.
+// Appends to *word the UTF8 encoding for the lowercase version of the
+// multi-byte UTF8 character that starts at |curr| and has |num_bytes| bytes.
 //
 // NOTE: if the current UTF8 character does not have a lowercase version, then
 // we append the original UTF8 character.
 inline SAFTM_ATTRIBUTE_ALWAYS_INLINE void AppendLowerCase(const char *curr,
                                                           int num_bytes,
                                                           string *word) {
-  if (num_bytes == 1) {
-    // Optimize the ASCII case.
-    word->push_back(tolower(*curr));
-    return;
-  }
-
-  // Harder, general case.
-  //
   // NOTE: for lowercasing, we use the utils from utf.h:
   // charntorune + tolowerrune + runetochar.  Unfortunately, that library does
   // not contain any fast util for determining the number of bytes for the UTF8
@@ -101,60 +128,81 @@ void TokenizerForLangId::Setup(TaskContext *context) {
 
 void TokenizerForLangId::Tokenize(StringPiece text,
                                   LightSentence *sentence) const {
-  const char *const start = text.data();
-  const char *curr = start;
-  const char *end = utils::GetSafeEndOfUtf8String(start, text.size());
-
-  // Corner case: the safe part of the text is empty ("").
-  if (curr >= end) {
-    return;
-  }
-
-  // Number of bytes for UTF8 character starting at *curr.  Note: the loop below
-  // is guaranteed to terminate because in each iteration, we move curr by at
-  // least num_bytes, and num_bytes is guaranteed to be > 0.
-  int num_bytes = utils::OneCharLen(curr);
+  const ByteClassTable &byte_classes = GetByteClassTable();
+  const char *curr = text.data();
+  const char *const end = utils::GetSafeEndOfUtf8String(curr, text.size());
+
+  // Number of tokens stored so far.  The strings of *sentence from a previous
+  // call are overwritten, so their buffers are reused.
+  int num_tokens = 0;
+
+  // Note: the loop below is guaranteed to terminate because in each iteration,
+  // we move curr by at least one byte.  By the guarantee of
+  // GetSafeEndOfUtf8String, moving curr by utils::OneCharLen(curr) bytes never
+  // jumps past end.
   while (curr < end) {
-    // Jump over consecutive token separators.
-    while (IsTokenSeparator(num_bytes, curr)) {
-      curr += num_bytes;
+    // Jump over consecutive token separators (each one is one byte long).
+    while (byte_classes.Get(curr) == kSeparator) {
+      ++curr;
       if (curr >= end) {
+        sentence->resize(num_tokens);
         return;
       }
-      num_bytes = utils::OneCharLen(curr);
     }
 
     // If control reaches this point, we are at beginning of a non-empty token.
-    sentence->emplace_back();
-    string *word = &(sentence->back());
+    string *word;
+    if (num_tokens < sentence->size()) {
+      word = &(*sentence)[num_tokens];
+      word->clear();
+    } else {
+      sentence->emplace_back();
+      word = &(sentence->back());
+    }
+    ++num_tokens;
 
     // Add special token-start character.
     word->push_back('^');
 
     // Add UTF8 characters to word, until we hit the end of the safe text or a
     // token separator.
-    while (true) {
-      if (lowercase_input_) {
-        AppendLowerCase(curr, num_bytes, word);
-      } else {
-        word->append(curr, num_bytes);
-      }
-      curr += num_bytes;
-      if (curr >= end) {
-        break;
-      }
-      num_bytes = utils::OneCharLen(curr);
-      if (IsTokenSeparator(num_bytes, curr)) {
-        curr += num_bytes;
-        if (curr >= end) {
-          break;
+    while (curr < end) {
+      const ByteClass byte_class = byte_classes.Get(curr);
+      if (byte_class == kAsciiLetter) {
+        // Fast path: append a whole run of ASCII letters at once.
+        const char *run_end = curr + 1;
+        while (run_end < end && byte_classes.Get(run_end) == kAsciiLetter) {
+          ++run_end;
+        }
+        const size_t run_start = word->size();
+        const size_t run_size = run_end - curr;
+        word->append(curr, run_size);
+        if (lowercase_input_) {
+          // An ASCII letter is lowercased by setting its 0x20 bit.  This loop
+          // has no branches, so the compiler vectorizes it.
+          char *letters = &(*word)[run_start];
+          for (size_t i = 0; i < run_size; ++i) {
+            letters[i] |= 0x20;
+          }
+        }
+        curr = run_end;
+      } else if (byte_class == kMultiByteStart) {
+        const int num_bytes = utils::OneCharLen(curr);
+        if (lowercase_input_) {
+          AppendLowerCase(curr, num_bytes, word);
+        } else {
+          word->append(curr, num_bytes);
         }
-        num_bytes = utils::OneCharLen(curr);
+        curr += num_bytes;
+      } else {
+        // Token separator: skip it and end the token.
+        ++curr;
         break;
       }
     }
     word->push_back('$');
   }
+  sentence->resize(num_tokens);
 }
 
 }  // namespace lang_id
@@ -38,7 +38,9 @@ class TokenizerForLangId {
   // tokens, and (for each of the remaining tokens) prepend "^" (special token
   // begin marker) and append "$" (special token end marker).
   //
-  // Tokens are stored into the "repeated Token token;" field of *sentence.
+  // The tokens replace the previous content of *sentence.  The strings already
+  // in *sentence are reused, so that tokenizing many texts with the same
+  // LightSentence does not reallocate the tokens each time.
   void Tokenize(StringPiece text, LightSentence *sentence) const;
 
  private:
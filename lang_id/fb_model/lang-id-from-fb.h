@@ -36,6 +36,12 @@ std::unique_ptr<LangId> GetLangIdFromFlatbufferFile(const string &filename);
 // given file descriptor.
 std::unique_ptr<LangId> GetLangIdFromFlatbufferFileDescriptor(int fd);
 
+// Returns a LangId built using the SAFT model in flatbuffer format from the
+// |size| bytes at |offset| of the given file descriptor.
+std::unique_ptr<LangId> GetLangIdFromFlatbufferFileDescriptor(int fd,
+                                                              int offset,
+                                                              int size);
+
 // Returns a LangId built using the SAFT model in flatbuffer format from
 // the |num_bytes| bytes that start at address |data|.
 //
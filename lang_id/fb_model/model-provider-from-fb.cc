@@ -31,7 +31,7 @@ ModelProviderFromFlatbuffer::ModelProviderFromFlatbuffer(const string &filename)
     // unmapped only when the field scoped_mmap_ is destructed, the model bytes
     // stay alive for the entire lifetime of this object.
     : scoped_mmap_(new ScopedMmap(filename)) {
-  Initialize(scoped_mmap_->handle().to_stringpiece());
+  InitializeFromMmap();
 }
 
 ModelProviderFromFlatbuffer::ModelProviderFromFlatbuffer(int fd)
@@ -40,13 +40,30 @@ ModelProviderFromFlatbuffer::ModelProviderFromFlatbuffer(int fd)
     // unmapped only when the field scoped_mmap_ is destructed, the model bytes
     // stay alive for the entire lifetime of this object.
     : scoped_mmap_(new ScopedMmap(fd)) {
-  Initialize(scoped_mmap_->handle().to_stringpiece());
+  InitializeFromMmap();
+}
+
+ModelProviderFromFlatbuffer::ModelProviderFromFlatbuffer(int fd, int offset,
+                                                         int size)
+    : scoped_mmap_(new ScopedMmap(fd, offset, size)) {
+  InitializeFromMmap();
+}
+
+void ModelProviderFromFlatbuffer::InitializeFromMmap() {
+  const MmapHandle &handle = scoped_mmap_->handle();
+  if (!handle.ok()) {
+    SAFTM_LOG(ERROR) << "Unable to mmap the model";
+    return;
+  }
+  Initialize(StringPiece(reinterpret_cast<const char *>(handle.start()),
+                         handle.num_bytes()));
 }
 
 void ModelProviderFromFlatbuffer::Initialize(StringPiece model_bytes) {
   // Note: valid_ was initialized to false.  In the code below, we set valid_ to
   // true only if all initialization steps completed successfully.  Otherwise,
   // we return early, leaving valid_ to its default value false.
+  model_bytes_ = model_bytes;
   model_ = saft_fbs::GetVerifiedModelFromBytes(model_bytes);
   if (model_ == nullptr) {
     SAFTM_LOG(ERROR) << "Unable to initialize ModelProviderFromFlatbuffer";
@@ -94,6 +111,40 @@ bool ModelProviderFromFlatbuffer::InitNetworkParams() {
     return false;
   }
   nn_params_ = std::move(nn_params_from_fb);
+  if (!NetworkParamsPointIntoModelBytes()) {
+    SAFTM_LOG(ERROR) << "Network weights are not read from the model bytes";
+    nn_params_.reset();
+    return false;
+  }
+  return true;
+}
+
+bool ModelProviderFromFlatbuffer::NetworkParamsPointIntoModelBytes() const {
+  const char *const begin = model_bytes_.data();
+  const char *const end = begin + model_bytes_.size();
+  auto points_into_model = [begin, end](const void *weights) {
+    const char *const p = reinterpret_cast<const char *>(weights);
+    return weights == nullptr || (p >= begin && p < end);
+  };
+  const EmbeddingNetworkParams &params = *nn_params_;
+  for (int i = 0; i < params.embeddings_size(); ++i) {
+    if (!points_into_model(params.embeddings_weights(i)) ||
+        !points_into_model(params.embeddings_quant_scales(i))) {
+      return false;
+    }
+  }
+  for (int i = 0; i < params.hidden_size(); ++i) {
+    if (!points_into_model(params.hidden_weights(i))) return false;
+  }
+  for (int i = 0; i < params.hidden_bias_size(); ++i) {
+    if (!points_into_model(params.hidden_bias_weights(i))) return false;
+  }
+  for (int i = 0; i < params.softmax_size(); ++i) {
+    if (!points_into_model(params.softmax_weights(i))) return false;
+  }
+  for (int i = 0; i < params.softmax_bias_size(); ++i) {
+    if (!points_into_model(params.softmax_bias_weights(i))) return false;
+  }
   return true;
 }
 
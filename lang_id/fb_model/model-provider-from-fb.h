@@ -23,10 +23,10 @@
 #include <vector>
 
 #include "lang_id/common/fel/task-context.h"
-#include "lang_id/common/file/mmap.h"
 #include "lang_id/common/flatbuffers/model_generated.h"
 #include "lang_id/common/lite_strings/stringpiece.h"
 #include "lang_id/model-provider.h"
+#include "utils/memory/mmap.h"
 
 namespace libtextclassifier3 {
 namespace mobile {
@@ -43,6 +43,11 @@ class ModelProviderFromFlatbuffer : public ModelProvider {
   // file descriptor |fd|.
   explicit ModelProviderFromFlatbuffer(int fd);
 
+  // Constructs a model provider based on a flatbuffer-format SAFT model stored
+  // in the |size| bytes at |offset| of the file descriptor |fd|, e.g., inside
+  // an APK or a model bundle.
+  ModelProviderFromFlatbuffer(int fd, int offset, int size);
+
   // Constructs a model provider from a flatbuffer-format SAFT model the bytes
   // of which are already in RAM (size bytes starting from address data).
   // Useful if you "transport" these bytes otherwise than via a normal file
@@ -75,20 +80,51 @@ class ModelProviderFromFlatbuffer : public ModelProvider {
     return languages_;
   }
 
+  size_t GetMappedBytes() const override {
+    return (scoped_mmap_ && scoped_mmap_->handle().ok())
+               ? scoped_mmap_->handle().num_bytes()
+               : 0;
+  }
+
+  size_t GetResidentMappedBytes() const override {
+    if (!scoped_mmap_) {
+      return 0;
+    }
+    const auto resident_bytes = scoped_mmap_->ResidentBytes();
+    return resident_bytes > 0 ? resident_bytes : 0;
+  }
+
+  // Returns the bytes of the Model flatbuffer, which the weights of
+  // GetNnParams() point into: the mapped file, or the bytes passed in.
+  StringPiece model_bytes() const { return model_bytes_; }
+
  private:
   // Initializes the fields of this class based on the flatbuffer from
   // |model_bytes|.  These bytes are supposed to be the representation of a
   // Model flatbuffer and should be alive during the lifetime of this object.
   void Initialize(StringPiece model_bytes);
 
+  // Initializes the fields of this class based on the bytes mmapped by
+  // scoped_mmap_.
+  void InitializeFromMmap();
+
   // Initializes nn_params_ based on model_.
   bool InitNetworkParams();
 
-  // If filename-based constructor is used, scoped_mmap_ keeps the file mmapped
+  // Returns true iff all the weights of nn_params_ point into model_bytes_,
+  // i.e., they are used in place, without a copy.
+  bool NetworkParamsPointIntoModelBytes() const;
+
+  // If a file-based constructor is used, scoped_mmap_ keeps the file mmapped
   // during the lifetime of this object, such that references inside the Model
-  // flatbuffer from those bytes remain valid.
+  // flatbuffer from those bytes remain valid.  The weights are read right from
+  // the mapping, so the pages of a model file are backed by the page cache and
+  // shared by all the processes that map it.
   const std::unique_ptr<ScopedMmap> scoped_mmap_;
 
+  // The bytes of the Model flatbuffer.
+  StringPiece model_bytes_;
+
   // Pointer to the flatbuffer from
   //
   // (a) [if filename constructor was used:] the bytes mmapped by scoped_mmap_
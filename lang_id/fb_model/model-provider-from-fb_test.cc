@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "lang_id/fb_model/model-provider-from-fb.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+
+#include "lang_id/common/embedding-network-params.h"
+#include "lang_id/common/lite_strings/stringpiece.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace mobile {
+namespace lang_id {
+namespace {
+
+// Where the model starts in the test file, as in an APK or a model bundle.
+constexpr int kModelOffset = 1024;
+
+std::string GetModelPath() { return TC3_TEST_DATA_DIR; }
+
+std::string ReadFile(const std::string& file_name) {
+  std::ifstream file_stream(file_name);
+  return std::string(std::istreambuf_iterator<char>(file_stream), {});
+}
+
+class ModelProviderFromFlatbufferTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    model_ = ReadFile(GetModelPath() + "lang_id.model");
+    ASSERT_FALSE(model_.empty());
+    char path[] = "/tmp/model_provider_test_XXXXXX";
+    const int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    path_ = path;
+    std::ofstream file(path_);
+    file << std::string(kModelOffset, 'a') << model_ << std::string(100, 'b');
+  }
+
+  void TearDown() override { unlink(path_.c_str()); }
+
+  std::string model_;
+  std::string path_;
+};
+
+TEST_F(ModelProviderFromFlatbufferTest, UsesWeightsOfFileSegmentInPlace) {
+  const int fd = open(path_.c_str(), O_RDONLY);
+  ASSERT_GE(fd, 0);
+  ModelProviderFromFlatbuffer model_provider(fd, kModelOffset, model_.size());
+  close(fd);
+  ASSERT_TRUE(model_provider.is_valid());
+
+  // The model bytes are the mapped segment of the file.
+  const StringPiece model_bytes = model_provider.model_bytes();
+  ASSERT_EQ(model_bytes.size(), model_.size());
+  EXPECT_EQ(std::string(model_bytes.data(), model_bytes.size()), model_);
+  EXPECT_GT(model_provider.GetMappedBytes(), 0);
+
+  // No weights were copied out of the mapping.
+  const char* const begin = model_bytes.data();
+  const char* const end = begin + model_bytes.size();
+  const auto expect_in_mapping = [begin, end](const void* weights) {
+    ASSERT_NE(weights, nullptr);
+    EXPECT_GE(static_cast<const char*>(weights), begin);
+    EXPECT_LT(static_cast<const char*>(weights), end);
+  };
+  const EmbeddingNetworkParams* params = model_provider.GetNnParams();
+  ASSERT_NE(params, nullptr);
+  ASSERT_GT(params->embeddings_size(), 0);
+  for (int i = 0; i < params->embeddings_size(); ++i) {
+    SCOPED_TRACE(i);
+    expect_in_mapping(params->embeddings_weights(i));
+    if (params->embeddings_quant_scales(i) != nullptr) {
+      expect_in_mapping(params->embeddings_quant_scales(i));
+    }
+  }
+  ASSERT_GT(params->hidden_size(), 0);
+  for (int i = 0; i < params->hidden_size(); ++i) {
+    SCOPED_TRACE(i);
+    expect_in_mapping(params->hidden_weights(i));
+  }
+  for (int i = 0; i < params->hidden_bias_size(); ++i) {
+    SCOPED_TRACE(i);
+    expect_in_mapping(params->hidden_bias_weights(i));
+  }
+  ASSERT_GT(params->softmax_size(), 0);
+  for (int i = 0; i < params->softmax_size(); ++i) {
+    SCOPED_TRACE(i);
+    expect_in_mapping(params->softmax_weights(i));
+  }
+  for (int i = 0; i < params->softmax_bias_size(); ++i) {
+    SCOPED_TRACE(i);
+    expect_in_mapping(params->softmax_bias_weights(i));
+  }
+}
+
+}  // namespace
+}  // namespace lang_id
+}  // namespace mobile
+}  // namespace libtextclassifier3
@@ -29,6 +29,27 @@ namespace libtextclassifier3 {
 namespace mobile {
 namespace lang_id {
 
+namespace {
+
+// Work data for ContinuousBagOfNgramsFunction::Evaluate().  There is one per
+// thread, shared by all feature functions, so that a single model can serve
+// many threads without locking.  Evaluate() leaves it cleared, and its capacity
+// stays allocated in between calls.
+struct NgramCountsScratch {
+  std::vector<int> counts;
+  std::vector<int> non_zero_count_indices;
+};
+
+NgramCountsScratch *GetThreadNgramCountsScratch(int ngram_id_dimension) {
+  static thread_local NgramCountsScratch scratch;
+  if (scratch.counts.size() < ngram_id_dimension) {
+    scratch.counts.resize(ngram_id_dimension, 0);
+  }
+  return &scratch;
+}
+
+}  // namespace
+
 bool ContinuousBagOfNgramsFunction::Setup(TaskContext *context) {
   // Parameters in the feature function descriptor.
   bool include_terminators = GetBoolParameter("include_terminators", false);
@@ -51,8 +72,6 @@ bool ContinuousBagOfNgramsFunction::Setup(TaskContext *context) {
 
   ngram_id_dimension_ = GetIntParameter("id_dim", 10000);
   ngram_size_ = GetIntParameter("size", 3);
-
-  counts_.assign(ngram_id_dimension_, 0);
   return true;
 }
 
@@ -62,9 +81,10 @@ bool ContinuousBagOfNgramsFunction::Init(TaskContext *context) {
 }
 
 int ContinuousBagOfNgramsFunction::ComputeNgramCounts(
-    const LightSentence &sentence) const {
-  SAFTM_CHECK_EQ(counts_.size(), ngram_id_dimension_);
-  SAFTM_CHECK_EQ(non_zero_count_indices_.size(), 0);
+    const LightSentence &sentence, std::vector<int> *counts,
+    std::vector<int> *non_zero_count_indices) const {
+  SAFTM_CHECK_GE(counts->size(), ngram_id_dimension_);
+  SAFTM_CHECK_EQ(non_zero_count_indices->size(), 0);
 
   int total_count = 0;
 
@@ -99,9 +119,9 @@ int ContinuousBagOfNgramsFunction::ComputeNgramCounts(
 
       // Use a reference to the actual count, such that we can both test whether
       // the count was 0 and increment it without perfoming two lookups.
-      int &ref_to_count_for_ngram = counts_[ngram_id];
+      int &ref_to_count_for_ngram = (*counts)[ngram_id];
       if (ref_to_count_for_ngram == 0) {
-        non_zero_count_indices_.push_back(ngram_id);
+        non_zero_count_indices->push_back(ngram_id);
       }
       ref_to_count_for_ngram++;
       total_count++;
@@ -123,30 +143,31 @@ int ContinuousBagOfNgramsFunction::ComputeNgramCounts(
 void ContinuousBagOfNgramsFunction::Evaluate(const WorkspaceSet &workspaces,
                                              const LightSentence &sentence,
                                              FeatureVector *result) const {
-  // NOTE: we use std::* constructs (instead of absl::Mutex & co) to simplify
-  // porting to Android and to avoid pulling in absl (which increases our code
-  // size).
-  std::lock_guard<std::mutex> mlock(state_mutex_);
+  NgramCountsScratch *scratch =
+      GetThreadNgramCountsScratch(ngram_id_dimension_);
+  std::vector<int> &counts = scratch->counts;
+  std::vector<int> &non_zero_count_indices = scratch->non_zero_count_indices;
 
   // Find the char ngram counts.
-  int total_count = ComputeNgramCounts(sentence);
+  int total_count =
+      ComputeNgramCounts(sentence, &counts, &non_zero_count_indices);
 
   // Populate the feature vector.
   const float norm = static_cast<float>(total_count);
 
   // TODO(salcianu): explore treating dense vectors (i.e., many non-zero
   // elements) separately.
-  for (int ngram_id : non_zero_count_indices_) {
-    const float weight = counts_[ngram_id] / norm;
+  for (int ngram_id : non_zero_count_indices) {
+    const float weight = counts[ngram_id] / norm;
     FloatFeatureValue value(ngram_id, weight);
     result->add(feature_type(), value.discrete_value);
 
-    // Clear up counts_, for the next invocation of Evaluate().
-    counts_[ngram_id] = 0;
+    // Clear up counts, for the next invocation of Evaluate().
+    counts[ngram_id] = 0;
   }
 
-  // Clear up non_zero_count_indices_, for the next invocation of Evaluate().
-  non_zero_count_indices_.clear();
+  // Clear up non_zero_count_indices, for the next invocation of Evaluate().
+  non_zero_count_indices.clear();
 }
 
 SAFTM_STATIC_REGISTRATION(ContinuousBagOfNgramsFunction);
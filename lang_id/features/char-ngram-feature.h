@@ -17,8 +17,8 @@
 #ifndef NLP_SAFT_COMPONENTS_LANG_ID_MOBILE_FEATURES_CHAR_NGRAM_FEATURE_H_
 #define NLP_SAFT_COMPONENTS_LANG_ID_MOBILE_FEATURES_CHAR_NGRAM_FEATURE_H_
 
-#include <mutex>  // NOLINT: see comments for state_mutex_
 #include <string>
+#include <vector>
 
 #include "lang_id/common/fel/feature-extractor.h"
 #include "lang_id/common/fel/task-context.h"
@@ -52,7 +52,8 @@ namespace lang_id {
 //   size(int, 3):
 //     Only ngrams of this size will be extracted.
 //
-// NOTE: this class is not thread-safe.  TODO(salcianu): make it thread-safe.
+// This class is thread-safe: the scratch buffers used by Evaluate() are per
+// thread, so concurrent calls don't wait for each other.
 class ContinuousBagOfNgramsFunction : public LightSentenceFeature {
  public:
   bool Setup(TaskContext *context) override;
@@ -66,22 +67,14 @@ class ContinuousBagOfNgramsFunction : public LightSentenceFeature {
                                    ContinuousBagOfNgramsFunction);
 
  private:
-  // Auxiliary for Evaluate().  Fills counts_ and non_zero_count_indices_ (see
-  // below), and returns the total ngram count.
-  int ComputeNgramCounts(const LightSentence &sentence) const;
-
-  // Guards counts_ and non_zero_count_indices_.  NOTE: we use std::* constructs
-  // (instead of absl::Mutex & co) to simplify porting to Android and to avoid
-  // pulling in absl (which increases our code size).
-  mutable std::mutex state_mutex_;
-
-  // counts_[i] is the count of all ngrams with id i.  Work data for Evaluate().
-  // NOTE: we declare this vector as a field, such that its underlying capacity
-  // stays allocated in between calls to Evaluate().
-  mutable std::vector<int> counts_;
-
-  // Indices of non-zero elements of counts_.  See comments for counts_.
-  mutable std::vector<int> non_zero_count_indices_;
+  // Auxiliary for Evaluate().  Fills counts and non_zero_count_indices, and
+  // returns the total ngram count.  counts[i] becomes the count of all ngrams
+  // with id i, and non_zero_count_indices the indices of non-zero elements of
+  // counts.  counts needs to have at least ngram_id_dimension_ zero elements,
+  // and non_zero_count_indices needs to be empty.
+  int ComputeNgramCounts(const LightSentence &sentence,
+                         std::vector<int> *counts,
+                         std::vector<int> *non_zero_count_indices) const;
 
   // The integer id of each char ngram is computed as follows:
   // Hash32WithDefaultSeed(char_ngram) % ngram_id_dimension_.
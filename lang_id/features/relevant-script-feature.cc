@@ -24,6 +24,7 @@
 #include "lang_id/common/lite_base/logging.h"
 #include "lang_id/common/utf8.h"
 #include "lang_id/script/script-detector.h"
+#include "utils/strings/utf8.h"
 
 namespace libtextclassifier3 {
 namespace mobile {
@@ -46,6 +47,11 @@ bool RelevantScriptFeature::Setup(TaskContext *context) {
   // the first model we trained with this feature.  See http://b/70617713.
   // Newer models may support more scripts.
   num_supported_scripts_ = GetIntParameter("num_supported_scripts", 172);
+
+  for (int c = 0; c < kNumAsciiChars; ++c) {
+    const char ascii_char = static_cast<char>(c);
+    ascii_scripts_[c] = script_detector_->GetScript(&ascii_char, 1);
+  }
   return true;
 }
 
@@ -60,35 +66,40 @@ void RelevantScriptFeature::Evaluate(
   // counts[s] is the number of characters with script s.
   std::vector<int> counts(num_supported_scripts_);
   int total_count = 0;
+  const auto count_script = [this, &counts, &total_count](int script) {
+    SAFTM_DCHECK_GE(script, 0);
+    if (script < num_supported_scripts_) {
+      counts[script]++;
+      total_count++;
+    } else {
+      // Unsupported script: this usually indicates a script that is
+      // recognized by newer versions of the code, after the model was
+      // trained.  E.g., new code running with old model.
+    }
+  };
   for (const string &word : sentence) {
-    const char *const word_end = word.data() + word.size();
-    const char *curr = word.data();
-
-    // Skip over token start '^'.
-    SAFTM_DCHECK_EQ(*curr, '^');
-    curr += utils::OneCharLen(curr);
-    while (true) {
-      const int num_bytes = utils::OneCharLen(curr);
-
-      int script = script_detector_->GetScript(curr, num_bytes);
-
-      // We do this update and the if (...) break below *before* incrementing
-      // counts[script] in order to skip the token end '$'.
-      curr += num_bytes;
+    // Skip over token start '^' and token end '$'.
+    SAFTM_DCHECK_EQ(word.front(), '^');
+    SAFTM_DCHECK_EQ(word.back(), '$');
+    const char *curr = word.data() + 1;
+    const char *const word_end = word.data() + word.size() - 1;
+    while (curr < word_end) {
+      // Runs of ASCII characters, found 16 bytes at a time, get their script
+      // from ascii_scripts_ instead of the detector.
+      const char *const ascii_end =
+          curr + GetNumLeadingAsciiBytes(curr, word_end - curr);
+      for (; curr < ascii_end; ++curr) {
+        count_script(ascii_scripts_[static_cast<unsigned char>(*curr)]);
+      }
       if (curr >= word_end) {
-        SAFTM_DCHECK_EQ(*(curr - num_bytes), '$');
         break;
       }
-      SAFTM_DCHECK_GE(script, 0);
-
-      if (script < num_supported_scripts_) {
-        counts[script]++;
-        total_count++;
-      } else {
-        // Unsupported script: this usually indicates a script that is
-        // recognized by newer versions of the code, after the model was
-        // trained.  E.g., new code running with old model.
+      const int num_bytes = utils::OneCharLen(curr);
+      if (curr + num_bytes > word_end) {
+        break;
       }
+      count_script(script_detector_->GetScript(curr, num_bytes));
+      curr += num_bytes;
     }
   }
 
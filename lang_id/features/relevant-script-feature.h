@@ -59,6 +59,11 @@ class RelevantScriptFeature : public LightSentenceFeature {
 
   // Current model supports scripts in [0, num_supported_scripts_).
   int num_supported_scripts_ = 0;
+
+  static constexpr int kNumAsciiChars = 128;
+
+  // Scripts of the ASCII characters, from script_detector_.
+  int ascii_scripts_[kNumAsciiChars];
 };
 
 }  // namespace lang_id
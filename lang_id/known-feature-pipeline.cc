@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "lang_id/known-feature-pipeline.h"
+
+#include "lang_id/common/fel/workspace.h"
+#include "lang_id/features/char-ngram-feature.h"
+#include "lang_id/features/relevant-script-feature.h"
+
+namespace libtextclassifier3 {
+namespace mobile {
+namespace lang_id {
+
+template <class F>
+void KnownFeaturePipeline::Evaluate(const LightSentenceFeature *function,
+                                    const LightSentence &sentence,
+                                    FeatureVector *result) {
+  static const WorkspaceSet *const kNoWorkspaces = new WorkspaceSet();
+  static_cast<const F *>(function)->F::Evaluate(*kNoWorkspaces, sentence,
+                                                result);
+}
+
+std::unique_ptr<KnownFeaturePipeline> KnownFeaturePipeline::Create(
+    const LangIdFeatureExtractor &extractor) {
+  std::unique_ptr<KnownFeaturePipeline> pipeline(new KnownFeaturePipeline());
+  pipeline->spaces_.resize(extractor.NumEmbeddings());
+  for (int i = 0; i < extractor.NumEmbeddings(); ++i) {
+    const LightSentenceExtractor &space_extractor =
+        extractor.feature_extractor(i);
+    EmbeddingSpace &space = pipeline->spaces_[i];
+    space.num_feature_types = space_extractor.feature_types();
+    for (const LightSentenceFeature *function : space_extractor.functions()) {
+      const FeatureFunctionDescriptor *descriptor = function->descriptor();
+      if (descriptor->feature_size() > 0) {
+        return nullptr;
+      }
+      if (descriptor->type() == "continuous-bag-of-ngrams") {
+        space.functions.push_back({kNgrams, function});
+      } else if (descriptor->type() == "continuous-bag-of-relevant-scripts") {
+        space.functions.push_back({kRelevantScripts, function});
+      } else {
+        return nullptr;
+      }
+    }
+  }
+  return pipeline;
+}
+
+void KnownFeaturePipeline::GetFeatures(
+    const LightSentence &sentence, std::vector<FeatureVector> *features) const {
+  if (features->size() != spaces_.size()) {
+    // FeatureVector can't be moved, so we can't just resize.
+    *features = std::vector<FeatureVector>(spaces_.size());
+  }
+  for (int i = 0; i < spaces_.size(); ++i) {
+    FeatureVector *result = &(*features)[i];
+    result->clear();
+    result->reserve(spaces_[i].num_feature_types);
+    for (const Function &function : spaces_[i].functions) {
+      switch (function.kind) {
+        case kNgrams:
+          Evaluate<ContinuousBagOfNgramsFunction>(function.function, sentence,
+                                                  result);
+          break;
+        case kRelevantScripts:
+          Evaluate<RelevantScriptFeature>(function.function, sentence, result);
+          break;
+      }
+    }
+  }
+}
+
+}  // namespace lang_id
+}  // namespace mobile
+}  // namespace nlp_saft
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NLP_SAFT_COMPONENTS_LANG_ID_MOBILE_KNOWN_FEATURE_PIPELINE_H_
+#define NLP_SAFT_COMPONENTS_LANG_ID_MOBILE_KNOWN_FEATURE_PIPELINE_H_
+
+#include <memory>
+#include <vector>
+
+#include "lang_id/common/embedding-feature-extractor.h"
+#include "lang_id/common/fel/feature-extractor.h"
+#include "lang_id/features/light-sentence-features.h"
+#include "lang_id/light-sentence.h"
+
+namespace libtextclassifier3 {
+namespace mobile {
+namespace lang_id {
+
+typedef EmbeddingFeatureExtractor<LightSentenceExtractor, LightSentence>
+    LangIdFeatureExtractor;
+
+// Extracts the features of the model families whose feature functions are all
+// continuous-bag-of-ngrams and continuous-bag-of-relevant-scripts ones, by
+// calling these functions directly: no virtual calls, and no workspaces, which
+// these functions don't use.  The features are the same as the ones of the
+// generic extractor the functions come from.
+class KnownFeaturePipeline {
+ public:
+  // Returns nullptr if |extractor| uses other feature functions, e.g. nested
+  // ones, in which case the generic extractor has to be used.
+  static std::unique_ptr<KnownFeaturePipeline> Create(
+      const LangIdFeatureExtractor &extractor);
+
+  // Same as EmbeddingFeatureInterface::GetFeaturesReusingBuffers().
+  void GetFeatures(const LightSentence &sentence,
+                   std::vector<FeatureVector> *features) const;
+
+ private:
+  enum Kind { kNgrams, kRelevantScripts };
+
+  struct Function {
+    Kind kind;
+    const LightSentenceFeature *function;
+  };
+
+  struct EmbeddingSpace {
+    std::vector<Function> functions;
+    int num_feature_types = 0;
+  };
+
+  KnownFeaturePipeline() {}
+
+  // Calls F::Evaluate() without virtual dispatch.  The Kind of the function
+  // was checked against its descriptor, which the function was instantiated
+  // from.
+  template <class F>
+  static void Evaluate(const LightSentenceFeature *function,
+                       const LightSentence &sentence, FeatureVector *result);
+
+  std::vector<EmbeddingSpace> spaces_;
+};
+
+}  // namespace lang_id
+}  // namespace mobile
+}  // namespace nlp_saft
+
+#endif  // NLP_SAFT_COMPONENTS_LANG_ID_MOBILE_KNOWN_FEATURE_PIPELINE_H_
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "lang_id/known-feature-pipeline.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "lang_id/common/embedding-feature-interface.h"
+#include "lang_id/common/fel/task-context.h"
+#include "lang_id/common/fel/workspace.h"
+#include "lang_id/custom-tokenizer.h"
+#include "lang_id/fb_model/model-provider-from-fb.h"
+#include "lang_id/light-sentence.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace mobile {
+namespace lang_id {
+namespace {
+
+std::string GetModelPath() { return TC3_TEST_DATA_DIR; }
+
+TEST(KnownFeaturePipelineTest, ExtractsSameFeaturesAsGenericExtractor) {
+  ModelProviderFromFlatbuffer model_provider(GetModelPath() + "lang_id.model");
+  ASSERT_TRUE(model_provider.is_valid());
+  TaskContext context = *model_provider.GetTaskContext();
+  TokenizerForLangId tokenizer;
+  tokenizer.Setup(&context);
+  EmbeddingFeatureInterface<LightSentenceExtractor, LightSentence>
+      feature_interface("language_identifier");
+  ASSERT_TRUE(feature_interface.SetupForProcessing(&context));
+  ASSERT_TRUE(feature_interface.InitForProcessing(&context));
+
+  // The test model only uses the feature functions of the pipeline.
+  const std::unique_ptr<KnownFeaturePipeline> pipeline =
+      KnownFeaturePipeline::Create(feature_interface.feature_extractor());
+  ASSERT_NE(pipeline, nullptr);
+
+  // The buffers are reused across the texts, as LangId does.
+  LightSentence sentence;
+  WorkspaceSet workspace;
+  std::vector<FeatureVector> expected;
+  std::vector<FeatureVector> features;
+  for (const std::string& text :
+       {std::string("Let's meet at the station tomorrow at ten."),
+        std::string("明天在车站见面。"),
+        std::string("Meet me at 東京駅, Ώρα 10:00, ok?"),
+        std::string("")}) {
+    SCOPED_TRACE(text);
+    tokenizer.Tokenize(text, &sentence);
+    feature_interface.GetFeaturesReusingBuffers(&sentence, &workspace,
+                                                &expected);
+    pipeline->GetFeatures(sentence, &features);
+
+    ASSERT_EQ(features.size(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+      ASSERT_EQ(features[i].size(), expected[i].size()) << i;
+      for (int j = 0; j < expected[i].size(); ++j) {
+        SCOPED_TRACE(testing::Message() << i << ", " << j);
+        EXPECT_EQ(features[i].type(j), expected[i].type(j));
+        EXPECT_EQ(features[i].value(j), expected[i].value(j));
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace lang_id
+}  // namespace mobile
+}  // namespace libtextclassifier3
@@ -16,27 +16,36 @@
 
 #include "lang_id/lang-id.h"
 
+#include <ctype.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <algorithm>
+#include <map>
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "lang_id/common/embedding-feature-interface.h"
 #include "lang_id/common/embedding-network-params.h"
 #include "lang_id/common/embedding-network.h"
 #include "lang_id/common/fel/feature-extractor.h"
+#include "lang_id/common/fel/workspace.h"
 #include "lang_id/common/lite_base/logging.h"
 #include "lang_id/common/lite_strings/numbers.h"
 #include "lang_id/common/lite_strings/str-split.h"
 #include "lang_id/common/lite_strings/stringpiece.h"
 #include "lang_id/common/math/algorithm.h"
 #include "lang_id/common/math/softmax.h"
+#include "lang_id/common/utf8.h"
 #include "lang_id/custom-tokenizer.h"
+#include "lang_id/known-feature-pipeline.h"
 #include "lang_id/features/light-sentence-features.h"
 #include "lang_id/light-sentence.h"
+#include "lang_id/script/tiny-script-detector.h"
+#include "utils/base/tracing.h"
 
 namespace libtextclassifier3 {
 namespace mobile {
@@ -50,6 +59,118 @@ namespace {
 // use that value instead.  Note: for legacy reasons, our code and comments use
 // the terms "confidence", "probability" and "reliability" equivalently.
 static const float kDefaultConfidenceThreshold = 0.50f;
+
+// Storage for featurizing a text, kept around in between calls such that the
+// steady state doesn't allocate.  One per thread, see GetFeaturizationBuffers.
+struct FeaturizationBuffers {
+  LightSentence sentence;
+  WorkspaceSet workspace;
+  std::vector<FeatureVector> features;
+};
+
+FeaturizationBuffers *GetFeaturizationBuffers() {
+  static thread_local FeaturizationBuffers buffers;
+  return &buffers;
+}
+
+// Returns the Script with the given name in the "single_script_languages" task
+// parameter, or kScriptError for an unknown name.
+int GetScriptForName(StringPiece name) {
+  static const struct {
+    const char *name;
+    Script script;
+  } kScriptNames[] = {
+      {"greek", kScriptGreek},
+      {"cyrillic", kScriptCyrillic},
+      {"hebrew", kScriptHebrew},
+      {"arabic", kScriptArabic},
+      {"hangul_jamo", kScriptHangulJamo},
+      {"hiragana", kScriptHiragana},
+      {"katakana", kScriptKatakana},
+  };
+  for (const auto &script_name : kScriptNames) {
+    if (string(name) == script_name.name) {
+      return script_name.script;
+    }
+  }
+  return kScriptError;
+}
+
+// Running weighted average of the features of several texts, see LangIdStream.
+// Continuous features are summed per (feature type, id), so the memory used is
+// bounded by the feature id dimensions of the model.  Discrete features can't
+// be averaged; the ones from the most recent text are kept.
+class FeatureAccumulator {
+ public:
+  // Adds |features| (one FeatureVector per embedding space) extracted from a
+  // text, with the given |weight|.
+  void Add(const std::vector<FeatureVector> &features, float weight) {
+    if (weight <= 0.0f) return;
+    if (sums_.size() != features.size()) {
+      sums_.resize(features.size());
+      discrete_.resize(features.size());
+    }
+    for (int i = 0; i < features.size(); ++i) {
+      const FeatureVector &feature_vector = features[i];
+      bool has_discrete = false;
+      for (int j = 0; j < feature_vector.size(); ++j) {
+        FeatureType *type = feature_vector.type(j);
+        if (!type->is_continuous()) {
+          if (!has_discrete) {
+            discrete_[i].clear();
+            has_discrete = true;
+          }
+          discrete_[i].emplace_back(type, feature_vector.value(j));
+          continue;
+        }
+        const FloatFeatureValue value(feature_vector.value(j));
+        sums_[i][std::make_pair(type, value.id)] += weight * value.weight;
+      }
+    }
+    total_weight_ += weight;
+  }
+
+  // Stores the average features in |features|, one FeatureVector per embedding
+  // space.
+  void GetFeatures(std::vector<FeatureVector> *features) const {
+    if (features->size() != sums_.size()) {
+      *features = std::vector<FeatureVector>(sums_.size());
+    }
+    for (int i = 0; i < sums_.size(); ++i) {
+      FeatureVector &feature_vector = (*features)[i];
+      feature_vector.clear();
+      feature_vector.reserve(sums_[i].size() + discrete_[i].size());
+      for (const auto &it : sums_[i]) {
+        const FloatFeatureValue value(it.first.second,
+                                      it.second / total_weight_);
+        feature_vector.add(it.first.first, value.discrete_value);
+      }
+      for (const auto &type_and_value : discrete_[i]) {
+        feature_vector.add(type_and_value.first, type_and_value.second);
+      }
+    }
+  }
+
+  // Returns true iff no text with a positive weight has been added.
+  bool empty() const { return total_weight_ <= 0.0f; }
+
+  void Clear() {
+    sums_.clear();
+    discrete_.clear();
+    total_weight_ = 0.0f;
+  }
+
+ private:
+  // sums_[i] maps the (type, id) of each continuous feature of embedding space
+  // i to the sum of its weights, each scaled by the weight of its text.
+  std::vector<std::map<std::pair<FeatureType *, uint32>, float>> sums_;
+
+  // The discrete features of each embedding space, from the latest text.
+  std::vector<std::vector<std::pair<FeatureType *, FeatureValue>>> discrete_;
+
+  // Sum of the weights of all texts added so far.
+  float total_weight_ = 0.0f;
+};
 }  // namespace
 
 // Class that performs all work behind LangId.
@@ -99,6 +220,10 @@ class LangIdImpl {
     if (!is_valid()) {
       return LangId::kUnknownLanguageCode;
     }
+    const string *single_script_language = GetSingleScriptLanguage(text);
+    if (single_script_language != nullptr) {
+      return *single_script_language;
+    }
 
     std::vector<float> scores;
     ComputeScores(text, &scores);
@@ -124,7 +249,10 @@ class LangIdImpl {
     return language;
   }
 
-  void FindLanguages(StringPiece text, LangIdResult *result) const {
+  // Works for both LangIdResult and LangIdCodeResult.
+  template <typename Result>
+  void FindLanguages(StringPiece text, int max_predictions,
+                     Result *result) const {
     if (result == nullptr) return;
 
     result->predictions.clear();
@@ -132,37 +260,127 @@ class LangIdImpl {
       result->predictions.emplace_back(LangId::kUnknownLanguageCode, 1);
       return;
     }
+    const string *single_script_language = GetSingleScriptLanguage(text);
+    if (single_script_language != nullptr) {
+      result->predictions.emplace_back(single_script_language->c_str(), 1);
+      return;
+    }
 
     std::vector<float> scores;
     ComputeScores(text, &scores);
+    FillPredictions(scores, max_predictions, result);
+  }
+
+  void FindLanguagesBatch(const std::vector<StringPiece> &texts,
+                          int max_predictions,
+                          std::vector<LangIdResult> *results) const {
+    if (results == nullptr) return;
 
-    // Compute and sort softmax in descending order by probability and convert
-    // IDs to language code strings.  When probabilities are equal, we sort by
-    // language code string in ascending order.
-    std::vector<float> softmax = ComputeSoftmax(scores);
+    results->resize(texts.size());
+    if (!is_valid()) {
+      for (LangIdResult &result : *results) {
+        result.predictions.clear();
+        result.predictions.emplace_back(LangId::kUnknownLanguageCode, 1);
+      }
+      return;
+    }
+
+    // Texts that need the neural network, see FindLanguages().
+    std::vector<int> network_inputs;
+    std::vector<std::vector<FeatureVector>> features;
+    FeaturizationBuffers *buffers = GetFeaturizationBuffers();
+    for (int i = 0; i < texts.size(); ++i) {
+      const string *single_script_language = GetSingleScriptLanguage(texts[i]);
+      if (single_script_language != nullptr) {
+        (*results)[i].predictions.clear();
+        (*results)[i].predictions.emplace_back(*single_script_language, 1);
+        continue;
+      }
+      tokenizer_.Tokenize(GetInputPrefix(texts[i]), &buffers->sentence);
+      features.emplace_back();
+      GetFeatures(buffers, &features.back());
+      network_inputs.push_back(i);
+    }
+
+    std::vector<std::vector<float>> scores;
+    network_->ComputeFinalScoresBatch(features, &scores);
+    for (int j = 0; j < network_inputs.size(); ++j) {
+      const StringPiece text = texts[network_inputs[j]];
+      if (GetInputPrefix(text).size() < text.size() &&
+          !HasConfidentPrediction(scores[j])) {
+        ComputeScoresForInput(text, &scores[j]);
+      }
+      FillPredictions(scores[j], max_predictions,
+                      &(*results)[network_inputs[j]]);
+    }
+  }
 
-    for (int i = 0; i < softmax.size(); ++i) {
-      result->predictions.emplace_back(GetLanguageForSoftmaxLabel(i),
-                                       softmax[i]);
+  // Featurizes |text|, one piece of a LangIdStream, and adds its features to
+  // |accumulator| and, if not null, to |segment_accumulator|, weighted by the
+  // number of characters in its tokens.
+  void AccumulateFeatures(StringPiece text, FeatureAccumulator *accumulator,
+                          FeatureAccumulator *segment_accumulator) const {
+    if (!is_valid()) return;
+    FeaturizationBuffers *buffers = GetFeaturizationBuffers();
+    tokenizer_.Tokenize(text, &buffers->sentence);
+    int num_chars = 0;
+    for (const string &word : buffers->sentence) {
+      for (const char *curr = word.data(); curr < word.data() + word.size();
+           curr += utils::OneCharLen(curr)) {
+        ++num_chars;
+      }
+      // Don't count the special token-start and token-end characters.
+      num_chars -= 2;
+    }
+    if (num_chars <= 0) return;
+    GetFeatures(buffers, &buffers->features);
+    accumulator->Add(buffers->features, num_chars);
+    if (segment_accumulator != nullptr) {
+      segment_accumulator->Add(buffers->features, num_chars);
     }
+  }
+
+  // Same as FindLanguages() above, but from the features accumulated in
+  // |accumulator| instead of a text.
+  void FindLanguages(const FeatureAccumulator &accumulator,
+                     int max_predictions, LangIdResult *result) const {
+    if (result == nullptr) return;
 
-    // Sort the resulting language predictions by probability in descending
-    // order.
-    std::sort(result->predictions.begin(), result->predictions.end(),
-              [](const std::pair<string, float> &a,
-                 const std::pair<string, float> &b) {
-                if (a.second == b.second) {
-                  return a.first.compare(b.first) < 0;
-                } else {
-                  return a.second > b.second;
-                }
-              });
+    result->predictions.clear();
+    if (!is_valid() || accumulator.empty()) {
+      result->predictions.emplace_back(LangId::kUnknownLanguageCode, 1);
+      return;
+    }
+    FeaturizationBuffers *buffers = GetFeaturizationBuffers();
+    accumulator.GetFeatures(&buffers->features);
+    std::vector<float> scores;
+    network_->ComputeFinalScores(buffers->features, &scores);
+    FillPredictions(scores, max_predictions, result);
   }
 
   bool is_valid() const { return valid_; }
 
   int GetModelVersion() const { return model_version_; }
 
+  bool FoldFirstLayer() {
+    if (!is_valid()) {
+      return false;
+    }
+    return network_->is_first_layer_folded() || network_->FoldFirstLayer();
+  }
+
+  MemoryStats GetMemoryStats() const {
+    MemoryStats stats;
+    if (model_provider_) {
+      stats.mapped_bytes = model_provider_->GetMappedBytes();
+      stats.resident_bytes = model_provider_->GetResidentMappedBytes();
+    }
+    if (network_) {
+      stats.decompressed_bytes = network_->FoldedEmbeddingsBytes();
+    }
+    return stats;
+  }
+
   // Returns a property stored in the model file.
   template <typename T, typename R>
   R GetProperty(const string &property, T default_value) const {
@@ -192,27 +410,223 @@ class LangIdImpl {
       }
     }
     model_version_ = context->Get("model_version", model_version_);
+
+    prefix_num_bytes_ = context->Get("prefix_num_bytes", prefix_num_bytes_);
+    prefix_min_margin_ =
+        context->Get("prefix_min_margin", prefix_min_margin_);
+
+    // Parse task parameter "single_script_languages", fill
+    // single_script_languages_.
+    const string script_languages_str =
+        context->Get("single_script_languages", "");
+    for (const auto &token : LiteStrSplit(script_languages_str, ',')) {
+      if (token.empty()) continue;
+      std::vector<StringPiece> parts = LiteStrSplit(token, '=');
+      const int script =
+          parts.size() == 2 ? GetScriptForName(parts[0]) : kScriptError;
+      if (script != kScriptError && !parts[1].empty()) {
+        single_script_languages_.resize(kNumRelevantScripts);
+        single_script_languages_[script] = string(parts[1]);
+      } else {
+        SAFTM_LOG(ERROR) << "Broken token: \"" << token << "\"";
+      }
+    }
+
+    // Models converted for speed over memory ask for the folded first layer.
+    // If it can't be folded, the network is used as is.
+    if (context->Get("fold_first_layer", false)) {
+      network_->FoldFirstLayer();
+    }
     return true;
   }
 
   bool Init(TaskContext *context) {
-    return lang_id_brain_interface_.InitForProcessing(context);
+    if (!lang_id_brain_interface_.InitForProcessing(context)) return false;
+    known_feature_pipeline_ = KnownFeaturePipeline::Create(
+        lang_id_brain_interface_.feature_extractor());
+    return true;
+  }
+
+  // Extracts the features of |buffers|->sentence into |features|, with the
+  // known feature pipeline of the model if it has one.
+  void GetFeatures(FeaturizationBuffers *buffers,
+                   std::vector<FeatureVector> *features) const {
+    if (known_feature_pipeline_ != nullptr) {
+      known_feature_pipeline_->GetFeatures(buffers->sentence, features);
+    } else {
+      lang_id_brain_interface_.GetFeaturesReusingBuffers(
+          &buffers->sentence, &buffers->workspace, features);
+    }
   }
 
   // Extracts features for |text|, runs them through the feed-forward neural
   // network, and computes the output scores (activations from the last layer).
   // These scores can be used to compute the softmax probabilities for our
   // labels (in this case, the languages).
+  //
+  // Texts longer than prefix_num_bytes_ are first scored on their prefix only;
+  // the whole text is scored only if that is not confident enough.
   void ComputeScores(StringPiece text, std::vector<float> *scores) const {
-    // Create a Sentence storing the input text.
-    LightSentence sentence;
-    tokenizer_.Tokenize(text, &sentence);
+    const StringPiece prefix = GetInputPrefix(text);
+    ComputeScoresForInput(prefix, scores);
+    if (prefix.size() < text.size() && !HasConfidentPrediction(*scores)) {
+      ComputeScoresForInput(text, scores);
+    }
+  }
 
-    std::vector<FeatureVector> features =
-        lang_id_brain_interface_.GetFeaturesNoCaching(&sentence);
+  // Same as ComputeScores(), but always scores the whole |text|.
+  void ComputeScoresForInput(StringPiece text,
+                             std::vector<float> *scores) const {
+    // Create a Sentence storing the input text.
+    FeaturizationBuffers *buffers = GetFeaturizationBuffers();
+    tokenizer_.Tokenize(text, &buffers->sentence);
+    GetFeatures(buffers, &buffers->features);
 
     // Run feed-forward neural network to compute scores.
-    network_->ComputeFinalScores(features, scores);
+    network_->ComputeFinalScores(buffers->features, scores);
+  }
+
+  // Returns the prefix of |text| that is scored first: its first
+  // prefix_num_bytes_ bytes, without splitting a UTF8 character, or the whole
+  // text if that is disabled or the text is short enough.
+  StringPiece GetInputPrefix(StringPiece text) const {
+    if (prefix_num_bytes_ <= 0 || text.size() <= prefix_num_bytes_) {
+      return text;
+    }
+    // Don't end the prefix before a UTF8 continuation byte (10xxxxxx).
+    int size = prefix_num_bytes_;
+    while (size > 0 &&
+           (static_cast<unsigned char>(text[size]) & 0xC0) == 0x80) {
+      --size;
+    }
+    return StringPiece(text.data(), size);
+  }
+
+  // Returns true if the probability of the most likely language is at least
+  // prefix_min_margin_ above the probability of the second most likely one.
+  bool HasConfidentPrediction(const std::vector<float> &scores) const {
+    if (prefix_min_margin_ <= 0.0f || scores.size() < 2) {
+      return true;
+    }
+    const std::vector<float> softmax = ComputeSoftmax(scores);
+    float first = 0.0f;
+    float second = 0.0f;
+    for (const float probability : softmax) {
+      if (probability > first) {
+        second = first;
+        first = probability;
+      } else if (probability > second) {
+        second = probability;
+      }
+    }
+    return first - second >= prefix_min_margin_;
+  }
+
+  // If all non-ASCII characters of |text| are from the same script, |text|
+  // contains no ASCII letters, and single_script_languages_ maps that script
+  // to a language, returns that language.  Otherwise, returns nullptr.
+  const string *GetSingleScriptLanguage(StringPiece text) const {
+    if (single_script_languages_.empty()) {
+      return nullptr;
+    }
+    int text_script = kScriptError;
+    const char *curr = text.data();
+    const char *const end =
+        utils::GetSafeEndOfUtf8String(text.data(), text.size());
+    while (curr < end) {
+      const int num_bytes = utils::OneCharLen(curr);
+      if (num_bytes == 1) {
+        // Digits, spaces and punctuation don't tell anything about the script,
+        // but Latin letters mean that the text is not single script.
+        if (isalpha(static_cast<unsigned char>(*curr))) {
+          return nullptr;
+        }
+      } else {
+        const int script =
+            GetScript(reinterpret_cast<const unsigned char *>(curr), num_bytes);
+        if (text_script != kScriptError && script != text_script) {
+          return nullptr;
+        }
+        text_script = script;
+      }
+      curr += num_bytes;
+    }
+    if (text_script == kScriptError ||
+        single_script_languages_[text_script].empty()) {
+      return nullptr;
+    }
+    return &single_script_languages_[text_script];
+  }
+
+  // Fills result with the |max_predictions| most likely languages according to
+  // the network output |scores| (all of them if |max_predictions| is
+  // negative).
+  void FillPredictions(const std::vector<float> &scores, int max_predictions,
+                       LangIdResult *result) const {
+    std::vector<float> softmax;
+    std::vector<int> labels;
+    SelectMostLikelyLabels(scores, max_predictions, &softmax, &labels);
+    result->predictions.clear();
+    result->predictions.reserve(labels.size());
+    for (int label : labels) {
+      result->predictions.emplace_back(GetLanguageForSoftmaxLabel(label),
+                                       softmax[label]);
+    }
+  }
+
+  // Same as above, but without copying the language codes.
+  void FillPredictions(const std::vector<float> &scores, int max_predictions,
+                       LangIdCodeResult *result) const {
+    std::vector<float> softmax;
+    std::vector<int> labels;
+    SelectMostLikelyLabels(scores, max_predictions, &softmax, &labels);
+    result->predictions.clear();
+    result->predictions.reserve(labels.size());
+    for (int label : labels) {
+      result->predictions.emplace_back(GetLanguageCodeForSoftmaxLabel(label),
+                                       softmax[label]);
+    }
+  }
+
+  // Computes the softmax of |scores| and sets labels to the |max_predictions|
+  // most likely labels (all of them if |max_predictions| is negative), in
+  // descending order by probability.  When probabilities are equal, we sort by
+  // language code in ascending order.
+  void SelectMostLikelyLabels(const std::vector<float> &scores,
+                              int max_predictions, std::vector<float> *softmax,
+                              std::vector<int> *labels) const {
+    *softmax = ComputeSoftmax(scores);
+    const int num_labels = softmax->size();
+    labels->resize(num_labels);
+    for (int i = 0; i < num_labels; ++i) {
+      (*labels)[i] = i;
+    }
+    const int num_predictions =
+        (max_predictions < 0 || max_predictions > num_labels) ? num_labels
+                                                              : max_predictions;
+    const std::vector<float> &probabilities = *softmax;
+    std::partial_sort(labels->begin(), labels->begin() + num_predictions,
+                      labels->end(), [this, &probabilities](int a, int b) {
+                        if (probabilities[a] == probabilities[b]) {
+                          return strcmp(GetLanguageCodeForSoftmaxLabel(a),
+                                        GetLanguageCodeForSoftmaxLabel(b)) < 0;
+                        } else {
+                          return probabilities[a] > probabilities[b];
+                        }
+                      });
+    labels->resize(num_predictions);
+  }
+
+  // Same as GetLanguageForSoftmaxLabel() below, but returns a pointer to the
+  // language code owned by this object instead of a copy.
+  const char *GetLanguageCodeForSoftmaxLabel(int label) const {
+    if ((label >= 0) && (label < languages_.size())) {
+      return languages_[label].c_str();
+    } else {
+      SAFTM_LOG(ERROR) << "Softmax label " << label << " outside range [0, "
+                       << languages_.size() << ")";
+      return LangId::kUnknownLanguageCode;
+    }
   }
 
   // Returns language code for a softmax label.  See comments for languages_
@@ -234,6 +648,10 @@ class LangIdImpl {
   EmbeddingFeatureInterface<LightSentenceExtractor, LightSentence>
       lang_id_brain_interface_;
 
+  // Fast path for the features of lang_id_brain_interface_, nullptr if the
+  // model uses feature functions it doesn't know.
+  std::unique_ptr<KnownFeaturePipeline> known_feature_pipeline_;
+
   // Neural network to use for scoring.
   std::unique_ptr<EmbeddingNetwork> network_;
 
@@ -253,6 +671,22 @@ class LangIdImpl {
   // Version of the model used by this LangIdImpl object.  Zero means that the
   // model version could not be determined.
   int model_version_ = 0;
+
+  // If positive, texts longer than this many bytes are first scored on a
+  // prefix of this size.  Set from the "prefix_num_bytes" task parameter.
+  int prefix_num_bytes_ = 0;
+
+  // Minimum probability margin between the two most likely languages of a
+  // prefix to skip scoring the whole text.  With the default of 0, the prefix
+  // is always enough.  Set from the "prefix_min_margin" task parameter.
+  float prefix_min_margin_ = 0.0f;
+
+  // single_script_languages_[s] is the language reported, without running the
+  // neural network, for texts written only in script s (see enum Script from
+  // tiny-script-detector.h), or empty to always run the network.  Set from the
+  // "single_script_languages" task parameter, e.g. "greek=el,hebrew=he".
+  // Empty if that parameter is not set.
+  std::vector<string> single_script_languages_;
 };
 
 const char LangId::kUnknownLanguageCode[] = "und";
@@ -269,20 +703,168 @@ string LangId::FindLanguage(const char *data, size_t num_bytes) const {
 
 void LangId::FindLanguages(const char *data, size_t num_bytes,
                            LangIdResult *result) const {
+  FindLanguages(data, num_bytes, /*max_predictions=*/-1, result);
+}
+
+void LangId::FindLanguages(const char *data, size_t num_bytes,
+                           int max_predictions, LangIdResult *result) const {
+  TC3_TRACE_SCOPE("LangId::FindLanguages");
   SAFTM_DCHECK(result) << "LangIdResult must not be null.";
   StringPiece text(data, num_bytes);
-  pimpl_->FindLanguages(text, result);
+  pimpl_->FindLanguages(text, max_predictions, result);
+}
+
+void LangId::FindLanguages(const char *data, size_t num_bytes,
+                           int max_predictions,
+                           LangIdCodeResult *result) const {
+  TC3_TRACE_SCOPE("LangId::FindLanguages");
+  SAFTM_DCHECK(result) << "LangIdCodeResult must not be null.";
+  StringPiece text(data, num_bytes);
+  pimpl_->FindLanguages(text, max_predictions, result);
+}
+
+void LangId::FindLanguagesBatch(const std::vector<StringPiece> &texts,
+                                int max_predictions,
+                                std::vector<LangIdResult> *results) const {
+  TC3_TRACE_SCOPE("LangId::FindLanguagesBatch");
+  SAFTM_DCHECK(results) << "Results must not be null.";
+  pimpl_->FindLanguagesBatch(texts, max_predictions, results);
 }
 
 bool LangId::is_valid() const { return pimpl_->is_valid(); }
 
 int LangId::GetModelVersion() const { return pimpl_->GetModelVersion(); }
 
+bool LangId::FoldFirstLayer() { return pimpl_->FoldFirstLayer(); }
+
+MemoryStats LangId::GetMemoryStats() const {
+  return pimpl_->GetMemoryStats();
+}
+
 float LangId::GetFloatProperty(const string &property,
                                float default_value) const {
   return pimpl_->GetProperty<float, float>(property, default_value);
 }
 
+// Chunks are processed up to their last ASCII whitespace; the rest is kept in
+// pending_ until the next chunk shows where its last token ends.
+class LangIdStreamState {
+ public:
+  LangIdStreamState(const LangIdImpl *impl, int segment_num_bytes)
+      : impl_(impl), segment_num_bytes_(segment_num_bytes) {}
+
+  void Append(StringPiece data) {
+    pending_.append(data.data(), data.size());
+    size_t end = pending_.size();
+    while (end > 0 && !IsAsciiSpace(pending_[end - 1])) {
+      --end;
+    }
+    if (end == 0 && pending_.size() > kMaxPendingBytes) {
+      // A very long token: cut it, without splitting a UTF8 character.
+      end = utils::GetSafeEndOfUtf8String(pending_.data(), pending_.size()) -
+            pending_.data();
+    }
+    if (end > 0) {
+      Process(StringPiece(pending_.data(), end));
+      pending_.erase(0, end);
+    }
+  }
+
+  void Finish() {
+    if (!pending_.empty()) {
+      Process(pending_);
+      pending_.clear();
+    }
+    EndSegment();
+  }
+
+  void FindLanguages(int max_predictions, LangIdResult *result) const {
+    impl_->FindLanguages(total_, max_predictions, result);
+  }
+
+  std::vector<LangIdStream::Segment> TakeSegments() {
+    std::vector<LangIdStream::Segment> segments;
+    segments.swap(segments_);
+    return segments;
+  }
+
+ private:
+  // Longest token kept in pending_ before it is processed anyway.
+  static constexpr size_t kMaxPendingBytes = 4096;
+
+  static bool IsAsciiSpace(char c) {
+    return (c & 0x80) == 0 && isspace(c);
+  }
+
+  void Process(StringPiece text) {
+    impl_->AccumulateFeatures(text, &total_,
+                              segment_num_bytes_ > 0 ? &segment_ : nullptr);
+    num_processed_bytes_ += text.size();
+    if (segment_num_bytes_ > 0 &&
+        num_processed_bytes_ - segment_begin_ >= segment_num_bytes_) {
+      EndSegment();
+    }
+  }
+
+  void EndSegment() {
+    if (segment_num_bytes_ <= 0 ||
+        num_processed_bytes_ == segment_begin_) {
+      return;
+    }
+    LangIdResult result;
+    impl_->FindLanguages(segment_, /*max_predictions=*/1, &result);
+    segments_.emplace_back();
+    LangIdStream::Segment &segment = segments_.back();
+    segment.begin = segment_begin_;
+    segment.end = num_processed_bytes_;
+    segment.language = result.predictions[0].first;
+    segment.probability = result.predictions[0].second;
+    segment_begin_ = num_processed_bytes_;
+    segment_.Clear();
+  }
+
+  const LangIdImpl *const impl_;
+  const int segment_num_bytes_;
+
+  // Features of the whole stream and of the current segment.
+  FeatureAccumulator total_;
+  FeatureAccumulator segment_;
+
+  // Appended bytes not processed yet.
+  string pending_;
+
+  // Number of bytes processed so far, and the offset where the current segment
+  // begins.
+  size_t num_processed_bytes_ = 0;
+  size_t segment_begin_ = 0;
+
+  // Completed segments, see TakeSegments().
+  std::vector<LangIdStream::Segment> segments_;
+};
+
+constexpr size_t LangIdStreamState::kMaxPendingBytes;
+
+LangIdStream::LangIdStream(const LangId *lang_id, int segment_num_bytes)
+    : state_(new LangIdStreamState(lang_id->pimpl_.get(), segment_num_bytes)) {}
+
+LangIdStream::~LangIdStream() = default;
+
+void LangIdStream::Append(const char *data, size_t num_bytes) {
+  state_->Append(StringPiece(data, num_bytes));
+}
+
+void LangIdStream::Finish() { state_->Finish(); }
+
+void LangIdStream::FindLanguages(int max_predictions,
+                                 LangIdResult *result) const {
+  SAFTM_DCHECK(result) << "LangIdResult must not be null.";
+  state_->FindLanguages(max_predictions, result);
+}
+
+std::vector<LangIdStream::Segment> LangIdStream::TakeSegments() {
+  return state_->TakeSegments();
+}
+
 }  // namespace lang_id
 }  // namespace mobile
 }  // namespace nlp_saft
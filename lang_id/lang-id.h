@@ -26,7 +26,9 @@
 #include <vector>
 
 #include "lang_id/common/lite_base/macros.h"
+#include "lang_id/common/lite_strings/stringpiece.h"
 #include "lang_id/model-provider.h"
+#include "utils/memory/memory-stats.h"
 
 namespace libtextclassifier3 {
 namespace mobile {
@@ -35,6 +37,9 @@ namespace lang_id {
 // Forward-declaration of the class that performs all underlying work.
 class LangIdImpl;
 
+// Forward-declaration of the state of a LangIdStream.
+class LangIdStreamState;
+
 struct LangIdResult {
   // An n-best list of possible language codes for a given input sorted in
   // descending order according to each code's respective probability.
@@ -48,6 +53,13 @@ struct LangIdResult {
   std::vector<std::pair<string, float>> predictions;
 };
 
+// Same as LangIdResult, but the language codes are not copied: they point to
+// strings owned by the LangId object that computed them, and stay valid for
+// the lifetime of that object.
+struct LangIdCodeResult {
+  std::vector<std::pair<const char *, float>> predictions;
+};
+
 // Class for detecting the language of a document.
 //
 // Note: this class does not handle the details of loading the actual model.
@@ -81,11 +93,52 @@ class LangId {
   void FindLanguages(const char *data, size_t num_bytes,
                      LangIdResult *result) const;
 
+  // Same as above, but only returns the |max_predictions| most likely languages
+  // (all of them if |max_predictions| is negative).  Cheaper than computing the
+  // complete list, as only the returned entries are sorted and materialized.
+  void FindLanguages(const char *data, size_t num_bytes, int max_predictions,
+                     LangIdResult *result) const;
+
+  // Same as above, but fills a LangIdCodeResult, which avoids allocating a copy
+  // of each returned language code.  For callers that only need the few most
+  // likely languages.
+  void FindLanguages(const char *data, size_t num_bytes, int max_predictions,
+                     LangIdCodeResult *result) const;
+
   // Convenience version of FindLanguages(const char *, size_t, LangIdResult *).
   void FindLanguages(const string &text, LangIdResult *result) const {
     FindLanguages(text.data(), text.size(), result);
   }
 
+  // Convenience version of
+  // FindLanguages(const char *, size_t, int, LangIdResult *).
+  void FindLanguages(const string &text, int max_predictions,
+                     LangIdResult *result) const {
+    FindLanguages(text.data(), text.size(), max_predictions, result);
+  }
+
+  // Convenience version of
+  // FindLanguages(const char *, size_t, int, LangIdCodeResult *).
+  void FindLanguages(const string &text, int max_predictions,
+                     LangIdCodeResult *result) const {
+    FindLanguages(text.data(), text.size(), max_predictions, result);
+  }
+
+  // Batch version of FindLanguages(const char *, size_t, int, LangIdResult *):
+  // sets (*results)[i] to the |max_predictions| most likely languages of
+  // texts[i].  The texts are featurized one by one, but run through the neural
+  // network together, which is cheaper than separate FindLanguages() calls
+  // when there are many texts.
+  void FindLanguagesBatch(const std::vector<StringPiece> &texts,
+                          int max_predictions,
+                          std::vector<LangIdResult> *results) const;
+
+  // Convenience version of FindLanguagesBatch() that returns all languages.
+  void FindLanguagesBatch(const std::vector<StringPiece> &texts,
+                          std::vector<LangIdResult> *results) const {
+    FindLanguagesBatch(texts, /*max_predictions=*/-1, results);
+  }
+
   // Returns language code for the most likely language for a piece of text.
   //
   // The input text consists of the |num_bytes| bytes that start at |data|.
@@ -122,7 +175,22 @@ class LangId {
   // Returns a typed property stored in the model file.
   float GetFloatProperty(const string &property, float default_value) const;
 
+  // Precomputes the products of the embeddings with the first hidden layer, so
+  // that predictions skip that layer, at the cost of a table of num features *
+  // embedding rows * hidden size floats per embedding space.  Models can ask
+  // for it with the "fold_first_layer" parameter.  The predictions are the
+  // same up to float rounding.  Not thread-safe: meant to be called right
+  // after loading.  Returns false if the model is invalid or its first layer
+  // can't be folded.
+  bool FoldFirstLayer();
+
+  // Returns the memory held by the model.  The weights are used in place, so
+  // this is mostly the mapped model file, plus the folded first layer if any.
+  MemoryStats GetMemoryStats() const;
+
  private:
+  friend class LangIdStream;
+
   // Pimpl ("pointer to implementation") pattern, to hide all internals from our
   // clients.
   std::unique_ptr<LangIdImpl> pimpl_;
@@ -130,6 +198,64 @@ class LangId {
   SAFTM_DISALLOW_COPY_AND_ASSIGN(LangId);
 };
 
+// Detects the language of a text that is provided in chunks, e.g., a very long
+// document or a log stream, without keeping the text in memory.
+//
+// Each chunk is featurized as it arrives, and only the accumulated feature
+// weights are kept; their size is bounded by the model, not by the text.  The
+// continuous features of the chunks are averaged, weighted by the number of
+// characters of each chunk, so the result approximates running FindLanguages()
+// on the whole text.
+//
+// Optionally, the stream is also cut into segments of about
+// |segment_num_bytes| bytes, and the most likely language of each segment is
+// reported, e.g., to detect code-switching.
+//
+// This class is not thread-safe, but several streams can share a LangId.
+class LangIdStream {
+ public:
+  // Language of a segment of the stream, see TakeSegments().
+  struct Segment {
+    // Byte range [begin, end) of the segment in the stream.
+    size_t begin = 0;
+    size_t end = 0;
+
+    // Most likely language of the segment and its probability.
+    string language;
+    float probability = 0.0f;
+  };
+
+  // Does not take ownership of |lang_id|, which should stay alive for the
+  // lifetime of this object.  If |segment_num_bytes| is positive, segments of
+  // at least that many bytes (cut at token boundaries) are reported.
+  explicit LangIdStream(const LangId *lang_id, int segment_num_bytes = 0);
+
+  ~LangIdStream();
+
+  // Appends the |num_bytes| bytes that start at |data| to the stream.  Chunks
+  // may end in the middle of a token or of a UTF8 character.
+  void Append(const char *data, size_t num_bytes);
+
+  // Convenience version of Append(const char *, size_t).
+  void Append(const string &text) { Append(text.data(), text.size()); }
+
+  // Ends the stream: processes the end of the last chunk, which Append() keeps
+  // back while the last token may still continue, and ends the last segment.
+  void Finish();
+
+  // Computes the |max_predictions| most likely languages (all of them if
+  // negative) of the text seen so far.  See LangId::FindLanguages().
+  void FindLanguages(int max_predictions, LangIdResult *result) const;
+
+  // Returns the segments completed since the last call, and forgets them.
+  std::vector<Segment> TakeSegments();
+
+ private:
+  std::unique_ptr<LangIdStreamState> state_;
+
+  SAFTM_DISALLOW_COPY_AND_ASSIGN(LangIdStream);
+};
+
 }  // namespace lang_id
 }  // namespace mobile
 }  // namespace nlp_saft
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "lang_id/fb_model/lang-id-from-fb.h"
+#include "lang_id/lang-id.h"
+#include "utils/testing/benchmark-utils.h"
+#include "benchmark/benchmark.h"
+
+namespace libtextclassifier3 {
+namespace mobile {
+namespace lang_id {
+namespace {
+
+void BM_FindLanguages(benchmark::State& state) {
+  static const LangId* const lang_id =
+      GetLangIdFromFlatbufferFile(BenchmarkModelPath("lang_id.model"))
+          .release();
+  if (lang_id == nullptr || !lang_id->is_valid()) {
+    state.SkipWithError("Couldn't load the model.");
+    return;
+  }
+
+  const BenchmarkCorpus corpus = static_cast<BenchmarkCorpus>(state.range(0));
+  state.SetLabel(BenchmarkCorpusName(corpus));
+  const std::vector<std::string>& texts = BenchmarkCorpusTexts(corpus);
+  int64 num_bytes = 0;
+  for (const std::string& text : texts) {
+    num_bytes += text.size();
+  }
+
+  int i = 0;
+  LangIdResult result;
+  RunMeasuredBenchmark(state, num_bytes / texts.size(), [&]() {
+    lang_id->FindLanguages(texts[i], &result);
+    benchmark::DoNotOptimize(result);
+    i = (i + 1) % texts.size();
+  });
+}
+BENCHMARK(BM_FindLanguages)->DenseRange(0, kNumBenchmarkCorpora - 1);
+
+}  // namespace
+}  // namespace lang_id
+}  // namespace mobile
+}  // namespace libtextclassifier3
@@ -17,45 +17,97 @@
 #include "lang_id/lang-id_jni.h"
 
 #include <jni.h>
+#include <string>
 #include <type_traits>
 #include <vector>
 
 #include "utils/base/logging.h"
+#include "utils/java/jni-warmup.h"
+#include "utils/java/scoped_global_ref.h"
 #include "utils/java/scoped_local_ref.h"
+#include "utils/warmup.h"
 #include "lang_id/fb_model/lang-id-from-fb.h"
 #include "lang_id/lang-id.h"
 
+using libtextclassifier3::MakeGlobalRef;
+using libtextclassifier3::ScopedGlobalRef;
 using libtextclassifier3::ScopedLocalRef;
 using libtextclassifier3::ToStlString;
+using libtextclassifier3::WarmupReport;
+using libtextclassifier3::WarmupReportToJObjectArray;
+using libtextclassifier3::mobile::StringPiece;
 using libtextclassifier3::mobile::lang_id::GetLangIdFromFlatbufferFile;
 using libtextclassifier3::mobile::lang_id::GetLangIdFromFlatbufferFileDescriptor;
 using libtextclassifier3::mobile::lang_id::LangId;
+using libtextclassifier3::mobile::lang_id::LangIdCodeResult;
 using libtextclassifier3::mobile::lang_id::LangIdResult;
 
 namespace {
+// The Java result class and its constructor. LangId has no per-model JNI
+// state, so they are resolved once per process, when the first model is
+// created, instead of on every call.
+struct LangIdJniResultClasses {
+  LangIdJniResultClasses(JNIEnv* env, JavaVM* jvm)
+      : language_result_class(
+            MakeGlobalRef(env->FindClass(TC3_PACKAGE_PATH
+                                         TC3_LANG_ID_CLASS_NAME_STR
+                                         "$LanguageResult"),
+                          env, jvm)),
+        language_result_array_class(
+            MakeGlobalRef(env->FindClass("[L" TC3_PACKAGE_PATH
+                                         TC3_LANG_ID_CLASS_NAME_STR
+                                         "$LanguageResult;"),
+                          env, jvm)) {
+    if (language_result_class == nullptr ||
+        language_result_array_class == nullptr) {
+      TC3_LOG(ERROR) << "Couldn't find LanguageResult class.";
+      return;
+    }
+    language_result_init = env->GetMethodID(
+        language_result_class.get(), "<init>", "(Ljava/lang/String;F)V");
+  }
+
+  ScopedGlobalRef<jclass> language_result_class;
+  jmethodID language_result_init = nullptr;
+  ScopedGlobalRef<jclass> language_result_array_class;
+};
+
+// Returns the result classes, resolving them on the first call. Returns
+// nullptr if they couldn't be resolved.
+const LangIdJniResultClasses* GetLangIdJniResultClasses(JNIEnv* env) {
+  static const LangIdJniResultClasses* const classes = [env]() {
+    JavaVM* jvm = nullptr;
+    if (env->GetJavaVM(&jvm) != JNI_OK) {
+      return static_cast<LangIdJniResultClasses*>(nullptr);
+    }
+    return new LangIdJniResultClasses(env, jvm);
+  }();
+  if (classes == nullptr || classes->language_result_init == nullptr) {
+    return nullptr;
+  }
+  return classes;
+}
+
+const char* LanguageCode(const char* code) { return code; }
+const char* LanguageCode(const std::string& code) { return code.c_str(); }
+
+// Converts the predictions of a LangIdCodeResult or a LangIdResult.
+template <typename Result>
 jobjectArray LangIdResultToJObjectArray(JNIEnv* env,
-                                        const LangIdResult& lang_id_result) {
-  const ScopedLocalRef<jclass> result_class(
-      env->FindClass(TC3_PACKAGE_PATH TC3_LANG_ID_CLASS_NAME_STR
-                     "$LanguageResult"),
-      env);
-  if (!result_class) {
-    TC3_LOG(ERROR) << "Couldn't find LanguageResult class.";
+                                        const Result& lang_id_result) {
+  const LangIdJniResultClasses* classes = GetLangIdJniResultClasses(env);
+  if (classes == nullptr) {
     return nullptr;
   }
 
-  // clang-format off
-  const std::vector<std::pair<std::string, float>>& predictions =
-      lang_id_result.predictions;
-  // clang-format on
-  const jmethodID result_class_constructor =
-      env->GetMethodID(result_class.get(), "<init>", "(Ljava/lang/String;F)V");
-  const jobjectArray results =
-      env->NewObjectArray(predictions.size(), result_class.get(), nullptr);
+  const auto& predictions = lang_id_result.predictions;
+  const jobjectArray results = env->NewObjectArray(
+      predictions.size(), classes->language_result_class.get(), nullptr);
   for (int i = 0; i < predictions.size(); i++) {
     ScopedLocalRef<jobject> result(
-        env->NewObject(result_class.get(), result_class_constructor,
-                       env->NewStringUTF(predictions[i].first.c_str()),
+        env->NewObject(classes->language_result_class.get(),
+                       classes->language_result_init,
+                       env->NewStringUTF(LanguageCode(predictions[i].first)),
                        static_cast<jfloat>(predictions[i].second)));
     env->SetObjectArrayElement(results, i, result.get());
   }
@@ -65,6 +117,7 @@ jobjectArray LangIdResultToJObjectArray(JNIEnv* env,
 
 TC3_JNI_METHOD(jlong, TC3_LANG_ID_CLASS_NAME, nativeNew)
 (JNIEnv* env, jobject thiz, jint fd) {
+  GetLangIdJniResultClasses(env);
   std::unique_ptr<LangId> lang_id = GetLangIdFromFlatbufferFileDescriptor(fd);
   if (!lang_id->is_valid()) {
     return reinterpret_cast<jlong>(nullptr);
@@ -74,6 +127,7 @@ TC3_JNI_METHOD(jlong, TC3_LANG_ID_CLASS_NAME, nativeNew)
 
 TC3_JNI_METHOD(jlong, TC3_LANG_ID_CLASS_NAME, nativeNewFromPath)
 (JNIEnv* env, jobject thiz, jstring path) {
+  GetLangIdJniResultClasses(env);
   const std::string path_str = ToStlString(env, path);
   std::unique_ptr<LangId> lang_id = GetLangIdFromFlatbufferFile(path_str);
   if (!lang_id->is_valid()) {
@@ -90,12 +144,70 @@ TC3_JNI_METHOD(jobjectArray, TC3_LANG_ID_CLASS_NAME, nativeDetectLanguages)
   }
 
   const std::string text_str = ToStlString(env, text);
-  LangIdResult result;
-  model->FindLanguages(text_str, &result);
+  LangIdCodeResult result;
+  model->FindLanguages(text_str, /*max_predictions=*/-1, &result);
 
   return LangIdResultToJObjectArray(env, result);
 }
 
+TC3_JNI_METHOD(jobjectArray, TC3_LANG_ID_CLASS_NAME, nativeDetectLanguagesBatch)
+(JNIEnv* env, jobject clazz, jlong ptr, jobjectArray texts) {
+  LangId* model = reinterpret_cast<LangId*>(ptr);
+  if (!model) {
+    return nullptr;
+  }
+  const LangIdJniResultClasses* classes = GetLangIdJniResultClasses(env);
+  if (classes == nullptr) {
+    return nullptr;
+  }
+
+  const int num_texts = env->GetArrayLength(texts);
+  std::vector<std::string> text_strs;
+  text_strs.reserve(num_texts);
+  for (int i = 0; i < num_texts; i++) {
+    const ScopedLocalRef<jstring> text(
+        static_cast<jstring>(env->GetObjectArrayElement(texts, i)), env);
+    text_strs.push_back(ToStlString(env, text.get()));
+  }
+  const std::vector<StringPiece> text_pieces(text_strs.begin(),
+                                             text_strs.end());
+  std::vector<LangIdResult> lang_id_results;
+  model->FindLanguagesBatch(text_pieces, &lang_id_results);
+
+  const jobjectArray results = env->NewObjectArray(
+      num_texts, classes->language_result_array_class.get(), nullptr);
+  for (int i = 0; i < num_texts; i++) {
+    const ScopedLocalRef<jobjectArray> result(
+        LangIdResultToJObjectArray(env, lang_id_results[i]), env);
+    env->SetObjectArrayElement(results, i, result.get());
+  }
+  return results;
+}
+
+TC3_JNI_METHOD(jobjectArray, TC3_LANG_ID_CLASS_NAME, nativeWarmup)
+(JNIEnv* env, jobject clazz, jlong ptr) {
+  const LangId* model = reinterpret_cast<LangId*>(ptr);
+  if (!model) {
+    return nullptr;
+  }
+
+  // LangId lives outside of the annotator and actions libraries, so its
+  // warm-up is driven from here: running a few texts in different scripts
+  // touches the embeddings and the network weights.
+  WarmupReport report;
+  report.RunPhase("find_languages", [model]() {
+    for (const char* text :
+         {"Are you free tomorrow?", "Bist du morgen frei?",
+          "\u0414\u043e \u0437\u0430\u0432\u0442\u0440\u0430!",
+          "\u660e\u5929\u89c1"}) {
+      LangIdResult result;
+      model->FindLanguages(text, &result);
+    }
+    return true;
+  });
+  return WarmupReportToJObjectArray(env, report);
+}
+
 TC3_JNI_METHOD(void, TC3_LANG_ID_CLASS_NAME, nativeClose)
 (JNIEnv* env, jobject clazz, jlong ptr) {
   if (!ptr) {
@@ -42,6 +42,12 @@ TC3_JNI_METHOD(jlong, TC3_LANG_ID_CLASS_NAME, nativeNewFromPath)
 TC3_JNI_METHOD(jobjectArray, TC3_LANG_ID_CLASS_NAME, nativeDetectLanguages)
 (JNIEnv* env, jobject clazz, jlong ptr, jstring text);
 
+TC3_JNI_METHOD(jobjectArray, TC3_LANG_ID_CLASS_NAME, nativeDetectLanguagesBatch)
+(JNIEnv* env, jobject clazz, jlong ptr, jobjectArray texts);
+
+TC3_JNI_METHOD(jobjectArray, TC3_LANG_ID_CLASS_NAME, nativeWarmup)
+(JNIEnv* env, jobject clazz, jlong ptr);
+
 TC3_JNI_METHOD(void, TC3_LANG_ID_CLASS_NAME, nativeClose)
 (JNIEnv* env, jobject clazz, jlong ptr);
 
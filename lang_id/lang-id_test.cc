@@ -0,0 +1,404 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "lang_id/lang-id.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "lang_id/common/fel/task-context.h"
+#include "lang_id/fb_model/lang-id-from-fb.h"
+#include "lang_id/fb_model/model-provider-from-fb.h"
+#include "lang_id/model-provider.h"
+#include "utils/testing/allocation-counter.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace mobile {
+namespace lang_id {
+namespace {
+
+// Heap allocations a warm FindLanguages call on the test text may make. The
+// featurization buffers are kept per thread and the result is reused, so only
+// the few allocations of the tokenization are left. A failure means that a
+// change added allocations to the path: remove them, or raise the budget
+// knowingly.
+constexpr int64 kMaxFindLanguagesAllocations = 50;
+
+constexpr char kText[] = "Meet me at the station, the train leaves at ten.";
+
+std::string GetModelPath() { return TC3_TEST_DATA_DIR; }
+
+// Texts in several languages and scripts.
+const std::vector<std::string>& MixedTexts() {
+  static const std::vector<std::string>* const texts =
+      new std::vector<std::string>{
+          kText,
+          "Wir treffen uns morgen am Bahnhof, der Zug fährt um zehn.",
+          "Nous nous retrouvons demain à la gare à dix heures.",
+          "Καλημέρα, τι κάνεις;",
+          "明天在车站见面。",
+          "ok",
+          ""};
+  return *texts;
+}
+
+// The test model, with some of its task parameters replaced.
+class ModelProviderWithParameters : public ModelProvider {
+ public:
+  explicit ModelProviderWithParameters(
+      const std::vector<std::pair<std::string, std::string>>& parameters)
+      : model_provider_(GetModelPath() + "lang_id.model") {
+    valid_ = model_provider_.is_valid();
+    if (valid_) {
+      task_context_ = *model_provider_.GetTaskContext();
+    }
+    for (const std::pair<std::string, std::string>& parameter : parameters) {
+      task_context_.SetParameter(parameter.first, parameter.second);
+    }
+  }
+
+  const TaskContext* GetTaskContext() const override { return &task_context_; }
+
+  const EmbeddingNetworkParams* GetNnParams() const override {
+    return model_provider_.GetNnParams();
+  }
+
+  std::vector<std::string> GetLanguages() const override {
+    return model_provider_.GetLanguages();
+  }
+
+ private:
+  ModelProviderFromFlatbuffer model_provider_;
+  TaskContext task_context_;
+};
+
+std::unique_ptr<LangId> GetLangIdWithParameters(
+    const std::vector<std::pair<std::string, std::string>>& parameters) {
+  return std::unique_ptr<LangId>(new LangId(std::unique_ptr<ModelProvider>(
+      new ModelProviderWithParameters(parameters))));
+}
+
+// Expects the same languages, with the same probabilities up to rounding.
+template <typename Result>
+void ExpectSamePredictions(const Result& result, const Result& expected) {
+  ASSERT_EQ(result.predictions.size(), expected.predictions.size());
+  for (int i = 0; i < expected.predictions.size(); ++i) {
+    EXPECT_EQ(std::string(result.predictions[i].first),
+              std::string(expected.predictions[i].first));
+    EXPECT_NEAR(result.predictions[i].second, expected.predictions[i].second,
+                1e-5);
+  }
+}
+
+TEST(LangIdTest, FindsLanguage) {
+  std::unique_ptr<LangId> lang_id =
+      GetLangIdFromFlatbufferFile(GetModelPath() + "lang_id.model");
+  ASSERT_TRUE(lang_id->is_valid());
+  EXPECT_EQ(lang_id->FindLanguage(kText), "en");
+}
+
+TEST(LangIdTest, FindLanguagesStaysWithinAllocationBudget) {
+  std::unique_ptr<LangId> lang_id =
+      GetLangIdFromFlatbufferFile(GetModelPath() + "lang_id.model");
+  ASSERT_TRUE(lang_id->is_valid());
+
+  const std::string text = kText;
+  LangIdCodeResult result;
+  lang_id->FindLanguages(text, /*max_predictions=*/3, &result);
+  const int64 num_allocations = CountAllocations([&]() {
+    lang_id->FindLanguages(text, /*max_predictions=*/3, &result);
+  });
+  EXPECT_LE(num_allocations, kMaxFindLanguagesAllocations);
+  ASSERT_FALSE(result.predictions.empty());
+  EXPECT_STREQ(result.predictions[0].first, "en");
+}
+
+TEST(LangIdTest, FindsSameLanguagesInBatch) {
+  std::unique_ptr<LangId> lang_id =
+      GetLangIdFromFlatbufferFile(GetModelPath() + "lang_id.model");
+  ASSERT_TRUE(lang_id->is_valid());
+  const std::vector<std::string>& texts = MixedTexts();
+  const std::vector<StringPiece> pieces(texts.begin(), texts.end());
+
+  for (const int max_predictions : {-1, 3}) {
+    std::vector<LangIdResult> results;
+    lang_id->FindLanguagesBatch(pieces, max_predictions, &results);
+    ASSERT_EQ(results.size(), texts.size());
+    for (int i = 0; i < texts.size(); ++i) {
+      SCOPED_TRACE(texts[i]);
+      LangIdResult expected;
+      lang_id->FindLanguages(texts[i], max_predictions, &expected);
+      ExpectSamePredictions(results[i], expected);
+    }
+  }
+}
+
+TEST(LangIdTest, FindsSameLanguagesWithFoldedFirstLayer) {
+  std::unique_ptr<LangId> lang_id =
+      GetLangIdFromFlatbufferFile(GetModelPath() + "lang_id.model");
+  std::unique_ptr<LangId> folded_lang_id =
+      GetLangIdFromFlatbufferFile(GetModelPath() + "lang_id.model");
+  ASSERT_TRUE(folded_lang_id->FoldFirstLayer());
+  EXPECT_GT(folded_lang_id->GetMemoryStats().decompressed_bytes,
+            lang_id->GetMemoryStats().decompressed_bytes);
+
+  const std::string text = kText;
+  LangIdCodeResult result;
+  LangIdCodeResult folded_result;
+  lang_id->FindLanguages(text, /*max_predictions=*/3, &result);
+  folded_lang_id->FindLanguages(text, /*max_predictions=*/3, &folded_result);
+  ASSERT_EQ(folded_result.predictions.size(), result.predictions.size());
+  for (int i = 0; i < result.predictions.size(); ++i) {
+    EXPECT_STREQ(folded_result.predictions[i].first,
+                 result.predictions[i].first);
+    EXPECT_NEAR(folded_result.predictions[i].second,
+                result.predictions[i].second, 1e-4);
+  }
+}
+
+TEST(LangIdTest, ScoresPrefixOfLongTextWhenConfident) {
+  std::unique_ptr<LangId> lang_id =
+      GetLangIdFromFlatbufferFile(GetModelPath() + "lang_id.model");
+  ASSERT_TRUE(lang_id->is_valid());
+  std::string text;
+  while (text.size() < 1000) {
+    text += std::string(kText) + " ";
+  }
+  const std::string prefix = text.substr(0, 100);
+  LangIdResult full_text_result;
+  lang_id->FindLanguages(text, &full_text_result);
+  LangIdResult prefix_result;
+  lang_id->FindLanguages(prefix, &prefix_result);
+
+  // The prefix is confident enough, so it decides: the same language as the
+  // whole text, with the probabilities of the prefix.
+  std::unique_ptr<LangId> prefix_lang_id = GetLangIdWithParameters(
+      {{"prefix_num_bytes", "100"}, {"prefix_min_margin", "0.1"}});
+  ASSERT_TRUE(prefix_lang_id->is_valid());
+  LangIdResult result;
+  prefix_lang_id->FindLanguages(text, &result);
+  ExpectSamePredictions(result, prefix_result);
+  ASSERT_FALSE(result.predictions.empty());
+  EXPECT_EQ(result.predictions[0].first,
+            full_text_result.predictions[0].first);
+
+  // No prefix is ever confident enough, so the whole text is scored.
+  std::unique_ptr<LangId> unconfident_lang_id = GetLangIdWithParameters(
+      {{"prefix_num_bytes", "100"}, {"prefix_min_margin", "2"}});
+  unconfident_lang_id->FindLanguages(text, &result);
+  ExpectSamePredictions(result, full_text_result);
+}
+
+TEST(LangIdTest, FindsLanguageOfSingleScriptTextWithoutModel) {
+  std::unique_ptr<LangId> lang_id =
+      GetLangIdFromFlatbufferFile(GetModelPath() + "lang_id.model");
+  ASSERT_TRUE(lang_id->is_valid());
+  const std::string greek_text = "Καλημέρα, τι κάνεις;";
+  const std::string hebrew_text = "שלום, מה שלומך היום?";
+
+  // The model agrees with the shortcut. It may use the legacy code of Hebrew.
+  LangIdResult greek_result;
+  lang_id->FindLanguages(greek_text, &greek_result);
+  ASSERT_FALSE(greek_result.predictions.empty());
+  EXPECT_EQ(greek_result.predictions[0].first, "el");
+  LangIdResult hebrew_result;
+  lang_id->FindLanguages(hebrew_text, &hebrew_result);
+  ASSERT_FALSE(hebrew_result.predictions.empty());
+  const std::string hebrew_code = hebrew_result.predictions[0].first;
+  EXPECT_TRUE(hebrew_code == "he" || hebrew_code == "iw") << hebrew_code;
+
+  std::unique_ptr<LangId> shortcut_lang_id = GetLangIdWithParameters(
+      {{"single_script_languages", "greek=el,hebrew=" + hebrew_code}});
+  ASSERT_TRUE(shortcut_lang_id->is_valid());
+  for (const std::pair<std::string, std::string>& text_and_language :
+       std::vector<std::pair<std::string, std::string>>{
+           {greek_text, "el"}, {hebrew_text, hebrew_code}}) {
+    SCOPED_TRACE(text_and_language.first);
+    LangIdResult result;
+    shortcut_lang_id->FindLanguages(text_and_language.first, &result);
+    ASSERT_EQ(result.predictions.size(), 1);
+    EXPECT_EQ(result.predictions[0].first, text_and_language.second);
+    EXPECT_EQ(result.predictions[0].second, 1.0f);
+  }
+
+  // Texts of several scripts, or with Latin letters, go through the model.
+  for (const std::string& text :
+       {greek_text + " " + hebrew_text, greek_text + " " + kText}) {
+    SCOPED_TRACE(text);
+    LangIdResult result;
+    shortcut_lang_id->FindLanguages(text, &result);
+    LangIdResult expected;
+    lang_id->FindLanguages(text, &expected);
+    ExpectSamePredictions(result, expected);
+  }
+}
+
+// Appends |text| to |stream| in chunks of |chunk_size| bytes, which can split
+// tokens and UTF8 characters.
+void AppendInChunks(const std::string& text, int chunk_size,
+                    LangIdStream* stream) {
+  for (int i = 0; i < text.size(); i += chunk_size) {
+    stream->Append(text.substr(i, chunk_size));
+  }
+}
+
+void ExpectUnknownLanguage(const LangIdResult& result) {
+  ASSERT_EQ(result.predictions.size(), 1);
+  EXPECT_EQ(result.predictions[0].first, LangId::kUnknownLanguageCode);
+  EXPECT_EQ(result.predictions[0].second, 1.0f);
+}
+
+TEST(LangIdStreamTest, FindsLanguagesOfWholeText) {
+  std::unique_ptr<LangId> lang_id =
+      GetLangIdFromFlatbufferFile(GetModelPath() + "lang_id.model");
+  ASSERT_TRUE(lang_id->is_valid());
+  for (const std::string& text : MixedTexts()) {
+    if (text.empty()) {
+      continue;
+    }
+    SCOPED_TRACE(text);
+    LangIdResult expected;
+    lang_id->FindLanguages(text, /*max_predictions=*/3, &expected);
+
+    // A single chunk that ends at a token boundary is featurized at once.
+    LangIdStream stream(lang_id.get());
+    stream.Append(text + " ");
+    stream.Finish();
+    LangIdResult result;
+    stream.FindLanguages(/*max_predictions=*/3, &result);
+    ASSERT_EQ(result.predictions.size(), expected.predictions.size());
+    for (int i = 0; i < expected.predictions.size(); ++i) {
+      EXPECT_EQ(result.predictions[i].first, expected.predictions[i].first);
+      EXPECT_NEAR(result.predictions[i].second,
+                  expected.predictions[i].second, 1e-4);
+    }
+  }
+}
+
+TEST(LangIdStreamTest, FindsLanguageOfChunkedText) {
+  std::unique_ptr<LangId> lang_id =
+      GetLangIdFromFlatbufferFile(GetModelPath() + "lang_id.model");
+  ASSERT_TRUE(lang_id->is_valid());
+  for (const std::string& sentence : MixedTexts()) {
+    std::string text;
+    for (int i = 0; i < 5; ++i) {
+      text += sentence + " ";
+    }
+    LangIdResult expected;
+    lang_id->FindLanguages(text, &expected);
+    if (expected.predictions[0].first == LangId::kUnknownLanguageCode) {
+      continue;
+    }
+    for (const int chunk_size : {1, 5, 16}) {
+      SCOPED_TRACE(testing::Message() << text << " " << chunk_size);
+      LangIdStream stream(lang_id.get());
+      AppendInChunks(text, chunk_size, &stream);
+      stream.Finish();
+      LangIdResult result;
+      stream.FindLanguages(/*max_predictions=*/1, &result);
+      ASSERT_EQ(result.predictions.size(), 1);
+      EXPECT_EQ(result.predictions[0].first, expected.predictions[0].first);
+    }
+  }
+}
+
+TEST(LangIdStreamTest, ProcessesLongTokenAtMaxPendingBytes) {
+  std::unique_ptr<LangId> lang_id =
+      GetLangIdFromFlatbufferFile(GetModelPath() + "lang_id.model");
+  ASSERT_TRUE(lang_id->is_valid());
+  // 24 bytes, without any whitespace.
+  const std::string sentence = "明天在车站见面。";
+  LangIdResult expected;
+  lang_id->FindLanguages(sentence, &expected);
+
+  // Nothing is processed while the token may go on, up to 4096 bytes.
+  LangIdStream stream(lang_id.get());
+  std::string text;
+  while (text.size() + sentence.size() <= 4096) {
+    text += sentence;
+  }
+  AppendInChunks(text, 7, &stream);
+  LangIdResult result;
+  stream.FindLanguages(/*max_predictions=*/1, &result);
+  ExpectUnknownLanguage(result);
+
+  // Then the token is cut, without splitting a character.
+  stream.Append(sentence);
+  stream.FindLanguages(/*max_predictions=*/1, &result);
+  ASSERT_EQ(result.predictions.size(), 1);
+  EXPECT_EQ(result.predictions[0].first, expected.predictions[0].first);
+}
+
+TEST(LangIdStreamTest, FindsUnknownLanguageWithoutText) {
+  std::unique_ptr<LangId> lang_id =
+      GetLangIdFromFlatbufferFile(GetModelPath() + "lang_id.model");
+  ASSERT_TRUE(lang_id->is_valid());
+  for (const std::string& text : {"", " \n\t "}) {
+    SCOPED_TRACE(text);
+    LangIdStream stream(lang_id.get(), /*segment_num_bytes=*/10);
+    LangIdResult result;
+    stream.FindLanguages(/*max_predictions=*/-1, &result);
+    ExpectUnknownLanguage(result);
+
+    stream.Append(text);
+    stream.Finish();
+    stream.FindLanguages(/*max_predictions=*/-1, &result);
+    ExpectUnknownLanguage(result);
+    EXPECT_TRUE(stream.TakeSegments().empty());
+  }
+}
+
+TEST(LangIdStreamTest, FindsLanguagesOfSegments) {
+  std::unique_ptr<LangId> lang_id =
+      GetLangIdFromFlatbufferFile(GetModelPath() + "lang_id.model");
+  ASSERT_TRUE(lang_id->is_valid());
+  std::string text;
+  for (int i = 0; i < 6; ++i) {
+    text += std::string(kText) + " ";
+  }
+  for (int i = 0; i < 6; ++i) {
+    text += "Wir treffen uns morgen am Bahnhof, der Zug fährt um zehn. ";
+  }
+
+  LangIdStream stream(lang_id.get(), /*segment_num_bytes=*/100);
+  AppendInChunks(text, 37, &stream);
+  std::vector<LangIdStream::Segment> segments = stream.TakeSegments();
+  stream.Finish();
+  for (LangIdStream::Segment& segment : stream.TakeSegments()) {
+    segments.push_back(segment);
+  }
+  EXPECT_TRUE(stream.TakeSegments().empty());
+
+  // The segments cover the text, one after the other.
+  ASSERT_GE(segments.size(), 2);
+  size_t end = 0;
+  for (const LangIdStream::Segment& segment : segments) {
+    EXPECT_EQ(segment.begin, end);
+    EXPECT_GT(segment.end, segment.begin);
+    end = segment.end;
+  }
+  EXPECT_EQ(end, text.size());
+  EXPECT_EQ(segments.front().language, "en");
+  EXPECT_EQ(segments.back().language, "de");
+}
+
+}  // namespace
+}  // namespace lang_id
+}  // namespace mobile
+}  // namespace libtextclassifier3
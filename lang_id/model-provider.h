@@ -53,6 +53,13 @@ class ModelProvider {
   // i.
   virtual std::vector<string> GetLanguages() const = 0;
 
+  // Returns the number of bytes of the model file mapped by this
+  // ModelProvider, or 0 if the model is read from memory owned by the client.
+  virtual size_t GetMappedBytes() const { return 0; }
+
+  // Returns how many of the mapped bytes are currently resident in memory.
+  virtual size_t GetResidentMappedBytes() const { return 0; }
+
  protected:
   bool valid_ = false;
 };
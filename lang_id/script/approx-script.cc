@@ -20,6 +20,7 @@
 #include "lang_id/common/lite_base/logging.h"
 #include "lang_id/common/utf8.h"
 #include "lang_id/script/approx-script-data.h"
+#include "utils/utf8/bmp-lookup-table.h"
 
 namespace libtextclassifier3 {
 namespace mobile {
@@ -76,6 +77,16 @@ inline int BinarySearch(uint32 codepoint, int start, int end) {
 
   return kUnknownUscript;
 }
+
+// Returns the script of each codepoint of the Basic Multilingual Plane, which
+// covers nearly all the text, computed once from the ranges.
+const BmpLookupTable<uint8> &GetBmpScripts() {
+  static const BmpLookupTable<uint8> *const bmp_scripts =
+      new BmpLookupTable<uint8>([](int codepoint) -> uint8 {
+        return BinarySearch(codepoint, 0, kNumRanges);
+      });
+  return *bmp_scripts;
+}
 }  // namespace
 
 int GetApproxScript(const unsigned char *s, int num_bytes) {
@@ -83,6 +94,9 @@ int GetApproxScript(const unsigned char *s, int num_bytes) {
   SAFTM_DCHECK_EQ(num_bytes,
                   utils::OneCharLen(reinterpret_cast<const char *>(s)));
   uint32 codepoint = Utf8ToCodepoint(s, num_bytes);
+  if (codepoint < BmpLookupTable<uint8>::kNumCodepoints) {
+    return GetBmpScripts().Get(codepoint);
+  }
   return BinarySearch(codepoint, 0, kNumRanges);
 }
 
@@ -0,0 +1,590 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Serves the annotator, the actions and LangId on a Unix socket: the
+// reference deployment of the library for high throughput.
+//
+// Usage:
+//   libtextclassifier_server --socket=<path>
+//       [--annotator_model=<path>] [--actions_model=<path>]
+//       [--lang_id_model=<path>] [--model_image=<path>]
+//       [--threads=<number of cores>] [--max_batch_size=32]
+//       [--max_batch_delay_us=500] [--locales=en] [--reference_timezone=UTC]
+//
+// The models are mapped once, from their files or from a model image (see
+// utils/model-image.h), and shared by a worker thread per core. The requests
+// of all the connections are spread over the workers, which run them in
+// batches through the batch APIs of the engines, see BatchingQueue. All the
+// requests are for --locales, so the annotator only loads the datetime rules
+// of these.
+//
+// Protocol: the client sends frames, and gets one frame back per request
+// frame, not necessarily in order. A frame is a 4-byte big-endian length
+// followed by that many bytes of fields separated by '\0':
+//   request:  <id> <method> <arguments>...
+//   response: <id> ok <result> | <id> error <message>
+// where <id> is chosen by the client to match the responses, and the methods
+// are:
+//   annotate <text>: a line "<start> <end> <collection> <score>" per
+//     annotation, with codepoint offsets.
+//   suggest_actions <message>...: the messages of a conversation, the last
+//     one from the remote user. A line "<type> <score> <response text>" per
+//     action.
+//   detect_language <text>: a line "<language> <score>" per prediction.
+//   stats: the throughput and latency figures of the methods, see
+//     ServerMetrics.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>  // NOLINT
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "actions/actions-suggestions.h"
+#include "annotator/annotator.h"
+#include "lang_id/fb_model/lang-id-from-fb.h"
+#include "lang_id/lang-id.h"
+#include "server/batching-queue.h"
+#include "server/server-metrics.h"
+#include "utils/base/integral_types.h"
+#include "utils/model-bundle.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+using mobile::lang_id::LangId;
+using mobile::lang_id::LangIdResult;
+
+// Larger frames are refused, and their connection closed.
+constexpr uint32 kMaxFrameBytes = 16 << 20;
+
+struct Flags {
+  std::string socket;
+  std::string annotator_model;
+  std::string actions_model;
+  std::string lang_id_model;
+  std::string model_image;
+  int threads = std::thread::hardware_concurrency();
+  int max_batch_size = 32;
+  int max_batch_delay_us = 500;
+  std::string locales = "en";
+  std::string reference_timezone = "UTC";
+};
+
+bool ParseFlags(int argc, char** argv, Flags* flags) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const size_t equals = arg.find('=');
+    const std::string name = arg.substr(0, equals);
+    const std::string value =
+        equals == std::string::npos ? "" : arg.substr(equals + 1);
+    if (name == "--socket") {
+      flags->socket = value;
+    } else if (name == "--annotator_model") {
+      flags->annotator_model = value;
+    } else if (name == "--actions_model") {
+      flags->actions_model = value;
+    } else if (name == "--lang_id_model") {
+      flags->lang_id_model = value;
+    } else if (name == "--model_image") {
+      flags->model_image = value;
+    } else if (name == "--threads") {
+      flags->threads = atoi(value.c_str());
+    } else if (name == "--max_batch_size") {
+      flags->max_batch_size = atoi(value.c_str());
+    } else if (name == "--max_batch_delay_us") {
+      flags->max_batch_delay_us = atoi(value.c_str());
+    } else if (name == "--locales") {
+      flags->locales = value;
+    } else if (name == "--reference_timezone") {
+      flags->reference_timezone = value;
+    } else {
+      fprintf(stderr, "Unknown flag: %s\n", arg.c_str());
+      return false;
+    }
+  }
+  if (flags->socket.empty()) {
+    fprintf(stderr, "--socket is required.\n");
+    return false;
+  }
+  if (flags->annotator_model.empty() && flags->actions_model.empty() &&
+      flags->lang_id_model.empty() && flags->model_image.empty()) {
+    fprintf(stderr, "At least one model is required.\n");
+    return false;
+  }
+  if (flags->threads < 1 || flags->max_batch_size < 1 ||
+      flags->max_batch_delay_us < 0) {
+    fprintf(stderr,
+            "--threads and --max_batch_size must be positive, "
+            "--max_batch_delay_us non-negative.\n");
+    return false;
+  }
+  return true;
+}
+
+// The methods the workers run, by their index in the metrics.
+enum Method {
+  kAnnotate = 0,
+  kSuggestActions = 1,
+  kDetectLanguage = 2,
+};
+
+const std::vector<std::string>& MethodNames() {
+  static const std::vector<std::string>* const kMethodNames =
+      new std::vector<std::string>{"annotate", "suggest_actions",
+                                   "detect_language"};
+  return *kMethodNames;
+}
+
+// The models, shared by all the workers.
+struct Models {
+  std::unique_ptr<ModelBundle> bundle;
+  std::unique_ptr<Annotator> annotator;
+  std::unique_ptr<ActionsSuggestions> actions;
+  std::unique_ptr<LangId> lang_id;
+};
+
+bool LoadModels(const Flags& flags, Models* models) {
+  if (!flags.model_image.empty()) {
+    models->bundle = ModelBundle::FromPath(flags.model_image);
+    if (models->bundle == nullptr) {
+      fprintf(stderr, "Couldn't load the model image %s.\n",
+              flags.model_image.c_str());
+      return false;
+    }
+    const StringPiece annotator_model =
+        models->bundle->GetSection(kAnnotatorBundleSection);
+    if (!annotator_model.empty()) {
+      models->annotator = Annotator::FromUnownedBuffer(
+          annotator_model.data(), annotator_model.size(), /*unilib=*/nullptr,
+          /*calendarlib=*/nullptr, /*load_locales=*/flags.locales);
+    }
+    const StringPiece actions_model =
+        models->bundle->GetSection(kActionsBundleSection);
+    if (!actions_model.empty()) {
+      models->actions = ActionsSuggestions::FromUnownedBuffer(
+          reinterpret_cast<const uint8_t*>(actions_model.data()),
+          actions_model.size());
+    }
+    const StringPiece lang_id_model =
+        models->bundle->GetSection(kLangIdBundleSection);
+    if (!lang_id_model.empty()) {
+      models->lang_id = mobile::lang_id::GetLangIdFromFlatbufferBytes(
+          lang_id_model.data(), lang_id_model.size());
+    }
+    if ((!annotator_model.empty() && models->annotator == nullptr) ||
+        (!actions_model.empty() && models->actions == nullptr) ||
+        (!lang_id_model.empty() &&
+         (models->lang_id == nullptr || !models->lang_id->is_valid()))) {
+      fprintf(stderr, "Couldn't load the models of the image %s.\n",
+              flags.model_image.c_str());
+      return false;
+    }
+  }
+  if (!flags.annotator_model.empty()) {
+    models->annotator =
+        Annotator::FromPath(flags.annotator_model, /*unilib=*/nullptr,
+                            /*calendarlib=*/nullptr,
+                            /*load_locales=*/flags.locales);
+    if (models->annotator == nullptr) {
+      fprintf(stderr, "Couldn't load the annotator model %s.\n",
+              flags.annotator_model.c_str());
+      return false;
+    }
+  }
+  if (!flags.actions_model.empty()) {
+    models->actions = ActionsSuggestions::FromPath(flags.actions_model);
+    if (models->actions == nullptr) {
+      fprintf(stderr, "Couldn't load the actions model %s.\n",
+              flags.actions_model.c_str());
+      return false;
+    }
+  }
+  if (!flags.lang_id_model.empty()) {
+    models->lang_id =
+        mobile::lang_id::GetLangIdFromFlatbufferFile(flags.lang_id_model);
+    if (models->lang_id == nullptr || !models->lang_id->is_valid()) {
+      fprintf(stderr, "Couldn't load the LangId model %s.\n",
+              flags.lang_id_model.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ReadFully(int fd, char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t num_read = read(fd, data, size);
+    if (num_read < 0 && errno == EINTR) {
+      continue;
+    }
+    if (num_read <= 0) {
+      return false;
+    }
+    data += num_read;
+    size -= num_read;
+  }
+  return true;
+}
+
+bool WriteFully(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    const ssize_t num_written = write(fd, data, size);
+    if (num_written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (num_written <= 0) {
+      return false;
+    }
+    data += num_written;
+    size -= num_written;
+  }
+  return true;
+}
+
+// A client connection. The responses are written by the workers, from
+// several threads. The socket is closed with the last reference, i.e. once
+// the client is gone and all its requests are answered.
+class Connection {
+ public:
+  explicit Connection(int fd) : fd_(fd) {}
+  ~Connection() { close(fd_); }
+
+  // Reads the fields of the next frame. Returns false when the client closes
+  // the connection or sends an invalid frame.
+  bool ReadFrame(std::vector<std::string>* fields) {
+    uint32 size;
+    if (!ReadFully(fd_, reinterpret_cast<char*>(&size), sizeof(size))) {
+      return false;
+    }
+    size = ntohl(size);
+    if (size > kMaxFrameBytes) {
+      fprintf(stderr, "Frame of %u bytes refused.\n", size);
+      return false;
+    }
+    std::string frame(size, '\0');
+    if (!ReadFully(fd_, &frame[0], size)) {
+      return false;
+    }
+    fields->clear();
+    size_t start = 0;
+    while (true) {
+      const size_t end = frame.find('\0', start);
+      fields->push_back(frame.substr(start, end - start));
+      if (end == std::string::npos) {
+        return true;
+      }
+      start = end + 1;
+    }
+  }
+
+  void WriteResponse(const std::string& id, const std::string& status,
+                     const std::string& result) {
+    std::string frame(sizeof(uint32), '\0');
+    frame += id;
+    frame.push_back('\0');
+    frame += status;
+    frame.push_back('\0');
+    frame += result;
+    const uint32 size = htonl(frame.size() - sizeof(uint32));
+    memcpy(&frame[0], &size, sizeof(size));
+
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    // A client that is gone no longer cares about its responses.
+    WriteFully(fd_, frame.data(), frame.size());
+  }
+
+ private:
+  const int fd_;
+  std::mutex write_mutex_;
+};
+
+struct Request {
+  std::shared_ptr<Connection> connection;
+  std::string id;
+  std::vector<std::string> arguments;
+  std::chrono::steady_clock::time_point arrival_time;
+};
+
+int64 MicrosSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+class Server {
+ public:
+  Server(const Flags& flags, const Models* models)
+      : flags_(flags),
+        models_(models),
+        queue_(flags.threads, flags.max_batch_size,
+               std::chrono::microseconds(flags.max_batch_delay_us)),
+        metrics_(MethodNames()) {}
+
+  // Starts the workers, one per core.
+  void StartWorkers() {
+    for (int worker = 0; worker < flags_.threads; ++worker) {
+      workers_.emplace_back(&Server::WorkerLoop, this, worker);
+#if defined(__linux__)
+      // Pins the worker to its core, so that it keeps its caches warm.
+      const int num_cores = std::thread::hardware_concurrency();
+      if (num_cores > 0) {
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(worker % num_cores, &cpu_set);
+        pthread_setaffinity_np(workers_.back().native_handle(),
+                               sizeof(cpu_set), &cpu_set);
+      }
+#endif
+    }
+  }
+
+  // Reads the requests of the connection until the client is gone.
+  void ServeConnection(std::shared_ptr<Connection> connection) {
+    std::vector<std::string> fields;
+    while (connection->ReadFrame(&fields)) {
+      if (fields.size() < 2) {
+        connection->WriteResponse(fields[0], "error", "No method.");
+        continue;
+      }
+      Request request{connection, fields[0],
+                      std::vector<std::string>(fields.begin() + 2,
+                                               fields.end()),
+                      std::chrono::steady_clock::now()};
+      const std::string& method = fields[1];
+      if (method == "stats") {
+        connection->WriteResponse(request.id, "ok", metrics_.ToString());
+      } else if (method == "annotate") {
+        const bool valid_arguments = request.arguments.size() == 1;
+        Enqueue(kAnnotate, models_->annotator != nullptr, valid_arguments,
+                std::move(request));
+      } else if (method == "suggest_actions") {
+        const bool valid_arguments = !request.arguments.empty();
+        Enqueue(kSuggestActions, models_->actions != nullptr,
+                valid_arguments, std::move(request));
+      } else if (method == "detect_language") {
+        const bool valid_arguments = request.arguments.size() == 1;
+        Enqueue(kDetectLanguage, models_->lang_id != nullptr, valid_arguments,
+                std::move(request));
+      } else {
+        connection->WriteResponse(request.id, "error",
+                                  "Unknown method: " + method);
+      }
+    }
+  }
+
+ private:
+  void Enqueue(Method method, bool has_model, bool valid_arguments,
+               Request request) {
+    if (!has_model) {
+      metrics_.RecordError(method);
+      request.connection->WriteResponse(
+          request.id, "error", "No model for " + MethodNames()[method]);
+    } else if (!valid_arguments) {
+      metrics_.RecordError(method);
+      request.connection->WriteResponse(
+          request.id, "error",
+          "Wrong number of arguments for " + MethodNames()[method]);
+    } else {
+      queue_.Push(method, std::move(request));
+    }
+  }
+
+  void WorkerLoop(int worker) {
+    int method;
+    std::vector<Request> batch;
+    std::vector<std::string> results;
+    while (queue_.PopBatch(worker, &method, &batch)) {
+      const auto start = std::chrono::steady_clock::now();
+      results.clear();
+      switch (method) {
+        case kAnnotate:
+          Annotate(batch, &results);
+          break;
+        case kSuggestActions:
+          SuggestActions(batch, &results);
+          break;
+        case kDetectLanguage:
+          DetectLanguage(batch, &results);
+          break;
+      }
+      const int64 batch_latency_us = MicrosSince(start);
+
+      std::vector<int64> request_latencies_us;
+      for (int i = 0; i < batch.size(); ++i) {
+        if (i < results.size()) {
+          batch[i].connection->WriteResponse(batch[i].id, "ok", results[i]);
+        } else {
+          batch[i].connection->WriteResponse(batch[i].id, "error",
+                                             "No result.");
+        }
+        request_latencies_us.push_back(MicrosSince(batch[i].arrival_time));
+      }
+      metrics_.RecordBatch(method, batch_latency_us, request_latencies_us);
+    }
+  }
+
+  void Annotate(const std::vector<Request>& batch,
+                std::vector<std::string>* results) const {
+    std::vector<std::string> texts;
+    for (const Request& request : batch) {
+      texts.push_back(request.arguments[0]);
+    }
+    AnnotationOptions options;
+    options.locales = flags_.locales;
+    options.reference_timezone = flags_.reference_timezone;
+    const std::vector<std::vector<AnnotatedSpan>> annotations =
+        models_->annotator->AnnotateBatch(texts, options);
+    for (const std::vector<AnnotatedSpan>& text_annotations : annotations) {
+      std::string result;
+      for (const AnnotatedSpan& annotation : text_annotations) {
+        if (annotation.classification.empty()) {
+          continue;
+        }
+        result += std::to_string(annotation.span.first) + " " +
+                  std::to_string(annotation.span.second) + " " +
+                  annotation.classification[0].collection + " " +
+                  std::to_string(annotation.classification[0].score) + "\n";
+      }
+      results->push_back(result);
+    }
+  }
+
+  void SuggestActions(const std::vector<Request>& batch,
+                      std::vector<std::string>* results) const {
+    std::vector<Conversation> conversations;
+    for (const Request& request : batch) {
+      Conversation conversation;
+      const std::vector<std::string>& messages = request.arguments;
+      for (int i = 0; i < messages.size(); ++i) {
+        ConversationMessage message;
+        // The last message is from the remote user.
+        message.user_id = (messages.size() - 1 - i) % 2 == 0 ? 1 : 0;
+        message.text = messages[i];
+        message.reference_timezone = flags_.reference_timezone;
+        message.detected_text_language_tags = flags_.locales;
+        conversation.messages.push_back(message);
+      }
+      conversations.push_back(conversation);
+    }
+    const std::vector<ActionsSuggestionsResponse> responses =
+        models_->actions->SuggestActionsBatch(conversations,
+                                              models_->annotator.get());
+    for (const ActionsSuggestionsResponse& response : responses) {
+      std::string result;
+      for (const ActionSuggestion& action : response.actions) {
+        result += action.type + " " + std::to_string(action.score) + " " +
+                  action.response_text + "\n";
+      }
+      results->push_back(result);
+    }
+  }
+
+  void DetectLanguage(const std::vector<Request>& batch,
+                      std::vector<std::string>* results) const {
+    std::vector<mobile::StringPiece> texts;
+    for (const Request& request : batch) {
+      texts.emplace_back(request.arguments[0].data(),
+                         request.arguments[0].size());
+    }
+    std::vector<LangIdResult> lang_id_results;
+    models_->lang_id->FindLanguagesBatch(texts, &lang_id_results);
+    for (const LangIdResult& lang_id_result : lang_id_results) {
+      std::string result;
+      for (const auto& prediction : lang_id_result.predictions) {
+        result += prediction.first + " " + std::to_string(prediction.second) +
+                  "\n";
+      }
+      results->push_back(result);
+    }
+  }
+
+  const Flags& flags_;
+  const Models* const models_;
+  BatchingQueue<Request> queue_;
+  ServerMetrics metrics_;
+  std::vector<std::thread> workers_;
+};
+
+int Main(int argc, char** argv) {
+  Flags flags;
+  if (!ParseFlags(argc, argv, &flags)) {
+    return 1;
+  }
+  Models models;
+  if (!LoadModels(flags, &models)) {
+    return 1;
+  }
+
+  const int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (flags.socket.size() >= sizeof(address.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", flags.socket.c_str());
+    return 1;
+  }
+  strncpy(address.sun_path, flags.socket.c_str(), sizeof(address.sun_path));
+  unlink(flags.socket.c_str());
+  if (listen_fd < 0 ||
+      bind(listen_fd, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(listen_fd, SOMAXCONN) != 0) {
+    fprintf(stderr, "Couldn't listen on %s: %s\n", flags.socket.c_str(),
+            strerror(errno));
+    return 1;
+  }
+  // Writes to clients that are gone fail instead of killing the server.
+  signal(SIGPIPE, SIG_IGN);
+
+  Server server(flags, &models);
+  server.StartWorkers();
+  fprintf(stderr, "Serving on %s with %d workers.\n", flags.socket.c_str(),
+          flags.threads);
+  while (true) {
+    const int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno != EINTR) {
+        fprintf(stderr, "accept failed: %s\n", strerror(errno));
+      }
+      continue;
+    }
+    std::shared_ptr<Connection> connection(new Connection(fd));
+    std::thread([&server, connection]() {
+      server.ServeConnection(connection);
+    }).detach();
+  }
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
+
+int main(int argc, char** argv) {
+  return libtextclassifier3::Main(argc, argv);
+}
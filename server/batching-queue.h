@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Queues of the server's worker threads, which take the requests in batches.
+
+#ifndef LIBTEXTCLASSIFIER_SERVER_BATCHING_QUEUE_H_
+#define LIBTEXTCLASSIFIER_SERVER_BATCHING_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <utility>
+#include <vector>
+
+#include "utils/base/integral_types.h"
+
+namespace libtextclassifier3 {
+
+// One queue per worker thread. Pushed items go to the queues in turn, and
+// each worker takes batches of items of the same kind from the front of its
+// own queue, which can then be run through the batch APIs of the engines.
+//
+// A batch is taken once it is full, or once its oldest item has waited
+// max_batch_delay: under load the batches fill up, and when idle an item
+// waits at most max_batch_delay for others to join it. A worker whose queue
+// has no batch ready steals the ready batches of the other queues, so that
+// one slow batch doesn't hold up the items queued behind it.
+//
+// The class is thread-safe.
+template <typename Item>
+class BatchingQueue {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  BatchingQueue(int num_workers, int max_batch_size,
+                std::chrono::microseconds max_batch_delay)
+      : queues_(num_workers),
+        max_batch_size_(max_batch_size),
+        max_batch_delay_(max_batch_delay) {
+    for (std::unique_ptr<WorkerQueue>& queue : queues_) {
+      queue.reset(new WorkerQueue);
+    }
+  }
+
+  BatchingQueue(const BatchingQueue&) = delete;
+  BatchingQueue& operator=(const BatchingQueue&) = delete;
+
+  // Adds an item of the given kind.
+  void Push(int kind, Item item) {
+    WorkerQueue* queue = queues_[next_queue_++ % queues_.size()].get();
+    {
+      std::lock_guard<std::mutex> lock(queue->mutex);
+      queue->entries.push_back({kind, Clock::now(), std::move(item)});
+    }
+    {
+      std::lock_guard<std::mutex> lock(wakeup_mutex_);
+      ++generation_;
+    }
+    wakeup_.notify_all();
+  }
+
+  // Blocks until a batch is ready for the worker and moves it to 'batch',
+  // with the kind of its items in 'kind'. Returns false once the queue is
+  // stopped and empty.
+  bool PopBatch(int worker, int* kind, std::vector<Item>* batch) {
+    while (true) {
+      int64 generation;
+      bool stopping;
+      {
+        std::lock_guard<std::mutex> lock(wakeup_mutex_);
+        generation = generation_;
+        stopping = stopping_;
+      }
+
+      // The own queue first, then the others in turn.
+      Clock::time_point next_deadline = Clock::time_point::max();
+      bool empty = true;
+      for (int i = 0; i < queues_.size(); ++i) {
+        WorkerQueue* queue = queues_[(worker + i) % queues_.size()].get();
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        if (queue->entries.empty()) {
+          continue;
+        }
+        empty = false;
+        const Clock::time_point deadline = ReadyTime(*queue);
+        if (deadline <= Clock::now() || stopping) {
+          TakeBatch(queue, kind, batch);
+          return true;
+        }
+        next_deadline = std::min(next_deadline, deadline);
+      }
+      if (empty && stopping) {
+        return false;
+      }
+
+      // Waits for new items, or for the first batch to be ready.
+      std::unique_lock<std::mutex> lock(wakeup_mutex_);
+      const auto woken = [this, generation]() {
+        return generation_ != generation || stopping_;
+      };
+      if (next_deadline == Clock::time_point::max()) {
+        wakeup_.wait(lock, woken);
+      } else {
+        wakeup_.wait_until(lock, next_deadline, woken);
+      }
+    }
+  }
+
+  // Makes the workers take the remaining items without waiting for their
+  // batches to fill up, and PopBatch return false once they are all taken.
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lock(wakeup_mutex_);
+      stopping_ = true;
+    }
+    wakeup_.notify_all();
+  }
+
+ private:
+  struct Entry {
+    int kind;
+    Clock::time_point enqueue_time;
+    Item item;
+  };
+
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<Entry> entries;
+  };
+
+  // Returns when the batch of the front item of the queue is ready: now if
+  // it's full, otherwise when the front item has waited long enough.
+  Clock::time_point ReadyTime(const WorkerQueue& queue) const {
+    const Entry& front = queue.entries.front();
+    int num_items = 0;
+    for (const Entry& entry : queue.entries) {
+      if (entry.kind == front.kind && ++num_items == max_batch_size_) {
+        return Clock::time_point::min();
+      }
+    }
+    return front.enqueue_time + max_batch_delay_;
+  }
+
+  // Moves the front item of the queue and the next ones of the same kind,
+  // up to a full batch, to 'batch'.
+  void TakeBatch(WorkerQueue* queue, int* kind,
+                 std::vector<Item>* batch) const {
+    *kind = queue->entries.front().kind;
+    batch->clear();
+    std::deque<Entry> remaining;
+    for (Entry& entry : queue->entries) {
+      if (entry.kind == *kind && batch->size() < max_batch_size_) {
+        batch->push_back(std::move(entry.item));
+      } else {
+        remaining.push_back(std::move(entry));
+      }
+    }
+    queue->entries.swap(remaining);
+  }
+
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+  std::atomic<uint32> next_queue_{0};
+  const int max_batch_size_;
+  const std::chrono::microseconds max_batch_delay_;
+
+  // Wakes the waiting workers up when items are pushed or on Stop().
+  std::mutex wakeup_mutex_;
+  std::condition_variable wakeup_;
+  int64 generation_ = 0;
+  bool stopping_ = false;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_SERVER_BATCHING_QUEUE_H_
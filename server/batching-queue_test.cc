@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "server/batching-queue.h"
+
+#include <atomic>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+using testing::ElementsAre;
+
+constexpr std::chrono::microseconds kNoDelay(0);
+constexpr std::chrono::microseconds kLongDelay(std::chrono::hours(1));
+
+TEST(BatchingQueueTest, BatchesItemsOfTheSameKind) {
+  BatchingQueue<int> queue(/*num_workers=*/1, /*max_batch_size=*/3, kNoDelay);
+  queue.Push(/*kind=*/0, 1);
+  queue.Push(/*kind=*/1, 2);
+  queue.Push(/*kind=*/0, 3);
+  queue.Push(/*kind=*/0, 4);
+  queue.Push(/*kind=*/0, 5);
+
+  int kind;
+  std::vector<int> batch;
+  ASSERT_TRUE(queue.PopBatch(/*worker=*/0, &kind, &batch));
+  EXPECT_EQ(kind, 0);
+  EXPECT_THAT(batch, ElementsAre(1, 3, 4));
+  ASSERT_TRUE(queue.PopBatch(/*worker=*/0, &kind, &batch));
+  EXPECT_EQ(kind, 1);
+  EXPECT_THAT(batch, ElementsAre(2));
+  ASSERT_TRUE(queue.PopBatch(/*worker=*/0, &kind, &batch));
+  EXPECT_EQ(kind, 0);
+  EXPECT_THAT(batch, ElementsAre(5));
+}
+
+TEST(BatchingQueueTest, TakesFullBatchesWithoutWaiting) {
+  BatchingQueue<int> queue(/*num_workers=*/1, /*max_batch_size=*/2,
+                           kLongDelay);
+  queue.Push(/*kind=*/0, 1);
+  queue.Push(/*kind=*/0, 2);
+
+  int kind;
+  std::vector<int> batch;
+  ASSERT_TRUE(queue.PopBatch(/*worker=*/0, &kind, &batch));
+  EXPECT_THAT(batch, ElementsAre(1, 2));
+}
+
+TEST(BatchingQueueTest, WaitsForBatchesToFillUp) {
+  BatchingQueue<int> queue(/*num_workers=*/1, /*max_batch_size=*/2,
+                           kLongDelay);
+  queue.Push(/*kind=*/0, 1);
+  std::thread pusher([&queue]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    queue.Push(/*kind=*/0, 2);
+  });
+
+  int kind;
+  std::vector<int> batch;
+  ASSERT_TRUE(queue.PopBatch(/*worker=*/0, &kind, &batch));
+  EXPECT_THAT(batch, ElementsAre(1, 2));
+  pusher.join();
+}
+
+TEST(BatchingQueueTest, StealsFromOtherWorkers) {
+  BatchingQueue<int> queue(/*num_workers=*/2, /*max_batch_size=*/4, kNoDelay);
+  // The items go to the queues in turn, i.e. to both workers.
+  queue.Push(/*kind=*/0, 1);
+  queue.Push(/*kind=*/0, 2);
+
+  int kind;
+  std::vector<int> first_batch;
+  std::vector<int> second_batch;
+  ASSERT_TRUE(queue.PopBatch(/*worker=*/1, &kind, &first_batch));
+  ASSERT_TRUE(queue.PopBatch(/*worker=*/1, &kind, &second_batch));
+  EXPECT_EQ(first_batch.size() + second_batch.size(), 2);
+}
+
+TEST(BatchingQueueTest, DrainsOnStop) {
+  BatchingQueue<int> queue(/*num_workers=*/1, /*max_batch_size=*/2,
+                           kLongDelay);
+  queue.Push(/*kind=*/0, 1);
+  queue.Stop();
+
+  int kind;
+  std::vector<int> batch;
+  ASSERT_TRUE(queue.PopBatch(/*worker=*/0, &kind, &batch));
+  EXPECT_THAT(batch, ElementsAre(1));
+  EXPECT_FALSE(queue.PopBatch(/*worker=*/0, &kind, &batch));
+}
+
+TEST(BatchingQueueTest, RunsEveryItemOnceOnManyWorkers) {
+  constexpr int kNumWorkers = 4;
+  constexpr int kNumItems = 10000;
+  BatchingQueue<int> queue(kNumWorkers, /*max_batch_size=*/8,
+                           std::chrono::microseconds(100));
+  std::vector<std::atomic<int>> num_runs(kNumItems);
+  std::vector<std::thread> workers;
+  for (int worker = 0; worker < kNumWorkers; ++worker) {
+    workers.emplace_back([&queue, &num_runs, worker]() {
+      int kind;
+      std::vector<int> batch;
+      while (queue.PopBatch(worker, &kind, &batch)) {
+        for (const int item : batch) {
+          ++num_runs[item];
+        }
+      }
+    });
+  }
+  for (int i = 0; i < kNumItems; ++i) {
+    queue.Push(/*kind=*/i % 3, i);
+  }
+  queue.Stop();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  for (int i = 0; i < kNumItems; ++i) {
+    EXPECT_EQ(num_runs[i], 1) << i;
+  }
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
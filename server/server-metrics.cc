@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "server/server-metrics.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace libtextclassifier3 {
+namespace {
+
+constexpr int kBucketsPerDoubling = 4;
+constexpr int kNumBuckets = 30 * kBucketsPerDoubling;
+
+int64 BucketUpperBound(int bucket) {
+  return std::llround(std::exp2(static_cast<double>(bucket) /
+                                kBucketsPerDoubling));
+}
+
+}  // namespace
+
+LatencyHistogram::LatencyHistogram() : buckets_(kNumBuckets) {}
+
+void LatencyHistogram::Record(int64 latency_us) {
+  int bucket = 0;
+  if (latency_us > 1) {
+    bucket = std::min<int>(
+        kNumBuckets - 1,
+        std::ceil(std::log2(static_cast<double>(latency_us)) *
+                  kBucketsPerDoubling));
+  }
+  ++buckets_[bucket];
+  ++count_;
+}
+
+int64 LatencyHistogram::Percentile(double percent) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  const int64 rank =
+      std::max<int64>(1, std::ceil(count_ * percent / 100.0));
+  int64 num_below = 0;
+  for (int bucket = 0; bucket < kNumBuckets; ++bucket) {
+    num_below += buckets_[bucket];
+    if (num_below >= rank) {
+      return BucketUpperBound(bucket);
+    }
+  }
+  return BucketUpperBound(kNumBuckets - 1);
+}
+
+ServerMetrics::ServerMetrics(const std::vector<std::string>& method_names)
+    : method_names_(method_names),
+      start_time_(std::chrono::steady_clock::now()),
+      methods_(method_names.size()) {}
+
+void ServerMetrics::RecordBatch(
+    int method, int64 batch_latency_us,
+    const std::vector<int64>& request_latencies_us) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  MethodMetrics& metrics = methods_[method];
+  ++metrics.num_batches;
+  metrics.batch_latency.Record(batch_latency_us);
+  metrics.num_requests += request_latencies_us.size();
+  for (const int64 latency_us : request_latencies_us) {
+    metrics.request_latency.Record(latency_us);
+  }
+}
+
+void ServerMetrics::RecordError(int method) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++methods_[method].num_errors;
+}
+
+std::string ServerMetrics::ToString() const {
+  const double uptime_s =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                    start_time_)
+          .count();
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string result;
+  char line[512];
+  snprintf(line, sizeof(line), "uptime_s %.1f\n", uptime_s);
+  result += line;
+  for (int i = 0; i < methods_.size(); ++i) {
+    const MethodMetrics& metrics = methods_[i];
+    snprintf(line, sizeof(line),
+             "%s requests %lld errors %lld requests_per_s %.1f "
+             "mean_batch_size %.2f latency_us p50 %lld p90 %lld p99 %lld "
+             "batch_latency_us p50 %lld p99 %lld\n",
+             method_names_[i].c_str(),
+             static_cast<long long>(metrics.num_requests),
+             static_cast<long long>(metrics.num_errors),
+             uptime_s > 0 ? metrics.num_requests / uptime_s : 0.0,
+             metrics.num_batches > 0
+                 ? static_cast<double>(metrics.num_requests) /
+                       metrics.num_batches
+                 : 0.0,
+             static_cast<long long>(metrics.request_latency.Percentile(50)),
+             static_cast<long long>(metrics.request_latency.Percentile(90)),
+             static_cast<long long>(metrics.request_latency.Percentile(99)),
+             static_cast<long long>(metrics.batch_latency.Percentile(50)),
+             static_cast<long long>(metrics.batch_latency.Percentile(99)));
+    result += line;
+  }
+  return result;
+}
+
+}  // namespace libtextclassifier3
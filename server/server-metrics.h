@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Latency and throughput figures of the server, per method.
+
+#ifndef LIBTEXTCLASSIFIER_SERVER_SERVER_METRICS_H_
+#define LIBTEXTCLASSIFIER_SERVER_SERVER_METRICS_H_
+
+#include <chrono>  // NOLINT
+#include <mutex>  // NOLINT
+#include <string>
+#include <vector>
+
+#include "utils/base/integral_types.h"
+
+namespace libtextclassifier3 {
+
+// Histogram of latencies in buckets growing by a factor of 2^(1/4), from 1us
+// to about 1000s, so that the percentiles are within 19% of the exact ones
+// whatever the number of recorded latencies.
+//
+// Not thread-safe.
+class LatencyHistogram {
+ public:
+  LatencyHistogram();
+
+  void Record(int64 latency_us);
+
+  int64 count() const { return count_; }
+
+  // Returns the latency below which the given percent of the recorded
+  // latencies are, as the upper bound of its bucket, or 0 if none was
+  // recorded.
+  int64 Percentile(double percent) const;
+
+ private:
+  std::vector<int64> buckets_;
+  int64 count_ = 0;
+};
+
+// The figures of a server method.
+struct MethodMetrics {
+  // The requests that were run, and the ones that were refused.
+  int64 num_requests = 0;
+  int64 num_errors = 0;
+  int64 num_batches = 0;
+
+  // From the arrival of the request to its response, and of its batch in the
+  // engine.
+  LatencyHistogram request_latency;
+  LatencyHistogram batch_latency;
+};
+
+// The figures of all the methods of the server.
+//
+// The class is thread-safe.
+class ServerMetrics {
+ public:
+  explicit ServerMetrics(const std::vector<std::string>& method_names);
+
+  // Records a batch of the method: the time it took in the engine, and the
+  // latency of each of its requests.
+  void RecordBatch(int method, int64 batch_latency_us,
+                   const std::vector<int64>& request_latencies_us);
+
+  // Records a request of the method that was refused, e.g. for its arguments.
+  void RecordError(int method);
+
+  // Returns the figures as text, a line per method with the requests per
+  // second since the creation, the mean batch size, and the percentiles of
+  // the latencies.
+  std::string ToString() const;
+
+ private:
+  const std::vector<std::string> method_names_;
+  const std::chrono::steady_clock::time_point start_time_;
+
+  mutable std::mutex mutex_;
+  std::vector<MethodMetrics> methods_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_SERVER_SERVER_METRICS_H_
@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "server/server-metrics.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+using testing::HasSubstr;
+
+TEST(LatencyHistogramTest, ReturnsPercentilesWithinABucket) {
+  LatencyHistogram histogram;
+  for (int latency_us = 1; latency_us <= 1000; ++latency_us) {
+    histogram.Record(latency_us);
+  }
+  EXPECT_EQ(histogram.count(), 1000);
+  for (const int percent : {50, 90, 99}) {
+    const int64 exact_us = percent * 10;
+    EXPECT_GE(histogram.Percentile(percent), exact_us);
+    EXPECT_LE(histogram.Percentile(percent), exact_us * 1.19 + 1);
+  }
+}
+
+TEST(LatencyHistogramTest, ReturnsZeroWhenEmpty) {
+  EXPECT_EQ(LatencyHistogram().Percentile(50), 0);
+}
+
+TEST(ServerMetricsTest, FormatsFiguresPerMethod) {
+  ServerMetrics metrics({"annotate", "detect_language"});
+  metrics.RecordBatch(/*method=*/1, /*batch_latency_us=*/100,
+                      /*request_latencies_us=*/{150, 200, 250});
+  metrics.RecordError(/*method=*/1);
+  const std::string text = metrics.ToString();
+  EXPECT_THAT(text, HasSubstr("annotate requests 0 errors 0"));
+  EXPECT_THAT(text, HasSubstr("detect_language requests 3 errors 1"));
+  EXPECT_THAT(text, HasSubstr("mean_batch_size 3.00"));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -17,6 +17,7 @@
 #include "utils/base/logging.h"
 
 #include <stdlib.h>
+#include <chrono>  // NOLINT
 #include <exception>
 #include <iostream>
 
@@ -63,5 +64,20 @@ LogMessage::~LogMessage() {
   }
 }
 
+bool LogSite::ShouldLogEveryNSec(double seconds) {
+  count_.fetch_add(1, std::memory_order_relaxed);
+  const int64 now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                           std::chrono::steady_clock::now().time_since_epoch())
+                           .count();
+  int64 next_log_time_us = next_log_time_us_.load(std::memory_order_relaxed);
+  if (now_us < next_log_time_us) {
+    return false;
+  }
+  // Of the threads that reach the site at the same time, only one logs.
+  return next_log_time_us_.compare_exchange_strong(
+      next_log_time_us, now_us + static_cast<int64>(seconds * 1e6),
+      std::memory_order_relaxed);
+}
+
 }  // namespace logging
 }  // namespace libtextclassifier3
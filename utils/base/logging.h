@@ -17,9 +17,11 @@
 #ifndef LIBTEXTCLASSIFIER_UTILS_BASE_LOGGING_H_
 #define LIBTEXTCLASSIFIER_UTILS_BASE_LOGGING_H_
 
+#include <atomic>
 #include <cassert>
 #include <string>
 
+#include "utils/base/integral_types.h"
 #include "utils/base/logging_levels.h"
 #include "utils/base/port.h"
 
@@ -91,6 +93,56 @@ class LogMessage {
   LoggingStringStream stream_;
 };
 
+// Returns whether the messages of the severity are logged at all. The logging
+// macros check it before they build the message, so that a disabled severity
+// costs a branch rather than the formatting of a message which is then
+// dropped.
+inline bool IsLogSeverityEnabled(LogSeverity severity) {
+#if defined(__ANDROID__) && !defined(TC3_DEBUG_LOGGING)
+  return severity <= ERROR;
+#else
+  return true;
+#endif
+}
+
+// Turns the logging statements into void expressions, so that the macros can
+// skip them with ?:. operator& binds more loosely than operator<< and more
+// tightly than ?:.
+struct LogMessageVoidify {
+  void operator&(const LoggingStringStream &) {}
+};
+
+// Per call site state of the rate-limited logging macros: the number of times
+// the site was reached, and when it may log next. Each site has its own
+// instance as a function-local static, which is constant-initialized.
+// The class is thread-safe.
+class LogSite {
+ public:
+  constexpr LogSite() {}
+
+  // Counts a call, and returns whether it's one of the first n ones.
+  bool ShouldLogFirstN(int n) {
+    return count_.fetch_add(1, std::memory_order_relaxed) < n;
+  }
+
+  // Counts a call, and returns whether it's the first one or an n-th one
+  // after it.
+  bool ShouldLogEveryN(int n) {
+    return count_.fetch_add(1, std::memory_order_relaxed) % n == 0;
+  }
+
+  // Counts a call, and returns whether the site didn't log in the last
+  // 'seconds'.
+  bool ShouldLogEveryNSec(double seconds);
+
+  // Number of times the site was reached, logged or not.
+  int64 count() const { return count_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<int64> count_{0};
+  std::atomic<int64> next_log_time_us_{0};
+};
+
 // Pseudo-stream that "eats" the tokens <<-pumped into it, without printing
 // anything.
 class NullStream {
@@ -106,19 +158,55 @@ inline NullStream &operator<<(NullStream &str, const T &) {
 }  // namespace logging
 }  // namespace libtextclassifier3
 
-#define TC3_LOG(severity)                                          \
+#define TC3_LOG_MESSAGE_(severity)                                 \
   ::libtextclassifier3::logging::LogMessage(                       \
       ::libtextclassifier3::logging::severity, __FILE__, __LINE__) \
       .stream()
 
+// Logs the message if the condition holds. Neither the condition nor the
+// message are evaluated if the severity is disabled.
+#define TC3_LOG_IF(severity, condition)                                     \
+  !(::libtextclassifier3::logging::IsLogSeverityEnabled(                    \
+        ::libtextclassifier3::logging::severity) &&                         \
+    (condition))                                                            \
+      ? (void)0                                                             \
+      : ::libtextclassifier3::logging::LogMessageVoidify() &                \
+            TC3_LOG_MESSAGE_(severity)
+
+#define TC3_LOG(severity) TC3_LOG_IF(severity, true)
+
+// The state of the call site of a rate-limited logging macro.
+#define TC3_LOG_SITE_()                                                     \
+  ([]() -> ::libtextclassifier3::logging::LogSite & {                       \
+    static ::libtextclassifier3::logging::LogSite site;                     \
+    return site;                                                            \
+  }())
+
+// Rate-limited logging, for the failures that can happen per match or per
+// token on bad inputs or models, so that they don't flood the log:
+//
+// TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Couldn't extract YEAR.";
+//
+// Only logs the first n times the site is reached.
+#define TC3_LOG_FIRST_N(severity, n) \
+  TC3_LOG_IF(severity, TC3_LOG_SITE_().ShouldLogFirstN(n))
+
+// Logs the first time and then one time in n.
+#define TC3_LOG_EVERY_N(severity, n) \
+  TC3_LOG_IF(severity, TC3_LOG_SITE_().ShouldLogEveryN(n))
+
+// Logs at most once every 'seconds'.
+#define TC3_LOG_EVERY_N_SEC(severity, seconds) \
+  TC3_LOG_IF(severity, TC3_LOG_SITE_().ShouldLogEveryNSec(seconds))
+
 // If condition x is true, does nothing.  Otherwise, crashes the program (liek
 // LOG(FATAL)) with an informative message.  Can be continued with extra
 // messages, via <<, like any logging macro, e.g.,
 //
 // TC3_CHECK(my_cond) << "I think we hit a problem";
-#define TC3_CHECK(x)                                                           \
-  (x) || TC3_LOG(FATAL) << __FILE__ << ":" << __LINE__ << ": check failed: \"" \
-                        << #x << "\" "
+#define TC3_CHECK(x)                                                \
+  (x) || TC3_LOG_MESSAGE_(FATAL) << __FILE__ << ":" << __LINE__     \
+                                 << ": check failed: \"" << #x << "\" "
 
 #define TC3_CHECK_EQ(x, y) TC3_CHECK((x) == (y))
 #define TC3_CHECK_LT(x, y) TC3_CHECK((x) < (y))
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/base/logging.h"
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+// Counts the messages that are built.
+int num_formatted = 0;
+
+const char* Formatted() {
+  ++num_formatted;
+  return "message";
+}
+
+TEST(LoggingTest, LogIfOnlyBuildsTheMessageIfTheConditionHolds) {
+  num_formatted = 0;
+  TC3_LOG_IF(ERROR, false) << Formatted();
+  EXPECT_EQ(num_formatted, 0);
+  TC3_LOG_IF(ERROR, true) << Formatted();
+  EXPECT_EQ(num_formatted, 1);
+}
+
+TEST(LoggingTest, LogEveryNBuildsOneMessageInN) {
+  num_formatted = 0;
+  for (int i = 0; i < 10; ++i) {
+    TC3_LOG_EVERY_N(ERROR, 4) << Formatted();
+  }
+  // The 1st, 5th and 9th calls.
+  EXPECT_EQ(num_formatted, 3);
+}
+
+TEST(LoggingTest, LogFirstNBuildsTheFirstNMessages) {
+  num_formatted = 0;
+  for (int i = 0; i < 10; ++i) {
+    TC3_LOG_FIRST_N(ERROR, 2) << Formatted();
+  }
+  EXPECT_EQ(num_formatted, 2);
+}
+
+TEST(LoggingTest, LogEveryNSecBuildsOneMessagePerPeriod) {
+  num_formatted = 0;
+  for (int i = 0; i < 10; ++i) {
+    TC3_LOG_EVERY_N_SEC(ERROR, 3600) << Formatted();
+  }
+  EXPECT_EQ(num_formatted, 1);
+}
+
+TEST(LoggingTest, SitesAreIndependent) {
+  num_formatted = 0;
+  for (int i = 0; i < 2; ++i) {
+    TC3_LOG_FIRST_N(ERROR, 1) << Formatted();
+    TC3_LOG_FIRST_N(ERROR, 1) << Formatted();
+  }
+  EXPECT_EQ(num_formatted, 2);
+}
+
+TEST(LoggingTest, LogSiteCountsAllCalls) {
+  logging::LogSite site;
+  EXPECT_TRUE(site.ShouldLogEveryNSec(3600));
+  EXPECT_FALSE(site.ShouldLogEveryNSec(3600));
+  EXPECT_TRUE(site.ShouldLogFirstN(3));
+  EXPECT_EQ(site.count(), 3);
+}
+
+TEST(LoggingTest, LogIsAnExpressionStatement) {
+  num_formatted = 0;
+  // Must not take the else branch of the if.
+  if (num_formatted == 0)
+    TC3_LOG(INFO) << Formatted();
+  else
+    ADD_FAILURE();
+  EXPECT_EQ(num_formatted, 1);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/base/tracing.h"
+
+#include <atomic>
+
+// NOTE: as for the logging, this file contains two implementations: one for
+// Android builds with tracing, which need libandroid, one for all other cases.
+#if defined(__ANDROID__) && defined(TC3_ENABLE_TRACING)
+#define TC3_TRACING_ATRACE
+#include <android/trace.h>
+#endif
+
+namespace libtextclassifier3 {
+namespace tracing {
+
+namespace {
+std::atomic<TraceSink *> trace_sink(nullptr);
+}  // namespace
+
+void SetTraceSink(TraceSink *sink) {
+  trace_sink.store(sink, std::memory_order_release);
+}
+
+#if defined(TC3_TRACING_ATRACE)
+
+void BeginSection(const char *name) { ATrace_beginSection(name); }
+
+void EndSection() { ATrace_endSection(); }
+
+#else  // if defined(TC3_TRACING_ATRACE)
+
+void BeginSection(const char *name) {
+  TraceSink *sink = trace_sink.load(std::memory_order_acquire);
+  if (sink != nullptr) {
+    sink->BeginSection(name);
+  }
+}
+
+void EndSection() {
+  TraceSink *sink = trace_sink.load(std::memory_order_acquire);
+  if (sink != nullptr) {
+    sink->EndSection();
+  }
+}
+
+#endif  // if defined(TC3_TRACING_ATRACE)
+
+}  // namespace tracing
+}  // namespace libtextclassifier3
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Trace sections, to see the work of the library in system traces.
+//
+//   TC3_TRACE_SCOPE("Annotate");
+//
+// marks the rest of the enclosing scope as a section of the trace. The
+// sections are compiled out unless the library is built with
+// -DTC3_ENABLE_TRACING. On Android they are then written with ATrace (the
+// library needs to link libandroid), elsewhere they are passed to the sink set
+// with SetTraceSink, if any.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_BASE_TRACING_H_
+#define LIBTEXTCLASSIFIER_UTILS_BASE_TRACING_H_
+
+#include "utils/base/macros.h"
+
+namespace libtextclassifier3 {
+namespace tracing {
+
+// Receives the trace sections outside of Android. The sections of a thread
+// nest, so the section ended is the last one begun on the thread. Called from
+// any thread.
+class TraceSink {
+ public:
+  virtual ~TraceSink() {}
+
+  virtual void BeginSection(const char *name) = 0;
+  virtual void EndSection() = 0;
+};
+
+// Sets the sink of the trace sections, or removes it if nullptr. Not owned,
+// must outlive the calls of the library that run while it's set.
+void SetTraceSink(TraceSink *sink);
+
+// Low-level tracing primitives, see TC3_TRACE_SCOPE.
+void BeginSection(const char *name);
+void EndSection();
+
+class ScopedTraceSection {
+ public:
+  explicit ScopedTraceSection(const char *name) { BeginSection(name); }
+  ~ScopedTraceSection() { EndSection(); }
+
+ private:
+  TC3_DISALLOW_COPY_AND_ASSIGN(ScopedTraceSection);
+};
+
+}  // namespace tracing
+}  // namespace libtextclassifier3
+
+#define TC3_TRACE_CONCAT_INTERNAL(a, b) a##b
+#define TC3_TRACE_CONCAT(a, b) TC3_TRACE_CONCAT_INTERNAL(a, b)
+
+#if defined(TC3_ENABLE_TRACING)
+#define TC3_TRACE_SCOPE(name)                               \
+  ::libtextclassifier3::tracing::ScopedTraceSection         \
+  TC3_TRACE_CONCAT(tc3_trace_section_, __LINE__)(name)
+#else
+#define TC3_TRACE_SCOPE(name) \
+  do {                        \
+  } while (0)
+#endif  // TC3_ENABLE_TRACING
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_BASE_TRACING_H_
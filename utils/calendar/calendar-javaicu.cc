@@ -16,33 +16,13 @@
 
 #include "utils/calendar/calendar-javaicu.h"
 
-#include "annotator/types.h"
+#include "utils/base/logging.h"
+#include "utils/java/scoped_global_ref.h"
 #include "utils/java/scoped_local_ref.h"
 
 namespace libtextclassifier3 {
 namespace {
 
-// Generic version of icu::Calendar::add with error checking.
-bool CalendarAdd(JniCache* jni_cache, JNIEnv* jenv, jobject calendar,
-                 jint field, jint value) {
-  jenv->CallVoidMethod(calendar, jni_cache->calendar_add, field, value);
-  return !jni_cache->ExceptionCheckAndClear();
-}
-
-// Generic version of icu::Calendar::get with error checking.
-bool CalendarGet(JniCache* jni_cache, JNIEnv* jenv, jobject calendar,
-                 jint field, jint* value) {
-  *value = jenv->CallIntMethod(calendar, jni_cache->calendar_get, field);
-  return !jni_cache->ExceptionCheckAndClear();
-}
-
-// Generic version of icu::Calendar::set with error checking.
-bool CalendarSet(JniCache* jni_cache, JNIEnv* jenv, jobject calendar,
-                 jint field, jint value) {
-  jenv->CallVoidMethod(calendar, jni_cache->calendar_set, field, value);
-  return !jni_cache->ExceptionCheckAndClear();
-}
-
 // Extracts the first tag from a BCP47 tag (e.g. "en" for "en-US").
 std::string GetFirstBcp47Tag(const std::string& tag) {
   for (size_t i = 0; i < tag.size(); ++i) {
@@ -53,102 +33,153 @@ std::string GetFirstBcp47Tag(const std::string& tag) {
   return tag;
 }
 
-}  // anonymous namespace
-
-Calendar::Calendar(JniCache* jni_cache)
-    : jni_cache_(jni_cache),
-      jenv_(jni_cache_ ? jni_cache->GetEnv() : nullptr) {}
+// Java's Calendar.SUNDAY.
+constexpr int kSunday = 1;
 
-bool Calendar::Initialize(const std::string& time_zone,
-                          const std::string& locale, int64 time_ms_utc) {
-  if (!jni_cache_ || !jenv_) {
-    TC3_LOG(ERROR) << "Initialize without env";
-    return false;
-  }
+}  // anonymous namespace
 
-  // We'll assume the day indices match later on, so verify it here.
-  if (jni_cache_->calendar_sunday !=
-          static_cast<int>(DateParseData::RelationType::SUNDAY) ||
-      jni_cache_->calendar_monday !=
-          static_cast<int>(DateParseData::RelationType::MONDAY) ||
-      jni_cache_->calendar_tuesday !=
-          static_cast<int>(DateParseData::RelationType::TUESDAY) ||
-      jni_cache_->calendar_wednesday !=
-          static_cast<int>(DateParseData::RelationType::WEDNESDAY) ||
-      jni_cache_->calendar_thursday !=
-          static_cast<int>(DateParseData::RelationType::THURSDAY) ||
-      jni_cache_->calendar_friday !=
-          static_cast<int>(DateParseData::RelationType::FRIDAY) ||
-      jni_cache_->calendar_saturday !=
-          static_cast<int>(DateParseData::RelationType::SATURDAY)) {
-    TC3_LOG(ERROR) << "day of the week indices mismatch";
-    return false;
-  }
+constexpr int JavaCalendarContext::kMaxCachedEntries;
 
-  // Get the time zone.
-  ScopedLocalRef<jstring> java_time_zone_str(
-      jenv_->NewStringUTF(time_zone.c_str()));
-  ScopedLocalRef<jobject> java_time_zone(jenv_->CallStaticObjectMethod(
+jobject JavaCalendarContext::NewJavaTimeZone(JNIEnv* jenv,
+                                             const std::string& id) const {
+  ScopedLocalRef<jstring> java_time_zone_str(jenv->NewStringUTF(id.c_str()));
+  jobject java_time_zone = jenv->CallStaticObjectMethod(
       jni_cache_->timezone_class.get(), jni_cache_->timezone_get_timezone,
-      java_time_zone_str.get()));
+      java_time_zone_str.get());
   if (jni_cache_->ExceptionCheckAndClear() || !java_time_zone) {
     TC3_LOG(ERROR) << "failed to get timezone";
-    return false;
+    return nullptr;
   }
+  return java_time_zone;
+}
 
-  // Get the locale.
-  ScopedLocalRef<jobject> java_locale;
+jobject JavaCalendarContext::NewJavaLocale(JNIEnv* jenv,
+                                           const std::string& locale) const {
+  jobject java_locale;
   if (jni_cache_->locale_for_language_tag) {
     // API level 21+, we can actually parse language tags.
-    ScopedLocalRef<jstring> java_locale_str(
-        jenv_->NewStringUTF(locale.c_str()));
-    java_locale.reset(jenv_->CallStaticObjectMethod(
+    ScopedLocalRef<jstring> java_locale_str(jenv->NewStringUTF(locale.c_str()));
+    java_locale = jenv->CallStaticObjectMethod(
         jni_cache_->locale_class.get(), jni_cache_->locale_for_language_tag,
-        java_locale_str.get()));
+        java_locale_str.get());
   } else {
     // API level <21. We can't parse tags, so we just use the language.
     ScopedLocalRef<jstring> java_language_str(
-        jenv_->NewStringUTF(GetFirstBcp47Tag(locale).c_str()));
-    java_locale.reset(jenv_->NewObject(jni_cache_->locale_class.get(),
-                                       jni_cache_->locale_init_string,
-                                       java_language_str.get()));
+        jenv->NewStringUTF(GetFirstBcp47Tag(locale).c_str()));
+    java_locale = jenv->NewObject(jni_cache_->locale_class.get(),
+                                  jni_cache_->locale_init_string,
+                                  java_language_str.get());
   }
   if (jni_cache_->ExceptionCheckAndClear() || !java_locale) {
     TC3_LOG(ERROR) << "failed to get locale";
-    return false;
+    return nullptr;
   }
+  return java_locale;
+}
 
-  // Get the calendar.
-  calendar_.reset(jenv_->CallStaticObjectMethod(
-      jni_cache_->calendar_class.get(), jni_cache_->calendar_get_instance,
-      java_time_zone.get(), java_locale.get()));
-  if (jni_cache_->ExceptionCheckAndClear() || !calendar_) {
-    TC3_LOG(ERROR) << "failed to get calendar";
-    return false;
+std::shared_ptr<const ZoneOffsetSource> JavaCalendarContext::GetZone(
+    const std::string& id) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = zones_.find(id);
+    if (it != zones_.end()) {
+      return it->second;
+    }
   }
 
-  // Set the time.
-  jenv_->CallVoidMethod(calendar_.get(),
-                        jni_cache_->calendar_set_time_in_millis, time_ms_utc);
-  if (jni_cache_->ExceptionCheckAndClear()) {
-    TC3_LOG(ERROR) << "failed to set time";
-    return false;
+  JNIEnv* jenv = jni_cache_->GetEnv();
+  if (!jenv) {
+    TC3_LOG(ERROR) << "GetZone without env";
+    return nullptr;
+  }
+  ScopedLocalRef<jobject> java_time_zone(NewJavaTimeZone(jenv, id), jenv);
+  if (!java_time_zone) {
+    return nullptr;
   }
-  return true;
-}
 
-bool Calendar::GetFirstDayOfWeek(int* value) const {
-  if (!jni_cache_ || !jenv_ || !calendar_) return false;
-  *value = jenv_->CallIntMethod(calendar_.get(),
-                                jni_cache_->calendar_get_first_day_of_week);
-  return !jni_cache_->ExceptionCheckAndClear();
+  // The zone is used from whatever thread interprets the next datetime, so
+  // keep a global reference and look up the env on each call.
+  std::shared_ptr<ScopedGlobalRef<jobject>> global_time_zone(
+      new ScopedGlobalRef<jobject>(
+          MakeGlobalRef(java_time_zone.release(), jenv, jni_cache_->jvm)));
+  if (!*global_time_zone) {
+    TC3_LOG(ERROR) << "failed to keep timezone";
+    return nullptr;
+  }
+  JniCache* jni_cache = jni_cache_;
+  std::shared_ptr<const CachedZoneOffsets> zone(new CachedZoneOffsets(
+      [jni_cache, global_time_zone](int64 time_ms_utc) {
+        ZoneOffsets offsets;
+        JNIEnv* jenv = jni_cache->GetEnv();
+        if (!jenv) {
+          return offsets;
+        }
+        const int total_offset_ms =
+            jenv->CallIntMethod(global_time_zone->get(),
+                                jni_cache->timezone_get_offset, time_ms_utc);
+        if (jni_cache->ExceptionCheckAndClear()) {
+          return offsets;
+        }
+
+        // Java only tells the current raw offset, attribute the rest to
+        // daylight time.
+        offsets.raw_offset_ms = jenv->CallIntMethod(
+            global_time_zone->get(), jni_cache->timezone_get_raw_offset);
+        if (jni_cache->ExceptionCheckAndClear()) {
+          offsets.raw_offset_ms = total_offset_ms;
+        }
+        offsets.dst_offset_ms = total_offset_ms - offsets.raw_offset_ms;
+        return offsets;
+      }));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (zones_.size() >= kMaxCachedEntries) {
+    zones_.clear();
+  }
+  return zones_.emplace(id, std::move(zone)).first->second;
 }
 
-bool Calendar::GetTimeInMillis(int64* value) const {
-  if (!jni_cache_ || !jenv_ || !calendar_) return false;
-  *value = jenv_->CallLongMethod(calendar_.get(),
-                                 jni_cache_->calendar_get_time_in_millis);
-  return !jni_cache_->ExceptionCheckAndClear();
+int JavaCalendarContext::GetFirstDayOfWeek(const std::string& locale) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = first_days_of_week_.find(locale);
+    if (it != first_days_of_week_.end()) {
+      return it->second;
+    }
+  }
+
+  JNIEnv* jenv = jni_cache_->GetEnv();
+  if (!jenv) {
+    TC3_LOG(ERROR) << "GetFirstDayOfWeek without env";
+    return kSunday;
+  }
+  ScopedLocalRef<jobject> java_time_zone(NewJavaTimeZone(jenv, "UTC"), jenv);
+  ScopedLocalRef<jobject> java_locale(NewJavaLocale(jenv, locale), jenv);
+  if (!java_time_zone || !java_locale) {
+    return kSunday;
+  }
+  ScopedLocalRef<jobject> calendar(
+      jenv->CallStaticObjectMethod(
+          jni_cache_->calendar_class.get(), jni_cache_->calendar_get_instance,
+          java_time_zone.get(), java_locale.get()),
+      jenv);
+  if (jni_cache_->ExceptionCheckAndClear() || !calendar) {
+    TC3_LOG(ERROR) << "failed to get calendar";
+    return kSunday;
+  }
+  const int first_day_of_week = jenv->CallIntMethod(
+      calendar.get(), jni_cache_->calendar_get_first_day_of_week);
+  if (jni_cache_->ExceptionCheckAndClear()) {
+    TC3_LOG(ERROR) << "failed to get first day of week";
+    return kSunday;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (first_days_of_week_.size() >= kMaxCachedEntries) {
+    first_days_of_week_.clear();
+  }
+  first_days_of_week_[locale] = first_day_of_week;
+  return first_day_of_week;
 }
 
 CalendarLib::CalendarLib() {
@@ -156,45 +187,8 @@ CalendarLib::CalendarLib() {
 }
 
 CalendarLib::CalendarLib(const std::shared_ptr<JniCache>& jni_cache)
-    : jni_cache_(jni_cache) {}
-
-// Below is the boilerplate code for implementing the specialisations of
-// get/set/add for the various field types.
-#define TC3_DEFINE_FIELD_ACCESSOR(NAME, FIELD, KIND, TYPE)      \
-  bool Calendar::KIND##NAME(TYPE value) const {                 \
-    if (!jni_cache_ || !jenv_ || !calendar_) return false;      \
-    return Calendar##KIND(jni_cache_, jenv_, calendar_.get(),   \
-                          jni_cache_->calendar_##FIELD, value); \
-  }
-#define TC3_DEFINE_ADD(NAME, CONST) \
-  TC3_DEFINE_FIELD_ACCESSOR(NAME, CONST, Add, int)
-#define TC3_DEFINE_SET(NAME, CONST) \
-  TC3_DEFINE_FIELD_ACCESSOR(NAME, CONST, Set, int)
-#define TC3_DEFINE_GET(NAME, CONST) \
-  TC3_DEFINE_FIELD_ACCESSOR(NAME, CONST, Get, int*)
-
-TC3_DEFINE_ADD(Second, second)
-TC3_DEFINE_ADD(Minute, minute)
-TC3_DEFINE_ADD(HourOfDay, hour_of_day)
-TC3_DEFINE_ADD(DayOfMonth, day_of_month)
-TC3_DEFINE_ADD(Year, year)
-TC3_DEFINE_ADD(Month, month)
-TC3_DEFINE_GET(DayOfWeek, day_of_week)
-TC3_DEFINE_SET(ZoneOffset, zone_offset)
-TC3_DEFINE_SET(DstOffset, dst_offset)
-TC3_DEFINE_SET(Year, year)
-TC3_DEFINE_SET(Month, month)
-TC3_DEFINE_SET(DayOfYear, day_of_year)
-TC3_DEFINE_SET(DayOfMonth, day_of_month)
-TC3_DEFINE_SET(DayOfWeek, day_of_week)
-TC3_DEFINE_SET(HourOfDay, hour_of_day)
-TC3_DEFINE_SET(Minute, minute)
-TC3_DEFINE_SET(Second, second)
-TC3_DEFINE_SET(Millisecond, millisecond)
-
-#undef TC3_DEFINE_FIELD_ACCESSOR
-#undef TC3_DEFINE_ADD
-#undef TC3_DEFINE_SET
-#undef TC3_DEFINE_GET
+    : jni_cache_(jni_cache),
+      context_(jni_cache_ ? new JavaCalendarContext(jni_cache_.get())
+                          : nullptr) {}
 
 }  // namespace libtextclassifier3
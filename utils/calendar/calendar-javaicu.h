@@ -19,46 +19,47 @@
 
 #include <jni.h>
 #include <memory>
+#include <mutex>  // NOLINT
 #include <string>
+#include <unordered_map>
 
 #include "annotator/types.h"
 #include "utils/base/integral_types.h"
 #include "utils/calendar/calendar-common.h"
+#include "utils/calendar/civil-calendar.h"
+#include "utils/calendar/zone-offset-cache.h"
 #include "utils/java/jni-cache.h"
-#include "utils/java/scoped_local_ref.h"
 
 namespace libtextclassifier3 {
 
-class Calendar {
+// Looks up zones and first days of the week through java.util, and remembers
+// them. Only the zone offsets come from Java (cached by day), the calendar
+// arithmetic is done by CivilCalendar.
+// The class is thread-safe.
+class JavaCalendarContext : public CivilCalendar::Context {
  public:
-  explicit Calendar(JniCache* jni_cache);
-  bool Initialize(const std::string& time_zone, const std::string& locale,
-                  int64 time_ms_utc);
-  bool AddSecond(int value) const;
-  bool AddMinute(int value) const;
-  bool AddHourOfDay(int value) const;
-  bool AddDayOfMonth(int value) const;
-  bool AddYear(int value) const;
-  bool AddMonth(int value) const;
-  bool GetDayOfWeek(int* value) const;
-  bool GetFirstDayOfWeek(int* value) const;
-  bool GetTimeInMillis(int64* value) const;
-  bool SetZoneOffset(int value) const;
-  bool SetDstOffset(int value) const;
-  bool SetYear(int value) const;
-  bool SetMonth(int value) const;
-  bool SetDayOfYear(int value) const;
-  bool SetDayOfMonth(int value) const;
-  bool SetDayOfWeek(int value) const;
-  bool SetHourOfDay(int value) const;
-  bool SetMinute(int value) const;
-  bool SetSecond(int value) const;
-  bool SetMillisecond(int value) const;
+  static constexpr int kMaxCachedEntries = 64;
+
+  // Does not take ownership of the cache, which needs to outlive the context.
+  explicit JavaCalendarContext(JniCache* jni_cache) : jni_cache_(jni_cache) {}
+
+  std::shared_ptr<const ZoneOffsetSource> GetZone(
+      const std::string& id) override;
+  int GetFirstDayOfWeek(const std::string& locale) override;
 
  private:
-  JniCache* jni_cache_;
-  JNIEnv* jenv_;
-  ScopedLocalRef<jobject> calendar_;
+  // Returns a new java.util.TimeZone, or nullptr if it couldn't be created.
+  jobject NewJavaTimeZone(JNIEnv* jenv, const std::string& id) const;
+
+  // Returns a new java.util.Locale, or nullptr if it couldn't be created.
+  jobject NewJavaLocale(JNIEnv* jenv, const std::string& locale) const;
+
+  JniCache* const jni_cache_;
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<const CachedZoneOffsets>>
+      zones_;
+  std::unordered_map<std::string, int> first_days_of_week_;
 };
 
 class CalendarLib {
@@ -66,14 +67,16 @@ class CalendarLib {
   CalendarLib();
   explicit CalendarLib(const std::shared_ptr<JniCache>& jni_cache);
 
-  // Returns false (dummy version).
   bool InterpretParseData(const DateParseData& parse_data,
                           int64 reference_time_ms_utc,
                           const std::string& reference_timezone,
                           const std::string& reference_locale,
                           int64* interpreted_time_ms_utc,
                           DatetimeGranularity* granularity) const {
-    Calendar calendar(jni_cache_.get());
+    if (context_ == nullptr) {
+      return false;
+    }
+    CivilCalendar calendar(context_.get());
     if (!impl_.InterpretParseData(parse_data, reference_time_ms_utc,
                                   reference_timezone, reference_locale,
                                   &calendar, granularity)) {
@@ -88,7 +91,8 @@ class CalendarLib {
 
  private:
   std::shared_ptr<JniCache> jni_cache_;
-  calendar::CalendarLibTempl<Calendar> impl_;
+  std::unique_ptr<JavaCalendarContext> context_;
+  calendar::CalendarLibTempl<CivilCalendar> impl_;
 };
 
 }  // namespace libtextclassifier3
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/calendar/calendar-native.h"
+
+#include <algorithm>
+
+#include "utils/i18n/locale.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+constexpr int kSunday = 1;
+constexpr int kMonday = 2;
+constexpr int kFriday = 6;
+constexpr int kSaturday = 7;
+
+// Regions whose week doesn't start on Monday, from CLDR.
+constexpr const char* kSundayFirstRegions[] = {
+    "AG", "AS", "BD", "BR", "BS", "BT", "BW", "BZ", "CA", "CN", "CO", "DM",
+    "DO", "ET", "GT", "GU", "HK", "HN", "ID", "IL", "IN", "JM", "JP", "KE",
+    "KH", "KR", "LA", "MH", "MM", "MO", "MT", "MX", "MZ", "NI", "NP", "PA",
+    "PE", "PH", "PK", "PR", "PT", "PY", "SA", "SG", "SV", "TH", "TT", "TW",
+    "UM", "US", "VE", "VI", "WS", "YE", "ZA", "ZW"};
+constexpr const char* kSaturdayFirstRegions[] = {
+    "AE", "AF", "BH", "DJ", "DZ", "EG", "IQ", "IR",
+    "JO", "KW", "LY", "OM", "QA", "SD", "SY"};
+
+// Most likely region of languages given without one, where it matters.
+constexpr const char* kLikelyRegions[][2] = {
+    {"ar", "EG"}, {"bn", "BD"}, {"en", "US"}, {"fa", "IR"}, {"he", "IL"},
+    {"hi", "IN"}, {"id", "ID"}, {"in", "ID"}, {"iw", "IL"}, {"ja", "JP"},
+    {"ko", "KR"}, {"pt", "BR"}, {"th", "TH"}, {"ur", "PK"}, {"zh", "CN"}};
+
+template <int N>
+bool Contains(const char* const (&regions)[N], const std::string& region) {
+  return std::find(std::begin(regions), std::end(regions), region) !=
+         std::end(regions);
+}
+
+int FirstDayOfWeekInLocale(const std::string& locale_tag) {
+  const Locale locale = Locale::FromBCP47(locale_tag);
+  std::string region = locale.Region();
+  if (region.empty()) {
+    for (const auto& likely_region : kLikelyRegions) {
+      if (locale.Language() == likely_region[0]) {
+        region = likely_region[1];
+        break;
+      }
+    }
+  }
+  if (Contains(kSundayFirstRegions, region)) {
+    return kSunday;
+  }
+  if (Contains(kSaturdayFirstRegions, region)) {
+    return kSaturday;
+  }
+  if (region == "MV") {
+    return kFriday;
+  }
+  return kMonday;
+}
+
+}  // namespace
+
+std::shared_ptr<const ZoneOffsetSource> NativeCalendarContext::GetZone(
+    const std::string& id) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = zones_.find(id);
+    if (it != zones_.end()) {
+      return it->second;
+    }
+  }
+
+  // Load outside of the lock, this reads a file.
+  std::shared_ptr<const TimeZone> zone = TimeZone::Load(id, zoneinfo_dir_);
+  if (zone == nullptr) {
+    zone = TimeZone::Fixed(0);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  return zones_.emplace(id, std::move(zone)).first->second;
+}
+
+int NativeCalendarContext::GetFirstDayOfWeek(const std::string& locale) {
+  return FirstDayOfWeekInLocale(locale);
+}
+
+}  // namespace libtextclassifier3
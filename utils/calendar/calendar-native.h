@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Calendar backend in plain C++, for builds without Java
+// (-DTC3_CALENDAR_NATIVE). Time zones are read from the tz database.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_CALENDAR_CALENDAR_NATIVE_H_
+#define LIBTEXTCLASSIFIER_UTILS_CALENDAR_CALENDAR_NATIVE_H_
+
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+
+#include "annotator/types.h"
+#include "utils/base/integral_types.h"
+#include "utils/calendar/calendar-common.h"
+#include "utils/calendar/civil-calendar.h"
+#include "utils/calendar/time-zone.h"
+
+namespace libtextclassifier3 {
+
+// Loads zones from a tz database, and knows the first days of the week of
+// locales from CLDR. Shared by the calendars of a CalendarLib.
+// The class is thread-safe.
+class NativeCalendarContext : public CivilCalendar::Context {
+ public:
+  explicit NativeCalendarContext(const std::string& zoneinfo_dir)
+      : zoneinfo_dir_(zoneinfo_dir) {}
+
+  std::shared_ptr<const ZoneOffsetSource> GetZone(
+      const std::string& id) override;
+  int GetFirstDayOfWeek(const std::string& locale) override;
+
+ private:
+  const std::string zoneinfo_dir_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, std::shared_ptr<const TimeZone>> zones_;
+};
+
+class CalendarLib {
+ public:
+  explicit CalendarLib(const std::string& zoneinfo_dir = kDefaultZoneInfoDir)
+      : context_(new NativeCalendarContext(zoneinfo_dir)) {}
+
+  bool InterpretParseData(const DateParseData& parse_data,
+                          int64 reference_time_ms_utc,
+                          const std::string& reference_timezone,
+                          const std::string& reference_locale,
+                          int64* interpreted_time_ms_utc,
+                          DatetimeGranularity* granularity) const {
+    CivilCalendar calendar(context_.get());
+    if (!impl_.InterpretParseData(parse_data, reference_time_ms_utc,
+                                  reference_timezone, reference_locale,
+                                  &calendar, granularity)) {
+      return false;
+    }
+    return calendar.GetTimeInMillis(interpreted_time_ms_utc);
+  }
+
+  DatetimeGranularity GetGranularity(const DateParseData& data) const {
+    return impl_.GetGranularity(data);
+  }
+
+ private:
+  std::unique_ptr<NativeCalendarContext> context_;
+  calendar::CalendarLibTempl<CivilCalendar> impl_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_CALENDAR_CALENDAR_NATIVE_H_
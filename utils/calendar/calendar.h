@@ -17,7 +17,12 @@
 #ifndef LIBTEXTCLASSIFIER_UTILS_CALENDAR_CALENDAR_H_
 #define LIBTEXTCLASSIFIER_UTILS_CALENDAR_CALENDAR_H_
 
+#if defined TC3_CALENDAR_NATIVE
+#include "utils/calendar/calendar-native.h"
+#define INIT_CALENDARLIB_FOR_TESTING(VAR) VAR()
+#else
 #include "utils/calendar/calendar-javaicu.h"
 #define INIT_CALENDARLIB_FOR_TESTING(VAR) VAR(nullptr)
+#endif
 
 #endif  // LIBTEXTCLASSIFIER_UTILS_CALENDAR_CALENDAR_H_
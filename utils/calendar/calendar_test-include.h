@@ -23,6 +23,9 @@
 #if defined TC3_CALENDAR_ICU
 #include "utils/calendar/calendar-icu.h"
 #define TC3_TESTING_CREATE_CALENDARLIB_INSTANCE(VAR) VAR()
+#elif defined TC3_CALENDAR_NATIVE
+#include "utils/calendar/calendar-native.h"
+#define TC3_TESTING_CREATE_CALENDARLIB_INSTANCE(VAR) VAR()
 #elif defined TC3_CALENDAR_JAVAICU
 #include <jni.h>
 extern JNIEnv* g_jenv;
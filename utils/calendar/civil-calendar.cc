@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/calendar/civil-calendar.h"
+
+#include <algorithm>
+
+#include "utils/base/logging.h"
+#include "utils/calendar/civil-time.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+using civil_time::FloorDiv;
+using civil_time::FloorMod;
+using civil_time::kMillisPerDay;
+using civil_time::kMillisPerHour;
+using civil_time::kMillisPerMinute;
+using civil_time::kMillisPerSecond;
+
+constexpr int kSunday = 1;
+
+}  // namespace
+
+bool CivilCalendar::Initialize(const std::string& time_zone,
+                               const std::string& locale, int64 time_ms_utc) {
+  zone_ = context_->GetZone(time_zone);
+  if (zone_ == nullptr) {
+    TC3_LOG(ERROR) << "Could not get time zone: " << time_zone;
+    return false;
+  }
+  first_day_of_week_ = context_->GetFirstDayOfWeek(locale);
+  time_ms_utc_ = time_ms_utc;
+  has_zone_offset_ = false;
+  has_dst_offset_ = false;
+  ComputeFields();
+  return true;
+}
+
+int64 CivilCalendar::FieldDays() const {
+  const int64 year = year_ + FloorDiv(month_, 12);
+  const int month = FloorMod(month_, 12) + 1;
+  return civil_time::DaysFromCivil(year, month, 1) + day_of_month_ - 1;
+}
+
+void CivilCalendar::ComputeTime() {
+  if (!is_time_stale_) {
+    return;
+  }
+  const int64 local_time_ms = FieldDays() * kMillisPerDay +
+                              hour_of_day_ * kMillisPerHour +
+                              minute_ * kMillisPerMinute +
+                              second_ * kMillisPerSecond + millisecond_;
+  if (!has_zone_offset_ && !has_dst_offset_) {
+    time_ms_utc_ = zone_->LocalToUtc(local_time_ms);
+  } else {
+    // Like Java, an offset that wasn't set explicitly comes from the zone.
+    ZoneOffsets offsets = zone_->GetOffsets(zone_->LocalToUtc(local_time_ms));
+    if (has_zone_offset_) {
+      offsets.raw_offset_ms = zone_offset_ms_;
+    }
+    if (has_dst_offset_) {
+      offsets.dst_offset_ms = dst_offset_ms_;
+    }
+    time_ms_utc_ = local_time_ms - offsets.total_ms();
+    has_zone_offset_ = false;
+    has_dst_offset_ = false;
+  }
+  ComputeFields();
+}
+
+void CivilCalendar::ComputeFields() {
+  const int64 local_time_ms =
+      time_ms_utc_ + zone_->GetOffsets(time_ms_utc_).total_ms();
+  const int64 days = FloorDiv(local_time_ms, kMillisPerDay);
+  int64 time_of_day_ms = local_time_ms - days * kMillisPerDay;
+
+  int month, day;
+  civil_time::CivilFromDays(days, &year_, &month, &day);
+  month_ = month - 1;
+  day_of_month_ = day;
+  hour_of_day_ = time_of_day_ms / kMillisPerHour;
+  time_of_day_ms %= kMillisPerHour;
+  minute_ = time_of_day_ms / kMillisPerMinute;
+  time_of_day_ms %= kMillisPerMinute;
+  second_ = time_of_day_ms / kMillisPerSecond;
+  millisecond_ = time_of_day_ms % kMillisPerSecond;
+  is_time_stale_ = false;
+}
+
+bool CivilCalendar::AddSecond(int value) {
+  ComputeTime();
+  time_ms_utc_ += value * kMillisPerSecond;
+  ComputeFields();
+  return true;
+}
+
+bool CivilCalendar::AddMinute(int value) {
+  ComputeTime();
+  time_ms_utc_ += value * kMillisPerMinute;
+  ComputeFields();
+  return true;
+}
+
+bool CivilCalendar::AddHourOfDay(int value) {
+  ComputeTime();
+  time_ms_utc_ += value * kMillisPerHour;
+  ComputeFields();
+  return true;
+}
+
+bool CivilCalendar::AddDayOfMonth(int value) {
+  // Keeps the wall time, across daylight saving time changes too.
+  ComputeTime();
+  day_of_month_ += value;
+  is_time_stale_ = true;
+  ComputeTime();
+  return true;
+}
+
+bool CivilCalendar::AddMonth(int value) {
+  ComputeTime();
+  month_ += value;
+  year_ += FloorDiv(month_, 12);
+  month_ = FloorMod(month_, 12);
+
+  // Stay within the month, e.g. Jan 31st plus a month is Feb 28th.
+  day_of_month_ = std::min<int64>(
+      day_of_month_, civil_time::DaysInMonth(year_, month_ + 1));
+  is_time_stale_ = true;
+  ComputeTime();
+  return true;
+}
+
+bool CivilCalendar::AddYear(int value) {
+  ComputeTime();
+  year_ += value;
+  day_of_month_ = std::min<int64>(
+      day_of_month_, civil_time::DaysInMonth(year_, month_ + 1));
+  is_time_stale_ = true;
+  ComputeTime();
+  return true;
+}
+
+bool CivilCalendar::GetDayOfWeek(int* value) {
+  ComputeTime();
+  *value = civil_time::DayOfWeek(FieldDays()) + kSunday;
+  return true;
+}
+
+bool CivilCalendar::GetFirstDayOfWeek(int* value) const {
+  *value = first_day_of_week_;
+  return true;
+}
+
+bool CivilCalendar::GetTimeInMillis(int64* value) {
+  ComputeTime();
+  *value = time_ms_utc_;
+  return true;
+}
+
+bool CivilCalendar::SetZoneOffset(int value) {
+  has_zone_offset_ = true;
+  zone_offset_ms_ = value;
+  is_time_stale_ = true;
+  return true;
+}
+
+bool CivilCalendar::SetDstOffset(int value) {
+  has_dst_offset_ = true;
+  dst_offset_ms_ = value;
+  is_time_stale_ = true;
+  return true;
+}
+
+bool CivilCalendar::SetDayOfYear(int value) {
+  ComputeTime();
+  month_ = 0;
+  day_of_month_ = value;
+  is_time_stale_ = true;
+  return true;
+}
+
+bool CivilCalendar::SetDayOfWeek(int value) {
+  // Moves to the day within the current week, which starts on the first day
+  // of the week of the locale.
+  ComputeTime();
+  const int64 days = FieldDays();
+  const int day_of_week = civil_time::DayOfWeek(days) + kSunday;
+  const int64 week_start = days - FloorMod(day_of_week - first_day_of_week_, 7);
+  const int64 target = week_start + FloorMod(value - first_day_of_week_, 7);
+  int month, day;
+  civil_time::CivilFromDays(target, &year_, &month, &day);
+  month_ = month - 1;
+  day_of_month_ = day;
+  is_time_stale_ = true;
+  return true;
+}
+
+// Plain fields are only normalized when the instant is computed.
+#define TC3_DEFINE_SET(NAME, MEMBER)  \
+  bool CivilCalendar::Set##NAME(int value) { \
+    MEMBER = value;                     \
+    is_time_stale_ = true;              \
+    return true;                        \
+  }
+
+TC3_DEFINE_SET(Year, year_)
+TC3_DEFINE_SET(Month, month_)
+TC3_DEFINE_SET(DayOfMonth, day_of_month_)
+TC3_DEFINE_SET(HourOfDay, hour_of_day_)
+TC3_DEFINE_SET(Minute, minute_)
+TC3_DEFINE_SET(Second, second_)
+TC3_DEFINE_SET(Millisecond, millisecond_)
+
+#undef TC3_DEFINE_SET
+
+}  // namespace libtextclassifier3
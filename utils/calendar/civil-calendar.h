@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_CALENDAR_CIVIL_CALENDAR_H_
+#define LIBTEXTCLASSIFIER_UTILS_CALENDAR_CIVIL_CALENDAR_H_
+
+#include <memory>
+#include <string>
+
+#include "utils/base/integral_types.h"
+#include "utils/calendar/time-zone.h"
+
+namespace libtextclassifier3 {
+
+// Calendar for CalendarLibTempl doing the field arithmetic in C++, following
+// the semantics of java.util.GregorianCalendar as far as CalendarLibTempl
+// relies on them.
+//
+// Local date and time fields over an instant. Fields can be set out of their
+// ranges, they are normalized when the instant is computed from them.
+// Months are 0-11 and days of the week 1-7 starting with Sunday, as in Java.
+class CivilCalendar {
+ public:
+  // Resolves the zone and locale a calendar is initialized with.
+  class Context {
+   public:
+    virtual ~Context() = default;
+
+    // Returns the zone with the given id. Unknown ids give UTC, like
+    // java.util.TimeZone.getTimeZone() does with GMT. Returns nullptr if the
+    // zone couldn't be looked up at all.
+    virtual std::shared_ptr<const ZoneOffsetSource> GetZone(
+        const std::string& id) = 0;
+
+    // Returns the first day of the week in the locale, 1-7 starting with
+    // Sunday.
+    virtual int GetFirstDayOfWeek(const std::string& locale) = 0;
+  };
+
+  // Does not take ownership of the context, which needs to outlive the
+  // calendar.
+  explicit CivilCalendar(Context* context) : context_(context) {}
+
+  bool Initialize(const std::string& time_zone, const std::string& locale,
+                  int64 time_ms_utc);
+  bool AddSecond(int value);
+  bool AddMinute(int value);
+  bool AddHourOfDay(int value);
+  bool AddDayOfMonth(int value);
+  bool AddYear(int value);
+  bool AddMonth(int value);
+  bool GetDayOfWeek(int* value);
+  bool GetFirstDayOfWeek(int* value) const;
+  bool GetTimeInMillis(int64* value);
+  bool SetZoneOffset(int value);
+  bool SetDstOffset(int value);
+  bool SetYear(int value);
+  bool SetMonth(int value);
+  bool SetDayOfYear(int value);
+  bool SetDayOfMonth(int value);
+  bool SetDayOfWeek(int value);
+  bool SetHourOfDay(int value);
+  bool SetMinute(int value);
+  bool SetSecond(int value);
+  bool SetMillisecond(int value);
+
+ private:
+  // Computes the instant from the fields, if they were changed.
+  void ComputeTime();
+
+  // Computes the fields from the instant.
+  void ComputeFields();
+
+  // Days since the epoch of the date in the fields.
+  int64 FieldDays() const;
+
+  Context* const context_;
+  std::shared_ptr<const ZoneOffsetSource> zone_;
+  int first_day_of_week_ = 1;
+
+  int64 time_ms_utc_ = 0;
+  int64 year_ = 1970;
+  int64 month_ = 0;
+  int64 day_of_month_ = 1;
+  int64 hour_of_day_ = 0;
+  int64 minute_ = 0;
+  int64 second_ = 0;
+  int64 millisecond_ = 0;
+  bool is_time_stale_ = false;
+
+  // Offsets set explicitly, used instead of the ones of the zone the next time
+  // the instant is computed.
+  bool has_zone_offset_ = false;
+  int zone_offset_ms_ = 0;
+  bool has_dst_offset_ = false;
+  int dst_offset_ms_ = 0;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_CALENDAR_CIVIL_CALENDAR_H_
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Arithmetic on dates of the proleptic Gregorian calendar.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_CALENDAR_CIVIL_TIME_H_
+#define LIBTEXTCLASSIFIER_UTILS_CALENDAR_CIVIL_TIME_H_
+
+#include "utils/base/integral_types.h"
+
+namespace libtextclassifier3 {
+namespace civil_time {
+
+constexpr int64 kMillisPerSecond = 1000;
+constexpr int64 kMillisPerMinute = 60 * kMillisPerSecond;
+constexpr int64 kMillisPerHour = 60 * kMillisPerMinute;
+constexpr int64 kMillisPerDay = 24 * kMillisPerHour;
+constexpr int64 kSecondsPerDay = 24 * 60 * 60;
+
+// Division rounding towards negative infinity.
+inline int64 FloorDiv(int64 a, int64 b) {
+  return a / b - ((a % b != 0 && (a < 0) != (b < 0)) ? 1 : 0);
+}
+
+inline int64 FloorMod(int64 a, int64 b) { return a - FloorDiv(a, b) * b; }
+
+inline bool IsLeapYear(int64 year) {
+  return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+// Month is 1-12.
+inline int DaysInMonth(int64 year, int month) {
+  static constexpr int kDaysInMonth[] = {31, 28, 31, 30, 31, 30,
+                                         31, 31, 30, 31, 30, 31};
+  return (month == 2 && IsLeapYear(year)) ? 29 : kDaysInMonth[month - 1];
+}
+
+// Days since 1970-01-01 of the given date, month is 1-12 and day 1-31.
+inline int64 DaysFromCivil(int64 year, int month, int day) {
+  year -= month <= 2 ? 1 : 0;
+  const int64 era = FloorDiv(year, 400);
+  const int64 year_of_era = year - era * 400;
+  const int64 day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 +
+                            day - 1;
+  const int64 day_of_era = year_of_era * 365 + year_of_era / 4 -
+                           year_of_era / 100 + day_of_year;
+  return era * 146097 + day_of_era - 719468;
+}
+
+// Inverse of DaysFromCivil.
+inline void CivilFromDays(int64 days, int64* year, int* month, int* day) {
+  days += 719468;
+  const int64 era = FloorDiv(days, 146097);
+  const int64 day_of_era = days - era * 146097;
+  const int64 year_of_era = (day_of_era - day_of_era / 1460 +
+                             day_of_era / 36524 - day_of_era / 146096) /
+                            365;
+  const int64 day_of_year =
+      day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+  const int64 month_index = (5 * day_of_year + 2) / 153;
+  *day = day_of_year - (153 * month_index + 2) / 5 + 1;
+  *month = month_index < 10 ? month_index + 3 : month_index - 9;
+  *year = year_of_era + era * 400 + (*month <= 2 ? 1 : 0);
+}
+
+// Day of the week of the given days since 1970-01-01, Sunday is 0.
+inline int DayOfWeek(int64 days) { return FloorMod(days + 4, 7); }
+
+}  // namespace civil_time
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_CALENDAR_CIVIL_TIME_H_
@@ -0,0 +1,527 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/calendar/time-zone.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#include "utils/base/logging.h"
+#include "utils/calendar/civil-time.h"
+
+namespace libtextclassifier3 {
+
+const char kDefaultZoneInfoDir[] = "/usr/share/zoneinfo";
+
+namespace {
+
+using civil_time::DaysFromCivil;
+using civil_time::FloorDiv;
+using civil_time::kSecondsPerDay;
+
+// Reads the big-endian fields of a TZif file.
+class TzifReader {
+ public:
+  explicit TzifReader(StringPiece data) : data_(data) {}
+
+  bool ReadBytes(int num_bytes, uint64* value) {
+    if (pos_ + num_bytes > data_.size()) {
+      return false;
+    }
+    *value = 0;
+    for (int i = 0; i < num_bytes; ++i) {
+      *value = (*value << 8) | static_cast<unsigned char>(data_[pos_++]);
+    }
+    return true;
+  }
+
+  // Reads a signed 32 or 64 bit value.
+  bool ReadSigned(int num_bytes, int64* value) {
+    uint64 bits;
+    if (!ReadBytes(num_bytes, &bits)) {
+      return false;
+    }
+    *value = num_bytes == 4 ? static_cast<int64>(static_cast<int32>(bits))
+                            : static_cast<int64>(bits);
+    return true;
+  }
+
+  bool Skip(int64 num_bytes) {
+    if (num_bytes < 0 || pos_ + num_bytes > data_.size()) {
+      return false;
+    }
+    pos_ += num_bytes;
+    return true;
+  }
+
+  StringPiece Rest() const {
+    return StringPiece(data_.data() + pos_, data_.size() - pos_);
+  }
+
+ private:
+  const StringPiece data_;
+  int64 pos_ = 0;
+};
+
+struct TzifHeader {
+  char version;
+  uint64 isutcnt, isstdcnt, leapcnt, timecnt, typecnt, charcnt;
+
+  // Size of the data block following the header, with times of the given
+  // size.
+  int64 DataSize(int time_size) const {
+    return timecnt * time_size + timecnt + typecnt * 6 + charcnt +
+           leapcnt * (time_size + 4) + isstdcnt + isutcnt;
+  }
+};
+
+bool ReadTzifHeader(TzifReader* reader, TzifHeader* header) {
+  uint64 magic, version;
+  if (!reader->ReadBytes(4, &magic) || magic != 0x545a6966 /* "TZif" */ ||
+      !reader->ReadBytes(1, &version) || !reader->Skip(15)) {
+    return false;
+  }
+  header->version = static_cast<char>(version);
+  return reader->ReadBytes(4, &header->isutcnt) &&
+         reader->ReadBytes(4, &header->isstdcnt) &&
+         reader->ReadBytes(4, &header->leapcnt) &&
+         reader->ReadBytes(4, &header->timecnt) &&
+         reader->ReadBytes(4, &header->typecnt) &&
+         reader->ReadBytes(4, &header->charcnt) && header->typecnt > 0;
+}
+
+// Parses the name of a zone in a POSIX TZ string, e.g. "CET" or "<+0330>".
+bool ParseZoneName(StringPiece rule, int* pos) {
+  if (*pos < rule.size() && rule[*pos] == '<') {
+    while (*pos < rule.size() && rule[*pos] != '>') {
+      ++*pos;
+    }
+    if (*pos == rule.size()) {
+      return false;
+    }
+    ++*pos;
+    return true;
+  }
+  const int begin = *pos;
+  while (*pos < rule.size() &&
+         ((rule[*pos] >= 'a' && rule[*pos] <= 'z') ||
+          (rule[*pos] >= 'A' && rule[*pos] <= 'Z'))) {
+    ++*pos;
+  }
+  return *pos - begin >= 3;
+}
+
+bool ParseNumber(StringPiece rule, int* pos, int* value) {
+  const int begin = *pos;
+  *value = 0;
+  while (*pos < rule.size() && rule[*pos] >= '0' && rule[*pos] <= '9' &&
+         *pos - begin < 4) {
+    *value = *value * 10 + (rule[*pos] - '0');
+    ++*pos;
+  }
+  return *pos > begin;
+}
+
+// Parses [+-]hh[:mm[:ss]] into seconds.
+bool ParseSignedTime(StringPiece rule, int* pos, int* seconds) {
+  int sign = 1;
+  if (*pos < rule.size() && (rule[*pos] == '+' || rule[*pos] == '-')) {
+    sign = rule[*pos] == '-' ? -1 : 1;
+    ++*pos;
+  }
+  int hours;
+  int minutes = 0;
+  int secs = 0;
+  if (!ParseNumber(rule, pos, &hours)) {
+    return false;
+  }
+  if (*pos < rule.size() && rule[*pos] == ':') {
+    ++*pos;
+    if (!ParseNumber(rule, pos, &minutes)) {
+      return false;
+    }
+    if (*pos < rule.size() && rule[*pos] == ':') {
+      ++*pos;
+      if (!ParseNumber(rule, pos, &secs)) {
+        return false;
+      }
+    }
+  }
+  *seconds = sign * (hours * 60 * 60 + minutes * 60 + secs);
+  return true;
+}
+
+bool ParseRuleDate(StringPiece rule, int* pos,
+                   PosixTimeZoneRule::Date* date) {
+  if (*pos < rule.size() && rule[*pos] == 'M') {
+    ++*pos;
+    date->kind = PosixTimeZoneRule::Date::kMonthWeekDay;
+    if (!ParseNumber(rule, pos, &date->month) || *pos >= rule.size() ||
+        rule[(*pos)++] != '.' || !ParseNumber(rule, pos, &date->week) ||
+        *pos >= rule.size() || rule[(*pos)++] != '.' ||
+        !ParseNumber(rule, pos, &date->day) || date->month < 1 ||
+        date->month > 12 || date->week < 1 || date->week > 5 ||
+        date->day > 6) {
+      return false;
+    }
+  } else if (*pos < rule.size() && rule[*pos] == 'J') {
+    ++*pos;
+    date->kind = PosixTimeZoneRule::Date::kJulianWithoutLeapDay;
+    if (!ParseNumber(rule, pos, &date->day) || date->day < 1 ||
+        date->day > 365) {
+      return false;
+    }
+  } else {
+    date->kind = PosixTimeZoneRule::Date::kJulianWithLeapDay;
+    if (!ParseNumber(rule, pos, &date->day) || date->day > 365) {
+      return false;
+    }
+  }
+  if (*pos < rule.size() && rule[*pos] == '/') {
+    ++*pos;
+    return ParseSignedTime(rule, pos, &date->time_seconds);
+  }
+  return true;
+}
+
+// Seconds since the epoch, in local time, of the transition in the year.
+int64 LocalTransitionSeconds(int64 year,
+                             const PosixTimeZoneRule::Date& date) {
+  int64 days = 0;
+  switch (date.kind) {
+    case PosixTimeZoneRule::Date::kJulianWithoutLeapDay:
+      days = DaysFromCivil(year, 1, 1) + date.day - 1 +
+             (civil_time::IsLeapYear(year) && date.day >= 60 ? 1 : 0);
+      break;
+    case PosixTimeZoneRule::Date::kJulianWithLeapDay:
+      days = DaysFromCivil(year, 1, 1) + date.day;
+      break;
+    case PosixTimeZoneRule::Date::kMonthWeekDay: {
+      const int64 first_day = DaysFromCivil(year, date.month, 1);
+      int day = (date.day - civil_time::DayOfWeek(first_day) + 7) % 7 +
+                (date.week - 1) * 7;
+      const int days_in_month = civil_time::DaysInMonth(year, date.month);
+      while (day >= days_in_month) {
+        day -= 7;
+      }
+      days = first_day + day;
+      break;
+    }
+  }
+  return days * kSecondsPerDay + date.time_seconds;
+}
+
+// Checks that a zone id only names a file within the database.
+bool IsValidZoneId(const std::string& id) {
+  if (id.empty() || id[0] == '/' || id.find("..") != std::string::npos) {
+    return false;
+  }
+  for (const char c : id) {
+    if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+          (c >= '0' && c <= '9') || c == '/' || c == '_' || c == '-' ||
+          c == '+')) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Parses custom ids like "GMT+1", "GMT-05:30" or "GMT+0530".
+bool ParseCustomZoneId(const std::string& id, int* offset_seconds) {
+  if (id.size() < 5 || id.compare(0, 3, "GMT") != 0 ||
+      (id[3] != '+' && id[3] != '-')) {
+    return false;
+  }
+  int hours = 0;
+  int minutes = 0;
+  int pos = 4;
+  int num_digits = 0;
+  while (pos < id.size() && id[pos] >= '0' && id[pos] <= '9') {
+    ++num_digits;
+    ++pos;
+  }
+  const std::string digits = id.substr(4, num_digits);
+  if (num_digits == 0 || num_digits > 4) {
+    return false;
+  }
+  if (pos < id.size()) {
+    if (id[pos] != ':' || num_digits > 2 || id.size() - pos != 3) {
+      return false;
+    }
+    hours = std::stoi(digits);
+    for (int i = pos + 1; i < id.size(); ++i) {
+      if (id[i] < '0' || id[i] > '9') {
+        return false;
+      }
+    }
+    minutes = std::stoi(id.substr(pos + 1));
+  } else if (num_digits <= 2) {
+    hours = std::stoi(digits);
+  } else {
+    hours = std::stoi(digits.substr(0, num_digits - 2));
+    minutes = std::stoi(digits.substr(num_digits - 2));
+  }
+  if (hours > 23 || minutes > 59) {
+    return false;
+  }
+  *offset_seconds = (id[3] == '-' ? -1 : 1) * (hours * 60 + minutes) * 60;
+  return true;
+}
+
+}  // namespace
+
+bool ParsePosixTimeZoneRule(StringPiece rule, PosixTimeZoneRule* result) {
+  *result = PosixTimeZoneRule();
+  int pos = 0;
+  int offset;
+
+  // POSIX offsets are positive west of Greenwich.
+  if (!ParseZoneName(rule, &pos) || !ParseSignedTime(rule, &pos, &offset)) {
+    return false;
+  }
+  result->std_offset_seconds = -offset;
+  if (pos == rule.size()) {
+    return true;
+  }
+
+  if (!ParseZoneName(rule, &pos)) {
+    return false;
+  }
+  result->has_dst = true;
+  result->dst_offset_seconds = result->std_offset_seconds + 60 * 60;
+  if (pos < rule.size() && rule[pos] != ',') {
+    if (!ParseSignedTime(rule, &pos, &offset)) {
+      return false;
+    }
+    result->dst_offset_seconds = -offset;
+  }
+  if (pos == rule.size()) {
+    // Default rules of the US.
+    result->dst_start.month = 3;
+    result->dst_start.week = 2;
+    result->dst_end.month = 11;
+    result->dst_end.week = 1;
+    return true;
+  }
+  if (rule[pos++] != ',' || !ParseRuleDate(rule, &pos, &result->dst_start) ||
+      pos >= rule.size() || rule[pos++] != ',' ||
+      !ParseRuleDate(rule, &pos, &result->dst_end)) {
+    return false;
+  }
+  return pos == rule.size();
+}
+
+std::unique_ptr<TimeZone> TimeZone::Load(const std::string& id,
+                                         const std::string& zoneinfo_dir) {
+  int offset_seconds;
+  if (ParseCustomZoneId(id, &offset_seconds)) {
+    return Fixed(offset_seconds * 1000);
+  }
+  if (!IsValidZoneId(id)) {
+    return nullptr;
+  }
+  std::ifstream file(zoneinfo_dir + "/" + id, std::ios::binary);
+  if (!file) {
+    if (id == "UTC" || id == "GMT") {
+      return Fixed(0);
+    }
+    return nullptr;
+  }
+  const std::string data((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+  return FromTzif(data);
+}
+
+std::unique_ptr<TimeZone> TimeZone::FromTzif(StringPiece data) {
+  TzifReader reader(data);
+  TzifHeader header;
+  if (!ReadTzifHeader(&reader, &header)) {
+    return nullptr;
+  }
+
+  // Version 2+ files repeat the data with 64-bit times, followed by a POSIX
+  // TZ string for the times after the last transition.
+  int time_size = 4;
+  if (header.version >= '2') {
+    if (!reader.Skip(header.DataSize(/*time_size=*/4)) ||
+        !ReadTzifHeader(&reader, &header)) {
+      return nullptr;
+    }
+    time_size = 8;
+  }
+
+  std::unique_ptr<TimeZone> zone(new TimeZone());
+  std::vector<int64> times(header.timecnt);
+  for (int64& time : times) {
+    if (!reader.ReadSigned(time_size, &time)) {
+      return nullptr;
+    }
+  }
+  std::vector<int> type_indices(header.timecnt);
+  for (int& type_index : type_indices) {
+    uint64 value;
+    if (!reader.ReadBytes(1, &value) || value >= header.typecnt) {
+      return nullptr;
+    }
+    type_index = value;
+  }
+  std::vector<int> utc_offsets(header.typecnt);
+  std::vector<bool> is_dst(header.typecnt);
+  for (int i = 0; i < header.typecnt; ++i) {
+    int64 utc_offset;
+    uint64 dst;
+    if (!reader.ReadSigned(4, &utc_offset) || !reader.ReadBytes(1, &dst) ||
+        !reader.Skip(1)) {
+      return nullptr;
+    }
+    utc_offsets[i] = utc_offset;
+    is_dst[i] = dst != 0;
+  }
+  if (!reader.Skip(header.charcnt + header.leapcnt * (time_size + 4) +
+                   header.isstdcnt + header.isutcnt)) {
+    return nullptr;
+  }
+
+  // TZif only records the total offset, the standard offset of a daylight
+  // period is the one of the standard period around it.
+  auto standard_offset_near = [&](int transition) {
+    for (int i = transition; i >= 0; --i) {
+      if (!is_dst[type_indices[i]]) {
+        return utc_offsets[type_indices[i]];
+      }
+    }
+    for (int i = transition + 1; i < type_indices.size(); ++i) {
+      if (!is_dst[type_indices[i]]) {
+        return utc_offsets[type_indices[i]];
+      }
+    }
+    return utc_offsets[type_indices[transition]] - 60 * 60;
+  };
+  zone->initial_offsets_ = {utc_offsets[0], 0};
+  for (int i = 0; i < times.size(); ++i) {
+    const int type = type_indices[i];
+    const int raw_offset =
+        is_dst[type] ? standard_offset_near(i) : utc_offsets[type];
+    zone->transition_times_.push_back(times[i]);
+    zone->transition_offsets_.push_back(
+        {raw_offset, utc_offsets[type] - raw_offset});
+  }
+
+  if (time_size == 8) {
+    StringPiece footer = reader.Rest();
+    if (footer.size() >= 2 && footer[0] == '\n') {
+      int end = 1;
+      while (end < footer.size() && footer[end] != '\n') {
+        ++end;
+      }
+      if (end < footer.size() && end > 1) {
+        zone->has_rule_ = ParsePosixTimeZoneRule(
+            StringPiece(footer.data() + 1, end - 1), &zone->rule_);
+      }
+    }
+  }
+  return zone;
+}
+
+std::unique_ptr<TimeZone> TimeZone::FromPosixRule(StringPiece rule) {
+  std::unique_ptr<TimeZone> zone(new TimeZone());
+  if (!ParsePosixTimeZoneRule(rule, &zone->rule_)) {
+    return nullptr;
+  }
+  zone->has_rule_ = true;
+  return zone;
+}
+
+std::unique_ptr<TimeZone> TimeZone::Fixed(int offset_ms) {
+  std::unique_ptr<TimeZone> zone(new TimeZone());
+  zone->initial_offsets_ = {offset_ms / 1000, 0};
+  return zone;
+}
+
+ZoneOffsets TimeZone::GetOffsets(int64 time_ms_utc) const {
+  const int64 time_seconds = FloorDiv(time_ms_utc, 1000);
+  const auto next_transition = std::upper_bound(
+      transition_times_.begin(), transition_times_.end(), time_seconds);
+  if (next_transition == transition_times_.end() && has_rule_) {
+    return GetRuleOffsets(time_seconds);
+  }
+
+  Offsets offsets = initial_offsets_;
+  if (next_transition != transition_times_.begin()) {
+    offsets = transition_offsets_[next_transition - transition_times_.begin() -
+                                  1];
+  }
+  ZoneOffsets result;
+  result.raw_offset_ms = offsets.raw_offset_seconds * 1000;
+  result.dst_offset_ms = offsets.dst_offset_seconds * 1000;
+  return result;
+}
+
+ZoneOffsets TimeZone::GetRuleOffsets(int64 time_seconds) const {
+  ZoneOffsets result;
+  result.raw_offset_ms = rule_.std_offset_seconds * 1000;
+  if (!rule_.has_dst) {
+    return result;
+  }
+
+  int64 year;
+  int month, day;
+  civil_time::CivilFromDays(
+      FloorDiv(time_seconds + rule_.std_offset_seconds, kSecondsPerDay), &year,
+      &month, &day);
+  const int64 start = LocalTransitionSeconds(year, rule_.dst_start) -
+                      rule_.std_offset_seconds;
+  const int64 end =
+      LocalTransitionSeconds(year, rule_.dst_end) - rule_.dst_offset_seconds;
+
+  // In the southern hemisphere, daylight time spans the turn of the year.
+  const bool is_dst = start < end
+                          ? (time_seconds >= start && time_seconds < end)
+                          : (time_seconds >= start || time_seconds < end);
+  if (is_dst) {
+    result.dst_offset_ms =
+        (rule_.dst_offset_seconds - rule_.std_offset_seconds) * 1000;
+  }
+  return result;
+}
+
+int64 ZoneOffsetSource::LocalToUtc(int64 local_time_ms) const {
+  // Transitions are assumed to be more than a day apart, so the offsets a day
+  // before and after are the ones on either side of any transition nearby.
+  const int offset_before =
+      GetOffsets(local_time_ms - civil_time::kMillisPerDay).total_ms();
+  const int offset_after =
+      GetOffsets(local_time_ms + civil_time::kMillisPerDay).total_ms();
+  const int64 utc_before = local_time_ms - offset_before;
+  const int64 utc_after = local_time_ms - offset_after;
+  const bool is_valid_before =
+      GetOffsets(utc_before).total_ms() == offset_before;
+  const bool is_valid_after = GetOffsets(utc_after).total_ms() == offset_after;
+  if (is_valid_before && is_valid_after) {
+    // Repeated wall time, take the later instant.
+    return std::max(utc_before, utc_after);
+  }
+  if (is_valid_after) {
+    return utc_after;
+  }
+
+  // Either valid before the transition, or skipped by it, in which case the
+  // offset before the transition moves it past the transition.
+  return utc_before;
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Time zones read from the tz database, for the native calendar backend.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_CALENDAR_TIME_ZONE_H_
+#define LIBTEXTCLASSIFIER_UTILS_CALENDAR_TIME_ZONE_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "utils/base/integral_types.h"
+#include "utils/strings/stringpiece.h"
+
+namespace libtextclassifier3 {
+
+// Directory of the compiled tz database on most Unix systems.
+extern const char kDefaultZoneInfoDir[];
+
+// The offsets from UTC in effect at an instant, split like the ZONE_OFFSET and
+// DST_OFFSET fields of java.util.Calendar.
+struct ZoneOffsets {
+  int raw_offset_ms = 0;
+  int dst_offset_ms = 0;
+
+  int total_ms() const { return raw_offset_ms + dst_offset_ms; }
+};
+
+// Rule for daylight saving time of a POSIX TZ string, e.g.
+// "CET-1CEST,M3.5.0,M10.5.0/3".
+struct PosixTimeZoneRule {
+  // Day of a year a transition happens on.
+  struct Date {
+    enum Kind {
+      // Day 1-365, February 29th is never counted ("Jn").
+      kJulianWithoutLeapDay,
+      // Day 0-365, February 29th is counted ("n").
+      kJulianWithLeapDay,
+      // Day of the week 0-6 (Sunday is 0) in week 1-5 of month 1-12, week 5
+      // being the last one ("Mm.w.d").
+      kMonthWeekDay,
+    };
+    Kind kind = kMonthWeekDay;
+    int day = 0;
+    int week = 0;
+    int month = 0;
+
+    // Local time of the transition, in seconds after midnight.
+    int time_seconds = 2 * 60 * 60;
+  };
+
+  int std_offset_seconds = 0;
+  bool has_dst = false;
+  int dst_offset_seconds = 0;
+  Date dst_start;
+  Date dst_end;
+};
+
+// Parses a POSIX TZ string as found at the end of version 2+ TZif files.
+// Returns false if the string is malformed.
+bool ParsePosixTimeZoneRule(StringPiece rule, PosixTimeZoneRule* result);
+
+// Gives the offsets from UTC of one zone.
+class ZoneOffsetSource {
+ public:
+  virtual ~ZoneOffsetSource() = default;
+
+  // Offsets in effect at the given instant.
+  virtual ZoneOffsets GetOffsets(int64 time_ms_utc) const = 0;
+
+  // Converts local wall time to an instant. Wall times that are skipped or
+  // repeated at a transition are interpreted as standard time, like
+  // java.util.Calendar does it (e.g. 2:30 on a day clocks go from 2:00 to 3:00
+  // becomes 3:30 daylight time).
+  int64 LocalToUtc(int64 local_time_ms) const;
+};
+
+// History of the offsets from UTC of one zone, from the tz database.
+// The class is immutable and thus thread-safe.
+class TimeZone : public ZoneOffsetSource {
+ public:
+  // Loads the zone with the given id (e.g. "Europe/Zurich") from the TZif
+  // files of a tz database. Also understands custom ids of the form
+  // "GMT+hh:mm" like java.util.TimeZone. Returns nullptr if the zone is
+  // unknown.
+  static std::unique_ptr<TimeZone> Load(
+      const std::string& id, const std::string& zoneinfo_dir =
+                                 kDefaultZoneInfoDir);
+
+  // Parses the content of a TZif file (RFC 8536). Returns nullptr if it is
+  // malformed.
+  static std::unique_ptr<TimeZone> FromTzif(StringPiece data);
+
+  // A zone following only the given POSIX TZ string.
+  static std::unique_ptr<TimeZone> FromPosixRule(StringPiece rule);
+
+  // A zone with a fixed offset.
+  static std::unique_ptr<TimeZone> Fixed(int offset_ms);
+
+  ZoneOffsets GetOffsets(int64 time_ms_utc) const override;
+
+ private:
+  // Offsets of a period between transitions.
+  struct Offsets {
+    int raw_offset_seconds;
+    int dst_offset_seconds;
+  };
+
+  TimeZone() = default;
+
+  // Offsets from the POSIX rule, for instants after the last transition.
+  ZoneOffsets GetRuleOffsets(int64 time_seconds) const;
+
+  // Seconds since the epoch at which the transitions happen, ascending, and
+  // the offsets in effect from then on.
+  std::vector<int64> transition_times_;
+  std::vector<Offsets> transition_offsets_;
+
+  // Offsets before the first transition.
+  Offsets initial_offsets_ = {0, 0};
+
+  bool has_rule_ = false;
+  PosixTimeZoneRule rule_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_CALENDAR_TIME_ZONE_H_
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/calendar/time-zone.h"
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+constexpr int64 kHourMs = 60 * 60 * 1000;
+
+TEST(TimeZoneTest, ParsesPosixRules) {
+  PosixTimeZoneRule rule;
+  ASSERT_TRUE(ParsePosixTimeZoneRule("CET-1CEST,M3.5.0,M10.5.0/3", &rule));
+  EXPECT_EQ(rule.std_offset_seconds, 3600);
+  EXPECT_TRUE(rule.has_dst);
+  EXPECT_EQ(rule.dst_offset_seconds, 7200);
+  EXPECT_EQ(rule.dst_start.month, 3);
+  EXPECT_EQ(rule.dst_start.week, 5);
+  EXPECT_EQ(rule.dst_start.time_seconds, 2 * 3600);
+  EXPECT_EQ(rule.dst_end.time_seconds, 3 * 3600);
+
+  ASSERT_TRUE(ParsePosixTimeZoneRule("<+0530>-5:30", &rule));
+  EXPECT_EQ(rule.std_offset_seconds, 5 * 3600 + 30 * 60);
+  EXPECT_FALSE(rule.has_dst);
+
+  EXPECT_FALSE(ParsePosixTimeZoneRule("", &rule));
+  EXPECT_FALSE(ParsePosixTimeZoneRule("CET-1CEST,M13.5.0,M10.5.0", &rule));
+}
+
+TEST(TimeZoneTest, GetsOffsetsFromRule) {
+  std::unique_ptr<TimeZone> zone =
+      TimeZone::FromPosixRule("CET-1CEST,M3.5.0,M10.5.0/3");
+  ASSERT_NE(zone, nullptr);
+
+  // Jan 15 2018 12:00 UTC.
+  ZoneOffsets offsets = zone->GetOffsets(1516017600000L);
+  EXPECT_EQ(offsets.raw_offset_ms, kHourMs);
+  EXPECT_EQ(offsets.dst_offset_ms, 0);
+
+  // Jul 15 2018 12:00 UTC.
+  offsets = zone->GetOffsets(1531656000000L);
+  EXPECT_EQ(offsets.raw_offset_ms, kHourMs);
+  EXPECT_EQ(offsets.dst_offset_ms, kHourMs);
+
+  // Daylight time started on Mar 25 2018 at 01:00 UTC.
+  EXPECT_EQ(zone->GetOffsets(1521939600000L - 1).total_ms(), kHourMs);
+  EXPECT_EQ(zone->GetOffsets(1521939600000L).total_ms(), 2 * kHourMs);
+}
+
+TEST(TimeZoneTest, HandlesSouthernHemisphereRules) {
+  std::unique_ptr<TimeZone> zone =
+      TimeZone::FromPosixRule("AEST-10AEDT,M10.1.0,M4.1.0/3");
+  ASSERT_NE(zone, nullptr);
+  EXPECT_EQ(zone->GetOffsets(1516017600000L).total_ms(), 11 * kHourMs);
+  EXPECT_EQ(zone->GetOffsets(1531656000000L).total_ms(), 10 * kHourMs);
+}
+
+TEST(TimeZoneTest, InterpretsAmbiguousWallTimeAsStandardTime) {
+  std::unique_ptr<TimeZone> zone =
+      TimeZone::FromPosixRule("EST5EDT,M3.2.0,M11.1.0");
+  ASSERT_NE(zone, nullptr);
+
+  // Mar 11 2018 02:30 doesn't exist, it becomes 03:30 EDT (07:30 UTC).
+  const int64 skipped_local = 1520735400000L;
+  EXPECT_EQ(zone->LocalToUtc(skipped_local), 1520753400000L);
+
+  // Nov 4 2018 01:30 happens twice, the second time in EST (06:30 UTC).
+  const int64 repeated_local = 1541295000000L;
+  EXPECT_EQ(zone->LocalToUtc(repeated_local), 1541313000000L);
+
+  // Jul 1 2018 12:00 EDT.
+  EXPECT_EQ(zone->LocalToUtc(1530446400000L), 1530460800000L);
+}
+
+TEST(TimeZoneTest, LoadsCustomZoneIds) {
+  std::unique_ptr<TimeZone> zone = TimeZone::Load("GMT+05:30", "/nonexistent");
+  ASSERT_NE(zone, nullptr);
+  EXPECT_EQ(zone->GetOffsets(0).total_ms(), 5 * kHourMs + 30 * 60 * 1000);
+
+  zone = TimeZone::Load("GMT-8", "/nonexistent");
+  ASSERT_NE(zone, nullptr);
+  EXPECT_EQ(zone->GetOffsets(0).total_ms(), -8 * kHourMs);
+
+  EXPECT_NE(TimeZone::Load("UTC", "/nonexistent"), nullptr);
+  EXPECT_EQ(TimeZone::Load("Europe/Zurich", "/nonexistent"), nullptr);
+  EXPECT_EQ(TimeZone::Load("../etc/passwd"), nullptr);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
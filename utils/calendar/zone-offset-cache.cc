@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/calendar/zone-offset-cache.h"
+
+#include "utils/calendar/civil-time.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+bool SameOffsets(const ZoneOffsets& a, const ZoneOffsets& b) {
+  return a.raw_offset_ms == b.raw_offset_ms &&
+         a.dst_offset_ms == b.dst_offset_ms;
+}
+
+}  // namespace
+
+constexpr int CachedZoneOffsets::kDefaultMaxDays;
+
+ZoneOffsets CachedZoneOffsets::GetOffsets(int64 time_ms_utc) const {
+  const int64 day =
+      civil_time::FloorDiv(time_ms_utc, civil_time::kMillisPerDay);
+  DayOffsets offsets;
+  bool found = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = days_.find(day);
+    if (it != days_.end()) {
+      offsets = it->second;
+      found = true;
+    }
+  }
+  if (!found) {
+    // Look up outside of the lock, this is the expensive part.
+    offsets = LookupDay(day);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (days_.size() >= max_days_) {
+      days_.clear();
+    }
+    days_[day] = offsets;
+  }
+  return time_ms_utc < offsets.transition_ms ? offsets.at_start
+                                             : offsets.after_transition;
+}
+
+CachedZoneOffsets::DayOffsets CachedZoneOffsets::LookupDay(int64 day) const {
+  const int64 start = day * civil_time::kMillisPerDay;
+  const int64 end = start + civil_time::kMillisPerDay - 1;
+  DayOffsets result;
+  result.at_start = lookup_(start);
+  result.after_transition = lookup_(end);
+  result.transition_ms = end + 1;
+  if (SameOffsets(result.at_start, result.after_transition)) {
+    // Zones don't change twice a day.
+    return result;
+  }
+
+  // Find the first instant with the new offsets.
+  int64 before = start;
+  int64 after = end;
+  while (after - before > 1) {
+    const int64 middle = before + (after - before) / 2;
+    if (SameOffsets(lookup_(middle), result.at_start)) {
+      before = middle;
+    } else {
+      after = middle;
+    }
+  }
+  result.transition_ms = after;
+  return result;
+}
+
+}  // namespace libtextclassifier3
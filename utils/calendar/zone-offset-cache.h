@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_CALENDAR_ZONE_OFFSET_CACHE_H_
+#define LIBTEXTCLASSIFIER_UTILS_CALENDAR_ZONE_OFFSET_CACHE_H_
+
+#include <functional>
+#include <mutex>  // NOLINT
+#include <unordered_map>
+
+#include "utils/base/integral_types.h"
+#include "utils/calendar/time-zone.h"
+
+namespace libtextclassifier3 {
+
+// Remembers the offsets of a zone by day, for zones whose offsets are
+// expensive to look up, e.g. through JNI. The requests of a batch usually
+// share one reference time and zone, so only the first interpretation has to
+// look up the offsets around it.
+//
+// The class is thread-safe.
+class CachedZoneOffsets : public ZoneOffsetSource {
+ public:
+  static constexpr int kDefaultMaxDays = 64;
+
+  // Looks up the offsets in effect at an instant.
+  typedef std::function<ZoneOffsets(int64 time_ms_utc)> Lookup;
+
+  explicit CachedZoneOffsets(const Lookup& lookup,
+                             int max_days = kDefaultMaxDays)
+      : lookup_(lookup), max_days_(max_days) {}
+
+  ZoneOffsets GetOffsets(int64 time_ms_utc) const override;
+
+ private:
+  // Offsets over one day in UTC.
+  struct DayOffsets {
+    ZoneOffsets at_start;
+
+    // Instant of a transition within the day and the offsets from then on.
+    // Days without a transition have it at the end of the day.
+    int64 transition_ms;
+    ZoneOffsets after_transition;
+  };
+
+  DayOffsets LookupDay(int64 day) const;
+
+  const Lookup lookup_;
+  const int max_days_;
+
+  mutable std::mutex mutex_;
+  mutable std::unordered_map<int64, DayOffsets> days_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_CALENDAR_ZONE_OFFSET_CACHE_H_
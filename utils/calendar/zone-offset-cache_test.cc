@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/calendar/zone-offset-cache.h"
+
+#include <memory>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(CachedZoneOffsetsTest, MatchesZoneAndCachesLookups) {
+  std::shared_ptr<TimeZone> zone(
+      TimeZone::FromPosixRule("CET-1CEST,M3.5.0,M10.5.0/3"));
+  ASSERT_NE(zone, nullptr);
+  int num_lookups = 0;
+  CachedZoneOffsets cached_zone([zone, &num_lookups](int64 time_ms_utc) {
+    ++num_lookups;
+    return zone->GetOffsets(time_ms_utc);
+  });
+
+  // Around the start of daylight time on Mar 25 2018 at 01:00 UTC.
+  const int64 transition_ms = 1521939600000L;
+  for (const int64 time_ms :
+       {transition_ms - 1, transition_ms, transition_ms + 1,
+        transition_ms - 3600000, transition_ms + 7200000}) {
+    EXPECT_EQ(cached_zone.GetOffsets(time_ms).total_ms(),
+              zone->GetOffsets(time_ms).total_ms());
+  }
+
+  // Further lookups on the same day are served from the cache.
+  const int num_day_lookups = num_lookups;
+  EXPECT_EQ(cached_zone.GetOffsets(transition_ms + 60000).dst_offset_ms,
+            3600000);
+  EXPECT_EQ(cached_zone.LocalToUtc(transition_ms + 3 * 3600000),
+            transition_ms + 3600000);
+  EXPECT_EQ(num_lookups, num_day_lookups + 4);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
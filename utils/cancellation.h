@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A token and a deadline to stop a running call early.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_CANCELLATION_H_
+#define LIBTEXTCLASSIFIER_UTILS_CANCELLATION_H_
+
+#include <atomic>
+#include <chrono>
+
+#include "utils/base/integral_types.h"
+
+namespace libtextclassifier3 {
+
+// Lets a caller tell a call that its result is no longer needed. The call
+// checks the token between steps of its work and gives up once it is
+// cancelled, so the cancellation takes effect at the next check, not
+// immediately.
+//
+// The class is thread-safe.
+class CancellationToken {
+ public:
+  CancellationToken() = default;
+
+  CancellationToken(const CancellationToken&) = delete;
+  CancellationToken& operator=(const CancellationToken&) = delete;
+
+  void Cancel() { cancelled_.store(true, std::memory_order_relaxed); }
+
+  bool IsCancelled() const {
+    return cancelled_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<bool> cancelled_{false};
+};
+
+// Returns whether the token is set and cancelled.
+inline bool IsCancelled(const CancellationToken* token) {
+  return token != nullptr && token->IsCancelled();
+}
+
+// The conditions under which a single call stops early: its cancellation
+// token, if any, and its timeout, if positive. The call checks it between
+// units of its work (lines, rules, candidates) and, once it says to stop,
+// skips the remaining units and returns what it found so far.
+//
+// The class is thread-safe: the sources of a call that run in parallel share
+// one instance.
+class StopCondition {
+ public:
+  // The token can be nullptr and is not owned. The timeout is measured from
+  // the construction of the condition.
+  StopCondition(const CancellationToken* token, int64 timeout_ms)
+      : token_(token),
+        has_deadline_(timeout_ms > 0),
+        deadline_(std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(timeout_ms)) {}
+
+  StopCondition(const StopCondition&) = delete;
+  StopCondition& operator=(const StopCondition&) = delete;
+
+  // Returns whether the call should stop. Once true, stays true.
+  bool ShouldStop() const {
+    if (stopped_.load(std::memory_order_relaxed)) {
+      return true;
+    }
+    if (IsCancelled(token_) ||
+        (has_deadline_ && std::chrono::steady_clock::now() >= deadline_)) {
+      stopped_.store(true, std::memory_order_relaxed);
+      return true;
+    }
+    return false;
+  }
+
+  // Returns whether a check has said to stop, i.e. whether the result of the
+  // call is partial.
+  bool stopped() const { return stopped_.load(std::memory_order_relaxed); }
+
+  // Returns the timeout for a nested call that has to stop by the same
+  // deadline: 0 (no timeout) if there is no deadline, otherwise the remaining
+  // milliseconds, at least 1.
+  int64 RemainingTimeoutMs() const {
+    if (!has_deadline_) {
+      return 0;
+    }
+    const int64 remaining_ms =
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline_ - std::chrono::steady_clock::now())
+            .count();
+    return remaining_ms > 1 ? remaining_ms : 1;
+  }
+
+ private:
+  const CancellationToken* const token_;
+  const bool has_deadline_;
+  const std::chrono::steady_clock::time_point deadline_;
+  mutable std::atomic<bool> stopped_{false};
+};
+
+// Returns whether the condition is set and says to stop.
+inline bool ShouldStop(const StopCondition* stop) {
+  return stop != nullptr && stop->ShouldStop();
+}
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_CANCELLATION_H_
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/cancellation.h"
+
+#include <thread>  // NOLINT
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(CancellationTokenTest, IsNotCancelledInitially) {
+  CancellationToken token;
+  EXPECT_FALSE(token.IsCancelled());
+  EXPECT_FALSE(IsCancelled(&token));
+  EXPECT_FALSE(IsCancelled(nullptr));
+}
+
+TEST(CancellationTokenTest, CancelsFromAnotherThread) {
+  CancellationToken token;
+  std::thread canceller([&token]() { token.Cancel(); });
+  canceller.join();
+  EXPECT_TRUE(token.IsCancelled());
+  EXPECT_TRUE(IsCancelled(&token));
+}
+
+TEST(StopConditionTest, DoesNotStopWithoutTokenOrTimeout) {
+  const StopCondition stop(/*token=*/nullptr, /*timeout_ms=*/0);
+  EXPECT_FALSE(stop.ShouldStop());
+  EXPECT_FALSE(stop.stopped());
+  EXPECT_FALSE(ShouldStop(nullptr));
+}
+
+TEST(StopConditionTest, StopsOnceCancelled) {
+  CancellationToken token;
+  const StopCondition stop(&token, /*timeout_ms=*/0);
+  EXPECT_FALSE(ShouldStop(&stop));
+  token.Cancel();
+  EXPECT_TRUE(ShouldStop(&stop));
+  EXPECT_TRUE(stop.stopped());
+}
+
+TEST(StopConditionTest, StopsAfterTimeout) {
+  const StopCondition stop(/*token=*/nullptr, /*timeout_ms=*/1);
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  EXPECT_TRUE(stop.ShouldStop());
+  EXPECT_TRUE(stop.stopped());
+}
+
+TEST(StopConditionTest, PassesRemainingTimeoutToNestedCalls) {
+  EXPECT_EQ(StopCondition(/*token=*/nullptr, /*timeout_ms=*/0)
+                .RemainingTimeoutMs(),
+            0);
+  const int64 remaining_ms =
+      StopCondition(/*token=*/nullptr, /*timeout_ms=*/60000)
+          .RemainingTimeoutMs();
+  EXPECT_GT(remaining_ms, 0);
+  EXPECT_LE(remaining_ms, 60000);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
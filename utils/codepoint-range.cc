@@ -17,6 +17,7 @@
 #include "utils/codepoint-range.h"
 
 #include <algorithm>
+#include <map>
 
 namespace libtextclassifier3 {
 
@@ -67,4 +68,55 @@ bool IsCodepointInRanges(
   }
 }
 
+constexpr int CodepointSet::kNumBmpCodepoints;
+constexpr int CodepointSet::kPageBits;
+constexpr int CodepointSet::kPageSize;
+constexpr int CodepointSet::kWordsPerPage;
+
+CodepointSet::CodepointSet(std::vector<CodepointRangeStruct> ranges) {
+  std::sort(ranges.begin(), ranges.end(),
+            [](const CodepointRangeStruct& a, const CodepointRangeStruct& b) {
+              return a.start < b.start;
+            });
+
+  std::vector<uint64> bitmap(kNumBmpCodepoints / 64, 0);
+  bool has_bmp_codepoints = false;
+  for (const CodepointRangeStruct& range : ranges) {
+    const int start = std::max(range.start, 0);
+    const int end = std::min(range.end, kNumBmpCodepoints);
+    for (int codepoint = start; codepoint < end; ++codepoint) {
+      bitmap[codepoint >> 6] |= uint64{1} << (codepoint & 63);
+      has_bmp_codepoints = true;
+    }
+    if (range.end > kNumBmpCodepoints) {
+      // Merge overlapping ranges, so that the binary search finds them.
+      const int supplementary_start = std::max(range.start, kNumBmpCodepoints);
+      if (!supplementary_ranges_.empty() &&
+          supplementary_ranges_.back().end >= supplementary_start) {
+        supplementary_ranges_.back().end =
+            std::max(supplementary_ranges_.back().end, range.end);
+      } else {
+        supplementary_ranges_.emplace_back(supplementary_start, range.end);
+      }
+    }
+  }
+  if (!has_bmp_codepoints) {
+    return;
+  }
+
+  // Store each distinct page once.
+  std::map<std::vector<uint64>, int> page_indices;
+  bmp_page_index_.reserve(kNumBmpCodepoints / kPageSize);
+  for (int word = 0; word < bitmap.size(); word += kWordsPerPage) {
+    std::vector<uint64> page(bitmap.begin() + word,
+                             bitmap.begin() + word + kWordsPerPage);
+    auto it = page_indices.find(page);
+    if (it == page_indices.end()) {
+      it = page_indices.emplace(page, page_indices.size()).first;
+      bmp_pages_.insert(bmp_pages_.end(), page.begin(), page.end());
+    }
+    bmp_page_index_.push_back(it->second);
+  }
+}
+
 }  // namespace libtextclassifier3
@@ -44,6 +44,44 @@ void SortCodepointRanges(
 bool IsCodepointInRanges(
     int codepoint, const std::vector<CodepointRangeStruct>& codepoint_ranges);
 
+// A set of codepoints with constant time lookups, built from codepoint ranges.
+// The BMP is held in a two-level bitmap that stores each distinct page of 256
+// codepoints once, so sets of a few large ranges stay small. The codepoints
+// beyond the BMP are looked up in the sorted ranges.
+class CodepointSet {
+ public:
+  CodepointSet() = default;
+
+  // The ranges don't need to be sorted and may overlap.
+  explicit CodepointSet(std::vector<CodepointRangeStruct> ranges);
+
+  bool Contains(int codepoint) const {
+    if (codepoint >= 0 && codepoint < kNumBmpCodepoints) {
+      if (bmp_page_index_.empty()) {
+        return false;
+      }
+      const uint64 word =
+          bmp_pages_[bmp_page_index_[codepoint >> kPageBits] * kWordsPerPage +
+                     ((codepoint & (kPageSize - 1)) >> 6)];
+      return (word >> (codepoint & 63)) & 1;
+    }
+    return IsCodepointInRanges(codepoint, supplementary_ranges_);
+  }
+
+ private:
+  static constexpr int kNumBmpCodepoints = 0x10000;
+  static constexpr int kPageBits = 8;
+  static constexpr int kPageSize = 1 << kPageBits;
+  static constexpr int kWordsPerPage = kPageSize / 64;
+
+  // For each page of the BMP, the index of its bitmap in bmp_pages_.
+  std::vector<uint8> bmp_page_index_;
+  std::vector<uint64> bmp_pages_;
+
+  // The ranges beyond the BMP, sorted.
+  std::vector<CodepointRangeStruct> supplementary_ranges_;
+};
+
 }  // namespace libtextclassifier3
 
 #endif  // LIBTEXTCLASSIFIER_UTILS_CODEPOINT_RANGE_H_
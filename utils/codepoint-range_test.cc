@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/codepoint-range.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(CodepointSetTest, ContainsCodepointsOfRanges) {
+  const CodepointSet set({CodepointRangeStruct(0x10000, 0x10010),
+                          CodepointRangeStruct('a', 'z' + 1),
+                          CodepointRangeStruct(0x4E00, 0x9FFF + 1),
+                          CodepointRangeStruct(0x10008, 0x10020),
+                          CodepointRangeStruct('|', '|' + 1)});
+
+  EXPECT_TRUE(set.Contains('a'));
+  EXPECT_TRUE(set.Contains('z'));
+  EXPECT_TRUE(set.Contains('|'));
+  EXPECT_TRUE(set.Contains(0x4E00));
+  EXPECT_TRUE(set.Contains(0x9FFF));
+  EXPECT_TRUE(set.Contains(0x10000));
+  EXPECT_TRUE(set.Contains(0x1001F));
+
+  EXPECT_FALSE(set.Contains(-1));
+  EXPECT_FALSE(set.Contains('A'));
+  EXPECT_FALSE(set.Contains('{'));
+  EXPECT_FALSE(set.Contains(0x4DFF));
+  EXPECT_FALSE(set.Contains(0xA000));
+  EXPECT_FALSE(set.Contains(0xFFFF));
+  EXPECT_FALSE(set.Contains(0x10020));
+}
+
+TEST(CodepointSetTest, EmptySetContainsNothing) {
+  const CodepointSet set;
+  EXPECT_FALSE(set.Contains(0));
+  EXPECT_FALSE(set.Contains('a'));
+  EXPECT_FALSE(set.Contains(0x10000));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -16,7 +16,9 @@
 
 #include "utils/flatbuffers.h"
 
+#include <algorithm>
 #include <vector>
+
 #include "utils/strings/numbers.h"
 #include "utils/variant.h"
 
@@ -58,6 +60,33 @@ bool CreateRepeatedField(
       return false;
   }
 }
+
+const reflection::Field* FindFieldByOffset(const reflection::Object* type,
+                                           const int field_offset) {
+  if (type->fields() == nullptr) {
+    return nullptr;
+  }
+  for (const reflection::Field* field : *type->fields()) {
+    if (field->offset() == field_offset) {
+      return field;
+    }
+  }
+  return nullptr;
+}
+
+// Finds the field of a table by name or, if no name is given, by offset.
+const reflection::Field* FindField(const reflection::Object* type,
+                                   const FlatbufferField* field) {
+  // Lookup by name might be faster as the fields are sorted by name in the
+  // schema data, so try that first.
+  if (field->field_name() != nullptr) {
+    if (type->fields() == nullptr) {
+      return nullptr;
+    }
+    return type->fields()->LookupByKey(field->field_name()->c_str());
+  }
+  return FindFieldByOffset(type, field->field_offset());
+}
 }  // namespace
 
 template <>
@@ -86,6 +115,36 @@ std::unique_ptr<ReflectiveFlatbuffer> ReflectiveFlatbufferBuilder::NewTable(
   return nullptr;
 }
 
+bool ReflectiveFlatbufferBuilder::ResolveFieldPath(
+    const FlatbufferFieldPath* field_path,
+    ResolvedFieldPath* resolved_path) const {
+  resolved_path->clear();
+  const auto* path = field_path->field();
+  if (path == nullptr || path->size() == 0 || !schema_->root_table()) {
+    return false;
+  }
+
+  const reflection::Object* type = schema_->root_table();
+  for (int i = 0; i < path->size(); i++) {
+    if (i > 0) {
+      const reflection::Field* parent_field = resolved_path->back();
+      if (parent_field->type()->base_type() != reflection::Obj) {
+        TC3_LOG(ERROR) << "Field is not of type Object.";
+        resolved_path->clear();
+        return false;
+      }
+      type = schema_->objects()->Get(parent_field->type()->index());
+    }
+    const reflection::Field* field = FindField(type, path->Get(i));
+    if (field == nullptr) {
+      resolved_path->clear();
+      return false;
+    }
+    resolved_path->push_back(field);
+  }
+  return true;
+}
+
 const reflection::Field* ReflectiveFlatbuffer::GetFieldOrNull(
     const StringPiece field_name) const {
   return type_->fields()->LookupByKey(field_name.data());
@@ -93,12 +152,7 @@ const reflection::Field* ReflectiveFlatbuffer::GetFieldOrNull(
 
 const reflection::Field* ReflectiveFlatbuffer::GetFieldOrNull(
     const FlatbufferField* field) const {
-  // Lookup by name might be faster as the fields are sorted by name in the
-  // schema data, so try that first.
-  if (field->field_name() != nullptr) {
-    return GetFieldOrNull(field->field_name()->str());
-  }
-  return GetFieldByOffsetOrNull(field->field_offset());
+  return FindField(type_, field);
 }
 
 bool ReflectiveFlatbuffer::GetFieldWithParent(
@@ -125,15 +179,7 @@ bool ReflectiveFlatbuffer::GetFieldWithParent(
 
 const reflection::Field* ReflectiveFlatbuffer::GetFieldByOffsetOrNull(
     const int field_offset) const {
-  if (type_->fields() == nullptr) {
-    return nullptr;
-  }
-  for (const reflection::Field* field : *type_->fields()) {
-    if (field->offset() == field_offset) {
-      return field;
-    }
-  }
-  return nullptr;
+  return FindFieldByOffset(type_, field_offset);
 }
 
 bool ReflectiveFlatbuffer::IsMatchingType(const reflection::Field* field,
@@ -209,6 +255,30 @@ bool ReflectiveFlatbuffer::ParseAndSet(const FlatbufferFieldPath* path,
   return parent->ParseAndSet(field, value);
 }
 
+bool ReflectiveFlatbuffer::ParseAndSet(const ResolvedFieldPath& path,
+                                       const std::string& value) {
+  ReflectiveFlatbuffer* parent = MutableParent(path);
+  if (parent == nullptr) {
+    return false;
+  }
+  return parent->ParseAndSet(path.back(), value);
+}
+
+ReflectiveFlatbuffer* ReflectiveFlatbuffer::MutableParent(
+    const ResolvedFieldPath& path) {
+  if (path.empty()) {
+    return nullptr;
+  }
+  ReflectiveFlatbuffer* parent = this;
+  for (int i = 0; i + 1 < path.size(); i++) {
+    parent = parent->Mutable(path[i]);
+    if (parent == nullptr) {
+      return nullptr;
+    }
+  }
+  return parent;
+}
+
 ReflectiveFlatbuffer* ReflectiveFlatbuffer::Mutable(
     const StringPiece field_name) {
   if (const reflection::Field* field = GetFieldOrNull(field_name)) {
@@ -218,23 +288,30 @@ ReflectiveFlatbuffer* ReflectiveFlatbuffer::Mutable(
   return nullptr;
 }
 
+ReflectiveFlatbuffer::FieldSlot* ReflectiveFlatbuffer::MutableSlot(
+    const reflection::Field* field) {
+  const int id = field->id();
+  if (id >= slots_.size()) {
+    slots_.resize(std::max<int>(
+        id + 1, type_->fields() != nullptr ? type_->fields()->size() : 0));
+  }
+  FieldSlot* slot = &slots_[id];
+  slot->field = field;
+  return slot;
+}
+
 ReflectiveFlatbuffer* ReflectiveFlatbuffer::Mutable(
     const reflection::Field* field) {
   if (field->type()->base_type() != reflection::Obj) {
     TC3_LOG(ERROR) << "Field is not of type Object.";
     return nullptr;
   }
-  const auto entry = children_.find(field);
-  if (entry != children_.end()) {
-    return entry->second.get();
+  FieldSlot* slot = MutableSlot(field);
+  if (slot->child == nullptr) {
+    slot->child.reset(new ReflectiveFlatbuffer(
+        schema_, schema_->objects()->Get(field->type()->index())));
   }
-  const auto it = children_.insert(
-      /*hint=*/entry,
-      std::make_pair(
-          field,
-          std::unique_ptr<ReflectiveFlatbuffer>(new ReflectiveFlatbuffer(
-              schema_, schema_->objects()->Get(field->type()->index())))));
-  return it->second.get();
+  return slot->child.get();
 }
 
 ReflectiveFlatbuffer::RepeatedField* ReflectiveFlatbuffer::Repeated(
@@ -254,75 +331,74 @@ ReflectiveFlatbuffer::RepeatedField* ReflectiveFlatbuffer::Repeated(
   }
 
   // If the repeated field was already set, return its instance.
-  const auto entry = repeated_fields_.find(field);
-  if (entry != repeated_fields_.end()) {
-    return entry->second.get();
+  FieldSlot* slot = MutableSlot(field);
+  if (slot->repeated != nullptr) {
+    return slot->repeated.get();
   }
 
   // Otherwise, create a new instance and store it.
-  std::unique_ptr<RepeatedField> repeated_field;
-  if (!CreateRepeatedField(schema_, field->type(), &repeated_field)) {
+  if (!CreateRepeatedField(schema_, field->type(), &slot->repeated)) {
     TC3_LOG(ERROR) << "Could not create repeated field.";
     return nullptr;
   }
-  const auto it = repeated_fields_.insert(
-      /*hint=*/entry, std::make_pair(field, std::move(repeated_field)));
-  return it->second.get();
+  return slot->repeated.get();
 }
 
 flatbuffers::uoffset_t ReflectiveFlatbuffer::Serialize(
     flatbuffers::FlatBufferBuilder* builder) const {
-  // Build all children before we can start with this table.
+  // Build all children, strings and repeated fields before we can start with
+  // this table.
   std::vector<
       std::pair</* field vtable offset */ int,
                 /* field data offset in buffer */ flatbuffers::uoffset_t>>
       offsets;
-  offsets.reserve(children_.size() + repeated_fields_.size());
-  for (const auto& it : children_) {
-    offsets.push_back({it.first->offset(), it.second->Serialize(builder)});
-  }
-
-  // Create strings.
-  for (const auto& it : fields_) {
-    if (it.second.HasString()) {
-      offsets.push_back({it.first->offset(),
-                         builder->CreateString(it.second.StringValue()).o});
+  offsets.reserve(slots_.size());
+  for (const FieldSlot& slot : slots_) {
+    if (slot.field == nullptr) {
+      continue;
+    }
+    if (slot.child != nullptr) {
+      offsets.push_back({slot.field->offset(), slot.child->Serialize(builder)});
+    } else if (slot.repeated != nullptr) {
+      offsets.push_back(
+          {slot.field->offset(), slot.repeated->Serialize(builder)});
+    } else if (slot.value.HasString()) {
+      offsets.push_back({slot.field->offset(),
+                         builder->CreateString(slot.value.StringValue()).o});
     }
-  }
-
-  // Build the repeated fields.
-  for (const auto& it : repeated_fields_) {
-    offsets.push_back({it.first->offset(), it.second->Serialize(builder)});
   }
 
   // Build the table now.
   const flatbuffers::uoffset_t table_start = builder->StartTable();
 
   // Add scalar fields.
-  for (const auto& it : fields_) {
-    switch (it.second.GetType()) {
+  for (const FieldSlot& slot : slots_) {
+    if (slot.field == nullptr) {
+      continue;
+    }
+    const reflection::Field* field = slot.field;
+    switch (slot.value.GetType()) {
       case Variant::TYPE_BOOL_VALUE:
         builder->AddElement<uint8_t>(
-            it.first->offset(), static_cast<uint8_t>(it.second.BoolValue()),
-            static_cast<uint8_t>(it.first->default_integer()));
+            field->offset(), static_cast<uint8_t>(slot.value.BoolValue()),
+            static_cast<uint8_t>(field->default_integer()));
         continue;
       case Variant::TYPE_INT_VALUE:
         builder->AddElement<int32>(
-            it.first->offset(), it.second.IntValue(),
-            static_cast<int32>(it.first->default_integer()));
+            field->offset(), slot.value.IntValue(),
+            static_cast<int32>(field->default_integer()));
         continue;
       case Variant::TYPE_INT64_VALUE:
-        builder->AddElement<int64>(it.first->offset(), it.second.Int64Value(),
-                                   it.first->default_integer());
+        builder->AddElement<int64>(field->offset(), slot.value.Int64Value(),
+                                   field->default_integer());
         continue;
       case Variant::TYPE_FLOAT_VALUE:
-        builder->AddElement<float>(
-            it.first->offset(), it.second.FloatValue(),
-            static_cast<float>(it.first->default_real()));
+        builder->AddElement<float>(field->offset(), slot.value.FloatValue(),
+                                   static_cast<float>(field->default_real()));
         continue;
       case Variant::TYPE_DOUBLE_VALUE:
-        builder->AddElement<double>(it.first->offset(), it.second.DoubleValue(),
-                                    it.first->default_real());
+        builder->AddElement<double>(field->offset(), slot.value.DoubleValue(),
+                                    field->default_real());
         continue;
       default:
         continue;
@@ -405,16 +481,19 @@ bool ReflectiveFlatbuffer::MergeFromSerializedFlatbuffer(StringPiece from) {
 void ReflectiveFlatbuffer::AsFlatMap(
     const std::string& key_separator, const std::string& key_prefix,
     std::map<std::string, Variant>* result) const {
-  // Add direct fields.
-  for (auto it : fields_) {
-    (*result)[key_prefix + it.first->name()->str()] = it.second;
-  }
-
-  // Add nested messages.
-  for (auto& it : children_) {
-    it.second->AsFlatMap(key_separator,
-                         key_prefix + it.first->name()->str() + key_separator,
-                         result);
+  for (const FieldSlot& slot : slots_) {
+    if (slot.field == nullptr) {
+      continue;
+    }
+    if (slot.value.HasValue()) {
+      // Add direct fields.
+      (*result)[key_prefix + slot.field->name()->str()] = slot.value;
+    } else if (slot.child != nullptr) {
+      // Add nested messages.
+      slot.child->AsFlatMap(
+          key_separator, key_prefix + slot.field->name()->str() + key_separator,
+          result);
+    }
   }
 }
 
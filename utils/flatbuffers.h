@@ -22,6 +22,7 @@
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "annotator/model_generated.h"
 #include "utils/strings/stringpiece.h"
@@ -97,6 +98,11 @@ std::string PackFlatbuffer(
                      builder.GetSize());
 }
 
+// A field path resolved against the reflection data of a schema: the fields of
+// the nested tables from the root table down to the field, see
+// ReflectiveFlatbufferBuilder::ResolveFieldPath.
+using ResolvedFieldPath = std::vector<const reflection::Field*>;
+
 // A flatbuffer that can be built using flatbuffer reflection data of the
 // schema.
 // Normally, field information is hard-coded in code generated from a flatbuffer
@@ -228,10 +234,19 @@ class ReflectiveFlatbuffer {
                      << ", got: " << variant_value.GetType();
       return false;
     }
-    fields_[field] = variant_value;
+    MutableSlot(field)->value = variant_value;
     return true;
   }
 
+  template <typename T>
+  bool Set(const ResolvedFieldPath& path, T value) {
+    ReflectiveFlatbuffer* parent = MutableParent(path);
+    if (parent == nullptr) {
+      return false;
+    }
+    return parent->Set<T>(path.back(), value);
+  }
+
   template <typename T>
   bool Set(const FlatbufferFieldPath* path, T value) {
     ReflectiveFlatbuffer* parent;
@@ -246,6 +261,7 @@ class ReflectiveFlatbuffer {
   // Parses the string value according to the field type.
   bool ParseAndSet(const reflection::Field* field, const std::string& value);
   bool ParseAndSet(const FlatbufferFieldPath* path, const std::string& value);
+  bool ParseAndSet(const ResolvedFieldPath& path, const std::string& value);
 
   // Gets the reflective flatbuffer for a table field.
   // Returns nullptr if the field was not found, or the field type was not a
@@ -293,16 +309,25 @@ class ReflectiveFlatbuffer {
   const reflection::Schema* const schema_;
   const reflection::Object* const type_;
 
-  // Cached primitive fields (scalars and strings).
-  std::map<const reflection::Field*, Variant> fields_;
+  // The cached value of a field: a primitive value (scalar or string), a
+  // sub-message or a repeated field, depending on the field type.
+  struct FieldSlot {
+    const reflection::Field* field = nullptr;
+    Variant value;
+    std::unique_ptr<ReflectiveFlatbuffer> child;
+    std::unique_ptr<RepeatedField> repeated;
+  };
+
+  // The cached fields, indexed by field id. The slots of the fields that were
+  // not set have no `field`.
+  std::vector<FieldSlot> slots_;
 
-  // Cached sub-messages.
-  std::map<const reflection::Field*, std::unique_ptr<ReflectiveFlatbuffer>>
-      children_;
+  // Gets the message a resolved field path ends in, or nullptr if the path is
+  // empty.
+  ReflectiveFlatbuffer* MutableParent(const ResolvedFieldPath& path);
 
-  // Cached repeated fields.
-  std::map<const reflection::Field*, std::unique_ptr<RepeatedField>>
-      repeated_fields_;
+  // Gets the slot of a field, and makes room for it if needed.
+  FieldSlot* MutableSlot(const reflection::Field* field);
 
   // Flattens the flatbuffer as a flat map.
   // (Nested) fields names are joined by `key_separator` and prefixed by
@@ -328,6 +353,12 @@ class ReflectiveFlatbufferBuilder {
   std::unique_ptr<ReflectiveFlatbuffer> NewTable(
       const StringPiece table_name) const;
 
+  // Resolves a field path of the root table, so that the field can be set
+  // without looking up the fields of the path by name or offset.
+  // Returns false if a field of the path is not defined.
+  bool ResolveFieldPath(const FlatbufferFieldPath* field_path,
+                        ResolvedFieldPath* resolved_path) const;
+
  private:
   const reflection::Schema* const schema_;
 };
@@ -67,6 +67,24 @@ TEST(FlatbuffersTest, PrimitiveFieldsAreCorrectlySet) {
   EXPECT_NEAR(entity_data->a_double_field, 1.f, 1e-4);
 }
 
+TEST(FlatbuffersTest, OverwritesFieldsSetTwice) {
+  std::string metadata_buffer = LoadTestMetadata();
+  ReflectiveFlatbufferBuilder reflective_builder(
+      flatbuffers::GetRoot<reflection::Schema>(metadata_buffer.data()));
+
+  std::unique_ptr<ReflectiveFlatbuffer> buffer = reflective_builder.NewRoot();
+  EXPECT_TRUE(buffer->Set("an_int_field", 42));
+  EXPECT_TRUE(buffer->Set("an_int_field", 43));
+  EXPECT_FALSE(buffer->Set("an_int_field", 1.0));
+
+  std::string serialized_entity_data = buffer->Serialize();
+  std::unique_ptr<test::EntityDataT> entity_data =
+      LoadAndVerifyMutableFlatbuffer<test::EntityData>(
+          serialized_entity_data.data(), serialized_entity_data.size());
+  ASSERT_TRUE(entity_data != nullptr);
+  EXPECT_EQ(entity_data->an_int_field, 43);
+}
+
 TEST(FlatbuffersTest, HandlesUnknownFields) {
   std::string metadata_buffer = LoadTestMetadata();
   const reflection::Schema* schema =
@@ -211,6 +229,60 @@ TEST(FlatbuffersTest, HandlesFieldsSetWithOffsetPath) {
   EXPECT_EQ(entity_data->flight_number->flight_code, 38);
 }
 
+TEST(FlatbuffersTest, HandlesFieldsSetWithResolvedPath) {
+  std::string metadata_buffer = LoadTestMetadata();
+  ReflectiveFlatbufferBuilder reflective_builder(
+      flatbuffers::GetRoot<reflection::Schema>(metadata_buffer.data()));
+
+  FlatbufferFieldPathT path;
+  path.field.emplace_back(new FlatbufferFieldT);
+  path.field.back()->field_name = "flight_number";
+  path.field.emplace_back(new FlatbufferFieldT);
+  path.field.back()->field_offset = 4;
+  flatbuffers::FlatBufferBuilder path_builder;
+  path_builder.Finish(FlatbufferFieldPath::Pack(path_builder, &path));
+  ResolvedFieldPath resolved_path;
+  ASSERT_TRUE(reflective_builder.ResolveFieldPath(
+      flatbuffers::GetRoot<FlatbufferFieldPath>(
+          path_builder.GetBufferPointer()),
+      &resolved_path));
+  EXPECT_EQ(resolved_path.size(), 2);
+
+  std::unique_ptr<ReflectiveFlatbuffer> buffer = reflective_builder.NewRoot();
+  EXPECT_TRUE(buffer->ParseAndSet(resolved_path, "LX"));
+
+  // Try to parse with the generated code.
+  std::string serialized_entity_data = buffer->Serialize();
+  std::unique_ptr<test::EntityDataT> entity_data =
+      LoadAndVerifyMutableFlatbuffer<test::EntityData>(
+          serialized_entity_data.data(), serialized_entity_data.size());
+  EXPECT_TRUE(entity_data != nullptr);
+  EXPECT_EQ(entity_data->flight_number->carrier_code, "LX");
+}
+
+TEST(FlatbuffersTest, DoesNotResolveUnknownFieldPaths) {
+  std::string metadata_buffer = LoadTestMetadata();
+  ReflectiveFlatbufferBuilder reflective_builder(
+      flatbuffers::GetRoot<reflection::Schema>(metadata_buffer.data()));
+
+  FlatbufferFieldPathT path;
+  path.field.emplace_back(new FlatbufferFieldT);
+  path.field.back()->field_name = "flight_number";
+  path.field.emplace_back(new FlatbufferFieldT);
+  path.field.back()->field_name = "unknown_field";
+  flatbuffers::FlatBufferBuilder path_builder;
+  path_builder.Finish(FlatbufferFieldPath::Pack(path_builder, &path));
+  ResolvedFieldPath resolved_path;
+  EXPECT_FALSE(reflective_builder.ResolveFieldPath(
+      flatbuffers::GetRoot<FlatbufferFieldPath>(
+          path_builder.GetBufferPointer()),
+      &resolved_path));
+  EXPECT_TRUE(resolved_path.empty());
+
+  std::unique_ptr<ReflectiveFlatbuffer> buffer = reflective_builder.NewRoot();
+  EXPECT_FALSE(buffer->ParseAndSet(resolved_path, "LX"));
+}
+
 TEST(FlatbuffersTest, PartialBuffersAreCorrectlyMerged) {
   std::string metadata_buffer = LoadTestMetadata();
   ReflectiveFlatbufferBuilder reflective_builder(
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/i18n/locale-table.h"
+
+namespace libtextclassifier3 {
+
+constexpr int LocaleTable::kMaxLists;
+constexpr int LocaleTable::kNumCachedLocales;
+constexpr uint64 LocaleTable::kComputedBit;
+
+LocaleTable::LocaleTable()
+    : supporting_lists_(new std::atomic<uint64>[kNumCachedLocales]) {
+  for (int i = 0; i < kNumCachedLocales; ++i) {
+    supporting_lists_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+int LocaleTable::Add(const std::vector<Locale>& supported_locales) {
+  if (lists_.size() >= kMaxLists) {
+    TC3_LOG(ERROR) << "Too many lists of supported locales.";
+    return -1;
+  }
+  lists_.push_back(supported_locales);
+  return lists_.size() - 1;
+}
+
+uint64 LocaleTable::SupportingLists(const Locale& locale) const {
+  const bool is_cached =
+      locale.id() != Locale::kNoId && locale.id() < kNumCachedLocales;
+  if (is_cached) {
+    const uint64 mask =
+        supporting_lists_[locale.id()].load(std::memory_order_relaxed);
+    if (mask & kComputedBit) {
+      return mask & ~kComputedBit;
+    }
+  }
+
+  uint64 mask = 0;
+  for (int list_id = 0; list_id < lists_.size(); ++list_id) {
+    if (Locale::IsLocaleSupported(locale, lists_[list_id],
+                                  /*default_value=*/false)) {
+      mask |= uint64{1} << list_id;
+    }
+  }
+  if (is_cached) {
+    // Threads racing here store the same value.
+    supporting_lists_[locale.id()].store(mask | kComputedBit,
+                                         std::memory_order_relaxed);
+  }
+  return mask;
+}
+
+bool LocaleTable::IsAnyLocaleSupported(const std::vector<Locale>& locales,
+                                       int list_id, bool default_value) const {
+  if (locales.empty() || list_id < 0 || lists_[list_id].empty()) {
+    return default_value;
+  }
+  for (const Locale& locale : locales) {
+    if (!locale.IsValid()) {
+      continue;
+    }
+    if (locale.IsUnknown()) {
+      if (default_value) {
+        return true;
+      }
+      continue;
+    }
+    if (SupportingLists(locale) & (uint64{1} << list_id)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_I18N_LOCALE_TABLE_H_
+#define LIBTEXTCLASSIFIER_UTILS_I18N_LOCALE_TABLE_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "utils/base/integral_types.h"
+#include "utils/i18n/locale.h"
+
+namespace libtextclassifier3 {
+
+// The lists of supported locales of the rules and models of a model, numbered
+// when the model is loaded. Each locale of a request is matched against all
+// the lists once, and the lists that support it are kept as a bit mask by
+// locale id, so that checking a list for the locales of later requests is a
+// bit test per locale rather than a comparison with each supported locale.
+//
+// Lists are only added while the model is set up, the checks are thread-safe.
+class LocaleTable {
+ public:
+  static constexpr int kMaxLists = 63;
+
+  LocaleTable();
+
+  // Adds a list of supported locales, and returns its id, or -1 if the table
+  // already has kMaxLists lists.
+  int Add(const std::vector<Locale>& supported_locales);
+
+  // Same as Locale::IsAnyLocaleSupported() with the supported locales of the
+  // list.
+  bool IsAnyLocaleSupported(const std::vector<Locale>& locales, int list_id,
+                            bool default_value) const;
+
+  // Returns the lists that support the valid and known locale, as a bit per
+  // list id.
+  uint64 SupportingLists(const Locale& locale) const;
+
+ private:
+  // The masks of the locales with an id below this are kept.
+  static constexpr int kNumCachedLocales = 256;
+
+  // Set in a kept mask once it's computed.
+  static constexpr uint64 kComputedBit = uint64{1} << kMaxLists;
+
+  std::vector<std::vector<Locale>> lists_;
+
+  // The masks of SupportingLists() by locale id, or 0 if not computed yet.
+  std::unique_ptr<std::atomic<uint64>[]> supporting_lists_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_I18N_LOCALE_TABLE_H_
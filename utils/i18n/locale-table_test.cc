@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/i18n/locale-table.h"
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+std::vector<Locale> Parse(const std::string& locales_list) {
+  std::vector<Locale> locales;
+  ParseLocales(locales_list, &locales);
+  return locales;
+}
+
+TEST(LocaleTableTest, AgreesWithLocale) {
+  const std::vector<std::string> supported_lists = {"en,de", "*", "zh-Hant",
+                                                    "", "en-US,fr"};
+  LocaleTable table;
+  std::vector<int> list_ids;
+  for (const std::string& supported : supported_lists) {
+    list_ids.push_back(table.Add(Parse(supported)));
+  }
+
+  LocaleListCache cache;
+  for (const char* requested :
+       {"en", "en-GB", "fr-CA", "zh-Hant-TW", "zh-Hans", "und", "ja,und",
+        "es,de-AT", ""}) {
+    // With ids from the cache and without, twice to use the kept masks.
+    std::vector<Locale> with_ids;
+    cache.Parse(requested, &with_ids);
+    const std::vector<Locale> without_ids = Parse(requested);
+    for (int i = 0; i < 2; ++i) {
+      for (int list = 0; list < supported_lists.size(); ++list) {
+        for (const bool default_value : {false, true}) {
+          const bool expected = Locale::IsAnyLocaleSupported(
+              without_ids, Parse(supported_lists[list]), default_value);
+          EXPECT_EQ(table.IsAnyLocaleSupported(with_ids, list_ids[list],
+                                               default_value),
+                    expected)
+              << requested << " " << supported_lists[list];
+          EXPECT_EQ(table.IsAnyLocaleSupported(without_ids, list_ids[list],
+                                               default_value),
+                    expected)
+              << requested << " " << supported_lists[list];
+        }
+      }
+    }
+  }
+}
+
+TEST(LocaleTableTest, SameLocalesGetTheSameId) {
+  LocaleListCache cache;
+  std::vector<Locale> locales;
+  EXPECT_TRUE(cache.Parse("en-US,de", &locales));
+  EXPECT_TRUE(cache.Parse("de,en-US", &locales));
+  ASSERT_EQ(locales.size(), 4);
+  EXPECT_NE(locales[0].id(), Locale::kNoId);
+  EXPECT_NE(locales[0].id(), locales[1].id());
+  EXPECT_EQ(locales[0].id(), locales[3].id());
+  EXPECT_EQ(locales[1].id(), locales[2].id());
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -75,8 +75,35 @@ bool CheckRegion(StringPiece region) {
   }
 }
 
+// The locale lists last parsed on a thread.
+struct ThreadLocaleLists {
+  static constexpr int kMaxLists = 4;
+
+  struct List {
+    std::string locales_list;
+    bool success;
+    std::vector<Locale> locales;
+  };
+
+  std::vector<List> lists;
+  int next_replaced = 0;
+};
+
+// Returns the id of the locale, see Locale::id().
+int InternLocale(const Locale& locale) {
+  static std::mutex* const mutex = new std::mutex();
+  static std::unordered_map<std::string, int>* const ids =
+      new std::unordered_map<std::string, int>();
+  const std::string key =
+      locale.Language() + "-" + locale.Script() + "-" + locale.Region();
+  std::lock_guard<std::mutex> lock(*mutex);
+  return ids->emplace(key, ids->size()).first->second;
+}
+
 }  // namespace
 
+constexpr int Locale::kNoId;
+
 Locale Locale::FromBCP47(const std::string& locale_tag) {
   std::vector<StringPiece> parts = strings::Split(locale_tag, '-');
   if (parts.empty()) {
@@ -189,4 +216,69 @@ bool ParseLocales(StringPiece locales_list, std::vector<Locale>* locales) {
   return true;
 }
 
+constexpr int LocaleListCache::kDefaultMaxEntries;
+
+bool LocaleListCache::Parse(StringPiece locales_list,
+                            std::vector<Locale>* locales) {
+  // The results don't depend on the cache, so the lists of the thread serve
+  // all the caches.
+  static thread_local ThreadLocaleLists thread_lists;
+  for (const ThreadLocaleLists::List& list : thread_lists.lists) {
+    if (locales_list.Equals(list.locales_list)) {
+      locales->insert(locales->end(), list.locales.begin(),
+                      list.locales.end());
+      return list.success;
+    }
+  }
+
+  ThreadLocaleLists::List list;
+  list.locales_list = locales_list.ToString();
+  list.success = ParseShared(list.locales_list, &list.locales);
+  locales->insert(locales->end(), list.locales.begin(), list.locales.end());
+  const bool success = list.success;
+  if (thread_lists.lists.size() < ThreadLocaleLists::kMaxLists) {
+    thread_lists.lists.push_back(std::move(list));
+  } else {
+    thread_lists.lists[thread_lists.next_replaced] = std::move(list);
+    thread_lists.next_replaced =
+        (thread_lists.next_replaced + 1) % ThreadLocaleLists::kMaxLists;
+  }
+  return success;
+}
+
+bool LocaleListCache::ParseShared(const std::string& locales_list,
+                                  std::vector<Locale>* locales) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = entries_.find(locales_list);
+    if (it != entries_.end()) {
+      locales->insert(locales->end(), it->second.locales.begin(),
+                      it->second.locales.end());
+      return it->second.success;
+    }
+  }
+
+  Entry entry;
+  entry.success = ParseLocales(locales_list, &entry.locales);
+  for (Locale& locale : entry.locales) {
+    locale.id_ = InternLocale(locale);
+  }
+  locales->insert(locales->end(), entry.locales.begin(), entry.locales.end());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (entries_.size() >= max_entries_) {
+    // The set of lists in use changed, start over.
+    entries_.clear();
+  }
+  const bool success = entry.success;
+  entries_.emplace(locales_list, std::move(entry));
+  return success;
+}
+
+LocaleListCache* LocaleListCache::Default() {
+  // Never destroyed, so that it can be used until the very end.
+  static LocaleListCache* const cache = new LocaleListCache();
+  return cache;
+}
+
 }  // namespace libtextclassifier3
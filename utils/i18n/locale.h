@@ -17,7 +17,9 @@
 #ifndef LIBTEXTCLASSIFIER_UTILS_I18N_LOCALE_H_
 #define LIBTEXTCLASSIFIER_UTILS_I18N_LOCALE_H_
 
+#include <mutex>  // NOLINT
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "utils/base/integral_types.h"
@@ -48,6 +50,12 @@ class Locale {
   bool IsValid() const { return is_valid_; }
   bool IsUnknown() const;
 
+  // Id of the locale, the same for all the locales with the same language,
+  // script and region in the process, or kNoId. Only the locales parsed by a
+  // LocaleListCache get one, see LocaleTable.
+  static constexpr int kNoId = -1;
+  int id() const { return id_; }
+
   // Returns whether any of the given locales is supported by any of the
   // supported locales. Returns default value if the given 'locales' list, or
   // 'supported_locales' list is empty or an unknown locale is found.
@@ -64,6 +72,9 @@ class Locale {
         region_(region),
         is_valid_(true) {}
 
+  friend class LocaleListCache;
+  friend class LocaleTable;
+
   static bool IsLocaleSupported(const Locale& locale,
                                 const std::vector<Locale>& supported_locales,
                                 bool default_value);
@@ -72,6 +83,7 @@ class Locale {
   std::string script_;
   std::string region_;
   bool is_valid_;
+  int id_ = kNoId;
 };
 
 // Pretty-printing function for Locale.
@@ -81,6 +93,41 @@ logging::LoggingStringStream& operator<<(logging::LoggingStringStream& stream,
 // Parses a comma-separated list of BCP47 tags.
 bool ParseLocales(StringPiece locales_list, std::vector<Locale>* locales);
 
+// Remembers the results of ParseLocales() for recently seen lists. Callers
+// usually send only a handful of distinct lists, which then don't need to be
+// split and parsed again for every request. The last few lists of each thread
+// are found without locking or copying the list; the others are looked up in
+// the entries shared by the threads.
+//
+// The class is thread-safe.
+class LocaleListCache {
+ public:
+  static constexpr int kDefaultMaxEntries = 16;
+
+  explicit LocaleListCache(int max_entries = kDefaultMaxEntries)
+      : max_entries_(max_entries) {}
+
+  // Same as ParseLocales(), and gives the locales an id.
+  bool Parse(StringPiece locales_list, std::vector<Locale>* locales);
+
+  // The cache shared by all callers in the process.
+  static LocaleListCache* Default();
+
+ private:
+  struct Entry {
+    bool success;
+    std::vector<Locale> locales;
+  };
+
+  // Same as Parse(), with the entries shared by the threads.
+  bool ParseShared(const std::string& locales_list,
+                   std::vector<Locale>* locales);
+
+  const int max_entries_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, Entry> entries_;
+};
+
 }  // namespace libtextclassifier3
 
 #endif  // LIBTEXTCLASSIFIER_UTILS_I18N_LOCALE_H_
@@ -16,6 +16,10 @@
 
 #include "utils/i18n/locale.h"
 
+#include <string>
+#include <thread>  // NOLINT
+#include <vector>
+
 #include "gtest/gtest.h"
 
 namespace libtextclassifier3 {
@@ -99,5 +103,60 @@ TEST(LocaleTest, IsAnyLocaleSupportedEmptyLocales) {
                                            /*default_value=*/true));
 }
 
+TEST(LocaleTest, LocaleListCacheParsesLocales) {
+  LocaleListCache cache(/*max_entries=*/2);
+  for (int i = 0; i < 2; ++i) {
+    std::vector<Locale> locales;
+    EXPECT_TRUE(cache.Parse("en-US,zh-Hant-TW", &locales));
+    ASSERT_EQ(locales.size(), 2);
+    EXPECT_EQ(locales[0].Language(), "en");
+    EXPECT_EQ(locales[1].Script(), "Hant");
+    EXPECT_EQ(locales[1].Region(), "TW");
+  }
+
+  // Evicting entries doesn't change the results.
+  std::vector<Locale> locales;
+  EXPECT_TRUE(cache.Parse("de", &locales));
+  EXPECT_FALSE(cache.Parse("not_a_locale!", &locales));
+  EXPECT_FALSE(cache.Parse("not_a_locale!", &locales));
+  locales.clear();
+  EXPECT_TRUE(cache.Parse("en-US,zh-Hant-TW", &locales));
+  EXPECT_EQ(locales.size(), 2);
+}
+
+TEST(LocaleTest, LocaleListCacheGivesSameLocalesOnAllThreads) {
+  const std::vector<std::string> lists = {"en-US", "de,fr", "zh-Hant-TW",
+                                          "ja",    "es",    "it,pt-BR"};
+  LocaleListCache cache;
+  std::vector<std::vector<Locale>> expected(lists.size());
+  for (int i = 0; i < lists.size(); ++i) {
+    ASSERT_TRUE(cache.Parse(lists[i], &expected[i]));
+  }
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&lists, &expected, t]() {
+      // More lists than each thread remembers, and from another cache.
+      LocaleListCache other_cache;
+      for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < lists.size(); ++i) {
+          const int list = (i + t) % lists.size();
+          std::vector<Locale> locales;
+          EXPECT_TRUE(other_cache.Parse(lists[list], &locales));
+          ASSERT_EQ(locales.size(), expected[list].size());
+          for (int j = 0; j < locales.size(); ++j) {
+            EXPECT_EQ(locales[j].Language(), expected[list][j].Language());
+            EXPECT_EQ(locales[j].Region(), expected[list][j].Region());
+            EXPECT_EQ(locales[j].id(), expected[list][j].id());
+          }
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
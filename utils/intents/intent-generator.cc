@@ -16,6 +16,7 @@
 
 #include "utils/intents/intent-generator.h"
 
+#include <unordered_map>
 #include <vector>
 
 #include "actions/lua-utils.h"
@@ -26,6 +27,7 @@
 #include "utils/java/jni-base.h"
 #include "utils/java/string_utils.h"
 #include "utils/lua-utils.h"
+#include "utils/shared-string-cache.h"
 #include "utils/strings/stringpiece.h"
 #include "utils/strings/substitute.h"
 #include "utils/utf8/unicodetext.h"
@@ -54,21 +56,32 @@ static constexpr const char* kPackageNameKey = "package_name";
 static constexpr const char* kDeviceLocaleKey = "device_locales";
 static constexpr const char* kFormatKey = "format";
 
+}  // namespace
+
 // An Android specific Lua environment with JNI backed callbacks.
+// An instance can be reused for several requests and entities: the libraries
+// and the callbacks are only set up once, every generator snippet is only
+// loaded the first time it is run, and the subclasses expose the data of the
+// next entity to the snippets.
 class JniLuaEnvironment : public LuaEnvironment {
  public:
-  JniLuaEnvironment(const Resources& resources, const JniCache* jni_cache,
-                    const jobject context,
-                    const std::vector<Locale>& device_locales);
+  JniLuaEnvironment(const Resources& resources, const JniCache* jni_cache);
   // Environment setup.
   bool Initialize();
 
-  // Runs an intent generator snippet.
+  // Binds the calling thread, the Android context and the locales of a
+  // request. The context needs to outlive the following RunIntentGenerator()
+  // calls.
+  void BindContext(const jobject context,
+                   const std::vector<Locale>& device_locales);
+
+  // Runs an intent generator snippet. The snippet needs to outlive the
+  // environment, as it is only loaded on its first run.
   bool RunIntentGenerator(const std::string& generator_snippet,
                           std::vector<RemoteActionTemplate>* remote_actions);
 
  protected:
-  virtual void SetupExternalHook();
+  void SetupExternalHook();
 
   int HandleExternalCallback();
   int HandleAndroidCallback();
@@ -107,9 +120,13 @@ class JniLuaEnvironment : public LuaEnvironment {
   const Resources& resources_;
   JNIEnv* jenv_;
   const JniCache* jni_cache_;
-  const jobject context_;
+  jobject context_;
   std::vector<Locale> device_locales_;
 
+  // References to the loaded generator snippets.
+  std::unordered_map<const std::string*, int> generator_refs_;
+
+  // The UserManager of the context of the bound request.
   ScopedGlobalRef<jobject> usermanager_;
   // Whether we previously attempted to retrieve the UserManager before.
   bool usermanager_retrieved_;
@@ -124,14 +141,11 @@ class JniLuaEnvironment : public LuaEnvironment {
 };
 
 JniLuaEnvironment::JniLuaEnvironment(const Resources& resources,
-                                     const JniCache* jni_cache,
-                                     const jobject context,
-                                     const std::vector<Locale>& device_locales)
+                                     const JniCache* jni_cache)
     : resources_(resources),
       jenv_(jni_cache ? jni_cache->GetEnv() : nullptr),
       jni_cache_(jni_cache),
-      context_(context),
-      device_locales_(device_locales),
+      context_(nullptr),
       usermanager_(/*object=*/nullptr,
                    /*jvm=*/(jni_cache ? jni_cache->jvm : nullptr)),
       usermanager_retrieved_(false),
@@ -160,6 +174,18 @@ bool JniLuaEnvironment::Initialize() {
           }) == LUA_OK);
 }
 
+void JniLuaEnvironment::BindContext(const jobject context,
+                                    const std::vector<Locale>& device_locales) {
+  // The environment may have been used from another thread before.
+  jenv_ = jni_cache_->GetEnv();
+  context_ = context;
+  device_locales_ = device_locales;
+
+  // The user manager belongs to the context, the system resources are kept.
+  usermanager_.reset();
+  usermanager_retrieved_ = false;
+}
+
 void JniLuaEnvironment::SetupExternalHook() {
   // This exposes an `external` object with the following fields:
   //   * entity: the bundle with all information about a classification.
@@ -667,17 +693,22 @@ int JniLuaEnvironment::ReadRemoteActionTemplates(
 bool JniLuaEnvironment::RunIntentGenerator(
     const std::string& generator_snippet,
     std::vector<RemoteActionTemplate>* remote_actions) {
-  int status;
-  status = luaL_loadbuffer(state_, generator_snippet.data(),
-                           generator_snippet.size(),
-                           /*name=*/nullptr);
-  if (status != LUA_OK) {
-    TC3_LOG(ERROR) << "Couldn't load generator snippet: " << status;
-    return false;
+  auto it = generator_refs_.find(&generator_snippet);
+  if (it == generator_refs_.end()) {
+    const int generator_ref = LoadSnippet(generator_snippet);
+    if (generator_ref == LUA_NOREF) {
+      TC3_LOG(ERROR) << "Couldn't load generator snippet.";
+      return false;
+    }
+    it = generator_refs_.emplace(&generator_snippet, generator_ref).first;
   }
-  status = lua_pcall(state_, /*nargs=*/0, /*nresults=*/1, /*errfunc=*/0);
+
+  // Leave the stack as it was, whatever happens, as the state is reused.
+  const int stack_top = lua_gettop(state_);
+  const int status = RunSnippet(it->second, /*num_results=*/1);
   if (status != LUA_OK) {
     TC3_LOG(ERROR) << "Couldn't run generator snippet: " << status;
+    lua_settop(state_, stack_top);
     return false;
   }
   if (RunProtected(
@@ -686,13 +717,13 @@ bool JniLuaEnvironment::RunIntentGenerator(
           },
           /*num_args=*/1) != LUA_OK) {
     TC3_LOG(ERROR) << "Could not read results.";
+    lua_settop(state_, stack_top);
     return false;
   }
   // Check that we correctly cleaned-up the state.
-  const int stack_size = lua_gettop(state_);
-  if (stack_size > 0) {
+  if (lua_gettop(state_) != stack_top) {
     TC3_LOG(ERROR) << "Unexpected stack size.";
-    lua_settop(state_, 0);
+    lua_settop(state_, stack_top);
     return false;
   }
   return true;
@@ -702,32 +733,34 @@ bool JniLuaEnvironment::RunIntentGenerator(
 class AnnotatorJniEnvironment : public JniLuaEnvironment {
  public:
   AnnotatorJniEnvironment(const Resources& resources, const JniCache* jni_cache,
-                          const jobject context,
-                          const std::vector<Locale>& device_locales,
-                          const std::string& entity_text,
-                          const ClassificationResult& classification,
-                          const int64 reference_time_ms_utc,
                           const reflection::Schema* entity_data_schema)
-      : JniLuaEnvironment(resources, jni_cache, context, device_locales),
-        entity_text_(entity_text),
-        classification_(classification),
-        reference_time_ms_utc_(reference_time_ms_utc),
+      : JniLuaEnvironment(resources, jni_cache),
         entity_data_schema_(entity_data_schema) {}
 
- protected:
-  void SetupExternalHook() override {
-    JniLuaEnvironment::SetupExternalHook();
-    lua_pushinteger(state_, reference_time_ms_utc_);
-    lua_setfield(state_, /*idx=*/-2, kReferenceTimeUsecKey);
-
-    PushAnnotation(classification_, entity_text_, entity_data_schema_, this);
-    lua_setfield(state_, /*idx=*/-2, "entity");
+  // Exposes a classification to the snippets. The arguments need to outlive
+  // the following RunIntentGenerator() call.
+  bool BindClassification(const std::string& entity_text,
+                          const ClassificationResult& classification,
+                          const int64 reference_time_ms_utc) {
+    return RunProtected([this, &entity_text, &classification,
+                         reference_time_ms_utc] {
+             lua_getglobal(state_, "external");
+             lua_pushinteger(state_, reference_time_ms_utc);
+             lua_setfield(state_, /*idx=*/-2, kReferenceTimeUsecKey);
+
+             PushAnnotation(classification, entity_text, entity_data_schema_,
+                            this);
+             lua_setfield(state_, /*idx=*/-2, "entity");
+             return LUA_OK;
+           }) == LUA_OK;
   }
 
-  const std::string& entity_text_;
-  const ClassificationResult& classification_;
-  const int64 reference_time_ms_utc_;
+  // Whether the instance was created for the given entity data schema.
+  bool HasSchema(const reflection::Schema* entity_data_schema) const {
+    return entity_data_schema_ == entity_data_schema;
+  }
 
+ protected:
   // Reflection schema data.
   const reflection::Schema* const entity_data_schema_;
 };
@@ -737,36 +770,58 @@ class ActionsJniLuaEnvironment : public JniLuaEnvironment {
  public:
   ActionsJniLuaEnvironment(
       const Resources& resources, const JniCache* jni_cache,
-      const jobject context, const std::vector<Locale>& device_locales,
-      const Conversation& conversation, const ActionSuggestion& action,
       const reflection::Schema* actions_entity_data_schema,
       const reflection::Schema* annotations_entity_data_schema)
-      : JniLuaEnvironment(resources, jni_cache, context, device_locales),
-        conversation_(conversation),
-        action_(action),
+      : JniLuaEnvironment(resources, jni_cache),
         annotation_iterator_(annotations_entity_data_schema, this),
         conversation_iterator_(annotations_entity_data_schema, this),
-        entity_data_schema_(actions_entity_data_schema) {}
-
- protected:
-  void SetupExternalHook() override {
-    JniLuaEnvironment::SetupExternalHook();
-    conversation_iterator_.NewIterator("conversation", &conversation_.messages,
-                                       state_);
-    lua_setfield(state_, /*idx=*/-2, "conversation");
+        entity_data_schema_(actions_entity_data_schema),
+        annotations_entity_data_schema_(annotations_entity_data_schema) {}
+
+  // Exposes an action and its conversation to the snippets. The arguments
+  // need to outlive the following RunIntentGenerator() call.
+  bool BindAction(const Conversation& conversation,
+                  const ActionSuggestion& action) {
+    return RunProtected([this, &conversation, &action] {
+             lua_getglobal(state_, "external");
+             conversation_iterator_.NewIterator(
+                 "conversation", &conversation.messages, state_);
+             lua_setfield(state_, /*idx=*/-2, "conversation");
+
+             PushAction(action, entity_data_schema_, annotation_iterator_,
+                        this);
+             lua_setfield(state_, /*idx=*/-2, "entity");
+             return LUA_OK;
+           }) == LUA_OK;
+  }
 
-    PushAction(action_, entity_data_schema_, annotation_iterator_, this);
-    lua_setfield(state_, /*idx=*/-2, "entity");
+  // Whether the instance was created for the given entity data schemas.
+  bool HasSchemas(
+      const reflection::Schema* actions_entity_data_schema,
+      const reflection::Schema* annotations_entity_data_schema) const {
+    return entity_data_schema_ == actions_entity_data_schema &&
+           annotations_entity_data_schema_ == annotations_entity_data_schema;
   }
 
-  const Conversation& conversation_;
-  const ActionSuggestion& action_;
+ protected:
   const AnnotationIterator<ActionSuggestionAnnotation> annotation_iterator_;
   const ConversationIterator conversation_iterator_;
   const reflection::Schema* entity_data_schema_;
+  const reflection::Schema* annotations_entity_data_schema_;
 };
 
-}  // namespace
+IntentGenerator::IntentGenerator(const IntentFactoryModel* options,
+                                 const ResourcePool* resources,
+                                 const std::shared_ptr<JniCache>& jni_cache)
+    : options_(options),
+      resources_(Resources(resources)),
+      jni_cache_(jni_cache),
+      annotator_environments_(
+          new LuaEnvironmentPool<AnnotatorJniEnvironment>()),
+      actions_environments_(
+          new LuaEnvironmentPool<ActionsJniLuaEnvironment>()) {}
+
+IntentGenerator::~IntentGenerator() = default;
 
 std::unique_ptr<IntentGenerator> IntentGenerator::Create(
     const IntentFactoryModel* options, const ResourcePool* resources,
@@ -788,24 +843,31 @@ std::unique_ptr<IntentGenerator> IntentGenerator::Create(
 
   for (const IntentFactoryModel_::IntentGenerator* generator :
        *options->generator()) {
-    std::string lua_template_generator;
-    if (!zlib_decompressor->MaybeDecompressOptionallyCompressedBuffer(
+    // The generators are shared by all instances loading the same model.
+    const std::shared_ptr<const std::string> lua_template_generator =
+        zlib_decompressor->MaybeDecompressShared(
             generator->lua_template_generator(),
-            generator->compressed_lua_template_generator(),
-            &lua_template_generator)) {
+            generator->compressed_lua_template_generator());
+    if (lua_template_generator == nullptr) {
       TC3_LOG(ERROR) << "Could not decompress generator template.";
       return nullptr;
     }
 
-    std::string lua_code = lua_template_generator;
+    std::shared_ptr<const std::string> lua_code = lua_template_generator;
     if (options->precompile_generators()) {
-      if (!Compile(lua_template_generator, &lua_code)) {
+      lua_code = SharedStringCache::Instance()->GetOrCreate(
+          SharedStringCache::Key("lua-bytecode", *lua_template_generator),
+          [&lua_template_generator](std::string* bytecode) {
+            return Compile(*lua_template_generator, bytecode);
+          });
+      if (lua_code == nullptr) {
         TC3_LOG(ERROR) << "Could not precompile generator template.";
         return nullptr;
       }
     }
 
-    intent_generator->generators_[generator->type()->str()] = lua_code;
+    intent_generator->generators_[generator->type()->str()] =
+        std::move(lua_code);
   }
 
   return intent_generator;
@@ -832,6 +894,47 @@ std::vector<Locale> IntentGenerator::ParseDeviceLocales(
   return locales;
 }
 
+LuaEnvironmentPool<AnnotatorJniEnvironment>::Lease
+IntentGenerator::AcquireAnnotatorEnvironment(
+    const reflection::Schema* annotations_entity_data_schema) const {
+  LuaEnvironmentPool<AnnotatorJniEnvironment>::Lease interpreter =
+      annotator_environments_->Acquire();
+  if (interpreter != nullptr &&
+      interpreter->HasSchema(annotations_entity_data_schema)) {
+    return interpreter;
+  }
+  interpreter = std::unique_ptr<AnnotatorJniEnvironment>(
+      new AnnotatorJniEnvironment(resources_, jni_cache_.get(),
+                                  annotations_entity_data_schema));
+  if (!interpreter->Initialize()) {
+    TC3_LOG(ERROR) << "Could not create Lua interpreter.";
+    return {};
+  }
+  return interpreter;
+}
+
+LuaEnvironmentPool<ActionsJniLuaEnvironment>::Lease
+IntentGenerator::AcquireActionsEnvironment(
+    const reflection::Schema* annotations_entity_data_schema,
+    const reflection::Schema* actions_entity_data_schema) const {
+  LuaEnvironmentPool<ActionsJniLuaEnvironment>::Lease interpreter =
+      actions_environments_->Acquire();
+  if (interpreter != nullptr &&
+      interpreter->HasSchemas(actions_entity_data_schema,
+                              annotations_entity_data_schema)) {
+    return interpreter;
+  }
+  interpreter = std::unique_ptr<ActionsJniLuaEnvironment>(
+      new ActionsJniLuaEnvironment(resources_, jni_cache_.get(),
+                                   actions_entity_data_schema,
+                                   annotations_entity_data_schema));
+  if (!interpreter->Initialize()) {
+    TC3_LOG(ERROR) << "Could not create Lua interpreter.";
+    return {};
+  }
+  return interpreter;
+}
+
 bool IntentGenerator::GenerateIntents(
     const jstring device_locales, const ClassificationResult& classification,
     const int64 reference_time_ms_utc, const std::string& text,
@@ -852,18 +955,73 @@ bool IntentGenerator::GenerateIntents(
       UTF8ToUnicodeText(text, /*do_copy=*/false)
           .UTF8Substring(selection_indices.first, selection_indices.second);
 
-  std::unique_ptr<AnnotatorJniEnvironment> interpreter(
-      new AnnotatorJniEnvironment(
-          resources_, jni_cache_.get(), context,
-          ParseDeviceLocales(device_locales), entity_text, classification,
-          reference_time_ms_utc, annotations_entity_data_schema));
+  LuaEnvironmentPool<AnnotatorJniEnvironment>::Lease interpreter =
+      AcquireAnnotatorEnvironment(annotations_entity_data_schema);
+  if (interpreter == nullptr) {
+    return false;
+  }
+  interpreter->BindContext(context, ParseDeviceLocales(device_locales));
+  if (!interpreter->BindClassification(entity_text, classification,
+                                       reference_time_ms_utc) ||
+      !interpreter->RunIntentGenerator(*it->second, remote_actions)) {
+    return false;
+  }
+  annotator_environments_->Release(std::move(interpreter));
+  return true;
+}
 
-  if (!interpreter->Initialize()) {
-    TC3_LOG(ERROR) << "Could not create Lua interpreter.";
+bool IntentGenerator::GenerateIntents(
+    const jstring device_locales,
+    const std::vector<ClassificationResult>& classifications,
+    const int64 reference_time_ms_utc, const std::string& text,
+    const CodepointSpan selection_indices, const jobject context,
+    const reflection::Schema* annotations_entity_data_schema,
+    std::vector<std::vector<RemoteActionTemplate>>* remote_actions) const {
+  remote_actions->clear();
+  remote_actions->resize(classifications.size());
+  if (options_ == nullptr) {
     return false;
   }
 
-  return interpreter->RunIntentGenerator(it->second, remote_actions);
+  const std::string entity_text =
+      UTF8ToUnicodeText(text, /*do_copy=*/false)
+          .UTF8Substring(selection_indices.first, selection_indices.second);
+  std::vector<Locale> locales;
+  bool locales_parsed = false;
+  LuaEnvironmentPool<AnnotatorJniEnvironment>::Lease interpreter;
+  bool success = true;
+  for (int i = 0; i < classifications.size(); i++) {
+    // Retrieve generator for the entity.
+    auto it = generators_.find(classifications[i].collection);
+    if (it == generators_.end()) {
+      continue;
+    }
+
+    // The environment and the locales are only set up once needed, and then
+    // shared by all the following results.
+    if (interpreter == nullptr) {
+      interpreter = AcquireAnnotatorEnvironment(annotations_entity_data_schema);
+      if (interpreter == nullptr) {
+        return false;
+      }
+      if (!locales_parsed) {
+        locales = ParseDeviceLocales(device_locales);
+        locales_parsed = true;
+      }
+      interpreter->BindContext(context, locales);
+    }
+    if (!interpreter->BindClassification(entity_text, classifications[i],
+                                         reference_time_ms_utc) ||
+        !interpreter->RunIntentGenerator(*it->second,
+                                         &(*remote_actions)[i])) {
+      // Don't reuse an environment that failed, the following results get a
+      // fresh one.
+      interpreter = LuaEnvironmentPool<AnnotatorJniEnvironment>::Lease();
+      success = false;
+    }
+  }
+  annotator_environments_->Release(std::move(interpreter));
+  return success;
 }
 
 bool IntentGenerator::GenerateIntents(
@@ -882,18 +1040,70 @@ bool IntentGenerator::GenerateIntents(
     return true;
   }
 
-  std::unique_ptr<ActionsJniLuaEnvironment> interpreter(
-      new ActionsJniLuaEnvironment(
-          resources_, jni_cache_.get(), context,
-          ParseDeviceLocales(device_locales), conversation, action,
-          actions_entity_data_schema, annotations_entity_data_schema));
+  LuaEnvironmentPool<ActionsJniLuaEnvironment>::Lease interpreter =
+      AcquireActionsEnvironment(annotations_entity_data_schema,
+                                actions_entity_data_schema);
+  if (interpreter == nullptr) {
+    return false;
+  }
+  interpreter->BindContext(context, ParseDeviceLocales(device_locales));
+  if (!interpreter->BindAction(conversation, action) ||
+      !interpreter->RunIntentGenerator(*it->second, remote_actions)) {
+    return false;
+  }
+  actions_environments_->Release(std::move(interpreter));
+  return true;
+}
 
-  if (!interpreter->Initialize()) {
-    TC3_LOG(ERROR) << "Could not create Lua interpreter.";
+bool IntentGenerator::GenerateIntents(
+    const jstring device_locales,
+    const std::vector<ActionSuggestion>& actions,
+    const Conversation& conversation, const jobject context,
+    const reflection::Schema* annotations_entity_data_schema,
+    const reflection::Schema* actions_entity_data_schema,
+    std::vector<std::vector<RemoteActionTemplate>>* remote_actions) const {
+  remote_actions->clear();
+  remote_actions->resize(actions.size());
+  if (options_ == nullptr) {
     return false;
   }
 
-  return interpreter->RunIntentGenerator(it->second, remote_actions);
+  std::vector<Locale> locales;
+  bool locales_parsed = false;
+  LuaEnvironmentPool<ActionsJniLuaEnvironment>::Lease interpreter;
+  bool success = true;
+  for (int i = 0; i < actions.size(); i++) {
+    // Retrieve generator for the action.
+    auto it = generators_.find(actions[i].type);
+    if (it == generators_.end()) {
+      continue;
+    }
+
+    // The environment and the locales are only set up once needed, and then
+    // shared by all the following actions.
+    if (interpreter == nullptr) {
+      interpreter = AcquireActionsEnvironment(annotations_entity_data_schema,
+                                              actions_entity_data_schema);
+      if (interpreter == nullptr) {
+        return false;
+      }
+      if (!locales_parsed) {
+        locales = ParseDeviceLocales(device_locales);
+        locales_parsed = true;
+      }
+      interpreter->BindContext(context, locales);
+    }
+    if (!interpreter->BindAction(conversation, actions[i]) ||
+        !interpreter->RunIntentGenerator(*it->second,
+                                         &(*remote_actions)[i])) {
+      // Don't reuse an environment that failed, the following actions get a
+      // fresh one.
+      interpreter = LuaEnvironmentPool<ActionsJniLuaEnvironment>::Lease();
+      success = false;
+    }
+  }
+  actions_environments_->Release(std::move(interpreter));
+  return success;
 }
 
 }  // namespace libtextclassifier3
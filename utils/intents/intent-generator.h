@@ -14,6 +14,7 @@
 #include "utils/intents/intent-config_generated.h"
 #include "utils/java/jni-cache.h"
 #include "utils/java/scoped_local_ref.h"
+#include "utils/lua-utils.h"
 #include "utils/optional.h"
 #include "utils/resources.h"
 #include "utils/resources_generated.h"
@@ -63,6 +64,9 @@ struct RemoteActionTemplate {
   Optional<int> request_code;
 };
 
+class AnnotatorJniEnvironment;
+class ActionsJniLuaEnvironment;
+
 // Helper class to generate Android intents for text classifier results.
 class IntentGenerator {
  public:
@@ -70,6 +74,8 @@ class IntentGenerator {
       const IntentFactoryModel* options, const ResourcePool* resources,
       const std::shared_ptr<JniCache>& jni_cache);
 
+  ~IntentGenerator();
+
   // Generates intents for a classification result.
   // Returns true, if the intent generator snippets could be successfully run,
   // returns false otherwise.
@@ -82,6 +88,19 @@ class IntentGenerator {
                        const reflection::Schema* annotations_entity_data_schema,
                        std::vector<RemoteActionTemplate>* remote_actions) const;
 
+  // Generates intents for all classification results of a request, with the
+  // device locales parsed once and one Lua environment shared by all results.
+  // Fills `remote_actions` with the intents of each result, in the order of
+  // the results. Returns false if any of the generator snippets failed, the
+  // intents of the other results are still filled in.
+  bool GenerateIntents(
+      const jstring device_locales,
+      const std::vector<ClassificationResult>& classifications,
+      const int64 reference_time_ms_utc, const std::string& text,
+      const CodepointSpan selection_indices, const jobject context,
+      const reflection::Schema* annotations_entity_data_schema,
+      std::vector<std::vector<RemoteActionTemplate>>* remote_actions) const;
+
   // Generates intents for an action suggestion.
   // Returns true, if the intent generator snippets could be successfully run,
   // returns false otherwise.
@@ -92,20 +111,44 @@ class IntentGenerator {
                        const reflection::Schema* actions_entity_data_schema,
                        std::vector<RemoteActionTemplate>* remote_actions) const;
 
+  // Same as above, but for all action suggestions of a request, see the batch
+  // form for classification results.
+  bool GenerateIntents(
+      const jstring device_locales,
+      const std::vector<ActionSuggestion>& actions,
+      const Conversation& conversation, const jobject context,
+      const reflection::Schema* annotations_entity_data_schema,
+      const reflection::Schema* actions_entity_data_schema,
+      std::vector<std::vector<RemoteActionTemplate>>* remote_actions) const;
+
  private:
   IntentGenerator(const IntentFactoryModel* options,
                   const ResourcePool* resources,
-                  const std::shared_ptr<JniCache>& jni_cache)
-      : options_(options),
-        resources_(Resources(resources)),
-        jni_cache_(jni_cache) {}
+                  const std::shared_ptr<JniCache>& jni_cache);
 
   std::vector<Locale> ParseDeviceLocales(const jstring device_locales) const;
 
+  // Checks out an idle Lua environment for the schemas, or sets up a new one.
+  LuaEnvironmentPool<AnnotatorJniEnvironment>::Lease
+  AcquireAnnotatorEnvironment(
+      const reflection::Schema* annotations_entity_data_schema) const;
+  LuaEnvironmentPool<ActionsJniLuaEnvironment>::Lease AcquireActionsEnvironment(
+      const reflection::Schema* annotations_entity_data_schema,
+      const reflection::Schema* actions_entity_data_schema) const;
+
   const IntentFactoryModel* options_;
   const Resources resources_;
   std::shared_ptr<JniCache> jni_cache_;
-  std::map<std::string, std::string> generators_;
+  std::map<std::string, std::shared_ptr<const std::string>> generators_;
+
+  // Idle Lua environments. Setting up an environment (creating the state,
+  // loading the libraries and binding the callbacks) is much more expensive
+  // than running a generator snippet, so the environments are reused for the
+  // following requests, together with the snippets they loaded.
+  std::unique_ptr<LuaEnvironmentPool<AnnotatorJniEnvironment>>
+      annotator_environments_;
+  std::unique_ptr<LuaEnvironmentPool<ActionsJniLuaEnvironment>>
+      actions_environments_;
 };
 
 }  // namespace libtextclassifier3
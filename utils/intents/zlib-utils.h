@@ -23,6 +23,9 @@ namespace libtextclassifier3 {
 
 bool CompressIntentModel(IntentFactoryModelT* intent_model);
 
+// Decompresses the intent generators in place.
+bool DecompressIntentModel(IntentFactoryModelT* intent_model);
+
 }  // namespace libtextclassifier3
 
 #endif  // LIBTEXTCLASSIFIER_UTILS_INTENTS_ZLIB_UTILS_H_
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/java/jni-async.h"
+
+#include <utility>
+
+#include "utils/base/logging.h"
+#include "utils/thread-pool.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+// Number of threads serving asynchronous requests. Requests are latency
+// bound rather than throughput bound, so a small pool is enough and keeps
+// them from competing with the per-request annotation pool.
+constexpr int kNumJniWorkerThreads = 2;
+
+// The pool lives for the whole process: its threads stay attached to the VM.
+ThreadPool* JniWorkerPool() {
+  static ThreadPool* pool = new ThreadPool(kNumJniWorkerThreads);
+  return pool;
+}
+
+// Returns the JNIEnv of the current thread, attaching it to the VM as a
+// daemon if needed. Returns nullptr on error.
+JNIEnv* GetOrAttachJniEnv(JavaVM* jvm) {
+  JNIEnv* env = nullptr;
+  if (jvm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_4) == JNI_OK) {
+    return env;
+  }
+#ifdef __ANDROID__
+  JNIEnv** env_out = &env;
+#else
+  void** env_out = reinterpret_cast<void**>(&env);
+#endif
+  if (jvm->AttachCurrentThreadAsDaemon(env_out, nullptr) != JNI_OK) {
+    TC3_LOG(ERROR) << "Couldn't attach the JNI worker thread.";
+    return nullptr;
+  }
+  return env;
+}
+
+// Initial capacity of the local reference frame of a task.
+constexpr jint kTaskLocalFrameCapacity = 16;
+
+}  // namespace
+
+void ScheduleJniTask(JavaVM* jvm, std::function<void(JNIEnv*)> task) {
+  JniWorkerPool()->Schedule([jvm, task = std::move(task)]() {
+    JNIEnv* env = GetOrAttachJniEnv(jvm);
+    if (env == nullptr) {
+      return;
+    }
+    if (env->PushLocalFrame(kTaskLocalFrameCapacity) != JNI_OK) {
+      TC3_LOG_EVERY_N_SEC(ERROR, 10)
+          << "Couldn't push a local frame for the JNI task.";
+      env->ExceptionClear();
+      return;
+    }
+    task(env);
+    if (env->ExceptionCheck()) {
+      TC3_LOG_EVERY_N_SEC(ERROR, 10)
+          << "Asynchronous JNI task left a pending exception.";
+      env->ExceptionDescribe();
+      env->ExceptionClear();
+    }
+    env->PopLocalFrame(nullptr);
+  });
+}
+
+std::shared_ptr<CancellationToken> GetAsyncRequestToken(jlong request_ptr) {
+  if (!request_ptr) {
+    return nullptr;
+  }
+  return *reinterpret_cast<std::shared_ptr<CancellationToken>*>(request_ptr);
+}
+
+}  // namespace libtextclassifier3
+
+using libtextclassifier3::CancellationToken;
+
+TC3_JNI_METHOD(jlong, TC3_ASYNC_REQUEST_CLASS_NAME, nativeNewAsyncRequest)
+(JNIEnv* env, jobject clazz) {
+  return reinterpret_cast<jlong>(new std::shared_ptr<CancellationToken>(
+      std::make_shared<CancellationToken>()));
+}
+
+TC3_JNI_METHOD(void, TC3_ASYNC_REQUEST_CLASS_NAME, nativeCancelAsyncRequest)
+(JNIEnv* env, jobject clazz, jlong request_ptr) {
+  if (!request_ptr) {
+    return;
+  }
+  (*reinterpret_cast<std::shared_ptr<CancellationToken>*>(request_ptr))
+      ->Cancel();
+}
+
+TC3_JNI_METHOD(void, TC3_ASYNC_REQUEST_CLASS_NAME, nativeCloseAsyncRequest)
+(JNIEnv* env, jobject clazz, jlong request_ptr) {
+  delete reinterpret_cast<std::shared_ptr<CancellationToken>*>(request_ptr);
+}
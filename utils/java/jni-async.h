@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Native worker pool for asynchronous JNI requests, and the natives of the
+// Java AsyncRequest handle used to cancel them.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_JAVA_JNI_ASYNC_H_
+#define LIBTEXTCLASSIFIER_UTILS_JAVA_JNI_ASYNC_H_
+
+#include <jni.h>
+
+#include <functional>
+#include <memory>
+
+#include "utils/cancellation.h"
+#include "utils/java/jni-base.h"
+
+#ifndef TC3_ASYNC_REQUEST_CLASS_NAME
+#define TC3_ASYNC_REQUEST_CLASS_NAME AsyncRequest
+#endif
+
+#define TC3_ASYNC_REQUEST_CLASS_NAME_STR \
+  TC3_ADD_QUOTES(TC3_ASYNC_REQUEST_CLASS_NAME)
+
+namespace libtextclassifier3 {
+
+// Runs the task on the process-wide JNI worker pool. The worker threads are
+// attached to the VM as daemons on first use and stay attached; the task gets
+// the JNIEnv of its worker and runs inside its own local reference frame. A
+// Java exception left pending by the task is logged and cleared.
+void ScheduleJniTask(JavaVM* jvm, std::function<void(JNIEnv*)> task);
+
+// Returns the cancellation token of the AsyncRequest with the given native
+// pointer, or nullptr if the pointer is 0.
+std::shared_ptr<CancellationToken> GetAsyncRequestToken(jlong request_ptr);
+
+}  // namespace libtextclassifier3
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+TC3_JNI_METHOD(jlong, TC3_ASYNC_REQUEST_CLASS_NAME, nativeNewAsyncRequest)
+(JNIEnv* env, jobject clazz);
+
+TC3_JNI_METHOD(void, TC3_ASYNC_REQUEST_CLASS_NAME, nativeCancelAsyncRequest)
+(JNIEnv* env, jobject clazz, jlong request_ptr);
+
+TC3_JNI_METHOD(void, TC3_ASYNC_REQUEST_CLASS_NAME, nativeCloseAsyncRequest)
+(JNIEnv* env, jobject clazz, jlong request_ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_JAVA_JNI_ASYNC_H_
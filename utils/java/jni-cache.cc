@@ -141,6 +141,8 @@ std::unique_ptr<JniCache> JniCache::Create(JNIEnv* env) {
   TC3_GET_METHOD(matcher, matches, "matches", "()Z");
   TC3_GET_METHOD(matcher, find, "find", "()Z");
   TC3_GET_METHOD(matcher, reset, "reset", "()Ljava/util/regex/Matcher;");
+  TC3_GET_METHOD(matcher, reset_text, "reset",
+                 "(Ljava/lang/CharSequence;)Ljava/util/regex/Matcher;");
   TC3_GET_METHOD(matcher, start_idx, "start", "(I)I");
   TC3_GET_METHOD(matcher, end_idx, "end", "(I)I");
   TC3_GET_METHOD(matcher, group, "group", "()Ljava/lang/String;");
@@ -199,6 +201,8 @@ std::unique_ptr<JniCache> JniCache::Create(JNIEnv* env) {
   TC3_GET_CLASS(timezone, "java/util/TimeZone");
   TC3_GET_STATIC_METHOD(timezone, get_timezone, "getTimeZone",
                         "(Ljava/lang/String;)Ljava/util/TimeZone;");
+  TC3_GET_METHOD(timezone, get_offset, "getOffset", "(J)I");
+  TC3_GET_METHOD(timezone, get_raw_offset, "getRawOffset", "()I");
 
   // URLEncoder.
   TC3_GET_CLASS(urlencoder, "java/net/URLEncoder");
@@ -254,7 +258,8 @@ JNIEnv* JniCache::GetEnv() const {
   if (JNI_OK == jvm->GetEnv(&env, JNI_VERSION_1_4)) {
     return reinterpret_cast<JNIEnv*>(env);
   } else {
-    TC3_LOG(ERROR) << "JavaICU UniLib used on unattached thread";
+    TC3_LOG_EVERY_N_SEC(ERROR, 10)
+        << "JavaICU UniLib used on unattached thread";
     return nullptr;
   }
 }
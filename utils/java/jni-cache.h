@@ -53,6 +53,7 @@ struct JniCache {
   jmethodID matcher_matches = nullptr;
   jmethodID matcher_find = nullptr;
   jmethodID matcher_reset = nullptr;
+  jmethodID matcher_reset_text = nullptr;
   jmethodID matcher_start_idx = nullptr;
   jmethodID matcher_end_idx = nullptr;
   jmethodID matcher_group = nullptr;
@@ -105,6 +106,8 @@ struct JniCache {
   // java.util.TimeZone
   ScopedGlobalRef<jclass> timezone_class;
   jmethodID timezone_get_timezone = nullptr;
+  jmethodID timezone_get_offset = nullptr;
+  jmethodID timezone_get_raw_offset = nullptr;
 
   // java.net.URLEncoder
   ScopedGlobalRef<jclass> urlencoder_class;
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/java/jni-warmup.h"
+
+#include "utils/base/logging.h"
+#include "utils/java/scoped_local_ref.h"
+
+namespace libtextclassifier3 {
+
+jobjectArray WarmupReportToJObjectArray(JNIEnv* env,
+                                        const WarmupReport& report) {
+  const ScopedLocalRef<jclass> named_variant_class(
+      env->FindClass(TC3_PACKAGE_PATH TC3_NAMED_VARIANT_CLASS_NAME_STR), env);
+  if (!named_variant_class) {
+    TC3_LOG(ERROR) << "Couldn't find NamedVariant class.";
+    return nullptr;
+  }
+  const jmethodID named_variant_from_long = env->GetMethodID(
+      named_variant_class.get(), "<init>", "(Ljava/lang/String;J)V");
+  if (!named_variant_from_long) {
+    TC3_LOG(ERROR) << "Couldn't find NamedVariant constructor.";
+    return nullptr;
+  }
+
+  const std::vector<WarmupReport::Phase>& phases = report.phases();
+  jobjectArray result =
+      env->NewObjectArray(phases.size(), named_variant_class.get(), nullptr);
+  if (!result) {
+    return nullptr;
+  }
+  for (int i = 0; i < phases.size(); i++) {
+    const int64 duration_us =
+        phases[i].success
+            ? phases[i].duration_us
+            : (phases[i].duration_us > 0 ? -phases[i].duration_us : -1);
+    const ScopedLocalRef<jstring> name(
+        env->NewStringUTF(phases[i].name.c_str()), env);
+    const ScopedLocalRef<jobject> phase(
+        env->NewObject(named_variant_class.get(), named_variant_from_long,
+                       name.get(), static_cast<jlong>(duration_us)),
+        env);
+    env->SetObjectArrayElement(result, i, phase.get());
+  }
+  return result;
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Conversion of warm-up reports to Java objects.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_JAVA_JNI_WARMUP_H_
+#define LIBTEXTCLASSIFIER_UTILS_JAVA_JNI_WARMUP_H_
+
+#include <jni.h>
+
+#include "utils/java/jni-base.h"
+#include "utils/warmup.h"
+
+#ifndef TC3_NAMED_VARIANT_CLASS_NAME
+#define TC3_NAMED_VARIANT_CLASS_NAME NamedVariant
+#endif
+
+#define TC3_NAMED_VARIANT_CLASS_NAME_STR \
+  TC3_ADD_QUOTES(TC3_NAMED_VARIANT_CLASS_NAME)
+
+namespace libtextclassifier3 {
+
+// Converts the report to a NamedVariant[] holding the duration of every phase
+// in microseconds (as a long), named after the phase. The duration of a phase
+// that failed is negated, and -1 if it took no measurable time. Returns
+// nullptr on error.
+jobjectArray WarmupReportToJObjectArray(JNIEnv* env,
+                                        const WarmupReport& report);
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_JAVA_JNI_WARMUP_H_
@@ -16,6 +16,7 @@
 
 #include "utils/java/string_utils.h"
 
+#include "utils/base/integral_types.h"
 #include "utils/base/logging.h"
 
 namespace libtextclassifier3 {
@@ -42,26 +43,46 @@ bool JStringToUtf8String(JNIEnv* env, const jstring& jstr,
     return false;
   }
 
-  jclass string_class = env->FindClass("java/lang/String");
-  if (!string_class) {
-    TC3_LOG(ERROR) << "Can't find String class";
+  // Encodes the UTF-16 chars directly instead of calling String.getBytes, so
+  // that no Java byte array is created. As in String.getBytes, unpaired
+  // surrogates are encoded as '?'.
+  const jsize length = env->GetStringLength(jstr);
+  const jchar* chars = env->GetStringCritical(jstr, nullptr);
+  if (chars == nullptr) {
+    TC3_LOG_EVERY_N_SEC(ERROR, 10) << "Can't get string chars";
     return false;
   }
-
-  jmethodID get_bytes_id =
-      env->GetMethodID(string_class, "getBytes", "(Ljava/lang/String;)[B");
-
-  jstring encoding = env->NewStringUTF("UTF-8");
-
-  jbyteArray array = reinterpret_cast<jbyteArray>(
-      env->CallObjectMethod(jstr, get_bytes_id, encoding));
-
-  JByteArrayToString(env, array, result);
-
-  // Release the array.
-  env->DeleteLocalRef(array);
-  env->DeleteLocalRef(string_class);
-  env->DeleteLocalRef(encoding);
+  result->clear();
+  result->reserve(length);
+  for (jsize i = 0; i < length; i++) {
+    uint32 codepoint = chars[i];
+    if (codepoint >= 0xD800 && codepoint <= 0xDFFF) {
+      if (codepoint <= 0xDBFF && i + 1 < length && chars[i + 1] >= 0xDC00 &&
+          chars[i + 1] <= 0xDFFF) {
+        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) +
+                    (chars[i + 1] - 0xDC00);
+        ++i;
+      } else {
+        codepoint = '?';
+      }
+    }
+    if (codepoint < 0x80) {
+      result->push_back(static_cast<char>(codepoint));
+    } else if (codepoint < 0x800) {
+      result->push_back(static_cast<char>(0xC0 | (codepoint >> 6)));
+      result->push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    } else if (codepoint < 0x10000) {
+      result->push_back(static_cast<char>(0xE0 | (codepoint >> 12)));
+      result->push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+      result->push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    } else {
+      result->push_back(static_cast<char>(0xF0 | (codepoint >> 18)));
+      result->push_back(static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F)));
+      result->push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+      result->push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    }
+  }
+  env->ReleaseStringCritical(jstr, chars);
 
   return true;
 }
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/lua-allocator.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace libtextclassifier3 {
+
+constexpr size_t LuaAllocator::kSizeClassBytes;
+constexpr size_t LuaAllocator::kMaxArenaBlockBytes;
+constexpr int LuaAllocator::kNumSizeClasses;
+constexpr size_t LuaAllocator::kChunkBytes;
+
+LuaAllocator::LuaAllocator(bool use_arena) : use_arena_(use_arena) {}
+
+// Blocks outside of the arena have to be freed by the state before, which
+// lua_close() does.
+LuaAllocator::~LuaAllocator() = default;
+
+void* LuaAllocator::Allocate(void* allocator, void* ptr, size_t old_size,
+                             size_t new_size) {
+  return static_cast<LuaAllocator*>(allocator)->Reallocate(ptr, old_size,
+                                                           new_size);
+}
+
+void* LuaAllocator::Reallocate(void* ptr, size_t old_size, size_t new_size) {
+  // For new blocks, lua passes the type of the object as the old size.
+  if (ptr == nullptr) {
+    old_size = 0;
+  }
+
+  if (new_size == 0) {
+    if (ptr != nullptr) {
+      if (IsArenaSize(old_size)) {
+        FreeToArena(ptr, old_size);
+      } else {
+        free(ptr);
+      }
+      bytes_in_use_ -= old_size;
+    }
+    return nullptr;
+  }
+
+  // Only growing allocations can fail, lua expects shrinking to succeed.
+  if (memory_limit_bytes_ > 0 && new_size > old_size &&
+      bytes_in_use_ + (new_size - old_size) > memory_limit_bytes_) {
+    return nullptr;
+  }
+
+  void* result;
+  if (!IsArenaSize(old_size) && !IsArenaSize(new_size)) {
+    // `old_size` is 0 for new blocks, so both are large blocks here.
+    result = realloc(ptr, new_size);
+  } else if (ptr != nullptr && IsArenaSize(old_size) &&
+             IsArenaSize(new_size) &&
+             SizeClass(old_size) == SizeClass(new_size)) {
+    // The block is big enough already.
+    result = ptr;
+  } else {
+    result = IsArenaSize(new_size) ? AllocateFromArena(new_size)
+                                   : malloc(new_size);
+    if (result != nullptr && ptr != nullptr) {
+      memcpy(result, ptr, std::min(old_size, new_size));
+      if (IsArenaSize(old_size)) {
+        FreeToArena(ptr, old_size);
+      } else {
+        free(ptr);
+      }
+    }
+  }
+  if (result == nullptr) {
+    return nullptr;
+  }
+
+  bytes_in_use_ = bytes_in_use_ - old_size + new_size;
+  peak_bytes_in_use_ = std::max(peak_bytes_in_use_, bytes_in_use_);
+  return result;
+}
+
+void* LuaAllocator::AllocateFromArena(size_t size) {
+  const int size_class = SizeClass(size);
+  if (free_blocks_[size_class] != nullptr) {
+    void* block = free_blocks_[size_class];
+    free_blocks_[size_class] = *static_cast<void**>(block);
+    return block;
+  }
+
+  const size_t block_size = (size_class + 1) * kSizeClassBytes;
+  if (chunk_offset_ + block_size > kChunkBytes) {
+    chunks_.emplace_back(new char[kChunkBytes]);
+    chunk_offset_ = 0;
+  }
+  void* block = chunks_.back().get() + chunk_offset_;
+  chunk_offset_ += block_size;
+  return block;
+}
+
+void LuaAllocator::FreeToArena(void* ptr, size_t size) {
+  const int size_class = SizeClass(size);
+  *static_cast<void**>(ptr) = free_blocks_[size_class];
+  free_blocks_[size_class] = ptr;
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_LUA_ALLOCATOR_H_
+#define LIBTEXTCLASSIFIER_UTILS_LUA_ALLOCATOR_H_
+
+#include <stddef.h>
+
+#include <memory>
+#include <vector>
+
+namespace libtextclassifier3 {
+
+// Memory allocator for a lua state, to be passed to lua_newstate() with
+// `Allocate` as the lua_Alloc function and the allocator as its user data.
+//
+// It accounts for the memory used by the state, and can bound it: allocations
+// that would exceed the limit fail, which lua reports as a memory error to the
+// running script.
+//
+// Optionally, small blocks (most of the strings, tables and closures a script
+// creates) are carved from an arena of larger chunks instead of calling malloc
+// for each of them. Freed small blocks are kept in free lists by size for
+// reuse, and all chunks are released at once with the allocator.
+//
+// The allocator is not thread-safe, just like the lua state it serves.
+class LuaAllocator {
+ public:
+  explicit LuaAllocator(bool use_arena = true);
+  ~LuaAllocator();
+
+  // The lua_Alloc function.
+  static void* Allocate(void* allocator, void* ptr, size_t old_size,
+                        size_t new_size);
+
+  // Bytes currently allocated by the state, and the maximum so far.
+  size_t bytes_in_use() const { return bytes_in_use_; }
+  size_t peak_bytes_in_use() const { return peak_bytes_in_use_; }
+
+  // Sets the maximum number of bytes the state can allocate, 0 disables the
+  // limit.
+  void set_memory_limit_bytes(size_t limit) { memory_limit_bytes_ = limit; }
+
+ private:
+  static constexpr size_t kSizeClassBytes = 16;
+  static constexpr size_t kMaxArenaBlockBytes = 256;
+  static constexpr int kNumSizeClasses =
+      kMaxArenaBlockBytes / kSizeClassBytes;
+  static constexpr size_t kChunkBytes = 16 * 1024;
+
+  void* Reallocate(void* ptr, size_t old_size, size_t new_size);
+
+  // Whether blocks of the size are served from the arena.
+  bool IsArenaSize(size_t size) const {
+    return use_arena_ && size <= kMaxArenaBlockBytes;
+  }
+
+  static int SizeClass(size_t size) {
+    return (size + kSizeClassBytes - 1) / kSizeClassBytes - 1;
+  }
+
+  void* AllocateFromArena(size_t size);
+  void FreeToArena(void* ptr, size_t size);
+
+  const bool use_arena_;
+  size_t bytes_in_use_ = 0;
+  size_t peak_bytes_in_use_ = 0;
+  size_t memory_limit_bytes_ = 0;
+
+  // Chunks of the arena, the last one is being carved.
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  size_t chunk_offset_ = kChunkBytes;
+
+  // Heads of the lists of free blocks in each size class. A free block holds
+  // the pointer to the next one.
+  void* free_blocks_[kNumSizeClasses] = {};
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_LUA_ALLOCATOR_H_
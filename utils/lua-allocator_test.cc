@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/lua-allocator.h"
+
+#include <string.h>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+class LuaAllocatorTest : public testing::TestWithParam<bool> {};
+
+INSTANTIATE_TEST_SUITE_P(WithAndWithoutArena, LuaAllocatorTest,
+                         testing::Bool());
+
+TEST_P(LuaAllocatorTest, AccountsForAllocatedMemory) {
+  LuaAllocator allocator(/*use_arena=*/GetParam());
+  void* small = LuaAllocator::Allocate(&allocator, nullptr, /*type=*/4, 24);
+  void* large = LuaAllocator::Allocate(&allocator, nullptr, /*type=*/5, 1000);
+  ASSERT_NE(small, nullptr);
+  ASSERT_NE(large, nullptr);
+  EXPECT_EQ(allocator.bytes_in_use(), 1024);
+
+  EXPECT_EQ(LuaAllocator::Allocate(&allocator, small, 24, 0), nullptr);
+  EXPECT_EQ(LuaAllocator::Allocate(&allocator, large, 1000, 0), nullptr);
+  EXPECT_EQ(allocator.bytes_in_use(), 0);
+  EXPECT_EQ(allocator.peak_bytes_in_use(), 1024);
+}
+
+TEST_P(LuaAllocatorTest, KeepsContentWhenReallocating) {
+  LuaAllocator allocator(/*use_arena=*/GetParam());
+  char* block = static_cast<char*>(
+      LuaAllocator::Allocate(&allocator, nullptr, /*type=*/4, 10));
+  ASSERT_NE(block, nullptr);
+  memcpy(block, "0123456789", 10);
+
+  // Grows through the size classes of the arena into a large block.
+  size_t old_size = 10;
+  for (size_t size : {20, 100, 2000}) {
+    block = static_cast<char*>(
+        LuaAllocator::Allocate(&allocator, block, old_size, size));
+    ASSERT_NE(block, nullptr);
+    EXPECT_EQ(memcmp(block, "0123456789", 10), 0);
+    old_size = size;
+  }
+  block =
+      static_cast<char*>(LuaAllocator::Allocate(&allocator, block, 2000, 8));
+  ASSERT_NE(block, nullptr);
+  EXPECT_EQ(memcmp(block, "01234567", 8), 0);
+  EXPECT_EQ(allocator.bytes_in_use(), 8);
+  LuaAllocator::Allocate(&allocator, block, 8, 0);
+}
+
+TEST_P(LuaAllocatorTest, FailsAllocationsOverTheLimit) {
+  LuaAllocator allocator(/*use_arena=*/GetParam());
+  allocator.set_memory_limit_bytes(100);
+  void* block = LuaAllocator::Allocate(&allocator, nullptr, /*type=*/4, 80);
+  ASSERT_NE(block, nullptr);
+  EXPECT_EQ(LuaAllocator::Allocate(&allocator, nullptr, /*type=*/4, 40),
+            nullptr);
+  EXPECT_EQ(LuaAllocator::Allocate(&allocator, block, 80, 120), nullptr);
+  EXPECT_EQ(allocator.bytes_in_use(), 80);
+
+  // Shrinking always succeeds.
+  allocator.set_memory_limit_bytes(10);
+  block = LuaAllocator::Allocate(&allocator, block, 80, 40);
+  EXPECT_NE(block, nullptr);
+  EXPECT_EQ(allocator.bytes_in_use(), 40);
+  LuaAllocator::Allocate(&allocator, block, 40, 0);
+}
+
+TEST(LuaAllocatorArenaTest, ReusesFreedBlocks) {
+  LuaAllocator allocator(/*use_arena=*/true);
+  void* first = LuaAllocator::Allocate(&allocator, nullptr, /*type=*/4, 32);
+  LuaAllocator::Allocate(&allocator, first, 32, 0);
+  void* second = LuaAllocator::Allocate(&allocator, nullptr, /*type=*/4, 30);
+  EXPECT_EQ(first, second);
+  LuaAllocator::Allocate(&allocator, second, 30, 0);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
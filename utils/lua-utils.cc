@@ -16,6 +16,8 @@
 
 #include "utils/lua-utils.h"
 
+#include "utils/base/logging.h"
+
 // lua_dump takes an extra argument "strip" in 5.3, but not in 5.2.
 #ifndef TC3_AOSP
 #define lua_dump(L, w, d, s) lua_dump((L), (w), (d))
@@ -44,9 +46,23 @@ int LuaStringWriter(lua_State *state, const void *data, size_t size,
   return LUA_OK;
 }
 
+// Reports errors raised outside of a protected call, like luaL_newstate does.
+int Panic(lua_State *state) {
+  TC3_LOG(ERROR) << "Unprotected error in lua: "
+                 << (lua_type(state, -1) == LUA_TSTRING
+                         ? lua_tostring(state, -1)
+                         : "unknown error");
+  return 0;
+}
+
 }  // namespace
 
-LuaEnvironment::LuaEnvironment() { state_ = luaL_newstate(); }
+LuaEnvironment::LuaEnvironment() {
+  state_ = lua_newstate(&LuaAllocator::Allocate, &allocator_);
+  if (state_ != nullptr) {
+    lua_atpanic(state_, &Panic);
+  }
+}
 
 LuaEnvironment::~LuaEnvironment() {
   if (state_ != nullptr) {
@@ -76,7 +92,8 @@ void LuaEnvironment::PushFlatbuffer(const char *name,
                                     const flatbuffers::Table *table,
                                     lua_State *state) {
   lua_newtable(state);
-  luaL_newmetatable(state, name);
+  // Not a named metatable, as its `__index` closure is bound to `table`.
+  lua_createtable(state, /*narr=*/0, /*nrec=*/1);
   lua_pushlightuserdata(state, AsUserData(schema));
   lua_pushlightuserdata(state, AsUserData(type));
   lua_pushlightuserdata(state, AsUserData(table));
@@ -257,6 +274,12 @@ void LuaEnvironment::PushFlatbuffer(const reflection::Schema *schema,
                  schema->root_table(), table, state_);
 }
 
+int LuaEnvironment::PushFlatbufferField(const reflection::Schema *schema,
+                                        const flatbuffers::Table *table,
+                                        lua_State *state) {
+  return GetField(schema, schema->root_table(), table, state);
+}
+
 int LuaEnvironment::RunProtected(const std::function<int()> &func,
                                  const int num_args, const int num_results) {
   struct ProtectedCall {
@@ -279,6 +302,37 @@ int LuaEnvironment::RunProtected(const std::function<int()> &func,
   return lua_pcall(state_, num_args, num_results, /*errorfunc=*/0);
 }
 
+int LuaEnvironment::LoadSnippet(StringPiece snippet) {
+  if (luaL_loadbuffer(state_, snippet.data(), snippet.size(),
+                      /*name=*/nullptr) != LUA_OK) {
+    TC3_LOG(ERROR) << "Could not load lua snippet: "
+                   << ReadString(/*index=*/-1).ToString();
+    lua_pop(state_, 1);
+    return LUA_NOREF;
+  }
+  return luaL_ref(state_, LUA_REGISTRYINDEX);
+}
+
+int LuaEnvironment::RunSnippet(int snippet_ref, const int num_results) {
+  const int status = RunProtected(
+      [this, snippet_ref] {
+        lua_rawgeti(state_, LUA_REGISTRYINDEX, snippet_ref);
+        lua_newtable(state_);
+        lua_newtable(state_);
+        lua_pushglobaltable(state_);
+        lua_setfield(state_, /*idx=*/-2, kIndexKey);
+        lua_setmetatable(state_, /*idx=*/-2);
+        // The globals of a loaded snippet are its first upvalue, `_ENV`.
+        lua_setupvalue(state_, /*funcindex=*/-2, /*n=*/1);
+        return 1;
+      },
+      /*num_args=*/0, /*num_results=*/1);
+  if (status != LUA_OK) {
+    return status;
+  }
+  return lua_pcall(state_, /*nargs=*/0, num_results, /*errfunc=*/0);
+}
+
 bool LuaEnvironment::Compile(StringPiece snippet, std::string *bytecode) {
   if (luaL_loadbuffer(state_, snippet.data(), snippet.size(),
                       /*name=*/nullptr) != LUA_OK) {
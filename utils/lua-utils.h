@@ -17,10 +17,17 @@
 #ifndef LIBTEXTCLASSIFIER_UTILS_LUA_UTILS_H_
 #define LIBTEXTCLASSIFIER_UTILS_LUA_UTILS_H_
 
+#include <algorithm>
+#include <condition_variable>  // NOLINT
+#include <cstddef>
 #include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <utility>
 #include <vector>
 
 #include "utils/flatbuffers.h"
+#include "utils/lua-allocator.h"
 #include "utils/strings/stringpiece.h"
 #include "utils/variant.h"
 #include "flatbuffers/reflection_generated.h"
@@ -87,9 +94,12 @@ class LuaEnvironment {
   template <typename T>
   class ItemIterator : public Iterator {
    public:
+    // Pushes a table that lazily provides the items. Every iterator table gets
+    // its own metatable, so it stays bound to `items` when other iterators of
+    // the same name are created. `name` is kept for the callers' benefit.
     void NewIterator(StringPiece name, const T *items, lua_State *state) const {
       lua_newtable(state);
-      luaL_newmetatable(state, name.data());
+      lua_createtable(state, /*narr=*/0, /*nrec=*/3);
       lua_pushlightuserdata(state, AsUserData(this));
       lua_pushlightuserdata(state, AsUserData(items));
       lua_pushcclosure(state, &Iterator::ItemCallback, 2);
@@ -221,10 +231,17 @@ class LuaEnvironment {
   // Pushes a string to the stack.
   void PushString(const StringPiece str);
 
-  // Pushes a flatbuffer to the stack.
+  // Pushes a flatbuffer to the stack. Fields are read from the table when they
+  // are accessed, so the table needs to outlive the lua value.
   void PushFlatbuffer(const reflection::Schema *schema,
                       const flatbuffers::Table *table);
 
+  // Pushes the field of a flatbuffer table named by the key on top of the
+  // stack. Raises a lua error if the root type has no such field.
+  static int PushFlatbufferField(const reflection::Schema *schema,
+                                 const flatbuffers::Table *table,
+                                 lua_State *state);
+
   // Reads a flatbuffer from the stack.
   int ReadFlatbuffer(ReflectiveFlatbuffer *buffer);
 
@@ -235,12 +252,38 @@ class LuaEnvironment {
   int RunProtected(const std::function<int()> &func, const int num_args = 0,
                    const int num_results = 0);
 
+  // Loads a snippet (source or compiled bytecode) once, so that it can be run
+  // repeatedly with RunSnippet. Returns a reference to the loaded snippet, or
+  // LUA_NOREF if it couldn't be loaded.
+  int LoadSnippet(StringPiece snippet);
+
+  // Runs a snippet loaded with LoadSnippet, leaving `num_results` results on
+  // the stack. Every run gets a fresh table of globals that falls back to the
+  // shared globals, so that runs don't see the globals set by earlier ones.
+  // Returns LUA_OK on success.
+  int RunSnippet(int snippet_ref, const int num_results);
+
   lua_State *state() const { return state_; }
 
+  // Memory currently allocated by the lua state, and the maximum so far.
+  size_t memory_usage_bytes() const { return allocator_.bytes_in_use(); }
+  size_t peak_memory_usage_bytes() const {
+    return allocator_.peak_bytes_in_use();
+  }
+
+  // Bounds the memory the lua state can allocate, scripts going over it fail
+  // with a memory error. 0 disables the limit.
+  void SetMemoryLimit(size_t limit_bytes) {
+    allocator_.set_memory_limit_bytes(limit_bytes);
+  }
+
  protected:
   lua_State *state_;
 
  private:
+  // Serves the allocations of `state_`, so needs to outlive it.
+  LuaAllocator allocator_;
+
   // Auxiliary methods to expose (reflective) flatbuffer based data to Lua.
   static void PushFlatbuffer(const char *name, const reflection::Schema *schema,
                              const reflection::Object *type,
@@ -259,6 +302,154 @@ class LuaEnvironment {
 
 bool Compile(StringPiece snippet, std::string *bytecode);
 
+// Keeps idle lua environments of one kind around, so that setting them up
+// (creating the state, loading the libraries and snippets) doesn't need to be
+// repeated for every request. Environments are checked out with Acquire() and
+// handed back with Release(), and are only ever used by one caller at a time.
+//
+// The pool also bounds the number of live environments, idle or checked out,
+// as each one holds a lua state: once the bound is reached, Acquire() blocks
+// until another caller hands an environment back or drops it.
+// The class is thread-safe.
+template <typename T>
+class LuaEnvironmentPool {
+ public:
+  static constexpr int kDefaultMaxIdleEnvironments = 4;
+  static constexpr int kDefaultMaxEnvironments = 16;
+
+  // An environment checked out of the pool. The lease holds one of the slots
+  // of the live environments until it is handed back with Release(), or is
+  // destroyed together with its environment.
+  class Lease {
+   public:
+    Lease() = default;
+    Lease(Lease&& other)
+        : pool_(other.pool_), environment_(std::move(other.environment_)) {
+      other.pool_ = nullptr;
+    }
+    Lease& operator=(Lease&& other) {
+      if (this != &other) {
+        Drop();
+        pool_ = other.pool_;
+        environment_ = std::move(other.environment_);
+        other.pool_ = nullptr;
+      }
+      return *this;
+    }
+    ~Lease() { Drop(); }
+
+    // Sets up the lease with a new environment, e.g. when the pool had no
+    // idle one. A previous environment is destroyed.
+    Lease& operator=(std::unique_ptr<T> environment) {
+      environment_ = std::move(environment);
+      return *this;
+    }
+
+    T* get() const { return environment_.get(); }
+    T* operator->() const { return environment_.get(); }
+    T& operator*() const { return *environment_; }
+    bool operator==(std::nullptr_t) const { return environment_ == nullptr; }
+    bool operator!=(std::nullptr_t) const { return environment_ != nullptr; }
+
+   private:
+    friend class LuaEnvironmentPool;
+
+    explicit Lease(LuaEnvironmentPool* pool) : pool_(pool) {}
+
+    // Destroys the environment and frees the slot.
+    void Drop() {
+      environment_.reset();
+      if (pool_ != nullptr) {
+        pool_->FreeSlot();
+        pool_ = nullptr;
+      }
+    }
+
+    LuaEnvironmentPool* pool_ = nullptr;
+    std::unique_ptr<T> environment_;
+  };
+
+  explicit LuaEnvironmentPool(
+      int max_idle_environments = kDefaultMaxIdleEnvironments,
+      int max_environments = kDefaultMaxEnvironments)
+      : max_idle_environments_(max_idle_environments),
+        max_environments_(std::max(1, max_environments)) {}
+
+  // Checks out an idle environment. The lease has no environment if there is
+  // none idle, and the caller needs to set up a new one. Blocks while the
+  // maximum number of environments is live and none of them is idle.
+  Lease Acquire() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    slot_freed_.wait(lock, [this]() {
+      return !idle_environments_.empty() || num_live_ < max_environments_;
+    });
+    Lease lease(this);
+    if (idle_environments_.empty()) {
+      ++num_live_;
+    } else {
+      lease.environment_ = std::move(idle_environments_.back());
+      idle_environments_.pop_back();
+    }
+    return lease;
+  }
+
+  // Hands an environment back to the pool. If the pool already holds the
+  // maximum number of idle environments, or the lease has no environment,
+  // the environment is destroyed and its slot freed.
+  void Release(Lease lease) {
+    if (lease.pool_ != this || lease.environment_ == nullptr) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (idle_environments_.size() >= max_idle_environments_) {
+        return;
+      }
+      idle_environments_.push_back(std::move(lease.environment_));
+      lease.pool_ = nullptr;
+    }
+    slot_freed_.notify_one();
+  }
+
+  // Number of live environments, idle or checked out.
+  int NumLiveEnvironments() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return num_live_;
+  }
+
+  // Memory allocated by the lua states of the idle environments.
+  size_t IdleMemoryUsageBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t num_bytes = 0;
+    for (const std::unique_ptr<T>& environment : idle_environments_) {
+      num_bytes += environment->memory_usage_bytes();
+    }
+    return num_bytes;
+  }
+
+ private:
+  void FreeSlot() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      --num_live_;
+    }
+    slot_freed_.notify_one();
+  }
+
+  const int max_idle_environments_;
+  const int max_environments_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable slot_freed_;
+  std::vector<std::unique_ptr<T>> idle_environments_;
+  int num_live_ = 0;
+};
+
+template <typename T>
+constexpr int LuaEnvironmentPool<T>::kDefaultMaxIdleEnvironments;
+template <typename T>
+constexpr int LuaEnvironmentPool<T>::kDefaultMaxEnvironments;
+
 }  // namespace libtextclassifier3
 
 #endif  // LIBTEXTCLASSIFIER_UTILS_LUA_UTILS_H_
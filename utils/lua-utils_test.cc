@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/lua-utils.h"
+
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <memory>
+#include <thread>  // NOLINT
+#include <utility>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+struct TestEnvironment {
+  explicit TestEnvironment(int id) : id(id) {}
+  int id;
+};
+
+using TestPool = LuaEnvironmentPool<TestEnvironment>;
+
+TEST(LuaEnvironmentPoolTest, ReusesReleasedEnvironments) {
+  TestPool pool(/*max_idle_environments=*/1, /*max_environments=*/2);
+  TestPool::Lease lease = pool.Acquire();
+  EXPECT_EQ(lease, nullptr);
+  lease = std::unique_ptr<TestEnvironment>(new TestEnvironment(1));
+  pool.Release(std::move(lease));
+  EXPECT_EQ(pool.NumLiveEnvironments(), 1);
+
+  lease = pool.Acquire();
+  ASSERT_NE(lease, nullptr);
+  EXPECT_EQ(lease->id, 1);
+  EXPECT_EQ(pool.NumLiveEnvironments(), 1);
+}
+
+TEST(LuaEnvironmentPoolTest, DroppedEnvironmentsFreeTheirSlots) {
+  TestPool pool(/*max_idle_environments=*/1, /*max_environments=*/2);
+  {
+    TestPool::Lease first = pool.Acquire();
+    first = std::unique_ptr<TestEnvironment>(new TestEnvironment(1));
+    TestPool::Lease second = pool.Acquire();
+    second = std::unique_ptr<TestEnvironment>(new TestEnvironment(2));
+    EXPECT_EQ(pool.NumLiveEnvironments(), 2);
+
+    // Only one is kept idle, the other one is destroyed.
+    pool.Release(std::move(first));
+    pool.Release(std::move(second));
+    EXPECT_EQ(pool.NumLiveEnvironments(), 1);
+  }
+  {
+    // Failed environments are dropped instead of being released.
+    TestPool::Lease lease = pool.Acquire();
+    TestPool::Lease other = pool.Acquire();
+    EXPECT_EQ(pool.NumLiveEnvironments(), 2);
+  }
+  EXPECT_EQ(pool.NumLiveEnvironments(), 0);
+}
+
+TEST(LuaEnvironmentPoolTest, BlocksAtMaxEnvironments) {
+  TestPool pool(/*max_idle_environments=*/1, /*max_environments=*/2);
+  TestPool::Lease first = pool.Acquire();
+  first = std::unique_ptr<TestEnvironment>(new TestEnvironment(1));
+  TestPool::Lease second = pool.Acquire();
+  second = std::unique_ptr<TestEnvironment>(new TestEnvironment(2));
+
+  std::atomic<bool> acquired(false);
+  int acquired_id = 0;
+  std::thread thread([&pool, &acquired, &acquired_id]() {
+    TestPool::Lease lease = pool.Acquire();
+    acquired_id = lease != nullptr ? lease->id : -1;
+    acquired = true;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT_FALSE(acquired);
+  EXPECT_EQ(pool.NumLiveEnvironments(), 2);
+
+  // The waiting caller gets the released environment.
+  pool.Release(std::move(first));
+  thread.join();
+  EXPECT_TRUE(acquired);
+  EXPECT_EQ(acquired_id, 1);
+  EXPECT_EQ(pool.NumLiveEnvironments(), 1);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
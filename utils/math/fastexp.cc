@@ -16,6 +16,20 @@
 
 #include "utils/math/fastexp.h"
 
+#include <algorithm>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TC3_FASTEXP_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define TC3_FASTEXP_SSE2
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TC3_FASTEXP_AVX2
+#endif
+#endif
+
 namespace libtextclassifier3 {
 
 const int FastMathClass::kBits;
@@ -45,4 +59,157 @@ const FastMathClass::Table FastMathClass::cache_ = {
      7940441, 8029106, 8118253, 8207884, 8298001}
 };
 
+namespace {
+
+// exp(x) is computed as 2^n * exp(r), with n = round(x / ln(2)) and
+// r = x - n * ln(2) in [-ln(2) / 2, ln(2) / 2]. exp(r) is approximated with a
+// polynomial (coefficients from Cephes' expf), 2^n is built directly in the
+// exponent bits. ln(2) is split in two parts so that n * kLn2Hi is exact.
+constexpr float kExpMin = -88.0f;
+constexpr float kExpMax = 88.0f;
+constexpr float kLog2OfE = 1.44269504088896340736f;
+constexpr float kLn2Hi = 0.693359375f;
+constexpr float kLn2Lo = -2.12194440e-4f;
+constexpr float kExpP0 = 1.9875691500e-4f;
+constexpr float kExpP1 = 1.3981999507e-3f;
+constexpr float kExpP2 = 8.3334519073e-3f;
+constexpr float kExpP3 = 4.1665795894e-2f;
+constexpr float kExpP4 = 1.6666665459e-1f;
+constexpr float kExpP5 = 5.0000001201e-1f;
+
+// Rounding is done by truncating x / ln(2) + 128.5, which is positive for all
+// clamped inputs, and subtracting 128 again. This gives n in [-127, 127]; for
+// n = -127 the exponent bits, and thus the result, are 0.
+constexpr float kRoundingOffset = 128.5f;
+constexpr int kRoundingBias = 128;
+
+#if defined(TC3_FASTEXP_NEON)
+
+constexpr int kExpLanes = 4;
+
+void ExpLanes(const float* values, float* result) {
+  const float32x4_t x =
+      vminq_f32(vmaxq_f32(vld1q_f32(values), vdupq_n_f32(kExpMin)),
+                vdupq_n_f32(kExpMax));
+  const int32x4_t n = vsubq_s32(
+      vcvtq_s32_f32(vaddq_f32(vmulq_f32(x, vdupq_n_f32(kLog2OfE)),
+                              vdupq_n_f32(kRoundingOffset))),
+      vdupq_n_s32(kRoundingBias));
+  const float32x4_t fn = vcvtq_f32_s32(n);
+  const float32x4_t r =
+      vsubq_f32(vsubq_f32(x, vmulq_f32(fn, vdupq_n_f32(kLn2Hi))),
+                vmulq_f32(fn, vdupq_n_f32(kLn2Lo)));
+  float32x4_t p = vdupq_n_f32(kExpP0);
+  p = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(kExpP1));
+  p = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(kExpP2));
+  p = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(kExpP3));
+  p = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(kExpP4));
+  p = vaddq_f32(vmulq_f32(p, r), vdupq_n_f32(kExpP5));
+  const float32x4_t y = vaddq_f32(
+      vaddq_f32(vmulq_f32(vmulq_f32(p, r), r), r), vdupq_n_f32(1.0f));
+  const float32x4_t scale = vreinterpretq_f32_s32(
+      vshlq_n_s32(vaddq_s32(n, vdupq_n_s32(127)), 23));
+  vst1q_f32(result, vmulq_f32(y, scale));
+}
+
+#elif defined(TC3_FASTEXP_AVX2)
+
+constexpr int kExpLanes = 8;
+
+void ExpLanes(const float* values, float* result) {
+  const __m256 x =
+      _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(values),
+                                  _mm256_set1_ps(kExpMin)),
+                    _mm256_set1_ps(kExpMax));
+  const __m256i n = _mm256_sub_epi32(
+      _mm256_cvttps_epi32(_mm256_add_ps(
+          _mm256_mul_ps(x, _mm256_set1_ps(kLog2OfE)),
+          _mm256_set1_ps(kRoundingOffset))),
+      _mm256_set1_epi32(kRoundingBias));
+  const __m256 fn = _mm256_cvtepi32_ps(n);
+  const __m256 r = _mm256_sub_ps(
+      _mm256_sub_ps(x, _mm256_mul_ps(fn, _mm256_set1_ps(kLn2Hi))),
+      _mm256_mul_ps(fn, _mm256_set1_ps(kLn2Lo)));
+  __m256 p = _mm256_set1_ps(kExpP0);
+  p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(kExpP1));
+  p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(kExpP2));
+  p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(kExpP3));
+  p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(kExpP4));
+  p = _mm256_add_ps(_mm256_mul_ps(p, r), _mm256_set1_ps(kExpP5));
+  const __m256 y = _mm256_add_ps(
+      _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(p, r), r), r),
+      _mm256_set1_ps(1.0f));
+  const __m256 scale = _mm256_castsi256_ps(
+      _mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23));
+  _mm256_storeu_ps(result, _mm256_mul_ps(y, scale));
+}
+
+#elif defined(TC3_FASTEXP_SSE2)
+
+constexpr int kExpLanes = 4;
+
+void ExpLanes(const float* values, float* result) {
+  const __m128 x = _mm_min_ps(
+      _mm_max_ps(_mm_loadu_ps(values), _mm_set1_ps(kExpMin)),
+      _mm_set1_ps(kExpMax));
+  const __m128i n = _mm_sub_epi32(
+      _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(kLog2OfE)),
+                                  _mm_set1_ps(kRoundingOffset))),
+      _mm_set1_epi32(kRoundingBias));
+  const __m128 fn = _mm_cvtepi32_ps(n);
+  const __m128 r =
+      _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(fn, _mm_set1_ps(kLn2Hi))),
+                 _mm_mul_ps(fn, _mm_set1_ps(kLn2Lo)));
+  __m128 p = _mm_set1_ps(kExpP0);
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(kExpP1));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(kExpP2));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(kExpP3));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(kExpP4));
+  p = _mm_add_ps(_mm_mul_ps(p, r), _mm_set1_ps(kExpP5));
+  const __m128 y = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, r), r), r), _mm_set1_ps(1.0f));
+  const __m128 scale = _mm_castsi128_ps(
+      _mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+  _mm_storeu_ps(result, _mm_mul_ps(y, scale));
+}
+
+#else
+
+constexpr int kExpLanes = 1;
+
+void ExpLanes(const float* values, float* result) {
+  const float x = std::min(std::max(*values, kExpMin), kExpMax);
+  const int32 n =
+      static_cast<int32>(x * kLog2OfE + kRoundingOffset) - kRoundingBias;
+  const float fn = n;
+  const float r = x - fn * kLn2Hi - fn * kLn2Lo;
+  float p = kExpP0;
+  p = p * r + kExpP1;
+  p = p * r + kExpP2;
+  p = p * r + kExpP3;
+  p = p * r + kExpP4;
+  p = p * r + kExpP5;
+  const float y = p * r * r + r + 1.0f;
+  *result = y * bit_cast<float>((n + 127) << 23);
+}
+
+#endif
+
+}  // namespace
+
+void VectorizedExp(const float* values, int size, float* result) {
+  int i = 0;
+  for (; i + kExpLanes <= size; i += kExpLanes) {
+    ExpLanes(values + i, result + i);
+  }
+  if (i < size) {
+    // Run the tail through the same kernel, so that all values get exactly the
+    // same approximation.
+    float tail[kExpLanes] = {};
+    std::copy(values + i, values + size, tail);
+    ExpLanes(tail, tail);
+    std::copy(tail, tail + (size - i), result + i);
+  }
+}
+
 }  // namespace libtextclassifier3
@@ -62,6 +62,13 @@ extern FastMathClass FastMathInstance;
 
 inline float VeryFastExp(float f) { return FastMathInstance.VeryFastExp(f); }
 
+// Computes exp(values[i]) for all size values and writes them to result, which
+// may be the values array itself. Evaluates 4 (NEON, SSE2) or 8 (AVX2) lanes at
+// a time with a polynomial approximation, which is more precise than
+// VeryFastExp (relative error around 1e-7). Inputs are clamped to [-88, 88];
+// values below -87.7 come out as exactly 0.
+void VectorizedExp(const float* values, int size, float* result);
+
 }  // namespace libtextclassifier3
 
 #endif  // LIBTEXTCLASSIFIER_UTILS_MATH_FASTEXP_H_
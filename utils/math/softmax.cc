@@ -16,6 +16,7 @@
 
 #include "utils/math/softmax.h"
 
+#include <algorithm>
 #include <limits>
 
 #include "utils/base/logging.h"
@@ -23,10 +24,26 @@
 
 namespace libtextclassifier3 {
 
+namespace {
+
+// Scores this far below the reference score are treated as having probability
+// 0. VectorizedExp returns exactly 0 for them.
+constexpr float kUnderflowScore = -100.0f;
+
+// Number of exponentials evaluated together by ComputeSoftmaxProbability.
+constexpr int kBlockSize = 64;
+
+}  // namespace
+
 float ComputeSoftmaxProbability(const std::vector<float> &scores, int label) {
-  if ((label < 0) || (label >= scores.size())) {
+  return ComputeSoftmaxProbability(scores.data(), scores.size(), label);
+}
+
+float ComputeSoftmaxProbability(const float *scores, int scores_size,
+                                int label) {
+  if ((label < 0) || (label >= scores_size)) {
     TC3_LOG(ERROR) << "label " << label << " outside range "
-                   << "[0, " << scores.size() << ")";
+                   << "[0, " << scores_size << ")";
     return 0.0f;
   }
 
@@ -41,30 +58,31 @@ float ComputeSoftmaxProbability(const std::vector<float> &scores, int label) {
   // which saves two calls to exp().
   const float label_score = scores[label];
   float denominator = 1.0f;  // Contribution of i == label.
-  for (int i = 0; i < scores.size(); ++i) {
-    if (i == label) continue;
-    const float delta_score = scores[i] - label_score;
-
-    // TODO(salcianu): one can optimize the test below, to avoid any float
-    // operation: extract exponent (via bit mask + shift) and check it's >= 4.
-    if (fabs(delta_score) >= 16.0f) {
-      if (delta_score > 0.0f) {
+  float exp_deltas[kBlockSize];
+  for (int begin = 0; begin < scores_size; begin += kBlockSize) {
+    const int block_size = std::min(kBlockSize, scores_size - begin);
+    for (int k = 0; k < block_size; ++k) {
+      const int i = begin + k;
+      const float delta_score = scores[i] - label_score;
+      if (delta_score >= 16.0f) {
         // If delta_score >= 16, the denominator (e^delta_score + other positive
         // terms) is very big and its inverse can be approximated with 0.
         return 0.0f;
-      } else {
-        // If delta_score <= -16, then e^delta_score < 1.2e-7.  Even if we have
-        // 1000 such labels i, their sum is < 1.2e-4 (which gets summed with
-        // 1.0f for i == label).  Hence, we can approximate each such label with
-        // 0 and skip the call to VeryFastExp and the update to denominator.
-        continue;
       }
+      // If delta_score <= -16, then e^delta_score < 1.2e-7.  Even if we have
+      // 1000 such labels i, their sum is < 1.2e-4 (which gets summed with
+      // 1.0f for i == label).  Hence, we can approximate each such label with
+      // 0.
+      exp_deltas[k] = (i == label || delta_score <= -16.0f) ? kUnderflowScore
+                                                            : delta_score;
     }
 
-    // At this point, delta_score is in (-16.0, 16.0).  For such values, vfexp
-    // works fine: no under/overflows (we have tests for that in fastexp_test).
-    // Also, even for 1000 labels, denominator will not overflow.
-    denominator += VeryFastExp(delta_score);
+    // At this point, all deltas are in (-16.0, 16.0), so even for 1000 labels
+    // the denominator will not overflow.
+    VectorizedExp(exp_deltas, block_size, exp_deltas);
+    for (int k = 0; k < block_size; ++k) {
+      denominator += exp_deltas[k];
+    }
   }
   return 1.0f / denominator;
 }
@@ -74,31 +92,34 @@ std::vector<float> ComputeSoftmax(const std::vector<float> &scores) {
 }
 
 std::vector<float> ComputeSoftmax(const float *scores, int scores_size) {
-  std::vector<float> softmax;
-  std::vector<float> exp_scores;
-  exp_scores.reserve(scores_size);
-  softmax.reserve(scores_size);
+  std::vector<float> softmax(scores_size);
+  ComputeSoftmax(scores, scores_size, softmax.data());
+  return softmax;
+}
 
+void ComputeSoftmax(const float *scores, int scores_size, float *softmax) {
   // Find max value in "scores" vector and rescale to avoid overflows.
-  float max = std::numeric_limits<float>::min();
+  float max = std::numeric_limits<float>::lowest();
   for (int i = 0; i < scores_size; ++i) {
     const float score = scores[i];
     if (score > max) max = score;
   }
-  float denominator = 0;
   for (int i = 0; i < scores_size; ++i) {
-    const float score = scores[i];
     // See comments above in ComputeSoftmaxProbability for the reasoning behind
     // this approximation.
-    const float exp_score = score - max < -16.0f ? 0 : VeryFastExp(score - max);
-    exp_scores.push_back(exp_score);
-    denominator += exp_score;
+    const float delta_score = scores[i] - max;
+    softmax[i] = delta_score < -16.0f ? kUnderflowScore : delta_score;
   }
+  VectorizedExp(softmax, scores_size, softmax);
 
+  float denominator = 0;
   for (int i = 0; i < scores_size; ++i) {
-    softmax.push_back(exp_scores[i] / denominator);
+    denominator += softmax[i];
+  }
+  const float inverse_denominator = 1.0f / denominator;
+  for (int i = 0; i < scores_size; ++i) {
+    softmax[i] *= inverse_denominator;
   }
-  return softmax;
 }
 
 }  // namespace libtextclassifier3
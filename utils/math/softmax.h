@@ -26,6 +26,10 @@ namespace libtextclassifier3 {
 // scores.size()).
 float ComputeSoftmaxProbability(const std::vector<float> &scores, int label);
 
+// Same as above but operates on an array of floats.
+float ComputeSoftmaxProbability(const float *scores, int scores_size,
+                                int label);
+
 // Computes and returns a softmax for a given vector of floats.  Parameter
 // "scores" is the vector of softmax logits.
 std::vector<float> ComputeSoftmax(const std::vector<float> &scores);
@@ -33,6 +37,11 @@ std::vector<float> ComputeSoftmax(const std::vector<float> &scores);
 // Same as above but operates on an array of floats.
 std::vector<float> ComputeSoftmax(const float *scores, int scores_size);
 
+// Same as above but writes the softmax to an array of scores_size floats,
+// which may be the scores array itself. Doesn't allocate, and evaluates the
+// exponentials with VectorizedExp.
+void ComputeSoftmax(const float *scores, int scores_size, float *softmax);
+
 }  // namespace libtextclassifier3
 
 #endif  // LIBTEXTCLASSIFIER_UTILS_MATH_SOFTMAX_H_
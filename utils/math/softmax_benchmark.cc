@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+
+#include "utils/math/softmax.h"
+#include "utils/testing/benchmark-utils.h"
+#include "benchmark/benchmark.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+// Argument: the number of scores, from the few labels of the classification
+// model to the candidates of a long text.
+void BM_ComputeSoftmax(benchmark::State& state) {
+  std::vector<float> scores(state.range(0));
+  for (int i = 0; i < scores.size(); ++i) {
+    scores[i] = static_cast<float>(i % 17) - 8.0f;
+  }
+  RunMeasuredBenchmark(state, /*bytes_per_call=*/0, [&]() {
+    benchmark::DoNotOptimize(ComputeSoftmax(scores));
+  });
+}
+BENCHMARK(BM_ComputeSoftmax)->RangeMultiplier(8)->Range(8, 4096);
+
+void BM_ComputeSoftmaxInPlace(benchmark::State& state) {
+  std::vector<float> scores(state.range(0));
+  std::vector<float> softmax(scores.size());
+  for (int i = 0; i < scores.size(); ++i) {
+    scores[i] = static_cast<float>(i % 17) - 8.0f;
+  }
+  RunMeasuredBenchmark(state, /*bytes_per_call=*/0, [&]() {
+    ComputeSoftmax(scores.data(), scores.size(), softmax.data());
+    benchmark::DoNotOptimize(softmax.data());
+  });
+}
+BENCHMARK(BM_ComputeSoftmaxInPlace)->RangeMultiplier(8)->Range(8, 4096);
+
+}  // namespace
+}  // namespace libtextclassifier3
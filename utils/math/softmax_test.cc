@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/math/softmax.h"
+
+#include <cmath>
+#include <vector>
+
+#include "utils/math/fastexp.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+std::vector<float> ReferenceSoftmax(const std::vector<float>& scores) {
+  double max = scores[0];
+  for (const float score : scores) {
+    max = std::max(max, static_cast<double>(score));
+  }
+  double denominator = 0;
+  for (const float score : scores) {
+    denominator += std::exp(score - max);
+  }
+  std::vector<float> softmax;
+  for (const float score : scores) {
+    softmax.push_back(std::exp(score - max) / denominator);
+  }
+  return softmax;
+}
+
+TEST(VectorizedExpTest, MatchesExp) {
+  // Odd size, to also cover the values that don't fill whole lanes.
+  std::vector<float> values;
+  for (float x = -87.0f; x < 88.0f; x += 0.173f) {
+    values.push_back(x);
+  }
+  std::vector<float> result(values.size());
+  VectorizedExp(values.data(), values.size(), result.data());
+  for (int i = 0; i < values.size(); ++i) {
+    const double expected = std::exp(static_cast<double>(values[i]));
+    EXPECT_NEAR(result[i], expected, expected * 1e-6) << values[i];
+  }
+}
+
+TEST(VectorizedExpTest, WorksInPlaceAndFlushesToZero) {
+  std::vector<float> values = {0.0f, 1.0f, -1.0f, -88.0f, -1000.0f};
+  VectorizedExp(values.data(), values.size(), values.data());
+  EXPECT_EQ(values[0], 1.0f);
+  EXPECT_NEAR(values[1], 2.7182817f, 1e-6);
+  EXPECT_NEAR(values[2], 0.36787944f, 1e-7);
+  EXPECT_EQ(values[3], 0.0f);
+  EXPECT_EQ(values[4], 0.0f);
+}
+
+TEST(SoftmaxTest, MatchesReference) {
+  std::vector<float> scores;
+  for (int i = 0; i < 37; ++i) {
+    scores.push_back(std::sin(i) * 5.0f);
+  }
+  const std::vector<float> expected = ReferenceSoftmax(scores);
+  const std::vector<float> softmax = ComputeSoftmax(scores);
+  ASSERT_EQ(softmax.size(), expected.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(softmax[i], expected[i], 1e-6);
+    EXPECT_NEAR(ComputeSoftmaxProbability(scores, i), expected[i], 1e-6);
+  }
+}
+
+TEST(SoftmaxTest, WorksInPlace) {
+  std::vector<float> scores = {1.0f, 2.0f, 3.0f, 4.0f, 5.0f};
+  const std::vector<float> expected = ReferenceSoftmax(scores);
+  ComputeSoftmax(scores.data(), scores.size(), scores.data());
+  for (int i = 0; i < expected.size(); ++i) {
+    EXPECT_NEAR(scores[i], expected[i], 1e-6);
+  }
+}
+
+TEST(SoftmaxTest, HandlesNegativeScores) {
+  const std::vector<float> softmax = ComputeSoftmax({-3.0f, -2.0f});
+  EXPECT_NEAR(softmax[0], 0.26894142f, 1e-6);
+  EXPECT_NEAR(softmax[1], 0.73105858f, 1e-6);
+}
+
+TEST(SoftmaxTest, IgnoresFarAwayScores) {
+  const std::vector<float> softmax = ComputeSoftmax({0.0f, 0.0f, -30.0f});
+  EXPECT_FLOAT_EQ(softmax[0], 0.5f);
+  EXPECT_FLOAT_EQ(softmax[1], 0.5f);
+  EXPECT_EQ(softmax[2], 0.0f);
+  EXPECT_EQ(ComputeSoftmaxProbability({0.0f, 30.0f}, 0), 0.0f);
+  EXPECT_EQ(ComputeSoftmaxProbability({0.0f, 30.0f}, 2), 0.0f);
+}
+
+TEST(SoftmaxTest, ProbabilityOfManyLabels) {
+  // More labels than are evaluated in one block.
+  std::vector<float> scores;
+  for (int i = 0; i < 200; ++i) {
+    scores.push_back(std::cos(i) * 3.0f);
+  }
+  const std::vector<float> expected = ReferenceSoftmax(scores);
+  for (const int label : {0, 63, 64, 199}) {
+    EXPECT_NEAR(ComputeSoftmaxProbability(scores, label), expected[label],
+                1e-6);
+  }
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
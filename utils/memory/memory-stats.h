@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Memory accounting of a loaded model.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_MEMORY_MEMORY_STATS_H_
+#define LIBTEXTCLASSIFIER_UTILS_MEMORY_MEMORY_STATS_H_
+
+#include "utils/base/integral_types.h"
+
+namespace libtextclassifier3 {
+
+// Memory held by a loaded model, to plan the capacity of the processes that
+// serve it and to size its caches. The heap figures are estimated from the
+// sizes of the buffers the library owns: allocator overhead and the internals
+// of third-party libraries (e.g. the compiled form of ICU patterns) are not
+// measured exactly.
+struct MemoryStats {
+  // Bytes of the model file mapped in memory, 0 if the model was loaded from a
+  // buffer owned by the caller, and how many of them are resident.
+  int64 mapped_bytes = 0;
+  int64 resident_bytes = 0;
+
+  // Source of the regular expressions, which the heap of their compiled form
+  // is proportional to.
+  int64 regex_bytes = 0;
+
+  // Parts of the model decompressed or compiled out of the model buffer, e.g.
+  // scripts and their bytecode.
+  int64 decompressed_bytes = 0;
+
+  // Tensor arenas of the TFLite interpreters kept between calls.
+  int64 interpreter_bytes = 0;
+
+  // Caches kept between calls, e.g. of token embeddings and results.
+  int64 cache_bytes = 0;
+
+  // Lua states kept between calls.
+  int64 lua_bytes = 0;
+
+  // The heap estimate: everything but the mapped model.
+  int64 heap_bytes() const {
+    return regex_bytes + decompressed_bytes + interpreter_bytes + cache_bytes +
+           lua_bytes;
+  }
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_MEMORY_MEMORY_STATS_H_
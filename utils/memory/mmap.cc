@@ -24,6 +24,8 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <vector>
+
 #include "utils/base/logging.h"
 #include "utils/base/macros.h"
 
@@ -34,6 +36,23 @@ inline std::string GetLastSystemError() { return std::string(strerror(errno)); }
 
 inline MmapHandle GetErrorMmapHandle() { return MmapHandle(nullptr, 0); }
 
+inline int64 GetPageSize() {
+  static const int64 kPageSize = sysconf(_SC_PAGE_SIZE);
+  return kPageSize;
+}
+
+// Widens [start, start + num_bytes) to page boundaries.
+void GetPageAlignedRange(const void *start, size_t num_bytes,
+                         char **aligned_start, size_t *aligned_size) {
+  const uintptr_t page_size = GetPageSize();
+  const uintptr_t begin = reinterpret_cast<uintptr_t>(start);
+  const uintptr_t aligned_begin = (begin / page_size) * page_size;
+  const uintptr_t aligned_end =
+      ((begin + num_bytes + page_size - 1) / page_size) * page_size;
+  *aligned_start = reinterpret_cast<char *>(aligned_begin);
+  *aligned_size = aligned_end - aligned_begin;
+}
+
 class FileCloser {
  public:
   explicit FileCloser(int fd) : fd_(fd) {}
@@ -83,7 +102,7 @@ MmapHandle MmapFile(int fd) {
 }
 
 MmapHandle MmapFile(int fd, int64 segment_offset, int64 segment_size) {
-  static const int64 kPageSize = sysconf(_SC_PAGE_SIZE);
+  const int64 kPageSize = GetPageSize();
   const int64 aligned_offset = (segment_offset / kPageSize) * kPageSize;
   const int64 alignment_shift = segment_offset - aligned_offset;
   const int64 aligned_length = segment_size + alignment_shift;
@@ -109,6 +128,12 @@ MmapHandle MmapFile(int fd, int64 segment_offset, int64 segment_size) {
       fd,
 
       aligned_offset);
+  if (mmap_addr == MAP_FAILED && (errno == EACCES || errno == EPERM)) {
+    // Regions that are read-only for good, e.g. the ashmem of a model shared
+    // by another process, can't be mapped writable, even privately.
+    mmap_addr = mmap(nullptr, aligned_length, PROT_READ, MAP_PRIVATE, fd,
+                     aligned_offset);
+  }
   if (mmap_addr == MAP_FAILED) {
     const std::string last_error = GetLastSystemError();
     TC3_LOG(ERROR) << "Error while mmapping: " << last_error;
@@ -132,4 +157,85 @@ bool Unmap(MmapHandle mmap_handle) {
   return true;
 }
 
+bool AdviseMemory(const void *start, size_t num_bytes, MmapAdvice advice) {
+  if (start == nullptr || num_bytes == 0) {
+    return true;
+  }
+
+  int system_advice;
+  switch (advice) {
+    case MmapAdvice::kNormal:
+      system_advice = MADV_NORMAL;
+      break;
+    case MmapAdvice::kRandom:
+      system_advice = MADV_RANDOM;
+      break;
+    case MmapAdvice::kSequential:
+      system_advice = MADV_SEQUENTIAL;
+      break;
+    case MmapAdvice::kWillNeed:
+      system_advice = MADV_WILLNEED;
+      break;
+    case MmapAdvice::kHugePage:
+#if defined(MADV_HUGEPAGE)
+      system_advice = MADV_HUGEPAGE;
+      break;
+#else
+      TC3_LOG(ERROR) << "Huge pages are not supported on this platform.";
+      return false;
+#endif
+    default:
+      TC3_LOG(ERROR) << "Unknown mmap advice.";
+      return false;
+  }
+
+  char *aligned_start;
+  size_t aligned_size;
+  GetPageAlignedRange(start, num_bytes, &aligned_start, &aligned_size);
+  if (madvise(aligned_start, aligned_size, system_advice) != 0) {
+    const std::string last_error = GetLastSystemError();
+    TC3_LOG(ERROR) << "Error during madvise: " << last_error;
+    return false;
+  }
+  return true;
+}
+
+void PrefaultMemory(const void *start, size_t num_bytes) {
+  if (start == nullptr) {
+    return;
+  }
+  const int64 page_size = GetPageSize();
+  const volatile char *bytes = static_cast<const volatile char *>(start);
+  for (size_t i = 0; i < num_bytes; i += page_size) {
+    bytes[i];
+  }
+  if (num_bytes > 0) {
+    bytes[num_bytes - 1];
+  }
+}
+
+int64 GetResidentBytes(const void *start, size_t num_bytes) {
+  if (start == nullptr || num_bytes == 0) {
+    return 0;
+  }
+
+  char *aligned_start;
+  size_t aligned_size;
+  GetPageAlignedRange(start, num_bytes, &aligned_start, &aligned_size);
+  const int64 page_size = GetPageSize();
+  std::vector<unsigned char> page_status(aligned_size / page_size);
+  if (mincore(aligned_start, aligned_size, page_status.data()) != 0) {
+    const std::string last_error = GetLastSystemError();
+    TC3_LOG(ERROR) << "Error during mincore: " << last_error;
+    return -1;
+  }
+  int64 num_resident_pages = 0;
+  for (const unsigned char status : page_status) {
+    if (status & 1) {
+      ++num_resident_pages;
+    }
+  }
+  return num_resident_pages * page_size;
+}
+
 }  // namespace libtextclassifier3
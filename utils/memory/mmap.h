@@ -112,6 +112,41 @@ MmapHandle MmapFile(int fd, int64 segment_offset, int64 segment_size);
 // otherwise.
 bool Unmap(MmapHandle mmap_handle);
 
+// How a range of mapped memory is expected to be accessed, see madvise(2).
+enum class MmapAdvice {
+  // No special treatment (the default).
+  kNormal,
+
+  // Pages are accessed in random order, so read-ahead is of little use.
+  // Typical for embedding tables.
+  kRandom,
+
+  // Pages are accessed sequentially, read ahead aggressively.
+  kSequential,
+
+  // The range will be needed soon. The kernel starts reading it in the
+  // background, so this can be used to asynchronously prefault a range.
+  kWillNeed,
+
+  // Back the range with transparent huge pages where the kernel supports it.
+  kHugePage,
+};
+
+// Applies the advice to the num_bytes bytes starting at start, which need to
+// lie in a mapped area (e.g. in a section of an mmapped model). The range is
+// widened to page boundaries.  Returns true on success, false otherwise (e.g.
+// if the advice isn't supported on this platform).
+bool AdviseMemory(const void *start, size_t num_bytes, MmapAdvice advice);
+
+// Synchronously faults in all pages of the range, by reading one byte per page.
+// Unlike MmapAdvice::kWillNeed this blocks until the range is resident, so it
+// is meant to be run off the critical path, e.g. on a background thread.
+void PrefaultMemory(const void *start, size_t num_bytes);
+
+// Returns the number of bytes of the range that are currently resident in
+// memory (at page granularity), or -1 on error.
+int64 GetResidentBytes(const void *start, size_t num_bytes);
+
 // Scoped mmapping of a file.  Mmaps a file on construction, unmaps it on
 // destruction.
 class ScopedMmap {
@@ -132,6 +167,18 @@ class ScopedMmap {
 
   const MmapHandle &handle() { return handle_; }
 
+  // Applies the advice to the whole mapped area.  See AdviseMemory().
+  bool Advise(MmapAdvice advice) {
+    return handle_.ok() &&
+           AdviseMemory(handle_.start(), handle_.num_bytes(), advice);
+  }
+
+  // Returns the number of bytes of the mapped area resident in memory.
+  int64 ResidentBytes() const {
+    return handle_.ok() ? GetResidentBytes(handle_.start(), handle_.num_bytes())
+                        : 0;
+  }
+
  private:
   MmapHandle handle_;
 };
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/memory/mmap.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+constexpr int kFileSize = 3 * 4096 + 100;
+
+class MmapTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    char path[] = "/tmp/mmap_test_XXXXXX";
+    const int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    path_ = path;
+    std::ofstream file(path_);
+    file << std::string(kFileSize, 'a');
+  }
+
+  void TearDown() override { unlink(path_.c_str()); }
+
+  std::string path_;
+};
+
+TEST_F(MmapTest, MapsFile) {
+  ScopedMmap mmap(path_);
+  ASSERT_TRUE(mmap.handle().ok());
+  EXPECT_EQ(mmap.handle().num_bytes(), kFileSize);
+  EXPECT_EQ(mmap.handle().to_stringpiece().ToString(),
+            std::string(kFileSize, 'a'));
+}
+
+TEST_F(MmapTest, AppliesAdvice) {
+  ScopedMmap mmap(path_);
+  ASSERT_TRUE(mmap.handle().ok());
+  EXPECT_TRUE(mmap.Advise(MmapAdvice::kRandom));
+  EXPECT_TRUE(mmap.Advise(MmapAdvice::kSequential));
+  EXPECT_TRUE(mmap.Advise(MmapAdvice::kWillNeed));
+  EXPECT_TRUE(mmap.Advise(MmapAdvice::kNormal));
+
+  // Ranges don't need to be page aligned.
+  const char* start = static_cast<const char*>(mmap.handle().start());
+  EXPECT_TRUE(AdviseMemory(start + 10, 5000, MmapAdvice::kRandom));
+}
+
+TEST_F(MmapTest, PrefaultMakesRangeResident) {
+  ScopedMmap mmap(path_);
+  ASSERT_TRUE(mmap.handle().ok());
+  PrefaultMemory(mmap.handle().start(), mmap.handle().num_bytes());
+  EXPECT_GE(mmap.ResidentBytes(), kFileSize);
+  EXPECT_LE(mmap.ResidentBytes(), kFileSize + 4096);
+}
+
+TEST_F(MmapTest, EmptyRangeIsNotResident) {
+  ScopedMmap mmap(path_);
+  ASSERT_TRUE(mmap.handle().ok());
+  EXPECT_EQ(GetResidentBytes(mmap.handle().start(), 0), 0);
+  EXPECT_TRUE(AdviseMemory(mmap.handle().start(), 0, MmapAdvice::kRandom));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
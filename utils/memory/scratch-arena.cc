@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/memory/scratch-arena.h"
+
+namespace libtextclassifier3 {
+
+constexpr size_t ScratchArena::kDefaultChunkBytes;
+
+ScratchArena::ScratchArena(size_t chunk_bytes) : chunk_bytes_(chunk_bytes) {}
+
+void* ScratchArena::Allocate(size_t bytes, size_t alignment) {
+  bytes_allocated_ += bytes;
+  if (bytes > chunk_bytes_) {
+    large_blocks_.emplace_back(new char[bytes]);
+    return large_blocks_.back().get();
+  }
+  size_t offset = (chunk_offset_ + alignment - 1) & ~(alignment - 1);
+  if (chunks_.empty() || offset + bytes > chunk_bytes_) {
+    chunks_.emplace_back(new char[chunk_bytes_]);
+    offset = 0;
+  }
+  chunk_offset_ = offset + bytes;
+  return chunks_.back().get() + offset;
+}
+
+void ScratchArena::Reset() {
+  large_blocks_.clear();
+  if (chunks_.size() > 1) {
+    chunks_.resize(1);
+  }
+  chunk_offset_ = 0;
+  bytes_allocated_ = 0;
+}
+
+namespace {
+
+struct ThreadScratchArena {
+  ScratchArena arena;
+  int depth = 0;
+};
+
+ThreadScratchArena* GetThreadScratchArena() {
+  static thread_local ThreadScratchArena thread_arena;
+  return &thread_arena;
+}
+
+}  // namespace
+
+ScopedScratchArena::ScopedScratchArena() { ++GetThreadScratchArena()->depth; }
+
+ScopedScratchArena::~ScopedScratchArena() {
+  ThreadScratchArena* thread_arena = GetThreadScratchArena();
+  if (--thread_arena->depth == 0) {
+    thread_arena->arena.Reset();
+  }
+}
+
+ScratchArena* CurrentScratchArena() {
+  ThreadScratchArena* thread_arena = GetThreadScratchArena();
+  return thread_arena->depth > 0 ? &thread_arena->arena : nullptr;
+}
+
+}  // namespace libtextclassifier3
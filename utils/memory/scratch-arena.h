@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Per-thread scratch memory for the short-lived buffers of a request.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_MEMORY_SCRATCH_ARENA_H_
+#define LIBTEXTCLASSIFIER_UTILS_MEMORY_SCRATCH_ARENA_H_
+
+#include <stddef.h>
+
+#include <functional>
+#include <memory>
+#include <set>
+#include <vector>
+
+namespace libtextclassifier3 {
+
+// A bump allocator: blocks are carved from large chunks and never freed one by
+// one, all of them are released at once by Reset(). The first chunk is kept
+// across resets, so that a thread serving requests of similar size doesn't
+// allocate at all once it is warm.
+//
+// Not thread-safe, see ScopedScratchArena for the arena of each thread.
+class ScratchArena {
+ public:
+  explicit ScratchArena(size_t chunk_bytes = kDefaultChunkBytes);
+
+  // Returns a block of the given size. Alignments up to that of
+  // std::max_align_t are supported.
+  void* Allocate(size_t bytes, size_t alignment);
+
+  // Releases all the blocks.
+  void Reset();
+
+  // Bytes allocated since the last reset.
+  size_t bytes_allocated() const { return bytes_allocated_; }
+
+  static constexpr size_t kDefaultChunkBytes = 64 * 1024;
+
+ private:
+  const size_t chunk_bytes_;
+
+  // The chunks, the last one is being carved.
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  size_t chunk_offset_ = 0;
+
+  // Blocks larger than a chunk, which get an allocation of their own.
+  std::vector<std::unique_ptr<char[]>> large_blocks_;
+
+  size_t bytes_allocated_ = 0;
+};
+
+// Marks the scope of a request on the current thread. While one is alive,
+// the ScratchAllocators created on the thread allocate from the arena of the
+// thread, which is reset when the outermost scope ends. Scopes nest, so that
+// requests calling other requests (e.g. the actions calling the annotator)
+// don't reset the memory of their caller.
+class ScopedScratchArena {
+ public:
+  ScopedScratchArena();
+  ~ScopedScratchArena();
+
+  ScopedScratchArena(const ScopedScratchArena&) = delete;
+  ScopedScratchArena& operator=(const ScopedScratchArena&) = delete;
+};
+
+// Returns the arena of the current thread, or nullptr outside of a
+// ScopedScratchArena.
+ScratchArena* CurrentScratchArena();
+
+// Allocator of standard containers that takes its memory from the arena of the
+// current thread, or from the heap outside of a request scope. The memory is
+// released with the scope, so the containers must not outlive it: they are
+// meant for the local buffers of a function. For the same reason, they must
+// only grow on the thread that created them.
+template <typename T>
+class ScratchAllocator {
+ public:
+  using value_type = T;
+
+  ScratchAllocator() : arena_(CurrentScratchArena()) {}
+
+  template <typename U>
+  ScratchAllocator(const ScratchAllocator<U>& other) : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    if (arena_ == nullptr) {
+      return std::allocator<T>().allocate(n);
+    }
+    return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* ptr, size_t n) {
+    if (arena_ == nullptr) {
+      std::allocator<T>().deallocate(ptr, n);
+    }
+  }
+
+  ScratchArena* arena() const { return arena_; }
+
+ private:
+  ScratchArena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const ScratchAllocator<T>& a, const ScratchAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ScratchAllocator<T>& a, const ScratchAllocator<U>& b) {
+  return !(a == b);
+}
+
+template <typename T>
+using ScratchVector = std::vector<T, ScratchAllocator<T>>;
+
+template <typename T, typename Compare = std::less<T>>
+using ScratchSet = std::set<T, Compare, ScratchAllocator<T>>;
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_MEMORY_SCRATCH_ARENA_H_
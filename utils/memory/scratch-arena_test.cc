@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/memory/scratch-arena.h"
+
+#include <stdint.h>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(ScratchArenaTest, AlignsBlocks) {
+  ScratchArena arena(/*chunk_bytes=*/64);
+  arena.Allocate(3, 1);
+  void* block = arena.Allocate(8, 8);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(block) % 8, 0);
+  EXPECT_EQ(arena.bytes_allocated(), 11);
+}
+
+TEST(ScratchArenaTest, AllocatesBeyondChunks) {
+  ScratchArena arena(/*chunk_bytes=*/64);
+  char* first = static_cast<char*>(arena.Allocate(48, 1));
+  char* second = static_cast<char*>(arena.Allocate(48, 1));
+  char* large = static_cast<char*>(arena.Allocate(1000, 1));
+  for (int i = 0; i < 48; ++i) {
+    first[i] = 1;
+    second[i] = 2;
+  }
+  for (int i = 0; i < 1000; ++i) {
+    large[i] = 3;
+  }
+  EXPECT_EQ(first[47], 1);
+  EXPECT_EQ(second[0], 2);
+
+  arena.Reset();
+  EXPECT_EQ(arena.bytes_allocated(), 0);
+  // The first chunk is reused.
+  EXPECT_EQ(arena.Allocate(48, 1), first);
+}
+
+TEST(ScratchArenaTest, AllocatesFromThreadArenaInScope) {
+  EXPECT_EQ(CurrentScratchArena(), nullptr);
+  {
+    ScopedScratchArena scope;
+    ScratchArena* arena = CurrentScratchArena();
+    ASSERT_NE(arena, nullptr);
+    {
+      ScopedScratchArena nested_scope;
+      ScratchVector<int> values;
+      for (int i = 0; i < 100; ++i) {
+        values.push_back(i);
+      }
+      EXPECT_EQ(values[99], 99);
+      EXPECT_GE(arena->bytes_allocated(), 100 * sizeof(int));
+    }
+    // Only the outermost scope resets the arena.
+    EXPECT_GE(arena->bytes_allocated(), 100 * sizeof(int));
+  }
+  EXPECT_EQ(CurrentScratchArena(), nullptr);
+
+  // Outside of a scope, the containers use the heap.
+  ScratchSet<int> set;
+  set.insert(1);
+  EXPECT_EQ(set.count(1), 1);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/memory/shared-memory.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "utils/base/logging.h"
+
+#if defined(__ANDROID__)
+#include <cutils/ashmem.h>
+#endif
+
+namespace libtextclassifier3 {
+namespace {
+
+inline std::string GetLastSystemError() { return std::string(strerror(errno)); }
+
+// Creates a writable region of the given size, or returns -1.
+int CreateRegion(const std::string& name, size_t size) {
+#if defined(__ANDROID__)
+  return ashmem_create_region(name.c_str(), size);
+#else
+  const int fd = memfd_create(name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0) {
+    return -1;
+  }
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+#endif
+}
+
+// Makes the region read-only, for this process and the ones it is passed to.
+bool MakeRegionReadOnly(int fd) {
+#if defined(__ANDROID__)
+  return ashmem_set_prot_region(fd, PROT_READ) == 0;
+#else
+  return fcntl(fd, F_ADD_SEALS,
+               F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == 0;
+#endif
+}
+
+}  // namespace
+
+int CreateReadOnlySharedMemory(const std::string& name, StringPiece contents) {
+  if (contents.empty()) {
+    TC3_LOG(ERROR) << "Shared memory can't be empty.";
+    return -1;
+  }
+  const size_t size = contents.size();
+  const int fd = CreateRegion(name, size);
+  if (fd < 0) {
+    const std::string last_error = GetLastSystemError();
+    TC3_LOG(ERROR) << "Error creating shared memory: " << last_error;
+    return -1;
+  }
+
+  // The writable mapping needs to be gone before the region is sealed.
+  void* mmap_addr =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mmap_addr == MAP_FAILED) {
+    const std::string last_error = GetLastSystemError();
+    TC3_LOG(ERROR) << "Error mapping shared memory: " << last_error;
+    close(fd);
+    return -1;
+  }
+  memcpy(mmap_addr, contents.data(), contents.size());
+  munmap(mmap_addr, size);
+
+  if (!MakeRegionReadOnly(fd)) {
+    const std::string last_error = GetLastSystemError();
+    TC3_LOG(ERROR) << "Error sealing shared memory: " << last_error;
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Read-only shared memory regions, to share prepared model data between
+// processes.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_MEMORY_SHARED_MEMORY_H_
+#define LIBTEXTCLASSIFIER_UTILS_MEMORY_SHARED_MEMORY_H_
+
+#include <string>
+
+#include "utils/strings/stringpiece.h"
+
+namespace libtextclassifier3 {
+
+// Creates an anonymous shared memory region holding a copy of the contents,
+// and makes it read-only for good: an ashmem region with its protection
+// restricted to PROT_READ on Android, a memfd sealed against writes and
+// resizing elsewhere. The returned file descriptor can be passed to other
+// processes (e.g. over binder or a unix socket), which map it with
+// ScopedMmap(fd) or load a model from it with FromFileDescriptor(fd), and
+// then share the physical pages of the region.
+//
+// The caller owns the file descriptor. Returns -1 on error.
+int CreateReadOnlySharedMemory(const std::string& name, StringPiece contents);
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_MEMORY_SHARED_MEMORY_H_
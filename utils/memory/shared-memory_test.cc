@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/memory/shared-memory.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "utils/memory/mmap.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(SharedMemoryTest, MapsContents) {
+  const std::string contents(3 * 4096 + 100, 'a');
+  const int fd = CreateReadOnlySharedMemory("shared-memory-test", contents);
+  ASSERT_GE(fd, 0);
+
+  {
+    ScopedMmap mmap(fd);
+    ASSERT_TRUE(mmap.handle().ok());
+    EXPECT_EQ(mmap.handle().to_stringpiece().ToString(), contents);
+  }
+  close(fd);
+}
+
+TEST(SharedMemoryTest, IsReadOnly) {
+  const int fd = CreateReadOnlySharedMemory("shared-memory-test", "contents");
+  ASSERT_GE(fd, 0);
+
+  EXPECT_EQ(mmap(nullptr, 8, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0),
+            MAP_FAILED);
+  close(fd);
+}
+
+TEST(SharedMemoryTest, FailsOnEmptyContents) {
+  EXPECT_EQ(CreateReadOnlySharedMemory("shared-memory-test", ""), -1);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/model-bundle.h"
+
+#include "utils/base/logging.h"
+#include "utils/verified-buffers.h"
+#include "flatbuffers/flatbuffers.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+// Alignment of the section contents, matches the alignment of the TFLite
+// models in the engine models.
+constexpr int kSectionAlignment = 16;
+
+const ModelBundleIndex* LoadAndVerifyIndex(const uint8_t* addr, int size) {
+  const bool verified =
+      VerifiedBufferRegistry::Instance()->Verify(addr, size, [addr, size]() {
+        flatbuffers::Verifier verifier(addr, size);
+        return VerifyModelBundleIndexBuffer(verifier);
+      });
+  if (!verified) {
+    return nullptr;
+  }
+  const ModelBundleIndex* index = GetModelBundleIndex(addr);
+  if (index->sections() == nullptr || index->blobs() == nullptr) {
+    return nullptr;
+  }
+  for (const ModelBundleSection* section : *index->sections()) {
+    if (section->name() == nullptr || section->blob() < 0 ||
+        section->blob() >= index->blobs()->size()) {
+      return nullptr;
+    }
+  }
+  return index;
+}
+
+}  // namespace
+
+std::unique_ptr<ModelBundle> ModelBundle::FromUnownedBuffer(const char* buffer,
+                                                            int size) {
+  const ModelBundleIndex* index =
+      LoadAndVerifyIndex(reinterpret_cast<const uint8_t*>(buffer), size);
+  if (index == nullptr) {
+    TC3_LOG(ERROR) << "Model bundle verification failed.";
+    return nullptr;
+  }
+  return std::unique_ptr<ModelBundle>(new ModelBundle(index, nullptr));
+}
+
+std::unique_ptr<ModelBundle> ModelBundle::FromScopedMmap(
+    std::unique_ptr<ScopedMmap> mmap) {
+  if (!mmap->handle().ok()) {
+    TC3_VLOG(1) << "Mmap failed.";
+    return nullptr;
+  }
+  const ModelBundleIndex* index = LoadAndVerifyIndex(
+      reinterpret_cast<const uint8_t*>(mmap->handle().start()),
+      mmap->handle().num_bytes());
+  if (index == nullptr) {
+    TC3_LOG(ERROR) << "Model bundle verification failed.";
+    return nullptr;
+  }
+  return std::unique_ptr<ModelBundle>(new ModelBundle(index, std::move(mmap)));
+}
+
+std::unique_ptr<ModelBundle> ModelBundle::FromFileDescriptor(int fd,
+                                                             int offset,
+                                                             int size) {
+  return FromScopedMmap(std::unique_ptr<ScopedMmap>(
+      new ScopedMmap(fd, offset, size)));
+}
+
+std::unique_ptr<ModelBundle> ModelBundle::FromFileDescriptor(int fd) {
+  return FromScopedMmap(std::unique_ptr<ScopedMmap>(new ScopedMmap(fd)));
+}
+
+std::unique_ptr<ModelBundle> ModelBundle::FromPath(const std::string& path) {
+  return FromScopedMmap(std::unique_ptr<ScopedMmap>(new ScopedMmap(path)));
+}
+
+StringPiece ModelBundle::GetSection(const std::string& name) const {
+  const ModelBundleSection* section =
+      index_->sections()->LookupByKey(name.c_str());
+  if (section == nullptr) {
+    return StringPiece();
+  }
+  const flatbuffers::Vector<uint8_t>* data =
+      index_->blobs()->Get(section->blob())->data();
+  if (data == nullptr) {
+    return StringPiece();
+  }
+  return StringPiece(reinterpret_cast<const char*>(data->data()),
+                     data->size());
+}
+
+std::vector<std::string> ModelBundle::SectionNames() const {
+  std::vector<std::string> names;
+  names.reserve(index_->sections()->size());
+  for (const ModelBundleSection* section : *index_->sections()) {
+    names.push_back(section->name()->str());
+  }
+  return names;
+}
+
+std::string PackModelBundle(
+    const std::vector<std::pair<std::string, std::string>>& sections) {
+  flatbuffers::FlatBufferBuilder builder;
+
+  // Bundles hold a handful of sections, compare the contents directly.
+  std::vector<const std::string*> blob_contents;
+  std::vector<flatbuffers::Offset<ModelBundleBlob>> blobs;
+  std::vector<flatbuffers::Offset<ModelBundleSection>> section_offsets;
+  for (const auto& section : sections) {
+    int blob = 0;
+    while (blob < blob_contents.size() &&
+           *blob_contents[blob] != section.second) {
+      ++blob;
+    }
+    if (blob == blob_contents.size()) {
+      builder.ForceVectorAlignment(section.second.size(), sizeof(uint8_t),
+                                   kSectionAlignment);
+      blobs.push_back(CreateModelBundleBlob(
+          builder, builder.CreateVector(
+                       reinterpret_cast<const uint8_t*>(section.second.data()),
+                       section.second.size())));
+      blob_contents.push_back(&section.second);
+    }
+    section_offsets.push_back(CreateModelBundleSection(
+        builder, builder.CreateString(section.first), blob));
+  }
+
+  const auto sorted_sections =
+      builder.CreateVectorOfSortedTables(&section_offsets);
+  FinishModelBundleIndexBuffer(
+      builder, CreateModelBundleIndex(builder, sorted_sections,
+                                      builder.CreateVector(blobs)));
+  return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                     builder.GetSize());
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Loading of several models packed into a single file.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_MODEL_BUNDLE_H_
+#define LIBTEXTCLASSIFIER_UTILS_MODEL_BUNDLE_H_
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "utils/memory/mmap.h"
+#include "utils/model-bundle_generated.h"
+#include "utils/strings/stringpiece.h"
+
+namespace libtextclassifier3 {
+
+// Names of the sections holding the models of the individual engines.
+constexpr char kAnnotatorBundleSection[] = "annotator";
+constexpr char kActionsBundleSection[] = "actions";
+constexpr char kLangIdBundleSection[] = "lang_id";
+
+// A read-only view of a model bundle: one file with an index of named
+// sections, where every section holds a complete model of one engine. The
+// whole file is mapped once and only the index is verified here; the engines
+// are created from the sections without copying, e.g.:
+//
+//   std::unique_ptr<ModelBundle> bundle = ModelBundle::FromPath(path);
+//   const StringPiece model = bundle->GetSection(kAnnotatorBundleSection);
+//   std::unique_ptr<Annotator> annotator =
+//       Annotator::FromUnownedBuffer(model.data(), model.size(), unilib);
+//
+// The bundle needs to outlive the engines created from its sections.
+class ModelBundle {
+ public:
+  // Returns nullptr if the buffer isn't a valid bundle. Doesn't take ownership
+  // of the buffer, which needs to outlive the bundle.
+  static std::unique_ptr<ModelBundle> FromUnownedBuffer(const char* buffer,
+                                                        int size);
+
+  static std::unique_ptr<ModelBundle> FromScopedMmap(
+      std::unique_ptr<ScopedMmap> mmap);
+  static std::unique_ptr<ModelBundle> FromFileDescriptor(int fd, int offset,
+                                                         int size);
+  static std::unique_ptr<ModelBundle> FromFileDescriptor(int fd);
+  static std::unique_ptr<ModelBundle> FromPath(const std::string& path);
+
+  // Returns the contents of the named section, or an empty StringPiece if the
+  // bundle has no such section. The contents are aligned to 16 bytes.
+  StringPiece GetSection(const std::string& name) const;
+
+  // Names of all sections in the bundle.
+  std::vector<std::string> SectionNames() const;
+
+  // The mapped bundle file, or nullptr if the bundle was created from an
+  // unowned buffer.
+  const ScopedMmap* mmap() const { return mmap_.get(); }
+
+ private:
+  ModelBundle(const ModelBundleIndex* index, std::unique_ptr<ScopedMmap> mmap)
+      : index_(index), mmap_(std::move(mmap)) {}
+
+  const ModelBundleIndex* index_;
+  std::unique_ptr<ScopedMmap> mmap_;
+};
+
+// Packs the (name, contents) sections into a bundle. Sections with the same
+// contents are stored once.
+std::string PackModelBundle(
+    const std::vector<std::pair<std::string, std::string>>& sections);
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_MODEL_BUNDLE_H_
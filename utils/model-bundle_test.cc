@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/model-bundle.h"
+
+#include <cstdint>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+using testing::ElementsAre;
+
+TEST(ModelBundleTest, ReturnsSections) {
+  const std::string buffer =
+      PackModelBundle({{kAnnotatorBundleSection, "annotator model"},
+                       {kActionsBundleSection, "actions model"},
+                       {kLangIdBundleSection, "lang id model"}});
+  std::unique_ptr<ModelBundle> bundle =
+      ModelBundle::FromUnownedBuffer(buffer.data(), buffer.size());
+  ASSERT_NE(bundle, nullptr);
+
+  EXPECT_EQ(bundle->GetSection(kAnnotatorBundleSection).ToString(),
+            "annotator model");
+  EXPECT_EQ(bundle->GetSection(kActionsBundleSection).ToString(),
+            "actions model");
+  EXPECT_EQ(bundle->GetSection(kLangIdBundleSection).ToString(),
+            "lang id model");
+  EXPECT_TRUE(bundle->GetSection("unknown").empty());
+  EXPECT_THAT(bundle->SectionNames(),
+              ElementsAre(kActionsBundleSection, kAnnotatorBundleSection,
+                          kLangIdBundleSection));
+}
+
+TEST(ModelBundleTest, DeduplicatesSectionContents) {
+  const std::string shared(1000, 'x');
+  const std::string buffer = PackModelBundle(
+      {{"first", shared}, {"second", shared}, {"third", "other"}});
+  std::unique_ptr<ModelBundle> bundle =
+      ModelBundle::FromUnownedBuffer(buffer.data(), buffer.size());
+  ASSERT_NE(bundle, nullptr);
+
+  EXPECT_LT(buffer.size(), 2 * shared.size());
+  EXPECT_EQ(bundle->GetSection("first").data(),
+            bundle->GetSection("second").data());
+  EXPECT_EQ(bundle->GetSection("third").ToString(), "other");
+}
+
+TEST(ModelBundleTest, AlignsSections) {
+  const std::string buffer =
+      PackModelBundle({{"a", "1"}, {"b", "22"}, {"c", "333"}});
+  std::unique_ptr<ModelBundle> bundle =
+      ModelBundle::FromUnownedBuffer(buffer.data(), buffer.size());
+  ASSERT_NE(bundle, nullptr);
+
+  const uintptr_t base = reinterpret_cast<uintptr_t>(buffer.data());
+  for (const std::string& name : bundle->SectionNames()) {
+    EXPECT_EQ(
+        (reinterpret_cast<uintptr_t>(bundle->GetSection(name).data()) - base) %
+            16,
+        0);
+  }
+}
+
+TEST(ModelBundleTest, RejectsInvalidBuffer) {
+  const std::string buffer = "not a model bundle";
+  EXPECT_EQ(ModelBundle::FromUnownedBuffer(buffer.data(), buffer.size()),
+            nullptr);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A handle to a model that can be replaced while it serves requests.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_MODEL_HANDLE_H_
+#define LIBTEXTCLASSIFIER_UTILS_MODEL_HANDLE_H_
+
+#include <memory>
+#include <mutex>  // NOLINT
+#include <utility>
+
+#include "utils/base/integral_types.h"
+#include "utils/warmup.h"
+
+namespace libtextclassifier3 {
+
+// Holds the current model and lets it be replaced without blocking callers.
+//
+// Callers take a snapshot with Get() for the duration of a request. Swap()
+// publishes a new model atomically: requests that start afterwards see the
+// new model, while requests in flight keep using their snapshot. The old model
+// is retired, i.e. destroyed, when the last snapshot of it is released, so a
+// swap never waits for in-flight requests and never frees a model under them.
+//
+// The class is thread-safe.
+template <typename T>
+class ModelHandle {
+ public:
+  explicit ModelHandle(std::unique_ptr<T> model = nullptr)
+      : model_(std::move(model)) {}
+
+  // Returns the current model, or nullptr if there is none. The model stays
+  // alive as long as the returned pointer is held.
+  std::shared_ptr<const T> Get() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return model_;
+  }
+
+  // Replaces the current model and returns the previous one. The previous
+  // model is destroyed once the returned pointer and all snapshots are
+  // released.
+  std::shared_ptr<const T> Swap(std::shared_ptr<const T> model) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    model_.swap(model);
+    ++generation_;
+    return model;
+  }
+
+  // Like Swap(), but first runs T::Warmup() on the new model, so that the
+  // requests right after the swap don't hit a cold model. Returns the warm-up
+  // report; the model is published even if some phases failed.
+  WarmupReport WarmupAndSwap(std::shared_ptr<const T> model) {
+    WarmupReport report;
+    if (model != nullptr) {
+      report = model->Warmup();
+    }
+    Swap(std::move(model));
+    return report;
+  }
+
+  // Number of swaps so far.
+  int64 generation() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return generation_;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  std::shared_ptr<const T> model_;
+  int64 generation_ = 0;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_MODEL_HANDLE_H_
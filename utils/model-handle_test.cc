@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/model-handle.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+class FakeModel {
+ public:
+  FakeModel(int id, std::atomic<int>* num_alive)
+      : id_(id), num_alive_(num_alive) {
+    ++*num_alive_;
+  }
+  ~FakeModel() { --*num_alive_; }
+
+  int id() const { return id_; }
+  bool warm() const { return warm_; }
+
+  WarmupReport Warmup() const {
+    WarmupReport report;
+    report.RunPhase("warm", [this]() {
+      warm_ = true;
+      return true;
+    });
+    return report;
+  }
+
+ private:
+  const int id_;
+  std::atomic<int>* const num_alive_;
+  mutable bool warm_ = false;
+};
+
+TEST(ModelHandleTest, ReturnsCurrentModel) {
+  std::atomic<int> num_alive(0);
+  ModelHandle<FakeModel> handle(
+      std::unique_ptr<FakeModel>(new FakeModel(1, &num_alive)));
+  EXPECT_EQ(handle.Get()->id(), 1);
+
+  handle.Swap(std::unique_ptr<FakeModel>(new FakeModel(2, &num_alive)));
+  EXPECT_EQ(handle.Get()->id(), 2);
+  EXPECT_EQ(handle.generation(), 1);
+  EXPECT_EQ(num_alive, 1);
+}
+
+TEST(ModelHandleTest, RetiresModelWhenSnapshotsAreReleased) {
+  std::atomic<int> num_alive(0);
+  ModelHandle<FakeModel> handle(
+      std::unique_ptr<FakeModel>(new FakeModel(1, &num_alive)));
+  std::shared_ptr<const FakeModel> in_flight = handle.Get();
+
+  handle.Swap(std::unique_ptr<FakeModel>(new FakeModel(2, &num_alive)));
+  EXPECT_EQ(num_alive, 2);
+  EXPECT_EQ(in_flight->id(), 1);
+
+  in_flight.reset();
+  EXPECT_EQ(num_alive, 1);
+}
+
+TEST(ModelHandleTest, WarmsUpBeforeSwap) {
+  std::atomic<int> num_alive(0);
+  ModelHandle<FakeModel> handle;
+  EXPECT_EQ(handle.Get(), nullptr);
+
+  const WarmupReport report = handle.WarmupAndSwap(
+      std::unique_ptr<FakeModel>(new FakeModel(1, &num_alive)));
+  EXPECT_TRUE(report.success());
+  ASSERT_EQ(report.phases().size(), 1);
+  EXPECT_TRUE(handle.Get()->warm());
+}
+
+TEST(ModelHandleTest, SwapsWhileServing) {
+  std::atomic<int> num_alive(0);
+  ModelHandle<FakeModel> handle(
+      std::unique_ptr<FakeModel>(new FakeModel(0, &num_alive)));
+  std::vector<std::thread> readers;
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&handle]() {
+      int last_id = 0;
+      for (int j = 0; j < 1000; ++j) {
+        const std::shared_ptr<const FakeModel> model = handle.Get();
+        ASSERT_NE(model, nullptr);
+        EXPECT_GE(model->id(), last_id);
+        last_id = model->id();
+      }
+    });
+  }
+  for (int id = 1; id <= 100; ++id) {
+    handle.Swap(std::unique_ptr<FakeModel>(new FakeModel(id, &num_alive)));
+  }
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  EXPECT_EQ(handle.Get()->id(), 100);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/model-image.h"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "actions/actions-suggestions.h"
+#include "actions/zlib-utils.h"
+#include "annotator/annotator.h"
+#include "annotator/zlib-utils.h"
+#include "utils/base/logging.h"
+#include "utils/memory/shared-memory.h"
+#include "utils/model-bundle.h"
+#include "flatbuffers/flatbuffers.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+bool BuildAnnotatorSection(const std::string& model, std::string* result) {
+  const Model* view = ViewModel(model.data(), model.size());
+  if (view == nullptr) {
+    TC3_LOG(ERROR) << "Invalid annotator model.";
+    return false;
+  }
+  std::unique_ptr<ModelT> unpacked_model(view->UnPack());
+  if (!DecompressModel(unpacked_model.get())) {
+    TC3_LOG(ERROR) << "Cannot decompress annotator model.";
+    return false;
+  }
+  flatbuffers::FlatBufferBuilder builder;
+  FinishModelBuffer(builder, Model::Pack(builder, unpacked_model.get()));
+  result->assign(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                 builder.GetSize());
+  return true;
+}
+
+bool BuildActionsSection(const std::string& model, std::string* result) {
+  const ActionsModel* view = ViewActionsModel(model.data(), model.size());
+  if (view == nullptr) {
+    TC3_LOG(ERROR) << "Invalid actions model.";
+    return false;
+  }
+  std::unique_ptr<ActionsModelT> unpacked_model(view->UnPack());
+  if (!DecompressActionsModel(unpacked_model.get())) {
+    TC3_LOG(ERROR) << "Cannot decompress actions model.";
+    return false;
+  }
+  flatbuffers::FlatBufferBuilder builder;
+  FinishActionsModelBuffer(builder,
+                           ActionsModel::Pack(builder, unpacked_model.get()));
+  result->assign(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                 builder.GetSize());
+  return true;
+}
+
+}  // namespace
+
+std::string BuildModelImage(const std::string& annotator_model,
+                            const std::string& actions_model,
+                            const std::string& lang_id_model) {
+  std::vector<std::pair<std::string, std::string>> sections;
+  if (!annotator_model.empty()) {
+    sections.emplace_back(kAnnotatorBundleSection, "");
+    if (!BuildAnnotatorSection(annotator_model, &sections.back().second)) {
+      return "";
+    }
+  }
+  if (!actions_model.empty()) {
+    sections.emplace_back(kActionsBundleSection, "");
+    if (!BuildActionsSection(actions_model, &sections.back().second)) {
+      return "";
+    }
+  }
+  if (!lang_id_model.empty()) {
+    // LangId models have no compressed sections.
+    sections.emplace_back(kLangIdBundleSection, lang_id_model);
+  }
+  return PackModelBundle(sections);
+}
+
+int CreateSharedModelImage(const std::string& annotator_model,
+                           const std::string& actions_model,
+                           const std::string& lang_id_model) {
+  const std::string image =
+      BuildModelImage(annotator_model, actions_model, lang_id_model);
+  if (image.empty()) {
+    return -1;
+  }
+  return CreateReadOnlySharedMemory("libtextclassifier-model-image", image);
+}
+
+}  // namespace libtextclassifier3
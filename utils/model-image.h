@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Model images: the models of several processes, prepared once and shared
+// read-only between them.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_MODEL_IMAGE_H_
+#define LIBTEXTCLASSIFIER_UTILS_MODEL_IMAGE_H_
+
+#include <string>
+
+namespace libtextclassifier3 {
+
+// Builds a model image of the serialized models: a model bundle (see
+// model-bundle.h) with a section per non-empty model, in which the annotator
+// and actions models are fully decompressed (see DecompressModel and
+// DecompressActionsModel). Loading a model from the image decompresses
+// nothing: the regex patterns, datetime rules, resources, intent generators
+// and Lua scripts are read in place, and the embedded TFLite models and
+// tables are mapped as they are.
+//
+// Returns an empty string if one of the models is invalid.
+std::string BuildModelImage(const std::string& annotator_model,
+                            const std::string& actions_model,
+                            const std::string& lang_id_model);
+
+// Builds the model image of the serialized models into a read-only shared
+// memory region, see CreateReadOnlySharedMemory(). The other processes load
+// the models from the returned file descriptor without copying them, e.g.:
+//
+//   std::unique_ptr<ModelBundle> bundle = ModelBundle::FromFileDescriptor(fd);
+//   const StringPiece model = bundle->GetSection(kAnnotatorBundleSection);
+//   std::unique_ptr<Annotator> annotator =
+//       Annotator::FromUnownedBuffer(model.data(), model.size(), unilib);
+//
+// and the pages of the models are then shared by all of them. The state the
+// engines derive from their models, like the compiled regexes or the TFLite
+// interpreters, holds pointers and is still built in each process.
+//
+// The caller owns the file descriptor. Returns -1 on error.
+int CreateSharedModelImage(const std::string& annotator_model,
+                           const std::string& actions_model,
+                           const std::string& lang_id_model);
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_MODEL_IMAGE_H_
@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/model-image.h"
+
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include "actions/actions_model_generated.h"
+#include "actions/zlib-utils.h"
+#include "annotator/model_generated.h"
+#include "annotator/zlib-utils.h"
+#include "utils/model-bundle.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+std::string CompressedAnnotatorModel() {
+  ModelT model;
+  model.regex_model.reset(new RegexModelT);
+  model.regex_model->patterns.emplace_back(new RegexModel_::PatternT);
+  model.regex_model->patterns.back()->pattern = "this is a test pattern";
+  EXPECT_TRUE(CompressModel(&model));
+  flatbuffers::FlatBufferBuilder builder;
+  FinishModelBuffer(builder, Model::Pack(builder, &model));
+  return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                     builder.GetSize());
+}
+
+std::string CompressedActionsModel() {
+  ActionsModelT model;
+  model.rules.reset(new RulesModelT);
+  model.rules->rule.emplace_back(new RulesModel_::RuleT);
+  model.rules->rule.back()->pattern = "this is a test pattern";
+  EXPECT_TRUE(CompressActionsModel(&model));
+  flatbuffers::FlatBufferBuilder builder;
+  FinishActionsModelBuffer(builder, ActionsModel::Pack(builder, &model));
+  return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
+                     builder.GetSize());
+}
+
+TEST(ModelImageTest, DecompressesModels) {
+  const std::string image = BuildModelImage(
+      CompressedAnnotatorModel(), CompressedActionsModel(), "lang id model");
+  std::unique_ptr<ModelBundle> bundle =
+      ModelBundle::FromUnownedBuffer(image.data(), image.size());
+  ASSERT_NE(bundle, nullptr);
+
+  const Model* annotator_model =
+      GetModel(bundle->GetSection(kAnnotatorBundleSection).data());
+  const auto* pattern = annotator_model->regex_model()->patterns()->Get(0);
+  EXPECT_EQ(pattern->compressed_pattern(), nullptr);
+  EXPECT_EQ(pattern->pattern()->str(), "this is a test pattern");
+
+  const ActionsModel* actions_model =
+      GetActionsModel(bundle->GetSection(kActionsBundleSection).data());
+  const auto* rule = actions_model->rules()->rule()->Get(0);
+  EXPECT_EQ(rule->compressed_pattern(), nullptr);
+  EXPECT_EQ(rule->pattern()->str(), "this is a test pattern");
+
+  EXPECT_EQ(bundle->GetSection(kLangIdBundleSection).ToString(),
+            "lang id model");
+}
+
+TEST(ModelImageTest, LeavesOutEmptyModels) {
+  const std::string image =
+      BuildModelImage(CompressedAnnotatorModel(), /*actions_model=*/"",
+                      /*lang_id_model=*/"");
+  std::unique_ptr<ModelBundle> bundle =
+      ModelBundle::FromUnownedBuffer(image.data(), image.size());
+  ASSERT_NE(bundle, nullptr);
+
+  EXPECT_FALSE(bundle->GetSection(kAnnotatorBundleSection).empty());
+  EXPECT_TRUE(bundle->GetSection(kActionsBundleSection).empty());
+  EXPECT_TRUE(bundle->GetSection(kLangIdBundleSection).empty());
+}
+
+TEST(ModelImageTest, FailsOnInvalidModel) {
+  EXPECT_TRUE(BuildModelImage("not a model", "", "").empty());
+  EXPECT_EQ(CreateSharedModelImage("not a model", "", ""), -1);
+}
+
+TEST(ModelImageTest, LoadsSharedModelImage) {
+  const int fd = CreateSharedModelImage(CompressedAnnotatorModel(),
+                                        /*actions_model=*/"", "lang id model");
+  ASSERT_GE(fd, 0);
+
+  std::unique_ptr<ModelBundle> bundle = ModelBundle::FromFileDescriptor(fd);
+  ASSERT_NE(bundle, nullptr);
+  EXPECT_EQ(bundle->GetSection(kLangIdBundleSection).ToString(),
+            "lang id model");
+  const Model* annotator_model =
+      GetModel(bundle->GetSection(kAnnotatorBundleSection).data());
+  const auto* pattern = annotator_model->regex_model()->patterns()->Get(0);
+  EXPECT_EQ(pattern->pattern()->str(), "this is a test pattern");
+  close(fd);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
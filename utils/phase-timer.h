@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Timing of the phases of a call, for callers that want to know where its
+// time goes without running a profiler.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_PHASE_TIMER_H_
+#define LIBTEXTCLASSIFIER_UTILS_PHASE_TIMER_H_
+
+#include <chrono>
+
+#include "utils/base/integral_types.h"
+
+namespace libtextclassifier3 {
+
+// Adds the wall time from its construction to its destruction, in
+// microseconds, to a phase counter of a struct of phase times, e.g.
+//
+//   ScopedPhaseTimer timer(options.phase_times, &PhaseTimes::regex_us);
+//
+// Does nothing, without reading the clock, if the struct is null, i.e. if the
+// caller didn't ask for the times. Builds with -DTC3_DISABLE_PHASE_TIMERS
+// compile the timers out altogether.
+//
+// The counters are plain integers: timers running at the same time on
+// different threads must use different counters.
+class ScopedPhaseTimer {
+ public:
+  template <typename PhaseTimes>
+  ScopedPhaseTimer(PhaseTimes* phase_times, int64 PhaseTimes::*phase_us) {
+#ifndef TC3_DISABLE_PHASE_TIMERS
+    if (phase_times != nullptr) {
+      elapsed_us_ = &(phase_times->*phase_us);
+      start_ = std::chrono::steady_clock::now();
+    }
+#endif  // TC3_DISABLE_PHASE_TIMERS
+  }
+
+  ~ScopedPhaseTimer() {
+#ifndef TC3_DISABLE_PHASE_TIMERS
+    if (elapsed_us_ != nullptr) {
+      *elapsed_us_ += std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::steady_clock::now() - start_)
+                          .count();
+    }
+#endif  // TC3_DISABLE_PHASE_TIMERS
+  }
+
+  ScopedPhaseTimer(const ScopedPhaseTimer&) = delete;
+  ScopedPhaseTimer& operator=(const ScopedPhaseTimer&) = delete;
+
+ private:
+#ifndef TC3_DISABLE_PHASE_TIMERS
+  int64* elapsed_us_ = nullptr;
+  std::chrono::steady_clock::time_point start_;
+#endif  // TC3_DISABLE_PHASE_TIMERS
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_PHASE_TIMER_H_
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/phase-timer.h"
+
+#include <chrono>  // NOLINT
+#include <thread>  // NOLINT
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+struct TestPhaseTimes {
+  int64 first_us = 0;
+  int64 second_us = 0;
+};
+
+TEST(ScopedPhaseTimerTest, AddsTheTimeOfTheScopeToThePhase) {
+  TestPhaseTimes phase_times;
+  {
+    ScopedPhaseTimer timer(&phase_times, &TestPhaseTimes::second_us);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  EXPECT_EQ(phase_times.first_us, 0);
+  EXPECT_GE(phase_times.second_us, 2000);
+
+  const int64 second_us = phase_times.second_us;
+  {
+    ScopedPhaseTimer timer(&phase_times, &TestPhaseTimes::second_us);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+  EXPECT_GE(phase_times.second_us, second_us + 2000);
+}
+
+TEST(ScopedPhaseTimerTest, DoesNothingWithoutPhaseTimes) {
+  TestPhaseTimes* phase_times = nullptr;
+  ScopedPhaseTimer timer(phase_times, &TestPhaseTimes::first_us);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/regex-compilation.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+bool CompileRange(const std::vector<const UniLib::RegexPattern*>& patterns,
+                  int begin, int end) {
+  bool success = true;
+  for (int i = begin; i < end; ++i) {
+    if (patterns[i] != nullptr && !patterns[i]->Compile()) {
+      success = false;
+    }
+  }
+  return success;
+}
+
+}  // namespace
+
+bool CompileRegexPatterns(
+    const std::vector<const UniLib::RegexPattern*>& patterns,
+    ThreadPool* thread_pool) {
+  return RunInBatches(patterns.size(), thread_pool,
+                      [&patterns](int begin, int end) {
+                        return CompileRange(patterns, begin, end);
+                      });
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compilation of many regex patterns at once.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_REGEX_COMPILATION_H_
+#define LIBTEXTCLASSIFIER_UTILS_REGEX_COMPILATION_H_
+
+#include <vector>
+
+#include "utils/thread-pool.h"
+#include "utils/utf8/unilib.h"
+
+namespace libtextclassifier3 {
+
+// Compiles the patterns that were created lazily and aren't compiled yet,
+// spread over the worker threads of the pool, and waits until all of them are
+// done. The calling thread takes part in the compilation, so this also makes
+// progress if the pool is busy. Without a pool, the patterns are compiled on
+// the calling thread.
+// As the patterns compile under their own lock, this can run concurrently with
+// requests that use them, e.g. from a background thread after loading.
+// Returns false if any of the patterns failed to compile.
+bool CompileRegexPatterns(
+    const std::vector<const UniLib::RegexPattern*>& patterns,
+    ThreadPool* thread_pool);
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_REGEX_COMPILATION_H_
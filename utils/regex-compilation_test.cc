@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/regex-compilation.h"
+
+#include <memory>
+#include <vector>
+
+#include "utils/utf8/unicodetext.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+class RegexCompilationTest : public testing::Test {
+ protected:
+  RegexCompilationTest() : INIT_UNILIB_FOR_TESTING(unilib_) {}
+
+  void AddPattern(const std::string& pattern) {
+    owned_patterns_.push_back(unilib_.CreateLazyRegexPattern(
+        UTF8ToUnicodeText(pattern, /*do_copy=*/true)));
+    patterns_.push_back(owned_patterns_.back().get());
+  }
+
+  UniLib unilib_;
+  std::vector<std::unique_ptr<UniLib::RegexPattern>> owned_patterns_;
+  std::vector<const UniLib::RegexPattern*> patterns_;
+};
+
+TEST_F(RegexCompilationTest, CompilesOnCallingThread) {
+  AddPattern("[a-z]+");
+  AddPattern("\\d{3}");
+  EXPECT_TRUE(CompileRegexPatterns(patterns_, /*thread_pool=*/nullptr));
+}
+
+TEST_F(RegexCompilationTest, CompilesOnThreadPool) {
+  for (int i = 0; i < 100; ++i) {
+    AddPattern("a{" + std::to_string(i) + "}b");
+  }
+  ThreadPool thread_pool(/*num_threads=*/3);
+  EXPECT_TRUE(CompileRegexPatterns(patterns_, &thread_pool));
+
+  int status;
+  std::unique_ptr<UniLib::RegexMatcher> matcher =
+      patterns_[2]->Matcher(UTF8ToUnicodeText("aab", /*do_copy=*/false));
+  EXPECT_TRUE(matcher->Matches(&status));
+}
+
+TEST_F(RegexCompilationTest, ReportsFailure) {
+  for (int i = 0; i < 10; ++i) {
+    AddPattern("(a|b)");
+  }
+  AddPattern("(unbalanced");
+  ThreadPool thread_pool(/*num_threads=*/2);
+  EXPECT_FALSE(CompileRegexPatterns(patterns_, &thread_pool));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -31,59 +31,76 @@ extern "C" {
 #endif
 
 namespace libtextclassifier3 {
-namespace {
 
 // Provide a lua environment for running regex match post verification.
 // It sets up and exposes the match data as well as the context.
 class LuaVerifier : private LuaEnvironment {
  public:
-  static std::unique_ptr<LuaVerifier> Create(
-      const std::string& context, const std::string& verifier_code,
-      const UniLib::RegexMatcher* matcher);
+  static std::unique_ptr<LuaVerifier> Create(const std::string& verifier_code);
 
-  bool Verify(bool* result);
+  // Runs the verifier on a match in the context. The context is only read
+  // during the call.
+  bool Verify(StringPiece context, const UniLib::RegexMatcher* matcher,
+              bool* result);
+
+  using LuaEnvironment::memory_usage_bytes;
 
  private:
-  explicit LuaVerifier(const std::string& context,
-                       const std::string& verifier_code,
-                       const UniLib::RegexMatcher* matcher)
-      : context_(context), verifier_code_(verifier_code), matcher_(matcher) {}
-  bool Initialize();
+  LuaVerifier() = default;
+  bool Initialize(const std::string& verifier_code);
 
   // Provides details of a capturing group to lua.
   int GetCapturingGroup();
 
-  const std::string& context_;
-  const std::string& verifier_code_;
-  const UniLib::RegexMatcher* matcher_;
+  // Provides the globals that are only pushed when the script reads them.
+  int GetLazyGlobal();
+
+  // The match currently being verified, and its context.
+  const UniLib::RegexMatcher* matcher_ = nullptr;
+  StringPiece context_;
+
+  // Reference to the loaded verifier snippet.
+  int verifier_ref_ = LUA_NOREF;
 };
 
-bool LuaVerifier::Initialize() {
+bool LuaVerifier::Initialize(const std::string& verifier_code) {
   // Run protected to not lua panic in case of setup failure.
-  return RunProtected([this] {
-           LoadDefaultLibraries();
-
-           // Expose context of the match as `context` global variable.
-           PushString(context_);
-           lua_setglobal(state_, "context");
-
-           // Expose match array as `match` global variable.
-           // Each entry `match[i]` exposes the ith capturing group as:
-           //   * `begin`: span start
-           //   * `end`: span end
-           //   * `text`: the text
-           BindTable<LuaVerifier, &LuaVerifier::GetCapturingGroup>("match");
-           lua_setglobal(state_, "match");
-           return LUA_OK;
-         }) == LUA_OK;
+  if (RunProtected([this] {
+        LoadDefaultLibraries();
+
+        // Expose match array as `match` global variable.
+        // Each entry `match[i]` exposes the ith capturing group as:
+        //   * `begin`: span start
+        //   * `end`: span end
+        //   * `text`: the text
+        BindTable<LuaVerifier, &LuaVerifier::GetCapturingGroup>("match");
+        lua_setglobal(state_, "match");
+
+        // Expose the context as `context` global variable, through the
+        // metatable of the globals, so that it is only copied into a lua
+        // string if the script reads it.
+        lua_pushglobaltable(state_);
+        BindTable<LuaVerifier, &LuaVerifier::GetLazyGlobal>("lazy_globals");
+        lua_getmetatable(state_, /*idx=*/-1);
+        lua_setmetatable(state_, /*idx=*/-3);
+        lua_pop(state_, 2);
+        return LUA_OK;
+      }) != LUA_OK) {
+    return false;
+  }
+
+  verifier_ref_ = LoadSnippet(verifier_code);
+  if (verifier_ref_ == LUA_NOREF) {
+    TC3_LOG(ERROR) << "Could not load verifier snippet.";
+    return false;
+  }
+  return true;
 }
 
 std::unique_ptr<LuaVerifier> LuaVerifier::Create(
-    const std::string& context, const std::string& verifier_code,
-    const UniLib::RegexMatcher* matcher) {
-  auto verifier = std::unique_ptr<LuaVerifier>(
-      new LuaVerifier(context, verifier_code, matcher));
-  if (!verifier->Initialize()) {
+    const std::string& verifier_code) {
+  auto verifier = std::unique_ptr<LuaVerifier>(new LuaVerifier());
+  if (!verifier->Initialize(verifier_code)) {
     TC3_LOG(ERROR) << "Could not initialize lua environment.";
     return nullptr;
   }
@@ -117,19 +134,31 @@ int LuaVerifier::GetCapturingGroup() {
   return 1;
 }
 
-bool LuaVerifier::Verify(bool* result) {
-  if (luaL_loadbuffer(state_, verifier_code_.data(), verifier_code_.size(),
-                      /*name=*/nullptr) != LUA_OK) {
-    TC3_LOG(ERROR) << "Could not load verifier snippet.";
-    return false;
+int LuaVerifier::GetLazyGlobal() {
+  if (lua_type(state_, /*idx=*/-1) == LUA_TSTRING &&
+      ReadString(/*index=*/-1).Equals("context")) {
+    PushString(context_);
+    return 1;
   }
+  lua_pushnil(state_);
+  return 1;
+}
 
-  if (lua_pcall(state_, /*nargs=*/0, /*nresults=*/1, /*errfunc=*/0) != LUA_OK) {
+bool LuaVerifier::Verify(StringPiece context,
+                         const UniLib::RegexMatcher* matcher, bool* result) {
+  // Leave the stack as it was, whatever happens, as the state is reused.
+  const int stack_top = lua_gettop(state_);
+  matcher_ = matcher;
+  context_ = context;
+
+  if (RunSnippet(verifier_ref_, /*num_results=*/1) != LUA_OK) {
     TC3_LOG(ERROR) << "Could not run verifier snippet.";
+    lua_settop(state_, stack_top);
     return false;
   }
 
-  if (RunProtected(
+  const bool success =
+      RunProtected(
           [this, result] {
             if (lua_type(state_, /*idx=*/-1) != LUA_TBOOLEAN) {
               TC3_LOG(ERROR) << "Unexpected verification result type: "
@@ -140,15 +169,14 @@ bool LuaVerifier::Verify(bool* result) {
             *result = lua_toboolean(state_, /*idx=*/-1);
             return LUA_OK;
           },
-          /*num_args=*/1) != LUA_OK) {
+          /*num_args=*/1) == LUA_OK;
+  lua_settop(state_, stack_top);
+  if (!success) {
     TC3_LOG(ERROR) << "Could not read lua result.";
-    return false;
   }
-  return true;
+  return success;
 }
 
-}  // namespace
-
 bool SetFieldFromCapturingGroup(const int group_id,
                                 const FlatbufferFieldPath* field_path,
                                 const UniLib::RegexMatcher* matcher,
@@ -161,20 +189,63 @@ bool SetFieldFromCapturingGroup(const int group_id,
   return flatbuffer->ParseAndSet(field_path, group_text);
 }
 
-bool VerifyMatch(const std::string& context,
+bool SetFieldFromCapturingGroup(const int group_id,
+                                const ResolvedFieldPath& field_path,
+                                const UniLib::RegexMatcher* matcher,
+                                ReflectiveFlatbuffer* flatbuffer) {
+  int status = UniLib::RegexMatcher::kNoError;
+  std::string group_text = matcher->Group(group_id, &status).ToUTF8String();
+  if (status != UniLib::RegexMatcher::kNoError || group_text.empty()) {
+    return false;
+  }
+  return flatbuffer->ParseAndSet(field_path, group_text);
+}
+
+bool VerifyMatch(StringPiece context,
                  const UniLib::RegexMatcher* matcher,
                  const std::string& lua_verifier_code) {
   bool status = false;
-  auto verifier = LuaVerifier::Create(context, lua_verifier_code, matcher);
+  auto verifier = LuaVerifier::Create(lua_verifier_code);
   if (verifier == nullptr) {
     TC3_LOG(ERROR) << "Could not create verifier.";
     return false;
   }
-  if (!verifier->Verify(&status)) {
+  if (!verifier->Verify(context, matcher, &status)) {
     TC3_LOG(ERROR) << "Could not create verifier.";
     return false;
   }
   return status;
 }
 
+LuaMatchVerifier::LuaMatchVerifier(const std::string& lua_verifier_code,
+                                   int max_idle_environments)
+    : lua_verifier_code_(lua_verifier_code),
+      verifiers_(new LuaEnvironmentPool<LuaVerifier>(max_idle_environments)) {}
+
+LuaMatchVerifier::~LuaMatchVerifier() = default;
+
+size_t LuaMatchVerifier::IdleMemoryUsageBytes() const {
+  return verifiers_->IdleMemoryUsageBytes();
+}
+
+bool LuaMatchVerifier::Verify(StringPiece context,
+                              const UniLib::RegexMatcher* matcher) const {
+  LuaEnvironmentPool<LuaVerifier>::Lease verifier = verifiers_->Acquire();
+  if (verifier == nullptr) {
+    verifier = LuaVerifier::Create(lua_verifier_code_);
+    if (verifier == nullptr) {
+      TC3_LOG(ERROR) << "Could not create verifier.";
+      return false;
+    }
+  }
+
+  bool status = false;
+  if (!verifier->Verify(context, matcher, &status)) {
+    TC3_LOG(ERROR) << "Could not run verifier.";
+    return false;
+  }
+  verifiers_->Release(std::move(verifier));
+  return status;
+}
+
 }  // namespace libtextclassifier3
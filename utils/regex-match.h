@@ -17,11 +17,20 @@
 #ifndef LIBTEXTCLASSIFIER_UTILS_REGEX_MATCH_H_
 #define LIBTEXTCLASSIFIER_UTILS_REGEX_MATCH_H_
 
+#include <memory>
+#include <string>
+
 #include "utils/flatbuffers.h"
 #include "utils/flatbuffers_generated.h"
+#include "utils/strings/stringpiece.h"
 #include "utils/utf8/unilib.h"
 
 namespace libtextclassifier3 {
+
+class LuaVerifier;
+template <typename T>
+class LuaEnvironmentPool;
+
 // Sets a field in the flatbuffer from a regex match group.
 // Returns true if successful, and false if the field couldn't be set.
 bool SetFieldFromCapturingGroup(const int group_id,
@@ -29,9 +38,16 @@ bool SetFieldFromCapturingGroup(const int group_id,
                                 const UniLib::RegexMatcher* matcher,
                                 ReflectiveFlatbuffer* flatbuffer);
 
+// Same as above, but with the field path resolved against the schema.
+bool SetFieldFromCapturingGroup(const int group_id,
+                                const ResolvedFieldPath& field_path,
+                                const UniLib::RegexMatcher* matcher,
+                                ReflectiveFlatbuffer* flatbuffer);
+
 // Post-checks a regular expression match with a lua verifier script.
 // The verifier can access:
-//   * `context`: The context as a string.
+//   * `context`: The context as a string. It is only copied into lua if the
+//     script reads it.
 //   * `match`: The groups of the regex match as an array, each group gives
 //       * `begin`: span start
 //       * `end`: span end
@@ -39,10 +55,37 @@ bool SetFieldFromCapturingGroup(const int group_id,
 // The verifier is expected to return a boolean, indicating whether the
 // verification succeeded or not.
 // Returns true if the verification was successful, false if not.
-bool VerifyMatch(const std::string& context,
+bool VerifyMatch(StringPiece context,
                  const UniLib::RegexMatcher* matcher,
                  const std::string& lua_verifier_code);
 
+// Like VerifyMatch, but runs one verifier snippet in reusable lua environments.
+// An environment loads the default libraries and compiles the snippet once,
+// and then only the context and the match are bound for each verification.
+// Every run gets a fresh table of globals (falling back to the shared ones),
+// so that runs don't see each other's globals.
+// The class is thread-safe, concurrent verifications use separate
+// environments.
+class LuaMatchVerifier {
+ public:
+  explicit LuaMatchVerifier(const std::string& lua_verifier_code,
+                            int max_idle_environments = 4);
+  ~LuaMatchVerifier();
+
+  // Returns true if the verification was successful, false if not. The context
+  // is only read during the call.
+  bool Verify(StringPiece context, const UniLib::RegexMatcher* matcher) const;
+
+  const std::string& lua_verifier_code() const { return lua_verifier_code_; }
+
+  // Memory allocated by the lua states of the idle environments.
+  size_t IdleMemoryUsageBytes() const;
+
+ private:
+  const std::string lua_verifier_code_;
+  const std::unique_ptr<LuaEnvironmentPool<LuaVerifier>> verifiers_;
+};
+
 }  // namespace libtextclassifier3
 
 #endif  // LIBTEXTCLASSIFIER_UTILS_REGEX_MATCH_H_
@@ -17,6 +17,8 @@
 #include "utils/regex-match.h"
 
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "utils/utf8/unilib.h"
 #include "gmock/gmock.h"
@@ -70,6 +72,47 @@ return luhn(match[1].text);
 
   EXPECT_TRUE(VerifyMatch(message.ToUTF8String(), matcher.get(), verifier));
 }
+
+TEST_F(LuaVerifierTest, ReusesEnvironmentAcrossVerifications) {
+  UnicodeText pattern = UTF8ToUnicodeText("(\\d+)", /*do_copy=*/true);
+  std::unique_ptr<UniLib::RegexPattern> regex_pattern =
+      unilib_.CreateRegexPattern(pattern);
+  ASSERT_TRUE(regex_pattern != nullptr);
+
+  // The verifier accepts even numbers. It would reject every match after the
+  // first one if globals leaked from one run to the next.
+  const LuaMatchVerifier verifier(R"(
+if seen ~= nil then
+  return false
+end
+seen = true
+return tonumber(match[1].text) % 2 == 0 and string.len(context) > 0
+)");
+
+  const std::string message = "4 7 12";
+  const UnicodeText message_unicode =
+      UTF8ToUnicodeText(message, /*do_copy=*/false);
+  std::unique_ptr<UniLib::RegexMatcher> matcher =
+      regex_pattern->Matcher(message_unicode);
+  ASSERT_TRUE(matcher != nullptr);
+  int status = UniLib::RegexMatcher::kNoError;
+  std::vector<bool> results;
+  while (matcher->Find(&status) && status == UniLib::RegexMatcher::kNoError) {
+    results.push_back(verifier.Verify(message, matcher.get()));
+  }
+  EXPECT_THAT(results, testing::ElementsAre(true, false, true));
+}
+
+TEST_F(LuaVerifierTest, ReadsContextFromView) {
+  // The context is a view of a part of a larger buffer.
+  const std::string buffer = "context: 4 7|rest";
+  const StringPiece context(buffer.data() + 9, 3);
+  const LuaMatchVerifier verifier(R"(
+return context == "4 7" and unknown_global == nil
+)");
+  EXPECT_TRUE(verifier.Verify(context, /*matcher=*/nullptr));
+  EXPECT_FALSE(verifier.Verify("4 8", /*matcher=*/nullptr));
+}
 #endif
 
 }  // namespace
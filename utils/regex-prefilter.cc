@@ -0,0 +1,973 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/regex-prefilter.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "utils/strings/utf8.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TC3_REGEX_PREFILTER_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define TC3_REGEX_PREFILTER_SSE2
+#endif
+
+namespace libtextclassifier3 {
+namespace {
+
+constexpr int kBlockSize = 16;
+
+// Returns whether the kBlockSize bytes at `block` contain an ASCII digit or a
+// non-ASCII byte.
+inline bool BlockMayContainDigit(const char* block) {
+#if defined(TC3_REGEX_PREFILTER_NEON)
+  const uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t*>(block));
+  const uint8x16_t hits =
+      vorrq_u8(vcleq_u8(vsubq_u8(bytes, vdupq_n_u8('0')), vdupq_n_u8(9)),
+               vcgeq_u8(bytes, vdupq_n_u8(0x80)));
+  const uint8x8_t merged = vorr_u8(vget_low_u8(hits), vget_high_u8(hits));
+  return vget_lane_u64(vreinterpret_u64_u8(merged), 0) != 0;
+#elif defined(TC3_REGEX_PREFILTER_SSE2)
+  const __m128i bytes =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+  // Non-ASCII bytes are negative as signed bytes, so the digit check skips
+  // them and their sign bit marks them in the mask.
+  const __m128i digits =
+      _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('0' - 1)),
+                    _mm_cmplt_epi8(bytes, _mm_set1_epi8('9' + 1)));
+  return _mm_movemask_epi8(_mm_or_si128(digits, bytes)) != 0;
+#else
+  for (int i = 0; i < kBlockSize; ++i) {
+    const unsigned char c = static_cast<unsigned char>(block[i]);
+    if ((c >= '0' && c <= '9') || c >= 0x80) {
+      return true;
+    }
+  }
+  return false;
+#endif
+}
+
+bool IsAsciiAlnum(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+         (c >= 'A' && c <= 'Z');
+}
+
+bool IsHexDigit(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+         (c >= 'A' && c <= 'F');
+}
+
+// Returns the position just past the first occurrence of `delimiter` at or
+// after `pos`, or the end of the pattern if there is none.
+int SkipPast(StringPiece pattern, int pos, char delimiter) {
+  while (pos < pattern.size() && pattern[pos] != delimiter) {
+    ++pos;
+  }
+  return std::min(pos + 1, static_cast<int>(pattern.size()));
+}
+
+// Returns the minimum count of the repetition quantifier ("{n}", "{n,}" or
+// "{n,m}") starting at `pos`, or 0 if there isn't one.
+int MinRepetitions(StringPiece pattern, int pos) {
+  constexpr int kMaxCount = 1 << 16;
+  int count = 0;
+  int i = pos + 1;
+  for (; i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9'; ++i) {
+    count = std::min(count * 10 + (pattern[i] - '0'), kMaxCount);
+  }
+  if (i == pos + 1 || i == pattern.size() ||
+      (pattern[i] != '}' && pattern[i] != ',')) {
+    return 0;
+  }
+  return count;
+}
+
+// Returns the position just past the character class starting at `pos`,
+// which points to the opening bracket. Handles escapes and nested classes.
+int SkipCharacterClass(StringPiece pattern, int pos) {
+  int depth = 0;
+  while (pos < pattern.size()) {
+    const char c = pattern[pos];
+    if (c == '\\') {
+      pos += 2;
+      continue;
+    }
+    if (c == '[') {
+      ++depth;
+      ++pos;
+      // A closing bracket right after the (possibly negated) opening bracket
+      // is a literal member of the class.
+      if (pos < pattern.size() && pattern[pos] == '^') {
+        ++pos;
+      }
+      if (pos < pattern.size() && pattern[pos] == ']') {
+        ++pos;
+      }
+      continue;
+    }
+    ++pos;
+    if (c == ']' && --depth == 0) {
+      break;
+    }
+  }
+  return std::min(pos, static_cast<int>(pattern.size()));
+}
+
+// Returns the position just past the arguments of the escape sequence with the
+// letter at `pos`, or -1 if the pattern is quoted from there on.
+int SkipEscapeArguments(StringPiece pattern, int pos) {
+  const char escape = pattern[pos++];
+  const bool has_braces = pos < pattern.size() && pattern[pos] == '{';
+  switch (escape) {
+    case 'Q':
+      return -1;
+    case 'p':
+    case 'P':
+    case 'N':
+      return has_braces ? SkipPast(pattern, pos, '}')
+                        : std::min(pos + 1, static_cast<int>(pattern.size()));
+    case 'x':
+      if (has_braces) {
+        return SkipPast(pattern, pos, '}');
+      }
+      for (int i = 0; i < 2 && pos < pattern.size() && IsHexDigit(pattern[pos]);
+           ++i) {
+        ++pos;
+      }
+      return pos;
+    case 'u':
+      for (int i = 0; i < 4 && pos < pattern.size() && IsHexDigit(pattern[pos]);
+           ++i) {
+        ++pos;
+      }
+      return pos;
+    case 'c':
+      return std::min(pos + 1, static_cast<int>(pattern.size()));
+    case 'k':
+      return SkipPast(pattern, pos, '>');
+    default:
+      // Octal escapes and back references.
+      if (escape >= '0' && escape <= '9') {
+        while (pos < pattern.size() && pattern[pos] >= '0' &&
+               pattern[pos] <= '9') {
+          ++pos;
+        }
+      }
+      return pos;
+  }
+}
+
+// Lowest length of the triggers, a digit counting as much as a two character
+// literal. Longer triggers are less likely to occur in a text.
+int MinTriggerLength(const RegexTriggers& triggers) {
+  int result = triggers.digit ? 2 : std::numeric_limits<int>::max();
+  for (const std::string& literal : triggers.literals) {
+    result = std::min(result, static_cast<int>(literal.size()));
+  }
+  for (const std::string& literal : triggers.case_insensitive_literals) {
+    result = std::min(result, static_cast<int>(literal.size()));
+  }
+  return result;
+}
+
+int NumTriggers(const RegexTriggers& triggers) {
+  return triggers.literals.size() + triggers.case_insensitive_literals.size() +
+         (triggers.digit ? 1 : 0);
+}
+
+// Triggers of an alternation: the ones of either alternative.
+RegexTriggers UnionOfTriggers(const RegexTriggers& a, const RegexTriggers& b) {
+  if (!a.known || !b.known) {
+    return RegexTriggers();
+  }
+  RegexTriggers result = a;
+  result.literals.insert(result.literals.end(), b.literals.begin(),
+                         b.literals.end());
+  result.case_insensitive_literals.insert(
+      result.case_insensitive_literals.end(),
+      b.case_insensitive_literals.begin(), b.case_insensitive_literals.end());
+  result.digit |= b.digit;
+  return result;
+}
+
+// Triggers of a concatenation: the ones of any of the parts will do, so this
+// keeps the more selective ones.
+RegexTriggers SelectiveTriggers(RegexTriggers a, RegexTriggers b) {
+  if (!a.known) {
+    return b;
+  }
+  if (!b.known) {
+    return a;
+  }
+  const int a_length = MinTriggerLength(a);
+  const int b_length = MinTriggerLength(b);
+  if (a_length != b_length) {
+    return a_length > b_length ? a : b;
+  }
+  return NumTriggers(a) <= NumTriggers(b) ? a : b;
+}
+
+// Recursive descent over a pattern, computing the triggers of every
+// sub-expression. Optional sub-expressions, character classes other than
+// digits, anchors and lookarounds have no known triggers.
+class RegexTriggerExtractor {
+ public:
+  explicit RegexTriggerExtractor(StringPiece pattern) : pattern_(pattern) {}
+
+  RegexTriggers Extract() {
+    RegexTriggers triggers = ParseAlternation(/*case_insensitive=*/false);
+    if (failed_ || !AtEnd()) {
+      return RegexTriggers();
+    }
+    return triggers;
+  }
+
+ private:
+  enum Quantifier { kNone, kOptional, kRepeated };
+
+  bool AtEnd() const { return pos_ >= pattern_.size(); }
+
+  RegexTriggers Fail() {
+    failed_ = true;
+    pos_ = pattern_.size();
+    return RegexTriggers();
+  }
+
+  static RegexTriggers Digit() {
+    RegexTriggers triggers;
+    triggers.known = true;
+    triggers.digit = true;
+    return triggers;
+  }
+
+  RegexTriggers ParseAlternation(bool case_insensitive) {
+    // Inline flags apply up to the end of the enclosing group, across
+    // alternatives.
+    RegexTriggers result = ParseConcatenation(&case_insensitive);
+    while (!AtEnd() && pattern_[pos_] == '|') {
+      ++pos_;
+      result = UnionOfTriggers(result, ParseConcatenation(&case_insensitive));
+    }
+    return result;
+  }
+
+  RegexTriggers ParseConcatenation(bool* case_insensitive) {
+    RegexTriggers result;
+    std::string run;
+    while (!AtEnd() && pattern_[pos_] != '|' && pattern_[pos_] != ')') {
+      std::string character;
+      if (ReadLiteralCharacter(&character)) {
+        const Quantifier quantifier = ParseQuantifier();
+        if (quantifier != kOptional) {
+          run += character;
+        }
+        if (quantifier != kNone) {
+          result = SelectiveTriggers(result,
+                                     RunTriggers(&run, *case_insensitive));
+        }
+        continue;
+      }
+      result = SelectiveTriggers(result, RunTriggers(&run, *case_insensitive));
+      RegexTriggers atom = ParseAtom(case_insensitive);
+      if (ParseQuantifier() == kOptional) {
+        atom = RegexTriggers();
+      }
+      result = SelectiveTriggers(result, atom);
+    }
+    return SelectiveTriggers(result, RunTriggers(&run, *case_insensitive));
+  }
+
+  // Reads a plain or escaped literal character.
+  bool ReadLiteralCharacter(std::string* character) {
+    int begin = pos_;
+    if (pattern_[begin] == '\\') {
+      if (begin + 1 >= pattern_.size() || IsAsciiAlnum(pattern_[begin + 1])) {
+        return false;
+      }
+      ++begin;
+    } else if (strchr("[](){}|.^$*+?", pattern_[begin]) != nullptr) {
+      return false;
+    }
+    const int num_bytes =
+        std::min(GetNumBytesForUTF8Char(pattern_.data() + begin),
+                 static_cast<int>(pattern_.size()) - begin);
+    character->assign(pattern_.data() + begin, num_bytes);
+    pos_ = begin + num_bytes;
+    return true;
+  }
+
+  Quantifier ParseQuantifier() {
+    Quantifier result = kNone;
+    while (!AtEnd()) {
+      const char c = pattern_[pos_];
+      bool optional;
+      if (c == '?' || c == '*') {
+        optional = true;
+        ++pos_;
+      } else if (c == '+') {
+        optional = false;
+        ++pos_;
+      } else if (c == '{') {
+        ++pos_;
+        bool has_digits = false;
+        optional = true;
+        while (!AtEnd() && pattern_[pos_] >= '0' && pattern_[pos_] <= '9') {
+          has_digits = true;
+          optional &= pattern_[pos_] == '0';
+          ++pos_;
+        }
+        if (!has_digits) {
+          Fail();
+          return kNone;
+        }
+        pos_ = SkipPast(pattern_, pos_, '}');
+      } else {
+        break;
+      }
+      result = (optional || result == kOptional) ? kOptional : kRepeated;
+
+      // Lazy and possessive variants.
+      if (!AtEnd() && (pattern_[pos_] == '?' || pattern_[pos_] == '+')) {
+        ++pos_;
+      }
+    }
+    return result;
+  }
+
+  RegexTriggers ParseAtom(bool* case_insensitive) {
+    switch (pattern_[pos_]) {
+      case '(':
+        return ParseGroup(case_insensitive);
+      case '[': {
+        const int class_end = SkipCharacterClass(pattern_, pos_);
+        const std::string char_class(pattern_.data() + pos_,
+                                     class_end - pos_);
+        pos_ = class_end;
+        if (char_class == "[0-9]" || char_class == "[\\d]") {
+          return Digit();
+        }
+        return RegexTriggers();
+      }
+      case '\\': {
+        if (pos_ + 1 >= pattern_.size()) {
+          return Fail();
+        }
+        const char escaped = pattern_[pos_ + 1];
+        pos_ = SkipEscapeArguments(pattern_, pos_ + 1);
+        if (pos_ < 0) {
+          return Fail();
+        }
+        return escaped == 'd' ? Digit() : RegexTriggers();
+      }
+      case '*':
+      case '+':
+      case '?':
+      case '{':
+        // A quantifier without anything to repeat.
+        return Fail();
+      default:
+        // Anchors, '.' and stray closing brackets.
+        ++pos_;
+        return RegexTriggers();
+    }
+  }
+
+  RegexTriggers ParseGroup(bool* case_insensitive) {
+    ++pos_;
+    bool group_case_insensitive = *case_insensitive;
+    bool is_lookaround = false;
+    if (!AtEnd() && pattern_[pos_] == '?') {
+      ++pos_;
+      if (AtEnd()) {
+        return Fail();
+      }
+      const char kind = pattern_[pos_];
+      if (kind == ':' || kind == '>') {
+        ++pos_;
+      } else if (kind == '=' || kind == '!') {
+        ++pos_;
+        is_lookaround = true;
+      } else if (kind == '#') {
+        pos_ = SkipPast(pattern_, pos_, ')');
+        return RegexTriggers();
+      } else if (kind == '<') {
+        ++pos_;
+        if (!AtEnd() && (pattern_[pos_] == '=' || pattern_[pos_] == '!')) {
+          ++pos_;
+          is_lookaround = true;
+        } else {
+          // A named group.
+          pos_ = SkipPast(pattern_, pos_, '>');
+        }
+      } else {
+        // Inline flags, e.g. (?i) or (?i-m:...).
+        bool enable = true;
+        bool flags_case_insensitive = *case_insensitive;
+        while (!AtEnd() && pattern_[pos_] != ')' && pattern_[pos_] != ':') {
+          const char flag = pattern_[pos_++];
+          if (flag == '-') {
+            enable = false;
+          } else if (flag == 'i') {
+            flags_case_insensitive = enable;
+          } else if (flag == 'x' || !IsAsciiAlnum(flag)) {
+            // Free-spacing mode changes what is a literal.
+            return Fail();
+          }
+        }
+        if (AtEnd()) {
+          return Fail();
+        }
+        if (pattern_[pos_++] == ')') {
+          *case_insensitive = flags_case_insensitive;
+          return RegexTriggers();
+        }
+        group_case_insensitive = flags_case_insensitive;
+      }
+    }
+
+    RegexTriggers triggers = ParseAlternation(group_case_insensitive);
+    if (AtEnd() || pattern_[pos_] != ')') {
+      return Fail();
+    }
+    ++pos_;
+    return is_lookaround ? RegexTriggers() : triggers;
+  }
+
+  // Returns the triggers of a run of literal characters and clears it.
+  RegexTriggers RunTriggers(std::string* run, bool case_insensitive) {
+    RegexTriggers triggers;
+    std::string literal;
+    bool is_case_insensitive_literal = false;
+    if (!case_insensitive) {
+      literal = *run;
+    } else {
+      // Use the longest ASCII piece, non-ASCII characters can fold to
+      // sequences of different length.
+      int piece_begin = 0;
+      for (int i = 0; i <= run->size(); ++i) {
+        if (i < run->size() && static_cast<unsigned char>((*run)[i]) < 0x80) {
+          continue;
+        }
+        if (i - piece_begin > literal.size()) {
+          literal = run->substr(piece_begin, i - piece_begin);
+        }
+        piece_begin = i + 1;
+      }
+      for (char& c : literal) {
+        if (c >= 'A' && c <= 'Z') {
+          c += 'a' - 'A';
+        }
+        if (c >= 'a' && c <= 'z') {
+          is_case_insensitive_literal = true;
+        }
+      }
+    }
+    run->clear();
+    if (literal.empty()) {
+      return triggers;
+    }
+    triggers.known = true;
+    if (is_case_insensitive_literal) {
+      triggers.case_insensitive_literals.push_back(literal);
+    } else {
+      triggers.literals.push_back(literal);
+    }
+    return triggers;
+  }
+
+  const StringPiece pattern_;
+  int pos_ = 0;
+  bool failed_ = false;
+};
+
+// Expands a pattern made of literals, groups, alternations and optional parts
+// into the strings it matches. Anchors, word boundaries and inline flags match
+// the empty string.
+class RegexLiteralExpander {
+ public:
+  RegexLiteralExpander(StringPiece pattern, int max_strings)
+      : pattern_(pattern), max_strings_(max_strings) {}
+
+  bool Expand(std::vector<std::string>* strings) {
+    std::vector<std::string> result = ParseAlternation();
+    if (failed_ || !AtEnd()) {
+      return false;
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    *strings = std::move(result);
+    return true;
+  }
+
+ private:
+  bool AtEnd() const { return pos_ >= pattern_.size(); }
+
+  std::vector<std::string> Fail() {
+    failed_ = true;
+    pos_ = pattern_.size();
+    return {};
+  }
+
+  std::vector<std::string> ParseAlternation() {
+    std::vector<std::string> result = ParseConcatenation();
+    while (!AtEnd() && pattern_[pos_] == '|') {
+      ++pos_;
+      const std::vector<std::string> alternative = ParseConcatenation();
+      result.insert(result.end(), alternative.begin(), alternative.end());
+      if (result.size() > max_strings_) {
+        return Fail();
+      }
+    }
+    return result;
+  }
+
+  std::vector<std::string> ParseConcatenation() {
+    std::vector<std::string> result = {""};
+    while (!AtEnd() && pattern_[pos_] != '|' && pattern_[pos_] != ')') {
+      std::vector<std::string> atom = ParseAtom();
+      if (!AtEnd() && pattern_[pos_] == '?') {
+        ++pos_;
+        // Lazy and possessive variants match the same strings.
+        if (!AtEnd() && (pattern_[pos_] == '?' || pattern_[pos_] == '+')) {
+          ++pos_;
+        }
+        atom.push_back("");
+      } else if (!AtEnd() && strchr("*+{", pattern_[pos_]) != nullptr) {
+        return Fail();
+      }
+      if (failed_ || result.size() * atom.size() > max_strings_) {
+        return Fail();
+      }
+      std::vector<std::string> concatenated;
+      for (const std::string& prefix : result) {
+        for (const std::string& suffix : atom) {
+          concatenated.push_back(prefix + suffix);
+        }
+      }
+      result = std::move(concatenated);
+    }
+    return result;
+  }
+
+  std::vector<std::string> ParseAtom() {
+    const char c = pattern_[pos_];
+    if (c == '(') {
+      return ParseGroup();
+    }
+    if (c == '^' || c == '$') {
+      ++pos_;
+      return {""};
+    }
+    if (c == '\\') {
+      if (pos_ + 1 >= pattern_.size()) {
+        return Fail();
+      }
+      const char escaped = pattern_[pos_ + 1];
+      pos_ += 2;
+      if (escaped == 'b' || escaped == 'B') {
+        return {""};
+      }
+      if (IsAsciiAlnum(escaped)) {
+        return Fail();
+      }
+      return {std::string(1, escaped)};
+    }
+    if (strchr("[].*+?{}", c) != nullptr) {
+      return Fail();
+    }
+    const int num_bytes =
+        std::min(GetNumBytesForUTF8Char(pattern_.data() + pos_),
+                 static_cast<int>(pattern_.size()) - pos_);
+    const std::string character(pattern_.data() + pos_, num_bytes);
+    pos_ += num_bytes;
+    return {character};
+  }
+
+  std::vector<std::string> ParseGroup() {
+    ++pos_;
+    if (!AtEnd() && pattern_[pos_] == '?') {
+      ++pos_;
+      if (AtEnd()) {
+        return Fail();
+      }
+      const char kind = pattern_[pos_];
+      if (kind == ':' || kind == '>') {
+        ++pos_;
+      } else if (kind == '<') {
+        ++pos_;
+        if (AtEnd() || pattern_[pos_] == '=' || pattern_[pos_] == '!') {
+          // Lookbehinds constrain the context, not the matched string.
+          return Fail();
+        }
+        // A named group.
+        pos_ = SkipPast(pattern_, pos_, '>');
+      } else if (kind == '=' || kind == '!' || kind == '#') {
+        return Fail();
+      } else {
+        // Inline flags, e.g. (?i) or (?i-m:...).
+        while (!AtEnd() && pattern_[pos_] != ')' && pattern_[pos_] != ':') {
+          const char flag = pattern_[pos_++];
+          if (flag == 'x' || (flag != '-' && !IsAsciiAlnum(flag))) {
+            // Free-spacing mode changes what is a literal.
+            return Fail();
+          }
+        }
+        if (AtEnd()) {
+          return Fail();
+        }
+        if (pattern_[pos_++] == ')') {
+          return {""};
+        }
+      }
+    }
+    std::vector<std::string> result = ParseAlternation();
+    if (AtEnd() || pattern_[pos_] != ')') {
+      return Fail();
+    }
+    ++pos_;
+    return result;
+  }
+
+  const StringPiece pattern_;
+  const int max_strings_;
+  int pos_ = 0;
+  bool failed_ = false;
+};
+
+}  // namespace
+
+RegexRequirements ExtractRegexRequirements(StringPiece pattern) {
+  RegexRequirements requirements;
+
+  // The run of literal characters currently being collected, and the byte
+  // offset of its last character, so that it can be dropped when it turns out
+  // to be optional.
+  std::string current;
+  int last_char_start = -1;
+
+  // Whether the current run directly follows a ^ at the start of the pattern.
+  bool is_anchored_run = false;
+  auto end_run = [&requirements, &current, &last_char_start,
+                  &is_anchored_run]() {
+    if (current.size() > requirements.literal.size()) {
+      requirements.literal = current;
+    }
+    if (is_anchored_run) {
+      requirements.prefix = current;
+      is_anchored_run = false;
+    }
+    current.clear();
+    last_char_start = -1;
+  };
+  auto append_char = [&current, &last_char_start](const char* begin,
+                                                  int num_bytes) {
+    last_char_start = current.size();
+    current.append(begin, num_bytes);
+  };
+
+  // Whether the last atom was a digit class, which is required unless a
+  // quantifier makes it optional.
+  bool is_digit_pending = false;
+
+  // Number of required digits of the current run of digit classes. Optional
+  // digit classes don't end it, any other atom does.
+  int digit_run = 0;
+  auto end_digit_run = [&requirements, &digit_run]() {
+    requirements.digit_run = std::max(requirements.digit_run, digit_run);
+    digit_run = 0;
+  };
+
+  // Nesting depth of groups. Literals within groups are not collected, as the
+  // group can contain alternations or be optional.
+  int depth = 0;
+  int pos = 0;
+  while (pos < pattern.size()) {
+    const char c = pattern[pos];
+    const bool is_quantifier = c == '?' || c == '*' || c == '{' || c == '+';
+    if (is_digit_pending) {
+      int min_count = 1;
+      if (c == '?' || c == '*') {
+        min_count = 0;
+      } else if (c == '{') {
+        min_count = MinRepetitions(pattern, pos);
+      }
+      requirements.digit |= min_count > 0;
+      digit_run += min_count;
+    }
+    is_digit_pending = false;
+
+    switch (c) {
+      case '|':
+        if (depth == 0) {
+          // Different alternatives don't need to share anything.
+          return RegexRequirements();
+        }
+        ++pos;
+        break;
+      case '(':
+        if (pos + 2 < pattern.size() && pattern[pos + 1] == '?' &&
+            (IsAsciiAlnum(pattern[pos + 2]) || pattern[pos + 2] == '-' ||
+             pattern[pos + 2] == ')')) {
+          // Inline flags, e.g. (?i), can change what literals match.
+          return RegexRequirements();
+        }
+        end_run();
+        ++depth;
+        ++pos;
+        break;
+      case ')':
+        end_run();
+        --depth;
+        ++pos;
+        break;
+      case '[': {
+        end_run();
+        const int class_end = SkipCharacterClass(pattern, pos);
+        const std::string char_class(pattern.data() + pos, class_end - pos);
+        is_digit_pending =
+            depth == 0 && (char_class == "[0-9]" || char_class == "[\\d]");
+        pos = class_end;
+        break;
+      }
+      case '?':
+      case '*':
+      case '{':
+        // The preceding character is optional.
+        if (last_char_start >= 0) {
+          current.resize(last_char_start);
+        }
+        end_run();
+        pos = (c == '{') ? SkipPast(pattern, pos, '}') : pos + 1;
+        break;
+      case '+':
+        // The preceding character is required, but can be repeated.
+        end_run();
+        ++pos;
+        break;
+      case '^':
+        end_run();
+        is_anchored_run = (pos == 0);
+        ++pos;
+        break;
+      case '.':
+      case '$':
+        end_run();
+        ++pos;
+        break;
+      case '\\': {
+        if (pos + 1 >= pattern.size()) {
+          return RegexRequirements();
+        }
+        const char escaped = pattern[pos + 1];
+        if (IsAsciiAlnum(escaped)) {
+          // A character class, anchor or other special escape sequence.
+          end_run();
+          is_digit_pending = depth == 0 && escaped == 'd';
+          pos = SkipEscapeArguments(pattern, pos + 1);
+          if (pos < 0) {
+            return RegexRequirements();
+          }
+          break;
+        }
+        const int num_bytes = std::min(
+            GetNumBytesForUTF8Char(pattern.data() + pos + 1),
+            static_cast<int>(pattern.size()) - pos - 1);
+        if (depth == 0) {
+          append_char(pattern.data() + pos + 1, num_bytes);
+        }
+        pos += 1 + num_bytes;
+        break;
+      }
+      default: {
+        const int num_bytes =
+            std::min(GetNumBytesForUTF8Char(pattern.data() + pos),
+                     static_cast<int>(pattern.size()) - pos);
+        if (depth == 0) {
+          append_char(pattern.data() + pos, num_bytes);
+        }
+        pos += num_bytes;
+        break;
+      }
+    }
+    if (!is_quantifier && !is_digit_pending) {
+      end_digit_run();
+    }
+  }
+  if (is_digit_pending) {
+    requirements.digit = true;
+    ++digit_run;
+  }
+  end_digit_run();
+  end_run();
+  return requirements;
+}
+
+bool MayContainDigit(StringPiece text) {
+  const char* data = text.data();
+  const int size = text.size();
+  int i = 0;
+
+  // Check whole blocks first, the block with a match is then found below.
+  while (i + kBlockSize <= size && !BlockMayContainDigit(data + i)) {
+    i += kBlockSize;
+  }
+  for (; i < size; ++i) {
+    const unsigned char c = static_cast<unsigned char>(data[i]);
+    if ((c >= '0' && c <= '9') || c >= 0x80) {
+      return true;
+    }
+  }
+  return false;
+}
+
+DigitRunMap::DigitRunMap(StringPiece text) {
+  const char* data = text.data();
+  const int size = text.size();
+  int run_start = -1;
+  auto end_run = [this, &run_start](int end) {
+    if (run_start >= 0) {
+      runs_.push_back({run_start, end - run_start});
+      longest_run_ = std::max(longest_run_, end - run_start);
+      run_start = -1;
+    }
+  };
+
+  int i = 0;
+  while (i < size) {
+    if (i + kBlockSize <= size && !BlockMayContainDigit(data + i)) {
+      end_run(i);
+      i += kBlockSize;
+      continue;
+    }
+    const int block_end = std::min(i + kBlockSize, size);
+    for (; i < block_end; ++i) {
+      const unsigned char c = static_cast<unsigned char>(data[i]);
+      if (c >= '0' && c <= '9') {
+        if (run_start < 0) {
+          run_start = i;
+        }
+      } else {
+        end_run(i);
+        has_non_ascii_ |= c >= 0x80;
+      }
+    }
+  }
+  end_run(size);
+}
+
+int LiteralSetMatcher::Add(const std::string& literal) {
+  const auto it = std::find(literals_.begin(), literals_.end(), literal);
+  if (it != literals_.end()) {
+    return it - literals_.begin();
+  }
+  const int id = literals_.size();
+  literals_.push_back(literal);
+  literals_by_first_byte_[static_cast<unsigned char>(literal[0])].push_back(
+      id);
+  return id;
+}
+
+void LiteralSetMatcher::FindAll(StringPiece text,
+                                std::vector<bool>* found) const {
+  found->assign(literals_.size(), false);
+  int num_remaining = literals_.size();
+  for (int i = 0; i < text.size() && num_remaining > 0; ++i) {
+    const std::vector<int>& candidates =
+        literals_by_first_byte_[static_cast<unsigned char>(text[i])];
+    for (const int id : candidates) {
+      if ((*found)[id]) {
+        continue;
+      }
+      const std::string& literal = literals_[id];
+      if (literal.size() <= text.size() - i &&
+          memcmp(text.data() + i, literal.data(), literal.size()) == 0) {
+        (*found)[id] = true;
+        --num_remaining;
+      }
+    }
+  }
+}
+
+RegexTriggers ExtractRegexTriggers(StringPiece pattern) {
+  return RegexTriggerExtractor(pattern).Extract();
+}
+
+bool ExpandRegexLiterals(StringPiece pattern, int max_strings,
+                         std::vector<std::string>* strings) {
+  return RegexLiteralExpander(pattern, max_strings).Expand(strings);
+}
+
+int RegexTriggerMatcher::Add(const RegexTriggers& triggers) {
+  PatternTriggers pattern_triggers{triggers.known, {}, {}, triggers.digit};
+  for (const std::string& literal : triggers.literals) {
+    pattern_triggers.literal_ids.push_back(literals_.Add(literal));
+  }
+  for (const std::string& literal : triggers.case_insensitive_literals) {
+    pattern_triggers.case_insensitive_literal_ids.push_back(
+        case_insensitive_literals_.Add(literal));
+  }
+  patterns_.push_back(std::move(pattern_triggers));
+  return patterns_.size() - 1;
+}
+
+void RegexTriggerMatcher::FindCandidates(StringPiece text,
+                                         std::vector<bool>* may_match) const {
+  std::vector<bool> found_literals;
+  literals_.FindAll(text, &found_literals);
+
+  bool is_ascii = true;
+  std::string lowercase_text(text.data(), text.size());
+  for (char& c : lowercase_text) {
+    if (static_cast<unsigned char>(c) >= 0x80) {
+      is_ascii = false;
+      break;
+    }
+    if (c >= 'A' && c <= 'Z') {
+      c += 'a' - 'A';
+    }
+  }
+  std::vector<bool> found_case_insensitive_literals;
+  if (is_ascii) {
+    case_insensitive_literals_.FindAll(lowercase_text,
+                                       &found_case_insensitive_literals);
+  }
+  const bool may_contain_digit = MayContainDigit(text);
+
+  may_match->assign(patterns_.size(), false);
+  for (int i = 0; i < patterns_.size(); ++i) {
+    const PatternTriggers& pattern = patterns_[i];
+    bool result = !pattern.known || (pattern.digit && may_contain_digit);
+    for (int j = 0; !result && j < pattern.literal_ids.size(); ++j) {
+      result = found_literals[pattern.literal_ids[j]];
+    }
+    if (!pattern.case_insensitive_literal_ids.empty() && !is_ascii) {
+      result = true;
+    }
+    for (int j = 0;
+         !result && j < pattern.case_insensitive_literal_ids.size(); ++j) {
+      result = found_case_insensitive_literals
+          [pattern.case_insensitive_literal_ids[j]];
+    }
+    (*may_match)[i] = result;
+  }
+}
+
+}  // namespace libtextclassifier3
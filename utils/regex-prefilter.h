@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Cheap checks run before regular expressions, to skip patterns that can't
+// match a text without running the regex engine over it.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_REGEX_PREFILTER_H_
+#define LIBTEXTCLASSIFIER_UTILS_REGEX_PREFILTER_H_
+
+#include <string>
+#include <vector>
+
+#include "utils/strings/stringpiece.h"
+
+namespace libtextclassifier3 {
+
+// What a text needs to contain for a regular expression pattern to possibly
+// match in it.
+// The analysis is conservative: it only looks at the top-level concatenation
+// of the pattern, and gives up on alternations at the top level, inline flags
+// and quoting.
+struct RegexRequirements {
+  // The longest literal that every match contains, empty if none is known.
+  std::string literal;
+
+  // A literal that the text has to start with, for patterns anchored at the
+  // start of the input. Empty if none is known.
+  std::string prefix;
+
+  // Whether every match contains a decimal digit.
+  bool digit = false;
+
+  // Length of a run of consecutive decimal digits that every match contains,
+  // e.g. 4 for "\d{3}-\d{4}". 0 if none is known.
+  int digit_run = 0;
+};
+
+RegexRequirements ExtractRegexRequirements(StringPiece pattern);
+
+// Literals of which every match of a regular expression pattern contains at
+// least one, e.g. the month names of a date pattern. Unlike RegexRequirements,
+// this looks into alternations and supports case-insensitive matching.
+struct RegexTriggers {
+  // Whether the triggers are known. If not, the pattern always has to run.
+  bool known = false;
+
+  // Literals that are matched as they are.
+  std::vector<std::string> literals;
+
+  // ASCII literals in lower case, that are matched case-insensitively.
+  std::vector<std::string> case_insensitive_literals;
+
+  // Whether any decimal digit is a trigger.
+  bool digit = false;
+};
+
+RegexTriggers ExtractRegexTriggers(StringPiece pattern);
+
+// Lists the strings that a pattern made only of literals, groups,
+// alternations and optional parts can match, e.g. "jan|feb(ruary)?". Anchors,
+// word boundaries and inline flags are ignored, so case-insensitive patterns
+// are expanded as written. Returns false for other patterns, or if there are
+// more than 'max_strings' strings.
+bool ExpandRegexLiterals(StringPiece pattern, int max_strings,
+                         std::vector<std::string>* strings);
+
+// Returns whether the text can contain a character matched by \d, i.e. an
+// ASCII digit or any non-ASCII character (Unicode decimal digits).
+bool MayContainDigit(StringPiece text);
+
+// The runs of consecutive ASCII digits of a text, found in one pass that
+// skips the blocks of the text without any digit. Most texts have none or
+// only short runs, so that the patterns needing a longer run of digits, e.g.
+// phone numbers, can be skipped without running them.
+class DigitRunMap {
+ public:
+  // A run of digits, in bytes.
+  struct Run {
+    int start;
+    int length;
+  };
+
+  explicit DigitRunMap(StringPiece text);
+
+  // The runs, in the order of the text.
+  const std::vector<Run>& runs() const { return runs_; }
+
+  bool has_ascii_digit() const { return !runs_.empty(); }
+
+  // Returns whether \d can match `length` times in a row in the text. As for
+  // MayContainDigit(), texts with non-ASCII characters are assumed to have
+  // runs of any length.
+  bool MayContainDigitRun(int length) const {
+    return has_non_ascii_ || longest_run_ >= length;
+  }
+
+ private:
+  std::vector<Run> runs_;
+  int longest_run_ = 0;
+  bool has_non_ascii_ = false;
+};
+
+// A set of literals, all of which can be looked for in a text in one pass.
+class LiteralSetMatcher {
+ public:
+  // Adds a literal to the set and returns its id. Adding a literal that is
+  // already in the set returns the id it was first added with.
+  // The literal must not be empty.
+  int Add(const std::string& literal);
+
+  // Number of distinct literals in the set.
+  int size() const { return literals_.size(); }
+
+  // Scans the text once and sets (*found)[id] to whether the literal with that
+  // id occurs in it.
+  void FindAll(StringPiece text, std::vector<bool>* found) const;
+
+ private:
+  std::vector<std::string> literals_;
+
+  // For every value of the first byte, the ids of the literals starting with
+  // it.
+  std::vector<int> literals_by_first_byte_[256];
+};
+
+// Finds the triggers of many patterns in a text at once.
+class RegexTriggerMatcher {
+ public:
+  // Adds the triggers of a pattern and returns its id, ids are given out
+  // consecutively from 0.
+  int Add(const RegexTriggers& triggers);
+
+  // Scans the text and sets (*may_match)[id] to whether the triggers of the
+  // pattern with that id allow it to match.
+  // Case folding relates some non-ASCII characters to ASCII letters (e.g. the
+  // Kelvin sign to 'k'), so case-insensitive literals are only checked for
+  // pure ASCII texts and are assumed to occur in any other.
+  void FindCandidates(StringPiece text, std::vector<bool>* may_match) const;
+
+ private:
+  struct PatternTriggers {
+    bool known;
+    std::vector<int> literal_ids;
+    std::vector<int> case_insensitive_literal_ids;
+    bool digit;
+  };
+
+  LiteralSetMatcher literals_;
+  LiteralSetMatcher case_insensitive_literals_;
+  std::vector<PatternTriggers> patterns_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_REGEX_PREFILTER_H_
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/regex-prefilter.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+using testing::ElementsAre;
+
+std::string RequiredLiteral(const std::string& pattern) {
+  return ExtractRegexRequirements(pattern).literal;
+}
+
+TEST(RegexPrefilterTest, ExtractsLongestRequiredLiteral) {
+  EXPECT_EQ(RequiredLiteral("hello"), "hello");
+  EXPECT_EQ(RequiredLiteral("ab\\d+hello"), "hello");
+  EXPECT_EQ(RequiredLiteral("[a-z]+@[a-z]+\\.com"), ".com");
+  EXPECT_EQ(RequiredLiteral("\\s*(test|exam)\\s+ab"), "ab");
+  EXPECT_EQ(RequiredLiteral("abc+d"), "abc");
+  EXPECT_EQ(RequiredLiteral("längerer Text"), "längerer Text");
+}
+
+TEST(RegexPrefilterTest, DropsOptionalCharacters) {
+  EXPECT_EQ(RequiredLiteral("abcd?"), "abc");
+  EXPECT_EQ(RequiredLiteral("xabcd*"), "xabc");
+  EXPECT_EQ(RequiredLiteral("ab{0,2}"), "a");
+  EXPECT_EQ(RequiredLiteral("ab\\.?"), "ab");
+  EXPECT_EQ(RequiredLiteral("ä?"), "");
+}
+
+TEST(RegexPrefilterTest, SkipsEscapesAndClasses) {
+  EXPECT_EQ(RequiredLiteral("\\u0041bc"), "bc");
+  EXPECT_EQ(RequiredLiteral("\\x41\\p{L}bc"), "bc");
+  EXPECT_EQ(RequiredLiteral("[]abcdef]xy"), "xy");
+  EXPECT_EQ(RequiredLiteral("[a-z&&[^bcdef]]xy"), "xy");
+  EXPECT_EQ(RequiredLiteral("(?:abcdef)xy"), "xy");
+}
+
+TEST(RegexPrefilterTest, GivesUpWhenNoLiteralIsRequired) {
+  EXPECT_EQ(RequiredLiteral("abc|def"), "");
+  EXPECT_EQ(RequiredLiteral("(?i)hello"), "");
+  EXPECT_EQ(RequiredLiteral("\\Qhello\\E"), "");
+  EXPECT_EQ(RequiredLiteral("\\d+"), "");
+}
+
+TEST(RegexPrefilterTest, ExtractsAnchoredPrefix) {
+  EXPECT_EQ(ExtractRegexRequirements("^abc\\d").prefix, "abc");
+  EXPECT_EQ(ExtractRegexRequirements("^abc?").prefix, "ab");
+  EXPECT_EQ(ExtractRegexRequirements("^(abc)").prefix, "");
+  EXPECT_EQ(ExtractRegexRequirements("abc").prefix, "");
+  EXPECT_EQ(ExtractRegexRequirements("a^bc").prefix, "");
+}
+
+TEST(RegexPrefilterTest, ExtractsRequiredDigit) {
+  EXPECT_TRUE(ExtractRegexRequirements("\\d").digit);
+  EXPECT_TRUE(ExtractRegexRequirements("ab\\d+").digit);
+  EXPECT_TRUE(ExtractRegexRequirements("[0-9]{3}").digit);
+  EXPECT_FALSE(ExtractRegexRequirements("[0-9]{0,3}").digit);
+  EXPECT_TRUE(ExtractRegexRequirements("x[0-9]y").digit);
+  EXPECT_FALSE(ExtractRegexRequirements("\\d?").digit);
+  EXPECT_FALSE(ExtractRegexRequirements("\\d*x").digit);
+  EXPECT_FALSE(ExtractRegexRequirements("(\\d)").digit);
+  EXPECT_FALSE(ExtractRegexRequirements("\\d|x").digit);
+  EXPECT_FALSE(ExtractRegexRequirements("\\D").digit);
+}
+
+TEST(RegexPrefilterTest, ExtractsRequiredDigitRun) {
+  EXPECT_EQ(ExtractRegexRequirements("\\d").digit_run, 1);
+  EXPECT_EQ(ExtractRegexRequirements("\\d{3}-\\d{4}").digit_run, 4);
+  EXPECT_EQ(ExtractRegexRequirements("[0-9]{2,4}\\d+").digit_run, 3);
+  EXPECT_EQ(ExtractRegexRequirements("\\d\\d?\\d").digit_run, 2);
+  EXPECT_EQ(ExtractRegexRequirements("\\dx?\\d").digit_run, 1);
+  EXPECT_EQ(ExtractRegexRequirements("\\d{,3}").digit_run, 0);
+  EXPECT_EQ(ExtractRegexRequirements("(\\d{5})").digit_run, 0);
+  EXPECT_EQ(ExtractRegexRequirements("\\d{5}|x").digit_run, 0);
+}
+
+TEST(RegexPrefilterTest, MayContainDigit) {
+  EXPECT_FALSE(MayContainDigit(""));
+  EXPECT_FALSE(MayContainDigit("no digits in this rather long text here"));
+  EXPECT_TRUE(MayContainDigit("a digit at the end of this long text: 7"));
+  EXPECT_TRUE(MayContainDigit("0"));
+  EXPECT_TRUE(MayContainDigit("eine Zahl: \u0663"));
+  EXPECT_TRUE(MayContainDigit("some text that is longer than a block ä"));
+}
+
+TEST(RegexPrefilterTest, DigitRunMapFindsRuns) {
+  const DigitRunMap no_digits("no digits in this rather long text here");
+  EXPECT_FALSE(no_digits.has_ascii_digit());
+  EXPECT_FALSE(no_digits.MayContainDigitRun(1));
+
+  // The runs cross the blocks of the scan.
+  const DigitRunMap runs("call 0123456789012345678 or 42, ext. 7");
+  ASSERT_EQ(runs.runs().size(), 3);
+  EXPECT_EQ(runs.runs()[0].start, 5);
+  EXPECT_EQ(runs.runs()[0].length, 19);
+  EXPECT_EQ(runs.runs()[1].start, 28);
+  EXPECT_EQ(runs.runs()[1].length, 2);
+  EXPECT_EQ(runs.runs()[2].start, 37);
+  EXPECT_EQ(runs.runs()[2].length, 1);
+  EXPECT_TRUE(runs.MayContainDigitRun(19));
+  EXPECT_FALSE(runs.MayContainDigitRun(20));
+
+  const DigitRunMap non_ascii("eine Zahl: \u0663");
+  EXPECT_FALSE(non_ascii.has_ascii_digit());
+  EXPECT_TRUE(non_ascii.MayContainDigitRun(10));
+}
+
+TEST(RegexPrefilterTest, LiteralSetMatcherFindsAllLiterals) {
+  LiteralSetMatcher matcher;
+  EXPECT_EQ(matcher.Add("@"), 0);
+  EXPECT_EQ(matcher.Add("http"), 1);
+  EXPECT_EQ(matcher.Add("https"), 2);
+  EXPECT_EQ(matcher.Add("@"), 0);
+  EXPECT_EQ(matcher.size(), 3);
+
+  std::vector<bool> found;
+  matcher.FindAll("mail me at me@example.com or http://exampl", &found);
+  EXPECT_THAT(found, ElementsAre(true, true, false));
+
+  matcher.FindAll("https", &found);
+  EXPECT_THAT(found, ElementsAre(false, true, true));
+
+  matcher.FindAll("htt", &found);
+  EXPECT_THAT(found, ElementsAre(false, false, false));
+}
+
+TEST(RegexPrefilterTest, ExtractsTriggersOfAlternations) {
+  const RegexTriggers triggers =
+      ExtractRegexTriggers("(?:on|by)\\s+(?:monday|tue(?:sday)?)");
+  EXPECT_TRUE(triggers.known);
+  EXPECT_THAT(triggers.literals, ElementsAre("monday", "tue"));
+  EXPECT_FALSE(triggers.digit);
+
+  EXPECT_THAT(ExtractRegexTriggers("at \\d\\d?(am|pm)?").literals,
+              ElementsAre("at "));
+  EXPECT_TRUE(ExtractRegexTriggers("\\d+[:.]\\d{2}").digit);
+  EXPECT_THAT(ExtractRegexTriggers("(?<day>today|[0-9])").literals,
+              ElementsAre("today"));
+}
+
+TEST(RegexPrefilterTest, ExtractsCaseInsensitiveTriggers) {
+  RegexTriggers triggers = ExtractRegexTriggers("(?i)(Jan|MÄRZ|\\d{4})");
+  EXPECT_TRUE(triggers.known);
+  EXPECT_THAT(triggers.case_insensitive_literals, ElementsAre("jan", "rz"));
+  EXPECT_TRUE(triggers.digit);
+
+  // Only the group is case-insensitive.
+  triggers = ExtractRegexTriggers("(?i:ab)|CD|(?i)ef|GH");
+  EXPECT_THAT(triggers.literals, ElementsAre("CD"));
+  EXPECT_THAT(triggers.case_insensitive_literals,
+              ElementsAre("ab", "ef", "gh"));
+}
+
+TEST(RegexPrefilterTest, HasNoTriggersForOptionalAlternatives) {
+  EXPECT_FALSE(ExtractRegexTriggers("(monday|tuesday)?").known);
+  EXPECT_FALSE(ExtractRegexTriggers("monday|").known);
+  EXPECT_FALSE(ExtractRegexTriggers("monday|\\w+").known);
+  EXPECT_FALSE(ExtractRegexTriggers("(?=monday)").known);
+  EXPECT_FALSE(ExtractRegexTriggers("(?x)mon day").known);
+  EXPECT_FALSE(ExtractRegexTriggers("(monday").known);
+}
+
+TEST(RegexPrefilterTest, ExpandsFiniteLiteralPatterns) {
+  std::vector<std::string> strings;
+  EXPECT_TRUE(ExpandRegexLiterals("(?i)\\b(jan(uary)?|feb\\.?)\\b",
+                                  /*max_strings=*/10, &strings));
+  EXPECT_THAT(strings, ElementsAre("feb", "feb.", "jan", "january"));
+
+  EXPECT_TRUE(ExpandRegexLiterals("(?<ampm>a|p)(?:\\.m\\.)?", 10, &strings));
+  EXPECT_THAT(strings, ElementsAre("a", "a.m.", "p", "p.m."));
+}
+
+TEST(RegexPrefilterTest, DoesNotExpandOpenEndedPatterns) {
+  std::vector<std::string> strings;
+  EXPECT_FALSE(ExpandRegexLiterals("\\d{1,2}", 10, &strings));
+  EXPECT_FALSE(ExpandRegexLiterals("mon(day)+", 10, &strings));
+  EXPECT_FALSE(ExpandRegexLiterals("[ap]m", 10, &strings));
+  EXPECT_FALSE(ExpandRegexLiterals("next(?= week)", 10, &strings));
+  EXPECT_FALSE(ExpandRegexLiterals("(a|b)(c|d)(e|f)", 7, &strings));
+  EXPECT_FALSE(ExpandRegexLiterals("(monday", 10, &strings));
+}
+
+TEST(RegexPrefilterTest, RegexTriggerMatcherFindsCandidates) {
+  RegexTriggerMatcher matcher;
+  EXPECT_EQ(matcher.Add(ExtractRegexTriggers("tomorrow|today")), 0);
+  EXPECT_EQ(matcher.Add(ExtractRegexTriggers("(?i)noon")), 1);
+  EXPECT_EQ(matcher.Add(ExtractRegexTriggers("\\d+ ?pm")), 2);
+  EXPECT_EQ(matcher.Add(ExtractRegexTriggers(".*")), 3);
+
+  std::vector<bool> may_match;
+  matcher.FindCandidates("see you today at NOON", &may_match);
+  EXPECT_THAT(may_match, ElementsAre(true, true, false, true));
+
+  matcher.FindCandidates("no date in here", &may_match);
+  EXPECT_THAT(may_match, ElementsAre(false, false, false, true));
+
+  // Case-insensitive literals can't be ruled out in non-ASCII texts.
+  matcher.FindCandidates("bis morgen ä", &may_match);
+  EXPECT_THAT(may_match, ElementsAre(false, true, true, true));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
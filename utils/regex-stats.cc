@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/regex-stats.h"
+
+#include "utils/base/logging.h"
+
+namespace libtextclassifier3 {
+
+RegexStats::RegexStats(const std::string& model,
+                       const std::vector<std::string>& collection_names)
+    : model_(model),
+      collection_names_(collection_names),
+      counters_(new PatternCounters[collection_names.size()]) {}
+
+void RegexStats::Enable(int64 slow_run_threshold_us) {
+  slow_run_threshold_us_.store(slow_run_threshold_us,
+                               std::memory_order_relaxed);
+  enabled_.store(true, std::memory_order_relaxed);
+}
+
+void RegexStats::Disable() {
+  enabled_.store(false, std::memory_order_relaxed);
+}
+
+std::vector<RegexPatternStats> RegexStats::GetStats() const {
+  std::vector<RegexPatternStats> stats;
+  for (int i = 0; i < collection_names_.size(); ++i) {
+    const PatternCounters& counters = counters_[i];
+    if (counters.num_matchers.load(std::memory_order_relaxed) == 0) {
+      continue;
+    }
+    stats.emplace_back();
+    RegexPatternStats& pattern_stats = stats.back();
+    pattern_stats.model = model_;
+    pattern_stats.pattern_index = i;
+    pattern_stats.collection_name = collection_names_[i];
+    pattern_stats.num_matchers =
+        counters.num_matchers.load(std::memory_order_relaxed);
+    pattern_stats.num_find_calls =
+        counters.num_find_calls.load(std::memory_order_relaxed);
+    pattern_stats.num_matches =
+        counters.num_matches.load(std::memory_order_relaxed);
+    pattern_stats.total_time_us =
+        counters.total_time_us.load(std::memory_order_relaxed);
+    pattern_stats.max_time_us =
+        counters.max_time_us.load(std::memory_order_relaxed);
+  }
+  return stats;
+}
+
+RegexStats::Run::Run(RegexStats* stats, int pattern_index,
+                     int text_size_bytes)
+    : pattern_index_(pattern_index),
+      text_size_bytes_(text_size_bytes) {
+  if (stats != nullptr && stats->enabled_.load(std::memory_order_relaxed) &&
+      pattern_index >= 0 && pattern_index < stats->collection_names_.size()) {
+    stats_ = stats;
+    start_ = std::chrono::steady_clock::now();
+  }
+}
+
+RegexStats::Run::~Run() {
+  if (stats_ == nullptr) {
+    return;
+  }
+  const int64 time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                            std::chrono::steady_clock::now() - start_)
+                            .count();
+  PatternCounters& counters = stats_->counters_[pattern_index_];
+  counters.num_matchers.fetch_add(1, std::memory_order_relaxed);
+  counters.num_find_calls.fetch_add(num_find_calls_,
+                                    std::memory_order_relaxed);
+  counters.num_matches.fetch_add(num_matches_, std::memory_order_relaxed);
+  counters.total_time_us.fetch_add(time_us, std::memory_order_relaxed);
+  int64 max_time_us = counters.max_time_us.load(std::memory_order_relaxed);
+  while (time_us > max_time_us &&
+         !counters.max_time_us.compare_exchange_weak(
+             max_time_us, time_us, std::memory_order_relaxed)) {
+  }
+
+  const int64 slow_run_threshold_us =
+      stats_->slow_run_threshold_us_.load(std::memory_order_relaxed);
+  if (slow_run_threshold_us > 0 && time_us > slow_run_threshold_us) {
+    TC3_LOG(WARNING) << "Slow regex: pattern " << pattern_index_ << " ("
+                     << stats_->collection_names_[pattern_index_]
+                     << ") of the " << stats_->model_ << " took " << time_us
+                     << " us on a text of " << text_size_bytes_
+                     << " bytes.";
+  }
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Cost accounting of the regular expressions of a model, to find the patterns
+// that are slow on some inputs (e.g. because of catastrophic backtracking).
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_REGEX_STATS_H_
+#define LIBTEXTCLASSIFIER_UTILS_REGEX_STATS_H_
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "utils/base/integral_types.h"
+
+namespace libtextclassifier3 {
+
+// The cost of a pattern since its counting was enabled.
+struct RegexPatternStats {
+  // The model of the pattern, e.g. "regex_model", its index there and the
+  // collection it annotates.
+  std::string model;
+  int pattern_index = -1;
+  std::string collection_name;
+
+  // Number of matchers created for the pattern, i.e. of texts it ran on.
+  int64 num_matchers = 0;
+
+  // Number of Find (or Matches) calls, and of the calls that found a match.
+  int64 num_find_calls = 0;
+  int64 num_matches = 0;
+
+  // Time of all the runs of the pattern over a text, and of the slowest one.
+  int64 total_time_us = 0;
+  int64 max_time_us = 0;
+};
+
+// Per-pattern counters of the regular expressions of a model. The counting is
+// disabled by default, in which case a run only reads a flag. The class is
+// thread-safe.
+class RegexStats {
+ public:
+  // `collection_names` are the collections of the patterns, by index.
+  RegexStats(const std::string& model,
+             const std::vector<std::string>& collection_names);
+
+  // Starts counting. Runs of a pattern over a text that take longer than
+  // `slow_run_threshold_us` are logged with the pattern, unless it's 0.
+  void Enable(int64 slow_run_threshold_us);
+
+  // Stops counting, keeping the counts.
+  void Disable();
+
+  // Returns the counters of the patterns that ran.
+  std::vector<RegexPatternStats> GetStats() const;
+
+  // Measures one run of a pattern over a text, from its construction (before
+  // the matcher is created) to its destruction. Does nothing if `stats` is
+  // null or not enabled.
+  class Run {
+   public:
+    Run(RegexStats* stats, int pattern_index, int text_size_bytes);
+    ~Run();
+
+    // Counts a Find (or Matches) call that returned `found`, and returns it.
+    bool CountFind(bool found) {
+      if (stats_ != nullptr) {
+        ++num_find_calls_;
+        num_matches_ += found;
+      }
+      return found;
+    }
+
+    Run(const Run&) = delete;
+    Run& operator=(const Run&) = delete;
+
+   private:
+    RegexStats* stats_ = nullptr;
+    int pattern_index_;
+    int text_size_bytes_;
+    std::chrono::steady_clock::time_point start_;
+    int64 num_find_calls_ = 0;
+    int64 num_matches_ = 0;
+  };
+
+ private:
+  struct PatternCounters {
+    std::atomic<int64> num_matchers{0};
+    std::atomic<int64> num_find_calls{0};
+    std::atomic<int64> num_matches{0};
+    std::atomic<int64> total_time_us{0};
+    std::atomic<int64> max_time_us{0};
+  };
+
+  const std::string model_;
+  const std::vector<std::string> collection_names_;
+  std::unique_ptr<PatternCounters[]> counters_;
+
+  std::atomic<bool> enabled_{false};
+  std::atomic<int64> slow_run_threshold_us_{0};
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_REGEX_STATS_H_
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/regex-stats.h"
+
+#include <chrono>  // NOLINT
+#include <thread>  // NOLINT
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(RegexStatsTest, DoesNotCountWhenDisabled) {
+  RegexStats stats("regex_model", {"phone", "email"});
+  {
+    RegexStats::Run run(&stats, /*pattern_index=*/0,
+                        /*text_size_bytes=*/10);
+    EXPECT_TRUE(run.CountFind(true));
+  }
+  EXPECT_TRUE(stats.GetStats().empty());
+}
+
+TEST(RegexStatsTest, CountsRunsOfEachPattern) {
+  RegexStats stats("regex_model", {"phone", "email"});
+  stats.Enable(/*slow_run_threshold_us=*/0);
+  for (int i = 0; i < 2; ++i) {
+    RegexStats::Run run(&stats, /*pattern_index=*/1,
+                        /*text_size_bytes=*/10);
+    EXPECT_TRUE(run.CountFind(true));
+    EXPECT_FALSE(run.CountFind(false));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  const std::vector<RegexPatternStats> pattern_stats = stats.GetStats();
+  ASSERT_EQ(pattern_stats.size(), 1);
+  EXPECT_EQ(pattern_stats[0].model, "regex_model");
+  EXPECT_EQ(pattern_stats[0].pattern_index, 1);
+  EXPECT_EQ(pattern_stats[0].collection_name, "email");
+  EXPECT_EQ(pattern_stats[0].num_matchers, 2);
+  EXPECT_EQ(pattern_stats[0].num_find_calls, 4);
+  EXPECT_EQ(pattern_stats[0].num_matches, 2);
+  EXPECT_GE(pattern_stats[0].max_time_us, 1000);
+  EXPECT_GE(pattern_stats[0].total_time_us, 2000);
+  EXPECT_GE(pattern_stats[0].total_time_us, pattern_stats[0].max_time_us);
+}
+
+TEST(RegexStatsTest, KeepsCountsWhenDisabled) {
+  RegexStats stats("datetime_model", {"datetime"});
+  stats.Enable(/*slow_run_threshold_us=*/0);
+  { RegexStats::Run run(&stats, /*pattern_index=*/0, /*text_size_bytes=*/1); }
+  stats.Disable();
+  { RegexStats::Run run(&stats, /*pattern_index=*/0, /*text_size_bytes=*/1); }
+
+  const std::vector<RegexPatternStats> pattern_stats = stats.GetStats();
+  ASSERT_EQ(pattern_stats.size(), 1);
+  EXPECT_EQ(pattern_stats[0].num_matchers, 1);
+}
+
+TEST(RegexStatsTest, IgnoresRunsWithoutStats) {
+  RegexStats::Run run(/*stats=*/nullptr, /*pattern_index=*/0,
+                      /*text_size_bytes=*/1);
+  EXPECT_TRUE(run.CountFind(true));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -30,43 +30,94 @@ bool isExactMatch(const flatbuffers::String* left, const std::string& right) {
   if (left == nullptr) {
     return right.empty();
   }
-  return left->str() == right;
+  return StringPiece(left->c_str(), left->size()).Equals(right);
 }
 
 }  // namespace
 
-int Resources::LocaleMatch(const Locale& locale,
+Resources::Resources(const ResourcePool* resources) : resources_(resources) {
+  if (resources_ == nullptr || resources_->resource_entry() == nullptr) {
+    return;
+  }
+  const int num_locales =
+      resources_->locale() != nullptr ? resources_->locale()->size() : 0;
+  for (const ResourceEntry* entry : *resources_->resource_entry()) {
+    if (entry->name() == nullptr) {
+      continue;
+    }
+    IndexedEntry indexed_entry;
+    indexed_entry.entry = entry;
+    if (entry->resource() != nullptr) {
+      for (int i = 0; i < entry->resource()->size(); i++) {
+        const Resource* resource = entry->resource()->Get(i);
+        if (resource->locale() == nullptr) {
+          continue;
+        }
+        for (const int locale_id : *resource->locale()) {
+          if (locale_id < 0 || locale_id >= num_locales) {
+            TC3_LOG(ERROR) << "Invalid locale of resource "
+                           << entry->name()->str();
+            continue;
+          }
+          const Candidate candidate{i, locale_id,
+                                    static_cast<int>(
+                                        indexed_entry.candidates.size())};
+          indexed_entry.candidates.push_back(candidate);
+          const flatbuffers::String* language =
+              resources_->locale()->Get(locale_id)->language();
+          if (language == nullptr) {
+            indexed_entry.wildcard_language_candidates.push_back(candidate);
+            continue;
+          }
+          const StringPiece language_key(language->c_str(), language->size());
+          std::vector<Candidate> language_candidates;
+          if (const std::vector<Candidate>* existing =
+                  indexed_entry.candidates_by_language.Find(language_key)) {
+            language_candidates = *existing;
+          }
+          language_candidates.push_back(candidate);
+          indexed_entry.candidates_by_language.Insert(
+              language_key, std::move(language_candidates));
+        }
+      }
+    }
+    entries_.Insert(StringPiece(entry->name()->c_str(), entry->name()->size()),
+                    std::move(indexed_entry));
+  }
+}
+
+int Resources::LocaleMatch(const std::string& language,
+                           const std::string& script, const std::string& region,
                            const LanguageTag* entry_locale) const {
   int match = LOCALE_NO_MATCH;
-  if (isExactMatch(entry_locale->language(), locale.Language())) {
+  if (isExactMatch(entry_locale->language(), language)) {
     match |= LOCALE_LANGUAGE_MATCH;
-  } else if (isWildcardMatch(entry_locale->language(), locale.Language())) {
+  } else if (isWildcardMatch(entry_locale->language(), language)) {
     match |= LOCALE_LANGUAGE_WILDCARD_MATCH;
   }
 
-  if (isExactMatch(entry_locale->script(), locale.Script())) {
+  if (isExactMatch(entry_locale->script(), script)) {
     match |= LOCALE_SCRIPT_MATCH;
-  } else if (isWildcardMatch(entry_locale->script(), locale.Script())) {
+  } else if (isWildcardMatch(entry_locale->script(), script)) {
     match |= LOCALE_SCRIPT_WILDCARD_MATCH;
   }
 
-  if (isExactMatch(entry_locale->region(), locale.Region())) {
+  if (isExactMatch(entry_locale->region(), region)) {
     match |= LOCALE_REGION_MATCH;
-  } else if (isWildcardMatch(entry_locale->region(), locale.Region())) {
+  } else if (isWildcardMatch(entry_locale->region(), region)) {
     match |= LOCALE_REGION_WILDCARD_MATCH;
   }
 
   return match;
 }
 
-const ResourceEntry* Resources::FindResource(
+const Resources::IndexedEntry* Resources::FindResource(
     const StringPiece resource_name) const {
   if (resources_ == nullptr || resources_->resource_entry() == nullptr) {
     TC3_LOG(ERROR) << "No resources defined.";
     return nullptr;
   }
-  const ResourceEntry* entry =
-      resources_->resource_entry()->LookupByKey(resource_name.data());
+  const IndexedEntry* entry = entries_.Find(resource_name);
   if (entry == nullptr) {
     TC3_LOG(ERROR) << "Resource " << resource_name.ToString() << " not found";
     return nullptr;
@@ -74,32 +125,63 @@ const ResourceEntry* Resources::FindResource(
   return entry;
 }
 
+void Resources::MatchCandidates(const std::vector<Candidate>& candidates,
+                                const std::string& language,
+                                const std::string& script,
+                                const std::string& region, int* best_match,
+                                const Candidate** best_candidate) const {
+  for (const Candidate& candidate : candidates) {
+    const int candidate_match =
+        LocaleMatch(language, script, region,
+                    resources_->locale()->Get(candidate.locale_id));
+
+    // Only consider if at least the language matches.
+    if ((candidate_match & LOCALE_LANGUAGE_MATCH) == 0 &&
+        (candidate_match & LOCALE_LANGUAGE_WILDCARD_MATCH) == 0) {
+      continue;
+    }
+
+    if (candidate_match > *best_match ||
+        (candidate_match == *best_match &&
+         candidate.order < (*best_candidate)->order)) {
+      *best_match = candidate_match;
+      *best_candidate = &candidate;
+    }
+  }
+}
+
 int Resources::BestResourceForLocales(
-    const ResourceEntry* resource, const std::vector<Locale>& locales) const {
+    const IndexedEntry& resource, const std::vector<Locale>& locales) const {
   // Find best match based on locale.
   int resource_id = -1;
   int locale_match = LOCALE_NO_MATCH;
-  const auto* resources = resource->resource();
   for (int user_locale = 0; user_locale < locales.size(); user_locale++) {
     if (!locales[user_locale].IsValid()) {
       continue;
     }
-    for (int i = 0; i < resources->size(); i++) {
-      for (const int locale_id : *resources->Get(i)->locale()) {
-        const int candidate_match = LocaleMatch(
-            locales[user_locale], resources_->locale()->Get(locale_id));
-
-        // Only consider if at least the language matches.
-        if ((candidate_match & LOCALE_LANGUAGE_MATCH) == 0 &&
-            (candidate_match & LOCALE_LANGUAGE_WILDCARD_MATCH) == 0) {
-          continue;
-        }
+    const std::string language = locales[user_locale].Language();
+    const std::string script = locales[user_locale].Script();
+    const std::string region = locales[user_locale].Region();
 
-        if (candidate_match > locale_match) {
-          locale_match = candidate_match;
-          resource_id = i;
-        }
+    // The first of the best matching candidates of this locale.
+    int best_match = LOCALE_NO_MATCH;
+    const Candidate* best_candidate = nullptr;
+    if (language.empty()) {
+      // Every candidate matches the language as a wildcard.
+      MatchCandidates(resource.candidates, language, script, region,
+                      &best_match, &best_candidate);
+    } else {
+      if (const std::vector<Candidate>* language_candidates =
+              resource.candidates_by_language.Find(language)) {
+        MatchCandidates(*language_candidates, language, script, region,
+                        &best_match, &best_candidate);
       }
+      MatchCandidates(resource.wildcard_language_candidates, language, script,
+                      region, &best_match, &best_candidate);
+    }
+    if (best_match > locale_match) {
+      locale_match = best_match;
+      resource_id = best_candidate->resource_index;
     }
 
     // If the language matches exactly, we are already finished.
@@ -114,23 +196,26 @@ int Resources::BestResourceForLocales(
 bool Resources::GetResourceContent(const std::vector<Locale>& locales,
                                    const StringPiece resource_name,
                                    std::string* result) const {
-  const ResourceEntry* entry = FindResource(resource_name);
-  if (entry == nullptr || entry->resource() == nullptr) {
+  const IndexedEntry* entry = FindResource(resource_name);
+  if (entry == nullptr || entry->entry->resource() == nullptr) {
     return false;
   }
 
-  int resource_id = BestResourceForLocales(entry, locales);
+  int resource_id = BestResourceForLocales(*entry, locales);
   if (resource_id < 0) {
     return false;
   }
-  const auto* resource = entry->resource()->Get(resource_id);
+  const auto* resource = entry->entry->resource()->Get(resource_id);
   if (resource->content() != nullptr) {
     *result = resource->content()->str();
     return true;
   } else if (resource->compressed_content() != nullptr) {
-    std::unique_ptr<ZlibDecompressor> decompressor = ZlibDecompressor::Instance(
-        resources_->compression_dictionary()->data(),
-        resources_->compression_dictionary()->size());
+    const flatbuffers::Vector<uint8_t>* dictionary =
+        resources_->compression_dictionary();
+    std::unique_ptr<ZlibDecompressor> decompressor =
+        dictionary != nullptr
+            ? ZlibDecompressor::Instance(dictionary->data(), dictionary->size())
+            : ZlibDecompressor::Instance();
     if (decompressor != nullptr &&
         decompressor->MaybeDecompress(resource->compressed_content(), result)) {
       return true;
@@ -146,7 +231,7 @@ bool CompressResources(ResourcePoolT* resources,
   if (build_compression_dictionary) {
     {
       // Build up a compression dictionary.
-      std::unique_ptr<ZlibCompressor> compressor = ZlibCompressor::Instance();
+      std::vector<std::string> samples;
       int i = 0;
       for (auto& entry : resources->resource_entry) {
         for (auto& resource : entry->resource) {
@@ -161,11 +246,13 @@ bool CompressResources(ResourcePoolT* resources,
           if (i % dictionary_sample_every != 0) {
             continue;
           }
-          CompressedBufferT compressed_content;
-          compressor->Compress(resource->content, &compressed_content);
+          samples.push_back(resource->content);
         }
       }
-      compressor->GetDictionary(&dictionary);
+      if (!BuildZlibDictionary(samples, &dictionary)) {
+        TC3_LOG(ERROR) << "Cannot build compression dictionary.";
+        return false;
+      }
       resources->compression_dictionary.assign(
           dictionary.data(), dictionary.data() + dictionary.size());
     }
@@ -202,16 +289,44 @@ bool CompressResources(ResourcePoolT* resources,
 }
 
 std::string CompressSerializedResources(const std::string& resources,
+                                        const bool build_compression_dictionary,
                                         const int dictionary_sample_every) {
   std::unique_ptr<ResourcePoolT> unpacked_resources(
       flatbuffers::GetRoot<ResourcePool>(resources.data())->UnPack());
   TC3_CHECK(unpacked_resources != nullptr);
-  TC3_CHECK(
-      CompressResources(unpacked_resources.get(), dictionary_sample_every));
+  TC3_CHECK(CompressResources(unpacked_resources.get(),
+                              build_compression_dictionary,
+                              dictionary_sample_every));
   flatbuffers::FlatBufferBuilder builder;
   builder.Finish(ResourcePool::Pack(builder, unpacked_resources.get()));
   return std::string(reinterpret_cast<const char*>(builder.GetBufferPointer()),
                      builder.GetSize());
 }
 
+bool DecompressResources(ResourcePoolT* resources) {
+  for (auto& entry : resources->resource_entry) {
+    for (auto& resource : entry->resource) {
+      if (resource->compressed_content == nullptr) {
+        continue;
+      }
+      // Every resource is compressed as a stream of its own.
+      std::unique_ptr<ZlibDecompressor> decompressor =
+          ZlibDecompressor::Instance(resources->compression_dictionary.data(),
+                                     resources->compression_dictionary.size());
+      if (!decompressor) {
+        TC3_LOG(ERROR) << "Cannot initialize decompressor.";
+        return false;
+      }
+      if (!decompressor->MaybeDecompress(resource->compressed_content.get(),
+                                         &resource->content)) {
+        TC3_LOG(ERROR) << "Cannot decompress resource: " << entry->name;
+        return false;
+      }
+      resource->compressed_content.reset(nullptr);
+    }
+  }
+  resources->compression_dictionary.clear();
+  return true;
+}
+
 }  // namespace libtextclassifier3
@@ -17,18 +17,22 @@
 #ifndef LIBTEXTCLASSIFIER_UTILS_RESOURCES_H_
 #define LIBTEXTCLASSIFIER_UTILS_RESOURCES_H_
 
+#include <string>
 #include <vector>
 
 #include "utils/i18n/locale.h"
 #include "utils/resources_generated.h"
+#include "utils/strings/string-piece-map.h"
 #include "utils/strings/stringpiece.h"
 
 namespace libtextclassifier3 {
 
 // Class for accessing localized model resources.
+// The resource entries are indexed by name, and their candidates by language,
+// when the class is constructed, so that lookups don't scan the pool.
 class Resources {
  public:
-  explicit Resources(const ResourcePool* resources) : resources_(resources) {}
+  explicit Resources(const ResourcePool* resources);
 
   // Returns the string value associated with the particular resource.
   // `locales` are locales in preference order.
@@ -50,16 +54,50 @@ class Resources {
     LOCALE_LANGUAGE_WILDCARD_MATCH = 1 << 4,
     LOCALE_LANGUAGE_MATCH = 1 << 5
   };
-  int LocaleMatch(const Locale& locale, const LanguageTag* entry_locale) const;
+
+  // A locale of a resource of an entry. `order` is the position in the
+  // entry's resources and their locales, which breaks ties between equally
+  // good matches.
+  struct Candidate {
+    int resource_index;
+    int locale_id;
+    int order;
+  };
+
+  // The candidates of an entry, by the language of their locale.
+  struct IndexedEntry {
+    const ResourceEntry* entry = nullptr;
+
+    // All candidates, in order.
+    std::vector<Candidate> candidates;
+
+    // The candidates with a language, by language.
+    StringPieceMap<std::vector<Candidate>> candidates_by_language;
+
+    // The candidates without a language, that match every language.
+    std::vector<Candidate> wildcard_language_candidates;
+  };
+
+  int LocaleMatch(const std::string& language, const std::string& script,
+                  const std::string& region,
+                  const LanguageTag* entry_locale) const;
 
   // Finds a resource entry by name.
-  const ResourceEntry* FindResource(const StringPiece resource_name) const;
+  const IndexedEntry* FindResource(const StringPiece resource_name) const;
 
   // Finds the best locale matching resource from a resource entry.
-  int BestResourceForLocales(const ResourceEntry* resource,
+  int BestResourceForLocales(const IndexedEntry& resource,
                              const std::vector<Locale>& locales) const;
 
+  // Updates the best candidate (by match, then order) with the candidates
+  // matching at least the language.
+  void MatchCandidates(const std::vector<Candidate>& candidates,
+                       const std::string& language, const std::string& script,
+                       const std::string& region, int* best_match,
+                       const Candidate** best_candidate) const;
+
   const ResourcePool* resources_;
+  StringPieceMap<IndexedEntry> entries_;
 };
 
 // Compresses resources in place.
@@ -71,6 +109,9 @@ std::string CompressSerializedResources(
     const bool build_compression_dictionary = false,
     const int dictionary_sample_every = 1);
 
+// Decompresses resources in place and drops the compression dictionary.
+bool DecompressResources(ResourcePoolT* resources);
+
 }  // namespace libtextclassifier3
 
 #endif  // LIBTEXTCLASSIFIER_UTILS_RESOURCES_H_
@@ -283,5 +283,17 @@ TEST_P(ResourcesTest, PreferGenericWhenGeneric) {
   EXPECT_EQ("concentrar", content);
 }
 
+TEST_P(ResourcesTest, FindsResourceByNamePrefix) {
+  std::string test_resources = BuildTestResources();
+  Resources resources(
+      flatbuffers::GetRoot<ResourcePool>(test_resources.data()));
+  std::string content;
+  EXPECT_TRUE(resources.GetResourceContent({Locale::FromBCP47("en-US")},
+                                           StringPiece("AB", 1), &content));
+  EXPECT_EQ("localize", content);
+  EXPECT_FALSE(resources.GetResourceContent({Locale::FromBCP47("en-US")},
+                                            /*resource_name=*/"AB", &content));
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
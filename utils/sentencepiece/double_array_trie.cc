@@ -19,34 +19,38 @@
 
 namespace libtextclassifier3 {
 
-bool DoubleArrayTrie::GatherPrefixMatches(
-    StringPiece input, const std::function<void(TrieMatch)>& update_fn) const {
+template <typename MatchCallback>
+bool DoubleArrayTrie::GatherPrefixMatches(StringPiece input,
+                                          MatchCallback update_fn) const {
   uint32 pos = 0;
   if (nodes_length_ == 0) {
     TC3_LOG(WARNING) << "Trie is empty. Skipping.";
     return true;
   }
-  pos = offset(0);
+  pos = offset(nodes_[0]);
   for (int i = 0; i < input.size(); i++) {
     if (input[i] == 0) {
       break;
     }
-    pos ^= static_cast<unsigned char>(input[i]);
+    const unsigned char c = static_cast<unsigned char>(input[i]);
+    pos ^= c;
     // We exhausted the trie, no more matches possible.
     if (pos < 0 || pos >= nodes_length_) {
       break;
     }
-    if (label(pos) != input[i]) {
+    // Load the node only once, label, leaf flag and offset are all decoded
+    // from the same word.
+    const TrieNode node = nodes_[pos];
+    if (label(node) != c) {
       break;
     }
-    const bool node_has_leaf = has_leaf(pos);
-    pos ^= offset(pos);
+    pos ^= offset(node);
     if (pos < 0 || pos > nodes_length_) {
       TC3_LOG(ERROR) << "Out-of-bounds trie search position.";
       return false;
     }
-    if (node_has_leaf) {
-      update_fn(TrieMatch(/*id=*/value(pos), /*match_length=*/i + 1));
+    if (has_leaf(node)) {
+      update_fn(TrieMatch(/*id=*/value(nodes_[pos]), /*match_length=*/i + 1));
     }
   }
   return true;
@@ -66,4 +70,28 @@ bool DoubleArrayTrie::LongestPrefixMatch(StringPiece input,
   });
 }
 
+bool DoubleArrayTrie::HasPrefix(StringPiece prefix) const {
+  if (nodes_length_ == 0) {
+    return false;
+  }
+  uint32 pos = offset(nodes_[0]);
+  for (int i = 0; i < prefix.size(); i++) {
+    const unsigned char c = static_cast<unsigned char>(prefix[i]);
+    // Matching stops at a zero byte, so no match can extend over it.
+    if (c == 0) {
+      return false;
+    }
+    pos ^= c;
+    if (pos >= nodes_length_) {
+      return false;
+    }
+    const TrieNode node = nodes_[pos];
+    if (label(node) != c) {
+      return false;
+    }
+    pos ^= offset(node);
+  }
+  return true;
+}
+
 }  // namespace libtextclassifier3
@@ -17,7 +17,6 @@
 #ifndef LIBTEXTCLASSIFIER_UTILS_SENTENCEPIECE_DOUBLE_ARRAY_TRIE_H_
 #define LIBTEXTCLASSIFIER_UTILS_SENTENCEPIECE_DOUBLE_ARRAY_TRIE_H_
 
-#include <functional>
 #include <vector>
 
 #include "utils/base/endian.h"
@@ -52,29 +51,39 @@ class DoubleArrayTrie : public SentencePieceMatcher {
   bool LongestPrefixMatch(StringPiece input,
                           TrieMatch* longest_match) const override;
 
+  // Returns whether any string in the trie starts with `prefix`.
+  bool HasPrefix(StringPiece prefix) const;
+
  private:
+  // The accessors below decode a node as stored in nodes_.
+
   // Returns whether a node as a leaf as a child.
-  bool has_leaf(uint32 i) const { return nodes_[i] & 0x100; }
+  static bool has_leaf(TrieNode node) {
+    return LittleEndian::ToHost32(node) & 0x100;
+  }
 
   // Available when a node is a leaf.
-  int value(uint32 i) const {
-    return static_cast<int>(LittleEndian::ToHost32(nodes_[i]) & 0x7fffffff);
+  static int value(TrieNode node) {
+    return static_cast<int>(LittleEndian::ToHost32(node) & 0x7fffffff);
   }
 
   // Label associated with a node.
   // A leaf node will have the MSB set and thus return an invalid label.
-  uint32 label(uint32 i) const {
-    return LittleEndian::ToHost32(nodes_[i]) & 0x800000ff;
+  static uint32 label(TrieNode node) {
+    return LittleEndian::ToHost32(node) & 0x800000ff;
   }
 
   // Returns offset to children.
-  uint32 offset(uint32 i) const {
-    const uint32 node = LittleEndian::ToHost32(nodes_[i]);
+  static uint32 offset(TrieNode node) {
+    node = LittleEndian::ToHost32(node);
     return (node >> 10) << ((node & 0x200) >> 6);
   }
 
-  bool GatherPrefixMatches(
-      StringPiece input, const std::function<void(TrieMatch)>& update_fn) const;
+  // Calls update_fn with every match, in order of increasing length. A
+  // template rather than a std::function, so that the callbacks of the
+  // matching methods get inlined into the traversal loop.
+  template <typename MatchCallback>
+  bool GatherPrefixMatches(StringPiece input, MatchCallback update_fn) const;
 
   const TrieNode* nodes_;
   const int nodes_length_;
@@ -110,5 +110,23 @@ TEST(DoubleArrayTest, Lookup) {
   }
 }
 
+TEST(DoubleArrayTest, HasPrefix) {
+  // Test trie that contains pieces "hell", "hello", "o", "there".
+  std::ifstream test_config_stream(GetTestConfigPath());
+  std::string config((std::istreambuf_iterator<char>(test_config_stream)),
+                     (std::istreambuf_iterator<char>()));
+  DoubleArrayTrie trie(reinterpret_cast<const TrieNode*>(config.data()),
+                       config.size() / sizeof(TrieNode));
+
+  EXPECT_TRUE(trie.HasPrefix("h"));
+  EXPECT_TRUE(trie.HasPrefix("hel"));
+  EXPECT_TRUE(trie.HasPrefix("hello"));
+  EXPECT_TRUE(trie.HasPrefix("o"));
+  EXPECT_TRUE(trie.HasPrefix(""));
+  EXPECT_FALSE(trie.HasPrefix("hellos"));
+  EXPECT_FALSE(trie.HasPrefix("x"));
+  EXPECT_FALSE(trie.HasPrefix(StringPiece("\0", 1)));
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
@@ -20,6 +20,12 @@ namespace libtextclassifier3 {
 
 bool Encoder::Encode(StringPiece normalized_text,
                      std::vector<int>* encoded_text) const {
+  Scratch scratch;
+  return Encode(normalized_text, &scratch, encoded_text);
+}
+
+bool Encoder::Encode(StringPiece normalized_text, Scratch* scratch,
+                     std::vector<int>* encoded_text) const {
   const int len = normalized_text.size();
   if (len <= 0) {
     *encoded_text = {start_code_, end_code_};
@@ -27,9 +33,10 @@ bool Encoder::Encode(StringPiece normalized_text,
   }
   // We use `previous_pos` to indicate whether a dynamic programming state was
   // reachable.
-  std::vector<SegmentationEntry> segmentation(
-      len + 1, {/*score=*/0, /*previous_pos=*/-1, /*piece_id=*/-1,
-                /*num_pieces=*/0});
+  std::vector<SegmentationEntry>& segmentation = scratch->segmentation_;
+  segmentation.assign(len + 1, {/*score=*/0, /*previous_pos=*/-1,
+                                /*piece_id=*/-1, /*num_pieces=*/0});
+  std::vector<TrieMatch>& matches = scratch->matches_;
   for (int i = 0; i < len; i++) {
     // State couldn't be reached.
     if (i > 0 && segmentation[i].previous_pos < 0) {
@@ -57,7 +64,7 @@ bool Encoder::Encode(StringPiece normalized_text,
         }
       }
     }
-    std::vector<TrieMatch> matches;
+    matches.clear();
     if (!matcher_->FindAllPrefixMatches(normalized_text, &matches)) {
       TC3_LOG(ERROR)
           << "Couldn't successfully gather prefix sentence piece matches.";
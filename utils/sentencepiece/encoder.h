@@ -29,6 +29,9 @@ namespace libtextclassifier3 {
 // scores of the pieces used is maximized.
 class Encoder {
  public:
+  // Buffers used by Encode(), see below.
+  class Scratch;
+
   // matcher: the list of valid sentence pieces represented as a matcher, e.g.
   //     a trie.
   // num_pieces: the number of pieces in the trie.
@@ -58,6 +61,12 @@ class Encoder {
   bool Encode(StringPiece normalized_text,
               std::vector<int>* encoded_text) const;
 
+  // Same as above, but with the dynamic programming lattice and the buffer for
+  // the prefix matches taken from scratch, which the caller can keep around to
+  // encode many texts without allocating these for every text.
+  bool Encode(StringPiece normalized_text, Scratch* scratch,
+              std::vector<int>* encoded_text) const;
+
  private:
   // State in the dynamic programming algorithm.
   struct SegmentationEntry {
@@ -84,6 +93,16 @@ class Encoder {
   const int unknown_score_;
 };
 
+// The buffers only grow, to the size needed for the longest text encoded so
+// far. A scratch object must not be used by several threads at a time.
+class Encoder::Scratch {
+ private:
+  friend class Encoder;
+
+  std::vector<SegmentationEntry> segmentation_;
+  std::vector<TrieMatch> matches_;
+};
+
 }  // namespace libtextclassifier3
 
 #endif  // LIBTEXTCLASSIFIER_UTILS_SENTENCEPIECE_ENCODER_H_
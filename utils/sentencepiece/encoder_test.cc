@@ -118,5 +118,25 @@ TEST(EncoderTest, HandlesOutOfDictionary) {
   }
 }
 
+TEST(EncoderTest, ReusesScratchAcrossTexts) {
+  const char pieces[] = "hell\0hello\0o\0there\0";
+  const uint32 offsets[] = {0, 5, 11, 13};
+  float scores[] = {-0.5, -1.0, -10.0, -1.0};
+  std::unique_ptr<SentencePieceMatcher> matcher(new SortedStringsTable(
+      /*num_pieces=*/4, offsets, StringPiece(pieces, 18)));
+  const Encoder encoder(matcher.get(),
+                        /*num_pieces=*/4, scores);
+  Encoder::Scratch scratch;
+  std::vector<int> encoded_text;
+  EXPECT_TRUE(encoder.Encode("hellothere", &scratch, &encoded_text));
+  EXPECT_THAT(encoded_text, ElementsAre(0, 3, 5, 1));
+  EXPECT_TRUE(encoder.Encode("hellhello", &scratch, &encoded_text));
+  EXPECT_THAT(encoded_text, ElementsAre(0, 2, 3, 1));
+  EXPECT_TRUE(encoder.Encode("", &scratch, &encoded_text));
+  EXPECT_THAT(encoded_text, ElementsAre(0, 1));
+  EXPECT_TRUE(encoder.Encode("hello", &scratch, &encoded_text));
+  EXPECT_THAT(encoded_text, ElementsAre(0, 3, 1));
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
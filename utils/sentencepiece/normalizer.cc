@@ -19,8 +19,73 @@
 #include "utils/base/logging.h"
 #include "utils/strings/utf8.h"
 
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TC3_NORMALIZER_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define TC3_NORMALIZER_SSE2
+#endif
+
 namespace libtextclassifier3 {
 
+void SentencePieceNormalizer::InitIdentityBytes() {
+  for (int c = 0; c < 256; ++c) {
+    const char byte = static_cast<char>(c);
+    is_identity_byte_[c] = c > 0 && c < 0x80 && c != ' ' &&
+                           !charsmap_trie_.HasPrefix(StringPiece(&byte, 1));
+  }
+  printable_ascii_is_identity_ = true;
+  for (int c = 0x21; c < 0x7f; ++c) {
+    printable_ascii_is_identity_ &= is_identity_byte_[c];
+  }
+}
+
+int SentencePieceNormalizer::GetNumLeadingIdentityBytes(
+    StringPiece input) const {
+  const char* data = input.data();
+  const int size = input.size();
+  int i = 0;
+
+  // Skip whole blocks of printable ASCII bytes. The block with the first other
+  // byte is then scanned below.
+  if (printable_ascii_is_identity_) {
+#if defined(TC3_NORMALIZER_NEON)
+    const uint8x16_t space = vdupq_n_u8(0x20);
+    const uint8x16_t del = vdupq_n_u8(0x7f);
+    for (; i + 16 <= size; i += 16) {
+      const uint8x16_t bytes =
+          vld1q_u8(reinterpret_cast<const uint8_t*>(data + i));
+      const uint8x16_t printable =
+          vandq_u8(vcgtq_u8(bytes, space), vcltq_u8(bytes, del));
+      const uint8x8_t merged =
+          vand_u8(vget_low_u8(printable), vget_high_u8(printable));
+      if (vget_lane_u64(vreinterpret_u64_u8(merged), 0) != ~0ULL) {
+        break;
+      }
+    }
+#elif defined(TC3_NORMALIZER_SSE2)
+    // The comparisons are signed, so they also reject the non-ASCII bytes.
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7f);
+    for (; i + 16 <= size; i += 16) {
+      const __m128i bytes =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+      const __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(bytes, space),
+                                              _mm_cmplt_epi8(bytes, del));
+      if (_mm_movemask_epi8(printable) != 0xffff) {
+        break;
+      }
+    }
+#endif
+  }
+
+  while (i < size && is_identity_byte_[static_cast<unsigned char>(data[i])]) {
+    ++i;
+  }
+  return i;
+}
+
 bool SentencePieceNormalizer::Normalize(StringPiece input,
                                         std::string* normalized_input) const {
   // Ignores heading space.
@@ -70,6 +135,16 @@ bool SentencePieceNormalizer::Normalize(StringPiece input,
 
   bool is_prev_space = remove_extra_whitespaces_;
   while (!input.empty()) {
+    // Bytes that normalize to themselves are copied in bulk. They are never
+    // spaces, so the whitespace handling below doesn't apply to them.
+    const int num_identity_bytes = GetNumLeadingIdentityBytes(input);
+    if (num_identity_bytes > 0) {
+      normalized_input->append(input.data(), num_identity_bytes);
+      input.RemovePrefix(num_identity_bytes);
+      is_prev_space = false;
+      continue;
+    }
+
     std::pair<StringPiece, int> p;
     if (!NormalizePrefix(input, &p)) {
       TC3_LOG(ERROR) << "Couldn't normalize string.";
@@ -50,13 +50,21 @@ class SentencePieceNormalizer {
         charsmap_normalized_(charsmap_normalized),
         add_dummy_prefix_(add_dummy_prefix),
         remove_extra_whitespaces_(remove_extra_whitespaces),
-        escape_whitespaces_(escape_whitespaces) {}
+        escape_whitespaces_(escape_whitespaces) {
+    InitIdentityBytes();
+  }
 
   // Normalizes a plain utf8 string into an internal representation for
   // Sentencepiece model.
   bool Normalize(StringPiece input, std::string* normalized_input) const;
 
  private:
+  // Determines the bytes that normalize to themselves on their own.
+  void InitIdentityBytes();
+
+  // Returns the length of the run of identity bytes that `input` starts with.
+  int GetNumLeadingIdentityBytes(StringPiece input) const;
+
   // Normalizes the prefix of `input` and returns the pair of
   // normalized prefix and the length of the prefix of `input` processed in the
   // normalization.
@@ -73,6 +81,15 @@ class SentencePieceNormalizer {
   const bool add_dummy_prefix_;
   const bool remove_extra_whitespaces_;
   const bool escape_whitespaces_;
+
+  // Whether a byte is an ASCII character that no normalization rule starts
+  // with and that is not a space. Such bytes are copied to the output as is,
+  // without looking them up in the trie.
+  bool is_identity_byte_[256];
+
+  // Whether all the printable ASCII characters other than space are identity
+  // bytes, this enables scanning them in blocks.
+  bool printable_ascii_is_identity_;
 };
 
 }  // namespace libtextclassifier3
@@ -80,6 +80,18 @@ TEST(NormalizerTest, NormalizesAsReferenceNormalizer) {
     EXPECT_TRUE(normalizer.Normalize("①②③", &normalized));
     EXPECT_EQ(normalized, "▁123");
   }
+
+  // Long runs of ASCII mixed with characters that need normalization.
+  {
+    std::string normalized;
+    EXPECT_TRUE(normalizer.Normalize(
+        "Supercalifragilisticexpialidocious,①②③ "
+        "\tflabbergasted!!  ㍿antidisestablishmentarianism ",
+        &normalized));
+    EXPECT_EQ(normalized,
+              "▁Supercalifragilisticexpialidocious,123▁flabbergasted!!▁"
+              "株式会社antidisestablishmentarianism");
+  }
 }
 
 TEST(NormalizerTest, NoDummyPrefix) {
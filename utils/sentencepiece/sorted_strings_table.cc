@@ -21,8 +21,9 @@
 
 namespace libtextclassifier3 {
 
-void SortedStringsTable::GatherPrefixMatches(
-    StringPiece input, const std::function<void(TrieMatch)>& update_fn) const {
+template <typename MatchCallback>
+void SortedStringsTable::GatherPrefixMatches(StringPiece input,
+                                             MatchCallback update_fn) const {
   int left = 0;
   int right = num_pieces_;
   int span_size = right - left;
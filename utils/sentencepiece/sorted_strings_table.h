@@ -17,7 +17,6 @@
 #ifndef LIBTEXTCLASSIFIER_UTILS_SENTENCEPIECE_SORTED_STRINGS_TABLE_H_
 #define LIBTEXTCLASSIFIER_UTILS_SENTENCEPIECE_SORTED_STRINGS_TABLE_H_
 
-#include <functional>
 #include <vector>
 
 #include "utils/base/integral_types.h"
@@ -53,8 +52,10 @@ class SortedStringsTable : public SentencePieceMatcher {
                           TrieMatch* longest_match) const override;
 
  private:
-  void GatherPrefixMatches(
-      StringPiece input, const std::function<void(TrieMatch)>& update_fn) const;
+  // Calls update_fn with every match. A template rather than a std::function,
+  // so that the callbacks of the matching methods get inlined.
+  template <typename MatchCallback>
+  void GatherPrefixMatches(StringPiece input, MatchCallback update_fn) const;
 
   const int num_pieces_;
   const uint32* offsets_;
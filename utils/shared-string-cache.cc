@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/shared-string-cache.h"
+
+#include "utils/base/integral_types.h"
+#include "utils/hash/farmhash.h"
+
+namespace libtextclassifier3 {
+
+SharedStringCache* SharedStringCache::Instance() {
+  static SharedStringCache* const instance = new SharedStringCache();
+  return instance;
+}
+
+std::string SharedStringCache::Key(StringPiece kind, StringPiece content) {
+  const uint64 fingerprint =
+      tc3farmhash::Fingerprint64(content.data(), content.size());
+  const uint64 size = content.size();
+  std::string key = kind.ToString();
+  key.push_back('\0');
+  key.append(reinterpret_cast<const char*>(&fingerprint), sizeof(fingerprint));
+  key.append(reinterpret_cast<const char*>(&size), sizeof(size));
+  return key;
+}
+
+int SharedStringCache::NumLiveEntries() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int num_live_entries = 0;
+  for (const auto& entry : entries_) {
+    if (!entry.second.expired()) {
+      ++num_live_entries;
+    }
+  }
+  return num_live_entries;
+}
+
+std::shared_ptr<const std::string> SharedStringCache::Lookup(
+    const std::string& key) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return nullptr;
+  }
+  return it->second.lock();
+}
+
+std::shared_ptr<const std::string> SharedStringCache::Insert(
+    const std::string& key, std::shared_ptr<const std::string> value) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::weak_ptr<const std::string>& entry = entries_[key];
+  if (std::shared_ptr<const std::string> existing = entry.lock()) {
+    return existing;
+  }
+  entry = value;
+
+  // Drop the entries of strings that are no longer used.
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    if (it->second.expired()) {
+      it = entries_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  return value;
+}
+
+}  // namespace libtextclassifier3
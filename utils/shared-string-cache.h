@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Process-wide cache of strings derived from model sections.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_SHARED_STRING_CACHE_H_
+#define LIBTEXTCLASSIFIER_UTILS_SHARED_STRING_CACHE_H_
+
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+
+#include "utils/strings/stringpiece.h"
+
+namespace libtextclassifier3 {
+
+// Shares strings that are expensive to build from a model, such as
+// decompressed sections or compiled Lua snippets, between all instances in the
+// process that load the same model. The cache only holds weak references: a
+// string is freed as soon as its last user drops it, and a later instance
+// builds it again.
+//
+// The class is thread-safe.
+class SharedStringCache {
+ public:
+  // The process-wide cache.
+  static SharedStringCache* Instance();
+
+  // Returns the key for the string of the given kind derived from content.
+  // Contents are identified by their fingerprint and size.
+  static std::string Key(StringPiece kind, StringPiece content);
+
+  // Returns the string cached for the key if it's still in use, otherwise
+  // builds it with create(std::string*) and caches it. Returns nullptr if
+  // create() fails.
+  template <typename CreateFn>
+  std::shared_ptr<const std::string> GetOrCreate(const std::string& key,
+                                                 CreateFn create) {
+    std::shared_ptr<const std::string> value = Lookup(key);
+    if (value != nullptr) {
+      return value;
+    }
+    // Build the string outside of the lock, this is the expensive part.
+    std::string created;
+    if (!create(&created)) {
+      return nullptr;
+    }
+    return Insert(key, std::make_shared<const std::string>(std::move(created)));
+  }
+
+  // Number of cached strings that are still in use.
+  int NumLiveEntries() const;
+
+ private:
+  std::shared_ptr<const std::string> Lookup(const std::string& key) const;
+
+  // Caches the value, unless another thread inserted a live value for the key
+  // in the meantime. Returns the cached value.
+  std::shared_ptr<const std::string> Insert(
+      const std::string& key, std::shared_ptr<const std::string> value);
+
+  mutable std::mutex mutex_;
+  std::unordered_map<std::string, std::weak_ptr<const std::string>> entries_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_SHARED_STRING_CACHE_H_
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/shared-string-cache.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(SharedStringCacheTest, SharesLiveStrings) {
+  SharedStringCache cache;
+  int num_created = 0;
+  auto create = [&num_created](std::string* value) {
+    ++num_created;
+    *value = "decompressed";
+    return true;
+  };
+  const std::string key = SharedStringCache::Key("zlib", "compressed");
+
+  std::shared_ptr<const std::string> first = cache.GetOrCreate(key, create);
+  std::shared_ptr<const std::string> second = cache.GetOrCreate(key, create);
+  ASSERT_NE(first, nullptr);
+  EXPECT_EQ(*first, "decompressed");
+  EXPECT_EQ(first.get(), second.get());
+  EXPECT_EQ(num_created, 1);
+  EXPECT_EQ(cache.NumLiveEntries(), 1);
+}
+
+TEST(SharedStringCacheTest, RebuildsReleasedStrings) {
+  SharedStringCache cache;
+  int num_created = 0;
+  auto create = [&num_created](std::string* value) {
+    ++num_created;
+    *value = "bytecode";
+    return true;
+  };
+  const std::string key = SharedStringCache::Key("lua", "script");
+
+  cache.GetOrCreate(key, create);
+  EXPECT_EQ(cache.NumLiveEntries(), 0);
+  EXPECT_NE(cache.GetOrCreate(key, create), nullptr);
+  EXPECT_EQ(num_created, 2);
+}
+
+TEST(SharedStringCacheTest, DoesNotCacheFailures) {
+  SharedStringCache cache;
+  const std::string key = SharedStringCache::Key("zlib", "corrupted");
+  EXPECT_EQ(cache.GetOrCreate(key, [](std::string*) { return false; }),
+            nullptr);
+  EXPECT_EQ(cache.NumLiveEntries(), 0);
+}
+
+TEST(SharedStringCacheTest, KeysDependOnKindAndContent) {
+  EXPECT_EQ(SharedStringCache::Key("zlib", "a"),
+            SharedStringCache::Key("zlib", "a"));
+  EXPECT_NE(SharedStringCache::Key("zlib", "a"),
+            SharedStringCache::Key("lua", "a"));
+  EXPECT_NE(SharedStringCache::Key("zlib", "a"),
+            SharedStringCache::Key("zlib", "b"));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
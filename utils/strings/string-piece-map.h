@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Flat hash tables keyed by string views.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_STRINGS_STRING_PIECE_MAP_H_
+#define LIBTEXTCLASSIFIER_UTILS_STRINGS_STRING_PIECE_MAP_H_
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "utils/base/integral_types.h"
+#include "utils/hash/farmhash.h"
+#include "utils/strings/stringpiece.h"
+
+namespace libtextclassifier3 {
+
+// A map from strings to values in a single open-addressing array. The keys are
+// not copied, their data must outlive the map (e.g. be strings of a model).
+//
+// The lookups can be given the hash of the key, so that a key looked up in
+// several maps is only hashed once, see Hash.
+template <typename V>
+class StringPieceMap {
+ public:
+  static uint64 Hash(StringPiece key) {
+    return tc3farmhash::Fingerprint64(key.data(), key.size());
+  }
+
+  // Adds the key with the value, or replaces the value of an existing key.
+  void Insert(StringPiece key, V value) {
+    const uint64 hash = Hash(key);
+    const int index = FindIndex(key, hash);
+    if (index >= 0) {
+      slots_[index].value = std::move(value);
+      return;
+    }
+    if (2 * (num_entries_ + 1) > slots_.size()) {
+      Grow();
+    }
+    InsertNew(key, hash, std::move(value));
+  }
+
+  // Returns the value of the key, or nullptr if the key is not in the map.
+  const V* Find(StringPiece key) const { return Find(key, Hash(key)); }
+
+  // Same as above, but with the Hash of the key precomputed.
+  const V* Find(StringPiece key, uint64 hash) const {
+    const int index = FindIndex(key, hash);
+    return index >= 0 ? &slots_[index].value : nullptr;
+  }
+
+  int size() const { return num_entries_; }
+  bool empty() const { return num_entries_ == 0; }
+
+ private:
+  struct Slot {
+    StringPiece key;
+    uint64 hash = 0;
+    V value = V();
+    bool occupied = false;
+  };
+
+  // Returns the index of the slot of the key, or -1. The table is never more
+  // than half full, so the probing always ends at an empty slot.
+  int FindIndex(StringPiece key, uint64 hash) const {
+    if (slots_.empty()) {
+      return -1;
+    }
+    const int mask = slots_.size() - 1;
+    for (int i = hash & mask; slots_[i].occupied; i = (i + 1) & mask) {
+      if (slots_[i].hash == hash && slots_[i].key.Equals(key)) {
+        return i;
+      }
+    }
+    return -1;
+  }
+
+  void InsertNew(StringPiece key, uint64 hash, V value) {
+    const int mask = slots_.size() - 1;
+    int i = hash & mask;
+    while (slots_[i].occupied) {
+      i = (i + 1) & mask;
+    }
+    slots_[i].key = key;
+    slots_[i].hash = hash;
+    slots_[i].value = std::move(value);
+    slots_[i].occupied = true;
+    ++num_entries_;
+  }
+
+  void Grow() {
+    std::vector<Slot> old_slots(std::max<int>(8, 2 * slots_.size()));
+    old_slots.swap(slots_);
+    num_entries_ = 0;
+    for (Slot& slot : old_slots) {
+      if (slot.occupied) {
+        InsertNew(slot.key, slot.hash, std::move(slot.value));
+      }
+    }
+  }
+
+  // The number of slots is a power of two.
+  std::vector<Slot> slots_;
+  int num_entries_ = 0;
+};
+
+// A set of strings, see StringPieceMap.
+class StringPieceSet {
+ public:
+  void Insert(StringPiece key) { map_.Insert(key, true); }
+
+  bool Contains(StringPiece key) const { return map_.Find(key) != nullptr; }
+
+  // Same as above, but with the StringPieceMap::Hash of the key precomputed.
+  bool Contains(StringPiece key, uint64 hash) const {
+    return map_.Find(key, hash) != nullptr;
+  }
+
+  int size() const { return map_.size(); }
+  bool empty() const { return map_.empty(); }
+
+ private:
+  StringPieceMap<bool> map_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_STRINGS_STRING_PIECE_MAP_H_
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/strings/string-piece-map.h"
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(StringPieceMapTest, FindsInsertedKeys) {
+  std::vector<std::string> keys;
+  for (int i = 0; i < 100; ++i) {
+    keys.push_back("key" + std::to_string(i));
+  }
+  StringPieceMap<int> map;
+  for (int i = 0; i < keys.size(); ++i) {
+    map.Insert(keys[i], i);
+  }
+
+  EXPECT_EQ(map.size(), 100);
+  for (int i = 0; i < keys.size(); ++i) {
+    const std::string key = "key" + std::to_string(i);
+    ASSERT_NE(map.Find(key), nullptr);
+    EXPECT_EQ(*map.Find(key), i);
+    EXPECT_EQ(*map.Find(key, StringPieceMap<int>::Hash(key)), i);
+  }
+  EXPECT_EQ(map.Find("key100"), nullptr);
+  EXPECT_EQ(map.Find(""), nullptr);
+}
+
+TEST(StringPieceMapTest, ReplacesValues) {
+  StringPieceMap<int> map;
+  map.Insert("hour", 1);
+  map.Insert("hour", 2);
+
+  EXPECT_EQ(map.size(), 1);
+  EXPECT_EQ(*map.Find("hour"), 2);
+}
+
+TEST(StringPieceMapTest, EmptyMapFindsNothing) {
+  StringPieceMap<int> map;
+  EXPECT_TRUE(map.empty());
+  EXPECT_EQ(map.Find("hour"), nullptr);
+}
+
+TEST(StringPieceSetTest, ContainsInsertedKeys) {
+  StringPieceSet set;
+  set.Insert("and");
+  set.Insert("a");
+
+  EXPECT_TRUE(set.Contains("and"));
+  EXPECT_TRUE(set.Contains(StringPiece("a and", 1)));
+  EXPECT_TRUE(set.Contains("a", StringPieceMap<bool>::Hash("a")));
+  EXPECT_FALSE(set.Contains("an"));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
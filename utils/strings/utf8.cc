@@ -16,6 +16,14 @@
 
 #include "utils/strings/utf8.h"
 
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define TC3_UTF8_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define TC3_UTF8_SSE2
+#endif
+
 namespace libtextclassifier3 {
 bool IsValidUTF8(const char *src, int size) {
   for (int i = 0; i < size;) {
@@ -49,4 +57,37 @@ int ValidUTF8CharLength(const char *src, int size) {
   return num_codepoint_bytes;
 }
 
+int GetNumLeadingAsciiBytes(const char *src, int size) {
+  int i = 0;
+
+  // Skip whole blocks of ASCII bytes. The block with the first non-ASCII byte
+  // is then scanned below.
+#if defined(TC3_UTF8_NEON)
+  for (; i + 16 <= size; i += 16) {
+    const uint8x16_t bytes =
+        vld1q_u8(reinterpret_cast<const uint8_t *>(src + i));
+    const uint8x8_t merged = vorr_u8(vget_low_u8(bytes), vget_high_u8(bytes));
+    if (vget_lane_u64(vreinterpret_u64_u8(merged), 0) &
+        0x8080808080808080ULL) {
+      break;
+    }
+  }
+#elif defined(TC3_UTF8_SSE2)
+  for (; i + 16 <= size; i += 16) {
+    const __m128i bytes =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    if (_mm_movemask_epi8(bytes) != 0) {
+      break;
+    }
+  }
+#endif
+
+  for (; i < size; ++i) {
+    if (static_cast<unsigned char>(src[i]) >= 0x80) {
+      return i;
+    }
+  }
+  return size;
+}
+
 }  // namespace libtextclassifier3
@@ -17,6 +17,8 @@
 #ifndef LIBTEXTCLASSIFIER_UTILS_STRINGS_UTF8_H_
 #define LIBTEXTCLASSIFIER_UTILS_STRINGS_UTF8_H_
 
+#include "utils/base/integral_types.h"
+
 namespace libtextclassifier3 {
 
 // Returns the length (number of bytes) of the Unicode code point starting at
@@ -44,6 +46,29 @@ static inline bool IsTrailByte(char x) {
   return static_cast<signed char>(x) < -0x40;
 }
 
+// Decodes the Unicode code point starting at src. Preconditions: src points to
+// a well-formed UTF-8 std::string.
+static inline char32 ValidCharToRune(const char *src) {
+  const unsigned char byte1 = static_cast<unsigned char>(src[0]);
+  if (byte1 < 0x80) return byte1;
+
+  const unsigned char byte2 = static_cast<unsigned char>(src[1]);
+  if (byte1 < 0xE0) return ((byte1 & 0x1F) << 6) | (byte2 & 0x3F);
+
+  const unsigned char byte3 = static_cast<unsigned char>(src[2]);
+  if (byte1 < 0xF0) {
+    return ((byte1 & 0x0F) << 12) | ((byte2 & 0x3F) << 6) | (byte3 & 0x3F);
+  }
+
+  const unsigned char byte4 = static_cast<unsigned char>(src[3]);
+  return ((byte1 & 0x07) << 18) | ((byte2 & 0x3F) << 12) |
+         ((byte3 & 0x3F) << 6) | (byte4 & 0x3F);
+}
+
+// Returns the number of ASCII bytes the first size bytes of src start with.
+// Checks 16 bytes at a time where SIMD instructions are available.
+int GetNumLeadingAsciiBytes(const char *src, int size);
+
 // Returns true iff src points to a well-formed UTF-8 string.
 bool IsValidUTF8(const char *src, int size);
 
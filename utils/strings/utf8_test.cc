@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <string>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -55,5 +57,27 @@ TEST(Utf8Test, ValidUTF8CharLength) {
   EXPECT_EQ(ValidUTF8CharLength("\xf0\x9f\x98\x61\x61", 5), -1);
 }
 
+TEST(Utf8Test, ValidCharToRune) {
+  EXPECT_EQ(ValidCharToRune("h"), 'h');
+  EXPECT_EQ(ValidCharToRune("\u00B0"), 0xB0);
+  EXPECT_EQ(ValidCharToRune("\u304A"), 0x304A);
+  EXPECT_EQ(ValidCharToRune("😋"), 0x1F60B);
+}
+
+TEST(Utf8Test, GetNumLeadingAsciiBytes) {
+  EXPECT_EQ(GetNumLeadingAsciiBytes("", 0), 0);
+  EXPECT_EQ(GetNumLeadingAsciiBytes("hello", 5), 5);
+  EXPECT_EQ(GetNumLeadingAsciiBytes("😋hello", 9), 0);
+  EXPECT_EQ(GetNumLeadingAsciiBytes("hello😋", 9), 5);
+
+  // Non-ASCII bytes at every position of blocks longer than 16 bytes.
+  const std::string ascii(40, 'a');
+  for (int i = 0; i <= ascii.size(); ++i) {
+    const std::string text = ascii.substr(0, i) + "\u00B0" + ascii.substr(i);
+    EXPECT_EQ(GetNumLeadingAsciiBytes(text.data(), text.size()), i);
+    EXPECT_EQ(GetNumLeadingAsciiBytes(text.data(), i), i);
+  }
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
@@ -19,10 +19,10 @@
 namespace libtextclassifier3 {
 
 namespace internal {
-int NumberOfElements(const std::vector<int>& shape) {
+int NumberOfElements(const int* shape, int dims) {
   int size = 1;
-  for (const int dim : shape) {
-    size *= dim;
+  for (int i = 0; i < dims; ++i) {
+    size *= shape[i];
   }
   return size;
 }
@@ -18,36 +18,52 @@
 #define LIBTEXTCLASSIFIER_UTILS_TENSOR_VIEW_H_
 
 #include <algorithm>
+#include <initializer_list>
 #include <vector>
 
 namespace libtextclassifier3 {
 namespace internal {
 // Computes the number of elements in a tensor of given shape.
-int NumberOfElements(const std::vector<int>& shape);
+int NumberOfElements(const int* shape, int dims);
 }  // namespace internal
 
 // View of a tensor of given type.
 // NOTE: Does not own the underlying memory, so the contract about its validity
 // needs to be specified on the interface that returns it.
+//
+// The shape is stored inline, so that creating a view doesn't allocate. A view
+// of a tensor with more than kMaxDims dimensions is invalid.
 template <typename T>
 class TensorView {
  public:
+  static constexpr int kMaxDims = 4;
+
+  TensorView(const T* data, const int* shape, int dims)
+      : data_(dims <= kMaxDims ? data : nullptr),
+        dims_(std::min(dims, kMaxDims)),
+        size_(internal::NumberOfElements(shape, dims_)) {
+    std::copy(shape, shape + dims_, shape_);
+  }
+
+  TensorView(const T* data, std::initializer_list<int> shape)
+      : TensorView(data, shape.begin(), shape.size()) {}
+
   TensorView(const T* data, const std::vector<int>& shape)
-      : data_(data), shape_(shape), size_(internal::NumberOfElements(shape)) {}
+      : TensorView(data, shape.data(), shape.size()) {}
 
   static TensorView Invalid() {
-    static std::vector<int>& invalid_shape =
-        *[]() { return new std::vector<int>(0); }();
-    return TensorView(nullptr, invalid_shape);
+    return TensorView(nullptr, /*shape=*/nullptr, /*dims=*/0);
   }
 
   bool is_valid() const { return data_ != nullptr; }
 
-  const std::vector<int>& shape() const { return shape_; }
+  std::vector<int> shape() const {
+    return std::vector<int>(shape_, shape_ + dims_);
+  }
 
   int dim(int i) const { return shape_[i]; }
 
-  int dims() const { return shape_.size(); }
+  int dims() const { return dims_; }
 
   const T* data() const { return data_; }
 
@@ -68,7 +84,8 @@ class TensorView {
 
  private:
   const T* data_ = nullptr;
-  const std::vector<int> shape_;
+  int shape_[kMaxDims];
+  const int dims_;
   const int size_;
 };
 
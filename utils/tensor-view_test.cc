@@ -48,5 +48,21 @@ TEST(TensorViewTest, TestSize) {
   EXPECT_FALSE(invalid_tensor.is_valid());
 }
 
+TEST(TensorViewTest, TakesShapeFromDimsArray) {
+  std::vector<int> data(24);
+  const int dims[] = {2, 3, 4};
+  const TensorView<int> tensor(data.data(), dims, /*dims=*/3);
+  EXPECT_TRUE(tensor.is_valid());
+  EXPECT_EQ(tensor.shape(), (std::vector<int>{2, 3, 4}));
+  EXPECT_EQ(tensor.size(), 24);
+}
+
+TEST(TensorViewTest, InvalidWithTooManyDims) {
+  std::vector<int> data(32);
+  const TensorView<int> tensor(data.data(), {2, 2, 2, 2, 2});
+  EXPECT_FALSE(tensor.is_valid());
+  EXPECT_EQ(tensor.size(), 0);
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
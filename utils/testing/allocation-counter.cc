@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/testing/allocation-counter.h"
+
+#include <stdlib.h>
+
+#include <atomic>
+
+namespace {
+
+std::atomic<int64_t> num_heap_allocations(0);
+thread_local int64_t num_thread_allocations = 0;
+thread_local int64_t num_thread_allocated_bytes = 0;
+
+void* CountedAllocate(size_t size) {
+  num_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+  ++num_thread_allocations;
+  num_thread_allocated_bytes += size;
+  void* ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    // The library is built without exceptions.
+    abort();
+  }
+  return ptr;
+}
+
+}  // namespace
+
+void* operator new(size_t size) { return CountedAllocate(size); }
+void* operator new[](size_t size) { return CountedAllocate(size); }
+void operator delete(void* ptr) noexcept { free(ptr); }
+void operator delete[](void* ptr) noexcept { free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { free(ptr); }
+
+namespace libtextclassifier3 {
+
+int64 NumHeapAllocations() {
+  return num_heap_allocations.load(std::memory_order_relaxed);
+}
+
+ScopedAllocationCounter::ScopedAllocationCounter()
+    : start_allocations_(num_thread_allocations),
+      start_bytes_(num_thread_allocated_bytes) {}
+
+int64 ScopedAllocationCounter::num_allocations() const {
+  return num_thread_allocations - start_allocations_;
+}
+
+int64 ScopedAllocationCounter::num_bytes() const {
+  return num_thread_allocated_bytes - start_bytes_;
+}
+
+}  // namespace libtextclassifier3
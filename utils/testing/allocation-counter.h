@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Counting of the heap allocations of the tests and benchmarks, to keep the
+// steady state of the library allocation-free where it is meant to be.
+//
+// allocation-counter.cc replaces the global operator new of the binary it is
+// linked into by one that counts, so it is only linked into the test and
+// benchmark binaries, never into the library. Allocations made with malloc
+// directly (e.g. by ICU or the lua allocator) are not counted.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_TESTING_ALLOCATION_COUNTER_H_
+#define LIBTEXTCLASSIFIER_UTILS_TESTING_ALLOCATION_COUNTER_H_
+
+#include "utils/base/integral_types.h"
+
+namespace libtextclassifier3 {
+
+// Returns the number of heap allocations of the process so far.
+int64 NumHeapAllocations();
+
+// Counts the heap allocations made by the current thread from its
+// construction on. Allocations of other threads, e.g. of a thread pool, are not
+// counted.
+class ScopedAllocationCounter {
+ public:
+  ScopedAllocationCounter();
+
+  // Number of allocations so far, and their total size.
+  int64 num_allocations() const;
+  int64 num_bytes() const;
+
+ private:
+  const int64 start_allocations_;
+  const int64 start_bytes_;
+};
+
+// Returns how many heap allocations `fn` makes on the current thread.
+template <typename Fn>
+int64 CountAllocations(Fn fn) {
+  ScopedAllocationCounter counter;
+  fn();
+  return counter.num_allocations();
+}
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_TESTING_ALLOCATION_COUNTER_H_
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/testing/allocation-counter.h"
+
+#include <memory>
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(AllocationCounterTest, CountsAllocationsOfTheScope) {
+  std::vector<int> before(10);
+  ScopedAllocationCounter counter;
+  EXPECT_EQ(counter.num_allocations(), 0);
+
+  std::unique_ptr<int> value(new int(1));
+  std::vector<char> buffer(100);
+  EXPECT_EQ(counter.num_allocations(), 2);
+  EXPECT_GE(counter.num_bytes(), sizeof(int) + 100);
+  EXPECT_GE(NumHeapAllocations(), 3);
+}
+
+TEST(AllocationCounterTest, DoesNotCountOtherThreads) {
+  ScopedAllocationCounter counter;
+  std::thread thread([]() {
+    for (int i = 0; i < 10; ++i) {
+      std::unique_ptr<int> value(new int(i));
+    }
+  });
+  thread.join();
+  // Only the state of the thread is allocated by this one.
+  EXPECT_LT(counter.num_allocations(), 10);
+}
+
+TEST(AllocationCounterTest, CountsAllocationsOfFunction) {
+  EXPECT_EQ(CountAllocations([]() { std::vector<int> values(10); }), 1);
+  EXPECT_EQ(CountAllocations([]() {}), 0);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/testing/benchmark-utils.h"
+
+#include <stdlib.h>
+
+#include "utils/testing/worst-case-search.h"
+#include "utils/utf8/unicodetext.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+std::vector<std::string> ChatTexts() {
+  return {
+      "hey are we still on for lunch tomorrow?",
+      "Sure! 12:30 at the place on 5th Ave?",
+      "Call me at (650) 253-0000 when you land",
+      "running 10 min late, sorry",
+      "can you send me the address? I think it was 1600 Amphitheatre "
+      "Parkway, Mountain View",
+      "Check this out https://www.example.com/articles/2019/06/foo",
+      "ok see you at 7pm",
+      "my email is jane.doe@example.com btw",
+      "Flight LX 38 lands at 6:45 tonight",
+      "thanks!! 😊",
+  };
+}
+
+std::vector<std::string> EmailTexts() {
+  return {
+      "Hi Jane,\n\nThanks for getting back to me so quickly. As discussed, "
+      "let's meet on Tuesday, March 3rd at 2:00 PM in the main conference "
+      "room at 350 Fifth Avenue, New York, NY 10118. If anything changes, "
+      "please call me on +1 212-736-3100 or reply to this email.\n\nI've "
+      "attached the draft agreement, the final version is also available at "
+      "https://docs.example.com/agreements/2020/final. Please review "
+      "sections 4 and 7 before the meeting.\n\nBest regards,\nJohn Smith\n"
+      "Senior Account Manager\njohn.smith@example.com",
+      "Hello team,\n\nA quick reminder that the quarterly review is "
+      "scheduled for Friday at 10am. The dial-in number is 1-800-555-0199, "
+      "passcode 445566. We will cover the roadmap for the next two quarters "
+      "and the results of the customer survey, which closed last week with "
+      "more than 1,200 responses.\n\nYour order #112-4456789-1234567 has "
+      "shipped and will arrive by Thursday, June 18. Track it with UPS "
+      "tracking number 1Z999AA10123456784.\n\nThanks,\nMaria",
+  };
+}
+
+std::vector<std::string> WebPageTexts() {
+  // Paragraphs of a news-like page, repeated to the size of a long article.
+  const std::string paragraphs =
+      "The city council met on Monday evening to discuss the proposed "
+      "renovation of the central library, which first opened its doors in "
+      "1924. According to the plans published on www.example.gov/library, "
+      "the building would close for eighteen months starting in September "
+      "2021. Residents can submit comments until August 15 by writing to "
+      "library-comments@example.gov or by calling 555-0142 between 9am and "
+      "5pm on weekdays. ";
+  std::string page;
+  while (page.size() < 32 * 1024) {
+    page += paragraphs;
+  }
+  return {page};
+}
+
+// A sentence of each script, indexed by BenchmarkScript.
+const char* const kScriptSentences[kNumBenchmarkScripts] = {
+    "Meet me at the station at 10:30, the train leaves from platform 4. ",
+    "Встретимся на вокзале в 10:30, поезд отходит с платформы 4. ",
+    "لنلتق في المحطة الساعة 10:30، القطار يغادر من الرصيف 4. ",
+    "我们十点半在车站见面，火车从4号站台出发。",
+    "เจอกันที่สถานีตอน 10:30 รถไฟออกจากชานชาลาที่ 4 ",
+};
+
+}  // namespace
+
+std::string BenchmarkScriptText(BenchmarkScript script, int num_codepoints) {
+  const UnicodeText sentence = UTF8ToUnicodeText(
+      kScriptSentences[static_cast<int>(script)], /*do_copy=*/false);
+  UnicodeText text;
+  int length = 0;
+  while (length < num_codepoints) {
+    for (const char32 codepoint : sentence) {
+      if (length == num_codepoints) {
+        break;
+      }
+      text.push_back(codepoint);
+      ++length;
+    }
+  }
+  return text.ToUTF8String();
+}
+
+std::string BenchmarkScriptName(BenchmarkScript script) {
+  switch (script) {
+    case BenchmarkScript::kLatin:
+      return "latin";
+    case BenchmarkScript::kCyrillic:
+      return "cyrillic";
+    case BenchmarkScript::kArabic:
+      return "arabic";
+    case BenchmarkScript::kHan:
+      return "han";
+    case BenchmarkScript::kThai:
+      return "thai";
+  }
+  return "";
+}
+
+void ScriptsAndLengths(benchmark::internal::Benchmark* benchmark) {
+  for (int script = 0; script < kNumBenchmarkScripts; ++script) {
+    for (const int length : {64, 1024, 16384}) {
+      benchmark->Args({script, length});
+    }
+  }
+}
+
+void WorstCaseInputsAndLengths(benchmark::internal::Benchmark* benchmark) {
+  for (int input = 0; input < kNumWorstCaseInputs; ++input) {
+    for (const int length : {1024, 16384}) {
+      benchmark->Args({input, length});
+    }
+  }
+}
+
+const std::vector<std::string>& BenchmarkCorpusTexts(BenchmarkCorpus corpus) {
+  static const std::vector<std::string>* const kCorpora[kNumBenchmarkCorpora] =
+      {new std::vector<std::string>(ChatTexts()),
+       new std::vector<std::string>(EmailTexts()),
+       new std::vector<std::string>(WebPageTexts())};
+  return *kCorpora[static_cast<int>(corpus)];
+}
+
+std::string BenchmarkCorpusName(BenchmarkCorpus corpus) {
+  switch (corpus) {
+    case BenchmarkCorpus::kChat:
+      return "chat";
+    case BenchmarkCorpus::kEmail:
+      return "email";
+    case BenchmarkCorpus::kWebPage:
+      return "web_page";
+  }
+  return "";
+}
+
+void SharedInstanceThreads(benchmark::internal::Benchmark* benchmark) {
+  benchmark->ThreadRange(1, 64)->UseRealTime();
+}
+
+std::string BenchmarkModelPath(const std::string& filename) {
+  const char* model_dir = getenv("TC3_MODEL_DIR");
+  return std::string(model_dir != nullptr ? model_dir : "models") + "/" +
+         filename;
+}
+
+}  // namespace libtextclassifier3
+
+BENCHMARK_MAIN();
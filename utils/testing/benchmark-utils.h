@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Helpers for the benchmarks of the libtextclassifier_benchmarks target.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_TESTING_BENCHMARK_UTILS_H_
+#define LIBTEXTCLASSIFIER_UTILS_TESTING_BENCHMARK_UTILS_H_
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "utils/base/integral_types.h"
+#include "utils/testing/allocation-counter.h"
+#include "benchmark/benchmark.h"
+
+namespace libtextclassifier3 {
+
+// Kinds of texts the benchmarks run on.
+enum class BenchmarkCorpus {
+  // Short chat messages.
+  kChat = 0,
+  // Emails of a few paragraphs.
+  kEmail = 1,
+  // A long web page.
+  kWebPage = 2,
+};
+
+constexpr int kNumBenchmarkCorpora = 3;
+
+// Returns the texts of the corpus.
+const std::vector<std::string>& BenchmarkCorpusTexts(BenchmarkCorpus corpus);
+
+// Returns the name of the corpus, to label the results.
+std::string BenchmarkCorpusName(BenchmarkCorpus corpus);
+
+// Scripts of the texts of the component benchmarks.
+enum class BenchmarkScript {
+  kLatin = 0,
+  kCyrillic = 1,
+  kArabic = 2,
+  kHan = 3,
+  kThai = 4,
+};
+
+constexpr int kNumBenchmarkScripts = 5;
+
+// Returns a text of `num_codepoints` codepoints in the script, made of
+// sentences with words, numbers and punctuation.
+std::string BenchmarkScriptText(BenchmarkScript script, int num_codepoints);
+
+// Returns the name of the script, to label the results.
+std::string BenchmarkScriptName(BenchmarkScript script);
+
+// Registers the arguments {script, text length in codepoints} of all the
+// scripts and lengths, to run a benchmark on the texts of
+// BenchmarkScriptText().
+void ScriptsAndLengths(benchmark::internal::Benchmark* benchmark);
+
+// Registers the arguments {shape, text length in bytes} of all the
+// WorstCaseInput shapes and lengths, to run a benchmark on the texts of
+// WorstCaseInputText(). These benchmarks catch the inputs that became slow per
+// byte again.
+void WorstCaseInputsAndLengths(benchmark::internal::Benchmark* benchmark);
+
+// Returns the path of the shipped model with the given file name, in the
+// directory in the TC3_MODEL_DIR environment variable, or models/.
+std::string BenchmarkModelPath(const std::string& filename);
+
+// Runs `fn` once per iteration of the benchmark and reports, besides the
+// time: the calls per second, the percentiles of the latency of a call, the
+// heap allocations per call and, if `bytes_per_call` isn't 0, the bytes
+// processed per second.
+template <typename Fn>
+void RunMeasuredBenchmark(benchmark::State& state, int64 bytes_per_call,
+                          Fn fn) {
+  std::vector<double> latencies_us;
+  latencies_us.reserve(state.max_iterations);
+  const int64 start_allocations = NumHeapAllocations();
+  for (auto _ : state) {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    latencies_us.push_back(std::chrono::duration<double, std::micro>(
+                               std::chrono::steady_clock::now() - start)
+                               .count());
+  }
+  const int64 num_allocations = NumHeapAllocations() - start_allocations;
+
+  state.SetItemsProcessed(state.iterations());
+  if (bytes_per_call > 0) {
+    state.SetBytesProcessed(state.iterations() * bytes_per_call);
+  }
+  if (latencies_us.empty()) {
+    return;
+  }
+  std::sort(latencies_us.begin(), latencies_us.end());
+  for (const int percentile : {50, 90, 99}) {
+    const int index =
+        std::min<int>(latencies_us.size() - 1,
+                      latencies_us.size() * percentile / 100);
+    state.counters["p" + std::to_string(percentile) + "_us"] =
+        latencies_us[index];
+  }
+  state.counters["allocs_per_call"] =
+      static_cast<double>(num_allocations) / latencies_us.size();
+}
+
+// Runs a benchmark on 1 to 64 threads, measured in wall time, for the
+// benchmarks of the scalability of an instance shared by the threads.
+void SharedInstanceThreads(benchmark::internal::Benchmark* benchmark);
+
+// Runs `fn` once per iteration on each thread of the benchmark and reports the
+// calls per second of all the threads and of one thread on average. The
+// latter stays flat as threads are added unless they wait on each other, e.g.
+// on a lock of the shared instance.
+template <typename Fn>
+void RunThreadScalingBenchmark(benchmark::State& state, Fn fn) {
+  for (auto _ : state) {
+    fn();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["calls_per_thread_per_s"] = benchmark::Counter(
+      state.iterations(),
+      benchmark::Counter::kIsRate | benchmark::Counter::kAvgThreads);
+}
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_TESTING_BENCHMARK_UTILS_H_
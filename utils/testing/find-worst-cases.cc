@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Searches for the texts that a model is the slowest on per byte, with
+// WorstCaseSearch, to find the pathological inputs of the annotator, the
+// datetime parser or the tokenizer of a model. The shapes of the inputs found
+// belong in WorstCaseInput, which the benchmarks and the time budget tests
+// run on.
+//
+// Usage:
+//   libtextclassifier_find_worst_cases --model=<path>
+//       [--target=annotate|datetime|tokenize] [--iterations=1000]
+//       [--min_bytes=256] [--max_bytes=4096] [--num_results=5]
+//       [--random_seed=1] [--locales=en]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "annotator/annotator.h"
+#include "annotator/datetime/parser.h"
+#include "annotator/feature-processor.h"
+#include "utils/testing/worst-case-search.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+struct Flags {
+  std::string model;
+  std::string target = "annotate";
+  std::string locales = "en";
+  WorstCaseSearchOptions options;
+};
+
+bool ParseFlags(int argc, char** argv, Flags* flags) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const size_t equals = arg.find('=');
+    const std::string name = arg.substr(0, equals);
+    const std::string value =
+        equals == std::string::npos ? "" : arg.substr(equals + 1);
+    if (name == "--model") {
+      flags->model = value;
+    } else if (name == "--target") {
+      flags->target = value;
+    } else if (name == "--locales") {
+      flags->locales = value;
+    } else if (name == "--iterations") {
+      flags->options.num_iterations = atoi(value.c_str());
+    } else if (name == "--min_bytes") {
+      flags->options.min_bytes = atoi(value.c_str());
+    } else if (name == "--max_bytes") {
+      flags->options.max_bytes = atoi(value.c_str());
+    } else if (name == "--num_results") {
+      flags->options.num_results = atoi(value.c_str());
+    } else if (name == "--random_seed") {
+      flags->options.random_seed = atoi(value.c_str());
+    } else {
+      fprintf(stderr, "Unknown flag: %s\n", arg.c_str());
+      return false;
+    }
+  }
+  if (flags->model.empty()) {
+    fprintf(stderr, "--model is required.\n");
+    return false;
+  }
+  if (flags->target != "annotate" && flags->target != "datetime" &&
+      flags->target != "tokenize") {
+    fprintf(stderr, "--target must be annotate, datetime or tokenize.\n");
+    return false;
+  }
+  if (flags->options.num_results < 1 || flags->options.min_bytes < 1 ||
+      flags->options.max_bytes < flags->options.min_bytes) {
+    fprintf(stderr, "Invalid sizes.\n");
+    return false;
+  }
+  return true;
+}
+
+// Returns the text as a C++ string literal, shortened to about `max_bytes`.
+std::string Quote(const std::string& text, int max_bytes) {
+  std::string quoted = "\"";
+  for (int i = 0; i < text.size() && i < max_bytes; ++i) {
+    switch (text[i]) {
+      case '\n':
+        quoted += "\\n";
+        break;
+      case '"':
+        quoted += "\\\"";
+        break;
+      case '\\':
+        quoted += "\\\\";
+        break;
+      default:
+        quoted += text[i];
+    }
+  }
+  quoted += "\"";
+  if (text.size() > max_bytes) {
+    quoted += "...";
+  }
+  return quoted;
+}
+
+int Main(int argc, char** argv) {
+  Flags flags;
+  if (!ParseFlags(argc, argv, &flags)) {
+    return 1;
+  }
+  std::unique_ptr<Annotator> annotator = Annotator::FromPath(flags.model);
+  if (annotator == nullptr) {
+    fprintf(stderr, "Couldn't load the model %s.\n", flags.model.c_str());
+    return 1;
+  }
+
+  std::function<void(const std::string&)> run;
+  if (flags.target == "annotate") {
+    AnnotationOptions options;
+    options.locales = flags.locales;
+    run = [&annotator, options](const std::string& text) {
+      annotator->Annotate(text, options);
+    };
+  } else if (flags.target == "datetime") {
+    const DatetimeParser* parser = annotator->DatetimeParserForTests();
+    if (parser == nullptr) {
+      fprintf(stderr, "The model has no datetime model.\n");
+      return 1;
+    }
+    const std::string locales = flags.locales;
+    run = [parser, locales](const std::string& text) {
+      std::vector<DatetimeParseResultSpan> results;
+      parser->Parse(text, /*reference_time_ms_utc=*/0,
+                    /*reference_timezone=*/"UTC", locales, ModeFlag_ANNOTATION,
+                    AnnotationUsecase_ANNOTATION_USECASE_SMART,
+                    /*anchor_start_end=*/false, &results);
+    };
+  } else {
+    const FeatureProcessor* feature_processor =
+        annotator->SelectionFeatureProcessorForTests();
+    if (feature_processor == nullptr) {
+      fprintf(stderr, "The model has no selection model.\n");
+      return 1;
+    }
+    run = [feature_processor](const std::string& text) {
+      feature_processor->Tokenize(text);
+    };
+  }
+
+  // The known worst cases and a plain text.
+  std::vector<std::string> seeds = {
+      "Let's meet at the station at 10:30, call me on 650-253-0000."};
+  for (int i = 0; i < kNumWorstCaseInputs; ++i) {
+    seeds.push_back(WorstCaseInputText(static_cast<WorstCaseInput>(i),
+                                       flags.options.min_bytes));
+  }
+
+  WorstCaseSearch search(run, flags.options);
+  const std::vector<WorstCaseResult> results = search.Run(seeds);
+  for (const WorstCaseResult& result : results) {
+    printf("%.3f us/byte, %zu bytes: %s\n", result.us_per_byte,
+           result.input.size(), Quote(result.input, 200).c_str());
+  }
+  return 0;
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
+
+int main(int argc, char** argv) {
+  return libtextclassifier3::Main(argc, argv);
+}
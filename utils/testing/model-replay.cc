@@ -0,0 +1,539 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays a corpus through two versions of a model, e.g. the annotator model
+// of a release and its candidate, and compares them: throughput, latency
+// percentiles, time per phase, memory, and the inputs whose results differ.
+//
+// Usage:
+//   libtextclassifier_model_replay --mode=annotate|actions
+//       --old_model=<path> --new_model=<path> --corpus=<path>
+//       [--threads=1] [--repeat=1] [--locales=en] [--reference_timezone=UTC]
+//       [--reference_time_ms_utc=0] [--max_diffs=10] [--regex_stats]
+//
+// The corpus has one input per line: a text to annotate, or for the actions
+// the messages of a conversation separated by tabs, the last one being from
+// the remote user. "\n", "\t" and "\\" in a line are unescaped.
+//
+// The models run one after the other, never concurrently, each first over the
+// whole corpus on the calling thread to warm it up and record its results,
+// then `repeat` times over the corpus on `threads` threads, which is what the
+// figures are measured on.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "actions/actions-suggestions.h"
+#include "annotator/annotator.h"
+#include "utils/base/integral_types.h"
+#include "utils/memory/memory-stats.h"
+#include "utils/regex-stats.h"
+#include "utils/thread-pool.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+struct Flags {
+  std::string mode = "annotate";
+  std::string old_model;
+  std::string new_model;
+  std::string corpus;
+  int threads = 1;
+  int repeat = 1;
+  std::string locales = "en";
+  std::string reference_timezone = "UTC";
+  int64 reference_time_ms_utc = 0;
+  int max_diffs = 10;
+  bool regex_stats = false;
+};
+
+bool ParseFlags(int argc, char** argv, Flags* flags) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    const size_t equals = arg.find('=');
+    const std::string name = arg.substr(0, equals);
+    const std::string value =
+        equals == std::string::npos ? "" : arg.substr(equals + 1);
+    if (name == "--mode") {
+      flags->mode = value;
+    } else if (name == "--old_model") {
+      flags->old_model = value;
+    } else if (name == "--new_model") {
+      flags->new_model = value;
+    } else if (name == "--corpus") {
+      flags->corpus = value;
+    } else if (name == "--threads") {
+      flags->threads = atoi(value.c_str());
+    } else if (name == "--repeat") {
+      flags->repeat = atoi(value.c_str());
+    } else if (name == "--locales") {
+      flags->locales = value;
+    } else if (name == "--reference_timezone") {
+      flags->reference_timezone = value;
+    } else if (name == "--reference_time_ms_utc") {
+      flags->reference_time_ms_utc = atoll(value.c_str());
+    } else if (name == "--max_diffs") {
+      flags->max_diffs = atoi(value.c_str());
+    } else if (name == "--regex_stats") {
+      flags->regex_stats = true;
+    } else {
+      fprintf(stderr, "Unknown flag: %s\n", arg.c_str());
+      return false;
+    }
+  }
+  if (flags->mode != "annotate" && flags->mode != "actions") {
+    fprintf(stderr, "--mode must be annotate or actions.\n");
+    return false;
+  }
+  if (flags->old_model.empty() || flags->new_model.empty() ||
+      flags->corpus.empty()) {
+    fprintf(stderr, "--old_model, --new_model and --corpus are required.\n");
+    return false;
+  }
+  if (flags->threads < 1 || flags->repeat < 1) {
+    fprintf(stderr, "--threads and --repeat must be positive.\n");
+    return false;
+  }
+  return true;
+}
+
+std::string Unescape(const std::string& line) {
+  std::string text;
+  for (int i = 0; i < line.size(); ++i) {
+    if (line[i] == '\\' && i + 1 < line.size()) {
+      const char next = line[i + 1];
+      if (next == 'n' || next == 't' || next == '\\') {
+        text.push_back(next == 'n' ? '\n' : next == 't' ? '\t' : '\\');
+        ++i;
+        continue;
+      }
+    }
+    text.push_back(line[i]);
+  }
+  return text;
+}
+
+std::vector<std::string> Split(const std::string& line, char separator) {
+  std::vector<std::string> parts;
+  size_t start = 0;
+  while (true) {
+    const size_t end = line.find(separator, start);
+    parts.push_back(line.substr(start, end - start));
+    if (end == std::string::npos) {
+      return parts;
+    }
+    start = end + 1;
+  }
+}
+
+// Skips the empty lines.
+bool ReadCorpus(const std::string& path, std::vector<std::string>* lines) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    if (!line.empty()) {
+      lines->push_back(line);
+    }
+  }
+  return true;
+}
+
+// A model under replay. Run() is called concurrently.
+class ReplayModel {
+ public:
+  virtual ~ReplayModel() {}
+
+  // Names of the phases Run() adds the time of.
+  virtual std::vector<std::string> PhaseNames() const = 0;
+
+  // Runs the model on a line of the corpus and returns its result in a form
+  // that compares equal iff the results are the same, ignoring the scores.
+  // Adds the time of the phases to `phase_us`, in the order of PhaseNames().
+  virtual std::string Run(const std::string& line,
+                          std::vector<int64>* phase_us) const = 0;
+
+  virtual MemoryStats GetMemoryStats() const = 0;
+
+  virtual void EnableRegexStats() {}
+  virtual std::vector<RegexPatternStats> GetRegexStats() const { return {}; }
+};
+
+class AnnotatorReplayModel : public ReplayModel {
+ public:
+  AnnotatorReplayModel(std::unique_ptr<Annotator> annotator,
+                       const Flags& flags)
+      : annotator_(std::move(annotator)) {
+    options_.locales = flags.locales;
+    options_.reference_timezone = flags.reference_timezone;
+    options_.reference_time_ms_utc = flags.reference_time_ms_utc;
+  }
+
+  std::vector<std::string> PhaseNames() const override {
+    return {"language_detection", "tokenization",   "feature_extraction",
+            "selection_inference", "classification_inference",
+            "regex",              "datetime",       "knowledge",
+            "number",             "duration",       "other_engines",
+            "conflict_resolution"};
+  }
+
+  std::string Run(const std::string& line,
+                  std::vector<int64>* phase_us) const override {
+    AnnotatorPhaseTimes phase_times;
+    AnnotationOptions options = options_;
+    options.phase_times = &phase_times;
+    const std::vector<AnnotatedSpan> annotations =
+        annotator_->Annotate(Unescape(line), options);
+
+    const int64 times[] = {phase_times.language_detection_us,
+                           phase_times.tokenization_us,
+                           phase_times.feature_extraction_us,
+                           phase_times.selection_inference_us,
+                           phase_times.classification_inference_us,
+                           phase_times.regex_us,
+                           phase_times.datetime_us,
+                           phase_times.knowledge_us,
+                           phase_times.number_us,
+                           phase_times.duration_us,
+                           phase_times.other_engines_us,
+                           phase_times.conflict_resolution_us};
+    for (int i = 0; i < phase_us->size(); ++i) {
+      (*phase_us)[i] += times[i];
+    }
+
+    std::string result;
+    for (const AnnotatedSpan& annotation : annotations) {
+      result += "[" + std::to_string(annotation.span.first) + "," +
+                std::to_string(annotation.span.second) + ") ";
+      result += annotation.classification.empty()
+                    ? ""
+                    : annotation.classification[0].collection;
+      result += "; ";
+    }
+    return result;
+  }
+
+  MemoryStats GetMemoryStats() const override {
+    return annotator_->GetMemoryStats();
+  }
+
+  void EnableRegexStats() override {
+    annotator_->EnableRegexStats(/*slow_run_threshold_us=*/0);
+  }
+
+  std::vector<RegexPatternStats> GetRegexStats() const override {
+    return annotator_->GetRegexStats();
+  }
+
+ private:
+  const std::unique_ptr<Annotator> annotator_;
+  AnnotationOptions options_;
+};
+
+class ActionsReplayModel : public ReplayModel {
+ public:
+  ActionsReplayModel(std::unique_ptr<ActionsSuggestions> actions,
+                     const Flags& flags)
+      : actions_(std::move(actions)), flags_(flags) {}
+
+  std::vector<std::string> PhaseNames() const override {
+    return {"annotations", "low_confidence", "model",
+            "lua",         "rules",          "ranking"};
+  }
+
+  std::string Run(const std::string& line,
+                  std::vector<int64>* phase_us) const override {
+    Conversation conversation;
+    const std::vector<std::string> messages = Split(line, '\t');
+    for (int i = 0; i < messages.size(); ++i) {
+      ConversationMessage message;
+      // The last message is from the remote user.
+      message.user_id = (messages.size() - 1 - i) % 2 == 0 ? 1 : 0;
+      message.text = Unescape(messages[i]);
+      message.reference_time_ms_utc = flags_.reference_time_ms_utc;
+      message.reference_timezone = flags_.reference_timezone;
+      message.detected_text_language_tags = flags_.locales;
+      conversation.messages.push_back(message);
+    }
+
+    ActionsPhaseTimes phase_times;
+    ActionSuggestionOptions options;
+    options.phase_times = &phase_times;
+    const ActionsSuggestionsResponse response =
+        actions_->SuggestActions(conversation, options);
+
+    const int64 times[] = {phase_times.annotations_us,
+                           phase_times.low_confidence_us,
+                           phase_times.model_us,
+                           phase_times.lua_us,
+                           phase_times.rules_us,
+                           phase_times.ranking_us};
+    for (int i = 0; i < phase_us->size(); ++i) {
+      (*phase_us)[i] += times[i];
+    }
+
+    std::string result;
+    for (const ActionSuggestion& action : response.actions) {
+      result += action.type;
+      if (!action.response_text.empty()) {
+        result += " \"" + action.response_text + "\"";
+      }
+      result += "; ";
+    }
+    return result;
+  }
+
+  MemoryStats GetMemoryStats() const override {
+    return actions_->GetMemoryStats();
+  }
+
+ private:
+  const std::unique_ptr<ActionsSuggestions> actions_;
+  const Flags flags_;
+};
+
+std::unique_ptr<ReplayModel> LoadModel(const std::string& path,
+                                       const Flags& flags) {
+  if (flags.mode == "annotate") {
+    std::unique_ptr<Annotator> annotator = Annotator::FromPath(path);
+    if (annotator == nullptr) {
+      return nullptr;
+    }
+    return std::unique_ptr<ReplayModel>(
+        new AnnotatorReplayModel(std::move(annotator), flags));
+  }
+  std::unique_ptr<ActionsSuggestions> actions =
+      ActionsSuggestions::FromPath(path);
+  if (actions == nullptr) {
+    return nullptr;
+  }
+  return std::unique_ptr<ReplayModel>(
+      new ActionsReplayModel(std::move(actions), flags));
+}
+
+struct ReplayStats {
+  // The results of the warm-up run, by line of the corpus.
+  std::vector<std::string> results;
+
+  int64 num_calls = 0;
+  double wall_time_s = 0;
+  // Sorted.
+  std::vector<double> latencies_us;
+  // Summed over the calls, in the order of ReplayModel::PhaseNames().
+  std::vector<int64> phase_us;
+
+  MemoryStats memory;
+  std::vector<RegexPatternStats> regex_stats;
+
+  double Percentile(int percentile) const {
+    if (latencies_us.empty()) {
+      return 0;
+    }
+    return latencies_us[std::min<int>(latencies_us.size() - 1,
+                                      latencies_us.size() * percentile / 100)];
+  }
+};
+
+double MicrosSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::micro>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+ReplayStats Replay(ReplayModel* model, const std::vector<std::string>& corpus,
+                   const Flags& flags) {
+  const int num_phases = model->PhaseNames().size();
+  ReplayStats stats;
+  std::vector<int64> warmup_phase_us(num_phases);
+  for (const std::string& line : corpus) {
+    stats.results.push_back(model->Run(line, &warmup_phase_us));
+  }
+  if (flags.regex_stats) {
+    model->EnableRegexStats();
+  }
+
+  // Each worker keeps its own figures, merged once they are all done.
+  struct WorkerStats {
+    std::vector<double> latencies_us;
+    std::vector<int64> phase_us;
+  };
+  std::vector<WorkerStats> workers(flags.threads);
+  stats.num_calls = static_cast<int64>(corpus.size()) * flags.repeat;
+  std::atomic<int64> next_call(0);
+  const auto start = std::chrono::steady_clock::now();
+  {
+    ThreadPool pool(flags.threads);
+    for (WorkerStats& worker : workers) {
+      pool.Schedule([&, model]() {
+        worker.phase_us.resize(num_phases);
+        for (int64 call = next_call++; call < stats.num_calls;
+             call = next_call++) {
+          const auto call_start = std::chrono::steady_clock::now();
+          model->Run(corpus[call % corpus.size()], &worker.phase_us);
+          worker.latencies_us.push_back(MicrosSince(call_start));
+        }
+      });
+    }
+    // The destructor of the pool waits for the workers.
+  }
+  stats.wall_time_s = MicrosSince(start) / 1e6;
+
+  stats.phase_us.resize(num_phases);
+  for (const WorkerStats& worker : workers) {
+    stats.latencies_us.insert(stats.latencies_us.end(),
+                              worker.latencies_us.begin(),
+                              worker.latencies_us.end());
+    for (int i = 0; i < num_phases; ++i) {
+      stats.phase_us[i] += worker.phase_us[i];
+    }
+  }
+  std::sort(stats.latencies_us.begin(), stats.latencies_us.end());
+
+  stats.memory = model->GetMemoryStats();
+  stats.regex_stats = model->GetRegexStats();
+  return stats;
+}
+
+void PrintRow(const std::string& name, double old_value, double new_value) {
+  const double delta =
+      old_value == 0 ? 0 : 100.0 * (new_value - old_value) / old_value;
+  printf("%-40s %14.1f %14.1f %+9.1f%%\n", name.c_str(), old_value, new_value,
+         delta);
+}
+
+void PrintComparison(const std::vector<std::string>& phase_names,
+                     const ReplayStats& old_stats,
+                     const ReplayStats& new_stats) {
+  printf("%-40s %14s %14s %10s\n", "", "old", "new", "delta");
+  PrintRow("throughput (calls/s)", old_stats.num_calls / old_stats.wall_time_s,
+           new_stats.num_calls / new_stats.wall_time_s);
+  for (const int percentile : {50, 90, 99}) {
+    PrintRow("latency p" + std::to_string(percentile) + " (us)",
+             old_stats.Percentile(percentile),
+             new_stats.Percentile(percentile));
+  }
+  for (int i = 0; i < phase_names.size(); ++i) {
+    PrintRow("phase " + phase_names[i] + " (us/call)",
+             static_cast<double>(old_stats.phase_us[i]) / old_stats.num_calls,
+             static_cast<double>(new_stats.phase_us[i]) / new_stats.num_calls);
+  }
+
+  const auto print_memory = [&](const std::string& name,
+                                int64 MemoryStats::*field) {
+    PrintRow("memory " + name + " (KiB)", old_stats.memory.*field / 1024.0,
+             new_stats.memory.*field / 1024.0);
+  };
+  print_memory("mapped", &MemoryStats::mapped_bytes);
+  print_memory("resident", &MemoryStats::resident_bytes);
+  print_memory("regex", &MemoryStats::regex_bytes);
+  print_memory("decompressed", &MemoryStats::decompressed_bytes);
+  print_memory("interpreter", &MemoryStats::interpreter_bytes);
+  print_memory("cache", &MemoryStats::cache_bytes);
+  print_memory("lua", &MemoryStats::lua_bytes);
+  PrintRow("memory heap (KiB)", old_stats.memory.heap_bytes() / 1024.0,
+           new_stats.memory.heap_bytes() / 1024.0);
+}
+
+// Prints the patterns that took the most time.
+void PrintRegexStats(const std::string& label, ReplayStats* stats) {
+  constexpr int kNumPatterns = 10;
+  std::sort(stats->regex_stats.begin(), stats->regex_stats.end(),
+            [](const RegexPatternStats& a, const RegexPatternStats& b) {
+              return a.total_time_us > b.total_time_us;
+            });
+  printf("\nCostliest patterns of the %s model:\n", label.c_str());
+  for (int i = 0; i < std::min<int>(kNumPatterns, stats->regex_stats.size());
+       ++i) {
+    const RegexPatternStats& pattern = stats->regex_stats[i];
+    printf("  %s #%d (%s): %lld us total, %lld us max, %lld finds\n",
+           pattern.model.c_str(), pattern.pattern_index,
+           pattern.collection_name.c_str(),
+           static_cast<long long>(pattern.total_time_us),
+           static_cast<long long>(pattern.max_time_us),
+           static_cast<long long>(pattern.num_find_calls));
+  }
+}
+
+void PrintDiffs(const std::vector<std::string>& corpus,
+                const ReplayStats& old_stats, const ReplayStats& new_stats,
+                int max_diffs) {
+  int num_diffs = 0;
+  for (int i = 0; i < corpus.size(); ++i) {
+    if (old_stats.results[i] == new_stats.results[i]) {
+      continue;
+    }
+    if (num_diffs < max_diffs) {
+      printf("\nline %d: %s\n  old: %s\n  new: %s\n", i + 1,
+             corpus[i].substr(0, 120).c_str(), old_stats.results[i].c_str(),
+             new_stats.results[i].c_str());
+    }
+    ++num_diffs;
+  }
+  printf("\n%d of %zu inputs have different results.\n", num_diffs,
+         corpus.size());
+}
+
+int Main(int argc, char** argv) {
+  Flags flags;
+  if (!ParseFlags(argc, argv, &flags)) {
+    return 1;
+  }
+  std::vector<std::string> corpus;
+  if (!ReadCorpus(flags.corpus, &corpus) || corpus.empty()) {
+    fprintf(stderr, "Couldn't read the corpus %s.\n", flags.corpus.c_str());
+    return 1;
+  }
+
+  ReplayStats stats[2];
+  std::vector<std::string> phase_names;
+  const std::string paths[] = {flags.old_model, flags.new_model};
+  for (int i = 0; i < 2; ++i) {
+    std::unique_ptr<ReplayModel> model = LoadModel(paths[i], flags);
+    if (model == nullptr) {
+      fprintf(stderr, "Couldn't load the model %s.\n", paths[i].c_str());
+      return 1;
+    }
+    phase_names = model->PhaseNames();
+    stats[i] = Replay(model.get(), corpus, flags);
+  }
+
+  printf("%zu inputs, %d passes on %d threads\n\n", corpus.size(),
+         flags.repeat, flags.threads);
+  PrintComparison(phase_names, stats[0], stats[1]);
+  if (flags.regex_stats) {
+    PrintRegexStats("old", &stats[0]);
+    PrintRegexStats("new", &stats[1]);
+  }
+  PrintDiffs(corpus, stats[0], stats[1], flags.max_diffs);
+  return 0;
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
+
+int main(int argc, char** argv) {
+  return libtextclassifier3::Main(argc, argv);
+}
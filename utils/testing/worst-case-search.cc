@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/testing/worst-case-search.h"
+
+#include <utility>
+
+namespace libtextclassifier3 {
+namespace {
+
+// Fragments the mutations insert.
+const char* const kFragments[] = {
+    "(",          ")",       "[",      "]",       "{",     "}",
+    "0",          "123",     "4567",   "+1 ",     "-",     ".",
+    "/",          ":",       ",",      " ",       "\n",    "@",
+    "www.",       "http://", ".com",   "12/12",   "10:30", " pm",
+    " monday ",   " at ",    " on ",   "2019",    "jan ",  "tomorrow",
+    "aaaaaaaaaa", "é",       "日本",   "😊",      "ไทย",   "й",
+};
+
+// Returns `fragment` repeated up to `num_bytes`, cut at a byte boundary of the
+// fragment so that no UTF-8 sequence is cut.
+std::string Repeat(const std::string& fragment, int num_bytes) {
+  std::string text;
+  if (fragment.empty()) {
+    return text;
+  }
+  while (text.size() + fragment.size() <= num_bytes) {
+    text += fragment;
+  }
+  return text;
+}
+
+}  // namespace
+
+std::string WorstCaseInputText(WorstCaseInput input, int num_bytes) {
+  switch (input) {
+    case WorstCaseInput::kLongToken:
+      return Repeat("abcdefghij", num_bytes);
+    case WorstCaseInput::kDigits:
+      return Repeat("0123456789", num_bytes);
+    case WorstCaseInput::kDateFragments:
+      return Repeat("on monday 12/12 at 10:30 pm ", num_bytes);
+    case WorstCaseInput::kNestedBrackets: {
+      const int depth = num_bytes / 2;
+      return std::string(depth, '(') + std::string(depth, ')');
+    }
+    case WorstCaseInput::kUnpairedBrackets:
+      return Repeat("(a ", num_bytes);
+    case WorstCaseInput::kPhoneFragments:
+      return Repeat("+1 (650) 25-", num_bytes);
+  }
+  return "";
+}
+
+std::string WorstCaseInputName(WorstCaseInput input) {
+  switch (input) {
+    case WorstCaseInput::kLongToken:
+      return "long_token";
+    case WorstCaseInput::kDigits:
+      return "digits";
+    case WorstCaseInput::kDateFragments:
+      return "date_fragments";
+    case WorstCaseInput::kNestedBrackets:
+      return "nested_brackets";
+    case WorstCaseInput::kUnpairedBrackets:
+      return "unpaired_brackets";
+    case WorstCaseInput::kPhoneFragments:
+      return "phone_fragments";
+  }
+  return "";
+}
+
+WorstCaseSearch::WorstCaseSearch(std::function<void(const std::string&)> run,
+                                 const WorstCaseSearchOptions& options)
+    : run_(std::move(run)), options_(options), random_(options.random_seed) {}
+
+std::vector<WorstCaseResult> WorstCaseSearch::Run(
+    const std::vector<std::string>& seeds) {
+  results_.clear();
+  for (const std::string& seed : seeds) {
+    Keep(Measure(seed));
+  }
+  if (results_.empty()) {
+    Keep(Measure(""));
+  }
+  for (int i = 0; i < options_.num_iterations; ++i) {
+    const WorstCaseResult& parent = results_[std::uniform_int_distribution<int>(
+        0, results_.size() - 1)(random_)];
+    Keep(Measure(Mutate(parent.input)));
+  }
+  return results_;
+}
+
+std::string WorstCaseSearch::Mutate(const std::string& input) {
+  constexpr int kNumFragments = sizeof(kFragments) / sizeof(kFragments[0]);
+  const std::string fragment =
+      kFragments[std::uniform_int_distribution<int>(0, kNumFragments - 1)(
+          random_)];
+  std::string mutated = input;
+  switch (std::uniform_int_distribution<int>(0, 3)(random_)) {
+    case 0:
+      // Insert the fragment.
+      mutated.insert(RandomOffset(mutated.size()), fragment);
+      break;
+    case 1: {
+      // Replace a slice of the size of the fragment with it.
+      const int offset = RandomOffset(mutated.size());
+      mutated.replace(offset, fragment.size(), fragment);
+      break;
+    }
+    case 2: {
+      // Repeat a slice in place.
+      const int start = RandomOffset(mutated.size());
+      const std::string slice = mutated.substr(start, 1 + RandomOffset(63));
+      mutated.insert(start, Repeat(slice, 4 * slice.size()));
+      break;
+    }
+    case 3:
+      // Tile the fragment over the input, e.g. to make long runs of digits.
+      mutated.insert(RandomOffset(mutated.size()), Repeat(fragment, 64));
+      break;
+  }
+  return mutated;
+}
+
+int WorstCaseSearch::RandomOffset(int size) {
+  return std::uniform_int_distribution<int>(0, size)(random_);
+}
+
+WorstCaseResult WorstCaseSearch::Measure(std::string input) {
+  while (input.size() < options_.min_bytes) {
+    input += input.empty() ? std::string(" ") : input;
+  }
+  if (input.size() > options_.max_bytes) {
+    // Cut at a character boundary.
+    int size = options_.max_bytes;
+    while (size > 0 && (input[size] & 0xC0) == 0x80) {
+      --size;
+    }
+    input.resize(size);
+  }
+  WorstCaseResult result;
+  result.us_per_byte =
+      MinTimeUs(options_.num_repetitions, [&]() { run_(input); }) /
+      input.size();
+  result.input = std::move(input);
+  return result;
+}
+
+void WorstCaseSearch::Keep(WorstCaseResult result) {
+  for (const WorstCaseResult& kept : results_) {
+    if (kept.input == result.input) {
+      return;
+    }
+  }
+  if (results_.size() >= options_.num_results &&
+      result.us_per_byte <= results_.back().us_per_byte) {
+    return;
+  }
+  results_.insert(
+      std::upper_bound(results_.begin(), results_.end(), result,
+                       [](const WorstCaseResult& a, const WorstCaseResult& b) {
+                         return a.us_per_byte > b.us_per_byte;
+                       }),
+      std::move(result));
+  if (results_.size() > options_.num_results) {
+    results_.pop_back();
+  }
+}
+
+}  // namespace libtextclassifier3
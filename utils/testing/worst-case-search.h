@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Search for the inputs a function is slowest on per byte, to find the
+// pathological texts of a component before users do, and the pathological
+// texts found so far, kept for the regression benchmarks and tests.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_TESTING_WORST_CASE_SEARCH_H_
+#define LIBTEXTCLASSIFIER_UTILS_TESTING_WORST_CASE_SEARCH_H_
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "utils/base/integral_types.h"
+
+namespace libtextclassifier3 {
+
+// Shapes of text that were found to be slow per byte.
+enum class WorstCaseInput {
+  // A single token without spaces or punctuation.
+  kLongToken = 0,
+  // An unbroken run of digits, which the phone and number patterns try at
+  // every position.
+  kDigits = 1,
+  // Date-like fragments, which the datetime rules and extractors all match.
+  kDateFragments = 2,
+  // Brackets nested in each other, e.g. "((((x))))".
+  kNestedBrackets = 3,
+  // Opening brackets that are never closed.
+  kUnpairedBrackets = 4,
+  // Fragments of phone numbers separated by punctuation.
+  kPhoneFragments = 5,
+};
+
+constexpr int kNumWorstCaseInputs = 6;
+
+// Returns a text of the shape of `num_bytes` bytes.
+std::string WorstCaseInputText(WorstCaseInput input, int num_bytes);
+
+// Returns the name of the shape, to label the results.
+std::string WorstCaseInputName(WorstCaseInput input);
+
+// Returns the minimum wall time of `num_repetitions` calls of `fn`, which is
+// less noisy than the mean.
+template <typename Fn>
+double MinTimeUs(int num_repetitions, Fn fn) {
+  double min_time_us = -1;
+  for (int i = 0; i < num_repetitions; ++i) {
+    const auto start = std::chrono::steady_clock::now();
+    fn();
+    const double time_us = std::chrono::duration<double, std::micro>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    if (min_time_us < 0 || time_us < min_time_us) {
+      min_time_us = time_us;
+    }
+  }
+  return min_time_us;
+}
+
+struct WorstCaseSearchOptions {
+  // Number of mutated inputs tried.
+  int num_iterations = 1000;
+
+  // Sizes of the inputs tried. Shorter inputs are dominated by the fixed
+  // cost of a call and don't tell anything about the cost per byte.
+  int min_bytes = 256;
+  int max_bytes = 4096;
+
+  // Number of times an input is run, keeping the fastest.
+  int num_repetitions = 3;
+
+  // Number of inputs kept and returned.
+  int num_results = 5;
+
+  uint32 random_seed = 1;
+};
+
+struct WorstCaseResult {
+  std::string input;
+  double us_per_byte = 0;
+};
+
+// Hill climbing over mutations of the inputs: keeps the slowest inputs per
+// byte found so far, and tries mutations of them that repeat, insert or
+// replace fragments of text known to be costly to parse (digits, brackets,
+// dates, punctuation, other scripts).
+class WorstCaseSearch {
+ public:
+  // `run` is the function under search, called with the inputs.
+  WorstCaseSearch(std::function<void(const std::string&)> run,
+                  const WorstCaseSearchOptions& options);
+
+  // Runs the search from the seeds, padded to options.min_bytes if they are
+  // shorter. Returns the slowest inputs per byte, slowest first.
+  std::vector<WorstCaseResult> Run(const std::vector<std::string>& seeds);
+
+ private:
+  std::string Mutate(const std::string& input);
+
+  // Adds the result if it's among the slowest, unless it's already there.
+  void Keep(WorstCaseResult result);
+
+  WorstCaseResult Measure(std::string input);
+
+  // Returns a random offset in [0, size].
+  int RandomOffset(int size);
+
+  const std::function<void(const std::string&)> run_;
+  const WorstCaseSearchOptions options_;
+  std::mt19937 random_;
+
+  // Slowest first.
+  std::vector<WorstCaseResult> results_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_TESTING_WORST_CASE_SEARCH_H_
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/testing/worst-case-search.h"
+
+#include <string>
+#include <vector>
+
+#include "utils/base/integral_types.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(WorstCaseSearchTest, GeneratesInputsOfTheRequestedSize) {
+  for (int i = 0; i < kNumWorstCaseInputs; ++i) {
+    const WorstCaseInput input = static_cast<WorstCaseInput>(i);
+    const std::string text = WorstCaseInputText(input, 1000);
+    EXPECT_LE(text.size(), 1000) << WorstCaseInputName(input);
+    EXPECT_GE(text.size(), 900) << WorstCaseInputName(input);
+  }
+}
+
+// A function that is slow on nested brackets: it does work quadratic in the
+// number of opening brackets.
+void SlowOnBrackets(const std::string& input) {
+  int num_brackets = 0;
+  for (const char c : input) {
+    if (c == '(') {
+      ++num_brackets;
+    }
+  }
+  // Unsigned, so that the sum wraps around instead of overflowing.
+  volatile uint64 sink = 0;
+  const int64 num_steps = static_cast<int64>(num_brackets) * num_brackets;
+  for (int64 i = 0; i < num_steps; ++i) {
+    sink = sink + i;
+  }
+}
+
+TEST(WorstCaseSearchTest, FindsSlowerInputsThanTheSeeds) {
+  WorstCaseSearchOptions options;
+  options.num_iterations = 300;
+  options.min_bytes = 64;
+  options.max_bytes = 1024;
+  options.num_repetitions = 1;
+  WorstCaseSearch search(SlowOnBrackets, options);
+
+  const std::vector<WorstCaseResult> results =
+      search.Run({"call me at 10:30 tomorrow"});
+
+  ASSERT_FALSE(results.empty());
+  EXPECT_LE(results.size(), options.num_results);
+  for (int i = 1; i < results.size(); ++i) {
+    EXPECT_GE(results[i - 1].us_per_byte, results[i].us_per_byte);
+  }
+  for (const WorstCaseResult& result : results) {
+    EXPECT_GE(result.input.size(), options.min_bytes);
+    EXPECT_LE(result.input.size(), options.max_bytes);
+  }
+  EXPECT_NE(results[0].input.find("(("), std::string::npos);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/tflite-interpreter-pool.h"
+
+#include <algorithm>
+
+#include "utils/base/logging.h"
+
+namespace libtextclassifier3 {
+
+std::unique_ptr<tflite::Interpreter> TfLiteInterpreterPool::Acquire() {
+  bool allocated;
+  return Acquire(/*input_shape=*/{}, &allocated);
+}
+
+std::unique_ptr<tflite::Interpreter> TfLiteInterpreterPool::Acquire(
+    const std::vector<int>& input_shape, bool* allocated) {
+  *allocated = false;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!idle_interpreters_.empty()) {
+      // Prefer an interpreter allocated for the input shape, then one that was
+      // last used on this thread, otherwise take the most recently released
+      // one.
+      const std::thread::id this_thread = std::this_thread::get_id();
+      const int last = idle_interpreters_.size() - 1;
+      int index = -1;
+      if (!input_shape.empty()) {
+        for (int i = last; i >= 0; --i) {
+          if (idle_interpreters_[i].input_shape == input_shape) {
+            index = i;
+            *allocated = true;
+            break;
+          }
+        }
+      }
+      for (int i = last; index < 0 && i >= 0; --i) {
+        if (idle_interpreters_[i].last_thread == this_thread) {
+          index = i;
+        }
+      }
+      if (index < 0) {
+        index = last;
+      }
+      std::unique_ptr<tflite::Interpreter> interpreter =
+          std::move(idle_interpreters_[index].interpreter);
+      idle_interpreters_.erase(idle_interpreters_.begin() + index);
+      return interpreter;
+    }
+  }
+
+  // Build the interpreter outside of the lock, this is the expensive part.
+  std::unique_ptr<tflite::Interpreter> interpreter =
+      executor_->CreateInterpreter();
+  if (!interpreter) {
+    TC3_LOG(ERROR) << "Could not build TFLite interpreter.";
+  }
+  return interpreter;
+}
+
+void TfLiteInterpreterPool::Release(
+    std::unique_ptr<tflite::Interpreter> interpreter) {
+  Release(std::move(interpreter), /*input_shape=*/{});
+}
+
+void TfLiteInterpreterPool::Release(
+    std::unique_ptr<tflite::Interpreter> interpreter,
+    const std::vector<int>& input_shape) {
+  if (interpreter == nullptr) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (max_idle_interpreters_ <= 0) {
+    return;
+  }
+  if (idle_interpreters_.size() >= max_idle_interpreters_) {
+    idle_interpreters_.erase(idle_interpreters_.begin());
+  }
+  idle_interpreters_.push_back(IdleInterpreter{
+      std::move(interpreter), std::this_thread::get_id(), input_shape});
+}
+
+void TfLiteInterpreterPool::SetMaxIdleInterpreters(int max_idle_interpreters) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  max_idle_interpreters_ = std::max(0, max_idle_interpreters);
+  if (idle_interpreters_.size() > max_idle_interpreters_) {
+    idle_interpreters_.erase(
+        idle_interpreters_.begin(),
+        idle_interpreters_.end() - max_idle_interpreters_);
+  }
+}
+
+int TfLiteInterpreterPool::MaxIdleInterpreters() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return max_idle_interpreters_;
+}
+
+int TfLiteInterpreterPool::NumIdleInterpreters() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return idle_interpreters_.size();
+}
+
+int64 TfLiteInterpreterPool::IdleTensorBytes() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  int64 num_bytes = 0;
+  for (const IdleInterpreter& idle_interpreter : idle_interpreters_) {
+    num_bytes += InterpreterTensorBytes(*idle_interpreter.interpreter);
+  }
+  return num_bytes;
+}
+
+int64 InterpreterTensorBytes(const tflite::Interpreter& interpreter) {
+  // The tensors of an arena share its memory, so an arena is measured by the
+  // range its tensors span rather than by the sum of their sizes.
+  const char* arena_begin[2] = {nullptr, nullptr};
+  const char* arena_end[2] = {nullptr, nullptr};
+  int64 dynamic_bytes = 0;
+  for (int i = 0; i < interpreter.tensors_size(); ++i) {
+    const TfLiteTensor* tensor = interpreter.tensor(i);
+    if (tensor == nullptr || tensor->data.raw == nullptr) {
+      continue;
+    }
+    int arena;
+    switch (tensor->allocation_type) {
+      case kTfLiteArenaRw:
+        arena = 0;
+        break;
+      case kTfLiteArenaRwPersistent:
+        arena = 1;
+        break;
+      case kTfLiteDynamic:
+        dynamic_bytes += tensor->bytes;
+        continue;
+      default:
+        continue;
+    }
+    const char* begin = tensor->data.raw;
+    const char* end = begin + tensor->bytes;
+    if (arena_begin[arena] == nullptr || begin < arena_begin[arena]) {
+      arena_begin[arena] = begin;
+    }
+    if (arena_end[arena] == nullptr || end > arena_end[arena]) {
+      arena_end[arena] = end;
+    }
+  }
+  return (arena_end[0] - arena_begin[0]) + (arena_end[1] - arena_begin[1]) +
+         dynamic_bytes;
+}
+
+}  // namespace libtextclassifier3
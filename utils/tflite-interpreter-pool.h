@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A pool of reusable TFLite interpreters for one model.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_TFLITE_INTERPRETER_POOL_H_
+#define LIBTEXTCLASSIFIER_UTILS_TFLITE_INTERPRETER_POOL_H_
+
+#include <memory>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+#include "utils/base/integral_types.h"
+#include "utils/tflite-model-executor.h"
+#include "tensorflow/lite/interpreter.h"
+
+namespace libtextclassifier3 {
+
+// Keeps idle interpreters (and thus their allocated tensor arenas) of a model
+// around, so that they don't need to be rebuilt for every request.
+// Interpreters are checked out with Acquire() and handed back with Release().
+// An interpreter is only ever used by one caller at a time.
+//
+// Released interpreters remember the thread that used them last, and Acquire()
+// prefers an interpreter last used by the calling thread (its memory is more
+// likely to still be in that core's caches).
+//
+// Callers that resize the input tensors can also tag an interpreter with the
+// input shape its tensors were allocated for. Acquiring with the same shape
+// then prefers such an interpreter, which can be used without resizing the
+// inputs and re-allocating the tensors.
+//
+// The class is thread-safe.
+class TfLiteInterpreterPool {
+ public:
+  static constexpr int kDefaultMaxIdleInterpreters = 4;
+
+  // Does not take ownership of the executor, which needs to outlive the pool.
+  explicit TfLiteInterpreterPool(
+      const TfLiteModelExecutor* executor,
+      int max_idle_interpreters = kDefaultMaxIdleInterpreters)
+      : executor_(executor), max_idle_interpreters_(max_idle_interpreters) {}
+
+  // Checks out an interpreter from the pool, or creates a new one if there is
+  // no idle interpreter. Returns nullptr if the interpreter couldn't be built.
+  std::unique_ptr<tflite::Interpreter> Acquire();
+
+  // Like Acquire(), but prefers an interpreter released with the same input
+  // shape. Sets `allocated` to whether the tensors of the returned interpreter
+  // are already allocated for the shape. An empty shape matches nothing.
+  std::unique_ptr<tflite::Interpreter> Acquire(
+      const std::vector<int>& input_shape, bool* allocated);
+
+  // Returns an interpreter obtained from Acquire() to the pool. If the pool
+  // already holds the maximum number of idle interpreters, the one released
+  // the longest time ago is destroyed.
+  void Release(std::unique_ptr<tflite::Interpreter> interpreter);
+
+  // Like Release(), but records the input shape the tensors of the
+  // interpreter are allocated for.
+  void Release(std::unique_ptr<tflite::Interpreter> interpreter,
+               const std::vector<int>& input_shape);
+
+  // Sets the maximum number of idle interpreters kept, dropping any extra ones.
+  // A size of 0 disables pooling.
+  void SetMaxIdleInterpreters(int max_idle_interpreters);
+
+  int MaxIdleInterpreters() const;
+
+  // Number of interpreters currently waiting in the pool.
+  int NumIdleInterpreters() const;
+
+  // Bytes of the allocated tensors of the idle interpreters: their arenas and
+  // dynamic tensors, not the weights read from the model.
+  int64 IdleTensorBytes() const;
+
+ private:
+  struct IdleInterpreter {
+    std::unique_ptr<tflite::Interpreter> interpreter;
+
+    // Thread that released the interpreter.
+    std::thread::id last_thread;
+
+    // Input shape the tensors are allocated for, empty if unknown.
+    std::vector<int> input_shape;
+  };
+
+  const TfLiteModelExecutor* const executor_;
+
+  mutable std::mutex mutex_;
+  int max_idle_interpreters_;
+  std::vector<IdleInterpreter> idle_interpreters_;
+};
+
+// Returns the bytes of the allocated tensors of the interpreter, see
+// TfLiteInterpreterPool::IdleTensorBytes().
+int64 InterpreterTensorBytes(const tflite::Interpreter& interpreter);
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_TFLITE_INTERPRETER_POOL_H_
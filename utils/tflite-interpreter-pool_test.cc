@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/tflite-interpreter-pool.h"
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "annotator/model_generated.h"
+#include "utils/tflite-model-executor.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+std::string GetModelPath() { return TC3_TEST_DATA_DIR; }
+
+std::string ReadFile(const std::string& file_name) {
+  std::ifstream file_stream(file_name);
+  return std::string(std::istreambuf_iterator<char>(file_stream), {});
+}
+
+class TfLiteInterpreterPoolTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    model_buffer_ = ReadFile(GetModelPath() + "test_model.fb");
+    const Model* model = GetModel(model_buffer_.data());
+    ASSERT_NE(model, nullptr);
+    executor_ = TfLiteModelExecutor::FromBuffer(model->selection_model());
+    ASSERT_NE(executor_, nullptr);
+  }
+
+  std::string model_buffer_;
+  std::unique_ptr<TfLiteModelExecutor> executor_;
+};
+
+TEST_F(TfLiteInterpreterPoolTest, ReusesReleasedInterpreter) {
+  TfLiteInterpreterPool pool(executor_.get());
+  std::unique_ptr<tflite::Interpreter> interpreter = pool.Acquire();
+  ASSERT_NE(interpreter, nullptr);
+  const tflite::Interpreter* interpreter_ptr = interpreter.get();
+
+  pool.Release(std::move(interpreter));
+  EXPECT_EQ(pool.NumIdleInterpreters(), 1);
+
+  interpreter = pool.Acquire();
+  EXPECT_EQ(interpreter.get(), interpreter_ptr);
+  EXPECT_EQ(pool.NumIdleInterpreters(), 0);
+}
+
+TEST_F(TfLiteInterpreterPoolTest, CountsTensorBytesOfIdleInterpreters) {
+  TfLiteInterpreterPool pool(executor_.get());
+  std::unique_ptr<tflite::Interpreter> interpreter = pool.Acquire();
+  ASSERT_NE(interpreter, nullptr);
+  ASSERT_EQ(interpreter->AllocateTensors(), kTfLiteOk);
+  const int64 tensor_bytes = InterpreterTensorBytes(*interpreter);
+  EXPECT_GT(tensor_bytes, 0);
+  EXPECT_EQ(pool.IdleTensorBytes(), 0);
+
+  pool.Release(std::move(interpreter));
+  EXPECT_EQ(pool.IdleTensorBytes(), tensor_bytes);
+
+  pool.SetMaxIdleInterpreters(0);
+  EXPECT_EQ(pool.IdleTensorBytes(), 0);
+}
+
+TEST_F(TfLiteInterpreterPoolTest, CreatesNewInterpreterWhenEmpty) {
+  TfLiteInterpreterPool pool(executor_.get());
+  std::unique_ptr<tflite::Interpreter> first = pool.Acquire();
+  std::unique_ptr<tflite::Interpreter> second = pool.Acquire();
+  ASSERT_NE(first, nullptr);
+  ASSERT_NE(second, nullptr);
+  EXPECT_NE(first.get(), second.get());
+}
+
+TEST_F(TfLiteInterpreterPoolTest, RespectsMaxIdleInterpreters) {
+  TfLiteInterpreterPool pool(executor_.get(), /*max_idle_interpreters=*/1);
+  std::unique_ptr<tflite::Interpreter> first = pool.Acquire();
+  std::unique_ptr<tflite::Interpreter> second = pool.Acquire();
+  pool.Release(std::move(first));
+  pool.Release(std::move(second));
+  EXPECT_EQ(pool.NumIdleInterpreters(), 1);
+
+  pool.SetMaxIdleInterpreters(0);
+  EXPECT_EQ(pool.MaxIdleInterpreters(), 0);
+  EXPECT_EQ(pool.NumIdleInterpreters(), 0);
+}
+
+TEST_F(TfLiteInterpreterPoolTest, PrefersInterpreterWithSameInputShape) {
+  TfLiteInterpreterPool pool(executor_.get());
+  std::unique_ptr<tflite::Interpreter> first = pool.Acquire();
+  std::unique_ptr<tflite::Interpreter> second = pool.Acquire();
+  const tflite::Interpreter* first_ptr = first.get();
+  const tflite::Interpreter* second_ptr = second.get();
+  pool.Release(std::move(first), {1, 2});
+  pool.Release(std::move(second), {3, 4});
+
+  bool allocated = false;
+  std::unique_ptr<tflite::Interpreter> interpreter =
+      pool.Acquire({1, 2}, &allocated);
+  EXPECT_EQ(interpreter.get(), first_ptr);
+  EXPECT_TRUE(allocated);
+
+  // Falls back to any idle interpreter, which needs to be re-allocated.
+  interpreter = pool.Acquire({5, 6}, &allocated);
+  EXPECT_EQ(interpreter.get(), second_ptr);
+  EXPECT_FALSE(allocated);
+}
+
+TEST_F(TfLiteInterpreterPoolTest, EvictsLeastRecentlyReleased) {
+  TfLiteInterpreterPool pool(executor_.get(), /*max_idle_interpreters=*/1);
+  std::unique_ptr<tflite::Interpreter> first = pool.Acquire();
+  std::unique_ptr<tflite::Interpreter> second = pool.Acquire();
+  const tflite::Interpreter* second_ptr = second.get();
+  pool.Release(std::move(first), {1});
+  pool.Release(std::move(second), {2});
+  EXPECT_EQ(pool.NumIdleInterpreters(), 1);
+
+  bool allocated = false;
+  EXPECT_EQ(pool.Acquire({2}, &allocated).get(), second_ptr);
+  EXPECT_TRUE(allocated);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -16,6 +16,8 @@
 
 #include "utils/tflite-model-executor.h"
 
+#include <mutex>  // NOLINT
+
 #include "utils/base/logging.h"
 #include "tensorflow/lite/kernels/register.h"
 
@@ -155,7 +157,31 @@ void RegisterSelectedOps(tflite::MutableOpResolver* resolver) {
 
 namespace libtextclassifier3 {
 
-inline std::unique_ptr<tflite::OpResolver> BuildOpResolver() {
+namespace {
+
+std::mutex* DefaultOptionsMutex() {
+  static std::mutex* mutex = new std::mutex;
+  return mutex;
+}
+
+TfLiteExecutorOptions* MutableDefaultOptions() {
+  static TfLiteExecutorOptions* options = new TfLiteExecutorOptions;
+  return options;
+}
+
+}  // namespace
+
+void SetDefaultTfLiteExecutorOptions(const TfLiteExecutorOptions& options) {
+  std::lock_guard<std::mutex> lock(*DefaultOptionsMutex());
+  *MutableDefaultOptions() = options;
+}
+
+TfLiteExecutorOptions DefaultTfLiteExecutorOptions() {
+  std::lock_guard<std::mutex> lock(*DefaultOptionsMutex());
+  return *MutableDefaultOptions();
+}
+
+std::unique_ptr<tflite::MutableOpResolver> BuildOpResolver() {
 #ifdef TC3_USE_SELECTIVE_REGISTRATION
   std::unique_ptr<tflite::MutableOpResolver> resolver(
       new tflite::MutableOpResolver);
@@ -172,7 +198,47 @@ inline std::unique_ptr<tflite::OpResolver> BuildOpResolver() {
   resolver->AddCustom("TokenEncoder",
                       tflite::ops::custom::Register_TOKEN_ENCODER());
 #endif  // TC3_WITH_ACTIONS_OPS
-  return std::unique_ptr<tflite::OpResolver>(std::move(resolver));
+  return std::unique_ptr<tflite::MutableOpResolver>(std::move(resolver));
+}
+
+std::shared_ptr<const tflite::OpResolver> SharedOpResolver() {
+  static const std::shared_ptr<const tflite::OpResolver>* resolver =
+      new std::shared_ptr<const tflite::OpResolver>(BuildOpResolver());
+  return *resolver;
+}
+
+std::unique_ptr<tflite::MutableOpResolver> BuildOpResolverForModel(
+    const tflite::Model* model_spec, const tflite::OpResolver& resolver) {
+  std::unique_ptr<tflite::MutableOpResolver> model_resolver(
+      new tflite::MutableOpResolver);
+  if (model_spec->operator_codes() == nullptr) {
+    return model_resolver;
+  }
+  for (const tflite::OperatorCode* op_code : *model_spec->operator_codes()) {
+    const int version = op_code->version();
+    if (op_code->builtin_code() == tflite::BuiltinOperator_CUSTOM) {
+      const char* name =
+          op_code->custom_code() ? op_code->custom_code()->c_str() : "";
+      const TfLiteRegistration* registration = resolver.FindOp(name, version);
+      if (registration == nullptr) {
+        TC3_LOG(ERROR) << "Unresolved custom op: " << name;
+        return nullptr;
+      }
+      model_resolver->AddCustom(name, registration, /*min_version=*/version,
+                                /*max_version=*/version);
+    } else {
+      const tflite::BuiltinOperator op = op_code->builtin_code();
+      const TfLiteRegistration* registration = resolver.FindOp(op, version);
+      if (registration == nullptr) {
+        TC3_LOG(ERROR) << "Unresolved builtin op: "
+                       << tflite::EnumNameBuiltinOperator(op);
+        return nullptr;
+      }
+      model_resolver->AddBuiltin(op, registration, /*min_version=*/version,
+                                 /*max_version=*/version);
+    }
+  }
+  return model_resolver;
 }
 
 std::unique_ptr<const tflite::FlatBufferModel> TfLiteModelFromModelSpec(
@@ -199,13 +265,30 @@ std::unique_ptr<const tflite::FlatBufferModel> TfLiteModelFromBuffer(
 }
 
 TfLiteModelExecutor::TfLiteModelExecutor(
-    std::unique_ptr<const tflite::FlatBufferModel> model)
-    : model_(std::move(model)), resolver_(BuildOpResolver()) {}
+    std::unique_ptr<const tflite::FlatBufferModel> model,
+    const TfLiteExecutorOptions& options)
+    : model_(std::move(model)),
+      resolver_(options.op_resolver != nullptr ? options.op_resolver
+                                               : SharedOpResolver()),
+      delegate_(options.delegate),
+      num_threads_(options.num_threads),
+      allow_fp16_(options.allow_fp16) {}
 
 std::unique_ptr<tflite::Interpreter> TfLiteModelExecutor::CreateInterpreter()
     const {
   std::unique_ptr<tflite::Interpreter> interpreter;
-  tflite::InterpreterBuilder(*model_, *resolver_)(&interpreter);
+  tflite::InterpreterBuilder(*model_, *resolver_)(&interpreter, num_threads_);
+  if (interpreter == nullptr) {
+    return nullptr;
+  }
+  // Needs to be set before applying the delegate, which reads it when taking
+  // over the graph.
+  interpreter->SetAllowFp16PrecisionForFp32(allow_fp16_);
+  if (delegate_ != nullptr &&
+      interpreter->ModifyGraphWithDelegate(delegate_) != kTfLiteOk) {
+    TC3_LOG(ERROR) << "Could not apply the TFLite delegate.";
+    return nullptr;
+  }
   return interpreter;
 }
 
@@ -221,6 +304,18 @@ void TfLiteModelExecutor::SetInput(const int input_index,
       interpreter->tensor(interpreter->inputs()[input_index]));
 }
 
+template <>
+void TfLiteModelExecutor::SetInput(const int input_index,
+                                   const std::vector<StringPiece>& input_data,
+                                   tflite::Interpreter* interpreter) const {
+  tflite::DynamicBuffer buf;
+  for (const StringPiece& s : input_data) {
+    buf.AddString(s.data(), s.length());
+  }
+  buf.WriteToTensorAsVector(
+      interpreter->tensor(interpreter->inputs()[input_index]));
+}
+
 template <>
 std::vector<tflite::StringRef> TfLiteModelExecutor::Output(
     const int output_index, const tflite::Interpreter* interpreter) const {
@@ -22,6 +22,7 @@
 #include <memory>
 
 #include "utils/base/logging.h"
+#include "utils/strings/stringpiece.h"
 #include "utils/tensor-view.h"
 #include "tensorflow/lite/interpreter.h"
 #include "tensorflow/lite/kernels/register.h"
@@ -31,39 +32,95 @@
 
 namespace libtextclassifier3 {
 
-std::unique_ptr<tflite::OpResolver> BuildOpResolver();
+// Returns a resolver with the builtin and custom ops used by our models.
+// Callers can register their own kernels on top, e.g. variants optimized for
+// the CPU features of the device, as later registrations of an op replace
+// earlier ones.
+std::unique_ptr<tflite::MutableOpResolver> BuildOpResolver();
+
+// Returns the resolver built by BuildOpResolver(), created once and shared by
+// all the executors of the process that aren't given their own.
+std::shared_ptr<const tflite::OpResolver> SharedOpResolver();
+
+// Returns a resolver with just the ops `model_spec` uses, taken from
+// `resolver`, or nullptr if `resolver` lacks one of them. Lets a process that
+// only loads a few models look up and hold only what they need.
+std::unique_ptr<tflite::MutableOpResolver> BuildOpResolverForModel(
+    const tflite::Model* model_spec, const tflite::OpResolver& resolver);
 std::unique_ptr<const tflite::FlatBufferModel> TfLiteModelFromModelSpec(
     const tflite::Model*);
 std::unique_ptr<const tflite::FlatBufferModel> TfLiteModelFromBuffer(
     const flatbuffers::Vector<uint8_t>*);
 
+// Options for building the interpreters of a model.
+struct TfLiteExecutorOptions {
+  // Resolver for the ops of the model, SharedOpResolver() if not set. Shared,
+  // so that one resolver can serve all the executors.
+  std::shared_ptr<const tflite::OpResolver> op_resolver;
+
+  // Delegate applied to every interpreter created, e.g. XNNPACK, NNAPI or GPU.
+  // Not owned, needs to outlive the executors and support being applied to
+  // several interpreters.
+  TfLiteDelegate* delegate = nullptr;
+
+  // Number of threads the interpreters may use to run ops, the TFLite default
+  // if not positive. Most of our models are small enough that one thread is
+  // best when several requests are served in parallel.
+  int num_threads = -1;
+
+  // Whether fp32 ops may be computed in fp16 where the kernels or the delegate
+  // support it, trading precision for speed.
+  bool allow_fp16 = false;
+};
+
+// Sets the options used by executors that are created without explicit
+// options, which is how the annotator and actions models are loaded. Meant to
+// be called once at startup, before loading any models; executors that
+// already exist are not affected.
+void SetDefaultTfLiteExecutorOptions(const TfLiteExecutorOptions& options);
+
+// Returns the options set with SetDefaultTfLiteExecutorOptions().
+TfLiteExecutorOptions DefaultTfLiteExecutorOptions();
+
 // Executor for the text selection prediction and classification models.
 class TfLiteModelExecutor {
  public:
   static std::unique_ptr<TfLiteModelExecutor> FromModelSpec(
-      const tflite::Model* model_spec) {
+      const tflite::Model* model_spec,
+      const TfLiteExecutorOptions& options = DefaultTfLiteExecutorOptions()) {
     auto model = TfLiteModelFromModelSpec(model_spec);
     if (!model) {
       return nullptr;
     }
     return std::unique_ptr<TfLiteModelExecutor>(
-        new TfLiteModelExecutor(std::move(model)));
+        new TfLiteModelExecutor(std::move(model), options));
   }
 
   static std::unique_ptr<TfLiteModelExecutor> FromBuffer(
-      const flatbuffers::Vector<uint8_t>* model_spec_buffer) {
+      const flatbuffers::Vector<uint8_t>* model_spec_buffer,
+      const TfLiteExecutorOptions& options = DefaultTfLiteExecutorOptions()) {
     auto model = TfLiteModelFromBuffer(model_spec_buffer);
     if (!model) {
       return nullptr;
     }
     return std::unique_ptr<TfLiteModelExecutor>(
-        new TfLiteModelExecutor(std::move(model)));
+        new TfLiteModelExecutor(std::move(model), options));
   }
 
   // Creates an Interpreter for the model that serves as a scratch-pad for the
-  // inference. The Interpreter is NOT thread-safe.
+  // inference. The Interpreter is NOT thread-safe. Returns nullptr if the
+  // delegate couldn't be applied.
   std::unique_ptr<tflite::Interpreter> CreateInterpreter() const;
 
+  // Returns the data of an input tensor, so that the input can be written in
+  // place instead of being copied in with SetInput. The tensors need to be
+  // allocated, and the pointer is only valid until they are allocated again.
+  template <typename T>
+  T* MutableInputData(const int input_index,
+                      tflite::Interpreter* interpreter) const {
+    return interpreter->typed_input_tensor<T>(input_index);
+  }
+
   template <typename T>
   void SetInput(const int input_index, const TensorView<T>& input_data,
                 tflite::Interpreter* interpreter) const {
@@ -116,9 +173,7 @@ class TfLiteModelExecutor {
     const TfLiteTensor* output_tensor =
         interpreter->tensor(interpreter->outputs()[output_index]);
     return TensorView<T>(interpreter->typed_output_tensor<T>(output_index),
-                         std::vector<int>(output_tensor->dims->data,
-                                          output_tensor->dims->data +
-                                              output_tensor->dims->size));
+                         output_tensor->dims->data, output_tensor->dims->size);
   }
 
   template <typename T>
@@ -130,11 +185,14 @@ class TfLiteModelExecutor {
   }
 
  protected:
-  explicit TfLiteModelExecutor(
-      std::unique_ptr<const tflite::FlatBufferModel> model);
+  TfLiteModelExecutor(std::unique_ptr<const tflite::FlatBufferModel> model,
+                      const TfLiteExecutorOptions& options);
 
   std::unique_ptr<const tflite::FlatBufferModel> model_;
-  std::unique_ptr<tflite::OpResolver> resolver_;
+  std::shared_ptr<const tflite::OpResolver> resolver_;
+  TfLiteDelegate* const delegate_;
+  const int num_threads_;
+  const bool allow_fp16_;
 };
 
 template <>
@@ -142,6 +200,11 @@ void TfLiteModelExecutor::SetInput(const int input_index,
                                    const std::vector<std::string>& input_data,
                                    tflite::Interpreter* interpreter) const;
 
+template <>
+void TfLiteModelExecutor::SetInput(const int input_index,
+                                   const std::vector<StringPiece>& input_data,
+                                   tflite::Interpreter* interpreter) const;
+
 template <>
 std::vector<tflite::StringRef> TfLiteModelExecutor::Output(
     const int output_index, const tflite::Interpreter* interpreter) const;
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/tflite-model-executor.h"
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "annotator/model_generated.h"
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+std::string GetModelPath() { return TC3_TEST_DATA_DIR; }
+
+std::string ReadFile(const std::string& file_name) {
+  std::ifstream file_stream(file_name);
+  return std::string(std::istreambuf_iterator<char>(file_stream), {});
+}
+
+class TfLiteModelExecutorTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    model_buffer_ = ReadFile(GetModelPath() + "test_model.fb");
+    model_ = GetModel(model_buffer_.data());
+    ASSERT_NE(model_, nullptr);
+  }
+
+  std::string model_buffer_;
+  const Model* model_ = nullptr;
+};
+
+TEST_F(TfLiteModelExecutorTest, UsesDefaultOpResolver) {
+  std::unique_ptr<TfLiteModelExecutor> executor =
+      TfLiteModelExecutor::FromBuffer(model_->selection_model());
+  ASSERT_NE(executor, nullptr);
+  EXPECT_NE(executor->CreateInterpreter(), nullptr);
+}
+
+TEST_F(TfLiteModelExecutorTest, UsesProvidedOpResolver) {
+  // A resolver without any ops can't build the interpreter.
+  TfLiteExecutorOptions options;
+  options.op_resolver.reset(new tflite::MutableOpResolver);
+  std::unique_ptr<TfLiteModelExecutor> executor =
+      TfLiteModelExecutor::FromBuffer(model_->selection_model(), options);
+  ASSERT_NE(executor, nullptr);
+  EXPECT_EQ(executor->CreateInterpreter(), nullptr);
+}
+
+TEST_F(TfLiteModelExecutorTest, SharesDefaultOpResolver) {
+  EXPECT_EQ(SharedOpResolver().get(), SharedOpResolver().get());
+}
+
+TEST_F(TfLiteModelExecutorTest, BuildsOpResolverForModel) {
+  const tflite::Model* model_spec =
+      flatbuffers::GetRoot<tflite::Model>(model_->selection_model()->data());
+  TfLiteExecutorOptions options;
+  options.op_resolver =
+      BuildOpResolverForModel(model_spec, *SharedOpResolver());
+  ASSERT_NE(options.op_resolver, nullptr);
+  std::unique_ptr<TfLiteModelExecutor> executor =
+      TfLiteModelExecutor::FromModelSpec(model_spec, options);
+  ASSERT_NE(executor, nullptr);
+  EXPECT_NE(executor->CreateInterpreter(), nullptr);
+
+  // Nothing can be taken from a resolver without any ops.
+  EXPECT_EQ(BuildOpResolverForModel(model_spec, tflite::MutableOpResolver()),
+            nullptr);
+}
+
+TEST_F(TfLiteModelExecutorTest, BuildsInterpreterWithThreadOptions) {
+  TfLiteExecutorOptions options;
+  options.num_threads = 1;
+  options.allow_fp16 = true;
+  std::unique_ptr<TfLiteModelExecutor> executor =
+      TfLiteModelExecutor::FromBuffer(model_->selection_model(), options);
+  ASSERT_NE(executor, nullptr);
+  EXPECT_NE(executor->CreateInterpreter(), nullptr);
+}
+
+TEST_F(TfLiteModelExecutorTest, UsesDefaultOptions) {
+  TfLiteExecutorOptions options;
+  options.op_resolver.reset(new tflite::MutableOpResolver);
+  SetDefaultTfLiteExecutorOptions(options);
+  std::unique_ptr<TfLiteModelExecutor> executor =
+      TfLiteModelExecutor::FromBuffer(model_->selection_model());
+  SetDefaultTfLiteExecutorOptions(TfLiteExecutorOptions());
+  ASSERT_NE(executor, nullptr);
+  EXPECT_EQ(executor->CreateInterpreter(), nullptr);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
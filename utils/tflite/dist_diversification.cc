@@ -24,34 +24,36 @@
 namespace libtextclassifier3 {
 namespace {
 
-// Returns a vector of row indices in a distance matrix.
+// Writes row indices of a distance matrix to `result` and returns their
+// number, at most `max_num_results`.
 // Indices are increasing and the distance of every selected index to others
 // is larger than `min_distance`.
+// The candidates are scanned greedily in order and the scan stops as soon as
+// enough indices were selected. Most candidates are rejected by their first
+// comparison, so this is typically much cheaper than the O(n * k) worst case.
 template <typename DistanceMatrixType>
-std::vector<int> DiversifyByDistance(const DistanceMatrixType& distance_matrix,
-                                     const int matrix_size,
-                                     const float min_distance,
-                                     const int max_num_results) {
-  std::vector<int> result{0};
-  result.reserve(max_num_results);
-  int index = 1;
-  while (result.size() < max_num_results && index < matrix_size) {
-    for (; index < matrix_size; ++index) {
-      bool too_close = false;
-      for (const int selected_index : result) {
-        if (distance_matrix(index, selected_index) < min_distance) {
-          too_close = true;
-          break;
-        }
-      }
-      if (!too_close) {
-        result.push_back(index);
-        ++index;
+int DiversifyByDistance(const DistanceMatrixType& distance_matrix,
+                        const int matrix_size, const float min_distance,
+                        const int max_num_results, int* result) {
+  if (matrix_size <= 0 || max_num_results <= 0) {
+    return 0;
+  }
+  result[0] = 0;
+  int num_results = 1;
+  for (int index = 1; num_results < max_num_results && index < matrix_size;
+       ++index) {
+    bool too_close = false;
+    for (int i = 0; i < num_results; ++i) {
+      if (distance_matrix(index, result[i]) < min_distance) {
+        too_close = true;
         break;
       }
     }
+    if (!too_close) {
+      result[num_results++] = index;
+    }
   }
-  return result;
+  return num_results;
 }
 
 // Input parameters for the op.
@@ -125,17 +127,18 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
       context
           ->tensors[node->inputs->data[DIST_DIVERSIFICATION_INPUT_NUM_RESULTS]]
           .data.i32[0];
-  const auto indices = DiversifyByDistance(
+  TF_LITE_ENSURE(context, num_results >= 0);
+  // The indices are written directly into the output tensor.
+  const int num_indices = DiversifyByDistance(
       [&](int row, int col) {
         return distance_matrix.data.f[row * distance_matrix_dim + col];
       },
-      distance_matrix_dim, min_distance, num_results);
-  std::copy(indices.begin(), indices.end(), output_indices.data.i32);
-  std::fill_n(output_indices.data.i32 + indices.size(),
-              num_results - indices.size(), -1);
+      distance_matrix_dim, min_distance, num_results, output_indices.data.i32);
+  std::fill_n(output_indices.data.i32 + num_indices, num_results - num_indices,
+              -1);
   TfLiteTensor& output_length =
       context->tensors[node->outputs->data[DIST_DIVERSIFICATION_OUTPUT_LENGTH]];
-  *output_length.data.i32 = indices.size();
+  *output_length.data.i32 = num_indices;
   return kTfLiteOk;
 }
 
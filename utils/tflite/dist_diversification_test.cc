@@ -78,5 +78,27 @@ TEST(DistanceDiversificationOp, Simple) {
   EXPECT_THAT(m.GetOutputIndexes(output_length), testing::ElementsAre(0, 3));
 }
 
+TEST(DistanceDiversificationOp, StopsAtNumResults) {
+  DistanceDiversificationOpModel m(5);
+  m.SetDistanceMatrix({0.0, 0.1, 0.2, 0.3, 0.4, 0.1, 0.0, 0.1, 0.2,
+                       0.3, 0.2, 0.1, 0.0, 0.1, 0.2, 0.3, 0.2, 0.1,
+                       0.0, 0.1, 0.4, 0.3, 0.2, 0.1, 0.0});
+  m.SetMinDistance(0.05);
+  m.SetNumOutput(2);
+  m.Invoke();
+  const int output_length = m.GetOutputLen();
+  EXPECT_EQ(output_length, 2);
+  EXPECT_THAT(m.GetOutputIndexes(output_length), testing::ElementsAre(0, 1));
+}
+
+TEST(DistanceDiversificationOp, NoResults) {
+  DistanceDiversificationOpModel m(2);
+  m.SetDistanceMatrix({0.0, 0.5, 0.5, 0.0});
+  m.SetMinDistance(0.1);
+  m.SetNumOutput(0);
+  m.Invoke();
+  EXPECT_EQ(m.GetOutputLen(), 0);
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
@@ -30,12 +30,34 @@ TfLiteIntArray* CreateIntArray(const std::initializer_list<int>& values) {
   return array_size;
 }
 
+int GetNumInputs(const TfLiteTensor& num_inputs, int row) {
+  return num_inputs.data.i32[tflite::NumElements(&num_inputs) == 1 ? 0 : row];
+}
+
+TfLiteStatus CheckNumInputs(const TfLiteTensor& num_inputs, int batch_size,
+                            int max_num_inputs, TfLiteContext* context) {
+  const int num_counts = tflite::NumElements(&num_inputs);
+  TF_LITE_ENSURE(context, num_counts == 1 || num_counts == batch_size);
+  for (int row = 0; row < batch_size; ++row) {
+    const int num_row_inputs = GetNumInputs(num_inputs, row);
+    TF_LITE_ENSURE(context, num_row_inputs >= 0);
+    TF_LITE_ENSURE(context, num_row_inputs <= max_num_inputs);
+  }
+  return kTfLiteOk;
+}
+
 TfLiteStatus CopyValuesToTensorAndPadOrTruncate(
     const TfLiteTensor& in, const std::vector<int>& encoding_end_offsets,
-    int start_offset, TfLiteContext* context, TfLiteTensor* out) {
+    int start_offset, int row, TfLiteContext* context, TfLiteTensor* out) {
   TF_LITE_ENSURE_EQ(context, in.dims->size, kEncoderInputRank);
-  TF_LITE_ENSURE_EQ(context, in.dims->data[0], kEncoderBatchSize);
+  TF_LITE_ENSURE_EQ(context, in.dims->data[0], out->dims->data[0]);
+  TF_LITE_ENSURE(context, row < in.dims->data[0]);
   const int output_size = out->dims->data[1];
+  const int in_row_offset = row * in.dims->data[1];
+  const int out_row_offset = row * output_size;
+  // Only one of the two is valid, depending on the attribute type.
+  int32_t* const out_i32 = out->data.i32 + out_row_offset;
+  float* const out_f = out->data.f + out_row_offset;
   int output_offset = 0;
   for (int value_index = 0;
        value_index < encoding_end_offsets.size() && output_offset < output_size;
@@ -54,14 +76,14 @@ TfLiteStatus CopyValuesToTensorAndPadOrTruncate(
 
     switch (in.type) {
       case kTfLiteInt32: {
-        std::fill(out->data.i32 + output_offset,
-                  out->data.i32 + output_offset + from_this_element,
-                  in.data.i32[value_index]);
+        std::fill(out_i32 + output_offset,
+                  out_i32 + output_offset + from_this_element,
+                  in.data.i32[in_row_offset + value_index]);
       } break;
       case kTfLiteFloat32: {
-        std::fill(out->data.f + output_offset,
-                  out->data.f + output_offset + from_this_element,
-                  in.data.f[value_index]);
+        std::fill(out_f + output_offset,
+                  out_f + output_offset + from_this_element,
+                  in.data.f[in_row_offset + value_index]);
       } break;
       default:
         context->ReportError(
@@ -74,14 +96,12 @@ TfLiteStatus CopyValuesToTensorAndPadOrTruncate(
   switch (in.type) {
     case kTfLiteInt32: {
       const int32_t value =
-          (output_offset > 0) ? out->data.i32[output_offset - 1] : 0;
-      std::fill(out->data.i32 + output_offset, out->data.i32 + output_size,
-                value);
+          (output_offset > 0) ? out_i32[output_offset - 1] : 0;
+      std::fill(out_i32 + output_offset, out_i32 + output_size, value);
     } break;
     case kTfLiteFloat32: {
-      const float value =
-          (output_offset > 0) ? out->data.f[output_offset - 1] : 0;
-      std::fill(out->data.f + output_offset, out->data.f + output_size, value);
+      const float value = (output_offset > 0) ? out_f[output_offset - 1] : 0;
+      std::fill(out_f + output_offset, out_f + output_size, value);
     } break;
     default:
       break;
@@ -89,23 +109,26 @@ TfLiteStatus CopyValuesToTensorAndPadOrTruncate(
   return kTfLiteOk;
 }
 
-TfLiteStatus ResizeOutputTensor(const int max_output_length,
+TfLiteStatus ResizeOutputTensor(const int batch_size,
+                                const int max_output_length,
                                 TfLiteTensor* tensor, TfLiteContext* context) {
   TF_LITE_ENSURE_OK(
-      context, context->ResizeTensor(
-                   context, tensor,
-                   CreateIntArray({kEncoderBatchSize, max_output_length})));
+      context,
+      context->ResizeTensor(context, tensor,
+                            CreateIntArray({batch_size, max_output_length})));
   return kTfLiteOk;
 }
 
 int CopyDataToTensorAndPadOrTruncate(const int32_t max_output_length,
                                      const std::vector<int32_t>& data,
                                      const int32_t padding_value,
+                                     const int row,
                                      TfLiteTensor* output_tensor) {
   const int num_skip =
       std::max(0, static_cast<int>(data.size()) - max_output_length);
   int output_offset = 0;
-  int32_t* output_buffer = output_tensor->data.i32;
+  int32_t* output_buffer =
+      output_tensor->data.i32 + row * output_tensor->dims->data[1];
   for (int i = num_skip; i < data.size(); ++i, ++output_offset) {
     output_buffer[output_offset] = data[i];
   }
@@ -27,15 +27,22 @@
 namespace libtextclassifier3 {
 
 // Input rank for the encoder ops is 2, because the first dimension is
-// always considered to be for batching, and during inference is always set to
-// 1, and the second dimension indexes the input values (texts or token
-// lengths).
+// always considered to be for batching, e.g. one conversation per row, and the
+// second dimension indexes the input values (texts or token lengths).
 constexpr const int kEncoderInputRank = 2;
-constexpr const int kEncoderBatchSize = 1;
 
 // Creates a TensorFlow Lite array from an initializer list.
 TfLiteIntArray* CreateIntArray(const std::initializer_list<int>& values);
 
+// Returns the number of inputs in a row of the batch. The num inputs tensor
+// holds either a single count for all the rows or one count per row.
+int GetNumInputs(const TfLiteTensor& num_inputs, int row);
+
+// Checks that the num inputs tensor has a valid count for each of the
+// batch_size rows, of at most max_num_inputs each.
+TfLiteStatus CheckNumInputs(const TfLiteTensor& num_inputs, int batch_size,
+                            int max_num_inputs, TfLiteContext* context);
+
 // Copies values associated with the input to the output.
 // Typically we have attribute values associated with each item in the input,
 // e.g. user id per message in the conversation.
@@ -44,15 +51,17 @@ TfLiteIntArray* CreateIntArray(const std::initializer_list<int>& values);
 // As the input for the whole conversation is concatenated and (potentially)
 // trimmed, `encoding_end_offset` indicates where each item ends and
 // `start_offset` indicates how many elements at the beginning were dropped.
+// Only the given `row` of the batch is read and written.
 TfLiteStatus CopyValuesToTensorAndPadOrTruncate(
     const TfLiteTensor& in, const std::vector<int>& encoding_end_offsets,
-    int start_offset, TfLiteContext* context, TfLiteTensor* out);
+    int start_offset, int row, TfLiteContext* context, TfLiteTensor* out);
 
-// Resizes an output tensor to shape {kBatchSize, max_output_length}.
-TfLiteStatus ResizeOutputTensor(const int max_output_length,
+// Resizes an output tensor to shape {batch_size, max_output_length}.
+TfLiteStatus ResizeOutputTensor(const int batch_size,
+                                const int max_output_length,
                                 TfLiteTensor* tensor, TfLiteContext* context);
 
-// Copy a slice of data to output.
+// Copy a slice of data to the given `row` of the output.
 // If the size of the data is smaller than `max_output_length` then the output
 // is padded with `padding_value`.
 // If the size of the data is larger than `max_output_length` then entries at
@@ -60,6 +69,7 @@ TfLiteStatus ResizeOutputTensor(const int max_output_length,
 int CopyDataToTensorAndPadOrTruncate(const int32_t max_output_length,
                                      const std::vector<int32_t>& data,
                                      const int32_t padding_value,
+                                     const int row,
                                      TfLiteTensor* output_tensor);
 
 }  // namespace libtextclassifier3
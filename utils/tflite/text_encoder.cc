@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -23,6 +24,7 @@
 #include "utils/sentencepiece/normalizer.h"
 #include "utils/sentencepiece/sorted_strings_table.h"
 #include "utils/strings/stringpiece.h"
+#include "utils/thread-pool.h"
 #include "utils/tflite/encoder_common.h"
 #include "utils/tflite/text_encoder.h"
 #include "utils/tflite/text_encoder_config_generated.h"
@@ -39,13 +41,30 @@ struct TextEncoderOp {
   std::unique_ptr<SentencePieceNormalizer> normalizer;
   std::unique_ptr<Encoder> encoder;
   std::unique_ptr<SentencePieceMatcher> matcher;
+
+  // Kept across invocations, as the op is run for every actions request.
+  Encoder::Scratch encoder_scratch;
+  std::string normalized;
+
+  // Encoding of each input string, indexed like the input tensor.
+  std::vector<std::vector<int>> encoded;
+
+  // End offset of the encoding of each message in a row.
+  std::vector<int> encoded_offsets;
+
+  // Workers for encoding the strings in parallel, only set up if the
+  // interpreter is configured to use more than one thread.
+  std::unique_ptr<ThreadPool> thread_pool;
 };
 
 // Input parameters for the op.
-// The conversation message as a (1, conversation length) string tensor.
+// The conversation messages as a (batch size, conversation length) string
+// tensor.
 constexpr const int kInputTexts = 0;
 
-// The number of messages, the conversation length, int scalar.
+// The number of messages, the conversation length, either an int scalar that
+// applies to all the rows or a (batch size) int tensor with one length per
+// row.
 constexpr const int kInputNumInputs = 1;
 
 // Maximum output length of the encoding, int scalar.
@@ -56,15 +75,16 @@ constexpr const int kInputMaxLength = 2;
 constexpr const int kInputAttr = 3;
 
 // Output parameters for the op.
-// The text sentence piece encodings as ids, (1, max output length) int tensor.
+// The text sentence piece encodings as ids,
+// (batch size, max output length) int tensor.
 constexpr const int kOutputEncoded = 0;
 
 // Relative position of each sentence piece in the input text,
-// (1, max output length) int tensor.
+// (batch size, max output length) int tensor.
 constexpr const int kOutputPosition = 1;
 
 // Output length after trimming to the maximum output length specified.
-// int scalar.
+// (batch size) int tensor.
 constexpr const int kOutputLengths = 2;
 
 // Padded and sentence piece aligned provided attributes, e.g. user id per
@@ -134,17 +154,17 @@ void Free(TfLiteContext* context, void* buffer) {
 }
 
 TfLiteStatus ResizeOutputTensors(TfLiteContext* context, TfLiteNode* node,
-                                 int max_output_length) {
+                                 int batch_size, int max_output_length) {
   TF_LITE_ENSURE_OK(
       context,
-      ResizeOutputTensor(max_output_length,
+      ResizeOutputTensor(batch_size, max_output_length,
                          &context->tensors[node->outputs->data[kOutputEncoded]],
                          context));
 
   TF_LITE_ENSURE_OK(
       context,
       ResizeOutputTensor(
-          max_output_length,
+          batch_size, max_output_length,
           &context->tensors[node->outputs->data[kOutputPosition]], context));
 
   const int num_output_attrs = node->outputs->size - kOutputAttr;
@@ -152,18 +172,32 @@ TfLiteStatus ResizeOutputTensors(TfLiteContext* context, TfLiteNode* node,
     TF_LITE_ENSURE_OK(
         context,
         ResizeOutputTensor(
-            max_output_length,
+            batch_size, max_output_length,
             &context->tensors[node->outputs->data[kOutputAttr + i]], context));
   }
   return kTfLiteOk;
 }
 
 TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
-  // Check that the batch dimension is kBatchSize.
+  if (node->user_data == nullptr) {
+    return kTfLiteError;
+  }
+  TextEncoderOp* encoder_op = reinterpret_cast<TextEncoderOp*>(node->user_data);
   const TfLiteTensor& input_text =
       context->tensors[node->inputs->data[kInputTexts]];
   TF_LITE_ENSURE_EQ(context, input_text.dims->size, kEncoderInputRank);
-  TF_LITE_ENSURE_EQ(context, input_text.dims->data[0], kEncoderBatchSize);
+  const int batch_size = input_text.dims->data[0];
+  TF_LITE_ENSURE(context, batch_size > 0);
+
+  // Spread the strings over the threads the interpreter was configured with,
+  // the calling thread being one of them.
+  const int num_workers = context->recommended_num_threads - 1;
+  if (num_workers <= 0 || batch_size * input_text.dims->data[1] < 2) {
+    encoder_op->thread_pool.reset();
+  } else if (encoder_op->thread_pool == nullptr ||
+             encoder_op->thread_pool->NumThreads() != num_workers) {
+    encoder_op->thread_pool.reset(new ThreadPool(num_workers));
+  }
 
   TfLiteTensor& output_lengths =
       context->tensors[node->outputs->data[kOutputLengths]];
@@ -174,7 +208,7 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
 
   TF_LITE_ENSURE_OK(context,
                     context->ResizeTensor(context, &output_lengths,
-                                          CreateIntArray({kEncoderBatchSize})));
+                                          CreateIntArray({batch_size})));
 
   // Check that there are enough outputs for attributes.
   const int num_output_attrs = node->outputs->size - kOutputAttr;
@@ -183,6 +217,8 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   // Copy attribute types from input to output tensors.
   for (int i = 0; i < num_output_attrs; ++i) {
     TfLiteTensor& input = context->tensors[node->inputs->data[kInputAttr + i]];
+    TF_LITE_ENSURE_EQ(context, input.dims->size, kEncoderInputRank);
+    TF_LITE_ENSURE_EQ(context, input.dims->data[0], batch_size);
     TfLiteTensor& output =
         context->tensors[node->outputs->data[kOutputAttr + i]];
     output.type = input.type;
@@ -192,7 +228,8 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
       context->tensors[node->inputs->data[kInputMaxLength]];
 
   if (tflite::IsConstantTensor(&output_length)) {
-    return ResizeOutputTensors(context, node, output_length.data.i64[0]);
+    return ResizeOutputTensors(context, node, batch_size,
+                               output_length.data.i64[0]);
   } else {
     tflite::SetTensorToDynamic(&output_encoded);
     tflite::SetTensorToDynamic(&output_positions);
@@ -206,73 +243,141 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   return kTfLiteOk;
 }
 
+// Normalizes and encodes the input strings [begin, end) that are part of the
+// conversation of their row.
+bool EncodeStrings(const TextEncoderOp* encoder_op,
+                   const TfLiteTensor& input_text,
+                   const TfLiteTensor& num_inputs, int begin, int end,
+                   std::string* normalized, Encoder::Scratch* scratch,
+                   std::vector<std::vector<int>>* encoded) {
+  const int max_num_inputs = input_text.dims->data[1];
+  for (int i = begin; i < end; ++i) {
+    std::vector<int>& encoded_string = (*encoded)[i];
+    encoded_string.clear();
+    if (i % max_num_inputs >= GetNumInputs(num_inputs, i / max_num_inputs)) {
+      continue;
+    }
+    const auto& strref = tflite::GetString(&input_text, i);
+    normalized->clear();
+    if (!encoder_op->normalizer->Normalize(StringPiece(strref.str, strref.len),
+                                           normalized) ||
+        !encoder_op->encoder->Encode(*normalized, scratch, &encoded_string)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   if (node->user_data == nullptr) {
     return kTfLiteError;
   }
-  const TextEncoderOp* encoder_op =
-      reinterpret_cast<TextEncoderOp*>(node->user_data);
+  TextEncoderOp* encoder_op = reinterpret_cast<TextEncoderOp*>(node->user_data);
   const TfLiteTensor& input_text =
       context->tensors[node->inputs->data[kInputTexts]];
+  const int batch_size = input_text.dims->data[0];
+  const int max_num_inputs = input_text.dims->data[1];
   const int num_strings = tflite::GetStringCount(&input_text);
+  TF_LITE_ENSURE_EQ(context, num_strings, batch_size * max_num_inputs);
   // Check that the number of strings matches the length parameter.
-  const int num_strings_param =
-      context->tensors[node->inputs->data[kInputNumInputs]].data.i32[0];
-  TF_LITE_ENSURE_EQ(context, num_strings, num_strings_param);
+  const TfLiteTensor& num_inputs =
+      context->tensors[node->inputs->data[kInputNumInputs]];
+  TF_LITE_ENSURE_OK(context, CheckNumInputs(num_inputs, batch_size,
+                                            max_num_inputs, context));
 
   TfLiteTensor& output_encoded =
       context->tensors[node->outputs->data[kOutputEncoded]];
   if (tflite::IsDynamicTensor(&output_encoded)) {
     const TfLiteTensor& output_length =
         context->tensors[node->inputs->data[kInputMaxLength]];
-    TF_LITE_ENSURE_OK(
-        context, ResizeOutputTensors(context, node, output_length.data.i64[0]));
+    TF_LITE_ENSURE_OK(context,
+                      ResizeOutputTensors(context, node, batch_size,
+                                          output_length.data.i64[0]));
   }
   TfLiteTensor& output_positions =
       context->tensors[node->outputs->data[kOutputPosition]];
-
-  std::vector<int> encoded_total;
-  std::vector<int> encoded_offsets;
-  std::vector<int> encoded_positions;
-  encoded_offsets.reserve(num_strings);
-  const int max_output_length = output_encoded.dims->data[1];
-  const int max_encoded_position = max_output_length;
-
-  for (int i = 0; i < num_strings; ++i) {
-    const auto& strref = tflite::GetString(&input_text, i);
-    std::string normalized;
-    TF_LITE_ENSURE(context,
-                   encoder_op->normalizer->Normalize(
-                       StringPiece(strref.str, strref.len), &normalized));
-    std::vector<int> encoded;
-    TF_LITE_ENSURE(context, encoder_op->encoder->Encode(normalized, &encoded));
-    encoded_total.insert(encoded_total.end(), encoded.begin(), encoded.end());
-    encoded_offsets.push_back(encoded_total.size());
-    for (int i = 0; i < encoded.size(); i++) {
-      encoded_positions.push_back(std::min(i, max_encoded_position - 1));
-    }
-  }
-
-  const int num_skip = CopyDataToTensorAndPadOrTruncate(
-      max_output_length, encoded_total,
-      /*padding_value=*/encoded_total.back(), &output_encoded);
   TfLiteTensor& output_lengths =
       context->tensors[node->outputs->data[kOutputLengths]];
-  output_lengths.data.i32[0] = encoded_total.size() - num_skip;
-  CopyDataToTensorAndPadOrTruncate(max_output_length, encoded_positions,
-                                   /*padding_value=*/max_encoded_position,
-                                   &output_positions);
 
-  // Process attributes, all checks of sizes and types are done in Prepare.
+  // Encode all the strings first, the rows are assembled afterwards.
+  std::vector<std::vector<int>>& encoded = encoder_op->encoded;
+  encoded.resize(num_strings);
+  bool encoded_all;
+  if (encoder_op->thread_pool == nullptr) {
+    encoded_all = EncodeStrings(encoder_op, input_text, num_inputs,
+                                /*begin=*/0, /*end=*/num_strings,
+                                &encoder_op->normalized,
+                                &encoder_op->encoder_scratch, &encoded);
+  } else {
+    encoded_all = RunInBatches(
+        num_strings, encoder_op->thread_pool.get(),
+        [encoder_op, &input_text, &num_inputs, &encoded](int begin, int end) {
+          std::string normalized;
+          Encoder::Scratch scratch;
+          return EncodeStrings(encoder_op, input_text, num_inputs, begin, end,
+                               &normalized, &scratch, &encoded);
+        });
+  }
+  TF_LITE_ENSURE(context, encoded_all);
+
+  std::vector<int>& encoded_offsets = encoder_op->encoded_offsets;
+  const int max_output_length = output_encoded.dims->data[1];
+  const int max_encoded_position = max_output_length;
   const int num_output_attrs = node->outputs->size - kOutputAttr;
   TF_LITE_ENSURE_EQ(context, node->inputs->size - kInputAttr, num_output_attrs);
-  for (int i = 0; i < num_output_attrs; ++i) {
-    TfLiteStatus attr_status = CopyValuesToTensorAndPadOrTruncate(
-        context->tensors[node->inputs->data[kInputAttr + i]], encoded_offsets,
-        num_skip, context,
-        &context->tensors[node->outputs->data[kOutputAttr + i]]);
-    if (attr_status != kTfLiteOk) {
-      return attr_status;
+
+  // Each row is padded or truncated on its own. The encodings are written
+  // directly into the output tensors, dropping entries at the beginning of a
+  // row if it doesn't fit.
+  for (int row = 0; row < batch_size; ++row) {
+    const std::vector<int>* row_encoded = &encoded[row * max_num_inputs];
+    const int num_row_inputs = GetNumInputs(num_inputs, row);
+    encoded_offsets.clear();
+    int num_encoded = 0;
+    for (int i = 0; i < num_row_inputs; ++i) {
+      num_encoded += row_encoded[i].size();
+      encoded_offsets.push_back(num_encoded);
+    }
+    const int num_skip = std::max(0, num_encoded - max_output_length);
+
+    int32_t* output_row_encoded =
+        output_encoded.data.i32 + row * max_output_length;
+    int32_t* output_row_positions =
+        output_positions.data.i32 + row * max_output_length;
+    int num_output = 0;
+    int num_to_skip = num_skip;
+    for (int i = 0; i < num_row_inputs; ++i) {
+      const std::vector<int>& encoded_string = row_encoded[i];
+      const int num_string_skip =
+          std::min<int>(num_to_skip, encoded_string.size());
+      num_to_skip -= num_string_skip;
+      for (int k = num_string_skip; k < encoded_string.size();
+           ++k, ++num_output) {
+        output_row_encoded[num_output] = encoded_string[k];
+        output_row_positions[num_output] =
+            std::min(k, max_encoded_position - 1);
+      }
+    }
+    output_lengths.data.i32[row] = num_output;
+
+    // Pad with the last encoded value, rows without any message are padded
+    // with zeros.
+    const int32_t padding_value =
+        num_output > 0 ? output_row_encoded[num_output - 1] : 0;
+    std::fill(output_row_encoded + num_output,
+              output_row_encoded + max_output_length, padding_value);
+    std::fill(output_row_positions + num_output,
+              output_row_positions + max_output_length, max_encoded_position);
+
+    // Process attributes, all checks of sizes and types are done in Prepare.
+    for (int i = 0; i < num_output_attrs; ++i) {
+      TfLiteStatus attr_status = CopyValuesToTensorAndPadOrTruncate(
+          context->tensors[node->inputs->data[kInputAttr + i]],
+          encoded_offsets, num_skip, row, context,
+          &context->tensors[node->outputs->data[kOutputAttr + i]]);
+      if (attr_status != kTfLiteOk) {
+        return attr_status;
+      }
     }
   }
 
@@ -43,6 +43,11 @@ class TextEncoderOpModel : public tflite::SingleOpModel {
     PopulateStringTensor(input_string_, strings);
     PopulateTensor(input_length_, {static_cast<int32_t>(strings.size())});
   }
+  void SetInputText(const std::initializer_list<string>& strings,
+                    int num_inputs) {
+    PopulateStringTensor(input_string_, strings);
+    PopulateTensor(input_length_, {num_inputs});
+  }
   void SetMaxOutputLength(int length) {
     PopulateTensor(input_output_maxlength_, {length});
   }
@@ -66,6 +71,9 @@ class TextEncoderOpModel : public tflite::SingleOpModel {
     return ExtractVector<float>(output_attributes_float_);
   }
   int GetEncodedLength() { return ExtractVector<int>(output_length_)[0]; }
+  std::vector<int> GetEncodedLengths() {
+    return ExtractVector<int>(output_length_);
+  }
 
  private:
   int input_string_;
@@ -172,5 +180,26 @@ TEST(TextEncoderTest, LongStrings) {
       testing::ElementsAre(4.f, 4.f, 3.f, 3.f, 3.f, 3.f, 2.f, 2.f, 2.f));
 }
 
+TEST(TextEncoderTest, Batch) {
+  TextEncoderOpModel m({2, 2}, {2, 2});
+  m.SetInt32Attribute({1, 2, 3, 4});
+  m.SetFloatAttribute({5.f, 4.f, 3.f, 2.f});
+  m.SetInputText({"Hello", "Hi", "Bye", "Hi"}, /*num_inputs=*/2);
+  m.SetMaxOutputLength(10);
+
+  m.Invoke();
+
+  EXPECT_THAT(m.GetEncodedLengths(), testing::ElementsAre(8, 7));
+  EXPECT_THAT(m.GetOutputEncoding(),
+              testing::ElementsAre(1, 90, 547, 58, 2, 1, 862, 2, 2, 2,  //
+                                   1, 1919, 19, 2, 1, 862, 2, 2, 2, 2));
+  EXPECT_THAT(m.GetOutputPositions(),
+              testing::ElementsAre(0, 1, 2, 3, 4, 0, 1, 2, 10, 10,  //
+                                   0, 1, 2, 3, 0, 1, 2, 10, 10, 10));
+  EXPECT_THAT(m.GetOutputAttributeInt32(),
+              testing::ElementsAre(1, 1, 1, 1, 1, 2, 2, 2, 2, 2,  //
+                                   3, 3, 3, 3, 4, 4, 4, 4, 4, 4));
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
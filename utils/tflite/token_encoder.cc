@@ -26,10 +26,13 @@ namespace libtextclassifier3 {
 namespace {
 
 // Input parameters for the op.
-// The number of tokens per message as (1, conversation length) int tensor.
+// The number of tokens per message as (batch size, conversation length) int
+// tensor.
 constexpr const int kInputNumTokens = 0;
 
-// The number of messages, the conversation length, int scalar.
+// The number of messages, the conversation length, either an int scalar that
+// applies to all the rows or a (batch size) int tensor with one length per
+// row.
 constexpr const int kInputNumInputs = 1;
 
 // Maximum output length of the encoding, int scalar.
@@ -41,11 +44,11 @@ constexpr const int kInputAttr = 3;
 
 // Output parameters for the op.
 // Relative position of each token in the input text,
-// (1, max output length) int tensor.
+// (batch size, max output length) int tensor.
 constexpr const int kOutputPosition = 0;
 
 // Output length after trimming to the maximum output length specified.
-// int scalar.
+// (batch size) int tensor.
 constexpr const int kOutputLengths = 1;
 
 // Padded and sentence piece aligned provided attributes, e.g. user id per
@@ -53,11 +56,11 @@ constexpr const int kOutputLengths = 1;
 constexpr const int kOutputAttr = 2;
 
 TfLiteStatus ResizeOutputTensors(TfLiteContext* context, TfLiteNode* node,
-                                 int max_output_length) {
+                                 int batch_size, int max_output_length) {
   TF_LITE_ENSURE_OK(
       context,
       ResizeOutputTensor(
-          max_output_length,
+          batch_size, max_output_length,
           &context->tensors[node->outputs->data[kOutputPosition]], context));
 
   const int num_output_attrs = node->outputs->size - kOutputAttr;
@@ -65,18 +68,18 @@ TfLiteStatus ResizeOutputTensors(TfLiteContext* context, TfLiteNode* node,
     TF_LITE_ENSURE_OK(
         context,
         ResizeOutputTensor(
-            max_output_length,
+            batch_size, max_output_length,
             &context->tensors[node->outputs->data[kOutputAttr + i]], context));
   }
   return kTfLiteOk;
 }
 
 TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
-  // Check that the batch dimension is kBatchSize.
   const TfLiteTensor& num_tokens =
       context->tensors[node->inputs->data[kInputNumTokens]];
   TF_LITE_ENSURE_EQ(context, num_tokens.dims->size, kEncoderInputRank);
-  TF_LITE_ENSURE_EQ(context, num_tokens.dims->data[0], kEncoderBatchSize);
+  const int batch_size = num_tokens.dims->data[0];
+  TF_LITE_ENSURE(context, batch_size > 0);
 
   TfLiteTensor& output_lengths =
       context->tensors[node->outputs->data[kOutputLengths]];
@@ -85,7 +88,7 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
 
   TF_LITE_ENSURE_OK(context,
                     context->ResizeTensor(context, &output_lengths,
-                                          CreateIntArray({kEncoderBatchSize})));
+                                          CreateIntArray({batch_size})));
 
   // Check that there are enough outputs for attributes.
   const int num_output_attrs = node->outputs->size - kOutputAttr;
@@ -94,6 +97,8 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   // Copy attribute types from input to output tensors.
   for (int i = 0; i < num_output_attrs; ++i) {
     TfLiteTensor& input = context->tensors[node->inputs->data[kInputAttr + i]];
+    TF_LITE_ENSURE_EQ(context, input.dims->size, kEncoderInputRank);
+    TF_LITE_ENSURE_EQ(context, input.dims->data[0], batch_size);
     TfLiteTensor& output =
         context->tensors[node->outputs->data[kOutputAttr + i]];
     output.type = input.type;
@@ -103,7 +108,8 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
       context->tensors[node->inputs->data[kInputMaxLength]];
 
   if (tflite::IsConstantTensor(&output_length)) {
-    return ResizeOutputTensors(context, node, output_length.data.i64[0]);
+    return ResizeOutputTensors(context, node, batch_size,
+                               output_length.data.i64[0]);
   } else {
     tflite::SetTensorToDynamic(&output_positions);
     for (int i = 0; i < num_output_attrs; ++i) {
@@ -119,52 +125,64 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
 TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
   const TfLiteTensor& num_tokens =
       context->tensors[node->inputs->data[kInputNumTokens]];
-  const int num_inputs =
-      context->tensors[node->inputs->data[kInputNumInputs]].data.i32[0];
+  const int batch_size = num_tokens.dims->data[0];
+  const int max_num_inputs = num_tokens.dims->data[1];
+  const TfLiteTensor& num_inputs =
+      context->tensors[node->inputs->data[kInputNumInputs]];
+  TF_LITE_ENSURE_OK(context, CheckNumInputs(num_inputs, batch_size,
+                                            max_num_inputs, context));
 
   const TfLiteTensor& output_length =
       context->tensors[node->inputs->data[kInputMaxLength]];
   TfLiteTensor& output_positions =
       context->tensors[node->outputs->data[kOutputPosition]];
   if (!tflite::IsConstantTensor(&output_length)) {
-    TF_LITE_ENSURE_OK(
-        context, ResizeOutputTensors(context, node, output_length.data.i64[0]));
+    TF_LITE_ENSURE_OK(context,
+                      ResizeOutputTensors(context, node, batch_size,
+                                          output_length.data.i64[0]));
   }
+  TfLiteTensor& output_lengths =
+      context->tensors[node->outputs->data[kOutputLengths]];
 
   std::vector<int> encoded_offsets;
   std::vector<int> encoded_positions;
-  encoded_offsets.reserve(num_inputs);
+  encoded_offsets.reserve(max_num_inputs);
   const int max_output_length = output_positions.dims->data[1];
   const int max_encoded_position = max_output_length;
-  int total_tokens = 0;
-
-  for (int i = 0; i < num_inputs; ++i) {
-    const int num_message_tokens =
-        num_tokens.data.i32[i] + 2; /* num_tokens + start and end token. */
-    total_tokens += num_message_tokens;
-    encoded_offsets.push_back(total_tokens);
-    for (int k = 0; k < num_message_tokens; k++) {
-      encoded_positions.push_back(std::min(k, max_encoded_position - 1));
+  const int num_output_attrs = node->outputs->size - kOutputAttr;
+  TF_LITE_ENSURE_EQ(context, node->inputs->size - kInputAttr, num_output_attrs);
+
+  // Each row is encoded independently, and padded or truncated on its own.
+  for (int row = 0; row < batch_size; ++row) {
+    encoded_offsets.clear();
+    encoded_positions.clear();
+    const int* row_num_tokens = num_tokens.data.i32 + row * max_num_inputs;
+    const int num_row_inputs = GetNumInputs(num_inputs, row);
+    int total_tokens = 0;
+    for (int i = 0; i < num_row_inputs; ++i) {
+      const int num_message_tokens =
+          row_num_tokens[i] + 2; /* num_tokens + start and end token. */
+      total_tokens += num_message_tokens;
+      encoded_offsets.push_back(total_tokens);
+      for (int k = 0; k < num_message_tokens; k++) {
+        encoded_positions.push_back(std::min(k, max_encoded_position - 1));
+      }
     }
-  }
 
-  const int num_skip = CopyDataToTensorAndPadOrTruncate(
-      max_output_length, encoded_positions,
-      /*padding_value=*/max_encoded_position, &output_positions);
-  TfLiteTensor& output_lengths =
-      context->tensors[node->outputs->data[kOutputLengths]];
-  output_lengths.data.i32[0] = encoded_positions.size() - num_skip;
+    const int num_skip = CopyDataToTensorAndPadOrTruncate(
+        max_output_length, encoded_positions,
+        /*padding_value=*/max_encoded_position, row, &output_positions);
+    output_lengths.data.i32[row] = encoded_positions.size() - num_skip;
 
-  // Process attributes, all checks of sizes and types are done in Prepare.
-  const int num_output_attrs = node->outputs->size - kOutputAttr;
-  TF_LITE_ENSURE_EQ(context, node->inputs->size - kInputAttr, num_output_attrs);
-  for (int i = 0; i < num_output_attrs; ++i) {
-    TfLiteStatus attr_status = CopyValuesToTensorAndPadOrTruncate(
-        context->tensors[node->inputs->data[kInputAttr + i]], encoded_offsets,
-        num_skip, context,
-        &context->tensors[node->outputs->data[kOutputAttr + i]]);
-    if (attr_status != kTfLiteOk) {
-      return attr_status;
+    // Process attributes, all checks of sizes and types are done in Prepare.
+    for (int i = 0; i < num_output_attrs; ++i) {
+      TfLiteStatus attr_status = CopyValuesToTensorAndPadOrTruncate(
+          context->tensors[node->inputs->data[kInputAttr + i]],
+          encoded_offsets, num_skip, row, context,
+          &context->tensors[node->outputs->data[kOutputAttr + i]]);
+      if (attr_status != kTfLiteOk) {
+        return attr_status;
+      }
     }
   }
 
@@ -30,11 +30,17 @@ namespace {
 class TokenEncoderOpModel : public tflite::SingleOpModel {
  public:
   TokenEncoderOpModel(std::initializer_list<int> input_shape,
-                      std::initializer_list<int> attribute_shape);
+                      std::initializer_list<int> attribute_shape,
+                      std::initializer_list<int> num_inputs_shape = {1});
   void SetNumTokens(const std::initializer_list<int>& num_tokens) {
     PopulateTensor(input_num_tokens_, num_tokens);
     PopulateTensor(input_length_, {static_cast<int32_t>(num_tokens.size())});
   }
+  void SetNumTokens(const std::initializer_list<int>& num_tokens,
+                    const std::initializer_list<int>& num_inputs) {
+    PopulateTensor(input_num_tokens_, num_tokens);
+    PopulateTensor(input_length_, num_inputs);
+  }
   void SetMaxOutputLength(int length) {
     PopulateTensor(input_output_maxlength_, {length});
   }
@@ -54,6 +60,9 @@ class TokenEncoderOpModel : public tflite::SingleOpModel {
     return ExtractVector<float>(output_attributes_float_);
   }
   int GetOutputLength() { return ExtractVector<int>(output_length_)[0]; }
+  std::vector<int> GetOutputLengths() {
+    return ExtractVector<int>(output_length_);
+  }
 
  private:
   int input_num_tokens_;
@@ -70,7 +79,8 @@ class TokenEncoderOpModel : public tflite::SingleOpModel {
 
 TokenEncoderOpModel::TokenEncoderOpModel(
     std::initializer_list<int> input_shape,
-    std::initializer_list<int> attribute_shape) {
+    std::initializer_list<int> attribute_shape,
+    std::initializer_list<int> num_inputs_shape) {
   input_num_tokens_ = AddInput(tflite::TensorType_INT32);
   input_length_ = AddInput(tflite::TensorType_INT32);
   input_output_maxlength_ = AddInput(tflite::TensorType_INT32);
@@ -83,7 +93,8 @@ TokenEncoderOpModel::TokenEncoderOpModel(
   output_attributes_float_ = AddOutput(tflite::TensorType_FLOAT32);
 
   SetCustomOp("TokenEncoder", {}, tflite::ops::custom::Register_TOKEN_ENCODER);
-  BuildInterpreter({input_shape, {1}, {1}, attribute_shape, attribute_shape});
+  BuildInterpreter(
+      {input_shape, num_inputs_shape, {1}, attribute_shape, attribute_shape});
 }
 
 // Tests
@@ -144,5 +155,26 @@ TEST(TokenEncoderTest, ManyMessagesMultipleTokens) {
       testing::ElementsAre(3.f, 3.f, 3.f, 2.f, 2.f, 2.f, 2.f, 2.f, 2.f));
 }
 
+TEST(TokenEncoderTest, Batch) {
+  TokenEncoderOpModel m({2, 3}, {2, 3}, /*num_inputs_shape=*/{2});
+  m.SetInt32Attribute({1, 2, 3, 4, 5, 6});
+  m.SetFloatAttribute({5.f, 4.f, 3.f, 2.f, 1.f, 0.f});
+  m.SetNumTokens({1, 1, 1, 1, 2, 0}, /*num_inputs=*/{3, 2});
+  m.SetMaxOutputLength(8);
+
+  m.Invoke();
+
+  EXPECT_THAT(m.GetOutputLengths(), testing::ElementsAre(8, 7));
+  EXPECT_THAT(m.GetOutputPositions(),
+              testing::ElementsAre(1, 2, 0, 1, 2, 0, 1, 2,  //
+                                   0, 1, 2, 0, 1, 2, 3, 8));
+  EXPECT_THAT(m.GetOutputAttributeInt32(),
+              testing::ElementsAre(1, 1, 2, 2, 2, 3, 3, 3,  //
+                                   4, 4, 4, 5, 5, 5, 5, 5));
+  EXPECT_THAT(m.GetOutputAttributeFloat(),
+              testing::ElementsAre(5.f, 5.f, 4.f, 4.f, 4.f, 3.f, 3.f, 3.f,  //
+                                   2.f, 2.f, 2.f, 1.f, 1.f, 1.f, 1.f, 1.f));
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/thread-pool.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "utils/base/integral_types.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+// Number of batches per worker thread in RunInBatches.
+constexpr int kBatchesPerThread = 4;
+
+}  // namespace
+
+ThreadPool::ThreadPool(int num_threads) {
+  workers_.reserve(num_threads);
+  for (int i = 0; i < num_threads; ++i) {
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  task_available_.notify_all();
+  for (std::thread& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::Schedule(std::function<void()> task) {
+  if (workers_.empty()) {
+    task();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  task_available_.notify_one();
+}
+
+void ThreadPool::WorkerLoop() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      task_available_.wait(lock,
+                           [this]() { return stopping_ || !tasks_.empty(); });
+      if (tasks_.empty()) {
+        return;
+      }
+      task = std::move(tasks_.front());
+      tasks_.pop_front();
+    }
+    task();
+  }
+}
+
+void SharedTask::ScheduleOn(ThreadPool* pool) const {
+  std::shared_ptr<State> state = state_;
+  pool->Schedule([state]() { Run(state.get()); });
+}
+
+bool SharedTask::Wait() const {
+  Run(state_.get());
+  return state_->result;
+}
+
+void SharedTask::Run(State* state) {
+  std::call_once(state->once, [state]() { state->result = state->task(); });
+}
+
+bool RunInBatches(int size, ThreadPool* thread_pool,
+                  const std::function<bool(int begin, int end)>& run_range) {
+  if (thread_pool == nullptr || thread_pool->NumThreads() == 0 || size < 2) {
+    return run_range(0, size);
+  }
+
+  const int num_batches =
+      std::min(size, (thread_pool->NumThreads() + 1) * kBatchesPerThread);
+  std::vector<SharedTask> tasks;
+  tasks.reserve(num_batches);
+  for (int batch = 0; batch < num_batches; ++batch) {
+    const int begin = static_cast<int64>(size) * batch / num_batches;
+    const int end = static_cast<int64>(size) * (batch + 1) / num_batches;
+    tasks.emplace_back(
+        [&run_range, begin, end]() { return run_range(begin, end); });
+    tasks.back().ScheduleOn(thread_pool);
+  }
+
+  // Every task is waited for here, so none of them runs after the caller's
+  // state is gone.
+  bool success = true;
+  for (const SharedTask& task : tasks) {
+    if (!task.Wait()) {
+      success = false;
+    }
+  }
+  return success;
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A simple fixed-size pool of worker threads.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_THREAD_POOL_H_
+#define LIBTEXTCLASSIFIER_UTILS_THREAD_POOL_H_
+
+#include <condition_variable>  // NOLINT
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
+#include <vector>
+
+namespace libtextclassifier3 {
+
+// Runs scheduled tasks on a fixed number of worker threads, in the order in
+// which they were scheduled. The destructor waits for all the scheduled tasks
+// to finish.
+//
+// The class is thread-safe.
+class ThreadPool {
+ public:
+  explicit ThreadPool(int num_threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Schedules the task to be run on one of the worker threads.
+  void Schedule(std::function<void()> task);
+
+  int NumThreads() const { return workers_.size(); }
+
+ private:
+  void WorkerLoop();
+
+  std::mutex mutex_;
+  std::condition_variable task_available_;
+  std::deque<std::function<void()>> tasks_;
+  bool stopping_ = false;
+  std::vector<std::thread> workers_;
+};
+
+// A task that can be handed to a thread pool and also run by the thread that
+// waits for its result. Whichever thread gets to the task first runs it, so
+// waiting for the task never deadlocks, even if all the workers of the pool
+// are busy (e.g. waiting themselves).
+class SharedTask {
+ public:
+  explicit SharedTask(std::function<bool()> task)
+      : state_(new State{std::move(task)}) {}
+
+  // Schedules the task on the pool.
+  void ScheduleOn(ThreadPool* pool) const;
+
+  // Runs the task unless it was already run, otherwise waits for it to
+  // finish. Returns the result of the task.
+  bool Wait() const;
+
+ private:
+  struct State {
+    std::function<bool()> task;
+    std::once_flag once;
+    bool result = false;
+  };
+
+  static void Run(State* state);
+
+  // Shared with the pool, which might pick the task up only after the waiting
+  // thread is gone.
+  std::shared_ptr<State> state_;
+};
+
+// Runs run_range(begin, end) over consecutive ranges covering [0, size). The
+// ranges are spread over the pool and the calling thread, with a few ranges
+// per worker so that the threads stay busy even if some items take much
+// longer than others. Without a pool, or with fewer than two items, the whole
+// range runs on the calling thread. Returns once all the ranges are done, with
+// whether all of them succeeded.
+bool RunInBatches(int size, ThreadPool* thread_pool,
+                  const std::function<bool(int begin, int end)>& run_range);
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_THREAD_POOL_H_
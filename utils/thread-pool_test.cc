@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/thread-pool.h"
+
+#include <atomic>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(ThreadPoolTest, RunsAllScheduledTasks) {
+  std::atomic<int> num_runs(0);
+  {
+    ThreadPool pool(/*num_threads=*/4);
+    for (int i = 0; i < 100; ++i) {
+      pool.Schedule([&num_runs]() { ++num_runs; });
+    }
+  }
+  EXPECT_EQ(num_runs, 100);
+}
+
+TEST(ThreadPoolTest, RunsTasksInlineWithoutThreads) {
+  ThreadPool pool(/*num_threads=*/0);
+  bool run = false;
+  pool.Schedule([&run]() { run = true; });
+  EXPECT_TRUE(run);
+}
+
+TEST(SharedTaskTest, RunsOnceAndReturnsResult) {
+  ThreadPool pool(/*num_threads=*/2);
+  std::atomic<int> num_runs(0);
+  SharedTask task([&num_runs]() {
+    ++num_runs;
+    return true;
+  });
+  task.ScheduleOn(&pool);
+  EXPECT_TRUE(task.Wait());
+  EXPECT_TRUE(task.Wait());
+  EXPECT_EQ(num_runs, 1);
+}
+
+TEST(SharedTaskTest, WaitRunsTaskWhenPoolIsBusy) {
+  SharedTask task([]() { return true; });
+  ThreadPool pool(/*num_threads=*/1);
+
+  // The only worker waits for the task that is queued behind it.
+  pool.Schedule([&task]() { task.Wait(); });
+  task.ScheduleOn(&pool);
+  EXPECT_TRUE(task.Wait());
+}
+
+TEST(RunInBatchesTest, CoversTheWholeRangeOnce) {
+  ThreadPool pool(/*num_threads=*/3);
+  std::vector<std::atomic<int>> num_runs(1000);
+  const bool success =
+      RunInBatches(num_runs.size(), &pool, [&num_runs](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+          ++num_runs[i];
+        }
+        return true;
+      });
+  EXPECT_TRUE(success);
+  for (const std::atomic<int>& runs : num_runs) {
+    EXPECT_EQ(runs, 1);
+  }
+}
+
+TEST(RunInBatchesTest, RunsOnCallerWithoutPool) {
+  int num_calls = 0;
+  EXPECT_FALSE(RunInBatches(10, /*thread_pool=*/nullptr,
+                            [&num_calls](int begin, int end) {
+                              ++num_calls;
+                              EXPECT_EQ(begin, 0);
+                              EXPECT_EQ(end, 10);
+                              return false;
+                            }));
+  EXPECT_EQ(num_calls, 1);
+}
+
+TEST(RunInBatchesTest, ReportsFailedBatch) {
+  ThreadPool pool(/*num_threads=*/2);
+  EXPECT_FALSE(RunInBatches(100, &pool, [](int begin, int end) {
+    return !(begin <= 42 && 42 < end);
+  }));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
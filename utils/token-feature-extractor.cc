@@ -16,37 +16,44 @@
 
 #include "utils/token-feature-extractor.h"
 
+#include <algorithm>
 #include <cctype>
+#include <cstring>
 #include <string>
 
 #include "utils/base/logging.h"
 #include "utils/hash/farmhash.h"
 #include "utils/strings/stringpiece.h"
+#include "utils/strings/utf8.h"
 #include "utils/utf8/unicodetext.h"
 
 namespace libtextclassifier3 {
 
 namespace {
 
-std::string RemapTokenAscii(const std::string& token,
-                            const TokenFeatureExtractorOptions& options) {
+// Appends the token text with the digits and case remapped according to the
+// options.
+void AppendRemappedTokenAscii(StringPiece token,
+                              const TokenFeatureExtractorOptions& options,
+                              std::string* remapped) {
   if (!options.remap_digits && !options.lowercase_tokens) {
-    return token;
+    remapped->append(token.data(), token.size());
+    return;
   }
 
-  std::string copy = token;
   for (int i = 0; i < token.size(); ++i) {
-    if (options.remap_digits && isdigit(copy[i])) {
-      copy[i] = '0';
+    char c = token[i];
+    if (options.remap_digits && isdigit(c)) {
+      c = '0';
     }
     if (options.lowercase_tokens) {
-      copy[i] = tolower(copy[i]);
+      c = tolower(c);
     }
+    remapped->push_back(c);
   }
-  return copy;
 }
 
-void RemapTokenUnicode(const std::string& token,
+void RemapTokenUnicode(StringPiece token,
                        const TokenFeatureExtractorOptions& options,
                        const UniLib& unilib, UnicodeText* remapped) {
   if (!options.remap_digits && !options.lowercase_tokens) {
@@ -54,7 +61,8 @@ void RemapTokenUnicode(const std::string& token,
     return;
   }
 
-  UnicodeText word = UTF8ToUnicodeText(token, /*do_copy=*/false);
+  UnicodeText word =
+      UTF8ToUnicodeText(token.data(), token.size(), /*do_copy=*/false);
   remapped->clear();
   for (auto it = word.begin(); it != word.end(); ++it) {
     if (options.remap_digits && unilib.IsDigit(*it)) {
@@ -67,12 +75,59 @@ void RemapTokenUnicode(const std::string& token,
   }
 }
 
+// Incremental charactergram hashing: FNV-1a over the bytes, so that a hash can
+// be extended by more characters, with a final mix for the bucket distribution.
+constexpr uint64 kChargramHashSeed = 0xcbf29ce484222325ULL;
+
+uint64 ExtendChargramHash(uint64 hash, const char* begin, const char* end) {
+  for (const char* p = begin; p < end; ++p) {
+    hash = (hash ^ static_cast<unsigned char>(*p)) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+uint64 FinishChargramHash(uint64 hash) {
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdULL;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+uint64 IncrementalChargramHash(StringPiece chargram) {
+  return FinishChargramHash(ExtendChargramHash(
+      kChargramHashSeed, chargram.data(), chargram.data() + chargram.size()));
+}
+
+// Returns the end of the character starting at p.
+const char* NextChar(const char* p, const char* end, bool unicode) {
+  const char* next = p + (unicode ? GetNumBytesForNonZeroUTF8Char(p) : 1);
+  return next < end ? next : end;
+}
+
+// Text of the token, which is empty for padding tokens.
+StringPiece TokenValue(const Token& token) {
+  return token.is_padding ? StringPiece() : StringPiece(token.value);
+}
+
+StringPiece TokenValue(const TokenRef& token) {
+  return token.is_padding ? StringPiece() : token.value();
+}
+
 }  // namespace
 
 TokenFeatureExtractor::TokenFeatureExtractor(
     const TokenFeatureExtractorOptions& options, const UniLib& unilib)
     : options_(options), unilib_(unilib) {
   for (const std::string& pattern : options.regexp_features) {
+    std::unique_ptr<SimpleRegexFeature> simple_feature(new SimpleRegexFeature);
+    if (ParseSimpleRegexFeature(pattern, simple_feature.get())) {
+      simple_regex_features_.push_back(std::move(simple_feature));
+      regex_patterns_.emplace_back(nullptr);
+      continue;
+    }
+    simple_regex_features_.emplace_back(nullptr);
     regex_patterns_.push_back(std::unique_ptr<UniLib::RegexPattern>(
         unilib_.CreateRegexPattern(UTF8ToUnicodeText(
             pattern.c_str(), pattern.size(), /*do_copy=*/false))));
@@ -86,52 +141,103 @@ bool TokenFeatureExtractor::Extract(const Token& token, bool is_in_span,
     return false;
   }
   if (sparse_features) {
-    *sparse_features = ExtractCharactergramFeatures(token);
+    ExtractCharactergramFeatures(token, sparse_features);
   }
-  *dense_features = ExtractDenseFeatures(token, is_in_span);
+  dense_features->clear();
+  AppendDenseFeatures(token, is_in_span, dense_features);
+  return true;
+}
+
+bool TokenFeatureExtractor::Extract(const TokenRef& token, bool is_in_span,
+                                    std::vector<int>* sparse_features,
+                                    std::vector<float>* dense_features) const {
+  if (!dense_features) {
+    return false;
+  }
+  if (sparse_features) {
+    ExtractCharactergramFeatures(token, sparse_features);
+  }
+  dense_features->clear();
+  AppendDenseFeatures(token, is_in_span, dense_features);
   return true;
 }
 
 std::vector<int> TokenFeatureExtractor::ExtractCharactergramFeatures(
     const Token& token) const {
+  std::vector<int> result;
+  ExtractCharactergramFeatures(token, &result);
+  return result;
+}
+
+void TokenFeatureExtractor::ExtractCharactergramFeatures(
+    const Token& token, std::vector<int>* sparse_features) const {
+  ExtractCharactergramFeaturesInternal(TokenValue(token), sparse_features);
+}
+
+void TokenFeatureExtractor::ExtractCharactergramFeatures(
+    const TokenRef& token, std::vector<int>* sparse_features) const {
+  ExtractCharactergramFeaturesInternal(TokenValue(token), sparse_features);
+}
+
+void TokenFeatureExtractor::ExtractCharactergramFeaturesInternal(
+    StringPiece value, std::vector<int>* sparse_features) const {
+  sparse_features->clear();
   if (options_.unicode_aware_features) {
-    return ExtractCharactergramFeaturesUnicode(token);
+    ExtractCharactergramFeaturesUnicode(value, sparse_features);
   } else {
-    return ExtractCharactergramFeaturesAscii(token);
+    ExtractCharactergramFeaturesAscii(value, sparse_features);
   }
 }
 
 std::vector<float> TokenFeatureExtractor::ExtractDenseFeatures(
     const Token& token, bool is_in_span) const {
   std::vector<float> dense_features;
+  AppendDenseFeatures(token, is_in_span, &dense_features);
+  return dense_features;
+}
 
+void TokenFeatureExtractor::AppendDenseFeatures(
+    const Token& token, bool is_in_span,
+    std::vector<float>* dense_features) const {
+  AppendDenseFeaturesInternal(token.value, is_in_span, dense_features);
+}
+
+void TokenFeatureExtractor::AppendDenseFeatures(
+    const TokenRef& token, bool is_in_span,
+    std::vector<float>* dense_features) const {
+  AppendDenseFeaturesInternal(token.value(), is_in_span, dense_features);
+}
+
+void TokenFeatureExtractor::AppendDenseFeaturesInternal(
+    StringPiece value, bool is_in_span,
+    std::vector<float>* dense_features) const {
   if (options_.extract_case_feature) {
     if (options_.unicode_aware_features) {
       UnicodeText token_unicode =
-          UTF8ToUnicodeText(token.value, /*do_copy=*/false);
+          UTF8ToUnicodeText(value.data(), value.size(), /*do_copy=*/false);
       const bool is_upper = unilib_.IsUpper(*token_unicode.begin());
-      if (!token.value.empty() && is_upper) {
-        dense_features.push_back(1.0);
+      if (!value.empty() && is_upper) {
+        dense_features->push_back(1.0);
       } else {
-        dense_features.push_back(-1.0);
+        dense_features->push_back(-1.0);
       }
     } else {
-      if (!token.value.empty() && isupper(*token.value.begin())) {
-        dense_features.push_back(1.0);
+      if (!value.empty() && isupper(value[0])) {
+        dense_features->push_back(1.0);
       } else {
-        dense_features.push_back(-1.0);
+        dense_features->push_back(-1.0);
       }
     }
   }
 
   if (options_.extract_selection_mask_feature) {
     if (is_in_span) {
-      dense_features.push_back(1.0);
+      dense_features->push_back(1.0);
     } else {
       if (options_.unicode_aware_features) {
-        dense_features.push_back(-1.0);
+        dense_features->push_back(-1.0);
       } else {
-        dense_features.push_back(0.0);
+        dense_features->push_back(0.0);
       }
     }
   }
@@ -139,28 +245,125 @@ std::vector<float> TokenFeatureExtractor::ExtractDenseFeatures(
   // Add regexp features.
   if (!regex_patterns_.empty()) {
     UnicodeText token_unicode =
-        UTF8ToUnicodeText(token.value, /*do_copy=*/false);
+        UTF8ToUnicodeText(value.data(), value.size(), /*do_copy=*/false);
     for (int i = 0; i < regex_patterns_.size(); ++i) {
+      if (simple_regex_features_[i] != nullptr) {
+        dense_features->push_back(
+            simple_regex_features_[i]->Matches(value) ? 1.0 : -1.0);
+        continue;
+      }
       if (!regex_patterns_[i].get()) {
-        dense_features.push_back(-1.0);
+        dense_features->push_back(-1.0);
         continue;
       }
       auto matcher = regex_patterns_[i]->Matcher(token_unicode);
       int status;
       if (matcher->Matches(&status)) {
-        dense_features.push_back(1.0);
+        dense_features->push_back(1.0);
       } else {
-        dense_features.push_back(-1.0);
+        dense_features->push_back(-1.0);
       }
     }
   }
+}
 
-  return dense_features;
+bool TokenFeatureExtractor::ParseSimpleRegexFeature(
+    const std::string& pattern, SimpleRegexFeature* feature) {
+  int i = 0;
+  const int size = pattern.size();
+  if (i < size && pattern[i] == '^') {
+    ++i;
+  }
+  while (i < size && pattern[i] != '$') {
+    if (feature->last_class_repeated) {
+      // Only the last class may be repeated.
+      return false;
+    }
+    std::bitset<128> codepoints;
+    if (pattern.compare(i, 2, "\\d") == 0) {
+      for (char c = '0'; c <= '9'; ++c) {
+        codepoints.set(c);
+      }
+      i += 2;
+    } else if (pattern[i] == '[') {
+      ++i;
+      const int class_start = i;
+      for (; i < size && pattern[i] != ']'; ++i) {
+        const char c = pattern[i];
+        // Negations, escapes, nested sets and set operations need the regex.
+        if (c <= ' ' || c > '~' || (i == class_start && c == '^') ||
+            strchr("\\[&:{}$", c) != nullptr) {
+          return false;
+        }
+        if (c == '-' && i > class_start && i + 1 < size &&
+            pattern[i + 1] != ']') {
+          const char last = pattern[i + 1];
+          if (last < pattern[i - 1] || last > '~' || last == '\\' ||
+              last == '[') {
+            return false;
+          }
+          for (int range_c = pattern[i - 1]; range_c <= last; ++range_c) {
+            codepoints.set(range_c);
+          }
+          ++i;
+        } else {
+          codepoints.set(c);
+        }
+      }
+      if (i == size || i == class_start) {
+        return false;
+      }
+      ++i;
+    } else {
+      return false;
+    }
+    feature->classes.push_back(codepoints);
+
+    if (i < size && (pattern[i] == '+' || pattern[i] == '*')) {
+      feature->last_class_repeated = true;
+      feature->last_class_min_repeat = pattern[i] == '+' ? 1 : 0;
+      ++i;
+    }
+  }
+  if (i < size && pattern[i] == '$') {
+    ++i;
+  }
+  return i == size && !feature->classes.empty();
+}
+
+bool TokenFeatureExtractor::SimpleRegexFeature::Matches(
+    StringPiece value) const {
+  const int num_single =
+      last_class_repeated ? classes.size() - 1 : classes.size();
+  if (value.size() < num_single ||
+      (!last_class_repeated && value.size() != num_single)) {
+    return false;
+  }
+  // The classes only hold ASCII characters, so the bytes of other codepoints
+  // never match.
+  for (int i = 0; i < value.size(); ++i) {
+    const unsigned char c = value[i];
+    const std::bitset<128>& codepoints =
+        classes[i < num_single ? i : num_single];
+    if (c >= 128 || !codepoints.test(c)) {
+      return false;
+    }
+  }
+  return !last_class_repeated ||
+         value.size() - num_single >= last_class_min_repeat;
 }
 
 int TokenFeatureExtractor::HashToken(StringPiece token) const {
+  if (options_.incremental_chargram_hashing) {
+    return ChargramBucket(token, IncrementalChargramHash(token));
+  }
+  return ChargramBucket(token, tc3farmhash::Fingerprint64(token));
+}
+
+int TokenFeatureExtractor::ChargramBucket(StringPiece token,
+                                          const uint64 hash) const {
   if (options_.allowed_chargrams.empty()) {
-    return tc3farmhash::Fingerprint64(token) % options_.num_buckets;
+    return hash % options_.num_buckets;
   } else {
     // Padding and out-of-vocabulary tokens have extra buckets reserved because
     // they are special and important tokens, and we don't want them to share
@@ -174,69 +377,127 @@ int TokenFeatureExtractor::HashToken(StringPiece token) const {
                options_.allowed_chargrams.end()) {
       return 0;  // Out-of-vocabulary.
     } else {
-      return (tc3farmhash::Fingerprint64(token) %
-              (options_.num_buckets - kNumExtraBuckets)) +
+      return (hash % (options_.num_buckets - kNumExtraBuckets)) +
              kNumExtraBuckets;
     }
   }
 }
 
-std::vector<int> TokenFeatureExtractor::ExtractCharactergramFeaturesAscii(
-    const Token& token) const {
-  std::vector<int> result;
-  if (token.is_padding || token.value.empty()) {
-    result.push_back(HashToken("<PAD>"));
-  } else {
-    const std::string word = RemapTokenAscii(token.value, options_);
+void TokenFeatureExtractor::AppendIncrementalChargramFeatures(
+    StringPiece feature_word, const bool unicode,
+    std::vector<int>* result) const {
+  const char* const begin = feature_word.data();
+  const char* const end = begin + feature_word.size();
+  const std::vector<int>& orders = options_.chargram_orders;
+
+  // The features keep the order of the farmhash extraction: by chargram
+  // order, then by position. Unigrams skip the padding characters.
+  int num_chars = 0;
+  for (const char* p = begin; p < end; p = NextChar(p, end, unicode)) {
+    ++num_chars;
+  }
+  std::vector<int> first_feature(orders.size());
+  int num_features = 0;
+  int max_order = 0;
+  for (int i = 0; i < orders.size(); ++i) {
+    first_feature[i] = result->size() + num_features;
+    if (orders[i] == 1) {
+      num_features += std::max(0, num_chars - 2);
+    } else if (orders[i] > 1) {
+      num_features += std::max(0, num_chars - orders[i] + 1);
+    }
+    max_order = std::max(max_order, orders[i]);
+  }
+  result->resize(result->size() + num_features);
+
+  int position = 0;
+  for (const char* start = begin; start < end;
+       start = NextChar(start, end, unicode), ++position) {
+    uint64 hash = kChargramHashSeed;
+    const char* chargram_end = start;
+    for (int length = 1; length <= max_order && chargram_end < end;
+         ++length) {
+      const char* const previous_end = chargram_end;
+      chargram_end = NextChar(chargram_end, end, unicode);
+      hash = ExtendChargramHash(hash, previous_end, chargram_end);
+      for (int i = 0; i < orders.size(); ++i) {
+        if (orders[i] != length) {
+          continue;
+        }
+        int index = position;
+        if (length == 1) {
+          if (position == 0 || position == num_chars - 1) {
+            continue;
+          }
+          --index;
+        }
+        (*result)[first_feature[i] + index] = ChargramBucket(
+            StringPiece(start, chargram_end - start), FinishChargramHash(hash));
+      }
+    }
+  }
+}
 
-    // Trim words that are over max_word_length characters.
+void TokenFeatureExtractor::ExtractCharactergramFeaturesAscii(
+    StringPiece value, std::vector<int>* result) const {
+  if (value.empty()) {
+    result->push_back(HashToken("<PAD>"));
+  } else {
+    // Trim words that are over max_word_length characters and add a prefix and
+    // suffix to the word.
     const int max_word_length = options_.max_word_length;
     std::string feature_word;
-    if (word.size() > max_word_length) {
-      feature_word =
-          "^" + word.substr(0, max_word_length / 2) + "\1" +
-          word.substr(word.size() - max_word_length / 2, max_word_length / 2) +
-          "$";
+    feature_word.push_back('^');
+    if (value.size() > max_word_length) {
+      const int half_length = max_word_length / 2;
+      AppendRemappedTokenAscii(StringPiece(value.data(), half_length),
+                               options_, &feature_word);
+      feature_word.push_back('\1');
+      AppendRemappedTokenAscii(
+          StringPiece(value.data() + value.size() - half_length, half_length),
+          options_, &feature_word);
     } else {
-      // Add a prefix and suffix to the word.
-      feature_word = "^" + word + "$";
+      AppendRemappedTokenAscii(value, options_, &feature_word);
     }
-
-    // Upper-bound the number of charactergram extracted to avoid resizing.
-    result.reserve(options_.chargram_orders.size() * feature_word.size());
+    feature_word.push_back('$');
 
     if (options_.chargram_orders.empty()) {
-      result.push_back(HashToken(feature_word));
+      result->push_back(HashToken(feature_word));
+    } else if (options_.incremental_chargram_hashing) {
+      AppendIncrementalChargramFeatures(feature_word, /*unicode=*/false,
+                                        result);
     } else {
+      // Upper-bound the number of charactergram extracted to avoid resizing.
+      result->reserve(options_.chargram_orders.size() * feature_word.size());
+
       // Generate the character-grams.
       for (int chargram_order : options_.chargram_orders) {
         if (chargram_order == 1) {
           for (int i = 1; i < feature_word.size() - 1; ++i) {
-            result.push_back(
+            result->push_back(
                 HashToken(StringPiece(feature_word, /*offset=*/i, /*len=*/1)));
           }
         } else {
           for (int i = 0;
                i < static_cast<int>(feature_word.size()) - chargram_order + 1;
                ++i) {
-            result.push_back(HashToken(StringPiece(feature_word, /*offset=*/i,
-                                                   /*len=*/chargram_order)));
+            result->push_back(HashToken(StringPiece(
+                feature_word, /*offset=*/i, /*len=*/chargram_order)));
           }
         }
       }
     }
   }
-  return result;
 }
 
-std::vector<int> TokenFeatureExtractor::ExtractCharactergramFeaturesUnicode(
-    const Token& token) const {
-  std::vector<int> result;
-  if (token.is_padding || token.value.empty()) {
-    result.push_back(HashToken("<PAD>"));
+void TokenFeatureExtractor::ExtractCharactergramFeaturesUnicode(
+    StringPiece value, std::vector<int>* result) const {
+  if (value.empty()) {
+    result->push_back(HashToken("<PAD>"));
   } else {
-    UnicodeText word = UTF8ToUnicodeText(token.value, /*do_copy=*/false);
-    RemapTokenUnicode(token.value, options_, unilib_, &word);
+    UnicodeText word =
+        UTF8ToUnicodeText(value.data(), value.size(), /*do_copy=*/false);
+    RemapTokenUnicode(value, options_, unilib_, &word);
 
     // Trim the word if needed by finding a left-cut point and right-cut point.
     auto left_cut = word.begin();
@@ -263,15 +524,17 @@ std::vector<int> TokenFeatureExtractor::ExtractCharactergramFeaturesUnicode(
       // clang-format on
     }
 
-    const UnicodeText feature_word_unicode =
-        UTF8ToUnicodeText(feature_word, /*do_copy=*/false);
-
-    // Upper-bound the number of charactergram extracted to avoid resizing.
-    result.reserve(options_.chargram_orders.size() * feature_word.size());
-
     if (options_.chargram_orders.empty()) {
-      result.push_back(HashToken(feature_word));
+      result->push_back(HashToken(feature_word));
+    } else if (options_.incremental_chargram_hashing) {
+      AppendIncrementalChargramFeatures(feature_word, /*unicode=*/true, result);
     } else {
+      const UnicodeText feature_word_unicode =
+          UTF8ToUnicodeText(feature_word, /*do_copy=*/false);
+
+      // Upper-bound the number of charactergram extracted to avoid resizing.
+      result->reserve(options_.chargram_orders.size() * feature_word.size());
+
       // Generate the character-grams.
       for (int chargram_order : options_.chargram_orders) {
         UnicodeText::const_iterator it_start = feature_word_unicode.begin();
@@ -299,13 +562,12 @@ std::vector<int> TokenFeatureExtractor::ExtractCharactergramFeaturesUnicode(
              ++it_chargram_start, ++it_chargram_end) {
           const int length_bytes =
               it_chargram_end.utf8_data() - it_chargram_start.utf8_data();
-          result.push_back(HashToken(
+          result->push_back(HashToken(
               StringPiece(it_chargram_start.utf8_data(), length_bytes)));
         }
       }
     }
   }
-  return result;
 }
 
 }  // namespace libtextclassifier3
@@ -17,11 +17,13 @@
 #ifndef LIBTEXTCLASSIFIER_UTILS_TOKEN_FEATURE_EXTRACTOR_H_
 #define LIBTEXTCLASSIFIER_UTILS_TOKEN_FEATURE_EXTRACTOR_H_
 
+#include <bitset>
 #include <memory>
 #include <unordered_set>
 #include <vector>
 
 #include "annotator/types.h"
+#include "utils/base/integral_types.h"
 #include "utils/strings/stringpiece.h"
 #include "utils/utf8/unilib.h"
 
@@ -56,6 +58,12 @@ struct TokenFeatureExtractorOptions {
   // Maximum length of a word.
   int max_word_length = 20;
 
+  // If true, the charactergrams are hashed incrementally: the hash of a
+  // charactergram extends the hash of the one a character shorter at the same
+  // position, so that all the orders share the work. The buckets differ from
+  // the default farmhash ones, so this must match how the model was trained.
+  bool incremental_chargram_hashing = false;
+
   // List of allowed charactergrams. The extracted charactergrams are filtered
   // using this list, and charactergrams that are not present are interpreted as
   // out-of-vocabulary.
@@ -76,15 +84,31 @@ class TokenFeatureExtractor {
   bool Extract(const Token& token, bool is_in_span,
                std::vector<int>* sparse_features,
                std::vector<float>* dense_features) const;
+  bool Extract(const TokenRef& token, bool is_in_span,
+               std::vector<int>* sparse_features,
+               std::vector<float>* dense_features) const;
 
   // Extracts the sparse (charactergram) features from the token.
   std::vector<int> ExtractCharactergramFeatures(const Token& token) const;
 
+  // Same as above, but writes the features to a caller-owned buffer, so that
+  // it can be reused between tokens.
+  void ExtractCharactergramFeatures(const Token& token,
+                                    std::vector<int>* sparse_features) const;
+  void ExtractCharactergramFeatures(const TokenRef& token,
+                                    std::vector<int>* sparse_features) const;
+
   // Extracts the dense features from the token. is_in_span is a bool indicator
   // whether the token is a part of the selection span (true) or not (false).
   std::vector<float> ExtractDenseFeatures(const Token& token,
                                           bool is_in_span) const;
 
+  // Same as above, but appends the features to dense_features.
+  void AppendDenseFeatures(const Token& token, bool is_in_span,
+                           std::vector<float>* dense_features) const;
+  void AppendDenseFeatures(const TokenRef& token, bool is_in_span,
+                           std::vector<float>* dense_features) const;
+
   int DenseFeaturesCount() const {
     int feature_count =
         options_.extract_case_feature + options_.extract_selection_mask_feature;
@@ -96,16 +120,56 @@ class TokenFeatureExtractor {
   // Hashes given token to given number of buckets.
   int HashToken(StringPiece token) const;
 
-  // Extracts the charactergram features from the token in a non-unicode-aware
-  // way.
-  std::vector<int> ExtractCharactergramFeaturesAscii(const Token& token) const;
+  // Maps the token with the given hash to its bucket.
+  int ChargramBucket(StringPiece token, uint64 hash) const;
 
-  // Extracts the charactergram features from the token in a unicode-aware way.
-  std::vector<int> ExtractCharactergramFeaturesUnicode(
-      const Token& token) const;
+  // Appends the features of the charactergrams of the padded and trimmed
+  // token text with incremental hashing. The charactergrams are codepoints if
+  // unicode is true, and bytes otherwise.
+  void AppendIncrementalChargramFeatures(StringPiece feature_word, bool unicode,
+                                         std::vector<int>* result) const;
+
+  // Extracts the charactergram features from the token text in a
+  // non-unicode-aware way. Empty text is treated as a padding token.
+  void ExtractCharactergramFeaturesAscii(StringPiece value,
+                                         std::vector<int>* result) const;
+
+  // Extracts the charactergram features from the token text in a unicode-aware
+  // way. Empty text is treated as a padding token.
+  void ExtractCharactergramFeaturesUnicode(StringPiece value,
+                                           std::vector<int>* result) const;
 
  private:
+  // Implementations of the public functions on the token text, shared by Token
+  // and TokenRef.
+  void ExtractCharactergramFeaturesInternal(
+      StringPiece value, std::vector<int>* sparse_features) const;
+  void AppendDenseFeaturesInternal(StringPiece value, bool is_in_span,
+                                   std::vector<float>* dense_features) const;
+
+  // A regexp feature simple enough to be matched without a regex: a sequence
+  // of ASCII character classes, of which the last may be repeated, e.g.
+  // "^[A-Z][a-z]+$".
+  struct SimpleRegexFeature {
+    std::vector<std::bitset<128>> classes;
+
+    // Minimum number of repetitions of the last class, if it is repeated.
+    bool last_class_repeated = false;
+    int last_class_min_repeat = 1;
+
+    // Whether the text fully matches the feature.
+    bool Matches(StringPiece value) const;
+  };
+
+  // Parses the pattern into a simple regexp feature, or returns false if the
+  // pattern isn't one.
+  static bool ParseSimpleRegexFeature(const std::string& pattern,
+                                      SimpleRegexFeature* feature);
+
   TokenFeatureExtractorOptions options_;
+
+  // The regexp features, either as simple features or as compiled patterns.
+  std::vector<std::unique_ptr<const SimpleRegexFeature>> simple_regex_features_;
   std::vector<std::unique_ptr<UniLib::RegexPattern>> regex_patterns_;
   const UniLib& unilib_;
 };
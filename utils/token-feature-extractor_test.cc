@@ -394,6 +394,25 @@ TEST_F(TokenFeatureExtractorTest, RegexFeatures) {
 }
 #endif
 
+TEST_F(TokenFeatureExtractorTest, MatchesSimpleRegexFeaturesNatively) {
+  TokenFeatureExtractorOptions options;
+  options.num_buckets = 1000;
+  options.regexp_features.push_back("^[A-Z][a-z]*$");  // capitalized.
+  options.regexp_features.push_back("\\d\\d");         // two digits.
+  TestingTokenFeatureExtractor extractor(options, unilib_);
+
+  EXPECT_THAT(extractor.ExtractDenseFeatures(Token{"Hello", 0, 5}, false),
+              testing::ElementsAreArray({1.0, -1.0}));
+  EXPECT_THAT(extractor.ExtractDenseFeatures(Token{"H", 0, 1}, false),
+              testing::ElementsAreArray({1.0, -1.0}));
+  EXPECT_THAT(extractor.ExtractDenseFeatures(Token{"Hé", 0, 2}, false),
+              testing::ElementsAreArray({-1.0, -1.0}));
+  EXPECT_THAT(extractor.ExtractDenseFeatures(Token{"42", 0, 2}, false),
+              testing::ElementsAreArray({-1.0, 1.0}));
+  EXPECT_THAT(extractor.ExtractDenseFeatures(Token{"421", 0, 3}, false),
+              testing::ElementsAreArray({-1.0, -1.0}));
+}
+
 TEST_F(TokenFeatureExtractorTest, ExtractTooLongWord) {
   TokenFeatureExtractorOptions options;
   options.num_buckets = 1000;
@@ -552,5 +571,106 @@ TEST_F(TokenFeatureExtractorTest, ExtractFiltered) {
   EXPECT_EQ(extractor.HashToken("<PAD>"), 1);
 }
 
+TEST_F(TokenFeatureExtractorTest, ReusesFeatureBuffers) {
+  TokenFeatureExtractorOptions options;
+  options.num_buckets = 1000;
+  options.chargram_orders = std::vector<int>{1, 2, 3};
+  options.extract_case_feature = true;
+  options.unicode_aware_features = false;
+  options.extract_selection_mask_feature = true;
+  TestingTokenFeatureExtractor extractor(options, unilib_);
+
+  std::vector<int> sparse_features;
+  extractor.ExtractCharactergramFeatures(Token{"Hello", 0, 5},
+                                         &sparse_features);
+  extractor.ExtractCharactergramFeatures(Token{"world!", 23, 29},
+                                         &sparse_features);
+  EXPECT_EQ(sparse_features,
+            extractor.ExtractCharactergramFeatures(Token{"world!", 23, 29}));
+
+  std::vector<float> dense_features = {5.0};
+  extractor.AppendDenseFeatures(Token{"Hello", 0, 5}, true, &dense_features);
+  EXPECT_THAT(dense_features, testing::ElementsAreArray({5.0, 1.0, 1.0}));
+}
+
+TEST_F(TokenFeatureExtractorTest, ExtractsIncrementallyHashedChargrams) {
+  TokenFeatureExtractorOptions options;
+  options.num_buckets = 1000;
+  options.chargram_orders = std::vector<int>{3, 1, 2};
+  options.unicode_aware_features = true;
+  options.incremental_chargram_hashing = true;
+  TestingTokenFeatureExtractor extractor(options, unilib_);
+
+  EXPECT_THAT(extractor.ExtractCharactergramFeatures(Token{"Hěl", 0, 3}),
+              testing::ElementsAreArray({
+                  // clang-format off
+                  extractor.HashToken("^Hě"),
+                  extractor.HashToken("Hěl"),
+                  extractor.HashToken("ěl$"),
+                  extractor.HashToken("H"),
+                  extractor.HashToken("ě"),
+                  extractor.HashToken("l"),
+                  extractor.HashToken("^H"),
+                  extractor.HashToken("Hě"),
+                  extractor.HashToken("ěl"),
+                  extractor.HashToken("l$")
+                  // clang-format on
+              }));
+  EXPECT_THAT(extractor.ExtractCharactergramFeatures(Token()),
+              testing::ElementsAre(extractor.HashToken("<PAD>")));
+
+  // The buckets differ from the farmhash ones.
+  options.incremental_chargram_hashing = false;
+  TestingTokenFeatureExtractor farmhash_extractor(options, unilib_);
+  EXPECT_NE(extractor.ExtractCharactergramFeatures(Token{"Hěl", 0, 3}),
+            farmhash_extractor.ExtractCharactergramFeatures(
+                Token{"Hěl", 0, 3}));
+
+  // Without unicode awareness the chargrams are bytes.
+  options.unicode_aware_features = false;
+  options.incremental_chargram_hashing = true;
+  options.chargram_orders = std::vector<int>{2};
+  TestingTokenFeatureExtractor ascii_extractor(options, unilib_);
+  EXPECT_THAT(
+      ascii_extractor.ExtractCharactergramFeatures(Token{"Hi", 0, 2}),
+      testing::ElementsAreArray({ascii_extractor.HashToken("^H"),
+                                 ascii_extractor.HashToken("Hi"),
+                                 ascii_extractor.HashToken("i$")}));
+}
+
+TEST_F(TokenFeatureExtractorTest, TokenRefMatchesToken) {
+  TokenFeatureExtractorOptions options;
+  options.num_buckets = 1000;
+  options.chargram_orders = std::vector<int>{1, 2, 3};
+  options.extract_case_feature = true;
+  options.extract_selection_mask_feature = true;
+  options.remap_digits = true;
+  options.lowercase_tokens = true;
+  options.max_word_length = 6;
+
+  for (const bool unicode_aware_features : {false, true}) {
+    options.unicode_aware_features = unicode_aware_features;
+    TestingTokenFeatureExtractor extractor(options, unilib_);
+
+    const std::string text = "Hello 2018 transformation";
+    for (const TokenRef& token_ref :
+         {TokenRef(text.data(), 0, 5, 0, 5), TokenRef(text.data(), 6, 4, 6, 10),
+          TokenRef(text.data(), 11, 14, 11, 25), TokenRef()}) {
+      std::vector<int> sparse_features_ref;
+      std::vector<float> dense_features_ref;
+      extractor.Extract(token_ref, true, &sparse_features_ref,
+                        &dense_features_ref);
+
+      std::vector<int> sparse_features;
+      std::vector<float> dense_features;
+      extractor.Extract(token_ref.ToToken(), true, &sparse_features,
+                        &dense_features);
+
+      EXPECT_THAT(sparse_features_ref, sparse_features);
+      EXPECT_THAT(dense_features_ref, dense_features);
+    }
+  }
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
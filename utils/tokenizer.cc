@@ -17,6 +17,8 @@
 #include "utils/tokenizer.h"
 
 #include <algorithm>
+#include <iterator>
+#include <utility>
 
 #include "utils/base/logging.h"
 #include "utils/base/macros.h"
@@ -47,10 +49,45 @@ Tokenizer::Tokenizer(
 
   SortCodepointRanges(internal_tokenizer_codepoint_ranges,
                       &internal_tokenizer_codepoint_ranges_);
+
+  BuildBmpLookupTable();
+
+  for (int codepoint = 0; codepoint < kNumAsciiCodepoints; ++codepoint) {
+    GetScriptAndRole(codepoint, &ascii_roles_[codepoint],
+                     &ascii_scripts_[codepoint]);
+  }
+}
+
+void Tokenizer::BuildBmpLookupTable() {
+  // The entries hold the range index plus one in 16 bits.
+  const int num_bmp_codepoints = BmpLookupTable<uint16>::kNumCodepoints;
+  if (codepoint_ranges_.size() >= num_bmp_codepoints) {
+    return;
+  }
+  std::vector<uint16> entries(num_bmp_codepoints, 0);
+  for (int i = 0; i < codepoint_ranges_.size(); ++i) {
+    const int start = std::max(codepoint_ranges_[i]->start, 0);
+    const int end = std::min(codepoint_ranges_[i]->end, num_bmp_codepoints);
+    for (int codepoint = start; codepoint < end; ++codepoint) {
+      entries[codepoint] = i + 1;
+    }
+  }
+  bmp_ranges_ = BmpLookupTable<uint16>(
+      [&entries](int codepoint) { return entries[codepoint]; });
 }
 
 const TokenizationCodepointRangeT* Tokenizer::FindTokenizationRange(
     int codepoint) const {
+  if (codepoint >= 0 && codepoint < BmpLookupTable<uint16>::kNumCodepoints &&
+      !bmp_ranges_.empty()) {
+    const int entry = bmp_ranges_.Get(codepoint);
+    return entry == 0 ? nullptr : codepoint_ranges_[entry - 1].get();
+  }
+  return FindTokenizationRangeWithBinarySearch(codepoint);
+}
+
+const TokenizationCodepointRangeT*
+Tokenizer::FindTokenizationRangeWithBinarySearch(int codepoint) const {
   auto it = std::lower_bound(
       codepoint_ranges_.begin(), codepoint_ranges_.end(), codepoint,
       [](const std::unique_ptr<const TokenizationCodepointRangeT>& range,
@@ -93,72 +130,209 @@ std::vector<Token> Tokenizer::Tokenize(const std::string& text) const {
 }
 
 std::vector<Token> Tokenizer::Tokenize(const UnicodeText& text_unicode) const {
+  std::vector<Token> tokens;
+  Tokenize(text_unicode, /*codepoint_offset=*/0, &tokens);
+  return tokens;
+}
+
+void Tokenizer::Tokenize(const UnicodeText& text_unicode,
+                         const int codepoint_offset,
+                         std::vector<Token>* tokens) const {
   switch (type_) {
     case TokenizationType_INTERNAL_TOKENIZER:
-      return InternalTokenize(text_unicode);
+      InternalTokenize(text_unicode, codepoint_offset, tokens);
+      return;
     case TokenizationType_ICU:
       TC3_FALLTHROUGH_INTENDED;
     case TokenizationType_MIXED: {
-      std::vector<Token> result;
-      if (!ICUTokenize(text_unicode, &result)) {
-        return {};
+      const int first_token = tokens->size();
+      if (!ICUTokenize(text_unicode, codepoint_offset, tokens)) {
+        tokens->erase(tokens->begin() + first_token, tokens->end());
+        return;
       }
       if (type_ == TokenizationType_MIXED) {
-        InternalRetokenize(text_unicode, &result);
+        InternalRetokenize(text_unicode, codepoint_offset, first_token, tokens);
       }
-      return result;
+      return;
     }
     default:
       TC3_LOG(ERROR) << "Unknown tokenization type specified. Using internal.";
-      return InternalTokenize(text_unicode);
+      InternalTokenize(text_unicode, codepoint_offset, tokens);
   }
 }
 
-std::vector<Token> Tokenizer::InternalTokenize(
-    const UnicodeText& text_unicode) const {
-  std::vector<Token> result;
-  Token new_token("", 0, 0);
+void Tokenizer::Tokenize(StringPiece text,
+                         std::vector<TokenRef>* tokens) const {
+  const UnicodeText text_unicode =
+      UTF8ToUnicodeText(text.data(), text.size(), /*do_copy=*/false);
+  Tokenize(text_unicode, tokens);
+}
+
+void Tokenizer::Tokenize(const UnicodeText& text_unicode,
+                         std::vector<TokenRef>* tokens) const {
+  tokens->clear();
+  if (type_ != TokenizationType_ICU && type_ != TokenizationType_MIXED) {
+    if (type_ != TokenizationType_INTERNAL_TOKENIZER) {
+      TC3_LOG(ERROR) << "Unknown tokenization type specified. Using internal.";
+    }
+    InternalTokenize(text_unicode, tokens);
+    return;
+  }
+
+  // The ICU tokenization produces owned tokens, find their text in the input.
+  const std::vector<Token> owned_tokens = Tokenize(text_unicode);
+  tokens->reserve(owned_tokens.size());
+  const char* buffer = text_unicode.begin().utf8_data();
+  auto it = text_unicode.begin();
   int codepoint_index = 0;
+  for (const Token& token : owned_tokens) {
+    if (token.start < codepoint_index) {
+      it = text_unicode.begin();
+      codepoint_index = 0;
+    }
+    std::advance(it, token.start - codepoint_index);
+    const char* token_begin = it.utf8_data();
+    std::advance(it, token.end - token.start);
+    codepoint_index = token.end;
+    tokens->emplace_back(buffer, token_begin - buffer,
+                         it.utf8_data() - token_begin, token.start, token.end);
+  }
+}
+
+namespace {
+
+// Collects the output of the internal tokenizer into tokens that own a copy of
+// their text, with their bounds shifted by an offset.
+class OwningTokenSink {
+ public:
+  OwningTokenSink(int codepoint_offset, std::vector<Token>* tokens)
+      : codepoint_offset_(codepoint_offset),
+        tokens_(tokens),
+        token_("", codepoint_offset, codepoint_offset) {}
+
+  void AddCodepoint(const char* utf8_data, int num_bytes) {
+    token_.value.append(utf8_data, num_bytes);
+    ++token_.end;
+  }
+
+  void FinishToken(CodepointIndex next_token_start) {
+    if (!token_.value.empty()) {
+      tokens_->push_back(std::move(token_));
+    }
+    token_ = Token("", next_token_start + codepoint_offset_,
+                   next_token_start + codepoint_offset_);
+  }
+
+ private:
+  const int codepoint_offset_;
+  std::vector<Token>* const tokens_;
+  Token token_;
+};
 
+// Collects the output of the internal tokenizer into tokens that reference
+// their text in the input buffer.
+class TokenRefSink {
+ public:
+  TokenRefSink(const char* buffer, std::vector<TokenRef>* tokens)
+      : buffer_(buffer), tokens_(tokens) {}
+
+  void AddCodepoint(const char* utf8_data, int num_bytes) {
+    if (token_begin_ == nullptr) {
+      token_begin_ = utf8_data;
+    }
+    token_end_ = utf8_data + num_bytes;
+    ++token_end_index_;
+  }
+
+  void FinishToken(CodepointIndex next_token_start) {
+    if (token_begin_ != nullptr) {
+      tokens_->emplace_back(buffer_, token_begin_ - buffer_,
+                            token_end_ - token_begin_, token_start_,
+                            token_end_index_);
+    }
+    token_begin_ = nullptr;
+    token_start_ = next_token_start;
+    token_end_index_ = next_token_start;
+  }
+
+ private:
+  const char* const buffer_;
+  std::vector<TokenRef>* const tokens_;
+
+  // The token being built, which is empty until its first codepoint is kept.
+  const char* token_begin_ = nullptr;
+  const char* token_end_ = nullptr;
+  CodepointIndex token_start_ = 0;
+  CodepointIndex token_end_index_ = 0;
+};
+
+}  // namespace
+
+template <typename TokenSink>
+void Tokenizer::InternalTokenizeImpl(const UnicodeText& text_unicode,
+                                     TokenSink* sink) const {
+  const char* it = text_unicode.data();
+  const char* const end = it + text_unicode.size_bytes();
+
+  // End of the run of ASCII bytes at the current position. These are
+  // classified with a table lookup, without decoding them.
+  const char* ascii_end = it;
+
+  int codepoint_index = 0;
   int last_script = kInvalidScript;
-  for (auto it = text_unicode.begin(); it != text_unicode.end();
-       ++it, ++codepoint_index) {
+  while (it < end) {
+    if (it >= ascii_end) {
+      ascii_end = it + GetNumLeadingAsciiBytes(it, end - it);
+    }
+
     TokenizationCodepointRange_::Role role;
     int script;
-    GetScriptAndRole(*it, &role, &script);
+    int num_bytes;
+    if (it < ascii_end) {
+      const int codepoint = *it;
+      role = ascii_roles_[codepoint];
+      script = ascii_scripts_[codepoint];
+      num_bytes = 1;
+    } else {
+      GetScriptAndRole(ValidCharToRune(it), &role, &script);
+      num_bytes = GetNumBytesForNonZeroUTF8Char(it);
+    }
 
     if (role & TokenizationCodepointRange_::Role_SPLIT_BEFORE ||
         (split_on_script_change_ && last_script != kInvalidScript &&
          last_script != script)) {
-      if (!new_token.value.empty()) {
-        result.push_back(new_token);
-      }
-      new_token = Token("", codepoint_index, codepoint_index);
+      sink->FinishToken(codepoint_index);
     }
     if (!(role & TokenizationCodepointRange_::Role_DISCARD_CODEPOINT)) {
-      new_token.value += std::string(
-          it.utf8_data(),
-          it.utf8_data() + GetNumBytesForNonZeroUTF8Char(it.utf8_data()));
-      ++new_token.end;
+      sink->AddCodepoint(it, num_bytes);
     }
     if (role & TokenizationCodepointRange_::Role_SPLIT_AFTER) {
-      if (!new_token.value.empty()) {
-        result.push_back(new_token);
-      }
-      new_token = Token("", codepoint_index + 1, codepoint_index + 1);
+      sink->FinishToken(codepoint_index + 1);
     }
 
     last_script = script;
+    it += num_bytes;
+    ++codepoint_index;
   }
-  if (!new_token.value.empty()) {
-    result.push_back(new_token);
-  }
+  sink->FinishToken(codepoint_index);
+}
 
-  return result;
+void Tokenizer::InternalTokenize(const UnicodeText& text_unicode,
+                                 const int codepoint_offset,
+                                 std::vector<Token>* tokens) const {
+  OwningTokenSink sink(codepoint_offset, tokens);
+  InternalTokenizeImpl(text_unicode, &sink);
+}
+
+void Tokenizer::InternalTokenize(const UnicodeText& text_unicode,
+                                 std::vector<TokenRef>* tokens) const {
+  TokenRefSink sink(text_unicode.data(), tokens);
+  InternalTokenizeImpl(text_unicode, &sink);
 }
 
 void Tokenizer::TokenizeSubstring(const UnicodeText& unicode_text,
                                   CodepointSpan span,
+                                  const int codepoint_offset,
                                   std::vector<Token>* result) const {
   if (span.first < 0) {
     // There is no span to tokenize.
@@ -169,52 +343,59 @@ void Tokenizer::TokenizeSubstring(const UnicodeText& unicode_text,
   UnicodeText text = UnicodeText::Substring(unicode_text, span.first,
                                             span.second, /*do_copy=*/false);
 
-  // Run the tokenizer and update the token bounds to reflect the offset of the
-  // substring.
-  std::vector<Token> tokens = InternalTokenize(text);
-
-  // Avoids progressive capacity increases in the for loop.
-  result->reserve(result->size() + tokens.size());
-  for (Token& token : tokens) {
-    token.start += span.first;
-    token.end += span.first;
-    result->emplace_back(std::move(token));
-  }
+  // The token bounds are shifted by the offset of the substring as they are
+  // added.
+  InternalTokenize(text, span.first + codepoint_offset, result);
 }
 
 void Tokenizer::InternalRetokenize(const UnicodeText& unicode_text,
+                                   const int codepoint_offset,
+                                   const int first_token,
                                    std::vector<Token>* tokens) const {
-  std::vector<Token> result;
-  CodepointSpan span(-1, -1);
-  for (Token& token : *tokens) {
+  const auto should_retokenize = [this](const Token& token) {
     const UnicodeText unicode_token_value =
         UTF8ToUnicodeText(token.value, /*do_copy=*/false);
-    bool should_retokenize = true;
     for (const int codepoint : unicode_token_value) {
       if (!IsCodepointInRanges(codepoint,
                                internal_tokenizer_codepoint_ranges_)) {
-        should_retokenize = false;
-        break;
+        return false;
       }
     }
+    return true;
+  };
+
+  // Nothing to do, and so nothing to allocate, if no token is retokenized.
+  if (std::none_of(tokens->begin() + first_token, tokens->end(),
+                   should_retokenize)) {
+    return;
+  }
 
-    if (should_retokenize) {
+  std::vector<Token> result;
+  CodepointSpan span(-1, -1);
+  for (auto it = tokens->begin() + first_token; it != tokens->end(); ++it) {
+    Token& token = *it;
+    if (should_retokenize(token)) {
+      // The span is relative to 'unicode_text', not shifted by the offset.
       if (span.first < 0) {
-        span.first = token.start;
+        span.first = token.start - codepoint_offset;
       }
-      span.second = token.end;
+      span.second = token.end - codepoint_offset;
     } else {
-      TokenizeSubstring(unicode_text, span, &result);
+      TokenizeSubstring(unicode_text, span, codepoint_offset, &result);
       span.first = -1;
       result.emplace_back(std::move(token));
     }
   }
-  TokenizeSubstring(unicode_text, span, &result);
+  TokenizeSubstring(unicode_text, span, codepoint_offset, &result);
 
-  *tokens = std::move(result);
+  // Replaces the retokenized tokens in place, keeping the ones before them.
+  tokens->erase(tokens->begin() + first_token, tokens->end());
+  tokens->insert(tokens->end(), std::make_move_iterator(result.begin()),
+                 std::make_move_iterator(result.end()));
 }
 
 bool Tokenizer::ICUTokenize(const UnicodeText& context_unicode,
+                            const int codepoint_offset,
                             std::vector<Token>* result) const {
   std::unique_ptr<UniLib::BreakIterator> break_iterator =
       unilib_->CreateBreakIterator(context_unicode);
@@ -247,7 +428,8 @@ bool Tokenizer::ICUTokenize(const UnicodeText& context_unicode,
         context_unicode.UTF8Substring(token_begin_it, token_end_it);
 
     if (!is_whitespace || icu_preserve_whitespace_tokens_) {
-      result->push_back(Token(token, last_unicode_index, unicode_index));
+      result->push_back(Token(token, last_unicode_index + codepoint_offset,
+                              unicode_index + codepoint_offset));
     }
 
     last_break_index = break_index;
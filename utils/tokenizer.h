@@ -23,7 +23,9 @@
 #include "annotator/types.h"
 #include "utils/base/integral_types.h"
 #include "utils/codepoint-range.h"
+#include "utils/strings/stringpiece.h"
 #include "utils/tokenizer_generated.h"
+#include "utils/utf8/bmp-lookup-table.h"
 #include "utils/utf8/unicodetext.h"
 #include "utils/utf8/unilib.h"
 
@@ -68,11 +70,35 @@ class Tokenizer {
   // Same as above but takes UnicodeText.
   std::vector<Token> Tokenize(const UnicodeText& text_unicode) const;
 
+  // Same as above, but appends the tokens to a caller-owned vector, with their
+  // bounds shifted by 'codepoint_offset', e.g. the offset of a line in the
+  // context. Clearing the vector between calls, instead of taking a new one,
+  // reuses its storage, so that repeated tokenizations don't reallocate it.
+  void Tokenize(const UnicodeText& text_unicode, int codepoint_offset,
+                std::vector<Token>* tokens) const;
+
+  // Same as above, but instead of copying the text of the tokens, the tokens
+  // reference it in the input, which needs to outlive them. The tokens are
+  // written to a caller-owned vector, so that its storage can be reused.
+  // NOTE: The text of a token needs to be contiguous, so codepoints that are
+  // discarded by the internal tokenizer without splitting the token are kept
+  // in its text.
+  void Tokenize(StringPiece text, std::vector<TokenRef>* tokens) const;
+
+  // Same as above but takes UnicodeText.
+  void Tokenize(const UnicodeText& text_unicode,
+                std::vector<TokenRef>* tokens) const;
+
  protected:
   // Finds the tokenization codepoint range config for given codepoint.
-  // Internally uses binary search so should be O(log(# of codepoint_ranges)).
+  // Codepoints in the Basic Multilingual Plane are looked up in a table, others
+  // use binary search so should be O(log(# of codepoint_ranges)).
   const TokenizationCodepointRangeT* FindTokenizationRange(int codepoint) const;
 
+  // Same as above, but always uses the binary search.
+  const TokenizationCodepointRangeT* FindTokenizationRangeWithBinarySearch(
+      int codepoint) const;
+
   // Finds the role and script for given codepoint. If not found, DEFAULT_ROLE
   // and kUnknownScript are assigned.
   void GetScriptAndRole(char32 codepoint,
@@ -81,22 +107,48 @@ class Tokenizer {
 
   // Tokenizes a substring of the unicode string, appending the resulting tokens
   // to the output vector. The resulting tokens have bounds relative to the full
-  // string. Does nothing if the start of the span is negative.
+  // string, shifted by 'codepoint_offset'. Does nothing if the start of the
+  // span is negative.
   void TokenizeSubstring(const UnicodeText& unicode_text, CodepointSpan span,
+                         int codepoint_offset,
                          std::vector<Token>* result) const;
 
-  std::vector<Token> InternalTokenize(const UnicodeText& text_unicode) const;
+  // Appends the tokens of the internal tokenizer, with their bounds shifted by
+  // 'codepoint_offset'.
+  void InternalTokenize(const UnicodeText& text_unicode, int codepoint_offset,
+                        std::vector<Token>* tokens) const;
+
+  // Same as above, but produces tokens that reference the input text.
+  void InternalTokenize(const UnicodeText& text_unicode,
+                        std::vector<TokenRef>* tokens) const;
 
-  // Takes the result of ICU tokenization and retokenizes stretches of tokens
-  // made of a specific subset of characters using the internal tokenizer.
+  // Takes the result of ICU tokenization, the tokens from 'first_token' on,
+  // and retokenizes stretches of tokens made of a specific subset of
+  // characters using the internal tokenizer.
   void InternalRetokenize(const UnicodeText& unicode_text,
+                          int codepoint_offset, int first_token,
                           std::vector<Token>* tokens) const;
 
-  // Tokenizes the input text using ICU tokenizer.
-  bool ICUTokenize(const UnicodeText& context_unicode,
+  // Tokenizes the input text using ICU tokenizer, appending the tokens with
+  // their bounds shifted by 'codepoint_offset'.
+  bool ICUTokenize(const UnicodeText& context_unicode, int codepoint_offset,
                    std::vector<Token>* result) const;
 
  private:
+  // Fills the lookup table of the Basic Multilingual Plane codepoints from
+  // codepoint_ranges_.
+  void BuildBmpLookupTable();
+
+  // Runs the internal tokenizer on the text. For each token, calls
+  // sink->AddCodepoint(utf8_data, num_bytes) for the codepoints kept in it and
+  // then sink->FinishToken(next_token_start). FinishToken is also called at
+  // boundaries where the current token is still empty.
+  template <typename TokenSink>
+  void InternalTokenizeImpl(const UnicodeText& text_unicode,
+                            TokenSink* sink) const;
+
+  static constexpr int kNumAsciiCodepoints = 128;
+
   const TokenizationType type_;
 
   const UniLib* unilib_;
@@ -106,6 +158,16 @@ class Tokenizer {
   std::vector<std::unique_ptr<const TokenizationCodepointRangeT>>
       codepoint_ranges_;
 
+  // The index in codepoint_ranges_ plus one of the range of each codepoint in
+  // the Basic Multilingual Plane, or 0 if there is no range. Empty if the table
+  // isn't used.
+  BmpLookupTable<uint16> bmp_ranges_;
+
+  // Roles and scripts of the ASCII codepoints, which the internal tokenizer
+  // looks up without decoding the text.
+  TokenizationCodepointRange_::Role ascii_roles_[kNumAsciiCodepoints];
+  int ascii_scripts_[kNumAsciiCodepoints];
+
   // Codepoint ranges that define which tokens (consisting of which codepoints)
   // should be re-tokenized with the internal tokenizer in the mixed
   // tokenization mode.
@@ -16,8 +16,11 @@
 
 #include "utils/tokenizer.h"
 
+#include <string>
+#include <utility>
 #include <vector>
 
+#include "utils/testing/worst-case-search.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
@@ -40,6 +43,7 @@ class TestingTokenizer : public Tokenizer {
                   icu_preserve_whitespace_tokens) {}
 
   using Tokenizer::FindTokenizationRange;
+  using Tokenizer::FindTokenizationRangeWithBinarySearch;
 };
 
 class TestingTokenizerProxy {
@@ -89,10 +93,28 @@ class TestingTokenizerProxy {
     }
   }
 
+  // Whether the table lookup and the binary search find the same range.
+  bool TestLookupMatchesBinarySearch(int c) const {
+    return tokenizer_->FindTokenizationRange(c) ==
+           tokenizer_->FindTokenizationRangeWithBinarySearch(c);
+  }
+
   std::vector<Token> Tokenize(const std::string& utf8_text) const {
     return tokenizer_->Tokenize(utf8_text);
   }
 
+  void TokenizeInto(const std::string& utf8_text, int codepoint_offset,
+                    std::vector<Token>* tokens) const {
+    tokenizer_->Tokenize(UTF8ToUnicodeText(utf8_text, /*do_copy=*/false),
+                         codepoint_offset, tokens);
+  }
+
+  std::vector<TokenRef> TokenizeToRefs(const std::string& utf8_text) const {
+    std::vector<TokenRef> tokens;
+    tokenizer_->Tokenize(utf8_text, &tokens);
+    return tokens;
+  }
+
  private:
   UniLib unilib_;
   std::vector<flatbuffers::DetachedBuffer> buffers_;
@@ -156,6 +178,35 @@ TEST(TokenizerTest, FindTokenizationRange) {
             TokenizationCodepointRange_::Role_DEFAULT_ROLE);
 }
 
+TEST(TokenizerTest, FindTokenizationRangeMatchesBinarySearch) {
+  std::vector<TokenizationCodepointRangeT> configs;
+  TokenizationCodepointRangeT* config;
+
+  // Ranges inside a page, across page boundaries and beyond the Basic
+  // Multilingual Plane.
+  for (const std::pair<int, int>& range :
+       std::vector<std::pair<int, int>>{{0, 10},
+                                        {32, 33},
+                                        {250, 300},
+                                        {0x3000, 0x3100},
+                                        {0xFFF0, 0x10010},
+                                        {0x1F600, 0x1F650}}) {
+    configs.emplace_back();
+    config = &configs.back();
+    config->start = range.first;
+    config->end = range.second;
+    config->role = TokenizationCodepointRange_::Role_TOKEN_SEPARATOR;
+  }
+
+  TestingTokenizerProxy tokenizer(TokenizationType_INTERNAL_TOKENIZER, configs,
+                                  {}, /*split_on_script_change=*/false,
+                                  /*icu_preserve_whitespace_tokens=*/false);
+
+  for (int c = 0; c < 0x20000; ++c) {
+    ASSERT_TRUE(tokenizer.TestLookupMatchesBinarySearch(c)) << c;
+  }
+}
+
 TEST(TokenizerTest, TokenizeOnSpace) {
   std::vector<TokenizationCodepointRangeT> configs;
   TokenizationCodepointRangeT* config;
@@ -177,6 +228,50 @@ TEST(TokenizerTest, TokenizeOnSpace) {
               ElementsAreArray({Token("Hello", 0, 5), Token("world!", 6, 12)}));
 }
 
+TEST(TokenizerTest, TokenizeLongAsciiRunsAndNonAscii) {
+  std::vector<TokenizationCodepointRangeT> configs;
+  TokenizationCodepointRangeT* config;
+
+  configs.emplace_back();
+  config = &configs.back();
+  // Space character.
+  config->start = 32;
+  config->end = 33;
+  config->role = TokenizationCodepointRange_::Role_WHITESPACE_SEPARATOR;
+
+  configs.emplace_back();
+  config = &configs.back();
+  // Comma.
+  config->start = 44;
+  config->end = 45;
+  config->role = TokenizationCodepointRange_::Role_TOKEN_SEPARATOR;
+
+  configs.emplace_back();
+  config = &configs.back();
+  // Ideographic space.
+  config->start = 0x3000;
+  config->end = 0x3001;
+  config->role = TokenizationCodepointRange_::Role_WHITESPACE_SEPARATOR;
+
+  TestingTokenizerProxy tokenizer(TokenizationType_INTERNAL_TOKENIZER, configs,
+                                  {},
+                                  /*split_on_script_change=*/false,
+                                  /*icu_preserve_whitespace_tokens=*/false);
+  const std::string text =
+      "Supercalifragilisticexpialidocious, héllo\u3000wörld 1234567890123456";
+  EXPECT_THAT(tokenizer.Tokenize(text),
+              ElementsAreArray({Token("Supercalifragilisticexpialidocious", 0,
+                                      34),
+                                Token(",", 34, 35), Token("héllo", 36, 41),
+                                Token("wörld", 42, 47),
+                                Token("1234567890123456", 48, 64)}));
+
+  const std::vector<TokenRef> token_refs = tokenizer.TokenizeToRefs(text);
+  ASSERT_EQ(token_refs.size(), 5);
+  EXPECT_EQ(token_refs[2].ToToken(), Token("héllo", 36, 41));
+  EXPECT_EQ(token_refs[4].ToToken(), Token("1234567890123456", 48, 64));
+}
+
 TEST(TokenizerTest, TokenizeOnSpaceAndScriptChange) {
   std::vector<TokenizationCodepointRangeT> configs;
   TokenizationCodepointRangeT* config;
@@ -212,6 +307,68 @@ TEST(TokenizerTest, TokenizeOnSpaceAndScriptChange) {
                                   Token("웹사이트", 23, 28)}));
 }  // namespace
 
+TEST(TokenizerTest, TokenizeToRefsMatchesTokenize) {
+  std::vector<TokenizationCodepointRangeT> configs;
+  TokenizationCodepointRangeT* config;
+
+  configs.emplace_back();
+  config = &configs.back();
+  config->start = 0;
+  config->end = 32;
+  config->role = TokenizationCodepointRange_::Role_DEFAULT_ROLE;
+  config->script_id = 1;
+  configs.emplace_back();
+  config = &configs.back();
+  config->start = 32;
+  config->end = 33;
+  config->role = TokenizationCodepointRange_::Role_WHITESPACE_SEPARATOR;
+  config->script_id = 1;
+  configs.emplace_back();
+  config = &configs.back();
+  config->start = 33;
+  config->end = 0x77F + 1;
+  config->role = TokenizationCodepointRange_::Role_DEFAULT_ROLE;
+  config->script_id = 1;
+
+  TestingTokenizerProxy tokenizer(TokenizationType_INTERNAL_TOKENIZER, configs,
+                                  {},
+                                  /*split_on_script_change=*/true,
+                                  /*icu_preserve_whitespace_tokens=*/false);
+  const std::string text = "앨라배마 주 전화(123)  456-789웹사이트";
+  const std::vector<Token> tokens = tokenizer.Tokenize(text);
+  const std::vector<TokenRef> token_refs = tokenizer.TokenizeToRefs(text);
+
+  ASSERT_EQ(token_refs.size(), tokens.size());
+  for (int i = 0; i < tokens.size(); ++i) {
+    EXPECT_EQ(token_refs[i].buffer, text.data());
+    EXPECT_EQ(token_refs[i].ToToken(), tokens[i]);
+  }
+}
+
+TEST(TokenizerTest, TokenizeIntoReusesStorage) {
+  std::vector<TokenizationCodepointRangeT> configs;
+  configs.emplace_back();
+  configs.back().start = 32;
+  configs.back().end = 33;
+  configs.back().role = TokenizationCodepointRange_::Role_WHITESPACE_SEPARATOR;
+  TestingTokenizerProxy tokenizer(TokenizationType_INTERNAL_TOKENIZER, configs,
+                                  {},
+                                  /*split_on_script_change=*/false,
+                                  /*icu_preserve_whitespace_tokens=*/false);
+
+  std::vector<Token> tokens;
+  tokenizer.TokenizeInto("Hello world", /*codepoint_offset=*/3, &tokens);
+  EXPECT_EQ(tokens, std::vector<Token>(
+                        {Token("Hello", 3, 8), Token("world", 9, 14)}));
+
+  const Token* storage = tokens.data();
+  tokens.clear();
+  tokenizer.TokenizeInto("Bye you", /*codepoint_offset=*/0, &tokens);
+  EXPECT_EQ(tokens,
+            std::vector<Token>({Token("Bye", 0, 3), Token("you", 4, 7)}));
+  EXPECT_EQ(tokens.data(), storage);
+}
+
 TEST(TokenizerTest, TokenizeComplex) {
   std::vector<TokenizationCodepointRangeT> configs;
   TokenizationCodepointRangeT* config;
@@ -399,6 +556,20 @@ TEST(TokenizerTest, ICUTokenizeWithWhitespaces) {
   // clang-format on
 }
 
+TEST(TokenizerTest, ICUTokenizeToRefs) {
+  TestingTokenizerProxy tokenizer(TokenizationType_ICU, {}, {},
+                                  /*split_on_script_change=*/false,
+                                  /*icu_preserve_whitespace_tokens=*/false);
+  const std::string text = "พระบาทสมเด็จพระปรมิ ndr";
+  const std::vector<Token> tokens = tokenizer.Tokenize(text);
+  const std::vector<TokenRef> token_refs = tokenizer.TokenizeToRefs(text);
+
+  ASSERT_EQ(token_refs.size(), tokens.size());
+  for (int i = 0; i < tokens.size(); ++i) {
+    EXPECT_EQ(token_refs[i].ToToken(), tokens[i]);
+  }
+}
+
 TEST(TokenizerTest, MixedTokenize) {
   std::vector<TokenizationCodepointRangeT> configs;
   TokenizationCodepointRangeT* config;
@@ -449,6 +620,32 @@ TEST(TokenizerTest, MixedTokenize) {
   // clang-format on
 }
 
+TEST(TokenizerTest, MixedTokenizeAppendsWithOffset) {
+  std::vector<TokenizationCodepointRangeT> configs;
+  configs.emplace_back();
+  configs.back().start = 32;
+  configs.back().end = 33;
+  configs.back().role = TokenizationCodepointRange_::Role_WHITESPACE_SEPARATOR;
+  std::vector<CodepointRangeT> internal_configs;
+  internal_configs.emplace_back();
+  internal_configs.back().start = 0;
+  internal_configs.back().end = 592;
+  TestingTokenizerProxy tokenizer(TokenizationType_MIXED, configs,
+                                  internal_configs,
+                                  /*split_on_script_change=*/false,
+                                  /*icu_preserve_whitespace_tokens=*/false);
+
+  const std::string text = "世界 Japanese-ląnguagę text";
+  std::vector<Token> tokens = {Token("first", 0, 5)};
+  tokenizer.TokenizeInto(text, /*codepoint_offset=*/10, &tokens);
+
+  std::vector<Token> expected = {Token("first", 0, 5)};
+  for (const Token& token : tokenizer.Tokenize(text)) {
+    expected.push_back(Token(token.value, token.start + 10, token.end + 10));
+  }
+  EXPECT_EQ(tokens, expected);
+}
+
 TEST(TokenizerTest, InternalTokenizeOnScriptChange) {
   std::vector<TokenizationCodepointRangeT> configs;
   TokenizationCodepointRangeT* config;
@@ -481,5 +678,29 @@ TEST(TokenizerTest, InternalTokenizeOnScriptChange) {
 }
 #endif
 
+TEST(TokenizerTest, TokenizesWorstCaseInputsWithinTimeBudget) {
+  // Generous, to only catch inputs that became superlinear: a linear
+  // tokenization takes well under 0.1us per byte.
+  constexpr double kMaxUsPerByte = 1.0;
+  std::vector<TokenizationCodepointRangeT> configs;
+  configs.emplace_back();
+  configs.back().start = 32;
+  configs.back().end = 33;
+  configs.back().role = TokenizationCodepointRange_::Role_WHITESPACE_SEPARATOR;
+  TestingTokenizerProxy tokenizer(TokenizationType_INTERNAL_TOKENIZER, configs,
+                                  {},
+                                  /*split_on_script_change=*/false,
+                                  /*icu_preserve_whitespace_tokens=*/false);
+
+  for (int i = 0; i < kNumWorstCaseInputs; ++i) {
+    const WorstCaseInput input = static_cast<WorstCaseInput>(i);
+    const std::string text = WorstCaseInputText(input, 64 * 1024);
+    const double time_us =
+        MinTimeUs(/*num_repetitions=*/3, [&]() { tokenizer.Tokenize(text); });
+    EXPECT_LE(time_us / text.size(), kMaxUsPerByte)
+        << WorstCaseInputName(input);
+  }
+}
+
 }  // namespace
 }  // namespace libtextclassifier3
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Lookup table of a small value (e.g. a script) per codepoint of the Basic
+// Multilingual Plane, for the per-codepoint classifications on the hot paths
+// of the tokenizer and of LangId.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_UTF8_BMP_LOOKUP_TABLE_H_
+#define LIBTEXTCLASSIFIER_UTILS_UTF8_BMP_LOOKUP_TABLE_H_
+
+#include <map>
+#include <vector>
+
+#include "utils/base/integral_types.h"
+#include "utils/base/logging.h"
+
+namespace libtextclassifier3 {
+
+// Two-level table: the high byte of the codepoint selects a page of 256
+// values and its low byte the value in the page. Identical pages, e.g. the
+// ones of a single script or of unassigned codepoints, are only stored once,
+// so that the table of a few dozen scripts is a few KB and the pages of the
+// text being processed stay in the cache. The first page, which holds the
+// ASCII values, is stored first.
+template <typename Value>
+class BmpLookupTable {
+ public:
+  static constexpr int kNumCodepoints = 0x10000;
+
+  // An empty table.
+  BmpLookupTable() = default;
+
+  // Builds the table from value_of(codepoint) for each codepoint of the Basic
+  // Multilingual Plane.
+  template <typename ValueOf>
+  explicit BmpLookupTable(ValueOf value_of) {
+    std::map<std::vector<Value>, int> page_indices;
+    page_index_.reserve(kNumCodepoints / kPageSize);
+    std::vector<Value> page(kPageSize);
+    for (int page_start = 0; page_start < kNumCodepoints;
+         page_start += kPageSize) {
+      for (int i = 0; i < kPageSize; ++i) {
+        page[i] = value_of(page_start + i);
+      }
+      auto it = page_indices.find(page);
+      if (it == page_indices.end()) {
+        it = page_indices.emplace(page, page_indices.size()).first;
+        pages_.insert(pages_.end(), page.begin(), page.end());
+      }
+      page_index_.push_back(it->second);
+    }
+  }
+
+  bool empty() const { return page_index_.empty(); }
+
+  // Returns the value of a codepoint in [0, kNumCodepoints). The table must
+  // not be empty.
+  Value Get(int codepoint) const {
+    TC3_DCHECK(codepoint >= 0 && codepoint < kNumCodepoints);
+    return pages_[page_index_[codepoint >> kPageBits] * kPageSize +
+                  (codepoint & (kPageSize - 1))];
+  }
+
+  // Returns the value of an ASCII byte, without the page indirection.
+  Value GetAscii(unsigned char byte) const {
+    TC3_DCHECK_LT(byte, 0x80);
+    return pages_[byte];
+  }
+
+  // Size of the table.
+  int64 bytes() const {
+    return page_index_.size() * sizeof(uint16) + pages_.size() * sizeof(Value);
+  }
+
+ private:
+  static constexpr int kPageBits = 8;
+  static constexpr int kPageSize = 1 << kPageBits;
+
+  // Index in pages_, in pages, of the page of each high byte.
+  std::vector<uint16> page_index_;
+  std::vector<Value> pages_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_UTF8_BMP_LOOKUP_TABLE_H_
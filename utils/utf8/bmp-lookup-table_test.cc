@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/utf8/bmp-lookup-table.h"
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+// A few scripts in ranges, as in the script data of LangId.
+uint8 TestScript(int codepoint) {
+  if (codepoint < 0x80) {
+    return codepoint >= 'a' && codepoint <= 'z' ? 1 : 0;
+  }
+  if (codepoint >= 0x400 && codepoint < 0x500) {
+    return 2;
+  }
+  if (codepoint >= 0x4E00 && codepoint < 0xA000) {
+    return 3;
+  }
+  return 0;
+}
+
+TEST(BmpLookupTableTest, ReturnsValueOfEachCodepoint) {
+  const BmpLookupTable<uint8> table(TestScript);
+  ASSERT_FALSE(table.empty());
+  for (int codepoint = 0; codepoint < BmpLookupTable<uint8>::kNumCodepoints;
+       ++codepoint) {
+    EXPECT_EQ(table.Get(codepoint), TestScript(codepoint)) << codepoint;
+  }
+  for (int byte = 0; byte < 0x80; ++byte) {
+    EXPECT_EQ(table.GetAscii(byte), TestScript(byte)) << byte;
+  }
+}
+
+TEST(BmpLookupTableTest, StoresIdenticalPagesOnce) {
+  const BmpLookupTable<uint8> table(TestScript);
+
+  // The ASCII page, the empty page, the Cyrillic page and the Han page.
+  EXPECT_EQ(table.bytes(), 256 * sizeof(uint16) + 4 * 256 * sizeof(uint8));
+}
+
+TEST(BmpLookupTableTest, IsEmptyByDefault) {
+  EXPECT_TRUE(BmpLookupTable<uint16>().empty());
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/utf8/codepoint-offsets.h"
+
+namespace libtextclassifier3 {
+
+constexpr int CodepointOffsetIndex::kBlockBits;
+constexpr int CodepointOffsetIndex::kBlockSize;
+
+CodepointOffsetIndex::CodepointOffsetIndex(const UnicodeText& text) {
+  // Every UTF-8 sequence takes at least one byte.
+  block_starts_.reserve((text.size_bytes() >> kBlockBits) + 1);
+  for (auto it = text.begin(); it != text.end(); ++it, ++num_codepoints_) {
+    if ((num_codepoints_ & (kBlockSize - 1)) == 0) {
+      block_starts_.push_back(it);
+    }
+  }
+
+  // Make the offset one past the end addressable too.
+  if ((num_codepoints_ & (kBlockSize - 1)) == 0) {
+    block_starts_.push_back(text.end());
+  }
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_UTF8_CODEPOINT_OFFSETS_H_
+#define LIBTEXTCLASSIFIER_UTILS_UTF8_CODEPOINT_OFFSETS_H_
+
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "utils/utf8/unicodetext.h"
+
+namespace libtextclassifier3 {
+
+// Translates codepoint offsets into a text into iterators in constant time,
+// for the callers that look up many spans of one long text, which would
+// otherwise walk to every span from the beginning of the text.
+//
+// The text is split into blocks of 64 codepoints, and the iterator at the
+// start of each block is stored, so a lookup walks at most 63 codepoints.
+// The index points into the text, which needs to outlive it and not change.
+class CodepointOffsetIndex {
+ public:
+  explicit CodepointOffsetIndex(const UnicodeText& text);
+
+  // Length of the text in codepoints.
+  int num_codepoints() const { return num_codepoints_; }
+
+  // Returns the iterator at the codepoint offset, which needs to be in
+  // [0, num_codepoints()].
+  UnicodeText::const_iterator IteratorAt(int codepoint_offset) const {
+    UnicodeText::const_iterator it =
+        block_starts_[codepoint_offset >> kBlockBits];
+    std::advance(it, codepoint_offset & (kBlockSize - 1));
+    return it;
+  }
+
+  // Returns the UTF-8 text between the codepoint offsets.
+  std::string UTF8Substring(int begin_codepoint, int end_codepoint) const {
+    return UnicodeText::UTF8Substring(IteratorAt(begin_codepoint),
+                                      IteratorAt(end_codepoint));
+  }
+
+ private:
+  static constexpr int kBlockBits = 6;
+  static constexpr int kBlockSize = 1 << kBlockBits;
+
+  int num_codepoints_ = 0;
+
+  // The iterator at the start of each block.
+  std::vector<UnicodeText::const_iterator> block_starts_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_UTF8_CODEPOINT_OFFSETS_H_
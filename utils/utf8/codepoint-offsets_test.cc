@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/utf8/codepoint-offsets.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(CodepointOffsetIndexTest, EmptyText) {
+  const UnicodeText text = UTF8ToUnicodeText("", /*do_copy=*/false);
+  const CodepointOffsetIndex index(text);
+  EXPECT_EQ(index.num_codepoints(), 0);
+  EXPECT_TRUE(index.IteratorAt(0) == text.end());
+}
+
+TEST(CodepointOffsetIndexTest, MatchesAdvancingFromTheBeginning) {
+  std::string utf8;
+  for (int i = 0; i < 200; ++i) {
+    utf8 += (i % 3 == 0) ? "😋" : (i % 3 == 1) ? "ü" : "a";
+  }
+  const UnicodeText text = UTF8ToUnicodeText(utf8, /*do_copy=*/false);
+  const CodepointOffsetIndex index(text);
+  EXPECT_EQ(index.num_codepoints(), 200);
+
+  UnicodeText::const_iterator it = text.begin();
+  for (int i = 0; i < 200; ++i, ++it) {
+    EXPECT_TRUE(index.IteratorAt(i) == it) << i;
+  }
+  EXPECT_TRUE(index.IteratorAt(200) == text.end());
+}
+
+TEST(CodepointOffsetIndexTest, UTF8Substring) {
+  const UnicodeText text =
+      UTF8ToUnicodeText("Grüße aus 東京 😋!", /*do_copy=*/false);
+  const CodepointOffsetIndex index(text);
+  EXPECT_EQ(index.UTF8Substring(2, 5), "üße");
+  EXPECT_EQ(index.UTF8Substring(10, 12), "東京");
+  EXPECT_EQ(index.UTF8Substring(13, 15), "😋!");
+  EXPECT_EQ(index.UTF8Substring(15, 15), "");
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -0,0 +1,501 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/utf8/unilib-icu.h"
+
+#include <algorithm>
+#include <limits>
+#include <string>
+
+#include "utils/base/logging.h"
+#include "utils/strings/utf8.h"
+#include "unicode/uchar.h"
+#include "unicode/utypes.h"
+
+namespace libtextclassifier3 {
+
+namespace {
+
+icu::UnicodeString ToIcuString(const UnicodeText& text) {
+  return icu::UnicodeString::fromUTF8(
+      icu::StringPiece(text.data(), text.size_bytes()));
+}
+
+}  // namespace
+
+bool UniLib::ParseInt32(const UnicodeText& text, int* result) const {
+  // Follows java.lang.Integer.parseInt: an optional sign followed by decimal
+  // digits of any script.
+  auto it = text.begin();
+  bool negative = false;
+  if (it != text.end() && (*it == '-' || *it == '+')) {
+    negative = *it == '-';
+    ++it;
+  }
+  if (it == text.end()) {
+    return false;
+  }
+
+  int64 value = 0;
+  for (; it != text.end(); ++it) {
+    const int digit = u_charDigitValue(*it);
+    if (digit < 0) {
+      return false;
+    }
+    value = value * 10 + digit;
+    if (value > static_cast<int64>(std::numeric_limits<int32>::max()) +
+                    (negative ? 1 : 0)) {
+      return false;
+    }
+  }
+  *result = negative ? -value : value;
+  return true;
+}
+
+bool UniLib::IsOpeningBracket(char32 codepoint) const {
+  return u_getIntPropertyValue(codepoint, UCHAR_BIDI_PAIRED_BRACKET_TYPE) ==
+         U_BPT_OPEN;
+}
+
+bool UniLib::IsClosingBracket(char32 codepoint) const {
+  return u_getIntPropertyValue(codepoint, UCHAR_BIDI_PAIRED_BRACKET_TYPE) ==
+         U_BPT_CLOSE;
+}
+
+bool UniLib::IsWhitespace(char32 codepoint) const {
+  return u_isWhitespace(codepoint);
+}
+
+bool UniLib::IsDigit(char32 codepoint) const { return u_isdigit(codepoint); }
+
+bool UniLib::IsUpper(char32 codepoint) const { return u_isupper(codepoint); }
+
+char32 UniLib::ToLower(char32 codepoint) const { return u_tolower(codepoint); }
+
+char32 UniLib::GetPairedBracket(char32 codepoint) const {
+  return u_getBidiPairedBracket(codepoint);
+}
+
+std::unique_ptr<UniLib::RegexPattern> UniLib::CreateRegexPattern(
+    const UnicodeText& regex) const {
+  return std::unique_ptr<UniLib::RegexPattern>(
+      new UniLib::RegexPattern(regex, /*lazy=*/false, /*copy_pattern=*/true));
+}
+
+std::unique_ptr<UniLib::RegexPattern> UniLib::CreateLazyRegexPattern(
+    const UnicodeText& regex) const {
+  return std::unique_ptr<UniLib::RegexPattern>(
+      new UniLib::RegexPattern(regex, /*lazy=*/true, /*copy_pattern=*/true));
+}
+
+std::unique_ptr<UniLib::RegexPattern> UniLib::CreateLazyRegexPatternNoCopy(
+    const UnicodeText& regex) const {
+  return std::unique_ptr<UniLib::RegexPattern>(
+      new UniLib::RegexPattern(regex, /*lazy=*/true, /*copy_pattern=*/false));
+}
+
+UniLib::RegexPattern::RegexPattern(const UnicodeText& pattern, bool lazy,
+                                   bool copy_pattern)
+    : initialized_(false), initialization_failure_(false) {
+  if (copy_pattern) {
+    pattern_text_.Copy(pattern);
+  } else {
+    pattern_text_.PointToUTF8(pattern.data(), pattern.size_bytes());
+  }
+  if (!lazy) {
+    LockedInitializeIfNotAlready();
+  }
+}
+
+void UniLib::RegexPattern::LockedInitializeIfNotAlready() const {
+  // Once the initialization was attempted, the flags never change again, so
+  // the calls after the first don't contend on the lock.
+  if (initialized_ || initialization_failure_) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (initialized_ || initialization_failure_) {
+    return;
+  }
+
+#if defined(TC3_UNILIB_RE2)
+  re2::RE2::Options options;
+  options.set_log_errors(false);
+  std::unique_ptr<re2::RE2> re2_pattern(new re2::RE2(
+      re2::StringPiece(pattern_text_.data(), pattern_text_.size_bytes()),
+      options));
+  if (re2_pattern->ok()) {
+    re2_pattern_ = std::move(re2_pattern);
+    pattern_text_.clear();  // We don't need this anymore.
+    initialized_ = true;
+    return;
+  }
+#endif
+
+  UErrorCode status = U_ZERO_ERROR;
+  pattern_.reset(icu::RegexPattern::compile(ToIcuString(pattern_text_),
+                                            /*flags=*/0, status));
+  if (U_FAILURE(status) || pattern_ == nullptr) {
+    TC3_LOG(ERROR) << "Failed to compile regex: " << u_errorName(status);
+    pattern_.reset();
+    initialization_failure_ = true;
+    return;
+  }
+
+  pattern_text_.clear();  // We don't need this anymore.
+  initialized_ = true;
+}
+
+constexpr int UniLib::RegexMatcher::kError;
+constexpr int UniLib::RegexMatcher::kNoError;
+
+bool UniLib::RegexPattern::Compile() const {
+  LockedInitializeIfNotAlready();
+  return !initialization_failure_;
+}
+
+std::unique_ptr<UniLib::RegexMatcher> UniLib::RegexPattern::Matcher(
+    const UnicodeText& context) const {
+  LockedInitializeIfNotAlready();  // Possibly lazy initialization.
+  if (initialization_failure_) {
+    return nullptr;
+  }
+#if defined(TC3_UNILIB_RE2)
+  if (re2_pattern_ != nullptr) {
+    return std::unique_ptr<UniLib::RegexMatcher>(
+        new UniLib::RegexMatcher(re2_pattern_.get(), context));
+  }
+#endif
+  return std::unique_ptr<UniLib::RegexMatcher>(
+      new UniLib::RegexMatcher(pattern_.get(), ToIcuString(context)));
+}
+
+UniLib::RegexMatcher::RegexMatcher(const icu::RegexPattern* pattern,
+                                   icu::UnicodeString text)
+    : text_(std::move(text)) {
+  UErrorCode status = U_ZERO_ERROR;
+  matcher_.reset(pattern->matcher(text_, status));
+  if (U_FAILURE(status)) {
+    matcher_.reset();
+  }
+}
+
+#if defined(TC3_UNILIB_RE2)
+UniLib::RegexMatcher::RegexMatcher(const re2::RE2* pattern,
+                                   const UnicodeText& text)
+    : re2_pattern_(pattern), re2_text_(text.data(), text.size_bytes()) {}
+
+bool UniLib::RegexMatcher::Re2Match(int start_offset,
+                                    re2::RE2::Anchor anchor) {
+  const int num_groups = re2_pattern_->NumberOfCapturingGroups() + 1;
+  re2_groups_.resize(num_groups);
+  if (!re2_pattern_->Match(re2_text_, start_offset, re2_text_.size(), anchor,
+                           re2_groups_.data(), num_groups)) {
+    re2_groups_.clear();
+    return false;
+  }
+  return true;
+}
+
+int UniLib::RegexMatcher::Re2GroupOffset(int group_idx, bool end,
+                                         int* status) const {
+  if (group_idx < 0 || group_idx >= re2_groups_.size()) {
+    *status = kError;
+    return kError;
+  }
+  *status = kNoError;
+  const re2::StringPiece& group = re2_groups_[group_idx];
+  if (group.data() == nullptr) {
+    return -1;
+  }
+  return group.data() - re2_text_.data() + (end ? group.size() : 0);
+}
+#endif
+
+int UniLib::RegexMatcher::ToCodepointOffset(int offset) const {
+#if defined(TC3_UNILIB_RE2)
+  if (re2_pattern_ != nullptr) {
+    // Count the bytes that start a codepoint.
+    const int begin = std::min(offset, last_offset_);
+    const int end = std::max(offset, last_offset_);
+    int num_codepoints = 0;
+    for (int i = begin; i < end; ++i) {
+      if (!IsTrailByte(re2_text_[i])) {
+        ++num_codepoints;
+      }
+    }
+    last_codepoint_offset_ +=
+        offset >= last_offset_ ? num_codepoints : -num_codepoints;
+    last_offset_ = offset;
+    return last_codepoint_offset_;
+  }
+#endif
+  if (offset >= last_offset_) {
+    last_codepoint_offset_ +=
+        text_.countChar32(last_offset_, offset - last_offset_);
+  } else {
+    last_codepoint_offset_ -=
+        text_.countChar32(offset, last_offset_ - offset);
+  }
+  last_offset_ = offset;
+  return last_codepoint_offset_;
+}
+
+bool UniLib::RegexMatcher::Matches(int* status) const {
+#if defined(TC3_UNILIB_RE2)
+  if (re2_pattern_ != nullptr) {
+    *status = kNoError;
+    return re2_pattern_->Match(re2_text_, 0, re2_text_.size(),
+                               re2::RE2::ANCHOR_BOTH, nullptr, 0);
+  }
+#endif
+  if (!matcher_) {
+    *status = kError;
+    return false;
+  }
+
+  UErrorCode icu_status = U_ZERO_ERROR;
+  const bool result = matcher_->matches(icu_status);
+  if (U_FAILURE(icu_status)) {
+    *status = kError;
+    return false;
+  }
+  *status = kNoError;
+  return result;
+}
+
+bool UniLib::RegexMatcher::ApproximatelyMatches(int* status) {
+#if defined(TC3_UNILIB_RE2)
+  if (re2_pattern_ != nullptr) {
+    re2_search_offset_ = 0;
+    if (!Find(status) || *status != kNoError) {
+      return false;
+    }
+    return re2_groups_[0].data() == re2_text_.data() &&
+           re2_groups_[0].size() == re2_text_.size();
+  }
+#endif
+  if (!matcher_) {
+    *status = kError;
+    return false;
+  }
+
+  matcher_->reset();
+  if (!Find(status) || *status != kNoError) {
+    return false;
+  }
+
+  UErrorCode icu_status = U_ZERO_ERROR;
+  const int found_start = matcher_->start(icu_status);
+  const int found_end = matcher_->end(icu_status);
+  if (U_FAILURE(icu_status)) {
+    *status = kError;
+    return false;
+  }
+  return found_start == 0 && found_end == text_.length();
+}
+
+bool UniLib::RegexMatcher::Find(int* status) {
+#if defined(TC3_UNILIB_RE2)
+  if (re2_pattern_ != nullptr) {
+    *status = kNoError;
+    if (re2_search_offset_ > re2_text_.size() ||
+        !Re2Match(re2_search_offset_, re2::RE2::UNANCHORED)) {
+      re2_groups_.clear();
+      re2_search_offset_ = re2_text_.size() + 1;
+      return false;
+    }
+
+    // Continue after the match. After an empty match skip a codepoint, so
+    // that the same empty match isn't found again.
+    const re2::StringPiece& match = re2_groups_[0];
+    re2_search_offset_ = match.data() - re2_text_.data() + match.size();
+    if (match.empty()) {
+      re2_search_offset_ +=
+          re2_search_offset_ < re2_text_.size()
+              ? GetNumBytesForNonZeroUTF8Char(re2_text_.data() +
+                                              re2_search_offset_)
+              : 1;
+    }
+    return true;
+  }
+#endif
+  if (!matcher_) {
+    *status = kError;
+    return false;
+  }
+
+  UErrorCode icu_status = U_ZERO_ERROR;
+  const bool result = matcher_->find(icu_status);
+  if (U_FAILURE(icu_status)) {
+    *status = kError;
+    return false;
+  }
+  *status = kNoError;
+  return result;
+}
+
+int UniLib::RegexMatcher::Start(int* status) const {
+  return Start(/*group_idx=*/0, status);
+}
+
+int UniLib::RegexMatcher::Start(int group_idx, int* status) const {
+  int result;
+#if defined(TC3_UNILIB_RE2)
+  if (re2_pattern_ != nullptr) {
+    result = Re2GroupOffset(group_idx, /*end=*/false, status);
+    if (*status != kNoError) {
+      return kError;
+    }
+  } else  // NOLINT
+#endif
+  {
+    if (!matcher_) {
+      *status = kError;
+      return kError;
+    }
+
+    UErrorCode icu_status = U_ZERO_ERROR;
+    result = matcher_->start(group_idx, icu_status);
+    if (U_FAILURE(icu_status)) {
+      *status = kError;
+      return kError;
+    }
+    *status = kNoError;
+  }
+
+  // The group didn't participate in the match.
+  if (result == -1) {
+    return -1;
+  }
+  return ToCodepointOffset(result);
+}
+
+int UniLib::RegexMatcher::End(int* status) const {
+  return End(/*group_idx=*/0, status);
+}
+
+int UniLib::RegexMatcher::End(int group_idx, int* status) const {
+  int result;
+#if defined(TC3_UNILIB_RE2)
+  if (re2_pattern_ != nullptr) {
+    result = Re2GroupOffset(group_idx, /*end=*/true, status);
+    if (*status != kNoError) {
+      return kError;
+    }
+  } else  // NOLINT
+#endif
+  {
+    if (!matcher_) {
+      *status = kError;
+      return kError;
+    }
+
+    UErrorCode icu_status = U_ZERO_ERROR;
+    result = matcher_->end(group_idx, icu_status);
+    if (U_FAILURE(icu_status)) {
+      *status = kError;
+      return kError;
+    }
+    *status = kNoError;
+  }
+
+  // The group didn't participate in the match.
+  if (result == -1) {
+    return -1;
+  }
+  return ToCodepointOffset(result);
+}
+
+UnicodeText UniLib::RegexMatcher::Group(int* status) const {
+  return Group(/*group_idx=*/0, status);
+}
+
+UnicodeText UniLib::RegexMatcher::Group(int group_idx, int* status) const {
+#if defined(TC3_UNILIB_RE2)
+  if (re2_pattern_ != nullptr) {
+    if (group_idx < 0 || group_idx >= re2_groups_.size()) {
+      *status = kError;
+      return UTF8ToUnicodeText("", /*do_copy=*/false);
+    }
+    *status = kNoError;
+
+    // The group references the input, groups that didn't participate in the
+    // match are empty.
+    const re2::StringPiece& group = re2_groups_[group_idx];
+    return UTF8ToUnicodeText(group.data() == nullptr ? "" : group.data(),
+                             group.size(), /*do_copy=*/false);
+  }
+#endif
+  if (!matcher_) {
+    *status = kError;
+    return UTF8ToUnicodeText("", /*do_copy=*/false);
+  }
+
+  UErrorCode icu_status = U_ZERO_ERROR;
+  const icu::UnicodeString group = matcher_->group(group_idx, icu_status);
+  if (U_FAILURE(icu_status)) {
+    *status = kError;
+    return UTF8ToUnicodeText("", /*do_copy=*/false);
+  }
+
+  // Groups that didn't participate in the match are empty, like in the other
+  // UniLib implementations.
+  std::string result;
+  group.toUTF8String(result);
+  *status = kNoError;
+  return UTF8ToUnicodeText(result, /*do_copy=*/true);
+}
+
+constexpr int UniLib::BreakIterator::kDone;
+
+UniLib::BreakIterator::BreakIterator(const UnicodeText& text)
+    : text_(ToIcuString(text)), last_break_index_(0), last_unicode_index_(0) {
+  UErrorCode status = U_ZERO_ERROR;
+  iterator_.reset(
+      icu::BreakIterator::createWordInstance(icu::Locale::getUS(), status));
+  if (U_FAILURE(status)) {
+    TC3_LOG(ERROR) << "Failed to create break iterator: "
+                   << u_errorName(status);
+    iterator_.reset();
+    return;
+  }
+  iterator_->setText(text_);
+}
+
+int UniLib::BreakIterator::Next() {
+  if (!iterator_) {
+    return BreakIterator::kDone;
+  }
+
+  const int break_index = iterator_->next();
+  if (break_index == icu::BreakIterator::DONE) {
+    return BreakIterator::kDone;
+  }
+
+  last_unicode_index_ +=
+      text_.countChar32(last_break_index_, break_index - last_break_index_);
+  last_break_index_ = break_index;
+  return last_unicode_index_;
+}
+
+std::unique_ptr<UniLib::BreakIterator> UniLib::CreateBreakIterator(
+    const UnicodeText& text) const {
+  return std::unique_ptr<UniLib::BreakIterator>(
+      new UniLib::BreakIterator(text));
+}
+
+}  // namespace libtextclassifier3
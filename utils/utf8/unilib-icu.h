@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// UniLib implementation with the same API as UniLib in unilib-javaicu.h,
+// backed by ICU4C instead of the Java ICU APIs. It doesn't need a JVM, so it
+// can be used in native-only deployments.
+//
+// When built with -DTC3_UNILIB_RE2, regexes whose syntax RE2 supports are run
+// with RE2 directly on the UTF-8 input. The matcher then references the input
+// instead of converting it, and groups are returned without copying them, so
+// the input needs to outlive the matcher and the returned groups. Patterns RE2
+// doesn't support (e.g. with lookarounds or backreferences) use ICU.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_UTF8_UNILIB_ICU_H_
+#define LIBTEXTCLASSIFIER_UTILS_UTF8_UNILIB_ICU_H_
+
+#include <atomic>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <vector>
+
+#include "utils/base/integral_types.h"
+#include "utils/utf8/unicodetext.h"
+#include "unicode/brkiter.h"
+#include "unicode/regex.h"
+#include "unicode/unistr.h"
+
+#if defined(TC3_UNILIB_RE2)
+#include "re2/re2.h"
+#endif
+
+namespace libtextclassifier3 {
+
+class UniLib {
+ public:
+  bool ParseInt32(const UnicodeText& text, int* result) const;
+  bool IsOpeningBracket(char32 codepoint) const;
+  bool IsClosingBracket(char32 codepoint) const;
+  bool IsWhitespace(char32 codepoint) const;
+  bool IsDigit(char32 codepoint) const;
+  bool IsUpper(char32 codepoint) const;
+
+  char32 ToLower(char32 codepoint) const;
+  char32 GetPairedBracket(char32 codepoint) const;
+
+  // Forward declaration for friend.
+  class RegexPattern;
+
+  class RegexMatcher {
+   public:
+    static constexpr int kError = -1;
+    static constexpr int kNoError = 0;
+
+    // Checks whether the input text matches the pattern exactly.
+    bool Matches(int* status) const;
+
+    // Approximate Matches() implementation implemented using Find(). It uses
+    // the first Find() result and then checks that it spans the whole input.
+    // NOTE: Unlike Matches() it can result in false negatives.
+    // NOTE: Resets the matcher, so the current Find() state will be lost.
+    bool ApproximatelyMatches(int* status);
+
+    // Finds occurrences of the pattern in the input text.
+    // Can be called repeatedly to find all occurences. A call will update
+    // internal state, so that 'Start', 'End' and 'Group' can be called to get
+    // information about the match.
+    // NOTE: Any call to ApproximatelyMatches() in between Find() calls will
+    // modify the state.
+    bool Find(int* status);
+
+    // Gets the start offset of the last match (from  'Find').
+    // Sets status to 'kError' if 'Find'
+    // was not called previously.
+    int Start(int* status) const;
+
+    // Gets the start offset of the specified group of the last match.
+    // (from  'Find').
+    // Sets status to 'kError' if an invalid group was specified or if 'Find'
+    // was not called previously.
+    int Start(int group_idx, int* status) const;
+
+    // Gets the end offset of the last match (from  'Find').
+    // Sets status to 'kError' if 'Find'
+    // was not called previously.
+    int End(int* status) const;
+
+    // Gets the end offset of the specified group of the last match.
+    // (from  'Find').
+    // Sets status to 'kError' if an invalid group was specified or if 'Find'
+    // was not called previously.
+    int End(int group_idx, int* status) const;
+
+    // Gets the text of the last match (from 'Find').
+    // Sets status to 'kError' if 'Find' was not called previously.
+    UnicodeText Group(int* status) const;
+
+    // Gets the text of the specified group of the last match (from 'Find').
+    // Sets status to 'kError' if an invalid group was specified or if 'Find'
+    // was not called previously.
+    UnicodeText Group(int group_idx, int* status) const;
+
+   private:
+    friend class RegexPattern;
+    RegexMatcher(const icu::RegexPattern* pattern, icu::UnicodeString text);
+
+    // Converts an offset in the input, in UTF-16 units for ICU and in bytes
+    // for RE2, to a codepoint offset.
+    int ToCodepointOffset(int offset) const;
+
+    std::unique_ptr<icu::RegexMatcher> matcher_;
+
+    // The ICU matcher only references the input, so it's owned here.
+    icu::UnicodeString text_;
+
+    // The last converted offset, both in input units and codepoints. Offsets
+    // are mostly requested in increasing order, so the conversion continues
+    // from here instead of from the start of the text.
+    mutable int last_offset_ = 0;
+    mutable int last_codepoint_offset_ = 0;
+
+#if defined(TC3_UNILIB_RE2)
+    RegexMatcher(const re2::RE2* pattern, const UnicodeText& text);
+
+    // Runs the RE2 pattern on the input from the given byte offset and stores
+    // the groups of the match. Returns whether there was a match.
+    bool Re2Match(int start_offset, re2::RE2::Anchor anchor);
+
+    // Byte offset of the group in the input, or -1 if it didn't participate
+    // in the last match. Sets status to 'kError' if there was no match or the
+    // group is invalid.
+    int Re2GroupOffset(int group_idx, bool end, int* status) const;
+
+    const re2::RE2* re2_pattern_ = nullptr;
+    re2::StringPiece re2_text_;
+
+    // Groups of the last match, empty if there is none.
+    std::vector<re2::StringPiece> re2_groups_;
+
+    // Byte offset the next Find() starts searching from.
+    int re2_search_offset_ = 0;
+#endif
+  };
+
+  class RegexPattern {
+   public:
+    std::unique_ptr<RegexMatcher> Matcher(const UnicodeText& context) const;
+
+    // Compiles a lazily created pattern, if it isn't compiled yet. Returns
+    // false if the pattern failed to compile.
+    bool Compile() const;
+
+   private:
+    friend class UniLib;
+    // If copy_pattern is false, only a view of the pattern text is kept until
+    // the pattern gets compiled, so the text needs to outlive the pattern.
+    RegexPattern(const UnicodeText& pattern, bool lazy, bool copy_pattern);
+    void LockedInitializeIfNotAlready() const;
+
+    // These members need to be mutable because of the lazy initialization.
+    // NOTE: The Matcher method first ensures that the initialization was
+    // attempted (by using LockedInitializeIfNotAlready) and then can access
+    // them without locking. The flags are atomic and set last, so that once
+    // they are, this doesn't need the lock either.
+    mutable std::mutex mutex_;
+    mutable std::unique_ptr<icu::RegexPattern> pattern_;
+#if defined(TC3_UNILIB_RE2)
+    mutable std::unique_ptr<re2::RE2> re2_pattern_;
+#endif
+    mutable std::atomic<bool> initialized_;
+    mutable std::atomic<bool> initialization_failure_;
+    mutable UnicodeText pattern_text_;
+  };
+
+  class BreakIterator {
+   public:
+    int Next();
+
+    static constexpr int kDone = -1;
+
+   private:
+    friend class UniLib;
+    explicit BreakIterator(const UnicodeText& text);
+
+    // The iterator only references the text, so it's owned here.
+    icu::UnicodeString text_;
+    std::unique_ptr<icu::BreakIterator> iterator_;
+    int last_break_index_;
+    int last_unicode_index_;
+  };
+
+  std::unique_ptr<RegexPattern> CreateRegexPattern(
+      const UnicodeText& regex) const;
+  std::unique_ptr<RegexPattern> CreateLazyRegexPattern(
+      const UnicodeText& regex) const;
+
+  // Same as CreateLazyRegexPattern, but doesn't copy the pattern text. The
+  // text (e.g. a string in a memory-mapped model) needs to outlive the pattern.
+  std::unique_ptr<RegexPattern> CreateLazyRegexPatternNoCopy(
+      const UnicodeText& regex) const;
+  std::unique_ptr<BreakIterator> CreateBreakIterator(
+      const UnicodeText& text) const;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_UTF8_UNILIB_ICU_H_
@@ -19,6 +19,8 @@
 #include <algorithm>
 #include <cassert>
 #include <cctype>
+#include <cstring>
+#include <limits>
 #include <map>
 
 #include "utils/java/string_utils.h"
@@ -216,6 +218,22 @@ int GetOverlappingRangeIndex(const char32* arr, int arr_length,
   }
 }
 
+// Returns the value of a decimal digit (Nd) codepoint, or kNoMatch if the
+// codepoint isn't one. The digits of each range are in order, from 0 to 9.
+int GetDecimalDigitValue(char32 c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  const int range_index =
+      GetOverlappingRangeIndex(kDecimalDigitRangesEnd,
+                               kNumDecimalDigitRangesEnd,
+                               /*range_length=*/10, c);
+  if (range_index == kNoMatch) {
+    return kNoMatch;
+  }
+  return c - (kDecimalDigitRangesEnd[range_index] - 9);
+}
+
 // As above, but with explicit codepoint start and end indices for the range.
 // The input array must be in sorted order.
 int GetOverlappingRangeIndex(const char32* start_arr, const char32* end_arr,
@@ -246,7 +264,8 @@ UniLib::UniLib() {
 }
 
 UniLib::UniLib(const std::shared_ptr<JniCache>& jni_cache)
-    : jni_cache_(jni_cache) {}
+    : jni_cache_(jni_cache),
+      context_string_cache_(new ContextStringCache(jni_cache.get())) {}
 
 bool UniLib::IsOpeningBracket(char32 codepoint) const {
   return GetMatchIndex(kOpeningBrackets, kNumOpeningBrackets, codepoint) >= 0;
@@ -321,6 +340,40 @@ char32 UniLib::GetPairedBracket(char32 codepoint) const {
 // -----------------------------------------------------------------------------
 
 bool UniLib::ParseInt32(const UnicodeText& text, int* result) const {
+  // Parses the text natively as Integer.parseInt does: an optional sign
+  // followed by decimal digits, of any script, that fit in an int. Java
+  // parses the text in UTF-16 and rejects the digits outside of the BMP,
+  // which are surrogate pairs there, so only these go through JNI.
+  UnicodeText::const_iterator it = text.begin();
+  bool negative = false;
+  if (it != text.end() && (*it == '-' || *it == '+')) {
+    negative = (*it == '-');
+    ++it;
+  }
+  if (it == text.end()) {
+    return false;
+  }
+  const int64 limit = static_cast<int64>(std::numeric_limits<int32>::max()) +
+                      (negative ? 1 : 0);
+  int64 value = 0;
+  for (; it != text.end(); ++it) {
+    if (*it > 0xFFFF) {
+      return ParseInt32WithJava(text, result);
+    }
+    const int digit = GetDecimalDigitValue(*it);
+    if (digit == kNoMatch) {
+      return false;
+    }
+    value = value * 10 + digit;
+    if (value > limit) {
+      return false;
+    }
+  }
+  *result = static_cast<int>(negative ? -value : value);
+  return true;
+}
+
+bool UniLib::ParseInt32WithJava(const UnicodeText& text, int* result) const {
   if (jni_cache_) {
     JNIEnv* env = jni_cache_->GetEnv();
     const ScopedLocalRef<jstring> text_java =
@@ -340,28 +393,91 @@ bool UniLib::ParseInt32(const UnicodeText& text, int* result) const {
 std::unique_ptr<UniLib::RegexPattern> UniLib::CreateRegexPattern(
     const UnicodeText& regex) const {
   return std::unique_ptr<UniLib::RegexPattern>(
-      new UniLib::RegexPattern(jni_cache_.get(), regex, /*lazy=*/false));
+      new UniLib::RegexPattern(jni_cache_.get(), context_string_cache_.get(),
+                               regex, /*lazy=*/false, /*copy_pattern=*/true));
 }
 
 std::unique_ptr<UniLib::RegexPattern> UniLib::CreateLazyRegexPattern(
     const UnicodeText& regex) const {
   return std::unique_ptr<UniLib::RegexPattern>(
-      new UniLib::RegexPattern(jni_cache_.get(), regex, /*lazy=*/true));
+      new UniLib::RegexPattern(jni_cache_.get(), context_string_cache_.get(),
+                               regex, /*lazy=*/true, /*copy_pattern=*/true));
+}
+
+std::unique_ptr<UniLib::RegexPattern> UniLib::CreateLazyRegexPatternNoCopy(
+    const UnicodeText& regex) const {
+  return std::unique_ptr<UniLib::RegexPattern>(
+      new UniLib::RegexPattern(jni_cache_.get(), context_string_cache_.get(),
+                               regex, /*lazy=*/true, /*copy_pattern=*/false));
+}
+
+constexpr int UniLib::ContextStringCache::kMaxEntries;
+
+std::shared_ptr<const UniLib::JavaContext> UniLib::ContextStringCache::Get(
+    const UnicodeText& text) {
+  const std::thread::id this_thread = std::this_thread::get_id();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const Entry& entry : entries_) {
+      if (entry.thread == this_thread &&
+          entry.text.size() == text.size_bytes() &&
+          memcmp(entry.text.data(), text.data(), text.size_bytes()) == 0) {
+        return entry.java_context;
+      }
+    }
+  }
+
+  // Convert the text outside of the lock, this is the expensive part.
+  JNIEnv* env = jni_cache_->GetEnv();
+  ScopedGlobalRef<jstring> text_java = MakeGlobalRef(
+      jni_cache_->ConvertToJavaString(text).release(), env, jni_cache_->jvm);
+  if (!text_java) {
+    return nullptr;
+  }
+  std::shared_ptr<const JavaContext> java_context(
+      new JavaContext(std::move(text_java), text));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = std::find_if(entries_.begin(), entries_.end(),
+                         [this_thread](const Entry& entry) {
+                           return entry.thread == this_thread;
+                         });
+  if (it != entries_.end()) {
+    entries_.erase(it);
+  } else if (entries_.size() >= kMaxEntries) {
+    entries_.erase(entries_.begin());
+  }
+  entries_.push_back(Entry{this_thread, text.ToUTF8String(), java_context});
+  return java_context;
 }
 
+constexpr int UniLib::RegexPattern::kMaxIdleMatchers;
+
 UniLib::RegexPattern::RegexPattern(const JniCache* jni_cache,
-                                   const UnicodeText& pattern, bool lazy)
+                                   ContextStringCache* context_string_cache,
+                                   const UnicodeText& pattern, bool lazy,
+                                   bool copy_pattern)
     : jni_cache_(jni_cache),
+      context_string_cache_(context_string_cache),
       pattern_(nullptr, jni_cache ? jni_cache->jvm : nullptr),
       initialized_(false),
-      initialization_failure_(false),
-      pattern_text_(pattern) {
+      initialization_failure_(false) {
+  if (copy_pattern) {
+    pattern_text_.Copy(pattern);
+  } else {
+    pattern_text_.PointToUTF8(pattern.data(), pattern.size_bytes());
+  }
   if (!lazy) {
     LockedInitializeIfNotAlready();
   }
 }
 
 void UniLib::RegexPattern::LockedInitializeIfNotAlready() const {
+  // Once the initialization was attempted, the flags never change again, so
+  // the calls after the first don't contend on the lock.
+  if (initialized_ || initialization_failure_) {
+    return;
+  }
   std::lock_guard<std::mutex> guard(mutex_);
   if (initialized_ || initialization_failure_) {
     return;
@@ -377,19 +493,24 @@ void UniLib::RegexPattern::LockedInitializeIfNotAlready() const {
                              jenv, jni_cache_->jvm);
 
     if (jni_cache_->ExceptionCheckAndClear() || pattern_ == nullptr) {
-      initialization_failure_ = true;
       pattern_.reset();
+      initialization_failure_ = true;
       return;
     }
 
-    initialized_ = true;
     pattern_text_.clear();  // We don't need this anymore.
+    initialized_ = true;
   }
 }
 
 constexpr int UniLib::RegexMatcher::kError;
 constexpr int UniLib::RegexMatcher::kNoError;
 
+bool UniLib::RegexPattern::Compile() const {
+  LockedInitializeIfNotAlready();
+  return !initialization_failure_;
+}
+
 std::unique_ptr<UniLib::RegexMatcher> UniLib::RegexPattern::Matcher(
     const UnicodeText& context) const {
   LockedInitializeIfNotAlready();  // Possibly lazy initialization.
@@ -398,34 +519,80 @@ std::unique_ptr<UniLib::RegexMatcher> UniLib::RegexPattern::Matcher(
   }
 
   if (jni_cache_) {
-    JNIEnv* env = jni_cache_->GetEnv();
-    const jstring context_java =
-        jni_cache_->ConvertToJavaString(context).release();
+    std::shared_ptr<const JavaContext> context_java =
+        context_string_cache_->Get(context);
     if (!context_java) {
       return nullptr;
     }
-    const jobject matcher = env->CallObjectMethod(
-        pattern_.get(), jni_cache_->pattern_matcher, context_java);
-    if (jni_cache_->ExceptionCheckAndClear() || !matcher) {
+    ScopedGlobalRef<jobject> matcher =
+        AcquireMatcher(context_java->text.get());
+    if (!matcher) {
       return nullptr;
     }
     return std::unique_ptr<UniLib::RegexMatcher>(new RegexMatcher(
-        jni_cache_, MakeGlobalRef(matcher, env, jni_cache_->jvm),
-        MakeGlobalRef(context_java, env, jni_cache_->jvm)));
+        jni_cache_, this, std::move(matcher), std::move(context_java)));
   } else {
     // NOTE: A valid object needs to be created here to pass the interface
     // tests.
     return std::unique_ptr<UniLib::RegexMatcher>(
-        new RegexMatcher(jni_cache_, nullptr, nullptr));
+        new RegexMatcher(jni_cache_, nullptr, nullptr, nullptr));
+  }
+}
+
+ScopedGlobalRef<jobject> UniLib::RegexPattern::AcquireMatcher(
+    jstring text) const {
+  ScopedGlobalRef<jobject> matcher(nullptr, jni_cache_->jvm);
+  {
+    std::lock_guard<std::mutex> lock(idle_matchers_mutex_);
+    if (!idle_matchers_.empty()) {
+      matcher = std::move(idle_matchers_.back());
+      idle_matchers_.pop_back();
+    }
+  }
+
+  JNIEnv* env = jni_cache_->GetEnv();
+  if (matcher) {
+    // Matcher.reset(CharSequence) returns the matcher itself.
+    const ScopedLocalRef<jobject> reset_result(
+        env->CallObjectMethod(matcher.get(), jni_cache_->matcher_reset_text,
+                              text),
+        env);
+    if (jni_cache_->ExceptionCheckAndClear()) {
+      return ScopedGlobalRef<jobject>(nullptr, jni_cache_->jvm);
+    }
+    return matcher;
+  }
+
+  const jobject new_matcher =
+      env->CallObjectMethod(pattern_.get(), jni_cache_->pattern_matcher, text);
+  if (jni_cache_->ExceptionCheckAndClear() || !new_matcher) {
+    return ScopedGlobalRef<jobject>(nullptr, jni_cache_->jvm);
+  }
+  return MakeGlobalRef(new_matcher, env, jni_cache_->jvm);
+}
+
+void UniLib::RegexPattern::ReleaseMatcher(
+    ScopedGlobalRef<jobject> matcher) const {
+  std::lock_guard<std::mutex> lock(idle_matchers_mutex_);
+  if (idle_matchers_.size() < kMaxIdleMatchers) {
+    idle_matchers_.push_back(std::move(matcher));
   }
 }
 
 UniLib::RegexMatcher::RegexMatcher(const JniCache* jni_cache,
+                                   const RegexPattern* pattern,
                                    ScopedGlobalRef<jobject> matcher,
-                                   ScopedGlobalRef<jstring> text)
+                                   std::shared_ptr<const JavaContext> context)
     : jni_cache_(jni_cache),
+      pattern_(pattern),
       matcher_(std::move(matcher)),
-      text_(std::move(text)) {}
+      context_(std::move(context)) {}
+
+UniLib::RegexMatcher::~RegexMatcher() {
+  if (pattern_ != nullptr && matcher_ != nullptr) {
+    pattern_->ReleaseMatcher(std::move(matcher_));
+  }
+}
 
 bool UniLib::RegexMatcher::Matches(int* status) const {
   if (jni_cache_) {
@@ -471,45 +638,13 @@ bool UniLib::RegexMatcher::ApproximatelyMatches(int* status) {
     return kError;
   }
 
-  int context_length_bmp = jni_cache_->GetEnv()->CallIntMethod(
-      text_.get(), jni_cache_->string_length);
-  if (jni_cache_->ExceptionCheckAndClear()) {
-    *status = kError;
-    return false;
-  }
-
-  if (found_start != 0 || found_end != context_length_bmp) {
+  if (found_start != 0 || found_end != context_->offsets.utf16_length()) {
     return false;
   }
 
   return true;
 }
 
-bool UniLib::RegexMatcher::UpdateLastFindOffset() const {
-  if (!last_find_offset_dirty_) {
-    return true;
-  }
-
-  const int find_offset = jni_cache_->GetEnv()->CallIntMethod(
-      matcher_.get(), jni_cache_->matcher_start_idx, 0);
-  if (jni_cache_->ExceptionCheckAndClear()) {
-    return false;
-  }
-
-  const int codepoint_count = jni_cache_->GetEnv()->CallIntMethod(
-      text_.get(), jni_cache_->string_code_point_count, last_find_offset_,
-      find_offset);
-  if (jni_cache_->ExceptionCheckAndClear()) {
-    return false;
-  }
-
-  last_find_offset_codepoints_ += codepoint_count;
-  last_find_offset_ = find_offset;
-  last_find_offset_dirty_ = false;
-
-  return true;
-}
-
 bool UniLib::RegexMatcher::Find(int* status) {
   if (jni_cache_) {
     const bool result = jni_cache_->GetEnv()->CallBooleanMethod(
@@ -519,7 +654,6 @@ bool UniLib::RegexMatcher::Find(int* status) {
       return false;
     }
 
-    last_find_offset_dirty_ = true;
     *status = kNoError;
     return result;
   } else {
@@ -536,11 +670,6 @@ int UniLib::RegexMatcher::Start(int group_idx, int* status) const {
   if (jni_cache_) {
     *status = kNoError;
 
-    if (!UpdateLastFindOffset()) {
-      *status = kError;
-      return kError;
-    }
-
     const int java_index = jni_cache_->GetEnv()->CallIntMethod(
         matcher_.get(), jni_cache_->matcher_start_idx, group_idx);
     if (jni_cache_->ExceptionCheckAndClear()) {
@@ -553,15 +682,7 @@ int UniLib::RegexMatcher::Start(int group_idx, int* status) const {
       return -1;
     }
 
-    const int unicode_index = jni_cache_->GetEnv()->CallIntMethod(
-        text_.get(), jni_cache_->string_code_point_count, last_find_offset_,
-        java_index);
-    if (jni_cache_->ExceptionCheckAndClear()) {
-      *status = kError;
-      return kError;
-    }
-
-    return unicode_index + last_find_offset_codepoints_;
+    return context_->offsets.ToCodepointOffset(java_index);
   } else {
     *status = kError;
     return kError;
@@ -576,11 +697,6 @@ int UniLib::RegexMatcher::End(int group_idx, int* status) const {
   if (jni_cache_) {
     *status = kNoError;
 
-    if (!UpdateLastFindOffset()) {
-      *status = kError;
-      return kError;
-    }
-
     const int java_index = jni_cache_->GetEnv()->CallIntMethod(
         matcher_.get(), jni_cache_->matcher_end_idx, group_idx);
     if (jni_cache_->ExceptionCheckAndClear()) {
@@ -593,15 +709,7 @@ int UniLib::RegexMatcher::End(int group_idx, int* status) const {
       return -1;
     }
 
-    const int unicode_index = jni_cache_->GetEnv()->CallIntMethod(
-        text_.get(), jni_cache_->string_code_point_count, last_find_offset_,
-        java_index);
-    if (jni_cache_->ExceptionCheckAndClear()) {
-      *status = kError;
-      return kError;
-    }
-
-    return unicode_index + last_find_offset_codepoints_;
+    return context_->offsets.ToCodepointOffset(java_index);
   } else {
     *status = kError;
     return kError;
@@ -22,9 +22,12 @@
 #define LIBTEXTCLASSIFIER_UTILS_UTF8_UNILIB_JAVAICU_H_
 
 #include <jni.h>
+#include <atomic>
 #include <memory>
 #include <mutex>  // NOLINT
 #include <string>
+#include <thread>  // NOLINT
+#include <vector>
 
 #include "utils/base/integral_types.h"
 #include "utils/java/jni-cache.h"
@@ -32,6 +35,7 @@
 #include "utils/java/scoped_local_ref.h"
 #include "utils/java/string_utils.h"
 #include "utils/utf8/unicodetext.h"
+#include "utils/utf8/utf16-offsets.h"
 
 namespace libtextclassifier3 {
 
@@ -53,11 +57,52 @@ class UniLib {
   // Forward declaration for friend.
   class RegexPattern;
 
+  // A context converted to a Java string, with the index to translate offsets
+  // into the Java string back into codepoint offsets.
+  struct JavaContext {
+    JavaContext(ScopedGlobalRef<jstring> text, const UnicodeText& context)
+        : text(std::move(text)), offsets(context) {}
+
+    ScopedGlobalRef<jstring> text;
+    Utf16ToCodepointOffsets offsets;
+  };
+
+  // Converts contexts to Java strings, and keeps the string last converted on
+  // each thread, so that all the patterns run on the same context on a thread
+  // share one Java string.
+  // The class is thread-safe.
+  class ContextStringCache {
+   public:
+    explicit ContextStringCache(const JniCache* jni_cache)
+        : jni_cache_(jni_cache) {}
+
+    // Returns the Java context for the text, or nullptr on failure.
+    std::shared_ptr<const JavaContext> Get(const UnicodeText& text);
+
+   private:
+    static constexpr int kMaxEntries = 8;
+
+    struct Entry {
+      std::thread::id thread;
+      std::string text;
+      std::shared_ptr<const JavaContext> java_context;
+    };
+
+    const JniCache* jni_cache_;
+    std::mutex mutex_;
+
+    // At most one entry per thread, the least recently added first.
+    std::vector<Entry> entries_;
+  };
+
   class RegexMatcher {
    public:
     static constexpr int kError = -1;
     static constexpr int kNoError = 0;
 
+    // Hands the Java matcher back to its pattern for reuse.
+    ~RegexMatcher();
+
     // Checks whether the input text matches the pattern exactly.
     bool Matches(int* status) const;
 
@@ -109,44 +154,69 @@ class UniLib {
     // Returns the matched text (the 0th capturing group).
     std::string Text() const {
       ScopedStringChars text_str =
-          GetScopedStringChars(jni_cache_->GetEnv(), text_.get());
+          GetScopedStringChars(jni_cache_->GetEnv(), context_->text.get());
       return text_str.get();
     }
 
    private:
     friend class RegexPattern;
-    RegexMatcher(const JniCache* jni_cache, ScopedGlobalRef<jobject> matcher,
-                 ScopedGlobalRef<jstring> text);
-    bool UpdateLastFindOffset() const;
+    RegexMatcher(const JniCache* jni_cache, const RegexPattern* pattern,
+                 ScopedGlobalRef<jobject> matcher,
+                 std::shared_ptr<const JavaContext> context);
 
     const JniCache* jni_cache_;
+
+    // The pattern the matcher was created from, nullptr if there is none.
+    const RegexPattern* pattern_;
     ScopedGlobalRef<jobject> matcher_;
-    ScopedGlobalRef<jstring> text_;
-    mutable int last_find_offset_ = 0;
-    mutable int last_find_offset_codepoints_ = 0;
-    mutable bool last_find_offset_dirty_ = true;
+    std::shared_ptr<const JavaContext> context_;
   };
 
   class RegexPattern {
    public:
+    // Returns a matcher for the context. Java matchers of destroyed
+    // RegexMatchers are reset onto the new context instead of allocating new
+    // ones, so the pattern needs to outlive all of its matchers.
     std::unique_ptr<RegexMatcher> Matcher(const UnicodeText& context) const;
 
+    // Compiles a lazily created pattern, if it isn't compiled yet. Returns
+    // false if the pattern failed to compile.
+    bool Compile() const;
+
    private:
     friend class UniLib;
-    RegexPattern(const JniCache* jni_cache, const UnicodeText& pattern,
-                 bool lazy);
+    friend class RegexMatcher;
+    static constexpr int kMaxIdleMatchers = 4;
+
+    // If copy_pattern is false, only a view of the pattern text is kept until
+    // the pattern gets compiled, so the text needs to outlive the pattern.
+    RegexPattern(const JniCache* jni_cache,
+                 ContextStringCache* context_string_cache,
+                 const UnicodeText& pattern, bool lazy, bool copy_pattern);
     void LockedInitializeIfNotAlready() const;
 
+    // Takes an idle Java matcher and resets it onto the text, or creates a new
+    // one if there is none. Returns nullptr on failure.
+    ScopedGlobalRef<jobject> AcquireMatcher(jstring text) const;
+
+    // Keeps a Java matcher that is no longer used for later reuse.
+    void ReleaseMatcher(ScopedGlobalRef<jobject> matcher) const;
+
     const JniCache* jni_cache_;
+    ContextStringCache* context_string_cache_;
+
+    mutable std::mutex idle_matchers_mutex_;
+    mutable std::vector<ScopedGlobalRef<jobject>> idle_matchers_;
 
     // These members need to be mutable because of the lazy initialization.
-    // NOTE: The Matcher method first ensures (using a lock) that the
-    // initialization was attempted (by using LockedInitializeIfNotAlready) and
-    // then can access them without locking.
+    // NOTE: The Matcher method first ensures that the initialization was
+    // attempted (by using LockedInitializeIfNotAlready) and then can access
+    // them without locking. The flags are atomic and set last, so that once
+    // they are, this doesn't need the lock either.
     mutable std::mutex mutex_;
     mutable ScopedGlobalRef<jobject> pattern_;
-    mutable bool initialized_;
-    mutable bool initialization_failure_;
+    mutable std::atomic<bool> initialized_;
+    mutable std::atomic<bool> initialization_failure_;
     mutable UnicodeText pattern_text_;
   };
 
@@ -171,11 +241,20 @@ class UniLib {
       const UnicodeText& regex) const;
   std::unique_ptr<RegexPattern> CreateLazyRegexPattern(
       const UnicodeText& regex) const;
+
+  // Same as CreateLazyRegexPattern, but doesn't copy the pattern text. The
+  // text (e.g. a string in a memory-mapped model) needs to outlive the pattern.
+  std::unique_ptr<RegexPattern> CreateLazyRegexPatternNoCopy(
+      const UnicodeText& regex) const;
   std::unique_ptr<BreakIterator> CreateBreakIterator(
       const UnicodeText& text) const;
 
  private:
+  // Parses the text with Integer.parseInt.
+  bool ParseInt32WithJava(const UnicodeText& text, int* result) const;
+
   std::shared_ptr<JniCache> jni_cache_;
+  std::shared_ptr<ContextStringCache> context_string_cache_;
 };
 
 }  // namespace libtextclassifier3
@@ -17,7 +17,12 @@
 #ifndef LIBTEXTCLASSIFIER_UTILS_UTF8_UNILIB_H_
 #define LIBTEXTCLASSIFIER_UTILS_UTF8_UNILIB_H_
 
+#if defined TC3_UNILIB_ICU
+#include "utils/utf8/unilib-icu.h"
+#define INIT_UNILIB_FOR_TESTING(VAR) VAR()
+#else
 #include "utils/utf8/unilib-javaicu.h"
 #define INIT_UNILIB_FOR_TESTING(VAR) VAR(nullptr)
+#endif
 
 #endif  // LIBTEXTCLASSIFIER_UTILS_UTF8_UNILIB_H_
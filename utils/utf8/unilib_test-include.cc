@@ -16,6 +16,8 @@
 
 #include "utils/utf8/unilib_test-include.h"
 
+#include <vector>
+
 #include "gmock/gmock.h"
 
 namespace libtextclassifier3 {
@@ -136,6 +138,23 @@ TEST_F(UniLibTest, RegexLazy) {
   EXPECT_EQ(status, UniLib::RegexMatcher::kNoError);
 }
 
+TEST_F(UniLibTest, RegexLazyNoCopy) {
+  const std::string pattern_text = "[a-z][0-9]";
+  std::unique_ptr<UniLib::RegexPattern> pattern =
+      unilib_.CreateLazyRegexPatternNoCopy(
+          UTF8ToUnicodeText(pattern_text, /*do_copy=*/false));
+  int status;
+  std::unique_ptr<UniLib::RegexMatcher> matcher;
+
+  matcher = pattern->Matcher(UTF8ToUnicodeText("a3", /*do_copy=*/false));
+  EXPECT_TRUE(matcher->Matches(&status));
+  EXPECT_EQ(status, UniLib::RegexMatcher::kNoError);
+
+  matcher = pattern->Matcher(UTF8ToUnicodeText("3a", /*do_copy=*/false));
+  EXPECT_FALSE(matcher->Matches(&status));
+  EXPECT_EQ(status, UniLib::RegexMatcher::kNoError);
+}
+
 TEST_F(UniLibTest, RegexGroups) {
   // The smiley face is a 4-byte UTF8 codepoint 0x1F60B, and it's important to
   // test the regex functionality with it to verify we are handling the indices
@@ -171,6 +190,57 @@ TEST_F(UniLibTest, RegexGroups) {
   EXPECT_EQ(status, UniLib::RegexMatcher::kNoError);
 }
 
+TEST_F(UniLibTest, RegexFindAll) {
+  std::unique_ptr<UniLib::RegexPattern> pattern = unilib_.CreateRegexPattern(
+      UTF8ToUnicodeText("(a)|(b)", /*do_copy=*/false));
+  int status;
+  std::unique_ptr<UniLib::RegexMatcher> matcher =
+      pattern->Matcher(UTF8ToUnicodeText("😋b a", /*do_copy=*/false));
+
+  EXPECT_TRUE(matcher->Find(&status));
+  EXPECT_EQ(status, UniLib::RegexMatcher::kNoError);
+  EXPECT_EQ(matcher->Start(&status), 1);
+  EXPECT_EQ(matcher->End(&status), 2);
+  EXPECT_EQ(matcher->Start(1, &status), -1);
+  EXPECT_EQ(status, UniLib::RegexMatcher::kNoError);
+  EXPECT_EQ(matcher->Group(1, &status).ToUTF8String(), "");
+  EXPECT_EQ(matcher->Group(2, &status).ToUTF8String(), "b");
+
+  EXPECT_TRUE(matcher->Find(&status));
+  EXPECT_EQ(matcher->Start(&status), 3);
+  EXPECT_EQ(matcher->Group(1, &status).ToUTF8String(), "a");
+  EXPECT_EQ(matcher->Start(2, &status), -1);
+
+  EXPECT_FALSE(matcher->Find(&status));
+  EXPECT_EQ(status, UniLib::RegexMatcher::kNoError);
+}
+
+TEST_F(UniLibTest, RegexFindEmptyMatches) {
+  std::unique_ptr<UniLib::RegexPattern> pattern =
+      unilib_.CreateRegexPattern(UTF8ToUnicodeText("x*", /*do_copy=*/false));
+  int status;
+  std::unique_ptr<UniLib::RegexMatcher> matcher =
+      pattern->Matcher(UTF8ToUnicodeText("a😋", /*do_copy=*/false));
+
+  std::vector<int> starts;
+  while (matcher->Find(&status)) {
+    starts.push_back(matcher->Start(&status));
+  }
+  EXPECT_THAT(starts, ElementsAre(0, 1, 2));
+}
+
+TEST_F(UniLibTest, RegexLookahead) {
+  std::unique_ptr<UniLib::RegexPattern> pattern = unilib_.CreateRegexPattern(
+      UTF8ToUnicodeText("[0-9]+(?= km)", /*do_copy=*/false));
+  int status;
+  std::unique_ptr<UniLib::RegexMatcher> matcher =
+      pattern->Matcher(UTF8ToUnicodeText("5 km 6 m", /*do_copy=*/false));
+
+  EXPECT_TRUE(matcher->Find(&status));
+  EXPECT_EQ(matcher->Group(&status).ToUTF8String(), "5");
+  EXPECT_FALSE(matcher->Find(&status));
+}
+
 TEST_F(UniLibTest, BreakIterator) {
   const UnicodeText text = UTF8ToUnicodeText("some text", /*do_copy=*/false);
   std::unique_ptr<UniLib::BreakIterator> iterator =
@@ -217,5 +287,36 @@ TEST_F(UniLibTest, IntegerParseFullWidthWithAlpha) {
                                   &result));
 }
 
+TEST_F(UniLibTest, IntegerParseSigned) {
+  int result;
+  EXPECT_TRUE(unilib_.ParseInt32(UTF8ToUnicodeText("-2147483648",
+                                                   /*do_copy=*/false),
+                                 &result));
+  EXPECT_EQ(result, -2147483648LL);
+  EXPECT_TRUE(
+      unilib_.ParseInt32(UTF8ToUnicodeText("+42", /*do_copy=*/false), &result));
+  EXPECT_EQ(result, 42);
+  EXPECT_FALSE(
+      unilib_.ParseInt32(UTF8ToUnicodeText("-", /*do_copy=*/false), &result));
+}
+
+TEST_F(UniLibTest, IntegerParseOverflow) {
+  int result;
+  EXPECT_FALSE(unilib_.ParseInt32(UTF8ToUnicodeText("2147483648",
+                                                    /*do_copy=*/false),
+                                  &result));
+  EXPECT_FALSE(unilib_.ParseInt32(UTF8ToUnicodeText("-2147483649",
+                                                    /*do_copy=*/false),
+                                  &result));
+}
+
+TEST_F(UniLibTest, IntegerParseArabicIndic) {
+  int result;
+  // The input string here is in Arabic-Indic digits.
+  EXPECT_TRUE(unilib_.ParseInt32(UTF8ToUnicodeText("٢٠١٩", /*do_copy=*/false),
+                                 &result));
+  EXPECT_EQ(result, 2019);
+}
+
 }  // namespace test_internal
 }  // namespace libtextclassifier3
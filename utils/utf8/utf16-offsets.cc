@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/utf8/utf16-offsets.h"
+
+namespace libtextclassifier3 {
+
+constexpr int Utf16ToCodepointOffsets::kBlockBits;
+constexpr int Utf16ToCodepointOffsets::kBlockSize;
+
+Utf16ToCodepointOffsets::Utf16ToCodepointOffsets(const UnicodeText& text) {
+  for (const char32 codepoint : text) {
+    if (codepoint < 0x10000) {
+      ++utf16_length_;
+      continue;
+    }
+
+    // Supplementary characters take a surrogate pair.
+    const int trail_offset = utf16_length_ + 1;
+    const int block = trail_offset >> kBlockBits;
+    if (block >= trail_surrogates_.size()) {
+      trail_surrogates_.resize(block + 1, 0);
+    }
+    trail_surrogates_[block] |= uint64{1} << (trail_offset & (kBlockSize - 1));
+    utf16_length_ += 2;
+  }
+
+  if (trail_surrogates_.empty()) {
+    return;
+  }
+
+  // Make the offset one past the end addressable too.
+  const int num_blocks = (utf16_length_ >> kBlockBits) + 1;
+  trail_surrogates_.resize(num_blocks, 0);
+  trail_surrogates_before_block_.resize(num_blocks);
+  int num_trail_surrogates = 0;
+  for (int block = 0; block < num_blocks; ++block) {
+    trail_surrogates_before_block_[block] = num_trail_surrogates;
+    num_trail_surrogates += __builtin_popcountll(trail_surrogates_[block]);
+  }
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_UTF8_UTF16_OFFSETS_H_
+#define LIBTEXTCLASSIFIER_UTILS_UTF8_UTF16_OFFSETS_H_
+
+#include <vector>
+
+#include "utils/base/integral_types.h"
+#include "utils/utf8/unicodetext.h"
+
+namespace libtextclassifier3 {
+
+// Translates offsets into the UTF-16 representation of a text (e.g. indices
+// into a Java string) into codepoint offsets in constant time.
+//
+// The text is split into blocks of 64 UTF-16 code units. Each block stores the
+// number of trailing surrogates before it, and a bit mask of the trailing
+// surrogates in it. Texts without supplementary characters need no blocks at
+// all.
+class Utf16ToCodepointOffsets {
+ public:
+  explicit Utf16ToCodepointOffsets(const UnicodeText& text);
+
+  // Length of the text in UTF-16 code units.
+  int utf16_length() const { return utf16_length_; }
+
+  // Returns the number of codepoints before the UTF-16 offset, which needs to
+  // be in [0, utf16_length()]. Like Java's String.codePointCount, an offset in
+  // the middle of a surrogate pair counts the leading surrogate as one
+  // codepoint.
+  int ToCodepointOffset(int utf16_offset) const {
+    if (trail_surrogates_.empty()) {
+      return utf16_offset;
+    }
+    const int block = utf16_offset >> kBlockBits;
+    const uint64 mask_before =
+        (uint64{1} << (utf16_offset & (kBlockSize - 1))) - 1;
+    return utf16_offset - trail_surrogates_before_block_[block] -
+           __builtin_popcountll(trail_surrogates_[block] & mask_before);
+  }
+
+ private:
+  static constexpr int kBlockBits = 6;
+  static constexpr int kBlockSize = 1 << kBlockBits;
+
+  int utf16_length_ = 0;
+
+  // Number of trailing surrogates before the start of each block.
+  std::vector<int> trail_surrogates_before_block_;
+
+  // For each block, the bits of the code units that are trailing surrogates.
+  std::vector<uint64> trail_surrogates_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_UTF8_UTF16_OFFSETS_H_
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/utf8/utf16-offsets.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(Utf16ToCodepointOffsetsTest, BmpOnlyText) {
+  const Utf16ToCodepointOffsets offsets(
+      UTF8ToUnicodeText("Grüße aus 東京", /*do_copy=*/false));
+  EXPECT_EQ(offsets.utf16_length(), 12);
+  EXPECT_EQ(offsets.ToCodepointOffset(0), 0);
+  EXPECT_EQ(offsets.ToCodepointOffset(7), 7);
+  EXPECT_EQ(offsets.ToCodepointOffset(12), 12);
+}
+
+TEST(Utf16ToCodepointOffsetsTest, SupplementaryCharacters) {
+  // 😋 and 𝄞 take two UTF-16 code units each.
+  const Utf16ToCodepointOffsets offsets(
+      UTF8ToUnicodeText("1234😋hello𝄞!", /*do_copy=*/false));
+  EXPECT_EQ(offsets.utf16_length(), 14);
+  EXPECT_EQ(offsets.ToCodepointOffset(4), 4);
+  EXPECT_EQ(offsets.ToCodepointOffset(5), 5);
+  EXPECT_EQ(offsets.ToCodepointOffset(6), 5);
+  EXPECT_EQ(offsets.ToCodepointOffset(11), 10);
+  EXPECT_EQ(offsets.ToCodepointOffset(13), 11);
+  EXPECT_EQ(offsets.ToCodepointOffset(14), 12);
+}
+
+TEST(Utf16ToCodepointOffsetsTest, MatchesCountingAcrossBlocks) {
+  std::string text;
+  for (int i = 0; i < 100; ++i) {
+    text += (i % 3 == 0) ? "😋" : "a";
+  }
+  const Utf16ToCodepointOffsets offsets(
+      UTF8ToUnicodeText(text, /*do_copy=*/false));
+
+  int utf16_offset = 0;
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(offsets.ToCodepointOffset(utf16_offset), i);
+    utf16_offset += (i % 3 == 0) ? 2 : 1;
+  }
+  EXPECT_EQ(utf16_offset, offsets.utf16_length());
+  EXPECT_EQ(offsets.ToCodepointOffset(utf16_offset), 100);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
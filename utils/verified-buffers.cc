@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/verified-buffers.h"
+
+#include "utils/hash/farmhash.h"
+
+namespace libtextclassifier3 {
+
+VerifiedBufferRegistry* VerifiedBufferRegistry::Instance() {
+  static VerifiedBufferRegistry* const instance = new VerifiedBufferRegistry();
+  return instance;
+}
+
+uint64 VerifiedBufferRegistry::Fingerprint(const void* buffer, int size) {
+  return tc3farmhash::Fingerprint64(reinterpret_cast<const char*>(buffer),
+                                    size);
+}
+
+void VerifiedBufferRegistry::SetEnabled(bool enabled) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  enabled_ = enabled;
+}
+
+bool VerifiedBufferRegistry::enabled() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return enabled_;
+}
+
+void VerifiedBufferRegistry::MarkVerified(uint64 fingerprint, int size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  verified_.insert({fingerprint, size});
+}
+
+bool VerifiedBufferRegistry::IsVerified(uint64 fingerprint, int size) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return verified_.find({fingerprint, size}) != verified_.end();
+}
+
+void VerifiedBufferRegistry::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  verified_.clear();
+}
+
+}  // namespace libtextclassifier3
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Registry of model buffers that passed flatbuffer verification.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_VERIFIED_BUFFERS_H_
+#define LIBTEXTCLASSIFIER_UTILS_VERIFIED_BUFFERS_H_
+
+#include <mutex>  // NOLINT
+#include <set>
+#include <utility>
+
+#include "utils/base/integral_types.h"
+
+namespace libtextclassifier3 {
+
+// Remembers the fingerprints of model buffers that were verified, so that
+// loading the same bytes again can skip the full flatbuffer verification,
+// which dominates the load time of large models.
+//
+// The registry is disabled by default, in which case every load verifies the
+// buffer. The fingerprints are not cryptographic: only enable the registry if
+// the model files come from a trusted source. Fingerprints recorded in an
+// earlier process (e.g. in a stamp next to the model file) can be restored
+// with MarkVerified.
+//
+// The class is thread-safe.
+class VerifiedBufferRegistry {
+ public:
+  // The process-wide registry used by the model loaders.
+  static VerifiedBufferRegistry* Instance();
+
+  // Returns the fingerprint identifying the bytes of a buffer.
+  static uint64 Fingerprint(const void* buffer, int size);
+
+  void SetEnabled(bool enabled);
+  bool enabled() const;
+
+  // Records that the buffer with the fingerprint and size is valid.
+  void MarkVerified(uint64 fingerprint, int size);
+
+  // Whether a buffer with the fingerprint and size was marked as valid.
+  bool IsVerified(uint64 fingerprint, int size) const;
+
+  void Clear();
+
+  // Returns whether the buffer is valid. Runs verify() and records the result
+  // if the registry is disabled or the bytes weren't verified before.
+  template <typename VerifyFn>
+  bool Verify(const void* buffer, int size, VerifyFn verify) {
+    if (!enabled()) {
+      return verify();
+    }
+    const uint64 fingerprint = Fingerprint(buffer, size);
+    if (IsVerified(fingerprint, size)) {
+      return true;
+    }
+    if (!verify()) {
+      return false;
+    }
+    MarkVerified(fingerprint, size);
+    return true;
+  }
+
+ private:
+  mutable std::mutex mutex_;
+  bool enabled_ = false;
+  std::set<std::pair<uint64, int>> verified_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_VERIFIED_BUFFERS_H_
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/verified-buffers.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+class VerifiedBufferRegistryTest : public testing::Test {
+ protected:
+  void SetUp() override { registry_.SetEnabled(true); }
+
+  bool Verify(const std::string& buffer, bool valid) {
+    return registry_.Verify(buffer.data(), buffer.size(), [this, valid]() {
+      ++num_verifications_;
+      return valid;
+    });
+  }
+
+  VerifiedBufferRegistry registry_;
+  int num_verifications_ = 0;
+};
+
+TEST_F(VerifiedBufferRegistryTest, VerifiesSameBytesOnce) {
+  const std::string buffer = "model bytes";
+  EXPECT_TRUE(Verify(buffer, /*valid=*/true));
+  EXPECT_TRUE(Verify(std::string(buffer), /*valid=*/true));
+  EXPECT_EQ(num_verifications_, 1);
+
+  EXPECT_TRUE(Verify("other model bytes", /*valid=*/true));
+  EXPECT_EQ(num_verifications_, 2);
+}
+
+TEST_F(VerifiedBufferRegistryTest, DoesNotRecordInvalidBuffers) {
+  const std::string buffer = "corrupted bytes";
+  EXPECT_FALSE(Verify(buffer, /*valid=*/false));
+  EXPECT_FALSE(Verify(buffer, /*valid=*/false));
+  EXPECT_EQ(num_verifications_, 2);
+}
+
+TEST_F(VerifiedBufferRegistryTest, AlwaysVerifiesWhenDisabled) {
+  registry_.SetEnabled(false);
+  const std::string buffer = "model bytes";
+  EXPECT_TRUE(Verify(buffer, /*valid=*/true));
+  EXPECT_TRUE(Verify(buffer, /*valid=*/true));
+  EXPECT_EQ(num_verifications_, 2);
+}
+
+TEST_F(VerifiedBufferRegistryTest, TrustsRestoredFingerprints) {
+  const std::string buffer = "model bytes";
+  registry_.MarkVerified(
+      VerifiedBufferRegistry::Fingerprint(buffer.data(), buffer.size()),
+      buffer.size());
+  EXPECT_TRUE(Verify(buffer, /*valid=*/false));
+  EXPECT_EQ(num_verifications_, 0);
+
+  registry_.Clear();
+  EXPECT_FALSE(Verify(buffer, /*valid=*/false));
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/warmup.h"
+
+#include <chrono>  // NOLINT
+
+namespace libtextclassifier3 {
+
+bool WarmupReport::RunPhase(const std::string& name,
+                            const std::function<bool()>& phase) {
+  const auto start = std::chrono::steady_clock::now();
+  const bool success = phase();
+  const auto end = std::chrono::steady_clock::now();
+  phases_.push_back(
+      {name,
+       std::chrono::duration_cast<std::chrono::microseconds>(end - start)
+           .count(),
+       success});
+  return success;
+}
+
+bool WarmupReport::success() const {
+  for (const Phase& phase : phases_) {
+    if (!phase.success) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int64 WarmupReport::total_duration_us() const {
+  int64 total_duration_us = 0;
+  for (const Phase& phase : phases_) {
+    total_duration_us += phase.duration_us;
+  }
+  return total_duration_us;
+}
+
+}  // namespace libtextclassifier3
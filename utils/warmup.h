@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Bookkeeping for warming up a model before it serves requests.
+
+#ifndef LIBTEXTCLASSIFIER_UTILS_WARMUP_H_
+#define LIBTEXTCLASSIFIER_UTILS_WARMUP_H_
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "utils/base/integral_types.h"
+
+namespace libtextclassifier3 {
+
+// How long the phases of a warm-up took.
+class WarmupReport {
+ public:
+  struct Phase {
+    std::string name;
+    int64 duration_us;
+    bool success;
+  };
+
+  // Runs the phase, records how long it took and whether it succeeded, and
+  // returns its result.
+  bool RunPhase(const std::string& name, const std::function<bool()>& phase);
+
+  const std::vector<Phase>& phases() const { return phases_; }
+
+  // Returns whether all the phases succeeded.
+  bool success() const;
+
+  // Returns the sum of the durations of all the phases.
+  int64 total_duration_us() const;
+
+ private:
+  std::vector<Phase> phases_;
+};
+
+}  // namespace libtextclassifier3
+
+#endif  // LIBTEXTCLASSIFIER_UTILS_WARMUP_H_
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/warmup.h"
+
+#include <chrono>  // NOLINT
+#include <thread>  // NOLINT
+
+#include "gtest/gtest.h"
+
+namespace libtextclassifier3 {
+namespace {
+
+TEST(WarmupReportTest, RecordsPhases) {
+  WarmupReport report;
+  EXPECT_TRUE(report.RunPhase("first", []() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    return true;
+  }));
+  EXPECT_TRUE(report.RunPhase("second", []() { return true; }));
+
+  ASSERT_EQ(report.phases().size(), 2);
+  EXPECT_EQ(report.phases()[0].name, "first");
+  EXPECT_GE(report.phases()[0].duration_us, 2000);
+  EXPECT_TRUE(report.phases()[0].success);
+  EXPECT_EQ(report.phases()[1].name, "second");
+  EXPECT_TRUE(report.success());
+  EXPECT_EQ(report.total_duration_us(),
+            report.phases()[0].duration_us + report.phases()[1].duration_us);
+}
+
+TEST(WarmupReportTest, ReportsFailedPhase) {
+  WarmupReport report;
+  EXPECT_TRUE(report.RunPhase("ok", []() { return true; }));
+  EXPECT_FALSE(report.RunPhase("failing", []() { return false; }));
+  EXPECT_FALSE(report.success());
+  EXPECT_FALSE(report.phases()[1].success);
+}
+
+TEST(WarmupReportTest, EmptyReportSucceeds) {
+  WarmupReport report;
+  EXPECT_TRUE(report.success());
+  EXPECT_EQ(report.total_duration_us(), 0);
+}
+
+}  // namespace
+}  // namespace libtextclassifier3
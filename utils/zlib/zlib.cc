@@ -17,6 +17,7 @@
 #include "utils/zlib/zlib.h"
 
 #include "utils/flatbuffers.h"
+#include "utils/shared-string-cache.h"
 
 namespace libtextclassifier3 {
 
@@ -31,20 +32,19 @@ std::unique_ptr<ZlibDecompressor> ZlibDecompressor::Instance(
 }
 
 ZlibDecompressor::ZlibDecompressor(const unsigned char* dictionary,
-                                   const unsigned int dictionary_size) {
+                                   const unsigned int dictionary_size)
+    : dictionary_(dictionary_size > 0 ? dictionary : nullptr),
+      dictionary_size_(dictionary_size) {
   memset(&stream_, 0, sizeof(stream_));
   stream_.zalloc = Z_NULL;
   stream_.zfree = Z_NULL;
   initialized_ = false;
+  // The dictionary of a zlib stream can only be set once inflate asks for it,
+  // see Decompress.
   if (inflateInit(&stream_) != Z_OK) {
     TC3_LOG(ERROR) << "Could not initialize decompressor.";
     return;
   }
-  if (dictionary != nullptr &&
-      inflateSetDictionary(&stream_, dictionary, dictionary_size) != Z_OK) {
-    TC3_LOG(ERROR) << "Could not set dictionary.";
-    return;
-  }
   initialized_ = true;
 }
 
@@ -61,11 +61,33 @@ bool ZlibDecompressor::Decompress(const uint8* buffer, const int buffer_size,
     return false;
   }
   out->resize(uncompressed_size);
+  return Decompress(buffer, buffer_size, uncompressed_size, &(*out)[0]);
+}
+
+bool ZlibDecompressor::Decompress(const uint8* buffer, const int buffer_size,
+                                  const int uncompressed_size, char* out) {
+  if (out == nullptr) {
+    return false;
+  }
+  // With a dictionary, every buffer is a stream of its own.
+  if (dictionary_ != nullptr && inflateReset(&stream_) != Z_OK) {
+    return false;
+  }
   stream_.next_in = reinterpret_cast<const Bytef*>(buffer);
   stream_.avail_in = buffer_size;
-  stream_.next_out = reinterpret_cast<Bytef*>(const_cast<char*>(out->c_str()));
+  stream_.next_out = reinterpret_cast<Bytef*>(out);
   stream_.avail_out = uncompressed_size;
-  return (inflate(&stream_, Z_SYNC_FLUSH) == Z_OK);
+  int status = inflate(&stream_, Z_SYNC_FLUSH);
+  if (status == Z_NEED_DICT) {
+    if (dictionary_ == nullptr ||
+        inflateSetDictionary(&stream_, dictionary_, dictionary_size_) !=
+            Z_OK) {
+      TC3_LOG(ERROR) << "Could not set dictionary.";
+      return false;
+    }
+    status = inflate(&stream_, Z_SYNC_FLUSH);
+  }
+  return status == Z_OK;
 }
 
 bool ZlibDecompressor::MaybeDecompress(
@@ -110,6 +132,63 @@ bool ZlibDecompressor::MaybeDecompressOptionallyCompressedBuffer(
   return MaybeDecompress(compressed_buffer, out);
 }
 
+namespace {
+
+template <typename UncompressedBuffer>
+std::shared_ptr<const std::string> MaybeDecompressSharedImpl(
+    ZlibDecompressor* decompressor,
+    const UncompressedBuffer* uncompressed_buffer,
+    const CompressedBuffer* compressed_buffer) {
+  // Sections are identified by their stored bytes, so that instances loading
+  // the same model from different mappings share the strings as well.
+  if (uncompressed_buffer != nullptr) {
+    return SharedStringCache::Instance()->GetOrCreate(
+        SharedStringCache::Key(
+            "uncompressed", StringPiece(reinterpret_cast<const char*>(
+                                            uncompressed_buffer->data()),
+                                        uncompressed_buffer->size())),
+        [decompressor, uncompressed_buffer](std::string* out) {
+          return decompressor->MaybeDecompressOptionallyCompressedBuffer(
+              uncompressed_buffer, /*compressed_buffer=*/nullptr, out);
+        });
+  }
+  if (compressed_buffer == nullptr || compressed_buffer->buffer() == nullptr) {
+    return std::make_shared<const std::string>();
+  }
+
+  // The buffer is decompressed even if the section is shared already, as the
+  // next buffers of the stream may refer back to it, see ZlibDecompressor.
+  std::string decompressed;
+  if (!decompressor->MaybeDecompress(compressed_buffer, &decompressed)) {
+    return nullptr;
+  }
+  return SharedStringCache::Instance()->GetOrCreate(
+      SharedStringCache::Key(
+          "zlib", StringPiece(reinterpret_cast<const char*>(
+                                  compressed_buffer->buffer()->data()),
+                              compressed_buffer->buffer()->size())),
+      [&decompressed](std::string* out) {
+        out->swap(decompressed);
+        return true;
+      });
+}
+
+}  // namespace
+
+std::shared_ptr<const std::string> ZlibDecompressor::MaybeDecompressShared(
+    const flatbuffers::String* uncompressed_buffer,
+    const CompressedBuffer* compressed_buffer) {
+  return MaybeDecompressSharedImpl(this, uncompressed_buffer,
+                                   compressed_buffer);
+}
+
+std::shared_ptr<const std::string> ZlibDecompressor::MaybeDecompressShared(
+    const flatbuffers::Vector<uint8>* uncompressed_buffer,
+    const CompressedBuffer* compressed_buffer) {
+  return MaybeDecompressSharedImpl(this, uncompressed_buffer,
+                                   compressed_buffer);
+}
+
 std::unique_ptr<ZlibCompressor> ZlibCompressor::Instance(
     const unsigned char* dictionary, const unsigned int dictionary_size) {
   std::unique_ptr<ZlibCompressor> result(
@@ -122,7 +201,9 @@ std::unique_ptr<ZlibCompressor> ZlibCompressor::Instance(
 
 ZlibCompressor::ZlibCompressor(const unsigned char* dictionary,
                                const unsigned int dictionary_size,
-                               const int level, const int tmp_buffer_size) {
+                               const int level, const int tmp_buffer_size)
+    : dictionary_(dictionary_size > 0 ? dictionary : nullptr),
+      dictionary_size_(dictionary_size) {
   memset(&stream_, 0, sizeof(stream_));
   stream_.zalloc = Z_NULL;
   stream_.zfree = Z_NULL;
@@ -147,6 +228,14 @@ void ZlibCompressor::Compress(const std::string& uncompressed_content,
                               CompressedBufferT* out) {
   out->uncompressed_size = uncompressed_content.size();
   out->buffer.clear();
+  // With a dictionary, every buffer is a stream of its own.
+  if (dictionary_ != nullptr &&
+      (deflateReset(&stream_) != Z_OK ||
+       deflateSetDictionary(&stream_, dictionary_, dictionary_size_) !=
+           Z_OK)) {
+    TC3_LOG(ERROR) << "Could not reset compressor.";
+    return;
+  }
   stream_.next_in =
       reinterpret_cast<const Bytef*>(uncompressed_content.c_str());
   stream_.avail_in = uncompressed_content.size();
@@ -187,4 +276,17 @@ bool ZlibCompressor::GetDictionary(std::vector<unsigned char>* dictionary) {
   return deflateGetDictionary(&stream_, dictionary->data(), &size) == Z_OK;
 }
 
+bool BuildZlibDictionary(const std::vector<std::string>& samples,
+                         std::vector<unsigned char>* dictionary) {
+  std::unique_ptr<ZlibCompressor> compressor = ZlibCompressor::Instance();
+  if (compressor == nullptr) {
+    return false;
+  }
+  for (const std::string& sample : samples) {
+    CompressedBufferT compressed;
+    compressor->Compress(sample, &compressed);
+  }
+  return compressor->GetDictionary(dictionary);
+}
+
 }  // namespace libtextclassifier3
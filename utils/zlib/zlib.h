@@ -19,6 +19,8 @@
 #ifndef LIBTEXTCLASSIFIER_UTILS_ZLIB_ZLIB_H_
 #define LIBTEXTCLASSIFIER_UTILS_ZLIB_ZLIB_H_
 
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "utils/base/integral_types.h"
@@ -27,8 +29,18 @@
 
 namespace libtextclassifier3 {
 
+// Decompresses buffers compressed by ZlibCompressor.
+// Without a dictionary, the buffers that one compressor produces are
+// consecutive parts of a single zlib stream: only the first has the stream
+// header, and the later ones can refer back to the data of the earlier ones.
+// They must therefore be decompressed by a single decompressor, in the order
+// they were compressed.
+// With a preset dictionary, every buffer is a stream of its own that only
+// refers back to the dictionary, so the buffers can be decompressed in any
+// order.
 class ZlibDecompressor {
  public:
+  // The dictionary is not copied, it must outlive the decompressor.
   static std::unique_ptr<ZlibDecompressor> Instance(
       const unsigned char* dictionary = nullptr,
       unsigned int dictionary_size = 0);
@@ -36,6 +48,11 @@ class ZlibDecompressor {
 
   bool Decompress(const uint8* buffer, const int buffer_size,
                   const int uncompressed_size, std::string* out);
+
+  // Same as above, but decompresses into a buffer of the caller (e.g. an arena
+  // or a mapped file) that holds exactly `uncompressed_size` bytes.
+  bool Decompress(const uint8* buffer, const int buffer_size,
+                  const int uncompressed_size, char* out);
   bool MaybeDecompress(const CompressedBuffer* compressed_buffer,
                        std::string* out);
   bool MaybeDecompress(const CompressedBufferT* compressed_buffer,
@@ -47,15 +64,37 @@ class ZlibDecompressor {
       const flatbuffers::Vector<uint8>* uncompressed_buffer,
       const CompressedBuffer* compressed_buffer, std::string* out);
 
+  // Same as MaybeDecompressOptionallyCompressedBuffer, but returns a string
+  // that is shared with all other users of the same section in the process,
+  // see SharedStringCache. Returns nullptr if the section couldn't be
+  // decompressed. A compressed section is decompressed even if it is shared
+  // already, to keep the stream of the decompressor in sync.
+  std::shared_ptr<const std::string> MaybeDecompressShared(
+      const flatbuffers::String* uncompressed_buffer,
+      const CompressedBuffer* compressed_buffer);
+  std::shared_ptr<const std::string> MaybeDecompressShared(
+      const flatbuffers::Vector<uint8>* uncompressed_buffer,
+      const CompressedBuffer* compressed_buffer);
+
+  // Whether every buffer is a stream of its own, so that buffers can be
+  // skipped without decompressing them.
+  bool has_dictionary() const { return dictionary_ != nullptr; }
+
  private:
   ZlibDecompressor(const unsigned char* dictionary,
                    const unsigned int dictionary_size);
   z_stream stream_;
+  const unsigned char* const dictionary_;
+  const unsigned int dictionary_size_;
   bool initialized_;
 };
 
+// Compresses buffers for ZlibDecompressor. Without a dictionary, the buffers
+// form a single stream, see ZlibDecompressor. With a preset dictionary, every
+// buffer is compressed as a stream of its own.
 class ZlibCompressor {
  public:
+  // The dictionary is not copied, it must outlive the compressor.
   static std::unique_ptr<ZlibCompressor> Instance(
       const unsigned char* dictionary = nullptr,
       unsigned int dictionary_size = 0);
@@ -74,11 +113,19 @@ class ZlibCompressor {
                           // of patterns to be compressed.
                           const int tmp_buffer_size = 64 * 1024);
   z_stream stream_;
+  const unsigned char* const dictionary_;
+  const unsigned int dictionary_size_;
   std::unique_ptr<Bytef[]> buffer_;
   unsigned int buffer_size_;
   bool initialized_;
 };
 
+// Builds a preset dictionary for compressing the buffers with a
+// ZlibCompressor: the most recent data (up to the zlib window size) of the
+// given samples compressed as one stream.
+bool BuildZlibDictionary(const std::vector<std::string>& samples,
+                         std::vector<unsigned char>* dictionary);
+
 }  // namespace libtextclassifier3
 
 #endif  // LIBTEXTCLASSIFIER_UTILS_ZLIB_ZLIB_H_
@@ -29,8 +29,9 @@ std::unique_ptr<UniLib::RegexPattern> UncompressMakeRegexPattern(
     ZlibDecompressor* decompressor, std::string* result_pattern_text) {
   UnicodeText unicode_regex_pattern;
   std::string decompressed_pattern;
-  if (compressed_pattern != nullptr &&
-      compressed_pattern->buffer() != nullptr) {
+  const bool is_compressed = compressed_pattern != nullptr &&
+                             compressed_pattern->buffer() != nullptr;
+  if (is_compressed) {
     if (decompressor == nullptr ||
         !decompressor->MaybeDecompress(compressed_pattern,
                                        &decompressed_pattern)) {
@@ -55,7 +56,11 @@ std::unique_ptr<UniLib::RegexPattern> UncompressMakeRegexPattern(
   }
 
   std::unique_ptr<UniLib::RegexPattern> regex_pattern;
-  if (lazy_compile_regex) {
+  if (lazy_compile_regex && !is_compressed) {
+    // The pattern text points into the model buffer, which outlives the
+    // pattern, so there is no need to keep a copy until it gets compiled.
+    regex_pattern = unilib.CreateLazyRegexPatternNoCopy(unicode_regex_pattern);
+  } else if (lazy_compile_regex) {
     regex_pattern = unilib.CreateLazyRegexPattern(unicode_regex_pattern);
   } else {
     regex_pattern = unilib.CreateRegexPattern(unicode_regex_pattern);
@@ -26,6 +26,8 @@
 namespace libtextclassifier3 {
 
 // Create and compile a regex pattern from optionally compressed pattern.
+// Lazily compiled uncompressed patterns reference the pattern text without
+// copying it, so the buffer holding it needs to outlive the pattern.
 std::unique_ptr<UniLib::RegexPattern> UncompressMakeRegexPattern(
     const UniLib& unilib, const flatbuffers::String* uncompressed_pattern,
     const CompressedBuffer* compressed_pattern, bool lazy_compile_regex,